@@ -0,0 +1,382 @@
+#ifndef ASYNC_CLIENT_H
+#define ASYNC_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+#include "core/AsyncExecutor.h"
+#include "core/DownloadTask.h"
+#include "core/HttpClient.h"
+#include "core/WebsiteCrawler.h"
+
+namespace dm {
+namespace core {
+
+class DownloadManager;
+
+/**
+ * @brief How an asynchronous download ended
+ */
+struct AsyncDownloadResult {
+    std::string taskId;
+    std::string url;
+    std::string filePath;
+    DownloadStatus status = DownloadStatus::NONE;   // COMPLETED, DOWNLOAD_ERROR or CANCELED
+    int64_t fileSize = -1;
+    std::string error;
+
+    bool succeeded() const { return status == DownloadStatus::COMPLETED; }
+};
+
+/**
+ * @brief A resource found by an asynchronous crawl
+ */
+struct AsyncCrawlItem {
+    std::string url;
+    ResourceType type = ResourceType::OTHER;
+};
+
+/**
+ * @brief Results delivered one by one to a single consumer
+ *
+ * The producer pushes items and closes the stream; the consumer takes them
+ * with tryNext() and asks with whenReady() to be called back, on the
+ * executor, once there is more to take. Items are buffered until taken.
+ *
+ * @tparam T The item type
+ */
+template <typename T>
+class AsyncStream {
+public:
+    /**
+     * @brief Construct a new AsyncStream
+     *
+     * @param executor Runs the consumer callbacks
+     */
+    explicit AsyncStream(AsyncExecutor& executor) : executor_(executor) {}
+
+    /**
+     * @brief Add an item, unless the stream is closed
+     *
+     * @param item The item
+     */
+    void push(T item) {
+        std::function<void()> waiter;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_) {
+                return;
+            }
+            items_.push_back(std::move(item));
+            waiter.swap(waiter_);
+        }
+        if (waiter) {
+            executor_.post(std::move(waiter));
+        }
+    }
+
+    /**
+     * @brief End the stream, the items already pushed can still be taken
+     */
+    void close() {
+        std::function<void()> waiter;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            waiter.swap(waiter_);
+        }
+        if (waiter) {
+            executor_.post(std::move(waiter));
+        }
+    }
+
+    /**
+     * @brief Stop the producer and drop the items not taken yet
+     */
+    void cancel() {
+        std::function<void()> cancelHandler;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelHandler.swap(cancelHandler_);
+        }
+        if (cancelHandler) {
+            cancelHandler();
+        }
+
+        close();
+        std::lock_guard<std::mutex> lock(mutex_);
+        items_.clear();
+    }
+
+    /**
+     * @brief Take the next item
+     *
+     * @param item Receives the item
+     * @return true if one was buffered, false otherwise
+     */
+    bool tryNext(T& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        return true;
+    }
+
+    /**
+     * @brief Check if every item was taken from a closed stream
+     *
+     * @return true if the stream ended, false otherwise
+     */
+    bool isFinished() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_ && items_.empty();
+    }
+
+    /**
+     * @brief Be called back once an item can be taken or the stream ended
+     *
+     * Called right away (through the executor) if that is already so;
+     * replaces a callback set before that was not called yet.
+     *
+     * @param callback The callback
+     */
+    void whenReady(std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (items_.empty() && !closed_) {
+                waiter_ = std::move(callback);
+                return;
+            }
+        }
+        executor_.post(std::move(callback));
+    }
+
+    /**
+     * @brief Set what cancel() does to the producer
+     *
+     * @param handler The handler, called once on the thread that cancels
+     */
+    void setCancelHandler(std::function<void()> handler) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelHandler_ = std::move(handler);
+    }
+
+    /**
+     * @brief Get the executor running the consumer callbacks
+     *
+     * @return AsyncExecutor& The executor
+     */
+    AsyncExecutor& getExecutor() const {
+        return executor_;
+    }
+
+private:
+    // Prevent copying
+    AsyncStream(const AsyncStream&) = delete;
+    AsyncStream& operator=(const AsyncStream&) = delete;
+
+    // Member variables
+    AsyncExecutor& executor_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    std::function<void()> waiter_;
+    std::function<void()> cancelHandler_;
+    mutable std::mutex mutex_;
+};
+
+/**
+ * @brief Completion-based API for embedding the engine
+ *
+ * Every operation returns at once and calls its callback on the executor
+ * when it is done, so a service can keep thousands of logical downloads in
+ * flight on a handful of threads. Downloads are queued as task records of
+ * the DownloadManager and wait for their slot without a thread; probes are
+ * driven by the TransferEngine event loop. Batches and crawls deliver their
+ * results as streams. core/AsyncTask.h wraps the same operations as C++20
+ * awaitables.
+ *
+ * The client, its executor and the DownloadManager must outlive the
+ * operations started through it.
+ */
+class AsyncClient {
+public:
+    using HeadCallback = std::function<void(HttpResponse response)>;
+    using DownloadCallback = std::function<void(AsyncDownloadResult result)>;
+
+    /**
+     * @brief Construct a new AsyncClient
+     *
+     * @param downloadManager The initialized download manager
+     * @param executor Runs the callbacks
+     */
+    AsyncClient(DownloadManager& downloadManager, AsyncExecutor& executor);
+
+    /**
+     * @brief Destroy the AsyncClient, stopping its crawls
+     *
+     * Downloads still running go on, their callbacks are not called.
+     */
+    ~AsyncClient();
+
+    /**
+     * @brief Probe the size, range support and validators of a URL
+     *
+     * Like HttpClient::probe(): asks for the first byte and cuts a full
+     * response off after its headers. FTP URLs are probed on an executor
+     * thread.
+     *
+     * @param url The URL
+     * @param callback Receives the response, without a body
+     */
+    void head(const std::string& url, HeadCallback callback);
+
+    /**
+     * @brief Download a file
+     *
+     * cancel() ends it as CANCELED.
+     *
+     * @param url The URL
+     * @param destinationPath The directory, empty for the default
+     * @param filename The file name, empty to take it from the URL
+     * @param priority The priority in the queue
+     * @param callback Receives how the download ended
+     * @return std::string The task ID, empty if it could not be queued (the
+     *         callback is then called with the error)
+     */
+    std::string download(const std::string& url, const std::string& destinationPath,
+                         const std::string& filename, DownloadPriority priority,
+                         DownloadCallback callback);
+
+    /**
+     * @brief Cancel a download started through the client
+     *
+     * Its callback gets CANCELED, also while it is still queued as a record.
+     *
+     * @param taskId The task ID
+     * @return true if it was waiting to end, false otherwise
+     */
+    bool cancel(const std::string& taskId);
+
+    /**
+     * @brief Download files, delivering each result as it ends
+     *
+     * Cancelling the stream cancels the downloads not ended yet.
+     *
+     * @param urls The URLs
+     * @param destinationPath The directory, empty for the default
+     * @param priority The priority in the queue
+     * @return std::shared_ptr<AsyncStream<AsyncDownloadResult>> The results,
+     *         in the order the downloads end, closed after the last
+     */
+    std::shared_ptr<AsyncStream<AsyncDownloadResult>> downloadBatch(const std::vector<std::string>& urls,
+                                                                    const std::string& destinationPath = "",
+                                                                    DownloadPriority priority = DownloadPriority::NORMAL);
+
+    /**
+     * @brief Crawl a site, delivering the resources it finds
+     *
+     * Resources are not downloaded by the crawl; the consumer downloads
+     * those it wants. Cancelling the stream stops the crawl.
+     *
+     * @param startUrl The first page
+     * @param options The crawl options, their resource and finished
+     *        handlers are replaced
+     * @return std::shared_ptr<AsyncStream<AsyncCrawlItem>> The resources,
+     *         closed when the crawl ends (at once if it cannot start)
+     */
+    std::shared_ptr<AsyncStream<AsyncCrawlItem>> crawl(const std::string& startUrl, CrawlOptions options);
+
+    /**
+     * @brief Get the executor running the callbacks
+     *
+     * @return AsyncExecutor& The executor
+     */
+    AsyncExecutor& getExecutor() const;
+
+    /**
+     * @brief Get the number of downloads waiting to end
+     *
+     * @return size_t The number of downloads
+     */
+    size_t getPendingDownloadCount() const;
+
+private:
+    /**
+     * @brief A download waiting to end
+     */
+    struct Pending {
+        std::string url;
+        DownloadCallback callback;
+    };
+
+    /**
+     * @brief A crawl and its stream
+     */
+    struct Crawl {
+        std::unique_ptr<WebsiteCrawler> crawler;
+        std::shared_ptr<AsyncStream<AsyncCrawlItem>> stream;
+        std::shared_ptr<std::atomic<bool>> finished;    // Set on a crawler thread
+    };
+
+    // Prevent copying
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    /**
+     * @brief Queue a download without starting it
+     *
+     * @param url The URL
+     * @param destinationPath The directory
+     * @param filename The file name
+     * @param priority The priority
+     * @param callback Called once it ends
+     * @return std::string The task ID, empty on failure
+     */
+    std::string queue(const std::string& url, const std::string& destinationPath,
+                      const std::string& filename, DownloadPriority priority, DownloadCallback callback);
+
+    /**
+     * @brief Deliver the end of a download started through the client
+     *
+     * @param task The task
+     * @param status The status it ended in
+     */
+    void onStatusChanged(const std::shared_ptr<DownloadTask>& task, DownloadStatus status);
+
+    /**
+     * @brief Deliver the result of a download once
+     *
+     * @param result The result
+     * @return true if the download was waiting to end, false otherwise
+     */
+    bool finish(AsyncDownloadResult result);
+
+    /**
+     * @brief Destroy the crawls that finished, outside their threads
+     */
+    void reapCrawls();
+
+    // Member variables
+    DownloadManager& downloadManager_;
+    AsyncExecutor& executor_;
+    int listenerId_ = -1;
+    std::map<std::string, Pending> pending_;                // By task ID
+    std::list<std::shared_ptr<Crawl>> crawls_;
+    mutable std::mutex mutex_;
+    std::mutex crawlsMutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // ASYNC_CLIENT_H
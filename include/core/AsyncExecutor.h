@@ -0,0 +1,124 @@
+#ifndef ASYNC_EXECUTOR_H
+#define ASYNC_EXECUTOR_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Where the continuations of asynchronous operations run
+ *
+ * AsyncClient hands every completion to its executor instead of running it
+ * on the engine or queue thread that finished the work. An embedding
+ * service implements post() to run continuations on its own event loop or
+ * pool.
+ */
+class AsyncExecutor {
+public:
+    virtual ~AsyncExecutor() = default;
+
+    /**
+     * @brief Run work soon, on a thread of the executor
+     *
+     * Must not run the work before returning when called from a thread of
+     * the executor, and must be safe to call from any thread.
+     *
+     * @param work The work
+     */
+    virtual void post(std::function<void()> work) = 0;
+};
+
+/**
+ * @brief Executor running continuations on a few threads of its own
+ */
+class ThreadPoolExecutor : public AsyncExecutor {
+public:
+    /**
+     * @brief Construct a new ThreadPoolExecutor
+     *
+     * @param threadCount The number of threads (at least 1)
+     */
+    explicit ThreadPoolExecutor(size_t threadCount = 1);
+
+    /**
+     * @brief Destroy the ThreadPoolExecutor, running the work already posted
+     */
+    ~ThreadPoolExecutor() override;
+
+    void post(std::function<void()> work) override;
+
+    /**
+     * @brief Get the number of threads
+     *
+     * @return size_t The number of threads
+     */
+    size_t getThreadCount() const;
+
+private:
+    // Prevent copying
+    ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+    ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+    /**
+     * @brief Worker thread body
+     */
+    void workerLoop();
+
+    // Member variables
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+/**
+ * @brief Executor driven by the caller
+ *
+ * Work is queued until run() is called, so an embedding service can drive
+ * the continuations from a loop it already has, or a test from its own
+ * thread.
+ */
+class ManualExecutor : public AsyncExecutor {
+public:
+    ManualExecutor() = default;
+
+    void post(std::function<void()> work) override;
+
+    /**
+     * @brief Run the work posted so far, and the work it posts
+     *
+     * @return size_t The number of work items run
+     */
+    size_t run();
+
+    /**
+     * @brief Wait until work is posted, then run it
+     *
+     * @param timeoutMs The longest wait in milliseconds, -1 for no limit
+     * @return size_t The number of work items run
+     */
+    size_t waitAndRun(int timeoutMs = -1);
+
+private:
+    // Prevent copying
+    ManualExecutor(const ManualExecutor&) = delete;
+    ManualExecutor& operator=(const ManualExecutor&) = delete;
+
+    // Member variables
+    std::deque<std::function<void()>> queue_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // ASYNC_EXECUTOR_H
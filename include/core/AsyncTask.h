@@ -0,0 +1,375 @@
+#ifndef ASYNC_TASK_H
+#define ASYNC_TASK_H
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "core/AsyncTask.h needs C++20 coroutines, use core/AsyncClient.h from C++17"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+#include "core/AsyncClient.h"
+#include "utils/Logger.h"
+
+namespace dm {
+namespace core {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+/**
+ * @brief What every task promise does
+ *
+ * Tasks start suspended and, when they finish, resume the coroutine that
+ * awaited them in the same step (symmetric transfer), so a chain of
+ * awaits does not grow the stack.
+ */
+struct TaskPromiseBase {
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().continuation;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object() noexcept;
+
+    template <typename Value>
+    void return_value(Value&& value) {
+        result.emplace(std::forward<Value>(value));
+    }
+
+    T take() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*result);
+    }
+
+    std::optional<T> result;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept {}
+
+    void take() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+/**
+ * @brief Coroutine that runs a task to its end without being awaited
+ */
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept {}
+    };
+};
+
+inline Detached runDetached(Task<void> task);
+
+} // namespace detail
+
+/**
+ * @brief Lazily started coroutine returning a T
+ *
+ * A Task runs once it is awaited, then resumes its awaiter on the thread
+ * it finished on: the executor thread that delivered its last result.
+ * Exceptions it lets out are rethrown to the awaiter.
+ *
+ * @tparam T The result type
+ */
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() noexcept = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return !handle_ || handle_.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+
+    T await_resume() {
+        return handle_.promise().take();
+    }
+
+private:
+    // Prevent copying
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    // Member variables
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+inline Detached runDetached(Task<void> task) {
+    try {
+        co_await std::move(task);
+    } catch (const std::exception& e) {
+        dm::utils::Logger::error("Exception in spawned task: " + std::string(e.what()));
+    }
+}
+
+/**
+ * @brief Awaits an AsyncClient operation that completes through a callback
+ *
+ * @tparam Result The result type
+ * @tparam Start Starts the operation with the callback
+ */
+template <typename Result, typename Start>
+class CallbackAwaiter {
+public:
+    explicit CallbackAwaiter(Start start) : start_(std::move(start)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        // The callback may resume the coroutine before start_ returns,
+        // nothing of this awaiter is touched after it
+        start_([this, handle](Result result) {
+            result_.emplace(std::move(result));
+            handle.resume();
+        });
+    }
+
+    Result await_resume() {
+        return std::move(*result_);
+    }
+
+private:
+    // Member variables
+    Start start_;
+    std::optional<Result> result_;
+};
+
+template <typename Result, typename Start>
+CallbackAwaiter<Result, Start> makeCallbackAwaiter(Start start) {
+    return CallbackAwaiter<Result, Start>(std::move(start));
+}
+
+} // namespace detail
+
+/**
+ * @brief Run a task to its end on an executor without awaiting it
+ *
+ * An exception it lets out is logged.
+ *
+ * @param executor Where the task starts
+ * @param task The task
+ */
+inline void spawn(AsyncExecutor& executor, Task<void> task) {
+    auto holder = std::make_shared<Task<void>>(std::move(task));
+    executor.post([holder]() {
+        detail::runDetached(std::move(*holder));
+    });
+}
+
+/**
+ * @brief Block the calling thread until a task ends
+ *
+ * For the edges of a program, such as main(); never call it from a thread
+ * of the executor the task completes on.
+ *
+ * @param executor Where the task starts
+ * @param task The task
+ * @return T The result of the task
+ */
+template <typename T>
+T syncWait(AsyncExecutor& executor, Task<T> task) {
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;
+    std::optional<T> result;
+    std::exception_ptr exception;
+
+    auto run = [&]() -> Task<void> {
+        try {
+            result.emplace(co_await std::move(task));
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        done.notify_all();
+    };
+    spawn(executor, run());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return finished; });
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+    return std::move(*result);
+}
+
+/**
+ * @brief Block the calling thread until a task without a result ends
+ *
+ * @param executor Where the task starts
+ * @param task The task
+ */
+inline void syncWait(AsyncExecutor& executor, Task<void> task) {
+    auto wrapped = [](Task<void> inner) -> Task<bool> {
+        co_await std::move(inner);
+        co_return true;
+    };
+    syncWait(executor, wrapped(std::move(task)));
+}
+
+/**
+ * @brief Probe a URL
+ *
+ * @param client The client
+ * @param url The URL
+ * @return An awaitable giving the HttpResponse, without a body
+ */
+inline auto asyncHead(AsyncClient& client, std::string url) {
+    return detail::makeCallbackAwaiter<HttpResponse>(
+        [&client, url = std::move(url)](AsyncClient::HeadCallback callback) {
+            client.head(url, std::move(callback));
+        });
+}
+
+/**
+ * @brief Download a file
+ *
+ * @param client The client
+ * @param url The URL
+ * @param destinationPath The directory, empty for the default
+ * @param filename The file name, empty to take it from the URL
+ * @param priority The priority in the queue
+ * @return An awaitable giving the AsyncDownloadResult
+ */
+inline auto asyncDownload(AsyncClient& client, std::string url, std::string destinationPath = "",
+                          std::string filename = "", DownloadPriority priority = DownloadPriority::NORMAL) {
+    return detail::makeCallbackAwaiter<AsyncDownloadResult>(
+        [&client, url = std::move(url), destinationPath = std::move(destinationPath),
+         filename = std::move(filename), priority](AsyncClient::DownloadCallback callback) {
+            client.download(url, destinationPath, filename, priority, std::move(callback));
+        });
+}
+
+/**
+ * @brief Awaits the next item of a stream
+ *
+ * @tparam T The item type
+ */
+template <typename T>
+class NextAwaiter {
+public:
+    explicit NextAwaiter(std::shared_ptr<AsyncStream<T>> stream) : stream_(std::move(stream)) {}
+
+    bool await_ready() {
+        return take() || stream_->isFinished();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        stream_->whenReady([handle]() { handle.resume(); });
+    }
+
+    std::optional<T> await_resume() {
+        if (!item_) {
+            take();
+        }
+        return std::move(item_);
+    }
+
+private:
+    bool take() {
+        T item;
+        if (!stream_->tryNext(item)) {
+            return false;
+        }
+        item_.emplace(std::move(item));
+        return true;
+    }
+
+    // Member variables
+    std::shared_ptr<AsyncStream<T>> stream_;
+    std::optional<T> item_;
+};
+
+/**
+ * @brief Take the next item of a stream
+ *
+ * Streams have a single consumer; await one next() at a time.
+ *
+ * @param stream The stream
+ * @return NextAwaiter<T> An awaitable giving the item, or nullopt once the
+ *         stream ended
+ */
+template <typename T>
+NextAwaiter<T> next(const std::shared_ptr<AsyncStream<T>>& stream) {
+    return NextAwaiter<T>(stream);
+}
+
+} // namespace core
+} // namespace dm
+
+#endif // ASYNC_TASK_H
@@ -7,9 +7,20 @@
 #include <functional>
 #include <atomic>
 #include <mutex>
-#include <map>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <istream>
+#include <chrono>
+#include <cstddef>
 
 namespace dm {
+
+namespace utils {
+    class UrlFingerprintSet;
+}
+
 namespace core {
 
 // Forward declarations
@@ -41,6 +52,8 @@ using BatchProgressCallback = std::function<void(int processedCount, int totalCo
 
 /**
  * @brief Batch job completion callback function type
+ *
+ * failedUrls holds the first MAX_FAILED_URLS failures, failureCount all of them.
  */
 using BatchCompletionCallback = std::function<void(int successCount, int failureCount, 
                                                  const std::vector<std::string>& failedUrls)>;
@@ -54,24 +67,45 @@ using BatchErrorCallback = std::function<void(const std::string& error)>;
  * @brief Batch download configuration structure
  */
 struct BatchDownloadConfig {
-    std::string sourceUrl;               // URL or file path to get URLs from
-    BatchUrlSourceType sourceType;       // Type of URL source
-    int maxConcurrentFiles;              // Maximum concurrent files to download
-    std::string destinationDirectory;    // Directory to save files to
-    bool createSubdirectories;           // Create subdirectories based on URL structure
-    bool skipExistingFiles;              // Skip files that already exist
-    bool startImmediately;               // Start downloads immediately
-    int retryCount;                      // Number of retries for failed downloads
-    UrlFilterFunction filterFunction;    // Function to filter URLs
-    std::string urlColumnName;           // Column name for URLs in CSV files
-    std::string fileNameColumnName;      // Column name for filenames in CSV files
-    int urlColumnIndex;                  // Column index for URLs in CSV files (if no header)
+    std::string sourceUrl;                                  // URL or file path to get URLs from
+    BatchUrlSourceType sourceType = BatchUrlSourceType::URL_LIST;  // Type of URL source
+    std::vector<std::string> urls;                          // The URLs of a URL_LIST source
+    int maxConcurrentFiles = 4;                             // Maximum concurrent files to download
+    std::string destinationDirectory;                       // Directory to save files to
+    bool createSubdirectories = false;                      // Create subdirectories based on URL structure
+    bool skipExistingFiles = false;                         // Skip files that already exist
+    bool startImmediately = true;                           // Start downloads immediately
+    int retryCount = 0;                                     // Number of retries for failed downloads
+    UrlFilterFunction filterFunction = nullptr;             // Function to filter URLs
+    std::string urlColumnName;                              // Column name for URLs in CSV files
+    std::string fileNameColumnName;                         // Column name for filenames in CSV files
+    int urlColumnIndex = 0;                                 // Column index for URLs in CSV files (if no header)
+    bool streamSource = false;                              // Read a text or CSV source as the batch runs ("-" for stdin)
+    size_t maxUrlMemory = 0;                                // Bytes for seen URLs of a stream before spilling (0 for no limit)
+    std::string spillDirectory;                             // Where a stream keeps seen URLs past the limit (memory if empty)
 };
 
 /**
  * @brief Batch downloader class
  * 
- * Manages batch downloads from various sources
+ * Manages batch downloads from various sources. The job thread keeps up
+ * to maxConcurrentFiles downloads in flight and sleeps until one of them
+ * finishes; completions arrive as task status events from the download
+ * manager. Items are dispatched in order from a cursor, so each one is
+ * looked at a constant number of times however large the batch is.
+ * 
+ * Without startImmediately the job only adds the tasks to the manager.
+ * 
+ * A streamed source is read line by line as dispatch slots open, so only
+ * the items in flight and a short read-ahead are held. Seen URLs go to a
+ * fingerprint set that can spill to disk, and finished tasks are removed
+ * from the manager, keeping memory bounded however long the list is.
+ * 
+ * With a cluster directory set, each started item is leased from the
+ * ClusterCoordinator first, so nodes given the same list share it. An item
+ * another node holds is looked at again until that node finishes it or its
+ * lease runs out; one whose file that node splits across the cluster is
+ * joined right away, taking pieces of it.
  */
 class BatchDownloader {
 public:
@@ -188,6 +222,25 @@ public:
                                                      UrlFilterFunction filterFunction = nullptr);
     
 private:
+    /**
+     * @brief A URL of the batch
+     */
+    struct BatchItem {
+        std::string url;
+        std::string directory;      // Where the file goes
+        std::string filename;       // Unique within the batch
+        int attempts = 0;
+        std::string clusterKey;     // Job leased from the cluster, empty if none
+    };
+    
+    /**
+     * @brief A download of the batch that has finished
+     */
+    struct FinishedTask {
+        std::string taskId;
+        bool succeeded;
+    };
+    
     /**
      * @brief Process a batch job in a separate thread
      * 
@@ -196,15 +249,125 @@ private:
     void processBatchJob(const BatchDownloadConfig& config);
     
     /**
-     * @brief Download a single URL
+     * @brief Open the URLs of a job, scanning them up front unless streamed
      * 
-     * @param url The URL to download
-     * @param destinationPath The destination path
-     * @param config The batch download configuration
-     * @return true if successful, false otherwise
+     * @return true if URLs can be read, false otherwise
+     */
+    bool openUrlSource();
+    
+    /**
+     * @brief Close the URL source of the job
+     */
+    void closeUrlSource();
+    
+    /**
+     * @brief Top up the read-ahead and resolve its new hosts
+     * 
+     * Takes only the lines a streamed source has sent so far.
+     * 
+     * @return true if a URL is waiting, false if none is for now
+     */
+    bool fillLookahead();
+    
+    /**
+     * @brief Take the next URL of a streamed source the reader has
+     * 
+     * @param url Output parameter for the URL
+     * @return true if a URL was taken, false if no line is waiting
+     */
+    bool readStreamUrl(std::string& url);
+    
+    /**
+     * @brief Check if every URL of the source was read
+     * 
+     * @return true at the end of the scanned URLs or of the stream
+     */
+    bool isSourceExhausted() const;
+    
+    /**
+     * @brief Start reading the lines of a streamed source on a thread of its own
+     */
+    void startStreamReader();
+    
+    /**
+     * @brief Create the item for the next URL, picking its file name
+     * 
+     * @param url The URL
+     * @return size_t The item ID
+     */
+    size_t createItem(std::string url);
+    
+    /**
+     * @brief Hand one item to the download manager without waiting for it
+     * 
+     * @param index ID of the item
+     * @return true if a download is now in flight for it, false if it was settled right away
+     */
+    bool dispatchItem(size_t index);
+    
+    /**
+     * @brief Lease an item from the cluster before downloading it
+     * 
+     * @param index ID of the item
+     * @return true to download it, false if it was settled or deferred
+     */
+    bool leaseItem(size_t index);
+    
+    /**
+     * @brief Settle an item whose download has finished
+     * 
+     * @param index ID of the item
+     * @param taskId ID of the finished task
+     * @param succeeded Whether the download completed
+     */
+    void onItemFinished(size_t index, const std::string& taskId, bool succeeded);
+    
+    /**
+     * @brief Record the final result of an item and forget it
+     * 
+     * @param index ID of the item
+     * @param succeeded Whether the item succeeded
+     */
+    void settleItem(size_t index, bool succeeded);
+    
+    /**
+     * @brief Queue a finished task for the job thread if it is one of ours
+     * 
+     * @param taskId The task ID
+     * @param succeeded Whether the download completed
+     */
+    void postFinished(const std::string& taskId, bool succeeded);
+    
+    /**
+     * @brief Extract URLs from a document held in memory
+     * 
+     * @param content The document
+     * @param baseUrl URL relative links are resolved against, may be empty
+     * @param filterFunction Optional function to filter URLs
+     * @return std::vector<std::string> The list of URLs found
+     */
+    std::vector<std::string> extractUrlsFromHtml(const std::string& content, const std::string& baseUrl,
+                                                 UrlFilterFunction filterFunction);
+    
+    /**
+     * @brief Extract the <loc> URLs of a sitemap held in memory
+     * 
+     * @param content The sitemap
+     * @param filterFunction Optional function to filter URLs
+     * @return std::vector<std::string> The list of URLs found
+     */
+    std::vector<std::string> extractUrlsFromSitemap(const std::string& content,
+                                                    UrlFilterFunction filterFunction);
+    
+    /**
+     * @brief Extract one URL per line from text held in memory
+     * 
+     * @param content The text
+     * @param filterFunction Optional function to filter URLs
+     * @return std::vector<std::string> The list of URLs found
      */
-    bool downloadUrl(const std::string& url, const std::string& destinationPath,
-                    const BatchDownloadConfig& config);
+    std::vector<std::string> extractUrlsFromText(const std::string& content,
+                                                 UrlFilterFunction filterFunction);
     
     /**
      * @brief Extract filename from URL
@@ -219,7 +382,7 @@ private:
      * 
      * @param url The URL
      * @param config The batch download configuration
-     * @return std::string The destination path
+     * @return std::string The destination directory
      */
     std::string determineDestinationPath(const std::string& url,
                                         const BatchDownloadConfig& config);
@@ -235,12 +398,45 @@ private:
     void updateJobProgress(int processedCount, int totalCount,
                           int successCount, int failureCount);
     
+    /**
+     * @brief Lines of a streamed source, read on a thread of their own
+     * 
+     * A pipe blocks its reader until the writer sends more, the job keeps
+     * settling downloads meanwhile. The reader only touches this state: as
+     * a read can block past the end of the job, it is detached and stops
+     * at its next line once abandoned.
+     */
+    struct StreamReader {
+        std::shared_ptr<std::istream> file;     // Null for stdin, kept open for the reader
+        std::istream* stream = nullptr;
+        std::mutex mutex;
+        std::condition_variable spaceFreed;
+        std::deque<std::string> lines;          // At most MAX_STREAM_LINES
+        bool exhausted = false;
+        bool abandoned = false;
+        std::function<void()> onChange;         // Wakes the job, never called once abandoned
+    };
+    
+    /**
+     * @brief Reader thread body
+     * 
+     * @param reader The reader's state
+     */
+    static void runStreamReader(std::shared_ptr<StreamReader> reader);
+    
+    static constexpr size_t DNS_PREFETCH_BATCH = 64;    // Hosts resolved ahead of the cursor at once
+    static constexpr size_t MAX_STREAM_LINES = 4 * DNS_PREFETCH_BATCH;     // Read ahead of the job
+    static constexpr size_t MAX_FAILED_URLS = 1000;     // Listed to the completion callback, the rest only counted
+    static constexpr size_t MAX_PATH_COLLISIONS = 4096; // Numbered paths remembered, forgotten ones are probed again
+    static constexpr size_t SNIFF_SIZE = 4096;          // Body bytes an HTTP source's format is sniffed from
+    
     // Member variables
     DownloadManager& downloadManager_;
     std::atomic<bool> jobRunning_;
     std::atomic<bool> jobCancelled_;
+    std::thread jobThread_;
     
-    std::mutex progressMutex_;
+    mutable std::mutex progressMutex_;
     int processedCount_;
     int totalCount_;
     double overallProgress_;
@@ -252,8 +448,30 @@ private:
     BatchCompletionCallback completionCallback_;
     BatchErrorCallback errorCallback_;
     
-    std::mutex tasksMutex_;
-    std::map<std::string, std::shared_ptr<DownloadTask>> activeTasks_;
+    // Dispatch state, owned by the job thread
+    BatchDownloadConfig config_;
+    std::vector<std::string> scannedUrls_;                  // URLs of a source scanned up front
+    size_t nextUrl_ = 0;                                    // First scanned URL not read yet
+    std::shared_ptr<std::istream> sourceFile_;              // Streamed source unless it is stdin
+    std::istream* sourceStream_ = nullptr;                  // Streamed source, null when scanning
+    size_t csvColumn_ = 0;                                  // URL column of a streamed CSV
+    std::shared_ptr<StreamReader> streamReader_;            // Lines of the streamed source
+    std::deque<std::string> lookahead_;                     // URLs read but not dispatched yet
+    std::unique_ptr<dm::utils::UrlFingerprintSet> seenUrls_;    // URLs of a stream already read
+    std::unique_ptr<dm::utils::UrlFingerprintSet> usedPaths_;   // Destination paths already given out
+    std::unordered_map<std::string, int> pathCollisions_;   // Last number given to a path used more than once
+    std::unordered_map<size_t, BatchItem> items_;           // Items in flight or waiting to retry
+    size_t nextItemId_ = 0;
+    std::deque<size_t> retryItems_;                         // Failed items waiting for another attempt
+    std::deque<size_t> deferredItems_;                      // Items other nodes of the cluster hold
+    std::chrono::steady_clock::time_point deferredCheckAt_; // When they are asked for again
+    
+    // Downloads in flight and their completion events
+    std::mutex eventsMutex_;
+    std::condition_variable eventsChanged_;
+    std::unordered_map<std::string, size_t> activeItems_;  // Task ID to item index
+    std::deque<FinishedTask> finishedTasks_;
+    bool streamChanged_ = false;                            // The reader has lines or reached the end
 };
 
 } // namespace core
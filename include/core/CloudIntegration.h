@@ -9,6 +9,8 @@
 #include <mutex>
 #include <atomic>
 #include <chrono>
+#include <thread>
+#include <cstdint>
 
 namespace dm {
 namespace core {
@@ -96,6 +98,23 @@ struct SyncConfig {
     bool includeDownloadedFiles = false;            // Include downloaded files in sync
     bool syncOnMeteredConnection = false;           // Sync on metered connection
     std::chrono::seconds syncInterval{3600};        // Sync interval for automatic sync
+    int uploadParallelParts = 4;                    // Parts of one file uploaded at once
+    int64_t uploadChunkSize = 10 * 1024 * 1024;     // Upload part size, a multiple of 320 KiB
+};
+
+/**
+ * @brief Chunked upload session, kept so an interrupted upload resumes
+ */
+struct UploadSession {
+    std::string localPath;                          // Local file
+    std::string cloudPath;                          // Destination path
+    std::string sessionId;                          // Provider session ID or upload URL
+    std::string fileHash;                           // Hash of the file when the session started
+    int64_t fileSize = 0;                           // File size in bytes
+    int64_t chunkSize = 0;                          // Part size in bytes
+    std::vector<bool> completedParts;               // Parts the provider has acknowledged
+    std::vector<uint8_t> cipherHeader;              // StreamCipher header when encrypted
+    std::chrono::system_clock::time_point expiryTime; // When the provider drops the session
 };
 
 /**
@@ -490,6 +509,9 @@ private:
     /**
      * @brief Encrypt data
      * 
+     * For small payloads such as settings; files are encrypted frame by
+     * frame with dm::utils::StreamCipher as their parts are uploaded.
+     * 
      * @param data The data to encrypt
      * @return std::vector<uint8_t> The encrypted data
      */
@@ -506,11 +528,76 @@ private:
     /**
      * @brief Calculate file hash
      * 
+     * Goes through the hash manifest, so files unchanged since they were
+     * last hashed are not read again when deciding what to sync.
+     * 
      * @param filePath Path to the file
      * @return std::string The file hash
      */
     std::string calculateFileHash(const std::string& filePath) const;
     
+    /**
+     * @brief Upload a file in parts through an upload session
+     * 
+     * Parts already acknowledged in a saved session for the same file are
+     * skipped. Dropbox sessions take parts concurrently, up to
+     * uploadParallelParts at once; Google Drive and OneDrive sessions take
+     * them in order.
+     * 
+     * @param localPath The local file path
+     * @param cloudPath The cloud file path
+     * @param progressCallback Optional callback for upload progress
+     * @return true if uploaded, false otherwise
+     */
+    bool uploadChunked(const std::string& localPath, 
+                      const std::string& cloudPath,
+                      SyncProgressCallback progressCallback = nullptr);
+    
+    /**
+     * @brief Open an upload session with the provider
+     * 
+     * @param session The session, its ID is set on success
+     * @return true if successful, false otherwise
+     */
+    bool startUploadSession(UploadSession& session);
+    
+    /**
+     * @brief Upload one part of a session's file
+     * 
+     * Reads the part straight from the file rather than into memory.
+     * With encryption on, the part is a range of the StreamCipher stream
+     * of the file: the frames it covers are sealed as they are read, with
+     * the session's cipher header, so a resumed upload produces the same
+     * bytes for the parts it has left.
+     * 
+     * @param session The session
+     * @param part The part index
+     * @return true if the provider acknowledged it, false otherwise
+     */
+    bool uploadPart(UploadSession& session, size_t part);
+    
+    /**
+     * @brief Commit a session whose parts are all uploaded
+     * 
+     * @param session The session
+     * @return true if successful, false otherwise
+     */
+    bool finishUploadSession(UploadSession& session);
+    
+    /**
+     * @brief Save unfinished upload sessions
+     * 
+     * @return true if successful, false otherwise
+     */
+    bool saveUploadSessions();
+    
+    /**
+     * @brief Load unfinished upload sessions, dropping expired ones
+     * 
+     * @return true if successful, false otherwise
+     */
+    bool loadUploadSessions();
+    
     /**
      * @brief Get the time of last sync
      * 
@@ -555,6 +642,7 @@ private:
     SyncCompletionCallback syncCompletionCallback_ = nullptr;
     std::chrono::system_clock::time_point nextScheduledSync_;
     std::map<SyncDataType, std::chrono::system_clock::time_point> lastSyncTimes_;
+    std::map<std::string, UploadSession> uploadSessions_; // By local path
 };
 
 } // namespace core
@@ -0,0 +1,368 @@
+#ifndef CLUSTER_COORDINATOR_H
+#define CLUSTER_COORDINATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief What a node got when asking for a unit of work
+ */
+enum class ClusterLeaseState {
+    ACQUIRED,       // This node holds it now
+    HELD,           // Another node holds a lease that has not run out
+    DONE,           // Finished, by any node
+    FAILED          // Given up on by the node that held it
+};
+
+/**
+ * @brief Where a file split across nodes stands
+ */
+enum class ClusterFileState {
+    CREATE,         // This node creates the file, then calls markFileReady()
+    PREPARING,      // Another node is creating it
+    READY           // Created, other nodes may write their pieces
+};
+
+/**
+ * @brief One node of the cluster, as it last reported
+ */
+struct ClusterNodeStats {
+    std::string id;
+    int64_t updatedAt = 0;          // Milliseconds since the epoch
+    double throughput = 0.0;        // Bytes per second downloaded by the node
+    int leases = 0;                 // Units of work held
+    int64_t completed = 0;          // Units of work finished
+    bool stale = false;             // Missed its reports, its leases run out
+};
+
+/**
+ * @brief Shares work between download managers that see the same directory
+ *
+ * Nodes that mount one export (NFS or SMB) coordinate through a lease table
+ * kept there: a unit of work is a file named by its key under leases/,
+ * holding the node and when the lease runs out, and a finished one leaves a
+ * marker under done/. Every change to the table happens under an exclusive
+ * lock on one lock file of the directory, taken with fcntl (LockFileEx on
+ * Windows), which NFS forwards to the server, so no node can take work
+ * another one holds. A background thread renews the leases of the node
+ * every third of the lease time and writes its report under nodes/; the
+ * leases of a node that stops are taken over once they run out. Lease
+ * times are compared between nodes, whose clocks are expected to be synced.
+ *
+ * Batch jobs lease each item before downloading it. A file of at least
+ * the split size is downloaded by every node that is given it: the first
+ * one creates it at its full size, and each node then leases pieces of
+ * getPieceSize() bytes as its connections free up, so a faster node takes
+ * more of them and the aggregate bandwidth grows with the nodes. Pieces
+ * are written to disjoint ranges; one written twice after a lost lease
+ * holds the same bytes.
+ */
+class ClusterCoordinator {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return ClusterCoordinator& The singleton instance
+     */
+    static ClusterCoordinator& getInstance();
+
+    /**
+     * @brief Set the shared directory and start coordinating through it
+     *
+     * @param directory The directory, empty to work alone
+     * @return true if the directory is usable (or empty), false otherwise
+     */
+    bool setDirectory(const std::string& directory);
+
+    /**
+     * @brief Check if work is shared with other nodes
+     *
+     * @return true if a shared directory is set, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Set the name of this node, before setDirectory()
+     *
+     * @param id The name, empty for the host name and process ID
+     */
+    void setNodeId(const std::string& id);
+
+    /**
+     * @brief Get the name of this node
+     *
+     * @return std::string The name
+     */
+    std::string getNodeId() const;
+
+    /**
+     * @brief Set how long a lease lasts without being renewed
+     *
+     * @param seconds The lease time (at least MIN_LEASE_SECONDS)
+     */
+    void setLeaseSeconds(int seconds);
+
+    /**
+     * @brief Get how long a lease lasts without being renewed
+     *
+     * @return int The lease time in seconds
+     */
+    int getLeaseSeconds() const;
+
+    /**
+     * @brief Set the size from which a file is split across nodes
+     *
+     * @param bytes The size, 0 to never split
+     */
+    void setSplitSize(int64_t bytes);
+
+    /**
+     * @brief Get the size from which a file is split across nodes
+     *
+     * @return int64_t The size, 0 if files are never split
+     */
+    int64_t getSplitSize() const;
+
+    /**
+     * @brief Set the size of the pieces a split file is leased in
+     *
+     * @param bytes The size (at least MIN_PIECE_SIZE)
+     */
+    void setPieceSize(int64_t bytes);
+
+    /**
+     * @brief Get the size of the pieces a split file is leased in
+     *
+     * @return int64_t The size
+     */
+    int64_t getPieceSize() const;
+
+    /**
+     * @brief Make the key of a unit of work
+     *
+     * Destination paths must name the same file on every node, as with one
+     * mount point for the export.
+     *
+     * @param kind What the work is, such as "job" or "file"
+     * @param url The URL
+     * @param filePath The destination file
+     * @return std::string The key, usable as a file name
+     */
+    static std::string makeKey(const std::string& kind, const std::string& url, const std::string& filePath);
+
+    /**
+     * @brief Make the key of a piece of a split file
+     *
+     * @param fileKey The key of the file
+     * @param piece The index of the piece
+     * @return std::string The key
+     */
+    static std::string makePieceKey(const std::string& fileKey, int64_t piece);
+
+    /**
+     * @brief Lease a unit of work for this node
+     *
+     * @param key The key
+     * @return ClusterLeaseState ACQUIRED if this node holds it now
+     */
+    ClusterLeaseState acquire(const std::string& key);
+
+    /**
+     * @brief Give a unit of work back unfinished, for any node to take
+     *
+     * @param key The key
+     */
+    void release(const std::string& key);
+
+    /**
+     * @brief Mark a unit of work finished and give its lease back
+     *
+     * @param key The key
+     * @param succeeded False if it failed, other nodes then leave it be
+     * @return true if recorded, false if the table could not be locked
+     */
+    bool complete(const std::string& key, bool succeeded);
+
+    /**
+     * @brief Take part in downloading a file split across nodes
+     *
+     * A file finished more than FILE_READY_TIMEOUT_SECONDS ago is started
+     * over, one finished since is joined with every piece done.
+     *
+     * @param fileKey The key of the file
+     * @return ClusterFileState CREATE if this node creates the file
+     */
+    ClusterFileState joinFile(const std::string& fileKey);
+
+    /**
+     * @brief Check if a file is being split across nodes
+     *
+     * @param fileKey The key of the file
+     * @return true if it is created and other nodes may join
+     */
+    bool isFileShared(const std::string& fileKey);
+
+    /**
+     * @brief Let other nodes write their pieces of a file this node created
+     *
+     * @param fileKey The key of the file
+     */
+    void markFileReady(const std::string& fileKey);
+
+    /**
+     * @brief Mark a split file finished
+     *
+     * @param fileKey The key of the file
+     */
+    void finishFile(const std::string& fileKey);
+
+    /**
+     * @brief Get the nodes of the cluster
+     *
+     * @return std::vector<ClusterNodeStats> The nodes, by name
+     */
+    std::vector<ClusterNodeStats> getNodes() const;
+
+    /**
+     * @brief Run work on the table from the renewal thread
+     *
+     * For callers that must not wait on the shared directory, such as a
+     * download holding its lock. Jobs run in order; those queued when
+     * coordinating stops still run, and a job posted while it is stopped
+     * runs at once.
+     *
+     * @param job The work
+     */
+    void post(std::function<void()> job);
+
+    /**
+     * @brief Stop coordinating, giving back the leases of this node
+     */
+    void shutdown();
+
+    static constexpr int DEFAULT_LEASE_SECONDS = 60;
+    static constexpr int MIN_LEASE_SECONDS = 6;
+    static constexpr int64_t DEFAULT_SPLIT_SIZE = 1024LL * 1024 * 1024;
+    static constexpr int64_t DEFAULT_PIECE_SIZE = 64LL * 1024 * 1024;
+    static constexpr int64_t MIN_PIECE_SIZE = 1024 * 1024;
+    static constexpr int POLL_INTERVAL_MS = 2000;           // How often work held elsewhere is looked at again
+    static constexpr int FILE_READY_TIMEOUT_SECONDS = 60;   // Wait for another node to create a split file
+    static constexpr int TABLE_LOCK_TIMEOUT_MS = 5000;      // Wait for another node's table lock, then give up
+
+private:
+    /**
+     * @brief Construct a new ClusterCoordinator
+     */
+    ClusterCoordinator();
+
+    /**
+     * @brief Destroy the ClusterCoordinator
+     */
+    ~ClusterCoordinator();
+
+    // Prevent copying
+    ClusterCoordinator(const ClusterCoordinator&) = delete;
+    ClusterCoordinator& operator=(const ClusterCoordinator&) = delete;
+
+    /**
+     * @brief Exclusive lock on the table, held for its scope
+     *
+     * Tried again until TABLE_LOCK_TIMEOUT_MS passed, so a node that hangs
+     * on the shared directory cannot hold up the others indefinitely.
+     */
+    class TableLock {
+    public:
+        explicit TableLock(const std::string& path);
+        ~TableLock();
+        bool isLocked() const;
+
+    private:
+        TableLock(const TableLock&) = delete;
+        TableLock& operator=(const TableLock&) = delete;
+
+#ifdef _WIN32
+        void* handle_;
+#else
+        int fd_;
+#endif
+    };
+
+    /**
+     * @brief Look up a unit of work and lease it if it is free
+     *
+     * Called with mutex_ and the table lock held.
+     *
+     * @param key The key
+     * @return ClusterLeaseState The state
+     */
+    ClusterLeaseState lookup(const std::string& key);
+
+    /**
+     * @brief Write a lease of this node
+     *
+     * Called with mutex_ and the table lock held.
+     *
+     * @param key The key
+     * @return true if written, false otherwise
+     */
+    bool writeLease(const std::string& key);
+
+    /**
+     * @brief Get the path of an entry of the table
+     *
+     * @param table "leases", "done", "files" or "nodes"
+     * @param key The key
+     * @return std::string The path
+     */
+    std::string getPath(const char* table, const std::string& key) const;
+
+    /**
+     * @brief Renew the leases and write the report of this node
+     */
+    void renew();
+
+    /**
+     * @brief Renewal thread function
+     */
+    void renewalThread();
+
+    /**
+     * @brief Get the time now, as compared between nodes
+     *
+     * @return int64_t Milliseconds since the epoch
+     */
+    static int64_t now();
+
+    // Member variables
+    std::string directory_;
+    std::string nodeId_;
+    std::atomic<bool> enabled_;
+    std::atomic<int> leaseSeconds_;
+    std::atomic<int64_t> splitSize_;
+    std::atomic<int64_t> pieceSize_;
+    std::map<std::string, int64_t> held_;           // Leases of this node, by key, to when they run out
+    int64_t completed_ = 0;
+    mutable std::mutex mutex_;
+
+    std::unique_ptr<std::thread> renewalThread_;
+    bool stopRenewal_ = false;
+    std::condition_variable renewalCv_;
+    std::deque<std::function<void()>> jobs_;         // Posted, for the renewal thread
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // CLUSTER_COORDINATOR_H
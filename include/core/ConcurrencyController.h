@@ -0,0 +1,102 @@
+#ifndef CONCURRENCY_CONTROLLER_H
+#define CONCURRENCY_CONTROLLER_H
+
+#include <string>
+#include <chrono>
+
+#include "core/LinkStats.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Closed-loop controller for the overall connection budget
+ *
+ * Fed one LinkSample per control interval, it steps the number of
+ * connections the downloads may use together. Like BBR it keeps the
+ * largest recent throughput and the smallest recent round trip as the
+ * link's baseline, and starts by doubling the budget until a step stops
+ * paying off; like AIMD it then adds one connection at a time and cuts
+ * multiplicatively:
+ *
+ * - loss above LOSS_THRESHOLD_PERCENT, or a round trip inflated past
+ *   LATENCY_INFLATION times the baseline, multiplies the budget by
+ *   DECREASE_FACTOR;
+ * - otherwise, while the budget is in full use, it grows as long as the
+ *   last step raised throughput by GAIN_THRESHOLD; a step that gains
+ *   nothing is taken back, and the budget holds for PROBE_INTERVALS
+ *   before probing again.
+ *
+ * Every decision is logged with the figures behind it. Not thread-safe;
+ * the owner serializes calls.
+ */
+class ConcurrencyController {
+public:
+    /**
+     * @brief Construct a new ConcurrencyController
+     *
+     * @param minConnections Lowest budget
+     * @param maxConnections Highest budget
+     */
+    ConcurrencyController(int minConnections, int maxConnections);
+
+    /**
+     * @brief Feed one sample and step the budget
+     *
+     * @param sample The link quality over the last interval
+     * @return int The new budget
+     */
+    int update(const LinkSample& sample);
+
+    /**
+     * @brief Get the current budget
+     *
+     * @return int The number of connections
+     */
+    int getConnections() const;
+
+    /**
+     * @brief Change the bounds, clamping the budget into them
+     *
+     * @param minConnections Lowest budget
+     * @param maxConnections Highest budget
+     */
+    void setBounds(int minConnections, int maxConnections);
+
+    static constexpr int CONTROL_INTERVAL_MS = 2000;
+    static constexpr int INITIAL_CONNECTIONS = 8;
+    static constexpr double LOSS_THRESHOLD_PERCENT = 2.0;
+    static constexpr double LATENCY_INFLATION = 1.5;
+    static constexpr double DECREASE_FACTOR = 0.7;
+    static constexpr double GAIN_THRESHOLD = 0.05;
+    static constexpr int PROBE_INTERVALS = 15;
+    static constexpr int BASELINE_WINDOW_SECONDS = 30;
+
+private:
+    /**
+     * @brief Log a decision
+     *
+     * @param from The budget before
+     * @param reason Why it changed or held
+     * @param sample The sample behind it
+     */
+    void logDecision(int from, const std::string& reason, const LinkSample& sample) const;
+
+    // Member variables
+    int minConnections_;
+    int maxConnections_;
+    int connections_;
+    double minLatencyMs_ = 0.0;             // Smallest round trip in the baseline window
+    double maxThroughput_ = 0.0;            // Largest throughput in the baseline window
+    std::chrono::steady_clock::time_point baselineSince_;
+    double throughputBeforeStep_ = -1.0;    // Throughput before the last increase, -1 if none pending
+    int connectionsBeforeStep_ = 0;
+    bool startup_ = true;                   // Doubling until a step gains nothing
+    int heldIntervals_ = 0;                 // Intervals since the budget last grew
+    bool plateau_ = false;                  // The last increase gained nothing
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // CONCURRENCY_CONTROLLER_H
@@ -0,0 +1,133 @@
+#ifndef CONTENT_SNIFFER_H
+#define CONTENT_SNIFFER_H
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include "utils/MagicMatcher.h"
+
+namespace dm {
+namespace core {
+
+class OutputFile;
+
+/**
+ * @brief The first and last bytes of a downloaded file
+ */
+struct ContentSample {
+    std::string head;                       // Up to ContentSniffer::HEAD_SIZE bytes from the start
+    std::string tail;                       // Up to ContentSniffer::TAIL_SIZE bytes before the end
+    int64_t fileSize = -1;                  // -1 if no sample was taken
+    dm::utils::FileSignature signature;     // Type matched on the head
+};
+
+/**
+ * @brief Captures the first and last bytes of a download in the write path
+ *
+ * Attached to the output file of a download next to the StreamingHasher.
+ * Writes that touch the start of the file fill the head; writes that
+ * extend the highest offset written keep a rolling tail, so the last
+ * segment's data ends up there whatever order the segments finish in.
+ * Ranges the write path never saw (data from an earlier session of a
+ * resumed download) are read back once in finish().
+ *
+ * The finished sample is recorded per file path, like streamed hashes, so
+ * every post-processor that needs magic bytes, footers or a type shares it
+ * instead of reopening the file. Only the latest MAX_RECORDED_SAMPLES are
+ * kept; post-processing runs right after a download completes.
+ */
+class ContentSniffer {
+public:
+    /**
+     * @brief Construct a new ContentSniffer
+     */
+    ContentSniffer();
+
+    // Prevent copying
+    ContentSniffer(const ContentSniffer&) = delete;
+    ContentSniffer& operator=(const ContentSniffer&) = delete;
+
+    /**
+     * @brief Account for data written to the file
+     *
+     * Called by OutputFile after each successful write.
+     *
+     * @param data The data
+     * @param size The size of the data
+     * @param offset The file offset of the data
+     */
+    void onWrite(const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Drop what was captured of a range that is written again
+     *
+     * For a piece that failed verification; finish() reads what its new
+     * data does not cover back from disk.
+     *
+     * @param start The first byte of the range
+     * @param end The byte after the range
+     */
+    void discard(int64_t start, int64_t end);
+
+    /**
+     * @brief Complete the sample and match its type
+     *
+     * @param file The completed file, still open
+     * @param totalSize The file size (-1 if unknown: the highest offset written)
+     * @return true if the sample is complete, false if the file could not be read
+     */
+    bool finish(OutputFile& file, int64_t totalSize);
+
+    /**
+     * @brief Get the sample
+     *
+     * @return ContentSample The sample, fileSize -1 until finish() succeeded
+     */
+    ContentSample getSample() const;
+
+    /**
+     * @brief Remember the sample of a completed file
+     *
+     * @param filePath The file path
+     * @param sample The sample
+     */
+    static void recordSample(const std::string& filePath, const ContentSample& sample);
+
+    /**
+     * @brief Get the sample of a file
+     *
+     * Returns the recorded sample while the file is unchanged; otherwise
+     * reads the head and tail from disk once and records them.
+     *
+     * @param filePath The file path
+     * @param sample Receives the sample
+     * @return true if successful, false if the file could not be read
+     */
+    static bool findSample(const std::string& filePath, ContentSample& sample);
+
+    /**
+     * @brief Forget the sample of a file
+     *
+     * @param filePath The file path
+     */
+    static void forgetSample(const std::string& filePath);
+
+    static constexpr size_t HEAD_SIZE = 8192;     // Covers the tar header at 257 and container headers
+    static constexpr size_t TAIL_SIZE = 4096;     // Covers PDF, ZIP and image trailers
+    static constexpr size_t MAX_RECORDED_SAMPLES = 1024;    // Oldest samples are dropped beyond this
+
+private:
+    // Member variables
+    std::string head_;
+    size_t headEnd_ = 0;                    // head_ holds [0, headEnd_)
+    std::string tail_;
+    int64_t tailEnd_ = 0;                   // tail_ holds [tailEnd_ - tail_.size(), tailEnd_)
+    ContentSample sample_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // CONTENT_SNIFFER_H
@@ -0,0 +1,155 @@
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+#include <string>
+#include <mutex>
+
+#include "utils/HashCalculator.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Content-addressed store of downloaded files
+ *
+ * Keeps a copy of every completed download whose hash is known, named by
+ * the hash, so a later download of the same bytes under another URL or
+ * filename completes from the store without touching the network, and a
+ * download that turns out to have the same bytes as a stored one gives
+ * its disk space back. Objects and the copies placed from them are
+ * reflinks, which share disk space but not later edits; each object
+ * lists the paths it was copied to, and goes once none of them is left.
+ * On a filesystem without reflinks nothing is stored unless hard links
+ * are enabled: a hard linked copy is the object, an edit to it changes
+ * the object, which is then dropped when next looked up. The store must
+ * be on the same filesystem as the downloads to be filled.
+ */
+class ContentStore {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return ContentStore& The singleton instance
+     */
+    static ContentStore& getInstance();
+
+    /**
+     * @brief Set the store directory
+     *
+     * @param directory The directory, empty to disable the store
+     */
+    void setDirectory(const std::string& directory);
+
+    /**
+     * @brief Check whether the store is enabled
+     *
+     * @return true if a directory is set, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Allow hard links where the filesystem has no reflinks
+     *
+     * @param enabled True to store and place hard links, which share edits
+     */
+    void setHardLinks(bool enabled);
+
+    /**
+     * @brief Put a stored copy of some content at a path
+     *
+     * @param algorithm The algorithm of the hash
+     * @param hash The hash of the content
+     * @param filePath The path, which must not exist
+     * @return true if the content was stored and placed, false otherwise
+     */
+    bool place(dm::utils::HashAlgorithm algorithm, const std::string& hash, const std::string& filePath);
+
+    /**
+     * @brief Add a completed download to the store
+     *
+     * A file with the same content as a stored one is replaced by a copy
+     * of it instead.
+     *
+     * @param filePath The downloaded file
+     * @param algorithm The algorithm of the hash
+     * @param hash The hash of the file
+     */
+    void add(const std::string& filePath, dm::utils::HashAlgorithm algorithm, const std::string& hash);
+
+    /**
+     * @brief Remove the objects no download links to anymore
+     *
+     * @return size_t The number of objects removed
+     */
+    size_t prune();
+
+private:
+    /**
+     * @brief Construct a new ContentStore
+     */
+    ContentStore() = default;
+
+    /**
+     * @brief Destroy the ContentStore
+     */
+    ~ContentStore() = default;
+
+    /**
+     * @brief Get the path of an object
+     *
+     * @param algorithm The algorithm of the hash
+     * @param hash The hash
+     * @return std::string The path, empty if the store is disabled or the hash is malformed
+     */
+    std::string getObjectPath(dm::utils::HashAlgorithm algorithm, const std::string& hash) const;
+
+    /**
+     * @brief Check that an object exists and still has its content, dropping it otherwise
+     *
+     * @param objectPath The object path
+     * @param algorithm The algorithm of the hash
+     * @param hash The hash
+     * @return true if usable, false otherwise
+     */
+    static bool verify(const std::string& objectPath, dm::utils::HashAlgorithm algorithm, const std::string& hash);
+
+    /**
+     * @brief Copy a file as a reflink, or as a hard link if allowed
+     *
+     * @param sourcePath The file
+     * @param destPath The path, which must not exist
+     * @param hardLinks True to fall back to a hard link
+     * @return true if copied, false otherwise
+     */
+    static bool link(const std::string& sourcePath, const std::string& destPath, bool hardLinks);
+
+    /**
+     * @brief Remember a path an object was copied to, for prune()
+     *
+     * @param objectPath The object path
+     * @param filePath The path of the copy
+     */
+    static void addReference(const std::string& objectPath, const std::string& filePath);
+
+    /**
+     * @brief Check whether any copy of an object is left
+     *
+     * @param objectPath The object path
+     * @return true if a hard link or a listed path exists, false otherwise
+     */
+    static bool isReferenced(const std::string& objectPath);
+
+    // Prevent copying
+    ContentStore(const ContentStore&) = delete;
+    ContentStore& operator=(const ContentStore&) = delete;
+
+    // Member variables
+    std::string directory_;
+    bool hardLinks_ = false;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // CONTENT_STORE_H
@@ -0,0 +1,232 @@
+#ifndef CURL_HANDLE_POOL_H
+#define CURL_HANDLE_POOL_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <curl/curl.h>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Handle pool statistics structure
+ */
+struct CurlPoolStatistics {
+    uint64_t hits = 0;          // Acquisitions served from an idle handle
+    uint64_t misses = 0;        // Acquisitions that had to create a new handle
+    uint64_t releases = 0;      // Handles returned to the pool
+    uint64_t evictions = 0;     // Handles destroyed because the pool was full
+    size_t idleHandles = 0;     // Handles currently parked in the pool
+};
+
+/**
+ * @brief Shared pool of CURL easy handles
+ *
+ * Handles are keyed by scheme+host+port, and by the proxy they went out
+ * through, so a returned handle is handed out again for the same origin
+ * and route, keeping its connection alive. All handles are
+ * attached to one CURLSH that shares the DNS cache, TLS sessions and the
+ * connection cache between them. Handles for multiplexed transfers get a
+ * second CURLSH without the connection cache: an HTTP/2 connection must stay
+ * owned by the multi handle driving its streams. FTP handles get it too and
+ * keep their control connection, so the idle handles of an FTP server form a
+ * pool of sessions that are already logged in.
+ *
+ * With an OpenSSL-based libcurl, handles offer AES-GCM first on CPUs with
+ * AES instructions and ChaCha20-Poly1305 first elsewhere, where it is the
+ * faster one to run; every library default cipher stays offered after them.
+ */
+class CurlHandlePool {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return CurlHandlePool& The singleton instance
+     */
+    static CurlHandlePool& getInstance();
+
+    /**
+     * @brief Check out a handle for a URL
+     *
+     * The returned handle has default options and the shared cache attached.
+     *
+     * @param url The URL that will be requested
+     * @param shareConnections False to keep the handle out of the shared connection cache
+     * @param proxy The proxy the request goes through, empty for none
+     * @return CURL* The handle, or nullptr if CURL could not create one
+     */
+    CURL* acquire(const std::string& url, bool shareConnections = true, const std::string& proxy = "");
+
+    /**
+     * @brief Return a handle to the pool
+     *
+     * @param url The URL the handle was acquired for
+     * @param handle The handle to return
+     * @param proxy The proxy the handle was acquired for
+     */
+    void release(const std::string& url, CURL* handle, const std::string& proxy = "");
+
+    /**
+     * @brief Set the maximum number of idle handles kept per origin
+     *
+     * @param maxIdle The maximum number of idle handles
+     */
+    void setMaxIdlePerHost(size_t maxIdle);
+
+    /**
+     * @brief Get the maximum number of idle handles kept per origin
+     *
+     * @return size_t The maximum number of idle handles
+     */
+    size_t getMaxIdlePerHost() const;
+
+    /**
+     * @brief Get the pool statistics
+     *
+     * @return CurlPoolStatistics The current counters
+     */
+    CurlPoolStatistics getStatistics() const;
+
+    /**
+     * @brief Destroy all idle handles
+     */
+    void clear();
+
+    /**
+     * @brief Build the pool key for a URL
+     *
+     * @param url The URL
+     * @return std::string The key in "scheme://host:port" form, with the
+     *         user name for FTP ("ftp://user@host:port")
+     */
+    static std::string makeKey(const std::string& url);
+
+    /**
+     * @brief Build the pool key for a URL requested through a proxy
+     *
+     * @param url The URL
+     * @param proxy The proxy, empty for none
+     * @return std::string The key, "scheme://host:port via proxy" with a proxy
+     */
+    static std::string makeKey(const std::string& url, const std::string& proxy);
+
+    /**
+     * @brief Let a request go out as TLS 1.3 early data on a resumed session
+     *
+     * Early data can be replayed by an attacker, so only for requests that
+     * are safe to repeat: a GET without a body. libcurl retries in the
+     * handshake when the server declines it.
+     *
+     * @param handle The handle
+     */
+    static void enableEarlyData(CURL* handle);
+
+    /**
+     * @brief Describe the cipher order handles offer
+     *
+     * @return const char* "AES-GCM", "ChaCha20" or "library default"
+     */
+    static const char* getCipherPreference();
+
+private:
+    /**
+     * @brief Construct a new CurlHandlePool
+     */
+    CurlHandlePool();
+
+    /**
+     * @brief Destroy the CurlHandlePool
+     */
+    ~CurlHandlePool();
+
+    // Prevent copying
+    CurlHandlePool(const CurlHandlePool&) = delete;
+    CurlHandlePool& operator=(const CurlHandlePool&) = delete;
+
+    /**
+     * @brief Check if a pool key is for an FTP or FTPS server
+     *
+     * @param key The pool key
+     * @return true if FTP, false otherwise
+     */
+    static bool isFtpKey(const std::string& key);
+
+    /**
+     * @brief Create a share object
+     *
+     * @param shareConnections True to share the connection cache as well
+     * @return CURLSH* The share object, or nullptr on failure
+     */
+    CURLSH* createShare(bool shareConnections);
+
+    /**
+     * @brief Offer the ciphers fastest on this CPU first
+     *
+     * @param handle The handle
+     */
+    static void applyCipherPreference(CURL* handle);
+
+    // CURLSH lock callback functions
+    static void lockCallback(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void unlockCallback(CURL* handle, curl_lock_data data, void* userptr);
+
+    // Member variables
+    CURLSH* share_ = nullptr;
+    CURLSH* streamShare_ = nullptr;         // Same caches minus connections
+    std::mutex shareMutexes_[CURL_LOCK_DATA_LAST];
+
+    std::map<std::string, std::vector<CURL*>> idleHandles_;
+    mutable std::mutex mutex_;
+    size_t maxIdlePerHost_ = 16;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> releases_;
+    std::atomic<uint64_t> evictions_;
+};
+
+/**
+ * @brief Scoped lease of a pooled CURL handle
+ *
+ * Acquires a handle on construction and returns it to the pool on destruction.
+ */
+class PooledCurlHandle {
+public:
+    /**
+     * @brief Acquire a handle for a URL
+     *
+     * @param url The URL that will be requested
+     * @param proxy The proxy the request goes through, empty for none
+     */
+    explicit PooledCurlHandle(const std::string& url, const std::string& proxy = "");
+
+    /**
+     * @brief Return the handle to the pool
+     */
+    ~PooledCurlHandle();
+
+    // Prevent copying
+    PooledCurlHandle(const PooledCurlHandle&) = delete;
+    PooledCurlHandle& operator=(const PooledCurlHandle&) = delete;
+
+    /**
+     * @brief Get the leased handle
+     *
+     * @return CURL* The handle, or nullptr if acquisition failed
+     */
+    CURL* get() const { return handle_; }
+
+private:
+    std::string url_;
+    std::string proxy_;
+    CURL* handle_ = nullptr;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // CURL_HANDLE_POOL_H
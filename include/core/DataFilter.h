@@ -0,0 +1,400 @@
+#ifndef DATA_FILTER_H
+#define DATA_FILTER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace core {
+
+class OutputFile;
+
+/**
+ * @brief Read-only view of bytes, valid only during the call it is passed to
+ */
+struct ByteSpan {
+    const std::byte* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * @brief Order in which a filter needs the data of a download
+ */
+enum class DataFilterOrder {
+    ORDERED,        // Each byte once, in file order
+    UNORDERED       // Each byte once, in any order, possibly from several threads at once
+};
+
+/**
+ * @brief Thread a filter sees the data on
+ */
+enum class DataFilterThread {
+    IO_THREAD,      // On the thread that wrote it, straight from the write buffer
+    WORKER          // On a worker of its own, copied through a bounded queue
+};
+
+/**
+ * @brief Download a filter session is opened for
+ */
+struct DataFilterContext {
+    std::string url;
+    std::string filePath;
+    int64_t totalSize = -1;         // -1 if unknown
+};
+
+/**
+ * @brief Profile of one data filter across downloads
+ */
+struct DataFilterStats {
+    std::string id;
+    int64_t calls = 0;
+    int64_t bytes = 0;
+    int64_t wallNanoseconds = 0;
+    int64_t cpuNanoseconds = 0;         // CPU time of the calling threads
+    int64_t maxCallNanoseconds = 0;
+    int64_t slowCalls = 0;              // Over the call budget
+    int64_t offloadedSessions = 0;      // Moved off the I/O thread for being slow
+};
+
+/**
+ * @brief Running counters behind DataFilterStats
+ */
+struct DataFilterCounters {
+    std::atomic<int64_t> calls = 0;
+    std::atomic<int64_t> bytes = 0;
+    std::atomic<int64_t> wallNanoseconds = 0;
+    std::atomic<int64_t> cpuNanoseconds = 0;
+    std::atomic<int64_t> maxCallNanoseconds = 0;
+    std::atomic<int64_t> slowCalls = 0;
+    std::atomic<int64_t> offloadedSessions = 0;
+};
+
+/**
+ * @brief One filter's view of one download
+ */
+class DataFilterSession {
+public:
+    virtual ~DataFilterSession() = default;
+
+    /**
+     * @brief Process data written to the file
+     *
+     * @param offset The file offset of the data
+     * @param data The data, only valid during the call
+     */
+    virtual void onChunk(int64_t offset, ByteSpan data) = 0;
+
+    /**
+     * @brief End the session
+     *
+     * @param completed True if every byte of the file was passed, false if
+     *        the download was canceled or the filter failed
+     */
+    virtual void onFinish(bool completed) = 0;
+};
+
+/**
+ * @brief Filter fed the data of every download as it is written
+ *
+ * Lets a plugin decompress, scan or checksum a download while it arrives
+ * instead of reading the file again on completion. Data from an earlier
+ * session of a resumed download is read back from the file, so a session
+ * always sees the whole file. A filter that throws is dropped from the
+ * download; the download itself carries on.
+ */
+class DataFilter {
+public:
+    static constexpr size_t DEFAULT_QUEUE_LIMIT = 8 * 1024 * 1024;
+
+    virtual ~DataFilter() = default;
+
+    /**
+     * @brief Get the order the filter needs the data in
+     *
+     * An unordered filter is fed by the segments of a download without
+     * serializing them.
+     *
+     * @return DataFilterOrder The order
+     */
+    virtual DataFilterOrder getOrder() const = 0;
+
+    /**
+     * @brief Get the thread the filter runs on
+     *
+     * @return DataFilterThread The thread
+     */
+    virtual DataFilterThread getThread() const { return DataFilterThread::IO_THREAD; }
+
+    /**
+     * @brief Get how many bytes may wait for a worker before writers wait for it
+     *
+     * @return size_t The limit in bytes
+     */
+    virtual size_t getQueueLimit() const { return DEFAULT_QUEUE_LIMIT; }
+
+    /**
+     * @brief Open a session for a download
+     *
+     * @param context The download
+     * @return std::shared_ptr<DataFilterSession> The session, or nullptr to skip the download
+     */
+    virtual std::shared_ptr<DataFilterSession> open(const DataFilterContext& context) = 0;
+};
+
+/**
+ * @brief A session opened by a filter, with the filter's counters
+ */
+struct DataFilterBinding {
+    std::string id;
+    std::shared_ptr<DataFilter> filter;
+    std::shared_ptr<DataFilterSession> session;
+    std::shared_ptr<DataFilterCounters> counters;
+};
+
+/**
+ * @brief The filter sessions of one download
+ *
+ * Attached to the output file of a download next to the StreamingHasher.
+ * Ordered sessions are fed like the hasher: data at the delivered
+ * frontier straight from the write buffer, data landing ahead of it read
+ * back once the frontier reaches it. Every call is timed; a session on
+ * the I/O thread that goes over the call budget SLOW_CALLS_BEFORE_OFFLOAD
+ * times is moved to a worker, so a slow plugin holds up its own queue
+ * instead of the download.
+ */
+class DataFilterChain {
+public:
+    static constexpr int SLOW_CALLS_BEFORE_OFFLOAD = 3;
+
+    /**
+     * @brief Construct a new DataFilterChain, starting the workers of its sessions
+     *
+     * @param bindings The sessions
+     * @param callBudgetNanoseconds How long a call may take, 0 if unlimited
+     */
+    DataFilterChain(const std::vector<DataFilterBinding>& bindings, int64_t callBudgetNanoseconds);
+
+    /**
+     * @brief Destroy the DataFilterChain, abandoning the sessions if not finished
+     */
+    ~DataFilterChain();
+
+    // Prevent copying
+    DataFilterChain(const DataFilterChain&) = delete;
+    DataFilterChain& operator=(const DataFilterChain&) = delete;
+
+    /**
+     * @brief Account for data written to the file
+     *
+     * Called by OutputFile after each successful write. Ignored once the
+     * sessions ended.
+     *
+     * @param file The file the data was written to
+     * @param data The data
+     * @param size The size of the data
+     * @param offset The file offset of the data
+     */
+    void onWrite(OutputFile& file, const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Feed what the write path did not see, wait for the workers and end the sessions
+     *
+     * @param file The completed file, still open
+     * @param totalSize The file size (-1 if unknown: the highest offset written)
+     */
+    void finish(OutputFile& file, int64_t totalSize);
+
+    /**
+     * @brief Wait for the workers and end the sessions as not completed
+     */
+    void abandon();
+
+private:
+    /**
+     * @brief One session and its delivery state
+     */
+    struct Stage {
+        std::string id;
+        std::shared_ptr<DataFilterSession> session;
+        std::shared_ptr<DataFilterCounters> counters;
+        DataFilterOrder order = DataFilterOrder::ORDERED;
+        std::atomic<DataFilterThread> thread = DataFilterThread::IO_THREAD;
+        size_t queueLimit = DataFilter::DEFAULT_QUEUE_LIMIT;
+        int64_t callBudget = 0;                 // Nanoseconds, 0 if unlimited
+        std::atomic<int> slowCalls = 0;
+        std::atomic<bool> failed = false;
+
+        // Ordered delivery
+        std::mutex orderMutex;
+        int64_t frontier = 0;                   // Everything before this offset is delivered
+        std::map<int64_t, int64_t> ahead;       // Written ranges ahead of the frontier, start -> end
+        std::vector<char> readBuffer;
+
+        // Worker
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        std::deque<std::pair<int64_t, std::vector<char>>> queue;
+        size_t queuedBytes = 0;
+        bool closing = false;
+        std::thread worker;
+    };
+
+    /**
+     * @brief Pass data to a session, on this thread or its worker
+     *
+     * @param stage The stage
+     * @param offset The file offset of the data
+     * @param data The data
+     * @param size The size of the data
+     */
+    static void deliver(Stage& stage, int64_t offset, const char* data, size_t size);
+
+    /**
+     * @brief Call a session and time it, dropping it if it throws
+     *
+     * @param stage The stage
+     * @param offset The file offset of the data
+     * @param data The data
+     * @param size The size of the data
+     */
+    static void call(Stage& stage, int64_t offset, const char* data, size_t size);
+
+    /**
+     * @brief Move a session off the I/O thread to a worker of its own
+     *
+     * @param stage The stage
+     */
+    static void offload(Stage& stage);
+
+    /**
+     * @brief Deliver a range already on disk to a session
+     *
+     * @param stage The stage
+     * @param file The file to read from
+     * @param start The start of the range
+     * @param end The end of the range (exclusive)
+     * @return true if successful, false if the file could not be read
+     */
+    static bool readBack(Stage& stage, OutputFile& file, int64_t start, int64_t end);
+
+    /**
+     * @brief Run the worker of a stage until it is closed and drained
+     *
+     * @param stage The stage
+     */
+    static void runWorker(Stage& stage);
+
+    /**
+     * @brief Wait for the workers and end the sessions
+     *
+     * @param completed True if every session was passed the whole file
+     */
+    void close(bool completed);
+
+    static constexpr size_t READ_BACK_CHUNK_SIZE = 1024 * 1024;
+
+    // Member variables
+    std::vector<std::unique_ptr<Stage>> stages_;
+    bool hasUnordered_ = false;
+    std::map<int64_t, int64_t> written_;        // Ranges written this session, for unordered stages
+    std::atomic<int64_t> highestWritten_ = 0;
+    std::mutex writtenMutex_;
+    std::shared_mutex closeMutex_;             // Shared by writes being delivered
+    bool closed_ = false;
+};
+
+/**
+ * @brief The data filters every download is fed to
+ */
+class DataFilterRegistry {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return DataFilterRegistry& The singleton instance
+     */
+    static DataFilterRegistry& getInstance();
+
+    /**
+     * @brief Add a filter for downloads started from now on
+     *
+     * @param id The filter ID (e.g. the plugin ID), replacing a filter with the same ID
+     * @param filter The filter
+     */
+    void addFilter(const std::string& id, std::shared_ptr<DataFilter> filter);
+
+    /**
+     * @brief Remove a filter from downloads started from now on
+     *
+     * @param id The filter ID
+     * @return true if removed, false if not found
+     */
+    bool removeFilter(const std::string& id);
+
+    /**
+     * @brief Set how long a filter may take per call
+     *
+     * Applies to downloads started from now on.
+     *
+     * @param milliseconds The budget in milliseconds, 0 for unlimited
+     */
+    void setCallBudget(int milliseconds);
+
+    /**
+     * @brief Get the profile of every filter
+     *
+     * @return std::vector<DataFilterStats> The profiles, by filter ID
+     */
+    std::vector<DataFilterStats> getStats();
+
+    /**
+     * @brief Open the sessions of a download
+     *
+     * @param context The download
+     * @return std::shared_ptr<DataFilterChain> The sessions, or nullptr if no filter wants the download
+     */
+    std::shared_ptr<DataFilterChain> openChain(const DataFilterContext& context);
+
+private:
+    /**
+     * @brief Construct a new DataFilterRegistry
+     */
+    DataFilterRegistry() = default;
+
+    /**
+     * @brief Destroy the DataFilterRegistry
+     */
+    ~DataFilterRegistry() = default;
+
+    // Prevent copying
+    DataFilterRegistry(const DataFilterRegistry&) = delete;
+    DataFilterRegistry& operator=(const DataFilterRegistry&) = delete;
+
+    /**
+     * @brief A registered filter and its counters
+     */
+    struct Entry {
+        std::shared_ptr<DataFilter> filter;
+        std::shared_ptr<DataFilterCounters> counters;
+    };
+
+    // Member variables
+    std::map<std::string, Entry> filters_;
+    int64_t callBudget_ = 0;                    // Nanoseconds
+    std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // DATA_FILTER_H
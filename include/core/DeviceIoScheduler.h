@@ -0,0 +1,347 @@
+#ifndef DEVICE_IO_SCHEDULER_H
+#define DEVICE_IO_SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include "utils/DiskIo.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Storage kind enumeration
+ */
+enum class StorageKind {
+    UNKNOWN,        // Virtual or undetected (tmpfs, overlay, other platforms)
+    SSD,            // Non-rotational block device
+    HDD,            // Rotational block device
+    NETWORK         // NFS, SMB and other network file systems
+};
+
+/**
+ * @brief The device a destination sits on
+ */
+struct StorageDeviceInfo {
+    uint64_t id = 0;                // st_dev of the file system
+    std::string name;               // Block device (e.g. "sda") or mount source
+    std::string mountPoint;
+    std::string fileSystem;
+    StorageKind kind = StorageKind::UNKNOWN;
+};
+
+/**
+ * @brief Write activity of one device
+ */
+struct StorageDeviceStats {
+    StorageDeviceInfo info;
+    int maxWriters = 0;
+    int activeWriters = 0;
+    size_t queuedRequests = 0;
+    int64_t queuedBytes = 0;
+    int64_t writes = 0;
+    int64_t bytesWritten = 0;
+    double throughput = 0.0;        // Bytes/second while busy, recent
+    double queueWaitMs = 0.0;       // Time a write waits for a writer, recent
+    bool saturated = false;
+};
+
+/**
+ * @brief Write queue of one storage device
+ *
+ * Writes of every output file on the device are queued here and performed
+ * by at most getMaxWriters() threads, so fifty segments landing on one
+ * disk make two writers' worth of requests instead of fifty competing
+ * seeks. Writers queue a block and keep receiving while it waits, like
+ * with an asynchronous disk I/O backend. A rotational disk takes its queue
+ * in elevator order instead of arrival order: on from the file and offset
+ * the head last wrote, so the blocks of a file go out one after the other.
+ * Writers hand each block on to the disk I/O backend, keeping its
+ * registered buffer and linked data sync; with io_uring that still costs
+ * a thread hop per block and the batching of deferred submission.
+ */
+class StorageDevice {
+public:
+    /**
+     * @brief Construct a new StorageDevice
+     *
+     * @param info The device
+     * @param maxWriters Writes performed at once
+     */
+    StorageDevice(const StorageDeviceInfo& info, int maxWriters);
+
+    /**
+     * @brief Destroy the StorageDevice, finishing queued writes
+     */
+    ~StorageDevice();
+
+    // Prevent copying
+    StorageDevice(const StorageDevice&) = delete;
+    StorageDevice& operator=(const StorageDevice&) = delete;
+
+    /**
+     * @brief Get the device
+     *
+     * @return const StorageDeviceInfo& The device
+     */
+    const StorageDeviceInfo& getInfo() const { return info_; }
+
+    /**
+     * @brief Set how many writes are performed at once
+     *
+     * @param maxWriters The number of writers, at least 1
+     */
+    void setMaxWriters(int maxWriters);
+
+    /**
+     * @brief Get how many writes are performed at once
+     *
+     * @return int The number of writers
+     */
+    int getMaxWriters() const;
+
+    /**
+     * @brief Queue a write
+     *
+     * The request and its buffer stay untouched until wait() returns for it.
+     *
+     * @param request The request, a WRITE with its descriptor set
+     */
+    void queue(dm::utils::DiskRequest& request);
+
+    /**
+     * @brief Wait for a queued write
+     *
+     * @param request The request
+     * @return true if it succeeded, false otherwise (see request.error)
+     */
+    bool wait(dm::utils::DiskRequest& request);
+
+    /**
+     * @brief Write all data at an offset and wait for it
+     *
+     * @param fd The file descriptor
+     * @param data The data
+     * @param size The size of the data
+     * @param offset The file offset
+     * @return true if written, false otherwise (errno is set)
+     */
+    bool write(int fd, const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Check if writes queue up faster than the device takes them
+     *
+     * @return true if a write waits longer than SATURATED_WAIT_MS for a writer
+     */
+    bool isSaturated() const;
+
+    /**
+     * @brief Get the write activity of the device
+     *
+     * @return StorageDeviceStats The activity
+     */
+    StorageDeviceStats getStats() const;
+
+    static constexpr double SATURATED_WAIT_MS = 250.0;
+
+private:
+    /**
+     * @brief A queued write
+     */
+    struct Entry {
+        dm::utils::DiskRequest* request = nullptr;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    using QueueKey = std::pair<int64_t, int64_t>;   // (fd, offset) in elevator order, (0, arrival) otherwise
+
+    /**
+     * @brief Writer thread body
+     *
+     * @param index The writer's index, writers beyond getMaxWriters() stay idle
+     */
+    void runWriter(int index);
+
+    /**
+     * @brief Take the next write off the queue
+     *
+     * @return Entry The write, with a null request if the queue is empty
+     */
+    Entry takeNext();
+
+    /**
+     * @brief Start writer threads up to the limit
+     */
+    void startWriters();
+
+    /**
+     * @brief Account for a performed write
+     *
+     * @param size The bytes written
+     * @param waitMs How long it waited for a writer
+     * @param busyNs How long the write took
+     */
+    void recordWrite(size_t size, double waitMs, int64_t busyNs);
+
+    static constexpr double EWMA_WEIGHT = 0.2;
+
+    // Member variables
+    StorageDeviceInfo info_;
+    bool elevator_ = false;
+    std::multimap<QueueKey, Entry> queue_;
+    int64_t arrivals_ = 0;
+    QueueKey head_ = {0, 0};                // Where the last elevator write ended
+    int maxWriters_ = 1;
+    int activeWriters_ = 0;
+    int64_t queuedBytes_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> writers_;
+    mutable std::mutex mutex_;
+    std::condition_variable queueChanged_;
+    std::condition_variable completed_;
+
+    // Metrics
+    int64_t writes_ = 0;
+    int64_t bytesWritten_ = 0;
+    double throughput_ = 0.0;
+    double queueWaitMs_ = 0.0;
+};
+
+/**
+ * @brief Per-device scheduling of download writes
+ *
+ * Finds the device a destination sits on from its st_dev, the mount table
+ * and, on Linux, whether the block device is rotational, and hands output
+ * files the write queue of their device. Each kind of device gets its own
+ * number of writers: a spinning disk is written by one at a time, an SSD
+ * by several, a network mount by a few. The download queue holds back
+ * downloads to a device that is saturated while others take its place.
+ */
+class DeviceIoScheduler {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return DeviceIoScheduler& The singleton instance
+     */
+    static DeviceIoScheduler& getInstance();
+
+    /**
+     * @brief Enable or disable device queues for files opened from now on
+     *
+     * @param enabled True to queue writes per device
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Check if device queues are handed out
+     *
+     * @return true if enabled, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Set the writers of a kind of device
+     *
+     * @param kind The kind
+     * @param maxWriters Writes performed at once, at least 1
+     */
+    void setMaxWriters(StorageKind kind, int maxWriters);
+
+    /**
+     * @brief Get the writers of a kind of device
+     *
+     * @param kind The kind
+     * @return int Writes performed at once
+     */
+    int getMaxWriters(StorageKind kind) const;
+
+    /**
+     * @brief Get the write queue of the device a path sits on
+     *
+     * @param path A file or directory, which need not exist yet
+     * @return std::shared_ptr<StorageDevice> The queue, nullptr if disabled or unsupported
+     */
+    std::shared_ptr<StorageDevice> getDevice(const std::string& path);
+
+    /**
+     * @brief Check if the device of a destination can take another download
+     *
+     * @param path A file or directory, which need not exist yet
+     * @return true unless its device is saturated
+     */
+    bool hasCapacity(const std::string& path);
+
+    /**
+     * @brief Find the device a path sits on
+     *
+     * @param path A file or directory, which need not exist yet
+     * @param info Receives the device
+     * @return true if found, false otherwise
+     */
+    static bool detectDevice(const std::string& path, StorageDeviceInfo& info);
+
+    /**
+     * @brief Get the write activity of every device written to
+     *
+     * @return std::vector<StorageDeviceStats> The activity, by device
+     */
+    std::vector<StorageDeviceStats> getStats() const;
+
+    /**
+     * @brief Get the st_dev of a path or its nearest existing parent
+     *
+     * @param path The path
+     * @param id Receives the st_dev
+     * @param existing Receives the path found
+     * @return true if found, false otherwise
+     */
+    static bool getDeviceId(const std::string& path, uint64_t& id, std::string& existing);
+
+    /**
+     * @brief Get the name of a storage kind
+     *
+     * @param kind The kind
+     * @return const char* The name
+     */
+    static const char* getKindName(StorageKind kind);
+
+    static constexpr int DEFAULT_SSD_WRITERS = 8;
+    static constexpr int DEFAULT_HDD_WRITERS = 1;
+    static constexpr int DEFAULT_NETWORK_WRITERS = 4;
+    static constexpr int DEFAULT_UNKNOWN_WRITERS = 8;
+
+private:
+    /**
+     * @brief Construct a new DeviceIoScheduler
+     */
+    DeviceIoScheduler();
+
+    /**
+     * @brief Destroy the DeviceIoScheduler
+     */
+    ~DeviceIoScheduler() = default;
+
+    // Prevent copying
+    DeviceIoScheduler(const DeviceIoScheduler&) = delete;
+    DeviceIoScheduler& operator=(const DeviceIoScheduler&) = delete;
+
+    // Member variables
+    std::atomic<bool> enabled_;
+    std::map<StorageKind, int> maxWriters_;
+    std::map<uint64_t, std::shared_ptr<StorageDevice>> devices_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // DEVICE_IO_SCHEDULER_H
@@ -0,0 +1,191 @@
+#ifndef DISK_SPACE_LEDGER_H
+#define DISK_SPACE_LEDGER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Free and reserved space of one file system
+ */
+struct DiskSpaceStats {
+    uint64_t id = 0;                // st_dev of the file system
+    std::string path;               // A destination on it
+    int64_t freeBytes = -1;         // Free for unprivileged users, -1 if unknown
+    int64_t reservedBytes = 0;      // Still to be allocated by downloads holding a reservation
+    int reservations = 0;
+    int64_t refusals = 0;           // Reservations that did not fit
+};
+
+/**
+ * @brief Process-wide ledger of the disk space downloads are about to use
+ *
+ * Free space is a point value: thirty queued downloads of several gigabytes
+ * each all find it sufficient when they start and run the volume out
+ * together. A download reserves its size here, per file system, before it
+ * is dispatched and releases it once it completes, fails or is canceled; a
+ * reservation that does not fit in the free space left by the others is
+ * refused and the download waits in the queue.
+ *
+ * A reservation only counts what its file has not allocated yet, so a
+ * preallocated file holds nothing here and a sparse one holds less as it
+ * fills. The free space of a file system and the allocation of the files
+ * on it are refreshed at most once per REFRESH_INTERVAL_MS, not on every
+ * check.
+ */
+class DiskSpaceLedger {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return DiskSpaceLedger& The singleton instance
+     */
+    static DiskSpaceLedger& getInstance();
+
+    /**
+     * @brief Reserve the space of a download's file
+     *
+     * Reserving again for the same owner replaces its earlier reservation.
+     * A file of unknown size (0) reserves nothing and always fits.
+     *
+     * @param owner The download
+     * @param filePath The file, which need not exist yet
+     * @param size The full size of the file
+     * @return true if reserved, false if it does not fit
+     */
+    bool reserve(const std::string& owner, const std::string& filePath, int64_t size);
+
+    /**
+     * @brief Release a download's reservation
+     *
+     * @param owner The download (one without a reservation is ignored)
+     */
+    void release(const std::string& owner);
+
+    /**
+     * @brief Get the space of a file system not spoken for by reservations
+     *
+     * @param path A file or directory on it, which need not exist yet
+     * @return int64_t Free bytes less reserved bytes, -1 if unknown
+     */
+    int64_t getAvailableSpace(const std::string& path);
+
+    /**
+     * @brief Enable or disable reservations
+     *
+     * While disabled every reservation fits; the ones held are kept.
+     *
+     * @param enabled True to account for reservations
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Check if reservations are accounted for
+     *
+     * @return true if enabled, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Set the space kept free beyond all reservations
+     *
+     * @param bytes The margin in bytes
+     */
+    void setMargin(int64_t bytes);
+
+    /**
+     * @brief Get the space kept free beyond all reservations
+     *
+     * @return int64_t The margin in bytes
+     */
+    int64_t getMargin() const;
+
+    /**
+     * @brief Get the space of every file system with a reservation so far
+     *
+     * @return std::vector<DiskSpaceStats> The space, by file system
+     */
+    std::vector<DiskSpaceStats> getStats();
+
+    static constexpr int REFRESH_INTERVAL_MS = 1000;
+    static constexpr int64_t DEFAULT_MARGIN = 64 * 1024 * 1024;
+
+private:
+    /**
+     * @brief One download's reservation
+     */
+    struct Reservation {
+        uint64_t volume = 0;
+        std::string path;
+        int64_t size = 0;
+        int64_t outstanding = 0;    // Size less what the file has allocated, as of the last refresh
+    };
+
+    /**
+     * @brief Space of one file system
+     */
+    struct Volume {
+        std::string path;
+        int64_t freeBytes = -1;
+        int64_t reservedBytes = 0;
+        int reservations = 0;
+        int64_t refusals = 0;
+        std::chrono::steady_clock::time_point refreshedAt;
+        bool refreshed = false;
+    };
+
+    /**
+     * @brief Construct a new DiskSpaceLedger
+     */
+    DiskSpaceLedger();
+
+    /**
+     * @brief Destroy the DiskSpaceLedger
+     */
+    ~DiskSpaceLedger() = default;
+
+    // Prevent copying
+    DiskSpaceLedger(const DiskSpaceLedger&) = delete;
+    DiskSpaceLedger& operator=(const DiskSpaceLedger&) = delete;
+
+    /**
+     * @brief Refresh the free space and reservations of a file system if due
+     *
+     * Called with mutex_ held.
+     *
+     * @param id The st_dev of the file system
+     * @param path An existing path on it
+     * @return Volume& The file system
+     */
+    Volume& refresh(uint64_t id, const std::string& path);
+
+    /**
+     * @brief Get the bytes a file has allocated on disk
+     *
+     * @param path The file
+     * @return int64_t The bytes, 0 if it does not exist
+     */
+    static int64_t getAllocatedSize(const std::string& path);
+
+    // Member variables
+    std::atomic<bool> enabled_;
+    std::atomic<int64_t> margin_;
+    std::map<uint64_t, Volume> volumes_;
+    std::unordered_map<std::string, Reservation> reservations_;
+    std::unordered_set<std::string> refused_;          // Owners refused since their last reservation
+    std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // DISK_SPACE_LEDGER_H
@@ -0,0 +1,187 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <curl/curl.h>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Process-wide host resolution cache
+ *
+ * Hosts are resolved ahead of their transfers on a few background threads
+ * and kept for a TTL. apply() hands fresh results to a CURL handle through
+ * CURLOPT_RESOLVE, so the request connects without waiting on the system
+ * resolver. Addresses are ordered with the families interleaved (RFC 8305)
+ * and libcurl races IPv6 and IPv4 connects between them. A host that is not
+ * cached yet is resolved by libcurl itself, into the cache it shares
+ * between pooled handles.
+ */
+class DnsCache {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return DnsCache& The singleton instance
+     */
+    static DnsCache& getInstance();
+
+    /**
+     * @brief Resolve the hosts of URLs in the background
+     *
+     * Hosts that are cached or already being resolved are skipped.
+     *
+     * @param urls The URLs
+     */
+    void prefetch(const std::vector<std::string>& urls);
+
+    /**
+     * @brief Resolve the host of a URL in the background
+     *
+     * @param url The URL
+     */
+    void prefetch(const std::string& url);
+
+    /**
+     * @brief Attach cached addresses and resolver options to a handle
+     *
+     * @param handle The CURL handle
+     * @param url The URL the handle will request
+     * @return struct curl_slist* The list set as CURLOPT_RESOLVE, to be freed
+     *         by the caller once the transfer is done (nullptr if none)
+     */
+    struct curl_slist* apply(CURL* handle, const std::string& url);
+
+    /**
+     * @brief Get the address the host of a URL connects to
+     *
+     * @param url The URL
+     * @return std::string The first cached address, the host itself for IP
+     *         literals, or an empty string if it is not resolved yet
+     */
+    std::string getAddress(const std::string& url) const;
+
+    /**
+     * @brief Set how long resolved addresses are kept
+     *
+     * @param seconds The TTL in seconds (0 disables the cache)
+     */
+    void setTtl(int seconds);
+
+    /**
+     * @brief Get how long resolved addresses are kept
+     *
+     * @return int The TTL in seconds
+     */
+    int getTtl() const;
+
+    /**
+     * @brief Set the head start of the first address family when connecting
+     *
+     * @param timeoutMs The delay before the other family is tried, in milliseconds
+     */
+    void setHappyEyeballsTimeout(int timeoutMs);
+
+    /**
+     * @brief Get the head start of the first address family when connecting
+     *
+     * @return int The delay in milliseconds
+     */
+    int getHappyEyeballsTimeout() const;
+
+    /**
+     * @brief Get the number of hosts currently cached
+     *
+     * @return size_t The number of hosts
+     */
+    size_t getCachedHostCount() const;
+
+    /**
+     * @brief Drop all cached addresses
+     */
+    void clear();
+
+    static constexpr int DEFAULT_TTL_SECONDS = 300;
+    static constexpr int DEFAULT_HAPPY_EYEBALLS_TIMEOUT_MS = 200;
+    static constexpr size_t MAX_RESOLVER_THREADS = 4;
+
+private:
+    struct Entry {
+        std::vector<std::string> addresses;     // Interleaved, IPv6 literals bracketed
+        std::chrono::steady_clock::time_point expires;
+        bool pending = false;
+    };
+
+    /**
+     * @brief Construct a new DnsCache
+     */
+    DnsCache();
+
+    /**
+     * @brief Destroy the DnsCache, abandoning queued lookups
+     */
+    ~DnsCache();
+
+    // Prevent copying
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    /**
+     * @brief Resolver thread body
+     */
+    void workerLoop();
+
+    /**
+     * @brief Queue a lookup unless the host is fresh or already queued
+     *
+     * Called with mutex_ held.
+     *
+     * @param key The host key in "host:port" form
+     * @return true if a lookup was queued, false otherwise
+     */
+    bool enqueue(const std::string& key);
+
+    /**
+     * @brief Resolve a host with the system resolver
+     *
+     * @param host The host name
+     * @param port The port
+     * @param addresses Receives the addresses, families interleaved
+     * @return true if at least one address was found, false otherwise
+     */
+    static bool lookup(const std::string& host, const std::string& port,
+                       std::vector<std::string>& addresses);
+
+    /**
+     * @brief Build the cache key for a URL
+     *
+     * @param url The URL
+     * @param key Receives the key in "host:port" form
+     * @return true if the URL names a host that needs resolving, false for
+     *         IP literals and unparsable URLs
+     */
+    static bool makeKey(const std::string& url, std::string& key);
+
+    // Member variables
+    std::map<std::string, Entry> entries_;
+    std::deque<std::string> queue_;
+    std::vector<std::thread> workers_;
+    int ttlSeconds_ = DEFAULT_TTL_SECONDS;
+    int happyEyeballsMs_ = DEFAULT_HAPPY_EYEBALLS_TIMEOUT_MS;
+    bool stopping_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // DNS_CACHE_H
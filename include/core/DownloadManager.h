@@ -8,11 +8,18 @@
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <condition_variable>
 #include <functional>
 
 #include "core/DownloadTask.h"
 #include "core/DownloadQueue.h"
 #include "core/Settings.h"
+#include "core/TaskJournal.h"
+#include "core/TaskRecordStore.h"
+#include "core/ConcurrencyController.h"
+#include "core/PostProcessingPipeline.h"
+#include "core/MetricsExporter.h"
+#include "utils/TimeSeriesRollup.h"
 
 namespace dm {
 namespace core {
@@ -32,6 +39,26 @@ using TaskRemovedCallback = std::function<void(std::shared_ptr<DownloadTask>)>;
  */
 using TaskStatusChangedCallback = std::function<void(std::shared_ptr<DownloadTask>, DownloadStatus)>;
 
+/**
+ * @brief A status change made by a bulk operation
+ */
+struct TaskStatusChange {
+    std::shared_ptr<DownloadTask> task;
+    DownloadStatus status;
+};
+
+/**
+ * @brief Bulk status changed callback function type
+ */
+using BulkStatusChangedCallback = std::function<void(const std::vector<TaskStatusChange>&)>;
+
+/**
+ * @brief Selects downloads for a bulk operation
+ * 
+ * Tasks and records are described alike; ranges are not filled in.
+ */
+using TaskFilter = std::function<bool(const JournalEntry&)>;
+
 /**
  * @brief Download manager class
  * 
@@ -49,10 +76,31 @@ public:
     /**
      * @brief Initialize the download manager
      * 
+     * Returns once settings are loaded and limits applied. Saved tasks,
+     * speed history and file hashes load on a background thread; calls
+     * that use tasks wait for them, and downloads start once they are in.
+     * 
      * @return true if successful, false otherwise
      */
     bool initialize();
     
+    /**
+     * @brief Wait until saved tasks are loaded
+     * 
+     * Returns at once if no load is in progress.
+     */
+    void waitUntilTasksLoaded() const;
+    
+    /**
+     * @brief Run a callback once saved tasks are loaded
+     * 
+     * Runs on the loading thread, or at once on the calling thread if no
+     * load is in progress.
+     * 
+     * @param callback The callback
+     */
+    void whenTasksLoaded(std::function<void()> callback);
+    
     /**
      * @brief Shutdown the download manager
      */
@@ -72,6 +120,58 @@ public:
                                             const std::string& filename = "",
                                             bool start = true);
     
+    /**
+     * @brief Add a download of one file from several equivalent URLs
+     * 
+     * Segments are spread over the URLs by their measured throughput;
+     * see DownloadTask::setMirrors().
+     * 
+     * @param urls The URLs, the first one names the task
+     * @param destinationPath The path to save the file (optional)
+     * @param filename The filename to use (optional)
+     * @param start Whether to start the download immediately
+     * @return std::shared_ptr<DownloadTask> The created task or nullptr on failure
+     */
+    std::shared_ptr<DownloadTask> addMirroredDownload(const std::vector<std::string>& urls,
+                                                    const std::string& destinationPath = "",
+                                                    const std::string& filename = "",
+                                                    bool start = true);
+    
+    /**
+     * @brief Add the files of a Metalink 4 document
+     * 
+     * Each file is downloaded from all of its URLs and checked against
+     * its size and strongest hash.
+     * 
+     * @param metalinkPath Path to the .meta4 file
+     * @param destinationPath The common destination path (optional)
+     * @param start Whether to start the downloads immediately
+     * @return std::vector<std::shared_ptr<DownloadTask>> The created tasks
+     */
+    std::vector<std::shared_ptr<DownloadTask>> addMetalinkDownload(const std::string& metalinkPath,
+                                                                  const std::string& destinationPath = "",
+                                                                  bool start = true);
+    
+    /**
+     * @brief Queue a download without creating its task yet
+     * 
+     * The download is kept as a compact record and gets a DownloadTask,
+     * probing the server, only when a slot opens for it or it is looked
+     * up. Use this for long lists instead of addDownload().
+     * 
+     * @param url The URL to download
+     * @param destinationPath The path to save the file (optional)
+     * @param filename The filename to use (optional)
+     * @param priority The priority
+     * @param start Whether to dispatch it when a slot opens
+     * @return std::string The task ID, empty on failure
+     */
+    std::string queueDownload(const std::string& url,
+                              const std::string& destinationPath = "",
+                              const std::string& filename = "",
+                              DownloadPriority priority = DownloadPriority::NORMAL,
+                              bool start = true);
+    
     /**
      * @brief Add a batch of downloads
      * 
@@ -117,6 +217,28 @@ public:
      */
     bool cancelDownload(const std::string& taskId);
     
+    /**
+     * @brief Change the priority of a download task
+     * 
+     * @param taskId The task ID
+     * @param priority The new priority
+     * @return true if successful, false otherwise
+     */
+    bool setDownloadPriority(const std::string& taskId, DownloadPriority priority);
+    
+    /**
+     * @brief Fetch the head of a download first so it can be played while it downloads
+     * 
+     * Poll DownloadTask::hasBuffered() or ProgressInfo::readableBytes for
+     * when playback can start. Segments laid out before the change keep
+     * their ranges; the ones started or split afterwards follow it.
+     * 
+     * @param taskId The task ID
+     * @param enabled True to favour the head of the file
+     * @return true if successful, false if the task was not found
+     */
+    bool setDownloadStreaming(const std::string& taskId, bool enabled);
+    
     /**
      * @brief Remove a download task
      * 
@@ -126,6 +248,73 @@ public:
      */
     bool removeDownload(const std::string& taskId, bool deleteFile = false);
     
+    /**
+     * @brief Find the downloads a filter selects, for the bulk operations
+     * 
+     * A download changing between task and record meanwhile may be missed.
+     * 
+     * @param filter The filter
+     * @return std::vector<std::string> The task IDs
+     */
+    std::vector<std::string> findDownloads(const TaskFilter& filter);
+    
+    /**
+     * @brief Start several downloads
+     * 
+     * Like the other bulk operations, locks are taken once for the whole
+     * set, journal records are written together, the status changes are
+     * reported in one bulk status changed callback and one line is logged.
+     * Records are queued and get their tasks as slots open.
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each download was started or queued
+     */
+    std::vector<bool> startDownloads(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Pause several downloads
+     * 
+     * Queued records are held back from dispatch until resumed.
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each download was paused
+     */
+    std::vector<bool> pauseDownloads(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Resume several downloads
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each download was resumed or queued
+     */
+    std::vector<bool> resumeDownloads(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Cancel several downloads
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each download was canceled
+     */
+    std::vector<bool> cancelDownloads(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Change the priority of several downloads
+     * 
+     * @param taskIds The task IDs
+     * @param priority The new priority
+     * @return std::vector<bool> Whether each download was found
+     */
+    std::vector<bool> setDownloadsPriority(const std::vector<std::string>& taskIds, DownloadPriority priority);
+    
+    /**
+     * @brief Remove several downloads
+     * 
+     * @param taskIds The task IDs
+     * @param deleteFile Whether to delete the downloaded files
+     * @return std::vector<bool> Whether each download was removed
+     */
+    std::vector<bool> removeDownloads(const std::vector<std::string>& taskIds, bool deleteFile = false);
+    
     /**
      * @brief Start all downloads
      */
@@ -149,6 +338,8 @@ public:
     /**
      * @brief Get a download task by ID
      * 
+     * A download kept as a record gets its task here.
+     * 
      * @param taskId The task ID
      * @return std::shared_ptr<DownloadTask> The task or nullptr if not found
      */
@@ -157,6 +348,8 @@ public:
     /**
      * @brief Get all download tasks
      * 
+     * Downloads kept as records are not included, see getDormantTasks().
+     * 
      * @return std::vector<std::shared_ptr<DownloadTask>> All tasks
      */
     std::vector<std::shared_ptr<DownloadTask>> getAllDownloadTasks();
@@ -164,11 +357,31 @@ public:
     /**
      * @brief Get download tasks by status
      * 
+     * Downloads kept as records are not included.
+     * 
      * @param status The status to filter by
      * @return std::vector<std::shared_ptr<DownloadTask>> The matching tasks
      */
     std::vector<std::shared_ptr<DownloadTask>> getDownloadTasksByStatus(DownloadStatus status);
     
+    /**
+     * @brief Get the number of downloads kept as records
+     * 
+     * These are queued downloads not dispatched yet and finished ones.
+     * 
+     * @return size_t The number of downloads
+     */
+    size_t getDormantTaskCount() const;
+    
+    /**
+     * @brief Read a page of the downloads kept as records
+     * 
+     * @param offset Number of downloads to skip
+     * @param count Maximum number of downloads to return
+     * @return std::vector<JournalEntry> The downloads
+     */
+    std::vector<JournalEntry> getDormantTasks(size_t offset, size_t count) const;
+    
     /**
      * @brief Set the task added callback
      * 
@@ -190,6 +403,38 @@ public:
      */
     void setTaskStatusChangedCallback(TaskStatusChangedCallback callback);
     
+    /**
+     * @brief Set the bulk status changed callback
+     * 
+     * Gets the status changes of each bulk operation at once. While set,
+     * the task status changed callback is not called for them; listeners
+     * still are, one change at a time.
+     * 
+     * @param callback The callback function
+     */
+    void setBulkStatusChangedCallback(BulkStatusChangedCallback callback);
+    
+    /**
+     * @brief Add a task status listener
+     * 
+     * Unlike the status changed callback, any number of listeners can be
+     * registered side by side. Listeners run on the thread that changed
+     * the status and must not block.
+     * 
+     * @param listener The listener function
+     * @return int The listener ID, for removeTaskStatusListener
+     */
+    int addTaskStatusListener(TaskStatusChangedCallback listener);
+    
+    /**
+     * @brief Remove a task status listener
+     * 
+     * Once this returns the listener is not running and is not called again.
+     * 
+     * @param listenerId The listener ID
+     */
+    void removeTaskStatusListener(int listenerId);
+    
     /**
      * @brief Get the settings
      * 
@@ -197,16 +442,35 @@ public:
      */
     std::shared_ptr<Settings> getSettings();
     
+    /**
+     * @brief Get the pipeline completed downloads go through
+     * 
+     * Holds the built-in "verify" and "classify" stages; scanners, movers
+     * and uploaders add theirs, depending on those.
+     * 
+     * @return PostProcessingPipeline& The pipeline
+     */
+    PostProcessingPipeline& getPostProcessingPipeline();
+    
     /**
      * @brief Load tasks from disk
      * 
+     * Replays the task journal. A tasks.json left by an older version is
+     * imported the first time, when there is no journal yet. Called with
+     * tasksMutex_ held; the tasks are queued by the caller once it is
+     * released.
+     * 
+     * @param restored Receives the tasks to queue
      * @return true if successful, false otherwise
      */
-    bool loadTasks();
+    bool loadTasks(std::vector<std::shared_ptr<DownloadTask>>& restored);
     
     /**
      * @brief Save tasks to disk
      * 
+     * Changes are journaled as they happen; this checkpoints the progress
+     * of every task and flushes the journal to the disk.
+     * 
      * @return true if successful, false otherwise
      */
     bool saveTasks();
@@ -239,6 +503,70 @@ public:
      */
     void setMaxConcurrentDownloads(int max);
     
+    /**
+     * @brief Get the global maximum download speed
+     * 
+     * @return int The maximum download speed in KB/s (0 for unlimited)
+     */
+    int getMaxDownloadSpeed() const;
+    
+    /**
+     * @brief Set the global maximum download speed
+     * 
+     * Applies to running downloads immediately
+     * 
+     * @param speed The maximum download speed in KB/s (0 for unlimited)
+     */
+    void setMaxDownloadSpeed(int speed);
+    
+    /**
+     * @brief Cap the global bandwidth for a scheduled window
+     * 
+     * Leaves the configured maximum download speed untouched; the tighter
+     * of the two applies. Running downloads are eased to the new rate over
+     * a few seconds instead of being paused, so their connections and TCP
+     * windows stay warm.
+     * 
+     * @param speed The cap in KB/s (0 for no cap)
+     * @param percent A cap as a percentage of the fastest aggregate speed
+     *                seen (0 for none); the lower cap applies
+     */
+    void setScheduledSpeedLimit(int speed, int percent = 0);
+    
+    /**
+     * @brief Lift the scheduled bandwidth cap
+     */
+    void clearScheduledSpeedLimit();
+    
+    /**
+     * @brief Get the aggregate download speed over a time range
+     * 
+     * Sampled every progress tick into per-second, per-minute, per-hour
+     * and per-day buckets of fixed memory, so a chart gets at most
+     * maxPoints points whatever the range. Hours are kept across runs.
+     * Charts that append incrementally ask again from the start of their
+     * last point and replace it.
+     * 
+     * @param from Start of the range in seconds since the epoch
+     * @param to End of the range in seconds since the epoch
+     * @param maxPoints The point budget, such as the chart width in pixels
+     * @return std::vector<dm::utils::TimeBucket> Speeds in bytes/second, oldest first
+     */
+    std::vector<dm::utils::TimeBucket> getSpeedHistory(int64_t from, int64_t to, size_t maxPoints) const;
+    
+    /**
+     * @brief Get the completed downloads over a time range
+     * 
+     * Each bucket counts the downloads completed in it and sums their
+     * sizes. Buckets are not downsampled, the totals would not add up.
+     * 
+     * @param from Start of the range in seconds since the epoch
+     * @param to End of the range in seconds since the epoch
+     * @param maxPoints The point budget, picks the bucket width
+     * @return std::vector<dm::utils::TimeBucket> Completions, oldest first
+     */
+    std::vector<dm::utils::TimeBucket> getCompletionHistory(int64_t from, int64_t to, size_t maxPoints) const;
+    
 private:
     /**
      * @brief Construct a new DownloadManager
@@ -262,24 +590,232 @@ private:
      */
     void onTaskStatusChanged(std::shared_ptr<DownloadTask> task, DownloadStatus status);
     
+    /**
+     * @brief Read the queue and speed gauges for the metrics exporter
+     * 
+     * @return EngineGauges The gauges
+     */
+    EngineGauges collectGauges() const;
+    
+    /**
+     * @brief Declare the post-processing stages every download gets
+     * 
+     * "verify" fails files whose type requires a footer they lack, which a
+     * server that closed early leaves behind; "classify" records the type
+     * matched on the file's head. Both work on the shared sample.
+     */
+    void addBuiltInStages();
+    
+    /**
+     * @brief Load saved state after initialize, then start the queue processor
+     */
+    void loadInBackground();
+    
     /**
      * @brief Queue processor thread function
      */
     void queueProcessorThread();
     
+    /**
+     * @brief Create, initialize and queue a task
+     * 
+     * @param urls The task's URL followed by its mirrors
+     * @param destinationPath The path to save the file (optional)
+     * @param filename The filename to use (optional)
+     * @param start Whether to start the download immediately
+     * @param prepare Called with the configured task before it is initialized (optional)
+     * @return std::shared_ptr<DownloadTask> The created task or nullptr on failure
+     */
+    std::shared_ptr<DownloadTask> addTask(const std::vector<std::string>& urls,
+                                        const std::string& destinationPath,
+                                        const std::string& filename,
+                                        bool start,
+                                        const std::function<void(const std::shared_ptr<DownloadTask>&)>& prepare);
+    
+    /**
+     * @brief Apply the download settings to a new task
+     * 
+     * @param task The task
+     */
+    void configureTask(const std::shared_ptr<DownloadTask>& task);
+    
+    /**
+     * @brief Describe a task for the journal
+     * 
+     * @param task The task
+     * @return JournalEntry The entry
+     */
+    static JournalEntry describeTask(const std::shared_ptr<DownloadTask>& task);
+    
+    /**
+     * @brief Journal how far a task has got
+     * 
+     * @param task The task
+     */
+    void checkpointTask(const std::shared_ptr<DownloadTask>& task);
+    
+    /**
+     * @brief Recreate a task saved in the journal
+     * 
+     * Called with tasksMutex_ held.
+     * 
+     * @param entry The saved task
+     * @param restored Receives the task when it is recreated, to be queued
+     */
+    void restoreTask(const JournalEntry& entry, std::vector<std::shared_ptr<DownloadTask>>& restored);
+    
+    /**
+     * @brief Create the task of a saved download
+     * 
+     * @param entry The saved download
+     * @return std::shared_ptr<DownloadTask> The task
+     */
+    std::shared_ptr<DownloadTask> inflateTask(const JournalEntry& entry);
+    
+    /**
+     * @brief Give a download kept as a record its task
+     * 
+     * The task is in tasks_ but not yet in the queue; the caller adds it
+     * there after releasing tasksMutex_. Called with tasksMutex_ held.
+     * 
+     * @param taskId The task ID
+     * @return std::shared_ptr<DownloadTask> The task or nullptr if there is no such record
+     */
+    std::shared_ptr<DownloadTask> hydrateTask(const std::string& taskId);
+    
+    /**
+     * @brief Give queued records their tasks and start them, up to the free slots
+     */
+    void dispatchTaskRecords();
+    
+    /**
+     * @brief Probe the queued records due next, ahead of their dispatch
+     */
+    void prefetchTaskRecords();
+    
+    /**
+     * @brief Turn tasks that have finished since the last call back into records
+     */
+    void dehydrateFinishedTasks();
+    
+    /**
+     * @brief Start collecting the status changes made on this thread
+     * 
+     * @param changes Receives the changes until endBulk()
+     */
+    void beginBulk(std::vector<TaskStatusChange>& changes);
+    
+    /**
+     * @brief Write the journal records and report the changes of a bulk operation
+     * 
+     * @param changes The changes collected since beginBulk()
+     * @param action What was done, for the log
+     * @param results Whether it succeeded for each download
+     */
+    void endBulk(std::vector<TaskStatusChange>& changes, const std::string& action,
+                 const std::vector<bool>& results);
+    
+    /**
+     * @brief Change the status of the records among downloads not handled yet
+     * 
+     * @param taskIds The task IDs
+     * @param results Whether each download was handled, set for the records changed
+     * @param from The statuses that change
+     * @param to The new status
+     */
+    void setRecordsStatus(const std::vector<std::string>& taskIds, std::vector<bool>& results,
+                          const std::vector<DownloadStatus>& from, DownloadStatus to);
+    
+    /**
+     * @brief Change the status of records in one status and journal it
+     * 
+     * @param from The status to change
+     * @param to The new status
+     */
+    void setRecordStatusWhere(DownloadStatus from, DownloadStatus to);
+    
+    /**
+     * @brief Step the connection budget from the link quality measured since the last call
+     * 
+     * Sets the overall limit of the HostConnectionLimiter, and the number
+     * of concurrent downloads that fills it, up to the configured maximum.
+     * 
+     * @param tasks The downloading tasks
+     */
+    void adjustConcurrency(const std::vector<std::shared_ptr<DownloadTask>>& tasks);
+    
+    /**
+     * @brief Get the global bandwidth the configured and scheduled limits allow
+     * 
+     * @return int64_t Bytes per second (0 for unlimited)
+     */
+    int64_t getTargetBandwidth() const;
+    
+    /**
+     * @brief Move the global throttler one step toward the target bandwidth
+     * 
+     * Lowering is spread over ticks so transfers slow down instead of
+     * stalling; raising, and any change while nothing runs, applies at once.
+     * 
+     * @param tasks The downloading tasks
+     */
+    void easeBandwidth(const std::vector<std::shared_ptr<DownloadTask>>& tasks);
+    
+    /**
+     * @brief Import the tasks.json of an older version into the journal
+     * 
+     * Called with tasksMutex_ held.
+     * 
+     * @param tasksFile The tasks.json path
+     * @param restored Receives the imported tasks, to be queued
+     * @return true if successful, false otherwise
+     */
+    bool importTasks(const std::string& tasksFile, std::vector<std::shared_ptr<DownloadTask>>& restored);
+    
+    static constexpr int PROGRESS_INTERVAL_MS = 100;
+    static constexpr int CHECKPOINT_INTERVAL_SECONDS = 2;
+    static constexpr int MIN_ADAPTIVE_CONNECTIONS = 2;
+    static constexpr double BANDWIDTH_EASE_FACTOR = 0.1;     // Share of the gap closed per progress tick
+    static constexpr int EMBEDDED_MALLOC_ARENAS = 2;
+    
     // Member variables
     std::shared_ptr<Settings> settings_;
+    int settingsCallbackId_ = 0;
     std::shared_ptr<DownloadQueue> queue_;
+    std::shared_ptr<Throttler> throttler_;     // Global bandwidth limit
+    std::unique_ptr<ConcurrencyController> concurrencyController_;     // Only with adaptive concurrency
+    std::atomic<int> scheduledSpeed_ = 0;       // Scheduled cap in KB/s, 0 for none
+    std::atomic<int> scheduledPercent_ = 0;     // Scheduled cap as a share of peakSpeed_, 0 for none
+    std::atomic<int64_t> peakSpeed_ = 0;        // Fastest aggregate speed seen, bytes/second
+    dm::utils::TimeSeriesRollup speedHistory_;          // Aggregate speed, bytes/second, archived by the hour
+    dm::utils::TimeSeriesRollup completionHistory_;     // Sizes of completed downloads
     
     std::map<std::string, std::shared_ptr<DownloadTask>> tasks_;
+    TaskRecordStore records_;                   // Downloads without a task, guarded by tasksMutex_
     mutable std::mutex tasksMutex_;
     
+    std::vector<std::string> finishedTasks_;    // Waiting to become records
+    std::mutex finishedMutex_;
+    std::unique_ptr<TaskJournal> journal_;
+    std::unique_ptr<PostProcessingPipeline> pipeline_;
+    std::unique_ptr<MetricsExporter> metricsExporter_;     // Only with a metrics file
+    
     std::atomic<bool> running_ = false;
     std::unique_ptr<std::thread> queueProcessorThread_;
+    std::unique_ptr<std::thread> loaderThread_;
+    mutable std::mutex loadMutex_;
+    mutable std::condition_variable loadCondition_;
+    bool loadingTasks_ = false;                 // Guarded by loadMutex_
+    std::vector<std::function<void()>> tasksLoadedCallbacks_;
     
     TaskAddedCallback taskAddedCallback_ = nullptr;
     TaskRemovedCallback taskRemovedCallback_ = nullptr;
     TaskStatusChangedCallback taskStatusChangedCallback_ = nullptr;
+    BulkStatusChangedCallback bulkStatusChangedCallback_ = nullptr;
+    
+    std::map<int, TaskStatusChangedCallback> statusListeners_;
+    int nextListenerId_ = 1;
+    std::mutex listenersMutex_;
 };
 
 } // namespace core
@@ -2,14 +2,16 @@
 #define DOWNLOAD_QUEUE_H
 
 #include <vector>
-#include <queue>
 #include <map>
+#include <unordered_map>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <functional>
 
 #include "core/DownloadTask.h"
+#include "core/PriorityTaskQueue.h"
 
 namespace dm {
 namespace core {
@@ -22,7 +24,14 @@ using QueueProcessorCallback = std::function<void()>;
 /**
  * @brief Download queue class
  * 
- * Manages and schedules download tasks
+ * Manages and schedules download tasks. Pending tasks are dispatched by
+ * priority with aging; task IDs are interned to integer handles so the
+ * scheduling path does not hash strings. A task whose host has no
+ * connection to spare in the HostConnectionLimiter, or whose destination
+ * device is saturated in the DeviceIoScheduler, is passed over for the
+ * next one and keeps its place. So is one whose size does not fit in the
+ * disk space left by the tasks already started, which reserve it in the
+ * DiskSpaceLedger until they complete, fail or are canceled.
  */
 class DownloadQueue {
 public:
@@ -108,6 +117,64 @@ public:
      */
     bool cancelTask(const std::string& taskId);
     
+    /**
+     * @brief Change the priority of a task, reordering it if it is pending
+     * 
+     * @param taskId The task ID
+     * @param priority The new priority
+     * @return true if the task was found, false otherwise
+     */
+    bool setTaskPriority(const std::string& taskId, DownloadPriority priority);
+    
+    /**
+     * @brief Start several tasks, taking the lock once
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each task was started or queued
+     */
+    std::vector<bool> startTasks(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Pause several tasks, taking the lock once
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each task was paused
+     */
+    std::vector<bool> pauseTasks(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Resume several tasks, taking the lock once
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each task was resumed or queued
+     */
+    std::vector<bool> resumeTasks(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Cancel several tasks, taking the lock once
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each task was canceled
+     */
+    std::vector<bool> cancelTasks(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Remove several tasks, taking the lock once
+     * 
+     * @param taskIds The task IDs
+     * @return std::vector<bool> Whether each task was found and removed
+     */
+    std::vector<bool> removeTasks(const std::vector<std::string>& taskIds);
+    
+    /**
+     * @brief Change the priority of several tasks, taking the lock once
+     * 
+     * @param taskIds The task IDs
+     * @param priority The new priority
+     * @return std::vector<bool> Whether each task was found
+     */
+    std::vector<bool> setTasksPriority(const std::vector<std::string>& taskIds, DownloadPriority priority);
+    
     /**
      * @brief Start all download tasks
      */
@@ -135,6 +202,39 @@ public:
      */
     void processQueue();
     
+    /**
+     * @brief Get the tasks that are currently downloading
+     * 
+     * @return std::vector<std::shared_ptr<DownloadTask>> The active tasks
+     */
+    std::vector<std::shared_ptr<DownloadTask>> getActiveTasks() const;
+    
+    /**
+     * @brief Wait until the queue changes
+     * 
+     * Returns early when a task changes status, a task is added or removed,
+     * or notifyChange() is called.
+     * 
+     * @param timeoutMs Maximum time to wait in milliseconds (-1 to wait indefinitely)
+     * @return true if a change was signalled, false on timeout
+     */
+    bool waitForChange(int timeoutMs);
+    
+    /**
+     * @brief Wake a thread blocked in waitForChange()
+     */
+    void notifyChange();
+    
+    /**
+     * @brief Set the callback for status changes of queued tasks
+     * 
+     * The queue owns the status change callback of its tasks and forwards
+     * every transition here. Set it before adding tasks.
+     * 
+     * @param callback The callback function
+     */
+    void setStatusChangeCallback(StatusChangeCallback callback);
+    
     /**
      * @brief Set the maximum number of concurrent downloads
      * 
@@ -156,6 +256,23 @@ public:
      */
     int getActiveDownloadsCount() const;
     
+    /**
+     * @brief Get the number of tasks waiting for a slot
+     * 
+     * @return int The number of pending tasks
+     */
+    int getPendingCount() const;
+    
+    /**
+     * @brief Check if a task was held back for disk space on the last pass
+     * 
+     * Space freed outside the queue wakes nobody; the caller should
+     * process the queue again in a while.
+     * 
+     * @return true if a task waits for disk space, false otherwise
+     */
+    bool isWaitingForDiskSpace() const;
+    
     /**
      * @brief Set the queue processor callback
      * 
@@ -163,31 +280,104 @@ public:
      */
     void setQueueProcessorCallback(QueueProcessorCallback callback);
     
+    static constexpr size_t MAX_HELD_BACK_TASKS = 32;   // Pending tasks passed over per pass for a busy host or disk
+    
 private:
     /**
      * @brief Task status change handler
      * 
+     * @param handle The handle of the task
      * @param task The task that changed status
      * @param oldStatus The previous status
      * @param newStatus The new status
      */
-    void onTaskStatusChanged(std::shared_ptr<DownloadTask> task, DownloadStatus oldStatus, DownloadStatus newStatus);
+    void onTaskStatusChanged(TaskHandle handle, std::shared_ptr<DownloadTask> task, 
+                             DownloadStatus oldStatus, DownloadStatus newStatus);
     
     /**
-     * @brief Count active downloads
+     * @brief Look up a task by ID
      * 
-     * @return int The number of active downloads
+     * Called with mutex_ held.
+     * 
+     * @param taskId The task ID
+     * @param handle Receives the task handle if not nullptr
+     * @return std::shared_ptr<DownloadTask> The task or nullptr if not found
+     */
+    std::shared_ptr<DownloadTask> findTask(const std::string& taskId, TaskHandle* handle = nullptr) const;
+    
+    /**
+     * @brief Start a task, or queue it if no slot is free
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param handle The task handle
+     * @param task The task
+     * @param queued Set to whether it was queued
+     * @return true if started or queued, false otherwise
      */
-    int countActiveDownloads();
+    bool startLocked(TaskHandle handle, const std::shared_ptr<DownloadTask>& task, bool& queued);
+    
+    /**
+     * @brief Resume a task, or queue it if no slot is free
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param handle The task handle
+     * @param task The task
+     * @param queued Set to whether it was queued
+     * @return true if resumed or queued, false otherwise
+     */
+    bool resumeLocked(TaskHandle handle, const std::shared_ptr<DownloadTask>& task, bool& queued);
+    
+    /**
+     * @brief Cancel a task if active and release its handle
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param taskId The task ID
+     * @param handle The task handle
+     * @param task The task
+     */
+    void removeLocked(const std::string& taskId, TaskHandle handle, const std::shared_ptr<DownloadTask>& task);
+    
+    /**
+     * @brief Queue a task for dispatch at its current priority
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param handle The task handle
+     */
+    void enqueue(TaskHandle handle);
+    
+    /**
+     * @brief Reserve the disk space of a task about to be dispatched
+     * 
+     * @param task The task
+     * @return true if reserved, false if it has to wait for space
+     */
+    bool reserveDiskSpace(const std::shared_ptr<DownloadTask>& task);
     
     // Member variables
-    std::map<std::string, std::shared_ptr<DownloadTask>> tasks_;
-    std::queue<std::string> pendingTasks_;
+    std::unordered_map<std::string, TaskHandle> handles_;
+    std::vector<std::shared_ptr<DownloadTask>> slots_;     // Tasks by handle, nullptr when free
+    std::vector<TaskHandle> freeHandles_;
+    PriorityTaskQueue pendingTasks_;
     mutable std::mutex mutex_;
     std::atomic<int> maxConcurrentDownloads_;
     std::atomic<int> activeDownloads_;
+    std::atomic<bool> waitingForDiskSpace_;
+    
+    // Downloading tasks, maintained from status transitions. Separate lock
+    // because transitions fire while mutex_ is held by start()/pause() calls
+    std::unordered_map<TaskHandle, std::shared_ptr<DownloadTask>> activeTasks_;
+    mutable std::mutex activeMutex_;
+    
+    std::mutex changeMutex_;
+    std::condition_variable changeCv_;
+    bool changed_ = false;
     
     QueueProcessorCallback queueProcessorCallback_ = nullptr;
+    StatusChangeCallback statusChangeCallback_ = nullptr;
 };
 
 } // namespace core
@@ -4,12 +4,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <queue>
 #include <memory>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <atomic>
 #include <functional>
+#include <cstdint>
 
 namespace dm {
 namespace core {
@@ -79,6 +83,27 @@ struct ScheduleEntry {
     std::chrono::system_clock::time_point nextRun; // When the schedule will next run
 };
 
+/**
+ * @brief Time-of-day bandwidth window
+ * 
+ * While a window is open the global bandwidth is capped at its limit;
+ * outside every window the configured maximum download speed applies. A
+ * window whose end is before its start runs past midnight, and one whose
+ * start equals its end lasts the whole day.
+ */
+struct BandwidthWindow {
+    std::string id;                  // Unique identifier
+    std::string name;                // User-friendly name
+    int startHour = 0;               // Opening hour (0-23)
+    int startMinute = 0;             // Opening minute (0-59)
+    int endHour = 0;                 // Closing hour (0-23)
+    int endMinute = 0;               // Closing minute (0-59)
+    std::vector<DayOfWeek> daysOfWeek; // Days the window opens on (empty for every day)
+    int bandwidthLimit = 0;          // Cap in KB/s (0 for full speed)
+    int bandwidthPercent = 0;        // Cap as a percentage of the fastest speed seen, instead of bandwidthLimit
+    bool enabled = true;             // Whether the window is enabled
+};
+
 /**
  * @brief Schedule event callback function type
  */
@@ -87,7 +112,16 @@ using ScheduleEventCallback = std::function<void(const ScheduleEntry& entry)>;
 /**
  * @brief Download scheduler class
  * 
- * Manages scheduling of download-related actions
+ * Manages scheduling of download-related actions. Enabled entries sit in a
+ * min-heap keyed on their next run time, so adding, updating or removing
+ * one costs O(log n) and the scheduler thread sleeps until exactly the
+ * earliest deadline instead of rescanning every entry. Entries that come
+ * due together are executed as one batch outside the lock.
+ *
+ * Bandwidth windows share the heap: each one keeps a timer on its next
+ * opening or closing, and at every boundary the tightest open window is
+ * handed to the download manager, which eases running transfers to it
+ * rather than pausing them.
  */
 class DownloadScheduler {
 public:
@@ -224,12 +258,141 @@ public:
      */
     std::vector<ScheduleEntry> getSchedulesByActionType(ScheduledActionType actionType) const;
     
+    /**
+     * @brief Add a bandwidth window
+     * 
+     * @param window The window to add
+     * @return std::string The ID of the added window
+     */
+    std::string addBandwidthWindow(const BandwidthWindow& window);
+    
+    /**
+     * @brief Update a bandwidth window
+     * 
+     * @param window The window to update
+     * @return true if the window was updated, false otherwise
+     */
+    bool updateBandwidthWindow(const BandwidthWindow& window);
+    
+    /**
+     * @brief Remove a bandwidth window
+     * 
+     * @param id The ID of the window to remove
+     * @return true if the window was removed, false otherwise
+     */
+    bool removeBandwidthWindow(const std::string& id);
+    
+    /**
+     * @brief Get all bandwidth windows
+     * 
+     * @return std::vector<BandwidthWindow> All bandwidth windows
+     */
+    std::vector<BandwidthWindow> getBandwidthWindows() const;
+    
 private:
     /**
-     * @brief Process scheduled actions
+     * @brief A deadline in the timer heap
+     *
+     * Updating or removing an entry does not search the heap; it bumps the
+     * entry's generation, and timers of an older generation are dropped
+     * when they reach the top.
+     */
+    struct Timer {
+        std::chrono::system_clock::time_point deadline;
+        uint64_t generation;
+        std::string id;
+        
+        bool operator>(const Timer& other) const {
+            return deadline > other.deadline;
+        }
+    };
+    
+    /**
+     * @brief Scheduler thread: sleep until the earliest deadline, then run what is due
      */
     void processSchedules();
     
+    /**
+     * @brief Push a timer for an entry's next run, replacing any earlier one
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param entry The schedule entry
+     * @return true if the timer is now the earliest, so the thread has to wake
+     */
+    bool arm(const ScheduleEntry& entry);
+    
+    /**
+     * @brief Push a timer for a bandwidth window's next boundary
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param window The bandwidth window
+     * @return true if the timer is now the earliest, so the thread has to wake
+     */
+    bool arm(const BandwidthWindow& window);
+    
+    /**
+     * @brief Push a timer, replacing any earlier one of the same ID
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param id The ID of the entry or window
+     * @param deadline When the timer fires
+     * @return true if the timer is now the earliest
+     */
+    bool pushTimer(const std::string& id, std::chrono::system_clock::time_point deadline);
+    
+    /**
+     * @brief Apply the tightest open bandwidth window, or lift the cap
+     */
+    void applyBandwidthWindows();
+    
+    /**
+     * @brief Check if a bandwidth window is open
+     * 
+     * @param window The bandwidth window
+     * @param time The time to check
+     * @return true if open, false otherwise
+     */
+    bool isWindowOpen(const BandwidthWindow& window, std::chrono::system_clock::time_point time) const;
+    
+    /**
+     * @brief Get the next opening or closing of a bandwidth window
+     * 
+     * @param window The bandwidth window
+     * @param time The time to look from
+     * @return std::chrono::system_clock::time_point The first boundary after time
+     */
+    std::chrono::system_clock::time_point getNextBoundary(const BandwidthWindow& window,
+                                                          std::chrono::system_clock::time_point time) const;
+    
+    /**
+     * @brief Drop the timer of an entry
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param id The ID of the entry
+     */
+    void disarm(const std::string& id);
+    
+    /**
+     * @brief Check if a timer still belongs to an enabled entry
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param timer The timer
+     * @return true if current, false if it was replaced or removed
+     */
+    bool isCurrent(const Timer& timer) const;
+    
+    /**
+     * @brief Rebuild the heap without stale timers once they outnumber the live ones
+     * 
+     * Called with mutex_ held.
+     */
+    void compactTimers();
+    
     /**
      * @brief Execute a scheduled action
      * 
@@ -241,6 +404,8 @@ private:
     /**
      * @brief Update next run time for a schedule entry
      * 
+     * Sets the first run after now; disables entries that cannot run again.
+     * 
      * @param entry The schedule entry to update
      */
     void updateNextRunTime(ScheduleEntry& entry);
@@ -280,12 +445,17 @@ private:
     std::atomic<bool> running_;
     
     std::unique_ptr<std::thread> schedulerThread_;
-    std::mutex mutex_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
     
     std::map<std::string, ScheduleEntry> schedules_;
+    std::map<std::string, BandwidthWindow> bandwidthWindows_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    std::unordered_map<std::string, uint64_t> generations_;  // Current timer of each armed entry
+    uint64_t nextGeneration_ = 1;
     ScheduleEventCallback eventCallback_;
     
-    std::chrono::seconds checkInterval_;
+    static constexpr size_t COMPACT_SLACK = 64;        // Stale timers tolerated beyond the live ones
 };
 
 } // namespace core
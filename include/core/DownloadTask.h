@@ -8,7 +8,17 @@
 #include <mutex>
 #include <functional>
 #include <chrono>
+#include <map>
 #include "core/SegmentDownloader.h"
+#include "core/HostConnectionLimiter.h"
+#include "core/ProxyPool.h"
+#include "core/ClusterCoordinator.h"
+#include "core/StreamingHasher.h"
+#include "core/PieceVerifier.h"
+#include "core/DataFilter.h"
+#include "core/ContentSniffer.h"
+#include "core/ValidatorCache.h"
+#include "utils/SeqLock.h"
 
 namespace dm {
 namespace core {
@@ -54,6 +64,27 @@ struct ProgressInfo {
     double averageSpeed = 0.0;       // Average download speed
     int64_t timeElapsed = 0;         // Time elapsed in seconds
     int64_t timeRemaining = 0;       // Estimated time remaining in seconds
+    int64_t readableBytes = 0;       // Written without a gap from the start of the file
+};
+
+/**
+ * @brief Byte range of a download still to be fetched
+ */
+struct SegmentRange {
+    int64_t startByte = 0;           // First missing byte
+    int64_t endByte = -1;            // Last byte of the range (inclusive)
+};
+
+/**
+ * @brief State of one of the URLs a download is fetched from
+ */
+struct DownloadSourceInfo {
+    std::string url;
+    bool usable = false;             // Probed and consistent, not dropped
+    int activeSegments = 0;          // Segments downloading from it
+    double downloadSpeed = 0.0;      // Smoothed speed of its segments in bytes/second
+    int failures = 0;                // Segments that gave up on it
+    bool peer = false;               // A manager on the LAN, taken before the others
 };
 
 /**
@@ -101,6 +132,8 @@ public:
     /**
      * @brief Pause the download
      * 
+     * Not once all the data is in and the file is being finished.
+     * 
      * @return true if paused, false otherwise
      */
     bool pause();
@@ -115,6 +148,8 @@ public:
     /**
      * @brief Cancel the download
      * 
+     * Not once all the data is in and the file is being finished.
+     * 
      * @return true if canceled, false otherwise
      */
     bool cancel();
@@ -164,6 +199,9 @@ public:
     /**
      * @brief Get the progress information
      * 
+     * Reads the last published snapshot without taking the task lock, so
+     * it is cheap to poll for many tasks while they are downloading.
+     * 
      * @return ProgressInfo The progress information
      */
     ProgressInfo getProgressInfo() const;
@@ -250,16 +288,504 @@ public:
      */
     void updateProgress();
     
+    /**
+     * @brief Report progress of a transfer the task does not run itself
+     * 
+     * For protocol handlers that move the data on their own (torrents).
+     * The progress goes into the same snapshot the segments publish to,
+     * and the task stops aggregating its segments from then on.
+     * 
+     * @param downloadedBytes Bytes downloaded so far
+     * @param totalBytes Total bytes to download, 0 if unknown
+     * @param downloadSpeed Download speed in bytes/second
+     * @param readableBytes Bytes readable from the start of the file, -1 if not tracked
+     */
+    void publishProgress(int64_t downloadedBytes, int64_t totalBytes, double downloadSpeed,
+                         int64_t readableBytes = -1);
+    
     // Set max retries for all segments
     void setSegmentMaxRetries(int retries);
     
+    /**
+     * @brief Set the transfer mode used by new segments
+     * 
+     * @param mode The transfer mode
+     */
+    void setTransferMode(TransferMode mode);
+    
+    /**
+     * @brief Set the bandwidth limit for this download
+     * 
+     * @param bytesPerSecond The limit in bytes per second (0 for unlimited)
+     */
+    void setSpeedLimit(int64_t bytesPerSecond);
+    
+    /**
+     * @brief Get the bandwidth limit for this download
+     * 
+     * @return int64_t The limit in bytes per second (0 for unlimited)
+     */
+    int64_t getSpeedLimit() const;
+    
+    /**
+     * @brief Set the throttler this download's throttler draws from
+     * 
+     * @param parent The parent throttler, usually the global one
+     */
+    void setParentThrottler(std::shared_ptr<Throttler> parent);
+    
+    /**
+     * @brief Set whether the output file is opened with direct I/O
+     * 
+     * @param enabled True to use direct I/O where supported
+     */
+    void setDirectIo(bool enabled);
+    
+    /**
+     * @brief Set the size of the per-segment write-combining buffers
+     * 
+     * @param bytes The buffer size in bytes (0 to disable buffering)
+     */
+    void setWriteBufferSize(size_t bytes);
+    
+    /**
+     * @brief Set whether finished segments take over work from slow ones
+     * 
+     * When a segment completes, the slowest active segment gives up the
+     * upper half of its remaining range to a new segment.
+     * 
+     * @param enabled True to enable dynamic splitting
+     * @param minSplitSize Smallest range handed to a new segment in bytes
+     */
+    void setDynamicSplitting(bool enabled, int64_t minSplitSize = DEFAULT_MIN_SPLIT_SIZE);
+    
+    /**
+     * @brief Set whether the number of connections adapts to throughput
+     * 
+     * The download starts with a few connections and adds one while the
+     * aggregate speed keeps rising, giving one back when it plateaus or
+     * when the server answers 429/503. The segment count becomes the upper
+     * bound and the learned count is reused for the same host.
+     * 
+     * @param enabled True to enable adaptive segmentation
+     */
+    void setAdaptiveSegments(bool enabled);
+    
+    /**
+     * @brief Set whether the head of the file is fetched first, for playback while downloading
+     * 
+     * Segments are laid out STREAMING_WINDOW_SIZE apart from the start of
+     * the file and started in file order, and a connection that becomes
+     * free takes the range right after the foremost active segment instead
+     * of half the slowest one, so the readable prefix grows at the speed of
+     * all connections together.
+     * 
+     * @param enabled True to favour the head of the file
+     */
+    void setStreamingPriority(bool enabled);
+    
+    /**
+     * @brief Get how much of the file can be read from the start without a gap
+     * 
+     * Counts only data that reached the file, not data still in write
+     * buffers. Also published as ProgressInfo::readableBytes.
+     * 
+     * @return int64_t The bytes
+     */
+    int64_t getReadableBytes() const;
+    
+    /**
+     * @brief Check if enough of the file is readable to start playing it
+     * 
+     * @param seconds The playback time required ahead
+     * @param bytesPerSecond The media bitrate in bytes/second
+     * @return true if that much is readable, or the whole file is
+     */
+    bool hasBuffered(double seconds, double bytesPerSecond) const;
+    
+    /**
+     * @brief Set whether the file is hashed while it is written
+     * 
+     * The digest is available when the download completes and is recorded
+     * for HashCalculator::findStreamedHash(), so verifying the file does
+     * not read it again.
+     * 
+     * @param enabled True to hash in the write path
+     * @param algorithm Hash algorithm to use
+     */
+    void setStreamingHash(bool enabled, dm::utils::HashAlgorithm algorithm = dm::utils::HashAlgorithm::SHA256);
+    
+    /**
+     * @brief Get the hash computed while downloading
+     * 
+     * @return std::string The hash, or an empty string if not available
+     */
+    std::string getStreamedHash() const;
+    
+    /**
+     * @brief Get the first and last bytes of the completed file
+     * 
+     * Captured while writing and recorded for ContentSniffer::findSample(),
+     * so type detection and header checks after the download do not read
+     * the file again.
+     * 
+     * @return ContentSample The sample, fileSize -1 until the download completed
+     */
+    ContentSample getContentSample() const;
+    
+    /**
+     * @brief Set whether a file downloaded before is revalidated instead of fetched again
+     * 
+     * When ValidatorCache has the URL and its copy is unchanged, the probe
+     * carries If-None-Match / If-Modified-Since and a 304 completes the
+     * task without a transfer. A copy recorded at another path is copied
+     * into place if the destination is free and the copy still has its
+     * recorded hash. Completed downloads record their validators.
+     * 
+     * @param enabled True to revalidate
+     */
+    void setRevalidate(bool enabled);
+    
+    /**
+     * @brief Set whether the expected hash is read from a .sha256 file next to the URL
+     * 
+     * Only fetched when no hash was set with setExpectedHash(). The hash
+     * names a copy in ContentStore and verifies the download.
+     * 
+     * @param enabled True to fetch the sidecar
+     */
+    void setChecksumSidecar(bool enabled);
+    
+    /**
+     * @brief Check if the task completed from a local copy without a transfer
+     * 
+     * Either the server said the copy is current, or ContentStore had the
+     * expected content.
+     * 
+     * @return true if nothing was downloaded, false otherwise
+     */
+    bool isUpToDate() const;
+    
+    /**
+     * @brief Set whether small downloads share multiplexed connections
+     * 
+     * In event loop mode, the segments of a download no larger than
+     * MULTIPLEX_MAX_FILE_SIZE (or of unknown size) run as HTTP/2 streams
+     * over one connection per origin, shared with other such downloads.
+     * Larger downloads keep a connection per segment.
+     * 
+     * @param enabled True to enable multiplexing
+     */
+    void setMultiplexing(bool enabled);
+    
+    /**
+     * @brief Set the size up to which a download is staged in memory
+     * 
+     * A download no larger than this, or of unknown size until it grows
+     * beyond it, is not preallocated and gets no metadata file; its data
+     * is kept in a pooled slab and written out once it completes, with a
+     * single open, write and close. Staged downloads start over after a
+     * restart of the program.
+     * 
+     * @param bytes The threshold in bytes (0 to always write to the file)
+     */
+    void setSmallFileThreshold(int64_t bytes);
+    
+    /**
+     * @brief Set equivalent URLs the file can also be fetched from
+     * 
+     * Called before initialize(). Every URL is probed; mirrors are used
+     * if they support ranges and report the same size (and, for URLs on
+     * the same host, the same ETag). New and split segments go to the
+     * source with the most measured throughput per segment it already
+     * serves. A source whose segments fail, or that stays far slower
+     * than the fastest one, is dropped and its remaining ranges move to
+     * the others.
+     * 
+     * @param urls The mirror URLs, in addition to the task's URL
+     */
+    void setMirrors(const std::vector<std::string>& urls);
+    
+    /**
+     * @brief Get the URLs the download is fetched from
+     * 
+     * @return std::vector<DownloadSourceInfo> The task's URL first, then the mirrors
+     */
+    std::vector<DownloadSourceInfo> getSources() const;
+    
+    /**
+     * @brief Set the size the file must have
+     * 
+     * Sources reporting another size are not used.
+     * 
+     * @param size The size in bytes (-1 for no check)
+     */
+    void setExpectedSize(int64_t size);
+    
+    /**
+     * @brief Set the hash the completed file must have
+     * 
+     * Enables the streaming hash with this algorithm; a mismatch fails
+     * the download.
+     * 
+     * @param algorithm Hash algorithm
+     * @param hash The expected hash as hex
+     */
+    void setExpectedHash(dm::utils::HashAlgorithm algorithm, const std::string& hash);
+    
+    /**
+     * @brief Set the hashes of the pieces of the file
+     * 
+     * Called before initialize(). Each piece is checked as soon as its
+     * last byte is written; one that does not match is fetched again by
+     * range, up to MAX_PIECE_REPAIRS times, instead of the whole file
+     * failing at the end. A source that keeps serving corrupt pieces is
+     * dropped. Ignored if the pieces do not cover the file.
+     * 
+     * @param pieces The piece size and hashes: published ones (Metalink),
+     *        or those an earlier session recorded
+     */
+    void setPieceHashes(const PieceMap& pieces);
+    
+    /**
+     * @brief Set the size of the pieces hashed while downloading
+     * 
+     * Without published piece hashes, pieces are hashed as they are
+     * written and their hashes saved with the progress checkpoints, so a
+     * resumed download checks what the earlier session left on the disk
+     * and fetches again only the pieces that changed.
+     * 
+     * @param bytes The piece size in bytes (0 to disable)
+     */
+    void setPieceHashSize(int64_t bytes);
+    
+    /**
+     * @brief Get the piece hashes of the file
+     * 
+     * @return PieceMap The piece size and the hashes known so far, empty
+     *         if the file is not verified by piece
+     */
+    PieceMap getPieceMap() const;
+    
+    /**
+     * @brief Get the number of pieces fetched again after failing verification
+     * 
+     * @return int The number of repairs
+     */
+    int getRepairedPieceCount() const;
+    
+    /**
+     * @brief Get the byte ranges not yet written to the file
+     * 
+     * Bytes still sitting in write buffers count as missing, so a download
+     * restored from these ranges never skips data.
+     * 
+     * @return std::vector<SegmentRange> The ranges, empty if the download
+     *         cannot be resumed or has made no progress
+     */
+    std::vector<SegmentRange> getRemainingRanges() const;
+    
+    /**
+     * @brief Get the missing byte ranges once the data before them is durable
+     * 
+     * The output file is synced after the segment positions are read, so a
+     * checkpoint of these ranges survives a power loss as well as a crash.
+     * 
+     * @param ranges Receives the ranges
+     * @return true if the data is on the disk, false if the sync failed
+     */
+    bool commitRanges(std::vector<SegmentRange>& ranges);
+    
+    /**
+     * @brief Restore a download saved by an earlier session
+     * 
+     * The task keeps the saved ID. An unfinished download whose partial
+     * file is still there continues with the missing ranges, without
+     * probing the server again; anything else is left to start over.
+     * A finished, failed or canceled download just takes its status back.
+     * 
+     * @param id The saved task ID
+     * @param fileSize The file size in bytes
+     * @param supportsResume Whether the server supports range requests
+     * @param status The saved status (PAUSED stays paused, unfinished ones are queued)
+     * @param ranges The byte ranges still to download
+     * @return true if the download continues from the ranges or is finished, false otherwise
+     */
+    bool restore(const std::string& id, int64_t fileSize, bool supportsResume,
+                 DownloadStatus status, const std::vector<SegmentRange>& ranges);
+    
+    /**
+     * @brief Generate a new task ID
+     * 
+     * @return std::string 16 random lowercase hex digits
+     */
+    static std::string generateId();
+    
+    static constexpr int64_t DEFAULT_MIN_SPLIT_SIZE = 1024 * 1024;
+    static constexpr int64_t STREAMING_WINDOW_SIZE = 4 * 1024 * 1024;
+    static constexpr int INITIAL_ADAPTIVE_SEGMENTS = 2;
+    static constexpr int ADAPT_INTERVAL_SECONDS = 2;
+    static constexpr double ADAPT_GAIN_THRESHOLD = 1.1;     // Speed gain that justifies another connection
+    static constexpr int64_t MULTIPLEX_MAX_FILE_SIZE = 8 * 1024 * 1024;
+    static constexpr int SOURCE_CHECK_INTERVAL_SECONDS = 2;
+    static constexpr int SOURCE_GRACE_SECONDS = 6;          // Time a source is measured before it can be dropped
+    static constexpr double SLOW_SOURCE_RATIO = 0.1;        // Of the fastest source's speed per segment
+    static constexpr double SOURCE_SPEED_SMOOTHING = 0.3;   // Weight of the newest speed sample
+    static constexpr int MAX_PIECE_REPAIRS = 3;             // Times a piece is fetched again before the download fails
+    static constexpr size_t MAX_CONCURRENT_PROBES = 12;     // Mirrors and peers probed at once
+    
 private:
     /**
-     * @brief Check if the server supports range requests
+     * @brief A URL the file is fetched from
+     */
+    struct Source {
+        std::string url;
+        std::string resolvedUrl;    // url after redirects, used by segments
+        std::string etag;
+        bool usable = false;
+        double speed = 0.0;
+        int failures = 0;
+        bool peer = false;          // Served by PeerCache on the LAN, never through a proxy
+        int corruptPieces = 0;      // Pieces its segments wrote that failed verification
+        bool measuring = false;     // Had downloading segments at the last check
+        std::chrono::steady_clock::time_point measuredSince;
+    };
+    
+    /**
+     * @brief Pieces of a split file handed to the cluster's thread and its answers
+     * 
+     * Shared with the job, which syncs the file and works on the table
+     * without the task lock; advanceCluster() takes the answers.
+     */
+    struct ClusterHandover {
+        std::mutex mutex;
+        bool busy = false;                  // A job is queued or running
+        bool abandoned = false;             // The segments were recreated, leases taken go back
+        std::vector<size_t> completed;      // Pieces recorded done
+        std::vector<std::pair<size_t, ClusterLeaseState>> answers;     // Pieces asked for
+    };
+    
+
+    /**
+     * @brief Learn size, range support and validators of the resource
+     * 
+     * One ranged request replaces separate HEAD and range checks.
+     */
+    void probeServer();
+    
+    /**
+     * @brief Find a copy of an earlier download that a 304 would make current
+     * 
+     * @param cached Receives the validators of the copy
+     * @return true if one was found, false otherwise
+     */
+    bool findCachedCopy(CachedValidators& cached);
+    
+    /**
+     * @brief Complete from ContentStore when it has the expected content
+     * 
+     * @return true if the stored copy was put in place, false otherwise
+     */
+    bool placeStoredCopy();
+    
+    /**
+     * @brief Take the expected hash from the .sha256 file next to the URL, if the server has one
+     */
+    void fetchChecksumSidecar();
+    
+    /**
+     * @brief Add the managers on the LAN that may have the file as sources
+     * 
+     * Called from probeServer() with mutex_ held, before probeMirrors() asks them.
+     */
+    void addPeerSources();
+    
+    /**
+     * @brief Probe the mirrors and keep those consistent with the file
+     * 
+     * Called from probeServer() with mutex_ held.
+     * 
+     * @param primary The probe result of the task's URL
+     */
+    void probeMirrors(const HttpResponse& primary);
+    
+    /**
+     * @brief Pick the source for a new segment
+     * 
+     * Called with mutex_ held.
      * 
-     * @return true if the server supports range requests, false otherwise
+     * @return size_t Index into sources_
      */
-    bool checkRangeSupport();
+    size_t pickSource() const;
+    
+    /**
+     * @brief Count the unfinished segments of each source
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param downloadingOnly Count only segments that are downloading
+     * @return std::vector<int> Segment counts, by source index
+     */
+    std::vector<int> countSourceSegments(bool downloadingOnly) const;
+    
+    /**
+     * @brief Measure each source and drop the slow ones
+     * 
+     * Called with mutex_ held, from updateProgress().
+     */
+    void updateSources();
+    
+    /**
+     * @brief Stop using a source, moving its downloading ranges elsewhere
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param index Index into sources_
+     * @param reason Why it is dropped, for the log
+     */
+    void dropSource(size_t index, const std::string& reason);
+    
+    /**
+     * @brief Start checking pieces as they are written, if the file has piece hashes
+     * 
+     * Called from createSegments() with mutex_ held, before the restored
+     * ranges are taken.
+     */
+    void createPieceVerifier();
+    
+    /**
+     * @brief Open the filter sessions of the output file, abandoning those open
+     * 
+     * Called with mutex_ held.
+     */
+    void openFilters();
+    
+    /**
+     * @brief Fetch pieces that failed verification again
+     * 
+     * Called with mutex_ held. The sources that wrote them are blamed,
+     * the whole-file hash starts over.
+     * 
+     * @param failed The piece indices
+     * @return true if the download goes on, false if a piece failed too often
+     */
+    bool repairPieces(const std::vector<size_t>& failed);
+    
+    /**
+     * @brief Fetch again the pieces that failed since the last check
+     * 
+     * Called with mutex_ held.
+     * 
+     * @return true if the download goes on, false if a piece failed too often
+     */
+    bool checkPieces();
+    
+    /**
+     * @brief Check if the download is staged in memory instead of the file
+     * 
+     * @return true if it is no larger than the small file threshold, false otherwise
+     */
+    bool isSmallFile() const;
     
     /**
      * @brief Initialize the file
@@ -275,6 +801,124 @@ private:
      */
     bool createSegments();
     
+    /**
+     * @brief Create a segment wired to this task
+     * 
+     * @param startByte The starting byte offset
+     * @param endByte The ending byte offset
+     * @param id The segment ID
+     * @return std::shared_ptr<SegmentDownloader> The new segment (not started)
+     */
+    std::shared_ptr<SegmentDownloader> makeSegment(int64_t startByte, int64_t endByte, int id);
+    
+    /**
+     * @brief Find the slowest active segment with enough left to split
+     * 
+     * With streaming priority, the foremost one instead. Called with
+     * mutex_ held.
+     * 
+     * @return std::shared_ptr<SegmentDownloader> The segment, or nullptr
+     */
+    std::shared_ptr<SegmentDownloader> findSplitCandidate() const;
+    
+    /**
+     * @brief Move the tail of a segment's remaining range to a new segment
+     * 
+     * Called with mutex_ held. The new segment is added but not started.
+     * 
+     * @param victim The segment to shrink
+     * @param keepBytes Bytes the victim keeps (the split point is page aligned)
+     * @return std::shared_ptr<SegmentDownloader> The new segment, or nullptr
+     */
+    std::shared_ptr<SegmentDownloader> splitSegment(std::shared_ptr<SegmentDownloader> victim, int64_t keepBytes);
+    
+    /**
+     * @brief Count the segments that are downloading
+     * 
+     * @return int The number of active segments
+     */
+    int countActiveSegments() const;
+    
+    /**
+     * @brief Start waiting segments, then split active ones, up to the connection target
+     * 
+     * Called with mutex_ held. Segments whose host has no connection to
+     * spare stay waiting until a later call.
+     */
+    void scheduleSegments();
+    
+    /**
+     * @brief Lease a connection for a segment from the host limiter and start it
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param segment The segment
+     * @return true if started, false if refused a connection or the start failed
+     */
+    bool startSegment(std::shared_ptr<SegmentDownloader> segment);
+    
+    /**
+     * @brief Give back the connection of a segment
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param segmentId The segment ID
+     */
+    void releaseSegment(int segmentId);
+    
+    /**
+     * @brief Give back every connection and stop waiting for more
+     * 
+     * Called with mutex_ held.
+     */
+    void releaseConnections();
+    
+    /**
+     * @brief Decide whether the file is split across the nodes of the cluster
+     * 
+     * Called with mutex_ held, once the size is known.
+     * 
+     * @param filePath The destination file
+     * @return true if this node creates the file, false if another node does
+     */
+    bool joinCluster(const std::string& filePath);
+    
+    /**
+     * @brief Finish the pieces of a split file this node fetched and lease more
+     * 
+     * Called with mutex_ held. Syncing the file and the table work are
+     * posted to the cluster's thread, their outcome is taken on the next
+     * call. Pieces held by other nodes are asked for again every
+     * POLL_INTERVAL_MS, taken over once their lease has run out.
+     * 
+     * @return true once every piece is done, by any node
+     */
+    bool advanceCluster();
+    
+    /**
+     * @brief Drop the answers of cluster work posted so far, giving back leases it took
+     * 
+     * Called with mutex_ held.
+     */
+    void abandonClusterWork();
+    
+    /**
+     * @brief Recompute the derived progress fields and publish them
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param downloadedBytes Bytes downloaded so far
+     * @param downloadSpeed Download speed in bytes/second
+     */
+    void refreshProgress(int64_t downloadedBytes, double downloadSpeed);
+    
+    /**
+     * @brief Adjust the connection target from the measured throughput
+     * 
+     * Called with mutex_ held, from updateProgress().
+     */
+    void adaptConnections();
+    
     /**
      * @brief Create a metadata file for resuming downloads
      * 
@@ -298,8 +942,23 @@ private:
     
     /**
      * @brief Task completion handler
+     *
+     * Marks the task as completing and hands the read-backs, the commit and
+     * the rest of the completion work to the IoTaskExecutor, so a large file
+     * does not hold up the caller. Runs the work once, however many callers
+     * see the last segment finish.
      */
     void onTaskCompleted();
+
+    /**
+     * @brief Verify, commit and record the finished file
+     *
+     * Runs on an IoTaskExecutor worker, the read-backs without mutex_ held.
+     *
+     * @return true once the task finished or failed, false if pieces that
+     *         failed verification are fetched again
+     */
+    bool finalize();
     
     /**
      * @brief Segment completion handler
@@ -316,29 +975,93 @@ private:
      */
     void onSegmentError(std::shared_ptr<SegmentDownloader> segment, const std::string& error);
     
+    /**
+     * @brief Server busy handler
+     * 
+     * @param segment The segment that got the reply
+     * @param statusCode The HTTP status code (429 or 503)
+     * @return true if the segment should be parked, false to let it retry
+     */
+    bool onSegmentBackoff(std::shared_ptr<SegmentDownloader> segment, int statusCode);
+    
     // Member variables
     std::string url_;
+    std::string etag_;
+    std::string lastModified_;
+    std::vector<Source> sources_;   // sources_[0] is url_
+    std::map<int, size_t> segmentSources_;      // Segment ID to source index
+    std::vector<std::shared_ptr<SegmentDownloader>> retiredSegments_;  // Failed, range moved to another source
+    std::map<int, int64_t> segmentBytes_;       // Segment ID to downloaded bytes at the last sample
+    std::chrono::steady_clock::time_point lastSourceSample_;
+    std::chrono::steady_clock::time_point lastSourceCheck_;
+    int64_t expectedSize_ = -1;
+    std::string expectedHash_;
+    bool serverDigest_ = false;                 // expectedHash_ came from the server's Digest header
     std::string destinationPath_;
     std::string filename_;
     std::string id_;
     std::string error_;
     
     int64_t fileSize_ = 0;
-    DownloadStatus status_ = DownloadStatus::NONE;
+    std::atomic<DownloadStatus> status_{DownloadStatus::NONE};     // Read without the lock by getStatus
     DownloadPriority priority_ = DownloadPriority::NORMAL;
     DownloadType type_ = DownloadType::REGULAR;
     
     bool supportsResume_ = false;
     int segmentCount_ = 4;
     int segmentMaxRetries_ = 3;
+    TransferMode transferMode_ = TransferMode::THREADED;
+    std::shared_ptr<Throttler> throttler_;
+    std::shared_ptr<OutputFile> outputFile_;   // Shared by all segments
+    bool directIo_ = false;
+    std::shared_ptr<WriteBufferPool> writeBufferPool_;
+    size_t writeBufferSize_ = WriteBufferPool::DEFAULT_BUFFER_SIZE;
+    bool dynamicSplitting_ = true;
+    int64_t minSplitSize_ = DEFAULT_MIN_SPLIT_SIZE;
+    int nextSegmentId_ = 0;
+    std::vector<SegmentRange> restoredRanges_;  // Missing ranges of a restored download, until it starts
+    std::string clusterKey_;            // File key of a download split across nodes, empty if not split
+    std::vector<SegmentRange> clusterMissing_;          // Ranges no node had finished when the segments were created
+    std::vector<ClusterLeaseState> clusterPieces_;      // ACQUIRED while this node fetches the piece, HELD until done
+    int64_t clusterPieceSize_ = 0;
+    std::chrono::steady_clock::time_point clusterPolledAt_;
+    std::shared_ptr<ClusterHandover> clusterHandover_ = std::make_shared<ClusterHandover>();
+    int64_t restoredBytes_ = 0;         // Bytes written by earlier sessions and retired segments
+    bool externalProgress_ = false;     // Progress comes from publishProgress()
+    bool revalidate_ = false;
+    bool checksumSidecar_ = false;
+    bool upToDate_ = false;             // Completed by a 304 or from the content store, nothing was downloaded
+    bool streamingHash_ = false;
+    dm::utils::HashAlgorithm streamingHashAlgorithm_ = dm::utils::HashAlgorithm::SHA256;
+    std::shared_ptr<StreamingHasher> hasher_;
+    PieceMap pieces_;                   // Set or restored, or hashed here once the size is known
+    int64_t pieceHashSize_ = 0;
+    std::shared_ptr<PieceVerifier> pieceVerifier_;
+    std::map<size_t, int> pieceRepairs_;        // Piece index to times fetched again
+    int repairedPieces_ = 0;
+    bool finalizing_ = false;           // Completion work is queued or running
+    std::shared_ptr<ContentSniffer> sniffer_;
+    std::shared_ptr<DataFilterChain> filters_;
+    bool multiplexing_ = false;
+    int64_t smallFileThreshold_ = 0;
+    bool adaptiveSegments_ = false;
+    bool streamingPriority_ = false;
+    int targetConnections_ = 0;         // Segments that should be downloading at once
+    std::map<int, HostConnectionLimiter::Lease> segmentLeases_;     // Segment ID to its connection
+    std::map<int, ProxyPool::Lease> segmentProxyLeases_;            // Segment ID to its proxy, through the pool
+    bool waitingForHost_ = false;       // A segment was refused a connection
+    bool adaptSettled_ = false;         // Stop probing for more connections
+    double adaptSpeed_ = 0.0;           // Aggregate speed at the last target change
+    std::chrono::steady_clock::time_point lastAdaptTime_;
     
     std::chrono::system_clock::time_point startTime_;
     std::chrono::system_clock::time_point lastUpdateTime_;
     
-    mutable std::mutex mutex_;
+    mutable std::recursive_mutex mutex_;   // Recursive: status changes are made from locked sections
     std::vector<std::shared_ptr<SegmentDownloader>> segments_;
     
-    ProgressInfo progressInfo_;
+    ProgressInfo progressInfo_;                         // Working copy, guarded by mutex_
+    dm::utils::SeqLock<ProgressInfo> progressSnapshot_; // Published copy for readers
     TaskProgressCallback progressCallback_ = nullptr;
     StatusChangeCallback statusChangeCallback_ = nullptr;
     
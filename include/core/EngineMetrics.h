@@ -0,0 +1,165 @@
+#ifndef ENGINE_METRICS_H
+#define ENGINE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Latencies recorded as histograms
+ */
+enum class LatencyMetric {
+    CONNECT,            // Round trip of a transfer's connection
+    FIRST_BYTE,         // Request sent to first byte
+    THROTTLE_WAIT,      // Wait for bandwidth tokens
+    DISK_WRITE,         // One positioned write to an output file
+    COUNT
+};
+
+/**
+ * @brief Events recorded as counters
+ */
+enum class EventMetric {
+    SEGMENT_RETRIES,    // Segment attempts after the first
+    HASHED_BYTES,       // Bytes fed to streaming hashes
+    HASH_NANOSECONDS,   // Time spent hashing them, exported in seconds
+    COUNT
+};
+
+/**
+ * @brief Cumulative histogram of one latency
+ */
+struct LatencySnapshot {
+    std::array<uint64_t, 14> buckets{};     // Observations at most each bound, cumulative
+    uint64_t count = 0;
+    double sumSeconds = 0.0;
+};
+
+/**
+ * @brief Process-wide engine timings for the metrics exporter
+ *
+ * Off until an exporter enables it: every recording site checks
+ * isEnabled() before it reads a clock, so an engine nobody scrapes pays
+ * one relaxed load per site. Once enabled, recording is a few relaxed
+ * atomic increments, never a lock.
+ */
+class EngineMetrics {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return EngineMetrics& The singleton instance
+     */
+    static EngineMetrics& getInstance();
+
+    /**
+     * @brief Start or stop recording
+     *
+     * @param enabled True to record
+     */
+    void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * @brief Check if recording
+     *
+     * @return true if recording, false otherwise
+     */
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Record a latency
+     *
+     * @param metric The latency
+     * @param seconds The duration in seconds
+     */
+    void observe(LatencyMetric metric, double seconds);
+
+    /**
+     * @brief Record events
+     *
+     * @param metric The event
+     * @param count The number of events, or bytes or nanoseconds
+     */
+    void count(EventMetric metric, int64_t count = 1) {
+        if (isEnabled()) {
+            events_[static_cast<size_t>(metric)].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Get a latency histogram
+     *
+     * @param metric The latency
+     * @return LatencySnapshot The histogram
+     */
+    LatencySnapshot getLatency(LatencyMetric metric) const;
+
+    /**
+     * @brief Get an event counter
+     *
+     * @param metric The event
+     * @return int64_t The count
+     */
+    int64_t getCount(EventMetric metric) const;
+
+    /**
+     * @brief Get the metric name of a latency
+     *
+     * @param metric The latency
+     * @return const char* The name, without unit suffix
+     */
+    static const char* getLatencyName(LatencyMetric metric);
+
+    /**
+     * @brief Get the metric name of an event counter
+     *
+     * @param metric The event
+     * @return const char* The name, without the _total suffix
+     */
+    static const char* getEventName(EventMetric metric);
+
+    /**
+     * @brief Get a monotonic clock reading for timing
+     *
+     * @return int64_t Nanoseconds
+     */
+    static int64_t nowNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Upper bounds of the histogram buckets in seconds, from half a millisecond to ten seconds
+    static constexpr std::array<double, 14> BUCKET_BOUNDS = {
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+    };
+
+private:
+    struct alignas(64) Histogram {
+        std::array<std::atomic<uint64_t>, BUCKET_BOUNDS.size() + 1> buckets{};   // Last one above every bound
+        std::atomic<uint64_t> sumNanoseconds{0};
+    };
+
+    /**
+     * @brief Construct a new EngineMetrics
+     */
+    EngineMetrics() = default;
+
+    // Prevent copying
+    EngineMetrics(const EngineMetrics&) = delete;
+    EngineMetrics& operator=(const EngineMetrics&) = delete;
+
+    // Member variables
+    std::atomic<bool> enabled_{false};
+    Histogram latencies_[static_cast<size_t>(LatencyMetric::COUNT)];
+    std::atomic<int64_t> events_[static_cast<size_t>(EventMetric::COUNT)] = {};
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // ENGINE_METRICS_H
@@ -6,7 +6,12 @@
 #include <memory>
 #include <functional>
 #include <filesystem>
+#include <map>
+#include <mutex>
 #include "../utils/FileUtils.h"
+#include "OutputFile.h"
+#include "DeviceIoScheduler.h"
+#include "DiskSpaceLedger.h"
 
 namespace fs = std::filesystem;
 
@@ -50,6 +55,12 @@ public:
      */
     bool writeToFile(const std::string& filePath, const char* data, int64_t offset, size_t size);
     
+    /**
+     * @brief Closes a file kept open by writeToFile
+     * @param filePath The path of the file to close
+     */
+    void closeFile(const std::string& filePath);
+    
     /**
      * @brief Checks if a file exists and is valid for resuming a download
      * @param filePath The path of the file to check
@@ -95,6 +106,20 @@ public:
      */
     int64_t getAvailableDiskSpace(const std::string& directoryPath);
     
+    /**
+     * @brief Gets the free space in the directory not reserved by started downloads
+     * @param directoryPath The path of the directory
+     * @return The free space less the reservations on its file system in bytes, or -1 if unknown
+     */
+    int64_t getUnreservedDiskSpace(const std::string& directoryPath);
+    
+    /**
+     * @brief Gets the storage device a path sits on
+     * @param path The path of a file or directory, which need not exist yet
+     * @return The device, with an UNKNOWN kind if it could not be detected
+     */
+    dm::core::StorageDeviceInfo getStorageDevice(const std::string& path);
+    
     /**
      * @brief Splits a file into segments for multi-part downloads
      * @param filePath The path of the file to split
@@ -125,6 +150,16 @@ private:
      * @return A unique temporary file path
      */
     std::string generateTempFileName(const std::string& basePath);
+    
+    /**
+     * @brief Gets the cached open file for a path, opening it on first use
+     * @param filePath The path of the file
+     * @return The open file, or nullptr if it could not be opened
+     */
+    std::shared_ptr<dm::core::OutputFile> getOpenFile(const std::string& filePath);
+    
+    std::map<std::string, std::shared_ptr<dm::core::OutputFile>> openFiles_;
+    std::mutex openFilesMutex_;
 };
 
 } // namespace Core
@@ -0,0 +1,280 @@
+#ifndef FTP_MIRROR_H
+#define FTP_MIRROR_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+namespace dm {
+namespace core {
+
+// Forward declarations
+class DownloadManager;
+
+/**
+ * @brief An entry of a remote FTP directory
+ */
+struct FtpMirrorEntry {
+    std::string name;
+    std::string url;                    // Remote URL, with a trailing '/' for directories
+    std::string localPath;              // Where the file is mirrored to
+    bool isDirectory = false;
+    int64_t size = -1;                  // Size in bytes, -1 if unknown
+    int64_t modified = -1;              // Modification time (Unix seconds, UTC), -1 if unknown
+    int64_t modifiedPrecision = 1;      // Seconds the modification time may be off by
+    int depth = 0;                      // Directories below the mirror root
+};
+
+/**
+ * @brief Mirror file handler type
+ *
+ * Called for each new or changed file instead of queueing a download
+ */
+using FtpMirrorFileHandler = std::function<void(const FtpMirrorEntry& entry)>;
+
+/**
+ * @brief Mirror progress callback type
+ */
+using FtpMirrorProgressCallback = std::function<void(int directoriesListed, int filesFound,
+                                                    int filesQueued, int filesSkipped)>;
+
+/**
+ * @brief Mirror options structure
+ */
+struct FtpMirrorOptions {
+    int maxConcurrentListings = 4;                  // Directories listed at once, each on its own session
+    int maxDepth = -1;                              // Directory levels to descend (-1 for no limit)
+    bool skipUnchanged = true;                      // Skip files whose size and mtime match the local copy
+    bool startDownloads = true;                     // Start queued downloads right away
+    int timeoutSeconds = 30;                        // Seconds a listing may stall
+    FtpMirrorFileHandler fileHandler = nullptr;     // Custom file handler
+};
+
+/**
+ * @brief Recursive FTP directory mirror
+ *
+ * Walks a remote tree with several listing workers at once. Each worker
+ * lists on a pooled handle, so it keeps a control session logged in to
+ * the server between directories. Listings use MLSD for exact sizes and
+ * UTC modification times; servers without it fall back to parsing LIST.
+ *
+ * Files are checked against the local tree as their directory's listing
+ * arrives and new or changed ones go to the download manager straight
+ * away, while the rest of the tree is still being walked. Completed
+ * downloads carry the server's modification time, so the next run skips
+ * them on size and mtime.
+ */
+class FtpMirror {
+public:
+    /**
+     * @brief Construct a new FtpMirror
+     *
+     * @param downloadManager Reference to download manager
+     */
+    explicit FtpMirror(DownloadManager& downloadManager);
+
+    /**
+     * @brief Destroy the FtpMirror
+     */
+    ~FtpMirror();
+
+    /**
+     * @brief Start mirroring a remote directory
+     *
+     * @param remoteUrl The ftp:// or ftps:// URL of the directory
+     * @param localDirectory The local directory to mirror into
+     * @param options Mirror options
+     * @param progressCallback Optional progress callback
+     * @return true if mirroring started successfully, false otherwise
+     */
+    bool startMirroring(const std::string& remoteUrl,
+                        const std::string& localDirectory,
+                        const FtpMirrorOptions& options = FtpMirrorOptions(),
+                        FtpMirrorProgressCallback progressCallback = nullptr);
+
+    /**
+     * @brief Stop mirroring
+     *
+     * @return true if stopped successfully, false otherwise
+     */
+    bool stopMirroring();
+
+    /**
+     * @brief Check if the mirror is running
+     *
+     * @return true if running, false otherwise
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Get mirror statistics
+     *
+     * @param directoriesListed Output parameter for directories listed
+     * @param filesFound Output parameter for files found
+     * @param filesQueued Output parameter for downloads queued
+     * @param filesSkipped Output parameter for unchanged files skipped
+     */
+    void getStatistics(int& directoriesListed, int& filesFound,
+                       int& filesQueued, int& filesSkipped) const;
+
+    /**
+     * @brief Get errors that occurred during mirroring
+     *
+     * @return std::map<std::string, std::string> Map of URL to error message
+     */
+    std::map<std::string, std::string> getErrors() const;
+
+    /**
+     * @brief Parse one line of an MLSD listing
+     *
+     * @param line The line, e.g. "type=file;size=42;modify=20240101120000; a.txt"
+     * @param entry Receives the name, type, size and modification time
+     * @return true if the line is a file or directory, false otherwise
+     */
+    static bool parseMlsdLine(const std::string& line, FtpMirrorEntry& entry);
+
+    /**
+     * @brief Parse one line of a Unix-style LIST listing
+     *
+     * @param line The line, e.g. "-rw-r--r-- 1 ftp ftp 42 Jan  1 12:00 a.txt"
+     * @param entry Receives the name, type, size and modification time
+     * @return true if the line is a file or directory, false otherwise
+     */
+    static bool parseListLine(const std::string& line, FtpMirrorEntry& entry);
+
+    /**
+     * @brief Check if a local file already matches a remote one
+     *
+     * @param entry The remote file
+     * @param localPath The local file
+     * @return true if the sizes and modification times match, false otherwise
+     */
+    static bool isUnchanged(const FtpMirrorEntry& entry, const std::string& localPath);
+
+private:
+    /**
+     * @brief Listing stage thread body
+     */
+    void listingWorker();
+
+    /**
+     * @brief Download stage thread body
+     */
+    void fileWorker();
+
+    /**
+     * @brief List one directory, queueing its files and subdirectories
+     *
+     * @param directory The directory
+     */
+    void listDirectory(const FtpMirrorEntry& directory);
+
+    /**
+     * @brief Fetch a listing with one command
+     *
+     * @param url The directory URL
+     * @param command "MLSD" or "LIST"
+     * @param lineHandler Called for each line as it arrives
+     * @param responseCode Receives the server's last reply code
+     * @param error Receives the error message on failure
+     * @return true if successful, false otherwise
+     */
+    bool fetchListing(const std::string& url, const char* command,
+                      const std::function<void(const std::string&)>& lineHandler,
+                      long& responseCode, std::string& error);
+
+    /**
+     * @brief Handle one listed entry of a directory
+     *
+     * @param directory The directory it was listed in
+     * @param entry The entry, with name, type, size and time filled in
+     */
+    void addEntry(const FtpMirrorEntry& directory, FtpMirrorEntry entry);
+
+    /**
+     * @brief Queue a file for the download stage
+     *
+     * @param entry The file
+     */
+    void queueFile(FtpMirrorEntry entry);
+
+    /**
+     * @brief Hand a new or changed file on
+     *
+     * @param entry The file
+     */
+    void handleFile(const FtpMirrorEntry& entry);
+
+    /**
+     * @brief Account for a directory that has been listed
+     */
+    void finishDirectory();
+
+    /**
+     * @brief Record an error for a URL
+     *
+     * @param url The URL
+     * @param error The error message
+     */
+    void recordError(const std::string& url, const std::string& error);
+
+    /**
+     * @brief Update statistics and call the progress callback
+     */
+    void updateStatistics();
+
+    /**
+     * @brief Wake every waiting worker
+     */
+    void notifyAll();
+
+    /**
+     * @brief Join all worker threads
+     */
+    void joinWorkers();
+
+    // Member variables
+    DownloadManager& downloadManager_;
+    FtpMirrorOptions options_;
+    FtpMirrorProgressCallback progressCallback_ = nullptr;
+    std::string rootUrl_;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> stopRequested_;
+    std::atomic<bool> useMlsd_;             // Cleared once the server rejects MLSD
+    std::atomic<bool> finished_;            // Every directory has been listed
+    std::atomic<int> pendingDirectories_;   // Queued or being listed
+
+    std::atomic<int> directoriesListed_;
+    std::atomic<int> filesFound_;
+    std::atomic<int> filesQueued_;
+    std::atomic<int> filesSkipped_;
+
+    // Listing stage
+    std::deque<FtpMirrorEntry> directoryQueue_;
+    std::mutex directoryMutex_;
+    std::condition_variable directoryChanged_;
+
+    // Download stage
+    std::deque<FtpMirrorEntry> fileQueue_;
+    std::mutex fileMutex_;
+    std::condition_variable fileChanged_;
+
+    std::vector<std::thread> workerThreads_;
+
+    std::map<std::string, std::string> errors_;
+    mutable std::mutex resultsMutex_;
+    std::mutex statsMutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // FTP_MIRROR_H
@@ -0,0 +1,71 @@
+#ifndef HOST_CONNECTION_CACHE_H
+#define HOST_CONNECTION_CACHE_H
+
+#include <string>
+#include <map>
+#include <mutex>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief In-memory cache of learned connection counts per origin
+ *
+ * Adaptive downloads record the number of parallel connections that stopped
+ * improving throughput (or that the server tolerated before answering 429 or
+ * 503), so later downloads from the same origin start at that count.
+ */
+class HostConnectionCache {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return HostConnectionCache& The singleton instance
+     */
+    static HostConnectionCache& getInstance();
+
+    /**
+     * @brief Get the learned connection count for a URL's origin
+     *
+     * @param url The URL
+     * @return int The connection count, or 0 if nothing was learned yet
+     */
+    int getConnectionCount(const std::string& url) const;
+
+    /**
+     * @brief Record the connection count for a URL's origin
+     *
+     * @param url The URL
+     * @param count The connection count
+     */
+    void setConnectionCount(const std::string& url, int count);
+
+    /**
+     * @brief Forget all learned counts
+     */
+    void clear();
+
+private:
+    /**
+     * @brief Construct a new HostConnectionCache
+     */
+    HostConnectionCache() = default;
+
+    /**
+     * @brief Destroy the HostConnectionCache
+     */
+    ~HostConnectionCache() = default;
+
+    // Prevent copying
+    HostConnectionCache(const HostConnectionCache&) = delete;
+    HostConnectionCache& operator=(const HostConnectionCache&) = delete;
+
+    // Member variables
+    std::map<std::string, int> counts_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // HOST_CONNECTION_CACHE_H
@@ -0,0 +1,253 @@
+#ifndef HOST_CONNECTION_LIMITER_H
+#define HOST_CONNECTION_LIMITER_H
+
+#include <string>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Process-wide connection budget per origin and server address
+ *
+ * Every connection a segment, crawler fetch or other transfer opens is
+ * leased here first, keyed by origin as CurlHandlePool keys its handles and
+ * by the address DnsCache resolved the host to. A lease is refused once the
+ * origin, the address or the whole process is at its limit.
+ *
+ * Owners that were refused line up per origin and are served round-robin:
+ * an owner that has just been given a connection goes to the back of the
+ * line before it gets another, so ten downloads from one host share its
+ * connections instead of the first one taking them all. Each line holds an
+ * owner only while it keeps asking; one that has not asked again for
+ * WAITER_TIMEOUT_MS loses its place.
+ *
+ * Origins share the overall limit. An origin may go beyond an even share
+ * of it while connections lie idle, but leaves one free for each other
+ * origin that is waiting, so a busy origin hands the connections it gives
+ * back to the waiting ones.
+ */
+class HostConnectionLimiter {
+public:
+    /**
+     * @brief Handle of one granted connection, 0 for none
+     */
+    using Lease = uint64_t;
+
+    /**
+     * @brief Callback for connections given back while owners are waiting
+     */
+    using ReleaseCallback = std::function<void()>;
+
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return HostConnectionLimiter& The singleton instance
+     */
+    static HostConnectionLimiter& getInstance();
+
+    /**
+     * @brief Lease a connection to the origin of a URL
+     *
+     * A refused owner waits in the origin's line and should ask again.
+     *
+     * @param url The URL the connection is for
+     * @param owner The download or crawl asking, for round-robin order
+     * @return Lease The lease, or 0 if the connection has to wait
+     */
+    Lease acquire(const std::string& url, const std::string& owner);
+
+    /**
+     * @brief Give a connection back
+     *
+     * @param lease The lease (0 is ignored)
+     */
+    void release(Lease lease);
+
+    /**
+     * @brief Take an owner out of every line
+     *
+     * @param owner The owner
+     */
+    void withdraw(const std::string& owner);
+
+    /**
+     * @brief Check if a new owner would get a connection to a URL's origin now
+     *
+     * @param url The URL
+     * @return true if a connection is free and nobody is waiting for the origin
+     */
+    bool hasCapacity(const std::string& url) const;
+
+    /**
+     * @brief Get the number of leased connections to a URL's origin
+     *
+     * @param url The URL
+     * @return int The number of connections
+     */
+    int getConnectionCount(const std::string& url) const;
+
+    /**
+     * @brief Get the number of leased connections overall
+     *
+     * @return int The number of connections
+     */
+    int getTotalConnectionCount() const;
+
+    /**
+     * @brief Set the limits
+     *
+     * @param perHost Maximum connections to one origin (0 for no limit)
+     * @param perAddress Maximum connections to one server address (0 for no limit)
+     * @param total Maximum connections overall (0 for no limit)
+     */
+    void setLimits(int perHost, int perAddress, int total);
+
+    /**
+     * @brief Set only the overall limit
+     *
+     * @param total Maximum connections overall (0 for no limit)
+     */
+    void setMaxConnections(int total);
+
+    /**
+     * @brief Get the maximum connections to one origin
+     *
+     * @return int The maximum (0 for no limit)
+     */
+    int getMaxConnectionsPerHost() const;
+
+    /**
+     * @brief Get the maximum connections to one server address
+     *
+     * @return int The maximum (0 for no limit)
+     */
+    int getMaxConnectionsPerAddress() const;
+
+    /**
+     * @brief Get the maximum connections overall
+     *
+     * @return int The maximum (0 for no limit)
+     */
+    int getMaxConnections() const;
+
+    /**
+     * @brief Set the callback for connections given back while owners wait
+     *
+     * Called without the limiter's lock, on the releasing thread; it should
+     * only wake whatever retries the waiting owners.
+     *
+     * @param callback The callback function
+     */
+    void setReleaseCallback(ReleaseCallback callback);
+
+    static constexpr int DEFAULT_MAX_CONNECTIONS_PER_HOST = 8;
+    static constexpr int DEFAULT_MAX_CONNECTIONS_PER_ADDRESS = 16;
+    static constexpr int DEFAULT_MAX_CONNECTIONS = 64;
+    static constexpr int WAITER_TIMEOUT_MS = 2000;
+
+private:
+    /**
+     * @brief An owner waiting for a connection to an origin
+     */
+    struct Waiter {
+        std::string owner;
+        std::chrono::steady_clock::time_point lastAsked;
+    };
+
+    /**
+     * @brief Connections and line of one origin
+     */
+    struct Host {
+        int connections = 0;
+        std::deque<Waiter> waiters;
+    };
+
+    /**
+     * @brief Where a lease counts
+     */
+    struct LeaseInfo {
+        std::string host;
+        std::string address;        // Empty if the host was not resolved yet
+    };
+
+    /**
+     * @brief Construct a new HostConnectionLimiter
+     */
+    HostConnectionLimiter() = default;
+
+    /**
+     * @brief Destroy the HostConnectionLimiter
+     */
+    ~HostConnectionLimiter() = default;
+
+    // Prevent copying
+    HostConnectionLimiter(const HostConnectionLimiter&) = delete;
+    HostConnectionLimiter& operator=(const HostConnectionLimiter&) = delete;
+
+    /**
+     * @brief Check the limits for one more connection to an origin
+     *
+     * Called with mutex_ held.
+     *
+     * @param key The origin key
+     * @param host The origin, nullptr if it has no connections or waiters
+     * @param address The server address, empty if unknown
+     * @return true if the connection fits, false otherwise
+     */
+    bool admits(const std::string& key, const Host* host, const std::string& address) const;
+
+    /**
+     * @brief Drop waiters that stopped asking
+     *
+     * Called with mutex_ held.
+     *
+     * @param host The origin
+     * @param now The current time
+     */
+    void pruneWaiters(Host& host, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Drop waiters that stopped asking from every line, and the
+     *        origins left idle
+     *
+     * Called with mutex_ held.
+     *
+     * @param now The current time
+     */
+    void pruneAll(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Forget an origin that has no connections or waiters
+     *
+     * Called with mutex_ held.
+     *
+     * @param it The origin
+     */
+    void eraseIfIdle(std::unordered_map<std::string, Host>::iterator it);
+
+    // Member variables
+    std::unordered_map<std::string, Host> hosts_;      // Origins with connections or waiters
+    std::map<std::string, int> addresses_;             // Connections per server address
+    std::unordered_map<Lease, LeaseInfo> leases_;
+    Lease nextLease_ = 1;
+    int connections_ = 0;
+    int waitingHosts_ = 0;                              // Origins with a non-empty line
+    std::chrono::steady_clock::time_point lastPrune_;
+    int maxPerHost_ = DEFAULT_MAX_CONNECTIONS_PER_HOST;
+    int maxPerAddress_ = DEFAULT_MAX_CONNECTIONS_PER_ADDRESS;
+    int maxTotal_ = DEFAULT_MAX_CONNECTIONS;
+    ReleaseCallback releaseCallback_ = nullptr;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // HOST_CONNECTION_LIMITER_H
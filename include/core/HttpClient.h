@@ -6,20 +6,37 @@
 #include <vector>
 #include <functional>
 #include <memory>
+#include <atomic>
 #include <curl/curl.h>
 
+#include "core/HttpHeaders.h"
+
 namespace dm {
 namespace core {
 
+class Throttler;
+class OutputFile;
+
 /**
  * @brief HTTP response data structure
  */
 struct HttpResponse {
     int statusCode = 0;
-    std::map<std::string, std::string> headers;
-    std::vector<char> body;
+    HttpHeaders headers;                            // Of the final response after redirects
+    std::vector<char> body;                         // Empty when the body went to a data callback
     std::string error;
     bool success = false;
+    
+    // Entity metadata parsed from the headers
+    int64_t contentLength = -1;     // Full resource size (a 206 reports it in Content-Range), -1 if unknown or encoded
+    bool acceptsRanges = false;     // Byte ranges are honoured
+    std::string etag;
+    std::string lastModified;
+    std::string digestAlgorithm;    // "sha-256" or "sha-512" of Repr-Digest or Digest, empty if not given
+    std::string digest;             // Of the whole file, lowercase hex
+    std::string effectiveUrl;       // URL after redirects
+    CURLcode curlCode = CURLE_OK;   // Transport result
+    int retryAfter = -1;            // Seconds asked by Retry-After, -1 if not given
 };
 
 /**
@@ -45,13 +62,26 @@ using ProgressCallback = std::function<bool(int64_t downloadTotal, int64_t downl
  */
 using DataCallback = std::function<bool(const char* data, size_t size)>;
 
+/**
+ * @brief HTTP headers callback function type
+ * 
+ * Called once with the headers of the final response, before its body
+ * 
+ * @param headers The response headers, valid for the duration of the call
+ * @return true to receive the body, false to skip it
+ */
+using HeadersCallback = std::function<bool(const HttpHeaders& headers)>;
+
 /**
  * @brief HTTP client class for making HTTP requests
  * 
- * Uses libcurl for handling HTTP/HTTPS communication
+ * Uses libcurl for handling HTTP/HTTPS communication. Easy handles are
+ * checked out of CurlHandlePool per request so connections are reused.
  */
 class HttpClient {
 public:
+    static constexpr size_t DEFAULT_MAX_BODY_SIZE = 64 * 1024 * 1024;
+    
     /**
      * @brief Construct a new HttpClient object
      */
@@ -112,6 +142,27 @@ public:
      */
     HttpClient& setDataCallback(DataCallback callback);
     
+    /**
+     * @brief Set the proxy requests go out through
+     * 
+     * Handles are pooled per proxy, so requests through the same proxy
+     * reuse its connections.
+     * 
+     * @param proxy The proxy URL, such as "http://10.0.0.1:3128", empty to connect directly
+     * @return HttpClient& Reference to this object for method chaining
+     */
+    HttpClient& setProxy(const std::string& proxy);
+    
+    /**
+     * @brief Set the headers callback
+     * 
+     * A skipped body does not make the request fail.
+     * 
+     * @param callback The headers callback function
+     * @return HttpClient& Reference to this object for method chaining
+     */
+    HttpClient& setHeadersCallback(HeadersCallback callback);
+    
     /**
      * @brief Set whether to follow redirects
      * 
@@ -120,6 +171,43 @@ public:
      */
     HttpClient& followRedirects(bool follow);
     
+    /**
+     * @brief Set the throttler applied to received data
+     * 
+     * When set, the total request timeout is replaced by a stall timeout
+     * since a throttled transfer may legitimately take longer.
+     * 
+     * @param throttler The throttler (nullptr for none)
+     * @return HttpClient& Reference to this object for method chaining
+     */
+    HttpClient& setThrottler(std::shared_ptr<Throttler> throttler);
+    
+    /**
+     * @brief Limit how much of a response body is kept in HttpResponse::body
+     * 
+     * A larger body fails the request as soon as it passes the limit
+     * instead of growing the buffer further; a body streamed to a data
+     * callback is not limited.
+     * 
+     * @param maxBodySize The limit in bytes (0 for none)
+     * @return HttpClient& Reference to this object for method chaining
+     */
+    HttpClient& setMaxBodySize(size_t maxBodySize);
+    
+    /**
+     * @brief Set whether whole-resource GETs offer compressed encodings
+     * 
+     * Asks for gzip, br and zstd, as far as libcurl can decode them. The
+     * body is inflated as it arrives, so data callbacks and the stored
+     * body see the decoded bytes and the size limit applies to those.
+     * Range requests, probes and uploads always use the identity encoding
+     * so byte offsets keep matching the resource.
+     * 
+     * @param accept True to offer compression, false for identity only
+     * @return HttpClient& Reference to this object for method chaining
+     */
+    HttpClient& setAcceptCompression(bool accept);
+    
     /**
      * @brief Perform a HEAD request
      * 
@@ -136,6 +224,19 @@ public:
      */
     HttpResponse get(const std::string& url);
     
+    /**
+     * @brief Perform a GET request, streaming the body
+     * 
+     * The body is passed to the callback chunk by chunk as it arrives, in
+     * place of the data callback set on the client, and is not stored in
+     * the response. The headers callback still runs first.
+     * 
+     * @param url The URL to request
+     * @param dataCallback Receives the body, return false to abort
+     * @return HttpResponse The response, without a body
+     */
+    HttpResponse get(const std::string& url, DataCallback dataCallback);
+    
     /**
      * @brief Perform a GET request with a byte range
      * 
@@ -146,6 +247,19 @@ public:
      */
     HttpResponse getRange(const std::string& url, int64_t startByte, int64_t endByte);
     
+    /**
+     * @brief Fetch everything needed to plan a download in one round trip
+     * 
+     * Sends a GET for the first byte. A 206 reply carries the size, range
+     * support, ETag, Last-Modified and the final URL; a server ignoring the
+     * range is cut off after its headers. FTP URLs are probed with SIZE,
+     * MDTM and REST 0 instead.
+     * 
+     * @param url The URL to probe
+     * @return HttpResponse The response with its entity fields filled in
+     */
+    HttpResponse probe(const std::string& url);
+    
     /**
      * @brief Check if a server supports range requests
      * 
@@ -195,11 +309,45 @@ public:
                             int64_t startByte, int64_t endByte,
                             ProgressCallback progressCallback = nullptr);
     
+    /**
+     * @brief Download a file segment into a shared output file
+     * 
+     * Data is written with positional writes at startByte onwards.
+     * 
+     * @param url The URL to download
+     * @param file The open output file
+     * @param startByte The starting byte offset
+     * @param endByte The ending byte offset
+     * @param progressCallback Optional progress callback
+     * @return true if successful, false otherwise
+     */
+    bool downloadFileSegment(const std::string& url, OutputFile& file,
+                            int64_t startByte, int64_t endByte,
+                            ProgressCallback progressCallback = nullptr);
+    
     /**
      * @brief Abort the current operation
      */
     void abort();
     
+    /**
+     * @brief Check if a URL is served over FTP or FTPS
+     * 
+     * @param url The URL to check
+     * @return true if the scheme is ftp or ftps, false otherwise
+     */
+    static bool isFtpUrl(const std::string& url);
+    
+    /**
+     * @brief Fill in the entity fields of a response from its headers
+     * 
+     * For responses received without this client, such as probes driven by
+     * the TransferEngine.
+     * 
+     * @param response The response
+     */
+    static void parseEntityHeaders(HttpResponse& response);
+    
 private:
     /**
      * @brief Set up common CURL options
@@ -213,14 +361,19 @@ private:
      * @brief Perform a CURL request
      * 
      * @param curl The CURL handle
+     * @param maxBodySize Stop once this much body is stored (0 for no limit)
+     * @param dataCallback Receives the body in place of the client's data callback
+     * @param rangeStart First byte of the requested range, a 200 reply fails the request when above 0
      * @return HttpResponse The response
      */
-    HttpResponse performRequest(CURL* curl);
+    HttpResponse performRequest(CURL* curl, size_t maxBodySize = 0, DataCallback dataCallback = nullptr,
+                                int64_t rangeStart = -1);
     
     // CURL callback functions
     static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp);
     static size_t headerCallback(void* contents, size_t size, size_t nmemb, void* userp);
     static int progressCallback(void* clientp, double dltotal, double dlnow, double ultotal, double ulnow);
+    static curl_socket_t openSocketCallback(void* clientp, curlsocktype purpose, struct curl_sockaddr* address);
     
     // Member variables
     std::map<std::string, std::string> headers_;
@@ -228,13 +381,20 @@ private:
     int timeoutSeconds_ = 30;
     std::string userAgent_ = "DownloadManager/1.0";
     bool followRedirects_ = true;
-    bool aborted_ = false;
+    std::atomic<bool> aborted_{false};
+    size_t maxBodySize_ = DEFAULT_MAX_BODY_SIZE;
+    bool acceptCompression_ = false;
+    std::string proxy_;
     
     ProgressCallback progressCallback_ = nullptr;
     DataCallback dataCallback_ = nullptr;
+    HeadersCallback headersCallback_ = nullptr;
+    std::shared_ptr<Throttler> throttler_;
     
-    // CURL easy handle
-    CURL* curl_ = nullptr;
+    // Request header and resolve lists for the transfer in progress
+    struct curl_slist* headerList_ = nullptr;
+    struct curl_slist* resolveList_ = nullptr;
+    bool decodingBody_ = false;                     // The transfer in progress offered compression
 };
 
 } // namespace core
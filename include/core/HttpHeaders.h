@@ -0,0 +1,176 @@
+#ifndef HTTP_HEADERS_H
+#define HTTP_HEADERS_H
+
+#include <string_view>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Header fields of one HTTP response
+ *
+ * Names and values are copied into a monotonic arena owned by the headers
+ * and indexed by a flat vector sorted by name, itself in the arena, so a
+ * response with the usual dozen or so headers costs no allocation once its
+ * thread's arenas are warm, instead of two strings and a tree node per
+ * header. Names are lowercased as they are added; a repeated header keeps
+ * its last value, as the map this replaces did.
+ *
+ * The headers the transfer code looks at on every request are parsed into
+ * typed fields as they are added. Views handed out stay valid until the
+ * headers are cleared, assigned to or destroyed.
+ */
+class HttpHeaders {
+public:
+    /**
+     * @brief One header, named like the pair of a map
+     */
+    struct Field {
+        std::string_view first;         // Name, lowercase
+        std::string_view second;        // Value, trimmed
+    };
+
+    using const_iterator = const Field*;
+
+    /**
+     * @brief Construct empty headers, without an arena until the first add()
+     */
+    HttpHeaders() = default;
+
+    /**
+     * @brief Destroy the headers, giving the arena back to the thread's pool
+     */
+    ~HttpHeaders() = default;
+
+    /**
+     * @brief Copy headers into an arena of their own
+     *
+     * @param other The headers to copy
+     */
+    HttpHeaders(const HttpHeaders& other);
+
+    /**
+     * @brief Copy headers into this arena
+     *
+     * @param other The headers to copy
+     * @return HttpHeaders& These headers
+     */
+    HttpHeaders& operator=(const HttpHeaders& other);
+
+    // Moving hands the arena over
+    HttpHeaders(HttpHeaders&& other) noexcept = default;
+    HttpHeaders& operator=(HttpHeaders&& other) noexcept = default;
+
+    /**
+     * @brief Add a header, replacing one of the same name
+     *
+     * @param name The name, in any case
+     * @param value The value
+     */
+    void add(std::string_view name, std::string_view value);
+
+    /**
+     * @brief Add a header line as received
+     *
+     * A status line starts a new response (a redirect or 100 Continue) and
+     * clears the headers; lines without a colon are skipped.
+     *
+     * @param line The line, with or without its CRLF
+     */
+    void addLine(std::string_view line);
+
+    /**
+     * @brief Remove all headers, keeping the arena for the next ones
+     */
+    void clear();
+
+    /**
+     * @brief Find a header
+     *
+     * @param name The name, in lowercase
+     * @return const_iterator The header, end() if not present
+     */
+    const_iterator find(std::string_view name) const;
+
+    /**
+     * @brief Get the value of a header
+     *
+     * @param name The name, in lowercase
+     * @return std::string_view The value, empty if not present
+     */
+    std::string_view get(std::string_view name) const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+
+    /**
+     * @brief Get the Content-Length header
+     *
+     * @return int64_t The length, -1 if absent or not a number
+     */
+    int64_t getContentLength() const;
+
+    /**
+     * @brief Check if Accept-Ranges offers byte ranges
+     *
+     * @return true if it is "bytes", in any case
+     */
+    bool acceptsByteRanges() const;
+
+    std::string_view getContentRange() const;
+    std::string_view getContentType() const;
+    std::string_view getContentEncoding() const;
+    std::string_view getEtag() const;
+    std::string_view getLastModified() const;
+
+    static constexpr size_t ARENA_BUFFER_SIZE = 4096;   // Enough for a typical response, more is chained on
+    static constexpr size_t MAX_IDLE_ARENAS = 8;        // Kept per thread
+
+private:
+    struct Arena;
+
+    /**
+     * @brief Give an arena back to the pool of the current thread
+     */
+    struct ArenaDeleter {
+        void operator()(Arena* arena) const;
+    };
+
+    /**
+     * @brief Get the arena, taking one from the pool if there is none yet
+     *
+     * @return Arena& The arena
+     */
+    Arena& getArena();
+
+    /**
+     * @brief Get the idle arenas of the current thread
+     *
+     * @return std::vector<Arena*>* The arenas, nullptr once the thread is exiting
+     */
+    static std::vector<Arena*>* getIdleArenas();
+
+    /**
+     * @brief Copy a string into the arena
+     *
+     * @param text The string
+     * @param lowercase True to lowercase it while copying
+     * @return std::string_view The copy
+     */
+    std::string_view store(std::string_view text, bool lowercase);
+
+    // Member variables
+    std::unique_ptr<Arena, ArenaDeleter> arena_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // HTTP_HEADERS_H
@@ -0,0 +1,221 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <curl/curl.h>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Link quality measured over one sampling window
+ */
+struct LinkSample {
+    double throughput = 0.0;        // Aggregate download speed in bytes/second
+    double latencyMs = 0.0;         // Mean round trip, 0 if no transfer measured one
+    double firstByteMs = 0.0;       // Mean wait from request sent to first byte, 0 if none
+    double packetLoss = 0.0;        // Percentage of transfers lost to network errors
+    int transfers = 0;              // Transfers finished in the window
+    int connections = 0;            // Connections in use when sampled
+};
+
+/**
+ * @brief TLS handshakes with one host
+ */
+struct HostHandshakeStats {
+    std::string host;
+    int64_t handshakes = 0;         // Connections that went through a TLS handshake
+    int64_t reusedConnections = 0;  // TLS transfers that needed no handshake
+    double meanMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+};
+
+/**
+ * @brief Process-wide link quality recorder
+ *
+ * Every finished transfer reports its handle here, and running transfers
+ * are sampled from their progress callbacks, so the figures come from
+ * traffic that flows anyway instead of probes of their own and long
+ * downloads are measured while they run. The round trip
+ * is the kernel's smoothed RTT of the transfer's socket (TCP_INFO) where
+ * the platform has it, else the TCP handshake time (connect time minus name
+ * lookup) of transfers that opened a connection. Transfers that ended in
+ * timeouts, resets or truncated bodies count as lost.
+ *
+ * Two views are kept: the controller drains a window with takeSample(), so
+ * its figures describe only recent traffic, and getRecent() returns moving
+ * averages that readers such as the socket tuner and the cluster report
+ * can poll without disturbing it.
+ *
+ * TLS handshake times (TLS done minus TCP connect) are kept per host as
+ * well, telling apart the hosts where connections are resumed and reused
+ * from those that pay a full handshake every time.
+ */
+class LinkStats {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return LinkStats& The singleton instance
+     */
+    static LinkStats& getInstance();
+
+    /**
+     * @brief Record a finished transfer
+     *
+     * @param handle The CURL handle, before it is reset or reused
+     * @param code The result of the transfer
+     */
+    void recordTransfer(CURL* handle, CURLcode code);
+
+    /**
+     * @brief Sample the round trip of a running transfer
+     *
+     * Called from progress callbacks, at most once per SAMPLE_INTERVAL_MS
+     * for each transfer. Only the socket's RTT is taken; the handshake time
+     * would repeat the same figure until the transfer finishes. libcurl
+     * only reports the socket of a connection a finished transfer used, so
+     * callers pass the sockets they saw curl use or open. Only one whose
+     * ports are those of the connection curl reports is measured: a socket
+     * of a connect attempt that lost is closed, and its number may belong
+     * to another file or connection by now.
+     *
+     * @param handle The CURL handle
+     * @param sockets The sockets that may be the transfer's, newest last
+     * @param count The number of sockets, 0 to ask the handle
+     * @param nextSample When the transfer is next sampled, moved on once it is
+     */
+    void sampleTransfer(CURL* handle, const curl_socket_t* sockets, size_t count,
+                        std::chrono::steady_clock::time_point& nextSample);
+
+    /**
+     * @brief Return the latency and loss since the last call and start a new window
+     *
+     * @return LinkSample The sample, throughput and connections left at 0
+     */
+    LinkSample takeSample();
+
+    /**
+     * @brief Get moving averages over the latest transfers
+     *
+     * @return LinkSample The averages, transfers being the count since start
+     */
+    LinkSample getRecent() const;
+
+    /**
+     * @brief Get the TLS handshake times of every host seen
+     *
+     * @return std::vector<HostHandshakeStats> The hosts, by name
+     */
+    std::vector<HostHandshakeStats> getHandshakeStats() const;
+
+    static constexpr size_t MAX_HANDSHAKE_HOSTS = 256;
+
+    static constexpr double RECENT_WEIGHT = 0.125;     // Weight of a new transfer in the averages, as TCP's SRTT
+
+    static constexpr int SAMPLE_INTERVAL_MS = 1000;    // Between samples of one running transfer
+
+private:
+    /**
+     * @brief Construct a new LinkStats
+     */
+    LinkStats() = default;
+
+    /**
+     * @brief Destroy the LinkStats
+     */
+    ~LinkStats() = default;
+
+    // Prevent copying
+    LinkStats(const LinkStats&) = delete;
+    LinkStats& operator=(const LinkStats&) = delete;
+
+    /**
+     * @brief Measure the round trip of a finished transfer
+     *
+     * @param handle The CURL handle
+     * @return double Milliseconds, 0 if nothing was measured
+     */
+    static double measureRoundTrip(CURL* handle);
+
+    /**
+     * @brief Get the socket of the connection the handle last used
+     *
+     * @param handle The CURL handle
+     * @return curl_socket_t The socket, CURL_SOCKET_BAD if libcurl has none
+     */
+    static curl_socket_t getActiveSocket(CURL* handle);
+
+    /**
+     * @brief Check if a socket is the one of the handle's current connection
+     *
+     * @param handle The CURL handle
+     * @param socket The socket
+     * @return true if its local and peer ports are those libcurl reports
+     */
+    static bool isConnectionSocket(CURL* handle, curl_socket_t socket);
+
+    /**
+     * @brief Read the kernel's smoothed RTT of a connected socket
+     *
+     * @param socket The socket
+     * @return double Milliseconds, 0 if the platform or socket has none
+     */
+    static double measureSocketRoundTrip(curl_socket_t socket);
+
+    /**
+     * @brief Add a round trip to the window and the moving average
+     *
+     * Called with mutex_ held.
+     *
+     * @param latencyMs The round trip in milliseconds
+     */
+    void addLatency(double latencyMs);
+
+    /**
+     * @brief Measure the wait from request sent to first byte
+     *
+     * @param handle The CURL handle
+     * @return double Milliseconds, 0 if nothing was measured
+     */
+    static double measureFirstByte(CURL* handle);
+
+    /**
+     * @brief Measure the TLS handshake of a finished transfer
+     *
+     * @param handle The CURL handle
+     * @param host Set to the host of the transfer, empty if it did not use TLS
+     * @return double Milliseconds, 0 if the connection was reused
+     */
+    static double measureHandshake(CURL* handle, std::string& host);
+
+    /**
+     * @brief Check if a result means the network lost the transfer
+     *
+     * @param code The result
+     * @return true for timeouts, resets and truncated transfers
+     */
+    static bool isNetworkLoss(CURLcode code);
+
+    // Member variables
+    double latencySumMs_ = 0.0;
+    int latencySamples_ = 0;
+    double firstByteSumMs_ = 0.0;
+    int firstByteSamples_ = 0;
+    int transfers_ = 0;
+    int lost_ = 0;
+    LinkSample recent_;                     // Moving averages, never reset
+    std::map<std::string, HostHandshakeStats> handshakes_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // LINK_STATS_H
@@ -0,0 +1,173 @@
+#ifndef METADATA_PREFETCHER_H
+#define METADATA_PREFETCHER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+#include "core/HttpClient.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Probes queued downloads before they get a slot
+ *
+ * The downloads due next are handed to prefetch() while they wait. A few
+ * background threads resolve their hosts through the DnsCache and probe
+ * them through the proxy they will download through, which also leaves a
+ * connection to the server in the handle pool. Successful probes are kept
+ * for a short TTL: a download that starts meanwhile takes its probe instead
+ * of sending one, and goes straight to its segments. Failed probes are not
+ * kept, the download probes again itself.
+ *
+ * Downloads that revalidate a cached copy send conditional probes of their
+ * own and do not take prefetched ones.
+ */
+class MetadataPrefetcher {
+public:
+    /**
+     * @brief A queued download to probe
+     */
+    struct Request {
+        std::string taskId;     // Picks the proxy the download is stuck to
+        std::string url;
+    };
+
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return MetadataPrefetcher& The singleton instance
+     */
+    static MetadataPrefetcher& getInstance();
+
+    /**
+     * @brief Probe downloads in the background
+     *
+     * URLs that are cached or already being probed are skipped.
+     *
+     * @param requests The downloads, in the order they are due
+     */
+    void prefetch(const std::vector<Request>& requests);
+
+    /**
+     * @brief Take the prefetched probe of a URL
+     *
+     * A probe is taken once; the next download of the URL probes again.
+     *
+     * @param url The URL
+     * @param proxy The proxy the download goes through
+     * @param response Receives the probe
+     * @return true if a fresh probe through that proxy was cached, false otherwise
+     */
+    bool take(const std::string& url, const std::string& proxy, HttpResponse& response);
+
+    /**
+     * @brief Get the size probed for a URL, leaving the probe cached
+     *
+     * @param url The URL
+     * @return int64_t The size, -1 if not probed or unknown
+     */
+    int64_t getFileSize(const std::string& url) const;
+
+    /**
+     * @brief Set how long probes are kept
+     *
+     * @param seconds The TTL in seconds (0 disables prefetching)
+     */
+    void setTtl(int seconds);
+
+    /**
+     * @brief Get how long probes are kept
+     *
+     * @return int The TTL in seconds
+     */
+    int getTtl() const;
+
+    /**
+     * @brief Set how many queued downloads are probed ahead
+     *
+     * @param count The number of downloads (0 disables prefetching)
+     */
+    void setLookahead(int count);
+
+    /**
+     * @brief Get how many queued downloads are probed ahead
+     *
+     * @return int The number of downloads
+     */
+    int getLookahead() const;
+
+    /**
+     * @brief Get the number of probes currently cached
+     *
+     * @return size_t The number of probes
+     */
+    size_t getCachedCount() const;
+
+    /**
+     * @brief Drop queued probes and wait for those in flight
+     */
+    void shutdown();
+
+    static constexpr int DEFAULT_TTL_SECONDS = 30;
+    static constexpr int DEFAULT_LOOKAHEAD = 4;
+    static constexpr size_t MAX_PREFETCH_THREADS = 2;      // Probes run behind the downloads, not beside them
+    static constexpr size_t MAX_ENTRIES = 256;
+    static constexpr int PROBE_TIMEOUT_SECONDS = 10;
+
+private:
+    struct Entry {
+        HttpResponse response;
+        std::string proxy;
+        std::chrono::steady_clock::time_point expires;
+        bool pending = false;
+    };
+
+    /**
+     * @brief Construct a new MetadataPrefetcher
+     */
+    MetadataPrefetcher() = default;
+
+    /**
+     * @brief Destroy the MetadataPrefetcher, abandoning queued probes
+     */
+    ~MetadataPrefetcher();
+
+    // Prevent copying
+    MetadataPrefetcher(const MetadataPrefetcher&) = delete;
+    MetadataPrefetcher& operator=(const MetadataPrefetcher&) = delete;
+
+    /**
+     * @brief Prefetch thread body
+     */
+    void workerLoop();
+
+    /**
+     * @brief Drop expired probes, then the oldest ones beyond MAX_ENTRIES
+     *
+     * Called with mutex_ held.
+     */
+    void prune();
+
+    // Member variables
+    std::map<std::string, Entry> entries_;          // By URL
+    std::deque<Request> queue_;
+    std::vector<std::thread> workers_;
+    int ttlSeconds_ = DEFAULT_TTL_SECONDS;
+    int lookahead_ = DEFAULT_LOOKAHEAD;
+    bool stopping_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // METADATA_PREFETCHER_H
@@ -0,0 +1,122 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <string>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Engine state read when metrics are written
+ */
+struct EngineGauges {
+    int queuedDownloads = 0;
+    int activeDownloads = 0;
+    double downloadSpeed = 0.0;                 // Aggregate, bytes/second
+    int64_t bandwidthLimit = 0;                 // Bytes/second, 0 for none
+    std::map<std::string, double> hostSpeeds;   // Bytes/second by host
+};
+
+/**
+ * @brief Writes engine metrics in the OpenMetrics text format
+ *
+ * A background thread renders the metrics at a fixed interval and
+ * replaces the file atomically, so a node exporter textfile collector or
+ * any scraper reading the file never sees half of it. Counters and
+ * histograms come from EngineMetrics, TransferCounters and the resource
+ * monitor; the gauge source is asked for the queue and per-host speeds
+ * only when a file is written. Timings are recorded only while an
+ * exporter runs.
+ */
+class MetricsExporter {
+public:
+    using GaugeSource = std::function<EngineGauges()>;
+
+    /**
+     * @brief Construct a new MetricsExporter
+     *
+     * @param source Called on the exporter thread for the gauges
+     */
+    explicit MetricsExporter(GaugeSource source);
+
+    /**
+     * @brief Destroy the MetricsExporter, stopping it
+     */
+    ~MetricsExporter();
+
+    /**
+     * @brief Start writing the metrics file
+     *
+     * @param path The file path
+     * @param intervalMs The time between writes in milliseconds
+     * @return true if the thread started, false otherwise
+     */
+    bool start(const std::string& path, int intervalMs = DEFAULT_INTERVAL_MS);
+
+    /**
+     * @brief Stop writing, leaving the last file in place
+     */
+    void stop();
+
+    /**
+     * @brief Check if the exporter is running
+     *
+     * @return true if running, false otherwise
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Render the metrics
+     *
+     * @return std::string The metrics in the OpenMetrics text format
+     */
+    std::string render() const;
+
+    /**
+     * @brief Render the metrics and replace the file
+     *
+     * @return true if written, false otherwise
+     */
+    bool writeNow();
+
+    static constexpr int DEFAULT_INTERVAL_MS = 15000;
+    static constexpr int MIN_INTERVAL_MS = 1000;
+
+private:
+    /**
+     * @brief Exporter thread body
+     */
+    void exportLoop();
+
+    /**
+     * @brief Escape a label value
+     *
+     * @param value The value
+     * @return std::string The value with backslashes, quotes and newlines escaped
+     */
+    static std::string escapeLabel(const std::string& value);
+
+    // Prevent copying
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Member variables
+    GaugeSource source_;
+    std::string path_;
+    int intervalMs_ = DEFAULT_INTERVAL_MS;
+    bool stopping_ = false;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // METRICS_EXPORTER_H
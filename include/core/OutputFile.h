@@ -0,0 +1,293 @@
+#ifndef OUTPUT_FILE_H
+#define OUTPUT_FILE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "utils/DiskIo.h"
+
+namespace dm {
+namespace core {
+
+class StreamingHasher;
+class PieceVerifier;
+class ContentSniffer;
+class DataFilterChain;
+class StorageDevice;
+
+/**
+ * @brief Shared output file for positional writes
+ *
+ * Opened once per download and shared by its segments. Every write carries
+ * its own offset (pwrite), so segments never contend on a file position.
+ * With direct I/O enabled, writes whose buffer, size and offset are all
+ * aligned bypass the page cache; other writes use a regular descriptor.
+ * I/O goes through the disk I/O backend selected when the file is opened.
+ * Writes queue on the device of the file when DeviceIoScheduler hands one
+ * out, and are then always asynchronous.
+ *
+ * A small file can instead be staged in a pooled memory slab and written
+ * out by commit() with a single open, write and close, skipping the
+ * preallocation and the per-block writes of the regular path.
+ */
+class OutputFile {
+public:
+    /**
+     * @brief Construct a new OutputFile
+     */
+    OutputFile();
+
+    /**
+     * @brief Destroy the OutputFile
+     */
+    ~OutputFile();
+
+    // Prevent copying
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    /**
+     * @brief Open the file, creating it if needed (existing data is kept)
+     *
+     * @param path The file path
+     * @param directIo True to also open an O_DIRECT descriptor where supported
+     * @return true if successful, false otherwise
+     */
+    bool open(const std::string& path, bool directIo = false);
+
+    /**
+     * @brief Open the file staged in memory, to be written out by commit()
+     *
+     * Writes and reads go to a pooled slab of at least capacity bytes and
+     * nothing is created on disk until commit(). A write beyond the slab
+     * first moves what was staged into the file, opened as by open(), if
+     * spilling is allowed, and fails otherwise. Spilling is only safe while
+     * a single writer uses the file.
+     *
+     * @param path The file path
+     * @param capacity The bytes to stage, the file's size when known
+     * @param spill True to fall back to the file for larger data
+     * @return true if successful, false otherwise
+     */
+    bool openStaged(const std::string& path, size_t capacity, bool spill);
+
+    /**
+     * @brief Write staged data out as the file and release the slab
+     *
+     * The file is replaced by the data written so far. Does nothing if the
+     * file is not staged.
+     *
+     * @return true if written or not staged, false otherwise
+     */
+    bool commit();
+
+    /**
+     * @brief Close the file, dropping staged data that was not committed
+     */
+    void close();
+
+    /**
+     * @brief Check if the data is held in memory rather than in the file
+     *
+     * @return true if staged, false otherwise
+     */
+    bool isStaged() const;
+
+    /**
+     * @brief Check if the file is open
+     *
+     * @return true if open, false otherwise
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Check if a direct I/O descriptor is available
+     *
+     * @return true if direct I/O is in use, false otherwise
+     */
+    bool isDirect() const;
+
+    /**
+     * @brief Write data at an offset
+     *
+     * Safe to call from several threads at once for disjoint ranges.
+     *
+     * @param data The data to write
+     * @param size The size of the data
+     * @param offset The file offset
+     * @return true if all data was written, false otherwise
+     */
+    bool writeAt(const char* data, size_t size, int64_t offset);
+    
+    /**
+     * @brief Read data at an offset
+     *
+     * @param data Receives the data
+     * @param size The number of bytes to read
+     * @param offset The file offset
+     * @return true if all bytes were read, false otherwise
+     */
+    bool readAt(char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Check whether queued writes complete asynchronously
+     *
+     * @return true if queueWrite() returns before the data is written, false otherwise
+     */
+    bool isAsync() const;
+
+    /**
+     * @brief Queue a write of request.data, request.size bytes at request.offset
+     *
+     * The request and its buffer must stay untouched until finishWrite().
+     *
+     * @param request The request (its descriptor and operation are filled in)
+     */
+    void queueWrite(dm::utils::DiskRequest& request);
+
+    /**
+     * @brief Wait for a queued write, feeding it to the hashers, sniffer and filters
+     *
+     * @param request The request passed to queueWrite()
+     * @return true if all data was written, false otherwise
+     */
+    bool finishWrite(dm::utils::DiskRequest& request);
+    
+    /**
+     * @brief Feed every successful write to a hasher
+     *
+     * Must be set before writing starts.
+     *
+     * @param hasher The hasher (nullptr to detach)
+     */
+    void setHasher(std::shared_ptr<StreamingHasher> hasher);
+
+    /**
+     * @brief Feed every successful write to a piece verifier
+     *
+     * Must be set before writing starts.
+     *
+     * @param verifier The verifier (nullptr to detach)
+     */
+    void setPieceVerifier(std::shared_ptr<PieceVerifier> verifier);
+
+    /**
+     * @brief Feed every successful write to a content sniffer
+     *
+     * Must be set before writing starts.
+     *
+     * @param sniffer The sniffer (nullptr to detach)
+     */
+    void setSniffer(std::shared_ptr<ContentSniffer> sniffer);
+
+    /**
+     * @brief Feed every successful write to data filters
+     *
+     * May be replaced while writing, by sessions opened afresh.
+     *
+     * @param filters The filter sessions (nullptr to detach)
+     */
+    void setFilters(std::shared_ptr<DataFilterChain> filters);
+
+    /**
+     * @brief Flush written data to storage
+     *
+     * @return true if successful, false otherwise
+     */
+    bool sync();
+
+    /**
+     * @brief Get the file path
+     *
+     * @return const std::string& The file path
+     */
+    const std::string& getPath() const;
+
+    /**
+     * @brief Get the alignment required for direct I/O writes
+     *
+     * @return size_t The alignment in bytes
+     */
+    static size_t getAlignment();
+
+private:
+    /**
+     * @brief Write data at an offset through a descriptor
+     *
+     * @param fd The descriptor
+     * @param data The data to write
+     * @param size The size of the data
+     * @param offset The file offset
+     * @return true if all data was written, false otherwise
+     */
+    bool writeFully(int fd, const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Pick the descriptor for a write
+     *
+     * @param data The data to write
+     * @param size The size of the data
+     * @param offset The file offset
+     * @return int The direct I/O descriptor if the write is aligned, the regular one otherwise
+     */
+    int selectDescriptor(const char* data, size_t size, int64_t offset) const;
+
+    /**
+     * @brief Copy data into the staging slab if it fits
+     *
+     * @param data The data to write
+     * @param size The size of the data
+     * @param offset The file offset
+     * @return true if staged, false if it goes beyond the slab
+     */
+    bool stage(const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Move staged data into the file and write there from now on
+     *
+     * @return true if the file took over, false if spilling is not allowed or failed
+     */
+    bool spill();
+
+    /**
+     * @brief Give the staging slab back to the pool
+     *
+     * Called with mutex_ held.
+     */
+    void releaseStagingLocked();
+
+    /**
+     * @brief Feed written data to the hashers, sniffer and filters
+     *
+     * @param data The data written
+     * @param size The size of the data
+     * @param offset The file offset
+     */
+    void notifyWritten(const char* data, size_t size, int64_t offset);
+
+    // Member variables
+    std::string path_;
+    int fd_ = -1;
+    int directFd_ = -1;
+    dm::utils::DiskIoBackend* backend_ = nullptr;
+    std::shared_ptr<StorageDevice> device_;     // Write queue of the file's device, nullptr to write directly
+    std::shared_ptr<StreamingHasher> hasher_;
+    std::shared_ptr<PieceVerifier> pieceVerifier_;
+    std::shared_ptr<ContentSniffer> sniffer_;
+    std::shared_ptr<DataFilterChain> filters_;
+    std::atomic<bool> staged_;
+    std::unique_ptr<char[]> staging_;           // Slab the data is staged in, nullptr if not staged
+    size_t stagingCapacity_ = 0;
+    bool stagingSpills_ = false;
+    std::atomic<int64_t> stagedSize_;           // End of the furthest write staged
+    mutable std::mutex mutex_;      // Guards open/close (and seeking on Windows)
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // OUTPUT_FILE_H
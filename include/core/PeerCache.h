@@ -0,0 +1,315 @@
+#ifndef PEER_CACHE_H
+#define PEER_CACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <cstdint>
+
+#include "utils/HashCalculator.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief A manager on the LAN that may have a download already
+ */
+struct PeerInfo {
+    std::string name;               // Its mDNS instance, or "host:port" when configured
+    std::string address;
+    int port = 0;
+    bool discovered = false;        // Found through mDNS, not configured
+    int secondsLeft = 0;            // Until it is forgotten unless it announces itself again
+};
+
+/**
+ * @brief Shares finished downloads between managers on the same LAN
+ *
+ * Every finished download is shared under the hash of its content and
+ * under its URL and strong ETag, and served to the LAN on a small HTTP
+ * endpoint that answers GET and HEAD of /peer/<key> with byte ranges. A
+ * file changed since it was shared is not served. Managers find each other
+ * through mDNS: each announces a _dmpeer._tcp service every
+ * ANNOUNCE_INTERVAL_SECONDS and asks for the others, and peers listed in
+ * the settings are always asked as well, for networks where multicast does
+ * not pass.
+ *
+ * A download whose hash or URL and ETag are known asks the peers for the
+ * key as it probes its mirrors. Peers that have the file become sources of
+ * the download, taken before the origin; the origin only gets segments
+ * once every peer has failed or been dropped. Peers are not trusted: only
+ * a download whose bytes are checked, by an expected hash or by published
+ * piece hashes, takes peers as sources. The endpoint and discovery only
+ * answer hosts on the subnets of this host's interfaces.
+ *
+ * POSIX only for now, IPv4 discovery.
+ */
+class PeerCache {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return PeerCache& The singleton instance
+     */
+    static PeerCache& getInstance();
+
+    /**
+     * @brief Start serving shared files and looking for peers
+     *
+     * @param port The TCP port of the endpoint, announced over mDNS
+     * @param name The name of this manager on the LAN
+     * @return true if serving, false otherwise
+     */
+    bool start(int port, const std::string& name);
+
+    /**
+     * @brief Say goodbye to the LAN and stop serving
+     */
+    void stop();
+
+    /**
+     * @brief Check if files are shared with the LAN
+     *
+     * @return true if serving, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Set the peers asked besides those found through mDNS
+     *
+     * @param list "host:port" entries separated by commas or whitespace
+     */
+    void setStaticPeers(const std::string& list);
+
+    /**
+     * @brief Make the key of some content by its hash
+     *
+     * @param algorithm The algorithm of the hash
+     * @param hash The hash
+     * @return std::string The key, empty if the hash is malformed
+     */
+    static std::string makeHashKey(dm::utils::HashAlgorithm algorithm, const std::string& hash);
+
+    /**
+     * @brief Make the key of a resource by its URL and ETag
+     *
+     * @param url The URL
+     * @param etag The ETag sent by the server
+     * @return std::string The key, empty for a missing or weak ETag
+     */
+    static std::string makeUrlKey(const std::string& url, const std::string& etag);
+
+    /**
+     * @brief Share a finished file with the LAN
+     *
+     * @param filePath The file
+     * @param keys The keys it is found by
+     */
+    void share(const std::string& filePath, const std::vector<std::string>& keys);
+
+    /**
+     * @brief Get the URLs through which peers would serve some content
+     *
+     * Peers are not asked here; a URL answers 404 if its peer lacks the key.
+     *
+     * @param key The key
+     * @return std::vector<std::string> One URL per peer, at most MAX_PEER_SOURCES
+     */
+    std::vector<std::string> getSourceUrls(const std::string& key) const;
+
+    /**
+     * @brief Get the peers currently known
+     *
+     * @return std::vector<PeerInfo> The peers, by name
+     */
+    std::vector<PeerInfo> getPeers() const;
+
+    /**
+     * @brief Get the number of keys shared
+     *
+     * @return size_t The number of keys
+     */
+    size_t getSharedCount() const;
+
+    /**
+     * @brief Get the bytes served to peers since the start
+     *
+     * @return int64_t The bytes
+     */
+    int64_t getServedBytes() const;
+
+    /**
+     * @brief Save the shared files, dropping those changed since
+     *
+     * @param path The index file
+     * @return true if saved, false otherwise
+     */
+    bool save(const std::string& path);
+
+    /**
+     * @brief Load the shared files saved by an earlier run
+     *
+     * @param path The index file
+     * @return true if loaded, false otherwise
+     */
+    bool load(const std::string& path);
+
+    static constexpr int DEFAULT_PORT = 47810;
+    static constexpr int64_t MIN_SHARED_SIZE = 1024 * 1024;     // Smaller downloads are not worth asking for
+    static constexpr size_t MAX_PEER_SOURCES = 8;
+    static constexpr size_t MAX_DISCOVERED_PEERS = 64;          // Announcements of further names are ignored
+    static constexpr int MAX_CONNECTIONS = 32;                  // Served at once, more are answered 503
+    static constexpr int ANNOUNCE_INTERVAL_SECONDS = 60;
+    static constexpr int PEER_TTL_SECONDS = 150;                // Announced lifetime of the service records
+    static constexpr int IDLE_TIMEOUT_MS = 15000;               // Of a kept-alive connection between requests
+    static constexpr int SEND_TIMEOUT_SECONDS = 30;             // A peer that reads nothing for longer is dropped
+    static constexpr int PROBE_TIMEOUT_SECONDS = 3;             // Of asking a peer for a key
+
+private:
+    /**
+     * @brief A shared file, as it was when shared
+     */
+    struct Shared {
+        std::string filePath;
+        std::uintmax_t fileSize = 0;
+        std::filesystem::file_time_type modified;
+    };
+
+    /**
+     * @brief A known peer
+     */
+    struct Peer {
+        std::string address;
+        int port = 0;
+        std::chrono::steady_clock::time_point expiresAt;    // Of a discovered peer
+    };
+
+    /**
+     * @brief A peer connection being served
+     */
+    struct Connection {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    /**
+     * @brief Construct a new PeerCache
+     */
+    PeerCache() = default;
+
+    /**
+     * @brief Destroy the PeerCache, stopping it
+     */
+    ~PeerCache();
+
+    // Prevent copying
+    PeerCache(const PeerCache&) = delete;
+    PeerCache& operator=(const PeerCache&) = delete;
+
+    /**
+     * @brief Find a shared file that is still as it was shared
+     *
+     * @param key The key
+     * @param shared Receives the file
+     * @return true if found, false otherwise
+     */
+    bool find(const std::string& key, Shared& shared);
+
+    /**
+     * @brief Check that a shared file was not changed since
+     *
+     * @param shared The file
+     * @return true if unchanged, false otherwise
+     */
+    static bool isUnchanged(const Shared& shared);
+
+    /**
+     * @brief Check if an address is one of the peers in the settings
+     *
+     * Those may sit beyond the local subnets, where multicast does not pass.
+     *
+     * @param address The numeric IPv4 address
+     * @return true if configured, false otherwise
+     */
+    bool isConfiguredPeer(const std::string& address) const;
+
+    /**
+     * @brief Accept peer connections until stopped
+     */
+    void acceptLoop();
+
+    /**
+     * @brief Answer the requests of one connection until it closes or idles
+     *
+     * @param connection The connection
+     */
+    void serveConnection(Connection* connection);
+
+    /**
+     * @brief Answer one request
+     *
+     * @param fd The connection
+     * @param head The request line and headers
+     * @return true to keep the connection open, false to close it
+     */
+    bool handleRequest(int fd, const std::string& head);
+
+    /**
+     * @brief Announce this manager and ask for the others until stopped
+     */
+    void discoveryLoop();
+
+    /**
+     * @brief Answer or learn from one mDNS packet
+     *
+     * @param packet The packet
+     * @param address The address it came from
+     */
+    void handlePacket(const std::string& packet, const std::string& address);
+
+    /**
+     * @brief Send a message to the mDNS group
+     *
+     * @param message The DNS message
+     */
+    void sendMulticast(const std::string& message);
+
+    /**
+     * @brief Make the records announcing this manager
+     *
+     * @param ttl Their lifetime in seconds, 0 to say goodbye
+     * @return std::string The DNS response message
+     */
+    std::string makeAnnouncement(uint32_t ttl) const;
+
+    // Member variables
+    std::map<std::string, Shared> shared_;          // By key
+    std::map<std::string, Peer> peers_;             // Configured, by "host:port"
+    std::map<std::string, Peer> discoveredPeers_;   // Announced over mDNS, by instance name
+    std::string name_;                              // mDNS instance label
+    int port_ = 0;
+    std::atomic<bool> running_{false};
+    std::atomic<int64_t> servedBytes_{0};
+    mutable std::mutex mutex_;
+
+    int listenFd_ = -1;
+    int multicastFd_ = -1;
+    int wakePipe_[2] = {-1, -1};                    // Written to on stop, never drained
+    std::thread acceptThread_;
+    std::thread discoveryThread_;
+    std::list<std::unique_ptr<Connection>> connections_;   // Accept thread only, until stopped
+    std::chrono::steady_clock::time_point lastAnswer_;      // Discovery thread only
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // PEER_CACHE_H
@@ -0,0 +1,248 @@
+#ifndef PIECE_VERIFIER_H
+#define PIECE_VERIFIER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "utils/HashCalculator.h"
+
+namespace dm {
+namespace core {
+
+class OutputFile;
+struct SegmentRange;
+
+/**
+ * @brief Hashes of the fixed-size pieces of a file
+ */
+struct PieceMap {
+    dm::utils::HashAlgorithm algorithm = dm::utils::HashAlgorithm::SHA256;
+    int64_t pieceSize = 0;              // 0 if the file is not split into pieces
+    bool published = false;             // Given by the source (Metalink), not computed here
+    std::vector<std::string> hashes;    // Lowercase hex by piece index, empty for pieces not hashed yet
+
+    bool empty() const { return pieceSize <= 0 || hashes.empty(); }
+
+    /**
+     * @brief Get the number of pieces of a file
+     *
+     * @param fileSize The file size in bytes
+     * @param pieceSize The piece size in bytes
+     * @return size_t The number of pieces, the last one may be shorter
+     */
+    static size_t countPieces(int64_t fileSize, int64_t pieceSize) {
+        return fileSize > 0 && pieceSize > 0 ? static_cast<size_t>((fileSize + pieceSize - 1) / pieceSize) : 0;
+    }
+};
+
+/**
+ * @brief Verifies a download piece by piece in the write path
+ *
+ * Attached to the output file next to the StreamingHasher. Each piece is
+ * hashed as its data is written, from the write buffers, and checked once
+ * its last byte is in: against the published hash, or, for pieces hashed
+ * here, against the hash taken when an earlier session wrote it. Data
+ * landing ahead of a piece's frontier, and data written by an earlier
+ * session, is read back when the frontier reaches it. A failed piece is
+ * fetched again by range instead of the whole file.
+ *
+ * Pieces are hashed in parallel, each under its own lock.
+ */
+class PieceVerifier {
+public:
+    /**
+     * @brief Construct a new PieceVerifier
+     *
+     * @param pieces The piece size and hashes; pieces without a hash are
+     *        hashed and recorded
+     * @param fileSize The file size in bytes
+     * @param missing The byte ranges not written yet, the rest is on the
+     *        disk from an earlier session
+     */
+    PieceVerifier(const PieceMap& pieces, int64_t fileSize, const std::vector<SegmentRange>& missing);
+
+    /**
+     * @brief Destroy the PieceVerifier
+     */
+    ~PieceVerifier();
+
+    /**
+     * @brief Account for data written to the file
+     *
+     * Called by OutputFile after each successful write.
+     *
+     * @param file The file the data was written to
+     * @param data The data
+     * @param size The size of the data
+     * @param offset The file offset of the data
+     */
+    void onWrite(OutputFile& file, const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Take the pieces that failed verification since the last call
+     *
+     * @return std::vector<size_t> The piece indices
+     */
+    std::vector<size_t> takeFailed();
+
+    /**
+     * @brief Verify every piece not verified yet, reading it back
+     *
+     * For the completed file: pieces written by earlier sessions or by
+     * other nodes, and pieces whose hashing could not finish in the write
+     * path.
+     *
+     * @param file The completed file, still open
+     * @return std::vector<size_t> The pieces that failed, including those
+     *         not taken with takeFailed() yet
+     */
+    std::vector<size_t> finish(OutputFile& file);
+
+    /**
+     * @brief Forget a piece that is about to be fetched again
+     *
+     * A piece hashed here loses its hash, the new data records another.
+     *
+     * @param index The piece index
+     */
+    void refetch(size_t index);
+
+    /**
+     * @brief Get the byte range of a piece
+     *
+     * @param index The piece index
+     * @return SegmentRange The range (its end inclusive)
+     */
+    SegmentRange getPieceRange(size_t index) const;
+
+    /**
+     * @brief Get the number of pieces
+     *
+     * @return size_t The number of pieces
+     */
+    size_t getPieceCount() const;
+
+    /**
+     * @brief Get the number of pieces verified in this session
+     *
+     * @return size_t The number of pieces
+     */
+    size_t getVerifiedCount() const;
+
+    /**
+     * @brief Get the piece map with the hashes recorded so far
+     *
+     * @return PieceMap The piece map
+     */
+    PieceMap getPieceMap() const;
+
+    /**
+     * @brief Get the number of bytes that had to be read back from the file
+     *
+     * @return int64_t The number of bytes
+     */
+    int64_t getReadBackBytes() const;
+
+    static constexpr size_t READ_BACK_CHUNK_SIZE = 1024 * 1024;
+
+private:
+    enum class PieceState : uint8_t {
+        PENDING,        // Not all of it seen yet
+        VERIFIED,       // Matches its hash, or its hash was recorded
+        FAILED          // Does not match, to be fetched again
+    };
+
+    /**
+     * @brief A piece being hashed
+     */
+    struct Active {
+        explicit Active(dm::utils::HashAlgorithm algorithm) : hash(algorithm) {}
+
+        dm::utils::IncrementalHash hash;
+        int64_t frontier = 0;                   // Everything of the piece before this offset is hashed
+        std::map<int64_t, int64_t> written;     // Ranges on the disk ahead of the frontier, start -> end
+        bool done = false;
+        std::mutex mutex;
+    };
+
+    // Prevent copying
+    PieceVerifier(const PieceVerifier&) = delete;
+    PieceVerifier& operator=(const PieceVerifier&) = delete;
+
+    /**
+     * @brief Start hashing a piece, with the data earlier sessions left of it
+     *
+     * Called with mutex_ held.
+     *
+     * @param index The piece index
+     * @return std::shared_ptr<Active> The piece
+     */
+    std::shared_ptr<Active> activate(size_t index);
+
+    /**
+     * @brief Hash the recorded ranges that the frontier of a piece has reached
+     *
+     * Called with the piece's mutex held.
+     *
+     * @param file The file to read from
+     * @param active The piece
+     * @return true if successful, false if the file could not be read
+     */
+    bool absorbWritten(OutputFile& file, Active& active);
+
+    /**
+     * @brief Advance the frontier of a piece over data on the disk
+     *
+     * Called with the piece's mutex held.
+     *
+     * @param file The file to read from
+     * @param active The piece
+     * @param end The end of the range (exclusive)
+     * @return true if successful, false if the file could not be read
+     */
+    bool readBack(OutputFile& file, Active& active, int64_t end);
+
+    /**
+     * @brief Check the digest of a piece whose last byte was hashed
+     *
+     * @param file The file, for the log
+     * @param index The piece index
+     * @param active The piece, no longer hashed
+     * @param digest Its digest, empty if the file could not be read
+     */
+    void complete(const OutputFile& file, size_t index, const std::shared_ptr<Active>& active,
+                  const std::string& digest);
+
+    /**
+     * @brief Feed bytes to the hash of a piece, counted while metrics are exported
+     *
+     * @param active The piece
+     * @param data The bytes
+     * @param size The number of bytes
+     */
+    static void update(Active& active, const char* data, size_t size);
+
+    // Member variables
+    dm::utils::HashAlgorithm algorithm_;
+    int64_t pieceSize_;
+    int64_t fileSize_;
+    bool published_;
+    std::vector<std::string> hashes_;
+    std::vector<PieceState> states_;
+    std::vector<SegmentRange> missing_;         // Not on the disk when their piece started hashing
+    std::map<size_t, std::shared_ptr<Active>> active_;
+    std::vector<size_t> failed_;                // Not taken yet
+    size_t verifiedCount_ = 0;
+    std::atomic<int64_t> readBackBytes_{0};
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // PIECE_VERIFIER_H
@@ -0,0 +1,383 @@
+#ifndef POST_PROCESSING_PIPELINE_H
+#define POST_PROCESSING_PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "core/ContentSniffer.h"
+
+namespace dm {
+namespace core {
+
+class PostProcessingPipeline;
+
+/**
+ * @brief Outcome of one stage for one file
+ */
+enum class StageStatus {
+    PENDING,        // Waiting for its dependencies or a worker
+    SUCCEEDED,
+    FAILED,
+    SKIPPED         // A dependency did not succeed
+};
+
+/**
+ * @brief One completed download going through the pipeline
+ *
+ * Stages of one job may run at the same time, so everything they share is
+ * reached through the locked accessors. A stage that moves the file sets
+ * the new path; stages that depend on it see that path.
+ */
+class PostProcessJob {
+public:
+    /**
+     * @brief Construct a new PostProcessJob
+     *
+     * @param taskId The download task ID
+     * @param filePath The downloaded file
+     * @param url The URL it was downloaded from
+     */
+    PostProcessJob(const std::string& taskId, const std::string& filePath, const std::string& url);
+
+    // Prevent copying
+    PostProcessJob(const PostProcessJob&) = delete;
+    PostProcessJob& operator=(const PostProcessJob&) = delete;
+
+    /**
+     * @brief Get the download task ID
+     *
+     * @return const std::string& The task ID
+     */
+    const std::string& getTaskId() const;
+
+    /**
+     * @brief Get the URL the file was downloaded from
+     *
+     * @return const std::string& The URL
+     */
+    const std::string& getUrl() const;
+
+    /**
+     * @brief Get the current path of the file
+     *
+     * @return std::string The file path
+     */
+    std::string getFilePath() const;
+
+    /**
+     * @brief Record that a stage moved the file
+     *
+     * @param filePath The new file path
+     */
+    void setFilePath(const std::string& filePath);
+
+    /**
+     * @brief Get the first and last bytes of the file
+     *
+     * Taken once per job, from the sample the download recorded or else by
+     * reading the file, and shared by every stage.
+     *
+     * @return const ContentSample& The sample, fileSize -1 if the file could not be read
+     */
+    const ContentSample& getSample();
+
+    /**
+     * @brief Set a value for later stages and listeners
+     *
+     * @param key The key
+     * @param value The value
+     */
+    void setAttribute(const std::string& key, const std::string& value);
+
+    /**
+     * @brief Get a value a stage set
+     *
+     * @param key The key
+     * @param defaultValue The value if it was not set
+     * @return std::string The value
+     */
+    std::string getAttribute(const std::string& key, const std::string& defaultValue = "") const;
+
+    /**
+     * @brief Get the outcome of a stage
+     *
+     * @param stageName The stage name
+     * @return StageStatus The outcome, SKIPPED for stages the job does not have
+     */
+    StageStatus getStageStatus(const std::string& stageName) const;
+
+    /**
+     * @brief Get the time from submission until the last stage finished
+     *
+     * @return int64_t The time in milliseconds, 0 while stages are outstanding
+     */
+    int64_t getElapsedMs() const;
+
+private:
+    friend class PostProcessingPipeline;
+
+    // Member variables
+    std::string taskId_;
+    std::string url_;
+    std::string filePath_;
+    std::map<std::string, std::string> attributes_;
+    std::vector<std::string> stageNames_;       // The stages that existed when the job was submitted
+    std::vector<StageStatus> statuses_;
+    ContentSample sample_;
+    std::once_flag sampleOnce_;
+    std::chrono::steady_clock::time_point submitted_;
+    int64_t elapsedMs_ = 0;
+    mutable std::mutex mutex_;
+
+    // Guarded by the pipeline's mutex
+    std::vector<int> remaining_;                // Unfinished dependencies per stage
+    size_t outstanding_ = 0;                    // Stages not finished yet
+};
+
+/**
+ * @brief Declaration of a stage
+ */
+struct PostProcessStage {
+    /**
+     * @brief Stage body, returns false if the stage failed
+     */
+    using Function = std::function<bool(PostProcessJob& job)>;
+
+    std::string name;
+    std::vector<std::string> dependencies;     // Stages that must succeed first
+    Function run;
+    int concurrency = 1;                       // Files the stage works on at once
+};
+
+/**
+ * @brief Latency and outcome counters of a stage
+ */
+struct StageMetrics {
+    std::string name;
+    uint64_t succeeded = 0;
+    uint64_t failed = 0;
+    uint64_t skipped = 0;
+    double totalRunMs = 0.0;                   // Time spent running
+    double maxRunMs = 0.0;
+    double totalWaitMs = 0.0;                  // Time between becoming ready and starting
+
+    /**
+     * @brief Get the average run time
+     *
+     * @return double The time in milliseconds, 0 if the stage never ran
+     */
+    double getAverageRunMs() const {
+        uint64_t runs = succeeded + failed;
+        return runs > 0 ? totalRunMs / runs : 0.0;
+    }
+};
+
+/**
+ * @brief Declarative post-processing of completed downloads
+ *
+ * Verification, scanning, classification, moving, extraction and uploads
+ * are declared as stages with the stages they depend on. Every completed
+ * file becomes a job; a stage of the job runs as soon as all its
+ * dependencies succeeded, and independent stages run side by side. A
+ * stage whose dependency failed or was skipped is skipped.
+ *
+ * Stages run on the pipeline's workers, never on the thread that reported
+ * the completion. A stage works on at most `concurrency` files at once,
+ * and the workers are shared: at least one per stage, at most
+ * MAX_WORKERS otherwise. A worker is always kept for each stage with
+ * nothing running, so a slow upload holding every other worker cannot
+ * hold up the classification of the files behind it. Ready work is taken
+ * in the order it became ready.
+ *
+ * Stages read the file's head and tail from the job's shared sample,
+ * which the download captured while writing, instead of opening the file
+ * again; hashes come from HashCalculator::findStreamedHash the same way.
+ */
+class PostProcessingPipeline {
+public:
+    /**
+     * @brief Callback for jobs whose stages have all finished
+     */
+    using CompletionCallback = std::function<void(std::shared_ptr<PostProcessJob> job)>;
+
+    /**
+     * @brief Construct a new PostProcessingPipeline
+     */
+    PostProcessingPipeline();
+
+    /**
+     * @brief Destroy the PostProcessingPipeline, see stop()
+     */
+    ~PostProcessingPipeline();
+
+    // Prevent copying
+    PostProcessingPipeline(const PostProcessingPipeline&) = delete;
+    PostProcessingPipeline& operator=(const PostProcessingPipeline&) = delete;
+
+    /**
+     * @brief Declare a stage
+     *
+     * Dependencies must be declared first, so the stages cannot form a
+     * cycle. Jobs already submitted do not get the stage.
+     *
+     * @param stage The stage
+     * @return true if added, false if the name is taken, a dependency is
+     *         unknown or the stage has no body
+     */
+    bool addStage(const PostProcessStage& stage);
+
+    /**
+     * @brief Check if a stage is declared
+     *
+     * @param name The stage name
+     * @return true if declared, false otherwise
+     */
+    bool hasStage(const std::string& name) const;
+
+    /**
+     * @brief Post-process a completed download
+     *
+     * @param taskId The download task ID
+     * @param filePath The downloaded file
+     * @param url The URL it was downloaded from
+     * @return std::shared_ptr<PostProcessJob> The job, nullptr once stopped
+     */
+    std::shared_ptr<PostProcessJob> submit(const std::string& taskId, const std::string& filePath,
+                                           const std::string& url);
+
+    /**
+     * @brief Set the callback for finished jobs
+     *
+     * Called on the worker that finished the last stage, without the
+     * pipeline's lock.
+     *
+     * @param callback The callback function
+     */
+    void setCompletionCallback(CompletionCallback callback);
+
+    /**
+     * @brief Get the counters of every stage, in declaration order
+     *
+     * @return std::vector<StageMetrics> The counters
+     */
+    std::vector<StageMetrics> getMetrics() const;
+
+    /**
+     * @brief Get the number of jobs with outstanding stages
+     *
+     * @return size_t The number of jobs
+     */
+    size_t getPendingCount() const;
+
+    /**
+     * @brief Stop the workers
+     *
+     * Running stages finish; stages still waiting are skipped and their
+     * jobs reported finished. Jobs submitted afterwards are refused.
+     */
+    void stop();
+
+    static constexpr unsigned MAX_WORKERS = 8;
+
+private:
+    /**
+     * @brief A job waiting for a stage
+     */
+    struct ReadyWork {
+        std::shared_ptr<PostProcessJob> job;
+        uint64_t sequence = 0;                  // Order it became ready in
+        std::chrono::steady_clock::time_point since;
+    };
+
+    /**
+     * @brief A stage's declaration and its queue
+     */
+    struct Stage {
+        PostProcessStage declaration;
+        std::vector<size_t> dependents;         // Stages depending on this one
+        std::deque<ReadyWork> ready;
+        int active = 0;
+        StageMetrics metrics;
+    };
+
+    /**
+     * @brief Worker thread body
+     */
+    void workerLoop();
+
+    /**
+     * @brief Take the stage work that became ready first
+     *
+     * Called with mutex_ held. A stage only takes a worker if one stays
+     * free for each other stage with nothing running.
+     *
+     * @param work Receives the work
+     * @param index Receives the stage
+     *
+     * @return true if work was taken, false if none may run now
+     */
+    bool takeWork(ReadyWork& work, size_t& index);
+
+    /**
+     * @brief Queue a stage of a job whose dependencies are done
+     *
+     * Called with mutex_ held.
+     *
+     * @param job The job
+     * @param index The stage
+     */
+    void enqueue(const std::shared_ptr<PostProcessJob>& job, size_t index);
+
+    /**
+     * @brief Record the outcome of a stage and release or skip its dependents
+     *
+     * Called with mutex_ held.
+     *
+     * @param job The job
+     * @param index The stage
+     * @param status The outcome
+     * @param finished Receives the job if it has no outstanding stages left
+     */
+    void finishStage(const std::shared_ptr<PostProcessJob>& job, size_t index, StageStatus status,
+                     std::vector<std::shared_ptr<PostProcessJob>>& finished);
+
+    /**
+     * @brief Start workers up to what the stages can use
+     *
+     * Called with mutex_ held.
+     */
+    void startWorkers();
+
+    /**
+     * @brief Report finished jobs
+     *
+     * Called without mutex_ held.
+     *
+     * @param finished The jobs
+     */
+    void notifyFinished(const std::vector<std::shared_ptr<PostProcessJob>>& finished);
+
+    // Member variables
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::map<std::string, size_t> stageIndex_;
+    std::vector<std::thread> workers_;
+    uint64_t nextSequence_ = 0;
+    size_t pendingJobs_ = 0;
+    bool stopping_ = false;
+    CompletionCallback completionCallback_ = nullptr;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // POST_PROCESSING_PIPELINE_H
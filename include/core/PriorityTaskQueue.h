@@ -0,0 +1,201 @@
+#ifndef PRIORITY_TASK_QUEUE_H
+#define PRIORITY_TASK_QUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "core/DownloadTask.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Integer handle a queue interns a task ID to
+ */
+using TaskHandle = uint32_t;
+
+/**
+ * @brief Indexed priority queue of pending tasks
+ *
+ * A 4-ary heap of task handles with a position index, so a handle can be
+ * reprioritized or removed in O(log n). Entries are ordered by
+ * enqueue time minus a per-priority head start of one aging interval, so
+ * a task that has waited long enough overtakes newer tasks of a higher
+ * priority and nothing starves. Equal keys are served in FIFO order.
+ * Not thread-safe; the owner serializes access.
+ */
+class PriorityTaskQueue {
+public:
+    /**
+     * @brief Construct a new PriorityTaskQueue
+     *
+     * @param agingIntervalMs Waiting time that is worth one priority level
+     */
+    explicit PriorityTaskQueue(int64_t agingIntervalMs = DEFAULT_AGING_INTERVAL_MS);
+
+    /**
+     * @brief Add a handle
+     *
+     * @param handle The task handle
+     * @param priority The task priority
+     * @return true if added, false if the handle is already queued
+     */
+    bool push(TaskHandle handle, DownloadPriority priority);
+
+    /**
+     * @brief Add a handle back with the wait time it already had
+     *
+     * @param handle The task handle
+     * @param priority The task priority
+     * @param enqueuedMs The time it was first queued, from getEnqueuedTime()
+     * @return true if added, false if the handle is already queued
+     */
+    bool push(TaskHandle handle, DownloadPriority priority, int64_t enqueuedMs);
+
+    /**
+     * @brief Change the priority of a queued handle, keeping its wait time
+     *
+     * @param handle The task handle
+     * @param priority The new priority
+     * @return true if updated, false if the handle is not queued
+     */
+    bool update(TaskHandle handle, DownloadPriority priority);
+
+    /**
+     * @brief Remove a queued handle
+     *
+     * @param handle The task handle
+     * @return true if removed, false if the handle is not queued
+     */
+    bool remove(TaskHandle handle);
+
+    /**
+     * @brief Check if a handle is queued
+     *
+     * @param handle The task handle
+     * @return true if queued, false otherwise
+     */
+    bool contains(TaskHandle handle) const;
+
+    /**
+     * @brief Get the handle that is due next
+     *
+     * @return TaskHandle The handle (the queue must not be empty)
+     */
+    TaskHandle top() const;
+
+    /**
+     * @brief Get the handles that are due next, without removing them
+     *
+     * @param count Maximum number of handles to return
+     * @return std::vector<TaskHandle> The handles, in the order they are due
+     */
+    std::vector<TaskHandle> peek(size_t count) const;
+
+    /**
+     * @brief Get the priority a handle is queued with
+     *
+     * @param handle The task handle (must be queued)
+     * @return DownloadPriority The priority
+     */
+    DownloadPriority getPriority(TaskHandle handle) const;
+
+    /**
+     * @brief Get the time a handle was queued
+     *
+     * @param handle The task handle (must be queued)
+     * @return int64_t The enqueue time in milliseconds
+     */
+    int64_t getEnqueuedTime(TaskHandle handle) const;
+
+    /**
+     * @brief Remove the handle that is due next
+     *
+     * @return TaskHandle The handle (the queue must not be empty)
+     */
+    TaskHandle pop();
+
+    /**
+     * @brief Get the number of queued handles
+     *
+     * @return size_t The number of handles
+     */
+    size_t size() const;
+
+    /**
+     * @brief Check if the queue is empty
+     *
+     * @return true if empty, false otherwise
+     */
+    bool empty() const;
+
+    /**
+     * @brief Remove all handles
+     */
+    void clear();
+
+    static constexpr int64_t DEFAULT_AGING_INTERVAL_MS = 2 * 60 * 1000;
+
+private:
+    /**
+     * @brief Heap entry structure
+     */
+    struct Entry {
+        int64_t key;                // Enqueue time minus the priority head start
+        uint64_t sequence;          // FIFO order for equal keys
+        int64_t enqueuedMs;
+        TaskHandle handle;
+        DownloadPriority priority;
+    };
+
+    /**
+     * @brief Compute the ordering key for an entry
+     *
+     * @param enqueuedMs The enqueue time in milliseconds
+     * @param priority The priority
+     * @return int64_t The key (smaller is served first)
+     */
+    int64_t makeKey(int64_t enqueuedMs, DownloadPriority priority) const;
+
+    /**
+     * @brief Check if entry a is served before entry b
+     */
+    static bool before(const Entry& a, const Entry& b);
+
+    /**
+     * @brief Move an entry toward the root
+     *
+     * @param index The heap index
+     */
+    void siftUp(size_t index);
+
+    /**
+     * @brief Move an entry toward the leaves
+     *
+     * @param index The heap index
+     */
+    void siftDown(size_t index);
+
+    /**
+     * @brief Place an entry at a heap index and record its position
+     *
+     * @param index The heap index
+     * @param entry The entry
+     */
+    void place(size_t index, const Entry& entry);
+
+    static constexpr size_t ARITY = 4;
+    static constexpr size_t NOT_QUEUED = static_cast<size_t>(-1);
+
+    // Member variables
+    std::vector<Entry> heap_;
+    std::vector<size_t> positions_;     // Heap index per handle, NOT_QUEUED if absent
+    int64_t agingIntervalMs_;
+    uint64_t nextSequence_ = 0;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // PRIORITY_TASK_QUEUE_H
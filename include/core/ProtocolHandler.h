@@ -7,6 +7,8 @@
 #include <memory>
 #include <functional>
 #include <mutex>
+#include <atomic>
+#include <cstdint>
 
 namespace dm {
 namespace core {
@@ -300,10 +302,27 @@ private:
     ProtocolAuthCallback authCallback_ = nullptr;
 };
 
+/**
+ * @brief Interned id of a URL scheme, valid for the life of the process
+ */
+using SchemeId = uint16_t;
+
+/**
+ * @brief Scheme id of a URL whose scheme no handler ever registered
+ */
+const SchemeId INVALID_SCHEME_ID = UINT16_MAX;
+
 /**
  * @brief Protocol handler factory class
  * 
- * Creates and manages protocol handlers
+ * Creates and manages protocol handlers. Handlers are registered at
+ * startup and rarely change, so every change publishes a new immutable
+ * registry and lookups read the current one without taking a lock or
+ * touching a reference count: the handler for a URL is found by
+ * interning its scheme in a short flat list and indexing a table by the
+ * id. Registries replaced by a change are kept until the factory is
+ * destroyed, so a handler pointer returned by a lookup stays valid and a
+ * task can look its handler up once and keep it.
  */
 class ProtocolHandlerFactory {
 public:
@@ -317,8 +336,10 @@ public:
     /**
      * @brief Register a protocol handler
      * 
+     * Its schemes go to the handler registered last when handlers share them.
+     * 
      * @param handler The protocol handler to register
-     * @return true if registered successfully, false otherwise
+     * @return true if registered successfully, false if a handler has the name already
      */
     bool registerHandler(std::shared_ptr<ProtocolHandler> handler);
     
@@ -338,6 +359,33 @@ public:
      */
     std::shared_ptr<ProtocolHandler> getHandlerForUrl(const std::string& url);
     
+    /**
+     * @brief Find the protocol handler for a URL without sharing ownership
+     * 
+     * For per-link dispatch. The handler stays valid for the life of the
+     * factory, even once unregistered.
+     * 
+     * @param url The URL
+     * @return ProtocolHandler* The protocol handler, or nullptr if none found
+     */
+    ProtocolHandler* findHandlerForUrl(const std::string& url) const;
+    
+    /**
+     * @brief Get the interned id of the scheme of a URL
+     * 
+     * @param url The URL
+     * @return SchemeId The id, INVALID_SCHEME_ID if no handler ever registered the scheme
+     */
+    SchemeId getSchemeId(const std::string& url) const;
+    
+    /**
+     * @brief Find the protocol handler for an interned scheme
+     * 
+     * @param schemeId The id returned by getSchemeId()
+     * @return ProtocolHandler* The protocol handler, or nullptr if none is registered now
+     */
+    ProtocolHandler* findHandler(SchemeId schemeId) const;
+    
     /**
      * @brief Get a protocol handler by name
      * 
@@ -378,15 +426,26 @@ public:
     /**
      * @brief Set the global authentication callback
      * 
+     * Applies to the registered handlers and those registered later.
+     * 
      * @param callback The authentication callback function
      */
     void setGlobalAuthCallback(ProtocolAuthCallback callback);
     
 private:
+    /**
+     * @brief One published state of the registry, never changed once published
+     */
+    struct Registry {
+        std::vector<std::shared_ptr<ProtocolHandler>> handlers;        // In registration order
+        std::vector<std::string> schemes;                               // Lowercase, by SchemeId
+        std::vector<ProtocolHandler*> handlersByScheme;                 // By SchemeId, nullptr if none
+    };
+    
     /**
      * @brief Construct a new ProtocolHandlerFactory
      */
-    ProtocolHandlerFactory() = default;
+    ProtocolHandlerFactory();
     
     /**
      * @brief Destroy the ProtocolHandlerFactory
@@ -398,17 +457,28 @@ private:
     ProtocolHandlerFactory& operator=(const ProtocolHandlerFactory&) = delete;
     
     /**
-     * @brief Extract protocol from URL
+     * @brief Find the interned id of a scheme
      * 
-     * @param url The URL
-     * @return std::string The protocol scheme
+     * @param registry The registry
+     * @param scheme The scheme, in any case
+     * @param length The length of the scheme
+     * @return SchemeId The id, INVALID_SCHEME_ID if not interned
+     */
+    static SchemeId findScheme(const Registry& registry, const char* scheme, size_t length);
+    
+    /**
+     * @brief Publish a registry built from a list of handlers
+     * 
+     * Called with mutex_ held.
+     * 
+     * @param handlers The handlers, in registration order
      */
-    std::string extractProtocol(const std::string& url) const;
+    void publish(std::vector<std::shared_ptr<ProtocolHandler>> handlers);
     
     // Member variables
-    std::map<std::string, std::shared_ptr<ProtocolHandler>> handlersByName_;
-    std::map<std::string, std::shared_ptr<ProtocolHandler>> handlersByScheme_;
-    mutable std::mutex mutex_;
+    std::atomic<const Registry*> registry_;
+    std::vector<std::unique_ptr<const Registry>> registries_;  // Every one published, readers may still use any
+    mutable std::mutex mutex_;                                   // Serializes changes
     ProtocolOptions defaultOptions_;
     ProtocolAuthCallback globalAuthCallback_ = nullptr;
 };
@@ -0,0 +1,388 @@
+#ifndef PROXY_POOL_H
+#define PROXY_POOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <curl/curl.h>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief How a connection is given a proxy
+ */
+enum class ProxyAssignment {
+    LEAST_LOADED,   // The proxy with the smallest share of its cap in use
+    WEIGHTED        // By configured weight times measured score, against load
+};
+
+/**
+ * @brief State of one proxy of the pool
+ */
+struct ProxyStats {
+    std::string url;
+    int connections = 0;            // Leased now
+    int maxConnections = 0;
+    double weight = 1.0;
+    double latencyMs = -1.0;        // Smoothed time to first byte, -1 until measured
+    double throughput = 0.0;        // Smoothed bytes per second of one connection
+    double score = 1.0;             // Measured quality relative to the pool
+    bool ejected = false;
+    int owners = 0;                 // Downloads stuck to it
+    int64_t transfers = 0;
+    int64_t failures = 0;           // Transfers the proxy failed
+    int64_t ejections = 0;
+};
+
+/**
+ * @brief Process-wide pool of forward proxies that connections go out through
+ *
+ * Each connection a segment opens is leased a proxy here, after its host's
+ * connection is leased from HostConnectionLimiter. A lease is refused while
+ * every healthy proxy is at its connection cap, and the segment waits for
+ * one as it waits for its host.
+ *
+ * A download sticks to the proxy it was first given, so all of its range
+ * requests and its probe leave through the same proxy; it only moves when
+ * that proxy is ejected, or when the proxy is full and the download holds
+ * no connection on it. Others are picked least-loaded or weighted.
+ *
+ * Transfers report the time to their first byte, their throughput and
+ * whether the proxy failed them. A proxy that fails
+ * MAX_CONSECUTIVE_FAILURES transfers in a row, or whose latency or
+ * throughput falls SLOW_FACTOR times behind the median of the pool, is
+ * ejected for EJECT_SECONDS, doubling on each ejection up to
+ * MAX_EJECT_SECONDS. With a health check URL a background thread fetches it
+ * through every proxy each HEALTH_CHECK_INTERVAL_SECONDS, refreshing the
+ * latencies and taking ejected proxies back once they answer; without one,
+ * ejected proxies come back on probation once their time is up.
+ */
+class ProxyPool {
+public:
+    /**
+     * @brief Handle of one proxied connection, 0 for none
+     */
+    using Lease = uint64_t;
+
+    /**
+     * @brief Callback for connections given back while owners are waiting
+     */
+    using ReleaseCallback = std::function<void()>;
+
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return ProxyPool& The singleton instance
+     */
+    static ProxyPool& getInstance();
+
+    /**
+     * @brief Replace the proxies of the pool
+     *
+     * Entries are separated by commas or whitespace, each a proxy URL
+     * optionally followed by "|cap" and "|weight", as in
+     * "http://10.0.0.1:3128|16|2". Proxies kept from the earlier list keep
+     * their measurements.
+     *
+     * @param list The proxies, empty to connect directly
+     */
+    void setProxies(const std::string& list);
+
+    /**
+     * @brief Check if connections go through the pool
+     *
+     * @return true if the pool has proxies, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Lease a proxy for one connection of a download
+     *
+     * @param owner The download
+     * @param proxy Receives the proxy URL
+     * @return Lease The lease, or 0 if the connection has to wait
+     */
+    Lease acquire(const std::string& owner, std::string& proxy);
+
+    /**
+     * @brief Give a connection back
+     *
+     * @param lease The lease (0 is ignored)
+     */
+    void release(Lease lease);
+
+    /**
+     * @brief Get the proxy of a download without leasing a connection
+     *
+     * For single requests such as probes; assigns one if the download has
+     * none yet.
+     *
+     * @param owner The download
+     * @return std::string The proxy URL, empty if the pool is disabled
+     */
+    std::string pick(const std::string& owner);
+
+    /**
+     * @brief Drop the proxy a download is stuck to
+     *
+     * @param owner The download
+     */
+    void forget(const std::string& owner);
+
+    /**
+     * @brief Record how a transfer through a proxy went
+     *
+     * @param proxy The proxy URL (empty is ignored)
+     * @param proxyFailed True if the proxy, not the origin, failed the transfer
+     * @param firstByteMs Milliseconds to the first byte, -1 if none arrived
+     * @param bytes Bytes received
+     * @param elapsedMs Milliseconds the transfer took
+     */
+    void report(const std::string& proxy, bool proxyFailed, int64_t firstByteMs,
+                int64_t bytes, int64_t elapsedMs);
+
+    /**
+     * @brief Check if a transfer result points at the proxy
+     *
+     * @param code The CURL result
+     * @param statusCode The HTTP status code
+     * @return true for proxy connection and gateway errors
+     */
+    static bool isProxyFailure(CURLcode code, int statusCode);
+
+    /**
+     * @brief Set how connections are given a proxy
+     *
+     * @param assignment The assignment policy
+     */
+    void setAssignment(ProxyAssignment assignment);
+
+    /**
+     * @brief Get how connections are given a proxy
+     *
+     * @return ProxyAssignment The assignment policy
+     */
+    ProxyAssignment getAssignment() const;
+
+    /**
+     * @brief Parse an assignment name ("least_loaded" or "weighted")
+     *
+     * @param name The name
+     * @param assignment Receives the assignment
+     * @return true if the name is known, false otherwise
+     */
+    static bool parseAssignment(const std::string& name, ProxyAssignment& assignment);
+
+    /**
+     * @brief Get the name of an assignment
+     *
+     * @param assignment The assignment
+     * @return const char* The name
+     */
+    static const char* getAssignmentName(ProxyAssignment assignment);
+
+    /**
+     * @brief Set the cap of proxies listed without one
+     *
+     * @param maxConnections Connections per proxy (at least 1)
+     */
+    void setDefaultMaxConnections(int maxConnections);
+
+    /**
+     * @brief Set the URL fetched through each proxy to check its health
+     *
+     * @param url The URL, empty to stop checking
+     */
+    void setHealthCheckUrl(const std::string& url);
+
+    /**
+     * @brief Check every proxy once through the health check URL
+     *
+     * Runs on the health check thread; blocks for the requests.
+     */
+    void checkHealth();
+
+    /**
+     * @brief Stop the health check thread
+     */
+    void shutdown();
+
+    /**
+     * @brief Get the state of every proxy
+     *
+     * @return std::vector<ProxyStats> The proxies, by URL
+     */
+    std::vector<ProxyStats> getStats() const;
+
+    /**
+     * @brief Set the callback for connections given back while owners wait
+     *
+     * Called without the pool's lock, on the releasing thread.
+     *
+     * @param callback The callback function
+     */
+    void setReleaseCallback(ReleaseCallback callback);
+
+    static constexpr int DEFAULT_MAX_CONNECTIONS = 8;
+    static constexpr int MAX_CONSECUTIVE_FAILURES = 3;
+    static constexpr int MIN_SAMPLES = 5;                   // Transfers before a proxy is judged slow
+    static constexpr double SLOW_FACTOR = 4.0;
+    static constexpr int EJECT_SECONDS = 30;
+    static constexpr int MAX_EJECT_SECONDS = 600;
+    static constexpr int HEALTH_CHECK_INTERVAL_SECONDS = 30;
+    static constexpr int HEALTH_CHECK_TIMEOUT_SECONDS = 10;
+    static constexpr int64_t MIN_THROUGHPUT_BYTES = 256 * 1024;     // Smaller transfers say little about bandwidth
+
+private:
+    /**
+     * @brief One proxy and its measurements
+     */
+    struct Proxy {
+        int connections = 0;
+        int maxConnections = 0;         // 0 for the pool default
+        double weight = 1.0;
+        double latencyMs = -1.0;
+        double throughput = 0.0;
+        int samples = 0;
+        int consecutiveFailures = 0;
+        int consecutiveSuccesses = 0;
+        bool ejected = false;
+        int ejectSeconds = 0;           // Length of the last ejection
+        std::chrono::steady_clock::time_point ejectedUntil;
+        int64_t transfers = 0;
+        int64_t failures = 0;
+        int64_t ejections = 0;
+    };
+
+    /**
+     * @brief The proxy a download is stuck to
+     */
+    struct Owner {
+        std::string proxy;
+        int connections = 0;            // Leased through that proxy
+    };
+
+    /**
+     * @brief Where a lease counts
+     */
+    struct LeaseInfo {
+        std::string proxy;
+        std::string owner;
+    };
+
+    /**
+     * @brief Construct a new ProxyPool
+     */
+    ProxyPool() = default;
+
+    /**
+     * @brief Destroy the ProxyPool
+     */
+    ~ProxyPool();
+
+    // Prevent copying
+    ProxyPool(const ProxyPool&) = delete;
+    ProxyPool& operator=(const ProxyPool&) = delete;
+
+    /**
+     * @brief Get the cap of a proxy
+     *
+     * @param proxy The proxy
+     * @return int The maximum connections
+     */
+    int getCap(const Proxy& proxy) const;
+
+    /**
+     * @brief Get the measured quality of a proxy relative to the pool
+     *
+     * Called with mutex_ held.
+     *
+     * @param proxy The proxy
+     * @return double 1 for a median proxy, more when faster
+     */
+    double getScore(const Proxy& proxy) const;
+
+    /**
+     * @brief Pick the best healthy proxy for another connection
+     *
+     * Called with mutex_ held.
+     *
+     * @param needCapacity True to skip proxies at their cap
+     * @return std::string The proxy URL, empty if none fits
+     */
+    std::string choose(bool needCapacity) const;
+
+    /**
+     * @brief Take back proxies whose ejection is over, when not health checked
+     *
+     * Called with mutex_ held.
+     */
+    void reinstateExpired();
+
+    /**
+     * @brief Eject a proxy if it keeps failing or falls behind the pool
+     *
+     * Called with mutex_ held.
+     *
+     * @param url The proxy URL
+     * @param proxy The proxy
+     */
+    void judge(const std::string& url, Proxy& proxy);
+
+    /**
+     * @brief Eject a proxy, unless it is the last healthy one
+     *
+     * Called with mutex_ held.
+     *
+     * @param url The proxy URL
+     * @param proxy The proxy
+     * @param reason Why, for the log
+     */
+    void eject(const std::string& url, Proxy& proxy, const std::string& reason);
+
+    /**
+     * @brief Update the medians of the healthy proxies
+     *
+     * Called with mutex_ held.
+     */
+    void updateMedians();
+
+    /**
+     * @brief Health check thread function
+     */
+    void healthThread();
+
+    // Member variables
+    std::map<std::string, Proxy> proxies_;
+    std::unordered_map<std::string, Owner> owners_;
+    std::unordered_map<Lease, LeaseInfo> leases_;
+    Lease nextLease_ = 1;
+    ProxyAssignment assignment_ = ProxyAssignment::LEAST_LOADED;
+    int defaultMaxConnections_ = DEFAULT_MAX_CONNECTIONS;
+    double medianLatencyMs_ = -1.0;
+    double medianThroughput_ = 0.0;
+    std::atomic<bool> enabled_{false};
+    bool waiting_ = false;              // An acquire was refused since the last release
+    ReleaseCallback releaseCallback_ = nullptr;
+    mutable std::mutex mutex_;
+
+    std::string healthCheckUrl_;
+    std::unique_ptr<std::thread> healthThread_;
+    bool stopHealth_ = false;
+    std::condition_variable healthCv_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // PROXY_POOL_H
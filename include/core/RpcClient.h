@@ -0,0 +1,146 @@
+#ifndef RPC_CLIENT_H
+#define RPC_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "core/RpcProtocol.h"
+
+namespace dm {
+namespace core {
+
+// Called for each event of a subscription, return false to stop
+using RpcEventCallback = std::function<bool(RpcEventKind, const RpcTaskSummary&)>;
+
+/**
+ * @brief Client of the download daemon
+ *
+ * A thin, blocking connection to an RpcServer for tools that submit and
+ * control downloads without starting the engine themselves. Batches are
+ * split into frames of ADD_BATCH_SIZE so any number of downloads can be
+ * sent, each frame in one round trip.
+ */
+class RpcClient {
+public:
+    static constexpr size_t ADD_BATCH_SIZE = 4096;
+
+    /**
+     * @brief Construct a new RpcClient
+     */
+    RpcClient();
+
+    /**
+     * @brief Destroy the RpcClient, disconnecting it
+     */
+    ~RpcClient();
+
+    /**
+     * @brief Connect to a daemon
+     *
+     * @param socketPath The daemon socket path
+     * @return true if connected, false otherwise
+     */
+    bool connect(const std::string& socketPath);
+
+    /**
+     * @brief Disconnect from the daemon
+     */
+    void disconnect();
+
+    /**
+     * @brief Check if connected
+     *
+     * @return true if connected, false otherwise
+     */
+    bool isConnected() const { return fd_ >= 0; }
+
+    /**
+     * @brief Add downloads
+     *
+     * @param downloads The downloads
+     * @param start Whether to dispatch them when slots open
+     * @param ids Receives the task ID of each download, empty where it failed
+     * @return true if the daemon answered, false otherwise
+     */
+    bool addDownloads(const std::vector<RpcDownload>& downloads, bool start, std::vector<std::string>& ids);
+
+    /**
+     * @brief Apply an operation to tasks
+     *
+     * @param operation The operation
+     * @param ids The task IDs
+     * @param results Receives whether it succeeded for each task
+     * @return true if the daemon answered, false otherwise
+     */
+    bool control(RpcControl operation, const std::vector<std::string>& ids, std::vector<bool>& results);
+
+    /**
+     * @brief List all tasks
+     *
+     * @param tasks Receives the tasks
+     * @return true if the daemon answered, false otherwise
+     */
+    bool listTasks(std::vector<RpcTaskSummary>& tasks);
+
+    /**
+     * @brief List the tasks with a status
+     *
+     * @param status The status to filter by
+     * @param tasks Receives the tasks
+     * @return true if the daemon answered, false otherwise
+     */
+    bool listTasks(DownloadStatus status, std::vector<RpcTaskSummary>& tasks);
+
+    /**
+     * @brief Receive events until the callback stops or the connection closes
+     *
+     * The connection is only used for events afterwards.
+     *
+     * @param progressIntervalMs How often to get progress of active tasks, 0 for status changes only
+     * @param callback The event callback
+     * @return true if the callback stopped, false if the connection failed
+     */
+    bool subscribe(uint32_t progressIntervalMs, RpcEventCallback callback);
+
+    /**
+     * @brief Ask the daemon to shut down
+     *
+     * @return true if the daemon accepted, false otherwise
+     */
+    bool shutdownDaemon();
+
+    /**
+     * @brief Get the last error
+     *
+     * @return const std::string& The error message
+     */
+    const std::string& getError() const { return error_; }
+
+private:
+    /**
+     * @brief Send a request and receive its result
+     *
+     * @param request The request payload
+     * @param response Receives the result payload
+     * @return true if the daemon answered with a result, false otherwise
+     */
+    bool call(const RpcWriter& request, std::string& response);
+
+    bool list(uint8_t filter, std::vector<RpcTaskSummary>& tasks);
+
+    // Prevent copying
+    RpcClient(const RpcClient&) = delete;
+    RpcClient& operator=(const RpcClient&) = delete;
+
+    // Member variables
+    int fd_ = -1;
+    uint32_t nextRequestId_ = 1;
+    std::string error_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // RPC_CLIENT_H
@@ -0,0 +1,213 @@
+#ifndef RPC_PROTOCOL_H
+#define RPC_PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "core/DownloadTask.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Message types of the daemon RPC protocol
+ *
+ * Every message is a frame: the payload size (u32), then the payload,
+ * which starts with the type (u8) and a request ID (u32) the response
+ * echoes. Integers are little-endian and strings are a u32 size and the
+ * bytes, as in the task journal.
+ *
+ *   ADD        u8 start, u32 count, count x (url, destination, filename, u8 priority)
+ *              -> u32 count, count x task ID, empty where the add failed
+ *   CONTROL    u8 RpcControl, u32 count, count x task ID
+ *              -> u32 count, count x u8 success
+ *   LIST       u8 status, 0xFF for all
+ *              -> u32 count, count x RpcTaskSummary
+ *   SUBSCRIBE  u32 progress interval in ms, 0 for status changes only
+ *              -> empty, then EVENT frames until the connection closes
+ *   SHUTDOWN   -> empty, then the daemon exits
+ *
+ * Failures are answered with ERROR and a message instead of RESULT.
+ */
+enum class RpcMessageType : uint8_t {
+    ADD = 1,
+    CONTROL = 2,
+    LIST = 3,
+    SUBSCRIBE = 4,
+    SHUTDOWN = 5,
+    RESULT = 0x80,
+    ERROR = 0x81,
+    EVENT = 0x82        // u8 RpcEventKind, then an RpcTaskSummary
+};
+
+/**
+ * @brief Operations applied to a batch of tasks by CONTROL
+ */
+enum class RpcControl : uint8_t {
+    START,
+    PAUSE,
+    RESUME,
+    CANCEL,
+    REMOVE
+};
+
+/**
+ * @brief Why an EVENT was sent
+ */
+enum class RpcEventKind : uint8_t {
+    STATUS,             // A task changed status
+    PROGRESS            // Periodic progress of an active task
+};
+
+/**
+ * @brief A download to add
+ */
+struct RpcDownload {
+    std::string url;
+    std::string destinationPath;        // Empty for the default directory
+    std::string filename;               // Empty to take it from the URL
+    DownloadPriority priority = DownloadPriority::NORMAL;
+};
+
+/**
+ * @brief State of one task as sent by LIST and EVENT
+ */
+struct RpcTaskSummary {
+    std::string id;
+    std::string url;
+    std::string filename;
+    DownloadStatus status = DownloadStatus::NONE;
+    int64_t downloadedBytes = 0;
+    int64_t totalBytes = 0;             // 0 if unknown
+    int64_t speed = 0;                  // Bytes/second
+};
+
+/**
+ * @brief Builds a message payload
+ */
+class RpcWriter {
+public:
+    /**
+     * @brief Start a payload
+     *
+     * @param type The message type
+     * @param requestId The request ID
+     */
+    RpcWriter(RpcMessageType type, uint32_t requestId);
+
+    // Append a value
+    void putU8(uint8_t value) { payload_.push_back(static_cast<char>(value)); }
+    void putU32(uint32_t value);
+    void putI64(int64_t value);
+    void putString(const std::string& value);
+    void putSummary(const RpcTaskSummary& summary);
+
+    /**
+     * @brief Get the payload
+     *
+     * @return const std::string& The payload
+     */
+    const std::string& getPayload() const { return payload_; }
+
+private:
+    // Member variables
+    std::string payload_;
+};
+
+/**
+ * @brief Bounds-checked reader over a message payload
+ *
+ * Every read fails once the payload runs out, so a message can be read
+ * through and checked once at the end.
+ */
+class RpcReader {
+public:
+    /**
+     * @brief Start reading a payload, past its type and request ID
+     *
+     * @param payload The payload, kept by reference
+     */
+    explicit RpcReader(const std::string& payload);
+
+    /**
+     * @brief Check if the payload had a type and request ID
+     *
+     * @return true if valid, false otherwise
+     */
+    bool isValid() const { return valid_; }
+
+    RpcMessageType getType() const { return type_; }
+    uint32_t getRequestId() const { return requestId_; }
+
+    // Read the next value, false if the payload runs out
+    bool readU8(uint8_t& value);
+    bool readU32(uint32_t& value);
+    bool readI64(int64_t& value);
+    bool readString(std::string& value);
+    bool readSummary(RpcTaskSummary& summary);
+
+    /**
+     * @brief Check if the payload was read exactly to its end
+     *
+     * @return true if done, false otherwise
+     */
+    bool done() const { return valid_ && pos_ == payload_.size(); }
+
+    /**
+     * @brief Get the count of items that can still follow, at a minimum size each
+     *
+     * Bounds counts read from the peer before anything is reserved for them.
+     *
+     * @param itemSize The smallest encoded size of one item
+     * @return size_t The most items that fit in what is left
+     */
+    size_t remainingItems(size_t itemSize) const { return (payload_.size() - pos_) / itemSize; }
+
+private:
+    // Member variables
+    const std::string& payload_;
+    size_t pos_ = 0;
+    bool valid_ = false;
+    RpcMessageType type_ = RpcMessageType::ERROR;
+    uint32_t requestId_ = 0;
+};
+
+/**
+ * @brief Frame I/O on a connected local socket
+ */
+class RpcChannel {
+public:
+    static constexpr size_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * @brief Send one frame
+     *
+     * @param fd The socket
+     * @param payload The payload
+     * @return true if sent, false if the connection failed
+     */
+    static bool sendFrame(int fd, const std::string& payload);
+
+    /**
+     * @brief Receive one frame
+     *
+     * @param fd The socket
+     * @param payload Receives the payload
+     * @return true if received, false on disconnect, error or an oversized frame
+     */
+    static bool receiveFrame(int fd, std::string& payload);
+
+    /**
+     * @brief Get the socket path used when none is given
+     *
+     * @return std::string The path
+     */
+    static std::string getDefaultSocketPath();
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // RPC_PROTOCOL_H
@@ -0,0 +1,170 @@
+#ifndef RPC_SERVER_H
+#define RPC_SERVER_H
+
+#include <string>
+#include <list>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "core/RpcProtocol.h"
+
+namespace dm {
+namespace core {
+
+// Forward declarations
+class DownloadManager;
+
+/**
+ * @brief Serves the daemon RPC protocol on a local socket
+ *
+ * Lets a long-lived headless process own the DownloadManager while
+ * command-line clients submit and control downloads through it, so a
+ * client starts in milliseconds instead of loading the engine and the
+ * saved tasks itself. Each connection has its own thread; requests on a
+ * connection are answered in order and carry whole batches, so one
+ * round trip adds or controls thousands of tasks.
+ *
+ * Subscribed connections get status events from a task status listener
+ * that only queues them, bounded per connection, so a slow client never
+ * holds up a download thread; a client that falls too far behind is
+ * disconnected. The socket is only accessible to the current user.
+ *
+ * Unix domain sockets only, not available on Windows yet.
+ */
+class RpcServer {
+public:
+    /**
+     * @brief Construct a new RpcServer
+     *
+     * @param manager The initialized download manager to serve
+     */
+    explicit RpcServer(DownloadManager& manager);
+
+    /**
+     * @brief Destroy the RpcServer, stopping it
+     */
+    ~RpcServer();
+
+    /**
+     * @brief Start listening
+     *
+     * A socket left by a daemon that died is replaced; one that another
+     * daemon is still listening on is not.
+     *
+     * @param socketPath The socket path
+     * @return true if listening, false otherwise
+     */
+    bool start(const std::string& socketPath);
+
+    /**
+     * @brief Stop listening, close all connections and remove the socket
+     */
+    void stop();
+
+    /**
+     * @brief Block until a client asks the daemon to shut down or requestShutdown() is called
+     */
+    void waitForShutdown();
+
+    /**
+     * @brief Release waitForShutdown()
+     */
+    void requestShutdown();
+
+private:
+    /**
+     * @brief A client connection
+     */
+    struct Connection {
+        int fd = -1;
+        int wakePipe[2] = {-1, -1};             // Written to when events are queued or on stop
+        std::thread thread;
+        std::atomic<bool> finished{false};
+
+        std::mutex mutex;                       // Guards the members below
+        std::deque<std::string> events;         // Encoded EVENT frames to send
+        bool overflowed = false;
+
+        int listenerId = -1;                    // Set once subscribed
+        uint32_t progressIntervalMs = 0;
+    };
+
+    /**
+     * @brief Accept connections until stopped
+     */
+    void acceptLoop();
+
+    /**
+     * @brief Serve one connection until it closes or the server stops
+     *
+     * @param connection The connection
+     */
+    void serveConnection(Connection* connection);
+
+    /**
+     * @brief Answer one request
+     *
+     * @param connection The connection it came on
+     * @param request The request payload
+     * @param response Receives the response payload
+     * @return true to keep the connection open, false to close it
+     */
+    bool handleRequest(Connection* connection, const std::string& request, std::string& response);
+
+    std::string handleAdd(RpcReader& reader);
+    std::string handleControl(RpcReader& reader);
+    std::string handleList(RpcReader& reader);
+    std::string handleSubscribe(Connection* connection, RpcReader& reader);
+
+    /**
+     * @brief Queue a status event for a subscribed connection
+     *
+     * Runs on the thread that changed the status and never blocks on the client.
+     *
+     * @param connection The connection
+     * @param event The encoded event
+     */
+    void queueEvent(Connection* connection, std::string event);
+
+    /**
+     * @brief Send progress events for the active tasks
+     *
+     * @param connection The connection
+     * @return true if sent, false if the connection failed
+     */
+    bool sendProgress(Connection* connection);
+
+    /**
+     * @brief Unsubscribe a connection, join its thread and close it
+     *
+     * @param connection The connection
+     */
+    void closeConnection(Connection* connection);
+
+    // Prevent copying
+    RpcServer(const RpcServer&) = delete;
+    RpcServer& operator=(const RpcServer&) = delete;
+
+    // Member variables
+    DownloadManager& manager_;
+    std::string socketPath_;
+    int listenFd_ = -1;
+    int wakePipe_[2] = {-1, -1};                // Written to on stop
+    std::atomic<bool> running_{false};
+    std::thread acceptThread_;
+    std::list<std::unique_ptr<Connection>> connections_;    // Accept thread only, until stopped
+
+    std::mutex shutdownMutex_;
+    std::condition_variable shutdownCondition_;
+    bool shutdownRequested_ = false;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // RPC_SERVER_H
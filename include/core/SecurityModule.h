@@ -10,6 +10,8 @@
 #include <atomic>
 #include <chrono>
 
+#include "utils/DomainMatcher.h"
+
 namespace dm {
 namespace core {
 
@@ -58,8 +60,8 @@ struct SecurityPolicy {
     bool quarantineRiskyFiles = true;        // Quarantine risky files
     bool enableContentFiltering = true;      // Enable content filtering
     bool enableFileTypeVerification = true;  // Verify file types
-    std::vector<std::string> trustedDomains; // Trusted domains
-    std::vector<std::string> blockedDomains; // Blocked domains
+    std::vector<std::string> trustedDomains; // Trusted domain patterns, see DomainMatcher
+    std::vector<std::string> blockedDomains; // Blocked domain patterns
     std::map<std::string, bool> fileTypeRules; // Rules for file types
     int maxFileSizeMB = 0;                   // Max file size (0 for unlimited)
     bool enablePasswordProtection = false;   // Enable password protection
@@ -221,6 +223,9 @@ public:
     /**
      * @brief Check if a domain is trusted
      * 
+     * Looks the domain up in the compiled trust list without taking the
+     * module lock, in time proportional to its label count.
+     * 
      * @param domain The domain to check
      * @return true if trusted, false otherwise
      */
@@ -229,6 +234,9 @@ public:
     /**
      * @brief Check if a domain is blocked
      * 
+     * Looks the domain up in the compiled block list without taking the
+     * module lock, in time proportional to its label count.
+     * 
      * @param domain The domain to check
      * @return true if blocked, false otherwise
      */
@@ -262,6 +270,20 @@ public:
      */
     void removeBlockedDomain(const std::string& domain);
     
+    /**
+     * @brief Replace the block list with a domain list file
+     * 
+     * Meant for large threat feeds: the list is compiled through a binary
+     * cache (see DomainMatcher::loadList) and swapped in atomically, so
+     * lookups in progress finish against the old list. The patterns are
+     * not copied into the policy.
+     * 
+     * @param listPath The list file
+     * @param cachePath The cache file, empty for none
+     * @return true if loaded, false otherwise
+     */
+    bool loadBlockedDomainList(const std::string& listPath, const std::string& cachePath = "");
+    
     /**
      * @brief Quarantine a file
      * 
@@ -289,6 +311,8 @@ public:
     /**
      * @brief Set security policy
      * 
+     * Recompiles the trust and block lists.
+     * 
      * @param policy The security policy
      */
     void setSecurityPolicy(const SecurityPolicy& policy);
@@ -424,14 +448,6 @@ private:
                          RiskLevel riskLevel = RiskLevel::SAFE,
                          const std::string& details = "");
     
-    /**
-     * @brief Extract domain from URL
-     * 
-     * @param url The URL
-     * @return std::string The domain
-     */
-    std::string extractDomain(const std::string& url) const;
-    
     /**
      * @brief Calculate file hash
      * 
@@ -457,6 +473,13 @@ private:
      */
     bool checkFileHeadersAndFooters(const std::string& filePath, const std::string& fileType) const;
     
+    /**
+     * @brief Compile the domain lists of the policy and swap them in
+     * 
+     * Called with mutex_ held after every change to the lists.
+     */
+    void compileDomainLists();
+    
     /**
      * @brief Generate a quarantine file ID
      * 
@@ -476,6 +499,8 @@ private:
     // Member variables
     DownloadManager* downloadManager_ = nullptr;
     SecurityPolicy policy_;
+    std::shared_ptr<const utils::DomainMatcher> trustedDomains_;    // Read and replaced with std::atomic_load/store
+    std::shared_ptr<const utils::DomainMatcher> blockedDomains_;
     std::string quarantineDirectory_;
     std::vector<SecurityEvent> securityEvents_;
     std::atomic<bool> enabled_;
@@ -11,6 +11,10 @@
 #include <memory>
 #include <functional>
 #include "core/HttpClient.h"
+#include "core/OutputFile.h"
+#include "core/WriteBufferPool.h"
+#include "core/TransferEngine.h"
+#include "core/Throttler.h"
 
 namespace dm {
 namespace core {
@@ -36,6 +40,14 @@ using SegmentCompletionCallback = std::function<void(std::shared_ptr<class Segme
  */
 using SegmentErrorCallback = std::function<void(std::shared_ptr<class SegmentDownloader>, const std::string&)>;
 
+/**
+ * @brief Server busy callback function type
+ * 
+ * Called when the server answers 429 or 503. Returning true parks the
+ * segment as PAUSED instead of retrying; the owner resumes it later.
+ */
+using SegmentBackoffCallback = std::function<bool(std::shared_ptr<class SegmentDownloader>, int statusCode)>;
+
 /**
  * @brief Segment downloader class
  * 
@@ -101,10 +113,19 @@ public:
     /**
      * @brief Set the error callback
      * 
+     * Called once the segment has given up, after its last retry.
+     * 
      * @param callback The error callback function
      */
     void setErrorCallback(SegmentErrorCallback callback);
     
+    /**
+     * @brief Set the server busy callback
+     * 
+     * @param callback The backoff callback function
+     */
+    void setBackoffCallback(SegmentBackoffCallback callback);
+    
     /**
      * @brief Get the current status
      * 
@@ -154,6 +175,34 @@ public:
      */
     int64_t getEndByte() const;
     
+    /**
+     * @brief Get the number of bytes not yet received
+     * 
+     * @return int64_t The remaining bytes (0 if unknown)
+     */
+    int64_t getRemainingBytes() const;
+    
+    /**
+     * @brief Get the offset up to which the range has reached the file
+     * 
+     * Unlike the bytes received, this excludes data still buffered, so a
+     * download restarted from here loses nothing.
+     * 
+     * @return int64_t The file offset
+     */
+    int64_t getSavedPosition() const;
+    
+    /**
+     * @brief Give away the tail of the range
+     * 
+     * Fails if bytes past the new end have already been accepted. Writes are
+     * clipped at the new end and the transfer completes once it is reached.
+     * 
+     * @param newEndByte The new, smaller end byte
+     * @return true if the range was shrunk, false otherwise
+     */
+    bool shrinkEnd(int64_t newEndByte);
+    
     /**
      * @brief Get the file path
      * 
@@ -189,12 +238,197 @@ public:
      */
     int getRetryCount() const { return retryCount_; }
     
+    /**
+     * @brief Set whether a retry continues from the last byte written out
+     * 
+     * Needs a server that honours byte ranges, otherwise every attempt
+     * starts over at the start of the range.
+     * 
+     * @param resumable True to continue where the failed attempt stopped
+     */
+    void setResumable(bool resumable) { resumable_ = resumable; }
+    
+    /**
+     * @brief Set the transfer mode
+     * 
+     * Takes effect on the next start()
+     * 
+     * @param mode The transfer mode
+     */
+    void setTransferMode(TransferMode mode) { transferMode_ = mode; }
+    
+    /**
+     * @brief Get the transfer mode
+     * 
+     * @return TransferMode The transfer mode
+     */
+    TransferMode getTransferMode() const { return transferMode_; }
+    
+    /**
+     * @brief Set whether the segment may share a multiplexed connection
+     * 
+     * Only used in event loop mode. Takes effect on the next start()
+     * 
+     * @param enabled True to request HTTP/2 (or HTTP/3) multiplexing
+     */
+    void setMultiplexing(bool enabled) { multiplex_ = enabled; }
+    
+    /**
+     * @brief Set the proxy the segment's requests go out through
+     * 
+     * Each attempt reports its latency, throughput and outcome to
+     * ProxyPool. Takes effect on the next start()
+     * 
+     * @param proxy The proxy URL, empty to connect directly
+     */
+    void setProxy(const std::string& proxy) { proxy_ = proxy; }
+    
+    /**
+     * @brief Get the proxy the segment's requests go out through
+     * 
+     * @return const std::string& The proxy URL, empty if direct
+     */
+    const std::string& getProxy() const { return proxy_; }
+    
+    /**
+     * @brief Request the range without an end while it runs to the end of the file
+     * 
+     * An FTP transfer that stops short of the end has to be aborted, which
+     * costs the control connection. A tail segment that lets the server
+     * finish keeps its session logged in for the next request.
+     * 
+     * @param lastByte The last byte of the file, -1 to always send the end
+     */
+    void setOpenEndedTail(int64_t lastByte) { openEndedTail_ = lastByte; }
+    
+    /**
+     * @brief Set the throttler shared by the segments of a task
+     * 
+     * @param throttler The throttler (nullptr for none)
+     */
+    void setThrottler(std::shared_ptr<Throttler> throttler);
+    
+    /**
+     * @brief Set the output file shared by the segments of a task
+     * 
+     * When unset the segment opens its own file on start()
+     * 
+     * @param file The open output file
+     */
+    void setOutputFile(std::shared_ptr<OutputFile> file);
+    
+    /**
+     * @brief Set the pool that write-combining buffers are taken from
+     * 
+     * @param pool The buffer pool (nullptr to write every chunk through)
+     */
+    void setWriteBufferPool(std::shared_ptr<WriteBufferPool> pool);
+    
 private:
     /**
      * @brief Download thread function
      */
     void downloadThread();
     
+    /**
+     * @brief Write received data, clipped to the current range
+     * 
+     * @param data The received data
+     * @param size The size of the data
+     * @return true to continue, false to stop the transfer
+     */
+    bool writeData(const char* data, size_t size);
+    
+    /**
+     * @brief Position the writer for a new attempt
+     * 
+     * Continues after the data earlier attempts wrote out when resumable,
+     * at the start of the range otherwise.
+     * 
+     * @return int64_t The offset of the first byte to request
+     */
+    int64_t resumeWriter();
+    
+    /**
+     * @brief Decide whether and when a failed attempt is retried
+     * 
+     * Failures that retrying cannot fix give up at once. An attempt that
+     * wrote data resets the failure count, a connection that dropped after
+     * writing data is retried at once, a busy reply waits as long as its
+     * Retry-After asks and anything else backs off exponentially with
+     * jitter.
+     * 
+     * @param curlCode The transport result of the attempt
+     * @param statusCode The HTTP or FTP reply code of the attempt
+     * @param retryAfter The seconds asked by Retry-After, -1 if not given
+     * @return int64_t The delay before the next attempt in ms, -1 to give up
+     */
+    int64_t planRetry(CURLcode curlCode, int statusCode, int retryAfter);
+    
+    /**
+     * @brief Sleep before a retry, waking up early when stopped
+     * 
+     * @param delayMs The delay in ms
+     */
+    void waitForRetry(int64_t delayMs);
+    
+    /**
+     * @brief Get the offset of the next byte to write
+     * 
+     * Called with rangeMutex_ held.
+     * 
+     * @return int64_t The file offset
+     */
+    int64_t getPosition() const;
+    
+    /**
+     * @brief Check if every byte of the range has been accepted
+     * 
+     * @return true if the range is filled, false otherwise
+     */
+    bool isRangeFilled() const;
+    
+    /**
+     * @brief Open a private output file if none was shared and create the writer
+     * 
+     * @return true if the output file is open, false otherwise
+     */
+    bool openOutputFile();
+    
+    /**
+     * @brief Submit the segment to the transfer engine
+     * 
+     * @param delayMs Delay before the transfer starts
+     * @return true if submitted, false otherwise
+     */
+    bool submitTransfer(int64_t delayMs);
+    
+    /**
+     * @brief Data callback for engine transfers
+     * 
+     * @param data The received data
+     * @param size The size of the data
+     * @return true to continue, false to abort
+     */
+    bool onTransferData(const char* data, size_t size);
+    
+    /**
+     * @brief Completion callback for engine transfers
+     * 
+     * @param result The transfer result
+     */
+    void onTransferCompleted(const TransferResult& result);
+    
+    /**
+     * @brief Register the segment as an active throttler consumer
+     */
+    void attachThrottler();
+    
+    /**
+     * @brief Unregister the segment as an active throttler consumer
+     */
+    void detachThrottler();
+    
     /**
      * @brief Set the status
      * 
@@ -202,6 +436,29 @@ private:
      */
     void setStatus(SegmentStatus status);
     
+    /**
+     * @brief Get the end byte to request, -1 for an open-ended tail
+     * 
+     * @return int64_t The end byte
+     */
+    int64_t requestEndByte() const;
+    
+    /**
+     * @brief Offer a server busy reply to the backoff callback
+     * 
+     * @param statusCode The HTTP or FTP reply code of the failed attempt
+     * @return true if the segment should be parked, false to retry as usual
+     */
+    bool backOff(int statusCode);
+    
+    /**
+     * @brief Report the attempt that just ended to the proxy pool
+     * 
+     * @param curlCode The CURL result of the attempt
+     * @param statusCode The HTTP status code of the attempt
+     */
+    void reportProxy(CURLcode curlCode, int statusCode);
+    
     /**
      * @brief Update the download speed
      */
@@ -219,18 +476,12 @@ private:
     bool onProgress(int64_t downloadTotal, int64_t downloadedNow, 
                    int64_t uploadTotal, int64_t uploadedNow);
     
-    /**
-     * @brief Log memory usage
-     * 
-     * @param prefix The prefix for the log message
-     */
-    void logMemoryUsage(const std::string& prefix);
-    
     // Member variables
     std::string url_;
     std::string filePath_;
     int64_t startByte_;
-    int64_t endByte_;
+    std::atomic<int64_t> endByte_;   // Shrinks when another segment steals the tail
+    mutable std::mutex rangeMutex_;  // Serializes shrinkEnd() with the write path
     int id_;
     
     std::atomic<SegmentStatus> status_ = SegmentStatus::NONE;
@@ -241,6 +492,12 @@ private:
     
     int maxRetries_ = 3; // Default max retries per segment
     int retryCount_ = 0;
+    int failures_ = 0;               // Consecutive failed attempts that wrote nothing
+    bool resumable_ = true;
+    int64_t attemptStart_ = 0;       // First byte requested by the current attempt
+    std::chrono::steady_clock::time_point attemptStartedAt_;
+    std::atomic<int64_t> firstByteMs_ = -1;     // Of the current attempt, -1 until data arrives
+    std::atomic<bool> writeFailed_ = false;
     
     std::unique_ptr<std::thread> thread_;
     std::mutex mutex_;
@@ -250,8 +507,21 @@ private:
     
     std::unique_ptr<HttpClient> httpClient_;
     
+    TransferMode transferMode_ = TransferMode::THREADED;
+    bool multiplex_ = false;
+    std::string proxy_;
+    int64_t openEndedTail_ = -1;     // Last byte of the file, requested without an end
+    std::atomic<TransferId> transferId_ = 0;
+    std::shared_ptr<OutputFile> outputFile_;
+    std::shared_ptr<WriteBufferPool> writeBufferPool_;
+    std::unique_ptr<BufferedFileWriter> writer_;
+    
+    std::shared_ptr<Throttler> throttler_;
+    std::atomic<bool> throttlerAttached_ = false;
+    
     SegmentCompletionCallback completionCallback_ = nullptr;
     SegmentErrorCallback errorCallback_ = nullptr;
+    SegmentBackoffCallback backoffCallback_ = nullptr;
 };
 
 } // namespace core
@@ -4,10 +4,95 @@
 #include <string>
 #include <mutex>
 #include <map>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include "core/SocketTuner.h"
+#include "core/DeviceIoScheduler.h"
+#include "core/TransferEngine.h"
+#include "core/ProxyPool.h"
+#include "utils/DiskIo.h"
 
 namespace dm {
 namespace core {
 
+/**
+ * @brief The known settings, parsed
+ * 
+ * Published immutable: a reader loads the current snapshot once and reads
+ * fields from it, with no lookups, parsing or locking. Defaults are the
+ * member initializers; values that fail to parse keep them.
+ */
+struct SettingsSnapshot {
+    std::string downloadDirectory;
+    int maxConcurrentDownloads = 3;
+    int segmentCount = 4;
+    bool closeToTray = true;
+    bool showNotifications = true;
+    bool startWithSystem = false;
+    bool startMinimized = false;
+    bool autoStartDownloads = true;
+    int maxDownloadSpeed = 0;                       // KB/s, 0 for unlimited
+    TransferMode transferMode = TransferMode::THREADED;
+    bool directIo = false;
+    dm::utils::DiskIoBackendType diskIoBackend = dm::utils::DiskIoBackendType::PORTABLE;
+    int writeBufferSize = 1024;                     // KB per segment
+    bool dynamicSplitting = true;
+    bool adaptiveSegments = false;
+    std::string streamingHash;
+    bool revalidateDownloads = false;
+    std::string contentStore;                       // Directory, empty disables
+    bool contentStoreHardLinks = false;             // Where reflinks are not supported
+    bool checksumSidecars = false;
+    bool httpMultiplexing = false;
+    bool http3 = false;
+    int maxStreamsPerConnection = 100;
+    int dnsCacheTtl = 300;                          // Seconds
+    int happyEyeballsTimeout = 200;                 // ms
+    int maxConnectionsPerHost = 8;
+    int maxConnectionsPerAddress = 16;
+    int maxConnections = 64;
+    bool adaptiveConcurrency = false;
+    int resourceSampleInterval = 1000;              // ms
+    std::string metricsFile;
+    int metricsInterval = 15000;                    // ms
+    int pluginCallBudget = 20;                      // ms, 0 disables
+    SocketProfile socketProfile = SocketProfile::AUTO;
+    bool streamMedia = false;                       // Audio and video are fetched head first
+    bool deviceIoScheduling = true;                 // "auto" resolves to the backend being portable
+    int ssdMaxWriters = 8;
+    int hddMaxWriters = 1;
+    int networkMaxWriters = 4;
+    bool reserveDiskSpace = true;
+    int diskSpaceMargin = 64;                       // MB kept free beyond all reservations
+    int smallFileThreshold = 256;                   // KB up to which downloads are staged in memory
+    std::string proxyPool;                          // Empty to connect directly
+    ProxyAssignment proxyAssignment = ProxyAssignment::LEAST_LOADED;
+    int proxyMaxConnections = 8;                    // Per proxy listed without a cap
+    std::string proxyHealthUrl;                     // Empty for no health checks
+    std::string clusterDirectory;                   // Shared with the other nodes, empty to work alone
+    std::string clusterNodeId;                      // Empty for the host name and process ID
+    int clusterLeaseSeconds = 60;
+    int clusterSplitSize = 1024;                    // MB from which a file is split across nodes, 0 never
+    int clusterPieceSize = 64;                      // MB leased at a time of a split file
+    bool peerCache = false;                         // Share finished downloads with the LAN
+    int peerCachePort = 47810;
+    std::string peerCachePeers;                     // "host:port" asked besides those found over mDNS
+    int prefetchQueuedTasks = 4;                    // Queued downloads probed ahead, 0 disables
+    int prefetchTtl = 30;                           // Seconds
+    int threadStackSize = 0;                        // KB, 0 for the system default
+    int writeBufferBudget = 0;                      // KB of write buffers of all downloads, 0 for no limit
+    int pieceHashSize = 0;                          // KB per locally hashed piece, 0 disables
+};
+
+/**
+ * @brief Settings change callback type, called with the snapshots before and after
+ */
+using SettingsChangeCallback = std::function<void(const SettingsSnapshot& previous,
+                                                  const SettingsSnapshot& current)>;
+
 /**
  * @brief Settings class for application configuration
  */
@@ -42,6 +127,37 @@ public:
      */
     void resetToDefaults();
     
+    /**
+     * @brief Get the current snapshot of the known settings
+     * 
+     * Code reading several settings, or reading them often, should hold
+     * one snapshot rather than call the getters, which each load it.
+     * 
+     * @return std::shared_ptr<const SettingsSnapshot> The snapshot, never null
+     */
+    std::shared_ptr<const SettingsSnapshot> getSnapshot() const;
+    
+    /**
+     * @brief Register a callback for settings changes
+     * 
+     * Called after the new snapshot is published, without the settings
+     * lock held. Deliveries are serialized and in publication order: one
+     * thread at a time runs the callbacks, and changes published while it
+     * does are delivered by it afterwards, possibly several in one call.
+     * Each call's previous snapshot is the current one of the call before.
+     * 
+     * @param callback The callback
+     * @return int Callback ID for removing it
+     */
+    int addChangeCallback(SettingsChangeCallback callback);
+    
+    /**
+     * @brief Remove a settings change callback
+     * 
+     * @param callbackId Callback ID from registration
+     */
+    void removeChangeCallback(int callbackId);
+    
     /**
      * @brief Get the download directory
      * 
@@ -168,6 +284,742 @@ public:
      */
     void setMaxDownloadSpeed(int speed);
     
+    /**
+     * @brief Get the transfer mode for new downloads
+     * 
+     * @return TransferMode The transfer mode
+     */
+    TransferMode getTransferMode() const;
+    
+    /**
+     * @brief Set the transfer mode for new downloads
+     * 
+     * @param mode The transfer mode
+     */
+    void setTransferMode(TransferMode mode);
+    
+    /**
+     * @brief Get whether output files use direct I/O
+     * 
+     * @return bool True if direct I/O is enabled
+     */
+    bool getDirectIo() const;
+    
+    /**
+     * @brief Set whether output files use direct I/O
+     * 
+     * @param enabled True to enable direct I/O
+     */
+    void setDirectIo(bool enabled);
+    
+    /**
+     * @brief Get the disk I/O backend, applied at startup
+     * 
+     * @return dm::utils::DiskIoBackendType The backend type
+     */
+    dm::utils::DiskIoBackendType getDiskIoBackend() const;
+    
+    /**
+     * @brief Set the disk I/O backend, applied at startup
+     * 
+     * @param type The backend type
+     */
+    void setDiskIoBackend(dm::utils::DiskIoBackendType type);
+    
+    /**
+     * @brief Get the per-segment write buffer size (0 to disable)
+     * 
+     * @return int The write buffer size in KB
+     */
+    int getWriteBufferSize() const;
+    
+    /**
+     * @brief Set the per-segment write buffer size (0 to disable)
+     * 
+     * @param size The write buffer size in KB
+     */
+    void setWriteBufferSize(int size);
+    
+    /**
+     * @brief Get whether idle connections split slow segments
+     * 
+     * @return bool True if dynamic splitting is enabled
+     */
+    bool getDynamicSplitting() const;
+    
+    /**
+     * @brief Set whether idle connections split slow segments
+     * 
+     * @param enabled True to enable dynamic splitting
+     */
+    void setDynamicSplitting(bool enabled);
+    
+    /**
+     * @brief Get whether downloads adapt their connection count
+     * 
+     * @return bool True if adaptive segmentation is enabled
+     */
+    bool getAdaptiveSegments() const;
+    
+    /**
+     * @brief Set whether downloads adapt their connection count
+     * 
+     * @param enabled True to enable adaptive segmentation
+     */
+    void setAdaptiveSegments(bool enabled);
+    
+    /**
+     * @brief Get the algorithm used to hash downloads while they are written
+     * 
+     * @return std::string The algorithm name (e.g. "SHA256"), empty if disabled
+     */
+    std::string getStreamingHash() const;
+    
+    /**
+     * @brief Set the algorithm used to hash downloads while they are written
+     * 
+     * @param algorithm The algorithm name, empty to disable
+     */
+    void setStreamingHash(const std::string& algorithm);
+    
+    /**
+     * @brief Get whether a URL downloaded before is revalidated instead of fetched again
+     * 
+     * @return bool True if revalidation is enabled
+     */
+    bool getRevalidateDownloads() const;
+    
+    /**
+     * @brief Set whether a URL downloaded before is revalidated instead of fetched again
+     * 
+     * @param enabled True to send conditional requests for unchanged local copies
+     */
+    void setRevalidateDownloads(bool enabled);
+    
+    /**
+     * @brief Get the directory of the content-addressed store of downloads
+     * 
+     * @return std::string The directory, empty if the store is disabled
+     */
+    std::string getContentStore() const;
+    
+    /**
+     * @brief Set the directory of the content-addressed store of downloads
+     * 
+     * Downloads whose hash is known complete from the store, and completed
+     * downloads with the same content share their disk space. Takes effect
+     * on the next start.
+     * 
+     * @param directory The directory, on the filesystem of the downloads, empty to disable
+     */
+    void setContentStore(const std::string& directory);
+    
+    /**
+     * @brief Check if the content store falls back to hard links
+     * 
+     * @return bool True if it does
+     */
+    bool getContentStoreHardLinks() const;
+    
+    /**
+     * @brief Set whether the content store falls back to hard links
+     * 
+     * Without reflinks the store keeps and places hard links, so an edit
+     * to a download changes the stored object too, which is dropped when
+     * next looked up. Off, such a filesystem gets no store. Takes effect
+     * on the next start.
+     * 
+     * @param enabled True to fall back to hard links
+     */
+    void setContentStoreHardLinks(bool enabled);
+    
+    /**
+     * @brief Get whether the expected hash of a download is read from a .sha256 file next to it
+     * 
+     * @return bool True if checksum sidecars are fetched
+     */
+    bool getChecksumSidecars() const;
+    
+    /**
+     * @brief Set whether the expected hash of a download is read from a .sha256 file next to it
+     * 
+     * @param enabled True to fetch the sidecar of downloads without an expected hash
+     */
+    void setChecksumSidecars(bool enabled);
+    
+    /**
+     * @brief Get whether small downloads share HTTP/2 connections
+     * 
+     * @return bool True if multiplexing is enabled
+     */
+    bool getHttpMultiplexing() const;
+    
+    /**
+     * @brief Set whether small downloads share HTTP/2 connections
+     * 
+     * @param enabled True to enable multiplexing
+     */
+    void setHttpMultiplexing(bool enabled);
+    
+    /**
+     * @brief Get whether multiplexed downloads try HTTP/3
+     * 
+     * @return bool True if HTTP/3 is preferred
+     */
+    bool getHttp3() const;
+    
+    /**
+     * @brief Set whether multiplexed downloads try HTTP/3
+     * 
+     * @param enabled True to prefer HTTP/3
+     */
+    void setHttp3(bool enabled);
+    
+    /**
+     * @brief Get the cap on concurrent streams per multiplexed connection
+     * 
+     * @return int The stream count
+     */
+    int getMaxStreamsPerConnection() const;
+    
+    /**
+     * @brief Set the cap on concurrent streams per multiplexed connection
+     * 
+     * @param count The stream count
+     */
+    void setMaxStreamsPerConnection(int count);
+    
+    /**
+     * @brief Get how long resolved host addresses are cached
+     * 
+     * @return int The TTL in seconds (0 if disabled)
+     */
+    int getDnsCacheTtl() const;
+    
+    /**
+     * @brief Set how long resolved host addresses are cached
+     * 
+     * @param seconds The TTL in seconds (0 to disable)
+     */
+    void setDnsCacheTtl(int seconds);
+    
+    /**
+     * @brief Get the head start given to the first address family when connecting
+     * 
+     * @return int The delay in milliseconds
+     */
+    int getHappyEyeballsTimeout() const;
+    
+    /**
+     * @brief Set the head start given to the first address family when connecting
+     * 
+     * @param timeoutMs The delay in milliseconds
+     */
+    void setHappyEyeballsTimeout(int timeoutMs);
+    
+    /**
+     * @brief Get the maximum number of connections to one origin
+     * 
+     * @return int The maximum, shared by all downloads and crawls
+     */
+    int getMaxConnectionsPerHost() const;
+    
+    /**
+     * @brief Set the maximum number of connections to one origin
+     * 
+     * @param max The maximum
+     */
+    void setMaxConnectionsPerHost(int max);
+    
+    /**
+     * @brief Get the maximum number of connections to one server address
+     * 
+     * @return int The maximum, shared by the origins resolving to it
+     */
+    int getMaxConnectionsPerAddress() const;
+    
+    /**
+     * @brief Set the maximum number of connections to one server address
+     * 
+     * @param max The maximum
+     */
+    void setMaxConnectionsPerAddress(int max);
+    
+    /**
+     * @brief Get the maximum number of connections overall
+     * 
+     * @return int The maximum
+     */
+    int getMaxConnections() const;
+    
+    /**
+     * @brief Set the maximum number of connections overall
+     * 
+     * @param max The maximum
+     */
+    void setMaxConnections(int max);
+    
+    /**
+     * @brief Get whether measured link quality steers the connection budget
+     * 
+     * @return bool True if enabled (max_connections becomes the upper bound)
+     */
+    bool getAdaptiveConcurrency() const;
+    
+    /**
+     * @brief Set whether measured link quality steers the connection budget
+     * 
+     * @param enabled True to enable
+     */
+    void setAdaptiveConcurrency(bool enabled);
+    
+    /**
+     * @brief Get how often process resource usage is sampled
+     * 
+     * @return int The interval in milliseconds
+     */
+    int getResourceSampleInterval() const;
+    
+    /**
+     * @brief Set how often process resource usage is sampled
+     * 
+     * @param intervalMs The interval in milliseconds
+     */
+    void setResourceSampleInterval(int intervalMs);
+    
+    /**
+     * @brief Get the file engine metrics are written to
+     * 
+     * @return std::string The path, empty to not export metrics
+     */
+    std::string getMetricsFile() const;
+    
+    /**
+     * @brief Set the file engine metrics are written to
+     * 
+     * Read by a textfile collector in the OpenMetrics text format.
+     * 
+     * @param path The path, empty to not export metrics
+     */
+    void setMetricsFile(const std::string& path);
+    
+    /**
+     * @brief Get how often the metrics file is rewritten
+     * 
+     * @return int The interval in milliseconds
+     */
+    int getMetricsInterval() const;
+    
+    /**
+     * @brief Set how often the metrics file is rewritten
+     * 
+     * @param intervalMs The interval in milliseconds
+     */
+    void setMetricsInterval(int intervalMs);
+    
+    /**
+     * @brief Get how long a plugin data filter may take per chunk
+     * 
+     * @return int The budget in milliseconds, 0 if unlimited
+     */
+    int getPluginCallBudget() const;
+    
+    /**
+     * @brief Set how long a plugin data filter may take per chunk
+     * 
+     * A filter running on the I/O thread that keeps going over it is moved
+     * to a worker of its own. Takes effect on the next start.
+     * 
+     * @param milliseconds The budget in milliseconds, 0 for unlimited
+     */
+    void setPluginCallBudget(int milliseconds);
+    
+    /**
+     * @brief Get the socket tuning profile of transfer connections
+     * 
+     * @return SocketProfile The profile
+     */
+    SocketProfile getSocketProfile() const;
+    
+    /**
+     * @brief Set the socket tuning profile of transfer connections
+     * 
+     * AUTO switches to HIGH_BDP while the measured link needs more in flight
+     * than the system's buffers carry. Takes effect on the next start.
+     * 
+     * @param profile The profile
+     */
+    void setSocketProfile(SocketProfile profile);
+    
+    /**
+     * @brief Check if audio and video downloads are fetched head first
+     * 
+     * @return bool True if they are
+     */
+    bool getStreamMedia() const;
+    
+    /**
+     * @brief Set whether audio and video downloads are fetched head first
+     * 
+     * Applies to downloads by their file extension, so they can be played
+     * while they download; see DownloadTask::setStreamingPriority().
+     * 
+     * @param enabled True to fetch them head first
+     */
+    void setStreamMedia(bool enabled);
+    
+    /**
+     * @brief Check if writes are queued per destination device
+     * 
+     * "auto" queues them with the portable backend only. With io_uring a
+     * device queue bounds the writers of a slow disk and orders its writes,
+     * but every block takes a hop to a writer thread and goes to the ring
+     * alone instead of batched with the event loop's other blocks.
+     * 
+     * @return bool True if they are
+     */
+    bool getDeviceIoScheduling() const;
+    
+    /**
+     * @brief Set whether writes are queued per destination device
+     * 
+     * Each device is written by a bounded number of writers, see
+     * DeviceIoScheduler. Takes effect on the next start.
+     * 
+     * @param enabled True to queue writes per device
+     */
+    void setDeviceIoScheduling(bool enabled);
+    
+    /**
+     * @brief Get the writers of a kind of storage device
+     * 
+     * @param kind SSD, HDD or NETWORK; others use the SSD count
+     * @return int Writes performed at once on one device
+     */
+    int getMaxDeviceWriters(StorageKind kind) const;
+    
+    /**
+     * @brief Set the writers of a kind of storage device
+     * 
+     * Takes effect on the next start.
+     * 
+     * @param kind SSD, HDD or NETWORK
+     * @param writers Writes performed at once on one device
+     */
+    void setMaxDeviceWriters(StorageKind kind, int writers);
+    
+    /**
+     * @brief Check if downloads reserve their disk space before starting
+     * 
+     * @return bool True if they do
+     */
+    bool getReserveDiskSpace() const;
+    
+    /**
+     * @brief Set whether downloads reserve their disk space before starting
+     * 
+     * A download whose size does not fit beside the others reserved on
+     * its file system waits in the queue, see DiskSpaceLedger.
+     * 
+     * @param enabled True to reserve disk space
+     */
+    void setReserveDiskSpace(bool enabled);
+    
+    /**
+     * @brief Get the disk space kept free beyond all reservations
+     * 
+     * @return int The margin in MB
+     */
+    int getDiskSpaceMargin() const;
+    
+    /**
+     * @brief Set the disk space kept free beyond all reservations
+     * 
+     * @param megabytes The margin in MB
+     */
+    void setDiskSpaceMargin(int megabytes);
+    
+    /**
+     * @brief Get the size up to which downloads are staged in memory
+     * 
+     * @return int The threshold in KB (0 if disabled)
+     */
+    int getSmallFileThreshold() const;
+    
+    /**
+     * @brief Set the size up to which downloads are staged in memory
+     * 
+     * Such a download is written out in one go once complete instead of
+     * being preallocated and written block by block.
+     * 
+     * @param kilobytes The threshold in KB (0 to disable)
+     */
+    void setSmallFileThreshold(int kilobytes);
+    
+    /**
+     * @brief Get the forward proxies connections are spread over
+     * 
+     * @return std::string The proxies, empty to connect directly
+     */
+    std::string getProxyPool() const;
+    
+    /**
+     * @brief Set the forward proxies connections are spread over
+     * 
+     * Entries are separated by commas, each a proxy URL optionally followed
+     * by "|cap" and "|weight". Takes effect on the next start.
+     * 
+     * @param proxies The proxies, empty to connect directly
+     */
+    void setProxyPool(const std::string& proxies);
+    
+    /**
+     * @brief Get how connections are given a proxy of the pool
+     * 
+     * @return ProxyAssignment The assignment policy
+     */
+    ProxyAssignment getProxyAssignment() const;
+    
+    /**
+     * @brief Set how connections are given a proxy of the pool
+     * 
+     * @param assignment The assignment policy
+     */
+    void setProxyAssignment(ProxyAssignment assignment);
+    
+    /**
+     * @brief Get the connection cap of proxies listed without one
+     * 
+     * @return int The maximum connections per proxy
+     */
+    int getProxyMaxConnections() const;
+    
+    /**
+     * @brief Set the connection cap of proxies listed without one
+     * 
+     * @param maxConnections The maximum connections per proxy
+     */
+    void setProxyMaxConnections(int maxConnections);
+    
+    /**
+     * @brief Get the URL fetched through each proxy to check its health
+     * 
+     * @return std::string The URL, empty for no health checks
+     */
+    std::string getProxyHealthUrl() const;
+    
+    /**
+     * @brief Set the URL fetched through each proxy to check its health
+     * 
+     * Without one, ejected proxies come back on probation once their time
+     * is up.
+     * 
+     * @param url The URL, empty for no health checks
+     */
+    void setProxyHealthUrl(const std::string& url);
+    
+    /**
+     * @brief Get the directory shared with the other nodes of a cluster
+     * 
+     * @return std::string The directory, empty to work alone
+     */
+    std::string getClusterDirectory() const;
+    
+    /**
+     * @brief Set the directory shared with the other nodes of a cluster
+     * 
+     * Nodes that see the same directory lease batch items and pieces of
+     * large files from each other. Takes effect on the next start.
+     * 
+     * @param directory The directory, empty to work alone
+     */
+    void setClusterDirectory(const std::string& directory);
+    
+    /**
+     * @brief Get the name of this node in the cluster
+     * 
+     * @return std::string The name, empty for the host name and process ID
+     */
+    std::string getClusterNodeId() const;
+    
+    /**
+     * @brief Set the name of this node in the cluster
+     * 
+     * @param id The name, empty for the host name and process ID
+     */
+    void setClusterNodeId(const std::string& id);
+    
+    /**
+     * @brief Get how long a cluster lease lasts without being renewed
+     * 
+     * @return int The lease time in seconds
+     */
+    int getClusterLeaseSeconds() const;
+    
+    /**
+     * @brief Set how long a cluster lease lasts without being renewed
+     * 
+     * Work of a node that stops is taken over after this long.
+     * 
+     * @param seconds The lease time in seconds
+     */
+    void setClusterLeaseSeconds(int seconds);
+    
+    /**
+     * @brief Get the size from which a file is split across the cluster
+     * 
+     * @return int The size in MB (0 if files are never split)
+     */
+    int getClusterSplitSize() const;
+    
+    /**
+     * @brief Set the size from which a file is split across the cluster
+     * 
+     * @param megabytes The size in MB (0 to never split)
+     */
+    void setClusterSplitSize(int megabytes);
+    
+    /**
+     * @brief Get the size of the pieces a split file is leased in
+     * 
+     * @return int The size in MB
+     */
+    int getClusterPieceSize() const;
+    
+    /**
+     * @brief Set the size of the pieces a split file is leased in
+     * 
+     * @param megabytes The size in MB
+     */
+    void setClusterPieceSize(int megabytes);
+    
+    /**
+     * @brief Check if finished downloads are shared with the LAN
+     * 
+     * @return true if shared, false otherwise
+     */
+    bool getPeerCache() const;
+    
+    /**
+     * @brief Set if finished downloads are shared with the LAN
+     * 
+     * Managers on the LAN find each other over mDNS, and downloads they
+     * have already are taken from them before the origin. Takes effect on
+     * the next start.
+     * 
+     * @param enabled True to share
+     */
+    void setPeerCache(bool enabled);
+    
+    /**
+     * @brief Get the port the LAN fetches shared downloads on
+     * 
+     * @return int The TCP port
+     */
+    int getPeerCachePort() const;
+    
+    /**
+     * @brief Set the port the LAN fetches shared downloads on
+     * 
+     * @param port The TCP port
+     */
+    void setPeerCachePort(int port);
+    
+    /**
+     * @brief Get the peers asked besides those found over mDNS
+     * 
+     * @return std::string The "host:port" entries, comma separated
+     */
+    std::string getPeerCachePeers() const;
+    
+    /**
+     * @brief Set the peers asked besides those found over mDNS
+     * 
+     * For networks where multicast does not pass.
+     * 
+     * @param peers The "host:port" entries, comma separated
+     */
+    void setPeerCachePeers(const std::string& peers);
+    
+    /**
+     * @brief Get how many queued downloads are probed before they start
+     * 
+     * @return int The number of downloads, 0 if none are
+     */
+    int getPrefetchQueuedTasks() const;
+    
+    /**
+     * @brief Set how many queued downloads are probed before they start
+     * 
+     * @param count The number of downloads, 0 to probe each as it starts
+     */
+    void setPrefetchQueuedTasks(int count);
+    
+    /**
+     * @brief Get how long the probe of a queued download is kept
+     * 
+     * @return int The time in seconds
+     */
+    int getPrefetchTtl() const;
+    
+    /**
+     * @brief Set how long the probe of a queued download is kept
+     * 
+     * @param seconds The time in seconds
+     */
+    void setPrefetchTtl(int seconds);
+    
+    /**
+     * @brief Get the stack size of the threads the engine starts
+     * 
+     * @return int The size in KB, 0 for the system default
+     */
+    int getThreadStackSize() const;
+    
+    /**
+     * @brief Set the stack size of the threads the engine starts
+     * 
+     * Applies from the next start of the download manager.
+     * 
+     * @param size The size in KB, 0 for the system default
+     */
+    void setThreadStackSize(int size);
+    
+    /**
+     * @brief Get the write buffer memory all downloads may hold together
+     * 
+     * @return int The budget in KB, 0 for no limit
+     */
+    int getWriteBufferBudget() const;
+    
+    /**
+     * @brief Set the write buffer memory all downloads may hold together
+     * 
+     * Segments beyond it write through unbuffered.
+     * 
+     * @param budget The budget in KB, 0 for no limit
+     */
+    void setWriteBufferBudget(int budget);
+    
+    /**
+     * @brief Get the size of the pieces resumable downloads are hashed in
+     * 
+     * @return int The size in KB, 0 if they are not
+     */
+    int getPieceHashSize() const;
+    
+    /**
+     * @brief Set the size of the pieces resumable downloads are hashed in
+     * 
+     * Each piece's hash is saved with the download; when it resumes, data
+     * left on the disk is checked against it and a piece that changed is
+     * fetched again. Pieces published by a Metalink are checked whatever
+     * this is.
+     * 
+     * @param size The size in KB, 0 to not hash pieces
+     */
+    void setPieceHashSize(int size);
+    
     /**
      * @brief Get a string setting value
      * 
@@ -227,9 +1079,27 @@ private:
      */
     std::string getSettingsFilePath() const;
     
+    /**
+     * @brief Publish a snapshot of the settings, then run the change callbacks
+     * 
+     * Unless another thread is delivering, which then delivers this change
+     * too, or this thread is (a callback changed a setting).
+     * 
+     * @param lock The held settings lock, released before the callbacks run
+     */
+    void publishSnapshot(std::unique_lock<std::mutex>& lock);
+    
     // Member variables
     mutable std::mutex mutex_;
     std::map<std::string, std::string> settings_;
+    std::shared_ptr<const SettingsSnapshot> snapshot_;  // Swapped atomically
+    uint64_t generation_ = 0;                           // Snapshots published
+    std::shared_ptr<const SettingsSnapshot> delivered_; // Last passed to the callbacks
+    uint64_t deliveredGeneration_ = 0;
+    std::mutex deliveryMutex_;                          // Held while callbacks run
+    std::atomic<std::thread::id> deliveringThread_{std::thread::id()};
+    std::map<int, SettingsChangeCallback> changeCallbacks_;
+    int nextCallbackId_ = 1;
 };
 
 } // namespace core
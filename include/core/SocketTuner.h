@@ -0,0 +1,149 @@
+#ifndef SOCKET_TUNER_H
+#define SOCKET_TUNER_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <curl/curl.h>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Socket tuning profile enumeration
+ */
+enum class SocketProfile {
+    AUTO,           // Follows the measured bandwidth-delay product
+    STANDARD,       // The system's defaults
+    HIGH_BDP        // Large buffers and BBR, for fast links far away
+};
+
+/**
+ * @brief Process-wide socket tuning of transfer connections
+ *
+ * A TCP connection moves at most one window per round trip, so on a fast
+ * link far away it is held back by its window long before the link is
+ * full, and only more segments make up for it. The HIGH_BDP profile sizes
+ * the connection for the link instead: the receive buffer and libcurl's
+ * read buffer grow, the congestion control becomes BBR where the system
+ * lets an unprivileged process choose it, and TCP_NOTSENT_LOWAT keeps
+ * uploads from queueing more than they need in the kernel. On Linux the
+ * receive buffer is only set where net.core.rmem_max allows more than
+ * autotuning reaches on its own, since a fixed SO_RCVBUF turns autotuning
+ * off.
+ *
+ * In AUTO the profile follows the link measured by LinkStats, entering
+ * HIGH_BDP above HIGH_BDP_ENTER_BYTES and leaving it below
+ * HIGH_BDP_LEAVE_BYTES so a burst does not flip it. Only connections
+ * opened afterwards pick up a change.
+ */
+class SocketTuner {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return SocketTuner& The singleton instance
+     */
+    static SocketTuner& getInstance();
+
+    /**
+     * @brief Set the profile
+     *
+     * @param profile The profile, AUTO to follow the link
+     */
+    void setProfile(SocketProfile profile);
+
+    /**
+     * @brief Get the profile set
+     *
+     * @return SocketProfile The profile, possibly AUTO
+     */
+    SocketProfile getProfile() const;
+
+    /**
+     * @brief Get the profile new connections get
+     *
+     * @return SocketProfile STANDARD or HIGH_BDP
+     */
+    SocketProfile getActiveProfile() const;
+
+    /**
+     * @brief Feed the measured link, switching the profile in AUTO
+     *
+     * @param throughput Aggregate download speed in bytes/second
+     * @param latencyMs Round trip in milliseconds, 0 if unknown
+     */
+    void update(double throughput, double latencyMs);
+
+    /**
+     * @brief Apply the active profile to a handle about to connect
+     *
+     * @param handle The handle
+     */
+    void apply(CURL* handle);
+
+    /**
+     * @brief Parse a profile name ("auto", "standard" or "high_bdp")
+     *
+     * @param name The name
+     * @param profile Receives the profile
+     * @return true if the name is known, false otherwise
+     */
+    static bool parseProfile(const std::string& name, SocketProfile& profile);
+
+    /**
+     * @brief Get the name of a profile
+     *
+     * @param profile The profile
+     * @return const char* The name
+     */
+    static const char* getProfileName(SocketProfile profile);
+
+    static constexpr double HIGH_BDP_ENTER_BYTES = 2.0 * 1024 * 1024;
+    static constexpr double HIGH_BDP_LEAVE_BYTES = 512.0 * 1024;
+    static constexpr double HIGH_BDP_MIN_LATENCY_MS = 30.0;
+    static constexpr int HIGH_BDP_RECEIVE_BUFFER = 16 * 1024 * 1024;
+    static constexpr int HIGH_BDP_NOTSENT_LOWAT = 128 * 1024;
+    static constexpr long HIGH_BDP_CURL_BUFFER_SIZE = 512 * 1024;
+
+private:
+    /**
+     * @brief Construct a new SocketTuner
+     */
+    SocketTuner() = default;
+
+    /**
+     * @brief Destroy the SocketTuner
+     */
+    ~SocketTuner() = default;
+
+    // Prevent copying
+    SocketTuner(const SocketTuner&) = delete;
+    SocketTuner& operator=(const SocketTuner&) = delete;
+
+    /**
+     * @brief Set the HIGH_BDP options on a socket before it connects
+     *
+     * @param clientp Unused
+     * @param socket The socket
+     * @param purpose What the socket is for
+     * @return int CURL_SOCKOPT_OK, the connection goes ahead untuned on failure
+     */
+    static int socketOptionCallback(void* clientp, curl_socket_t socket, curlsocktype purpose);
+
+    /**
+     * @brief Get the receive buffer to set
+     *
+     * @return int Bytes, 0 if the system's autotuning does as well
+     */
+    static int getReceiveBufferSize();
+
+    // Member variables
+    std::atomic<SocketProfile> profile_ = SocketProfile::AUTO;
+    std::atomic<SocketProfile> active_ = SocketProfile::STANDARD;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // SOCKET_TUNER_H
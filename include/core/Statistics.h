@@ -405,14 +405,6 @@ private:
      */
     bool loadStatistics();
     
-    /**
-     * @brief Extract domain from URL
-     * 
-     * @param url The URL
-     * @return std::string The domain
-     */
-    std::string extractDomain(const std::string& url) const;
-    
     /**
      * @brief Extract file type from file name
      * 
@@ -0,0 +1,288 @@
+#ifndef STREAM_DOWNLOADER_H
+#define STREAM_DOWNLOADER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include "core/StreamManifest.h"
+#include "core/TransferEngine.h"
+
+namespace dm {
+namespace core {
+
+class OutputFile;
+
+/**
+ * @brief Stream download progress callback type
+ */
+using StreamProgressCallback = std::function<void(int segmentsWritten, int segmentsTotal, int64_t bytesWritten)>;
+
+/**
+ * @brief Stream download completion callback type
+ */
+using StreamCompletionCallback = std::function<void(bool success, const std::string& error)>;
+
+/**
+ * @brief Stream download options structure
+ */
+struct StreamDownloadOptions {
+    int maxSegmentsInFlight = 8;                // Segments fetched or waiting to be written at once
+    int maxRetries = 5;                         // Attempts per segment beyond the first
+    int64_t maxBandwidth = 0;                   // Highest HLS variant wanted in bits per second, 0 for the best
+    int64_t maxSegmentSize = 256 * 1024 * 1024; // A segment larger than this fails the download
+    bool multiplex = true;                      // Share one HTTP/2 connection per origin
+    std::string userAgent = "DownloadManager/1.0";
+    std::map<std::string, std::string> headers;
+};
+
+/**
+ * @brief Downloader of HLS and DASH streams
+ *
+ * Fetches the manifest, picks the best variant and fetches its segments
+ * through the TransferEngine, several at once over pooled, multiplexed
+ * connections. Segments arriving out of order are held until the ones
+ * before them are written; the window bounds both the requests in flight
+ * and the segments held, so memory stays at a few segments whatever the
+ * length of the stream. Each track is written by plain concatenation, the
+ * way players read it: MPEG-TS segments as they are, fragmented MP4 after
+ * its initialization segment.
+ *
+ * Progress is kept next to the first output file as "<file>.stream": the
+ * next segment sequence number and file offset of each track, updated as
+ * segments are written. A restarted download for the same manifest cuts
+ * each file back to its recorded offset and carries on from there.
+ *
+ * Live and encrypted streams are refused.
+ */
+class StreamDownloader {
+public:
+    /**
+     * @brief Construct a new StreamDownloader
+     */
+    StreamDownloader();
+
+    /**
+     * @brief Destroy the StreamDownloader, stopping it if running
+     */
+    ~StreamDownloader();
+
+    // Prevent copying
+    StreamDownloader(const StreamDownloader&) = delete;
+    StreamDownloader& operator=(const StreamDownloader&) = delete;
+
+    /**
+     * @brief Start downloading a stream
+     *
+     * @param manifestUrl The URL of the m3u8 playlist or MPD
+     * @param outputPath The file of the first track; further tracks go next to it
+     *        as "<name>.<track>.<extension>"
+     * @param options Download options
+     * @param progressCallback Optional callback after each segment written
+     * @param completionCallback Optional callback once finished, stopped or failed
+     * @return true if the download started, false if one is already running
+     */
+    bool start(const std::string& manifestUrl, const std::string& outputPath,
+               const StreamDownloadOptions& options = StreamDownloadOptions(),
+               StreamProgressCallback progressCallback = nullptr,
+               StreamCompletionCallback completionCallback = nullptr);
+
+    /**
+     * @brief Stop the download, keeping its progress for a later start
+     */
+    void stop();
+
+    /**
+     * @brief Wait for the download to end
+     *
+     * @return true if every segment was written, false otherwise
+     */
+    bool wait();
+
+    /**
+     * @brief Check if the download is running
+     *
+     * @return true if running, false otherwise
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Get download statistics
+     *
+     * @param segmentsWritten Output parameter for segments written, including resumed ones
+     * @param segmentsTotal Output parameter for segments of every track
+     * @param bytesWritten Output parameter for bytes written, including resumed ones
+     */
+    void getStatistics(int& segmentsWritten, int& segmentsTotal, int64_t& bytesWritten) const;
+
+    /**
+     * @brief Get the error the download failed with
+     *
+     * @return std::string The error, empty if none
+     */
+    std::string getError() const;
+
+    /**
+     * @brief Get the files the tracks are written to
+     *
+     * @return std::vector<std::string> The paths, known once the manifest is parsed
+     */
+    std::vector<std::string> getOutputFiles() const;
+
+    static constexpr size_t MAX_MANIFEST_SIZE = 16 * 1024 * 1024;
+    static constexpr int64_t RETRY_BASE_DELAY_MS = 500;
+    static constexpr int64_t RETRY_MAX_DELAY_MS = 30000;
+
+private:
+    /**
+     * @brief One segment to fetch and write
+     */
+    struct Item {
+        size_t track = 0;
+        StreamSegment segment;
+        bool init = false;
+    };
+
+    /**
+     * @brief Where a track is written to
+     */
+    struct TrackOutput {
+        std::string path;
+        int64_t offset = 0;             // Bytes written so far
+        int64_t nextSequence = -1;      // Next media segment to write, -1 before the first
+        bool initWritten = false;
+    };
+
+    /**
+     * @brief A segment being fetched or waiting to be written
+     */
+    struct Fetch {
+        size_t index = 0;               // Into items_
+        int attempts = 0;
+        TransferId transfer = 0;
+        std::vector<char> data;
+        bool done = false;
+        bool failed = false;
+        TransferResult result;
+    };
+
+    /**
+     * @brief Download thread body
+     */
+    void run();
+
+    /**
+     * @brief Fetch and parse the manifest, resolving a master playlist to its variant
+     *
+     * @param manifest Receives the tracks
+     * @return true if successful, false otherwise (error_ set)
+     */
+    bool loadManifest(StreamManifest& manifest);
+
+    /**
+     * @brief Fetch and parse one manifest document
+     *
+     * @param url The URL
+     * @param manifest Receives the manifest
+     * @return true if successful, false otherwise (error_ set)
+     */
+    bool fetchManifest(const std::string& url, StreamManifest& manifest);
+
+    /**
+     * @brief Lay out the output files and the segments left to fetch, resuming earlier progress
+     *
+     * @param manifest The manifest
+     * @return true if successful, false otherwise (error_ set)
+     */
+    bool prepare(const StreamManifest& manifest);
+
+    /**
+     * @brief Fetch segments within the window and write them in order
+     *
+     * @return true if every segment was written, false otherwise
+     */
+    bool transfer();
+
+    /**
+     * @brief Submit a fetch to the engine
+     *
+     * @param fetch The fetch
+     * @param delayMs Delay before it starts
+     * @return true if submitted, false otherwise
+     */
+    bool submit(const std::shared_ptr<Fetch>& fetch, int64_t delayMs);
+
+    /**
+     * @brief Get the delay before retrying a failed fetch
+     *
+     * @param fetch The fetch
+     * @return int64_t The delay in milliseconds, -1 to give up
+     */
+    int64_t getRetryDelay(const Fetch& fetch) const;
+
+    /**
+     * @brief Write a fetched segment to its track
+     *
+     * @param fetch The fetch
+     * @return true if written, false otherwise (error_ set)
+     */
+    bool write(Fetch& fetch);
+
+    /**
+     * @brief Record the progress of every track
+     */
+    void saveProgress();
+
+    /**
+     * @brief Read the progress recorded by an earlier run
+     *
+     * @return std::vector<TrackOutput> The tracks, empty if none was recorded for this manifest
+     */
+    std::vector<TrackOutput> loadProgress() const;
+
+    /**
+     * @brief Record the error the download fails with
+     *
+     * @param error The error
+     */
+    void setError(const std::string& error);
+
+    // Member variables
+    StreamDownloadOptions options_;
+    StreamProgressCallback progressCallback_ = nullptr;
+    StreamCompletionCallback completionCallback_ = nullptr;
+    std::string manifestUrl_;
+    std::string outputPath_;
+    std::string variantUrl_;                    // The media playlist or MPD the segments come from
+
+    std::vector<Item> items_;                   // Segments left to write, in write order
+    std::vector<TrackOutput> outputs_;
+    std::vector<std::unique_ptr<OutputFile>> files_;    // Open while transferring, by track
+    std::atomic<int> segmentsWritten_;
+    std::atomic<int> segmentsTotal_;
+    std::atomic<int64_t> bytesWritten_;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> stopRequested_;
+    bool succeeded_ = false;
+    std::string error_;
+    std::thread thread_;
+
+    // Fetches in flight, completed by the engine thread
+    std::map<size_t, std::shared_ptr<Fetch>> fetches_;
+    std::mutex fetchMutex_;
+    std::condition_variable fetchChanged_;
+
+    mutable std::mutex stateMutex_;             // Guards error_, outputs_ paths and succeeded_
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // STREAM_DOWNLOADER_H
@@ -0,0 +1,148 @@
+#ifndef STREAM_MANIFEST_H
+#define STREAM_MANIFEST_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Adaptive streaming manifest type enumeration
+ */
+enum class StreamManifestType {
+    UNKNOWN,
+    HLS,            // An m3u8 playlist
+    DASH            // An MPD
+};
+
+/**
+ * @brief One media segment of a stream
+ */
+struct StreamSegment {
+    std::string url;
+    int64_t sequence = 0;           // Media sequence (HLS) or segment number (DASH)
+    int64_t rangeStart = -1;        // Byte range within the URL (-1 for the whole resource)
+    int64_t rangeEnd = -1;          // Inclusive
+    double duration = 0.0;          // Seconds
+};
+
+/**
+ * @brief One rendition a master playlist offers
+ */
+struct StreamVariant {
+    std::string url;                // The media playlist
+    int64_t bandwidth = 0;          // Bits per second
+    std::string resolution;
+    std::string codecs;
+    std::string audioUrl;           // Media playlist of its audio rendition, empty if muxed in
+};
+
+/**
+ * @brief One track of a stream, written out as one file
+ */
+struct StreamTrack {
+    std::string name;               // "video", "audio", ...; empty for the only track
+    std::string extension;          // Of the concatenated file, e.g. "ts" or "mp4"
+    int64_t bandwidth = 0;
+    bool hasInit = false;
+    StreamSegment init;             // Initialization segment, written ahead of the media segments
+    std::vector<StreamSegment> segments;
+};
+
+/**
+ * @brief A parsed adaptive streaming manifest
+ */
+struct StreamManifest {
+    StreamManifestType type = StreamManifestType::UNKNOWN;
+    std::vector<StreamVariant> variants;    // Non-empty for an HLS master playlist
+    std::vector<StreamTrack> tracks;
+    bool live = false;                      // Still growing, segments beyond these will follow
+    bool encrypted = false;                 // Segments need a key to be played
+    double duration = 0.0;                  // Seconds
+};
+
+/**
+ * @brief Parser of HLS playlists and DASH MPDs
+ *
+ * Turns a manifest into the list of segment URLs to fetch, every URL
+ * resolved against the manifest's own. An HLS master playlist yields its
+ * variants, each pointing to a media playlist to parse in turn. An MPD
+ * yields one track per adaptation set of its first period, at the
+ * representation with the highest bandwidth, with SegmentTemplate
+ * (numbered or timed, with or without a SegmentTimeline), SegmentList and
+ * single-file representations expanded into segments.
+ */
+class StreamManifestParser {
+public:
+    /**
+     * @brief Parse a manifest of either type
+     *
+     * @param text The manifest
+     * @param baseUrl The URL it was fetched from (after redirects)
+     * @param manifest Receives the manifest
+     * @return true if parsed successfully, false otherwise
+     */
+    static bool parse(const std::string& text, const std::string& baseUrl, StreamManifest& manifest);
+
+    /**
+     * @brief Parse an HLS master or media playlist
+     *
+     * @param text The playlist
+     * @param baseUrl The URL it was fetched from
+     * @param manifest Receives the variants or the single track
+     * @return true if parsed successfully, false otherwise
+     */
+    static bool parseHls(const std::string& text, const std::string& baseUrl, StreamManifest& manifest);
+
+    /**
+     * @brief Parse a DASH MPD
+     *
+     * @param text The MPD
+     * @param baseUrl The URL it was fetched from
+     * @param manifest Receives the tracks
+     * @return true if parsed successfully, false otherwise
+     */
+    static bool parseDash(const std::string& text, const std::string& baseUrl, StreamManifest& manifest);
+
+    /**
+     * @brief Pick the variant to download from a master playlist
+     *
+     * @param manifest The master playlist
+     * @param maxBandwidth Highest bandwidth wanted in bits per second, 0 for the best
+     * @return int The index of the variant, -1 if there are none
+     */
+    static int selectVariant(const StreamManifest& manifest, int64_t maxBandwidth = 0);
+
+    /**
+     * @brief Check if a URL looks like a manifest by its extension
+     *
+     * @param url The URL
+     * @return true if it ends in .m3u8 or .mpd, false otherwise
+     */
+    static bool isManifestUrl(const std::string& url);
+
+    /**
+     * @brief Resolve a link in a manifest against the manifest's URL
+     *
+     * @param baseUrl The URL of the manifest
+     * @param link The link
+     * @return std::string The absolute URL, empty if it cannot be resolved
+     */
+    static std::string resolveUrl(const std::string& baseUrl, const std::string& link);
+
+    /**
+     * @brief Parse an ISO 8601 duration such as "PT1H2M3.5S"
+     *
+     * @param text The duration
+     * @param seconds Receives the duration in seconds
+     * @return true if parsed successfully, false otherwise
+     */
+    static bool parseDuration(const std::string& text, double& seconds);
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // STREAM_MANIFEST_H
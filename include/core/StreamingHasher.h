@@ -0,0 +1,174 @@
+#ifndef STREAMING_HASHER_H
+#define STREAMING_HASHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include "utils/HashCalculator.h"
+
+namespace dm {
+namespace core {
+
+class OutputFile;
+
+/**
+ * @brief Hashes a download in the write path
+ *
+ * Attached to the output file of a download. Data written at the hashed
+ * frontier is hashed straight from the write buffer. Data landing ahead
+ * of it (later segments) is only remembered; once the frontier reaches
+ * such a range, a thread of the hasher reads it back and hashes it, so
+ * the writer is not held up and the digest is ready soon after the last
+ * byte is written. Writes arriving while it catches up are remembered
+ * the same way. A single-stream download is hashed entirely without
+ * reading the file again.
+ */
+class StreamingHasher {
+public:
+    /**
+     * @brief Construct a new StreamingHasher
+     *
+     * @param algorithm Hash algorithm to use
+     */
+    explicit StreamingHasher(dm::utils::HashAlgorithm algorithm);
+
+    /**
+     * @brief Destroy the StreamingHasher, stopping the read-back thread
+     */
+    ~StreamingHasher();
+
+    // Prevent copying
+    StreamingHasher(const StreamingHasher&) = delete;
+    StreamingHasher& operator=(const StreamingHasher&) = delete;
+
+    /**
+     * @brief Account for data written to the file
+     *
+     * Called by OutputFile after each successful write.
+     *
+     * @param file The file the data was written to
+     * @param data The data
+     * @param size The size of the data
+     * @param offset The file offset of the data
+     */
+    void onWrite(OutputFile& file, const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Finalize the digest
+     *
+     * Reads back whatever was not hashed in the write path (e.g. data
+     * written by an earlier session of a resumed download).
+     *
+     * @param file The completed file, still open
+     * @param totalSize The file size (-1 if unknown: everything hashed so far)
+     * @return true if the digest is available, false otherwise
+     */
+    bool finish(OutputFile& file, int64_t totalSize);
+
+    /**
+     * @brief Stop reading back in the background
+     *
+     * Called by OutputFile before it closes. What is left is read back by
+     * finish(), or by the thread started on the next write.
+     */
+    void stopReadBack();
+
+    /**
+     * @brief Hash the file again from its start
+     *
+     * For data rewritten after it was hashed (a repaired piece). Writes
+     * may go on meanwhile; what they land ahead of the frontier is read
+     * back as before.
+     */
+    void restart();
+
+    /**
+     * @brief Get the digest
+     *
+     * @return std::string The hash as lowercase hex, empty until finish() succeeded
+     */
+    std::string getDigest() const;
+
+    /**
+     * @brief Get the hash algorithm
+     *
+     * @return dm::utils::HashAlgorithm The algorithm
+     */
+    dm::utils::HashAlgorithm getAlgorithm() const;
+
+    /**
+     * @brief Get the number of bytes that had to be read back from the file
+     *
+     * @return int64_t The number of bytes
+     */
+    int64_t getReadBackBytes() const;
+
+private:
+    /**
+     * @brief Advance the frontier over a range already on disk
+     *
+     * Called with mutex_ held.
+     *
+     * @param file The file to read from
+     * @param end The end of the range (exclusive)
+     * @return true if successful, false if the file could not be read
+     */
+    bool readBack(OutputFile& file, int64_t end);
+
+    /**
+     * @brief Drop recorded ranges the frontier has passed
+     *
+     * Called with mutex_ held.
+     *
+     * @return true if the first remaining range starts at the frontier
+     */
+    bool reachedWritten();
+
+    /**
+     * @brief Stop the read-back thread and wait for it
+     *
+     * Leaves stopRequested_ set, the caller clears it under mutex_.
+     */
+    void joinReadBack();
+
+    /**
+     * @brief Read-back thread body, hashes recorded ranges the frontier reaches
+     *
+     * @param file The file to read from
+     */
+    void runReadBack(OutputFile* file);
+
+    /**
+     * @brief Feed bytes to the hash, timed while metrics are exported
+     *
+     * Called with mutex_ held.
+     *
+     * @param data The bytes
+     * @param size The number of bytes
+     */
+    void update(const char* data, size_t size);
+
+    static constexpr size_t READ_BACK_CHUNK_SIZE = 1024 * 1024;
+
+    // Member variables
+    dm::utils::IncrementalHash hash_;
+    int64_t frontier_ = 0;                  // Everything before this offset is hashed
+    std::map<int64_t, int64_t> written_;    // Written ranges ahead of the frontier, start -> end
+    int64_t readBackBytes_ = 0;
+    bool failed_ = false;
+    std::string digest_;
+    std::vector<char> readBuffer_;
+    std::thread readBackThread_;
+    bool readingBack_ = false;              // The thread owns the frontier and the hash
+    bool stopRequested_ = false;
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // STREAMING_HASHER_H
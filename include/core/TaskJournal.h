@@ -0,0 +1,291 @@
+#ifndef TASK_JOURNAL_H
+#define TASK_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include "core/DownloadTask.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Saved state of one download
+ */
+struct JournalEntry {
+    std::string id;
+    std::string url;
+    std::string destinationPath;
+    std::string filename;
+    DownloadStatus status = DownloadStatus::NONE;
+    DownloadPriority priority = DownloadPriority::NORMAL;
+    int64_t fileSize = 0;
+    bool supportsResume = false;
+    std::vector<SegmentRange> ranges;   // Byte ranges still to download
+    PieceMap pieces;                    // Piece hashes, published or taken so far
+};
+
+/**
+ * @brief Append-only log of download task state
+ *
+ * Each change (task added, status changed, progress checkpoint, piece
+ * hashes taken, task removed) is appended as a small checksummed binary record instead of
+ * rewriting the whole task list, so saving costs the same with one task
+ * or ten thousand. Opening the journal replays it; a record torn by a
+ * crash fails its checksum and is cut off with everything after it.
+ * When most records are stale, the live state is rewritten to a new file
+ * that replaces the old one atomically.
+ *
+ * Completed downloads are dropped from the state, like removed ones.
+ */
+class TaskJournal {
+public:
+    /**
+     * @brief Construct a new TaskJournal
+     *
+     * @param path The journal file path
+     */
+    explicit TaskJournal(const std::string& path);
+
+    /**
+     * @brief Destroy the TaskJournal, closing the file
+     */
+    ~TaskJournal();
+
+    /**
+     * @brief Open the journal, creating it if needed, and replay it
+     *
+     * @param entries Receives the saved downloads
+     * @return true if successful, false otherwise
+     */
+    bool open(std::vector<JournalEntry>& entries);
+
+    /**
+     * @brief Flush and close the journal
+     */
+    void close();
+
+    /**
+     * @brief Check if the journal is open
+     *
+     * @return true if open, false otherwise
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Record a new download
+     *
+     * @param entry The download (status, size and ranges included)
+     * @return true if the record was written, false otherwise
+     */
+    bool recordAdd(const JournalEntry& entry);
+
+    /**
+     * @brief Record a status change
+     *
+     * @param id The task ID
+     * @param status The new status
+     * @return true if the record was written, false otherwise
+     */
+    bool recordStatus(const std::string& id, DownloadStatus status);
+
+    /**
+     * @brief Record how far a download has got
+     *
+     * Unchanged progress is not written again.
+     *
+     * @param id The task ID
+     * @param fileSize The file size in bytes
+     * @param supportsResume Whether the server supports range requests
+     * @param ranges The byte ranges still to download
+     * @return true if the record was written or not needed, false otherwise
+     */
+    bool recordProgress(const std::string& id, int64_t fileSize, bool supportsResume,
+                        const std::vector<SegmentRange>& ranges);
+
+    /**
+     * @brief Record the piece hashes of a download
+     *
+     * Only the hashes changed since the last record are written.
+     *
+     * @param id The task ID
+     * @param pieces The piece map
+     * @return true if the record was written or not needed, false otherwise
+     */
+    bool recordPieces(const std::string& id, const PieceMap& pieces);
+
+    /**
+     * @brief Record that a download was removed
+     *
+     * @param id The task ID
+     * @return true if the record was written, false otherwise
+     */
+    bool recordRemove(const std::string& id);
+
+    /**
+     * @brief Hold records back until the matching endBatch()
+     *
+     * Records from every thread are kept in order in memory meanwhile and
+     * written with one write, so a bulk change to thousands of tasks costs
+     * one system call. Batches nest.
+     */
+    void beginBatch();
+
+    /**
+     * @brief Write the records held back since beginBatch()
+     *
+     * @return true if the records were written, false otherwise
+     */
+    bool endBatch();
+
+    /**
+     * @brief Rewrite the journal with only the live state
+     *
+     * @return true if successful, false otherwise
+     */
+    bool compact();
+
+    /**
+     * @brief Flush written records to the disk
+     *
+     * @return true if successful, false otherwise
+     */
+    bool sync();
+
+    /**
+     * @brief Get the journal file path
+     *
+     * @return const std::string& The path
+     */
+    const std::string& getPath() const;
+
+    static constexpr size_t MIN_COMPACT_RECORDS = 4096;
+    static constexpr size_t COMPACT_RATIO = 4;          // Records per live task that trigger compaction
+    static constexpr uint32_t MAX_RECORD_SIZE = 16 * 1024 * 1024;
+
+private:
+    enum class RecordType : uint8_t {
+        ADD = 1,
+        STATUS = 2,
+        PROGRESS = 3,
+        REMOVE = 4,
+        PIECES = 5          // Changed piece hashes, the whole map if its layout changed
+    };
+
+    /**
+     * @brief Apply one record to the live state
+     *
+     * @param type The record type
+     * @param payload The record payload
+     * @param size The payload size
+     * @return true if the record was well formed, false otherwise
+     */
+    bool apply(uint8_t type, const char* payload, size_t size);
+
+    /**
+     * @brief Append a record to the file and apply it
+     *
+     * Called with mutex_ held.
+     *
+     * @param type The record type
+     * @param payload The record payload
+     * @return true if the record was written, false otherwise
+     */
+    bool append(RecordType type, const std::string& payload);
+
+    /**
+     * @brief Write the records held back by a batch
+     *
+     * Called with mutex_ held.
+     *
+     * @return true if successful, false otherwise
+     */
+    bool writePending();
+
+    /**
+     * @brief Rewrite the journal with only the live state
+     *
+     * Called with mutex_ held.
+     *
+     * @return true if successful, false otherwise
+     */
+    bool compactLocked();
+
+    /**
+     * @brief Close the file descriptor
+     *
+     * Called with mutex_ held.
+     */
+    void closeFile();
+
+    /**
+     * @brief Serialize an entry as the payload of an ADD record
+     *
+     * @param entry The entry
+     * @return std::string The payload
+     */
+    static std::string encodeAdd(const JournalEntry& entry);
+
+    /**
+     * @brief Serialize the piece hashes that changed as the payload of a PIECES record
+     *
+     * @param id The task ID
+     * @param pieces The piece map
+     * @param previous The map recorded so far
+     * @return std::string The payload, empty if nothing changed
+     */
+    static std::string encodePieces(const std::string& id, const PieceMap& pieces, const PieceMap& previous);
+
+    /**
+     * @brief Frame a record with its size and checksum
+     *
+     * @param type The record type
+     * @param payload The record payload
+     * @param out Receives the framed record
+     */
+    static void frame(RecordType type, const std::string& payload, std::string& out);
+
+    /**
+     * @brief Write a whole buffer to a file descriptor
+     *
+     * @param fd The file descriptor
+     * @param data The data
+     * @param size The size of the data
+     * @return true if everything was written, false otherwise
+     */
+    static bool writeAll(int fd, const char* data, size_t size);
+
+    /**
+     * @brief Open a file for appending
+     *
+     * @param path The file path
+     * @param truncate True to start the file empty
+     * @return int The file descriptor, or -1 on failure
+     */
+    static int openFile(const std::string& path, bool truncate);
+
+    /**
+     * @brief Flush a file descriptor to the disk
+     *
+     * @param fd The file descriptor
+     * @return true if successful, false otherwise
+     */
+    static bool syncFile(int fd);
+
+    // Member variables
+    std::string path_;
+    int fd_ = -1;
+    std::map<std::string, JournalEntry> live_;
+    size_t recordCount_ = 0;        // Records in the file, live or stale
+    uint64_t fileBytes_ = 0;        // Size of the file up to the last whole record
+    size_t batchDepth_ = 0;
+    std::string pendingRecords_;    // Framed records held back by a batch, already applied
+    mutable std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // TASK_JOURNAL_H
@@ -0,0 +1,260 @@
+#ifndef TASK_RECORD_STORE_H
+#define TASK_RECORD_STORE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "core/TaskJournal.h"
+#include "core/PriorityTaskQueue.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Compact store of downloads that have no DownloadTask
+ *
+ * Queued downloads that are not dispatched yet and finished ones are kept
+ * as fixed-size records in one contiguous array instead of full tasks.
+ * URLs and filenames live in a shared character arena and destination
+ * directories are interned there, so a record costs its strings plus
+ * about 40 bytes. Queued records wait in a PriorityTaskQueue keyed by
+ * record slot. The owner turns a record into a DownloadTask when it is
+ * dispatched or looked up, and back when the task finishes.
+ *
+ * Only task IDs of 16 hex digits, as generated by DownloadTask, can be
+ * packed; add() refuses any other. Not thread-safe; the owner serializes
+ * access.
+ */
+class TaskRecordStore {
+public:
+    /**
+     * @brief Construct a new TaskRecordStore
+     */
+    TaskRecordStore();
+
+    /**
+     * @brief Add a download
+     *
+     * A QUEUED download waits for takeNextQueued().
+     *
+     * @param entry The download
+     * @return true if added, false if its ID cannot be packed or is already stored
+     */
+    bool add(const JournalEntry& entry);
+
+    /**
+     * @brief Check if a download is stored
+     *
+     * @param id The task ID
+     * @return true if stored, false otherwise
+     */
+    bool contains(const std::string& id) const;
+
+    /**
+     * @brief Read a download
+     *
+     * @param id The task ID
+     * @param entry Receives the download
+     * @return true if it is stored, false otherwise
+     */
+    bool get(const std::string& id, JournalEntry& entry) const;
+
+    /**
+     * @brief Remove a download, returning its state
+     *
+     * @param id The task ID
+     * @param entry Receives the download
+     * @return true if it was stored, false otherwise
+     */
+    bool take(const std::string& id, JournalEntry& entry);
+
+    /**
+     * @brief Remove the queued download that is due next
+     *
+     * @param entry Receives the download
+     * @return true if one was queued, false otherwise
+     */
+    bool takeNextQueued(JournalEntry& entry);
+
+    /**
+     * @brief Read the queued downloads that are due next, leaving them queued
+     *
+     * @param count Maximum number of downloads to return
+     * @return std::vector<JournalEntry> The downloads, in the order they are due
+     */
+    std::vector<JournalEntry> peekQueued(size_t count) const;
+
+    /**
+     * @brief Change the status of a download, queueing or unqueueing it
+     *
+     * @param id The task ID
+     * @param status The new status
+     * @return true if it is stored, false otherwise
+     */
+    bool setStatus(const std::string& id, DownloadStatus status);
+
+    /**
+     * @brief Change the status of every download in one status
+     *
+     * @param from The status to change
+     * @param to The new status
+     * @param changed Receives the IDs that changed if not nullptr
+     */
+    void setStatusWhere(DownloadStatus from, DownloadStatus to, std::vector<std::string>* changed = nullptr);
+
+    /**
+     * @brief Change the priority of a download
+     *
+     * @param id The task ID
+     * @param priority The new priority
+     * @return true if it is stored, false otherwise
+     */
+    bool setPriority(const std::string& id, DownloadPriority priority);
+
+    /**
+     * @brief Read stored downloads in slot order
+     *
+     * @param offset Number of downloads to skip
+     * @param count Maximum number of downloads to return
+     * @return std::vector<JournalEntry> The downloads
+     */
+    std::vector<JournalEntry> list(size_t offset, size_t count) const;
+
+    /**
+     * @brief Get the number of stored downloads
+     *
+     * @return size_t The number of downloads
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the number of queued downloads
+     *
+     * @return size_t The number of downloads
+     */
+    size_t queuedCount() const;
+
+    /**
+     * @brief Get the memory held by records, strings and indexes
+     *
+     * @return size_t The size in bytes
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * @brief Remove every download
+     */
+    void clear();
+
+    /**
+     * @brief Check if a task ID can be packed into a record
+     *
+     * @param id The task ID
+     * @return true if it can, false otherwise
+     */
+    static bool canStore(const std::string& id);
+
+    static constexpr size_t MIN_COMPACT_BYTES = 1024 * 1024;
+
+private:
+    enum RecordFlags : uint8_t {
+        FLAG_USED = 1,
+        FLAG_SUPPORTS_RESUME = 2,
+        FLAG_HAS_RANGES = 4,
+        FLAG_HAS_PIECES = 8
+    };
+
+    /**
+     * @brief Fixed-size state of one download
+     */
+    struct Record {
+        uint64_t id = 0;                // The 16 hex digits of the task ID
+        int64_t fileSize = 0;
+        uint32_t url = 0;               // Arena offsets of NUL-terminated strings
+        uint32_t destination = 0;       // Interned
+        uint32_t filename = 0;
+        uint8_t status = 0;
+        uint8_t priority = 0;
+        uint8_t flags = 0;
+    };
+
+    /**
+     * @brief Find the slot of a task ID
+     *
+     * @param id The task ID
+     * @param slot Receives the slot
+     * @return true if stored, false otherwise
+     */
+    bool find(const std::string& id, uint32_t& slot) const;
+
+    /**
+     * @brief Unpack a record
+     *
+     * @param slot The slot
+     * @return JournalEntry The download
+     */
+    JournalEntry unpack(uint32_t slot) const;
+
+    /**
+     * @brief Free a slot
+     *
+     * @param slot The slot
+     */
+    void release(uint32_t slot);
+
+    /**
+     * @brief Append a string to the arena
+     *
+     * @param text The string
+     * @return uint32_t Its offset
+     */
+    uint32_t appendString(const std::string& text);
+
+    /**
+     * @brief Append a directory to the arena unless it is already there
+     *
+     * @param directory The directory
+     * @return uint32_t Its offset
+     */
+    uint32_t internDirectory(const std::string& directory);
+
+    /**
+     * @brief Rewrite the arena without the strings of freed records
+     */
+    void compactStrings();
+
+    /**
+     * @brief Parse a task ID
+     *
+     * @param id The task ID
+     * @param value Receives its value
+     * @return true if it is 16 lowercase hex digits, false otherwise
+     */
+    static bool packId(const std::string& id, uint64_t& value);
+
+    /**
+     * @brief Format a task ID
+     *
+     * @param value The packed ID
+     * @return std::string The task ID
+     */
+    static std::string unpackId(uint64_t value);
+
+    std::vector<Record> records_;
+    std::vector<uint32_t> freeSlots_;
+    std::unordered_map<uint64_t, uint32_t> slots_;          // Packed ID to slot
+    std::vector<char> strings_;
+    size_t wastedBytes_ = 0;                                // Arena bytes of freed URLs and filenames
+    std::unordered_map<std::string, uint32_t> directories_; // Interned directory to offset
+    std::unordered_map<uint32_t, std::vector<SegmentRange>> ranges_;    // Slot to missing ranges
+    std::unordered_map<uint32_t, PieceMap> pieces_;                     // Slot to piece hashes
+    PriorityTaskQueue queued_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // TASK_RECORD_STORE_H
@@ -4,6 +4,7 @@
 #include <mutex>
 #include <chrono>
 #include <atomic>
+#include <memory>
 #include <condition_variable>
 
 namespace dm {
@@ -12,7 +13,12 @@ namespace core {
 /**
  * @brief Throttler class for bandwidth limiting
  * 
- * Uses a token bucket algorithm to limit bandwidth
+ * Uses a token bucket algorithm to limit bandwidth. Token accounting is
+ * lock-free; the mutex is only taken by callers that have to sleep.
+ *
+ * Throttlers form a hierarchy (global -> task -> segments): bytes requested
+ * from a throttler are also requested from its parent, and the bandwidth of
+ * each level is shared fairly between its active consumers.
  */
 class Throttler {
 public:
@@ -98,12 +104,74 @@ public:
      */
     bool isEnabled() const;
     
+    /**
+     * @brief Set the parent throttler
+     * 
+     * Must be set before any consumer is attached
+     * 
+     * @param parent The parent throttler (nullptr for none)
+     */
+    void setParent(std::shared_ptr<Throttler> parent);
+    
+    /**
+     * @brief Get the parent throttler
+     * 
+     * @return std::shared_ptr<Throttler> The parent throttler
+     */
+    std::shared_ptr<Throttler> getParent() const;
+    
+    /**
+     * @brief Register an active consumer
+     * 
+     * The first consumer also registers this throttler with its parent
+     */
+    void attach();
+    
+    /**
+     * @brief Unregister an active consumer
+     */
+    void detach();
+    
+    /**
+     * @brief Get the number of active consumers
+     * 
+     * @return int The number of active consumers
+     */
+    int getActiveConsumers() const;
+    
+    /**
+     * @brief Get the fair bandwidth share of one consumer
+     * 
+     * The effective bandwidth is the lower of this throttler's limit and the
+     * parent's fair share, split between the active consumers.
+     * 
+     * @return int64_t Bytes per second per consumer (0 for unlimited)
+     */
+    int64_t getFairShare() const;
+    
 private:
+    /**
+     * @brief Acquire tokens from this bucket only
+     * 
+     * @param bytes Number of bytes requested
+     * @param deadline Point at which to give up, or nullptr to wait indefinitely
+     * @return true if the tokens were acquired, false if the deadline passed
+     */
+    bool acquire(int64_t bytes, const std::chrono::steady_clock::time_point* deadline);
+    
+    /**
+     * @brief Get the current time in nanoseconds
+     * 
+     * @return int64_t Steady clock time in nanoseconds
+     */
+    static int64_t nowNanoseconds();
+    
     /**
      * @brief Fill the token bucket
      * 
      * This will add tokens to the bucket based on the time elapsed
-     * since the last fill
+     * since the last fill. Only the caller that advances the fill time
+     * adds the tokens.
      */
     void fillBucket();
     
@@ -120,7 +188,12 @@ private:
     std::atomic<int64_t> tokens_;
     std::atomic<bool> enabled_;
     
-    std::chrono::steady_clock::time_point lastFillTime_;
+    std::atomic<int64_t> lastFillTime_;   // Steady clock nanoseconds
+    
+    std::shared_ptr<Throttler> parent_;
+    std::atomic<int> activeConsumers_;
+    
+    // Only used by callers waiting for tokens
     std::mutex mutex_;
     std::condition_variable cv_;
 };
@@ -23,6 +23,9 @@ namespace libtorrent {
 namespace dm {
 namespace core {
 
+// Forward declarations
+class NetworkMonitor;
+
 /**
  * @brief Structure to hold torrent download information
  */
@@ -250,6 +253,10 @@ public:
     /**
      * @brief Set session settings
      * 
+     * A "preset" key applies one of getSessionPresets() first, validated
+     * against the bandwidth measured by the network monitor. The other
+     * keys are libtorrent setting names and override the preset.
+     * 
      * @param settings The settings to set
      * @return true if successful, false otherwise
      */
@@ -262,6 +269,21 @@ public:
      */
     std::map<std::string, std::string> getSessionSettings();
     
+    /**
+     * @brief Get the names of the session presets
+     * 
+     * @return std::vector<std::string> "default", "high_throughput_seedbox",
+     *         "low_memory" and "many_torrents"
+     */
+    static std::vector<std::string> getSessionPresets();
+    
+    /**
+     * @brief Set the network monitor presets are validated against
+     * 
+     * @param networkMonitor The network monitor, or nullptr
+     */
+    void setNetworkMonitor(NetworkMonitor* networkMonitor);
+    
     /**
      * @brief Add trackers to a torrent
      * 
@@ -0,0 +1,165 @@
+#ifndef TRANSFER_COUNTERS_H
+#define TRANSFER_COUNTERS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Downloads and bytes counted for one domain or file type
+ */
+struct DownloadCounts {
+    int64_t completed = 0;
+    int64_t failed = 0;
+    int64_t bytes = 0;              // Sizes of the completed downloads
+};
+
+/**
+ * @brief Totals of all counters, merged from every shard
+ */
+struct TransferTotals {
+    int64_t bytesReceived = 0;      // Bytes written by segments, retries included
+    int64_t completed = 0;
+    int64_t failed = 0;
+    std::map<std::string, DownloadCounts> domains;
+    std::map<std::string, DownloadCounts> fileTypes;
+};
+
+/**
+ * @brief Process-wide download counters, sharded by thread
+ *
+ * Every thread updates a shard of its own, picked once per thread, so
+ * completing downloads and writing segments do not contend on one lock;
+ * readers merge the shards. Received bytes are a relaxed atomic per
+ * shard, so the write path is lock-free; rates are derived by readers
+ * from the difference between two reads. Domains and file types are
+ * interned into small integer ids, so the per-shard tables are vectors
+ * indexed by id rather than maps keyed by string.
+ */
+class TransferCounters {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return TransferCounters& The singleton instance
+     */
+    static TransferCounters& getInstance();
+
+    /**
+     * @brief Get the id of a domain, assigning one the first time
+     *
+     * @param domain The domain, compared case-insensitively
+     * @return uint32_t The id
+     */
+    uint32_t internDomain(const std::string& domain);
+
+    /**
+     * @brief Get the id of a file type, assigning one the first time
+     *
+     * @param fileType The file extension, compared case-insensitively
+     * @return uint32_t The id
+     */
+    uint32_t internFileType(const std::string& fileType);
+
+    /**
+     * @brief Count bytes received
+     *
+     * @param bytes The byte count
+     */
+    void addBytes(int64_t bytes) {
+        localShard().bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Count a finished download
+     *
+     * @param domainId The id of its domain
+     * @param fileTypeId The id of its file type
+     * @param bytes Its size
+     * @param succeeded True if it completed, false if it failed
+     */
+    void recordDownload(uint32_t domainId, uint32_t fileTypeId, int64_t bytes, bool succeeded);
+
+    /**
+     * @brief Get the bytes received so far, without locking
+     *
+     * @return int64_t The byte count
+     */
+    int64_t getBytesReceived() const;
+
+    /**
+     * @brief Merge all counters
+     *
+     * @return TransferTotals The totals
+     */
+    TransferTotals getTotals() const;
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+private:
+    /**
+     * @brief Counters updated by the threads assigned to one shard
+     */
+    struct alignas(64) Shard {
+        std::atomic<int64_t> bytes{0};
+        std::vector<DownloadCounts> domains;        // By id, guarded by mutex
+        std::vector<DownloadCounts> fileTypes;      // By id, guarded by mutex
+        mutable std::mutex mutex;
+    };
+
+    /**
+     * @brief Construct a new TransferCounters
+     */
+    TransferCounters() = default;
+
+    /**
+     * @brief Destroy the TransferCounters
+     */
+    ~TransferCounters() = default;
+
+    // Prevent copying
+    TransferCounters(const TransferCounters&) = delete;
+    TransferCounters& operator=(const TransferCounters&) = delete;
+
+    /**
+     * @brief Get the shard of the calling thread
+     *
+     * @return Shard& The shard
+     */
+    Shard& localShard();
+
+    /**
+     * @brief Get the id of a key, assigning one the first time
+     *
+     * @param key The key
+     * @param ids Ids by key
+     * @param names Keys by id
+     * @return uint32_t The id
+     */
+    uint32_t intern(const std::string& key, std::unordered_map<std::string, uint32_t>& ids,
+                    std::vector<std::string>& names);
+
+    // Member variables
+    std::array<Shard, SHARD_COUNT> shards_;
+    std::atomic<size_t> nextShard_{0};
+
+    std::unordered_map<std::string, uint32_t> domainIds_;
+    std::vector<std::string> domainNames_;
+    std::unordered_map<std::string, uint32_t> fileTypeIds_;
+    std::vector<std::string> fileTypeNames_;
+    mutable std::mutex keysMutex_;                  // Guards the ids and names
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // TRANSFER_COUNTERS_H
@@ -0,0 +1,298 @@
+#ifndef TRANSFER_ENGINE_H
+#define TRANSFER_ENGINE_H
+
+#ifndef Q_MOC_RUN
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#endif
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <curl/curl.h>
+#include "core/HttpClient.h"
+
+namespace dm {
+namespace core {
+
+class Throttler;
+
+/**
+ * @brief Transfer mode enumeration
+ */
+enum class TransferMode {
+    THREADED,       // One blocking thread per segment
+    EVENT_LOOP      // All segments driven by the shared TransferEngine
+};
+
+/**
+ * @brief Transfer identifier type (0 is never a valid ID)
+ */
+using TransferId = uint64_t;
+
+/**
+ * @brief Transfer result structure
+ */
+struct TransferResult {
+    bool success = false;       // Transfer completed with a non-error status
+    bool aborted = false;       // Transfer was aborted by the data callback
+    int statusCode = 0;         // HTTP status code
+    CURLcode curlCode = CURLE_OK;
+    int retryAfter = -1;        // Seconds asked by Retry-After, -1 if not given
+    std::string error;
+    HttpHeaders headers;        // Of the final response, if the request keeps them
+    std::string effectiveUrl;   // URL after redirects, if the request keeps the headers
+};
+
+/**
+ * @brief Transfer completion callback function type
+ *
+ * Called on the engine thread when a transfer finishes
+ */
+using TransferCompletionCallback = std::function<void(TransferId id, const TransferResult& result)>;
+
+/**
+ * @brief Transfer request structure
+ */
+struct TransferRequest {
+    std::string url;
+    int64_t startByte = -1;                     // Range start (-1 for no range)
+    int64_t endByte = -1;                       // Range end (-1 for open-ended)
+    std::map<std::string, std::string> headers;
+    std::string userAgent = "DownloadManager/1.0";
+    int connectTimeoutSeconds = 30;
+    int lowSpeedTimeSeconds = 30;               // Abort if stalled for this long
+    bool followRedirects = true;
+    int64_t startDelayMs = 0;                   // Delay before the transfer is started
+    int64_t maxRecvSpeed = 0;                   // Bytes per second (0 for unlimited)
+    bool multiplex = false;                     // Share one HTTP/2 (or HTTP/3) connection per origin
+    std::string proxy;                          // Proxy to go out through, empty to connect directly
+    std::shared_ptr<Throttler> throttler;       // Paces the transfer without blocking the engine
+    bool keepHeaders = false;                   // Hand the response headers to the completion callback
+
+    DataCallback dataCallback = nullptr;        // Called on the engine thread per chunk
+    TransferCompletionCallback completionCallback = nullptr;
+};
+
+/**
+ * @brief Event-driven transfer engine
+ *
+ * Drives all submitted transfers from a single I/O thread using
+ * curl_multi_socket_action. On Linux sockets are watched with epoll;
+ * other platforms fall back to curl_multi_poll.
+ */
+class TransferEngine {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return TransferEngine& The singleton instance
+     */
+    static TransferEngine& getInstance();
+
+    /**
+     * @brief Start the engine thread
+     *
+     * Called implicitly by submit()
+     *
+     * @return true if the engine is running, false otherwise
+     */
+    bool start();
+
+    /**
+     * @brief Stop the engine thread and abort all transfers
+     */
+    void stop();
+
+    /**
+     * @brief Submit a transfer
+     *
+     * @param request The transfer request
+     * @return TransferId The transfer ID, or 0 if the engine could not start
+     */
+    TransferId submit(TransferRequest request);
+
+    /**
+     * @brief Cancel a transfer
+     *
+     * No callbacks are invoked for the transfer once this returns. When called
+     * from another thread this blocks until the engine has removed the transfer.
+     *
+     * @param id The transfer ID
+     * @return true if the transfer was found, false otherwise
+     */
+    bool cancel(TransferId id);
+
+    /**
+     * @brief Get the number of submitted, unfinished transfers
+     *
+     * @return size_t The number of transfers
+     */
+    size_t getActiveTransferCount() const;
+
+    /**
+     * @brief Check if the caller is running on the engine thread
+     *
+     * @return true if on the engine thread, false otherwise
+     */
+    bool isEngineThread() const;
+    
+    /**
+     * @brief Configure multiplexed transfers
+     *
+     * Requests with the multiplex flag set negotiate HTTP/2 (or HTTP/3) and
+     * wait for a connection to the origin that can take another stream
+     * rather than opening their own.
+     *
+     * @param maxStreamsPerConnection Cap on concurrent streams per connection
+     * @param preferHttp3 True to try HTTP/3 where libcurl supports it
+     */
+    void setMultiplexing(int maxStreamsPerConnection, bool preferHttp3);
+    
+    /**
+     * @brief Check if the linked libcurl multiplexes reliably
+     *
+     * HTTP/2 in libcurl before 8.1 can hold back the final frame of a stream
+     * that closes while other streams on the connection are busy, leaving
+     * the transfer hanging. Multiplex requests fall back to a connection of
+     * their own there.
+     *
+     * @return true if multiplexing is used, false otherwise
+     */
+    static bool supportsMultiplexing();
+    
+    /**
+     * @brief Check if the linked libcurl can negotiate HTTP/3
+     *
+     * @return true if HTTP/3 is available, false otherwise
+     */
+    static bool supportsHttp3();
+    
+    static constexpr int DEFAULT_MAX_STREAMS_PER_CONNECTION = 100;
+
+private:
+    struct Transfer;
+
+    /**
+     * @brief Construct a new TransferEngine
+     */
+    TransferEngine();
+
+    /**
+     * @brief Destroy the TransferEngine
+     */
+    ~TransferEngine();
+
+    // Prevent copying
+    TransferEngine(const TransferEngine&) = delete;
+    TransferEngine& operator=(const TransferEngine&) = delete;
+
+    /**
+     * @brief Engine thread function
+     */
+    void engineThread();
+
+    /**
+     * @brief Wake the engine thread
+     */
+    void wakeup();
+
+    /**
+     * @brief Apply multiplexing options to the multi handle
+     */
+    void applyMultiplexing();
+    
+    /**
+     * @brief Apply queued submissions and cancellations
+     */
+    void processCommands();
+
+    /**
+     * @brief Add a transfer to the multi handle
+     *
+     * @param transfer The transfer to add
+     */
+    void addToMulti(const std::shared_ptr<Transfer>& transfer);
+
+    /**
+     * @brief Remove a transfer from the multi handle and release its handle
+     *
+     * @param transfer The transfer to remove
+     */
+    void removeFromMulti(const std::shared_ptr<Transfer>& transfer);
+
+    /**
+     * @brief Process completed transfers
+     */
+    void checkMultiInfo();
+
+    /**
+     * @brief Remove a finished transfer and deliver its result
+     *
+     * @param transfer The transfer
+     * @param code The CURL result of the transfer
+     */
+    void completeTransfer(const std::shared_ptr<Transfer>& transfer, CURLcode code);
+
+    /**
+     * @brief Add delayed transfers whose start time has passed
+     */
+    void startDueTransfers();
+
+    /**
+     * @brief Resume throttled transfers whose pause has elapsed
+     */
+    void resumePausedTransfers();
+    
+    /**
+     * @brief Get the time to wait until the next timer or delayed start
+     *
+     * @return int Milliseconds to wait, or -1 to wait indefinitely
+     */
+    int nextWaitMs();
+
+    // CURL callback functions
+    static int socketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp);
+    static int timerCallback(CURLM* multi, long timeoutMs, void* userp);
+    static size_t writeCallback(char* data, size_t size, size_t nmemb, void* userp);
+    static size_t headerCallback(char* data, size_t size, size_t nmemb, void* userp);
+    static int progressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+    // Member variables
+    CURLM* multi_ = nullptr;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+
+    std::atomic<bool> running_;
+    std::unique_ptr<std::thread> thread_;
+    std::atomic<std::thread::id> threadId_;
+    std::mutex startMutex_;
+
+    // Commands from other threads
+    mutable std::mutex mutex_;
+    std::condition_variable cancelCv_;
+    std::vector<std::shared_ptr<Transfer>> pendingAdds_;
+    std::vector<std::shared_ptr<Transfer>> pendingCancels_;
+    std::map<TransferId, std::shared_ptr<Transfer>> transfers_;
+    std::atomic<TransferId> nextId_;
+    std::atomic<int> maxStreams_{DEFAULT_MAX_STREAMS_PER_CONNECTION};
+    std::atomic<bool> preferHttp3_{false};
+    std::atomic<bool> multiplexChanged_{false};
+
+    // Engine thread state
+    std::map<CURL*, std::shared_ptr<Transfer>> inMulti_;
+    std::vector<std::shared_ptr<Transfer>> delayed_;
+    std::vector<std::shared_ptr<Transfer>> paused_;
+    bool timerArmed_ = false;
+    std::chrono::steady_clock::time_point timerDeadline_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // TRANSFER_ENGINE_H
@@ -0,0 +1,127 @@
+#ifndef VALIDATOR_CACHE_H
+#define VALIDATOR_CACHE_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <filesystem>
+
+#include "utils/HashCalculator.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief What is known about the local copy of a downloaded URL
+ */
+struct CachedValidators {
+    std::string etag;                               // From the response the copy came from
+    std::string lastModified;
+    std::string filePath;                           // The local copy
+    std::uintmax_t fileSize = 0;                    // Of the copy when it was recorded
+    std::filesystem::file_time_type modified;
+    dm::utils::HashAlgorithm hashAlgorithm = dm::utils::HashAlgorithm::SHA256;
+    std::string hash;                               // Of the copy, empty if it was not hashed
+};
+
+/**
+ * @brief Persistent cache of HTTP validators per downloaded URL
+ *
+ * Lets a download of a URL fetched before ask the server whether it
+ * changed (If-None-Match / If-Modified-Since) instead of fetching it
+ * again. An entry is only trusted while its local copy keeps the size and
+ * modification time it had when recorded, the same rule the hash manifest
+ * follows.
+ */
+class ValidatorCache {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return ValidatorCache& The singleton instance
+     */
+    static ValidatorCache& getInstance();
+
+    /**
+     * @brief Record the validators of a finished download
+     *
+     * Nothing is recorded when the response had neither an ETag nor a
+     * Last-Modified date.
+     *
+     * @param url The URL
+     * @param filePath The downloaded file
+     * @param etag The ETag of the response
+     * @param lastModified The Last-Modified date of the response
+     * @param hashAlgorithm The algorithm of the hash
+     * @param hash The hash of the file, empty if not known
+     */
+    void record(const std::string& url, const std::string& filePath, const std::string& etag,
+                const std::string& lastModified, dm::utils::HashAlgorithm hashAlgorithm, const std::string& hash);
+
+    /**
+     * @brief Look up the validators of a URL whose local copy is unchanged
+     *
+     * An entry whose copy changed or disappeared is dropped.
+     *
+     * @param url The URL
+     * @param validators Receives the validators
+     * @return true if found, false otherwise
+     */
+    bool find(const std::string& url, CachedValidators& validators);
+
+    /**
+     * @brief Forget a URL
+     *
+     * @param url The URL
+     */
+    void forget(const std::string& url);
+
+    /**
+     * @brief Write the entries whose copies are unchanged to a file
+     *
+     * @param path The cache file
+     * @return true if written, false otherwise
+     */
+    bool save(const std::string& path);
+
+    /**
+     * @brief Add the entries of a file written by save()
+     *
+     * @param path The cache file
+     * @return true if read, false otherwise
+     */
+    bool load(const std::string& path);
+
+private:
+    /**
+     * @brief Construct a new ValidatorCache
+     */
+    ValidatorCache() = default;
+
+    /**
+     * @brief Destroy the ValidatorCache
+     */
+    ~ValidatorCache() = default;
+
+    /**
+     * @brief Check that a recorded copy is still as it was
+     *
+     * @param validators The validators
+     * @return true if unchanged, false otherwise
+     */
+    static bool isUnchanged(const CachedValidators& validators);
+
+    // Prevent copying
+    ValidatorCache(const ValidatorCache&) = delete;
+    ValidatorCache& operator=(const ValidatorCache&) = delete;
+
+    // Member variables
+    std::map<std::string, CachedValidators> entries_;      // By URL
+    std::mutex mutex_;
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // VALIDATOR_CACHE_H
@@ -3,22 +3,33 @@
 
 #include <string>
 #include <vector>
-#include <set>
+#include <deque>
 #include <queue>
 #include <map>
 #include <functional>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <atomic>
 #include <memory>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "core/HostConnectionLimiter.h"
+#include "utils/DomainMatcher.h"
 
 namespace dm {
+namespace utils {
+class HtmlLinkScanner;
+class UrlFingerprintSet;
+}
+
 namespace core {
 
 // Forward declarations
 class DownloadManager;
-class BatchDownloader;
+class HttpClient;
 
 /**
  * @brief Crawl mode enumeration
@@ -59,6 +70,14 @@ using ContentFilter = std::function<bool(const std::string& url, const std::stri
  */
 using ResourceHandler = std::function<void(const std::string& url, ResourceType type)>;
 
+/**
+ * @brief Crawl finished handler type
+ *
+ * Called on a crawler thread once a crawl runs out of pages on its own,
+ * not when it is stopped; must not destroy the crawler.
+ */
+using CrawlFinishedHandler = std::function<void()>;
+
 /**
  * @brief Progress callback type
  */
@@ -73,22 +92,37 @@ struct CrawlOptions {
     int maxDepth = 3;                               // Maximum crawl depth
     int maxPages = 100;                             // Maximum pages to visit
     int maxConcurrent = 5;                          // Maximum concurrent connections
+    int maxConnectionsPerHost = 2;                  // Maximum concurrent connections to one host
+    size_t maxFrontierSize = 100000;                // Maximum URLs waiting to be fetched
+    size_t maxUrlMemory = 0;                        // Bytes for seen URLs before spilling to disk (0 for no limit)
+    std::string spillDirectory;                     // Where large crawls keep seen and found URLs (memory if empty)
     bool respectRobotsTxt = true;                   // Respect robots.txt rules
     bool downloadResources = true;                  // Download resources (images, etc.)
-    std::vector<std::string> allowedDomains;        // Domains to crawl (for SPECIFIED_DOMAINS mode)
+    bool acceptCompression = true;                  // Fetch pages gzip, br or zstd encoded when the server can
+    std::vector<std::string> allowedDomains;        // Domain patterns to crawl (for SPECIFIED_DOMAINS mode), see DomainMatcher
     std::vector<std::string> fileTypesToDownload;   // File types to download
+    std::vector<std::string> includePatterns;       // Pages to crawl, '*' matches anything (all if empty)
+    std::vector<std::string> excludePatterns;       // URLs never to crawl or download, same syntax
     std::string userAgent = "DownloadManager/1.0";  // User agent string
-    std::chrono::milliseconds requestDelay{500};    // Delay between requests
+    std::chrono::milliseconds requestDelay{500};    // Delay between requests to the same host
     std::string downloadDirectory;                  // Directory to save downloads
     UrlFilter urlFilter = nullptr;                  // Custom URL filter
     ContentFilter contentFilter = nullptr;          // Custom content filter
     ResourceHandler resourceHandler = nullptr;      // Custom resource handler
+    CrawlFinishedHandler finishedHandler = nullptr; // Called once the crawl finishes on its own
 };
 
 /**
  * @brief Website crawler class
  * 
- * Crawls websites and downloads resources
+ * Crawls websites and downloads resources. The crawl runs as a pipeline:
+ * fetch workers take pages from a per-host frontier (each host gets its
+ * own queue, request delay and connection limit, so a slow or distant
+ * host does not hold back the others), parse workers extract links from
+ * the fetched pages and feed new URLs back into the frontier, and a
+ * resource stage hands found files to the handler and the download
+ * manager. URLs are deduplicated on a hash of their normalized form in a
+ * sharded set.
  */
 class WebsiteCrawler {
 public:
@@ -133,6 +167,9 @@ public:
     /**
      * @brief Stop crawling
      * 
+     * Waits for the crawler threads, unless called from one of them (a
+     * callback); they are then joined by the next start or the destructor.
+     * 
      * @return true if stopped successfully, false otherwise
      */
     bool stopCrawling();
@@ -162,6 +199,15 @@ public:
     void getStatistics(int& pagesVisited, int& totalUrls, 
                       int& resourcesFound, int& downloadQueued) const;
     
+    /**
+     * @brief Get the number of pages left out because the frontier was full
+     * 
+     * Those are not counted in the total URLs found.
+     * 
+     * @return int The number of pages
+     */
+    int getDroppedPages() const;
+    
     /**
      * @brief Get all found URLs
      * 
@@ -212,53 +258,191 @@ public:
     
 private:
     /**
-     * @brief Crawl worker thread function
+     * @brief A URL waiting to be fetched
+     */
+    struct FrontierEntry {
+        std::string url;
+        std::string host;
+        int depth = 0;
+        HostConnectionLimiter::Lease lease = 0;     // Connection held while it is fetched
+    };
+    
+    /**
+     * @brief The frontier of one host
+     */
+    struct HostQueue {
+        std::deque<FrontierEntry> urls;
+        std::chrono::steady_clock::time_point nextFetch;   // Earliest start of the next request
+        int inFlight = 0;
+        bool scheduled = false;                             // Listed in readyHosts_
+        bool robotsLoaded = false;
+        std::vector<std::pair<std::string, bool>> robotsRules;     // Path prefix, allowed
+    };
+    
+    /**
+     * @brief A fetched page waiting to be parsed
+     */
+    struct FetchedPage {
+        std::string url;            // After redirects, the base for relative links
+        int depth = 0;
+        std::vector<std::string> links;
+        std::vector<std::string> resources;
+        std::string baseHref;
+    };
+    
+    /**
+     * @brief A URL pattern split at its wildcards
+     */
+    struct UrlPattern {
+        std::vector<std::string> parts;     // Literal text between the '*'s
+        bool anchoredStart = true;          // Does not begin with '*'
+        bool anchoredEnd = true;            // Does not end with '*'
+    };
+    
+    /**
+     * @brief A found resource waiting to be handled
+     */
+    struct FoundResource {
+        std::string url;
+        std::string contentType;
+        int64_t contentLength = -1;
+    };
+    
+    using ReadyHost = std::pair<std::chrono::steady_clock::time_point, std::string>;
+    
+    /**
+     * @brief Fetch stage thread body
+     */
+    void fetchWorker();
+    
+    /**
+     * @brief Parse stage thread body
+     */
+    void parseWorker();
+    
+    /**
+     * @brief Resource stage thread body
      */
-    void crawlWorker();
+    void resourceWorker();
     
     /**
-     * @brief Process a single URL
+     * @brief Fetch one page and pass it on to the parse stage
      * 
-     * @param url The URL to process
-     * @param depth The current depth
-     * @return true if processed successfully, false otherwise
+     * @param client The worker's HTTP client
+     * @param scanner The worker's scanner, fed as the page arrives
+     * @param entry The page to fetch
      */
-    bool processUrl(const std::string& url, int depth);
+    void fetchPage(HttpClient& client, dm::utils::HtmlLinkScanner& scanner, const FrontierEntry& entry);
     
     /**
-     * @brief Extract links from HTML content
+     * @brief Extract links and resources from a page and queue them
      * 
-     * @param baseUrl The base URL for resolving relative links
-     * @param htmlContent The HTML content
-     * @return std::vector<std::string> The extracted links
+     * @param page The fetched page
      */
-    std::vector<std::string> extractLinks(const std::string& baseUrl, const std::string& htmlContent);
+    void processPage(const FetchedPage& page);
     
     /**
-     * @brief Extract resources from HTML content
+     * @brief Take the next URL whose host may be contacted now
      * 
-     * @param baseUrl The base URL for resolving relative links
-     * @param htmlContent The HTML content
-     * @return std::vector<std::string> The extracted resource URLs
+     * Blocks until one is ready, the crawl is paused or it ends.
+     * 
+     * @param entry Receives the URL
+     * @return true if a URL was taken, false if the crawl is over
+     */
+    bool takeFromFrontier(FrontierEntry& entry);
+    
+    /**
+     * @brief Add a URL to the frontier
+     * 
+     * @param entry The URL
+     * @return true if queued, false if the frontier is full or closed
+     */
+    bool addToFrontier(FrontierEntry entry);
+    
+    /**
+     * @brief Finish a request to a host and reschedule the host
+     * 
+     * @param entry The entry that was fetched
      */
-    std::vector<std::string> extractResources(const std::string& baseUrl, const std::string& htmlContent);
+    void releaseHost(const FrontierEntry& entry);
+    
+    /**
+     * @brief List a host as ready once its delay has passed
+     * 
+     * Called with frontierMutex_ held.
+     * 
+     * @param name The host
+     * @param host The host queue
+     */
+    void scheduleHost(const std::string& name, HostQueue& host);
+    
+    /**
+     * @brief Drop every URL in the frontier
+     */
+    void clearFrontier();
+    
+    /**
+     * @brief Mark one queued page as fully processed
+     */
+    void finishPage();
+    
+    /**
+     * @brief Queue a resource for the resource stage
+     * 
+     * @param resource The resource
+     */
+    void queueResource(FoundResource resource);
+    
+    /**
+     * @brief Mark a URL as seen
+     * 
+     * @param url The normalized URL
+     * @return true if it was not seen before, false otherwise
+     */
+    bool markVisited(const std::string& url);
+    
+    /**
+     * @brief Compile URL patterns for matching
+     * 
+     * @param patterns The patterns
+     * @return std::vector<UrlPattern> The compiled patterns
+     */
+    static std::vector<UrlPattern> compilePatterns(const std::vector<std::string>& patterns);
+    
+    /**
+     * @brief Check a URL against compiled patterns
+     * 
+     * @param url The URL
+     * @param patterns The compiled patterns
+     * @return true if any pattern matches the whole URL, false otherwise
+     */
+    static bool matchesAny(const std::string& url, const std::vector<UrlPattern>& patterns);
     
     /**
      * @brief Normalize a URL
      * 
+     * Resolves a relative URL against the base URL with libcurl, then
+     * writes the UrlParser::canonicalize() form: lowercased scheme and
+     * host, no fragment, default port or dot segments. Absolute URLs are
+     * canonicalized directly.
+     * 
      * @param url The URL to normalize
      * @param baseUrl The base URL for resolving relative links
-     * @return std::string The normalized URL
+     * @param normalized Receives the normalized URL
+     * @param host Receives the host
+     * @return true if the URL is a usable http(s) URL, false otherwise
      */
-    std::string normalizeUrl(const std::string& url, const std::string& baseUrl);
+    static bool normalizeUrl(const std::string& url, const std::string& baseUrl,
+                             std::string& normalized, std::string& host);
     
     /**
      * @brief Check if a URL should be crawled
      * 
      * @param url The URL to check
+     * @param host The URL's host
      * @return true if the URL should be crawled, false otherwise
      */
-    bool shouldCrawl(const std::string& url);
+    bool shouldCrawl(const std::string& url, const std::string& host) const;
     
     /**
      * @brief Check if a resource should be downloaded
@@ -268,56 +452,148 @@ private:
      * @param contentLength The content length
      * @return true if the resource should be downloaded, false otherwise
      */
-    bool shouldDownloadResource(const std::string& url, const std::string& contentType, int64_t contentLength);
+    bool shouldDownloadResource(const std::string& url, const std::string& contentType, int64_t contentLength) const;
     
     /**
      * @brief Handle a discovered resource
      * 
-     * @param url The resource URL
-     * @param contentType The content type
-     * @param contentLength The content length
+     * @param resource The resource
+     */
+    void handleResource(const FoundResource& resource);
+    
+    /**
+     * @brief Check a URL against the robots.txt rules of its host
+     * 
+     * Loads the rules on first use of a host.
+     * 
+     * @param client The HTTP client to fetch robots.txt with
+     * @param entry The URL
+     * @return true if allowed, false otherwise
      */
-    void handleResource(const std::string& url, const std::string& contentType, int64_t contentLength);
+    bool isAllowed(HttpClient& client, const FrontierEntry& entry);
     
     /**
-     * @brief Get robots.txt rules for a domain
+     * @brief Parse the rules of a robots.txt that apply to a user agent
      * 
-     * @param domain The domain
-     * @return std::string The robots.txt content
+     * @param content The robots.txt content
+     * @param userAgent The user agent
+     * @return std::vector<std::pair<std::string, bool>> Path prefixes and whether they are allowed
      */
-    std::string getRobotsTxt(const std::string& domain);
+    static std::vector<std::pair<std::string, bool>> parseRobotsTxt(const std::string& content,
+                                                                    const std::string& userAgent);
     
     /**
-     * @brief Update crawl statistics
+     * @brief Check a path against robots.txt rules, the longest match wins
+     * 
+     * @param path The URL path and query
+     * @param rules The rules
+     * @return true if allowed, false otherwise
+     */
+    static bool matchesRobotsRules(const std::string& path, const std::vector<std::pair<std::string, bool>>& rules);
+    
+    /**
+     * @brief Get the path and query of a URL
+     * 
+     * @param url The URL
+     * @return std::string The path, "/" if empty
+     */
+    static std::string getPath(const std::string& url);
+    
+    /**
+     * @brief Add URLs to the found list
+     * 
+     * Called with resultsMutex_ held.
+     * 
+     * @param urls The URLs
+     */
+    void appendFoundUrls(const std::vector<std::string>& urls);
+    
+    /**
+     * @brief Drop the found list, deleting its spill file
+     * 
+     * Called with resultsMutex_ held.
+     */
+    void clearFoundUrls();
+    
+    /**
+     * @brief Record a crawl error
+     * 
+     * @param url The URL
+     * @param error The error message
+     */
+    void recordError(const std::string& url, const std::string& error);
+    
+    /**
+     * @brief Report progress to the callback
      */
     void updateStatistics();
     
+    /**
+     * @brief Wake every stage
+     */
+    void notifyAll();
+    
+    /**
+     * @brief Join the stage threads, unless called from one of them
+     */
+    void joinWorkers();
+    
+    static constexpr size_t MAX_PAGE_SIZE = 8 * 1024 * 1024;   // Pages are scanned up to this size
+    static constexpr int FETCH_TIMEOUT_SECONDS = 30;
+    static constexpr int HOST_BUSY_RETRY_MS = 250;     // Retry delay for a host without a free connection
+    
     // Member variables
     DownloadManager& downloadManager_;
-    std::shared_ptr<BatchDownloader> batchDownloader_;
     
     std::atomic<bool> running_;
     std::atomic<bool> paused_;
     std::atomic<bool> stopRequested_;
+    std::atomic<bool> finished_{false};         // No page left anywhere in the pipeline
     
     CrawlOptions options_;
+    std::vector<UrlPattern> includePatterns_;   // Compiled once per crawl
+    std::vector<UrlPattern> excludePatterns_;
     std::string startUrl_;
+    std::string limiterOwner_;                  // Identifies this crawl to the HostConnectionLimiter
+    std::string startHost_;
     std::string baseDomain_;
+    dm::utils::DomainMatcher allowedDomains_;   // Compiled once per crawl
     
-    std::mutex statsMutex_;
-    int pagesVisited_;
-    int totalUrls_;
-    int resourcesFound_;
-    int downloadQueued_;
+    std::mutex statsMutex_;                     // Serializes progress callbacks
+    std::atomic<int> pagesVisited_;
+    std::atomic<int> totalUrls_;
+    std::atomic<int> resourcesFound_;
+    std::atomic<int> downloadQueued_;
+    std::atomic<int> pagesDropped_{0};          // Left out, the frontier was full
+    std::atomic<int> pagesStarted_{0};          // Fetches claimed against maxPages
+    std::atomic<int64_t> pendingPages_{0};      // Pages queued, fetching or parsing
     
-    std::mutex urlsMutex_;
-    std::set<std::string> visitedUrls_;
-    std::set<std::string> downloadedResources_;
-    std::queue<std::pair<std::string, int>> urlQueue_; // URL and depth
-    std::map<std::string, std::string> errors_;
+    // Frontier, one queue per host
+    std::mutex frontierMutex_;
+    std::condition_variable frontierChanged_;
+    std::map<std::string, HostQueue> hosts_;
+    std::priority_queue<ReadyHost, std::vector<ReadyHost>, std::greater<ReadyHost>> readyHosts_;
+    size_t frontierSize_ = 0;
+    
+    // Fetched pages, bounded so fetching cannot outrun parsing
+    std::mutex parseMutex_;
+    std::condition_variable parseChanged_;
+    std::deque<FetchedPage> parseQueue_;
+    size_t parseQueueCapacity_ = 1;
     
-    std::mutex robotsMutex_;
-    std::map<std::string, std::string> robotsTxtCache_;
+    // Found resources
+    std::mutex resourceMutex_;
+    std::condition_variable resourceChanged_;
+    std::deque<FoundResource> resourceQueue_;
+    
+    std::unique_ptr<dm::utils::UrlFingerprintSet> visited_;
+    
+    mutable std::mutex resultsMutex_;
+    std::string foundUrls_;                     // One URL per line, packed
+    std::string foundUrlsPath_;                 // Spill file used instead, if any
+    std::FILE* foundUrlsFile_ = nullptr;
+    std::vector<std::string> downloadedResources_;
+    std::map<std::string, std::string> errors_;
     
     std::vector<std::thread> workerThreads_;
     CrawlProgressCallback progressCallback_;
@@ -0,0 +1,234 @@
+#ifndef WRITE_BUFFER_POOL_H
+#define WRITE_BUFFER_POOL_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "core/OutputFile.h"
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Pool of page aligned write buffers
+ *
+ * Owned by a download task and shared by its segments, so buffer memory is
+ * allocated once and bounded by the number of segments writing at a time.
+ * Buffers are registered with the disk I/O backend when it supports it.
+ * A process-wide budget can cap the buffers of all pools together; once it
+ * is spent, segments write through unbuffered.
+ */
+class WriteBufferPool {
+public:
+    /**
+     * @brief Construct a new WriteBufferPool
+     *
+     * @param bufferSize Size of each buffer, rounded up to the page size and capped at 8MB
+     */
+    explicit WriteBufferPool(size_t bufferSize = DEFAULT_BUFFER_SIZE);
+
+    /**
+     * @brief Destroy the WriteBufferPool and free all idle buffers
+     */
+    ~WriteBufferPool();
+
+    // Prevent copying
+    WriteBufferPool(const WriteBufferPool&) = delete;
+    WriteBufferPool& operator=(const WriteBufferPool&) = delete;
+
+    /**
+     * @brief Take a buffer from the pool, allocating one if none is idle
+     *
+     * @return char* The buffer (getBufferSize() bytes), or nullptr on allocation
+     *         failure or when the budget is spent
+     */
+    char* acquire();
+
+    /**
+     * @brief Return a buffer to the pool
+     *
+     * @param buffer The buffer obtained from acquire()
+     */
+    void release(char* buffer);
+
+    /**
+     * @brief Free the idle buffers, for when the owner stops writing
+     */
+    void trim();
+
+    /**
+     * @brief Get the size of each buffer
+     *
+     * @return size_t The buffer size in bytes
+     */
+    size_t getBufferSize() const;
+
+    /**
+     * @brief Get the number of buffers allocated by this pool
+     *
+     * @return size_t The number of buffers
+     */
+    size_t getAllocatedCount() const;
+
+    /**
+     * @brief Get the backend slot a buffer is registered in
+     *
+     * @param buffer The buffer obtained from acquire()
+     * @return int The slot, or -1 if the buffer is not registered
+     */
+    int getBufferSlot(const char* buffer) const;
+
+    /**
+     * @brief Set the buffer memory all pools may hold together
+     *
+     * Buffers already allocated are kept when it shrinks.
+     *
+     * @param bytes The budget in bytes, 0 for no limit
+     */
+    static void setBudget(size_t bytes);
+
+    /**
+     * @brief Get the buffer memory all pools may hold together
+     *
+     * @return size_t The budget in bytes, 0 for no limit
+     */
+    static size_t getBudget();
+
+    /**
+     * @brief Get the buffer memory all pools hold
+     *
+     * @return size_t The bytes allocated and not yet freed
+     */
+    static size_t getAllocatedBytes();
+
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+    static constexpr size_t MAX_BUFFER_SIZE = 8 * 1024 * 1024;
+
+private:
+    // Member variables
+    size_t bufferSize_;
+    std::vector<char*> idleBuffers_;
+    size_t allocatedCount_ = 0;
+    dm::utils::DiskIoBackend& backend_;
+    std::map<const char*, int> slots_;          // Registered buffers
+    mutable std::mutex mutex_;
+
+    static std::atomic<size_t> budget_;
+    static std::atomic<size_t> allocatedBytes_;     // By all pools
+};
+
+/**
+ * @brief Write-combining writer for one segment
+ *
+ * Collects the small chunks delivered by CURL and writes them to the output
+ * file in buffer sized blocks. The first block is shortened so that later
+ * blocks start on an aligned offset and can use direct I/O. When the disk
+ * I/O backend is asynchronous a full block is queued and the next one is
+ * filled in another buffer while it is written, one block in flight at a
+ * time.
+ * Not thread-safe; a segment only writes from one thread at a time.
+ */
+class BufferedFileWriter {
+public:
+    /**
+     * @brief Construct a new BufferedFileWriter
+     *
+     * @param file The output file
+     * @param pool The buffer pool (nullptr to write through unbuffered)
+     */
+    BufferedFileWriter(std::shared_ptr<OutputFile> file, std::shared_ptr<WriteBufferPool> pool);
+
+    /**
+     * @brief Destroy the BufferedFileWriter, flushing pending data
+     */
+    ~BufferedFileWriter();
+
+    // Prevent copying
+    BufferedFileWriter(const BufferedFileWriter&) = delete;
+    BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+    /**
+     * @brief Position the writer, discarding any unflushed data
+     *
+     * @param offset The file offset of the next write
+     */
+    void reset(int64_t offset);
+
+    /**
+     * @brief Append data at the current offset
+     *
+     * @param data The data to write
+     * @param size The size of the data
+     * @return true if successful, false if a flush failed
+     */
+    bool write(const char* data, size_t size);
+
+    /**
+     * @brief Write out buffered data and wait for it
+     *
+     * @return true if successful, false otherwise
+     */
+    bool flush();
+
+    /**
+     * @brief Flush and hand the buffer back to the pool
+     *
+     * @return true if the flush succeeded, false otherwise
+     */
+    bool release();
+
+    /**
+     * @brief Get the file offset of the next write
+     *
+     * @return int64_t The offset
+     */
+    int64_t getOffset() const { return offset_ + static_cast<int64_t>(used_); }
+
+    /**
+     * @brief Get the file offset up to which data has been written out
+     *
+     * @return int64_t The offset
+     */
+    int64_t getFlushedOffset() const { return pendingBuffer_ ? pending_.offset : offset_; }
+
+private:
+    /**
+     * @brief Hand the buffered data to the file
+     *
+     * Waits for the block in flight first, if any.
+     *
+     * @return true if successful, false if a write failed
+     */
+    bool submit();
+
+    /**
+     * @brief Wait for the block in flight and return its buffer
+     *
+     * A failed block rewinds the writer to its offset, dropping what was
+     * buffered after it.
+     *
+     * @return true if it was written, false otherwise
+     */
+    bool finishPending();
+
+    // Member variables
+    std::shared_ptr<OutputFile> file_;
+    std::shared_ptr<WriteBufferPool> pool_;
+    char* buffer_ = nullptr;
+    size_t used_ = 0;
+    size_t limit_ = 0;          // Flush threshold for the current block
+    int64_t offset_ = 0;        // File offset of buffer_[0]
+    bool async_ = false;
+    dm::utils::DiskRequest pending_;
+    char* pendingBuffer_ = nullptr;     // Buffer of the block in flight
+};
+
+} // namespace core
+} // namespace dm
+
+#endif // WRITE_BUFFER_POOL_H
@@ -8,6 +8,8 @@
 #include <functional>
 #include <mutex>
 
+#include "core/DataFilter.h"
+
 namespace dm {
 namespace plugin {
 
@@ -142,6 +144,13 @@ public:
      * @return std::map<std::string, std::string> Map of file name to file path
      */
     virtual std::map<std::string, std::string> getUiFiles() const = 0;
+    
+    /**
+     * @brief Get the filter fed the data of every download while the plugin is enabled
+     * 
+     * @return std::shared_ptr<dm::core::DataFilter> The filter, or nullptr if the plugin has none
+     */
+    virtual std::shared_ptr<dm::core::DataFilter> getDataFilter() { return nullptr; }
 };
 
 /**
@@ -5,7 +5,6 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QProgressBar>
-#include <QTimer>
 #include <memory>
 
 #include "core/DownloadTask.h"
@@ -43,6 +42,9 @@ public:
     
     /**
      * @brief Update the widget
+     * 
+     * Labels are only reformatted when the task's state changed since the
+     * last update.
      */
     void update();
     
@@ -109,9 +111,9 @@ private slots:
     void onOpenClicked();
     
     /**
-     * @brief Update timer handler
+     * @brief Frame clock refresh handler
      */
-    void onUpdateTimer();
+    void onRefresh();
     
 private:
     /**
@@ -166,8 +168,11 @@ private:
     QPushButton* removeButton_;
     QPushButton* openButton_;
     
-    // Update timer
-    QTimer* updateTimer_;
+    // State shown, to skip updates that change nothing
+    bool shown_ = false;
+    dm::core::DownloadStatus shownStatus_ = dm::core::DownloadStatus::NONE;
+    int64_t shownFileSize_ = 0;
+    dm::core::ProgressInfo shownProgress_;
 };
 
 } // namespace ui
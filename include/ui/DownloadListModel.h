@@ -0,0 +1,185 @@
+#ifndef DOWNLOAD_LIST_MODEL_H
+#define DOWNLOAD_LIST_MODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "core/DownloadTask.h"
+#include "core/TaskJournal.h"
+
+namespace dm {
+namespace ui {
+
+/**
+ * @brief Table model of the download list
+ *
+ * One row per download, live task or record. A row caches the values it
+ * shows; refreshRows() re-reads them from the tasks' lock-free progress
+ * snapshots and emits dataChanged only for the rows whose values moved,
+ * so the caller passes just the rows on screen. Display text is formatted
+ * in data(), which the view asks for visible rows only.
+ *
+ * Rows hold weak references: a finished task that the manager turned into
+ * a record is freed, and its row keeps the final values.
+ *
+ * Sorting and filtering go through a QSortFilterProxyModel on SORT_ROLE,
+ * which keeps only a row mapping. Must be used on the GUI thread.
+ */
+class DownloadListModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Columns of the list
+     */
+    enum Column {
+        NAME_COLUMN,
+        STATUS_COLUMN,
+        SIZE_COLUMN,
+        PROGRESS_COLUMN,
+        SPEED_COLUMN,
+        ETA_COLUMN,
+        URL_COLUMN,
+        COLUMN_COUNT
+    };
+
+    static constexpr int TASK_ID_ROLE = Qt::UserRole;       // Task ID of the row, any column
+    static constexpr int SORT_ROLE = Qt::UserRole + 1;      // Raw value to sort on
+
+    /**
+     * @brief Construct a new DownloadListModel
+     *
+     * @param parent The parent object
+     */
+    explicit DownloadListModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    /**
+     * @brief Add a task, or attach it to the row of its ID
+     *
+     * @param task The task
+     */
+    void addTask(std::shared_ptr<dm::core::DownloadTask> task);
+
+    /**
+     * @brief Add downloads kept as records
+     *
+     * Inserted in one step; IDs already listed are skipped.
+     *
+     * @param entries The downloads
+     */
+    void addRecords(const std::vector<dm::core::JournalEntry>& entries);
+
+    /**
+     * @brief Remove the row of a task
+     *
+     * @param taskId The task ID
+     */
+    void removeTask(const QString& taskId);
+
+    /**
+     * @brief Re-read one task's row, visible or not
+     *
+     * @param taskId The task ID
+     */
+    void refreshTask(const QString& taskId);
+
+    /**
+     * @brief Re-read the rows of several tasks at once
+     *
+     * @param taskIds The task IDs
+     */
+    void refreshTasks(const QStringList& taskIds);
+
+    /**
+     * @brief Re-read rows and report the ones that changed
+     *
+     * @param rows The rows, in any order
+     */
+    void refreshRows(std::vector<int> rows);
+
+    /**
+     * @brief Get the task ID of a row
+     *
+     * @param row The row
+     * @return QString The task ID, empty if the row does not exist
+     */
+    QString getTaskId(int row) const;
+
+    /**
+     * @brief Get the status shown in a row
+     *
+     * @param row The row
+     * @return dm::core::DownloadStatus The status
+     */
+    dm::core::DownloadStatus getStatus(int row) const;
+
+    /**
+     * @brief Get the number of rows with a status
+     *
+     * @param status The status
+     * @return int The number of rows
+     */
+    int getStatusCount(dm::core::DownloadStatus status) const;
+
+private:
+    /**
+     * @brief A download and the values its row shows
+     */
+    struct Row {
+        QString id;
+        QString name;
+        QString url;
+        std::weak_ptr<dm::core::DownloadTask> task;     // Expired once the task became a record
+        dm::core::DownloadStatus status = dm::core::DownloadStatus::NONE;
+        int64_t fileSize = 0;
+        int64_t downloadedBytes = 0;
+        double progressPercent = 0.0;
+        double downloadSpeed = 0.0;
+        int64_t timeRemaining = 0;
+    };
+
+    /**
+     * @brief Read a task's current values into its row
+     *
+     * @param row The row
+     * @param task The task
+     * @return true if a shown value changed, false otherwise
+     */
+    bool readTask(Row& row, const dm::core::DownloadTask& task);
+
+    /**
+     * @brief Move a row from one status count to another
+     *
+     * @param from The old status
+     * @param to The new status
+     */
+    void countStatus(dm::core::DownloadStatus from, dm::core::DownloadStatus to);
+
+    /**
+     * @brief Get the text of a status
+     *
+     * @param status The status
+     * @return QString The text
+     */
+    static QString getStatusText(dm::core::DownloadStatus status);
+
+    // Member variables
+    std::vector<Row> rows_;
+    QHash<QString, int> rowsById_;
+    std::map<dm::core::DownloadStatus, int> statusCounts_;
+};
+
+} // namespace ui
+} // namespace dm
+
+#endif // DOWNLOAD_LIST_MODEL_H
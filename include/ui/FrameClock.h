@@ -0,0 +1,78 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMetaMethod>
+
+namespace dm {
+namespace ui {
+
+/**
+ * @brief Shared clock that paces every progress widget
+ *
+ * Instead of a timer per widget, widgets connect to one of two signals of
+ * this clock: frame() for animations, refresh() for re-reading download
+ * state. Both fire from a single timer, so all widgets update in the same
+ * event loop pass and Qt paints the window once for all of them. The
+ * timer only runs while something is connected.
+ *
+ * Widgets should return early from their handlers while hidden. GUI
+ * thread only.
+ */
+class FrameClock : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Get the clock
+     *
+     * @return FrameClock& The clock
+     */
+    static FrameClock& getInstance();
+
+    static constexpr int FRAME_INTERVAL_MS = 50;        // Animation rate, 20 fps
+    static constexpr int FRAMES_PER_REFRESH = 10;       // Download state is re-read every 500 ms
+
+signals:
+    /**
+     * @brief Emitted every frame, for animations
+     */
+    void frame();
+
+    /**
+     * @brief Emitted every FRAMES_PER_REFRESH frames, for download state
+     */
+    void refresh();
+
+protected:
+    /**
+     * @brief Start the timer when the first widget connects
+     *
+     * @param signal The signal connected to
+     */
+    void connectNotify(const QMetaMethod& signal) override;
+
+private slots:
+    /**
+     * @brief Timer handler
+     */
+    void onTimer();
+
+private:
+    /**
+     * @brief Construct a new FrameClock
+     *
+     * @param parent The parent object
+     */
+    explicit FrameClock(QObject* parent);
+
+    // Member variables
+    QTimer timer_;
+    int frameCount_ = 0;
+};
+
+} // namespace ui
+} // namespace dm
+
+#endif // FRAME_CLOCK_H
@@ -2,7 +2,9 @@
 #define MAIN_WINDOW_H
 
 #include <QMainWindow>
-#include <QTreeWidget>
+#include <QTreeView>
+#include <QSortFilterProxyModel>
+#include <QLineEdit>
 #include <QToolBar>
 #include <QStatusBar>
 #include <QMenu>
@@ -10,11 +12,11 @@
 #include <QTimer>
 #include <QLabel>
 #include <QSystemTrayIcon>
-#include <QMap>
 #include <memory>
 
 #include "core/DownloadManager.h"
 #include "core/DownloadTask.h"
+#include "ui/DownloadListModel.h"
 
 namespace dm {
 namespace ui {
@@ -115,10 +117,17 @@ private slots:
     void trayIconActivated(QSystemTrayIcon::ActivationReason reason);
     
     /**
-     * @brief Update the download items in the UI
+     * @brief Refresh the rows on screen and the status bar
      */
     void updateDownloadItems();
     
+    /**
+     * @brief Show only the downloads whose name contains the filter text
+     * 
+     * @param text The filter text
+     */
+    void onFilterChanged(const QString& text);
+    
     /**
      * @brief Handle download item selection
      */
@@ -127,10 +136,9 @@ private slots:
     /**
      * @brief Handle download item double click
      * 
-     * @param item The item that was double-clicked
-     * @param column The column that was double-clicked
+     * @param index The proxy index that was double-clicked
      */
-    void onDownloadItemDoubleClicked(QTreeWidgetItem* item, int column);
+    void onDownloadItemDoubleClicked(const QModelIndex& index);
     
     /**
      * @brief Show the context menu for download items
@@ -180,6 +188,13 @@ private:
      */
     void loadTasks();
     
+    /**
+     * @brief Load a page of dormant tasks into the UI, then schedule the next
+     * 
+     * @param offset Index of the first record of the page
+     */
+    void loadDormantTasks(size_t offset);
+    
     /**
      * @brief Add a download task to the UI
      * 
@@ -201,6 +216,20 @@ private:
      */
     void removeDownloadFromUi(std::shared_ptr<dm::core::DownloadTask> task);
     
+    /**
+     * @brief Get the model rows on screen
+     * 
+     * @return std::vector<int> The source rows
+     */
+    std::vector<int> getVisibleRows() const;
+    
+    /**
+     * @brief Get the model rows of the selection
+     * 
+     * @return std::vector<int> The source rows
+     */
+    std::vector<int> getSelectedRows() const;
+    
     /**
      * @brief Get the selected download task
      * 
@@ -209,11 +238,13 @@ private:
     std::shared_ptr<dm::core::DownloadTask> getSelectedDownloadTask();
     
     /**
-     * @brief Get selected download tasks
+     * @brief Get the task IDs of the selection
+     * 
+     * Records are not turned into tasks for this.
      * 
-     * @return std::vector<std::shared_ptr<dm::core::DownloadTask>> The selected tasks
+     * @return std::vector<std::string> The task IDs
      */
-    std::vector<std::shared_ptr<dm::core::DownloadTask>> getSelectedDownloadTasks();
+    std::vector<std::string> getSelectedTaskIds() const;
     
     /**
      * @brief Task added handler
@@ -238,13 +269,25 @@ private:
     void onTaskStatusChanged(std::shared_ptr<dm::core::DownloadTask> task, 
                            dm::core::DownloadStatus status);
     
+    /**
+     * @brief Handler of the status changes of a bulk operation
+     * 
+     * @param changes The changes
+     */
+    void onBulkStatusChanged(const std::vector<dm::core::TaskStatusChange>& changes);
+    
     /**
      * @brief Update UI state based on selection
      */
     void updateUiState();
     
+    static constexpr size_t DORMANT_PAGE_SIZE = 4096;     // Records listed per turn of the event loop
+    
     // UI elements
-    QTreeWidget* downloadList_;
+    QTreeView* downloadList_;
+    DownloadListModel* downloadModel_;
+    QSortFilterProxyModel* proxyModel_;
+    QLineEdit* filterEdit_;
     QToolBar* mainToolBar_;
     QStatusBar* statusBar_;
     QLabel* statusLabel_;
@@ -276,9 +319,6 @@ private:
     // Timers
     QTimer* updateTimer_;
     
-    // Mapping of download IDs to list items
-    QMap<QString, QTreeWidgetItem*> downloadItems_;
-    
     // Download manager reference
     dm::core::DownloadManager& downloadManager_;
 };
@@ -6,6 +6,7 @@
 #include <QTimer>
 #include <QPaintEvent>
 #include <QString>
+#include <QMetaObject>
 
 namespace dm {
 namespace ui {
@@ -13,7 +14,9 @@ namespace ui {
 /**
  * @brief Custom progress bar widget
  * 
- * Provides additional features like segment visualization and animations
+ * Provides additional features like segment visualization and animations.
+ * Animation runs on the shared FrameClock; new progress and speed values
+ * only schedule a paint when they change what is drawn.
  */
 class ProgressBar : public QProgressBar {
     Q_OBJECT
@@ -145,9 +148,21 @@ public:
      */
     void setSegments(const std::vector<int>& segments);
     
+    /**
+     * @brief Set the progress
+     * 
+     * Nothing is repainted unless the filled width in pixels or the
+     * percentage shown changes.
+     * 
+     * @param percent Progress percentage (0-100)
+     */
+    void setProgress(double percent);
+    
     /**
      * @brief Set the speed
      * 
+     * Nothing is repainted unless the speed text shown changes.
+     * 
      * @param bytesPerSecond Speed in bytes per second
      */
     void setSpeed(double bytesPerSecond);
@@ -190,9 +205,9 @@ protected:
     
 private slots:
     /**
-     * @brief Animation timer handler
+     * @brief Frame clock handler, advances the animation
      */
-    void onAnimationTimer();
+    void onFrame();
     
 private:
     // Custom properties
@@ -209,9 +224,14 @@ private:
     
     // Speed
     double bytesPerSecond_;
+    QString speedText_;             // Formatted bytesPerSecond_, empty if not shown
+    
+    // Progress
+    double progress_;               // Percentage last set
+    int paintedWidth_;              // Filled width at the last paint, -1 before it
     
     // Animation
-    QTimer* animationTimer_;
+    QMetaObject::Connection frameConnection_;
     int animationOffset_;
     
     // Format
@@ -224,6 +244,14 @@ private:
      * @return QString The formatted speed
      */
     QString formatSpeed(double bytesPerSecond) const;
+    
+    /**
+     * @brief Get the filled width for a progress
+     * 
+     * @param percent Progress percentage (0-100)
+     * @return int The width in pixels
+     */
+    int getProgressWidth(double percent) const;
 };
 
 } // namespace ui
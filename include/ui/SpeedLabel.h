@@ -3,6 +3,8 @@
 
 #include <QLabel>
 #include <QTimer>
+#include <QMetaObject>
+#include <cstdint>
 
 namespace dm {
 namespace ui {
@@ -10,7 +12,9 @@ namespace ui {
 /**
  * @brief Label for displaying download speed
  * 
- * Provides automatic formatting and unit selection
+ * Provides automatic formatting and unit selection. The text is only
+ * reformatted when the value shown at the current precision changes, and
+ * the smoothing animation runs on the shared FrameClock.
  */
 class SpeedLabel : public QLabel {
     Q_OBJECT
@@ -86,9 +90,9 @@ public:
     
 private slots:
     /**
-     * @brief Animation timer handler
+     * @brief Frame clock handler, advances the animation
      */
-    void onAnimationTimer();
+    void onFrame();
     
 private:
     /**
@@ -99,14 +103,30 @@ private:
      */
     QString formatSpeed(double bytesPerSecond) const;
     
+    /**
+     * @brief Show a speed, reformatting only if the shown value differs
+     * 
+     * @param bytesPerSecond Speed in bytes per second
+     */
+    void showSpeed(double bytesPerSecond);
+    
+    /**
+     * @brief Forget the shown value, so the next showSpeed() reformats
+     */
+    void invalidateShownSpeed();
+    
     // Member variables
     double bytesPerSecond_;
     bool showUnits_;
     bool animateChanges_;
     int decimals_;
     
+    // Shown value: unit index and digits at decimals_ precision
+    int shownUnit_;
+    int64_t shownDigits_;
+    
     // Animation
-    QTimer* animationTimer_;
+    QMetaObject::Connection frameConnection_;
     double targetSpeed_;
     double displaySpeed_;
     bool speedChanging_;
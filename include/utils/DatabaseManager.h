@@ -7,6 +7,9 @@
 #include <mutex>
 #include <memory>
 #include <functional>
+#include <deque>
+#include <thread>
+#include <condition_variable>
 
 // Forward declaration for SQLite3 handle
 struct sqlite3;
@@ -15,6 +18,8 @@ struct sqlite3_stmt;
 namespace dm {
 namespace utils {
 
+class Statement;
+
 /**
  * @brief Database connection mode enumeration
  */
@@ -434,7 +439,65 @@ public:
      */
     bool setBusyTimeout(int milliseconds);
     
+    /**
+     * @brief Queue a write for the background writer
+     * 
+     * Queued writes are committed together in one transaction per batch
+     * interval, on the writer thread, with statements prepared once per SQL
+     * text. A write with a key replaces the queued write with the same key
+     * and moves to the back of the queue, so repeated updates of one row
+     * cost one statement per batch.
+     * 
+     * @param sql The SQL statement
+     * @param bind Binds the statement's parameters (may be empty)
+     * @param key Coalescing key (empty to keep every write)
+     */
+    void enqueueWrite(const std::string& sql, std::function<void(Statement&)> bind,
+                      const std::string& key = "");
+    
+    /**
+     * @brief Commit all queued writes now, on the calling thread
+     */
+    void flushWrites();
+    
+    /**
+     * @brief Set how long writes are collected before they are committed
+     * 
+     * @param milliseconds The batch interval in milliseconds
+     */
+    void setWriteBatchInterval(int milliseconds);
+    
+    static constexpr int DEFAULT_WRITE_BATCH_INTERVAL_MS = 250;
+    
 private:
+    struct PendingWrite {
+        std::string sql;
+        std::function<void(Statement&)> bind;
+        std::string key;
+    };
+    
+    /**
+     * @brief Writer thread body
+     */
+    void writerLoop();
+    
+    /**
+     * @brief Take the queued writes and commit them in one transaction
+     * 
+     * Called with m_dbMutex held, which keeps batches in queue order.
+     */
+    void commitPendingWrites();
+    
+    /**
+     * @brief Get the cached statement for a SQL text, preparing it once
+     * 
+     * Called with m_dbMutex held. The statement is reset and unbound.
+     * 
+     * @param sql The SQL statement
+     * @return std::shared_ptr<Statement> The statement
+     */
+    std::shared_ptr<Statement> prepareCached(const std::string& sql);
+    
     /**
      * @brief Bind parameters to a statement
      * 
@@ -467,6 +530,15 @@ private:
     std::string dbPath_;
     mutable std::mutex mutex_;
     std::atomic<bool> transactionActive_;
+    
+    std::deque<PendingWrite> m_pendingWrites;
+    std::map<std::string, std::shared_ptr<Statement>> m_statementCache;  // Writer statements by SQL text
+    std::thread m_writerThread;
+    std::mutex m_dbMutex;               // Held while a batch runs, taken before m_writeMutex
+    std::mutex m_writeMutex;            // Guards the queue
+    std::condition_variable m_writeChanged;
+    int m_writeBatchIntervalMs = DEFAULT_WRITE_BATCH_INTERVAL_MS;
+    bool m_stopWriter = false;
 };
 
 } // namespace utils
@@ -0,0 +1,216 @@
+#ifndef DISK_IO_H
+#define DISK_IO_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Disk I/O backend types
+ */
+enum class DiskIoBackendType {
+    PORTABLE,       // Blocking pread/pwrite
+    IO_URING        // Linux io_uring
+};
+
+/**
+ * @brief Disk operation types
+ */
+enum class DiskOperation {
+    READ,
+    WRITE,
+    SYNC            // Data sync of the whole file
+};
+
+/**
+ * @brief One queued disk operation
+ *
+ * Owned by the caller, who keeps it and its buffer alive and untouched
+ * until wait() returns for it.
+ */
+struct DiskRequest {
+    DiskOperation operation = DiskOperation::WRITE;
+    int fd = -1;
+    char* data = nullptr;
+    size_t size = 0;
+    int64_t offset = 0;
+    int bufferSlot = -1;            // From registerBuffer(), -1 if the buffer is not registered
+    bool sync = false;              // Data sync the file once a write is done
+
+    // Results, valid once wait() returned
+    size_t transferred = 0;         // Short only for a read reaching the end of the file
+    int error = 0;                  // errno of the failure, 0 on success
+
+    // Backend state
+    bool pending = false;
+    bool synced = false;
+    bool endOfFile = false;
+    unsigned operations = 0;
+};
+
+/**
+ * @brief Pluggable backend for positional file I/O
+ *
+ * Output files and hashing read and write through the selected backend.
+ * The portable backend performs every request on the spot with blocking
+ * calls. The io_uring backend queues requests on a shared ring, so a
+ * writer can hand a block to the kernel and keep receiving while it is
+ * written, with one system call submitting all blocks queued since the
+ * last one. A data sync requested with a write is linked to it on the
+ * ring, and registered buffers skip the per-request page pinning.
+ */
+class DiskIoBackend {
+public:
+    virtual ~DiskIoBackend() = default;
+
+    /**
+     * @brief Get the selected backend
+     *
+     * @return DiskIoBackend& The backend (portable until another is selected)
+     */
+    static DiskIoBackend& getInstance();
+
+    /**
+     * @brief Select the backend for files opened from now on
+     *
+     * The portable backend stays selected when the requested one is not
+     * available.
+     *
+     * @param type The backend type
+     * @return true if selected, false if unavailable
+     */
+    static bool select(DiskIoBackendType type);
+
+    /**
+     * @brief Check whether a backend can be used on this system
+     *
+     * @param type The backend type
+     * @return true if available, false otherwise
+     */
+    static bool isAvailable(DiskIoBackendType type);
+
+    /**
+     * @brief Parse a backend name ("portable" or "io_uring")
+     *
+     * @param name The name
+     * @param type Receives the type
+     * @return true if the name is known, false otherwise
+     */
+    static bool parseType(const std::string& name, DiskIoBackendType& type);
+
+    /**
+     * @brief Get the name of a backend type
+     *
+     * @param type The backend type
+     * @return const char* The name
+     */
+    static const char* getTypeName(DiskIoBackendType type);
+
+    /**
+     * @brief Make the calling thread's queued requests wait for submit()
+     *
+     * For an event loop that submits once per iteration, so the blocks of
+     * all its transfers go to the kernel together.
+     *
+     * @param deferred True to defer submission on this thread
+     */
+    static void setDeferredSubmission(bool deferred);
+
+    /**
+     * @brief Get the backend type
+     *
+     * @return DiskIoBackendType The type
+     */
+    virtual DiskIoBackendType getType() const = 0;
+
+    /**
+     * @brief Check whether queue() returns before the operation is done
+     *
+     * @return true if requests complete asynchronously, false otherwise
+     */
+    virtual bool isAsync() const = 0;
+
+    /**
+     * @brief Queue a request
+     *
+     * Submitted right away unless the thread defers submission.
+     *
+     * @param request The request
+     */
+    virtual void queue(DiskRequest& request) = 0;
+
+    /**
+     * @brief Submit the requests queued so far
+     */
+    virtual void submit() = 0;
+
+    /**
+     * @brief Wait for a queued request to complete
+     *
+     * @param request The request
+     * @return true if it succeeded, false otherwise (see request.error)
+     */
+    virtual bool wait(DiskRequest& request) = 0;
+
+    /**
+     * @brief Register a buffer for requests that name its slot
+     *
+     * @param data The buffer
+     * @param size The buffer size
+     * @return int The slot, or -1 if the buffer could not be registered
+     */
+    virtual int registerBuffer(char* data, size_t size) = 0;
+
+    /**
+     * @brief Unregister a buffer
+     *
+     * @param slot The slot returned by registerBuffer()
+     */
+    virtual void unregisterBuffer(int slot) = 0;
+
+    /**
+     * @brief Write all data at an offset and wait for it
+     *
+     * @param fd The file descriptor
+     * @param data The data
+     * @param size The size of the data
+     * @param offset The file offset
+     * @return true if written, false otherwise (errno is set)
+     */
+    bool write(int fd, const char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Read at an offset and wait for it
+     *
+     * @param fd The file descriptor
+     * @param data Receives the data
+     * @param size The number of bytes to read
+     * @param offset The file offset
+     * @return int64_t The bytes read (short at the end of the file), -1 on error (errno is set)
+     */
+    int64_t read(int fd, char* data, size_t size, int64_t offset);
+
+    /**
+     * @brief Flush the written data of a file to storage
+     *
+     * @param fd The file descriptor
+     * @return true if successful, false otherwise (errno is set)
+     */
+    bool sync(int fd);
+
+protected:
+    /**
+     * @brief Check whether the calling thread defers submission
+     *
+     * @return true if deferred, false otherwise
+     */
+    static bool isSubmissionDeferred();
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // DISK_IO_H
@@ -0,0 +1,187 @@
+#ifndef DOMAIN_MATCHER_H
+#define DOMAIN_MATCHER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Compiled set of domain patterns
+ *
+ * Patterns are stored as a trie over their labels from the right, so a
+ * lookup walks one node per label of the domain, whatever the number of
+ * patterns. The trie is flattened into three arrays, nodes, edges sorted
+ * by label, and one pool of label characters; it is immutable once built,
+ * so any number of threads may look up at once without locking, and the
+ * arrays are written to and read from a binary cache as they are.
+ *
+ * Pattern forms, matched case-insensitively:
+ *   example.com        example.com and every subdomain of it
+ *   *.example.com      subdomains of example.com only
+ *   cdn.*.example.net  '*' alone as a label matches any one label there
+ *   *                  every domain
+ *
+ * To change a list, build a new matcher and swap the shared pointer to it
+ * with std::atomic_store; readers holding the old one keep using it.
+ */
+class DomainMatcher {
+public:
+    /**
+     * @brief Construct an empty DomainMatcher, matching nothing
+     */
+    DomainMatcher();
+
+    /**
+     * @brief Compile a DomainMatcher
+     *
+     * Invalid patterns are skipped.
+     *
+     * @param patterns The patterns
+     */
+    explicit DomainMatcher(const std::vector<std::string>& patterns);
+
+    /**
+     * @brief Check if a domain matches any pattern
+     *
+     * @param domain The host name, a trailing dot is ignored
+     * @return true if it matches, false otherwise
+     */
+    bool matches(std::string_view domain) const;
+
+    /**
+     * @brief Get the number of patterns compiled in
+     *
+     * @return size_t The pattern count
+     */
+    size_t size() const { return patternCount_; }
+
+    /**
+     * @brief Check if no patterns are compiled in
+     *
+     * @return true if empty, false otherwise
+     */
+    bool empty() const { return patternCount_ == 0; }
+
+    /**
+     * @brief Get the memory held by the arrays
+     *
+     * @return size_t The size in bytes
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * @brief Write the compiled matcher to a binary cache file
+     *
+     * @param path The cache file
+     * @param sourceStamp Identifies the list it was built from
+     * @return true if written, false otherwise
+     */
+    bool saveCache(const std::string& path, uint64_t sourceStamp = 0) const;
+
+    /**
+     * @brief Read a matcher from a binary cache file
+     *
+     * @param path The cache file
+     * @param sourceStamp Must match the stamp it was saved with
+     * @return std::shared_ptr<const DomainMatcher> The matcher, nullptr if the
+     *         cache is missing, stale or damaged
+     */
+    static std::shared_ptr<const DomainMatcher> loadCache(const std::string& path, uint64_t sourceStamp = 0);
+
+    /**
+     * @brief Compile a domain list file, through a binary cache
+     *
+     * The list has one pattern per line; '#' starts a comment, and hosts
+     * file lines ("0.0.0.0 example.com") give their host names. The cache
+     * is used while the list's size and modification time are unchanged,
+     * and rewritten otherwise.
+     *
+     * @param listPath The list file
+     * @param cachePath The cache file, empty for none
+     * @return std::shared_ptr<const DomainMatcher> The matcher, nullptr if the
+     *         list cannot be read
+     */
+    static std::shared_ptr<const DomainMatcher> loadList(const std::string& listPath,
+                                                         const std::string& cachePath = "");
+
+    /**
+     * @brief Normalize a pattern or domain for the matcher
+     *
+     * Lowercases and trims it and drops a trailing dot.
+     *
+     * @param text The pattern or domain
+     * @return std::string The normalized form, empty if nothing is left
+     */
+    static std::string normalize(std::string_view text);
+
+private:
+    static constexpr uint32_t NO_NODE = 0xFFFFFFFF;
+
+    // Node flags
+    static constexpr uint32_t MATCH_SELF = 1;           // A pattern ends here
+    static constexpr uint32_t MATCH_SUBDOMAINS = 2;     // and covers what lies below
+
+    /**
+     * @brief A trie node, its edges are edges_[firstEdge, firstEdge + edgeCount)
+     */
+    struct Node {
+        uint32_t firstEdge = 0;
+        uint32_t edgeCount = 0;
+        uint32_t wildcard = NO_NODE;     // Child for a '*' label
+        uint32_t flags = 0;
+    };
+
+    /**
+     * @brief A labelled edge to a child node
+     */
+    struct Edge {
+        uint32_t labelOffset = 0;        // Into labels_
+        uint32_t labelLength = 0;
+        uint32_t node = 0;
+    };
+
+    /**
+     * @brief Match the labels left of end against the trie below a node
+     *
+     * @param node The node
+     * @param domain The normalized domain
+     * @param end One past the last unmatched character
+     * @return true if matched, false otherwise
+     */
+    bool matchFrom(uint32_t node, std::string_view domain, size_t end) const;
+
+    /**
+     * @brief Find the child of a node for a label
+     *
+     * @param node The node
+     * @param label The label
+     * @return uint32_t The child, NO_NODE if none
+     */
+    uint32_t findChild(const Node& node, std::string_view label) const;
+
+    /**
+     * @brief Get the stamp a list file is cached under
+     *
+     * @param path The list file
+     * @param stamp The stamp, set on success
+     * @return true if the file exists, false otherwise
+     */
+    static bool getSourceStamp(const std::string& path, uint64_t& stamp);
+
+    // Member variables
+    std::vector<Node> nodes_;            // nodes_[0] is the root
+    std::vector<Edge> edges_;
+    std::string labels_;
+    size_t patternCount_ = 0;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // DOMAIN_MATCHER_H
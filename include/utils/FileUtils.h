@@ -31,6 +31,23 @@ public:
      */
     static int64_t getFileSize(const std::string& filePath);
     
+    /**
+     * @brief Get the file modification time
+     * 
+     * @param filePath The file path
+     * @return int64_t The modification time in Unix seconds, or -1 on error
+     */
+    static int64_t getModificationTime(const std::string& filePath);
+    
+    /**
+     * @brief Set the file modification time
+     * 
+     * @param filePath The file path
+     * @param seconds The modification time in Unix seconds
+     * @return true if successful, false otherwise
+     */
+    static bool setModificationTime(const std::string& filePath, int64_t seconds);
+    
     /**
      * @brief Create a directory
      * 
@@ -47,6 +64,19 @@ public:
      */
     static bool deleteFile(const std::string& filePath);
     
+    /**
+     * @brief Create a file and reserve disk space for it
+     * 
+     * Existing content is discarded. Uses fallocate on Linux, F_PREALLOCATE
+     * on macOS and SetEndOfFile on Windows, falling back to a free space
+     * check and a sparse extension elsewhere.
+     * 
+     * @param filePath The file path
+     * @param size The file size in bytes
+     * @return true if the space was reserved, false otherwise (e.g. disk full)
+     */
+    static bool preallocateFile(const std::string& filePath, int64_t size);
+    
     /**
      * @brief Rename a file
      * 
@@ -59,12 +89,47 @@ public:
     /**
      * @brief Copy a file
      * 
+     * Shares the extents of the source where the filesystem supports it
+     * (FICLONE on btrfs and XFS, clonefile on APFS) and otherwise lets the
+     * kernel copy the data (copy_file_range or sendfile on Linux,
+     * CopyFileEx on Windows), falling back to a buffered copy.
+     * 
      * @param sourcePath The source file path
      * @param destPath The destination file path
      * @return true if successful, false otherwise
      */
     static bool copyFile(const std::string& sourcePath, const std::string& destPath);
     
+    /**
+     * @brief Copy a file by sharing its extents, without copying any data
+     * 
+     * Uses FICLONE on Linux (btrfs, XFS) and clonefile on macOS (APFS).
+     * The copy is independent of the source, later writes to either are
+     * not seen by the other.
+     * 
+     * @param sourcePath The source file path
+     * @param destPath The destination file path, replaced if it exists
+     * @return true if cloned, false if the filesystem cannot (nothing is left at destPath)
+     */
+    static bool cloneFile(const std::string& sourcePath, const std::string& destPath);
+    
+    /**
+     * @brief Copy part of a file into another file at an offset
+     * 
+     * The destination is created if needed but not truncated. Shares the
+     * extents where the filesystem supports it and the range is block
+     * aligned, and otherwise copies in the kernel like copyFile().
+     * 
+     * @param sourcePath The source file path
+     * @param sourceOffset The offset of the range in the source
+     * @param length The range length in bytes, -1 for the rest of the source
+     * @param destPath The destination file path
+     * @param destOffset The offset to copy the range to
+     * @return true if the whole range was copied, false otherwise
+     */
+    static bool copyFileRange(const std::string& sourcePath, int64_t sourceOffset, int64_t length,
+                              const std::string& destPath, int64_t destOffset);
+    
     /**
      * @brief Get the directory part of a path
      * 
@@ -4,10 +4,11 @@
 #include <string>
 #include <vector>
 #include <functional>
-#include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <memory>
+#include <map>
 
 namespace dm {
 namespace utils {
@@ -38,6 +39,68 @@ using HashCompletionCallback = std::function<void(const std::string& hash)>;
  */
 using HashErrorCallback = std::function<void(const std::string& error)>;
 
+/**
+ * @brief Incremental hash context
+ * 
+ * Hashes data fed in order, in any number of pieces, for one algorithm.
+ */
+class IncrementalHash {
+public:
+    /**
+     * @brief Construct a new IncrementalHash
+     * 
+     * @param algorithm Hash algorithm to use
+     */
+    explicit IncrementalHash(HashAlgorithm algorithm);
+    
+    /**
+     * @brief Destroy the IncrementalHash
+     */
+    ~IncrementalHash();
+    
+    // Prevent copying
+    IncrementalHash(const IncrementalHash&) = delete;
+    IncrementalHash& operator=(const IncrementalHash&) = delete;
+    
+    /**
+     * @brief Hash the next piece of data
+     * 
+     * @param data The data
+     * @param size The size of the data
+     */
+    void update(const char* data, size_t size);
+    
+    /**
+     * @brief Finalize the hash
+     * 
+     * The context must not be updated afterwards.
+     * 
+     * @return std::string The hash as lowercase hex
+     */
+    std::string finish();
+    
+    /**
+     * @brief Start over, dropping the data hashed so far
+     * 
+     * Also makes the context usable again after finish().
+     */
+    void reset();
+    
+    /**
+     * @brief Get the hash algorithm
+     * 
+     * @return HashAlgorithm The algorithm
+     */
+    HashAlgorithm getAlgorithm() const;
+    
+private:
+    struct Context;
+    
+    // Member variables
+    HashAlgorithm algorithm_;
+    std::unique_ptr<Context> context_;
+};
+
 /**
  * @brief Hash calculator class
  * 
@@ -65,9 +128,29 @@ public:
      */
     std::string calculateHash(const std::string& filePath, HashAlgorithm algorithm);
     
+    /**
+     * @brief Calculate several hashes of a file in one pass
+     * 
+     * The file is read once; each extra algorithm hashes on a worker
+     * thread of its own for the whole pass, fed the chunks through a
+     * bounded queue while the next chunk is read.
+     * 
+     * @param filePath Path to the file
+     * @param algorithms Hash algorithms to use
+     * @param progressCallback Optional callback for progress updates
+     * @return std::map<HashAlgorithm, std::string> The calculated hashes
+     * @throws std::runtime_error if hash calculation fails
+     */
+    std::map<HashAlgorithm, std::string> calculateHashes(const std::string& filePath,
+                                                         const std::vector<HashAlgorithm>& algorithms,
+                                                         HashProgressCallback progressCallback = nullptr);
+    
     /**
      * @brief Calculate file hash asynchronously
      * 
+     * Runs on the shared IoTaskExecutor. A calculation still running on
+     * this calculator is cancelled first.
+     * 
      * @param filePath Path to the file
      * @param algorithm Hash algorithm to use
      * @param progressCallback Optional callback for progress updates
@@ -100,6 +183,85 @@ public:
      */
     static std::string getAlgorithmName(HashAlgorithm algorithm);
     
+    /**
+     * @brief Parse an algorithm name
+     * 
+     * Case-insensitive, dashes are ignored ("SHA-256" and "sha256" match).
+     * 
+     * @param name The algorithm name
+     * @param algorithm Receives the algorithm
+     * @return true if the name is known, false otherwise
+     */
+    static bool parseAlgorithm(const std::string& name, HashAlgorithm& algorithm);
+    
+    /**
+     * @brief Remember a hash computed while the file was being written
+     * 
+     * The entry is tied to the file's current size and modification time,
+     * so it is ignored once the file changes. A few thousand entries are
+     * kept; past that those of changed files go first, then the oldest.
+     * 
+     * @param filePath Path to the file
+     * @param algorithm Hash algorithm used
+     * @param hash The hash
+     */
+    static void recordStreamedHash(const std::string& filePath, HashAlgorithm algorithm, const std::string& hash);
+    
+    /**
+     * @brief Look up a hash recorded by recordStreamedHash()
+     * 
+     * @param filePath Path to the file
+     * @param algorithm Hash algorithm
+     * @return std::string The hash, or an empty string if none is valid
+     */
+    static std::string findStreamedHash(const std::string& filePath, HashAlgorithm algorithm);
+    
+    /**
+     * @brief Calculate a file hash unless one is known for the file as it is
+     * 
+     * Uses the hash recorded for the file's current size and modification
+     * time if there is one, and records the hash it calculates otherwise,
+     * so an unchanged file is read once.
+     * 
+     * @param filePath Path to the file
+     * @param algorithm Hash algorithm to use
+     * @return std::string The hash
+     */
+    std::string calculateHashCached(const std::string& filePath, HashAlgorithm algorithm);
+    
+    /**
+     * @brief Write the recorded hashes to a manifest file
+     * 
+     * Entries for files that have changed or gone are left out.
+     * 
+     * @param path The manifest file
+     * @return true if written, false otherwise
+     */
+    static bool saveHashManifest(const std::string& path);
+    
+    /**
+     * @brief Read hashes recorded in an earlier run
+     * 
+     * Entries are checked against the files when looked up, as recorded
+     * ones are; hashes already recorded in this run are kept. From then on
+     * the manifest is saved again on the IoTaskExecutor whenever a hash is
+     * recorded, one save covering the changes made while it was queued.
+     * 
+     * @param path The manifest file
+     * @return true if read, false if missing or unreadable
+     */
+    static bool loadHashManifest(const std::string& path);
+    
+    /**
+     * @brief Compute or extend a CRC32 (IEEE) of a memory block
+     * 
+     * @param data The data
+     * @param size The size of the data
+     * @param crc The CRC of the preceding data (0 to start)
+     * @return uint32_t The CRC including this block
+     */
+    static uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+    
     /**
      * @brief Verify file hash
      * 
@@ -192,11 +354,13 @@ private:
                     std::function<void(const char* data, size_t size)> processFunction,
                     HashProgressCallback progressCallback);
     
+    static constexpr size_t READ_BUFFER_SIZE = 4 * 1024 * 1024;
+    
     // Member variables
     std::atomic<bool> cancelled_;
     std::atomic<bool> calculating_;
-    std::unique_ptr<std::thread> thread_;
     std::mutex mutex_;
+    std::condition_variable finished_;      // Signalled when an async calculation ends
 };
 
 } // namespace utils
@@ -0,0 +1,118 @@
+#ifndef HTML_LINK_SCANNER_H
+#define HTML_LINK_SCANNER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Incremental scanner for the URLs in an HTML document
+ *
+ * Consumes the document in chunks as they arrive and keeps only the
+ * state of the tag it is in, so a page never has to be buffered. Text
+ * between tags is skipped with memchr; comments and script/style bodies
+ * are skipped as a whole. Page links come from anchors and frames,
+ * resources from images, media, scripts and stylesheets.
+ */
+class HtmlLinkScanner {
+public:
+    /**
+     * @brief Construct a new HtmlLinkScanner
+     */
+    HtmlLinkScanner();
+
+    /**
+     * @brief Scan the next chunk of the document
+     *
+     * @param data The chunk
+     * @param size The size of the chunk
+     */
+    void feed(const char* data, size_t size);
+
+    /**
+     * @brief Start a new document, keeping allocated storage
+     */
+    void reset();
+
+    /**
+     * @brief Move out what was found so far
+     *
+     * @param links Receives the raw page links
+     * @param resources Receives the raw resource URLs
+     * @param baseHref Receives the document's <base href>, if any
+     */
+    void takeResults(std::vector<std::string>& links, std::vector<std::string>& resources,
+                     std::string& baseHref);
+
+    static constexpr size_t MAX_VALUE_LENGTH = 8192;   // Longer attribute values are dropped
+
+private:
+    enum class State {
+        TEXT,
+        TAG_OPEN,           // After '<'
+        TAG_NAME,
+        MARKUP_DECLARATION, // After "<!"
+        COMMENT,
+        SKIP_TAG,           // End tags, doctype and processing instructions
+        IN_TAG,             // Between attributes
+        ATTRIBUTE_NAME,
+        AFTER_ATTRIBUTE_NAME,
+        BEFORE_VALUE,
+        QUOTED_VALUE,
+        UNQUOTED_VALUE,
+        RAW_TEXT            // Script or style body
+    };
+
+    enum class Target {
+        NONE,
+        LINK,
+        RESOURCE,
+        BASE
+    };
+
+    /**
+     * @brief Handle the end of a start tag
+     */
+    void endTag();
+
+    /**
+     * @brief Decide where the value of the current attribute goes
+     */
+    void beginValue();
+
+    /**
+     * @brief Store the value of the current attribute
+     */
+    void endValue();
+
+    /**
+     * @brief Decode the character references in an attribute value
+     *
+     * @param value The value
+     * @return std::string The decoded value
+     */
+    static std::string decodeEntities(const std::string& value);
+
+    // Member variables
+    State state_ = State::TEXT;
+    Target target_ = Target::NONE;
+    std::string tagName_;
+    std::string attributeName_;
+    std::string value_;
+    bool valueTooLong_ = false;
+    char quote_ = '"';
+    int dashes_ = 0;                // Dashes seen toward "<!--" or "-->"
+    const char* rawTextEnd_ = "";   // "</script" or "</style" while in RAW_TEXT
+    size_t rawTextMatched_ = 0;
+    std::vector<std::string> links_;
+    std::vector<std::string> resources_;
+    std::string baseHref_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // HTML_LINK_SCANNER_H
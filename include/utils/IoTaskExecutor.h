@@ -0,0 +1,151 @@
+#ifndef IO_TASK_EXECUTOR_H
+#define IO_TASK_EXECUTOR_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Shared worker pool for post-download file work
+ *
+ * Hashing, scanning and other whole-file passes run here instead of on a
+ * thread per call. Jobs are grouped by the storage device of their file and
+ * each device runs a bounded number of jobs at a time (one for rotational
+ * disks), so a batch finishing together does not thrash a disk. Urgent jobs,
+ * those for files the user is waiting on, run before the backlog.
+ */
+class IoTaskExecutor {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return IoTaskExecutor& The singleton instance
+     */
+    static IoTaskExecutor& getInstance();
+
+    /**
+     * @brief Queue a job that reads a file
+     *
+     * @param filePath The file the job works on, used to pick its device
+     * @param job The job
+     * @param urgent True if the user is waiting on the result
+     */
+    void submit(const std::string& filePath, std::function<void()> job, bool urgent = false);
+
+    /**
+     * @brief Move queued jobs for a file ahead of the backlog
+     *
+     * @param filePath The file path
+     * @return true if a queued job was found, false otherwise
+     */
+    bool prioritize(const std::string& filePath);
+
+    /**
+     * @brief Set how many jobs may run at once on a non-rotational device
+     *
+     * @param count The job count (at least 1)
+     */
+    void setDeviceConcurrency(int count);
+
+    /**
+     * @brief Get the number of queued and running jobs
+     *
+     * @return size_t The number of jobs
+     */
+    size_t getPendingCount() const;
+
+    static constexpr int DEFAULT_DEVICE_CONCURRENCY = 2;
+    static constexpr unsigned MAX_WORKERS = 8;
+
+private:
+    struct Job {
+        std::string filePath;
+        std::function<void()> work;
+        uint64_t sequence = 0;
+    };
+
+    struct Device {
+        std::deque<Job> urgent;
+        std::deque<Job> normal;
+        int active = 0;
+        bool rotational = false;
+    };
+
+    /**
+     * @brief Construct a new IoTaskExecutor
+     */
+    IoTaskExecutor();
+
+    /**
+     * @brief Destroy the IoTaskExecutor, finishing queued jobs
+     */
+    ~IoTaskExecutor();
+
+    // Prevent copying
+    IoTaskExecutor(const IoTaskExecutor&) = delete;
+    IoTaskExecutor& operator=(const IoTaskExecutor&) = delete;
+
+    /**
+     * @brief Worker thread body
+     */
+    void workerLoop();
+
+    /**
+     * @brief Take the next runnable job
+     *
+     * Called with mutex_ held.
+     *
+     * @param job Receives the job
+     * @param deviceKey Receives the job's device
+     * @return true if a job was taken, false if none may run now
+     */
+    bool takeJob(Job& job, std::string& deviceKey);
+
+    /**
+     * @brief Start the worker threads if they are not running yet
+     *
+     * Called with mutex_ held.
+     */
+    void startWorkers();
+
+    /**
+     * @brief Get the per-device job limit
+     *
+     * @param device The device
+     * @return int The limit
+     */
+    int getLimit(const Device& device) const;
+
+    /**
+     * @brief Identify the storage device holding a path
+     *
+     * @param filePath The file path
+     * @param rotational Receives whether the device is a spinning disk
+     * @return std::string The device key
+     */
+    static std::string getDeviceKey(const std::string& filePath, bool& rotational);
+
+    // Member variables
+    std::map<std::string, Device> devices_;
+    std::vector<std::thread> workers_;
+    uint64_t nextSequence_ = 0;
+    size_t pending_ = 0;
+    int deviceConcurrency_ = DEFAULT_DEVICE_CONCURRENCY;
+    bool stopping_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // IO_TASK_EXECUTOR_H
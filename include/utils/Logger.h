@@ -4,6 +4,13 @@
 #include <string>
 #include <fstream>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <memory>
 #include <functional>
 
 namespace dm {
@@ -20,6 +27,14 @@ enum class LogLevel {
     CRITICAL
 };
 
+/**
+ * @brief What a producer does when the log queue is full
+ */
+enum class LogOverflowPolicy {
+    DROP,       // Discard the message and count it
+    BLOCK       // Wait for the writer thread to make room
+};
+
 /**
  * @brief Log callback function type
  */
@@ -27,6 +42,14 @@ using LogCallback = std::function<void(LogLevel level, const std::string& messag
 
 /**
  * @brief Logger class for application logging
+ *
+ * Logging threads only stamp the message and push it into a bounded
+ * lock-free queue. A background writer thread drains the queue in batches,
+ * formats the lines and writes them to the console and the log file with
+ * one flush per batch. The log callback is invoked on the writer thread.
+ * Critical messages are waited for, so they reach the file before a crash.
+ * Before the writer has started, after shutdown() and from the writer
+ * thread itself, messages are written synchronously instead.
  */
 class Logger {
 public:
@@ -44,43 +67,62 @@ public:
     
     /**
      * @brief Shutdown the logger
+     *
+     * Queued messages are written before the writer thread stops.
      */
     static void shutdown();
     
+    /**
+     * @brief Wait until every message logged so far has been written
+     */
+    static void flush();
+    
+    /**
+     * @brief Check if messages of a level are logged
+     *
+     * Lets callers skip building a message that would be filtered out.
+     *
+     * @param level The log level
+     * @return true if the level is enabled, false otherwise
+     */
+    static bool isEnabled(LogLevel level) {
+        return level >= logLevel_.load(std::memory_order_relaxed);
+    }
+    
     /**
      * @brief Log a debug message
      * 
      * @param message The message to log
      */
-    static void debug(const std::string& message);
+    static void debug(std::string message);
     
     /**
      * @brief Log an info message
      * 
      * @param message The message to log
      */
-    static void info(const std::string& message);
+    static void info(std::string message);
     
     /**
      * @brief Log a warning message
      * 
      * @param message The message to log
      */
-    static void warning(const std::string& message);
+    static void warning(std::string message);
     
     /**
      * @brief Log an error message
      * 
      * @param message The message to log
      */
-    static void error(const std::string& message);
+    static void error(std::string message);
     
     /**
      * @brief Log a critical message
      * 
      * @param message The message to log
      */
-    static void critical(const std::string& message);
+    static void critical(std::string message);
     
     /**
      * @brief Log a message with the specified level
@@ -88,7 +130,7 @@ public:
      * @param level The log level
      * @param message The message to log
      */
-    static void log(LogLevel level, const std::string& message);
+    static void log(LogLevel level, std::string message);
     
     /**
      * @brief Set the minimum log level
@@ -125,28 +167,125 @@ public:
      */
     static void enableFileLogging(bool enable);
     
+    /**
+     * @brief Set what happens when the log queue is full
+     * 
+     * @param policy The overflow policy
+     */
+    static void setOverflowPolicy(LogOverflowPolicy policy);
+    
+    /**
+     * @brief Get what happens when the log queue is full
+     * 
+     * @return LogOverflowPolicy The overflow policy
+     */
+    static LogOverflowPolicy getOverflowPolicy();
+    
+    /**
+     * @brief Get the number of messages dropped because the queue was full
+     * 
+     * @return uint64_t The number of dropped messages
+     */
+    static uint64_t getDroppedCount();
+    
+#ifdef DM_EMBEDDED
+    static constexpr size_t QUEUE_CAPACITY = 512;      // Must be a power of two
+#else
+    static constexpr size_t QUEUE_CAPACITY = 8192;     // Must be a power of two
+#endif
+    static constexpr size_t MAX_BATCH_SIZE = 512;
+    static constexpr int WRITER_IDLE_TIMEOUT_MS = 100;
+    
 private:
+    struct QueueSlot;
+    
+    /**
+     * @brief A message waiting to be written
+     */
+    struct LogRecord {
+        std::chrono::system_clock::time_point time;
+        LogLevel level = LogLevel::INFO;
+        std::string message;
+    };
+    
     /**
-     * @brief Get the current timestamp
+     * @brief Push a record into the queue
      * 
-     * @return std::string The timestamp
+     * @param record The record, moved from on success
+     * @return true if queued, false if the queue was full
      */
-    static std::string getCurrentTimestamp();
+    static bool enqueue(LogRecord& record);
     
     /**
-     * @brief Convert a log level to a string
+     * @brief Pop records from the queue
      * 
-     * @param level The log level
-     * @return std::string The log level as a string
+     * Only the writer thread, or shutdown() once it has stopped, may call this.
+     * 
+     * @param batch Receives the records
+     * @param maxRecords The maximum number of records to take
+     */
+    static void dequeue(std::vector<LogRecord>& batch, size_t maxRecords);
+    
+    /**
+     * @brief Check if the queue has a record ready to pop
+     * 
+     * @return true if a record is ready, false otherwise
+     */
+    static bool hasQueuedRecord();
+    
+    /**
+     * @brief Check if the queue has a free slot for the next record
+     * 
+     * @return true if a record can be pushed, false if the queue is full
+     */
+    static bool hasQueueSpace();
+    
+    /**
+     * @brief Wake the writer thread if it is waiting for records
+     */
+    static void wakeWriter();
+    
+    /**
+     * @brief Start the writer thread if it is not running
+     */
+    static void startWriter();
+    
+    /**
+     * @brief Stop the writer thread after it has drained the queue
+     * 
+     * Then waits for producers still pushing and writes what they pushed.
+     */
+    static void stopWriter();
+    
+    /**
+     * @brief Writer thread body
+     */
+    static void writerLoop();
+    
+    /**
+     * @brief Write records to the console and file and pass them to the callback
+     * 
+     * @param batch The records
      */
-    static std::string logLevelToString(LogLevel level);
+    static void writeRecords(const std::vector<LogRecord>& batch);
     
     /**
-     * @brief Write a log message to the file
+     * @brief Append a formatted timestamp to a line
      * 
-     * @param message The message to write
+     * Called with mutex_ held.
+     * 
+     * @param line The line
+     * @param time The time to format
+     */
+    static void appendTimestamp(std::string& line, std::chrono::system_clock::time_point time);
+    
+    /**
+     * @brief Convert a log level to a string
+     * 
+     * @param level The log level
+     * @return const char* The log level as a string
      */
-    static void writeToFile(const std::string& message);
+    static const char* logLevelToString(LogLevel level);
     
     /**
      * @brief Rotate log files if needed
@@ -157,16 +296,36 @@ private:
     static std::string logFile_;
     static std::ofstream logStream_;
     static std::mutex mutex_;
-    static LogLevel logLevel_;
+    static std::atomic<LogLevel> logLevel_;
     static size_t maxFileSize_;
+    static size_t fileSize_;
     static int maxFiles_;
     static bool initialized_;
     static bool consoleLoggingEnabled_;
     static bool fileLoggingEnabled_;
     static LogCallback logCallback_;
+    
+    // Writer thread state
+    static std::unique_ptr<QueueSlot[]> queue_;
+    static std::atomic<uint64_t> enqueuePosition_;
+    static uint64_t dequeuePosition_;
+    static std::thread writerThread_;
+    static std::atomic<std::thread::id> writerThreadId_;
+    static std::atomic<bool> writerRunning_;
+    static std::atomic<bool> asyncEnabled_;
+    static std::atomic<bool> writerIdle_;
+    static std::atomic<int> activeProducers_;   // Pushing or waiting for room
+    static bool writerStopping_;
+    static std::mutex wakeMutex_;
+    static std::condition_variable wakeCondition_;
+    static std::condition_variable flushedCondition_;
+    static std::atomic<uint64_t> writtenCount_;
+    static std::atomic<LogOverflowPolicy> overflowPolicy_;
+    static std::atomic<uint64_t> droppedCount_;
+    static std::atomic<uint64_t> unreportedDrops_;
 };
 
 } // namespace utils
 } // namespace dm
 
-#endif // LOGGER_H
\ No newline at end of file
+#endif // LOGGER_H
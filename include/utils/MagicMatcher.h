@@ -0,0 +1,157 @@
+#ifndef MAGIC_MATCHER_H
+#define MAGIC_MATCHER_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief A file type recognized from its magic number
+ */
+struct FileSignature {
+    std::string mimeType;           // Empty if nothing matched
+    std::string extension;          // Usual extension, without the dot
+    std::string description;        // Human-readable name
+    std::string footer;             // Bytes the file ends with (near the end), empty if none
+
+    /**
+     * @brief Check if a signature matched
+     *
+     * @return true if matched, false otherwise
+     */
+    bool isValid() const { return !mimeType.empty(); }
+};
+
+/**
+ * @brief Magic-number matcher over the first bytes of a file
+ *
+ * The signature table is compiled once into one trie per offset the
+ * signatures start at. Each root is a 256-entry jump table on the first
+ * byte; deeper nodes keep short sorted edge lists, plus a wildcard edge
+ * for bytes a signature does not care about (RIFF sizes, for one).
+ * Matching walks each trie once and returns the longest, hence most
+ * specific, signature, so the cost is bounded by the signature length and
+ * not by the number of signatures.
+ */
+class MagicMatcher {
+public:
+    /**
+     * @brief Get the shared matcher, compiled on first use
+     *
+     * @return const MagicMatcher& The matcher
+     */
+    static const MagicMatcher& getInstance();
+
+    /**
+     * @brief Match the first bytes of a file
+     *
+     * @param data The first bytes
+     * @param size The number of bytes
+     * @return FileSignature The signature, invalid if none matched
+     */
+    FileSignature match(const char* data, size_t size) const;
+
+    /**
+     * @brief Match the first bytes of a file
+     *
+     * @param head The first bytes
+     * @return FileSignature The signature, invalid if none matched
+     */
+    FileSignature match(const std::string& head) const;
+
+    /**
+     * @brief Check that a file ends the way its type requires
+     *
+     * @param signature The file's signature
+     * @param tail The last bytes of the file
+     * @return true if the type has no footer or the tail contains it
+     */
+    static bool hasFooter(const FileSignature& signature, const std::string& tail);
+
+    /**
+     * @brief Get the number of bytes a head must have to match every signature
+     *
+     * @return size_t The number of bytes
+     */
+    size_t getMaxSignatureEnd() const;
+
+    static constexpr int ANY_BYTE = -1;    // Wildcard in a signature pattern
+
+private:
+    /**
+     * @brief One entry of the signature table
+     */
+    struct Signature {
+        size_t offset;
+        std::vector<int> pattern;       // Bytes, ANY_BYTE for wildcards
+        FileSignature type;
+    };
+
+    /**
+     * @brief A trie node
+     */
+    struct Node {
+        std::vector<std::pair<uint8_t, int32_t>> edges;    // Sorted by byte
+        int32_t any = -1;               // Wildcard child
+        int32_t signature = -1;         // Signature ending here
+    };
+
+    /**
+     * @brief The trie of the signatures starting at one offset
+     */
+    struct Trie {
+        size_t offset;
+        std::array<int32_t, 256> root;  // Jump table on the first byte
+        int32_t rootAny = -1;           // Signatures starting with a wildcard
+    };
+
+    /**
+     * @brief Compile the built-in signature table
+     */
+    MagicMatcher();
+
+    /**
+     * @brief Add a signature to the trie of its offset
+     *
+     * @param index The signature's index in signatures_
+     */
+    void insert(int32_t index);
+
+    /**
+     * @brief Get or create the child of a node
+     *
+     * @param node The node
+     * @param value The byte, or ANY_BYTE
+     * @return int32_t The child
+     */
+    int32_t child(int32_t node, int value);
+
+    /**
+     * @brief Find the longest signature below a node
+     *
+     * @param node The node reached so far
+     * @param data The bytes
+     * @param size The number of bytes
+     * @param position The position of the next byte to match
+     * @param best Receives the longest signature, kept if none is longer
+     * @param bestLength The length of best
+     */
+    void walk(int32_t node, const uint8_t* data, size_t size, size_t position,
+              int32_t& best, size_t& bestLength) const;
+
+    // Member variables
+    std::vector<Signature> signatures_;
+    std::vector<Node> nodes_;
+    std::vector<Trie> tries_;
+    size_t maxSignatureEnd_ = 0;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // MAGIC_MATCHER_H
@@ -0,0 +1,64 @@
+#ifndef METALINK_PARSER_H
+#define METALINK_PARSER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief A file described by a Metalink document
+ */
+struct MetalinkFile {
+    std::string name;                           // Relative path, may contain directories
+    int64_t size = -1;                          // Size in bytes, -1 if not given
+    std::map<std::string, std::string> hashes;  // Hash type ("sha-256") to lowercase hex digest
+    std::vector<std::string> urls;              // Equivalent URLs, most preferred first
+    int64_t pieceLength = 0;                    // Piece size in bytes, 0 without piece hashes
+    std::string pieceHashType;                  // Hash type of the pieces ("sha-256")
+    std::vector<std::string> pieceHashes;       // Lowercase hex digest by piece index
+};
+
+/**
+ * @brief Parser for Metalink 4 (RFC 5854) documents
+ *
+ * Reads the name, size, whole-file hashes, piece hashes (the first
+ * <pieces> element) and URLs of each <file>. Signatures and <metaurl>
+ * links (torrents) are ignored.
+ */
+class MetalinkParser {
+public:
+    /**
+     * @brief Parse a Metalink document
+     *
+     * @param xml The document
+     * @param files Receives the files that have a usable name and at least one URL
+     * @return true if the document is a Metalink with at least one file, false otherwise
+     */
+    static bool parse(const std::string& xml, std::vector<MetalinkFile>& files);
+
+    /**
+     * @brief Parse a Metalink file
+     *
+     * @param path Path to the .meta4 file
+     * @param files Receives the files
+     * @return true if successful, false otherwise
+     */
+    static bool parseFile(const std::string& path, std::vector<MetalinkFile>& files);
+
+    /**
+     * @brief Check if a file name stays inside the download directory
+     *
+     * @param name The name from the document
+     * @return true if it is relative and has no ".." components, false otherwise
+     */
+    static bool isSafeName(const std::string& name);
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // METALINK_PARSER_H
@@ -0,0 +1,190 @@
+#ifndef RESOURCE_MONITOR_H
+#define RESOURCE_MONITOR_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Parts of the downloader whose allocations are counted
+ */
+enum class ResourceSubsystem {
+    WRITE_BUFFERS,      // Aligned segment write buffers
+    CURL_HANDLES,       // Easy handles, live or pooled
+    SEGMENTS,           // Segment downloaders
+    COUNT
+};
+
+/**
+ * @brief Process resource usage at one sample
+ */
+struct ResourceUsage {
+    int64_t residentBytes = 0;          // Resident set size
+    int64_t peakResidentBytes = 0;      // Largest resident set size sampled
+    int64_t virtualBytes = 0;           // Virtual memory size
+    int openFiles = 0;                  // Open file descriptors or handles
+    int threadCount = 0;                // Threads in the process
+    std::chrono::system_clock::time_point sampledAt;   // Epoch if never sampled
+};
+
+/**
+ * @brief Allocation counters of one subsystem
+ */
+struct SubsystemUsage {
+    int64_t liveObjects = 0;            // Allocated and not yet released
+    int64_t liveBytes = 0;              // Bytes held by the live objects
+    uint64_t totalAllocations = 0;      // Allocations since startup
+};
+
+/**
+ * @brief Process-wide resource sampler
+ *
+ * A background thread reads the process's memory, open files and thread
+ * count at a fixed interval and publishes them as atomics, so readers
+ * (statistics, CLI, UI) never touch /proc themselves. Subsystems report
+ * their own allocations through relaxed atomic counters.
+ */
+class ResourceMonitor {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return ResourceMonitor& The singleton instance
+     */
+    static ResourceMonitor& getInstance();
+
+    /**
+     * @brief Start the sampler thread, or change its interval if running
+     *
+     * @param intervalMs The time between samples in milliseconds
+     */
+    void start(int intervalMs = DEFAULT_SAMPLE_INTERVAL_MS);
+
+    /**
+     * @brief Stop the sampler thread
+     */
+    void stop();
+
+    /**
+     * @brief Check if the sampler thread is running
+     *
+     * @return true if running, false otherwise
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Take a sample immediately on the calling thread
+     */
+    void sampleNow();
+
+    /**
+     * @brief Get the latest sample
+     *
+     * @return ResourceUsage The usage, all zero if nothing was sampled yet
+     */
+    ResourceUsage getUsage() const;
+
+    /**
+     * @brief Record an allocation made by a subsystem
+     *
+     * @param subsystem The subsystem
+     * @param bytes The size of the allocation
+     */
+    void recordAllocation(ResourceSubsystem subsystem, int64_t bytes = 0) {
+        Counters& counters = counters_[static_cast<size_t>(subsystem)];
+        counters.liveObjects.fetch_add(1, std::memory_order_relaxed);
+        counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+        counters.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Record that a subsystem released an allocation
+     *
+     * @param subsystem The subsystem
+     * @param bytes The size of the allocation
+     */
+    void recordRelease(ResourceSubsystem subsystem, int64_t bytes = 0) {
+        Counters& counters = counters_[static_cast<size_t>(subsystem)];
+        counters.liveObjects.fetch_sub(1, std::memory_order_relaxed);
+        counters.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the allocation counters of a subsystem
+     *
+     * @param subsystem The subsystem
+     * @return SubsystemUsage The counters
+     */
+    SubsystemUsage getSubsystemUsage(ResourceSubsystem subsystem) const;
+
+    /**
+     * @brief Get a display name for a subsystem
+     *
+     * @param subsystem The subsystem
+     * @return const char* The name
+     */
+    static const char* getSubsystemName(ResourceSubsystem subsystem);
+
+    static constexpr int DEFAULT_SAMPLE_INTERVAL_MS = 1000;
+    static constexpr int MIN_SAMPLE_INTERVAL_MS = 100;
+
+private:
+    struct alignas(64) Counters {
+        std::atomic<int64_t> liveObjects{0};
+        std::atomic<int64_t> liveBytes{0};
+        std::atomic<uint64_t> totalAllocations{0};
+    };
+
+    /**
+     * @brief Construct a new ResourceMonitor
+     */
+    ResourceMonitor();
+
+    /**
+     * @brief Destroy the ResourceMonitor, stopping the sampler
+     */
+    ~ResourceMonitor();
+
+    // Prevent copying
+    ResourceMonitor(const ResourceMonitor&) = delete;
+    ResourceMonitor& operator=(const ResourceMonitor&) = delete;
+
+    /**
+     * @brief Sampler thread body
+     */
+    void samplerLoop();
+
+    /**
+     * @brief Read the process counters from the operating system
+     *
+     * @param usage Receives the counters
+     * @return true if anything could be read, false otherwise
+     */
+    static bool readProcessUsage(ResourceUsage& usage);
+
+    // Member variables
+    Counters counters_[static_cast<size_t>(ResourceSubsystem::COUNT)];
+    std::atomic<int64_t> residentBytes_{0};
+    std::atomic<int64_t> peakResidentBytes_{0};
+    std::atomic<int64_t> virtualBytes_{0};
+    std::atomic<int> openFiles_{0};
+    std::atomic<int> threadCount_{0};
+    std::atomic<int64_t> sampledAtMs_{0};
+    std::thread thread_;
+    int intervalMs_ = DEFAULT_SAMPLE_INTERVAL_MS;
+    bool stopping_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // RESOURCE_MONITOR_H
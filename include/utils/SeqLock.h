@@ -0,0 +1,95 @@
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Single-writer snapshot cell based on a sequence lock
+ *
+ * The writer bumps the sequence to odd, copies the value in and bumps it
+ * back to even. Readers never block the writer or each other: they copy the
+ * value out and retry only if a store overlapped their read. The value is
+ * kept in atomic words so torn reads are detected rather than undefined.
+ * Concurrent writers must be serialized by the caller.
+ */
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+public:
+    /**
+     * @brief Construct a new SeqLock
+     *
+     * @param value The initial value
+     */
+    explicit SeqLock(const T& value = T()) {
+        store(value);
+    }
+
+    // Prevent copying
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    /**
+     * @brief Publish a new value
+     *
+     * @param value The value
+     */
+    void store(const T& value) {
+        uint64_t words[WORD_COUNT] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORD_COUNT; i++) {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Read a consistent copy of the latest value
+     *
+     * @return T The value
+     */
+    T load() const {
+        uint64_t words[WORD_COUNT];
+        uint64_t before;
+        uint64_t after;
+
+        do {
+            before = sequence_.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORD_COUNT; i++) {
+                words[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence_.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1) != 0);
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    static constexpr size_t WORD_COUNT = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // Member variables
+    std::atomic<uint64_t> sequence_{0};
+    std::atomic<uint64_t> words_[WORD_COUNT];
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // SEQ_LOCK_H
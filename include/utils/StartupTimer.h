@@ -0,0 +1,122 @@
+#ifndef STARTUP_TIMER_H
+#define STARTUP_TIMER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Where cold start time goes
+ *
+ * Collects the stages of startup, timed from when the timer was first
+ * used, and milestones such as the window being shown. The report lists
+ * them in order with the thread each ran on, so work that holds up the
+ * window can be told from work done in the background.
+ */
+class StartupTimer {
+public:
+    /**
+     * @brief Get the singleton instance, the origin of all timings
+     *
+     * @return StartupTimer& The singleton instance
+     */
+    static StartupTimer& getInstance();
+
+    /**
+     * @brief Record a finished stage
+     *
+     * @param name The stage name
+     * @param start When it started
+     * @param end When it finished
+     */
+    void recordStage(const std::string& name, std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end);
+
+    /**
+     * @brief Record a milestone reached now
+     *
+     * @param name The milestone name
+     */
+    void markMilestone(const std::string& name);
+
+    /**
+     * @brief Get the report of the stages and milestones recorded so far
+     *
+     * @return std::string The report, one line each
+     */
+    std::string getReport() const;
+
+    /**
+     * @brief Write the report to the log, once
+     */
+    void logReport();
+
+private:
+    /**
+     * @brief A recorded stage, or a milestone when it has no duration
+     */
+    struct Entry {
+        std::string name;
+        std::chrono::steady_clock::duration start{};    // Since the origin
+        std::chrono::steady_clock::duration duration{};
+        bool milestone = false;
+        bool background = false;                        // Not on the thread that started the timer
+    };
+
+    /**
+     * @brief Construct a new StartupTimer
+     */
+    StartupTimer();
+
+    // Prevent copying
+    StartupTimer(const StartupTimer&) = delete;
+    StartupTimer& operator=(const StartupTimer&) = delete;
+
+    // Member variables
+    const std::chrono::steady_clock::time_point origin_;
+    const std::thread::id mainThread_;
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+    bool reported_ = false;
+};
+
+/**
+ * @brief Times a startup stage from construction to destruction
+ */
+class StartupStage {
+public:
+    /**
+     * @brief Start timing a stage
+     *
+     * @param name The stage name
+     */
+    explicit StartupStage(std::string name)
+        : name_(std::move(name)), start_(std::chrono::steady_clock::now()) {}
+
+    /**
+     * @brief Record the stage
+     */
+    ~StartupStage() {
+        StartupTimer::getInstance().recordStage(name_, start_, std::chrono::steady_clock::now());
+    }
+
+    // Prevent copying
+    StartupStage(const StartupStage&) = delete;
+    StartupStage& operator=(const StartupStage&) = delete;
+
+private:
+    // Member variables
+    std::string name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // STARTUP_TIMER_H
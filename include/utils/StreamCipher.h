@@ -0,0 +1,201 @@
+#ifndef STREAM_CIPHER_H
+#define STREAM_CIPHER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Authenticated encryption of a stream in fixed-size frames
+ *
+ * AES-256-GCM through OpenSSL EVP, which uses AES-NI or the ARM crypto
+ * extensions where the CPU has them. The stream starts with a header and
+ * every frame of plaintext becomes a frame of ciphertext of the same size
+ * followed by its tag, so only one frame is ever held in memory and the
+ * ciphertext offset of any frame is known in advance. That lets a chunked
+ * upload encrypt just the frames of the part it sends, and resume from any
+ * part after a restart.
+ *
+ * Each frame's nonce is a random per-stream prefix and the frame index,
+ * and the header and whether the frame is the last one are authenticated
+ * with it, so frames cannot be reordered, mixed between streams or cut
+ * off at the end without decryption failing. Re-encrypting a frame gives
+ * the same ciphertext only for the same plaintext; a stream whose source
+ * changed must be started afresh with startEncryption. encryptFile binds
+ * the size and modification time of its source into the header, keyed so
+ * it reveals neither, and only resumes a stream of the same source.
+ *
+ * Not thread-safe, use one StreamCipher per thread.
+ */
+class StreamCipher {
+public:
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t TAG_SIZE = 16;
+    static constexpr size_t HEADER_SIZE = 32;
+    static constexpr size_t SOURCE_TAG_SIZE = 16;
+    static constexpr size_t DEFAULT_FRAME_SIZE = 64 * 1024;
+
+    /**
+     * @brief Construct a new StreamCipher
+     *
+     * @param key The key, KEY_SIZE bytes
+     * @throws std::invalid_argument if the key has the wrong size
+     */
+    explicit StreamCipher(const std::vector<uint8_t>& key);
+
+    /**
+     * @brief Destroy the StreamCipher, wiping the key
+     */
+    ~StreamCipher();
+
+    /**
+     * @brief Start a new stream to encrypt, with a fresh nonce prefix
+     *
+     * @param frameSize Plaintext bytes per frame
+     * @return true if successful, false otherwise
+     */
+    bool startEncryption(size_t frameSize = DEFAULT_FRAME_SIZE);
+
+    /**
+     * @brief Continue a stream from its header
+     *
+     * Used to decrypt a stream, or to encrypt more of one started earlier.
+     *
+     * @param header The stream header, HEADER_SIZE bytes
+     * @return true if the header is valid, false otherwise
+     */
+    bool startStream(const uint8_t* header);
+
+    /**
+     * @brief Get the header of the current stream
+     *
+     * @return const uint8_t* The header, HEADER_SIZE bytes
+     */
+    const uint8_t* getHeader() const { return header_; }
+
+    /**
+     * @brief Get the plaintext bytes per frame of the current stream
+     *
+     * @return size_t The frame size
+     */
+    size_t getFrameSize() const { return frameSize_; }
+
+    /**
+     * @brief Encrypt one frame
+     *
+     * @param index The frame index
+     * @param data The plaintext, frame size bytes for all but the last frame
+     * @param size The plaintext size
+     * @param last Whether this is the last frame of the stream
+     * @param out Receives size + TAG_SIZE bytes
+     * @return true if successful, false otherwise
+     */
+    bool encryptFrame(uint64_t index, const uint8_t* data, size_t size, bool last, uint8_t* out);
+
+    /**
+     * @brief Decrypt and authenticate one frame
+     *
+     * @param index The frame index
+     * @param data The frame, size bytes of ciphertext then the tag
+     * @param size The frame size including the tag
+     * @param last Whether this is the last frame of the stream
+     * @param out Receives size - TAG_SIZE bytes
+     * @return true if authentic, false otherwise
+     */
+    bool decryptFrame(uint64_t index, const uint8_t* data, size_t size, bool last, uint8_t* out);
+
+    /**
+     * @brief Encrypt a file into a stream file
+     *
+     * With resume, an output left by an interrupted run of the same stream
+     * keeps its header and whole frames and encryption continues after
+     * them. If the source's size or modification time changed since, the
+     * output is encrypted afresh under a new nonce prefix instead.
+     *
+     * @param inputPath The file to encrypt
+     * @param outputPath The stream file
+     * @param resume Whether to continue an existing output
+     * @return true if successful, false otherwise
+     */
+    bool encryptFile(const std::string& inputPath, const std::string& outputPath, bool resume = false);
+
+    /**
+     * @brief Decrypt a stream file
+     *
+     * @param inputPath The stream file
+     * @param outputPath The decrypted file, removed if decryption fails
+     * @return true if the whole stream is authentic, false otherwise
+     */
+    bool decryptFile(const std::string& inputPath, const std::string& outputPath);
+
+    /**
+     * @brief Get the stream size for a plaintext size
+     *
+     * @param plainSize The plaintext size in bytes
+     * @param frameSize Plaintext bytes per frame
+     * @return int64_t The stream size including the header
+     */
+    static int64_t getEncryptedSize(int64_t plainSize, size_t frameSize = DEFAULT_FRAME_SIZE);
+
+    /**
+     * @brief Get the offset of a frame in the stream
+     *
+     * @param index The frame index
+     * @param frameSize Plaintext bytes per frame
+     * @return int64_t The offset in bytes
+     */
+    static int64_t getFrameOffset(uint64_t index, size_t frameSize = DEFAULT_FRAME_SIZE) {
+        return static_cast<int64_t>(HEADER_SIZE + index * (frameSize + TAG_SIZE));
+    }
+
+private:
+    /**
+     * @brief Prepare the context for a frame
+     *
+     * @param index The frame index
+     * @param last Whether this is the last frame
+     * @param encrypt True to encrypt, false to decrypt
+     * @return true if successful, false otherwise
+     */
+    bool startFrame(uint64_t index, bool last, bool encrypt);
+
+    /**
+     * @brief Compute the tag that binds the current stream to its source
+     *
+     * @param size The source size in bytes
+     * @param modified The source modification time, in file clock ticks
+     * @param tag Receives SOURCE_TAG_SIZE bytes
+     * @return true if successful, false otherwise
+     */
+    bool computeSourceTag(int64_t size, int64_t modified, uint8_t* tag) const;
+
+    /**
+     * @brief Check that a stream file holds the whole stream
+     *
+     * @param path The stream file, of the full stream size
+     * @param plainSize The plaintext size
+     * @return true if its last frame is authentic, false otherwise
+     */
+    bool isCompleteStream(const std::string& path, int64_t plainSize);
+
+    // Prevent copying
+    StreamCipher(const StreamCipher&) = delete;
+    StreamCipher& operator=(const StreamCipher&) = delete;
+
+    // Member variables
+    EVP_CIPHER_CTX* context_ = nullptr;
+    uint8_t key_[KEY_SIZE];
+    uint8_t header_[HEADER_SIZE] = {};
+    size_t frameSize_ = 0;      // 0 until a stream is started
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // STREAM_CIPHER_H
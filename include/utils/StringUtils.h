@@ -2,6 +2,7 @@
 #define STRING_UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <sstream>
@@ -17,7 +18,12 @@ namespace Utils {
 /**
  * @brief String utilities class
  * 
- * Provides utility functions for string manipulation
+ * Provides utility functions for string manipulation. The view variants
+ * (trimView, toLowerCaseInPlace, splitView, replaceInPlace) allocate
+ * nothing; they and the functions built on them run case folding, byte
+ * search and whitespace skipping through SSE2, AVX2 or NEON kernels picked
+ * once at run time, with a portable fallback. Case folding and whitespace
+ * are ASCII, as in the "C" locale.
  */
 class StringUtils {
 public:
@@ -45,6 +51,14 @@ public:
      */
     static std::string trim(const std::string& str);
     
+    /**
+     * @brief Trim whitespace from both ends of a string without copying it
+     * 
+     * @param str The string to trim
+     * @return std::string_view The trimmed part of str
+     */
+    static std::string_view trimView(std::string_view str);
+    
     /**
      * @brief Convert a string to lowercase
      * 
@@ -53,6 +67,13 @@ public:
      */
     static std::string toLowerCase(const std::string& str);
     
+    /**
+     * @brief Convert a string to lowercase in place
+     * 
+     * @param str The string to convert
+     */
+    static void toLowerCaseInPlace(std::string& str);
+    
     /**
      * @brief Convert a string to uppercase
      * 
@@ -73,6 +94,23 @@ public:
                                        const std::string& delimiter,
                                        bool skipEmpty = true);
     
+    /**
+     * @brief Split a string by delimiter into views of it
+     * 
+     * The tokens vector is cleared first; reusing it across calls keeps
+     * its capacity, so splitting line after line allocates nothing.
+     * 
+     * @param str The string to split
+     * @param delimiter The delimiter
+     * @param tokens Receives the tokens, valid as long as str's characters
+     * @param skipEmpty Skip empty tokens
+     * @return size_t The number of tokens
+     */
+    static size_t splitView(std::string_view str,
+                          std::string_view delimiter,
+                          std::vector<std::string_view>& tokens,
+                          bool skipEmpty = true);
+    
     /**
      * @brief Split a string by whitespace
      * 
@@ -105,6 +143,21 @@ public:
                              const std::string& from,
                              const std::string& to);
     
+    /**
+     * @brief Replace all occurrences of a substring in place
+     * 
+     * Allocates nothing when the replacement is no longer than the
+     * substring, which is the case for entity decoding.
+     * 
+     * @param str The string to process
+     * @param from The substring to replace
+     * @param to The replacement
+     * @return size_t The number of replacements
+     */
+    static size_t replaceInPlace(std::string& str,
+                               std::string_view from,
+                               std::string_view to);
+    
     /**
      * @brief Check if a string starts with a prefix
      * 
@@ -137,8 +190,8 @@ public:
      * @param caseSensitive Whether the check is case-sensitive
      * @return bool True if the string contains the substring
      */
-    static bool contains(const std::string& str,
-                        const std::string& substring,
+    static bool contains(std::string_view str,
+                        std::string_view substring,
                         bool caseSensitive = true);
     
     /**
@@ -231,6 +284,8 @@ public:
     /**
      * @brief Extract the domain from a URL
      * 
+     * Same as dm::utils::UrlParser::extractDomain().
+     * 
      * @param url The URL
      * @return std::string The domain
      */
@@ -258,7 +313,7 @@ public:
      * @param str The string to check
      * @return bool True if the string is a valid URL
      */
-    static bool isValidUrl(const std::string& str);
+    static bool isValidUrl(std::string_view str);
     
     /**
      * @brief Check if a string is a valid email
@@ -355,6 +410,13 @@ public:
      * @return std::string The decoded string
      */
     static std::string base64Decode(const std::string& str);
+    
+    /**
+     * @brief Get the instruction set the string kernels run on
+     * 
+     * @return const char* "avx2", "sse2", "neon" or "portable"
+     */
+    static const char* getKernelName();
 };
 
 } // namespace Utils
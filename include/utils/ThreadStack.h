@@ -0,0 +1,42 @@
+#ifndef THREAD_STACK_H
+#define THREAD_STACK_H
+
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Stack size of the threads the process starts
+ *
+ * std::thread takes no attributes, so the size is set as the process
+ * default (pthread_setattr_default_np) and applies to every thread started
+ * afterwards, the engine's and libcurl's resolver threads alike. Threads
+ * already running keep theirs. Only Linux supports it; elsewhere the
+ * system default stays.
+ */
+class ThreadStack {
+public:
+    /**
+     * @brief Set the stack size of threads started from now on
+     *
+     * @param bytes The size, rounded up to the page size and at least
+     *        MIN_STACK_SIZE; 0 restores the size the process started with
+     * @return true if applied, false if the platform does not support it
+     */
+    static bool setDefaultSize(size_t bytes);
+
+    /**
+     * @brief Get the stack size of threads started from now on
+     *
+     * @return size_t The size in bytes, 0 if unknown
+     */
+    static size_t getDefaultSize();
+
+    static constexpr size_t MIN_STACK_SIZE = 64 * 1024;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // THREAD_STACK_H
@@ -0,0 +1,246 @@
+#ifndef TIME_SERIES_ROLLUP_H
+#define TIME_SERIES_ROLLUP_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Width of the buckets of a rollup
+ */
+enum class RollupResolution {
+    SECOND,
+    MINUTE,
+    HOUR,
+    DAY
+};
+
+/**
+ * @brief Samples that fell into one time bucket
+ */
+struct TimeBucket {
+    int64_t start = 0;          // Seconds since the epoch, a multiple of the bucket width
+    uint32_t count = 0;         // Samples added
+    double sum = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+
+    /**
+     * @brief Get the average of the samples
+     *
+     * @return double The average, 0 if the bucket is empty
+     */
+    double getAverage() const { return count > 0 ? sum / count : 0.0; }
+};
+
+/**
+ * @brief Time series kept as per-second, per-minute, per-hour and per-day rollups
+ *
+ * Each resolution is a ring buffer of fixed capacity, stored a column per
+ * field and allocated once, so memory stays the same however long the
+ * process runs. Each sample updates the current bucket of every
+ * resolution in constant time; buckets without samples are not stored.
+ * Range queries binary search the bucket starts, pick the finest
+ * resolution that fits the range and can downsample the result to a
+ * point budget, such as a chart's width in pixels, with
+ * Largest-Triangle-Three-Buckets, which keeps the peaks and dips a plain
+ * average would flatten.
+ *
+ * With an archive open, every completed hour is also appended to it as a
+ * fixed-size record, so hours the ring no longer holds, and hours from
+ * earlier runs, are still answered from the file.
+ *
+ * Consumers that draw incrementally query from the start of the last
+ * bucket they have: that bucket may have grown since, the rest is new.
+ * Thread-safe.
+ */
+class TimeSeriesRollup {
+public:
+    /**
+     * @brief Construct a new TimeSeriesRollup
+     *
+     * @param secondBuckets Seconds kept
+     * @param minuteBuckets Minutes kept
+     * @param hourBuckets Hours kept in memory
+     * @param dayBuckets Days kept
+     */
+    explicit TimeSeriesRollup(size_t secondBuckets = DEFAULT_SECOND_BUCKETS,
+                              size_t minuteBuckets = DEFAULT_MINUTE_BUCKETS,
+                              size_t hourBuckets = DEFAULT_HOUR_BUCKETS,
+                              size_t dayBuckets = DEFAULT_DAY_BUCKETS);
+
+    /**
+     * @brief Open the hour archive, creating it if needed
+     *
+     * The archived hours are loaded into the hour and day resolutions.
+     * A record torn by a crash is ignored and later overwritten. Call
+     * before adding samples.
+     *
+     * @param path The archive file path
+     * @return true if successful, false otherwise
+     */
+    bool openArchive(const std::string& path);
+
+    /**
+     * @brief Add a sample
+     *
+     * Samples older than the current bucket are merged into theirs if it
+     * is still kept, and dropped otherwise.
+     *
+     * @param timestamp Seconds since the epoch
+     * @param value The value
+     */
+    void add(int64_t timestamp, double value);
+
+    /**
+     * @brief Get the buckets of a resolution that start in a range
+     *
+     * @param resolution The resolution
+     * @param from Start of the range in seconds, inclusive
+     * @param to End of the range in seconds, inclusive
+     * @return std::vector<TimeBucket> The buckets, oldest first
+     */
+    std::vector<TimeBucket> getBuckets(RollupResolution resolution, int64_t from, int64_t to) const;
+
+    /**
+     * @brief Get a range at the finest resolution that fits a point budget
+     *
+     * A resolution that no longer holds the start of the range, while a
+     * coarser one does, gives way to the coarser one.
+     *
+     * @param from Start of the range in seconds, inclusive
+     * @param to End of the range in seconds, inclusive
+     * @param maxPoints The point budget (0 for no limit)
+     * @param downsample True to reduce a result still over budget with
+     *        LTTB on the averages, false to return it as is
+     * @return std::vector<TimeBucket> The buckets, oldest first
+     */
+    std::vector<TimeBucket> query(int64_t from, int64_t to, size_t maxPoints, bool downsample = true) const;
+
+    /**
+     * @brief Pick the finest resolution whose buckets over a range fit a budget
+     *
+     * @param from Start of the range in seconds
+     * @param to End of the range in seconds
+     * @param maxPoints The point budget (0 for no limit)
+     * @return RollupResolution The resolution, DAY if none fits
+     */
+    static RollupResolution chooseResolution(int64_t from, int64_t to, size_t maxPoints);
+
+    /**
+     * @brief Reduce buckets to a point count with Largest-Triangle-Three-Buckets
+     *
+     * The first and last buckets are always kept; of every group in
+     * between, the one forming the largest triangle with its neighbours'
+     * picks, on start and average, is kept.
+     *
+     * @param buckets The buckets, oldest first
+     * @param maxPoints The point count (at least 3 to downsample)
+     * @return std::vector<TimeBucket> The kept buckets
+     */
+    static std::vector<TimeBucket> downsample(const std::vector<TimeBucket>& buckets, size_t maxPoints);
+
+    /**
+     * @brief Get the width of a resolution's buckets
+     *
+     * @param resolution The resolution
+     * @return int64_t The width in seconds
+     */
+    static int64_t getBucketSeconds(RollupResolution resolution);
+
+    /**
+     * @brief Remove every sample held in memory, the archive is kept
+     */
+    void clear();
+
+    static constexpr size_t DEFAULT_SECOND_BUCKETS = 60 * 60;        // One hour
+    static constexpr size_t DEFAULT_MINUTE_BUCKETS = 7 * 24 * 60;    // One week
+    static constexpr size_t DEFAULT_HOUR_BUCKETS = 90 * 24;          // About three months, the archive keeps the rest
+    static constexpr size_t DEFAULT_DAY_BUCKETS = 5 * 366;           // Five years
+    static constexpr size_t RESOLUTION_COUNT = 4;
+    static constexpr size_t ARCHIVE_RECORD_SIZE = 36;                // Start, count, sum, min, max
+
+private:
+    /**
+     * @brief Ring buffer of the buckets of one resolution, a column per field
+     */
+    struct Level {
+        std::vector<int64_t> starts;
+        std::vector<uint32_t> counts;
+        std::vector<double> sums;
+        std::vector<double> mins;
+        std::vector<double> maxs;
+        size_t head = 0;            // Slot of the oldest bucket
+        size_t size = 0;
+
+        void reset(size_t capacity);
+        size_t capacity() const { return starts.size(); }
+        size_t slot(size_t index) const { return (head + index) % starts.size(); }
+        int64_t startAt(size_t index) const { return starts[slot(index)]; }
+        TimeBucket bucketAt(size_t index) const;
+        size_t lowerBound(int64_t start) const;
+        void merge(size_t index, double value);
+        void push(const TimeBucket& bucket);
+    };
+
+    /**
+     * @brief Merge a whole bucket into a coarser level
+     *
+     * Called with mutex_ held.
+     *
+     * @param level The level
+     * @param bucket The bucket
+     * @param width Width of the level's buckets in seconds
+     */
+    static void mergeBucket(Level& level, TimeBucket bucket, int64_t width);
+
+    /**
+     * @brief Append a completed hour to the archive
+     *
+     * Called with mutex_ held.
+     *
+     * @param bucket The hour
+     */
+    void archive(const TimeBucket& bucket);
+
+    /**
+     * @brief Read archived hours that start in a range
+     *
+     * Called with mutex_ held.
+     *
+     * @param from Start of the range in seconds, inclusive
+     * @param to End of the range in seconds, inclusive
+     * @param buckets Receives the hours, oldest first
+     */
+    void readArchive(int64_t from, int64_t to, std::vector<TimeBucket>& buckets) const;
+
+    /**
+     * @brief Get the start of the oldest bucket of a level, archive included
+     *
+     * Called with mutex_ held.
+     *
+     * @param index The level index
+     * @param start Receives the start
+     * @return true if the level has a bucket, false otherwise
+     */
+    bool getOldestStart(size_t index, int64_t& start) const;
+
+    // Member variables
+    std::array<Level, RESOLUTION_COUNT> levels_;
+    std::string archivePath_;                   // Empty without an archive
+    uint64_t archivedCount_ = 0;                // Whole records in the archive
+    int64_t firstArchivedStart_ = 0;
+    int64_t lastArchivedStart_ = 0;
+    mutable std::mutex mutex_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // TIME_SERIES_ROLLUP_H
@@ -0,0 +1,209 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief One finished span
+ */
+struct TraceEvent {
+    const char* name = nullptr;     // Static string, never copied
+    int64_t startNs = 0;            // Steady clock
+    int64_t durationNs = 0;
+};
+
+/**
+ * @brief Process-wide recorder of trace spans
+ *
+ * Spans are written to a ring buffer owned by the recording thread, so
+ * threads never contend with each other; each buffer keeps the latest
+ * EVENTS_PER_THREAD spans, the window an incident dump looks back over.
+ * Buffers outlive their threads until the next dump, at most
+ * MAX_EXITED_BUFFERS of them: beyond that a new thread takes over the
+ * oldest buffer of an exited thread, so short-lived threads do not
+ * grow the tracer between dumps. Recording is off
+ * until enabled at runtime, and the DM_TRACE_SPAN macro is compiled out
+ * entirely unless the build defines DM_ENABLE_TRACING.
+ *
+ * Dumps use the Chrome trace event format, opened in chrome://tracing
+ * or Perfetto.
+ */
+class Tracer {
+public:
+    /**
+     * @brief Get the singleton instance
+     *
+     * @return Tracer& The singleton instance
+     */
+    static Tracer& getInstance();
+
+    /**
+     * @brief Start or stop recording
+     *
+     * @param enabled True to record
+     */
+    void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * @brief Check if recording
+     *
+     * @return true if recording, false otherwise
+     */
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Record a finished span on the calling thread
+     *
+     * @param name The span name, a string literal
+     * @param startNs When it started, from nowNanoseconds()
+     * @param durationNs How long it took
+     */
+    void record(const char* name, int64_t startNs, int64_t durationNs);
+
+    /**
+     * @brief Name the calling thread in dumps
+     *
+     * @param name The name, a string literal
+     */
+    void setThreadName(const char* name);
+
+    /**
+     * @brief Write the recorded spans as Chrome trace JSON
+     *
+     * @param path The file path
+     * @return true if written, false otherwise
+     */
+    bool writeChromeTrace(const std::string& path);
+
+    /**
+     * @brief Get a steady clock reading for spans
+     *
+     * @return int64_t Nanoseconds
+     */
+    static int64_t nowNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Check if spans are compiled in
+     *
+     * @return true if built with DM_ENABLE_TRACING
+     */
+    static constexpr bool isCompiledIn() {
+#ifdef DM_ENABLE_TRACING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static constexpr size_t EVENTS_PER_THREAD = 16384;
+    static constexpr size_t MAX_EXITED_BUFFERS = 16;   // Kept for the next dump, about 6 MB
+
+private:
+    /**
+     * @brief Spans of one thread
+     */
+    struct ThreadBuffer {
+        std::vector<TraceEvent> events;     // Ring of EVENTS_PER_THREAD
+        size_t next = 0;                    // Slot the next span goes to
+        bool wrapped = false;
+        int threadId = 0;
+        const char* threadName = nullptr;
+        std::mutex mutex;                   // Only contended while dumping
+    };
+
+    /**
+     * @brief Construct a new Tracer
+     */
+    Tracer() = default;
+
+    // Prevent copying
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /**
+     * @brief Get the buffer of the calling thread, creating it on first use
+     *
+     * @return ThreadBuffer& The buffer
+     */
+    ThreadBuffer& localBuffer();
+
+    /**
+     * @brief Take over the buffer of the thread that exited first, if too many are kept
+     *
+     * Called with buffersMutex_ held.
+     *
+     * @return std::shared_ptr<ThreadBuffer> The emptied buffer, nullptr if none is taken
+     */
+    std::shared_ptr<ThreadBuffer> reuseExitedBuffer();
+
+    // Member variables
+    std::atomic<bool> enabled_{false};
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+    int nextThreadId_ = 1;
+    mutable std::mutex buffersMutex_;
+};
+
+/**
+ * @brief Records the scope it lives in as a span
+ */
+class TraceSpan {
+public:
+    /**
+     * @brief Start a span if recording
+     *
+     * @param name The span name, a string literal
+     */
+    explicit TraceSpan(const char* name)
+        : name_(name), startNs_(Tracer::getInstance().isEnabled() ? Tracer::nowNanoseconds() : 0) {
+    }
+
+    /**
+     * @brief Finish the span
+     */
+    ~TraceSpan() {
+        if (startNs_ > 0) {
+            Tracer::getInstance().record(name_, startNs_, Tracer::nowNanoseconds() - startNs_);
+        }
+    }
+
+    // Prevent copying
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    int64_t startNs_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#ifdef DM_ENABLE_TRACING
+#define DM_TRACE_CONCAT_INNER(a, b) a##b
+#define DM_TRACE_CONCAT(a, b) DM_TRACE_CONCAT_INNER(a, b)
+#define DM_TRACE_SPAN(name) ::dm::utils::TraceSpan DM_TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#define DM_TRACE_THREAD(name) \
+    do { \
+        if (::dm::utils::Tracer::getInstance().isEnabled()) { \
+            ::dm::utils::Tracer::getInstance().setThreadName(name); \
+        } \
+    } while (0)
+#else
+#define DM_TRACE_SPAN(name) ((void)0)
+#define DM_TRACE_THREAD(name) ((void)0)
+#endif
+
+#endif // TRACER_H
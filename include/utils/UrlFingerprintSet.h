@@ -0,0 +1,232 @@
+#ifndef URL_FINGERPRINT_SET_H
+#define URL_FINGERPRINT_SET_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+namespace dm {
+namespace utils {
+
+/**
+ * @brief Memory-compact set of seen URLs
+ *
+ * Stores a 64-bit fingerprint of each (already canonical) URL instead of
+ * the URL itself, in open-addressing tables of 11 to 22 bytes per URL.
+ * The set is split into shards with their own locks so crawler threads
+ * rarely contend.
+ *
+ * Without a memory limit and a spill directory the tables simply grow.
+ * With both, a shard whose table reaches its share of the limit writes
+ * the table out as a sorted run file and starts over, so the tables stay
+ * within the limit. A scalable Bloom filter over everything spilled
+ * answers most lookups of new URLs without touching the disk; only its
+ * positives are checked against the runs, through a sparse in-memory
+ * index that costs one block read per run. Those two still grow with
+ * the crawl, by 1.2 bytes or more per spilled URL for the filter and 8
+ * bytes per RUN_BLOCK_KEYS URLs for the index.
+ *
+ * Two URLs share a fingerprint with a chance of about 1 in 30 million at
+ * a million URLs; the later one is then taken as seen.
+ */
+class UrlFingerprintSet {
+public:
+    /**
+     * @brief Construct a new UrlFingerprintSet
+     *
+     * @param memoryLimit Bytes of tables before spilling, 0 for no limit
+     * @param spillDirectory Directory for run files, empty to never spill
+     */
+    explicit UrlFingerprintSet(size_t memoryLimit = 0, const std::string& spillDirectory = "");
+
+    /**
+     * @brief Destroy the UrlFingerprintSet, deleting its run files
+     */
+    ~UrlFingerprintSet();
+
+    /**
+     * @brief Add a URL
+     *
+     * @param url The canonical URL
+     * @return true if the URL was not in the set, false otherwise
+     */
+    bool insert(const std::string& url);
+
+    /**
+     * @brief Check if a URL is in the set
+     *
+     * @param url The canonical URL
+     * @return true if present, false otherwise
+     */
+    bool contains(const std::string& url) const;
+
+    /**
+     * @brief Remove every URL and delete the run files
+     */
+    void clear();
+
+    /**
+     * @brief Get the number of URLs in the set
+     *
+     * @return size_t The number of URLs
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the memory held by tables, Bloom filters and run indexes
+     *
+     * @return size_t The size in bytes
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * @brief Get the fingerprint of a URL
+     *
+     * @param url The URL
+     * @return uint64_t The fingerprint, never 0
+     */
+    static uint64_t fingerprint(const std::string& url);
+
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t INITIAL_SHARD_CAPACITY = 1024;     // Table slots, a power of two
+    static constexpr size_t RUN_BLOCK_KEYS = 512;              // Keys per indexed run block
+    static constexpr size_t MAX_RUNS_PER_SHARD = 4;            // More are merged into one
+    static constexpr double BLOOM_ERROR_RATE = 0.01;           // Of the first Bloom stage
+
+private:
+    /**
+     * @brief One stage of the scalable Bloom filter
+     */
+    struct BloomStage {
+        std::vector<uint64_t> bits;
+        uint64_t bitCount = 0;
+        int hashCount = 0;
+        size_t capacity = 0;
+        size_t count = 0;
+    };
+
+    /**
+     * @brief A sorted run of fingerprints on disk
+     */
+    struct Run {
+        std::string path;
+        std::FILE* file = nullptr;
+        uint64_t keyCount = 0;
+        std::vector<uint64_t> index;    // First key of each block
+    };
+
+    /**
+     * @brief One shard of the set
+     */
+    struct Shard {
+        mutable std::mutex mutex;
+        std::vector<uint64_t> table;    // 0 marks an empty slot
+        size_t tableCount = 0;
+        size_t spilledCount = 0;
+        std::vector<BloomStage> bloom;
+        std::vector<Run> runs;
+        size_t nextRunId = 0;
+    };
+
+    /**
+     * @brief Check a fingerprint, called with the shard's lock held
+     *
+     * @param shard The shard
+     * @param key The fingerprint
+     * @return true if present, false otherwise
+     */
+    bool containsLocked(const Shard& shard, uint64_t key) const;
+
+    /**
+     * @brief Add a fingerprint to a shard's table, growing or spilling it
+     *
+     * @param shard The shard
+     * @param shardIndex The shard's position, for run file names
+     * @param key The fingerprint
+     */
+    void addToTable(Shard& shard, size_t shardIndex, uint64_t key);
+
+    /**
+     * @brief Write a shard's table out as a sorted run
+     *
+     * @param shard The shard
+     * @param shardIndex The shard's position, for run file names
+     * @return true if successful, false otherwise
+     */
+    bool spill(Shard& shard, size_t shardIndex);
+
+    /**
+     * @brief Merge all runs of a shard into one
+     *
+     * @param shard The shard
+     * @param shardIndex The shard's position, for run file names
+     * @return true if successful, false otherwise
+     */
+    bool mergeRuns(Shard& shard, size_t shardIndex);
+
+    /**
+     * @brief Close and delete a run file
+     *
+     * @param run The run
+     */
+    static void removeRun(Run& run);
+
+    /**
+     * @brief Look a fingerprint up in a run
+     *
+     * @param run The run
+     * @param key The fingerprint
+     * @return true if present, false otherwise
+     */
+    static bool runContains(const Run& run, uint64_t key);
+
+    /**
+     * @brief Insert into an open-addressing table
+     *
+     * @param table The table, with a power-of-two size
+     * @param key The fingerprint
+     * @return true if inserted, false if already present
+     */
+    static bool tableInsert(std::vector<uint64_t>& table, uint64_t key);
+
+    /**
+     * @brief Look a fingerprint up in an open-addressing table
+     *
+     * @param table The table, with a power-of-two size
+     * @param key The fingerprint
+     * @return true if present, false otherwise
+     */
+    static bool tableContains(const std::vector<uint64_t>& table, uint64_t key);
+
+    /**
+     * @brief Add a fingerprint to a shard's Bloom filter
+     *
+     * @param shard The shard
+     * @param key The fingerprint
+     */
+    static void bloomAdd(Shard& shard, uint64_t key);
+
+    /**
+     * @brief Check a shard's Bloom filter
+     *
+     * @param shard The shard
+     * @param key The fingerprint
+     * @return true if the key may be present, false if it is not
+     */
+    static bool bloomMayContain(const Shard& shard, uint64_t key);
+
+    // Member variables
+    std::unique_ptr<Shard[]> shards_;
+    size_t shardMemoryLimit_;       // Table bytes per shard, 0 for no limit
+    std::string spillDirectory_;
+    std::string filePrefix_;
+};
+
+} // namespace utils
+} // namespace dm
+
+#endif // URL_FINGERPRINT_SET_H
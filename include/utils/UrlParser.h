@@ -2,6 +2,8 @@
 #define URL_PARSER_H
 
 #include <string>
+#include <string_view>
+#include <curl/curl.h>
 
 namespace dm {
 namespace utils {
@@ -25,6 +27,29 @@ struct UrlInfo {
     bool isValid() const { return !host.empty(); }
 };
 
+/**
+ * @brief Non-owning parsed URL
+ * 
+ * Each component is a slice of the parsed string, which must outlive the
+ * view. Delimiters are not part of the components, so the query has no
+ * '?' and the fragment no '#'; IPv6 hosts keep their brackets. Nothing is
+ * decoded, lowercased or defaulted.
+ */
+struct UrlView {
+    std::string_view scheme;      // empty if the URL has none
+    std::string_view username;
+    std::string_view password;
+    std::string_view host;
+    std::string_view port;        // empty if not given
+    std::string_view path;        // empty if not given
+    std::string_view query;
+    std::string_view fragment;
+    bool hasQuery = false;        // true for a '?' even with nothing after it
+    bool hasFragment = false;
+    
+    bool isValid() const { return !host.empty(); }
+};
+
 /**
  * @brief URL Parser class
  * 
@@ -40,6 +65,43 @@ public:
      */
     static UrlInfo parse(const std::string& url);
     
+    /**
+     * @brief Parse a URL without copying it
+     * 
+     * Does not allocate; use this where only a few components are read.
+     * 
+     * @param url The URL to parse
+     * @return UrlView Slices of url
+     */
+    static UrlView parseView(std::string_view url);
+    
+    /**
+     * @brief Extract the host of a URL for per-domain bookkeeping
+     * 
+     * The one domain extractor the engine uses; credentials, the port and
+     * IPv6 brackets are dropped and the host is lowercased.
+     * 
+     * @param url The URL
+     * @return std::string The host, or an empty string if there is none
+     */
+    static std::string extractDomain(std::string_view url);
+    
+    /**
+     * @brief Write the canonical form of a URL into a buffer
+     * 
+     * The scheme and host are lowercased, a default port is dropped, dot
+     * segments are removed from the path and an empty path becomes "/".
+     * The buffer is overwritten and its capacity reused, so canonicalizing
+     * many URLs into one buffer allocates only when a URL is longer than
+     * any before it. A URL without a scheme is taken as http.
+     * 
+     * @param url The URL
+     * @param out The buffer to write into
+     * @param keepFragment True to keep the fragment
+     * @return true if url has a host, false otherwise (out is cleared)
+     */
+    static bool canonicalize(std::string_view url, std::string& out, bool keepFragment = false);
+    
     /**
      * @brief Extract the filename from a URL
      * 
@@ -51,6 +113,9 @@ public:
     /**
      * @brief Normalize a URL (resolve relative paths, etc.)
      * 
+     * Same as canonicalize(), keeping the fragment, and returns url as
+     * given if it has no host.
+     * 
      * @param url The URL to normalize
      * @return std::string The normalized URL
      */
@@ -80,6 +145,28 @@ public:
      * @return std::string The combined URL
      */
     static std::string combine(const std::string& baseUrl, const std::string& relativeUrl);
+    
+    /**
+     * @brief Resolve a link against a base URL with libcurl
+     * 
+     * Only links to schemes the engine downloads (http, https, ftp, ftps)
+     * are kept, without their fragment.
+     * 
+     * @param baseUrl The base URL, empty for an absolute link
+     * @param link The link
+     * @return std::string The absolute URL, empty for anything else
+     */
+    static std::string resolve(const std::string& baseUrl, const std::string& link);
+    
+    /**
+     * @brief Read one part of a URL parsed by libcurl
+     * 
+     * @param handle The parsed URL
+     * @param part The part
+     * @param flags curl_url_get() flags, such as CURLU_URLDECODE
+     * @return std::string The part, empty if not present
+     */
+    static std::string getPart(CURLU* handle, CURLUPart part, unsigned int flags = 0);
 };
 
 } // namespace utils
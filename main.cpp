@@ -1,6 +1,12 @@
 #include "core/DownloadManager.h"
+#include "core/RpcClient.h"
+#include "core/RpcServer.h"
 #include "include/ui/MainWindow.h"
+#include "include/utils/FileUtils.h"
 #include "include/utils/Logger.h"
+#include "include/utils/StartupTimer.h"
+#include "include/utils/Tracer.h"
+#include "include/utils/UrlParser.h"
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QDir>
@@ -13,6 +19,21 @@
 #include <QTimer>
 #include <QTranslator>
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <csignal>
+#include <pthread.h>
+#endif
+
+// Where spans recorded with --trace are written on exit, empty if not tracing
+static std::string traceFile;
+
 /**
  * @brief Initialize the application
  *
@@ -32,6 +53,7 @@ bool initializeApplication() {
 
   // Initialize logger
   try {
+    dm::utils::StartupStage stage("logger");
     dm::utils::Logger::initialize(appDataDir.filePath("log.txt").toStdString());
   } catch (const std::exception &e) {
     QMessageBox::warning(
@@ -43,7 +65,8 @@ bool initializeApplication() {
   // Log application start
   dm::utils::Logger::info("Application starting...");
 
-  // Initialize download manager
+  // Initialize download manager, saved tasks keep loading in the background
+  dm::utils::StartupStage stage("download manager");
   if (!dm::core::DownloadManager::getInstance().initialize()) {
     QMessageBox::critical(nullptr, "Error",
                           "Failed to initialize download manager.");
@@ -63,6 +86,11 @@ void cleanupApplication() {
   // Shutdown download manager
   dm::core::DownloadManager::getInstance().shutdown();
 
+  // Dump the trace once the workers have finished their spans
+  if (!traceFile.empty()) {
+    dm::utils::Tracer::getInstance().writeChromeTrace(traceFile);
+  }
+
   // Log application exit
   dm::utils::Logger::info("Application exiting...");
 
@@ -70,6 +98,202 @@ void cleanupApplication() {
   dm::utils::Logger::shutdown();
 }
 
+/**
+ * @brief Run the download manager headless, serving clients until told to stop
+ *
+ * @param socketPath The socket to listen on
+ * @return int Exit code
+ */
+int runDaemon(const std::string &socketPath) {
+#ifndef _WIN32
+  // SIGINT and SIGTERM are taken by one thread, blocked before any other
+  // thread starts so none of them is interrupted
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+
+  std::string appDataDir = dm::utils::FileUtils::getAppDataDirectory();
+  dm::utils::FileUtils::createDirectory(appDataDir);
+  try {
+    dm::utils::Logger::initialize(
+        dm::utils::FileUtils::combinePaths(appDataDir, "daemon.log"));
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to initialize logger: " << e.what() << std::endl;
+  }
+  dm::utils::Logger::info("Daemon starting...");
+
+  auto &downloadManager = dm::core::DownloadManager::getInstance();
+  if (!downloadManager.initialize()) {
+    std::cerr << "Failed to initialize download manager." << std::endl;
+    dm::utils::Logger::shutdown();
+    return 1;
+  }
+
+  dm::core::RpcServer server(downloadManager);
+  if (!server.start(socketPath)) {
+    std::cerr << "Failed to listen on " << socketPath << std::endl;
+    downloadManager.shutdown();
+    dm::utils::Logger::shutdown();
+    return 1;
+  }
+
+#ifndef _WIN32
+  std::thread signalThread([&server, signals]() {
+    int received = 0;
+    sigwait(&signals, &received);
+    server.requestShutdown();
+  });
+#endif
+
+  server.waitForShutdown();
+  server.stop();
+
+#ifndef _WIN32
+  // Releases the signal thread when a client asked for the shutdown
+  pthread_kill(signalThread.native_handle(), SIGTERM);
+  signalThread.join();
+#endif
+
+  downloadManager.saveTasks();
+  downloadManager.shutdown();
+  dm::utils::Logger::info("Daemon exiting...");
+  dm::utils::Logger::shutdown();
+  return 0;
+}
+
+/**
+ * @brief Read downloads to submit, one per line
+ *
+ * A line is a URL, optionally followed by a tab and the destination path
+ * and another tab and the filename. Blank lines and lines starting with #
+ * are skipped.
+ *
+ * @param input The input
+ * @return std::vector<dm::core::RpcDownload> The downloads
+ */
+std::vector<dm::core::RpcDownload> readDownloads(std::istream &input) {
+  std::vector<dm::core::RpcDownload> downloads;
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    dm::core::RpcDownload download;
+    std::istringstream fields(line);
+    std::getline(fields, download.url, '\t');
+    std::getline(fields, download.destinationPath, '\t');
+    std::getline(fields, download.filename, '\t');
+    dm::utils::UrlView url = dm::utils::UrlParser::parseView(download.url);
+    if (url.isValid() && !url.scheme.empty()) {
+      downloads.push_back(std::move(download));
+    } else {
+      std::cerr << "Skipping invalid URL: " << download.url << std::endl;
+    }
+  }
+  return downloads;
+}
+
+/**
+ * @brief Run a command against a running daemon
+ *
+ * Submits, lists, controls or watches downloads through the daemon
+ * without starting the engine in this process.
+ *
+ * @param command The command flag
+ * @param argument The command argument, if it takes one
+ * @param socketPath The daemon socket
+ * @return int Exit code
+ */
+int runDaemonCommand(const std::string &command, const std::string &argument,
+                     const std::string &socketPath) {
+  dm::core::RpcClient client;
+  if (!client.connect(socketPath)) {
+    std::cerr << client.getError() << std::endl;
+    return 1;
+  }
+
+  bool success = true;
+  if (command == "--submit") {
+    std::vector<dm::core::RpcDownload> downloads;
+    if (argument == "-") {
+      downloads = readDownloads(std::cin);
+    } else {
+      std::ifstream file(argument);
+      if (!file) {
+        std::cerr << "Failed to open " << argument << std::endl;
+        return 1;
+      }
+      downloads = readDownloads(file);
+    }
+
+    std::vector<std::string> ids;
+    success = client.addDownloads(downloads, true, ids);
+    size_t added = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+      if (ids[i].empty()) {
+        std::cerr << "Failed to add " << downloads[i].url << std::endl;
+      } else {
+        std::cout << ids[i] << '\n';
+        added++;
+      }
+    }
+    std::cerr << "Added " << added << " of " << downloads.size()
+              << " downloads" << std::endl;
+  } else if (command == "--list") {
+    std::vector<dm::core::RpcTaskSummary> tasks;
+    success = client.listTasks(tasks);
+    for (const auto &task : tasks) {
+      std::cout << task.id << '\t' << static_cast<int>(task.status) << '\t'
+                << task.downloadedBytes << '/' << task.totalBytes << '\t'
+                << task.url << '\n';
+    }
+  } else if (command == "--pause-all" || command == "--resume-all") {
+    // Bulk operations are one list and one batched control round trip,
+    // downloads that cannot be paused or resumed are skipped by the daemon
+    bool pause = command == "--pause-all";
+    std::vector<dm::core::RpcTaskSummary> tasks;
+    std::vector<std::string> ids;
+    std::vector<bool> results;
+    success = client.listTasks(tasks);
+    for (const auto &task : tasks) {
+      ids.push_back(task.id);
+    }
+    success = success &&
+              client.control(pause ? dm::core::RpcControl::PAUSE
+                                   : dm::core::RpcControl::RESUME,
+                             ids, results);
+    std::cerr << (pause ? "Paused " : "Resumed ")
+              << std::count(results.begin(), results.end(), true)
+              << " downloads" << std::endl;
+  } else if (command == "--watch") {
+    success = client.subscribe(
+        1000, [](dm::core::RpcEventKind kind,
+                 const dm::core::RpcTaskSummary &task) {
+          std::cout << (kind == dm::core::RpcEventKind::STATUS ? "status"
+                                                               : "progress")
+                    << '\t' << task.id << '\t' << static_cast<int>(task.status)
+                    << '\t' << task.downloadedBytes << '/' << task.totalBytes
+                    << '\t' << task.speed << " B/s" << std::endl;
+          return true;
+        });
+  } else if (command == "--stop-daemon") {
+    success = client.shutdownDaemon();
+  }
+
+  if (!success) {
+    std::cerr << client.getError() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
 /**
  * @brief Main function
  *
@@ -78,6 +302,35 @@ void cleanupApplication() {
  * @return int Exit code
  */
 int main(int argc, char *argv[]) {
+  // The daemon and its client commands run without the GUI
+  std::string socketPath = dm::core::RpcChannel::getDefaultSocketPath();
+  std::string daemonCommand;
+  std::string daemonArgument;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--submit") == 0 && i + 1 < argc) {
+      daemonCommand = argv[i];
+      daemonArgument = argv[++i];
+    } else if (std::strcmp(argv[i], "--daemon") == 0 ||
+               std::strcmp(argv[i], "--list") == 0 ||
+               std::strcmp(argv[i], "--pause-all") == 0 ||
+               std::strcmp(argv[i], "--resume-all") == 0 ||
+               std::strcmp(argv[i], "--watch") == 0 ||
+               std::strcmp(argv[i], "--stop-daemon") == 0) {
+      daemonCommand = argv[i];
+    }
+  }
+  if (daemonCommand == "--daemon") {
+    return runDaemon(socketPath);
+  }
+  if (!daemonCommand.empty()) {
+    return runDaemonCommand(daemonCommand, daemonArgument, socketPath);
+  }
+
+  // Startup timings are measured from here
+  dm::utils::StartupTimer::getInstance();
+
   // Set application attributes
   QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
   QApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
@@ -98,6 +351,24 @@ int main(int argc, char *argv[]) {
   parser.addHelpOption();
   parser.addVersionOption();
   parser.addOption(QCommandLineOption("url", "URL to download", "url"));
+  parser.addOption(QCommandLineOption(
+      "trace", "Record trace spans and write them to file on exit", "file"));
+  // Handled before the application is created, listed for --help
+  parser.addOption(QCommandLineOption(
+      "daemon", "Run headless, serving downloads to client commands"));
+  parser.addOption(QCommandLineOption(
+      "submit", "Add downloads listed in file (- for stdin) to the daemon",
+      "file"));
+  parser.addOption(QCommandLineOption("list", "List the daemon's downloads"));
+  parser.addOption(
+      QCommandLineOption("pause-all", "Pause the daemon's active and queued downloads"));
+  parser.addOption(
+      QCommandLineOption("resume-all", "Resume the daemon's paused downloads"));
+  parser.addOption(
+      QCommandLineOption("watch", "Print the daemon's download events"));
+  parser.addOption(QCommandLineOption("stop-daemon", "Shut the daemon down"));
+  parser.addOption(
+      QCommandLineOption("socket", "Daemon socket to use", "path"));
   parser.process(app);
 
   // Create splash screen
@@ -108,6 +379,8 @@ int main(int argc, char *argv[]) {
     splashPixmap.fill(Qt::white);
   }
 
+  dm::utils::StartupTimer::getInstance().markMilestone("application created");
+
   QSplashScreen splash(splashPixmap);
   splash.show();
   app.processEvents();
@@ -133,28 +406,49 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  // Start recording spans if asked to
+  if (parser.isSet("trace")) {
+    if (!dm::utils::Tracer::isCompiledIn()) {
+      dm::utils::Logger::warning(
+          "Tracing requested but this build has no trace spans, "
+          "configure with -DDM_ENABLE_TRACING=ON");
+    }
+    traceFile = parser.value("trace").toStdString();
+    dm::utils::Tracer::getInstance().setEnabled(true);
+  }
+
   // Create main window
   splash.showMessage("Creating user interface...",
                      Qt::AlignBottom | Qt::AlignHCenter, Qt::black);
   app.processEvents();
 
+  auto windowStart = std::chrono::steady_clock::now();
   dm::ui::MainWindow mainWindow;
+  dm::utils::StartupTimer::getInstance().recordStage(
+      "main window", windowStart, std::chrono::steady_clock::now());
 
   // Clean up on exit
   QObject::connect(&app, &QApplication::aboutToQuit, &cleanupApplication);
 
-  // Show the main window
+  // Show the main window, saved downloads are listed as they finish loading
   mainWindow.show();
   splash.finish(&mainWindow);
+  dm::utils::StartupTimer::getInstance().markMilestone("window shown");
 
-  // Process URL from command line if provided
+  // Process URL from command line if provided, without waiting here for
+  // saved tasks to load
+  auto &downloadManager = dm::core::DownloadManager::getInstance();
   if (parser.isSet("url")) {
-    QString url = parser.value("url");
-    if (!url.isEmpty()) {
-      dm::core::DownloadManager::getInstance().addDownload(url.toStdString());
+    std::string url = parser.value("url").toStdString();
+    if (!url.empty()) {
+      downloadManager.whenTasksLoaded(
+          [url]() { dm::core::DownloadManager::getInstance().addDownload(url); });
     }
   }
 
+  downloadManager.whenTasksLoaded(
+      []() { dm::utils::StartupTimer::getInstance().logReport(); });
+
   // Run the application
   return app.exec();
 }
\ No newline at end of file
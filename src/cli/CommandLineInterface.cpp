@@ -1,9 +1,20 @@
 #include "../../include/cli/CommandLineInterface.h"
 #include "../../include/utils/Logger.h"
 #include "../../include/utils/StringUtils.h"
+#include "../../include/utils/ResourceMonitor.h"
+#include "../../include/utils/Tracer.h"
+#include "../../include/core/CurlHandlePool.h"
+#include "../../include/core/DataFilter.h"
 #include "../../include/core/DownloadManager.h"
 #include "../../include/core/BatchDownloader.h"
 #include "../../include/core/WebsiteCrawler.h"
+#include "../../include/core/LinkStats.h"
+#include "../../include/core/StreamDownloader.h"
+#include "../../include/core/DeviceIoScheduler.h"
+#include "../../include/core/DiskSpaceLedger.h"
+#include "../../include/core/ProxyPool.h"
+#include "../../include/core/ClusterCoordinator.h"
+#include "../../include/core/PeerCache.h"
 
 #include <iostream>
 #include <sstream>
@@ -11,6 +22,8 @@
 #include <chrono>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
+#include <condition_variable>
 
 namespace DownloadManager {
 namespace CLI {
@@ -212,6 +225,51 @@ void CommandLineInterface::registerCommands() {
         cmdProgress(args);
     };
     
+    // Resources command
+    m_commands["resources"] = [this](const std::vector<std::string>& args) {
+        cmdResources(args);
+    };
+    
+    // Trace command
+    m_commands["trace"] = [this](const std::vector<std::string>& args) {
+        cmdTrace(args);
+    };
+    
+    // Plugins command
+    m_commands["plugins"] = [this](const std::vector<std::string>& args) {
+        cmdPlugins(args);
+    };
+    
+    // TLS command
+    m_commands["tls"] = [this](const std::vector<std::string>& args) {
+        cmdTls(args);
+    };
+    
+    // Media stream command
+    m_commands["media"] = [this](const std::vector<std::string>& args) {
+        cmdMedia(args);
+    };
+    
+    // Disks command
+    m_commands["disks"] = [this](const std::vector<std::string>& args) {
+        cmdDisks(args);
+    };
+    
+    // Proxies command
+    m_commands["proxies"] = [this](const std::vector<std::string>& args) {
+        cmdProxies(args);
+    };
+    
+    // Cluster command
+    m_commands["cluster"] = [this](const std::vector<std::string>& args) {
+        cmdCluster(args);
+    };
+    
+    // Peers command
+    m_commands["peers"] = [this](const std::vector<std::string>& args) {
+        cmdPeers(args);
+    };
+    
     // Quit command
     m_commands["quit"] = [this](const std::vector<std::string>& args) {
         cmdQuit(args);
@@ -346,6 +404,15 @@ void CommandLineInterface::cmdHelp(const std::vector<std::string>& args) {
         std::cout << "  crawl <url> [options]       - Crawl a website for downloads" << std::endl;
         std::cout << "  settings [key] [value]      - View or change settings" << std::endl;
         std::cout << "  progress <on|off>           - Turn progress display on or off" << std::endl;
+        std::cout << "  resources                   - Show memory, file and thread usage" << std::endl;
+        std::cout << "  trace <on|off|dump <file>>  - Record trace spans or write them out" << std::endl;
+        std::cout << "  plugins                     - Show the time plugin data filters take" << std::endl;
+        std::cout << "  tls                         - Show TLS handshake times per host" << std::endl;
+        std::cout << "  media <url> <file>          - Download an HLS or DASH stream" << std::endl;
+        std::cout << "  disks                       - Show write queues and reserved space per device" << std::endl;
+        std::cout << "  proxies                     - Show the load and health of each proxy" << std::endl;
+        std::cout << "  cluster                     - Show the nodes sharing the downloads and their speed" << std::endl;
+        std::cout << "  peers                       - Show the managers on the LAN sharing their downloads" << std::endl;
         std::cout << "  quit                        - Exit the program" << std::endl;
     } 
     else {
@@ -402,6 +469,8 @@ void CommandLineInterface::cmdHelp(const std::vector<std::string>& args) {
             std::cout << "Process batch downloads" << std::endl;
             std::cout << "Commands:" << std::endl;
             std::cout << "  add <file>               - Add URLs from a text file" << std::endl;
+            std::cout << "  stream <file|->          - Download a URL list as it is read (- for stdin)" << std::endl;
+            std::cout << "                             Memory stays bounded however long the list is" << std::endl;
             std::cout << "  pattern <url> <start> <end> [step] [padding]" << std::endl;
             std::cout << "                           - Generate URLs from a pattern" << std::endl;
             std::cout << "                             Use {$PATTERN} as placeholder in URL" << std::endl;
@@ -412,6 +481,8 @@ void CommandLineInterface::cmdHelp(const std::vector<std::string>& args) {
             std::cout << "Options:" << std::endl;
             std::cout << "  -d, --dir <directory>    - Specify destination directory" << std::endl;
             std::cout << "  -c, --concurrent <num>   - Max concurrent downloads (default: 3)" << std::endl;
+            std::cout << "  --csv <column>           - Stream: read URLs from a CSV column" << std::endl;
+            std::cout << "  --spill <directory>      - Stream: keep seen URLs on disk past 64 MB" << std::endl;
         } 
         else if (command == "crawl") {
             std::cout << "Usage: crawl <url> [options]" << std::endl;
@@ -446,6 +517,53 @@ void CommandLineInterface::cmdHelp(const std::vector<std::string>& args) {
             std::cout << "Usage: progress <on|off>" << std::endl;
             std::cout << "Turn progress display on or off" << std::endl;
         } 
+        else if (command == "resources") {
+            std::cout << "Usage: resources" << std::endl;
+            std::cout << "Show the process memory, open files, threads and allocation counters" << std::endl;
+        } 
+        else if (command == "trace") {
+            std::cout << "Usage: trace <on|off|dump <file>>" << std::endl;
+            std::cout << "Record spans of requests, segments, writes and hashing, or write the" << std::endl;
+            std::cout << "latest ones to a Chrome trace file for chrome://tracing or Perfetto" << std::endl;
+        } 
+        else if (command == "plugins") {
+            std::cout << "Usage: plugins" << std::endl;
+            std::cout << "Show the calls, wall and CPU time of each plugin data filter, the calls" << std::endl;
+            std::cout << "over plugin_call_budget and the downloads it was moved to a worker in" << std::endl;
+        } 
+        else if (command == "tls") {
+            std::cout << "Usage: tls" << std::endl;
+            std::cout << "Show the TLS handshakes made with each host, how long they took and the" << std::endl;
+            std::cout << "transfers that reused a connection instead, and the preferred cipher" << std::endl;
+        } 
+        else if (command == "media") {
+            std::cout << "Usage: media <manifest-url> <file> [--window n] [--max-bandwidth bps]" << std::endl;
+            std::cout << "Download the segments of an m3u8 playlist or MPD, n at a time, and join" << std::endl;
+            std::cout << "them into <file>; further tracks go next to it. Rerun to resume" << std::endl;
+        } 
+        else if (command == "disks") {
+            std::cout << "Usage: disks" << std::endl;
+            std::cout << "Show each storage device downloads are written to, its kind, writers," << std::endl;
+            std::cout << "queued writes, recent throughput and whether it is saturated, then the" << std::endl;
+            std::cout << "free space of each file system and the space started downloads reserve" << std::endl;
+        } 
+        else if (command == "proxies") {
+            std::cout << "Usage: proxies" << std::endl;
+            std::cout << "Show each proxy of the pool (proxy_pool), its connections against its cap," << std::endl;
+            std::cout << "the downloads stuck to it, its measured latency, throughput and score, and" << std::endl;
+            std::cout << "whether it is ejected" << std::endl;
+        } 
+        else if (command == "cluster") {
+            std::cout << "Usage: cluster" << std::endl;
+            std::cout << "Show each node sharing the cluster directory (cluster_directory), its" << std::endl;
+            std::cout << "download speed, the batch items and pieces it holds and has finished," << std::endl;
+            std::cout << "and the aggregate speed of the nodes still reporting" << std::endl;
+        } 
+        else if (command == "peers") {
+            std::cout << "Usage: peers" << std::endl;
+            std::cout << "Show the managers on the LAN found over mDNS or listed in peer_cache_peers," << std::endl;
+            std::cout << "the downloads shared from here (peer_cache) and the bytes served to them" << std::endl;
+        } 
         else if (command == "quit" || command == "exit") {
             std::cout << "Usage: quit" << std::endl;
             std::cout << "Exit the program" << std::endl;
@@ -1018,6 +1136,81 @@ void CommandLineInterface::cmdBatch(const std::vector<std::string>& args) {
             std::cout << "Failed to add batch URLs from file" << std::endl;
         }
     } 
+    else if (command == "stream") {
+        if (args.size() < 2) {
+            std::cout << "Error: File path required" << std::endl;
+            std::cout << "Usage: batch stream <file|-> [options]" << std::endl;
+            return;
+        }
+        
+        dm::core::BatchDownloadConfig config;
+        config.sourceUrl = args[1];
+        config.sourceType = dm::core::BatchUrlSourceType::TEXT_FILE;
+        config.streamSource = true;
+        config.maxConcurrentFiles = 3;
+        
+        // Parse options
+        for (size_t i = 2; i < args.size(); i++) {
+            if ((args[i] == "-d" || args[i] == "--dir") && i + 1 < args.size()) {
+                config.destinationDirectory = args[++i];
+            }
+            else if ((args[i] == "-c" || args[i] == "--concurrent") && i + 1 < args.size()) {
+                try {
+                    config.maxConcurrentFiles = std::max(1, std::stoi(args[++i]));
+                } catch (...) {
+                    std::cout << "Warning: Invalid concurrent downloads value" << std::endl;
+                }
+            }
+            else if (args[i] == "--csv" && i + 1 < args.size()) {
+                config.sourceType = dm::core::BatchUrlSourceType::CSV_FILE;
+                config.urlColumnName = args[++i];
+            }
+            else if (args[i] == "--spill" && i + 1 < args.size()) {
+                config.spillDirectory = args[++i];
+                config.maxUrlMemory = 64 * 1024 * 1024;
+            }
+        }
+        
+        // The job reads the list while it downloads, so wait for it here
+        std::mutex doneMutex;
+        std::condition_variable doneChanged;
+        bool done = false;
+        dm::core::BatchDownloader streamDownloader(dm::core::DownloadManager::getInstance());
+        
+        auto finish = [&]() {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done = true;
+            doneChanged.notify_all();
+        };
+        
+        bool started = streamDownloader.startBatchJob(config,
+            [this](int processed, int total, double, int succeeded, int failed) {
+                if (m_showProgress) {
+                    std::cout << "\rProcessed " << processed << " of " << total << " read ("
+                              << succeeded << " succeeded, " << failed << " failed)" << std::flush;
+                }
+            },
+            [&](int succeeded, int failed, const std::vector<std::string>& failedUrls) {
+                std::cout << std::endl << "Batch stream finished: " << succeeded << " succeeded, "
+                          << failed << " failed" << std::endl;
+                for (const auto& failedUrl : failedUrls) {
+                    std::cout << "  Failed: " << failedUrl << std::endl;
+                }
+                finish();
+            },
+            [&](const std::string& error) {
+                std::cout << "Error: " << error << std::endl;
+                finish();
+            });
+        
+        if (!started) {
+            std::cout << "Failed to start batch stream" << std::endl;
+            return;
+        }
+        
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneChanged.wait(lock, [&done]() { return done; });
+    } 
     else if (command == "pattern") {
         if (args.size() < 4) {
             std::cout << "Error: Pattern URL, start, and end values required" << std::endl;
@@ -1164,7 +1357,7 @@ void CommandLineInterface::cmdBatch(const std::vector<std::string>& args) {
     } 
     else {
         std::cout << "Unknown batch command: " << command << std::endl;
-        std::cout << "Valid commands: add, pattern, list, start, stop, clear" << std::endl;
+        std::cout << "Valid commands: add, stream, pattern, list, start, stop, clear" << std::endl;
     }
 }
 
@@ -1462,6 +1655,308 @@ void CommandLineInterface::cmdProgress(const std::vector<std::string>& args) {
     }
 }
 
+void CommandLineInterface::cmdResources(const std::vector<std::string>& args) {
+    auto& monitor = dm::utils::ResourceMonitor::getInstance();
+    
+    // Without the sampler thread the numbers would never be filled in
+    if (!monitor.isRunning()) {
+        monitor.sampleNow();
+    }
+    dm::utils::ResourceUsage usage = monitor.getUsage();
+    
+    std::cout << "Resident memory: " << formatSize(usage.residentBytes)
+              << " (peak " << formatSize(usage.peakResidentBytes) << ")" << std::endl;
+    std::cout << "Virtual memory:  " << formatSize(usage.virtualBytes) << std::endl;
+    std::cout << "Open files:      " << usage.openFiles << std::endl;
+    std::cout << "Threads:         " << usage.threadCount << std::endl;
+    std::cout << std::endl;
+    
+    std::cout << std::left << std::setw(16) << "Subsystem" << std::right
+              << std::setw(10) << "Live" << std::setw(14) << "Bytes" << std::setw(14) << "Allocated" << std::endl;
+    std::cout << std::string(54, '-') << std::endl;
+    
+    for (int i = 0; i < static_cast<int>(dm::utils::ResourceSubsystem::COUNT); i++) {
+        auto subsystem = static_cast<dm::utils::ResourceSubsystem>(i);
+        dm::utils::SubsystemUsage counters = monitor.getSubsystemUsage(subsystem);
+        std::cout << std::left << std::setw(16) << dm::utils::ResourceMonitor::getSubsystemName(subsystem) << std::right
+                  << std::setw(10) << counters.liveObjects
+                  << std::setw(14) << formatSize(counters.liveBytes)
+                  << std::setw(14) << counters.totalAllocations << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdTrace(const std::vector<std::string>& args) {
+    auto& tracer = dm::utils::Tracer::getInstance();
+    
+    if (!dm::utils::Tracer::isCompiledIn()) {
+        std::cout << "This build has no trace spans, configure with -DDM_ENABLE_TRACING=ON" << std::endl;
+        return;
+    }
+    
+    if (args.empty()) {
+        std::cout << "Tracing is currently " << (tracer.isEnabled() ? "ON" : "OFF") << std::endl;
+        std::cout << "Usage: trace <on|off|dump <file>>" << std::endl;
+        return;
+    }
+    
+    std::string option = Utils::StringUtils::toLower(args[0]);
+    
+    if (option == "on") {
+        tracer.setEnabled(true);
+        std::cout << "Tracing turned ON" << std::endl;
+    } 
+    else if (option == "off") {
+        tracer.setEnabled(false);
+        std::cout << "Tracing turned OFF" << std::endl;
+    } 
+    else if (option == "dump" && args.size() > 1) {
+        if (tracer.writeChromeTrace(args[1])) {
+            std::cout << "Trace written to " << args[1] << std::endl;
+        } else {
+            std::cout << "Failed to write trace to " << args[1] << std::endl;
+        }
+    } 
+    else {
+        std::cout << "Invalid option: " << option << std::endl;
+        std::cout << "Usage: trace <on|off|dump <file>>" << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdPlugins(const std::vector<std::string>& args) {
+    std::vector<dm::core::DataFilterStats> filters = dm::core::DataFilterRegistry::getInstance().getStats();
+    if (filters.empty()) {
+        std::cout << "No plugin data filters" << std::endl;
+        return;
+    }
+    
+    std::cout << std::left << std::setw(20) << "Filter" << std::right
+              << std::setw(10) << "Calls" << std::setw(12) << "Data" << std::setw(12) << "Avg ms"
+              << std::setw(12) << "Max ms" << std::setw(12) << "CPU ms" << std::setw(8) << "Slow"
+              << std::setw(11) << "Offloaded" << std::endl;
+    std::cout << std::string(97, '-') << std::endl;
+    
+    for (const auto& filter : filters) {
+        double average = filter.calls > 0 ? filter.wallNanoseconds / 1e6 / filter.calls : 0.0;
+        std::cout << std::left << std::setw(20) << filter.id << std::right
+                  << std::setw(10) << filter.calls
+                  << std::setw(12) << formatSize(filter.bytes)
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(12) << average
+                  << std::setw(12) << filter.maxCallNanoseconds / 1e6
+                  << std::setprecision(1)
+                  << std::setw(12) << filter.cpuNanoseconds / 1e6
+                  << std::setw(8) << filter.slowCalls
+                  << std::setw(11) << filter.offloadedSessions << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdTls(const std::vector<std::string>& args) {
+    std::cout << "Preferred cipher: " << dm::core::CurlHandlePool::getCipherPreference() << std::endl;
+    
+    std::vector<dm::core::HostHandshakeStats> hosts = dm::core::LinkStats::getInstance().getHandshakeStats();
+    if (hosts.empty()) {
+        std::cout << "No TLS transfers" << std::endl;
+        return;
+    }
+    
+    std::cout << std::left << std::setw(32) << "Host" << std::right
+              << std::setw(12) << "Handshakes" << std::setw(10) << "Reused" << std::setw(12) << "Mean ms"
+              << std::setw(12) << "Min ms" << std::setw(12) << "Max ms" << std::endl;
+    std::cout << std::string(90, '-') << std::endl;
+    
+    for (const auto& host : hosts) {
+        std::cout << std::left << std::setw(32) << host.host << std::right
+                  << std::setw(12) << host.handshakes
+                  << std::setw(10) << host.reusedConnections
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(12) << host.meanMs
+                  << std::setw(12) << host.minMs
+                  << std::setw(12) << host.maxMs << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdMedia(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Error: Manifest URL and file required" << std::endl;
+        std::cout << "Usage: media <manifest-url> <file> [--window n] [--max-bandwidth bps]" << std::endl;
+        return;
+    }
+    
+    dm::core::StreamDownloadOptions options;
+    for (size_t i = 2; i < args.size(); i++) {
+        try {
+            if (args[i] == "--window" && i + 1 < args.size()) {
+                options.maxSegmentsInFlight = std::stoi(args[++i]);
+            } 
+            else if (args[i] == "--max-bandwidth" && i + 1 < args.size()) {
+                options.maxBandwidth = std::stoll(args[++i]);
+            }
+        } catch (...) {
+            std::cout << "Warning: Invalid value for " << args[i - 1] << std::endl;
+        }
+    }
+    
+    // Segments are fetched on the engine thread, wait for the last one here
+    dm::core::StreamDownloader streamDownloader;
+    bool started = streamDownloader.start(args[0], args[1], options,
+        [this](int written, int total, int64_t bytes) {
+            if (m_showProgress) {
+                std::cout << "\rSegment " << written << " of " << total << " ("
+                          << formatSize(bytes) << ")" << std::flush;
+            }
+        });
+    if (!started) {
+        std::cout << "Failed to start stream download" << std::endl;
+        return;
+    }
+    
+    if (streamDownloader.wait()) {
+        std::cout << std::endl << "Stream downloaded:" << std::endl;
+        for (const auto& file : streamDownloader.getOutputFiles()) {
+            std::cout << "  " << file << std::endl;
+        }
+    } else {
+        std::cout << std::endl << "Error: " << streamDownloader.getError() << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdDisks(const std::vector<std::string>& args) {
+    dm::core::DeviceIoScheduler& scheduler = dm::core::DeviceIoScheduler::getInstance();
+    std::vector<dm::core::StorageDeviceStats> devices = scheduler.getStats();
+    if (!scheduler.isEnabled()) {
+        std::cout << "Device I/O scheduling is off (device_io_scheduling)" << std::endl;
+    } else if (devices.empty()) {
+        std::cout << "No writes queued yet" << std::endl;
+    } else {
+        std::cout << std::left << std::setw(16) << "Device" << std::setw(20) << "Mount" << std::setw(9) << "Kind"
+                  << std::right << std::setw(9) << "Writers" << std::setw(8) << "Queued"
+                  << std::setw(12) << "Written" << std::setw(12) << "Speed/s" << std::setw(10) << "Wait ms" << std::endl;
+        std::cout << std::string(96, '-') << std::endl;
+        
+        for (const auto& device : devices) {
+            std::ostringstream writers;
+            writers << device.activeWriters << "/" << device.maxWriters;
+            std::cout << std::left << std::setw(16) << device.info.name
+                      << std::setw(20) << device.info.mountPoint
+                      << std::setw(9) << dm::core::DeviceIoScheduler::getKindName(device.info.kind)
+                      << std::right << std::setw(9) << writers.str()
+                      << std::setw(8) << device.queuedRequests
+                      << std::setw(12) << formatSize(device.bytesWritten)
+                      << std::setw(12) << formatSize(static_cast<int64_t>(device.throughput))
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(10) << device.queueWaitMs
+                      << (device.saturated ? "  saturated" : "") << std::endl;
+        }
+    }
+    
+    std::vector<dm::core::DiskSpaceStats> volumes = dm::core::DiskSpaceLedger::getInstance().getStats();
+    if (volumes.empty()) {
+        return;
+    }
+    
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(36) << "Space at" << std::right
+              << std::setw(12) << "Free" << std::setw(12) << "Reserved" << std::setw(10) << "Holders"
+              << std::setw(10) << "Refused" << std::endl;
+    std::cout << std::string(80, '-') << std::endl;
+    
+    for (const auto& volume : volumes) {
+        std::cout << std::left << std::setw(36) << volume.path << std::right
+                  << std::setw(12) << (volume.freeBytes < 0 ? std::string("?") : formatSize(volume.freeBytes))
+                  << std::setw(12) << formatSize(volume.reservedBytes)
+                  << std::setw(10) << volume.reservations
+                  << std::setw(10) << volume.refusals << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdProxies(const std::vector<std::string>& args) {
+    dm::core::ProxyPool& pool = dm::core::ProxyPool::getInstance();
+    if (!pool.isEnabled()) {
+        std::cout << "No proxies configured (proxy_pool)" << std::endl;
+        return;
+    }
+    
+    std::cout << "Assignment: " << dm::core::ProxyPool::getAssignmentName(pool.getAssignment()) << std::endl;
+    std::cout << std::left << std::setw(32) << "Proxy" << std::right
+              << std::setw(8) << "Conns" << std::setw(8) << "Owners" << std::setw(8) << "Weight"
+              << std::setw(10) << "Latency" << std::setw(12) << "Speed/s" << std::setw(7) << "Score"
+              << std::setw(10) << "Failed" << std::endl;
+    std::cout << std::string(95, '-') << std::endl;
+    
+    for (const auto& proxy : pool.getStats()) {
+        std::ostringstream connections;
+        connections << proxy.connections << "/" << proxy.maxConnections;
+        std::ostringstream failed;
+        failed << proxy.failures << "/" << proxy.transfers;
+        std::cout << std::left << std::setw(32) << proxy.url << std::right
+                  << std::setw(8) << connections.str()
+                  << std::setw(8) << proxy.owners
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(8) << proxy.weight
+                  << std::setw(10) << (proxy.latencyMs < 0 ? std::string("?") : std::to_string(static_cast<int>(proxy.latencyMs)) + " ms")
+                  << std::setw(12) << formatSize(static_cast<int64_t>(proxy.throughput))
+                  << std::setprecision(2) << std::setw(7) << proxy.score
+                  << std::setw(10) << failed.str()
+                  << (proxy.ejected ? "  ejected" : "") << std::endl;
+    }
+}
+
+void CommandLineInterface::cmdCluster(const std::vector<std::string>& args) {
+    dm::core::ClusterCoordinator& cluster = dm::core::ClusterCoordinator::getInstance();
+    if (!cluster.isEnabled()) {
+        std::cout << "Not part of a cluster (cluster_directory)" << std::endl;
+        return;
+    }
+    
+    std::string self = cluster.getNodeId();
+    std::cout << std::left << std::setw(32) << "Node" << std::right
+              << std::setw(12) << "Speed/s" << std::setw(8) << "Leases" << std::setw(11) << "Finished"
+              << std::setw(10) << "Seen" << std::endl;
+    std::cout << std::string(73, '-') << std::endl;
+    
+    double aggregate = 0.0;
+    int reporting = 0;
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (const auto& node : cluster.getNodes()) {
+        if (!node.stale) {
+            aggregate += node.throughput;
+            reporting++;
+        }
+        std::cout << std::left << std::setw(32) << (node.id == self ? node.id + " *" : node.id) << std::right
+                  << std::setw(12) << formatSize(static_cast<int64_t>(node.throughput))
+                  << std::setw(8) << node.leases
+                  << std::setw(11) << node.completed
+                  << std::setw(10) << (std::to_string(std::max<int64_t>(0, now - node.updatedAt) / 1000) + " s")
+                  << (node.stale ? "  stale" : "") << std::endl;
+    }
+    
+    std::cout << std::endl << reporting << " nodes reporting, " << formatSize(static_cast<int64_t>(aggregate))
+              << "/s together" << std::endl;
+}
+
+void CommandLineInterface::cmdPeers(const std::vector<std::string>& args) {
+    dm::core::PeerCache& peerCache = dm::core::PeerCache::getInstance();
+    if (!peerCache.isEnabled()) {
+        std::cout << "Not sharing downloads with the LAN (peer_cache)" << std::endl;
+        return;
+    }
+    
+    std::vector<dm::core::PeerInfo> peers = peerCache.getPeers();
+    std::cout << std::left << std::setw(32) << "Peer" << std::setw(24) << "Address" << std::right
+              << std::setw(12) << "Expires" << std::endl;
+    std::cout << std::string(68, '-') << std::endl;
+    for (const auto& peer : peers) {
+        std::cout << std::left << std::setw(32) << peer.name
+                  << std::setw(24) << (peer.address + ":" + std::to_string(peer.port)) << std::right
+                  << std::setw(12) << (peer.discovered ? std::to_string(peer.secondsLeft) + " s" : "configured")
+                  << std::endl;
+    }
+    
+    std::cout << std::endl << peers.size() << " peers, " << peerCache.getSharedCount() << " keys shared, "
+              << formatSize(peerCache.getServedBytes()) << " served" << std::endl;
+}
+
 void CommandLineInterface::cmdQuit(const std::vector<std::string>& args) {
     std::cout << "Exiting Download Manager..." << std::endl;
     m_isRunning = false;
@@ -0,0 +1,324 @@
+#include "core/AsyncClient.h"
+#include "core/DownloadManager.h"
+#include "core/TransferEngine.h"
+#include "core/ProxyPool.h"
+#include "utils/FileUtils.h"
+#include "utils/Logger.h"
+
+namespace dm {
+namespace core {
+
+namespace {
+
+bool isFinal(DownloadStatus status) {
+    return status == DownloadStatus::COMPLETED || status == DownloadStatus::DOWNLOAD_ERROR ||
+           status == DownloadStatus::CANCELED;
+}
+
+// Probes go out through the pool like those of downloads, without keeping a proxy
+std::string pickProxy(const std::string& url) {
+    ProxyPool& pool = ProxyPool::getInstance();
+    std::string proxy = pool.pick(url);
+    pool.forget(url);
+    return proxy;
+}
+
+} // namespace
+
+AsyncClient::AsyncClient(DownloadManager& downloadManager, AsyncExecutor& executor)
+    : downloadManager_(downloadManager), executor_(executor) {
+    listenerId_ = downloadManager_.addTaskStatusListener(
+        [this](std::shared_ptr<DownloadTask> task, DownloadStatus status) {
+            onStatusChanged(task, status);
+        });
+}
+
+AsyncClient::~AsyncClient() {
+    downloadManager_.removeTaskStatusListener(listenerId_);
+
+    std::list<std::shared_ptr<Crawl>> crawls;
+    {
+        std::lock_guard<std::mutex> lock(crawlsMutex_);
+        crawls.swap(crawls_);
+    }
+    for (const auto& crawl : crawls) {
+        crawl->crawler->stopCrawling();
+        crawl->stream->close();
+    }
+}
+
+void AsyncClient::head(const std::string& url, HeadCallback callback) {
+    std::string proxy = pickProxy(url);
+
+    // The engine only drives HTTP requests
+    if (HttpClient::isFtpUrl(url)) {
+        executor_.post([url, proxy, callback]() {
+            callback(HttpClient().setProxy(proxy).probe(url));
+        });
+        return;
+    }
+
+    TransferRequest request;
+    request.url = url;
+    request.startByte = 0;
+    request.endByte = 0;
+    request.proxy = proxy;
+    request.keepHeaders = true;
+
+    // A full 200 body is cut off after the headers
+    auto received = std::make_shared<size_t>(0);
+    request.dataCallback = [received](const char* data, size_t size) {
+        (void)data;
+        *received += size;
+        return *received <= 1;
+    };
+
+    AsyncExecutor& executor = executor_;
+    request.completionCallback = [&executor, callback](TransferId id, const TransferResult& result) {
+        (void)id;
+        HttpResponse response;
+        response.statusCode = result.statusCode;
+        response.headers = result.headers;
+        response.effectiveUrl = result.effectiveUrl;
+        response.curlCode = result.curlCode;
+        response.retryAfter = result.retryAfter;
+        response.success = result.success ||
+                           (result.aborted && result.error.empty() && result.statusCode >= 200 && result.statusCode < 300);
+        HttpClient::parseEntityHeaders(response);
+
+        // An empty resource cannot satisfy the range but still has a size
+        if (response.statusCode == 416 && response.contentLength == 0) {
+            response.success = true;
+        }
+        if (!response.success) {
+            response.error = result.error;
+        }
+
+        executor.post([callback, response = std::move(response)]() mutable {
+            callback(std::move(response));
+        });
+    };
+
+    if (TransferEngine::getInstance().submit(std::move(request)) == 0) {
+        HttpResponse response;
+        response.error = "Transfer engine is not running";
+        executor_.post([callback, response = std::move(response)]() mutable {
+            callback(std::move(response));
+        });
+    }
+}
+
+std::string AsyncClient::download(const std::string& url, const std::string& destinationPath,
+                                  const std::string& filename, DownloadPriority priority,
+                                  DownloadCallback callback) {
+    std::string taskId = queue(url, destinationPath, filename, priority, callback);
+    if (taskId.empty()) {
+        AsyncDownloadResult result;
+        result.url = url;
+        result.status = DownloadStatus::DOWNLOAD_ERROR;
+        result.error = "Failed to queue download";
+        executor_.post([callback, result = std::move(result)]() mutable {
+            callback(std::move(result));
+        });
+        return "";
+    }
+
+    downloadManager_.startDownloads({taskId});
+    return taskId;
+}
+
+bool AsyncClient::cancel(const std::string& taskId) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.find(taskId) == pending_.end()) {
+            return false;
+        }
+    }
+
+    // A task reports its cancel to the listener, a record only changes status
+    downloadManager_.cancelDownload(taskId);
+
+    AsyncDownloadResult result;
+    result.taskId = taskId;
+    result.status = DownloadStatus::CANCELED;
+    result.error = "Canceled";
+    finish(std::move(result));
+    return true;
+}
+
+std::shared_ptr<AsyncStream<AsyncDownloadResult>> AsyncClient::downloadBatch(const std::vector<std::string>& urls,
+                                                                         const std::string& destinationPath,
+                                                                         DownloadPriority priority) {
+    auto stream = std::make_shared<AsyncStream<AsyncDownloadResult>>(executor_);
+    if (urls.empty()) {
+        stream->close();
+        return stream;
+    }
+
+    // The last result closes the stream
+    auto remaining = std::make_shared<std::atomic<size_t>>(urls.size());
+    DownloadCallback deliver = [stream, remaining](AsyncDownloadResult result) {
+        stream->push(std::move(result));
+        if (--*remaining == 0) {
+            stream->close();
+        }
+    };
+
+    std::vector<std::string> taskIds;
+    for (const auto& url : urls) {
+        std::string taskId = queue(url, destinationPath, "", priority, deliver);
+        if (taskId.empty()) {
+            AsyncDownloadResult result;
+            result.url = url;
+            result.status = DownloadStatus::DOWNLOAD_ERROR;
+            result.error = "Failed to queue download";
+            deliver(std::move(result));
+            continue;
+        }
+        taskIds.push_back(taskId);
+    }
+
+    stream->setCancelHandler([this, taskIds]() {
+        for (const auto& taskId : taskIds) {
+            cancel(taskId);
+        }
+    });
+
+    if (!taskIds.empty()) {
+        downloadManager_.startDownloads(taskIds);
+    }
+    return stream;
+}
+
+std::shared_ptr<AsyncStream<AsyncCrawlItem>> AsyncClient::crawl(const std::string& startUrl, CrawlOptions options) {
+    reapCrawls();
+
+    auto crawl = std::make_shared<Crawl>();
+    crawl->stream = std::make_shared<AsyncStream<AsyncCrawlItem>>(executor_);
+    crawl->finished = std::make_shared<std::atomic<bool>>(false);
+    crawl->crawler = std::make_unique<WebsiteCrawler>(downloadManager_);
+
+    // Crawler threads only see the stream and the flag, never the crawl
+    auto stream = crawl->stream;
+    auto finished = crawl->finished;
+    options.resourceHandler = [stream](const std::string& url, ResourceType type) {
+        stream->push(AsyncCrawlItem{url, type});
+    };
+    options.finishedHandler = [stream, finished]() {
+        *finished = true;
+        stream->close();
+    };
+
+    if (!crawl->crawler->startCrawling(startUrl, options)) {
+        stream->close();
+        return stream;
+    }
+
+    Crawl* key = crawl.get();
+    stream->setCancelHandler([this, key]() {
+        std::shared_ptr<Crawl> stopped;
+        {
+            std::lock_guard<std::mutex> lock(crawlsMutex_);
+            for (auto it = crawls_.begin(); it != crawls_.end(); ++it) {
+                if (it->get() == key) {
+                    stopped = *it;
+                    crawls_.erase(it);
+                    break;
+                }
+            }
+        }
+        if (stopped) {
+            stopped->crawler->stopCrawling();
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(crawlsMutex_);
+    crawls_.push_back(crawl);
+    return stream;
+}
+
+AsyncExecutor& AsyncClient::getExecutor() const {
+    return executor_;
+}
+
+size_t AsyncClient::getPendingDownloadCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+std::string AsyncClient::queue(const std::string& url, const std::string& destinationPath,
+                               const std::string& filename, DownloadPriority priority, DownloadCallback callback) {
+    // Registered before it starts, so no end is missed
+    std::string taskId = downloadManager_.queueDownload(url, destinationPath, filename, priority, false);
+    if (taskId.empty()) {
+        return "";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_[taskId] = Pending{url, std::move(callback)};
+    return taskId;
+}
+
+void AsyncClient::onStatusChanged(const std::shared_ptr<DownloadTask>& task, DownloadStatus status) {
+    if (!task || !isFinal(status)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.find(task->getId()) == pending_.end()) {
+            return;
+        }
+    }
+
+    AsyncDownloadResult result;
+    result.taskId = task->getId();
+    result.url = task->getUrl();
+    result.filePath = dm::utils::FileUtils::combinePaths(task->getDestinationPath(), task->getFilename());
+    result.status = status;
+    result.fileSize = task->getFileSize();
+    if (status != DownloadStatus::COMPLETED) {
+        result.error = status == DownloadStatus::CANCELED ? "Canceled" : task->getError();
+    }
+    finish(std::move(result));
+}
+
+bool AsyncClient::finish(AsyncDownloadResult result) {
+    DownloadCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(result.taskId);
+        if (it == pending_.end()) {
+            return false;
+        }
+        if (result.url.empty()) {
+            result.url = it->second.url;
+        }
+        callback = std::move(it->second.callback);
+        pending_.erase(it);
+    }
+
+    executor_.post([callback = std::move(callback), result = std::move(result)]() mutable {
+        callback(std::move(result));
+    });
+    return true;
+}
+
+void AsyncClient::reapCrawls() {
+    // Destroyed here, outside the crawler threads, which have left their loops
+    std::list<std::shared_ptr<Crawl>> finished;
+    {
+        std::lock_guard<std::mutex> lock(crawlsMutex_);
+        for (auto it = crawls_.begin(); it != crawls_.end();) {
+            if (*(*it)->finished) {
+                finished.push_back(*it);
+                it = crawls_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+} // namespace core
+} // namespace dm
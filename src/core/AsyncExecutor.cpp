@@ -0,0 +1,117 @@
+#include "core/AsyncExecutor.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+// A continuation that throws must not take its thread down
+void runWork(const std::function<void()>& work) {
+    try {
+        work();
+    } catch (const std::exception& e) {
+        dm::utils::Logger::error("Exception in async continuation: " + std::string(e.what()));
+    }
+}
+
+} // namespace
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t threadCount) {
+    threadCount = std::max<size_t>(1, threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        workers_.emplace_back(&ThreadPoolExecutor::workerLoop, this);
+    }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void ThreadPoolExecutor::post(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(work));
+    }
+    changed_.notify_one();
+}
+
+size_t ThreadPoolExecutor::getThreadCount() const {
+    return workers_.size();
+}
+
+void ThreadPoolExecutor::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        changed_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+
+        // Work posted before the destructor still runs
+        if (queue_.empty()) {
+            return;
+        }
+
+        std::function<void()> work = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        runWork(work);
+
+        lock.lock();
+    }
+}
+
+void ManualExecutor::post(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(work));
+    }
+    changed_.notify_one();
+}
+
+size_t ManualExecutor::run() {
+    size_t count = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!queue_.empty()) {
+        std::function<void()> work = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        runWork(work);
+        count++;
+
+        lock.lock();
+    }
+    return count;
+}
+
+size_t ManualExecutor::waitAndRun(int timeoutMs) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto ready = [this]() { return !queue_.empty(); };
+        if (timeoutMs < 0) {
+            changed_.wait(lock, ready);
+        } else if (!changed_.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready)) {
+            return 0;
+        }
+    }
+    return run();
+}
+
+} // namespace core
+} // namespace dm
@@ -1,509 +1,1101 @@
-#include "../../include/core/BatchDownloader.h"
-#include "../../include/core/DownloadManager.h"
-#include "../../include/utils/Logger.h"
-#include "../../include/utils/UrlParser.h"
-#include "../../include/utils/FileUtils.h"
+#include "core/BatchDownloader.h"
+#include "core/DownloadManager.h"
+#include "core/HttpClient.h"
+#include "core/DnsCache.h"
+#include "core/HostConnectionLimiter.h"
+#include "core/ClusterCoordinator.h"
+#include "utils/Logger.h"
+#include "utils/HtmlLinkScanner.h"
+#include "utils/FileUtils.h"
+#include "utils/UrlFingerprintSet.h"
+#include "utils/UrlParser.h"
 
-#include <fstream>
-#include <regex>
-#include <thread>
+#include <curl/curl.h>
 #include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <unordered_set>
 
-namespace DownloadManager {
-namespace Core {
+namespace dm {
+namespace core {
 
-BatchDownloader::BatchDownloader() :
-    m_isRunning(false),
-    m_maxConcurrentDownloads(3),
-    m_parsePatterns(true),
-    m_maxTotalDownloads(-1),
-    m_processingThread(nullptr)
-{
-}
+namespace {
 
-BatchDownloader::~BatchDownloader() {
-    stop();
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
 }
 
-bool BatchDownloader::addBatchUrls(const std::vector<std::string>& urls, const std::string& destinationDir) {
-    if (urls.empty()) {
-        return false;
-    }
-    
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    
-    // Parse each URL
-    for (const auto& url : urls) {
-        BatchItem item;
-        item.url = url;
-        item.status = BatchItemStatus::PENDING;
-        item.destinationDir = destinationDir;
-        
-        // Parse URL for filename if possible
-        Utils::UrlParser urlParser;
-        auto parsedUrl = urlParser.parse(url);
-        
-        if (parsedUrl.valid && !parsedUrl.path.empty()) {
-            size_t lastSlash = parsedUrl.path.find_last_of('/');
-            if (lastSlash != std::string::npos && lastSlash < parsedUrl.path.length() - 1) {
-                item.suggestedFilename = parsedUrl.path.substr(lastSlash + 1);
-            }
-        }
-        
-        m_batchItems.push_back(item);
+std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n\f");
+    if (start == std::string::npos) {
+        return "";
     }
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Added " + std::to_string(urls.size()) + " URLs to batch queue");
-    
-    return true;
+    size_t end = text.find_last_not_of(" \t\r\n\f");
+    return text.substr(start, end - start + 1);
 }
 
-bool BatchDownloader::addBatchFromFile(const std::string& filePath, const std::string& destinationDir) {
-    try {
-        std::ifstream file(filePath);
-        if (!file.is_open()) {
-            Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                "Failed to open batch file: " + filePath);
-            return false;
-        }
-        
-        std::vector<std::string> urls;
-        std::string line;
-        
-        while (std::getline(file, line)) {
-            // Trim whitespace
-            line.erase(0, line.find_first_not_of(" \t\r\n"));
-            line.erase(line.find_last_not_of(" \t\r\n") + 1);
-            
-            // Skip empty lines and comments
-            if (line.empty() || line[0] == '#') {
-                continue;
-            }
-            
-            // Add valid URL to list
-            if (isValidUrl(line)) {
-                urls.push_back(line);
-            } else {
-                Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                    "Skipping invalid URL in batch file: " + line);
-            }
-        }
-        
-        file.close();
-        
-        // Add valid URLs to the batch
-        if (!urls.empty()) {
-            return addBatchUrls(urls, destinationDir);
+// Make one decoded path component safe to use as a file or directory name
+std::string sanitizeName(const std::string& name) {
+    std::string result;
+    result.reserve(name.size());
+    for (char c : name) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte < 0x20 || std::strchr("<>:\"/\\|?*", c)) {
+            result += '_';
         } else {
-            Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                "No valid URLs found in batch file: " + filePath);
-            return false;
+            result += c;
         }
-    } 
-    catch (const std::exception& e) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Exception reading batch file: " + std::string(e.what()));
-        return false;
     }
+    if (result == "." || result == "..") {
+        return "";
+    }
+    return result;
 }
 
-bool BatchDownloader::addBatchFromPattern(const std::string& patternUrl, int start, int end, 
-                                           int step, int padding, const std::string& destinationDir) {
-    if (!m_parsePatterns) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Pattern parsing is disabled");
-        return false;
-    }
-    
-    // Validate parameters
-    if (start > end || step <= 0) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Invalid pattern parameters");
-        return false;
-    }
-    
-    try {
-        // Find the pattern placeholder in the URL
-        std::string pattern = "{$PATTERN}";
-        size_t patternPos = patternUrl.find(pattern);
-        
-        if (patternPos == std::string::npos) {
-            Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                "Pattern placeholder not found in URL: " + patternUrl);
-            return false;
-        }
-        
-        std::vector<std::string> urls;
-        
-        // Generate URLs based on the pattern
-        for (int i = start; i <= end; i += step) {
-            std::string formattedNumber;
-            
-            if (padding > 0) {
-                // Format number with padding
-                std::ostringstream ss;
-                ss << std::setw(padding) << std::setfill('0') << i;
-                formattedNumber = ss.str();
-            } else {
-                formattedNumber = std::to_string(i);
-            }
-            
-            // Replace pattern in URL
-            std::string url = patternUrl;
-            url.replace(patternPos, pattern.length(), formattedNumber);
-            
-            // Validate URL
-            if (isValidUrl(url)) {
-                urls.push_back(url);
+// Split one CSV record, honouring quoted fields with doubled quotes
+std::vector<std::string> splitCsvLine(const std::string& line) {
+    std::vector<std::string> fields;
+    std::string field;
+    bool quoted = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
             } else {
-                Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                    "Skipping invalid pattern-generated URL: " + url);
+                field += c;
             }
-        }
-        
-        // Add generated URLs to the batch
-        if (!urls.empty()) {
-            return addBatchUrls(urls, destinationDir);
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(trim(field));
+            field.clear();
         } else {
-            Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                "No valid URLs generated from pattern");
-            return false;
+            field += c;
         }
-    } 
-    catch (const std::exception& e) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Exception in pattern generation: " + std::string(e.what()));
-        return false;
     }
+    fields.push_back(trim(field));
+
+    return fields;
 }
 
-void BatchDownloader::start() {
-    if (m_isRunning || m_batchItems.empty()) {
+// Keep a URL if it is new and passes the filter
+void addUrl(std::vector<std::string>& urls, std::unordered_set<std::string>& seen,
+            const std::string& url, const UrlFilterFunction& filterFunction) {
+    if (url.empty() || (filterFunction && !filterFunction(url))) {
         return;
     }
-    
-    m_isRunning = true;
-    m_processingThread = std::make_unique<std::thread>(&BatchDownloader::processQueue, this);
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Batch downloader started with " + std::to_string(m_batchItems.size()) + " items");
+    if (seen.insert(url).second) {
+        urls.push_back(url);
+    }
 }
 
-void BatchDownloader::stop() {
-    if (!m_isRunning) {
+// Keep the URL of one line of a text list
+void addTextLine(std::vector<std::string>& urls, std::unordered_set<std::string>& seen,
+                 const std::string& text, const UrlFilterFunction& filterFunction) {
+    std::string line = trim(text);
+
+    // Skip empty lines and comments
+    if (line.empty() || line[0] == '#') {
         return;
     }
-    
-    m_isRunning = false;
-    if (m_processingThread && m_processingThread->joinable()) {
-        m_processingThread->join();
+
+    std::string url = dm::utils::UrlParser::resolve("", line);
+    if (url.empty()) {
+        dm::utils::Logger::warning("Skipping invalid URL in batch source: " + line);
+        return;
     }
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Batch downloader stopped");
+    addUrl(urls, seen, url, filterFunction);
 }
 
-void BatchDownloader::pause() {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    m_isPaused = true;
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Batch downloader paused");
+// Keep the complete <loc> URLs of a sitemap, returning where an incomplete one starts
+size_t addSitemapUrls(std::vector<std::string>& urls, std::unordered_set<std::string>& seen,
+                      const std::string& content, const UrlFilterFunction& filterFunction) {
+    size_t pos = 0;
+    size_t start = 0;
+    while ((start = content.find("<loc>", pos)) != std::string::npos) {
+        size_t end = content.find("</loc>", start + 5);
+        if (end == std::string::npos) {
+            return start;
+        }
+
+        // Sitemaps escape '&' and friends
+        std::string url = trim(content.substr(start + 5, end - start - 5));
+        for (const auto& entity : {std::make_pair("&amp;", "&"), std::make_pair("&apos;", "'"),
+                                   std::make_pair("&quot;", "\""), std::make_pair("&gt;", ">"),
+                                   std::make_pair("&lt;", "<")}) {
+            size_t at = 0;
+            while ((at = url.find(entity.first, at)) != std::string::npos) {
+                url.replace(at, std::strlen(entity.first), entity.second);
+                at++;
+            }
+        }
+
+        addUrl(urls, seen, dm::utils::UrlParser::resolve("", url), filterFunction);
+        pos = end + 6;
+    }
+
+    // Keep a tail that may be the start of the next tag
+    return std::max(pos, content.size() > 4 ? content.size() - 4 : 0);
 }
 
-void BatchDownloader::resume() {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    m_isPaused = false;
-    m_queueCV.notify_all();
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Batch downloader resumed");
+// Keep the links and resources a scanner found, resolved against the document URL
+void addScannedUrls(std::vector<std::string>& urls, std::unordered_set<std::string>& seen,
+                    dm::utils::HtmlLinkScanner& scanner, const std::string& baseUrl,
+                    const UrlFilterFunction& filterFunction) {
+    std::vector<std::string> links;
+    std::vector<std::string> resources;
+    std::string baseHref;
+    scanner.takeResults(links, resources, baseHref);
+
+    // A <base href> overrides the document URL
+    std::string base = baseUrl;
+    if (!baseHref.empty()) {
+        std::string resolved = dm::utils::UrlParser::resolve(baseUrl, baseHref);
+        if (!resolved.empty()) {
+            base = resolved;
+        }
+    }
+
+    for (const auto& link : links) {
+        addUrl(urls, seen, dm::utils::UrlParser::resolve(base, link), filterFunction);
+    }
+    for (const auto& resource : resources) {
+        addUrl(urls, seen, dm::utils::UrlParser::resolve(base, resource), filterFunction);
+    }
 }
 
-bool BatchDownloader::isRunning() const {
-    return m_isRunning;
+} // namespace
+
+BatchDownloader::BatchDownloader(DownloadManager& downloadManager)
+    : downloadManager_(downloadManager),
+      jobRunning_(false),
+      jobCancelled_(false),
+      processedCount_(0),
+      totalCount_(0),
+      overallProgress_(0.0),
+      successCount_(0),
+      failureCount_(0),
+      progressCallback_(nullptr),
+      completionCallback_(nullptr),
+      errorCallback_(nullptr) {
 }
 
-bool BatchDownloader::isPaused() const {
-    return m_isPaused;
+BatchDownloader::~BatchDownloader() {
+    cancelBatchJob();
 }
 
-void BatchDownloader::setMaxConcurrentDownloads(int max) {
-    m_maxConcurrentDownloads = max > 0 ? max : 1;
+bool BatchDownloader::startBatchJob(const BatchDownloadConfig& config,
+                                    BatchProgressCallback progressCallback,
+                                    BatchCompletionCallback completionCallback,
+                                    BatchErrorCallback errorCallback) {
+    if (jobRunning_) {
+        dm::utils::Logger::warning("A batch job is already running");
+        return false;
+    }
+
+    // Reap the thread of the previous job
+    if (jobThread_.joinable()) {
+        jobThread_.join();
+    }
+
+    // Keep callbacks registered earlier unless new ones are given
+    if (progressCallback) {
+        progressCallback_ = progressCallback;
+    }
+    if (completionCallback) {
+        completionCallback_ = completionCallback;
+    }
+    if (errorCallback) {
+        errorCallback_ = errorCallback;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        processedCount_ = 0;
+        totalCount_ = 0;
+        overallProgress_ = 0.0;
+        successCount_ = 0;
+        failureCount_ = 0;
+        failedUrls_.clear();
+    }
+
+    jobCancelled_ = false;
+    jobRunning_ = true;
+    jobThread_ = std::thread(&BatchDownloader::processBatchJob, this, config);
+
+    return true;
 }
 
-int BatchDownloader::getMaxConcurrentDownloads() const {
-    return m_maxConcurrentDownloads;
+void BatchDownloader::cancelBatchJob() {
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        jobCancelled_ = true;
+    }
+    eventsChanged_.notify_all();
+
+    if (jobThread_.joinable() && jobThread_.get_id() != std::this_thread::get_id()) {
+        jobThread_.join();
+    }
 }
 
-void BatchDownloader::setMaxTotalDownloads(int max) {
-    m_maxTotalDownloads = max;
+bool BatchDownloader::isJobRunning() const {
+    return jobRunning_;
 }
 
-int BatchDownloader::getMaxTotalDownloads() const {
-    return m_maxTotalDownloads;
+void BatchDownloader::getJobProgress(int& processedCount, int& totalCount,
+                                     double& overallProgress, int& successCount, int& failureCount) const {
+    std::lock_guard<std::mutex> lock(progressMutex_);
+    processedCount = processedCount_;
+    totalCount = totalCount_;
+    overallProgress = overallProgress_;
+    successCount = successCount_;
+    failureCount = failureCount_;
 }
 
-void BatchDownloader::setParsePatterns(bool enable) {
-    m_parsePatterns = enable;
+std::vector<std::string> BatchDownloader::scanUrlSource(const BatchDownloadConfig& config) {
+    switch (config.sourceType) {
+        case BatchUrlSourceType::TEXT_FILE:
+            return extractUrlsFromTextFile(config.sourceUrl, config.filterFunction);
+        case BatchUrlSourceType::HTML_FILE:
+            return extractUrlsFromHtmlFile(config.sourceUrl, config.filterFunction);
+        case BatchUrlSourceType::CSV_FILE:
+            return extractUrlsFromCsvFile(config.sourceUrl, config.urlColumnName,
+                                          config.urlColumnIndex, config.filterFunction);
+        case BatchUrlSourceType::SITEMAP_FILE:
+            return extractUrlsFromSitemapFile(config.sourceUrl, config.filterFunction);
+        case BatchUrlSourceType::HTTP_SOURCE:
+            return extractUrlsFromHttpSource(config.sourceUrl, config.filterFunction);
+        case BatchUrlSourceType::URL_LIST:
+        default: {
+            std::vector<std::string> urls;
+            std::unordered_set<std::string> seen;
+            urls.reserve(config.urls.size());
+            seen.reserve(config.urls.size());
+            for (const auto& url : config.urls) {
+                addUrl(urls, seen, dm::utils::UrlParser::resolve("", trim(url)), config.filterFunction);
+            }
+            return urls;
+        }
+    }
 }
 
-bool BatchDownloader::getParsePatterns() const {
-    return m_parsePatterns;
+std::vector<std::string> BatchDownloader::extractUrlsFromTextFile(const std::string& filePath,
+                                                                UrlFilterFunction filterFunction) {
+    if (!dm::utils::FileUtils::fileExists(filePath)) {
+        dm::utils::Logger::error("Batch source not found: " + filePath);
+        return {};
+    }
+    return extractUrlsFromText(dm::utils::FileUtils::readTextFile(filePath), filterFunction);
 }
 
-int BatchDownloader::getTotalItems() const {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    return static_cast<int>(m_batchItems.size());
+std::vector<std::string> BatchDownloader::extractUrlsFromHtmlFile(const std::string& filePath,
+                                                                UrlFilterFunction filterFunction) {
+    if (!dm::utils::FileUtils::fileExists(filePath)) {
+        dm::utils::Logger::error("Batch source not found: " + filePath);
+        return {};
+    }
+    return extractUrlsFromHtml(dm::utils::FileUtils::readTextFile(filePath), "", filterFunction);
 }
 
-int BatchDownloader::getCompletedItems() const {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    return std::count_if(m_batchItems.begin(), m_batchItems.end(), 
-                        [](const BatchItem& item) { 
-                            return item.status == BatchItemStatus::COMPLETED; 
-                        });
+std::vector<std::string> BatchDownloader::extractUrlsFromCsvFile(const std::string& filePath,
+                                                               const std::string& columnName,
+                                                               int columnIndex,
+                                                               UrlFilterFunction filterFunction) {
+    if (!dm::utils::FileUtils::fileExists(filePath)) {
+        dm::utils::Logger::error("Batch source not found: " + filePath);
+        return {};
+    }
+
+    std::istringstream content(dm::utils::FileUtils::readTextFile(filePath));
+    std::vector<std::string> urls;
+    std::unordered_set<std::string> seen;
+    std::string line;
+
+    // A named column is looked up in the header row
+    size_t column = static_cast<size_t>(std::max(0, columnIndex));
+    if (!columnName.empty()) {
+        if (!std::getline(content, line)) {
+            return urls;
+        }
+        std::vector<std::string> header = splitCsvLine(line);
+        auto it = std::find_if(header.begin(), header.end(), [&columnName](const std::string& name) {
+            return toLower(name) == toLower(columnName);
+        });
+        if (it == header.end()) {
+            dm::utils::Logger::error("Column " + columnName + " not found in " + filePath);
+            return urls;
+        }
+        column = static_cast<size_t>(it - header.begin());
+    }
+
+    while (std::getline(content, line)) {
+        std::vector<std::string> fields = splitCsvLine(line);
+        if (column < fields.size()) {
+            addUrl(urls, seen, dm::utils::UrlParser::resolve("", fields[column]), filterFunction);
+        }
+    }
+
+    return urls;
 }
 
-int BatchDownloader::getFailedItems() const {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    return std::count_if(m_batchItems.begin(), m_batchItems.end(), 
-                        [](const BatchItem& item) { 
-                            return item.status == BatchItemStatus::FAILED; 
-                        });
+std::vector<std::string> BatchDownloader::extractUrlsFromSitemapFile(const std::string& filePath,
+                                                                   UrlFilterFunction filterFunction) {
+    if (!dm::utils::FileUtils::fileExists(filePath)) {
+        dm::utils::Logger::error("Batch source not found: " + filePath);
+        return {};
+    }
+    return extractUrlsFromSitemap(dm::utils::FileUtils::readTextFile(filePath), filterFunction);
 }
 
-int BatchDownloader::getPendingItems() const {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    return std::count_if(m_batchItems.begin(), m_batchItems.end(), 
-                        [](const BatchItem& item) { 
-                            return item.status == BatchItemStatus::PENDING; 
-                        });
+std::vector<std::string> BatchDownloader::extractUrlsFromHttpSource(const std::string& url,
+                                                                  UrlFilterFunction filterFunction) {
+    enum class Format { UNKNOWN, HTML, SITEMAP, TEXT };
+
+    // Pick the format from the content type, sniffing when the server is vague
+    Format format = Format::UNKNOWN;
+    std::string contentType;
+    HttpClient client;
+    client.setAcceptCompression(true);
+    client.setHeadersCallback([&contentType](const HttpHeaders& headers) -> bool {
+        contentType = toLower(std::string(headers.getContentType()));
+        return true;
+    });
+    auto chooseFormat = [&format, &contentType](const std::string& head) {
+        if (contentType.find("html") != std::string::npos) {
+            format = Format::HTML;
+        } else if (contentType.find("xml") != std::string::npos || head.find("<urlset") != std::string::npos ||
+                   head.find("<sitemapindex") != std::string::npos) {
+            format = Format::SITEMAP;
+        } else {
+            format = Format::TEXT;
+        }
+    };
+
+    // Parse the body as it arrives, only its unparsed tail is held
+    std::vector<std::string> urls;
+    std::unordered_set<std::string> seen;
+    dm::utils::HtmlLinkScanner scanner;
+    std::string pending;
+    auto parse = [&](bool final) {
+        if (format == Format::HTML) {
+            scanner.feed(pending.data(), pending.size());
+            pending.clear();
+        } else if (format == Format::SITEMAP) {
+            size_t parsed = addSitemapUrls(urls, seen, pending, filterFunction);
+            pending.erase(0, final ? pending.size() : parsed);
+        } else {
+            size_t start = 0;
+            size_t end = 0;
+            while ((end = pending.find('\n', start)) != std::string::npos) {
+                addTextLine(urls, seen, pending.substr(start, end - start), filterFunction);
+                start = end + 1;
+            }
+            if (final && start < pending.size()) {
+                addTextLine(urls, seen, pending.substr(start), filterFunction);
+                start = pending.size();
+            }
+            pending.erase(0, start);
+        }
+    };
+
+    HttpResponse response = client.get(url, [&](const char* data, size_t size) -> bool {
+        pending.append(data, size);
+        if (format == Format::UNKNOWN) {
+            if (pending.size() < SNIFF_SIZE && contentType.find("html") == std::string::npos &&
+                contentType.find("xml") == std::string::npos) {
+                return true;
+            }
+            chooseFormat(pending);
+        }
+        parse(false);
+        return true;
+    });
+    if (!response.success) {
+        dm::utils::Logger::error("Failed to fetch batch source " + url + ": " + response.error);
+        return {};
+    }
+
+    if (format == Format::UNKNOWN) {
+        chooseFormat(pending);
+    }
+    parse(true);
+    if (format == Format::HTML) {
+        addScannedUrls(urls, seen, scanner, response.effectiveUrl.empty() ? url : response.effectiveUrl,
+                       filterFunction);
+    }
+    return urls;
 }
 
-int BatchDownloader::getActiveItems() const {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    return std::count_if(m_batchItems.begin(), m_batchItems.end(), 
-                        [](const BatchItem& item) { 
-                            return item.status == BatchItemStatus::ACTIVE; 
-                        });
+std::vector<std::string> BatchDownloader::extractUrlsFromHtml(const std::string& content,
+                                                              const std::string& baseUrl,
+                                                              UrlFilterFunction filterFunction) {
+    dm::utils::HtmlLinkScanner scanner;
+    scanner.feed(content.data(), content.size());
+
+    std::vector<std::string> urls;
+    std::unordered_set<std::string> seen;
+    addScannedUrls(urls, seen, scanner, baseUrl, filterFunction);
+    return urls;
 }
 
-std::vector<BatchItem> BatchDownloader::getBatchItems() const {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    return m_batchItems;
+std::vector<std::string> BatchDownloader::extractUrlsFromSitemap(const std::string& content,
+                                                                 UrlFilterFunction filterFunction) {
+    std::vector<std::string> urls;
+    std::unordered_set<std::string> seen;
+    addSitemapUrls(urls, seen, content, filterFunction);
+    return urls;
 }
 
-void BatchDownloader::clearQueue() {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    m_batchItems.clear();
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Batch queue cleared");
+std::vector<std::string> BatchDownloader::extractUrlsFromText(const std::string& content,
+                                                              UrlFilterFunction filterFunction) {
+    std::istringstream stream(content);
+    std::vector<std::string> urls;
+    std::unordered_set<std::string> seen;
+    std::string line;
+
+    while (std::getline(stream, line)) {
+        addTextLine(urls, seen, line, filterFunction);
+    }
+
+    return urls;
 }
 
-void BatchDownloader::removeItem(int index) {
-    std::lock_guard<std::mutex> lock(m_queueMutex);
-    
-    if (index >= 0 && index < static_cast<int>(m_batchItems.size())) {
-        // If the item is active, we can't safely remove it
-        if (m_batchItems[index].status == BatchItemStatus::ACTIVE) {
-            Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                "Cannot remove active batch item");
-            return;
+void BatchDownloader::processBatchJob(const BatchDownloadConfig& config) {
+    config_ = config;
+    if (!openUrlSource()) {
+        std::string error = "No URLs found in batch source" +
+                            (config_.sourceUrl.empty() ? std::string() : ": " + config_.sourceUrl);
+        dm::utils::Logger::error(error);
+        if (errorCallback_) {
+            errorCallback_(error);
+        }
+        closeUrlSource();
+        jobRunning_ = false;
+        return;
+    }
+
+    usedPaths_.reset(new dm::utils::UrlFingerprintSet(config_.maxUrlMemory, config_.spillDirectory));
+    pathCollisions_.clear();
+    items_.clear();
+    nextItemId_ = 0;
+    retryItems_.clear();
+    deferredItems_.clear();
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        activeItems_.clear();
+        finishedTasks_.clear();
+    }
+
+    // A stream's total grows as it is read
+    updateJobProgress(0, static_cast<int>(scannedUrls_.size()), 0, 0);
+    if (sourceStream_) {
+        dm::utils::Logger::info("Batch job started, streaming URLs from " +
+                                (config_.sourceUrl == "-" ? std::string("stdin") : config_.sourceUrl));
+    } else {
+        dm::utils::Logger::info("Batch job started with " + std::to_string(scannedUrls_.size()) + " URLs");
+    }
+
+    // Completions arrive from whichever thread finishes the task
+    int listenerId = downloadManager_.addTaskStatusListener(
+        [this](std::shared_ptr<DownloadTask> task, DownloadStatus status) {
+            if (status == DownloadStatus::COMPLETED || status == DownloadStatus::DOWNLOAD_ERROR ||
+                status == DownloadStatus::CANCELED) {
+                postFinished(task->getId(), status == DownloadStatus::COMPLETED);
+            }
+        });
+
+    // Tasks that are not started would never finish, so they are only added
+    size_t window = config_.startImmediately ? static_cast<size_t>(std::max(1, config_.maxConcurrentFiles))
+                                             : std::numeric_limits<size_t>::max();
+    size_t inFlight = 0;
+
+    while (!jobCancelled_) {
+        // Ask the cluster again for items other nodes held
+        if (!deferredItems_.empty() && std::chrono::steady_clock::now() >= deferredCheckAt_) {
+            retryItems_.insert(retryItems_.end(), deferredItems_.begin(), deferredItems_.end());
+            deferredItems_.clear();
         }
         
-        m_batchItems.erase(m_batchItems.begin() + index);
-        
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Removed item " + std::to_string(index) + " from batch queue");
+        // Fill the window, retries first
+        while (inFlight < window && !jobCancelled_) {
+            size_t index;
+            if (!retryItems_.empty()) {
+                index = retryItems_.front();
+                retryItems_.pop_front();
+            } else if (fillLookahead()) {
+                // Prefer a URL whose host has a connection to spare, one for a
+                // busy host would only wait in the manager's queue
+                auto next = std::find_if(lookahead_.begin(), lookahead_.end(), [](const std::string& url) {
+                    return HostConnectionLimiter::getInstance().hasCapacity(url);
+                });
+                if (next == lookahead_.end()) {
+                    next = lookahead_.begin();
+                }
+                index = createItem(std::move(*next));
+                lookahead_.erase(next);
+            } else {
+                break;
+            }
+
+            if (dispatchItem(index) && config_.startImmediately) {
+                inFlight++;
+            }
+        }
+
+        if (inFlight == 0 && retryItems_.empty() && deferredItems_.empty() && !fillLookahead() &&
+            isSourceExhausted()) {
+            break;
+        }
+
+        // Sleep until a download finishes, the stream sends more, or it is time to look at deferred items
+        std::deque<FinishedTask> finished;
+        {
+            std::unique_lock<std::mutex> lock(eventsMutex_);
+            auto ready = [this]() { return jobCancelled_ || !finishedTasks_.empty() || streamChanged_; };
+            if (deferredItems_.empty()) {
+                eventsChanged_.wait(lock, ready);
+            } else {
+                eventsChanged_.wait_until(lock, deferredCheckAt_, ready);
+            }
+            streamChanged_ = false;
+            finished.swap(finishedTasks_);
+        }
+
+        for (const auto& event : finished) {
+            size_t index;
+            {
+                // A task may be reported twice, only the first report counts
+                std::lock_guard<std::mutex> lock(eventsMutex_);
+                auto it = activeItems_.find(event.taskId);
+                if (it == activeItems_.end()) {
+                    continue;
+                }
+                index = it->second;
+                activeItems_.erase(it);
+            }
+            inFlight--;
+            onItemFinished(index, event.taskId, event.succeeded);
+        }
+    }
+
+    downloadManager_.removeTaskStatusListener(listenerId);
+
+    // Stop what is still in flight
+    std::vector<std::string> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        for (const auto& active : activeItems_) {
+            abandoned.push_back(active.first);
+        }
+        activeItems_.clear();
+        finishedTasks_.clear();
+    }
+    if (jobCancelled_ && config_.startImmediately) {
+        for (const auto& taskId : abandoned) {
+            downloadManager_.cancelDownload(taskId);
+        }
+    }
+
+    // Items leased and not finished go back to the other nodes
+    for (const auto& item : items_) {
+        if (!item.second.clusterKey.empty()) {
+            ClusterCoordinator::getInstance().release(item.second.clusterKey);
+        }
+    }
+    deferredItems_.clear();
+
+    bool streamed = sourceStream_ != nullptr;
+    closeUrlSource();
+    usedPaths_.reset();
+    pathCollisions_.clear();
+    items_ = std::unordered_map<size_t, BatchItem>();
+
+    // An empty stream is only noticed once it ends
+    if (streamed && nextItemId_ == 0 && !jobCancelled_) {
+        std::string error = "No URLs found in batch source: " + config_.sourceUrl;
+        dm::utils::Logger::error(error);
+        if (errorCallback_) {
+            errorCallback_(error);
+        }
+        jobRunning_ = false;
+        return;
+    }
+
+    int successCount;
+    int failureCount;
+    std::vector<std::string> failedUrls;
+    {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        successCount = successCount_;
+        failureCount = failureCount_;
+        failedUrls = failedUrls_;
+    }
+
+    dm::utils::Logger::info("Batch job " + std::string(jobCancelled_ ? "cancelled" : "finished") + ": " +
+                            std::to_string(successCount) + " succeeded, " +
+                            std::to_string(failureCount) + " failed");
+
+    jobRunning_ = false;
+
+    if (completionCallback_) {
+        completionCallback_(successCount, failureCount, failedUrls);
     }
 }
 
-void BatchDownloader::addBatchProgressCallback(const BatchProgressCallback& callback) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    m_progressCallbacks.push_back(callback);
+bool BatchDownloader::openUrlSource() {
+    closeUrlSource();
+
+    bool streamable = config_.sourceType == BatchUrlSourceType::TEXT_FILE ||
+                      config_.sourceType == BatchUrlSourceType::CSV_FILE;
+    if (!config_.streamSource || !streamable) {
+        if (config_.streamSource) {
+            dm::utils::Logger::warning("Only text and CSV batch sources can be streamed, scanning " +
+                                       config_.sourceUrl);
+        }
+        scannedUrls_ = scanUrlSource(config_);
+        return !scannedUrls_.empty();
+    }
+
+    if (config_.sourceUrl == "-") {
+        sourceStream_ = &std::cin;
+    } else {
+        sourceFile_ = std::make_shared<std::ifstream>(config_.sourceUrl);
+        if (!*sourceFile_) {
+            dm::utils::Logger::error("Batch source not found: " + config_.sourceUrl);
+            sourceFile_.reset();
+            return false;
+        }
+        sourceStream_ = sourceFile_.get();
+    }
+    seenUrls_.reset(new dm::utils::UrlFingerprintSet(config_.maxUrlMemory, config_.spillDirectory));
+
+    // A named column is looked up in the header row
+    csvColumn_ = static_cast<size_t>(std::max(0, config_.urlColumnIndex));
+    if (config_.sourceType == BatchUrlSourceType::CSV_FILE && !config_.urlColumnName.empty()) {
+        std::string line;
+        if (!std::getline(*sourceStream_, line)) {
+            return false;
+        }
+        std::vector<std::string> header = splitCsvLine(line);
+        auto it = std::find_if(header.begin(), header.end(), [this](const std::string& name) {
+            return toLower(name) == toLower(config_.urlColumnName);
+        });
+        if (it == header.end()) {
+            dm::utils::Logger::error("Column " + config_.urlColumnName + " not found in " + config_.sourceUrl);
+            return false;
+        }
+        csvColumn_ = static_cast<size_t>(it - header.begin());
+    }
+
+    startStreamReader();
+    return true;
 }
 
-void BatchDownloader::addBatchItemCallback(const BatchItemCallback& callback) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    m_itemCallbacks.push_back(callback);
+void BatchDownloader::closeUrlSource() {
+    // A reader blocked on a pipe stops at its next line
+    if (streamReader_) {
+        {
+            std::lock_guard<std::mutex> lock(streamReader_->mutex);
+            streamReader_->abandoned = true;
+            streamReader_->onChange = nullptr;
+        }
+        streamReader_->spaceFreed.notify_all();
+        streamReader_.reset();
+    }
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        streamChanged_ = false;
+    }
+    sourceStream_ = nullptr;
+    sourceFile_.reset();
+    scannedUrls_ = std::vector<std::string>();
+    nextUrl_ = 0;
+    lookahead_.clear();
+
+    // Deletes the spill files of the stream
+    seenUrls_.reset();
 }
 
-void BatchDownloader::processQueue() {
-    DownloadManager& downloadManager = DownloadManager::instance();
-    int totalProcessed = 0;
-    
-    while (m_isRunning) {
-        // Check if we've reached the maximum number of downloads
-        if (m_maxTotalDownloads > 0 && totalProcessed >= m_maxTotalDownloads) {
-            Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                "Reached maximum total downloads limit: " + std::to_string(m_maxTotalDownloads));
+bool BatchDownloader::fillLookahead() {
+    if (!lookahead_.empty()) {
+        return true;
+    }
+
+    // Read a group ahead and resolve its hosts while the current downloads run
+    std::string url;
+    while (lookahead_.size() < DNS_PREFETCH_BATCH) {
+        if (sourceStream_) {
+            if (!readStreamUrl(url)) {
+                break;
+            }
+        } else if (nextUrl_ < scannedUrls_.size()) {
+            url = std::move(scannedUrls_[nextUrl_++]);
+        } else {
             break;
         }
-        
-        // Wait if paused
+        lookahead_.push_back(std::move(url));
+    }
+    if (lookahead_.empty()) {
+        return false;
+    }
+
+    DnsCache::getInstance().prefetch(std::vector<std::string>(lookahead_.begin(), lookahead_.end()));
+    return true;
+}
+
+bool BatchDownloader::readStreamUrl(std::string& url) {
+    std::string line;
+    while (!jobCancelled_) {
         {
-            std::unique_lock<std::mutex> lock(m_queueMutex);
-            if (m_isPaused) {
-                m_queueCV.wait(lock, [this] { return !m_isPaused || !m_isRunning; });
-                if (!m_isRunning) break;
+            std::lock_guard<std::mutex> lock(streamReader_->mutex);
+            if (streamReader_->lines.empty()) {
+                break;
             }
+            line = std::move(streamReader_->lines.front());
+            streamReader_->lines.pop_front();
         }
-        
-        // Find next pending item and active count
-        int activeCount = 0;
-        int nextIndex = -1;
-        
-        {
-            std::lock_guard<std::mutex> lock(m_queueMutex);
-            
-            for (size_t i = 0; i < m_batchItems.size(); i++) {
-                if (m_batchItems[i].status == BatchItemStatus::ACTIVE) {
-                    activeCount++;
-                } 
-                else if (m_batchItems[i].status == BatchItemStatus::PENDING && nextIndex == -1) {
-                    nextIndex = static_cast<int>(i);
-                }
+        streamReader_->spaceFreed.notify_one();
+
+        std::string candidate;
+        if (config_.sourceType == BatchUrlSourceType::CSV_FILE) {
+            std::vector<std::string> fields = splitCsvLine(line);
+            if (csvColumn_ >= fields.size()) {
+                continue;
             }
-            
-            // No more pending items
-            if (nextIndex == -1) {
-                // If there are no active items either, we're done
-                if (activeCount == 0) {
-                    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                        "Batch download queue completed");
-                    break;
-                }
-                
-                // Wait for active downloads to finish
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            candidate = dm::utils::UrlParser::resolve("", fields[csvColumn_]);
+        } else {
+            // Skip empty lines and comments
+            line = trim(line);
+            if (line.empty() || line[0] == '#') {
                 continue;
             }
-            
-            // Check if we can start more downloads
-            if (activeCount >= m_maxConcurrentDownloads) {
-                // Wait and check again
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            candidate = dm::utils::UrlParser::resolve("", line);
+            if (candidate.empty()) {
+                dm::utils::Logger::warning("Skipping invalid URL in batch source: " + line);
                 continue;
             }
-            
-            // Set item as active
-            m_batchItems[nextIndex].status = BatchItemStatus::ACTIVE;
         }
-        
-        // Get the next item
-        BatchItem& item = m_batchItems[nextIndex];
-        
-        // Notify progress
-        notifyBatchProgress();
-        
-        // Notify item started
-        notifyBatchItem(nextIndex, BatchItemStatus::ACTIVE);
-        
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Starting batch download for URL: " + item.url);
-        
-        // Create download options
-        DownloadOptions options;
-        options.url = item.url;
-        
-        // If destination directory is not specified, use default
-        if (item.destinationDir.empty()) {
-            options.destination = downloadManager.getDefaultDownloadDirectory() + "/" + item.suggestedFilename;
-        } else {
-            // Ensure directory path ends with a separator
-            std::string dir = item.destinationDir;
-            if (!dir.empty() && dir.back() != '/' && dir.back() != '\\') {
-                dir += '/';
+
+        if (candidate.empty() || (config_.filterFunction && !config_.filterFunction(candidate)) ||
+            !seenUrls_->insert(candidate)) {
+            continue;
+        }
+        url = std::move(candidate);
+        return true;
+    }
+    return false;
+}
+
+bool BatchDownloader::isSourceExhausted() const {
+    if (!sourceStream_) {
+        return nextUrl_ >= scannedUrls_.size();
+    }
+    std::lock_guard<std::mutex> lock(streamReader_->mutex);
+    return streamReader_->exhausted && streamReader_->lines.empty();
+}
+
+void BatchDownloader::startStreamReader() {
+    streamReader_ = std::make_shared<StreamReader>();
+    streamReader_->file = sourceFile_;
+    streamReader_->stream = sourceStream_;
+    streamReader_->onChange = [this]() {
+        {
+            std::lock_guard<std::mutex> lock(eventsMutex_);
+            streamChanged_ = true;
+        }
+        eventsChanged_.notify_one();
+    };
+    std::thread(&BatchDownloader::runStreamReader, streamReader_).detach();
+}
+
+void BatchDownloader::runStreamReader(std::shared_ptr<StreamReader> reader) {
+    std::string line;
+    while (true) {
+        bool read = static_cast<bool>(std::getline(*reader->stream, line));
+
+        // The job is woken when lines start waiting and at the end, not for every line
+        std::unique_lock<std::mutex> lock(reader->mutex);
+        reader->spaceFreed.wait(lock, [&reader]() {
+            return reader->abandoned || reader->lines.size() < MAX_STREAM_LINES;
+        });
+        if (reader->abandoned) {
+            return;
+        }
+        if (!read) {
+            reader->exhausted = true;
+            reader->onChange();
+            return;
+        }
+        reader->lines.push_back(std::move(line));
+        if (reader->lines.size() == 1) {
+            reader->onChange();
+        }
+    }
+}
+
+size_t BatchDownloader::createItem(std::string url) {
+    BatchItem item;
+    item.directory = determineDestinationPath(url, config_);
+    item.filename = extractFilenameFromUrl(url);
+
+    // URLs differing only in their query would share a name, number the later ones
+    std::string path = dm::utils::FileUtils::combinePaths(item.directory, item.filename);
+    if (!usedPaths_->insert(path)) {
+        // Numbering starts over for a forgotten path, the used ones are skipped
+        if (pathCollisions_.size() >= MAX_PATH_COLLISIONS && pathCollisions_.find(path) == pathCollisions_.end()) {
+            pathCollisions_.clear();
+        }
+        int& count = pathCollisions_[path];
+        count = std::max(count, 1);
+        std::string numbered;
+        do {
+            count++;
+            numbered = item.filename;
+            size_t dot = numbered.find_last_of('.');
+            if (dot == 0 || dot == std::string::npos) {
+                dot = numbered.size();
             }
-            
-            options.destination = dir + item.suggestedFilename;
+            numbered.insert(dot, " (" + std::to_string(count) + ")");
+        } while (!usedPaths_->insert(dm::utils::FileUtils::combinePaths(item.directory, numbered)));
+        item.filename = std::move(numbered);
+    }
+    item.url = std::move(url);
+
+    if (sourceStream_) {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        totalCount_++;
+    }
+
+    size_t index = nextItemId_++;
+    items_.emplace(index, std::move(item));
+    return index;
+}
+
+bool BatchDownloader::dispatchItem(size_t index) {
+    // Queued items are only handed to this node's manager, they are not shared
+    if (config_.startImmediately && !leaseItem(index)) {
+        return false;
+    }
+
+    BatchItem& item = items_[index];
+    item.attempts++;
+
+    if (config_.skipExistingFiles &&
+        dm::utils::FileUtils::fileExists(dm::utils::FileUtils::combinePaths(item.directory, item.filename))) {
+        dm::utils::Logger::debug("Skipping existing file for " + item.url);
+        settleItem(index, true);
+        return false;
+    }
+
+    // Items that are only added stay compact records in the manager
+    if (!config_.startImmediately) {
+        bool queued = !downloadManager_.queueDownload(item.url, item.directory, item.filename,
+                                                      DownloadPriority::NORMAL, false).empty();
+        if (!queued) {
+            dm::utils::Logger::error("Failed to add batch download: " + item.url);
         }
-        
-        try {
-            // Add download to manager
-            std::shared_ptr<DownloadTask> task = downloadManager.addDownload(options);
-            
-            if (task) {
-                // Store task ID for later reference
-                item.taskId = task->getId();
-                
-                // Wait for download to complete
-                downloadManager.waitForDownload(task->getId());
-                
-                // Check final status
-                DownloadStatus status = task->getStatus();
-                
-                if (status == DownloadStatus::COMPLETED) {
-                    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                        "Batch download completed for URL: " + item.url);
-                    
-                    std::lock_guard<std::mutex> lock(m_queueMutex);
-                    item.status = BatchItemStatus::COMPLETED;
-                    totalProcessed++;
-                } 
-                else {
-                    Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                        "Batch download failed for URL: " + item.url + 
-                        " (Status: " + std::to_string(static_cast<int>(status)) + ")");
-                    
-                    std::lock_guard<std::mutex> lock(m_queueMutex);
-                    item.status = BatchItemStatus::FAILED;
-                    item.errorMessage = "Download failed with status: " + 
-                                     std::to_string(static_cast<int>(status));
-                }
-            } 
-            else {
-                Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                    "Failed to create download task for URL: " + item.url);
-                
-                std::lock_guard<std::mutex> lock(m_queueMutex);
-                item.status = BatchItemStatus::FAILED;
-                item.errorMessage = "Failed to create download task";
+        settleItem(index, queued);
+        return false;
+    }
+
+    auto task = downloadManager_.addDownload(item.url, item.directory, item.filename, true);
+    if (!task) {
+        dm::utils::Logger::error("Failed to add batch download: " + item.url);
+        settleItem(index, false);
+        return false;
+    }
+
+    // Register before reading the status: a finish reported before the
+    // registration is caught by the check, one after it by the listener
+    std::string taskId = task->getId();
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        activeItems_[taskId] = index;
+    }
+    DownloadStatus status = task->getStatus();
+    if (status == DownloadStatus::COMPLETED || status == DownloadStatus::DOWNLOAD_ERROR ||
+        status == DownloadStatus::CANCELED) {
+        postFinished(taskId, status == DownloadStatus::COMPLETED);
+    }
+
+    return true;
+}
+
+bool BatchDownloader::leaseItem(size_t index) {
+    ClusterCoordinator& cluster = ClusterCoordinator::getInstance();
+    BatchItem& item = items_[index];
+    if (!cluster.isEnabled() || !item.clusterKey.empty()) {
+        return true;
+    }
+
+    // Keys name the path as the task does, the file of another node is found
+    std::string path = item.directory + "/" + item.filename;
+    std::string key = ClusterCoordinator::makeKey("job", item.url, path);
+    switch (cluster.acquire(key)) {
+        case ClusterLeaseState::ACQUIRED:
+            item.clusterKey = key;
+            return true;
+        case ClusterLeaseState::DONE:
+            dm::utils::Logger::debug("Batch download finished by another node: " + item.url);
+            settleItem(index, true);
+            return false;
+        case ClusterLeaseState::FAILED:
+            dm::utils::Logger::debug("Batch download failed on another node: " + item.url);
+            settleItem(index, false);
+            return false;
+        case ClusterLeaseState::HELD:
+        default:
+            break;
+    }
+
+    // Join a file the holder splits across the cluster, wait for any other
+    if (cluster.isFileShared(ClusterCoordinator::makeKey("file", item.url, path))) {
+        dm::utils::Logger::debug("Joining split download of another node: " + item.url);
+        return true;
+    }
+    if (deferredItems_.empty()) {
+        deferredCheckAt_ = std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds(ClusterCoordinator::POLL_INTERVAL_MS);
+    }
+    deferredItems_.push_back(index);
+    return false;
+}
+
+void BatchDownloader::onItemFinished(size_t index, const std::string& taskId, bool succeeded) {
+    if (!succeeded && !jobCancelled_ && items_[index].attempts <= config_.retryCount) {
+        // Try again with a fresh task, dropping the failed one
+        dm::utils::Logger::info("Retrying batch download: " + items_[index].url);
+        downloadManager_.removeDownload(taskId, true);
+        retryItems_.push_back(index);
+        return;
+    }
+
+    // A stream would otherwise leave every task it ever ran in the manager
+    if (sourceStream_) {
+        downloadManager_.removeDownload(taskId, false);
+    }
+
+    settleItem(index, succeeded);
+}
+
+void BatchDownloader::settleItem(size_t index, bool succeeded) {
+    int processedCount;
+    int totalCount;
+    int successCount;
+    int failureCount;
+    {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        processedCount_++;
+        if (succeeded) {
+            successCount_++;
+        } else {
+            failureCount_++;
+            if (failedUrls_.size() < MAX_FAILED_URLS) {
+                failedUrls_.push_back(items_[index].url);
             }
-        } 
-        catch (const std::exception& e) {
-            Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                "Exception in batch download: " + std::string(e.what()));
-            
-            std::lock_guard<std::mutex> lock(m_queueMutex);
-            item.status = BatchItemStatus::FAILED;
-            item.errorMessage = e.what();
         }
-        
-        // Notify item completed or failed
-        notifyBatchItem(nextIndex, item.status);
-        
-        // Notify overall progress
-        notifyBatchProgress();
+        processedCount = processedCount_;
+        totalCount = totalCount_;
+        successCount = successCount_;
+        failureCount = failureCount_;
+    }
+    if (!items_[index].clusterKey.empty()) {
+        ClusterCoordinator::getInstance().complete(items_[index].clusterKey, succeeded);
+    }
+    items_.erase(index);
+
+    updateJobProgress(processedCount, totalCount, successCount, failureCount);
+}
+
+void BatchDownloader::postFinished(const std::string& taskId, bool succeeded) {
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex_);
+        if (activeItems_.find(taskId) == activeItems_.end()) {
+            return;
+        }
+        finishedTasks_.push_back(FinishedTask{taskId, succeeded});
     }
-    
-    m_isRunning = false;
+    eventsChanged_.notify_one();
 }
 
-bool BatchDownloader::isValidUrl(const std::string& url) {
-    Utils::UrlParser urlParser;
-    auto parsedUrl = urlParser.parse(url);
-    return parsedUrl.valid;
+std::string BatchDownloader::extractFilenameFromUrl(const std::string& url) {
+    std::string filename;
+
+    CURLU* handle = curl_url();
+    if (handle) {
+        if (curl_url_set(handle, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK) {
+            std::string path = dm::utils::UrlParser::getPart(handle, CURLUPART_PATH, CURLU_URLDECODE);
+            size_t slash = path.find_last_of('/');
+            filename = sanitizeName(slash == std::string::npos ? path : path.substr(slash + 1));
+        }
+        curl_url_cleanup(handle);
+    }
+
+    return filename.empty() ? "index.html" : filename;
 }
 
-void BatchDownloader::notifyBatchProgress() {
-    int total = getTotalItems();
-    int completed = getCompletedItems();
-    int failed = getFailedItems();
-    int active = getActiveItems();
-    int pending = getPendingItems();
-    
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    for (const auto& callback : m_progressCallbacks) {
-        callback(total, completed, failed, active, pending);
+std::string BatchDownloader::determineDestinationPath(const std::string& url,
+                                                     const BatchDownloadConfig& config) {
+    std::string directory = config.destinationDirectory.empty() ?
+                            downloadManager_.getDefaultDownloadDirectory() : config.destinationDirectory;
+    if (!config.createSubdirectories) {
+        return directory;
     }
+
+    // Mirror the host and the URL's directories below the destination
+    CURLU* handle = curl_url();
+    if (!handle) {
+        return directory;
+    }
+    if (curl_url_set(handle, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK) {
+        std::string host = sanitizeName(dm::utils::UrlParser::getPart(handle, CURLUPART_HOST));
+        if (!host.empty()) {
+            directory = dm::utils::FileUtils::combinePaths(directory, host);
+        }
+
+        std::string path = dm::utils::UrlParser::getPart(handle, CURLUPART_PATH, CURLU_URLDECODE);
+        size_t start = 0;
+        size_t slash;
+        while ((slash = path.find('/', start)) != std::string::npos) {
+            std::string component = sanitizeName(path.substr(start, slash - start));
+            if (!component.empty()) {
+                directory = dm::utils::FileUtils::combinePaths(directory, component);
+            }
+            start = slash + 1;
+        }
+    }
+    curl_url_cleanup(handle);
+
+    return directory;
 }
 
-void BatchDownloader::notifyBatchItem(int index, BatchItemStatus status) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    for (const auto& callback : m_itemCallbacks) {
-        callback(index, status);
+void BatchDownloader::updateJobProgress(int processedCount, int totalCount,
+                                        int successCount, int failureCount) {
+    double overallProgress = totalCount > 0 ? 100.0 * processedCount / totalCount : 0.0;
+    {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        processedCount_ = processedCount;
+        totalCount_ = totalCount;
+        overallProgress_ = overallProgress;
+        successCount_ = successCount;
+        failureCount_ = failureCount;
+    }
+
+    if (progressCallback_) {
+        progressCallback_(processedCount, totalCount, overallProgress, successCount, failureCount);
     }
 }
 
-} // namespace Core
-} // namespace DownloadManager
\ No newline at end of file
+} // namespace core
+} // namespace dm
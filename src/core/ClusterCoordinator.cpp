@@ -0,0 +1,563 @@
+#include "core/ClusterCoordinator.h"
+#include "core/LinkStats.h"
+#include "utils/UrlFingerprintSet.h"
+#include "utils/Logger.h"
+#include "utils/Tracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+constexpr const char* LOCK_FILE = "cluster.lock";
+constexpr const char* LEASES = "leases";
+constexpr const char* DONE = "done";
+constexpr const char* FILES = "files";
+constexpr const char* NODES = "nodes";
+constexpr int TABLE_LOCK_RETRY_MS = 20;
+
+/**
+ * @brief Read the tab separated fields of a table entry
+ */
+bool readEntry(const std::string& path, std::vector<std::string>& fields) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        return false;
+    }
+    fields.clear();
+    std::istringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '\t')) {
+        fields.push_back(field);
+    }
+    return !fields.empty();
+}
+
+bool writeEntry(const std::string& path, const std::string& line) {
+    std::ofstream out(path, std::ios::trunc);
+    out << line << '\n';
+    out.close();
+    return static_cast<bool>(out);
+}
+
+void removeEntry(const std::string& path) {
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+std::string getDefaultNodeId() {
+    char host[256] = {0};
+#ifdef _WIN32
+    DWORD size = sizeof(host);
+    if (!GetComputerNameA(host, &size)) {
+        host[0] = '\0';
+    }
+    int pid = _getpid();
+#else
+    if (gethostname(host, sizeof(host) - 1) != 0) {
+        host[0] = '\0';
+    }
+    int pid = static_cast<int>(getpid());
+#endif
+    std::string id = host[0] ? host : "node";
+    std::replace_if(id.begin(), id.end(), [](char c) { return c == '/' || c == '\\' || c == '\t'; }, '_');
+    return id + "-" + std::to_string(pid);
+}
+
+} // anonymous namespace
+
+ClusterCoordinator::TableLock::TableLock(const std::string& path) {
+#ifdef _WIN32
+    handle_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle_ == INVALID_HANDLE_VALUE) {
+        handle_ = nullptr;
+        return;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TABLE_LOCK_TIMEOUT_MS);
+    OVERLAPPED overlapped = {};
+    while (!LockFileEx(handle_, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, MAXDWORD, MAXDWORD, &overlapped)) {
+        if (GetLastError() != ERROR_LOCK_VIOLATION || std::chrono::steady_clock::now() >= deadline) {
+            CloseHandle(handle_);
+            handle_ = nullptr;
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(TABLE_LOCK_RETRY_MS));
+    }
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        return;
+    }
+    // Locks are per process, threads are kept apart by mutex_
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TABLE_LOCK_TIMEOUT_MS);
+    struct flock lock = {};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    int result;
+    while ((result = fcntl(fd_, F_SETLK, &lock)) != 0) {
+        bool contended = errno == EACCES || errno == EAGAIN || errno == EINTR;
+        if (!contended || std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(TABLE_LOCK_RETRY_MS));
+    }
+    if (result != 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+ClusterCoordinator::TableLock::~TableLock() {
+#ifdef _WIN32
+    if (handle_) {
+        OVERLAPPED overlapped = {};
+        UnlockFileEx(handle_, 0, MAXDWORD, MAXDWORD, &overlapped);
+        CloseHandle(handle_);
+    }
+#else
+    // Closing the descriptor drops the lock
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+#endif
+}
+
+bool ClusterCoordinator::TableLock::isLocked() const {
+#ifdef _WIN32
+    return handle_ != nullptr;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+ClusterCoordinator& ClusterCoordinator::getInstance() {
+    static ClusterCoordinator instance;
+    return instance;
+}
+
+ClusterCoordinator::ClusterCoordinator()
+    : nodeId_(getDefaultNodeId()), enabled_(false), leaseSeconds_(DEFAULT_LEASE_SECONDS),
+      splitSize_(DEFAULT_SPLIT_SIZE), pieceSize_(DEFAULT_PIECE_SIZE) {
+}
+
+ClusterCoordinator::~ClusterCoordinator() {
+    shutdown();
+}
+
+bool ClusterCoordinator::setDirectory(const std::string& directory) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (directory == directory_ && enabled_ == !directory.empty()) {
+            return true;
+        }
+    }
+    shutdown();
+    if (directory.empty()) {
+        return true;
+    }
+
+    std::error_code error;
+    for (const char* table : {LEASES, DONE, FILES, NODES}) {
+        std::filesystem::create_directories(std::filesystem::path(directory) / table, error);
+        if (error) {
+            dm::utils::Logger::error("Cluster directory not usable: " + directory + ": " + error.message());
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directory_ = directory;
+        if (!TableLock((std::filesystem::path(directory_) / LOCK_FILE).string()).isLocked()) {
+            dm::utils::Logger::error("Cluster directory cannot be locked: " + directory);
+            directory_.clear();
+            return false;
+        }
+        enabled_ = true;
+        stopRenewal_ = false;
+        renewalThread_ = std::make_unique<std::thread>(&ClusterCoordinator::renewalThread, this);
+    }
+    renew();
+
+    dm::utils::Logger::info("Cluster node " + getNodeId() + " sharing work through " + directory);
+    return true;
+}
+
+bool ClusterCoordinator::isEnabled() const {
+    return enabled_;
+}
+
+void ClusterCoordinator::setNodeId(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodeId_ = id.empty() ? getDefaultNodeId() : id;
+    std::replace_if(nodeId_.begin(), nodeId_.end(), [](char c) { return c == '/' || c == '\\' || c == '\t'; }, '_');
+}
+
+std::string ClusterCoordinator::getNodeId() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nodeId_;
+}
+
+void ClusterCoordinator::setLeaseSeconds(int seconds) {
+    leaseSeconds_ = std::max(MIN_LEASE_SECONDS, seconds);
+    renewalCv_.notify_all();
+}
+
+int ClusterCoordinator::getLeaseSeconds() const {
+    return leaseSeconds_;
+}
+
+void ClusterCoordinator::setSplitSize(int64_t bytes) {
+    splitSize_ = std::max<int64_t>(0, bytes);
+}
+
+int64_t ClusterCoordinator::getSplitSize() const {
+    return splitSize_;
+}
+
+void ClusterCoordinator::setPieceSize(int64_t bytes) {
+    pieceSize_ = std::max(MIN_PIECE_SIZE, bytes);
+}
+
+int64_t ClusterCoordinator::getPieceSize() const {
+    return pieceSize_;
+}
+
+std::string ClusterCoordinator::makeKey(const std::string& kind, const std::string& url, const std::string& filePath) {
+    std::ostringstream key;
+    key << kind << '-' << std::hex << std::setw(16) << std::setfill('0')
+        << dm::utils::UrlFingerprintSet::fingerprint(url + '\n' + filePath);
+    return key.str();
+}
+
+std::string ClusterCoordinator::makePieceKey(const std::string& fileKey, int64_t piece) {
+    return fileKey + "." + std::to_string(piece);
+}
+
+ClusterLeaseState ClusterCoordinator::acquire(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return ClusterLeaseState::ACQUIRED;
+    }
+    TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+    if (!table.isLocked()) {
+        dm::utils::Logger::warning("Cluster table locked out, leaving " + key + " to other nodes");
+        return ClusterLeaseState::HELD;
+    }
+    return lookup(key);
+}
+
+void ClusterCoordinator::release(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_ || held_.erase(key) == 0) {
+        return;
+    }
+    TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+    std::vector<std::string> fields;
+    std::string path = getPath(LEASES, key);
+    if (table.isLocked() && readEntry(path, fields) && fields[0] == nodeId_) {
+        removeEntry(path);
+    }
+}
+
+bool ClusterCoordinator::complete(const std::string& key, bool succeeded) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return true;
+    }
+    TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+    if (!table.isLocked()) {
+        dm::utils::Logger::warning("Cluster table locked out, " + key + " not recorded done yet");
+        return false;
+    }
+    writeEntry(getPath(DONE, key), nodeId_ + "\t" + (succeeded ? "1" : "0"));
+    removeEntry(getPath(LEASES, key));
+    held_.erase(key);
+    completed_++;
+    return true;
+}
+
+ClusterFileState ClusterCoordinator::joinFile(const std::string& fileKey) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return ClusterFileState::CREATE;
+    }
+    TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+    if (!table.isLocked()) {
+        return ClusterFileState::PREPARING;
+    }
+
+    std::error_code error;
+    std::vector<std::string> fields;
+    std::string path = getPath(FILES, fileKey);
+    if (readEntry(getPath(DONE, fileKey), fields)) {
+        // A node joining just as the file finished finds its pieces done
+        if (fields.size() >= 3 && now() - std::atoll(fields[2].c_str()) < FILE_READY_TIMEOUT_SECONDS * 1000LL) {
+            return ClusterFileState::READY;
+        }
+
+        // Downloaded again, the pieces of the earlier run say nothing now
+        removeEntry(getPath(DONE, fileKey));
+        std::string prefix = fileKey + ".";
+        for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::path(directory_) / DONE, error)) {
+            if (entry.path().filename().string().compare(0, prefix.size(), prefix) == 0) {
+                removeEntry(entry.path().string());
+            }
+        }
+        removeEntry(path);
+    } else if (readEntry(path, fields) && fields.size() >= 3) {
+        if (fields[1] == "ready") {
+            return ClusterFileState::READY;
+        }
+        // A node that died creating the file leaves it to the next one
+        bool abandoned = now() - std::atoll(fields[2].c_str()) > FILE_READY_TIMEOUT_SECONDS * 1000LL;
+        if (fields[0] != nodeId_ && !abandoned) {
+            return ClusterFileState::PREPARING;
+        }
+    }
+
+    writeEntry(path, nodeId_ + "\tpreparing\t" + std::to_string(now()));
+    return ClusterFileState::CREATE;
+}
+
+bool ClusterCoordinator::isFileShared(const std::string& fileKey) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return false;
+    }
+    std::vector<std::string> fields;
+    return readEntry(getPath(FILES, fileKey), fields) && fields.size() >= 2 && fields[1] == "ready";
+}
+
+void ClusterCoordinator::markFileReady(const std::string& fileKey) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return;
+    }
+    TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+    writeEntry(getPath(FILES, fileKey), nodeId_ + "\tready\t" + std::to_string(now()));
+}
+
+void ClusterCoordinator::finishFile(const std::string& fileKey) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return;
+    }
+    TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+    if (!table.isLocked()) {
+        return;
+    }
+    writeEntry(getPath(DONE, fileKey), nodeId_ + "\t1\t" + std::to_string(now()));
+    removeEntry(getPath(FILES, fileKey));
+}
+
+std::vector<ClusterNodeStats> ClusterCoordinator::getNodes() const {
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_) {
+            return {};
+        }
+        directory = directory_;
+    }
+
+    // Reports are renamed into place, a reader never sees half of one
+    std::vector<ClusterNodeStats> nodes;
+    std::error_code error;
+    int64_t staleBefore = now() - 2LL * leaseSeconds_ * 1000;
+    for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::path(directory) / NODES, error)) {
+        std::vector<std::string> fields;
+        if (entry.path().extension() == ".tmp" || !readEntry(entry.path().string(), fields) || fields.size() < 5) {
+            continue;
+        }
+        ClusterNodeStats node;
+        node.id = fields[0];
+        node.updatedAt = std::atoll(fields[1].c_str());
+        node.throughput = std::strtod(fields[2].c_str(), nullptr);
+        node.leases = std::atoi(fields[3].c_str());
+        node.completed = std::atoll(fields[4].c_str());
+        node.stale = node.updatedAt < staleBefore;
+        nodes.push_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const ClusterNodeStats& a, const ClusterNodeStats& b) {
+        return a.id < b.id;
+    });
+    return nodes;
+}
+
+void ClusterCoordinator::post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (renewalThread_) {
+            jobs_.push_back(std::move(job));
+            renewalCv_.notify_all();
+            return;
+        }
+    }
+    job();
+}
+
+void ClusterCoordinator::shutdown() {
+    std::unique_ptr<std::thread> thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopRenewal_ = true;
+        thread = std::move(renewalThread_);
+    }
+    renewalCv_.notify_all();
+    if (thread && thread->joinable()) {
+        thread->join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return;
+    }
+
+    // Unfinished work goes straight back to the other nodes
+    {
+        TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+        if (table.isLocked()) {
+            for (const auto& lease : held_) {
+                std::vector<std::string> fields;
+                std::string path = getPath(LEASES, lease.first);
+                if (readEntry(path, fields) && fields[0] == nodeId_) {
+                    removeEntry(path);
+                }
+            }
+        }
+    }
+    removeEntry(getPath(NODES, nodeId_));
+
+    held_.clear();
+    enabled_ = false;
+    directory_.clear();
+}
+
+ClusterLeaseState ClusterCoordinator::lookup(const std::string& key) {
+    std::vector<std::string> fields;
+    if (readEntry(getPath(DONE, key), fields)) {
+        return fields.size() >= 2 && fields[1] == "0" ? ClusterLeaseState::FAILED : ClusterLeaseState::DONE;
+    }
+
+    // A lease that ran out is the node's to take, its holder stopped renewing
+    if (readEntry(getPath(LEASES, key), fields) && fields.size() >= 2 && fields[0] != nodeId_ &&
+        std::atoll(fields[1].c_str()) > now()) {
+        return ClusterLeaseState::HELD;
+    }
+
+    if (!writeLease(key)) {
+        dm::utils::Logger::warning("Failed to write cluster lease " + key);
+        return ClusterLeaseState::HELD;
+    }
+    return ClusterLeaseState::ACQUIRED;
+}
+
+bool ClusterCoordinator::writeLease(const std::string& key) {
+    int64_t expires = now() + leaseSeconds_ * 1000LL;
+    if (!writeEntry(getPath(LEASES, key), nodeId_ + "\t" + std::to_string(expires))) {
+        return false;
+    }
+    held_[key] = expires;
+    return true;
+}
+
+std::string ClusterCoordinator::getPath(const char* table, const std::string& key) const {
+    return (std::filesystem::path(directory_) / table / key).string();
+}
+
+void ClusterCoordinator::renew() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return;
+    }
+
+    {
+        TableLock table((std::filesystem::path(directory_) / LOCK_FILE).string());
+        if (table.isLocked()) {
+            for (auto it = held_.begin(); it != held_.end();) {
+                std::vector<std::string> fields;
+                if (readEntry(getPath(LEASES, it->first), fields) && fields[0] != nodeId_) {
+                    // Renewed too late, the piece may be fetched twice, into the same bytes
+                    dm::utils::Logger::warning("Cluster lease " + it->first + " was taken over by " + fields[0]);
+                    it = held_.erase(it);
+                    continue;
+                }
+                writeLease(it->first);
+                ++it;
+            }
+        } else {
+            dm::utils::Logger::warning("Cluster table locked out, leases not renewed");
+        }
+    }
+
+    // The report is the node's own, written aside and renamed without the lock
+    std::ostringstream report;
+    report << nodeId_ << '\t' << now() << '\t'
+           << static_cast<int64_t>(LinkStats::getInstance().getRecent().throughput) << '\t'
+           << held_.size() << '\t' << completed_;
+    std::string path = getPath(NODES, nodeId_);
+    std::string temporary = path + ".tmp";
+    if (!writeEntry(temporary, report.str()) || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        removeEntry(temporary);
+    }
+}
+
+void ClusterCoordinator::renewalThread() {
+    DM_TRACE_THREAD("cluster-renewal");
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto renewedAt = std::chrono::steady_clock::now();
+    while (true) {
+        auto renewAt = renewedAt + std::chrono::milliseconds(leaseSeconds_ * 1000LL / 3);
+        renewalCv_.wait_until(lock, renewAt, [this]() {
+            return stopRenewal_ || !jobs_.empty();
+        });
+
+        // Posted work first, all of it before stopping
+        while (!jobs_.empty()) {
+            std::function<void()> job = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+        if (stopRenewal_) {
+            break;
+        }
+        if (std::chrono::steady_clock::now() >= renewAt) {
+            lock.unlock();
+            renew();
+            lock.lock();
+            renewedAt = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+int64_t ClusterCoordinator::now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace core
+} // namespace dm
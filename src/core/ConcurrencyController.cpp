@@ -0,0 +1,116 @@
+#include "core/ConcurrencyController.h"
+#include "utils/Logger.h"
+#include "utils/FileUtils.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace dm {
+namespace core {
+
+ConcurrencyController::ConcurrencyController(int minConnections, int maxConnections)
+    : minConnections_(std::max(1, minConnections)),
+      maxConnections_(std::max(minConnections_, maxConnections)),
+      connections_(std::min(maxConnections_, std::max(minConnections_, INITIAL_CONNECTIONS))),
+      baselineSince_(std::chrono::steady_clock::now()) {
+}
+
+int ConcurrencyController::update(const LinkSample& sample) {
+    // The baseline follows the link as it changes
+    auto now = std::chrono::steady_clock::now();
+    if (now - baselineSince_ >= std::chrono::seconds(BASELINE_WINDOW_SECONDS)) {
+        minLatencyMs_ = 0.0;
+        maxThroughput_ = 0.0;
+        baselineSince_ = now;
+    }
+    if (sample.latencyMs > 0.0 && (minLatencyMs_ <= 0.0 || sample.latencyMs < minLatencyMs_)) {
+        minLatencyMs_ = sample.latencyMs;
+    }
+    maxThroughput_ = std::max(maxThroughput_, sample.throughput);
+
+    int from = connections_;
+
+    // Congestion: back off multiplicatively
+    bool lossy = sample.transfers > 0 && sample.packetLoss > LOSS_THRESHOLD_PERCENT;
+    bool inflated = sample.latencyMs > 0.0 && minLatencyMs_ > 0.0 &&
+                    sample.latencyMs > minLatencyMs_ * LATENCY_INFLATION;
+    if (lossy || inflated) {
+        connections_ = std::max(minConnections_, static_cast<int>(connections_ * DECREASE_FACTOR));
+        startup_ = false;
+        plateau_ = false;
+        throughputBeforeStep_ = -1.0;
+        heldIntervals_ = 0;
+        logDecision(from, lossy ? "loss" : "latency", sample);
+        return connections_;
+    }
+
+    // Judge the last increase by what it did to throughput
+    if (throughputBeforeStep_ >= 0.0) {
+        bool gained = sample.throughput >= throughputBeforeStep_ * (1.0 + GAIN_THRESHOLD);
+        throughputBeforeStep_ = -1.0;
+        if (!gained) {
+            connections_ = connectionsBeforeStep_;
+            startup_ = false;
+            plateau_ = true;
+            logDecision(from, "no gain", sample);
+            return connections_;
+        }
+    }
+
+    // Only a budget in full use holds throughput back
+    heldIntervals_++;
+    bool saturated = sample.connections >= connections_;
+    if (saturated && connections_ < maxConnections_ && (!plateau_ || heldIntervals_ >= PROBE_INTERVALS)) {
+        throughputBeforeStep_ = sample.throughput;
+        connectionsBeforeStep_ = connections_;
+        connections_ = startup_ ? std::min(maxConnections_, connections_ * 2) : connections_ + 1;
+        plateau_ = false;
+        heldIntervals_ = 0;
+        logDecision(from, startup_ ? "startup" : "probe", sample);
+        return connections_;
+    }
+
+    logDecision(from, saturated ? (plateau_ ? "plateau" : "at maximum") : "not in full use", sample);
+    return connections_;
+}
+
+int ConcurrencyController::getConnections() const {
+    return connections_;
+}
+
+void ConcurrencyController::setBounds(int minConnections, int maxConnections) {
+    minConnections_ = std::max(1, minConnections);
+    maxConnections_ = std::max(minConnections_, maxConnections);
+    connections_ = std::min(maxConnections_, std::max(minConnections_, connections_));
+}
+
+void ConcurrencyController::logDecision(int from, const std::string& reason, const LinkSample& sample) const {
+    bool changed = from != connections_;
+    dm::utils::LogLevel level = changed ? dm::utils::LogLevel::INFO : dm::utils::LogLevel::DEBUG;
+    if (!dm::utils::Logger::isEnabled(level)) {
+        return;
+    }
+
+    std::ostringstream log;
+    log << std::fixed << std::setprecision(1);
+    if (changed) {
+        log << "Connection budget " << from << " -> " << connections_;
+    } else {
+        log << "Connection budget holds at " << connections_;
+    }
+    log << " (" << reason << "): "
+        << dm::utils::FileUtils::formatFileSize(static_cast<int64_t>(sample.throughput)) << "/s (max "
+        << dm::utils::FileUtils::formatFileSize(static_cast<int64_t>(maxThroughput_)) << "/s), rtt "
+        << sample.latencyMs << " ms (min " << minLatencyMs_ << "), loss " << sample.packetLoss
+        << "% over " << sample.transfers << " transfers, " << sample.connections << " in use";
+
+    if (changed) {
+        dm::utils::Logger::info(log.str());
+    } else {
+        dm::utils::Logger::debug(log.str());
+    }
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,209 @@
+#include "core/ContentSniffer.h"
+#include "core/OutputFile.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+struct RecordedSample {
+    ContentSample sample;
+    std::filesystem::file_time_type modified;
+    uint64_t sequence;
+};
+
+std::mutex recordedSamplesMutex;
+std::map<std::string, RecordedSample> recordedSamples;
+std::deque<std::pair<std::string, uint64_t>> recordedOrder;     // Oldest first, stale once re-recorded
+uint64_t nextSequence = 0;
+
+} // namespace
+
+ContentSniffer::ContentSniffer() {
+    head_.resize(HEAD_SIZE);
+    tail_.reserve(TAIL_SIZE);
+}
+
+void ContentSniffer::onWrite(const char* data, size_t size, int64_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int64_t end = offset + static_cast<int64_t>(size);
+
+    // Extend the head while writes continue it
+    if (offset <= static_cast<int64_t>(headEnd_) && end > static_cast<int64_t>(headEnd_) && headEnd_ < HEAD_SIZE) {
+        size_t from = headEnd_ - static_cast<size_t>(offset);
+        size_t count = std::min(HEAD_SIZE - headEnd_, size - from);
+        head_.replace(headEnd_, count, data + from, count);
+        headEnd_ += count;
+    }
+
+    // Keep the last bytes of whatever extends the file the furthest
+    if (end <= tailEnd_) {
+        return;
+    }
+    int64_t tailStart = tailEnd_ - static_cast<int64_t>(tail_.size());
+    if (offset > tailEnd_ || offset < tailStart) {
+        // A new range further out, or one covering the tail entirely
+        size_t keep = std::min(size, TAIL_SIZE);
+        tail_.assign(data + size - keep, keep);
+    } else {
+        size_t from = static_cast<size_t>(tailEnd_ - offset);
+        size_t count = size - from;
+        if (count >= TAIL_SIZE) {
+            tail_.assign(data + size - TAIL_SIZE, TAIL_SIZE);
+        } else {
+            size_t overflow = tail_.size() + count > TAIL_SIZE ? tail_.size() + count - TAIL_SIZE : 0;
+            tail_.erase(0, overflow);
+            tail_.append(data + from, count);
+        }
+    }
+    tailEnd_ = end;
+}
+
+void ContentSniffer::discard(int64_t start, int64_t end) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The head continues from the range once its data comes again
+    if (start < static_cast<int64_t>(headEnd_)) {
+        headEnd_ = static_cast<size_t>(start);
+    }
+    int64_t tailStart = tailEnd_ - static_cast<int64_t>(tail_.size());
+    if (start < tailEnd_ && end > tailStart) {
+        tail_.clear();
+        tailEnd_ = 0;
+    }
+}
+
+bool ContentSniffer::finish(OutputFile& file, int64_t totalSize) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int64_t size = totalSize >= 0 ? totalSize : tailEnd_;
+
+    // Read back what an earlier session wrote
+    size_t headSize = static_cast<size_t>(std::min<int64_t>(size, HEAD_SIZE));
+    if (headEnd_ < headSize) {
+        if (!file.readAt(&head_[headEnd_], headSize - headEnd_, static_cast<int64_t>(headEnd_))) {
+            return false;
+        }
+        headEnd_ = headSize;
+    }
+    size_t tailSize = static_cast<size_t>(std::min<int64_t>(size, TAIL_SIZE));
+    if (tailEnd_ != size || tail_.size() < tailSize) {
+        tail_.resize(tailSize);
+        if (tailSize > 0 && !file.readAt(&tail_[0], tailSize, size - static_cast<int64_t>(tailSize))) {
+            return false;
+        }
+        tailEnd_ = size;
+    }
+
+    sample_.head.assign(head_, 0, headSize);
+    sample_.tail = tail_.substr(tail_.size() - tailSize);
+    sample_.fileSize = size;
+    sample_.signature = dm::utils::MagicMatcher::getInstance().match(sample_.head);
+    return true;
+}
+
+ContentSample ContentSniffer::getSample() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sample_;
+}
+
+void ContentSniffer::recordSample(const std::string& filePath, const ContentSample& sample) {
+    std::error_code error;
+    RecordedSample entry;
+    entry.sample = sample;
+    entry.modified = std::filesystem::last_write_time(filePath, error);
+    if (error || sample.fileSize < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(recordedSamplesMutex);
+    entry.sequence = nextSequence++;
+    recordedSamples[filePath] = entry;
+    recordedOrder.emplace_back(filePath, entry.sequence);
+
+    // Evict the oldest, and drop order entries of samples since replaced
+    while (!recordedOrder.empty()) {
+        auto it = recordedSamples.find(recordedOrder.front().first);
+        bool current = it != recordedSamples.end() && it->second.sequence == recordedOrder.front().second;
+        if (current && recordedSamples.size() <= MAX_RECORDED_SAMPLES) {
+            break;
+        }
+        if (current) {
+            recordedSamples.erase(it);
+        }
+        recordedOrder.pop_front();
+    }
+    if (recordedOrder.size() > 2 * MAX_RECORDED_SAMPLES) {
+        std::deque<std::pair<std::string, uint64_t>> order;
+        for (const auto& item : recordedOrder) {
+            auto it = recordedSamples.find(item.first);
+            if (it != recordedSamples.end() && it->second.sequence == item.second) {
+                order.push_back(item);
+            }
+        }
+        recordedOrder.swap(order);
+    }
+}
+
+bool ContentSniffer::findSample(const std::string& filePath, ContentSample& sample) {
+    std::error_code error;
+    int64_t size = static_cast<int64_t>(std::filesystem::file_size(filePath, error));
+    if (error) {
+        return false;
+    }
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(filePath, error);
+    if (error) {
+        return false;
+    }
+
+    // Only trust the sample while the file is unchanged
+    {
+        std::lock_guard<std::mutex> lock(recordedSamplesMutex);
+        auto it = recordedSamples.find(filePath);
+        if (it != recordedSamples.end()) {
+            if (it->second.sample.fileSize == size && it->second.modified == modified) {
+                sample = it->second.sample;
+                return true;
+            }
+            recordedSamples.erase(it);
+        }
+    }
+
+    // Not downloaded in this session: one read of each end
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    ContentSample read;
+    read.fileSize = size;
+    read.head.resize(static_cast<size_t>(std::min<int64_t>(size, HEAD_SIZE)));
+    read.tail.resize(static_cast<size_t>(std::min<int64_t>(size, TAIL_SIZE)));
+    file.read(&read.head[0], static_cast<std::streamsize>(read.head.size()));
+    file.seekg(size - static_cast<int64_t>(read.tail.size()));
+    file.read(&read.tail[0], static_cast<std::streamsize>(read.tail.size()));
+    if (!file) {
+        dm::utils::Logger::warning("Failed to read content sample of " + filePath);
+        return false;
+    }
+    read.signature = dm::utils::MagicMatcher::getInstance().match(read.head);
+
+    recordSample(filePath, read);
+    sample = read;
+    return true;
+}
+
+void ContentSniffer::forgetSample(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(recordedSamplesMutex);
+    recordedSamples.erase(filePath);
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,249 @@
+#include "core/ContentStore.h"
+#include "utils/FileUtils.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const size_t MIN_OBJECT_HASH_LENGTH = 8;
+const char* const REFERENCES_EXTENSION = ".refs";    // Paths an object was copied to, one per line
+
+} // anonymous namespace
+
+ContentStore& ContentStore::getInstance() {
+    static ContentStore instance;
+    return instance;
+}
+
+void ContentStore::setDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_ = directory;
+}
+
+bool ContentStore::isEnabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !directory_.empty();
+}
+
+void ContentStore::setHardLinks(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hardLinks_ = enabled;
+}
+
+bool ContentStore::place(dm::utils::HashAlgorithm algorithm, const std::string& hash, const std::string& filePath) {
+    std::string objectPath = getObjectPath(algorithm, hash);
+    if (objectPath.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!verify(objectPath, algorithm, hash)) {
+        return false;
+    }
+    if (!link(objectPath, filePath, hardLinks_)) {
+        dm::utils::Logger::warning("Failed to place stored copy " + objectPath + " at " + filePath);
+        return false;
+    }
+    addReference(objectPath, filePath);
+
+    // A reflink has a hash entry of its own to record
+    dm::utils::HashCalculator::recordStreamedHash(filePath, algorithm, hash);
+    dm::utils::Logger::debug("Placed stored copy " + objectPath + " at " + filePath);
+    return true;
+}
+
+void ContentStore::add(const std::string& filePath, dm::utils::HashAlgorithm algorithm, const std::string& hash) {
+    std::string objectPath = getObjectPath(algorithm, hash);
+    if (objectPath.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code error;
+    if (fs::exists(objectPath, error)) {
+        if (fs::equivalent(objectPath, filePath, error)) {
+            return;
+        }
+
+        // The same bytes are stored already, share them instead of keeping both
+        if (verify(objectPath, algorithm, hash)) {
+            std::string temporary = filePath + ".dedup";
+            fs::remove(temporary, error);
+            if (link(objectPath, temporary, hardLinks_)) {
+                fs::rename(temporary, filePath, error);
+                if (!error) {
+                    addReference(objectPath, filePath);
+                    dm::utils::HashCalculator::recordStreamedHash(filePath, algorithm, hash);
+                    dm::utils::Logger::info("Deduplicated " + filePath + " against " + objectPath);
+                    return;
+                }
+                fs::remove(temporary, error);
+            }
+            dm::utils::Logger::debug("Not deduplicating " + filePath + " against " + objectPath +
+                                     ", the filesystem has no reflinks");
+            return;
+        }
+    }
+
+    // Copied aside and renamed, a crash never leaves an object with partial content
+    std::string temporary = objectPath + ".tmp";
+    fs::create_directories(fs::path(objectPath).parent_path(), error);
+    fs::remove(temporary, error);
+    if (!link(filePath, temporary, hardLinks_)) {
+        dm::utils::Logger::debug("Not storing " + filePath + ", the filesystem has no reflinks");
+        return;
+    }
+    fs::rename(temporary, objectPath, error);
+    if (error) {
+        fs::remove(temporary, error);
+        dm::utils::Logger::debug("Not storing " + filePath + ": " + error.message());
+        return;
+    }
+    addReference(objectPath, filePath);
+
+    dm::utils::HashCalculator::recordStreamedHash(objectPath, algorithm, hash);
+    dm::utils::Logger::debug("Stored " + filePath + " as " + objectPath);
+}
+
+size_t ContentStore::prune() {
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directory = directory_;
+    }
+    std::error_code error;
+    if (directory.empty() || !fs::is_directory(directory, error)) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t removed = 0;
+    for (fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, error), end;
+         !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file(error)) {
+            continue;
+        }
+
+        // No copy of it is left, or left over by a crash; references go with their object
+        std::string extension = it->path().extension().string();
+        if (extension == REFERENCES_EXTENSION) {
+            if (!fs::exists(it->path().parent_path() / it->path().stem(), error) && !error) {
+                fs::remove(it->path(), error);
+            }
+            error.clear();
+            continue;
+        }
+        if ((extension == ".tmp" || !isReferenced(it->path().string())) && fs::remove(it->path(), error)) {
+            fs::remove(it->path().string() + REFERENCES_EXTENSION, error);
+            removed++;
+        }
+        error.clear();
+    }
+
+    if (removed > 0) {
+        dm::utils::Logger::info("Removed " + std::to_string(removed) + " unused objects from the content store");
+    }
+    return removed;
+}
+
+std::string ContentStore::getObjectPath(dm::utils::HashAlgorithm algorithm, const std::string& hash) const {
+    // The name is the hash, it must not be able to leave the store
+    if (hash.size() < MIN_OBJECT_HASH_LENGTH ||
+        !std::all_of(hash.begin(), hash.end(), [](unsigned char c) { return std::isxdigit(c); })) {
+        return "";
+    }
+
+    std::string name = hash;
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directory_.empty()) {
+        return "";
+    }
+    return directory_ + "/" + dm::utils::HashCalculator::getAlgorithmName(algorithm) + "/" +
+           name.substr(0, 2) + "/" + name;
+}
+
+bool ContentStore::verify(const std::string& objectPath, dm::utils::HashAlgorithm algorithm, const std::string& hash) {
+    std::error_code error;
+    if (!fs::is_regular_file(objectPath, error)) {
+        return false;
+    }
+
+    // Cheap while the object is unchanged, the manifest knows its hash
+    std::string expected = hash;
+    std::transform(expected.begin(), expected.end(), expected.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    dm::utils::HashCalculator calculator;
+    std::string actual = calculator.calculateHashCached(objectPath, algorithm);
+    std::transform(actual.begin(), actual.end(), actual.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (actual == expected) {
+        return true;
+    }
+
+    // A hard linked copy was edited
+    dm::utils::Logger::warning("Dropping changed content store object: " + objectPath);
+    fs::remove(objectPath, error);
+    return false;
+}
+
+bool ContentStore::link(const std::string& sourcePath, const std::string& destPath, bool hardLinks) {
+    // A reflink can be edited without touching the other copy
+    if (dm::utils::FileUtils::cloneFile(sourcePath, destPath)) {
+        return true;
+    }
+    if (!hardLinks) {
+        return false;
+    }
+
+    std::error_code error;
+    fs::create_hard_link(sourcePath, destPath, error);
+    return !error;
+}
+
+void ContentStore::addReference(const std::string& objectPath, const std::string& filePath) {
+    std::error_code error;
+    std::string absolute = fs::absolute(filePath, error).lexically_normal().string();
+    std::ifstream existing(objectPath + REFERENCES_EXTENSION);
+    std::string line;
+    while (std::getline(existing, line)) {
+        if (line == absolute) {
+            return;
+        }
+    }
+    existing.close();
+
+    std::ofstream references(objectPath + REFERENCES_EXTENSION, std::ios::app);
+    references << absolute << '\n';
+}
+
+bool ContentStore::isReferenced(const std::string& objectPath) {
+    std::error_code error;
+    if (fs::hard_link_count(objectPath, error) > 1 || error) {
+        return true;
+    }
+
+    // A reflink stays a file of its own, the listed paths say if a copy is left
+    std::ifstream references(objectPath + REFERENCES_EXTENSION);
+    std::string line;
+    while (std::getline(references, line)) {
+        if (!line.empty() && fs::is_regular_file(line, error)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,355 @@
+#include "core/CurlHandlePool.h"
+#include "utils/Logger.h"
+#include "utils/ResourceMonitor.h"
+#include "utils/UrlParser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+// Listed first, the library default list follows without repeating them
+const char TLS12_AES_FIRST[] =
+    "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+    "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+    "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:DEFAULT";
+const char TLS12_CHACHA_FIRST[] =
+    "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+    "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+    "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:DEFAULT";
+const char TLS13_AES_FIRST[] = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+const char TLS13_CHACHA_FIRST[] = "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384";
+
+enum class CipherPreference {
+    LIBRARY_DEFAULT,    // Cipher names of another TLS library
+    AES_GCM,
+    CHACHA20
+};
+
+bool hasAesInstructions() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) != 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) != 0;
+#elif defined(__aarch64__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__aarch64__) && defined(__APPLE__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+CipherPreference detectCipherPreference() {
+    // The cipher strings are OpenSSL's, forks included
+    const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    const char* ssl = info && info->ssl_version ? info->ssl_version : "";
+    bool openssl = false;
+    for (const char* name : {"OpenSSL", "LibreSSL", "BoringSSL", "quictls", "AWS-LC"}) {
+        openssl = openssl || std::strncmp(ssl, name, std::strlen(name)) == 0;
+    }
+    if (!openssl) {
+        return CipherPreference::LIBRARY_DEFAULT;
+    }
+    return hasAesInstructions() ? CipherPreference::AES_GCM : CipherPreference::CHACHA20;
+}
+
+CipherPreference getPreference() {
+    static const CipherPreference preference = detectCipherPreference();
+    return preference;
+}
+
+} // anonymous namespace
+
+CurlHandlePool& CurlHandlePool::getInstance() {
+    static CurlHandlePool instance;
+    return instance;
+}
+
+CurlHandlePool::CurlHandlePool()
+    : hits_(0), misses_(0), releases_(0), evictions_(0) {
+    // Initialize CURL (reference counted by libcurl)
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    // Constructed first so it is still alive when the pool is destroyed
+    dm::utils::ResourceMonitor::getInstance();
+
+    // Create the share objects for DNS, TLS sessions and connections
+    share_ = createShare(true);
+    streamShare_ = createShare(false);
+    if (!share_ || !streamShare_) {
+        dm::utils::Logger::warning("Failed to create CURL share, handles will not share caches");
+    }
+
+    dm::utils::Logger::debug("CURL handle pool created");
+}
+
+CurlHandlePool::~CurlHandlePool() {
+    clear();
+
+    if (share_) {
+        curl_share_cleanup(share_);
+        share_ = nullptr;
+    }
+    if (streamShare_) {
+        curl_share_cleanup(streamShare_);
+        streamShare_ = nullptr;
+    }
+
+    curl_global_cleanup();
+}
+
+CURL* CurlHandlePool::acquire(const std::string& url, bool shareConnections, const std::string& proxy) {
+    std::string key = makeKey(url, proxy);
+    CURL* handle = nullptr;
+    
+    // An FTP handle keeps its logged-in control connection to itself,
+    // so every idle handle in an FTP origin's list is a ready session
+    if (isFtpKey(key)) {
+        shareConnections = false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idleHandles_.find(key);
+        if (it != idleHandles_.end() && !it->second.empty()) {
+            handle = it->second.back();
+            it->second.pop_back();
+        }
+    }
+
+    if (handle) {
+        hits_++;
+    } else {
+        handle = curl_easy_init();
+        if (!handle) {
+            dm::utils::Logger::error("Failed to initialize CURL handle for " + key);
+            return nullptr;
+        }
+        misses_++;
+        dm::utils::ResourceMonitor::getInstance().recordAllocation(dm::utils::ResourceSubsystem::CURL_HANDLES);
+    }
+
+    // Attach the shared caches (curl_easy_reset clears this option)
+    CURLSH* share = shareConnections ? share_ : streamShare_;
+    if (share) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    }
+    applyCipherPreference(handle);
+
+    return handle;
+}
+
+void CurlHandlePool::release(const std::string& url, CURL* handle, const std::string& proxy) {
+    if (!handle) {
+        return;
+    }
+
+    // Reset options, the live connection and caches are kept
+    curl_easy_reset(handle);
+    releases_++;
+
+    std::string key = makeKey(url, proxy);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& handles = idleHandles_[key];
+        if (handles.size() < maxIdlePerHost_) {
+            handles.push_back(handle);
+            return;
+        }
+    }
+
+    // Pool is full for this origin
+    curl_easy_cleanup(handle);
+    evictions_++;
+    dm::utils::ResourceMonitor::getInstance().recordRelease(dm::utils::ResourceSubsystem::CURL_HANDLES);
+}
+
+CURLSH* CurlHandlePool::createShare(bool shareConnections) {
+    CURLSH* share = curl_share_init();
+    if (!share) {
+        return nullptr;
+    }
+
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockCallback);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockCallback);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (shareConnections) {
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+
+    return share;
+}
+
+void CurlHandlePool::setMaxIdlePerHost(size_t maxIdle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    maxIdlePerHost_ = maxIdle;
+}
+
+size_t CurlHandlePool::getMaxIdlePerHost() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxIdlePerHost_;
+}
+
+CurlPoolStatistics CurlHandlePool::getStatistics() const {
+    CurlPoolStatistics stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.releases = releases_;
+    stats.evictions = evictions_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& pair : idleHandles_) {
+        stats.idleHandles += pair.second.size();
+    }
+
+    return stats;
+}
+
+void CurlHandlePool::clear() {
+    std::map<std::string, std::vector<CURL*>> handles;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        handles.swap(idleHandles_);
+    }
+
+    for (auto& pair : handles) {
+        for (CURL* handle : pair.second) {
+            curl_easy_cleanup(handle);
+            dm::utils::ResourceMonitor::getInstance().recordRelease(dm::utils::ResourceSubsystem::CURL_HANDLES);
+        }
+    }
+}
+
+std::string CurlHandlePool::makeKey(const std::string& url) {
+    dm::utils::UrlView view = dm::utils::UrlParser::parseView(url);
+    std::string_view scheme = view.scheme.empty() ? std::string_view("http") : view.scheme;
+    
+    // "scheme://host:port", built in one buffer
+    std::string key;
+    key.reserve(scheme.size() + view.username.size() + view.host.size() + 10);
+    auto appendLower = [&key](std::string_view text) {
+        for (char c : text) {
+            key += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    };
+    
+    appendLower(scheme);
+    key += "://";
+    
+    // An FTP session is logged in as one user
+    bool ftp = key == "ftp://" || key == "ftps://";
+    if (ftp && !view.username.empty()) {
+        key += view.username;
+        key += '@';
+    }
+    
+    appendLower(view.host);
+    key += ':';
+    
+    // Default ports
+    if (!view.port.empty()) {
+        key += view.port;
+    } else if (key.compare(0, 8, "https://") == 0) {
+        key += "443";
+    } else if (key.compare(0, 6, "ftp://") == 0) {
+        key += "21";
+    } else if (key.compare(0, 7, "ftps://") == 0) {
+        key += "990";
+    } else {
+        key += "80";
+    }
+    
+    return key;
+}
+
+void CurlHandlePool::enableEarlyData(CURL* handle) {
+#ifdef CURLSSLOPT_EARLYDATA
+    curl_easy_setopt(handle, CURLOPT_SSL_OPTIONS, static_cast<long>(CURLSSLOPT_EARLYDATA));
+#else
+    (void)handle;
+#endif
+}
+
+const char* CurlHandlePool::getCipherPreference() {
+    switch (getPreference()) {
+        case CipherPreference::AES_GCM:
+            return "AES-GCM";
+        case CipherPreference::CHACHA20:
+            return "ChaCha20";
+        default:
+            return "library default";
+    }
+}
+
+void CurlHandlePool::applyCipherPreference(CURL* handle) {
+    CipherPreference preference = getPreference();
+    if (preference == CipherPreference::LIBRARY_DEFAULT) {
+        return;
+    }
+
+    bool aes = preference == CipherPreference::AES_GCM;
+    curl_easy_setopt(handle, CURLOPT_SSL_CIPHER_LIST, aes ? TLS12_AES_FIRST : TLS12_CHACHA_FIRST);
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    curl_easy_setopt(handle, CURLOPT_TLS13_CIPHERS, aes ? TLS13_AES_FIRST : TLS13_CHACHA_FIRST);
+#endif
+}
+
+std::string CurlHandlePool::makeKey(const std::string& url, const std::string& proxy) {
+    // A connection through a proxy goes to the proxy, not to the origin
+    return proxy.empty() ? makeKey(url) : makeKey(url) + " via " + proxy;
+}
+
+bool CurlHandlePool::isFtpKey(const std::string& key) {
+    return key.compare(0, 6, "ftp://") == 0 || key.compare(0, 7, "ftps://") == 0;
+}
+
+void CurlHandlePool::lockCallback(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    (void)handle;
+    (void)access;
+    CurlHandlePool* pool = static_cast<CurlHandlePool*>(userptr);
+    if (data >= 0 && data < CURL_LOCK_DATA_LAST) {
+        pool->shareMutexes_[data].lock();
+    }
+}
+
+void CurlHandlePool::unlockCallback(CURL* handle, curl_lock_data data, void* userptr) {
+    (void)handle;
+    CurlHandlePool* pool = static_cast<CurlHandlePool*>(userptr);
+    if (data >= 0 && data < CURL_LOCK_DATA_LAST) {
+        pool->shareMutexes_[data].unlock();
+    }
+}
+
+PooledCurlHandle::PooledCurlHandle(const std::string& url, const std::string& proxy)
+    : url_(url), proxy_(proxy) {
+    handle_ = CurlHandlePool::getInstance().acquire(url_, true, proxy_);
+}
+
+PooledCurlHandle::~PooledCurlHandle() {
+    if (handle_) {
+        CurlHandlePool::getInstance().release(url_, handle_, proxy_);
+        handle_ = nullptr;
+    }
+}
+
+} // namespace core
+} // namespace dm
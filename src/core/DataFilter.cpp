@@ -0,0 +1,459 @@
+#include "core/DataFilter.h"
+#include "core/OutputFile.h"
+#include "core/EngineMetrics.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <iterator>
+#include <ctime>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+using RangeMap = std::map<int64_t, int64_t>;
+
+/**
+ * @brief Add a range to disjoint ranges, merging it with the ones it touches
+ */
+void addRange(RangeMap& ranges, int64_t start, int64_t end) {
+    auto next = ranges.lower_bound(start);
+    if (next != ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->second >= start) {
+            start = prev->first;
+            end = std::max(end, prev->second);
+            next = ranges.erase(prev);
+        }
+    }
+    while (next != ranges.end() && next->first <= end) {
+        end = std::max(end, next->second);
+        next = ranges.erase(next);
+    }
+    ranges[start] = end;
+}
+
+/**
+ * @brief Add a range to disjoint ranges, returning the parts of it that were not in them
+ */
+std::vector<std::pair<int64_t, int64_t>> claimRange(RangeMap& ranges, int64_t start, int64_t end) {
+    std::vector<std::pair<int64_t, int64_t>> fresh;
+    auto it = ranges.upper_bound(start);
+    if (it != ranges.begin() && std::prev(it)->second > start) {
+        it = std::prev(it);
+    }
+
+    int64_t cursor = start;
+    for (; it != ranges.end() && it->first < end; ++it) {
+        if (it->first > cursor) {
+            fresh.emplace_back(cursor, it->first);
+        }
+        cursor = std::max(cursor, it->second);
+    }
+    if (cursor < end) {
+        fresh.emplace_back(cursor, end);
+    }
+
+    addRange(ranges, start, end);
+    return fresh;
+}
+
+/**
+ * @brief Get the CPU time used by the calling thread
+ */
+int64_t threadCpuNanoseconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto ticks = [](const FILETIME& time) {
+        return (static_cast<int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void updateMax(std::atomic<int64_t>& maximum, int64_t value) {
+    int64_t current = maximum.load(std::memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+} // anonymous namespace
+
+DataFilterChain::DataFilterChain(const std::vector<DataFilterBinding>& bindings, int64_t callBudgetNanoseconds) {
+    for (const auto& binding : bindings) {
+        auto stage = std::make_unique<Stage>();
+        stage->id = binding.id;
+        stage->session = binding.session;
+        stage->counters = binding.counters ? binding.counters : std::make_shared<DataFilterCounters>();
+        stage->order = binding.filter->getOrder();
+        stage->thread = binding.filter->getThread();
+        stage->queueLimit = std::max<size_t>(binding.filter->getQueueLimit(), 1);
+        stage->callBudget = callBudgetNanoseconds;
+        hasUnordered_ = hasUnordered_ || stage->order == DataFilterOrder::UNORDERED;
+
+        if (stage->thread == DataFilterThread::WORKER) {
+            Stage* worker = stage.get();
+            stage->worker = std::thread([worker]() { runWorker(*worker); });
+        }
+        stages_.push_back(std::move(stage));
+    }
+}
+
+DataFilterChain::~DataFilterChain() {
+    close(false);
+}
+
+void DataFilterChain::onWrite(OutputFile& file, const char* data, size_t size, int64_t offset) {
+    std::shared_lock<std::shared_mutex> closeLock(closeMutex_);
+    if (closed_) {
+        return;
+    }
+
+    int64_t end = offset + static_cast<int64_t>(size);
+    int64_t highest = highestWritten_.load(std::memory_order_relaxed);
+    while (end > highest && !highestWritten_.compare_exchange_weak(highest, end, std::memory_order_relaxed)) {
+    }
+
+    // Unordered sessions only skip what they were already passed (segment retry)
+    if (hasUnordered_) {
+        std::vector<std::pair<int64_t, int64_t>> fresh;
+        {
+            std::lock_guard<std::mutex> lock(writtenMutex_);
+            fresh = claimRange(written_, offset, end);
+        }
+        for (auto& stage : stages_) {
+            if (stage->order != DataFilterOrder::UNORDERED) {
+                continue;
+            }
+            for (const auto& range : fresh) {
+                deliver(*stage, range.first, data + (range.first - offset),
+                        static_cast<size_t>(range.second - range.first));
+            }
+        }
+    }
+
+    for (auto& stage : stages_) {
+        if (stage->order != DataFilterOrder::ORDERED) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(stage->orderMutex);
+        if (stage->failed || end <= stage->frontier) {
+            continue;
+        }
+        if (offset > stage->frontier) {
+            addRange(stage->ahead, offset, end);
+            continue;
+        }
+
+        // Pass straight from the caller's buffer, then whatever the frontier reached
+        deliver(*stage, stage->frontier, data + (stage->frontier - offset),
+                static_cast<size_t>(end - stage->frontier));
+        stage->frontier = end;
+        while (!stage->ahead.empty() && stage->ahead.begin()->first <= stage->frontier) {
+            int64_t aheadEnd = stage->ahead.begin()->second;
+            stage->ahead.erase(stage->ahead.begin());
+            if (aheadEnd > stage->frontier) {
+                if (!readBack(*stage, file, stage->frontier, aheadEnd)) {
+                    stage->ahead.clear();
+                    break;
+                }
+                stage->frontier = aheadEnd;
+            }
+        }
+    }
+}
+
+void DataFilterChain::finish(OutputFile& file, int64_t totalSize) {
+    if (totalSize < 0) {
+        totalSize = highestWritten_.load(std::memory_order_relaxed);
+    }
+
+    // Ranges written by an earlier session of a resumed download
+    std::vector<std::pair<int64_t, int64_t>> unseen;
+    if (hasUnordered_) {
+        std::lock_guard<std::mutex> lock(writtenMutex_);
+        unseen = claimRange(written_, 0, totalSize);
+    }
+
+    for (auto& stage : stages_) {
+        if (stage->order == DataFilterOrder::UNORDERED) {
+            for (const auto& range : unseen) {
+                if (!readBack(*stage, file, range.first, range.second)) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(stage->orderMutex);
+        stage->ahead.clear();
+        if (totalSize > stage->frontier && readBack(*stage, file, stage->frontier, totalSize)) {
+            stage->frontier = totalSize;
+        }
+    }
+
+    close(true);
+}
+
+void DataFilterChain::abandon() {
+    close(false);
+}
+
+void DataFilterChain::deliver(Stage& stage, int64_t offset, const char* data, size_t size) {
+    if (stage.failed || size == 0) {
+        return;
+    }
+    if (stage.thread == DataFilterThread::IO_THREAD) {
+        call(stage, offset, data, size);
+        return;
+    }
+
+    // The write buffer is reused once this returns, the worker gets a copy
+    std::unique_lock<std::mutex> lock(stage.queueMutex);
+    stage.queueCondition.wait(lock, [&stage, size]() {
+        return stage.queuedBytes == 0 || stage.queuedBytes + size <= stage.queueLimit || stage.failed;
+    });
+    if (stage.failed) {
+        return;
+    }
+    stage.queue.emplace_back(offset, std::vector<char>(data, data + size));
+    stage.queuedBytes += size;
+    stage.queueCondition.notify_all();
+}
+
+void DataFilterChain::call(Stage& stage, int64_t offset, const char* data, size_t size) {
+    if (stage.failed) {
+        return;
+    }
+
+    bool ioThread = stage.thread == DataFilterThread::IO_THREAD;
+    int64_t started = EngineMetrics::nowNanoseconds();
+    int64_t cpuStarted = threadCpuNanoseconds();
+    try {
+        ByteSpan span;
+        span.data = reinterpret_cast<const std::byte*>(data);
+        span.size = size;
+        stage.session->onChunk(offset, span);
+    } catch (const std::exception& e) {
+        dm::utils::Logger::error("Data filter " + stage.id + " failed, dropping it from the download: " + e.what());
+        stage.failed = true;
+    } catch (...) {
+        dm::utils::Logger::error("Data filter " + stage.id + " failed, dropping it from the download");
+        stage.failed = true;
+    }
+    int64_t elapsed = EngineMetrics::nowNanoseconds() - started;
+
+    DataFilterCounters& counters = *stage.counters;
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    counters.wallNanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+    counters.cpuNanoseconds.fetch_add(threadCpuNanoseconds() - cpuStarted, std::memory_order_relaxed);
+    updateMax(counters.maxCallNanoseconds, elapsed);
+
+    if (stage.callBudget <= 0 || elapsed <= stage.callBudget) {
+        return;
+    }
+    counters.slowCalls.fetch_add(1, std::memory_order_relaxed);
+    int slowCalls = ++stage.slowCalls;
+    if (slowCalls == 1) {
+        dm::utils::Logger::warning("Data filter " + stage.id + " took " + std::to_string(elapsed / 1000000) +
+                                   " ms for " + std::to_string(size) + " bytes, over its budget of " +
+                                   std::to_string(stage.callBudget / 1000000) + " ms");
+    }
+    if (ioThread && slowCalls >= SLOW_CALLS_BEFORE_OFFLOAD && !stage.failed) {
+        offload(stage);
+    }
+}
+
+void DataFilterChain::offload(Stage& stage) {
+    std::lock_guard<std::mutex> lock(stage.queueMutex);
+    if (stage.thread == DataFilterThread::WORKER || stage.closing) {
+        return;
+    }
+
+    // Calls in progress finish on their threads, the next ones are queued
+    Stage* worker = &stage;
+    stage.worker = std::thread([worker]() { runWorker(*worker); });
+    stage.thread = DataFilterThread::WORKER;
+    stage.counters->offloadedSessions.fetch_add(1, std::memory_order_relaxed);
+    dm::utils::Logger::warning("Data filter " + stage.id + " keeps going over its budget, moved to a worker");
+}
+
+bool DataFilterChain::readBack(Stage& stage, OutputFile& file, int64_t start, int64_t end) {
+    stage.readBuffer.resize(READ_BACK_CHUNK_SIZE);
+
+    while (start < end && !stage.failed) {
+        size_t chunk = static_cast<size_t>(std::min<int64_t>(end - start, READ_BACK_CHUNK_SIZE));
+        if (!file.readAt(stage.readBuffer.data(), chunk, start)) {
+            dm::utils::Logger::error("Data filter failed to read back " + file.getPath());
+            stage.failed = true;
+            break;
+        }
+
+        deliver(stage, start, stage.readBuffer.data(), chunk);
+        start += static_cast<int64_t>(chunk);
+    }
+
+    return !stage.failed;
+}
+
+void DataFilterChain::runWorker(Stage& stage) {
+    std::unique_lock<std::mutex> lock(stage.queueMutex);
+    while (true) {
+        stage.queueCondition.wait(lock, [&stage]() { return !stage.queue.empty() || stage.closing; });
+        if (stage.queue.empty()) {
+            return;
+        }
+
+        std::pair<int64_t, std::vector<char>> chunk = std::move(stage.queue.front());
+        stage.queue.pop_front();
+        stage.queuedBytes -= chunk.second.size();
+        stage.queueCondition.notify_all();
+
+        lock.unlock();
+        call(stage, chunk.first, chunk.second.data(), chunk.second.size());
+        lock.lock();
+
+        // A failed filter wants nothing more, let waiting writers go
+        if (stage.failed) {
+            stage.queue.clear();
+            stage.queuedBytes = 0;
+            stage.queueCondition.notify_all();
+        }
+    }
+}
+
+void DataFilterChain::close(bool completed) {
+    // After writes still being delivered, which see closed_ once it is set
+    std::unique_lock<std::shared_mutex> lock(closeMutex_);
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    for (auto& stage : stages_) {
+        if (stage->worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> queueLock(stage->queueMutex);
+                stage->closing = true;
+            }
+            stage->queueCondition.notify_all();
+            stage->worker.join();
+        }
+
+        try {
+            stage->session->onFinish(completed && !stage->failed);
+        } catch (...) {
+            dm::utils::Logger::error("Data filter failed to finish");
+        }
+        std::vector<char>().swap(stage->readBuffer);
+    }
+}
+
+DataFilterRegistry& DataFilterRegistry::getInstance() {
+    static DataFilterRegistry instance;
+    return instance;
+}
+
+void DataFilterRegistry::addFilter(const std::string& id, std::shared_ptr<DataFilter> filter) {
+    if (!filter) {
+        return;
+    }
+
+    // A filter added again keeps its profile
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = filters_[id];
+    entry.filter = filter;
+    if (!entry.counters) {
+        entry.counters = std::make_shared<DataFilterCounters>();
+    }
+    dm::utils::Logger::info("Added data filter: " + id);
+}
+
+bool DataFilterRegistry::removeFilter(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (filters_.erase(id) == 0) {
+        return false;
+    }
+    dm::utils::Logger::info("Removed data filter: " + id);
+    return true;
+}
+
+void DataFilterRegistry::setCallBudget(int milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callBudget_ = static_cast<int64_t>(std::max(milliseconds, 0)) * 1000000;
+}
+
+std::vector<DataFilterStats> DataFilterRegistry::getStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<DataFilterStats> result;
+    for (const auto& item : filters_) {
+        const DataFilterCounters& counters = *item.second.counters;
+        DataFilterStats stats;
+        stats.id = item.first;
+        stats.calls = counters.calls.load(std::memory_order_relaxed);
+        stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+        stats.wallNanoseconds = counters.wallNanoseconds.load(std::memory_order_relaxed);
+        stats.cpuNanoseconds = counters.cpuNanoseconds.load(std::memory_order_relaxed);
+        stats.maxCallNanoseconds = counters.maxCallNanoseconds.load(std::memory_order_relaxed);
+        stats.slowCalls = counters.slowCalls.load(std::memory_order_relaxed);
+        stats.offloadedSessions = counters.offloadedSessions.load(std::memory_order_relaxed);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+std::shared_ptr<DataFilterChain> DataFilterRegistry::openChain(const DataFilterContext& context) {
+    std::map<std::string, Entry> filters;
+    int64_t callBudget;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (filters_.empty()) {
+            return nullptr;
+        }
+        filters = filters_;
+        callBudget = callBudget_;
+    }
+
+    // Plugin code, called without the lock
+    std::vector<DataFilterBinding> sessions;
+    for (const auto& filter : filters) {
+        try {
+            DataFilterBinding binding;
+            binding.session = filter.second.filter->open(context);
+            if (binding.session) {
+                binding.id = filter.first;
+                binding.filter = filter.second.filter;
+                binding.counters = filter.second.counters;
+                sessions.push_back(std::move(binding));
+            }
+        } catch (const std::exception& e) {
+            dm::utils::Logger::error("Data filter " + filter.first + " failed to open " + context.url + ": " + e.what());
+        } catch (...) {
+            dm::utils::Logger::error("Data filter " + filter.first + " failed to open " + context.url);
+        }
+    }
+
+    if (sessions.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<DataFilterChain>(sessions, callBudget);
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,479 @@
+#include "core/DeviceIoScheduler.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+#ifdef __linux__
+const char* const NETWORK_FILE_SYSTEMS[] = {
+    "nfs", "nfs4", "cifs", "smb3", "smbfs", "9p", "ceph", "glusterfs", "afs",
+    "fuse.sshfs", "fuse.rclone", "fuse.s3fs", "davfs", "fuse.davfs2"};
+
+// Undo the octal escapes of spaces, tabs and backslashes in /proc/self/mountinfo
+std::string unescapeMountField(const std::string& field) {
+    std::string result;
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] == '\\' && i + 3 < field.size()) {
+            int value = 0;
+            bool octal = true;
+            for (size_t j = 1; j <= 3; j++) {
+                char c = field[i + j];
+                if (c < '0' || c > '7') {
+                    octal = false;
+                    break;
+                }
+                value = value * 8 + (c - '0');
+            }
+            if (octal) {
+                result += static_cast<char>(value);
+                i += 3;
+                continue;
+            }
+        }
+        result += field[i];
+    }
+    return result;
+}
+
+bool isUnder(const std::string& path, const std::string& mountPoint) {
+    if (mountPoint == "/") {
+        return true;
+    }
+    return path.compare(0, mountPoint.size(), mountPoint) == 0 &&
+           (path.size() == mountPoint.size() || path[mountPoint.size()] == '/');
+}
+
+// The whole disk behind a block device number, and whether it is rotational
+bool readBlockDevice(dev_t device, std::string& name, StorageKind& kind) {
+    std::error_code error;
+    std::filesystem::path sysfs = std::filesystem::canonical(
+        "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device)), error);
+    if (error) {
+        return false;
+    }
+    if (std::filesystem::exists(sysfs / "partition", error)) {
+        sysfs = sysfs.parent_path();
+    }
+
+    std::ifstream rotational(sysfs / "queue" / "rotational");
+    int value = -1;
+    if (!(rotational >> value)) {
+        return false;
+    }
+    name = sysfs.filename().string();
+    kind = value ? StorageKind::HDD : StorageKind::SSD;
+    return true;
+}
+#endif
+
+} // anonymous namespace
+
+StorageDevice::StorageDevice(const StorageDeviceInfo& info, int maxWriters)
+    : info_(info), elevator_(info.kind == StorageKind::HDD), maxWriters_(std::max(1, maxWriters)) {
+}
+
+StorageDevice::~StorageDevice() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queueChanged_.notify_all();
+    for (auto& writer : writers_) {
+        if (writer.joinable()) {
+            writer.join();
+        }
+    }
+}
+
+void StorageDevice::setMaxWriters(int maxWriters) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        maxWriters_ = std::max(1, maxWriters);
+        if (!queue_.empty()) {
+            startWriters();
+        }
+    }
+    queueChanged_.notify_all();
+}
+
+int StorageDevice::getMaxWriters() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxWriters_;
+}
+
+void StorageDevice::queue(dm::utils::DiskRequest& request) {
+    request.pending = true;
+    request.error = 0;
+    request.transferred = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        QueueKey key = elevator_ ? QueueKey(request.fd, request.offset) : QueueKey(0, arrivals_++);
+        queue_.emplace(key, Entry{&request, std::chrono::steady_clock::now()});
+        queuedBytes_ += static_cast<int64_t>(request.size);
+        startWriters();
+    }
+    // Writers beyond the limit wait on the same condition, wake them all
+    queueChanged_.notify_all();
+}
+
+bool StorageDevice::wait(dm::utils::DiskRequest& request) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    completed_.wait(lock, [&request] { return !request.pending; });
+    return request.error == 0;
+}
+
+bool StorageDevice::write(int fd, const char* data, size_t size, int64_t offset) {
+    dm::utils::DiskRequest request;
+    request.operation = dm::utils::DiskOperation::WRITE;
+    request.fd = fd;
+    request.data = const_cast<char*>(data);
+    request.size = size;
+    request.offset = offset;
+
+    queue(request);
+    if (!wait(request)) {
+        errno = request.error;
+        return false;
+    }
+    return true;
+}
+
+bool StorageDevice::isSaturated() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !queue_.empty() && queueWaitMs_ > SATURATED_WAIT_MS;
+}
+
+StorageDeviceStats StorageDevice::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StorageDeviceStats stats;
+    stats.info = info_;
+    stats.maxWriters = maxWriters_;
+    stats.activeWriters = activeWriters_;
+    stats.queuedRequests = queue_.size();
+    stats.queuedBytes = queuedBytes_;
+    stats.writes = writes_;
+    stats.bytesWritten = bytesWritten_;
+    stats.throughput = throughput_;
+    stats.queueWaitMs = queueWaitMs_;
+    stats.saturated = !queue_.empty() && queueWaitMs_ > SATURATED_WAIT_MS;
+    return stats;
+}
+
+void StorageDevice::runWriter(int index) {
+    dm::utils::DiskIoBackend& backend = dm::utils::DiskIoBackend::getInstance();
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        // A stopping device drains its queue with every writer it has
+        queueChanged_.wait(lock, [this, index] {
+            return (!queue_.empty() && (index < maxWriters_ || stopping_)) || (stopping_ && queue_.empty());
+        });
+        if (queue_.empty()) {
+            return;
+        }
+
+        Entry entry = takeNext();
+        activeWriters_++;
+        lock.unlock();
+
+        dm::utils::DiskRequest& request = *entry.request;
+        auto started = std::chrono::steady_clock::now();
+        double waitMs = std::chrono::duration<double, std::milli>(started - entry.queuedAt).count();
+
+        // Through the backend's own queue, so a registered buffer and a linked
+        // data sync survive. The backend's state goes in a copy: the queuing
+        // thread reads the caller's request under mutex_ only
+        dm::utils::DiskRequest forwarded;
+        forwarded.operation = request.operation;
+        forwarded.fd = request.fd;
+        forwarded.data = request.data;
+        forwarded.size = request.size;
+        forwarded.offset = request.offset;
+        forwarded.bufferSlot = request.bufferSlot;
+        forwarded.sync = request.sync;
+        backend.queue(forwarded);
+        int error = backend.wait(forwarded) ? 0 : (forwarded.error ? forwarded.error : EIO);
+        int64_t busyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count();
+
+        lock.lock();
+        activeWriters_--;
+        if (error == 0) {
+            recordWrite(request.size, waitMs, busyNs);
+        }
+        request.error = error;
+        request.transferred = error == 0 ? forwarded.transferred : 0;
+        request.synced = forwarded.synced;
+        request.pending = false;
+        completed_.notify_all();
+    }
+}
+
+StorageDevice::Entry StorageDevice::takeNext() {
+    auto it = queue_.begin();
+    if (elevator_) {
+        // On from where the last write ended, back to the lowest once past the end
+        it = queue_.lower_bound(head_);
+        if (it == queue_.end()) {
+            it = queue_.begin();
+        }
+    }
+
+    Entry entry = it->second;
+    queue_.erase(it);
+    queuedBytes_ -= static_cast<int64_t>(entry.request->size);
+    if (elevator_) {
+        head_ = QueueKey(entry.request->fd, entry.request->offset + static_cast<int64_t>(entry.request->size));
+    }
+    return entry;
+}
+
+void StorageDevice::startWriters() {
+    while (static_cast<int>(writers_.size()) < maxWriters_) {
+        int index = static_cast<int>(writers_.size());
+        writers_.emplace_back(&StorageDevice::runWriter, this, index);
+    }
+}
+
+void StorageDevice::recordWrite(size_t size, double waitMs, int64_t busyNs) {
+    writes_++;
+    bytesWritten_ += static_cast<int64_t>(size);
+    queueWaitMs_ = writes_ == 1 ? waitMs : queueWaitMs_ + EWMA_WEIGHT * (waitMs - queueWaitMs_);
+
+    // Each writer's rate, times the writers the device keeps busy
+    if (busyNs > 0) {
+        double rate = static_cast<double>(size) * 1e9 / busyNs * std::max(1, std::min(activeWriters_ + 1, maxWriters_));
+        throughput_ = throughput_ <= 0.0 ? rate : throughput_ + EWMA_WEIGHT * (rate - throughput_);
+    }
+}
+
+DeviceIoScheduler& DeviceIoScheduler::getInstance() {
+    static DeviceIoScheduler instance;
+    return instance;
+}
+
+DeviceIoScheduler::DeviceIoScheduler() : enabled_(true) {
+    maxWriters_[StorageKind::SSD] = DEFAULT_SSD_WRITERS;
+    maxWriters_[StorageKind::HDD] = DEFAULT_HDD_WRITERS;
+    maxWriters_[StorageKind::NETWORK] = DEFAULT_NETWORK_WRITERS;
+    maxWriters_[StorageKind::UNKNOWN] = DEFAULT_UNKNOWN_WRITERS;
+}
+
+void DeviceIoScheduler::setEnabled(bool enabled) {
+    enabled_ = enabled;
+}
+
+bool DeviceIoScheduler::isEnabled() const {
+    return enabled_;
+}
+
+void DeviceIoScheduler::setMaxWriters(StorageKind kind, int maxWriters) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    maxWriters_[kind] = std::max(1, maxWriters);
+    for (const auto& entry : devices_) {
+        if (entry.second->getInfo().kind == kind) {
+            entry.second->setMaxWriters(maxWriters);
+        }
+    }
+}
+
+int DeviceIoScheduler::getMaxWriters(StorageKind kind) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = maxWriters_.find(kind);
+    return it != maxWriters_.end() ? it->second : DEFAULT_UNKNOWN_WRITERS;
+}
+
+std::shared_ptr<StorageDevice> DeviceIoScheduler::getDevice(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+    return nullptr;
+#else
+    uint64_t id = 0;
+    std::string existing;
+    if (!enabled_ || !getDeviceId(path, id, existing)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = devices_.find(id);
+    if (it != devices_.end()) {
+        return it->second;
+    }
+
+    StorageDeviceInfo info;
+    if (!detectDevice(existing, info)) {
+        info.id = id;
+        info.name = std::to_string(id);
+    }
+    auto device = std::make_shared<StorageDevice>(info, maxWriters_[info.kind]);
+    devices_[id] = device;
+
+    dm::utils::Logger::info("Storage device " + info.name + " (" + getKindName(info.kind) + ")" +
+                            (info.mountPoint.empty() ? "" : " at " + info.mountPoint) + ": " +
+                            std::to_string(maxWriters_[info.kind]) + " writers");
+    return device;
+#endif
+}
+
+bool DeviceIoScheduler::hasCapacity(const std::string& path) {
+    uint64_t id = 0;
+    std::string existing;
+    if (!enabled_ || !getDeviceId(path, id, existing)) {
+        return true;
+    }
+
+    std::shared_ptr<StorageDevice> device;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = devices_.find(id);
+        if (it == devices_.end()) {
+            return true;
+        }
+        device = it->second;
+    }
+    return !device->isSaturated();
+}
+
+bool DeviceIoScheduler::detectDevice(const std::string& path, StorageDeviceInfo& info) {
+    uint64_t id = 0;
+    std::string existing;
+    if (!getDeviceId(path, id, existing)) {
+        return false;
+    }
+    info = StorageDeviceInfo();
+    info.id = id;
+    info.name = std::to_string(id);
+
+#ifdef __linux__
+    dev_t device = static_cast<dev_t>(id);
+    std::string number = std::to_string(major(device)) + ":" + std::to_string(minor(device));
+    std::error_code error;
+    std::string resolved = std::filesystem::weakly_canonical(existing, error).string();
+    if (error) {
+        resolved = existing;
+    }
+
+    // The mount of the device that holds the path, the longest one if bind mounted
+    std::ifstream mounts("/proc/self/mountinfo");
+    std::string line;
+    std::string source;
+    bool sourceUnder = false;
+    while (std::getline(mounts, line)) {
+        std::istringstream fields(line);
+        std::vector<std::string> parts;
+        std::string field;
+        while (fields >> field) {
+            parts.push_back(field);
+        }
+        auto separator = std::find(parts.begin(), parts.end(), "-");
+        if (parts.size() < 5 || parts[2] != number || separator == parts.end() || parts.end() - separator < 3) {
+            continue;
+        }
+        std::string mountPoint = unescapeMountField(parts[4]);
+        bool under = isUnder(resolved, mountPoint);
+        if (info.mountPoint.empty() || (under && (!sourceUnder || mountPoint.size() > info.mountPoint.size()))) {
+            sourceUnder = under;
+            info.mountPoint = mountPoint;
+            info.fileSystem = *(separator + 1);
+            source = unescapeMountField(*(separator + 2));
+        }
+    }
+    if (!source.empty()) {
+        info.name = source;
+    }
+
+    for (const char* network : NETWORK_FILE_SYSTEMS) {
+        if (info.fileSystem == network) {
+            info.kind = StorageKind::NETWORK;
+            return true;
+        }
+    }
+
+    // Btrfs and device mapper mounts carry an anonymous number, their source names the disk
+    std::string name;
+    StorageKind kind = StorageKind::UNKNOWN;
+    struct stat sourceStat;
+    if (major(device) != 0 && readBlockDevice(device, name, kind)) {
+        info.name = name;
+        info.kind = kind;
+    } else if (source.compare(0, 5, "/dev/") == 0 && ::stat(source.c_str(), &sourceStat) == 0 &&
+               S_ISBLK(sourceStat.st_mode) && readBlockDevice(sourceStat.st_rdev, name, kind)) {
+        info.name = name;
+        info.kind = kind;
+    }
+#endif
+
+    return true;
+}
+
+std::vector<StorageDeviceStats> DeviceIoScheduler::getStats() const {
+    std::vector<std::shared_ptr<StorageDevice>> devices;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : devices_) {
+            devices.push_back(entry.second);
+        }
+    }
+
+    std::vector<StorageDeviceStats> stats;
+    for (const auto& device : devices) {
+        stats.push_back(device->getStats());
+    }
+    return stats;
+}
+
+const char* DeviceIoScheduler::getKindName(StorageKind kind) {
+    switch (kind) {
+        case StorageKind::SSD:
+            return "ssd";
+        case StorageKind::HDD:
+            return "hdd";
+        case StorageKind::NETWORK:
+            return "network";
+        case StorageKind::UNKNOWN:
+        default:
+            return "unknown";
+    }
+}
+
+bool DeviceIoScheduler::getDeviceId(const std::string& path, uint64_t& id, std::string& existing) {
+    if (path.empty()) {
+        return false;
+    }
+
+    // A destination is usually created only once its download starts
+    std::filesystem::path current(path);
+    while (true) {
+        struct stat info;
+        if (::stat(current.string().c_str(), &info) == 0) {
+            id = static_cast<uint64_t>(info.st_dev);
+            existing = current.string();
+            return true;
+        }
+        std::filesystem::path parent = current.parent_path();
+        if (parent.empty()) {
+            parent = ".";
+        }
+        if (parent == current) {
+            return false;
+        }
+        current = parent;
+    }
+}
+
+} // namespace core
+} // namespace dm
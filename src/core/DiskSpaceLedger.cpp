@@ -0,0 +1,189 @@
+#include "core/DiskSpaceLedger.h"
+#include "core/DeviceIoScheduler.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+std::string formatMegabytes(int64_t bytes) {
+    return std::to_string(bytes / (1024 * 1024)) + " MB";
+}
+
+} // anonymous namespace
+
+DiskSpaceLedger& DiskSpaceLedger::getInstance() {
+    static DiskSpaceLedger instance;
+    return instance;
+}
+
+DiskSpaceLedger::DiskSpaceLedger()
+    : enabled_(true), margin_(DEFAULT_MARGIN) {
+}
+
+bool DiskSpaceLedger::reserve(const std::string& owner, const std::string& filePath, int64_t size) {
+    uint64_t id = 0;
+    std::string existing;
+    if (!enabled_ || size <= 0 || !DeviceIoScheduler::getDeviceId(filePath, id, existing)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Take back an earlier reservation of the owner first, it is replaced
+    auto previous = reservations_.find(owner);
+    if (previous != reservations_.end()) {
+        Volume& volume = volumes_[previous->second.volume];
+        volume.reservedBytes = std::max<int64_t>(0, volume.reservedBytes - previous->second.outstanding);
+        volume.reservations--;
+        reservations_.erase(previous);
+    }
+
+    Volume& volume = refresh(id, existing);
+    int64_t outstanding = std::max<int64_t>(0, size - getAllocatedSize(filePath));
+
+    if (outstanding > 0 && volume.freeBytes >= 0 &&
+        outstanding > volume.freeBytes - volume.reservedBytes - margin_) {
+        volume.refusals++;
+        if (refused_.insert(owner).second) {
+            dm::utils::Logger::warning("Waiting for disk space: " + filePath + " needs " +
+                                       formatMegabytes(outstanding) + ", " +
+                                       formatMegabytes(std::max<int64_t>(0, volume.freeBytes - volume.reservedBytes - margin_)) +
+                                       " free beyond other downloads and the margin");
+        }
+        return false;
+    }
+
+    Reservation reservation;
+    reservation.volume = id;
+    reservation.path = filePath;
+    reservation.size = size;
+    reservation.outstanding = outstanding;
+    reservations_[owner] = reservation;
+    volume.reservedBytes += outstanding;
+    volume.reservations++;
+    refused_.erase(owner);
+    return true;
+}
+
+void DiskSpaceLedger::release(const std::string& owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    refused_.erase(owner);
+    auto it = reservations_.find(owner);
+    if (it == reservations_.end()) {
+        return;
+    }
+
+    Volume& volume = volumes_[it->second.volume];
+    volume.reservedBytes = std::max<int64_t>(0, volume.reservedBytes - it->second.outstanding);
+    volume.reservations--;
+    reservations_.erase(it);
+}
+
+int64_t DiskSpaceLedger::getAvailableSpace(const std::string& path) {
+    uint64_t id = 0;
+    std::string existing;
+    if (!DeviceIoScheduler::getDeviceId(path, id, existing)) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Volume& volume = refresh(id, existing);
+    if (volume.freeBytes < 0) {
+        return -1;
+    }
+    return std::max<int64_t>(0, volume.freeBytes - volume.reservedBytes);
+}
+
+void DiskSpaceLedger::setEnabled(bool enabled) {
+    enabled_ = enabled;
+}
+
+bool DiskSpaceLedger::isEnabled() const {
+    return enabled_;
+}
+
+void DiskSpaceLedger::setMargin(int64_t bytes) {
+    margin_ = std::max<int64_t>(0, bytes);
+}
+
+int64_t DiskSpaceLedger::getMargin() const {
+    return margin_;
+}
+
+std::vector<DiskSpaceStats> DiskSpaceLedger::getStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<DiskSpaceStats> result;
+    result.reserve(volumes_.size());
+    for (auto& pair : volumes_) {
+        Volume& volume = refresh(pair.first, pair.second.path);
+        DiskSpaceStats stats;
+        stats.id = pair.first;
+        stats.path = volume.path;
+        stats.freeBytes = volume.freeBytes;
+        stats.reservedBytes = volume.reservedBytes;
+        stats.reservations = volume.reservations;
+        stats.refusals = volume.refusals;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+DiskSpaceLedger::Volume& DiskSpaceLedger::refresh(uint64_t id, const std::string& path) {
+    Volume& volume = volumes_[id];
+    if (volume.path.empty()) {
+        volume.path = path;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (volume.refreshed && now - volume.refreshedAt < std::chrono::milliseconds(REFRESH_INTERVAL_MS)) {
+        return volume;
+    }
+    volume.refreshed = true;
+    volume.refreshedAt = now;
+
+    std::error_code error;
+    std::filesystem::space_info space = std::filesystem::space(path, error);
+    volume.freeBytes = error ? -1 : static_cast<int64_t>(space.available);
+
+    // What the files wrote since counts in the free space now, not here
+    volume.reservedBytes = 0;
+    volume.reservations = 0;
+    for (auto& pair : reservations_) {
+        Reservation& reservation = pair.second;
+        if (reservation.volume != id) {
+            continue;
+        }
+        reservation.outstanding = std::max<int64_t>(0, reservation.size - getAllocatedSize(reservation.path));
+        volume.reservedBytes += reservation.outstanding;
+        volume.reservations++;
+    }
+    return volume;
+}
+
+int64_t DiskSpaceLedger::getAllocatedSize(const std::string& path) {
+#ifdef _WIN32
+    // SetEndOfFile allocates the whole size up front
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    return error ? 0 : static_cast<int64_t>(size);
+#else
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(info.st_blocks) * 512;
+#endif
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,306 @@
+#include "core/DnsCache.h"
+#include "core/CurlHandlePool.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#endif
+
+namespace dm {
+namespace core {
+
+DnsCache& DnsCache::getInstance() {
+    static DnsCache instance;
+    return instance;
+}
+
+DnsCache::DnsCache() {
+}
+
+DnsCache::~DnsCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queue_.clear();
+    }
+    changed_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void DnsCache::prefetch(const std::vector<std::string>& urls) {
+    size_t queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ttlSeconds_ <= 0 || stopping_) {
+            return;
+        }
+
+        for (const auto& url : urls) {
+            std::string key;
+            if (makeKey(url, key) && enqueue(key)) {
+                queued++;
+            }
+        }
+
+        // Start resolver threads as the queue needs them
+        while (workers_.size() < MAX_RESOLVER_THREADS && workers_.size() < queue_.size()) {
+            workers_.emplace_back(&DnsCache::workerLoop, this);
+        }
+    }
+
+    if (queued > 0) {
+        changed_.notify_all();
+    }
+}
+
+void DnsCache::prefetch(const std::string& url) {
+    prefetch(std::vector<std::string>{url});
+}
+
+struct curl_slist* DnsCache::apply(CURL* handle, const std::string& url) {
+    std::string key;
+    bool resolvable = makeKey(url, key);
+
+    std::string entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // A TTL of 0 turns our cache off, not libcurl's, which keeps its default
+        if (ttlSeconds_ > 0) {
+            curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, static_cast<long>(ttlSeconds_));
+        }
+#if LIBCURL_VERSION_NUM >= 0x073B00
+        curl_easy_setopt(handle, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS, static_cast<long>(happyEyeballsMs_));
+#endif
+
+        if (!resolvable || ttlSeconds_ <= 0) {
+            return nullptr;
+        }
+
+        auto it = entries_.find(key);
+        if (it == entries_.end() || it->second.pending || it->second.addresses.empty() ||
+            it->second.expires <= std::chrono::steady_clock::now()) {
+            return nullptr;
+        }
+
+        for (const auto& address : it->second.addresses) {
+            entry += (entry.empty() ? "" : ",") + address;
+        }
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x074B00
+    // The '+' prefix lets the entry expire like a resolved one instead of
+    // pinning the address in libcurl's cache
+    struct curl_slist* list = curl_slist_append(nullptr, ("+" + key + ":" + entry).c_str());
+    if (list) {
+        curl_easy_setopt(handle, CURLOPT_RESOLVE, list);
+    }
+    return list;
+#else
+    // Older libcurl never expires CURLOPT_RESOLVE entries
+    return nullptr;
+#endif
+}
+
+std::string DnsCache::getAddress(const std::string& url) const {
+    std::string key;
+    if (!makeKey(url, key)) {
+        // An IP literal is its own address
+        std::string origin = CurlHandlePool::makeKey(url);
+        size_t hostStart = origin.find("://");
+        size_t colon = origin.rfind(':');
+        if (hostStart == std::string::npos || colon == std::string::npos || colon <= hostStart + 3) {
+            return "";
+        }
+        return origin.substr(hostStart + 3, colon - hostStart - 3);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.pending || it->second.addresses.empty()) {
+        return "";
+    }
+    return it->second.addresses.front();
+}
+
+void DnsCache::setTtl(int seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ttlSeconds_ = std::max(0, seconds);
+}
+
+int DnsCache::getTtl() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ttlSeconds_;
+}
+
+void DnsCache::setHappyEyeballsTimeout(int timeoutMs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    happyEyeballsMs_ = std::max(0, timeoutMs);
+}
+
+int DnsCache::getHappyEyeballsTimeout() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return happyEyeballsMs_;
+}
+
+size_t DnsCache::getCachedHostCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    return static_cast<size_t>(std::count_if(entries_.begin(), entries_.end(),
+        [now](const std::pair<const std::string, Entry>& pair) {
+            return !pair.second.pending && !pair.second.addresses.empty() && pair.second.expires > now;
+        }));
+}
+
+void DnsCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Lookups in flight still need their entries
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.pending) {
+            ++it;
+        } else {
+            it = entries_.erase(it);
+        }
+    }
+}
+
+void DnsCache::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        changed_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+
+        std::string key = queue_.front();
+        queue_.pop_front();
+        int ttl = ttlSeconds_;
+        lock.unlock();
+
+        size_t colon = key.rfind(':');
+        std::vector<std::string> addresses;
+        bool found = lookup(key.substr(0, colon), key.substr(colon + 1), addresses);
+        if (!found) {
+            dm::utils::Logger::debug("DNS prefetch found no address for " + key);
+        }
+
+        lock.lock();
+        Entry& entry = entries_[key];
+        entry.pending = false;
+        entry.addresses = std::move(addresses);
+        // Failures are retried on the next prefetch rather than cached
+        entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(found ? ttl : 0);
+    }
+}
+
+bool DnsCache::enqueue(const std::string& key) {
+    auto it = entries_.find(key);
+    if (it != entries_.end() &&
+        (it->second.pending || it->second.expires > std::chrono::steady_clock::now())) {
+        return false;
+    }
+
+    entries_[key].pending = true;
+    queue_.push_back(key);
+    return true;
+}
+
+bool DnsCache::lookup(const std::string& host, const std::string& port,
+                      std::vector<std::string>& addresses) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        return false;
+    }
+
+    // Keep the resolver's preference order within each family
+    std::vector<std::string> preferred;
+    std::vector<std::string> other;
+    int preferredFamily = result->ai_family;
+    for (addrinfo* info = result; info; info = info->ai_next) {
+        char text[INET6_ADDRSTRLEN] = {};
+        std::string address;
+        if (info->ai_family == AF_INET6) {
+            auto* sin6 = reinterpret_cast<sockaddr_in6*>(info->ai_addr);
+            if (inet_ntop(AF_INET6, &sin6->sin6_addr, text, sizeof(text))) {
+                address = "[" + std::string(text) + "]";
+            }
+        } else if (info->ai_family == AF_INET) {
+            auto* sin = reinterpret_cast<sockaddr_in*>(info->ai_addr);
+            if (inet_ntop(AF_INET, &sin->sin_addr, text, sizeof(text))) {
+                address = text;
+            }
+        }
+        if (address.empty()) {
+            continue;
+        }
+
+        auto& list = info->ai_family == preferredFamily ? preferred : other;
+        if (std::find(list.begin(), list.end(), address) == list.end()) {
+            list.push_back(address);
+        }
+    }
+    freeaddrinfo(result);
+
+    // Alternate families so a dead family costs one attempt, not several
+    for (size_t i = 0; i < std::max(preferred.size(), other.size()); i++) {
+        if (i < preferred.size()) {
+            addresses.push_back(preferred[i]);
+        }
+        if (i < other.size()) {
+            addresses.push_back(other[i]);
+        }
+    }
+
+    return !addresses.empty();
+}
+
+bool DnsCache::makeKey(const std::string& url, std::string& key) {
+    // "scheme://host:port" with the default port filled in
+    std::string origin = CurlHandlePool::makeKey(url);
+    size_t hostStart = origin.find("://");
+    size_t colon = origin.rfind(':');
+    if (hostStart == std::string::npos || colon == std::string::npos || colon <= hostStart + 3) {
+        return false;
+    }
+    hostStart += 3;
+
+    std::string host = origin.substr(hostStart, colon - hostStart);
+    if (host.empty() || host.front() == '[') {
+        return false;
+    }
+
+    // Nothing to resolve for an IPv4 literal
+    in_addr address;
+    if (inet_pton(AF_INET, host.c_str(), &address) == 1) {
+        return false;
+    }
+
+    key = origin.substr(hostStart);
+    return true;
+}
+
+} // namespace core
+} // namespace dm
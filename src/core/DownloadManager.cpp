@@ -1,14 +1,70 @@
 #include "core/DownloadManager.h"
+#include "core/DnsCache.h"
+#include "core/HostConnectionLimiter.h"
+#include "core/LinkStats.h"
+#include "core/ContentSniffer.h"
+#include "core/ContentStore.h"
+#include "core/DataFilter.h"
+#include "core/DeviceIoScheduler.h"
+#include "core/DiskSpaceLedger.h"
+#include "core/SocketTuner.h"
+#include "core/ProxyPool.h"
+#include "core/ClusterCoordinator.h"
+#include "core/PeerCache.h"
+#include "core/MetadataPrefetcher.h"
+#include "core/WriteBufferPool.h"
+#include "core/TransferCounters.h"
+#include "core/ValidatorCache.h"
 #include "utils/Logger.h"
+#include "utils/DiskIo.h"
 #include "utils/FileUtils.h"
 #include "utils/UrlParser.h"
+#include "utils/HashCalculator.h"
+#include "utils/MetalinkParser.h"
+#include "utils/ResourceMonitor.h"
+#include "utils/StartupTimer.h"
+#include "utils/ThreadStack.h"
 
 #include <fstream>
+#include <algorithm>
+#include <cctype>
+#if defined(DM_EMBEDDED) && defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#ifndef DM_EMBEDDED
 #include <json/json.h> // Using jsoncpp library for task serialization
+#endif
 
 namespace dm {
 namespace core {
 
+namespace {
+
+const size_t FILTER_PAGE_SIZE = 4096;
+
+// Status changes of the bulk operation running on this thread, reported together at its end
+thread_local std::vector<TaskStatusChange>* bulkChanges = nullptr;
+
+// Audio and video containers a player can start on before they are complete
+const char* const STREAMABLE_EXTENSIONS[] = {
+    "mp4", "m4v", "m4a", "mkv", "webm", "mov", "avi", "ts", "flv", "mp3", "ogg", "oga", "ogv", "opus", "flac", "wav"
+};
+
+bool isStreamableMedia(const std::string& name) {
+    std::string path = name.substr(0, name.find_first_of("?#"));
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+        return false;
+    }
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return std::find(std::begin(STREAMABLE_EXTENSIONS), std::end(STREAMABLE_EXTENSIONS), extension) !=
+           std::end(STREAMABLE_EXTENSIONS);
+}
+
+} // anonymous namespace
+
 DownloadManager& DownloadManager::getInstance() {
     static DownloadManager instance;
     return instance;
@@ -18,6 +74,14 @@ DownloadManager::DownloadManager()
     : running_(false) {
     settings_ = std::make_shared<Settings>();
     queue_ = std::make_shared<DownloadQueue>();
+    throttler_ = std::make_shared<Throttler>();
+    pipeline_ = std::make_unique<PostProcessingPipeline>();
+    addBuiltInStages();
+    
+    // The queue owns the tasks' status callbacks and forwards transitions here
+    queue_->setStatusChangeCallback([this](std::shared_ptr<DownloadTask> task, DownloadStatus, DownloadStatus newStatus) {
+        this->onTaskStatusChanged(task, newStatus);
+    });
 }
 
 DownloadManager::~DownloadManager() {
@@ -40,29 +104,214 @@ bool DownloadManager::initialize() {
     }
     
     // Load settings
-    settings_->load();
+    {
+        dm::utils::StartupStage stage("settings");
+        settings_->load();
+    }
+    
+#if defined(DM_EMBEDDED) && defined(__GLIBC__)
+    // Each thread would get a malloc arena of its own, keeping what it once held
+    mallopt(M_ARENA_MAX, EMBEDDED_MALLOC_ARENAS);
+#endif
+    
+    // Before the engine starts its threads, which all take this stack size
+    dm::utils::ThreadStack::setDefaultSize(static_cast<size_t>(std::max(0, settings_->getThreadStackSize())) * 1024);
+    WriteBufferPool::setBudget(static_cast<size_t>(std::max(0, settings_->getWriteBufferBudget())) * 1024);
     
     // Set queue settings
     queue_->setMaxConcurrentDownloads(settings_->getMaxConcurrentDownloads());
     
+    // Apply the global bandwidth limit
+    throttler_->setMaxBandwidth(getTargetBandwidth());
+    
+    // Limits changed later, here or from the settings dialog, apply at once
+    settingsCallbackId_ = settings_->addChangeCallback(
+        [this](const SettingsSnapshot& previous, const SettingsSnapshot& current) {
+            if (current.maxConcurrentDownloads != previous.maxConcurrentDownloads) {
+                queue_->setMaxConcurrentDownloads(current.maxConcurrentDownloads);
+            }
+            if (current.maxDownloadSpeed != previous.maxDownloadSpeed) {
+                throttler_->setMaxBandwidth(getTargetBandwidth());
+            }
+        });
+    
+    // Configure host resolution shared by all transfers
+    DnsCache::getInstance().setTtl(settings_->getDnsCacheTtl());
+    DnsCache::getInstance().setHappyEyeballsTimeout(settings_->getHappyEyeballsTimeout());
+    
+    // Share connections per host between downloads, and retry waiting
+    // segments as soon as a connection is given back
+    HostConnectionLimiter::getInstance().setLimits(settings_->getMaxConnectionsPerHost(),
+                                                   settings_->getMaxConnectionsPerAddress(),
+                                                   settings_->getMaxConnections());
+    HostConnectionLimiter::getInstance().setReleaseCallback([this]() {
+        queue_->notifyChange();
+    });
+    
+    // Let measured link quality move the connection budget below that limit
+    if (settings_->getAdaptiveConcurrency()) {
+        concurrencyController_ = std::make_unique<ConcurrencyController>(MIN_ADAPTIVE_CONNECTIONS,
+                                                                         settings_->getMaxConnections());
+        HostConnectionLimiter::getInstance().setMaxConnections(concurrencyController_->getConnections());
+    }
+    
+    // Before any output file is opened, files keep the backend they opened with
+    if (settings_->getDiskIoBackend() != dm::utils::DiskIoBackendType::PORTABLE) {
+        dm::utils::DiskIoBackend::select(settings_->getDiskIoBackend());
+    }
+    
+    ContentStore::getInstance().setDirectory(settings_->getContentStore());
+    ContentStore::getInstance().setHardLinks(settings_->getContentStoreHardLinks());
+    DataFilterRegistry::getInstance().setCallBudget(settings_->getPluginCallBudget());
+    SocketTuner::getInstance().setProfile(settings_->getSocketProfile());
+    
+    // Spread connections over the proxy pool, segments waiting for a full
+    // pool are retried like those waiting for their host
+    ProxyPool& proxyPool = ProxyPool::getInstance();
+    proxyPool.setAssignment(settings_->getProxyAssignment());
+    proxyPool.setDefaultMaxConnections(settings_->getProxyMaxConnections());
+    proxyPool.setProxies(settings_->getProxyPool());
+    proxyPool.setHealthCheckUrl(settings_->getProxyHealthUrl());
+    proxyPool.setReleaseCallback([this]() {
+        queue_->notifyChange();
+    });
+    
+    // Share batch items and large files with the nodes of the cluster
+    ClusterCoordinator& cluster = ClusterCoordinator::getInstance();
+    cluster.setNodeId(settings_->getClusterNodeId());
+    cluster.setLeaseSeconds(settings_->getClusterLeaseSeconds());
+    cluster.setSplitSize(static_cast<int64_t>(std::max(0, settings_->getClusterSplitSize())) * 1024 * 1024);
+    cluster.setPieceSize(static_cast<int64_t>(settings_->getClusterPieceSize()) * 1024 * 1024);
+    cluster.setDirectory(settings_->getClusterDirectory());
+    
+    // Serve finished downloads to the LAN and take those it has from there first
+    PeerCache& peerCache = PeerCache::getInstance();
+    peerCache.load(appDataDir + "/peers.index");
+    peerCache.setStaticPeers(settings_->getPeerCachePeers());
+    if (settings_->getPeerCache()) {
+        peerCache.start(settings_->getPeerCachePort(), cluster.getNodeId());
+    }
+    
+    // Probe the downloads due next while they wait for a slot
+    MetadataPrefetcher& prefetcher = MetadataPrefetcher::getInstance();
+    prefetcher.setLookahead(settings_->getPrefetchQueuedTasks());
+    prefetcher.setTtl(settings_->getPrefetchTtl());
+    
+    // Also before any output file is opened, files keep the queue of their device
+    DeviceIoScheduler& deviceScheduler = DeviceIoScheduler::getInstance();
+    deviceScheduler.setEnabled(settings_->getDeviceIoScheduling());
+    for (StorageKind kind : {StorageKind::SSD, StorageKind::HDD, StorageKind::NETWORK}) {
+        deviceScheduler.setMaxWriters(kind, settings_->getMaxDeviceWriters(kind));
+    }
+    DiskSpaceLedger::getInstance().setEnabled(settings_->getReserveDiskSpace());
+    DiskSpaceLedger::getInstance().setMargin(static_cast<int64_t>(settings_->getDiskSpaceMargin()) * 1024 * 1024);
+    
+    // Configure multiplexed connections for the event loop engine
+    if (settings_->getHttpMultiplexing()) {
+        TransferEngine::getInstance().setMultiplexing(settings_->getMaxStreamsPerConnection(), settings_->getHttp3());
+    }
+    
+    // Sample process memory, files and threads in the background
+    dm::utils::ResourceMonitor::getInstance().start(settings_->getResourceSampleInterval());
+    
+    // Engine timings are only taken while a metrics file is written
+    std::string metricsFile = settings_->getMetricsFile();
+    if (!metricsFile.empty()) {
+        metricsExporter_ = std::make_unique<MetricsExporter>([this]() { return collectGauges(); });
+        metricsExporter_->start(metricsFile, settings_->getMetricsInterval());
+    }
+    
     // Set queue processor callback
     queue_->setQueueProcessorCallback([this]() {
         // This is called when the queue is processed
         // Here we can add additional logic if needed
     });
     
+    // Saved state loads in the background, callers needing tasks wait for it
+    {
+        std::lock_guard<std::mutex> loadLock(loadMutex_);
+        loadingTasks_ = true;
+    }
+    running_ = true;
+    loaderThread_ = std::make_unique<std::thread>(&DownloadManager::loadInBackground, this);
+    
+    dm::utils::Logger::info("Download manager initialized");
+    return true;
+}
+
+void DownloadManager::loadInBackground() {
+    std::string appDataDir = dm::utils::FileUtils::getAppDataDirectory();
+    
+    // History from earlier runs, by the hour
+    {
+        dm::utils::StartupStage stage("history archives");
+        speedHistory_.openArchive(appDataDir + "/speed.history");
+        completionHistory_.openArchive(appDataDir + "/completions.history");
+    }
+    
+    // Hashes of files left unchanged since the last run are not recalculated
+    {
+        dm::utils::StartupStage stage("hash manifest");
+        dm::utils::HashCalculator::loadHashManifest(appDataDir + "/hashes.manifest");
+        ValidatorCache::getInstance().load(appDataDir + "/validators.cache");
+    }
+    
+    // Stored files whose downloads were all deleted
+    {
+        dm::utils::StartupStage stage("content store");
+        ContentStore::getInstance().prune();
+    }
+    
     // Load tasks
-    if (!loadTasks()) {
-        dm::utils::Logger::warning("Failed to load saved tasks");
-        // Continue anyway, not critical
+    {
+        dm::utils::StartupStage stage("task journal");
+        std::vector<std::shared_ptr<DownloadTask>> restored;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex_);
+            if (!loadTasks(restored)) {
+                dm::utils::Logger::warning("Failed to load saved tasks");
+                // Continue anyway, not critical
+            }
+        }
+        
+        // The queue is never locked inside tasksMutex_
+        for (const auto& task : restored) {
+            queue_->addTask(task);
+        }
     }
     
     // Start queue processor thread
-    running_ = true;
     queueProcessorThread_ = std::make_unique<std::thread>(&DownloadManager::queueProcessorThread, this);
     
-    dm::utils::Logger::info("Download manager initialized");
-    return true;
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> loadLock(loadMutex_);
+        loadingTasks_ = false;
+        callbacks.swap(tasksLoadedCallbacks_);
+    }
+    loadCondition_.notify_all();
+    dm::utils::StartupTimer::getInstance().markMilestone("tasks loaded");
+    
+    for (const auto& callback : callbacks) {
+        callback();
+    }
+}
+
+void DownloadManager::waitUntilTasksLoaded() const {
+    std::unique_lock<std::mutex> loadLock(loadMutex_);
+    loadCondition_.wait(loadLock, [this]() { return !loadingTasks_; });
+}
+
+void DownloadManager::whenTasksLoaded(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> loadLock(loadMutex_);
+        if (loadingTasks_) {
+            tasksLoadedCallbacks_.push_back(std::move(callback));
+            return;
+        }
+    }
+    
+    callback();
 }
 
 void DownloadManager::shutdown() {
@@ -77,6 +326,17 @@ void DownloadManager::shutdown() {
         running_ = false;
     }
     
+    // The queue processor is started by the loader, which finishes first
+    if (loaderThread_ && loaderThread_->joinable()) {
+        loaderThread_->join();
+    }
+    
+    // Wake the queue processor so it sees the flag
+    HostConnectionLimiter::getInstance().setReleaseCallback(nullptr);
+    ProxyPool::getInstance().setReleaseCallback(nullptr);
+    ProxyPool::getInstance().shutdown();
+    queue_->notifyChange();
+    
     // Save tasks
     saveTasks();
     
@@ -85,9 +345,32 @@ void DownloadManager::shutdown() {
         queueProcessorThread_->join();
     }
     
+    // Work saved above goes back to the other nodes of the cluster
+    ClusterCoordinator::getInstance().shutdown();
+    PeerCache::getInstance().stop();
+    PeerCache::getInstance().save(dm::utils::FileUtils::getAppDataDirectory() + "/peers.index");
+    MetadataPrefetcher::getInstance().shutdown();
+    
+    // Stages already running finish, files still waiting are left as they are
+    pipeline_->stop();
+    dm::utils::HashCalculator::saveHashManifest(
+        dm::utils::FileUtils::getAppDataDirectory() + "/hashes.manifest");
+    ValidatorCache::getInstance().save(dm::utils::FileUtils::getAppDataDirectory() + "/validators.cache");
+    
+    // The last metrics file written stays in place
+    metricsExporter_.reset();
+    
+    // Nothing may be journaled after the final checkpoint
+    if (journal_) {
+        journal_->close();
+    }
+    
     // Save settings
+    settings_->removeChangeCallback(settingsCallbackId_);
     settings_->save();
     
+    dm::utils::ResourceMonitor::getInstance().stop();
+    
     dm::utils::Logger::info("Download manager shutdown");
 }
 
@@ -95,6 +378,101 @@ std::shared_ptr<DownloadTask> DownloadManager::addDownload(const std::string& ur
                                                          const std::string& destinationPath,
                                                          const std::string& filename,
                                                          bool start) {
+    return addTask({url}, destinationPath, filename, start, nullptr);
+}
+
+std::shared_ptr<DownloadTask> DownloadManager::addMirroredDownload(const std::vector<std::string>& urls,
+                                                                 const std::string& destinationPath,
+                                                                 const std::string& filename,
+                                                                 bool start) {
+    if (urls.empty()) {
+        dm::utils::Logger::error("No URLs provided");
+        return nullptr;
+    }
+    
+    // Resolve every mirror up front, the task probes them all at once
+    DnsCache::getInstance().prefetch(urls);
+    
+    return addTask(urls, destinationPath, filename, start, nullptr);
+}
+
+std::vector<std::shared_ptr<DownloadTask>> DownloadManager::addMetalinkDownload(const std::string& metalinkPath,
+                                                                              const std::string& destinationPath,
+                                                                              bool start) {
+    std::vector<std::shared_ptr<DownloadTask>> addedTasks;
+    
+    std::vector<dm::utils::MetalinkFile> files;
+    if (!dm::utils::MetalinkParser::parseFile(metalinkPath, files)) {
+        return addedTasks;
+    }
+    
+    std::string baseDirectory = destinationPath.empty() ? settings_->getDownloadDirectory() : destinationPath;
+    
+    for (const auto& file : files) {
+        // Names may place the file in subdirectories
+        std::string directory = baseDirectory;
+        std::string filename = file.name;
+        size_t slash = file.name.find_last_of("/\\");
+        if (slash != std::string::npos) {
+            directory = dm::utils::FileUtils::combinePaths(baseDirectory, file.name.substr(0, slash));
+            filename = file.name.substr(slash + 1);
+        }
+        
+        // Verify with the strongest hash the document gives
+        dm::utils::HashAlgorithm hashAlgorithm = dm::utils::HashAlgorithm::SHA256;
+        std::string hash;
+        for (const char* type : {"sha-512", "sha-256", "sha-1", "md5"}) {
+            auto it = file.hashes.find(type);
+            if (it != file.hashes.end() && dm::utils::HashCalculator::parseAlgorithm(type, hashAlgorithm)) {
+                hash = it->second;
+                break;
+            }
+        }
+        
+        // Piece hashes let a corrupt piece be fetched again on its own
+        PieceMap pieces;
+        if (!file.pieceHashes.empty() &&
+            dm::utils::HashCalculator::parseAlgorithm(file.pieceHashType, pieces.algorithm)) {
+            pieces.pieceSize = file.pieceLength;
+            pieces.published = true;
+            pieces.hashes = file.pieceHashes;
+        }
+        
+        DnsCache::getInstance().prefetch(file.urls);
+        auto task = addTask(file.urls, directory, filename, false,
+                            [&file, &hash, hashAlgorithm, &pieces](const std::shared_ptr<DownloadTask>& task) {
+            task->setExpectedSize(file.size);
+            if (!hash.empty()) {
+                task->setExpectedHash(hashAlgorithm, hash);
+            }
+            if (!pieces.empty()) {
+                task->setPieceHashes(pieces);
+            }
+        });
+        if (task) {
+            addedTasks.push_back(task);
+        }
+    }
+    
+    // Start tasks if requested
+    if (start) {
+        for (const auto& task : addedTasks) {
+            startDownload(task->getId());
+        }
+    }
+    
+    return addedTasks;
+}
+
+std::shared_ptr<DownloadTask> DownloadManager::addTask(const std::vector<std::string>& urls,
+                                                     const std::string& destinationPath,
+                                                     const std::string& filename,
+                                                     bool start,
+                                                     const std::function<void(const std::shared_ptr<DownloadTask>&)>& prepare) {
+    waitUntilTasksLoaded();
+    
+    const std::string& url = urls.front();
+    
     // Validate URL
     if (url.empty()) {
         dm::utils::Logger::error("Empty URL provided");
@@ -136,8 +514,13 @@ std::shared_ptr<DownloadTask> DownloadManager::addDownload(const std::string& ur
     // Create download task
     auto task = std::make_shared<DownloadTask>(url, finalDestinationPath, finalFilename);
     
-    // Set segment count from settings
-    task->setSegmentCount(settings_->getSegmentCount());
+    configureTask(task);
+    if (urls.size() > 1) {
+        task->setMirrors(std::vector<std::string>(urls.begin() + 1, urls.end()));
+    }
+    if (prepare) {
+        prepare(task);
+    }
     
     // Initialize task
     if (!task->initialize()) {
@@ -151,6 +534,11 @@ std::shared_ptr<DownloadTask> DownloadManager::addDownload(const std::string& ur
         tasks_[task->getId()] = task;
     }
     
+    // Journal it before its status changes are
+    if (journal_) {
+        journal_->recordAdd(describeTask(task));
+    }
+    
     // Add to download queue
     queue_->addTask(task);
     
@@ -168,6 +556,55 @@ std::shared_ptr<DownloadTask> DownloadManager::addDownload(const std::string& ur
     return task;
 }
 
+std::string DownloadManager::queueDownload(const std::string& url,
+                                           const std::string& destinationPath,
+                                           const std::string& filename,
+                                           DownloadPriority priority,
+                                           bool start) {
+    waitUntilTasksLoaded();
+    
+    dm::utils::UrlInfo urlInfo = dm::utils::UrlParser::parse(url);
+    if (url.empty() || !urlInfo.isValid()) {
+        dm::utils::Logger::error("Invalid URL: " + url);
+        return "";
+    }
+    
+    JournalEntry entry;
+    entry.id = DownloadTask::generateId();
+    entry.url = url;
+    entry.destinationPath = destinationPath.empty() ? settings_->getDownloadDirectory() : destinationPath;
+    entry.filename = filename.empty() ? urlInfo.filename : filename;
+    if (entry.filename.empty()) {
+        entry.filename = "download"; // Fallback name
+    }
+    entry.status = start ? DownloadStatus::QUEUED : DownloadStatus::NONE;
+    entry.priority = priority;
+    
+    if (!dm::utils::FileUtils::createDirectory(entry.destinationPath)) {
+        dm::utils::Logger::error("Failed to create destination directory: " + entry.destinationPath);
+        return "";
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        if (!records_.add(entry)) {
+            dm::utils::Logger::error("Failed to queue download: " + url);
+            return "";
+        }
+    }
+    
+    if (journal_) {
+        journal_->recordAdd(entry);
+    }
+    
+    // The queue processor hydrates it once a slot is free
+    if (start) {
+        queue_->notifyChange();
+    }
+    
+    return entry.id;
+}
+
 std::vector<std::shared_ptr<DownloadTask>> DownloadManager::addBatchDownload(
     const std::vector<std::string>& urls,
     const std::string& destinationPath,
@@ -175,6 +612,9 @@ std::vector<std::shared_ptr<DownloadTask>> DownloadManager::addBatchDownload(
     
     std::vector<std::shared_ptr<DownloadTask>> addedTasks;
     
+    // Resolve every host up front, the probes below then skip the resolver
+    DnsCache::getInstance().prefetch(urls);
+    
     for (const auto& url : urls) {
         auto task = addDownload(url, destinationPath, "", false);
         if (task) {
@@ -193,22 +633,102 @@ std::vector<std::shared_ptr<DownloadTask>> DownloadManager::addBatchDownload(
 }
 
 bool DownloadManager::startDownload(const std::string& taskId) {
+    getDownloadTask(taskId);
     return queue_->startTask(taskId);
 }
 
 bool DownloadManager::pauseDownload(const std::string& taskId) {
+    waitUntilTasksLoaded();
     return queue_->pauseTask(taskId);
 }
 
 bool DownloadManager::resumeDownload(const std::string& taskId) {
+    getDownloadTask(taskId);
     return queue_->resumeTask(taskId);
 }
 
 bool DownloadManager::cancelDownload(const std::string& taskId) {
+    waitUntilTasksLoaded();
+    
+    {
+        // A record has nothing running, it only changes status
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        JournalEntry entry;
+        if (records_.get(taskId, entry)) {
+            if (entry.status == DownloadStatus::COMPLETED || entry.status == DownloadStatus::CANCELED) {
+                return false;
+            }
+            records_.setStatus(taskId, DownloadStatus::CANCELED);
+            if (journal_) {
+                journal_->recordStatus(taskId, DownloadStatus::CANCELED);
+            }
+            return true;
+        }
+    }
+    
     return queue_->cancelTask(taskId);
 }
 
+bool DownloadManager::setDownloadPriority(const std::string& taskId, DownloadPriority priority) {
+    waitUntilTasksLoaded();
+    
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        JournalEntry entry;
+        if (records_.get(taskId, entry)) {
+            records_.setPriority(taskId, priority);
+            entry.priority = priority;
+            if (journal_) {
+                journal_->recordAdd(entry);
+            }
+            return true;
+        }
+    }
+    
+    if (!queue_->setTaskPriority(taskId, priority)) {
+        return false;
+    }
+    
+    // An ADD record replaces the saved task as a whole
+    auto task = getDownloadTask(taskId);
+    if (task && journal_) {
+        journal_->recordAdd(describeTask(task));
+    }
+    return true;
+}
+
+bool DownloadManager::setDownloadStreaming(const std::string& taskId, bool enabled) {
+    auto task = getDownloadTask(taskId);
+    if (!task) {
+        return false;
+    }
+    
+    task->setStreamingPriority(enabled);
+    return true;
+}
+
 bool DownloadManager::removeDownload(const std::string& taskId, bool deleteFile) {
+    waitUntilTasksLoaded();
+    
+    // A record goes without ever getting a task
+    JournalEntry entry;
+    bool isRecord;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        isRecord = records_.take(taskId, entry);
+    }
+    if (isRecord) {
+        std::string filePath = entry.destinationPath + "/" + entry.filename;
+        if (deleteFile && dm::utils::FileUtils::fileExists(filePath) &&
+            !dm::utils::FileUtils::deleteFile(filePath)) {
+            dm::utils::Logger::warning("Failed to delete file: " + filePath);
+        }
+        if (journal_) {
+            journal_->recordRemove(taskId);
+        }
+        return true;
+    }
+    
     // Get task
     auto task = getDownloadTask(taskId);
     if (!task) {
@@ -226,15 +746,19 @@ bool DownloadManager::removeDownload(const std::string& taskId, bool deleteFile)
         }
     }
     
-    // Remove from queue
-    bool removed = queue_->removeTask(taskId);
-    
-    // Remove from tasks map
+    // Remove from tasks map first, so the cancel below cannot turn it into a record
     {
         std::lock_guard<std::mutex> lock(tasksMutex_);
         tasks_.erase(taskId);
     }
     
+    // Remove from queue
+    bool removed = queue_->removeTask(taskId);
+    
+    if (journal_) {
+        journal_->recordRemove(taskId);
+    }
+    
     // Call task removed callback
     if (removed && taskRemovedCallback_) {
         taskRemovedCallback_(task);
@@ -243,52 +767,296 @@ bool DownloadManager::removeDownload(const std::string& taskId, bool deleteFile)
     return removed;
 }
 
-void DownloadManager::startAllDownloads() {
-    queue_->startAllTasks();
+std::vector<std::string> DownloadManager::findDownloads(const TaskFilter& filter) {
+    waitUntilTasksLoaded();
+    
+    std::vector<std::string> taskIds;
+    for (const auto& task : getAllDownloadTasks()) {
+        JournalEntry entry;
+        entry.id = task->getId();
+        entry.url = task->getUrl();
+        entry.destinationPath = task->getDestinationPath();
+        entry.filename = task->getFilename();
+        entry.status = task->getStatus();
+        entry.priority = task->getPriority();
+        entry.fileSize = task->getFileSize();
+        entry.supportsResume = task->supportsResume();
+        if (filter(entry)) {
+            taskIds.push_back(entry.id);
+        }
+    }
+    
+    // Records are filtered a page at a time, outside the lock
+    for (size_t offset = 0;; offset += FILTER_PAGE_SIZE) {
+        std::vector<JournalEntry> page = getDormantTasks(offset, FILTER_PAGE_SIZE);
+        for (const auto& entry : page) {
+            if (filter(entry)) {
+                taskIds.push_back(entry.id);
+            }
+        }
+        if (page.size() < FILTER_PAGE_SIZE) {
+            break;
+        }
+    }
+    
+    return taskIds;
 }
 
-void DownloadManager::pauseAllDownloads() {
-    queue_->pauseAllTasks();
+std::vector<bool> DownloadManager::startDownloads(const std::vector<std::string>& taskIds) {
+    waitUntilTasksLoaded();
+    
+    std::vector<TaskStatusChange> changes;
+    beginBulk(changes);
+    std::vector<bool> results = queue_->startTasks(taskIds);
+    setRecordsStatus(taskIds, results,
+                     {DownloadStatus::NONE, DownloadStatus::PAUSED, DownloadStatus::DOWNLOAD_ERROR,
+                      DownloadStatus::CANCELED},
+                     DownloadStatus::QUEUED);
+    endBulk(changes, "Started", results);
+    
+    queue_->notifyChange();
+    return results;
 }
 
-void DownloadManager::resumeAllDownloads() {
-    queue_->resumeAllTasks();
+std::vector<bool> DownloadManager::pauseDownloads(const std::vector<std::string>& taskIds) {
+    waitUntilTasksLoaded();
+    
+    std::vector<TaskStatusChange> changes;
+    beginBulk(changes);
+    std::vector<bool> results = queue_->pauseTasks(taskIds);
+    setRecordsStatus(taskIds, results, {DownloadStatus::QUEUED}, DownloadStatus::PAUSED);
+    endBulk(changes, "Paused", results);
+    return results;
 }
 
-void DownloadManager::cancelAllDownloads() {
-    queue_->cancelAllTasks();
+std::vector<bool> DownloadManager::resumeDownloads(const std::vector<std::string>& taskIds) {
+    waitUntilTasksLoaded();
+    
+    std::vector<TaskStatusChange> changes;
+    beginBulk(changes);
+    std::vector<bool> results = queue_->resumeTasks(taskIds);
+    setRecordsStatus(taskIds, results, {DownloadStatus::PAUSED}, DownloadStatus::QUEUED);
+    endBulk(changes, "Resumed", results);
+    
+    queue_->notifyChange();
+    return results;
 }
 
-std::shared_ptr<DownloadTask> DownloadManager::getDownloadTask(const std::string& taskId) {
-    std::lock_guard<std::mutex> lock(tasksMutex_);
-    
-    auto it = tasks_.find(taskId);
-    if (it != tasks_.end()) {
-        return it->second;
-    }
+std::vector<bool> DownloadManager::cancelDownloads(const std::vector<std::string>& taskIds) {
+    waitUntilTasksLoaded();
     
-    return nullptr;
+    std::vector<TaskStatusChange> changes;
+    beginBulk(changes);
+    std::vector<bool> results = queue_->cancelTasks(taskIds);
+    setRecordsStatus(taskIds, results,
+                     {DownloadStatus::NONE, DownloadStatus::QUEUED, DownloadStatus::PAUSED,
+                      DownloadStatus::DOWNLOAD_ERROR},
+                     DownloadStatus::CANCELED);
+    endBulk(changes, "Canceled", results);
+    return results;
 }
 
-std::vector<std::shared_ptr<DownloadTask>> DownloadManager::getAllDownloadTasks() {
-    std::lock_guard<std::mutex> lock(tasksMutex_);
+std::vector<bool> DownloadManager::setDownloadsPriority(const std::vector<std::string>& taskIds,
+                                                        DownloadPriority priority) {
+    waitUntilTasksLoaded();
     
-    std::vector<std::shared_ptr<DownloadTask>> result;
-    result.reserve(tasks_.size());
+    std::vector<TaskStatusChange> changes;
+    beginBulk(changes);
     
-    for (const auto& pair : tasks_) {
-        result.push_back(pair.second);
+    // Records first, the rest are tasks
+    std::vector<bool> results(taskIds.size(), false);
+    std::vector<std::string> liveIds;
+    std::vector<size_t> liveIndexes;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        for (size_t i = 0; i < taskIds.size(); i++) {
+            JournalEntry entry;
+            if (records_.get(taskIds[i], entry)) {
+                records_.setPriority(taskIds[i], priority);
+                entry.priority = priority;
+                if (journal_) {
+                    journal_->recordAdd(entry);
+                }
+                results[i] = true;
+            } else {
+                liveIds.push_back(taskIds[i]);
+                liveIndexes.push_back(i);
+            }
+        }
     }
     
-    return result;
+    std::vector<bool> liveResults = queue_->setTasksPriority(liveIds, priority);
+    std::vector<std::shared_ptr<DownloadTask>> changed;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        for (size_t i = 0; i < liveIds.size(); i++) {
+            results[liveIndexes[i]] = liveResults[i];
+            auto it = tasks_.find(liveIds[i]);
+            if (liveResults[i] && it != tasks_.end()) {
+                changed.push_back(it->second);
+            }
+        }
+    }
+    
+    // An ADD record replaces the saved task as a whole
+    if (journal_) {
+        for (const auto& task : changed) {
+            journal_->recordAdd(describeTask(task));
+        }
+    }
+    
+    endBulk(changes, "Reprioritized", results);
+    return results;
 }
 
-std::vector<std::shared_ptr<DownloadTask>> DownloadManager::getDownloadTasksByStatus(DownloadStatus status) {
-    std::lock_guard<std::mutex> lock(tasksMutex_);
+std::vector<bool> DownloadManager::removeDownloads(const std::vector<std::string>& taskIds, bool deleteFile) {
+    waitUntilTasksLoaded();
     
-    std::vector<std::shared_ptr<DownloadTask>> result;
+    std::vector<TaskStatusChange> changes;
+    beginBulk(changes);
     
-    for (const auto& pair : tasks_) {
+    // Records go without ever getting a task; tasks leave the map before
+    // they are canceled, so the cancel cannot turn them into records
+    std::vector<bool> results(taskIds.size(), false);
+    std::vector<std::string> filePaths;
+    std::vector<std::shared_ptr<DownloadTask>> removedTasks;
+    std::vector<std::string> liveIds;
+    std::vector<size_t> liveIndexes;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        for (size_t i = 0; i < taskIds.size(); i++) {
+            JournalEntry entry;
+            if (records_.take(taskIds[i], entry)) {
+                filePaths.push_back(entry.destinationPath + "/" + entry.filename);
+                results[i] = true;
+                continue;
+            }
+            
+            auto it = tasks_.find(taskIds[i]);
+            if (it != tasks_.end()) {
+                filePaths.push_back(it->second->getDestinationPath() + "/" + it->second->getFilename());
+                removedTasks.push_back(it->second);
+                liveIds.push_back(taskIds[i]);
+                liveIndexes.push_back(i);
+                tasks_.erase(it);
+            }
+        }
+    }
+    
+    std::vector<bool> liveResults = queue_->removeTasks(liveIds);
+    for (size_t i = 0; i < liveIds.size(); i++) {
+        results[liveIndexes[i]] = liveResults[i];
+    }
+    
+    if (deleteFile) {
+        for (const auto& filePath : filePaths) {
+            if (dm::utils::FileUtils::fileExists(filePath) && !dm::utils::FileUtils::deleteFile(filePath)) {
+                dm::utils::Logger::warning("Failed to delete file: " + filePath);
+            }
+        }
+    }
+    
+    if (journal_) {
+        for (size_t i = 0; i < taskIds.size(); i++) {
+            if (results[i]) {
+                journal_->recordRemove(taskIds[i]);
+            }
+        }
+    }
+    
+    endBulk(changes, "Removed", results);
+    
+    if (taskRemovedCallback_) {
+        for (size_t i = 0; i < removedTasks.size(); i++) {
+            if (liveResults[i]) {
+                taskRemovedCallback_(removedTasks[i]);
+            }
+        }
+    }
+    return results;
+}
+
+void DownloadManager::startAllDownloads() {
+    waitUntilTasksLoaded();
+    
+    queue_->startAllTasks();
+    
+    // Records are queued and get their tasks as slots open
+    setRecordStatusWhere(DownloadStatus::NONE, DownloadStatus::QUEUED);
+    setRecordStatusWhere(DownloadStatus::PAUSED, DownloadStatus::QUEUED);
+    setRecordStatusWhere(DownloadStatus::DOWNLOAD_ERROR, DownloadStatus::QUEUED);
+    queue_->notifyChange();
+}
+
+void DownloadManager::pauseAllDownloads() {
+    waitUntilTasksLoaded();
+    
+    queue_->pauseAllTasks();
+}
+
+void DownloadManager::resumeAllDownloads() {
+    waitUntilTasksLoaded();
+    
+    queue_->resumeAllTasks();
+    
+    setRecordStatusWhere(DownloadStatus::PAUSED, DownloadStatus::QUEUED);
+    queue_->notifyChange();
+}
+
+void DownloadManager::cancelAllDownloads() {
+    waitUntilTasksLoaded();
+    
+    queue_->cancelAllTasks();
+    
+    // Like pending tasks, queued records are only taken off the queue
+    setRecordStatusWhere(DownloadStatus::QUEUED, DownloadStatus::NONE);
+    setRecordStatusWhere(DownloadStatus::PAUSED, DownloadStatus::CANCELED);
+}
+
+std::shared_ptr<DownloadTask> DownloadManager::getDownloadTask(const std::string& taskId) {
+    waitUntilTasksLoaded();
+    
+    std::shared_ptr<DownloadTask> task;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        
+        auto it = tasks_.find(taskId);
+        if (it != tasks_.end()) {
+            return it->second;
+        }
+        
+        task = hydrateTask(taskId);
+    }
+    
+    if (task) {
+        queue_->addTask(task);
+    }
+    return task;
+}
+
+std::vector<std::shared_ptr<DownloadTask>> DownloadManager::getAllDownloadTasks() {
+    waitUntilTasksLoaded();
+    
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    
+    std::vector<std::shared_ptr<DownloadTask>> result;
+    result.reserve(tasks_.size());
+    
+    for (const auto& pair : tasks_) {
+        result.push_back(pair.second);
+    }
+    
+    return result;
+}
+
+std::vector<std::shared_ptr<DownloadTask>> DownloadManager::getDownloadTasksByStatus(DownloadStatus status) {
+    waitUntilTasksLoaded();
+    
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    
+    std::vector<std::shared_ptr<DownloadTask>> result;
+    
+    for (const auto& pair : tasks_) {
         if (pair.second->getStatus() == status) {
             result.push_back(pair.second);
         }
@@ -297,6 +1065,20 @@ std::vector<std::shared_ptr<DownloadTask>> DownloadManager::getDownloadTasksBySt
     return result;
 }
 
+size_t DownloadManager::getDormantTaskCount() const {
+    waitUntilTasksLoaded();
+    
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    return records_.size();
+}
+
+std::vector<JournalEntry> DownloadManager::getDormantTasks(size_t offset, size_t count) const {
+    waitUntilTasksLoaded();
+    
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    return records_.list(offset, count);
+}
+
 void DownloadManager::setTaskAddedCallback(TaskAddedCallback callback) {
     taskAddedCallback_ = callback;
 }
@@ -306,31 +1088,366 @@ void DownloadManager::setTaskRemovedCallback(TaskRemovedCallback callback) {
 }
 
 void DownloadManager::setTaskStatusChangedCallback(TaskStatusChangedCallback callback) {
+    // Transitions of all tasks reach it through the queue
     taskStatusChangedCallback_ = callback;
-    // Set the callback for existing tasks
-    std::lock_guard<std::mutex> lock(tasksMutex_);
-    for (const auto& pair : tasks_) {
-        // The lambda must match StatusChangeCallback: (shared_ptr<DownloadTask>, DownloadStatus, DownloadStatus)
-        pair.second->setStatusChangeCallback([this, callback, task=pair.second](std::shared_ptr<DownloadTask> t, DownloadStatus oldStatus, DownloadStatus newStatus) {
-            // Forward to the DownloadManager's callback
-            if (callback) callback(t, newStatus);
-            this->onTaskStatusChanged(t, newStatus);
-        });
-    }
+}
+
+void DownloadManager::setBulkStatusChangedCallback(BulkStatusChangedCallback callback) {
+    bulkStatusChangedCallback_ = callback;
+}
+
+int DownloadManager::addTaskStatusListener(TaskStatusChangedCallback listener) {
+    std::lock_guard<std::mutex> lock(listenersMutex_);
+    int listenerId = nextListenerId_++;
+    statusListeners_[listenerId] = listener;
+    return listenerId;
+}
+
+void DownloadManager::removeTaskStatusListener(int listenerId) {
+    std::lock_guard<std::mutex> lock(listenersMutex_);
+    statusListeners_.erase(listenerId);
 }
 
 std::shared_ptr<Settings> DownloadManager::getSettings() {
     return settings_;
 }
 
-bool DownloadManager::loadTasks() {
-    std::string tasksFile = dm::utils::FileUtils::getAppDataDirectory() + "/tasks.json";
+PostProcessingPipeline& DownloadManager::getPostProcessingPipeline() {
+    return *pipeline_;
+}
+
+bool DownloadManager::loadTasks(std::vector<std::shared_ptr<DownloadTask>>& restored) {
+    std::string appDataDir = dm::utils::FileUtils::getAppDataDirectory();
+    std::string journalFile = appDataDir + "/tasks.journal";
+    std::string tasksFile = appDataDir + "/tasks.json";
+    
+    // Older versions saved the whole list to tasks.json instead
+    bool import = !dm::utils::FileUtils::fileExists(journalFile) && dm::utils::FileUtils::fileExists(tasksFile);
+    
+    if (!journal_) {
+        journal_ = std::make_unique<TaskJournal>(journalFile);
+    }
+    
+    std::vector<JournalEntry> entries;
+    if (!journal_->open(entries)) {
+        dm::utils::Logger::error("Failed to open task journal: " + journalFile);
+        return false;
+    }
+    
+    if (import) {
+        return importTasks(tasksFile, restored);
+    }
+    
+    for (const auto& entry : entries) {
+        restoreTask(entry, restored);
+    }
+    
+    dm::utils::Logger::info("Loaded " + std::to_string(entries.size()) + " tasks from " + journalFile);
+    return true;
+}
+
+bool DownloadManager::saveTasks() {
+    waitUntilTasksLoaded();
+    
+    if (!journal_ || !journal_->isOpen()) {
+        return false;
+    }
+    
+    // Everything but progress is already journaled
+    for (const auto& task : getAllDownloadTasks()) {
+        checkpointTask(task);
+    }
+    
+    if (!journal_->sync()) {
+        dm::utils::Logger::error("Failed to flush task journal: " + journal_->getPath());
+        return false;
+    }
+    
+    dm::utils::Logger::info("Saved tasks to " + journal_->getPath());
+    return true;
+}
+
+void DownloadManager::configureTask(const std::shared_ptr<DownloadTask>& task) {
+    // Set segment count from settings
+    auto settings = settings_->getSnapshot();
+    task->setSegmentCount(settings->segmentCount);
+    task->setTransferMode(settings->transferMode);
+    task->setParentThrottler(throttler_);
+    task->setDirectIo(settings->directIo);
+    task->setDynamicSplitting(settings->dynamicSplitting);
+    task->setAdaptiveSegments(settings->adaptiveSegments);
+    task->setMultiplexing(settings->httpMultiplexing);
+    task->setStreamingPriority(settings->streamMedia &&
+                               (isStreamableMedia(task->getFilename()) || isStreamableMedia(task->getUrl())));
+    
+    dm::utils::HashAlgorithm hashAlgorithm;
+    const std::string& streamingHash = settings->streamingHash;
+    if (!streamingHash.empty()) {
+        if (dm::utils::HashCalculator::parseAlgorithm(streamingHash, hashAlgorithm)) {
+            task->setStreamingHash(true, hashAlgorithm);
+        } else {
+            dm::utils::Logger::warning("Unknown streaming hash algorithm: " + streamingHash);
+        }
+    } else if (!settings->contentStore.empty()) {
+        // The store names completed downloads by their hash
+        task->setStreamingHash(true, dm::utils::HashAlgorithm::SHA256);
+    }
+    task->setWriteBufferSize(static_cast<size_t>(std::max(0, settings->writeBufferSize)) * 1024);
+    task->setSmallFileThreshold(static_cast<int64_t>(std::max(0, settings->smallFileThreshold)) * 1024);
+    task->setRevalidate(settings->revalidateDownloads);
+    task->setChecksumSidecar(settings->checksumSidecars);
+    task->setPieceHashSize(static_cast<int64_t>(std::max(0, settings->pieceHashSize)) * 1024);
+}
+
+JournalEntry DownloadManager::describeTask(const std::shared_ptr<DownloadTask>& task) {
+    JournalEntry entry;
+    entry.id = task->getId();
+    entry.url = task->getUrl();
+    entry.destinationPath = task->getDestinationPath();
+    entry.filename = task->getFilename();
+    entry.status = task->getStatus();
+    entry.priority = task->getPriority();
+    entry.fileSize = task->getFileSize();
+    entry.supportsResume = task->supportsResume();
+    entry.ranges = task->getRemainingRanges();
+    entry.pieces = task->getPieceMap();
+    return entry;
+}
+
+void DownloadManager::checkpointTask(const std::shared_ptr<DownloadTask>& task) {
+    if (!task || !journal_) {
+        return;
+    }
+    
+    // The data must reach the disk before the checkpoint that points past it
+    std::vector<SegmentRange> ranges;
+    if (task->commitRanges(ranges)) {
+        journal_->recordProgress(task->getId(), task->getFileSize(), task->supportsResume(), ranges);
+    }
+    
+    // Hashes taken of pieces on the disk check them when the download resumes
+    PieceMap pieces = task->getPieceMap();
+    if (!pieces.empty()) {
+        journal_->recordPieces(task->getId(), pieces);
+    }
+}
+
+void DownloadManager::restoreTask(const JournalEntry& entry, std::vector<std::shared_ptr<DownloadTask>>& restored) {
+    // Saved downloads stay records until they are dispatched or looked up;
+    // one that was running when the last session ended is queued again
+    JournalEntry record = entry;
+    if (record.status == DownloadStatus::CONNECTING || record.status == DownloadStatus::DOWNLOADING) {
+        record.status = DownloadStatus::QUEUED;
+    }
+    if (records_.add(record)) {
+        return;
+    }
+    
+    auto task = inflateTask(entry);
+    tasks_[task->getId()] = task;
+    restored.push_back(task);
+}
+
+std::shared_ptr<DownloadTask> DownloadManager::inflateTask(const JournalEntry& entry) {
+    auto task = std::make_shared<DownloadTask>(entry.url, entry.destinationPath, entry.filename);
+    configureTask(task);
+    task->setPriority(entry.priority);
+    if (!entry.pieces.empty()) {
+        task->setPieceHashes(entry.pieces);
+    }
+    
+    if (!task->restore(entry.id, entry.fileSize, entry.supportsResume, entry.status, entry.ranges) && journal_) {
+        // Starts over, the saved ranges no longer describe the file
+        journal_->recordStatus(entry.id, task->getStatus());
+        journal_->recordProgress(entry.id, entry.fileSize, entry.supportsResume, {});
+    }
+    
+    return task;
+}
+
+std::shared_ptr<DownloadTask> DownloadManager::hydrateTask(const std::string& taskId) {
+    JournalEntry entry;
+    if (!records_.take(taskId, entry)) {
+        return nullptr;
+    }
+    
+    auto task = inflateTask(entry);
+    tasks_[task->getId()] = task;
+    return task;
+}
+
+void DownloadManager::dispatchTaskRecords() {
+    // Only as many records get tasks as can start right away
+    int freeSlots = queue_->getMaxConcurrentDownloads() - queue_->getActiveDownloadsCount() -
+                    queue_->getPendingCount();
+    if (freeSlots <= 0) {
+        return;
+    }
+    
+    std::vector<std::shared_ptr<DownloadTask>> dispatched;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        JournalEntry entry;
+        while (static_cast<int>(dispatched.size()) < freeSlots && records_.takeNextQueued(entry)) {
+            auto task = inflateTask(entry);
+            tasks_[task->getId()] = task;
+            dispatched.push_back(task);
+        }
+    }
+    
+    for (const auto& task : dispatched) {
+        queue_->addTask(task);
+        if (taskAddedCallback_) {
+            taskAddedCallback_(task);
+        }
+        queue_->startTask(task->getId());
+    }
+}
+
+void DownloadManager::prefetchTaskRecords() {
+    MetadataPrefetcher& prefetcher = MetadataPrefetcher::getInstance();
+    int lookahead = prefetcher.getLookahead();
+    if (lookahead <= 0) {
+        return;
+    }
+    
+    // Records with ranges continue without a probe
+    std::vector<MetadataPrefetcher::Request> requests;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        for (const auto& entry : records_.peekQueued(static_cast<size_t>(lookahead))) {
+            if (entry.ranges.empty()) {
+                requests.push_back({entry.id, entry.url});
+            }
+        }
+    }
+    
+    if (!requests.empty()) {
+        prefetcher.prefetch(requests);
+    }
+}
+
+void DownloadManager::dehydrateFinishedTasks() {
+    std::vector<std::string> finished;
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex_);
+        finished.swap(finishedTasks_);
+    }
     
-    // Check if file exists
-    if (!dm::utils::FileUtils::fileExists(tasksFile)) {
-        return true; // No tasks to load
+    for (const auto& taskId : finished) {
+        std::shared_ptr<DownloadTask> task;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex_);
+            auto it = tasks_.find(taskId);
+            if (it == tasks_.end()) {
+                continue;
+            }
+            task = it->second;
+        }
+        
+        // Restarted meanwhile, it stays a task
+        DownloadStatus status = task->getStatus();
+        if (status != DownloadStatus::COMPLETED && status != DownloadStatus::DOWNLOAD_ERROR &&
+            status != DownloadStatus::CANCELED) {
+            continue;
+        }
+        
+        // The queue is never locked inside tasksMutex_; the journal already has the final status
+        queue_->removeTask(taskId);
+        bool stored;
+        {
+            // Removed meanwhile, it must not come back as a record
+            std::lock_guard<std::mutex> lock(tasksMutex_);
+            auto it = tasks_.find(taskId);
+            if (it == tasks_.end() || it->second != task) {
+                continue;
+            }
+            stored = records_.add(describeTask(task));
+            if (stored) {
+                tasks_.erase(it);
+            }
+        }
+        if (!stored) {
+            dm::utils::Logger::warning("No room to keep finished download as a record: " + taskId);
+            queue_->addTask(task);
+        }
+    }
+}
+
+void DownloadManager::beginBulk(std::vector<TaskStatusChange>& changes) {
+    if (journal_) {
+        journal_->beginBatch();
+    }
+    bulkChanges = &changes;
+}
+
+void DownloadManager::endBulk(std::vector<TaskStatusChange>& changes, const std::string& action,
+                              const std::vector<bool>& results) {
+    bulkChanges = nullptr;
+    if (journal_) {
+        journal_->endBatch();
     }
     
+    if (!changes.empty()) {
+        if (bulkStatusChangedCallback_) {
+            bulkStatusChangedCallback_(changes);
+        } else if (taskStatusChangedCallback_) {
+            for (const auto& change : changes) {
+                taskStatusChangedCallback_(change.task, change.status);
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(listenersMutex_);
+        for (const auto& listener : statusListeners_) {
+            for (const auto& change : changes) {
+                listener.second(change.task, change.status);
+            }
+        }
+    }
+    
+    dm::utils::Logger::info(action + " " + std::to_string(std::count(results.begin(), results.end(), true)) +
+                            " of " + std::to_string(results.size()) + " downloads");
+}
+
+void DownloadManager::setRecordsStatus(const std::vector<std::string>& taskIds, std::vector<bool>& results,
+                                       const std::vector<DownloadStatus>& from, DownloadStatus to) {
+    std::lock_guard<std::mutex> lock(tasksMutex_);
+    for (size_t i = 0; i < taskIds.size(); i++) {
+        JournalEntry entry;
+        if (results[i] || !records_.get(taskIds[i], entry) ||
+            std::find(from.begin(), from.end(), entry.status) == from.end()) {
+            continue;
+        }
+        
+        records_.setStatus(taskIds[i], to);
+        if (journal_) {
+            journal_->recordStatus(taskIds[i], to);
+        }
+        results[i] = true;
+    }
+}
+
+void DownloadManager::setRecordStatusWhere(DownloadStatus from, DownloadStatus to) {
+    std::vector<std::string> changed;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex_);
+        records_.setStatusWhere(from, to, &changed);
+    }
+    
+    if (journal_) {
+        for (const auto& taskId : changed) {
+            journal_->recordStatus(taskId, to);
+        }
+    }
+}
+
+bool DownloadManager::importTasks(const std::string& tasksFile, std::vector<std::shared_ptr<DownloadTask>>& restored) {
+#ifdef DM_EMBEDDED
+    // Built without a JSON parser, the journal is the only task state read
+    (void)restored;
+    dm::utils::Logger::warning("Not importing " + tasksFile + ", the embedded build only reads the task journal");
+    return true;
+#else
     try {
         // Read JSON file
         std::string jsonStr = dm::utils::FileUtils::readTextFile(tasksFile);
@@ -364,103 +1481,24 @@ bool DownloadManager::loadTasks() {
             
             // Create task
             auto task = std::make_shared<DownloadTask>(url, destinationPath, filename);
+            configureTask(task);
             
             // Add to tasks map
             std::string taskId = task->getId();
             tasks_[taskId] = task;
+            journal_->recordAdd(describeTask(task));
             
-            // Add to queue
-            queue_->addTask(task);
+            // Queued by the caller
+            restored.push_back(task);
         }
         
-        dm::utils::Logger::info("Loaded tasks from " + tasksFile);
+        dm::utils::Logger::info("Imported tasks from " + tasksFile);
         return true;
     } catch (const std::exception& e) {
         dm::utils::Logger::error("Exception while loading tasks: " + std::string(e.what()));
         return false;
     }
-}
-
-bool DownloadManager::saveTasks() {
-    std::string tasksFile = dm::utils::FileUtils::getAppDataDirectory() + "/tasks.json";
-    
-    try {
-        // Create JSON root
-        Json::Value root;
-        Json::Value tasksArray(Json::arrayValue);
-        
-        // Get all tasks
-        std::vector<std::shared_ptr<DownloadTask>> tasks = getAllDownloadTasks();
-        
-        // Add tasks to JSON array
-        for (const auto& task : tasks) {
-            // Skip if task is null
-            if (!task) {
-                continue;
-            }
-            
-            // Create task JSON
-            Json::Value taskJson;
-            taskJson["id"] = task->getId();
-            taskJson["url"] = task->getUrl();
-            taskJson["destinationPath"] = task->getDestinationPath();
-            taskJson["filename"] = task->getFilename();
-            
-            // Convert status to string
-            std::string statusStr;
-            switch (task->getStatus()) {
-                case DownloadStatus::NONE:
-                    statusStr = "NONE";
-                    break;
-                case DownloadStatus::QUEUED:
-                    statusStr = "QUEUED";
-                    break;
-                case DownloadStatus::CONNECTING:
-                    statusStr = "CONNECTING";
-                    break;
-                case DownloadStatus::DOWNLOADING:
-                    statusStr = "DOWNLOADING";
-                    break;
-                case DownloadStatus::PAUSED:
-                    statusStr = "PAUSED";
-                    break;
-                case DownloadStatus::COMPLETED:
-                    statusStr = "COMPLETED";
-                    break;
-                case DownloadStatus::DOWNLOAD_ERROR:
-                    statusStr = "ERROR";
-                    break;
-                case DownloadStatus::CANCELED:
-                    statusStr = "CANCELED";
-                    break;
-                default:
-                    statusStr = "UNKNOWN";
-                    break;
-            }
-            taskJson["status"] = statusStr;
-            
-            // Add task to array
-            tasksArray.append(taskJson);
-        }
-        
-        // Set tasks array in root
-        root["tasks"] = tasksArray;
-        
-        // Write JSON to file
-        Json::StyledWriter writer;
-        std::string jsonStr = writer.write(root);
-        
-        if (!dm::utils::FileUtils::writeTextFile(tasksFile, jsonStr)) {
-            dm::utils::Logger::error("Failed to write tasks JSON to file: " + tasksFile);
-            return false;
-        }
-        
-        dm::utils::Logger::info("Saved tasks to " + tasksFile);
-        return true;
-    } catch (const std::exception& e) {
-        dm::utils::Logger::error("Exception while saving tasks: " + std::string(e.what()));
-        return false;
-    }
+#endif
 }
 
 std::string DownloadManager::getDefaultDownloadDirectory() const {
@@ -478,32 +1516,248 @@ int DownloadManager::getMaxConcurrentDownloads() const {
 
 void DownloadManager::setMaxConcurrentDownloads(int max) {
     settings_->setMaxConcurrentDownloads(max);
-    queue_->setMaxConcurrentDownloads(max);
     settings_->save();
 }
 
+int DownloadManager::getMaxDownloadSpeed() const {
+    return settings_->getMaxDownloadSpeed();
+}
+
+void DownloadManager::setMaxDownloadSpeed(int speed) {
+    settings_->setMaxDownloadSpeed(speed);
+    settings_->save();
+}
+
+void DownloadManager::setScheduledSpeedLimit(int speed, int percent) {
+    scheduledSpeed_ = std::max(0, speed);
+    scheduledPercent_ = std::clamp(percent, 0, 100);
+    
+    // The processor eases running downloads to the new rate
+    queue_->notifyChange();
+}
+
+void DownloadManager::clearScheduledSpeedLimit() {
+    setScheduledSpeedLimit(0, 0);
+}
+
+EngineGauges DownloadManager::collectGauges() const {
+    EngineGauges gauges;
+    gauges.queuedDownloads = queue_->getPendingCount();
+    gauges.activeDownloads = queue_->getActiveDownloadsCount();
+    gauges.bandwidthLimit = throttler_->getMaxBandwidth();
+    for (const auto& task : queue_->getActiveTasks()) {
+        double speed = task->getDownloadSpeed();
+        gauges.downloadSpeed += speed;
+        gauges.hostSpeeds[dm::utils::UrlParser::extractDomain(task->getUrl())] += speed;
+    }
+    return gauges;
+}
+
+std::vector<dm::utils::TimeBucket> DownloadManager::getSpeedHistory(int64_t from, int64_t to, size_t maxPoints) const {
+    return speedHistory_.query(from, to, maxPoints);
+}
+
+std::vector<dm::utils::TimeBucket> DownloadManager::getCompletionHistory(int64_t from, int64_t to, size_t maxPoints) const {
+    return completionHistory_.query(from, to, maxPoints, false);
+}
+
+int64_t DownloadManager::getTargetBandwidth() const {
+    int64_t configured = static_cast<int64_t>(settings_->getMaxDownloadSpeed()) * 1024;
+    
+    // A share of a speed never measured is no cap yet
+    int64_t limit = configured;
+    for (int64_t cap : {static_cast<int64_t>(scheduledSpeed_) * 1024, peakSpeed_ * scheduledPercent_ / 100}) {
+        if (cap > 0 && (limit <= 0 || cap < limit)) {
+            limit = cap;
+        }
+    }
+    return limit;
+}
+
+void DownloadManager::easeBandwidth(const std::vector<std::shared_ptr<DownloadTask>>& tasks) {
+    int64_t target = getTargetBandwidth();
+    int64_t current = throttler_->getMaxBandwidth();
+    if (current == target) {
+        return;
+    }
+    
+    if (tasks.empty() || target <= 0 || (current > 0 && target > current)) {
+        throttler_->setMaxBandwidth(target);
+        return;
+    }
+    
+    // Coming from unlimited, start where the downloads actually are
+    if (current <= 0) {
+        double speed = 0.0;
+        for (const auto& task : tasks) {
+            speed += task->getDownloadSpeed();
+        }
+        current = static_cast<int64_t>(speed);
+        if (current <= target) {
+            throttler_->setMaxBandwidth(target);
+            return;
+        }
+    }
+    
+    int64_t next = current - static_cast<int64_t>((current - target) * BANDWIDTH_EASE_FACTOR);
+    if (next - target <= target / 20) {
+        next = target;
+    }
+    throttler_->setMaxBandwidth(next);
+}
+
 void DownloadManager::onTaskStatusChanged(std::shared_ptr<DownloadTask> task, DownloadStatus status) {
-    // Call the status change callback if provided
-    if (taskStatusChangedCallback_) {
-        taskStatusChangedCallback_(task, status);
+    // Tasks destroyed at exit cancel themselves, that is not a user's cancel
+    if (running_ && journal_) {
+        journal_->recordStatus(task->getId(), status);
+        if (status == DownloadStatus::PAUSED) {
+            checkpointTask(task);
+        }
+    }
+    
+    // A bulk operation on this thread reports its changes together at its end
+    if (bulkChanges) {
+        bulkChanges->push_back({task, status});
+    } else {
+        // Call the status change callback if provided
+        if (taskStatusChangedCallback_) {
+            taskStatusChangedCallback_(task, status);
+        }
+        
+        // Listeners run under the lock, so a removed one is never called afterwards
+        std::lock_guard<std::mutex> lock(listenersMutex_);
+        for (const auto& listener : statusListeners_) {
+            listener.second(task, status);
+        }
+    }
+    
+    // A task completed by a 304 transferred nothing and its file was processed before
+    bool upToDate = status == DownloadStatus::COMPLETED && task->isUpToDate();
+    
+    // Counted on the task's thread, against that thread's shard
+    if (running_ && !upToDate && (status == DownloadStatus::COMPLETED || status == DownloadStatus::DOWNLOAD_ERROR)) {
+        TransferCounters& counters = TransferCounters::getInstance();
+        std::string extension = dm::utils::FileUtils::getExtension(task->getFilename());
+        counters.recordDownload(counters.internDomain(dm::utils::UrlParser::extractDomain(task->getUrl())),
+                                counters.internFileType(extension.empty() ? "none" : extension),
+                                task->getFileSize(), status == DownloadStatus::COMPLETED);
+    }
+    
+    // Post-processing runs on the pipeline's workers, not on the task's thread
+    if (running_ && status == DownloadStatus::COMPLETED && !upToDate) {
+        completionHistory_.add(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(), static_cast<double>(task->getFileSize()));
+        pipeline_->submit(task->getId(), task->getDestinationPath() + "/" + task->getFilename(), task->getUrl());
+    }
+    
+    // The queue processor turns it into a record, a task may not remove itself here
+    if (running_ && TaskRecordStore::canStore(task->getId()) &&
+        (status == DownloadStatus::COMPLETED || status == DownloadStatus::DOWNLOAD_ERROR ||
+         status == DownloadStatus::CANCELED)) {
+        std::lock_guard<std::mutex> lock(finishedMutex_);
+        finishedTasks_.push_back(task->getId());
+    }
+}
+
+void DownloadManager::addBuiltInStages() {
+    PostProcessStage verify;
+    verify.name = "verify";
+    verify.concurrency = 2;
+    verify.run = [](PostProcessJob& job) {
+        const ContentSample& sample = job.getSample();
+        if (sample.fileSize < 0) {
+            dm::utils::Logger::error("Failed to read completed download: " + job.getFilePath());
+            return false;
+        }
+        if (!dm::utils::MagicMatcher::hasFooter(sample.signature, sample.tail)) {
+            dm::utils::Logger::warning("Completed download looks truncated, " + sample.signature.description +
+                                       " without its trailer: " + job.getFilePath());
+            return false;
+        }
+        return true;
+    };
+    pipeline_->addStage(verify);
+    
+    PostProcessStage classify;
+    classify.name = "classify";
+    classify.concurrency = 2;
+    classify.run = [](PostProcessJob& job) {
+        const ContentSample& sample = job.getSample();
+        if (sample.signature.isValid()) {
+            job.setAttribute("mimeType", sample.signature.mimeType);
+            job.setAttribute("extension", sample.signature.extension);
+        }
+        return sample.fileSize >= 0;
+    };
+    pipeline_->addStage(classify);
+}
+
+void DownloadManager::adjustConcurrency(const std::vector<std::shared_ptr<DownloadTask>>& tasks) {
+    LinkSample sample = LinkStats::getInstance().takeSample();
+    for (const auto& task : tasks) {
+        sample.throughput += task->getDownloadSpeed();
+    }
+    sample.connections = HostConnectionLimiter::getInstance().getTotalConnectionCount();
+    
+    int connections = concurrencyController_->update(sample);
+    HostConnectionLimiter::getInstance().setMaxConnections(connections);
+    
+    // Enough downloads to fill the budget, each at its configured segment count
+    auto settings = settings_->getSnapshot();
+    int segments = std::max(1, settings->segmentCount);
+    int downloads = std::min(settings->maxConcurrentDownloads,
+                             std::max(1, (connections + segments - 1) / segments));
+    if (downloads != queue_->getMaxConcurrentDownloads()) {
+        queue_->setMaxConcurrentDownloads(downloads);
     }
 }
 
 void DownloadManager::queueProcessorThread() {
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    auto lastControl = lastCheckpoint;
+    
     while (running_) {
-        // Process the queue
+        // Process the queue, then fill what is left with queued records
         queue_->processQueue();
+        dehydrateFinishedTasks();
+        dispatchTaskRecords();
+        prefetchTaskRecords();
         
-        // Update progress for all tasks
-        std::vector<std::shared_ptr<DownloadTask>> tasks = getAllDownloadTasks();
+        // Only downloading tasks have progress to update
+        std::vector<std::shared_ptr<DownloadTask>> tasks = queue_->getActiveTasks();
+        double speed = 0.0;
         for (const auto& task : tasks) {
-            if (task) {
-                task->updateProgress();
+            task->updateProgress();
+            speed += task->getDownloadSpeed();
+        }
+        if (speed > peakSpeed_) {
+            peakSpeed_ = static_cast<int64_t>(speed);
+        }
+        speedHistory_.add(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(), speed);
+        easeBandwidth(tasks);
+        if (!tasks.empty()) {
+            SocketTuner::getInstance().update(speed, LinkStats::getInstance().getRecent().latencyMs);
+        }
+        
+        // Checkpoint so a crash costs only the last few seconds of data
+        auto now = std::chrono::steady_clock::now();
+        if (!tasks.empty() && now - lastCheckpoint >= std::chrono::seconds(CHECKPOINT_INTERVAL_SECONDS)) {
+            for (const auto& task : tasks) {
+                checkpointTask(task);
             }
+            lastCheckpoint = now;
+        }
+        
+        // Measure the link while it carries downloads and step the budget
+        if (concurrencyController_ && !tasks.empty() &&
+            now - lastControl >= std::chrono::milliseconds(ConcurrencyController::CONTROL_INTERVAL_MS)) {
+            adjustConcurrency(tasks);
+            lastControl = now;
         }
         
-        // Sleep for a short time
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // Sleep until a task changes status, ticking only while downloads run or wait for disk space
+        queue_->waitForChange(tasks.empty() && !queue_->isWaitingForDiskSpace() ? -1 : PROGRESS_INTERVAL_MS);
     }
 }
 
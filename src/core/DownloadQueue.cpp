@@ -1,11 +1,14 @@
 #include "core/DownloadQueue.h"
+#include "core/HostConnectionLimiter.h"
+#include "core/DeviceIoScheduler.h"
+#include "core/DiskSpaceLedger.h"
 #include "utils/Logger.h"
 
 namespace dm {
 namespace core {
 
 DownloadQueue::DownloadQueue(int maxConcurrentDownloads)
-    : maxConcurrentDownloads_(maxConcurrentDownloads), activeDownloads_(0) {
+    : maxConcurrentDownloads_(maxConcurrentDownloads), activeDownloads_(0), waitingForDiskSpace_(false) {
     // Log queue creation
     dm::utils::Logger::info("Download queue created with max concurrent downloads: " + 
                           std::to_string(maxConcurrentDownloads));
@@ -25,72 +28,70 @@ void DownloadQueue::addTask(std::shared_ptr<DownloadTask> task) {
     }
     std::lock_guard<std::mutex> lock(mutex_);
     std::string taskId = task->getId();
-    if (tasks_.find(taskId) != tasks_.end()) {
+    if (handles_.find(taskId) != handles_.end()) {
         dm::utils::Logger::warning("Task already exists in queue: " + taskId);
         return;
     }
-    tasks_[taskId] = task;
+    
+    // Intern the ID, reusing handles of removed tasks
+    TaskHandle handle;
+    if (!freeHandles_.empty()) {
+        handle = freeHandles_.back();
+        freeHandles_.pop_back();
+        slots_[handle] = task;
+    } else {
+        handle = static_cast<TaskHandle>(slots_.size());
+        slots_.push_back(task);
+    }
+    handles_[taskId] = handle;
+    
     // Set status change callback with new signature
-    task->setStatusChangeCallback([this](std::shared_ptr<DownloadTask> t, DownloadStatus oldStatus, DownloadStatus newStatus) {
-        this->onTaskStatusChanged(t, oldStatus, newStatus);
+    task->setStatusChangeCallback([this, handle](std::shared_ptr<DownloadTask> t, DownloadStatus oldStatus, DownloadStatus newStatus) {
+        this->onTaskStatusChanged(handle, t, oldStatus, newStatus);
     });
     if (task->getStatus() == DownloadStatus::QUEUED) {
-        pendingTasks_.push(taskId);
+        enqueue(handle);
     }
     dm::utils::Logger::info("Task added to queue: " + taskId);
-    processQueue();
+    notifyChange();
 }
 
 bool DownloadQueue::removeTask(const std::string& taskId) {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Find task
-    auto it = tasks_.find(taskId);
-    if (it == tasks_.end()) {
+    TaskHandle handle;
+    auto task = findTask(taskId, &handle);
+    if (!task) {
         return false;
     }
     
-    // Get task
-    auto task = it->second;
-    
-    // Cancel task if it's active
-    if (task->getStatus() == DownloadStatus::DOWNLOADING) {
-        task->cancel();
-        activeDownloads_--;
-    }
-    
-    // Remove from map
-    tasks_.erase(it);
+    removeLocked(taskId, handle, task);
     
     // Log task removal
     dm::utils::Logger::info("Task removed from queue: " + taskId);
     
-    // Process queue
-    processQueue();
+    // Let the processor fill the slot
+    notifyChange();
     
     return true;
 }
 
 std::shared_ptr<DownloadTask> DownloadQueue::getTask(const std::string& taskId) {
     std::lock_guard<std::mutex> lock(mutex_);
-    
-    // Find task
-    auto it = tasks_.find(taskId);
-    if (it == tasks_.end()) {
-        return nullptr;
-    }
-    
-    return it->second;
+    return findTask(taskId);
 }
 
 std::vector<std::shared_ptr<DownloadTask>> DownloadQueue::getAllTasks() {
     std::lock_guard<std::mutex> lock(mutex_);
     
     std::vector<std::shared_ptr<DownloadTask>> result;
-    result.reserve(tasks_.size());
+    result.reserve(handles_.size());
     
-    for (const auto& pair : tasks_) {
-        result.push_back(pair.second);
+    for (const auto& task : slots_) {
+        if (task) {
+            result.push_back(task);
+        }
     }
     
     return result;
@@ -101,9 +102,9 @@ std::vector<std::shared_ptr<DownloadTask>> DownloadQueue::getTasksByStatus(Downl
     
     std::vector<std::shared_ptr<DownloadTask>> result;
     
-    for (const auto& pair : tasks_) {
-        if (pair.second->getStatus() == status) {
-            result.push_back(pair.second);
+    for (const auto& task : slots_) {
+        if (task && task->getStatus() == status) {
+            result.push_back(task);
         }
     }
     
@@ -114,137 +115,193 @@ bool DownloadQueue::startTask(const std::string& taskId) {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Find task
-    auto it = tasks_.find(taskId);
-    if (it == tasks_.end()) {
+    TaskHandle handle;
+    auto task = findTask(taskId, &handle);
+    if (!task) {
         return false;
     }
     
-    // Get task
-    auto task = it->second;
-    
-    // Check if we have available slots
-    if (activeDownloads_ >= maxConcurrentDownloads_) {
-        // Queue the task instead of starting it
-        task->initialize();
-        
-        // Add to pending tasks
-        pendingTasks_.push(taskId);
-        
-        // Log task queuing
+    bool queued = false;
+    bool started = startLocked(handle, task, queued);
+    if (queued) {
         dm::utils::Logger::info("Task queued due to max concurrent downloads: " + taskId);
-        
-        return true;
-    }
-    
-    // Start task
-    if (task->start()) {
-        activeDownloads_++;
-        return true;
     }
-    
-    return false;
+    return started;
 }
 
 bool DownloadQueue::pauseTask(const std::string& taskId) {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Find task
-    auto it = tasks_.find(taskId);
-    if (it == tasks_.end()) {
+    TaskHandle handle;
+    auto task = findTask(taskId, &handle);
+    if (!task) {
         return false;
     }
     
-    // Get task
-    auto task = it->second;
-    
     // Pause task
-    if (task->pause()) {
-        if (task->getStatus() == DownloadStatus::PAUSED && 
-            task->getStatus() == DownloadStatus::DOWNLOADING) {
-            activeDownloads_--;
-        }
-        return true;
+    return task->pause();
+}
+
+bool DownloadQueue::resumeTask(const std::string& taskId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Find task
+    TaskHandle handle;
+    auto task = findTask(taskId, &handle);
+    if (!task) {
+        return false;
     }
     
-    return false;
+    bool queued = false;
+    bool resumed = resumeLocked(handle, task, queued);
+    if (queued) {
+        dm::utils::Logger::info("Task re-queued due to max concurrent downloads: " + taskId);
+    }
+    return resumed;
 }
 
-bool DownloadQueue::resumeTask(const std::string& taskId) {
+bool DownloadQueue::cancelTask(const std::string& taskId) {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Find task
-    auto it = tasks_.find(taskId);
-    if (it == tasks_.end()) {
+    TaskHandle handle;
+    auto task = findTask(taskId, &handle);
+    if (!task) {
         return false;
     }
     
-    // Get task
-    auto task = it->second;
+    // Cancel task
+    return task->cancel();
+}
+
+std::vector<bool> DownloadQueue::startTasks(const std::vector<std::string>& taskIds) {
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    // Check if we have available slots
-    if (activeDownloads_ >= maxConcurrentDownloads_) {
-        // Queue the task instead of resuming it
-        pendingTasks_.push(taskId);
-        
-        // Log task queuing
-        dm::utils::Logger::info("Task re-queued due to max concurrent downloads: " + taskId);
-        
-        return true;
+    std::vector<bool> results;
+    results.reserve(taskIds.size());
+    size_t queuedCount = 0;
+    for (const auto& taskId : taskIds) {
+        TaskHandle handle;
+        auto task = findTask(taskId, &handle);
+        bool queued = false;
+        results.push_back(task && startLocked(handle, task, queued));
+        queuedCount += queued ? 1 : 0;
     }
     
-    // Resume task
-    if (task->resume()) {
-        activeDownloads_++;
-        return true;
+    if (queuedCount > 0) {
+        dm::utils::Logger::info(std::to_string(queuedCount) + " tasks queued due to max concurrent downloads");
     }
+    return results;
+}
+
+std::vector<bool> DownloadQueue::pauseTasks(const std::vector<std::string>& taskIds) {
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    return false;
+    std::vector<bool> results;
+    results.reserve(taskIds.size());
+    for (const auto& taskId : taskIds) {
+        auto task = findTask(taskId);
+        results.push_back(task && task->pause());
+    }
+    return results;
 }
 
-bool DownloadQueue::cancelTask(const std::string& taskId) {
+std::vector<bool> DownloadQueue::resumeTasks(const std::vector<std::string>& taskIds) {
     std::lock_guard<std::mutex> lock(mutex_);
     
-    // Find task
-    auto it = tasks_.find(taskId);
-    if (it == tasks_.end()) {
-        return false;
+    std::vector<bool> results;
+    results.reserve(taskIds.size());
+    size_t queuedCount = 0;
+    for (const auto& taskId : taskIds) {
+        TaskHandle handle;
+        auto task = findTask(taskId, &handle);
+        bool queued = false;
+        results.push_back(task && resumeLocked(handle, task, queued));
+        queuedCount += queued ? 1 : 0;
+    }
+    
+    if (queuedCount > 0) {
+        dm::utils::Logger::info(std::to_string(queuedCount) + " tasks re-queued due to max concurrent downloads");
     }
+    return results;
+}
+
+std::vector<bool> DownloadQueue::cancelTasks(const std::vector<std::string>& taskIds) {
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    // Get task
-    auto task = it->second;
+    std::vector<bool> results;
+    results.reserve(taskIds.size());
+    for (const auto& taskId : taskIds) {
+        auto task = findTask(taskId);
+        results.push_back(task && task->cancel());
+    }
+    return results;
+}
+
+std::vector<bool> DownloadQueue::removeTasks(const std::vector<std::string>& taskIds) {
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    // Cancel task
-    if (task->cancel()) {
-        if (task->getStatus() == DownloadStatus::DOWNLOADING) {
-            activeDownloads_--;
+    std::vector<bool> results;
+    results.reserve(taskIds.size());
+    size_t removedCount = 0;
+    for (const auto& taskId : taskIds) {
+        TaskHandle handle;
+        auto task = findTask(taskId, &handle);
+        if (task) {
+            removeLocked(taskId, handle, task);
+            removedCount++;
         }
-        return true;
+        results.push_back(task != nullptr);
+    }
+    
+    if (removedCount > 0) {
+        dm::utils::Logger::info(std::to_string(removedCount) + " tasks removed from queue");
+        notifyChange();
     }
+    return results;
+}
+
+std::vector<bool> DownloadQueue::setTasksPriority(const std::vector<std::string>& taskIds,
+                                                  DownloadPriority priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    return false;
+    std::vector<bool> results;
+    results.reserve(taskIds.size());
+    for (const auto& taskId : taskIds) {
+        TaskHandle handle;
+        auto task = findTask(taskId, &handle);
+        if (task) {
+            task->setPriority(priority);
+            pendingTasks_.update(handle, priority);
+        }
+        results.push_back(task != nullptr);
+    }
+    return results;
 }
 
 void DownloadQueue::startAllTasks() {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Start all tasks that aren't already downloading or completed
-    for (const auto& pair : tasks_) {
-        auto task = pair.second;
+    for (TaskHandle handle = 0; handle < slots_.size(); handle++) {
+        auto task = slots_[handle];
+        if (!task) {
+            continue;
+        }
         DownloadStatus status = task->getStatus();
         
         if (status != DownloadStatus::DOWNLOADING && 
             status != DownloadStatus::COMPLETED && 
             status != DownloadStatus::CANCELED) {
             
-            if (activeDownloads_ < maxConcurrentDownloads_) {
+            if (activeDownloads_ < maxConcurrentDownloads_ && reserveDiskSpace(task)) {
                 // Start task
-                if (task->start()) {
-                    activeDownloads_++;
-                }
+                task->start();
             } else {
                 // Queue task
                 task->initialize();
-                pendingTasks_.push(pair.first);
+                enqueue(handle);
             }
         }
     }
@@ -257,13 +314,14 @@ void DownloadQueue::pauseAllTasks() {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Pause all downloading tasks
-    for (const auto& pair : tasks_) {
-        auto task = pair.second;
+    for (TaskHandle handle = 0; handle < slots_.size(); handle++) {
+        auto task = slots_[handle];
+        if (!task) {
+            continue;
+        }
         
         if (task->getStatus() == DownloadStatus::DOWNLOADING) {
-            if (task->pause()) {
-                activeDownloads_--;
-            }
+            task->pause();
         }
     }
     
@@ -275,18 +333,19 @@ void DownloadQueue::resumeAllTasks() {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Resume all paused tasks
-    for (const auto& pair : tasks_) {
-        auto task = pair.second;
+    for (TaskHandle handle = 0; handle < slots_.size(); handle++) {
+        auto task = slots_[handle];
+        if (!task) {
+            continue;
+        }
         
         if (task->getStatus() == DownloadStatus::PAUSED) {
-            if (activeDownloads_ < maxConcurrentDownloads_) {
+            if (activeDownloads_ < maxConcurrentDownloads_ && reserveDiskSpace(task)) {
                 // Resume task
-                if (task->resume()) {
-                    activeDownloads_++;
-                }
+                task->resume();
             } else {
                 // Queue task
-                pendingTasks_.push(pair.first);
+                enqueue(handle);
             }
         }
     }
@@ -299,21 +358,20 @@ void DownloadQueue::cancelAllTasks() {
     std::lock_guard<std::mutex> lock(mutex_);
     
     // Cancel all active tasks
-    for (const auto& pair : tasks_) {
-        auto task = pair.second;
+    for (TaskHandle handle = 0; handle < slots_.size(); handle++) {
+        auto task = slots_[handle];
+        if (!task) {
+            continue;
+        }
         
         if (task->getStatus() == DownloadStatus::DOWNLOADING || 
             task->getStatus() == DownloadStatus::PAUSED) {
-            if (task->cancel() && task->getStatus() == DownloadStatus::DOWNLOADING) {
-                activeDownloads_--;
-            }
+            task->cancel();
         }
     }
     
     // Clear pending tasks
-    while (!pendingTasks_.empty()) {
-        pendingTasks_.pop();
-    }
+    pendingTasks_.clear();
     
     // Log action
     dm::utils::Logger::info("Canceled all tasks");
@@ -322,40 +380,53 @@ void DownloadQueue::cancelAllTasks() {
 void DownloadQueue::processQueue() {
     std::lock_guard<std::mutex> lock(mutex_);
     
-    // Update active downloads count
-    activeDownloads_ = countActiveDownloads();
+    // Tasks whose host has no connection to spare, whose disk is behind on
+    // its writes or has no space for them keep their place for later
+    std::vector<std::pair<TaskHandle, int64_t>> heldBack;
+    waitingForDiskSpace_ = false;
     
-    // Process pending tasks
-    while (!pendingTasks_.empty() && activeDownloads_ < maxConcurrentDownloads_) {
+    // Process pending tasks (starting one updates activeDownloads_ through its transition)
+    while (!pendingTasks_.empty() && activeDownloads_ < maxConcurrentDownloads_ &&
+           heldBack.size() < MAX_HELD_BACK_TASKS) {
         // Get next task
-        std::string taskId = pendingTasks_.front();
-        pendingTasks_.pop();
+        TaskHandle handle = pendingTasks_.top();
+        auto task = slots_[handle];
+        
+        // DownloadTask::setPriority() does not tell the queue, catch up here
+        if (task && task->getPriority() != pendingTasks_.getPriority(handle)) {
+            pendingTasks_.update(handle, task->getPriority());
+            continue;
+        }
         
-        // Find task
-        auto it = tasks_.find(taskId);
-        if (it == tasks_.end()) {
+        if (task && (!HostConnectionLimiter::getInstance().hasCapacity(task->getUrl()) ||
+                     !DeviceIoScheduler::getInstance().hasCapacity(task->getDestinationPath()) ||
+                     !reserveDiskSpace(task))) {
+            heldBack.emplace_back(handle, pendingTasks_.getEnqueuedTime(handle));
+            pendingTasks_.pop();
             continue;
         }
         
-        // Get task
-        auto task = it->second;
+        pendingTasks_.pop();
+        if (!task) {
+            continue;
+        }
         
         // Check task status
         DownloadStatus status = task->getStatus();
         
         if (status == DownloadStatus::QUEUED) {
             // Start task
-            if (task->start()) {
-                activeDownloads_++;
-            }
+            task->start();
         } else if (status == DownloadStatus::PAUSED) {
             // Resume task
-            if (task->resume()) {
-                activeDownloads_++;
-            }
+            task->resume();
         }
     }
     
+    for (const auto& held : heldBack) {
+        pendingTasks_.push(held.first, slots_[held.first]->getPriority(), held.second);
+    }
+    
     // Call queue processor callback if provided
     if (queueProcessorCallback_) {
         queueProcessorCallback_();
@@ -369,8 +440,8 @@ void DownloadQueue::setMaxConcurrentDownloads(int maxConcurrentDownloads) {
     dm::utils::Logger::info("Max concurrent downloads changed to: " + 
                           std::to_string(maxConcurrentDownloads));
     
-    // Process queue
-    processQueue();
+    // Let the processor use the new limit
+    notifyChange();
 }
 
 int DownloadQueue::getMaxConcurrentDownloads() const {
@@ -381,35 +452,176 @@ int DownloadQueue::getActiveDownloadsCount() const {
     return activeDownloads_;
 }
 
+int DownloadQueue::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(pendingTasks_.size());
+}
+
 void DownloadQueue::setQueueProcessorCallback(QueueProcessorCallback callback) {
     queueProcessorCallback_ = callback;
 }
 
-void DownloadQueue::onTaskStatusChanged(std::shared_ptr<DownloadTask> task, DownloadStatus oldStatus, DownloadStatus newStatus) {
+bool DownloadQueue::setTaskPriority(const std::string& taskId, DownloadPriority priority) {
     std::lock_guard<std::mutex> lock(mutex_);
-    // Update active downloads count based on transitions
-    if (newStatus == DownloadStatus::DOWNLOADING && oldStatus != DownloadStatus::DOWNLOADING) {
-        activeDownloads_++;
-        dm::utils::Logger::debug("Active downloads incremented: " + std::to_string(activeDownloads_));
-    } else if (oldStatus == DownloadStatus::DOWNLOADING && newStatus != DownloadStatus::DOWNLOADING) {
-        if (activeDownloads_ > 0) activeDownloads_--;
-        dm::utils::Logger::debug("Active downloads decremented: " + std::to_string(activeDownloads_));
+    
+    // Find task
+    TaskHandle handle;
+    auto task = findTask(taskId, &handle);
+    if (!task) {
+        return false;
+    }
+    
+    task->setPriority(priority);
+    pendingTasks_.update(handle, priority);
+    
+    return true;
+}
+
+bool DownloadQueue::startLocked(TaskHandle handle, const std::shared_ptr<DownloadTask>& task, bool& queued) {
+    // Check if we have available slots and space
+    if (activeDownloads_ >= maxConcurrentDownloads_ || !reserveDiskSpace(task)) {
+        // Queue the task instead of starting it
+        task->initialize();
+        enqueue(handle);
+        queued = true;
+        return true;
+    }
+    
+    // Start task
+    queued = false;
+    return task->start();
+}
+
+bool DownloadQueue::resumeLocked(TaskHandle handle, const std::shared_ptr<DownloadTask>& task, bool& queued) {
+    // Check if we have available slots and space
+    if (activeDownloads_ >= maxConcurrentDownloads_ || !reserveDiskSpace(task)) {
+        // Queue the task instead of resuming it
+        enqueue(handle);
+        queued = true;
+        return true;
+    }
+    
+    // Resume task
+    queued = false;
+    return task->resume();
+}
+
+void DownloadQueue::removeLocked(const std::string& taskId, TaskHandle handle,
+                                 const std::shared_ptr<DownloadTask>& task) {
+    // Cancel task if it's active (the transition frees its slot)
+    if (task->getStatus() == DownloadStatus::DOWNLOADING) {
+        task->cancel();
+    }
+    
+    // Release the handle and space, later transitions of the task are not ours
+    task->setStatusChangeCallback(nullptr);
+    DiskSpaceLedger::getInstance().release(task->getId());
+    pendingTasks_.remove(handle);
+    handles_.erase(taskId);
+    slots_[handle] = nullptr;
+    freeHandles_.push_back(handle);
+}
+
+std::shared_ptr<DownloadTask> DownloadQueue::findTask(const std::string& taskId, TaskHandle* handle) const {
+    auto it = handles_.find(taskId);
+    if (it == handles_.end()) {
+        return nullptr;
+    }
+    
+    if (handle) {
+        *handle = it->second;
+    }
+    return slots_[it->second];
+}
+
+void DownloadQueue::enqueue(TaskHandle handle) {
+    pendingTasks_.push(handle, slots_[handle]->getPriority());
+}
+
+bool DownloadQueue::reserveDiskSpace(const std::shared_ptr<DownloadTask>& task) {
+    // What is left of a paused or restored download counts, not its whole size
+    if (!DiskSpaceLedger::getInstance().reserve(task->getId(),
+                                                task->getDestinationPath() + "/" + task->getFilename(),
+                                                task->getFileSize())) {
+        waitingForDiskSpace_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool DownloadQueue::isWaitingForDiskSpace() const {
+    return waitingForDiskSpace_;
+}
+
+void DownloadQueue::setStatusChangeCallback(StatusChangeCallback callback) {
+    statusChangeCallback_ = callback;
+}
+
+std::vector<std::shared_ptr<DownloadTask>> DownloadQueue::getActiveTasks() const {
+    std::lock_guard<std::mutex> lock(activeMutex_);
+    
+    std::vector<std::shared_ptr<DownloadTask>> result;
+    result.reserve(activeTasks_.size());
+    
+    for (const auto& pair : activeTasks_) {
+        result.push_back(pair.second);
     }
-    // Always process the queue after a status change
-    processQueue();
-    dm::utils::Logger::info("Task status changed: " + task->getId() + " from " + std::to_string(static_cast<int>(oldStatus)) + " to " + std::to_string(static_cast<int>(newStatus)));
+    
+    return result;
 }
 
-int DownloadQueue::countActiveDownloads() {
-    int count = 0;
+bool DownloadQueue::waitForChange(int timeoutMs) {
+    std::unique_lock<std::mutex> lock(changeMutex_);
+    
+    if (timeoutMs < 0) {
+        changeCv_.wait(lock, [this]() { return changed_; });
+    } else {
+        changeCv_.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return changed_; });
+    }
     
-    for (const auto& pair : tasks_) {
-        if (pair.second->getStatus() == DownloadStatus::DOWNLOADING) {
-            count++;
+    bool changed = changed_;
+    changed_ = false;
+    return changed;
+}
+
+void DownloadQueue::notifyChange() {
+    {
+        std::lock_guard<std::mutex> lock(changeMutex_);
+        changed_ = true;
+    }
+    changeCv_.notify_all();
+}
+
+void DownloadQueue::onTaskStatusChanged(TaskHandle handle, std::shared_ptr<DownloadTask> task, 
+                                        DownloadStatus oldStatus, DownloadStatus newStatus) {
+    // Runs on whatever thread changed the status, possibly inside processQueue()
+    {
+        std::lock_guard<std::mutex> lock(activeMutex_);
+        if (newStatus == DownloadStatus::DOWNLOADING) {
+            activeTasks_[handle] = task;
+        } else if (oldStatus == DownloadStatus::DOWNLOADING) {
+            activeTasks_.erase(handle);
         }
+        activeDownloads_ = static_cast<int>(activeTasks_.size());
+    }
+    
+    // A finished task has allocated all it will, a paused one keeps its space
+    if (newStatus == DownloadStatus::COMPLETED || newStatus == DownloadStatus::CANCELED ||
+        newStatus == DownloadStatus::DOWNLOAD_ERROR) {
+        DiskSpaceLedger::getInstance().release(task->getId());
+    }
+    
+    // Every transition is also logged by the task, this only adds the ID
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        dm::utils::Logger::debug("Task status changed: " + task->getId() + " from " + std::to_string(static_cast<int>(oldStatus)) + " to " + std::to_string(static_cast<int>(newStatus)));
+    }
+    
+    if (statusChangeCallback_) {
+        statusChangeCallback_(task, oldStatus, newStatus);
     }
     
-    return count;
+    // A freed slot or a newly queued task lets the queue advance
+    notifyChange();
 }
 
 } // namespace core
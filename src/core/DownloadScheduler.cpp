@@ -1,611 +1,871 @@
-#include "../../include/core/DownloadScheduler.h"
-#include "../../include/utils/Logger.h"
-#include "../../include/utils/TimeUtils.h"
-#include "../../include/core/DownloadManager.h"
+#include "core/DownloadScheduler.h"
+#include "core/DownloadManager.h"
+#include "core/DownloadTask.h"
+#include "utils/Logger.h"
+#include "utils/FileUtils.h"
 
 #include <algorithm>
-#include <chrono>
-#include <iomanip>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <sstream>
 
-namespace DownloadManager {
-namespace Core {
+namespace dm {
+namespace core {
 
-// Initialize static members
-std::shared_ptr<DownloadScheduler> DownloadScheduler::s_instance = nullptr;
-std::mutex DownloadScheduler::s_instanceMutex;
+namespace {
 
-DownloadScheduler::DownloadScheduler()
-    : m_isRunning(false),
-      m_schedulerThread(nullptr)
-{
+using Clock = std::chrono::system_clock;
+
+std::tm toLocalTime(Clock::time_point time) {
+    std::time_t seconds = Clock::to_time_t(time);
+    std::tm parts{};
+#ifdef _WIN32
+    localtime_s(&parts, &seconds);
+#else
+    localtime_r(&seconds, &parts);
+#endif
+    return parts;
 }
 
-DownloadScheduler::~DownloadScheduler() {
-    stop();
+Clock::time_point fromLocalTime(std::tm parts) {
+    parts.tm_isdst = -1;
+    return Clock::from_time_t(std::mktime(&parts));
+}
+
+int daysInMonth(int year, int month) {
+    std::tm parts{};
+    parts.tm_year = year;
+    parts.tm_mon = month + 1;
+    parts.tm_mday = 0;      // The last day of the month before
+    parts.tm_hour = 12;
+    parts.tm_isdst = -1;
+    std::mktime(&parts);
+    return parts.tm_mday;
+}
+
+int64_t toSeconds(Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
 }
 
-std::shared_ptr<DownloadScheduler> DownloadScheduler::instance() {
-    std::lock_guard<std::mutex> lock(s_instanceMutex);
-    if (!s_instance) {
-        s_instance = std::shared_ptr<DownloadScheduler>(new DownloadScheduler());
+Clock::time_point fromSeconds(int64_t seconds) {
+    return Clock::time_point(std::chrono::seconds(seconds));
+}
+
+std::vector<DayOfWeek> parseDays(const std::string& value) {
+    std::vector<DayOfWeek> days;
+    std::istringstream list(value);
+    std::string day;
+    while (std::getline(list, day, ',')) {
+        if (!day.empty()) {
+            days.push_back(static_cast<DayOfWeek>(std::stoi(day)));
+        }
     }
-    return s_instance;
+    return days;
+}
+
+std::string formatDays(const std::vector<DayOfWeek>& days) {
+    std::string list;
+    for (size_t i = 0; i < days.size(); i++) {
+        list += (i > 0 ? "," : "") + std::to_string(static_cast<int>(days[i]));
+    }
+    return list;
+}
+
+const std::string WINDOW_SECTION_PREFIX = "window:";
+
+} // namespace
+
+DownloadScheduler::DownloadScheduler(DownloadManager& downloadManager)
+    : downloadManager_(downloadManager),
+      running_(false) {
+}
+
+DownloadScheduler::~DownloadScheduler() {
+    stop();
 }
 
 void DownloadScheduler::start() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (m_isRunning) {
-        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) {
+            return;
+        }
+
+        running_ = true;
+        schedulerThread_ = std::make_unique<std::thread>(&DownloadScheduler::processSchedules, this);
     }
-    
-    m_isRunning = true;
-    m_schedulerThread = std::make_unique<std::thread>(&DownloadScheduler::schedulerLoop, this);
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Download scheduler started");
+
+    // A window may already be open
+    applyBandwidthWindows();
+    dm::utils::Logger::info("Download scheduler started");
 }
 
 void DownloadScheduler::stop() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (!m_isRunning) {
-        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
     }
-    
-    m_isRunning = false;
-    m_condition.notify_all();
-    
-    if (m_schedulerThread && m_schedulerThread->joinable()) {
-        m_schedulerThread->join();
-    }
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Download scheduler stopped");
-}
-
-int DownloadScheduler::scheduleDownload(std::shared_ptr<DownloadTask> task, time_t startTime) {
-    if (!task) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, "Cannot schedule null download task");
-        return -1;
-    }
-    
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    // Generate schedule ID
-    int scheduleId = generateScheduleId();
-    
-    // Create schedule item
-    ScheduleItem item;
-    item.id = scheduleId;
-    item.taskId = task->getId();
-    item.task = task;
-    item.startTime = startTime;
-    item.repeat = ScheduleRepeat::NONE;
-    item.repeatInterval = 0;
-    item.active = true;
-    
-    // Add to schedule map
-    m_schedules[scheduleId] = item;
-    
-    // Log
-    std::string startTimeStr = formatTime(startTime);
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Scheduled download task " + std::to_string(task->getId()) + 
-        " to start at " + startTimeStr + 
-        " (Schedule ID: " + std::to_string(scheduleId) + ")");
-    
-    // Notify scheduler thread
-    m_condition.notify_one();
-    
-    return scheduleId;
-}
-
-int DownloadScheduler::scheduleDownload(const DownloadOptions& options, time_t startTime) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    // Generate schedule ID
-    int scheduleId = generateScheduleId();
-    
-    // Create schedule item
-    ScheduleItem item;
-    item.id = scheduleId;
-    item.taskId = -1; // No task yet
-    item.task = nullptr;
-    item.options = options;
-    item.startTime = startTime;
-    item.repeat = ScheduleRepeat::NONE;
-    item.repeatInterval = 0;
-    item.active = true;
-    
-    // Add to schedule map
-    m_schedules[scheduleId] = item;
-    
-    // Log
-    std::string startTimeStr = formatTime(startTime);
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Scheduled download for URL " + options.url + 
-        " to start at " + startTimeStr + 
-        " (Schedule ID: " + std::to_string(scheduleId) + ")");
-    
-    // Notify scheduler thread
-    m_condition.notify_one();
-    
-    return scheduleId;
-}
-
-int DownloadScheduler::scheduleRecurringDownload(const DownloadOptions& options, 
-                                              ScheduleRepeat repeat, 
-                                              int repeatInterval, 
-                                              time_t startTime) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    // Validate repeat parameters
-    if (repeat == ScheduleRepeat::NONE || repeatInterval <= 0) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Invalid repeat parameters for recurring download");
-        return -1;
-    }
-    
-    // Generate schedule ID
-    int scheduleId = generateScheduleId();
-    
-    // Create schedule item
-    ScheduleItem item;
-    item.id = scheduleId;
-    item.taskId = -1; // No task yet
-    item.task = nullptr;
-    item.options = options;
-    item.startTime = startTime;
-    item.repeat = repeat;
-    item.repeatInterval = repeatInterval;
-    item.active = true;
-    
-    // Add to schedule map
-    m_schedules[scheduleId] = item;
-    
-    // Log
-    std::string startTimeStr = formatTime(startTime);
-    std::string repeatStr = getRepeatString(repeat, repeatInterval);
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Scheduled recurring download for URL " + options.url + 
-        " to start at " + startTimeStr + 
-        " with repeat " + repeatStr + 
-        " (Schedule ID: " + std::to_string(scheduleId) + ")");
-    
-    // Notify scheduler thread
-    m_condition.notify_one();
-    
-    return scheduleId;
-}
-
-bool DownloadScheduler::updateSchedule(int scheduleId, time_t newStartTime) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    auto it = m_schedules.find(scheduleId);
-    if (it == m_schedules.end()) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Schedule ID not found: " + std::to_string(scheduleId));
-        return false;
+    condition_.notify_all();
+
+    if (schedulerThread_ && schedulerThread_->joinable()) {
+        schedulerThread_->join();
     }
-    
-    // Update start time
-    it->second.startTime = newStartTime;
-    
-    // Log
-    std::string startTimeStr = formatTime(newStartTime);
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Updated schedule " + std::to_string(scheduleId) + 
-        " to start at " + startTimeStr);
-    
-    // Notify scheduler thread
-    m_condition.notify_one();
-    
-    return true;
+    schedulerThread_.reset();
+
+    // Windows no longer close on time, so do not leave one in force
+    downloadManager_.clearScheduledSpeedLimit();
+    dm::utils::Logger::info("Download scheduler stopped");
 }
 
-bool DownloadScheduler::updateRecurringSchedule(int scheduleId, 
-                                             ScheduleRepeat repeat, 
-                                             int repeatInterval) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    auto it = m_schedules.find(scheduleId);
-    if (it == m_schedules.end()) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Schedule ID not found: " + std::to_string(scheduleId));
-        return false;
+std::string DownloadScheduler::addSchedule(const ScheduleEntry& entry) {
+    ScheduleEntry added = entry;
+    if (added.id.empty()) {
+        added.id = generateUniqueId();
     }
-    
-    // Validate repeat parameters
-    if (repeat == ScheduleRepeat::NONE && repeatInterval > 0) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Invalid repeat parameters for schedule update");
-        return false;
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (added.enabled) {
+            updateNextRunTime(added);
+        }
+        schedules_[added.id] = added;
+        if (added.enabled) {
+            wake = arm(added);
+        }
+    }
+
+    if (wake) {
+        condition_.notify_one();
+    }
+    return added.id;
+}
+
+bool DownloadScheduler::updateSchedule(const ScheduleEntry& entry) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = schedules_.find(entry.id);
+        if (it == schedules_.end()) {
+            return false;
+        }
+
+        it->second = entry;
+        if (it->second.enabled) {
+            updateNextRunTime(it->second);
+        }
+        if (it->second.enabled) {
+            wake = arm(it->second);
+        } else {
+            disarm(entry.id);
+        }
+    }
+
+    if (wake) {
+        condition_.notify_one();
     }
-    
-    // Update repeat settings
-    it->second.repeat = repeat;
-    it->second.repeatInterval = repeatInterval;
-    
-    // Log
-    std::string repeatStr = getRepeatString(repeat, repeatInterval);
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Updated schedule " + std::to_string(scheduleId) + 
-        " with repeat " + repeatStr);
-    
     return true;
 }
 
-bool DownloadScheduler::cancelSchedule(int scheduleId) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    auto it = m_schedules.find(scheduleId);
-    if (it == m_schedules.end()) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Schedule ID not found: " + std::to_string(scheduleId));
+bool DownloadScheduler::removeSchedule(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (schedules_.erase(id) == 0) {
         return false;
     }
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Cancelled schedule " + std::to_string(scheduleId));
-    
-    // Remove schedule
-    m_schedules.erase(it);
-    
+    disarm(id);
     return true;
 }
 
-bool DownloadScheduler::pauseSchedule(int scheduleId) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    auto it = m_schedules.find(scheduleId);
-    if (it == m_schedules.end()) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Schedule ID not found: " + std::to_string(scheduleId));
-        return false;
+ScheduleEntry DownloadScheduler::getSchedule(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = schedules_.find(id);
+    return it != schedules_.end() ? it->second : ScheduleEntry{};
+}
+
+std::vector<ScheduleEntry> DownloadScheduler::getAllSchedules() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ScheduleEntry> result;
+    result.reserve(schedules_.size());
+    for (const auto& pair : schedules_) {
+        result.push_back(pair.second);
     }
-    
-    if (!it->second.active) {
-        // Already paused
-        return true;
+    return result;
+}
+
+bool DownloadScheduler::enableSchedule(const std::string& id) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = schedules_.find(id);
+        if (it == schedules_.end()) {
+            return false;
+        }
+        if (it->second.enabled) {
+            return true;
+        }
+
+        it->second.enabled = true;
+        updateNextRunTime(it->second);
+        if (it->second.enabled) {
+            wake = arm(it->second);
+        }
+    }
+
+    if (wake) {
+        condition_.notify_one();
     }
-    
-    // Pause schedule
-    it->second.active = false;
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Paused schedule " + std::to_string(scheduleId));
-    
     return true;
 }
 
-bool DownloadScheduler::resumeSchedule(int scheduleId) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    auto it = m_schedules.find(scheduleId);
-    if (it == m_schedules.end()) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Schedule ID not found: " + std::to_string(scheduleId));
+bool DownloadScheduler::disableSchedule(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = schedules_.find(id);
+    if (it == schedules_.end()) {
         return false;
     }
-    
-    if (it->second.active) {
-        // Already active
-        return true;
-    }
-    
-    // Resume schedule
-    it->second.active = true;
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Resumed schedule " + std::to_string(scheduleId));
-    
-    // Notify scheduler thread
-    m_condition.notify_one();
-    
+
+    it->second.enabled = false;
+    disarm(id);
     return true;
 }
 
-std::vector<ScheduleInfo> DownloadScheduler::getAllSchedules() const {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    std::vector<ScheduleInfo> result;
-    
-    for (const auto& pair : m_schedules) {
-        const ScheduleItem& item = pair.second;
-        
-        ScheduleInfo info;
-        info.id = item.id;
-        info.taskId = item.taskId;
-        
-        if (item.task) {
-            info.url = item.task->getUrl();
-        } else {
-            info.url = item.options.url;
+bool DownloadScheduler::isRunning() const {
+    return running_;
+}
+
+void DownloadScheduler::setEventCallback(ScheduleEventCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    eventCallback_ = callback;
+}
+
+bool DownloadScheduler::executeScheduleNow(const std::string& id) {
+    ScheduleEntry entry;
+    ScheduleEventCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = schedules_.find(id);
+        if (it == schedules_.end()) {
+            return false;
         }
-        
-        info.startTime = item.startTime;
-        info.repeat = item.repeat;
-        info.repeatInterval = item.repeatInterval;
-        info.active = item.active;
-        
-        result.push_back(info);
+        it->second.lastRun = Clock::now();
+        entry = it->second;
+        callback = eventCallback_;
     }
-    
-    return result;
+
+    bool success = executeAction(entry);
+    if (callback) {
+        callback(entry);
+    }
+    return success;
 }
 
-ScheduleInfo DownloadScheduler::getSchedule(int scheduleId) const {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    ScheduleInfo info;
-    info.id = -1; // Invalid by default
-    
-    auto it = m_schedules.find(scheduleId);
-    if (it == m_schedules.end()) {
-        return info;
-    }
-    
-    const ScheduleItem& item = it->second;
-    
-    info.id = item.id;
-    info.taskId = item.taskId;
-    
-    if (item.task) {
-        info.url = item.task->getUrl();
-    } else {
-        info.url = item.options.url;
-    }
-    
-    info.startTime = item.startTime;
-    info.repeat = item.repeat;
-    info.repeatInterval = item.repeatInterval;
-    info.active = item.active;
-    
-    return info;
-}
-
-void DownloadScheduler::schedulerLoop() {
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Scheduler thread started");
-    
-    while (m_isRunning) {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        
-        // Find the next schedule to execute
-        time_t now = time(nullptr);
-        time_t nextScheduleTime = findNextScheduleTime();
-        
-        if (nextScheduleTime == 0) {
-            // No schedules, wait for notification or timeout
-            m_condition.wait_for(lock, std::chrono::minutes(1));
-            continue;
+std::string DownloadScheduler::addBandwidthWindow(const BandwidthWindow& window) {
+    BandwidthWindow added = window;
+    if (added.id.empty()) {
+        added.id = generateUniqueId();
+    }
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bandwidthWindows_[added.id] = added;
+        if (added.enabled) {
+            wake = arm(added);
+        }
+    }
+
+    if (wake) {
+        condition_.notify_one();
+    }
+    applyBandwidthWindows();
+    return added.id;
+}
+
+bool DownloadScheduler::updateBandwidthWindow(const BandwidthWindow& window) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = bandwidthWindows_.find(window.id);
+        if (it == bandwidthWindows_.end()) {
+            return false;
         }
-        
-        if (nextScheduleTime <= now) {
-            // Execute due schedules
-            executeDueSchedules();
-            
-            // Wait a short time before checking again
-            lock.unlock();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        it->second = window;
+        if (window.enabled) {
+            wake = arm(window);
         } else {
-            // Wait until next schedule time or notification
-            auto waitTime = std::chrono::seconds(nextScheduleTime - now);
-            m_condition.wait_for(lock, waitTime);
+            disarm(window.id);
         }
     }
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Scheduler thread stopped");
+
+    if (wake) {
+        condition_.notify_one();
+    }
+    applyBandwidthWindows();
+    return true;
 }
 
-time_t DownloadScheduler::findNextScheduleTime() {
-    time_t nextTime = 0;
-    time_t now = time(nullptr);
-    
-    for (const auto& pair : m_schedules) {
-        const ScheduleItem& item = pair.second;
-        
-        // Skip inactive schedules
-        if (!item.active) {
-            continue;
+bool DownloadScheduler::removeBandwidthWindow(const std::string& id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bandwidthWindows_.erase(id) == 0) {
+            return false;
         }
-        
-        // If schedule is in the future
-        if (item.startTime > now) {
-            if (nextTime == 0 || item.startTime < nextTime) {
-                nextTime = item.startTime;
+        disarm(id);
+    }
+
+    applyBandwidthWindows();
+    return true;
+}
+
+std::vector<BandwidthWindow> DownloadScheduler::getBandwidthWindows() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<BandwidthWindow> result;
+    result.reserve(bandwidthWindows_.size());
+    for (const auto& pair : bandwidthWindows_) {
+        result.push_back(pair.second);
+    }
+    return result;
+}
+
+bool DownloadScheduler::loadSchedules(const std::string& filePath) {
+    std::string path = filePath.empty() ? getSchedulerFilePath() : filePath;
+    if (!dm::utils::FileUtils::fileExists(path)) {
+        return true;
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        dm::utils::Logger::error("Failed to open schedules file: " + path);
+        return false;
+    }
+
+    // One "[id]" or "[window:id]" section per entry, followed by its key=value lines
+    std::vector<ScheduleEntry> loaded;
+    std::vector<BandwidthWindow> windows;
+    bool inWindow = false;
+    std::string line;
+    try {
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            if (line.front() == '[' && line.back() == ']') {
+                std::string id = line.substr(1, line.size() - 2);
+                inWindow = id.compare(0, WINDOW_SECTION_PREFIX.size(), WINDOW_SECTION_PREFIX) == 0;
+                if (inWindow) {
+                    BandwidthWindow window;
+                    window.id = id.substr(WINDOW_SECTION_PREFIX.size());
+                    windows.push_back(window);
+                } else {
+                    ScheduleEntry entry{};
+                    entry.id = id;
+                    loaded.push_back(entry);
+                }
+                continue;
+            }
+
+            size_t pos = line.find('=');
+            if (pos == std::string::npos || (inWindow ? windows.empty() : loaded.empty())) {
+                continue;
+            }
+            std::string key = line.substr(0, pos);
+            std::string value = line.substr(pos + 1);
+
+            if (inWindow) {
+                BandwidthWindow& window = windows.back();
+                if (key == "name") {
+                    window.name = value;
+                } else if (key == "start") {
+                    std::sscanf(value.c_str(), "%d:%d", &window.startHour, &window.startMinute);
+                } else if (key == "end") {
+                    std::sscanf(value.c_str(), "%d:%d", &window.endHour, &window.endMinute);
+                } else if (key == "days_of_week") {
+                    window.daysOfWeek = parseDays(value);
+                } else if (key == "bandwidth") {
+                    window.bandwidthLimit = std::stoi(value);
+                } else if (key == "bandwidth_percent") {
+                    window.bandwidthPercent = std::stoi(value);
+                } else if (key == "enabled") {
+                    window.enabled = value == "true";
+                }
+                continue;
+            }
+
+            ScheduleEntry& entry = loaded.back();
+            if (key == "name") {
+                entry.name = value;
+            } else if (key == "recurrence") {
+                entry.recurrenceType = static_cast<RecurrenceType>(std::stoi(value));
+            } else if (key == "task") {
+                entry.taskId = value;
+            } else if (key == "action") {
+                entry.actionType = static_cast<ScheduledActionType>(std::stoi(value));
+            } else if (key == "hour") {
+                entry.hour = std::stoi(value);
+            } else if (key == "minute") {
+                entry.minute = std::stoi(value);
+            } else if (key == "day_of_month") {
+                entry.dayOfMonth = std::stoi(value);
+            } else if (key == "days_of_week") {
+                entry.daysOfWeek = parseDays(value);
+            } else if (key == "interval") {
+                entry.intervalMinutes = std::stoi(value);
+            } else if (key == "bandwidth") {
+                entry.bandwidthLimit = std::stoi(value);
+            } else if (key == "enabled") {
+                entry.enabled = value == "true";
+            } else if (key == "last_run") {
+                entry.lastRun = fromSeconds(std::stoll(value));
+            } else if (key == "next_run") {
+                entry.nextRun = fromSeconds(std::stoll(value));
             }
         }
+    } catch (const std::exception& e) {
+        dm::utils::Logger::error("Invalid schedules file " + path + ": " + e.what());
+        return false;
     }
-    
-    return nextTime;
+
+    // Rebuilding the heap once beats pushing entry by entry
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        schedules_.clear();
+        bandwidthWindows_.clear();
+        generations_.clear();
+        timers_ = decltype(timers_)();
+
+        Clock::time_point now = Clock::now();
+        std::vector<Timer> timers;
+        timers.reserve(loaded.size() + windows.size());
+        for (ScheduleEntry& entry : loaded) {
+            if (entry.enabled) {
+                updateNextRunTime(entry);
+            }
+            if (entry.enabled) {
+                uint64_t generation = nextGeneration_++;
+                generations_[entry.id] = generation;
+                timers.push_back(Timer{entry.nextRun, generation, entry.id});
+            }
+            schedules_[entry.id] = entry;
+        }
+        for (const BandwidthWindow& window : windows) {
+            if (window.enabled) {
+                uint64_t generation = nextGeneration_++;
+                generations_[window.id] = generation;
+                timers.push_back(Timer{getNextBoundary(window, now), generation, window.id});
+            }
+            bandwidthWindows_[window.id] = window;
+        }
+        timers_ = decltype(timers_)(std::greater<Timer>(), std::move(timers));
+    }
+    condition_.notify_one();
+    applyBandwidthWindows();
+
+    dm::utils::Logger::info("Loaded " + std::to_string(loaded.size()) + " schedules from " + path);
+    return true;
+}
+
+bool DownloadScheduler::saveSchedules(const std::string& filePath) {
+    std::string path = filePath.empty() ? getSchedulerFilePath() : filePath;
+    std::string directory = dm::utils::FileUtils::getDirectory(path);
+    if (!dm::utils::FileUtils::createDirectory(directory)) {
+        dm::utils::Logger::error("Failed to create schedules directory: " + directory);
+        return false;
+    }
+
+    std::vector<ScheduleEntry> entries = getAllSchedules();
+    std::vector<BandwidthWindow> windows = getBandwidthWindows();
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        dm::utils::Logger::error("Failed to open schedules file for writing: " + path);
+        return false;
+    }
+
+    file << "# Download Manager Schedules" << std::endl;
+    file << "# This file is automatically generated" << std::endl;
+    for (const ScheduleEntry& entry : entries) {
+        file << std::endl << "[" << entry.id << "]" << std::endl;
+        file << "name=" << entry.name << std::endl;
+        file << "recurrence=" << static_cast<int>(entry.recurrenceType) << std::endl;
+        file << "task=" << entry.taskId << std::endl;
+        file << "action=" << static_cast<int>(entry.actionType) << std::endl;
+        file << "hour=" << entry.hour << std::endl;
+        file << "minute=" << entry.minute << std::endl;
+        file << "day_of_month=" << entry.dayOfMonth << std::endl;
+        file << "days_of_week=" << formatDays(entry.daysOfWeek) << std::endl;
+        file << "interval=" << entry.intervalMinutes << std::endl;
+        file << "bandwidth=" << entry.bandwidthLimit << std::endl;
+        file << "enabled=" << (entry.enabled ? "true" : "false") << std::endl;
+        file << "last_run=" << toSeconds(entry.lastRun) << std::endl;
+        file << "next_run=" << toSeconds(entry.nextRun) << std::endl;
+    }
+    for (const BandwidthWindow& window : windows) {
+        file << std::endl << "[" << WINDOW_SECTION_PREFIX << window.id << "]" << std::endl;
+        file << "name=" << window.name << std::endl;
+        file << "start=" << window.startHour << ":" << window.startMinute << std::endl;
+        file << "end=" << window.endHour << ":" << window.endMinute << std::endl;
+        file << "days_of_week=" << formatDays(window.daysOfWeek) << std::endl;
+        file << "bandwidth=" << window.bandwidthLimit << std::endl;
+        file << "bandwidth_percent=" << window.bandwidthPercent << std::endl;
+        file << "enabled=" << (window.enabled ? "true" : "false") << std::endl;
+    }
+
+    return static_cast<bool>(file);
 }
 
-void DownloadScheduler::executeDueSchedules() {
-    time_t now = time(nullptr);
-    std::vector<int> schedulesToUpdate;
-    
-    // Find and execute all due schedules
-    for (auto& pair : m_schedules) {
-        ScheduleItem& item = pair.second;
-        
-        // Skip inactive schedules
-        if (!item.active) {
+std::vector<ScheduleEntry> DownloadScheduler::getSchedulesByTaskId(const std::string& taskId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ScheduleEntry> result;
+    for (const auto& pair : schedules_) {
+        if (pair.second.taskId == taskId) {
+            result.push_back(pair.second);
+        }
+    }
+    return result;
+}
+
+std::vector<ScheduleEntry> DownloadScheduler::getSchedulesByActionType(ScheduledActionType actionType) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ScheduleEntry> result;
+    for (const auto& pair : schedules_) {
+        if (pair.second.actionType == actionType) {
+            result.push_back(pair.second);
+        }
+    }
+    return result;
+}
+
+void DownloadScheduler::processSchedules() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (running_) {
+        while (!timers_.empty() && !isCurrent(timers_.top())) {
+            timers_.pop();
+        }
+
+        // Sleep until the earliest deadline, or until an earlier one is armed
+        if (timers_.empty()) {
+            condition_.wait(lock);
+            continue;
+        }
+        Clock::time_point deadline = timers_.top().deadline;
+        if (deadline > Clock::now()) {
+            condition_.wait_until(lock, deadline);
             continue;
         }
-        
-        // Check if it's time to execute
-        if (item.startTime <= now) {
-            // Execute schedule
-            executeSchedule(item);
-            
-            // If it's a recurring schedule, update for next execution
-            if (item.repeat != ScheduleRepeat::NONE && item.repeatInterval > 0) {
-                // Calculate next execution time
-                time_t nextTime = calculateNextExecutionTime(item);
-                
-                // Update schedule
-                item.startTime = nextTime;
-                
-                Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                    "Rescheduled schedule " + std::to_string(item.id) + 
-                    " for next execution at " + formatTime(nextTime));
+
+        // Take every entry that is due as one batch and re-arm the recurring ones
+        Clock::time_point now = Clock::now();
+        std::vector<ScheduleEntry> due;
+        bool windowsChanged = false;
+        while (!timers_.empty() && timers_.top().deadline <= now) {
+            Timer timer = timers_.top();
+            timers_.pop();
+            if (!isCurrent(timer)) {
+                continue;
+            }
+            generations_.erase(timer.id);
+
+            auto window = bandwidthWindows_.find(timer.id);
+            if (window != bandwidthWindows_.end()) {
+                arm(window->second);
+                windowsChanged = true;
+                continue;
+            }
+
+            ScheduleEntry& entry = schedules_[timer.id];
+            entry.lastRun = now;
+            due.push_back(entry);
+
+            if (entry.recurrenceType == RecurrenceType::ONCE) {
+                entry.enabled = false;
             } else {
-                // One-time schedule, mark for removal
-                schedulesToUpdate.push_back(item.id);
+                updateNextRunTime(entry);
+                if (entry.enabled) {
+                    arm(entry);
+                }
             }
         }
-    }
-    
-    // Remove completed one-time schedules
-    for (int scheduleId : schedulesToUpdate) {
-        m_schedules.erase(scheduleId);
-        
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Removed completed one-time schedule " + std::to_string(scheduleId));
-    }
-}
-
-void DownloadScheduler::executeSchedule(ScheduleItem& item) {
-    // If task already exists, just start/resume it
-    if (item.task) {
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Executing schedule " + std::to_string(item.id) + 
-            " for existing task " + std::to_string(item.taskId));
-        
-        // Get download manager
-        auto& downloadManager = DownloadManager::instance();
-        
-        // Check current task status
-        DownloadStatus status = item.task->getStatus();
-        
-        if (status == DownloadStatus::QUEUED || 
-            status == DownloadStatus::PAUSED) {
-            // Resume/start the task
-            downloadManager.resumeDownload(item.taskId);
-        } else if (status == DownloadStatus::COMPLETED || 
-                 status == DownloadStatus::FAILED) {
-            // Restart the task
-            downloadManager.restartDownload(item.taskId);
-        }
-        // If already downloading, do nothing
-    } else {
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Executing schedule " + std::to_string(item.id) + 
-            " by creating new download task for URL " + item.options.url);
-        
-        // Get download manager
-        auto& downloadManager = DownloadManager::instance();
-        
-        try {
-            // Create new download task
-            std::shared_ptr<DownloadTask> task = downloadManager.addDownload(item.options);
-            
-            if (task) {
-                // Store task reference
-                item.task = task;
-                item.taskId = task->getId();
-                
-                Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                    "Created download task " + std::to_string(item.taskId) + 
-                    " for schedule " + std::to_string(item.id));
-            } else {
-                Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                    "Failed to create download task for schedule " + std::to_string(item.id));
+        compactTimers();
+        ScheduleEventCallback callback = eventCallback_;
+
+        lock.unlock();
+        if (windowsChanged) {
+            applyBandwidthWindows();
+        }
+        for (const ScheduleEntry& entry : due) {
+            executeAction(entry);
+            if (callback) {
+                callback(entry);
             }
-        } catch (const std::exception& e) {
-            Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                "Exception creating download task for schedule " + 
-                std::to_string(item.id) + ": " + e.what());
         }
+        lock.lock();
     }
 }
 
-time_t DownloadScheduler::calculateNextExecutionTime(const ScheduleItem& item) {
-    time_t nextTime = item.startTime;
-    
-    switch (item.repeat) {
-        case ScheduleRepeat::HOURLY:
-            nextTime += item.repeatInterval * 3600; // seconds in an hour
-            break;
-        case ScheduleRepeat::DAILY:
-            nextTime += item.repeatInterval * 86400; // seconds in a day
-            break;
-        case ScheduleRepeat::WEEKLY:
-            nextTime += item.repeatInterval * 604800; // seconds in a week
-            break;
-        case ScheduleRepeat::MONTHLY: {
-            // This is approximate (not accounting for varying month lengths)
-            nextTime += item.repeatInterval * 2592000; // ~seconds in a 30-day month
-            break;
+bool DownloadScheduler::arm(const ScheduleEntry& entry) {
+    return pushTimer(entry.id, entry.nextRun);
+}
+
+bool DownloadScheduler::arm(const BandwidthWindow& window) {
+    return pushTimer(window.id, getNextBoundary(window, Clock::now()));
+}
+
+bool DownloadScheduler::pushTimer(const std::string& id, Clock::time_point deadline) {
+    bool earliest = true;
+    while (!timers_.empty() && !isCurrent(timers_.top())) {
+        timers_.pop();
+    }
+    if (!timers_.empty()) {
+        earliest = deadline < timers_.top().deadline;
+    }
+
+    uint64_t generation = nextGeneration_++;
+    generations_[id] = generation;
+    timers_.push(Timer{deadline, generation, id});
+    compactTimers();
+    return earliest;
+}
+
+void DownloadScheduler::disarm(const std::string& id) {
+    generations_.erase(id);
+    compactTimers();
+}
+
+bool DownloadScheduler::isCurrent(const Timer& timer) const {
+    auto it = generations_.find(timer.id);
+    return it != generations_.end() && it->second == timer.generation;
+}
+
+void DownloadScheduler::compactTimers() {
+    if (timers_.size() <= 2 * generations_.size() + COMPACT_SLACK) {
+        return;
+    }
+
+    std::vector<Timer> timers;
+    timers.reserve(generations_.size());
+    while (!timers_.empty()) {
+        if (isCurrent(timers_.top())) {
+            timers.push_back(timers_.top());
         }
-        case ScheduleRepeat::CUSTOM:
-            nextTime += item.repeatInterval; // Custom interval in seconds
-            break;
-        default:
-            // No repeat
-            break;
+        timers_.pop();
     }
-    
-    return nextTime;
+    timers_ = decltype(timers_)(std::greater<Timer>(), std::move(timers));
 }
 
-int DownloadScheduler::generateScheduleId() {
-    static int nextId = 1;
-    return nextId++;
+void DownloadScheduler::applyBandwidthWindows() {
+    int speed = 0;
+    int percent = 0;
+    std::string open;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+
+        // The tightest open window wins; the manager takes the lower of its
+        // absolute and relative caps
+        Clock::time_point now = Clock::now();
+        for (const auto& pair : bandwidthWindows_) {
+            const BandwidthWindow& window = pair.second;
+            if (!window.enabled || !isWindowOpen(window, now)) {
+                continue;
+            }
+            if (window.bandwidthPercent > 0) {
+                percent = percent > 0 ? std::min(percent, window.bandwidthPercent) : window.bandwidthPercent;
+            } else if (window.bandwidthLimit > 0) {
+                speed = speed > 0 ? std::min(speed, window.bandwidthLimit) : window.bandwidthLimit;
+            }
+            open += (open.empty() ? "" : ", ") + (window.name.empty() ? window.id : window.name);
+        }
+
+        // Under the lock, so a boundary and an edit cannot apply out of order
+        downloadManager_.setScheduledSpeedLimit(speed, percent);
+    }
+
+    dm::utils::Logger::debug("Bandwidth windows open: " + (open.empty() ? std::string("none") : open) +
+                             " (cap " + std::to_string(speed) + " KB/s, " + std::to_string(percent) + "%)");
 }
 
-std::string DownloadScheduler::formatTime(time_t time) {
-    struct tm* timeinfo = localtime(&time);
-    char buffer[80];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-    return std::string(buffer);
+bool DownloadScheduler::isWindowOpen(const BandwidthWindow& window, Clock::time_point time) const {
+    std::tm parts = toLocalTime(time);
+    int minute = parts.tm_hour * 60 + parts.tm_min;
+    int start = window.startHour * 60 + window.startMinute;
+    int end = window.endHour * 60 + window.endMinute;
+    DayOfWeek today = static_cast<DayOfWeek>(parts.tm_wday);
+    DayOfWeek yesterday = static_cast<DayOfWeek>((parts.tm_wday + 6) % 7);
+    auto opensOn = [&](DayOfWeek day) {
+        return window.daysOfWeek.empty() || isDayInList(day, window.daysOfWeek);
+    };
+
+    if (start == end) {
+        return opensOn(today);
+    }
+    if (start < end) {
+        return minute >= start && minute < end && opensOn(today);
+    }
+
+    // Past midnight the window belongs to the day it opened on
+    if (minute >= start) {
+        return opensOn(today);
+    }
+    return minute < end && opensOn(yesterday);
 }
 
-std::string DownloadScheduler::getRepeatString(ScheduleRepeat repeat, int interval) {
-    std::string result;
-    
-    switch (repeat) {
-        case ScheduleRepeat::NONE:
-            result = "none";
-            break;
-        case ScheduleRepeat::HOURLY:
-            if (interval == 1) {
-                result = "hourly";
-            } else {
-                result = "every " + std::to_string(interval) + " hours";
+Clock::time_point DownloadScheduler::getNextBoundary(const BandwidthWindow& window, Clock::time_point time) const {
+    // Both times come round every day, so the next one is at most a day away;
+    // a boundary on a day the window skips only re-applies the same cap
+    std::tm today = toLocalTime(time);
+    Clock::time_point next = Clock::time_point::max();
+    for (int offset = 0; offset <= 1; offset++) {
+        for (int boundary = 0; boundary < 2; boundary++) {
+            std::tm day = today;
+            day.tm_mday += offset;
+            day.tm_hour = std::clamp(boundary == 0 ? window.startHour : window.endHour, 0, 23);
+            day.tm_min = std::clamp(boundary == 0 ? window.startMinute : window.endMinute, 0, 59);
+            day.tm_sec = 0;
+            Clock::time_point candidate = fromLocalTime(day);
+            if (candidate > time && candidate < next) {
+                next = candidate;
             }
-            break;
-        case ScheduleRepeat::DAILY:
-            if (interval == 1) {
-                result = "daily";
-            } else {
-                result = "every " + std::to_string(interval) + " days";
+        }
+    }
+    return next;
+}
+
+bool DownloadScheduler::executeAction(const ScheduleEntry& entry) {
+    dm::utils::Logger::info("Running schedule " + (entry.name.empty() ? entry.id : entry.name));
+
+    bool allTasks = entry.taskId.empty();
+    switch (entry.actionType) {
+        case ScheduledActionType::START_DOWNLOAD:
+            if (allTasks) {
+                downloadManager_.startAllDownloads();
+                return true;
             }
+            return downloadManager_.startDownload(entry.taskId);
+        case ScheduledActionType::PAUSE_DOWNLOAD:
+            if (allTasks) {
+                downloadManager_.pauseAllDownloads();
+                return true;
+            }
+            return downloadManager_.pauseDownload(entry.taskId);
+        case ScheduledActionType::RESUME_DOWNLOAD:
+            if (allTasks) {
+                downloadManager_.resumeAllDownloads();
+                return true;
+            }
+            return downloadManager_.resumeDownload(entry.taskId);
+        case ScheduledActionType::LIMIT_BANDWIDTH:
+            downloadManager_.setMaxDownloadSpeed(std::max(0, entry.bandwidthLimit));
+            return true;
+        case ScheduledActionType::UNLIMITED_BANDWIDTH:
+            downloadManager_.setMaxDownloadSpeed(0);
+            return true;
+    }
+    return false;
+}
+
+void DownloadScheduler::updateNextRunTime(ScheduleEntry& entry) {
+    Clock::time_point now = Clock::now();
+
+    if (entry.recurrenceType == RecurrenceType::INTERVAL) {
+        auto interval = std::chrono::minutes(std::max(1, entry.intervalMinutes));
+        Clock::time_point base = entry.lastRun.time_since_epoch().count() > 0 ? entry.lastRun : now;
+        Clock::time_point next = base + interval;
+
+        // Skip the runs missed while stopped in one step
+        if (next <= now) {
+            next += interval * ((now - next) / interval + 1);
+        }
+        entry.nextRun = next;
+        return;
+    }
+
+    // A one-off keeps the time it was given while that is still ahead
+    if (entry.recurrenceType == RecurrenceType::ONCE && entry.nextRun > now) {
+        return;
+    }
+
+    std::tm today = toLocalTime(now);
+    today.tm_hour = std::clamp(entry.hour, 0, 23);
+    today.tm_min = std::clamp(entry.minute, 0, 59);
+    today.tm_sec = 0;
+
+    switch (entry.recurrenceType) {
+        case RecurrenceType::ONCE:
+        case RecurrenceType::DAILY: {
+            Clock::time_point next = fromLocalTime(today);
+            if (next <= now) {
+                today.tm_mday += 1;
+                next = fromLocalTime(today);
+            }
+            entry.nextRun = next;
             break;
-        case ScheduleRepeat::WEEKLY:
-            if (interval == 1) {
-                result = "weekly";
-            } else {
-                result = "every " + std::to_string(interval) + " weeks";
+        }
+        case RecurrenceType::WEEKLY: {
+            if (entry.daysOfWeek.empty()) {
+                dm::utils::Logger::warning("Weekly schedule " + entry.id + " has no days, disabling it");
+                entry.enabled = false;
+                return;
+            }
+            for (int offset = 0; offset <= 7; offset++) {
+                std::tm day = today;
+                day.tm_mday += offset;
+                Clock::time_point next = fromLocalTime(day);
+                DayOfWeek weekday = static_cast<DayOfWeek>(toLocalTime(next).tm_wday);
+                if (next > now && isDayInList(weekday, entry.daysOfWeek)) {
+                    entry.nextRun = next;
+                    break;
+                }
             }
             break;
-        case ScheduleRepeat::MONTHLY:
-            if (interval == 1) {
-                result = "monthly";
-            } else {
-                result = "every " + std::to_string(interval) + " months";
+        }
+        case RecurrenceType::MONTHLY: {
+            // Days past the end of a short month run on its last day
+            int wanted = std::max(1, entry.dayOfMonth);
+            std::tm day = today;
+            day.tm_mday = std::min(wanted, daysInMonth(day.tm_year, day.tm_mon));
+            Clock::time_point next = fromLocalTime(day);
+            if (next <= now) {
+                day = today;
+                day.tm_mday = 1;
+                day.tm_mon += 1;
+                std::mktime(&day);
+                day.tm_hour = today.tm_hour;
+                day.tm_min = today.tm_min;
+                day.tm_sec = 0;
+                day.tm_mday = std::min(wanted, daysInMonth(day.tm_year, day.tm_mon));
+                next = fromLocalTime(day);
             }
+            entry.nextRun = next;
             break;
-        case ScheduleRepeat::CUSTOM:
-            result = "custom interval of " + std::to_string(interval) + " seconds";
+        }
+        case RecurrenceType::INTERVAL:
             break;
-        default:
-            result = "unknown";
     }
-    
-    return result;
 }
 
-} // namespace Core
-} // namespace DownloadManager
\ No newline at end of file
+std::string DownloadScheduler::generateUniqueId() const {
+    return DownloadTask::generateId();
+}
+
+std::string DownloadScheduler::getSchedulerFilePath() const {
+    return dm::utils::FileUtils::getAppDataDirectory() + "/schedules.ini";
+}
+
+bool DownloadScheduler::isDayInList(DayOfWeek dayOfWeek, const std::vector<DayOfWeek>& daysOfWeek) const {
+    return std::find(daysOfWeek.begin(), daysOfWeek.end(), dayOfWeek) != daysOfWeek.end();
+}
+
+DayOfWeek DownloadScheduler::getCurrentDayOfWeek() const {
+    return static_cast<DayOfWeek>(toLocalTime(Clock::now()).tm_wday);
+}
+
+} // namespace core
+} // namespace dm
@@ -1,7 +1,13 @@
 #include "core/DownloadTask.h"
+#include "core/ContentStore.h"
+#include "core/PeerCache.h"
+#include "core/MetadataPrefetcher.h"
 #include "core/HttpClient.h"
+#include "core/HostConnectionCache.h"
 #include "utils/Logger.h"
+#include "utils/Tracer.h"
 #include "utils/FileUtils.h"
+#include "utils/IoTaskExecutor.h"
 #include "utils/UrlParser.h"
 
 #include <fstream>
@@ -11,7 +17,9 @@
 #include <ctime>
 #include <filesystem>
 #include <thread>
+#include <system_error>
 #include <algorithm>
+#include <cctype>
 #include <cmath>
 
 namespace dm {
@@ -36,6 +44,32 @@ std::string generateUniqueId() {
     return ss.str();
 }
 
+namespace {
+
+// The parts of ranges that fall within [startByte, endByte]
+std::vector<SegmentRange> clipRanges(const std::vector<SegmentRange>& ranges, int64_t startByte, int64_t endByte) {
+    std::vector<SegmentRange> clipped;
+    for (const auto& range : ranges) {
+        SegmentRange part;
+        part.startByte = std::max(range.startByte, startByte);
+        part.endByte = std::min(range.endByte, endByte);
+        if (part.startByte <= part.endByte) {
+            clipped.push_back(part);
+        }
+    }
+    return clipped;
+}
+
+int64_t countBytes(const std::vector<SegmentRange>& ranges) {
+    int64_t bytes = 0;
+    for (const auto& range : ranges) {
+        bytes += range.endByte + 1 - range.startByte;
+    }
+    return bytes;
+}
+
+} // anonymous namespace
+
 DownloadTask::DownloadTask(const std::string& url, 
                          const std::string& destinationPath,
                          const std::string& filename)
@@ -55,6 +89,15 @@ DownloadTask::DownloadTask(const std::string& url,
         filename_ = filename;
     }
     
+    // The task's own URL is the first source
+    Source primary;
+    primary.url = url;
+    primary.usable = true;
+    sources_.push_back(primary);
+    
+    // Per-task bandwidth limiter, unlimited until configured
+    throttler_ = std::make_shared<Throttler>();
+    
     // Initialize start time
     startTime_ = std::chrono::system_clock::now();
     lastUpdateTime_ = startTime_;
@@ -63,13 +106,17 @@ DownloadTask::DownloadTask(const std::string& url,
     dm::utils::Logger::info("Created download task: " + url + " -> " + destinationPath + "/" + filename_);
 }
 
+std::string DownloadTask::generateId() {
+    return generateUniqueId();
+}
+
 DownloadTask::~DownloadTask() {
     // Make sure all segments are stopped
     cancel();
 }
 
 bool DownloadTask::initialize() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     
     // Check if already initialized
     if (status_ != DownloadStatus::NONE) {
@@ -77,12 +124,29 @@ bool DownloadTask::initialize() {
     }
     
     try {
-        // Check if the server supports range requests
-        supportsResume_ = checkRangeSupport();
+        // Get file size and range support, unless the file is stored already
+        if (!placeStoredCopy()) {
+            probeServer();
+        }
+        
+        // The copy from an earlier download is current, there is nothing to fetch
+        if (upToDate_) {
+            progressInfo_.totalBytes = fileSize_;
+            progressInfo_.downloadedBytes = fileSize_;
+            progressInfo_.progressPercent = 100.0;
+            progressSnapshot_.store(progressInfo_);
+            setStatus(DownloadStatus::COMPLETED);
+            dm::utils::Logger::info("Download up to date: " + url_ + " -> " + destinationPath_ + "/" + filename_);
+            return true;
+        }
         
-        // Get file size
-        HttpClient client;
-        fileSize_ = client.getContentLength(url_);
+        bool usable = std::any_of(sources_.begin(), sources_.end(),
+                                  [](const Source& source) { return source.usable; });
+        if (!usable) {
+            error_ = "No source has the expected file";
+            setStatus(DownloadStatus::DOWNLOAD_ERROR);
+            return false;
+        }
         
         // Initialize the file
         if (!initializeFile()) {
@@ -91,8 +155,8 @@ bool DownloadTask::initialize() {
             return false;
         }
         
-        // Create metadata file
-        if (!createMetadataFile()) {
+        // Create metadata file, a staged download has nothing on disk to describe
+        if (!isSmallFile() && !createMetadataFile()) {
             dm::utils::Logger::warning("Failed to create metadata file");
             // Continue anyway, metadata is not critical
         }
@@ -114,6 +178,11 @@ bool DownloadTask::start() {
         return false;
     }
     
+    // Revalidation found the earlier copy current
+    if (status_ == DownloadStatus::COMPLETED && upToDate_) {
+        return true;
+    }
+    
     // Check if already downloading
     if (status_ == DownloadStatus::DOWNLOADING) {
         return true;
@@ -137,9 +206,10 @@ bool DownloadTask::start() {
         // Set status to downloading
         setStatus(DownloadStatus::DOWNLOADING);
         
-        // Start all segments
-        for (auto& segment : segments_) {
-            segment->start();
+        // Start the segments the host has connections for, the rest wait their turn
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            scheduleSegments();
         }
         
         return true;
@@ -151,10 +221,10 @@ bool DownloadTask::start() {
 }
 
 bool DownloadTask::pause() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     
-    // Check if downloading
-    if (status_ != DownloadStatus::DOWNLOADING) {
+    // Check if downloading, with data left to fetch
+    if (status_ != DownloadStatus::DOWNLOADING || finalizing_) {
         return false;
     }
     
@@ -175,21 +245,22 @@ bool DownloadTask::pause() {
 }
 
 bool DownloadTask::resume() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     
     // Check if paused
     if (status_ != DownloadStatus::PAUSED) {
         return false;
     }
     
+    // A restored download has no segments until it first starts
+    if (segments_.empty()) {
+        return start();
+    }
+    
     try {
-        // Resume all segments
-        for (auto& segment : segments_) {
-            segment->resume();
-        }
-        
-        // Set status to downloading
+        // Set status to downloading, then restart the paused segments as connections allow
         setStatus(DownloadStatus::DOWNLOADING);
+        scheduleSegments();
         
         return true;
     } catch (const std::exception& e) {
@@ -199,22 +270,43 @@ bool DownloadTask::resume() {
 }
 
 bool DownloadTask::cancel() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::shared_ptr<SegmentDownloader>> segments;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        
+        // Check if already canceled or completed; a finishing task has all its data
+        if (status_ == DownloadStatus::CANCELED || status_ == DownloadStatus::COMPLETED || finalizing_) {
+            return false;
+        }
+        
+        // Take the segments out, their threads report back under the task lock
+        segments.swap(segments_);
+    }
     
-    // Check if already canceled or completed
-    if (status_ == DownloadStatus::CANCELED || status_ == DownloadStatus::COMPLETED) {
+    // Cancel all segments, joining their threads without the lock
+    for (auto& segment : segments) {
+        segment->cancel();
+    }
+    
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (status_ == DownloadStatus::CANCELED || status_ == DownloadStatus::COMPLETED || finalizing_) {
         return false;
     }
     
     try {
-        // Cancel all segments
+        // Clear segments started meanwhile
         for (auto& segment : segments_) {
             segment->cancel();
         }
-        
-        // Clear segments
         segments_.clear();
         
+        if (filters_) {
+            filters_->abandon();
+        }
+        if (outputFile_) {
+            outputFile_->close();
+        }
+        
         // Set status to canceled
         setStatus(DownloadStatus::CANCELED);
         
@@ -226,7 +318,7 @@ bool DownloadTask::cancel() {
 }
 
 void DownloadTask::setSegmentCount(int count) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     
     // Check if download has started
     if (status_ != DownloadStatus::NONE && status_ != DownloadStatus::QUEUED) {
@@ -238,22 +330,22 @@ void DownloadTask::setSegmentCount(int count) {
 }
 
 void DownloadTask::setPriority(DownloadPriority priority) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     priority_ = priority;
 }
 
 void DownloadTask::setType(DownloadType type) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     type_ = type;
 }
 
 void DownloadTask::setProgressCallback(TaskProgressCallback callback) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     progressCallback_ = callback;
 }
 
 void DownloadTask::setStatusChangeCallback(StatusChangeCallback callback) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     statusChangeCallback_ = callback;
 }
 
@@ -264,13 +356,211 @@ void DownloadTask::setSegmentMaxRetries(int retries) {
     }
 }
 
+void DownloadTask::setTransferMode(TransferMode mode) {
+    transferMode_ = mode;
+}
+
+void DownloadTask::setSpeedLimit(int64_t bytesPerSecond) {
+    throttler_->setMaxBandwidth(bytesPerSecond);
+}
+
+int64_t DownloadTask::getSpeedLimit() const {
+    return throttler_->getMaxBandwidth();
+}
+
+void DownloadTask::setParentThrottler(std::shared_ptr<Throttler> parent) {
+    throttler_->setParent(parent);
+}
+
+void DownloadTask::setDirectIo(bool enabled) {
+    directIo_ = enabled;
+}
+
+void DownloadTask::setDynamicSplitting(bool enabled, int64_t minSplitSize) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    dynamicSplitting_ = enabled;
+    minSplitSize_ = std::max<int64_t>(minSplitSize, static_cast<int64_t>(OutputFile::getAlignment()));
+}
+
+void DownloadTask::setAdaptiveSegments(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    adaptiveSegments_ = enabled;
+}
+
+void DownloadTask::setStreamingPriority(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    streamingPriority_ = enabled;
+}
+
+int64_t DownloadTask::getReadableBytes() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    
+    if (externalProgress_) {
+        return progressInfo_.readableBytes;
+    }
+    if (status_ == DownloadStatus::COMPLETED) {
+        return fileSize_ > 0 ? fileSize_ : progressInfo_.downloadedBytes;
+    }
+    
+    // Not started since it was restored, the gaps are the missing ranges
+    if (segments_.empty()) {
+        int64_t readable = restoredRanges_.empty() ? 0 : restoredRanges_.front().startByte;
+        for (const auto& range : restoredRanges_) {
+            readable = std::min(readable, range.startByte);
+        }
+        return readable;
+    }
+    
+    // Everything outside the unfinished segments has reached the file
+    int64_t readable = -1;
+    for (const auto& segment : segments_) {
+        if (segment->getStatus() == SegmentStatus::COMPLETED) {
+            continue;
+        }
+        int64_t saved = segment->getSavedPosition();
+        readable = readable < 0 ? saved : std::min(readable, saved);
+    }
+    if (readable < 0) {
+        return fileSize_ > 0 ? fileSize_ : progressInfo_.downloadedBytes;
+    }
+    return readable;
+}
+
+bool DownloadTask::hasBuffered(double seconds, double bytesPerSecond) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    int64_t readable = getReadableBytes();
+    return (fileSize_ > 0 && readable >= fileSize_) || readable >= static_cast<int64_t>(seconds * bytesPerSecond);
+}
+
+void DownloadTask::setStreamingHash(bool enabled, dm::utils::HashAlgorithm algorithm) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    streamingHash_ = enabled;
+    streamingHashAlgorithm_ = algorithm;
+}
+
+std::string DownloadTask::getStreamedHash() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return hasher_ ? hasher_->getDigest() : "";
+}
+
+ContentSample DownloadTask::getContentSample() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return sniffer_ ? sniffer_->getSample() : ContentSample();
+}
+
+void DownloadTask::setRevalidate(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    revalidate_ = enabled;
+}
+
+void DownloadTask::setChecksumSidecar(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    checksumSidecar_ = enabled;
+}
+
+bool DownloadTask::isUpToDate() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return upToDate_;
+}
+
+void DownloadTask::setMultiplexing(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    multiplexing_ = enabled;
+}
+
+void DownloadTask::setSmallFileThreshold(int64_t bytes) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    smallFileThreshold_ = std::max<int64_t>(0, bytes);
+}
+
+void DownloadTask::setMirrors(const std::vector<std::string>& urls) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    
+    if (status_ != DownloadStatus::NONE) {
+        return;
+    }
+    
+    // Mirrors are not used until they are probed
+    sources_.resize(1);
+    for (const auto& url : urls) {
+        if (url.empty() || url == url_) {
+            continue;
+        }
+        Source mirror;
+        mirror.url = url;
+        sources_.push_back(mirror);
+    }
+}
+
+std::vector<DownloadSourceInfo> DownloadTask::getSources() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    
+    std::vector<int> active = countSourceSegments(true);
+    std::vector<DownloadSourceInfo> sources;
+    for (size_t i = 0; i < sources_.size(); i++) {
+        DownloadSourceInfo info;
+        info.url = sources_[i].url;
+        info.usable = sources_[i].usable;
+        info.activeSegments = active[i];
+        info.downloadSpeed = sources_[i].speed;
+        info.failures = sources_[i].failures;
+        info.peer = sources_[i].peer;
+        sources.push_back(info);
+    }
+    
+    return sources;
+}
+
+void DownloadTask::setExpectedSize(int64_t size) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    expectedSize_ = size;
+}
+
+void DownloadTask::setExpectedHash(dm::utils::HashAlgorithm algorithm, const std::string& hash) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    expectedHash_ = hash;
+    std::transform(expectedHash_.begin(), expectedHash_.end(), expectedHash_.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    streamingHash_ = !expectedHash_.empty() || streamingHash_;
+    streamingHashAlgorithm_ = algorithm;
+}
+
+void DownloadTask::setPieceHashes(const PieceMap& pieces) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    pieces_ = pieces;
+    for (auto& hash : pieces_.hashes) {
+        std::transform(hash.begin(), hash.end(), hash.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    }
+}
+
+void DownloadTask::setPieceHashSize(int64_t bytes) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    pieceHashSize_ = std::max<int64_t>(0, bytes);
+}
+
+PieceMap DownloadTask::getPieceMap() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return pieceVerifier_ ? pieceVerifier_->getPieceMap() : pieces_;
+}
+
+int DownloadTask::getRepairedPieceCount() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return repairedPieces_;
+}
+
+void DownloadTask::setWriteBufferSize(size_t bytes) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    writeBufferSize_ = bytes;
+    writeBufferPool_.reset();
+}
+
 DownloadStatus DownloadTask::getStatus() const {
     return status_;
 }
 
 ProgressInfo DownloadTask::getProgressInfo() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return progressInfo_;
+    return progressSnapshot_.load();
 }
 
 const std::string& DownloadTask::getUrl() const {
@@ -294,8 +584,7 @@ const std::string& DownloadTask::getError() const {
 }
 
 double DownloadTask::getDownloadSpeed() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return progressInfo_.downloadSpeed;
+    return progressSnapshot_.load().downloadSpeed;
 }
 
 std::chrono::system_clock::time_point DownloadTask::getStartTime() const {
@@ -319,15 +608,22 @@ DownloadType DownloadTask::getType() const {
 }
 
 void DownloadTask::updateProgress() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // Started before the lock, so waiting on it shows up
+    DM_TRACE_SPAN("progress update");
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
     
-    // Check if downloading
-    if (status_ != DownloadStatus::DOWNLOADING) {
+    // Check if downloading; a finishing task is left to its completion work
+    if (status_ != DownloadStatus::DOWNLOADING || externalProgress_ || finalizing_) {
         return;
     }
-    
+
+    // Pieces that failed verification are fetched again before anything counts as done
+    if (!checkPieces()) {
+        return;
+    }
+
     // Calculate total downloaded bytes
-    int64_t totalDownloaded = 0;
+    int64_t totalDownloaded = restoredBytes_;
     double totalSpeed = 0.0;
     bool allCompleted = true;
     
@@ -340,13 +636,70 @@ void DownloadTask::updateProgress() {
         }
     }
     
+    refreshProgress(totalDownloaded, totalSpeed);
+    progressInfo_.readableBytes = getReadableBytes();
+    
+    // Check if all segments are completed, and for a split file every
+    // piece, starting those taken over from other nodes
+    if (!clusterKey_.empty()) {
+        scheduleSegments();
+        allCompleted = advanceCluster() && allCompleted;
+    }
+    if (allCompleted) {
+        onTaskCompleted();
+        return;
+    }
+    
+    updateSources();
+    adaptConnections();
+    
+    // Ask again for connections the host refused earlier
+    if (waitingForHost_) {
+        scheduleSegments();
+    }
+    
+    // Call progress callback if provided, without holding the lock
+    TaskProgressCallback callback = progressCallback_;
+    ProgressInfo progress = progressInfo_;
+    lock.unlock();
+    
+    if (callback) {
+        callback(progress);
+    }
+}
+
+void DownloadTask::publishProgress(int64_t downloadedBytes, int64_t totalBytes, double downloadSpeed,
+                                   int64_t readableBytes) {
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    
+    externalProgress_ = true;
+    if (totalBytes > 0) {
+        fileSize_ = totalBytes;
+        progressInfo_.totalBytes = totalBytes;
+    }
+    if (readableBytes >= 0) {
+        progressInfo_.readableBytes = readableBytes;
+    }
+    refreshProgress(downloadedBytes, downloadSpeed);
+    
+    // Call progress callback if provided, without holding the lock
+    TaskProgressCallback callback = progressCallback_;
+    ProgressInfo progress = progressInfo_;
+    lock.unlock();
+    
+    if (callback) {
+        callback(progress);
+    }
+}
+
+void DownloadTask::refreshProgress(int64_t downloadedBytes, double downloadSpeed) {
     // Update progress info
-    progressInfo_.downloadedBytes = totalDownloaded;
-    progressInfo_.downloadSpeed = totalSpeed;
+    progressInfo_.downloadedBytes = downloadedBytes;
+    progressInfo_.downloadSpeed = downloadSpeed;
     
     // Calculate percentage
     if (fileSize_ > 0) {
-        progressInfo_.progressPercent = static_cast<double>(totalDownloaded) / fileSize_ * 100.0;
+        progressInfo_.progressPercent = static_cast<double>(downloadedBytes) / fileSize_ * 100.0;
     } else {
         progressInfo_.progressPercent = 0.0;
     }
@@ -357,9 +710,9 @@ void DownloadTask::updateProgress() {
         std::chrono::duration_cast<std::chrono::seconds>(now - startTime_).count();
     
     // Calculate estimated time remaining
-    if (totalSpeed > 0 && fileSize_ > 0) {
-        int64_t bytesRemaining = fileSize_ - totalDownloaded;
-        progressInfo_.timeRemaining = static_cast<int64_t>(bytesRemaining / totalSpeed);
+    if (downloadSpeed > 0 && fileSize_ > 0) {
+        int64_t bytesRemaining = fileSize_ - downloadedBytes;
+        progressInfo_.timeRemaining = static_cast<int64_t>(bytesRemaining / downloadSpeed);
     } else {
         progressInfo_.timeRemaining = 0;
     }
@@ -367,7 +720,7 @@ void DownloadTask::updateProgress() {
     // Update speed history for calculating average speed
     if (std::chrono::duration_cast<std::chrono::seconds>(now - lastUpdateTime_).count() >= 1) {
         // Add current speed to history
-        speedHistory_.push_back(totalSpeed);
+        speedHistory_.push_back(downloadSpeed);
         
         // Keep only the last 10 speed measurements
         if (speedHistory_.size() > 10) {
@@ -386,191 +739,1596 @@ void DownloadTask::updateProgress() {
         lastUpdateTime_ = now;
     }
     
-    // Call progress callback if provided
-    if (progressCallback_) {
-        progressCallback_(progressInfo_);
-    }
-    
-    // Check if all segments are completed
-    if (allCompleted) {
-        onTaskCompleted();
-    }
-}
-
-bool DownloadTask::checkRangeSupport() {
-    HttpClient client;
-    return client.supportsRangeRequests(url_);
+    // Publish for lock-free readers
+    progressSnapshot_.store(progressInfo_);
 }
 
-bool DownloadTask::initializeFile() {
-    // Create destination directory if it doesn't exist
-    if (!dm::utils::FileUtils::createDirectory(destinationPath_)) {
-        return false;
+std::vector<SegmentRange> DownloadTask::getRemainingRanges() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    
+    // Staged data does not outlive the session, such a download starts over
+    if (!supportsResume_ || fileSize_ <= 0 || (outputFile_ && outputFile_->isStaged())) {
+        return {};
     }
     
-    // If destination path doesn't end with a separator, add one
-    std::string fullPath = destinationPath_;
-    if (!fullPath.empty() && fullPath.back() != '/' && fullPath.back() != '\\') {
-        fullPath += "/";
+    // Not started since it was restored
+    if (segments_.empty()) {
+        return restoredRanges_;
     }
-    fullPath += filename_;
     
-    // Create or truncate the file if it doesn't support resume or if we're starting a new download
-    if (!supportsResume_ || status_ == DownloadStatus::NONE) {
-        std::ofstream file(fullPath, std::ios::binary | std::ios::trunc);
-        if (!file) {
-            return false;
+    std::vector<SegmentRange> ranges;
+    for (const auto& segment : segments_) {
+        if (segment->getStatus() == SegmentStatus::COMPLETED) {
+            continue;
         }
         
-        // If file size is known, pre-allocate space
-        if (fileSize_ > 0) {
-            file.seekp(fileSize_ - 1);
-            file.put(0);
+        SegmentRange range;
+        range.startByte = segment->getSavedPosition();
+        range.endByte = segment->getEndByte();
+        if (range.startByte <= range.endByte) {
+            ranges.push_back(range);
         }
-        
-        file.close();
     }
     
-    return true;
+    // Pieces of a split file other nodes have not finished yet are missing too
+    for (size_t i = 0; i < clusterPieces_.size(); i++) {
+        if (clusterPieces_[i] == ClusterLeaseState::HELD) {
+            int64_t startByte = static_cast<int64_t>(i) * clusterPieceSize_;
+            for (const auto& range : clipRanges(clusterMissing_, startByte,
+                                                std::min(fileSize_, startByte + clusterPieceSize_) - 1)) {
+                ranges.push_back(range);
+            }
+        }
+    }
+    
+    return ranges;
 }
 
-bool DownloadTask::createSegments() {
-    std::lock_guard<std::mutex> lock(mutex_);
+bool DownloadTask::commitRanges(std::vector<SegmentRange>& ranges) {
+    std::shared_ptr<OutputFile> file;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        ranges = getRemainingRanges();
+        file = outputFile_;
+    }
     
-    // Clear existing segments
-    segments_.clear();
+    // Restored ranges describe data synced by an earlier session
+    if (ranges.empty() || !file || !file->isOpen()) {
+        return true;
+    }
     
-    // If file size is unknown or no range support, use a single segment
-    if (fileSize_ <= 0 || !supportsResume_ || segmentCount_ <= 1) {
-        auto segment = std::make_shared<SegmentDownloader>(
-            url_,
-            destinationPath_ + "/" + filename_,
-            0,
-            fileSize_ - 1,
-            0
-        );
-        
-        segment->setMaxRetries(segmentMaxRetries_);
-        
-        // Set callbacks
-        segment->setCompletionCallback(std::bind(&DownloadTask::onSegmentCompleted, this, std::placeholders::_1));
-        segment->setErrorCallback(std::bind(&DownloadTask::onSegmentError, this, std::placeholders::_1, std::placeholders::_2));
-        
-        segments_.push_back(segment);
-    } else {
-        // Calculate segment size
-        int64_t segmentSize = fileSize_ / segmentCount_;
-        
-        // Create segments
-        for (int i = 0; i < segmentCount_; i++) {
-            int64_t startByte = i * segmentSize;
-            int64_t endByte;
-            
-            if (i == segmentCount_ - 1) {
-                endByte = fileSize_ - 1;  // Last segment gets all remaining bytes
-            } else {
-                endByte = (i + 1) * segmentSize - 1;
-            }
-            
-            auto segment = std::make_shared<SegmentDownloader>(
-                url_,
-                destinationPath_ + "/" + filename_,
-                startByte,
-                endByte,
-                i
-            );
-            
-            segment->setMaxRetries(segmentMaxRetries_);
-            
-            // Set callbacks
-            segment->setCompletionCallback(std::bind(&DownloadTask::onSegmentCompleted, this, std::placeholders::_1));
-            segment->setErrorCallback(std::bind(&DownloadTask::onSegmentError, this, std::placeholders::_1, std::placeholders::_2));
-            
-            segments_.push_back(segment);
-        }
+    // Sync without the task lock, segments keep writing meanwhile
+    if (!file->sync()) {
+        dm::utils::Logger::warning("Failed to sync " + file->getPath() + " for a progress checkpoint");
+        return false;
     }
     
     return true;
 }
 
-bool DownloadTask::createMetadataFile() {
-    // Create metadata file path
-    std::string metadataPath = destinationPath_ + "/" + filename_ + ".meta";
+bool DownloadTask::restore(const std::string& id, int64_t fileSize, bool supportsResume,
+                           DownloadStatus status, const std::vector<SegmentRange>& ranges) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     
-    // Open file for writing
-    std::ofstream file(metadataPath, std::ios::binary | std::ios::trunc);
-    if (!file) {
+    if (status_ != DownloadStatus::NONE) {
         return false;
     }
     
-    // Write metadata
-    file << "id=" << id_ << std::endl;
-    file << "url=" << url_ << std::endl;
-    file << "file_size=" << fileSize_ << std::endl;
-    file << "supports_resume=" << (supportsResume_ ? "true" : "false") << std::endl;
-    file << "segment_count=" << segmentCount_ << std::endl;
+    id_ = id;
     
-    // Add timestamp
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    file << "timestamp=" << time << std::endl;
+    // Finished, failed and canceled downloads keep their status but are not picked up again
+    if (status == DownloadStatus::COMPLETED || status == DownloadStatus::DOWNLOAD_ERROR ||
+        status == DownloadStatus::CANCELED) {
+        fileSize_ = fileSize;
+        supportsResume_ = supportsResume;
+        if (status == DownloadStatus::COMPLETED && fileSize > 0) {
+            progressInfo_.totalBytes = fileSize;
+            progressInfo_.downloadedBytes = fileSize;
+            progressInfo_.progressPercent = 100.0;
+            progressSnapshot_.store(progressInfo_);
+        }
+        setStatus(status);
+        return true;
+    }
+    if (status != DownloadStatus::QUEUED && status != DownloadStatus::CONNECTING &&
+        status != DownloadStatus::DOWNLOADING && status != DownloadStatus::PAUSED) {
+        return false;
+    }
     
-    file.close();
-    return true;
-}
-
-bool DownloadTask::loadMetadata() {
-    // Not implemented in this version
-    return false;
-}
-
-void DownloadTask::setStatus(DownloadStatus status) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    DownloadStatus oldStatus = status_;
-    status_ = status;
-    // Log status change
-    dm::utils::Logger::info("Download status changed: " + url_ + " -> " + std::to_string(static_cast<int>(status)));
-    // Call status change callback if provided
-    if (statusChangeCallback_ && oldStatus != status) {
-        statusChangeCallback_(shared_from_this(), oldStatus, status);
+    // Without the partial file or range support there is nothing to continue
+    std::string filePath = destinationPath_ + "/" + filename_;
+    if (!supportsResume || fileSize <= 0 || ranges.empty() || !dm::utils::FileUtils::fileExists(filePath)) {
+        return false;
     }
-}
-
-void DownloadTask::onTaskCompleted() {
-    // Set status to completed
-    setStatus(DownloadStatus::COMPLETED);
     
-    // Update progress to 100%
-    progressInfo_.downloadedBytes = fileSize_;
-    progressInfo_.progressPercent = 100.0;
-    progressInfo_.downloadSpeed = 0.0;
-    progressInfo_.timeRemaining = 0;
+    for (const auto& range : ranges) {
+        if (range.startByte < 0 || range.startByte > range.endByte || range.endByte >= fileSize) {
+            return false;
+        }
+    }
     
-    // Call progress callback if provided
-    if (progressCallback_) {
-        progressCallback_(progressInfo_);
+    fileSize_ = fileSize;
+    supportsResume_ = true;
+    restoredRanges_ = ranges;
+    
+    int64_t missing = 0;
+    for (const auto& range : ranges) {
+        missing += range.endByte + 1 - range.startByte;
     }
+    progressInfo_.totalBytes = fileSize_;
+    progressInfo_.downloadedBytes = std::max<int64_t>(0, fileSize_ - missing);
+    progressInfo_.progressPercent = static_cast<double>(progressInfo_.downloadedBytes) / fileSize_ * 100.0;
+    progressSnapshot_.store(progressInfo_);
     
-    // Log completion
-    dm::utils::Logger::info("Download completed: " + url_ + " -> " + 
-                          destinationPath_ + "/" + filename_);
+    setStatus(status == DownloadStatus::PAUSED ? DownloadStatus::PAUSED : DownloadStatus::QUEUED);
+    return true;
 }
 
-void DownloadTask::onSegmentCompleted(std::shared_ptr<SegmentDownloader> segment) {
-    // Log segment completion
-    dm::utils::Logger::debug("Segment completed: " + std::to_string(segment->getId()) + 
-                           " of download " + id_);
+void DownloadTask::probeServer() {
+    // A file downloaded before is only fetched again if the server changed it;
+    // the probe leaves through the proxy the segments will use
+    std::string proxy = ProxyPool::getInstance().pick(id_);
+    HttpClient client;
+    client.setProxy(proxy);
+    CachedValidators cached;
+    bool conditional = revalidate_ && !HttpClient::isFtpUrl(url_) && findCachedCopy(cached);
+    if (conditional) {
+        if (!cached.etag.empty()) {
+            client.setHeader("If-None-Match", cached.etag);
+        }
+        if (!cached.lastModified.empty()) {
+            client.setHeader("If-Modified-Since", cached.lastModified);
+        }
+    }
+    // A probe sent while the download was queued saves the round trips
+    HttpResponse response;
+    if (conditional || !MetadataPrefetcher::getInstance().take(url_, proxy, response)) {
+        response = client.probe(url_);
+    } else {
+        dm::utils::Logger::debug("Download " + url_ + " starts from its prefetched probe");
+    }
+    
+    if (conditional && response.statusCode == 304) {
+        std::string filePath = destinationPath_ + "/" + filename_;
+        if (cached.filePath == filePath || dm::utils::FileUtils::copyFile(cached.filePath, filePath)) {
+            if (cached.filePath != filePath && !cached.lastModified.empty()) {
+                time_t modified = curl_getdate(cached.lastModified.c_str(), nullptr);
+                if (modified > 0) {
+                    dm::utils::FileUtils::setModificationTime(filePath, static_cast<int64_t>(modified));
+                }
+            }
+            upToDate_ = true;
+            fileSize_ = static_cast<int64_t>(cached.fileSize);
+            etag_ = cached.etag;
+            lastModified_ = cached.lastModified;
+            ValidatorCache::getInstance().record(url_, filePath, etag_, lastModified_,
+                                                 cached.hashAlgorithm, cached.hash);
+            return;
+        }
+        
+        // The copy could not be put in place, fetch the file after all
+        dm::utils::Logger::warning("Failed to copy " + cached.filePath + " to " + filePath);
+        response = HttpClient().setProxy(proxy).probe(url_);
+    }
+    
+    supportsResume_ = response.success && response.acceptsRanges;
+    fileSize_ = response.success ? response.contentLength : -1;
+    etag_ = response.etag;
+    lastModified_ = response.lastModified;
+
+    // A digest the server sends checks the file when nobody gave a hash;
+    // it is taken again should the file have changed since
+    dm::utils::HashAlgorithm digestAlgorithm;
+    if (response.success && (expectedHash_.empty() || serverDigest_) && !response.digest.empty() &&
+        dm::utils::HashCalculator::parseAlgorithm(response.digestAlgorithm, digestAlgorithm)) {
+        setExpectedHash(digestAlgorithm, response.digest);
+        serverDigest_ = true;
+        dm::utils::Logger::debug("Download " + url_ + " is checked against the " + response.digestAlgorithm +
+                                 " digest of its server");
+    }
+
+    // Segments go straight to the final location instead of each
+    // following the redirects again
+    Source& primary = sources_[0];
+    primary.resolvedUrl.clear();
+    primary.etag = response.etag;
+    if (response.success && !response.effectiveUrl.empty() && response.effectiveUrl != url_) {
+        primary.resolvedUrl = response.effectiveUrl;
+        dm::utils::Logger::debug("Download " + url_ + " redirects to " + primary.resolvedUrl);
+    }
+    
+    if (response.success) {
+        addPeerSources();
+    }
+    if (sources_.size() > 1 || expectedSize_ >= 0) {
+        probeMirrors(response);
+    }
+}
+
+bool DownloadTask::findCachedCopy(CachedValidators& cached) {
+    if (!ValidatorCache::getInstance().find(url_, cached)) {
+        return false;
+    }
+    
+    std::string filePath = destinationPath_ + "/" + filename_;
+    if (cached.filePath == filePath) {
+        return true;
+    }
+    
+    // A copy kept elsewhere must still hash to what was downloaded and not replace another file
+    if (cached.hash.empty() || dm::utils::FileUtils::fileExists(filePath)) {
+        return false;
+    }
+    dm::utils::HashCalculator calculator;
+    return calculator.calculateHashCached(cached.filePath, cached.hashAlgorithm) == cached.hash;
+}
+
+bool DownloadTask::placeStoredCopy() {
+    if (checksumSidecar_ && expectedHash_.empty()) {
+        fetchChecksumSidecar();
+    }
+    
+    ContentStore& store = ContentStore::getInstance();
+    if (expectedHash_.empty() || !store.isEnabled()) {
+        return false;
+    }
+    
+    // Never replaces a file
+    std::string filePath = destinationPath_ + "/" + filename_;
+    if (dm::utils::FileUtils::fileExists(filePath) || !dm::utils::FileUtils::createDirectory(destinationPath_) ||
+        !store.place(streamingHashAlgorithm_, expectedHash_, filePath)) {
+        return false;
+    }
+    
+    upToDate_ = true;
+    fileSize_ = dm::utils::FileUtils::getFileSize(filePath);
+    return true;
+}
+
+void DownloadTask::fetchChecksumSidecar() {
+    // The sidecar sits next to the file, the query string stays last
+    size_t query = url_.find_first_of("?#");
+    std::string sidecarUrl = query == std::string::npos ? url_ + ".sha256" :
+                             url_.substr(0, query) + ".sha256" + url_.substr(query);
+    HttpResponse response = HttpClient().setProxy(ProxyPool::getInstance().pick(id_)).get(sidecarUrl);
+    if (!response.success || response.statusCode != 200) {
+        return;
+    }
+    
+    // The bare hash, or "<hash>  <filename>" as written by sha256sum
+    std::string body(response.body.begin(), response.body.end());
+    std::string hash = body.substr(0, body.find_first_of(" \t\r\n"));
+    if (hash.size() != 64 || !std::all_of(hash.begin(), hash.end(), [](unsigned char c) { return std::isxdigit(c); })) {
+        dm::utils::Logger::debug("Ignoring malformed checksum sidecar: " + sidecarUrl);
+        return;
+    }
+    
+    dm::utils::Logger::debug("Expecting SHA256 " + hash + " for " + url_ + " from its sidecar");
+    setExpectedHash(dm::utils::HashAlgorithm::SHA256, hash);
+}
+
+void DownloadTask::addPeerSources() {
+    PeerCache& peers = PeerCache::getInstance();
+    if (!peers.isEnabled() || !supportsResume_ || fileSize_ < PeerCache::MIN_SHARED_SIZE) {
+        return;
+    }
+
+    // Any host on the LAN can answer, its bytes are taken only if checked
+    bool checkedPieces = pieces_.published &&
+                         pieces_.hashes.size() == PieceMap::countPieces(fileSize_, pieces_.pieceSize);
+    if (expectedHash_.empty() && !checkedPieces) {
+        return;
+    }
+    
+    // The hash names the bytes under any URL, the ETag only under this one
+    std::string key = expectedHash_.empty() ? PeerCache::makeUrlKey(url_, etag_) :
+                      PeerCache::makeHashKey(streamingHashAlgorithm_, expectedHash_);
+    for (const auto& url : peers.getSourceUrls(key)) {
+        Source source;
+        source.url = url;
+        source.peer = true;
+        sources_.push_back(source);
+    }
+}
+
+void DownloadTask::probeMirrors(const HttpResponse& primary) {
+    // Probe the mirrors side by side, a slow one delays the start only by
+    // itself; a long Metalink list is worked through by a few threads
+    std::vector<HttpResponse> responses(sources_.size());
+    responses[0] = primary;
+    std::vector<Source> sources = sources_;
+    std::string proxy = ProxyPool::getInstance().pick(id_);
+    std::atomic<size_t> nextProbe{1};
+    auto probe = [&sources, &responses, &nextProbe, &proxy]() {
+        for (size_t i = nextProbe++; i < sources.size(); i = nextProbe++) {
+            HttpClient client;
+            if (sources[i].peer) {
+                client.setTimeout(PeerCache::PROBE_TIMEOUT_SECONDS);
+            } else {
+                client.setProxy(proxy);
+            }
+            responses[i] = client.probe(sources[i].url);
+        }
+    };
+    
+    size_t threads = std::min(MAX_CONCURRENT_PROBES, sources.size() - 1);
+    std::vector<std::thread> probes;
+    try {
+        while (probes.size() < threads) {
+            probes.emplace_back(probe);
+        }
+    } catch (const std::system_error& e) {
+        // The threads already started probe the rest
+        dm::utils::Logger::warning("Probing the sources of download " + id_ + " on fewer threads: " + e.what());
+    }
+    if (probes.empty()) {
+        probe();
+    }
+    for (auto& thread : probes) {
+        thread.join();
+    }
+    
+    // The first source with the expected size describes the file
+    size_t reference = sources_.size();
+    for (size_t i = 0; i < sources_.size(); i++) {
+        const HttpResponse& response = responses[i];
+        if (response.success && response.contentLength >= 0 &&
+            (expectedSize_ < 0 || response.contentLength == expectedSize_)) {
+            reference = i;
+            break;
+        }
+    }
+    if (reference == sources_.size()) {
+        for (auto& source : sources_) {
+            source.usable = false;
+        }
+        dm::utils::Logger::error("No source of download " + id_ + " reports the expected file");
+        return;
+    }
+    
+    const HttpResponse& file = responses[reference];
+    supportsResume_ = file.acceptsRanges;
+    fileSize_ = file.contentLength;
+    etag_ = file.etag;
+    lastModified_ = file.lastModified;
+    std::string referenceHost = dm::utils::UrlParser::extractDomain(sources_[reference].url);
+    
+    for (size_t i = 0; i < sources_.size(); i++) {
+        Source& source = sources_[i];
+        const HttpResponse& response = responses[i];
+        source.etag = response.etag;
+        if (i > 0) {
+            source.resolvedUrl.clear();
+            if (response.success && !response.effectiveUrl.empty() && response.effectiveUrl != source.url) {
+                source.resolvedUrl = response.effectiveUrl;
+            }
+        }
+        
+        // ETags are only comparable between URLs on the same server
+        std::string problem;
+        if (i == reference) {
+            problem.clear();
+        } else if (!response.success) {
+            problem = response.error.empty() ? "status " + std::to_string(response.statusCode) : response.error;
+        } else if (response.contentLength != fileSize_) {
+            problem = "size " + std::to_string(response.contentLength) + " instead of " + std::to_string(fileSize_);
+        } else if (!supportsResume_ || !response.acceptsRanges) {
+            problem = "no range support";
+        } else if (!etag_.empty() && !response.etag.empty() && response.etag != etag_ &&
+                   dm::utils::UrlParser::extractDomain(source.url) == referenceHost) {
+            problem = "ETag " + response.etag + " instead of " + etag_;
+        }
+        
+        // Most peers asked do not have the file
+        source.usable = problem.empty();
+        if (!source.usable && source.peer) {
+            dm::utils::Logger::debug("Peer " + source.url + " cannot serve download " + id_ + ": " + problem);
+        } else if (!source.usable) {
+            dm::utils::Logger::warning("Not using " + source.url + " for download " + id_ + ": " + problem);
+        } else if (source.peer) {
+            dm::utils::Logger::info("Download " + id_ + " is served by peer " + source.url);
+        }
+    }
+}
+
+size_t DownloadTask::pickSource() const {
+    if (sources_.size() == 1) {
+        return 0;
+    }
+    
+    // Sources not measured yet are taken to be as fast as the average one
+    double measuredSpeed = 0.0;
+    int measured = 0;
+    for (const auto& source : sources_) {
+        if (source.usable && source.speed > 0.0) {
+            measuredSpeed += source.speed;
+            measured++;
+        }
+    }
+    double assumedSpeed = measured > 0 ? measuredSpeed / measured : 1.0;
+    
+    // Segments per source follow the source's share of the throughput;
+    // peers on the LAN take them all while one of them is usable
+    bool peers = std::any_of(sources_.begin(), sources_.end(),
+                             [](const Source& source) { return source.usable && source.peer; });
+    std::vector<int> segments = countSourceSegments(false);
+    size_t best = 0;
+    double bestLoad = 0.0;
+    bool found = false;
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if (!sources_[i].usable || (peers && !sources_[i].peer)) {
+            continue;
+        }
+        double speed = sources_[i].speed > 0.0 ? sources_[i].speed : assumedSpeed;
+        double load = (segments[i] + 1) / speed;
+        if (!found || load < bestLoad) {
+            best = i;
+            bestLoad = load;
+            found = true;
+        }
+    }
+    
+    return best;
+}
+
+std::vector<int> DownloadTask::countSourceSegments(bool downloadingOnly) const {
+    std::vector<int> counts(sources_.size(), 0);
+    for (const auto& segment : segments_) {
+        SegmentStatus status = segment->getStatus();
+        bool counted = downloadingOnly ? status == SegmentStatus::DOWNLOADING :
+                       status != SegmentStatus::COMPLETED && status != SegmentStatus::SEGMENT_ERROR;
+        auto it = segmentSources_.find(segment->getId());
+        if (counted && it != segmentSources_.end()) {
+            counts[it->second]++;
+        }
+    }
+    return counts;
+}
+
+void DownloadTask::updateSources() {
+    if (sources_.size() < 2) {
+        return;
+    }
+    
+    // Measure each source from the bytes its segments moved since the last sample
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - lastSourceSample_).count();
+    if (elapsed < 0.5) {
+        return;
+    }
+    lastSourceSample_ = now;
+    
+    std::vector<int64_t> bytes(sources_.size(), 0);
+    std::vector<int> active(sources_.size(), 0);
+    for (const auto& segment : segments_) {
+        auto it = segmentSources_.find(segment->getId());
+        if (it == segmentSources_.end()) {
+            continue;
+        }
+        int64_t downloaded = segment->getDownloadedBytes();
+        auto last = segmentBytes_.find(segment->getId());
+        if (last != segmentBytes_.end()) {
+            bytes[it->second] += std::max<int64_t>(0, downloaded - last->second);
+        }
+        segmentBytes_[segment->getId()] = downloaded;
+        if (segment->getStatus() == SegmentStatus::DOWNLOADING) {
+            active[it->second]++;
+        }
+    }
+    for (size_t i = 0; i < sources_.size(); i++) {
+        Source& source = sources_[i];
+        double speed = bytes[i] / elapsed;
+        if (active[i] == 0) {
+            source.measuring = false;
+        } else if (!source.measuring) {
+            source.measuring = true;
+            source.measuredSince = now;
+            source.speed = speed;
+        } else {
+            source.speed = SOURCE_SPEED_SMOOTHING * speed + (1.0 - SOURCE_SPEED_SMOOTHING) * source.speed;
+        }
+    }
+    
+    if (now - lastSourceCheck_ < std::chrono::seconds(SOURCE_CHECK_INTERVAL_SECONDS)) {
+        return;
+    }
+    lastSourceCheck_ = now;
+    
+    // Compare per segment, a source serving fewer segments is not slower for it
+    double fastest = 0.0;
+    int usable = 0;
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if (sources_[i].usable) {
+            usable++;
+            if (active[i] > 0) {
+                fastest = std::max(fastest, sources_[i].speed / active[i]);
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < sources_.size() && usable > 1; i++) {
+        const Source& source = sources_[i];
+        if (!source.usable || active[i] == 0 ||
+            now - source.measuredSince < std::chrono::seconds(SOURCE_GRACE_SECONDS)) {
+            continue;
+        }
+        if (source.speed / active[i] < fastest * SLOW_SOURCE_RATIO) {
+            std::ostringstream reason;
+            reason << "too slow (" << static_cast<int64_t>(source.speed / active[i]) << " B/s per segment, fastest "
+                   << static_cast<int64_t>(fastest) << ")";
+            dropSource(i, reason.str());
+            usable--;
+        }
+    }
+}
+
+void DownloadTask::dropSource(size_t index, const std::string& reason) {
+    sources_[index].usable = false;
+    dm::utils::Logger::warning("Dropping source " + sources_[index].url + " of download " + id_ + ": " + reason);
+    
+    // Segments not started yet are simply made again for another source
+    for (auto& segment : segments_) {
+        auto it = segmentSources_.find(segment->getId());
+        if (it != segmentSources_.end() && it->second == index && segment->getStatus() == SegmentStatus::NONE) {
+            segmentSources_.erase(it);
+            segment = makeSegment(segment->getStartByte(), segment->getEndByte(), segment->getId());
+        }
+    }
+    
+    // Downloading ones keep a page and hand the rest over
+    std::vector<std::shared_ptr<SegmentDownloader>> victims;
+    for (auto& segment : segments_) {
+        auto it = segmentSources_.find(segment->getId());
+        if (it != segmentSources_.end() && it->second == index && segment->getStatus() == SegmentStatus::DOWNLOADING) {
+            victims.push_back(segment);
+        }
+    }
+    for (auto& victim : victims) {
+        auto segment = splitSegment(victim, static_cast<int64_t>(OutputFile::getAlignment()));
+        if (segment && status_ == DownloadStatus::DOWNLOADING) {
+            startSegment(segment);
+        }
+    }
+}
+
+void DownloadTask::createPieceVerifier() {
+    // A restart keeps what the last run hashed
+    if (pieceVerifier_) {
+        pieces_ = pieceVerifier_->getPieceMap();
+        pieceVerifier_ = nullptr;
+    }
+    pieceRepairs_.clear();
+    if (fileSize_ <= 0 || !supportsResume_) {
+        return;
+    }
+
+    if (!pieces_.empty() && pieces_.hashes.size() != PieceMap::countPieces(fileSize_, pieces_.pieceSize)) {
+        if (pieces_.published) {
+            dm::utils::Logger::warning("Ignoring the piece hashes of download " + id_ + ": " +
+                                       std::to_string(pieces_.hashes.size()) + " pieces of " +
+                                       std::to_string(pieces_.pieceSize) + " bytes do not cover " +
+                                       std::to_string(fileSize_) + " bytes");
+        }
+        pieces_ = PieceMap();
+    }
+
+    // Hashes taken here only describe data the file keeps
+    if (!pieces_.published && (pieces_.empty() || restoredRanges_.empty() || pieceHashSize_ <= 0)) {
+        pieces_ = PieceMap();
+        if (pieceHashSize_ > 0) {
+            pieces_.pieceSize = pieceHashSize_;
+            pieces_.hashes.resize(PieceMap::countPieces(fileSize_, pieceHashSize_));
+        }
+    }
+    if (pieces_.empty()) {
+        return;
+    }
+
+    std::vector<SegmentRange> missing = restoredRanges_;
+    if (missing.empty()) {
+        SegmentRange whole;
+        whole.startByte = 0;
+        whole.endByte = fileSize_ - 1;
+        missing.push_back(whole);
+    }
+    pieceVerifier_ = std::make_shared<PieceVerifier>(pieces_, fileSize_, missing);
+}
+
+bool DownloadTask::repairPieces(const std::vector<size_t>& failed) {
+    for (size_t index : failed) {
+        SegmentRange piece = pieceVerifier_->getPieceRange(index);
+        int& repairs = pieceRepairs_[index];
+        if (repairs >= MAX_PIECE_REPAIRS) {
+            error_ = "Piece " + std::to_string(index) + " still fails verification after " +
+                     std::to_string(repairs) + " attempts";
+            dm::utils::Logger::error("Download " + url_ + " failed verification: " + error_);
+            setStatus(DownloadStatus::DOWNLOAD_ERROR);
+            return false;
+        }
+        repairs++;
+        repairedPieces_++;
+
+        // Blame the sources whose segments wrote it
+        for (const auto& segment : segments_) {
+            auto source = segmentSources_.find(segment->getId());
+            if (source != segmentSources_.end() && segment->getStartByte() <= piece.endByte &&
+                segment->getEndByte() >= piece.startByte) {
+                sources_[source->second].corruptPieces++;
+            }
+        }
+
+        // The piece counts as missing again until its new segment has it
+        pieceVerifier_->refetch(index);
+        restoredBytes_ -= piece.endByte + 1 - piece.startByte;
+        segments_.push_back(makeSegment(piece.startByte, piece.endByte, nextSegmentId_++));
+
+        std::ostringstream log;
+        log << "Fetching piece " << index << " [" << piece.startByte << "-" << piece.endByte
+            << "] of download " << id_ << " again";
+        dm::utils::Logger::info(log.str());
+    }
+
+    // A source that keeps serving corrupt data goes, its waiting repairs with it
+    for (size_t i = 0; i < sources_.size(); i++) {
+        bool otherSource = false;
+        for (size_t j = 0; j < sources_.size(); j++) {
+            otherSource = otherSource || (j != i && sources_[j].usable);
+        }
+        if (sources_[i].usable && otherSource && sources_[i].corruptPieces >= MAX_PIECE_REPAIRS) {
+            dropSource(i, std::to_string(sources_[i].corruptPieces) + " corrupt pieces");
+        }
+    }
+
+    // The whole-file hash, the sample and the plugins took in the corrupt
+    // data; each reads what it did not see later back from disk at the end
+    if (hasher_) {
+        hasher_->restart();
+    }
+    if (sniffer_) {
+        for (size_t index : failed) {
+            SegmentRange piece = pieceVerifier_->getPieceRange(index);
+            sniffer_->discard(piece.startByte, piece.endByte + 1);
+        }
+    }
+    if (filters_) {
+        openFilters();
+    }
+
+    scheduleSegments();
+    return true;
+}
+
+void DownloadTask::openFilters() {
+    std::shared_ptr<DataFilterChain> abandoned = filters_;
+    DataFilterContext filterContext;
+    filterContext.url = url_;
+    filterContext.filePath = outputFile_->getPath();
+    filterContext.totalSize = fileSize_;
+    filters_ = DataFilterRegistry::getInstance().openChain(filterContext);
+    outputFile_->setFilters(filters_);
+    if (abandoned) {
+        abandoned->abandon();
+    }
+}
+
+bool DownloadTask::checkPieces() {
+    if (!pieceVerifier_) {
+        return true;
+    }
+    std::vector<size_t> failed = pieceVerifier_->takeFailed();
+    return failed.empty() || repairPieces(failed);
+}
+
+bool DownloadTask::isSmallFile() const {
+    // Readers of a streamed file need its head on disk early
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return smallFileThreshold_ > 0 && fileSize_ <= smallFileThreshold_ &&
+           !streamingPriority_ && restoredRanges_.empty();
+}
+
+bool DownloadTask::initializeFile() {
+    // Create destination directory if it doesn't exist
+    if (!dm::utils::FileUtils::createDirectory(destinationPath_)) {
+        return false;
+    }
+    
+    // If destination path doesn't end with a separator, add one
+    std::string fullPath = destinationPath_;
+    if (!fullPath.empty() && fullPath.back() != '/' && fullPath.back() != '\\') {
+        fullPath += "/";
+    }
+    fullPath += filename_;
+    
+    // Create or truncate the file if it doesn't support resume or if we're starting a new download,
+    // reserving the whole size now so a full disk is reported before any segment starts;
+    // a staged file is created only once complete, a split file by only one node
+    bool create = joinCluster(fullPath);
+    if (create && !isSmallFile() && (!supportsResume_ || status_ == DownloadStatus::NONE)) {
+        if (!dm::utils::FileUtils::preallocateFile(fullPath, fileSize_)) {
+            return false;
+        }
+    }
+    if (create && !clusterKey_.empty()) {
+        ClusterCoordinator::getInstance().markFileReady(clusterKey_);
+    }
+    
+    return true;
+}
+
+bool DownloadTask::createSegments() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    
+    // Clear existing segments
+    segments_.clear();
+    segmentSources_.clear();
+    retiredSegments_.clear();
+    segmentBytes_.clear();
+    lastSourceSample_ = std::chrono::steady_clock::now();
+    lastSourceCheck_ = lastSourceSample_;
+    
+    // Open the output file once for all segments
+    if (!outputFile_) {
+        outputFile_ = std::make_shared<OutputFile>();
+    }
+    std::string filePath = destinationPath_ + "/" + filename_;
+    
+    // A restored download was not initialized, the file is there already
+    if (clusterKey_.empty() && joinCluster(filePath) && !clusterKey_.empty()) {
+        ClusterCoordinator::getInstance().markFileReady(clusterKey_);
+    }
+    
+    bool opened;
+    if (isSmallFile()) {
+        // Of unknown size, it moves to the file if it outgrows the threshold
+        opened = outputFile_->openStaged(filePath, static_cast<size_t>(fileSize_ > 0 ? fileSize_ : smallFileThreshold_),
+                                         fileSize_ <= 0);
+    } else {
+        opened = outputFile_->open(filePath, directIo_);
+    }
+    if (!opened) {
+        return false;
+    }
+    
+    // Start a fresh digest, data from earlier runs is read back at the end
+    hasher_ = streamingHash_ ? std::make_shared<StreamingHasher>(streamingHashAlgorithm_) : nullptr;
+    outputFile_->setHasher(hasher_);
+    createPieceVerifier();
+    outputFile_->setPieceVerifier(pieceVerifier_);
+    
+    // Post-processors read the file's ends from here, not from disk
+    sniffer_ = std::make_shared<ContentSniffer>();
+    outputFile_->setSniffer(sniffer_);
+    
+    // Plugins see the data as it lands, a restart opens their sessions again
+    openFilters();
+    
+    // Buffers are reused across restarts of this task, staged data is copied once into its slab
+    if (!writeBufferPool_ && writeBufferSize_ > 0 && !outputFile_->isStaged()) {
+        writeBufferPool_ = std::make_shared<WriteBufferPool>(writeBufferSize_);
+    }
+    
+    // Adaptive downloads start small, or at what was learned for this host
+    int count = segmentCount_;
+    if (adaptiveSegments_) {
+        int learned = HostConnectionCache::getInstance().getConnectionCount(url_);
+        count = std::min(segmentCount_, learned > 0 ? learned : INITIAL_ADAPTIVE_SEGMENTS);
+        adaptSettled_ = learned > 0;
+        adaptSpeed_ = 0.0;
+        lastAdaptTime_ = std::chrono::steady_clock::now();
+    }
+    
+    // Continue a restored download with the ranges it was missing
+    restoredBytes_ = 0;
+    abandonClusterWork();
+    clusterPieces_.clear();
+    if (!clusterKey_.empty()) {
+        // Split across nodes, the missing ranges are leased piece by piece
+        // as connections free up; pieces nothing is missing from are done
+        clusterMissing_ = restoredRanges_;
+        if (clusterMissing_.empty()) {
+            SegmentRange whole;
+            whole.startByte = 0;
+            whole.endByte = fileSize_ - 1;
+            clusterMissing_.push_back(whole);
+        }
+        restoredRanges_.clear();
+        restoredBytes_ = fileSize_ - countBytes(clusterMissing_);
+        
+        // Those already on disk are handed over like pieces just fetched
+        clusterPieceSize_ = ClusterCoordinator::getInstance().getPieceSize();
+        clusterPieces_.assign(static_cast<size_t>((fileSize_ + clusterPieceSize_ - 1) / clusterPieceSize_),
+                              ClusterLeaseState::HELD);
+        for (size_t i = 0; i < clusterPieces_.size(); i++) {
+            int64_t startByte = static_cast<int64_t>(i) * clusterPieceSize_;
+            if (clipRanges(clusterMissing_, startByte, std::min(fileSize_, startByte + clusterPieceSize_) - 1).empty()) {
+                clusterPieces_[i] = ClusterLeaseState::ACQUIRED;
+            }
+        }
+        
+        targetConnections_ = count;
+        clusterPolledAt_ = std::chrono::steady_clock::time_point();
+        advanceCluster();
+    } else if (!restoredRanges_.empty() && fileSize_ > 0 && supportsResume_) {
+        restoredBytes_ = fileSize_;
+        for (const auto& range : restoredRanges_) {
+            segments_.push_back(makeSegment(range.startByte, range.endByte, static_cast<int>(segments_.size())));
+            restoredBytes_ -= range.endByte + 1 - range.startByte;
+        }
+        restoredRanges_.clear();
+        targetConnections_ = static_cast<int>(segments_.size());
+    } else if (fileSize_ <= 0 || !supportsResume_ || count <= 1) {
+        // If file size is unknown or no range support, use a single segment
+        segments_.push_back(makeSegment(0, fileSize_ - 1, 0));
+        targetConnections_ = 1;
+    } else {
+        // Calculate segment size; streaming keeps the first ones short, the
+        // last one takes the rest and is split as connections free up
+        int64_t segmentSize = fileSize_ / count;
+        if (streamingPriority_) {
+            segmentSize = std::min(segmentSize, std::max(minSplitSize_, STREAMING_WINDOW_SIZE));
+        }
+        
+        // Create segments
+        for (int i = 0; i < count; i++) {
+            int64_t startByte = i * segmentSize;
+            int64_t endByte;
+            
+            if (i == count - 1) {
+                endByte = fileSize_ - 1;  // Last segment gets all remaining bytes
+            } else {
+                endByte = (i + 1) * segmentSize - 1;
+            }
+            
+            segments_.push_back(makeSegment(startByte, endByte, i));
+        }
+        targetConnections_ = count;
+    }
+    
+    nextSegmentId_ = static_cast<int>(segments_.size());
+    
+    return true;
+}
+
+std::shared_ptr<SegmentDownloader> DownloadTask::makeSegment(int64_t startByte, int64_t endByte, int id) {
+    size_t sourceIndex = pickSource();
+    const Source& source = sources_[sourceIndex];
+    segmentSources_[id] = sourceIndex;
+    
+    auto segment = std::make_shared<SegmentDownloader>(
+        source.resolvedUrl.empty() ? source.url : source.resolvedUrl,
+        destinationPath_ + "/" + filename_,
+        startByte,
+        endByte,
+        id
+    );
+    
+    segment->setMaxRetries(segmentMaxRetries_);
+    segment->setResumable(supportsResume_);
+    segment->setTransferMode(transferMode_);
+    
+    // FTP segments each hold a session of their own; the one reaching the
+    // end of the file asks with REST alone so its session survives
+    if (HttpClient::isFtpUrl(source.url)) {
+        segment->setOpenEndedTail(fileSize_ > 0 ? fileSize_ - 1 : -1);
+    } else {
+        segment->setMultiplexing(multiplexing_ && fileSize_ <= MULTIPLEX_MAX_FILE_SIZE);
+    }
+    segment->setThrottler(throttler_);
+    segment->setOutputFile(outputFile_);
+    segment->setWriteBufferPool(writeBufferPool_);
+    
+    // Set callbacks; each holds the task for the call, the manager may let go
+    // of a finished task while its last segment is still reporting in
+    std::weak_ptr<DownloadTask> weakSelf = weak_from_this();
+    segment->setCompletionCallback([weakSelf](std::shared_ptr<SegmentDownloader> segment) {
+        if (auto self = weakSelf.lock()) {
+            self->onSegmentCompleted(segment);
+        }
+    });
+    segment->setErrorCallback([weakSelf](std::shared_ptr<SegmentDownloader> segment, const std::string& error) {
+        if (auto self = weakSelf.lock()) {
+            self->onSegmentError(segment, error);
+        }
+    });
+    segment->setBackoffCallback([weakSelf](std::shared_ptr<SegmentDownloader> segment, int statusCode) {
+        auto self = weakSelf.lock();
+        return self && self->onSegmentBackoff(segment, statusCode);
+    });
+    
+    return segment;
+}
+
+std::shared_ptr<SegmentDownloader> DownloadTask::findSplitCandidate() const {
+    if (!supportsResume_ || fileSize_ <= 0) {
+        return nullptr;
+    }
+    
+    std::shared_ptr<SegmentDownloader> victim;
+    int64_t victimRemaining = 0;
+    for (auto& segment : segments_) {
+        if (segment->getStatus() != SegmentStatus::DOWNLOADING) {
+            continue;
+        }
+        
+        int64_t remaining = segment->getRemainingBytes();
+        if (remaining < 2 * minSplitSize_) {
+            continue;
+        }
+        
+        if (streamingPriority_) {
+            if (!victim || segment->getEndByte() - remaining < victim->getEndByte() - victimRemaining) {
+                victim = segment;
+                victimRemaining = remaining;
+            }
+            continue;
+        }
+        
+        if (!victim || segment->getDownloadSpeed() < victim->getDownloadSpeed() ||
+            (segment->getDownloadSpeed() == victim->getDownloadSpeed() && remaining > victimRemaining)) {
+            victim = segment;
+            victimRemaining = remaining;
+        }
+    }
+    
+    return victim;
+}
+
+std::shared_ptr<SegmentDownloader> DownloadTask::splitSegment(std::shared_ptr<SegmentDownloader> victim, int64_t keepBytes) {
+    int64_t endByte = victim->getEndByte();
+    int64_t position = endByte + 1 - victim->getRemainingBytes();
+    
+    // Start the new segment on a page boundary
+    int64_t splitStart = position + keepBytes;
+    int64_t alignment = static_cast<int64_t>(OutputFile::getAlignment());
+    if (splitStart - splitStart % alignment > position) {
+        splitStart -= splitStart % alignment;
+    }
+    
+    if (splitStart > endByte || !victim->shrinkEnd(splitStart - 1)) {
+        return nullptr;
+    }
+    
+    auto segment = makeSegment(splitStart, endByte, nextSegmentId_++);
+    segments_.push_back(segment);
+    
+    std::ostringstream log;
+    log << "Split segment " << victim->getId() << " of download " << id_ << ", new segment "
+        << segment->getId() << " takes [" << splitStart << "-" << endByte << "]";
+    dm::utils::Logger::debug(log.str());
+    
+    return segment;
+}
+
+int DownloadTask::countActiveSegments() const {
+    int active = 0;
+    for (auto& segment : segments_) {
+        if (segment->getStatus() == SegmentStatus::DOWNLOADING) {
+            active++;
+        }
+    }
+    return active;
+}
+
+void DownloadTask::scheduleSegments() {
+    if (status_ != DownloadStatus::DOWNLOADING) {
+        return;
+    }
+    
+    // Spare connections of a split file take new pieces before splitting segments
+    if (!clusterKey_.empty()) {
+        advanceCluster();
+    }
+    
+    int active = countActiveSegments();
+    bool wasWaiting = waitingForHost_;
+    waitingForHost_ = false;
+    
+    // Parked and not yet started segments hold ranges nobody is fetching
+    std::vector<std::shared_ptr<SegmentDownloader>> waiting;
+    for (auto& segment : segments_) {
+        SegmentStatus status = segment->getStatus();
+        if (status == SegmentStatus::NONE || status == SegmentStatus::PAUSED) {
+            waiting.push_back(segment);
+        }
+    }
+    if (streamingPriority_) {
+        std::sort(waiting.begin(), waiting.end(), [](const auto& a, const auto& b) {
+            return a->getStartByte() < b->getStartByte();
+        });
+    }
+    
+    for (auto& segment : waiting) {
+        if (active >= targetConnections_) {
+            break;
+        }
+        if (startSegment(segment)) {
+            active++;
+        }
+    }
+    
+    // Then let the spare connections steal from the slowest segments, unless
+    // the host has none to give
+    if ((dynamicSplitting_ || adaptiveSegments_ || streamingPriority_) && !waitingForHost_) {
+        while (active < targetConnections_) {
+            auto victim = findSplitCandidate();
+            if (!victim || !HostConnectionLimiter::getInstance().hasCapacity(victim->getUrl())) {
+                break;
+            }
+            
+            // Streaming takes the next window ahead of the foremost segment
+            int64_t keepBytes = victim->getRemainingBytes() / 2;
+            if (streamingPriority_) {
+                keepBytes = std::min(keepBytes, std::max(minSplitSize_, STREAMING_WINDOW_SIZE));
+            }
+            auto segment = splitSegment(victim, keepBytes);
+            if (!segment || !startSegment(segment)) {
+                break;
+            }
+            active++;
+        }
+    }
+    
+    // Nothing is waiting for a connection any more, leave the host's line
+    if (wasWaiting && !waitingForHost_) {
+        HostConnectionLimiter::getInstance().withdraw(id_);
+    }
+}
+
+bool DownloadTask::startSegment(std::shared_ptr<SegmentDownloader> segment) {
+    auto& limiter = HostConnectionLimiter::getInstance();
+    HostConnectionLimiter::Lease lease = limiter.acquire(segment->getUrl(), id_);
+    if (lease == 0) {
+        waitingForHost_ = true;
+        return false;
+    }
+    
+    // Through the pool the connection also needs room on the task's proxy,
+    // peers on the LAN are reached directly
+    auto& proxies = ProxyPool::getInstance();
+    ProxyPool::Lease proxyLease = 0;
+    std::string proxy;
+    auto source = segmentSources_.find(segment->getId());
+    bool peer = source != segmentSources_.end() && sources_[source->second].peer;
+    if (proxies.isEnabled() && !peer) {
+        proxyLease = proxies.acquire(id_, proxy);
+        if (proxyLease == 0) {
+            limiter.release(lease);
+            waitingForHost_ = true;
+            return false;
+        }
+    }
+    segment->setProxy(proxy);
+    
+    if (!segment->start()) {
+        limiter.release(lease);
+        proxies.release(proxyLease);
+        return false;
+    }
+    
+    releaseSegment(segment->getId());
+    segmentLeases_[segment->getId()] = lease;
+    if (proxyLease != 0) {
+        segmentProxyLeases_[segment->getId()] = proxyLease;
+    }
+    return true;
+}
+
+void DownloadTask::releaseSegment(int segmentId) {
+    auto it = segmentLeases_.find(segmentId);
+    if (it != segmentLeases_.end()) {
+        HostConnectionLimiter::getInstance().release(it->second);
+        segmentLeases_.erase(it);
+    }
+    auto proxy = segmentProxyLeases_.find(segmentId);
+    if (proxy != segmentProxyLeases_.end()) {
+        ProxyPool::getInstance().release(proxy->second);
+        segmentProxyLeases_.erase(proxy);
+    }
+}
+
+void DownloadTask::releaseConnections() {
+    for (const auto& lease : segmentLeases_) {
+        HostConnectionLimiter::getInstance().release(lease.second);
+    }
+    segmentLeases_.clear();
+    for (const auto& lease : segmentProxyLeases_) {
+        ProxyPool::getInstance().release(lease.second);
+    }
+    segmentProxyLeases_.clear();
+    
+    if (waitingForHost_) {
+        waitingForHost_ = false;
+        HostConnectionLimiter::getInstance().withdraw(id_);
+    }
+}
+
+bool DownloadTask::joinCluster(const std::string& filePath) {
+    ClusterCoordinator& cluster = ClusterCoordinator::getInstance();
+    if (!cluster.isEnabled() || cluster.getSplitSize() <= 0 || fileSize_ < cluster.getSplitSize() ||
+        !supportsResume_ || streamingPriority_ || isSmallFile()) {
+        clusterKey_.clear();
+        return true;
+    }
+    
+    // Only one node creates the file, the others wait as it would truncate their pieces
+    std::string key = ClusterCoordinator::makeKey("file", url_, filePath);
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::seconds(2 * ClusterCoordinator::FILE_READY_TIMEOUT_SECONDS);
+    ClusterFileState state;
+    while ((state = cluster.joinFile(key)) == ClusterFileState::PREPARING) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            dm::utils::Logger::warning("Cluster file " + filePath + " was never created, downloading it alone");
+            clusterKey_.clear();
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(ClusterCoordinator::POLL_INTERVAL_MS));
+    }
+    
+    clusterKey_ = key;
+    dm::utils::Logger::info("Download " + id_ + " is split across the cluster in pieces of " +
+                            std::to_string(cluster.getPieceSize() / (1024 * 1024)) + " MB" +
+                            (state == ClusterFileState::READY ? ", joining" : ""));
+    return state == ClusterFileState::CREATE;
+}
+
+bool DownloadTask::advanceCluster() {
+    auto pieceEnd = [this](size_t piece) {
+        return std::min(fileSize_, static_cast<int64_t>(piece + 1) * clusterPieceSize_) - 1;
+    };
+    auto allDone = [this]() {
+        return std::all_of(clusterPieces_.begin(), clusterPieces_.end(),
+                           [](ClusterLeaseState state) { return state == ClusterLeaseState::DONE; });
+    };
+    
+    // Take what the cluster's thread did since the last call
+    std::shared_ptr<ClusterHandover> handover = clusterHandover_;
+    std::unique_lock<std::mutex> handoverLock(handover->mutex);
+    for (size_t piece : handover->completed) {
+        if (piece < clusterPieces_.size()) {
+            clusterPieces_[piece] = ClusterLeaseState::DONE;
+        }
+    }
+    for (const auto& answer : handover->answers) {
+        size_t piece = answer.first;
+        if (piece >= clusterPieces_.size() || clusterPieces_[piece] != ClusterLeaseState::HELD) {
+            continue;
+        }
+        std::vector<SegmentRange> missing = clipRanges(clusterMissing_, static_cast<int64_t>(piece) * clusterPieceSize_,
+                                                       pieceEnd(piece));
+        if (answer.second == ClusterLeaseState::ACQUIRED) {
+            for (const auto& range : missing) {
+                segments_.push_back(makeSegment(range.startByte, range.endByte, nextSegmentId_++));
+            }
+            clusterPieces_[piece] = ClusterLeaseState::ACQUIRED;
+        } else if (answer.second == ClusterLeaseState::DONE) {
+            restoredBytes_ += countBytes(missing);
+            clusterPieces_[piece] = ClusterLeaseState::DONE;
+        }
+    }
+    handover->completed.clear();
+    handover->answers.clear();
+    if (handover->busy) {
+        return allDone();
+    }
+    
+    // Hand finished pieces over once their bytes are on the server
+    std::vector<size_t> finished;
+    for (size_t i = 0; i < clusterPieces_.size(); i++) {
+        if (clusterPieces_[i] != ClusterLeaseState::ACQUIRED) {
+            continue;
+        }
+        int64_t startByte = static_cast<int64_t>(i) * clusterPieceSize_;
+        int64_t endByte = pieceEnd(i);
+        if (std::none_of(segments_.begin(), segments_.end(), [startByte, endByte](const auto& segment) {
+                return segment->getStartByte() >= startByte && segment->getStartByte() <= endByte &&
+                       segment->getStatus() != SegmentStatus::COMPLETED;
+            })) {
+            finished.push_back(i);
+        }
+    }
+    
+    // Lease more while connections are spare; a finished piece asks right away
+    int unfinished = 0;
+    for (const auto& segment : segments_) {
+        if (segment->getStatus() != SegmentStatus::COMPLETED) {
+            unfinished++;
+        }
+    }
+    std::vector<size_t> held;
+    auto now = std::chrono::steady_clock::now();
+    if (unfinished < targetConnections_ &&
+        (!finished.empty() || now - clusterPolledAt_ >= std::chrono::milliseconds(ClusterCoordinator::POLL_INTERVAL_MS))) {
+        clusterPolledAt_ = now;
+        for (size_t i = 0; i < clusterPieces_.size(); i++) {
+            if (clusterPieces_[i] == ClusterLeaseState::HELD) {
+                held.push_back(i);
+            }
+        }
+    }
+    if (finished.empty() && held.empty()) {
+        return allDone();
+    }
+    
+    // A full sync on a network mount and the table's lock take their time, off the task lock
+    handover->busy = true;
+    handoverLock.unlock();
+    int spare = targetConnections_ - unfinished;
+    std::shared_ptr<OutputFile> file = outputFile_;
+    std::string fileKey = clusterKey_;
+    std::string name = filename_;
+    ClusterCoordinator::getInstance().post([handover, file, fileKey, name, finished, held, spare]() {
+        ClusterCoordinator& cluster = ClusterCoordinator::getInstance();
+        std::vector<size_t> completed;
+        if (!finished.empty()) {
+            if (!file || !file->sync()) {
+                dm::utils::Logger::warning("Failed to sync " + name + ", its pieces stay leased");
+            } else {
+                for (size_t piece : finished) {
+                    if (cluster.complete(ClusterCoordinator::makePieceKey(fileKey, static_cast<int64_t>(piece)), true)) {
+                        completed.push_back(piece);
+                    }
+                }
+            }
+        }
+        std::vector<std::pair<size_t, ClusterLeaseState>> answers;
+        int acquired = 0;
+        for (size_t i = 0; i < held.size() && acquired < spare; i++) {
+            ClusterLeaseState state = cluster.acquire(ClusterCoordinator::makePieceKey(fileKey, static_cast<int64_t>(held[i])));
+            answers.emplace_back(held[i], state);
+            acquired += state == ClusterLeaseState::ACQUIRED ? 1 : 0;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(handover->mutex);
+            handover->busy = false;
+            if (!handover->abandoned) {
+                handover->completed.insert(handover->completed.end(), completed.begin(), completed.end());
+                handover->answers.insert(handover->answers.end(), answers.begin(), answers.end());
+                return;
+            }
+        }
+        for (const auto& answer : answers) {
+            if (answer.second == ClusterLeaseState::ACQUIRED) {
+                cluster.release(ClusterCoordinator::makePieceKey(fileKey, static_cast<int64_t>(answer.first)));
+            }
+        }
+    });
+    return allDone();
+}
+
+void DownloadTask::abandonClusterWork() {
+    std::vector<std::string> leased;
+    {
+        std::lock_guard<std::mutex> lock(clusterHandover_->mutex);
+        clusterHandover_->abandoned = true;
+        for (const auto& answer : clusterHandover_->answers) {
+            if (answer.second == ClusterLeaseState::ACQUIRED) {
+                leased.push_back(ClusterCoordinator::makePieceKey(clusterKey_, static_cast<int64_t>(answer.first)));
+            }
+        }
+    }
+    clusterHandover_ = std::make_shared<ClusterHandover>();
+    if (!leased.empty()) {
+        ClusterCoordinator::getInstance().post([leased]() {
+            for (const auto& key : leased) {
+                ClusterCoordinator::getInstance().release(key);
+            }
+        });
+    }
+}
+
+void DownloadTask::adaptConnections() {
+    if (!adaptiveSegments_ || !supportsResume_ || fileSize_ <= 0) {
+        return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastAdaptTime_ < std::chrono::seconds(ADAPT_INTERVAL_SECONDS)) {
+        return;
+    }
+    lastAdaptTime_ = now;
+    
+    // Only judge windows in which the full target was running
+    if (!adaptSettled_ && countActiveSegments() >= targetConnections_) {
+        double speed = progressInfo_.downloadSpeed;
+        
+        if (speed > adaptSpeed_ * ADAPT_GAIN_THRESHOLD && targetConnections_ < segmentCount_) {
+            adaptSpeed_ = speed;
+            targetConnections_++;
+            
+            dm::utils::Logger::debug("Download " + id_ + " probing " + std::to_string(targetConnections_) + " connections");
+        } else {
+            // The last connection added nothing, let its range go back to waiting
+            if (speed <= adaptSpeed_ * ADAPT_GAIN_THRESHOLD && targetConnections_ > 1) {
+                targetConnections_--;
+                if (auto victim = findSplitCandidate()) {
+                    splitSegment(victim, static_cast<int64_t>(OutputFile::getAlignment()));
+                }
+            }
+            
+            adaptSettled_ = true;
+            HostConnectionCache::getInstance().setConnectionCount(url_, targetConnections_);
+            
+            dm::utils::Logger::debug("Download " + id_ + " settled on " + std::to_string(targetConnections_) + " connections");
+        }
+    }
+    
+    scheduleSegments();
+}
+
+bool DownloadTask::createMetadataFile() {
+    // Create metadata file path
+    std::string metadataPath = destinationPath_ + "/" + filename_ + ".meta";
+    
+    // Open file for writing
+    std::ofstream file(metadataPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    
+    // Write metadata
+    file << "id=" << id_ << std::endl;
+    file << "url=" << url_ << std::endl;
+    file << "file_size=" << fileSize_ << std::endl;
+    file << "supports_resume=" << (supportsResume_ ? "true" : "false") << std::endl;
+    file << "etag=" << etag_ << std::endl;
+    file << "last_modified=" << lastModified_ << std::endl;
+    for (size_t i = 1; i < sources_.size(); i++) {
+        if (!sources_[i].peer) {
+            file << "mirror=" << sources_[i].url << std::endl;
+        }
+    }
+    file << "segment_count=" << segmentCount_ << std::endl;
+    
+    // Add timestamp
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    file << "timestamp=" << time << std::endl;
+    
+    file.close();
+    return true;
+}
+
+bool DownloadTask::loadMetadata() {
+    // Not implemented in this version
+    return false;
+}
+
+void DownloadTask::setStatus(DownloadStatus status) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    DownloadStatus oldStatus = status_;
+    status_ = status;
+    // Connections are only held while downloading, and so is buffer memory
+    if (oldStatus == DownloadStatus::DOWNLOADING && status != DownloadStatus::DOWNLOADING) {
+        releaseConnections();
+        if (writeBufferPool_) {
+            writeBufferPool_->trim();
+        }
+    }
+    // A paused download keeps its proxy and its pieces for when it resumes
+    if (status == DownloadStatus::COMPLETED || status == DownloadStatus::CANCELED ||
+        status == DownloadStatus::DOWNLOAD_ERROR) {
+        ProxyPool::getInstance().forget(id_);
+        abandonClusterWork();
+        for (size_t i = 0; i < clusterPieces_.size(); i++) {
+            if (clusterPieces_[i] == ClusterLeaseState::ACQUIRED) {
+                ClusterCoordinator::getInstance().release(ClusterCoordinator::makePieceKey(clusterKey_, static_cast<int64_t>(i)));
+                clusterPieces_[i] = ClusterLeaseState::HELD;
+            }
+        }
+    }
+    // Log status change
+    dm::utils::Logger::info("Download status changed: " + url_ + " -> " + std::to_string(static_cast<int>(status)));
+    // Call status change callback if provided
+    if (statusChangeCallback_ && oldStatus != status) {
+        statusChangeCallback_(shared_from_this(), oldStatus, status);
+    }
+}
+
+void DownloadTask::onTaskCompleted() {
+    std::string filePath;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        // The queue thread and the last segment's thread can both get here
+        if (finalizing_ || status_ != DownloadStatus::DOWNLOADING) {
+            return;
+        }
+        finalizing_ = true;
+        filePath = destinationPath_ + "/" + filename_;
+    }
+    
+    // Reading a large file back must not hold up the caller, often the queue thread
+    std::shared_ptr<DownloadTask> self = shared_from_this();
+    dm::utils::IoTaskExecutor::getInstance().submit(filePath, [self]() {
+        if (self->finalize()) {
+            // Finished or failed, its status keeps callers out from now on
+            std::lock_guard<std::recursive_mutex> lock(self->mutex_);
+            self->finalizing_ = false;
+        }
+    });
+}
+
+bool DownloadTask::finalize() {
+    // All segments are done writing
+    std::string filePath = destinationPath_ + "/" + filename_;
+    std::shared_ptr<StreamingHasher> hasher;
+    std::shared_ptr<ContentSniffer> sniffer;
+    std::shared_ptr<DataFilterChain> filters;
+    std::shared_ptr<PieceVerifier> verifier;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        hasher = hasher_;
+        filters = filters_;
+        verifier = pieceVerifier_;
+        sniffer = sniffer_;
+        // Other nodes wrote their pieces through their own clients, a fresh
+        // open reads what they synced instead of stale cached pages
+        if (!clusterKey_.empty() && outputFile_ && outputFile_->isOpen()) {
+            outputFile_->close();
+            outputFile_->open(filePath, false);
+        }
+    }
+    bool open = outputFile_ && outputFile_->isOpen();
+    
+    // Pieces not checked on their way in are read back; the task
+    // completes once those that failed are fetched again
+    if (verifier && open) {
+        std::vector<size_t> failed = verifier->finish(*outputFile_);
+        if (!failed.empty()) {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            finalizing_ = false;
+            repairPieces(failed);
+            return false;
+        }
+        dm::utils::Logger::debug("Verified " + std::to_string(verifier->getVerifiedCount()) +
+                                 " pieces of download " + id_ + ", " + std::to_string(repairedPieces_) +
+                                 " fetched again");
+    }
+    if (hasher && open) {
+        hasher->finish(*outputFile_, fileSize_);
+    }
+    if (sniffer && !(open && sniffer->finish(*outputFile_, fileSize_))) {
+        sniffer.reset();
+    }
+    
+    // Filter workers may still be catching up, without holding up the task
+    if (filters && outputFile_ && outputFile_->isOpen()) {
+        filters->finish(*outputFile_, fileSize_);
+    }
+    if (outputFile_ && !outputFile_->commit()) {
+        outputFile_->close();
+        error_ = "Failed to write the downloaded file";
+        setStatus(DownloadStatus::DOWNLOAD_ERROR);
+        return true;
+    }
+    if (outputFile_) {
+        outputFile_->close();
+    }
+
+    // Keep the server's modification time, mirrors compare on it
+    std::string lastModified;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        lastModified = lastModified_;
+    }
+    if (!lastModified.empty()) {
+        time_t modified = curl_getdate(lastModified.c_str(), nullptr);
+        if (modified > 0) {
+            dm::utils::FileUtils::setModificationTime(filePath, static_cast<int64_t>(modified));
+        }
+    }
+    if (hasher && !hasher->getDigest().empty()) {
+        dm::utils::HashCalculator::recordStreamedHash(filePath, hasher->getAlgorithm(), hasher->getDigest());
+    }
+    if (sniffer) {
+        ContentSniffer::recordSample(filePath, sniffer->getSample());
+    }
+    
+    // A file described by a Metalink must match its hash
+    std::string expectedHash;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        expectedHash = expectedHash_;
+    }
+    if (!expectedHash.empty()) {
+        std::string digest = hasher ? hasher->getDigest() : "";
+        if (digest != expectedHash) {
+            error_ = digest.empty() ? "Failed to hash the downloaded file" :
+                     "Hash mismatch: expected " + expectedHash + ", got " + digest;
+            dm::utils::Logger::error("Download " + url_ + " failed verification: " + error_);
+            setStatus(DownloadStatus::DOWNLOAD_ERROR);
+            return true;
+        }
+    }
+    
+    // Identical downloads share their disk space
+    if (hasher && !hasher->getDigest().empty() && ContentStore::getInstance().isEnabled()) {
+        ContentStore::getInstance().add(filePath, hasher->getAlgorithm(), hasher->getDigest());
+    }
+    
+    // A later download of the URL can ask whether this copy is still current
+    bool revalidate;
+    std::string etag;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        revalidate = revalidate_;
+        etag = etag_;
+    }
+    if (revalidate) {
+        ValidatorCache::getInstance().record(url_, filePath, etag, lastModified,
+                                             hasher ? hasher->getAlgorithm() : dm::utils::HashAlgorithm::SHA256,
+                                             hasher ? hasher->getDigest() : "");
+    }
+    
+    // Managers on the LAN may take the file from here from now on
+    PeerCache& peers = PeerCache::getInstance();
+    if (peers.isEnabled()) {
+        peers.share(filePath, {hasher ? PeerCache::makeHashKey(hasher->getAlgorithm(), hasher->getDigest()) : "",
+                               PeerCache::makeUrlKey(url_, etag)});
+    }
+    
+    if (!clusterKey_.empty()) {
+        ClusterCoordinator::getInstance().finishFile(clusterKey_);
+    }
+    
+    // Set status to completed
+    setStatus(DownloadStatus::COMPLETED);
+    
+    // Update progress to 100%
+    TaskProgressCallback callback;
+    ProgressInfo progress;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        progressInfo_.downloadedBytes = fileSize_;
+        progressInfo_.progressPercent = 100.0;
+        progressInfo_.downloadSpeed = 0.0;
+        progressInfo_.timeRemaining = 0;
+        progressSnapshot_.store(progressInfo_);
+        
+        callback = progressCallback_;
+        progress = progressInfo_;
+    }
+    
+    // Call progress callback if provided
+    if (callback) {
+        callback(progress);
+    }
+    
+    // Log completion
+    dm::utils::Logger::info("Download completed: " + url_ + " -> " + 
+                          destinationPath_ + "/" + filename_);
+    return true;
+}
+
+void DownloadTask::onSegmentCompleted(std::shared_ptr<SegmentDownloader> segment) {
+    // Log segment completion
+    dm::utils::Logger::debug("Segment completed: " + std::to_string(segment->getId()) + 
+                           " of download " + id_);
     
-    // Check if all segments are completed
+    // Check if all segments are completed, handing the free connection on first
     bool allCompleted = true;
     {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        releaseSegment(segment->getId());
+        
+        // A segment taken out by cancel() no longer counts
+        if (std::find(segments_.begin(), segments_.end(), segment) == segments_.end()) {
+            return;
+        }
+        if (finalizing_ || !checkPieces()) {
+            return;
+        }
+        scheduleSegments();
+        
         for (auto& seg : segments_) {
             if (seg->getStatus() != SegmentStatus::COMPLETED) {
                 allCompleted = false;
                 break;
             }
         }
+        if (allCompleted && !clusterKey_.empty()) {
+            allCompleted = advanceCluster();
+        }
     }
     
     // If all segments are completed, mark the task as completed
@@ -584,6 +2342,52 @@ void DownloadTask::onSegmentError(std::shared_ptr<SegmentDownloader> segment, co
     dm::utils::Logger::error("Segment error: " + std::to_string(segment->getId()) + 
                            " of download " + id_ + " - " + error);
     
+    // With another source left, the range moves there instead of failing the download
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        releaseSegment(segment->getId());
+        
+        auto source = segmentSources_.find(segment->getId());
+        bool current = std::find(segments_.begin(), segments_.end(), segment) != segments_.end();
+        
+        // A segment taken out by cancel() no longer counts
+        if (!current) {
+            return;
+        }
+        if (source != segmentSources_.end() &&
+            status_ == DownloadStatus::DOWNLOADING && supportsResume_ && fileSize_ > 0) {
+            size_t index = source->second;
+            sources_[index].failures++;
+            
+            bool otherSource = false;
+            for (size_t i = 0; i < sources_.size(); i++) {
+                otherSource = otherSource || (i != index && sources_[i].usable);
+            }
+            
+            if (otherSource) {
+                if (sources_[index].usable) {
+                    dropSource(index, error);
+                }
+                
+                // Continue from what reached the file, the segment object
+                // lives on until the task restarts as its thread unwinds
+                int64_t savedPosition = segment->getSavedPosition();
+                int64_t endByte = segment->getEndByte();
+                restoredBytes_ += savedPosition - segment->getStartByte();
+                retiredSegments_.push_back(segment);
+                segments_.erase(std::find(segments_.begin(), segments_.end(), segment));
+                segmentSources_.erase(segment->getId());
+                
+                if (savedPosition <= endByte) {
+                    auto replacement = makeSegment(savedPosition, endByte, nextSegmentId_++);
+                    segments_.push_back(replacement);
+                    startSegment(replacement);
+                }
+                return;
+            }
+        }
+    }
+    
     // Set error message
     error_ = "Segment " + std::to_string(segment->getId()) + " error: " + error;
     
@@ -591,5 +2395,33 @@ void DownloadTask::onSegmentError(std::shared_ptr<SegmentDownloader> segment, co
     setStatus(DownloadStatus::DOWNLOAD_ERROR);
 }
 
+bool DownloadTask::onSegmentBackoff(std::shared_ptr<SegmentDownloader> segment, int statusCode) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    
+    if (!adaptiveSegments_ || status_ != DownloadStatus::DOWNLOADING) {
+        return false;
+    }
+    
+    // The last connection keeps retrying, there is nobody to hand the range to
+    int others = countActiveSegments();
+    if (segment->getStatus() == SegmentStatus::DOWNLOADING) {
+        others--;
+    }
+    if (others <= 0) {
+        return false;
+    }
+    
+    targetConnections_ = std::min(targetConnections_, others);
+    adaptSettled_ = true;
+    HostConnectionCache::getInstance().setConnectionCount(url_, targetConnections_);
+    
+    std::ostringstream log;
+    log << "Server answered " << statusCode << " for download " << id_ << ", dropping to "
+        << targetConnections_ << " connections";
+    dm::utils::Logger::warning(log.str());
+    
+    return true;
+}
+
 } // namespace core
 } // namespace dm
\ No newline at end of file
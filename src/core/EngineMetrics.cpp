@@ -0,0 +1,65 @@
+#include "core/EngineMetrics.h"
+
+#include <algorithm>
+
+namespace dm {
+namespace core {
+
+constexpr std::array<double, 14> EngineMetrics::BUCKET_BOUNDS;
+
+EngineMetrics& EngineMetrics::getInstance() {
+    static EngineMetrics instance;
+    return instance;
+}
+
+void EngineMetrics::observe(LatencyMetric metric, double seconds) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    // Counted in its own bucket only, snapshots add them up
+    Histogram& histogram = latencies_[static_cast<size_t>(metric)];
+    size_t bucket = std::lower_bound(BUCKET_BOUNDS.begin(), BUCKET_BOUNDS.end(), seconds) - BUCKET_BOUNDS.begin();
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.sumNanoseconds.fetch_add(static_cast<uint64_t>(std::max(0.0, seconds) * 1e9), std::memory_order_relaxed);
+}
+
+LatencySnapshot EngineMetrics::getLatency(LatencyMetric metric) const {
+    const Histogram& histogram = latencies_[static_cast<size_t>(metric)];
+
+    LatencySnapshot snapshot;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < BUCKET_BOUNDS.size(); i++) {
+        cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+        snapshot.buckets[i] = cumulative;
+    }
+    snapshot.count = cumulative + histogram.buckets[BUCKET_BOUNDS.size()].load(std::memory_order_relaxed);
+    snapshot.sumSeconds = histogram.sumNanoseconds.load(std::memory_order_relaxed) / 1e9;
+    return snapshot;
+}
+
+int64_t EngineMetrics::getCount(EventMetric metric) const {
+    return events_[static_cast<size_t>(metric)].load(std::memory_order_relaxed);
+}
+
+const char* EngineMetrics::getLatencyName(LatencyMetric metric) {
+    switch (metric) {
+        case LatencyMetric::CONNECT: return "dm_connect_latency";
+        case LatencyMetric::FIRST_BYTE: return "dm_first_byte_latency";
+        case LatencyMetric::THROTTLE_WAIT: return "dm_throttle_wait";
+        case LatencyMetric::DISK_WRITE: return "dm_disk_write_latency";
+        default: return "dm_unknown_latency";
+    }
+}
+
+const char* EngineMetrics::getEventName(EventMetric metric) {
+    switch (metric) {
+        case EventMetric::SEGMENT_RETRIES: return "dm_segment_retries";
+        case EventMetric::HASHED_BYTES: return "dm_hashed_bytes";
+        case EventMetric::HASH_NANOSECONDS: return "dm_hash_seconds";
+        default: return "dm_unknown";
+    }
+}
+
+} // namespace core
+} // namespace dm
@@ -1,5 +1,6 @@
 #include "../../include/core/FileManager.h"
 #include "utils/Logger.h"
+#include "utils/Tracer.h"
 #include "utils/HashCalculator.h"
 
 #include <fstream>
@@ -31,23 +32,11 @@ bool FileManager::createFile(const std::string& filePath, int64_t fileSize) {
             return false;
         }
         
-        // Create the file with specified size
-        std::ofstream file(filePath, std::ios::binary | std::ios::out);
-        if (!file.is_open()) {
-            dm::utils::Logger::error("Failed to create file: " + filePath);
-            return false;
-        }
+        // Drop any descriptor cached for the old file
+        closeFile(filePath);
         
-        // Pre-allocate the file if size is known
-        if (fileSize > 0) {
-            // Seek to the end position
-            file.seekp(fileSize - 1);
-            // Write a single byte to allocate the space
-            file.put(0);
-        }
-        
-        file.close();
-        return true;
+        // Create the file and reserve its space if size is known
+        return dm::utils::FileUtils::preallocateFile(filePath, fileSize);
     } 
     catch (const std::exception& e) {
         dm::utils::Logger::error(std::string("Exception in createFile: ") + e.what());
@@ -56,26 +45,20 @@ bool FileManager::createFile(const std::string& filePath, int64_t fileSize) {
 }
 
 bool FileManager::writeToFile(const std::string& filePath, const char* data, int64_t offset, size_t size) {
+    DM_TRACE_SPAN("file write");
     try {
-        std::fstream file(filePath, std::ios::binary | std::ios::in | std::ios::out);
-        if (!file.is_open()) {
+        // The file stays open between calls, writes are positional
+        auto file = getOpenFile(filePath);
+        if (!file) {
             dm::utils::Logger::error("Failed to open file for writing: " + filePath);
             return false;
         }
         
-        // Seek to the position
-        file.seekp(offset);
-        
-        // Write the data
-        file.write(data, size);
-        
-        // Check if write was successful
-        if (file.fail()) {
+        if (!file->writeAt(data, size, offset)) {
             dm::utils::Logger::error("Failed to write data to file: " + filePath);
             return false;
         }
         
-        file.close();
         return true;
     } 
     catch (const std::exception& e) {
@@ -84,6 +67,11 @@ bool FileManager::writeToFile(const std::string& filePath, const char* data, int
     }
 }
 
+void FileManager::closeFile(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(openFilesMutex_);
+    openFiles_.erase(filePath);
+}
+
 bool FileManager::isFileResumeValid(const std::string& filePath) {
     try {
         // Check if file exists
@@ -148,13 +136,26 @@ bool FileManager::finalizeDownload(const std::string& tempFilePath, const std::s
             return false;
         }
         
+        // Make sure no cached descriptor outlives the rename
+        closeFile(tempFilePath);
+        
         // Remove existing target file if it exists
         if (fs::exists(targetFilePath)) {
             fs::remove(targetFilePath);
         }
         
-        // Rename temp file to target file
-        fs::rename(tempFilePath, targetFilePath);
+        // Rename temp file to target file, copying it across filesystems
+        std::error_code error;
+        fs::rename(tempFilePath, targetFilePath, error);
+        if (error == std::errc::cross_device_link) {
+            if (!dm::utils::FileUtils::copyFile(tempFilePath, targetFilePath)) {
+                dm::utils::Logger::error("Failed to copy " + tempFilePath + " to " + targetFilePath);
+                return false;
+            }
+            fs::remove(tempFilePath);
+        } else if (error) {
+            throw fs::filesystem_error("rename", tempFilePath, targetFilePath, error);
+        }
         
         return true;
     } 
@@ -170,8 +171,17 @@ bool FileManager::checkFileIntegrity(const std::string& filePath, const std::str
         dm::utils::HashCalculator hashCalculator;
         std::string calculatedHash;
         
+        // Prefer the hash computed while the file was downloaded
+        dm::utils::HashAlgorithm algorithm;
+        if (dm::utils::HashCalculator::parseAlgorithm(hashType, algorithm)) {
+            calculatedHash = dm::utils::HashCalculator::findStreamedHash(filePath, algorithm);
+        }
+        
         // Replace direct calls to calculateMD5, calculateSHA1, calculateSHA256 with calculateHash and the appropriate enum
-        if (hashType == "MD5") {
+        if (!calculatedHash.empty()) {
+            dm::utils::Logger::debug("Using streamed " + hashType + " hash of " + filePath);
+        }
+        else if (hashType == "MD5") {
             calculatedHash = hashCalculator.calculateHash(filePath, dm::utils::HashAlgorithm::MD5);
         } 
         else if (hashType == "SHA1") {
@@ -210,6 +220,18 @@ int64_t FileManager::getAvailableDiskSpace(const std::string& directoryPath) {
     }
 }
 
+int64_t FileManager::getUnreservedDiskSpace(const std::string& directoryPath) {
+    return dm::core::DiskSpaceLedger::getInstance().getAvailableSpace(directoryPath);
+}
+
+dm::core::StorageDeviceInfo FileManager::getStorageDevice(const std::string& path) {
+    dm::core::StorageDeviceInfo info;
+    if (!dm::core::DeviceIoScheduler::detectDevice(path, info)) {
+        dm::utils::Logger::warning("Could not find the storage device of " + path);
+    }
+    return info;
+}
+
 std::vector<std::string> FileManager::splitFileIntoSegments(const std::string& filePath, int segments) {
     std::vector<std::string> segmentPaths;
     
@@ -227,14 +249,8 @@ std::vector<std::string> FileManager::splitFileIntoSegments(const std::string& f
         size_t segmentSize = fileSize / segments;
         size_t remainder = fileSize % segments;
         
-        // Open source file
-        std::ifstream srcFile(filePath, std::ios::binary);
-        if (!srcFile.is_open()) {
-            dm::utils::Logger::error("Failed to open source file: " + filePath);
-            return segmentPaths;
-        }
-        
         // Create segments
+        size_t offset = 0;
         for (int i = 0; i < segments; i++) {
             // Calculate current segment size
             size_t currentSegmentSize = segmentSize;
@@ -245,35 +261,25 @@ std::vector<std::string> FileManager::splitFileIntoSegments(const std::string& f
             // Create segment file name
             std::string segmentPath = filePath + ".part" + std::to_string(i + 1);
             
-            // Open segment file
+            size_t segmentOffset = offset;
+            offset += currentSegmentSize;
+            
+            // Create an empty segment file
             std::ofstream segmentFile(segmentPath, std::ios::binary);
             if (!segmentFile.is_open()) {
                 dm::utils::Logger::error("Failed to create segment file: " + segmentPath);
                 continue;
             }
+            segmentFile.close();
             
-            // Read and write data
-            std::vector<char> buffer(1024 * 1024); // 1MB buffer
-            size_t bytesRemaining = currentSegmentSize;
-            
-            while (bytesRemaining > 0 && srcFile.good()) {
-                size_t bytesToRead = std::min(bytesRemaining, buffer.size());
-                srcFile.read(buffer.data(), bytesToRead);
-                size_t bytesRead = srcFile.gcount();
-                
-                if (bytesRead > 0) {
-                    segmentFile.write(buffer.data(), bytesRead);
-                    bytesRemaining -= bytesRead;
-                } else {
-                    break;
-                }
+            // Copy the range in the kernel, sharing extents where possible
+            if (!dm::utils::FileUtils::copyFileRange(filePath, static_cast<int64_t>(segmentOffset),
+                                                     static_cast<int64_t>(currentSegmentSize), segmentPath, 0)) {
+                dm::utils::Logger::error("Failed to write segment file: " + segmentPath);
+                continue;
             }
-            
-            segmentFile.close();
             segmentPaths.push_back(segmentPath);
         }
-        
-        srcFile.close();
     } 
     catch (const std::exception& e) {
         dm::utils::Logger::error("Exception in splitFileIntoSegments: " + std::string(e.what()));
@@ -296,44 +302,29 @@ bool FileManager::mergeFileSegments(const std::vector<std::string>& segmentPaths
             dm::utils::Logger::error("Failed to create output file: " + outputFilePath);
             return false;
         }
+        outputFile.close();
         
-        // Merge segments
-        std::vector<char> buffer(1024 * 1024); // 1MB buffer
-        
+        // Merge segments, copied in the kernel and sharing extents where possible
+        int64_t offset = 0;
         for (const auto& segmentPath : segmentPaths) {
             // Validate segment file
-            if (!fs::exists(segmentPath)) {
+            std::error_code error;
+            auto segmentSize = fs::file_size(segmentPath, error);
+            if (error) {
                 dm::utils::Logger::error("Segment file does not exist: " + segmentPath);
-                outputFile.close();
                 fs::remove(outputFilePath);
                 return false;
             }
             
-            // Open segment file
-            std::ifstream segmentFile(segmentPath, std::ios::binary);
-            if (!segmentFile.is_open()) {
-                dm::utils::Logger::error("Failed to open segment file: " + segmentPath);
-                outputFile.close();
+            if (!dm::utils::FileUtils::copyFileRange(segmentPath, 0, static_cast<int64_t>(segmentSize),
+                                                     outputFilePath, offset)) {
+                dm::utils::Logger::error("Failed to merge segment file: " + segmentPath);
                 fs::remove(outputFilePath);
                 return false;
             }
-            
-            // Read and write data
-            while (segmentFile.good()) {
-                segmentFile.read(buffer.data(), buffer.size());
-                size_t bytesRead = segmentFile.gcount();
-                
-                if (bytesRead > 0) {
-                    outputFile.write(buffer.data(), bytesRead);
-                } else {
-                    break;
-                }
-            }
-            
-            segmentFile.close();
+            offset += static_cast<int64_t>(segmentSize);
         }
         
-        outputFile.close();
         return true;
     } 
     catch (const std::exception& e) {
@@ -359,6 +350,28 @@ bool FileManager::ensureDirectoryExists(const std::string& filePath) {
     }
 }
 
+std::shared_ptr<dm::core::OutputFile> FileManager::getOpenFile(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(openFilesMutex_);
+    
+    auto it = openFiles_.find(filePath);
+    if (it != openFiles_.end()) {
+        return it->second;
+    }
+    
+    // Only existing files are written to, creation goes through createFile
+    if (!fs::exists(filePath)) {
+        return nullptr;
+    }
+    
+    auto file = std::make_shared<dm::core::OutputFile>();
+    if (!file->open(filePath)) {
+        return nullptr;
+    }
+    
+    openFiles_[filePath] = file;
+    return file;
+}
+
 std::string FileManager::generateTempFileName(const std::string& basePath) {
     // Generate a unique temporary file name based on timestamp and random number
     std::stringstream ss;
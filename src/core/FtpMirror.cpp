@@ -0,0 +1,615 @@
+#include "core/FtpMirror.h"
+#include "core/DownloadManager.h"
+#include "core/HttpClient.h"
+#include "core/CurlHandlePool.h"
+#include "core/DnsCache.h"
+#include "utils/Logger.h"
+#include "utils/FileUtils.h"
+#include "utils/UrlParser.h"
+
+#include <curl/curl.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <system_error>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+// Seconds a LIST time is off by: "Jan  1 12:00" lacks seconds, "Jan  1  2020" the time
+constexpr int64_t LIST_MINUTE_PRECISION = 60;
+constexpr int64_t LIST_DAY_PRECISION = 86400;
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+bool isDigits(const std::string& text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(),
+                                        [](unsigned char c) { return std::isdigit(c) != 0; });
+}
+
+// Names that would leave the directory being mirrored
+bool isUsableName(const std::string& name) {
+    return !name.empty() && name != "." && name != ".." &&
+           name.find_first_of("/\\") == std::string::npos;
+}
+
+// Broken-down UTC time to Unix seconds
+int64_t toUnixTime(struct tm& time) {
+#ifdef _WIN32
+    return static_cast<int64_t>(_mkgmtime(&time));
+#else
+    return static_cast<int64_t>(timegm(&time));
+#endif
+}
+
+int monthIndex(const std::string& name) {
+    static const char* const MONTHS[] = {
+        "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+    };
+    std::string lower = toLower(name);
+    for (int i = 0; i < 12; i++) {
+        if (lower == MONTHS[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Listing data arrives in arbitrary chunks, lines are handed on whole
+struct ListingBuffer {
+    std::string partial;
+    const std::function<void(const std::string&)>* lineHandler = nullptr;
+    const std::atomic<bool>* stopRequested = nullptr;
+
+    void handleLine(std::string line) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            (*lineHandler)(line);
+        }
+    }
+};
+
+size_t writeListing(char* data, size_t size, size_t nmemb, void* userdata) {
+    ListingBuffer* buffer = static_cast<ListingBuffer*>(userdata);
+    size_t total = size * nmemb;
+    if (*buffer->stopRequested) {
+        return 0;
+    }
+
+    buffer->partial.append(data, total);
+    size_t start = 0;
+    size_t newline;
+    while ((newline = buffer->partial.find('\n', start)) != std::string::npos) {
+        buffer->handleLine(buffer->partial.substr(start, newline - start));
+        start = newline + 1;
+    }
+    buffer->partial.erase(0, start);
+
+    return total;
+}
+
+} // anonymous namespace
+
+FtpMirror::FtpMirror(DownloadManager& downloadManager)
+    : downloadManager_(downloadManager),
+      running_(false),
+      stopRequested_(false),
+      useMlsd_(true),
+      finished_(false),
+      pendingDirectories_(0),
+      directoriesListed_(0),
+      filesFound_(0),
+      filesQueued_(0),
+      filesSkipped_(0) {
+}
+
+FtpMirror::~FtpMirror() {
+    stopMirroring();
+    joinWorkers();
+}
+
+bool FtpMirror::startMirroring(const std::string& remoteUrl,
+                               const std::string& localDirectory,
+                               const FtpMirrorOptions& options,
+                               FtpMirrorProgressCallback progressCallback) {
+    if (running_) {
+        dm::utils::Logger::warning("FTP mirror is already running");
+        return false;
+    }
+
+    // Threads of a finished mirror may still be winding down
+    joinWorkers();
+
+    if (!HttpClient::isFtpUrl(remoteUrl)) {
+        dm::utils::Logger::error("Not an FTP URL: " + remoteUrl);
+        return false;
+    }
+    if (!dm::utils::FileUtils::createDirectory(localDirectory)) {
+        dm::utils::Logger::error("Failed to create mirror directory: " + localDirectory);
+        return false;
+    }
+
+    // Reset state
+    options_ = options;
+    options_.maxConcurrentListings = std::max(1, options_.maxConcurrentListings);
+    progressCallback_ = progressCallback;
+    rootUrl_ = remoteUrl;
+    if (rootUrl_.back() != '/') {
+        rootUrl_ += '/';
+    }
+
+    useMlsd_ = true;
+    finished_ = false;
+    stopRequested_ = false;
+    directoriesListed_ = 0;
+    filesFound_ = 0;
+    filesQueued_ = 0;
+    filesSkipped_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(fileMutex_);
+        fileQueue_.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(resultsMutex_);
+        errors_.clear();
+    }
+
+    FtpMirrorEntry root;
+    root.url = rootUrl_;
+    root.localPath = localDirectory;
+    root.isDirectory = true;
+    {
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+        directoryQueue_.clear();
+        directoryQueue_.push_back(root);
+    }
+    pendingDirectories_ = 1;
+
+    running_ = true;
+
+    try {
+        for (int i = 0; i < options_.maxConcurrentListings; i++) {
+            workerThreads_.emplace_back(&FtpMirror::listingWorker, this);
+        }
+        workerThreads_.emplace_back(&FtpMirror::fileWorker, this);
+    } catch (const std::system_error& e) {
+        dm::utils::Logger::error("Failed to start mirror threads: " + std::string(e.what()));
+        stopMirroring();
+        return false;
+    }
+
+    dm::utils::Logger::info("Started mirroring " + rootUrl_ + " to " + localDirectory + " with " +
+                            std::to_string(options_.maxConcurrentListings) + " listing workers");
+    return true;
+}
+
+bool FtpMirror::stopMirroring() {
+    if (!running_) {
+        return false;
+    }
+
+    stopRequested_ = true;
+    notifyAll();
+    joinWorkers();
+
+    running_ = false;
+    dm::utils::Logger::info("FTP mirror stopped");
+    return true;
+}
+
+bool FtpMirror::isRunning() const {
+    return running_;
+}
+
+void FtpMirror::getStatistics(int& directoriesListed, int& filesFound,
+                              int& filesQueued, int& filesSkipped) const {
+    directoriesListed = directoriesListed_;
+    filesFound = filesFound_;
+    filesQueued = filesQueued_;
+    filesSkipped = filesSkipped_;
+}
+
+std::map<std::string, std::string> FtpMirror::getErrors() const {
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    return errors_;
+}
+
+bool FtpMirror::parseMlsdLine(const std::string& line, FtpMirrorEntry& entry) {
+    // "fact=value;fact=value; name", facts hold no spaces
+    size_t space = line.find(' ');
+    if (space == std::string::npos) {
+        return false;
+    }
+
+    entry = FtpMirrorEntry();
+    entry.name = line.substr(space + 1);
+
+    std::string type;
+    size_t start = 0;
+    while (start < space) {
+        size_t end = line.find(';', start);
+        if (end == std::string::npos || end > space) {
+            end = space;
+        }
+        size_t equals = line.find('=', start);
+        if (equals != std::string::npos && equals < end) {
+            std::string fact = toLower(line.substr(start, equals - start));
+            std::string value = line.substr(equals + 1, end - equals - 1);
+
+            if (fact == "type") {
+                type = toLower(value);
+            } else if (fact == "size" && isDigits(value)) {
+                entry.size = std::stoll(value);
+            } else if (fact == "modify") {
+                // YYYYMMDDHHMMSS[.sss] in UTC
+                struct tm time = {};
+                if (std::sscanf(value.c_str(), "%4d%2d%2d%2d%2d%2d", &time.tm_year, &time.tm_mon,
+                                &time.tm_mday, &time.tm_hour, &time.tm_min, &time.tm_sec) == 6) {
+                    time.tm_year -= 1900;
+                    time.tm_mon -= 1;
+                    entry.modified = toUnixTime(time);
+                    entry.modifiedPrecision = 1;
+                }
+            }
+        }
+        start = end + 1;
+    }
+
+    // cdir and pdir are the listed directory and its parent, links are not followed
+    if (type == "dir") {
+        entry.isDirectory = true;
+    } else if (type != "file") {
+        return false;
+    }
+
+    return isUsableName(entry.name);
+}
+
+bool FtpMirror::parseListLine(const std::string& line, FtpMirrorEntry& entry) {
+    if (line.empty() || (line[0] != '-' && line[0] != 'd')) {
+        // "total 42", symlinks, devices and non-Unix formats
+        return false;
+    }
+
+    // Split into whitespace separated fields, remembering where each starts
+    std::vector<std::string> fields;
+    std::vector<size_t> offsets;
+    size_t pos = 0;
+    while (pos < line.size() && fields.size() < 9) {
+        size_t start = line.find_first_not_of(" \t", pos);
+        if (start == std::string::npos) {
+            break;
+        }
+        size_t end = line.find_first_of(" \t", start);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        fields.push_back(line.substr(start, end - start));
+        offsets.push_back(start);
+        pos = end;
+    }
+
+    // The month follows the size; some servers leave out the group column
+    size_t month = 0;
+    for (size_t i = 3; i + 3 < fields.size() && i <= 5; i++) {
+        if (monthIndex(fields[i]) >= 0 && isDigits(fields[i - 1]) && isDigits(fields[i + 1])) {
+            month = i;
+            break;
+        }
+    }
+    if (month == 0) {
+        return false;
+    }
+
+    entry = FtpMirrorEntry();
+    entry.isDirectory = line[0] == 'd';
+    entry.size = std::stoll(fields[month - 1]);
+
+    // The name is the rest of the line after the time or year
+    size_t nameStart = offsets[month + 2] + fields[month + 2].size();
+    if (nameStart < line.size()) {
+        nameStart++;
+    }
+    entry.name = line.substr(nameStart);
+
+    struct tm time = {};
+    time.tm_mon = monthIndex(fields[month]);
+    time.tm_mday = std::atoi(fields[month + 1].c_str());
+    const std::string& timeOrYear = fields[month + 2];
+    size_t colon = timeOrYear.find(':');
+    if (colon != std::string::npos) {
+        // Within the last six months, taken as UTC as most servers list it
+        time_t now = std::time(nullptr);
+        struct tm nowUtc = {};
+#ifdef _WIN32
+        gmtime_s(&nowUtc, &now);
+#else
+        gmtime_r(&now, &nowUtc);
+#endif
+        time.tm_year = nowUtc.tm_year;
+        time.tm_hour = std::atoi(timeOrYear.substr(0, colon).c_str());
+        time.tm_min = std::atoi(timeOrYear.substr(colon + 1).c_str());
+        entry.modified = toUnixTime(time);
+        if (entry.modified > static_cast<int64_t>(now) + LIST_DAY_PRECISION) {
+            time.tm_year--;
+            entry.modified = toUnixTime(time);
+        }
+        entry.modifiedPrecision = LIST_MINUTE_PRECISION;
+    } else if (isDigits(timeOrYear)) {
+        time.tm_year = std::atoi(timeOrYear.c_str()) - 1900;
+        entry.modified = toUnixTime(time);
+        entry.modifiedPrecision = LIST_DAY_PRECISION;
+    }
+
+    return isUsableName(entry.name);
+}
+
+bool FtpMirror::isUnchanged(const FtpMirrorEntry& entry, const std::string& localPath) {
+    if (entry.size < 0 || entry.modified < 0) {
+        return false;
+    }
+    if (dm::utils::FileUtils::getFileSize(localPath) != entry.size) {
+        return false;
+    }
+
+    // A listed time is truncated to its precision, the local file keeps the exact one
+    int64_t localModified = dm::utils::FileUtils::getModificationTime(localPath);
+    return localModified >= entry.modified &&
+           localModified < entry.modified + std::max<int64_t>(1, entry.modifiedPrecision);
+}
+
+void FtpMirror::listingWorker() {
+    std::unique_lock<std::mutex> lock(directoryMutex_);
+
+    while (true) {
+        directoryChanged_.wait(lock, [this]() {
+            return stopRequested_ || finished_ || !directoryQueue_.empty();
+        });
+        if (stopRequested_ || directoryQueue_.empty()) {
+            break;
+        }
+
+        FtpMirrorEntry directory = std::move(directoryQueue_.front());
+        directoryQueue_.pop_front();
+        lock.unlock();
+
+        listDirectory(directory);
+        finishDirectory();
+
+        lock.lock();
+    }
+}
+
+void FtpMirror::fileWorker() {
+    std::unique_lock<std::mutex> lock(fileMutex_);
+
+    while (true) {
+        fileChanged_.wait(lock, [this]() {
+            return stopRequested_ || finished_ || !fileQueue_.empty();
+        });
+        if (stopRequested_ || fileQueue_.empty()) {
+            break;
+        }
+
+        FtpMirrorEntry entry = std::move(fileQueue_.front());
+        fileQueue_.pop_front();
+        lock.unlock();
+
+        handleFile(entry);
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    updateStatistics();
+
+    if (!stopRequested_) {
+        dm::utils::Logger::info("Mirroring finished: " + std::to_string(directoriesListed_) +
+                                " directories, " + std::to_string(filesQueued_) + " files queued, " +
+                                std::to_string(filesSkipped_) + " unchanged");
+        running_ = false;
+    }
+}
+
+void FtpMirror::listDirectory(const FtpMirrorEntry& directory) {
+    // Empty directories are mirrored too
+    if (!dm::utils::FileUtils::createDirectory(directory.localPath)) {
+        recordError(directory.url, "Failed to create " + directory.localPath);
+        return;
+    }
+
+    bool mlsd = useMlsd_;
+    bool received = false;
+    std::function<void(const std::string&)> lineHandler = [this, &directory, &mlsd, &received](const std::string& line) {
+        received = true;
+        FtpMirrorEntry entry;
+        if (mlsd ? parseMlsdLine(line, entry) : parseListLine(line, entry)) {
+            addEntry(directory, std::move(entry));
+        }
+    };
+
+    long responseCode = 0;
+    std::string error;
+    bool success = fetchListing(directory.url, mlsd ? "MLSD" : "LIST", lineHandler, responseCode, error);
+
+    // A server without MLSD rejects the command itself, list it the old way from now on
+    if (!success && mlsd && !received && responseCode >= 500 && responseCode <= 504 && !stopRequested_) {
+        if (useMlsd_.exchange(false)) {
+            dm::utils::Logger::info("Server does not support MLSD, falling back to LIST");
+        }
+        mlsd = false;
+        success = fetchListing(directory.url, "LIST", lineHandler, responseCode, error);
+    }
+
+    if (stopRequested_) {
+        return;
+    }
+    if (!success) {
+        recordError(directory.url, error);
+        return;
+    }
+
+    directoriesListed_++;
+    updateStatistics();
+}
+
+bool FtpMirror::fetchListing(const std::string& url, const char* command,
+                             const std::function<void(const std::string&)>& lineHandler,
+                             long& responseCode, std::string& error) {
+    // Check out a session that may already be logged in to the server
+    PooledCurlHandle handle(url);
+    CURL* curl = handle.get();
+    if (!curl) {
+        error = "Failed to initialize CURL";
+        return false;
+    }
+
+    ListingBuffer buffer;
+    buffer.lineHandler = &lineHandler;
+    buffer.stopRequested = &stopRequested_;
+
+    // A directory URL with a custom request sends it in place of LIST
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, command);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeListing);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, static_cast<long>(options_.timeoutSeconds));
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(options_.timeoutSeconds));
+
+    // Connect to prefetched addresses
+    struct curl_slist* resolveList = DnsCache::getInstance().apply(curl, url);
+
+    CURLcode result = curl_easy_perform(curl);
+    curl_slist_free_all(resolveList);
+
+    responseCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+    if (result != CURLE_OK) {
+        error = curl_easy_strerror(result);
+        if (responseCode > 0) {
+            error += " (" + std::to_string(responseCode) + ")";
+        }
+        return false;
+    }
+
+    // The last line may lack its line break
+    buffer.handleLine(std::move(buffer.partial));
+
+    return true;
+}
+
+void FtpMirror::addEntry(const FtpMirrorEntry& directory, FtpMirrorEntry entry) {
+    entry.depth = directory.depth + (entry.isDirectory ? 1 : 0);
+    entry.url = directory.url + dm::utils::UrlParser::encode(entry.name);
+    entry.localPath = dm::utils::FileUtils::combinePaths(directory.localPath, entry.name);
+
+    if (entry.isDirectory) {
+        if (options_.maxDepth >= 0 && entry.depth > options_.maxDepth) {
+            return;
+        }
+        entry.url += '/';
+
+        // Counted before this directory finishes, so the walk cannot end early
+        pendingDirectories_++;
+        {
+            std::lock_guard<std::mutex> lock(directoryMutex_);
+            directoryQueue_.push_back(std::move(entry));
+        }
+        directoryChanged_.notify_one();
+        return;
+    }
+
+    filesFound_++;
+    if (options_.skipUnchanged && isUnchanged(entry, entry.localPath)) {
+        filesSkipped_++;
+        updateStatistics();
+        return;
+    }
+
+    queueFile(std::move(entry));
+}
+
+void FtpMirror::queueFile(FtpMirrorEntry entry) {
+    {
+        std::lock_guard<std::mutex> lock(fileMutex_);
+        fileQueue_.push_back(std::move(entry));
+    }
+    fileChanged_.notify_one();
+}
+
+void FtpMirror::handleFile(const FtpMirrorEntry& entry) {
+    if (options_.fileHandler) {
+        options_.fileHandler(entry);
+        filesQueued_++;
+    } else if (downloadManager_.addDownload(entry.url, dm::utils::FileUtils::getDirectory(entry.localPath),
+                                            entry.name, options_.startDownloads)) {
+        filesQueued_++;
+    } else {
+        recordError(entry.url, "Failed to queue download");
+    }
+
+    updateStatistics();
+}
+
+void FtpMirror::finishDirectory() {
+    if (pendingDirectories_.fetch_sub(1) == 1) {
+        finished_ = true;
+        notifyAll();
+    }
+}
+
+void FtpMirror::recordError(const std::string& url, const std::string& error) {
+    dm::utils::Logger::warning("Mirror error for " + url + ": " + error);
+
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    errors_[url] = error;
+}
+
+void FtpMirror::updateStatistics() {
+    if (!progressCallback_) {
+        return;
+    }
+
+    // Workers report concurrently, keep the callback single threaded
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    progressCallback_(directoriesListed_, filesFound_, filesQueued_, filesSkipped_);
+}
+
+void FtpMirror::notifyAll() {
+    // Taking each lock orders the wakeup after a waiter's predicate check
+    {
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+    }
+    directoryChanged_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(fileMutex_);
+    }
+    fileChanged_.notify_all();
+}
+
+void FtpMirror::joinWorkers() {
+    for (auto& thread : workerThreads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    workerThreads_.clear();
+}
+
+} // namespace core
+} // namespace dm
@@ -1,4 +1,6 @@
 #include "../../include/core/FtpProtocolHandler.h"
+#include "../../include/core/DnsCache.h"
+#include "../../include/core/CurlHandlePool.h"
 #include "../../include/utils/Logger.h"
 #include "../../include/utils/UrlParser.h"
 
@@ -112,8 +114,9 @@ bool FtpProtocolHandler::getFileInfo(const std::string& url, DownloadFileInfo& f
             return false;
         }
         
-        // Initialize CURL
-        CURL* curl = curl_easy_init();
+        // Check out a session that may already be logged in to the server
+        dm::core::PooledCurlHandle handle(url);
+        CURL* curl = handle.get();
         if (!curl) {
             Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
                 "Failed to initialize libcurl");
@@ -124,8 +127,12 @@ bool FtpProtocolHandler::getFileInfo(const std::string& url, DownloadFileInfo& f
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
         curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+        curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
         curl_easy_setopt(curl, CURLOPT_FTP_USE_EPSV, 1L);
         
+        // Connect to prefetched addresses
+        struct curl_slist* resolveList = dm::core::DnsCache::getInstance().apply(curl, url);
+        
         // Set authentication if provided in URL
         if (!parsedUrl.username.empty()) {
             std::string userpass = parsedUrl.username;
@@ -140,6 +147,7 @@ bool FtpProtocolHandler::getFileInfo(const std::string& url, DownloadFileInfo& f
         
         // Perform request
         CURLcode res = curl_easy_perform(curl);
+        curl_slist_free_all(resolveList);
         
         if (res == CURLE_OK) {
             // Get file size
@@ -178,13 +186,11 @@ bool FtpProtocolHandler::getFileInfo(const std::string& url, DownloadFileInfo& f
             // FTP is generally resumable
             fileInfo.resumable = true;
             
-            curl_easy_cleanup(curl);
             return true;
         } else {
             // Handle error
             Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
                 "libcurl error: " + std::string(curl_easy_strerror(res)));
-            curl_easy_cleanup(curl);
             return false;
         }
     } catch (const std::exception& e) {
@@ -252,8 +258,9 @@ bool FtpProtocolHandler::download(std::shared_ptr<DownloadTask> task, const Prog
         transferData.progressCallback = progressCallback;
         transferData.downloadedSize = task->getDownloadedSize();
         
-        // Initialize CURL
-        CURL* curl = curl_easy_init();
+        // Reuse the session the size probe left logged in
+        dm::core::PooledCurlHandle handle(task->getUrl());
+        CURL* curl = handle.get();
         if (!curl) {
             Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
                 "Failed to initialize libcurl");
@@ -270,6 +277,9 @@ bool FtpProtocolHandler::download(std::shared_ptr<DownloadTask> task, const Prog
         curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &transferData);
         curl_easy_setopt(curl, CURLOPT_FTP_USE_EPSV, 1L);
         
+        // Connect to prefetched addresses
+        struct curl_slist* resolveList = dm::core::DnsCache::getInstance().apply(curl, task->getUrl());
+        
         // Set authentication if provided in URL
         if (!parsedUrl.username.empty()) {
             std::string userpass = parsedUrl.username;
@@ -291,6 +301,7 @@ bool FtpProtocolHandler::download(std::shared_ptr<DownloadTask> task, const Prog
         
         // Perform the download
         CURLcode res = curl_easy_perform(curl);
+        curl_slist_free_all(resolveList);
         
         // Close file
         outputFile.close();
@@ -299,12 +310,10 @@ bool FtpProtocolHandler::download(std::shared_ptr<DownloadTask> task, const Prog
         if (res == CURLE_OK) {
             Utils::Logger::instance().log(Utils::LogLevel::INFO, 
                 "FTP download completed successfully: " + task->getUrl());
-            curl_easy_cleanup(curl);
             return true;
         } else {
             Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
                 "FTP download failed: " + std::string(curl_easy_strerror(res)));
-            curl_easy_cleanup(curl);
             return false;
         }
     } catch (const std::exception& e) {
@@ -0,0 +1,42 @@
+#include "core/HostConnectionCache.h"
+#include "core/CurlHandlePool.h"
+#include "utils/Logger.h"
+
+namespace dm {
+namespace core {
+
+HostConnectionCache& HostConnectionCache::getInstance() {
+    static HostConnectionCache instance;
+    return instance;
+}
+
+int HostConnectionCache::getConnectionCount(const std::string& url) const {
+    std::string key = CurlHandlePool::makeKey(url);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = counts_.find(key);
+    return it != counts_.end() ? it->second : 0;
+}
+
+void HostConnectionCache::setConnectionCount(const std::string& url, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    std::string key = CurlHandlePool::makeKey(url);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    int& current = counts_[key];
+    if (current != count) {
+        current = count;
+        dm::utils::Logger::debug("Learned " + std::to_string(count) + " connections for " + key);
+    }
+}
+
+void HostConnectionCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts_.clear();
+}
+
+} // namespace core
+} // namespace dm
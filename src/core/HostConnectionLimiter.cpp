@@ -0,0 +1,261 @@
+#include "core/HostConnectionLimiter.h"
+#include "core/CurlHandlePool.h"
+#include "core/DnsCache.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+
+namespace dm {
+namespace core {
+
+HostConnectionLimiter& HostConnectionLimiter::getInstance() {
+    static HostConnectionLimiter instance;
+    return instance;
+}
+
+HostConnectionLimiter::Lease HostConnectionLimiter::acquire(const std::string& url, const std::string& owner) {
+    std::string key = CurlHandlePool::makeKey(url);
+    std::string address = DnsCache::getInstance().getAddress(url);
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (now - lastPrune_ >= std::chrono::milliseconds(WAITER_TIMEOUT_MS)) {
+        pruneAll(now);
+    }
+    auto it = hosts_.emplace(key, Host()).first;
+    Host& host = it->second;
+    pruneWaiters(host, now);
+    bool wasWaiting = !host.waiters.empty();
+
+    // Only the owner at the front of the line may take a connection
+    bool first = host.waiters.empty() || host.waiters.front().owner == owner;
+    if (first && admits(key, &host, address)) {
+        if (!host.waiters.empty()) {
+            host.waiters.pop_front();
+        }
+        if (wasWaiting && host.waiters.empty()) {
+            waitingHosts_--;
+        }
+
+        host.connections++;
+        if (!address.empty()) {
+            addresses_[address]++;
+        }
+        connections_++;
+
+        Lease lease = nextLease_++;
+        leases_[lease] = LeaseInfo{key, address};
+        return lease;
+    }
+
+    // Keep the owner's place, or line it up at the back
+    auto waiter = std::find_if(host.waiters.begin(), host.waiters.end(),
+                               [&owner](const Waiter& w) { return w.owner == owner; });
+    if (waiter != host.waiters.end()) {
+        waiter->lastAsked = now;
+    } else {
+        host.waiters.push_back(Waiter{owner, now});
+    }
+    if (!wasWaiting) {
+        waitingHosts_++;
+    }
+    return 0;
+}
+
+void HostConnectionLimiter::release(Lease lease) {
+    if (lease == 0) {
+        return;
+    }
+
+    ReleaseCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = leases_.find(lease);
+        if (it == leases_.end()) {
+            return;
+        }
+
+        auto host = hosts_.find(it->second.host);
+        if (host != hosts_.end()) {
+            host->second.connections--;
+            eraseIfIdle(host);
+        }
+        auto address = addresses_.find(it->second.address);
+        if (address != addresses_.end() && --address->second <= 0) {
+            addresses_.erase(address);
+        }
+        connections_--;
+        leases_.erase(it);
+
+        if (waitingHosts_ > 0) {
+            callback = releaseCallback_;
+        }
+    }
+
+    // Let the waiting owners ask again
+    if (callback) {
+        callback();
+    }
+}
+
+void HostConnectionLimiter::withdraw(const std::string& owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = hosts_.begin(); it != hosts_.end();) {
+        auto& waiters = it->second.waiters;
+        bool wasWaiting = !waiters.empty();
+        waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                     [&owner](const Waiter& w) { return w.owner == owner; }),
+                      waiters.end());
+        if (wasWaiting && waiters.empty()) {
+            waitingHosts_--;
+        }
+
+        if (it->second.connections <= 0 && waiters.empty()) {
+            it = hosts_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool HostConnectionLimiter::hasCapacity(const std::string& url) const {
+    std::string key = CurlHandlePool::makeKey(url);
+    std::string address = DnsCache::getInstance().getAddress(url);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(key);
+    const Host* host = it != hosts_.end() ? &it->second : nullptr;
+    if (host && !host->waiters.empty()) {
+        return false;
+    }
+    return admits(key, host, address);
+}
+
+int HostConnectionLimiter::getConnectionCount(const std::string& url) const {
+    std::string key = CurlHandlePool::makeKey(url);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(key);
+    return it != hosts_.end() ? it->second.connections : 0;
+}
+
+int HostConnectionLimiter::getTotalConnectionCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_;
+}
+
+void HostConnectionLimiter::setLimits(int perHost, int perAddress, int total) {
+    ReleaseCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        maxPerHost_ = std::max(0, perHost);
+        maxPerAddress_ = std::max(0, perAddress);
+        maxTotal_ = std::max(0, total);
+        callback = releaseCallback_;
+    }
+
+    dm::utils::Logger::info("Connection limits: " + std::to_string(perHost) + " per host, " +
+                            std::to_string(perAddress) + " per address, " +
+                            std::to_string(total) + " overall");
+
+    // Raised limits may admit waiting owners
+    if (callback) {
+        callback();
+    }
+}
+
+void HostConnectionLimiter::setMaxConnections(int total) {
+    ReleaseCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (maxTotal_ == std::max(0, total)) {
+            return;
+        }
+        maxTotal_ = std::max(0, total);
+        callback = releaseCallback_;
+    }
+
+    if (callback) {
+        callback();
+    }
+}
+
+int HostConnectionLimiter::getMaxConnectionsPerHost() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxPerHost_;
+}
+
+int HostConnectionLimiter::getMaxConnectionsPerAddress() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxPerAddress_;
+}
+
+int HostConnectionLimiter::getMaxConnections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxTotal_;
+}
+
+void HostConnectionLimiter::setReleaseCallback(ReleaseCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    releaseCallback_ = callback;
+}
+
+bool HostConnectionLimiter::admits(const std::string& key, const Host* host, const std::string& address) const {
+    int connections = host ? host->connections : 0;
+    if (maxTotal_ > 0 && connections_ >= maxTotal_) {
+        return false;
+    }
+    if (maxPerHost_ > 0 && connections >= maxPerHost_) {
+        return false;
+    }
+    if (maxPerAddress_ > 0 && !address.empty()) {
+        auto it = addresses_.find(address);
+        if (it != addresses_.end() && it->second >= maxPerAddress_) {
+            return false;
+        }
+    }
+
+    // Beyond an even share an origin leaves one free connection for each
+    // other origin that is waiting
+    if (maxTotal_ > 0) {
+        int origins = static_cast<int>(hosts_.size()) + (hosts_.count(key) ? 0 : 1);
+        int share = std::max(1, maxTotal_ / origins);
+        int othersWaiting = waitingHosts_ - (host && !host->waiters.empty() ? 1 : 0);
+        if (connections >= share && maxTotal_ - connections_ <= othersWaiting) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HostConnectionLimiter::pruneWaiters(Host& host, std::chrono::steady_clock::time_point now) {
+    bool wasWaiting = !host.waiters.empty();
+    auto timeout = std::chrono::milliseconds(WAITER_TIMEOUT_MS);
+    host.waiters.erase(std::remove_if(host.waiters.begin(), host.waiters.end(),
+                                      [now, timeout](const Waiter& w) { return now - w.lastAsked > timeout; }),
+                       host.waiters.end());
+    if (wasWaiting && host.waiters.empty()) {
+        waitingHosts_--;
+    }
+}
+
+void HostConnectionLimiter::pruneAll(std::chrono::steady_clock::time_point now) {
+    lastPrune_ = now;
+    for (auto it = hosts_.begin(); it != hosts_.end();) {
+        pruneWaiters(it->second, now);
+        if (it->second.connections <= 0 && it->second.waiters.empty()) {
+            it = hosts_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HostConnectionLimiter::eraseIfIdle(std::unordered_map<std::string, Host>::iterator it) {
+    if (it->second.connections <= 0 && it->second.waiters.empty()) {
+        hosts_.erase(it);
+    }
+}
+
+} // namespace core
+} // namespace dm
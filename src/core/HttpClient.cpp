@@ -1,23 +1,96 @@
 #include "core/HttpClient.h"
+#include "core/CurlHandlePool.h"
+#include "core/DnsCache.h"
+#include "core/LinkStats.h"
+#include "core/SocketTuner.h"
+#include "core/Throttler.h"
+#include "core/OutputFile.h"
 #include "utils/Logger.h"
+#include "utils/Tracer.h"
 #include <sstream>
 #include <fstream>
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <string_view>
 
 namespace dm {
 namespace core {
 
+#ifdef DM_ENABLE_TRACING
+namespace {
+
+// Split a finished transfer into spans from the phase timings CURL keeps,
+// each measured from the start of the transfer
+void traceTransferPhases(CURL* curl, int64_t startNs) {
+    const char* names[] = {"dns", "tcp connect", "tls handshake", "server wait", "body transfer"};
+    int64_t ends[5] = {};
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    const CURLINFO infos[] = {CURLINFO_NAMELOOKUP_TIME_T, CURLINFO_CONNECT_TIME_T, CURLINFO_APPCONNECT_TIME_T,
+                              CURLINFO_STARTTRANSFER_TIME_T, CURLINFO_TOTAL_TIME_T};
+    for (int i = 0; i < 5; i++) {
+        curl_off_t micros = 0;
+        if (curl_easy_getinfo(curl, infos[i], &micros) == CURLE_OK) {
+            ends[i] = static_cast<int64_t>(micros) * 1000;
+        }
+    }
+#else
+    const CURLINFO infos[] = {CURLINFO_NAMELOOKUP_TIME, CURLINFO_CONNECT_TIME, CURLINFO_APPCONNECT_TIME,
+                              CURLINFO_STARTTRANSFER_TIME, CURLINFO_TOTAL_TIME};
+    for (int i = 0; i < 5; i++) {
+        double seconds = 0.0;
+        if (curl_easy_getinfo(curl, infos[i], &seconds) == CURLE_OK) {
+            ends[i] = static_cast<int64_t>(seconds * 1e9);
+        }
+    }
+#endif
+
+    // Phases a reused connection or plain HTTP skipped report zero
+    dm::utils::Tracer& tracer = dm::utils::Tracer::getInstance();
+    int64_t previous = 0;
+    for (int i = 0; i < 5; i++) {
+        if (ends[i] > previous) {
+            tracer.record(names[i], startNs + previous, ends[i] - previous);
+            previous = ends[i];
+        }
+    }
+}
+
+} // namespace
+#endif
+
 // Structure to pass to CURL callbacks
 struct CurlCallbackData {
     HttpResponse* response;
     DataCallback dataCallback;
+    HeadersCallback headersCallback;
     ProgressCallback progressCallback;
+    Throttler* throttler;
+    const std::atomic<bool>* clientAborted;
     bool aborted;
+    size_t maxBodySize;         // Cut the body off here and succeed
+    size_t bodyLimit;           // Fail once the body is larger than this
+    bool truncated;
+    bool tooLarge;
+    bool decoding;              // Content-Length is the encoded size
+    bool headersDelivered;
+    CURL* curl;
+    int64_t rangeStart;         // A 200 reply carries the whole file when above 0
+    bool rangeIgnored;
+    std::chrono::steady_clock::time_point nextLinkSample;
+    std::vector<curl_socket_t> sockets;     // Opened for this transfer, none on a reused connection
     
     CurlCallbackData(HttpResponse* resp) 
-        : response(resp), dataCallback(nullptr), progressCallback(nullptr), aborted(false) {}
+        : response(resp), dataCallback(nullptr), headersCallback(nullptr), progressCallback(nullptr),
+          throttler(nullptr), clientAborted(nullptr), aborted(false),
+          maxBodySize(0), bodyLimit(0), truncated(false), tooLarge(false), decoding(false), headersDelivered(false),
+          curl(nullptr), rangeStart(-1), rangeIgnored(false) {}
+    
+    static constexpr size_t MAX_SOCKETS = 8;    // Connect attempts remembered for the link samples
 };
 
 // Callback for receiving data from CURL
@@ -31,17 +104,70 @@ size_t HttpClient::writeCallback(void* contents, size_t size, size_t nmemb, void
             return 0; // Abort the transfer
         }
         
-        // If there's a data callback, use it
+        // The first body data follows the final response's headers
+        if (!data->headersDelivered) {
+            data->headersDelivered = true;
+            
+            // A 200 reply to a range request carries the whole file, not the range
+            if (data->rangeStart > 0) {
+                long statusCode = 0;
+                curl_easy_getinfo(data->curl, CURLINFO_RESPONSE_CODE, &statusCode);
+                if (statusCode == 200) {
+                    data->rangeIgnored = true;
+                    return 0; // Abort the transfer
+                }
+            }
+            
+            if (data->headersCallback && !data->headersCallback(data->response->headers)) {
+                data->truncated = true;
+                return 0; // Skip the body
+            }
+            
+            // Size a stored body once from Content-Length instead of growing it chunk by chunk
+            int64_t expected = data->response->headers.getContentLength();
+            if (!data->dataCallback && !data->decoding && expected >= 0) {
+                size_t limit = data->maxBodySize > 0 ? data->maxBodySize : data->bodyLimit;
+                if (limit > 0 && static_cast<uint64_t>(expected) > limit) {
+                    expected = static_cast<int64_t>(limit);
+                }
+                data->response->body.reserve(static_cast<size_t>(expected));
+            }
+        }
+        
+        // Wait for bandwidth, waking up periodically to notice abort()
+        if (data->throttler) {
+            while (!data->throttler->requestWithTimeout(static_cast<int64_t>(realSize), 100)) {
+                if (data->clientAborted && *data->clientAborted) {
+                    data->aborted = true;
+                    return 0; // Abort the transfer
+                }
+            }
+        }
+        
+        // If there's a data callback, it consumes the data
         if (data->dataCallback) {
             if (!data->dataCallback(static_cast<char*>(contents), realSize)) {
                 data->aborted = true;
                 return 0; // Abort the transfer
             }
+            return realSize;
         }
         
         // Store the data in the response body
         const char* bytes = static_cast<char*>(contents);
-        data->response->body.insert(data->response->body.end(), bytes, bytes + realSize);
+        std::vector<char>& body = data->response->body;
+        if (data->maxBodySize > 0 && body.size() + realSize > data->maxBodySize) {
+            // Enough of the body, stop the transfer
+            body.insert(body.end(), bytes, bytes + (data->maxBodySize - body.size()));
+            data->truncated = true;
+            return 0;
+        }
+        if (data->bodyLimit > 0 && body.size() + realSize > data->bodyLimit) {
+            // Too large to hold in memory, the caller should stream it
+            data->tooLarge = true;
+            return 0;
+        }
+        body.insert(body.end(), bytes, bytes + realSize);
         
         return realSize;
     } catch (const std::exception& e) {
@@ -61,37 +187,8 @@ size_t HttpClient::headerCallback(void* contents, size_t size, size_t nmemb, voi
             return 0; // Abort the transfer
         }
         
-        // Parse the header
-        std::string header(static_cast<char*>(contents), realSize);
-        
-        // Trim trailing CR/LF
-        header.erase(std::remove(header.begin(), header.end(), '\r'), header.end());
-        header.erase(std::remove(header.begin(), header.end(), '\n'), header.end());
-        
-        // Skip empty headers
-        if (header.empty()) {
-            return realSize;
-        }
-        
-        // Split header into name and value
-        size_t colonPos = header.find(':');
-        if (colonPos != std::string::npos) {
-            std::string name = header.substr(0, colonPos);
-            std::string value = header.substr(colonPos + 1);
-            
-            // Trim leading/trailing whitespace
-            name.erase(0, name.find_first_not_of(" \t"));
-            name.erase(name.find_last_not_of(" \t") + 1);
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t") + 1);
-            
-            // Convert header name to lowercase for case-insensitive lookup
-            std::transform(name.begin(), name.end(), name.begin(), 
-                          [](unsigned char c) { return std::tolower(c); });
-            
-            // Store the header
-            data->response->headers[name] = value;
-        }
+        // Parsed in place, the headers copy what they keep
+        data->response->headers.addLine(std::string_view(static_cast<char*>(contents), realSize));
         
         return realSize;
     } catch (const std::exception& e) {
@@ -106,10 +203,15 @@ int HttpClient::progressCallback(void* clientp, double dltotal, double dlnow, do
     
     try {
         // Check if the operation has been aborted
-        if (data->aborted) {
+        if (data->aborted || (data->clientAborted && *data->clientAborted)) {
+            data->aborted = true;
             return 1; // Abort the transfer
         }
         
+        // Long transfers feed the link figures while they run
+        LinkStats::getInstance().sampleTransfer(data->curl, data->sockets.data(), data->sockets.size(),
+                                                data->nextLinkSample);
+        
         // If there's a progress callback, use it
         if (data->progressCallback) {
             if (!data->progressCallback(
@@ -129,19 +231,33 @@ int HttpClient::progressCallback(void* clientp, double dltotal, double dlnow, do
     }
 }
 
-HttpClient::HttpClient() {
-    // Initialize CURL
-    curl_ = curl_easy_init();
-    if (!curl_) {
-        throw std::runtime_error("Failed to initialize CURL");
+// Callback opening the sockets of new connections, remembered for the link
+// samples; LinkStats only measures the one the connection ends up using
+curl_socket_t HttpClient::openSocketCallback(void* clientp, curlsocktype purpose, struct curl_sockaddr* address) {
+    CurlCallbackData* data = static_cast<CurlCallbackData*>(clientp);
+    curl_socket_t socket = ::socket(address->family, address->socktype, address->protocol);
+    if (socket != CURL_SOCKET_BAD && purpose == CURLSOCKTYPE_IPCXN) {
+        if (data->sockets.size() >= CurlCallbackData::MAX_SOCKETS) {
+            data->sockets.erase(data->sockets.begin());
+        }
+        data->sockets.push_back(socket);
     }
+    return socket;
+}
+
+HttpClient::HttpClient() {
+    // Handles are checked out of the shared pool per request
 }
 
 HttpClient::~HttpClient() {
-    // Clean up CURL
-    if (curl_) {
-        curl_easy_cleanup(curl_);
-        curl_ = nullptr;
+    // Free any lists left over from an interrupted request
+    if (headerList_) {
+        curl_slist_free_all(headerList_);
+        headerList_ = nullptr;
+    }
+    if (resolveList_) {
+        curl_slist_free_all(resolveList_);
+        resolveList_ = nullptr;
     }
 }
 
@@ -175,38 +291,83 @@ HttpClient& HttpClient::setDataCallback(DataCallback callback) {
     return *this;
 }
 
+HttpClient& HttpClient::setProxy(const std::string& proxy) {
+    proxy_ = proxy;
+    return *this;
+}
+
+HttpClient& HttpClient::setHeadersCallback(HeadersCallback callback) {
+    headersCallback_ = callback;
+    return *this;
+}
+
 HttpClient& HttpClient::followRedirects(bool follow) {
     followRedirects_ = follow;
     return *this;
 }
 
+HttpClient& HttpClient::setThrottler(std::shared_ptr<Throttler> throttler) {
+    throttler_ = throttler;
+    return *this;
+}
+
+HttpClient& HttpClient::setMaxBodySize(size_t maxBodySize) {
+    maxBodySize_ = maxBodySize;
+    return *this;
+}
+
+HttpClient& HttpClient::setAcceptCompression(bool accept) {
+    acceptCompression_ = accept;
+    return *this;
+}
+
 void HttpClient::setupCurlOptions(CURL* curl, const std::string& url) {
     // Reset the aborted flag
     aborted_ = false;
+    decodingBody_ = false;
     
     // Set the URL
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     
+    // Connect to prefetched addresses (freed in performRequest)
+    if (resolveList_) {
+        curl_slist_free_all(resolveList_);
+    }
+    resolveList_ = DnsCache::getInstance().apply(curl, url);
+    
     // Set the user agent
     curl_easy_setopt(curl, CURLOPT_USERAGENT, userAgent_.c_str());
     
-    // Set timeout
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(timeoutSeconds_));
+    // Set timeout (throttled transfers only fail when they stall)
+    if (throttler_) {
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(timeoutSeconds_));
+    } else {
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(timeoutSeconds_));
+    }
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, static_cast<long>(timeoutSeconds_));
     
+    // Go out through the proxy given (handles come back reset without one)
+    if (!proxy_.empty()) {
+        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_.c_str());
+    }
+    
     // Follow redirects if requested
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, followRedirects_ ? 1L : 0L);
     curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 10L);
     
-    // Set up headers
-    struct curl_slist* headerList = nullptr;
+    // Set up headers (freed in performRequest once the transfer is done)
+    if (headerList_) {
+        curl_slist_free_all(headerList_);
+        headerList_ = nullptr;
+    }
     for (const auto& header : headers_) {
         std::string headerStr = header.first + ": " + header.second;
-        headerList = curl_slist_append(headerList, headerStr.c_str());
+        headerList_ = curl_slist_append(headerList_, headerStr.c_str());
     }
     
-    if (headerList) {
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
+    if (headerList_) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList_);
     }
     
     // Set up cookies
@@ -227,15 +388,25 @@ void HttpClient::setupCurlOptions(CURL* curl, const std::string& url) {
     
     // Set TCP keepalive
     curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    SocketTuner::getInstance().apply(curl);
 }
 
-HttpResponse HttpClient::performRequest(CURL* curl) {
+HttpResponse HttpClient::performRequest(CURL* curl, size_t maxBodySize, DataCallback dataCallback,
+                                        int64_t rangeStart) {
     HttpResponse response;
     CurlCallbackData callbackData(&response);
+    callbackData.curl = curl;
+    callbackData.rangeStart = rangeStart;
+    callbackData.maxBodySize = maxBodySize;
+    callbackData.bodyLimit = maxBodySize_;
     
     // Set up callbacks
-    callbackData.dataCallback = dataCallback_;
+    callbackData.dataCallback = dataCallback ? std::move(dataCallback) : dataCallback_;
+    callbackData.headersCallback = headersCallback_;
     callbackData.progressCallback = progressCallback_;
+    callbackData.throttler = throttler_.get();
+    callbackData.clientAborted = &aborted_;
+    callbackData.decoding = decodingBody_;
     
     // Set write callback
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
@@ -245,30 +416,83 @@ HttpResponse HttpClient::performRequest(CURL* curl) {
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &callbackData);
     
-    // Set progress callback if provided
-    if (progressCallback_) {
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-        curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progressCallback);
-        curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, &callbackData);
-    } else {
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-    }
+    // Set progress callback, always on since it samples the link as well
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progressCallback);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, &callbackData);
+    curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, openSocketCallback);
+    curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, &callbackData);
     
     // Perform the request
+#ifdef DM_ENABLE_TRACING
+    int64_t traceStartNs = dm::utils::Tracer::getInstance().isEnabled() ? dm::utils::Tracer::nowNanoseconds() : 0;
+#endif
     CURLcode result = curl_easy_perform(curl);
+    LinkStats::getInstance().recordTransfer(curl, result);
+#ifdef DM_ENABLE_TRACING
+    if (traceStartNs > 0) {
+        traceTransferPhases(curl, traceStartNs);
+    }
+#endif
+    
+    // The header and resolve lists are no longer referenced by the handle
+    if (headerList_) {
+        curl_slist_free_all(headerList_);
+        headerList_ = nullptr;
+    }
+    if (resolveList_) {
+        curl_slist_free_all(resolveList_);
+        resolveList_ = nullptr;
+    }
     
     // Get the status code
     long statusCode = 0;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
     response.statusCode = static_cast<int>(statusCode);
+    response.curlCode = result;
+#if LIBCURL_VERSION_NUM >= 0x074200
+    curl_off_t retryAfter = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retryAfter) == CURLE_OK && retryAfter > 0) {
+        response.retryAfter = static_cast<int>(std::min<curl_off_t>(retryAfter, INT32_MAX));
+    }
+#endif
+    
+    char* effectiveUrl = nullptr;
+    if (curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effectiveUrl) == CURLE_OK && effectiveUrl) {
+        response.effectiveUrl = effectiveUrl;
+    }
+    parseEntityHeaders(response);
+    
+    // The length of an encoded body says nothing about its decoded size
+    std::string_view encoding = response.headers.getContentEncoding();
+    if (decodingBody_ && !encoding.empty() && encoding != "identity") {
+        response.contentLength = -1;
+    }
+    
+    // Cutting the body short on purpose is not a failure
+    if (result == CURLE_WRITE_ERROR && callbackData.truncated) {
+        result = CURLE_OK;
+    }
     
     // Check for errors
-    if (result != CURLE_OK && !callbackData.aborted) {
+    if (callbackData.rangeIgnored) {
+        response.error = "Server ignored range request";
+        response.success = false;
+    } else if (callbackData.tooLarge) {
+        response.body = std::vector<char>();
+        response.error = "Response body larger than " + std::to_string(maxBodySize_) + " bytes";
+        response.success = false;
+    } else if (result != CURLE_OK && !callbackData.aborted) {
         response.error = curl_easy_strerror(result);
         response.success = false;
     } else if (callbackData.aborted) {
         response.error = "Request aborted";
         response.success = false;
+    } else if (statusCode >= 400 && !isFtpUrl(response.effectiveUrl)) {
+        // FTP failures are reported as CURL errors, a ranged RETR that
+        // is aborted once complete may still end on a 426
+        response.error = "HTTP error " + std::to_string(statusCode);
+        response.success = false;
     } else {
         response.success = true;
     }
@@ -280,8 +504,9 @@ HttpResponse HttpClient::head(const std::string& url) {
     // Log the request
     dm::utils::Logger::debug("HTTP HEAD: " + url);
     
-    // Create a new CURL handle
-    CURL* curl = curl_easy_init();
+    // Check out a pooled CURL handle
+    PooledCurlHandle handle(url, proxy_);
+    CURL* curl = handle.get();
     if (!curl) {
         HttpResponse response;
         response.error = "Failed to initialize CURL";
@@ -298,9 +523,6 @@ HttpResponse HttpClient::head(const std::string& url) {
     // Perform the request
     HttpResponse response = performRequest(curl);
     
-    // Clean up
-    curl_easy_cleanup(curl);
-    
     // Log the response
     dm::utils::Logger::debug("HTTP Response: " + std::to_string(response.statusCode) + 
                            (response.success ? " (Success)" : " (Error: " + response.error + ")"));
@@ -309,11 +531,18 @@ HttpResponse HttpClient::head(const std::string& url) {
 }
 
 HttpResponse HttpClient::get(const std::string& url) {
+    return get(url, nullptr);
+}
+
+HttpResponse HttpClient::get(const std::string& url, DataCallback dataCallback) {
+    DM_TRACE_SPAN("http get");
+
     // Log the request
     dm::utils::Logger::debug("HTTP GET: " + url);
     
-    // Create a new CURL handle
-    CURL* curl = curl_easy_init();
+    // Check out a pooled CURL handle
+    PooledCurlHandle handle(url, proxy_);
+    CURL* curl = handle.get();
     if (!curl) {
         HttpResponse response;
         response.error = "Failed to initialize CURL";
@@ -324,14 +553,18 @@ HttpResponse HttpClient::get(const std::string& url) {
     // Set up CURL options
     setupCurlOptions(curl, url);
     
-    // Set GET method
+    // Set GET method, safe to replay as early data
     curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    CurlHandlePool::enableEarlyData(curl);
     
-    // Perform the request
-    HttpResponse response = performRequest(curl);
+    // An empty list offers every encoding libcurl was built to decode
+    if (acceptCompression_) {
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        decodingBody_ = true;
+    }
     
-    // Clean up
-    curl_easy_cleanup(curl);
+    // Perform the request
+    HttpResponse response = performRequest(curl, 0, std::move(dataCallback));
     
     // Log the response
     dm::utils::Logger::debug("HTTP Response: " + std::to_string(response.statusCode) + 
@@ -341,12 +574,15 @@ HttpResponse HttpClient::get(const std::string& url) {
 }
 
 HttpResponse HttpClient::getRange(const std::string& url, int64_t startByte, int64_t endByte) {
+    DM_TRACE_SPAN("http get range");
+
     // Log the request
     dm::utils::Logger::debug("HTTP GET Range: " + url + " [" + 
                            std::to_string(startByte) + "-" + std::to_string(endByte) + "]");
     
-    // Create a new CURL handle
-    CURL* curl = curl_easy_init();
+    // Check out a pooled CURL handle
+    PooledCurlHandle handle(url, proxy_);
+    CURL* curl = handle.get();
     if (!curl) {
         HttpResponse response;
         response.error = "Failed to initialize CURL";
@@ -357,8 +593,9 @@ HttpResponse HttpClient::getRange(const std::string& url, int64_t startByte, int
     // Set up CURL options
     setupCurlOptions(curl, url);
     
-    // Set GET method
+    // Set GET method, safe to replay as early data
     curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    CurlHandlePool::enableEarlyData(curl);
     
     // Set range
     std::string range = std::to_string(startByte) + "-";
@@ -368,10 +605,7 @@ HttpResponse HttpClient::getRange(const std::string& url, int64_t startByte, int
     curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
     
     // Perform the request
-    HttpResponse response = performRequest(curl);
-    
-    // Clean up
-    curl_easy_cleanup(curl);
+    HttpResponse response = performRequest(curl, 0, nullptr, startByte);
     
     // Log the response
     dm::utils::Logger::debug("HTTP Response: " + std::to_string(response.statusCode) + 
@@ -380,63 +614,209 @@ HttpResponse HttpClient::getRange(const std::string& url, int64_t startByte, int
     return response;
 }
 
-bool HttpClient::supportsRangeRequests(const std::string& url) {
-    // Send a HEAD request to check for range support
-    HttpResponse response = head(url);
+HttpResponse HttpClient::probe(const std::string& url) {
+    // Log the request
+    dm::utils::Logger::debug("HTTP probe: " + url);
     
-    if (!response.success) {
-        return false;
+    // Check out a pooled CURL handle
+    PooledCurlHandle handle(url, proxy_);
+    CURL* curl = handle.get();
+    if (!curl) {
+        HttpResponse response;
+        response.error = "Failed to initialize CURL";
+        response.success = false;
+        return response;
     }
     
-    // Check for Accept-Ranges header
-    auto it = response.headers.find("accept-ranges");
-    if (it != response.headers.end() && it->second == "bytes") {
-        return true;
+    // Set up CURL options
+    setupCurlOptions(curl, url);
+    
+    if (isFtpUrl(url)) {
+        // SIZE, MDTM and REST 0 come back as Content-Length, Last-Modified
+        // and Accept-ranges; the control connection stays logged in
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+        
+        HttpResponse response = performRequest(curl);
+        
+        // The last reply is REST's 350, not a 2xx
+        response.acceptsRanges = response.success && response.headers.acceptsByteRanges();
+        
+        dm::utils::Logger::debug("FTP Response: " + std::to_string(response.statusCode) + 
+                               (response.success ? " (Success)" : " (Error: " + response.error + ")"));
+        
+        return response;
+    }
+    
+    // Ask for the first byte, a 206 completes and keeps the connection
+    // warm for the first segment
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, "0-0");
+    CurlHandlePool::enableEarlyData(curl);
+    
+    // Perform the request, a full 200 body is cut off after the headers
+    HttpResponse response = performRequest(curl, 1);
+    
+    // An empty resource cannot satisfy the range but still has a size
+    if (response.statusCode == 416 && response.contentLength == 0) {
+        response.success = true;
+        response.error.clear();
     }
     
-    // Try with a small range request
-    response = getRange(url, 0, 1);
+    // Log the response
+    dm::utils::Logger::debug("HTTP Response: " + std::to_string(response.statusCode) + 
+                           (response.success ? " (Success)" : " (Error: " + response.error + ")"));
     
-    // Check if the response is partial content (206)
-    return response.success && response.statusCode == 206;
+    return response;
+}
+
+bool HttpClient::supportsRangeRequests(const std::string& url) {
+    HttpResponse response = probe(url);
+    return response.success && response.acceptsRanges;
 }
 
 int64_t HttpClient::getContentLength(const std::string& url) {
-    // Send a HEAD request to get the content length
-    HttpResponse response = head(url);
+    HttpResponse response = probe(url);
+    return response.success ? response.contentLength : -1;
+}
+
+std::string HttpClient::getLastModified(const std::string& url) {
+    HttpResponse response = probe(url);
+    return response.success ? response.lastModified : "";
+}
+
+bool HttpClient::isFtpUrl(const std::string& url) {
+    auto hasScheme = [&url](const char* scheme) {
+        size_t length = std::strlen(scheme);
+        if (url.size() < length) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (std::tolower(static_cast<unsigned char>(url[i])) != scheme[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
     
-    if (!response.success) {
-        return -1;
+    return hasScheme("ftp://") || hasScheme("ftps://");
+}
+
+namespace {
+
+// Hex of a base64 value, empty if it is not valid base64
+std::string base64ToHex(std::string_view value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : value) {
+        int sextet;
+        if (c >= 'A' && c <= 'Z') {
+            sextet = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            sextet = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            sextet = c - '0' + 52;
+        } else if (c == '+' || c == '-') {
+            sextet = 62;
+        } else if (c == '/' || c == '_') {
+            sextet = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return std::string();
+        }
+        bits = (bits << 6) | static_cast<uint32_t>(sextet);
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            unsigned char byte = static_cast<unsigned char>(bits >> count);
+            hex += digits[byte >> 4];
+            hex += digits[byte & 0x0F];
+        }
     }
-    
-    // Look for Content-Length header
-    auto it = response.headers.find("content-length");
-    if (it != response.headers.end()) {
-        try {
-            return std::stoll(it->second);
-        } catch (...) {
-            return -1;
+    return hex;
+}
+
+// Take the SHA-256 (else SHA-512) digest of a Repr-Digest field,
+// "sha-256=:<base64>:" (structured), or of a legacy Digest field,
+// "SHA-256=<base64>"; other algorithms are too weak or unknown here
+bool parseDigestField(std::string_view field, bool structured, std::string& algorithm, std::string& digest) {
+    bool found = false;
+    while (!field.empty()) {
+        size_t comma = field.find(',');
+        std::string_view item = field.substr(0, comma);
+        field = comma == std::string_view::npos ? std::string_view() : field.substr(comma + 1);
+
+        size_t equals = item.find('=');
+        if (equals == std::string_view::npos) {
+            continue;
+        }
+        std::string name;
+        for (char c : item.substr(0, equals)) {
+            if (!std::isspace(static_cast<unsigned char>(c))) {
+                name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        std::string_view value = item.substr(equals + 1);
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front()))) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+            value.remove_suffix(1);
+        }
+        if (structured) {
+            if (value.size() < 2 || value.front() != ':' || value.back() != ':') {
+                continue;
+            }
+            value = value.substr(1, value.size() - 2);
+        }
+
+        size_t length = name == "sha-256" ? 64 : name == "sha-512" ? 128 : 0;
+        if (length == 0 || (found && algorithm == "sha-256")) {
+            continue;
+        }
+        std::string hex = base64ToHex(value);
+        if (hex.size() == length) {
+            algorithm = name;
+            digest = hex;
+            found = true;
         }
     }
-    
-    return -1;
+    return found;
 }
 
-std::string HttpClient::getLastModified(const std::string& url) {
-    // Send a HEAD request to get the last modified time
-    HttpResponse response = head(url);
-    
-    if (!response.success) {
-        return "";
+} // namespace
+
+void HttpClient::parseEntityHeaders(HttpResponse& response) {
+    const HttpHeaders& headers = response.headers;
+    response.etag = std::string(headers.getEtag());
+    response.lastModified = std::string(headers.getLastModified());
+    
+    // "bytes 0-0/12345" (or "bytes */12345" on a 416) carries the full size
+    std::string_view contentRange = headers.getContentRange();
+    if (!contentRange.empty()) {
+        size_t slash = contentRange.rfind('/');
+        if (slash != std::string_view::npos) {
+            int64_t length = -1;
+            std::string_view total = contentRange.substr(slash + 1);
+            auto result = std::from_chars(total.data(), total.data() + total.size(), length);
+            response.contentLength = result.ec == std::errc() ? length : -1;    // "*": size unknown
+        }
+    } else if (response.statusCode != 206) {
+        response.contentLength = headers.getContentLength();
     }
     
-    // Look for Last-Modified header
-    auto it = response.headers.find("last-modified");
-    if (it != response.headers.end()) {
-        return it->second;
-    }
+    response.acceptsRanges = response.statusCode == 206 ||
+                             (response.statusCode < 300 && headers.acceptsByteRanges());
     
-    return "";
+    // A digest of the whole file, only as stored (not content-encoded)
+    std::string_view encoding = headers.getContentEncoding();
+    if (response.statusCode < 300 && (encoding.empty() || encoding == "identity") &&
+        !parseDigestField(headers.get("repr-digest"), true, response.digestAlgorithm, response.digest)) {
+        parseDigestField(headers.get("digest"), false, response.digestAlgorithm, response.digest);
+    }
 }
 
 bool HttpClient::downloadFile(const std::string& url, const std::string& filePath,
@@ -527,6 +907,43 @@ bool HttpClient::downloadFileSegment(const std::string& url, const std::string&
     return response.success;
 }
 
+bool HttpClient::downloadFileSegment(const std::string& url, OutputFile& file,
+                                    int64_t startByte, int64_t endByte,
+                                    ProgressCallback progressCallback) {
+    if (!file.isOpen()) {
+        return false;
+    }
+    
+    // Set progress callback if provided
+    ProgressCallback oldCallback = progressCallback_;
+    if (progressCallback) {
+        progressCallback_ = progressCallback;
+    }
+    
+    // Write each chunk at its own offset
+    int64_t offset = startByte > 0 ? startByte : 0;
+    DataCallback oldDataCallback = dataCallback_;
+    dataCallback_ = [&file, &offset](const char* data, size_t size) -> bool {
+        if (!file.writeAt(data, size, offset)) {
+            return false;
+        }
+        offset += static_cast<int64_t>(size);
+        return true;
+    };
+    
+    // Send a range GET request
+    HttpResponse response = getRange(url, startByte, endByte);
+    
+    // Reset callbacks
+    dataCallback_ = oldDataCallback;
+    if (progressCallback) {
+        progressCallback_ = oldCallback;
+    }
+    
+    // Return success status
+    return response.success;
+}
+
 void HttpClient::abort() {
     aborted_ = true;
 }
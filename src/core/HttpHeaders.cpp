@@ -0,0 +1,270 @@
+#include "core/HttpHeaders.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Storage of one set of headers
+ *
+ * The fields vector and the strings share the resource, which starts in
+ * the inline buffer and only goes to the heap for unusually large headers.
+ */
+struct HttpHeaders::Arena {
+    Arena() : resource(buffer, sizeof(buffer)), fields(&resource) {}
+
+    /**
+     * @brief Drop the headers and rewind the resource to the inline buffer
+     */
+    void reset() {
+        std::pmr::vector<Field>(&resource).swap(fields);
+        resource.release();
+        contentLength = -1;
+        acceptsByteRanges = false;
+        contentRange = {};
+        contentType = {};
+        contentEncoding = {};
+        etag = {};
+        lastModified = {};
+    }
+
+    alignas(std::max_align_t) char buffer[ARENA_BUFFER_SIZE];
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::vector<Field> fields;     // Sorted by name
+
+    // Well-known headers, parsed as they are added
+    int64_t contentLength = -1;
+    bool acceptsByteRanges = false;
+    std::string_view contentRange;
+    std::string_view contentType;
+    std::string_view contentEncoding;
+    std::string_view etag;
+    std::string_view lastModified;
+};
+
+namespace {
+
+constexpr size_t INITIAL_FIELD_CAPACITY = 16;
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+HttpHeaders::HttpHeaders(const HttpHeaders& other) {
+    *this = other;
+}
+
+HttpHeaders& HttpHeaders::operator=(const HttpHeaders& other) {
+    if (this == &other) {
+        return *this;
+    }
+    clear();
+    for (const Field& field : other) {
+        add(field.first, field.second);
+    }
+    return *this;
+}
+
+void HttpHeaders::add(std::string_view name, std::string_view value) {
+    Arena& arena = getArena();
+    std::string_view storedName = store(name, true);
+    std::string_view storedValue = store(value, false);
+
+    auto& fields = arena.fields;
+    auto it = std::lower_bound(fields.begin(), fields.end(), storedName,
+                               [](const Field& field, std::string_view key) { return field.first < key; });
+    if (it != fields.end() && it->first == storedName) {
+        it->second = storedValue;
+    } else {
+        fields.insert(it, Field{storedName, storedValue});
+    }
+
+    if (storedName == "content-length") {
+        int64_t length = -1;
+        const char* end = storedValue.data() + storedValue.size();
+        auto result = std::from_chars(storedValue.data(), end, length);
+        arena.contentLength = result.ec == std::errc() && result.ptr == end && length >= 0 ? length : -1;
+    } else if (storedName == "accept-ranges") {
+        arena.acceptsByteRanges = equalsIgnoreCase(storedValue, "bytes");
+    } else if (storedName == "content-range") {
+        arena.contentRange = storedValue;
+    } else if (storedName == "content-type") {
+        arena.contentType = storedValue;
+    } else if (storedName == "content-encoding") {
+        arena.contentEncoding = storedValue;
+    } else if (storedName == "etag") {
+        arena.etag = storedValue;
+    } else if (storedName == "last-modified") {
+        arena.lastModified = storedValue;
+    }
+}
+
+void HttpHeaders::addLine(std::string_view line) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+        line.remove_suffix(1);
+    }
+    if (line.empty()) {
+        return;
+    }
+
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        clear();
+        return;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return;
+    }
+
+    auto trim = [](std::string_view text) {
+        size_t first = text.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            return std::string_view();
+        }
+        return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    };
+    add(trim(line.substr(0, colon)), trim(line.substr(colon + 1)));
+}
+
+void HttpHeaders::clear() {
+    if (arena_) {
+        arena_->reset();
+    }
+}
+
+HttpHeaders::const_iterator HttpHeaders::find(std::string_view name) const {
+    if (!arena_) {
+        return nullptr;
+    }
+    const auto& fields = arena_->fields;
+    auto it = std::lower_bound(fields.begin(), fields.end(), name,
+                               [](const Field& field, std::string_view key) { return field.first < key; });
+    if (it == fields.end() || it->first != name) {
+        return end();
+    }
+    return fields.data() + (it - fields.begin());
+}
+
+std::string_view HttpHeaders::get(std::string_view name) const {
+    const_iterator it = find(name);
+    return it != end() ? it->second : std::string_view();
+}
+
+HttpHeaders::const_iterator HttpHeaders::begin() const {
+    return arena_ ? arena_->fields.data() : nullptr;
+}
+
+HttpHeaders::const_iterator HttpHeaders::end() const {
+    return arena_ ? arena_->fields.data() + arena_->fields.size() : nullptr;
+}
+
+size_t HttpHeaders::size() const {
+    return arena_ ? arena_->fields.size() : 0;
+}
+
+bool HttpHeaders::empty() const {
+    return size() == 0;
+}
+
+int64_t HttpHeaders::getContentLength() const {
+    return arena_ ? arena_->contentLength : -1;
+}
+
+bool HttpHeaders::acceptsByteRanges() const {
+    return arena_ && arena_->acceptsByteRanges;
+}
+
+std::string_view HttpHeaders::getContentRange() const {
+    return arena_ ? arena_->contentRange : std::string_view();
+}
+
+std::string_view HttpHeaders::getContentType() const {
+    return arena_ ? arena_->contentType : std::string_view();
+}
+
+std::string_view HttpHeaders::getContentEncoding() const {
+    return arena_ ? arena_->contentEncoding : std::string_view();
+}
+
+std::string_view HttpHeaders::getEtag() const {
+    return arena_ ? arena_->etag : std::string_view();
+}
+
+std::string_view HttpHeaders::getLastModified() const {
+    return arena_ ? arena_->lastModified : std::string_view();
+}
+
+HttpHeaders::Arena& HttpHeaders::getArena() {
+    if (!arena_) {
+        std::vector<Arena*>* idle = getIdleArenas();
+        if (idle && !idle->empty()) {
+            arena_.reset(idle->back());
+            idle->pop_back();
+        } else {
+            arena_.reset(new Arena());
+        }
+        arena_->fields.reserve(INITIAL_FIELD_CAPACITY);
+    }
+    return *arena_;
+}
+
+std::string_view HttpHeaders::store(std::string_view text, bool lowercase) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    char* copy = static_cast<char*>(getArena().resource.allocate(text.size(), 1));
+    if (lowercase) {
+        std::transform(text.begin(), text.end(), copy,
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    } else {
+        std::memcpy(copy, text.data(), text.size());
+    }
+    return std::string_view(copy, text.size());
+}
+
+std::vector<HttpHeaders::Arena*>* HttpHeaders::getIdleArenas() {
+    // Headers that outlive their thread's pool free their arena directly
+    thread_local bool alive = false;
+    thread_local struct Pool {
+        Pool() {
+            alive = true;
+        }
+        ~Pool() {
+            alive = false;
+            for (Arena* arena : arenas) {
+                delete arena;
+            }
+        }
+        std::vector<Arena*> arenas;
+    } pool;
+    return alive ? &pool.arenas : nullptr;
+}
+
+void HttpHeaders::ArenaDeleter::operator()(Arena* arena) const {
+    std::vector<Arena*>* idle = getIdleArenas();
+    if (!idle || idle->size() >= MAX_IDLE_ARENAS) {
+        delete arena;
+        return;
+    }
+    arena->reset();
+    idle->push_back(arena);
+}
+
+} // namespace core
+} // namespace dm
@@ -76,7 +76,6 @@ bool HttpProtocolHandler::startDownload(const std::string& url,
     }
     
     utils::Logger::info("[HTTP] Download started for URL: " + url);
-    logMemoryUsage("[HTTP] Before download: " + url);
     
     std::shared_ptr<HttpClient> client = std::make_shared<HttpClient>();
     configureHttpClient(*client, options);
@@ -172,7 +171,6 @@ bool HttpProtocolHandler::startDownload(const std::string& url,
                 }
             }
         }
-        logMemoryUsage("[HTTP] After download: " + url);
         std::lock_guard<std::mutex> lock(clientsMutex_);
         activeClients_.erase(task->getId());
         if (success) {
@@ -265,21 +263,22 @@ std::map<std::string, std::string> HttpProtocolHandler::getMetadata(const std::s
     if (response.success) {
         // Extract interesting headers
         for (const auto& header : response.headers) {
-            if (header.first == "Content-Type") {
-                metadata["content-type"] = header.second;
-            } else if (header.first == "Content-Length") {
-                metadata["content-length"] = header.second;
-            } else if (header.first == "Last-Modified") {
-                metadata["last-modified"] = header.second;
-            } else if (header.first == "ETag") {
-                metadata["etag"] = header.second;
-            } else if (header.first == "Content-Disposition") {
-                metadata["content-disposition"] = header.second;
+            std::string value(header.second);
+            if (header.first == "content-type") {
+                metadata["content-type"] = value;
+            } else if (header.first == "content-length") {
+                metadata["content-length"] = value;
+            } else if (header.first == "last-modified") {
+                metadata["last-modified"] = value;
+            } else if (header.first == "etag") {
+                metadata["etag"] = value;
+            } else if (header.first == "content-disposition") {
+                metadata["content-disposition"] = value;
                 
                 // Try to extract filename from Content-Disposition
                 std::regex fileNameRegex("filename[^;=\\n]*=((['\"]).*?\\2|[^;\\n]*)");
                 std::smatch matches;
-                if (std::regex_search(header.second, matches, fileNameRegex) && matches.size() > 1) {
+                if (std::regex_search(value, matches, fileNameRegex) && matches.size() > 1) {
                     std::string fileName = matches[1].str();
                     // Remove quotes if present
                     if (fileName.size() >= 2 && 
@@ -302,6 +301,7 @@ std::vector<DirectoryEntry> HttpProtocolHandler::listDirectory(const std::string
     
     HttpClient client;
     configureHttpClient(client, options);
+    client.setAcceptCompression(true);
     
     HttpResponse response = client.get(url);
     
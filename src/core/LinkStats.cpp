@@ -0,0 +1,324 @@
+#include "core/LinkStats.h"
+#include "core/EngineMetrics.h"
+
+#include <algorithm>
+#include <cctype>
+
+#ifdef __linux__
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+#endif
+
+namespace dm {
+namespace core {
+
+LinkStats& LinkStats::getInstance() {
+    static LinkStats instance;
+    return instance;
+}
+
+void LinkStats::recordTransfer(CURL* handle, CURLcode code) {
+    // Transfers stopped on purpose say nothing about the link
+    if (code == CURLE_ABORTED_BY_CALLBACK || code == CURLE_WRITE_ERROR) {
+        return;
+    }
+
+    double latencyMs = measureRoundTrip(handle);
+    double firstByteMs = measureFirstByte(handle);
+    bool lost = isNetworkLoss(code);
+    std::string host;
+    double handshakeMs = measureHandshake(handle, host);
+
+    EngineMetrics& metrics = EngineMetrics::getInstance();
+    if (latencyMs > 0.0) {
+        metrics.observe(LatencyMetric::CONNECT, latencyMs / 1000.0);
+    }
+    if (firstByteMs > 0.0) {
+        metrics.observe(LatencyMetric::FIRST_BYTE, firstByteMs / 1000.0);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    transfers_++;
+    if (lost) {
+        lost_++;
+    }
+    if (latencyMs > 0.0) {
+        addLatency(latencyMs);
+    }
+    if (firstByteMs > 0.0) {
+        firstByteSumMs_ += firstByteMs;
+        firstByteSamples_++;
+        recent_.firstByteMs = recent_.firstByteMs > 0.0
+            ? recent_.firstByteMs + RECENT_WEIGHT * (firstByteMs - recent_.firstByteMs)
+            : firstByteMs;
+    }
+    recent_.packetLoss += RECENT_WEIGHT * ((lost ? 100.0 : 0.0) - recent_.packetLoss);
+    recent_.transfers++;
+
+    auto it = handshakes_.find(host);
+    if (host.empty() || (it == handshakes_.end() && handshakes_.size() >= MAX_HANDSHAKE_HOSTS)) {
+        return;
+    }
+    HostHandshakeStats& stats = it != handshakes_.end() ? it->second : handshakes_[host];
+    stats.host = host;
+    if (handshakeMs <= 0.0) {
+        stats.reusedConnections++;
+        return;
+    }
+    stats.minMs = stats.handshakes > 0 ? std::min(stats.minMs, handshakeMs) : handshakeMs;
+    stats.maxMs = std::max(stats.maxMs, handshakeMs);
+    stats.handshakes++;
+    stats.meanMs += (handshakeMs - stats.meanMs) / stats.handshakes;
+}
+
+void LinkStats::sampleTransfer(CURL* handle, const curl_socket_t* sockets, size_t count,
+                               std::chrono::steady_clock::time_point& nextSample) {
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextSample) {
+        return;
+    }
+
+    // Nothing until the transfer has a connected socket
+    curl_socket_t socket = CURL_SOCKET_BAD;
+    for (size_t i = count; i > 0 && socket == CURL_SOCKET_BAD; i--) {
+        if (isConnectionSocket(handle, sockets[i - 1])) {
+            socket = sockets[i - 1];
+        }
+    }
+    if (socket == CURL_SOCKET_BAD) {
+        socket = getActiveSocket(handle);
+    }
+    double latencyMs = measureSocketRoundTrip(socket);
+    if (latencyMs <= 0.0) {
+        return;
+    }
+    nextSample = now + std::chrono::milliseconds(SAMPLE_INTERVAL_MS);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    addLatency(latencyMs);
+}
+
+LinkSample LinkStats::takeSample() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    LinkSample sample;
+    sample.transfers = transfers_;
+    if (latencySamples_ > 0) {
+        sample.latencyMs = latencySumMs_ / latencySamples_;
+    }
+    if (firstByteSamples_ > 0) {
+        sample.firstByteMs = firstByteSumMs_ / firstByteSamples_;
+    }
+    if (transfers_ > 0) {
+        sample.packetLoss = 100.0 * lost_ / transfers_;
+    }
+
+    latencySumMs_ = 0.0;
+    latencySamples_ = 0;
+    firstByteSumMs_ = 0.0;
+    firstByteSamples_ = 0;
+    transfers_ = 0;
+    lost_ = 0;
+    return sample;
+}
+
+LinkSample LinkStats::getRecent() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recent_;
+}
+
+std::vector<HostHandshakeStats> LinkStats::getHandshakeStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<HostHandshakeStats> stats;
+    stats.reserve(handshakes_.size());
+    for (const auto& entry : handshakes_) {
+        stats.push_back(entry.second);
+    }
+    return stats;
+}
+
+void LinkStats::addLatency(double latencyMs) {
+    latencySumMs_ += latencyMs;
+    latencySamples_++;
+    recent_.latencyMs = recent_.latencyMs > 0.0
+        ? recent_.latencyMs + RECENT_WEIGHT * (latencyMs - recent_.latencyMs)
+        : latencyMs;
+}
+
+double LinkStats::measureRoundTrip(CURL* handle) {
+    // The kernel's smoothed RTT covers reused connections as well
+    double socketMs = measureSocketRoundTrip(getActiveSocket(handle));
+    if (socketMs > 0.0) {
+        return socketMs;
+    }
+
+    // A reused connection has no handshake to time
+    long connects = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects) != CURLE_OK || connects <= 0) {
+        return 0.0;
+    }
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    curl_off_t lookup = 0;
+    curl_off_t connect = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &lookup) == CURLE_OK &&
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect) == CURLE_OK && connect > lookup) {
+        return static_cast<double>(connect - lookup) / 1000.0;
+    }
+#else
+    double lookup = 0.0;
+    double connect = 0.0;
+    if (curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME, &lookup) == CURLE_OK &&
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect) == CURLE_OK && connect > lookup) {
+        return (connect - lookup) * 1000.0;
+    }
+#endif
+    return 0.0;
+}
+
+curl_socket_t LinkStats::getActiveSocket(CURL* handle) {
+    curl_socket_t socket = CURL_SOCKET_BAD;
+#if LIBCURL_VERSION_NUM >= 0x072D00
+    if (curl_easy_getinfo(handle, CURLINFO_ACTIVESOCKET, &socket) != CURLE_OK) {
+        socket = CURL_SOCKET_BAD;
+    }
+#else
+    (void)handle;
+#endif
+    return socket;
+}
+
+bool LinkStats::isConnectionSocket(CURL* handle, curl_socket_t socket) {
+#ifdef __linux__
+    long localPort = 0;
+    long peerPort = 0;
+    if (socket == CURL_SOCKET_BAD ||
+        curl_easy_getinfo(handle, CURLINFO_LOCAL_PORT, &localPort) != CURLE_OK || localPort <= 0 ||
+        curl_easy_getinfo(handle, CURLINFO_PRIMARY_PORT, &peerPort) != CURLE_OK || peerPort <= 0) {
+        return false;
+    }
+
+    auto portOf = [](const sockaddr_storage& address) -> long {
+        if (address.ss_family == AF_INET) {
+            return ntohs(reinterpret_cast<const sockaddr_in&>(address).sin_port);
+        }
+        if (address.ss_family == AF_INET6) {
+            return ntohs(reinterpret_cast<const sockaddr_in6&>(address).sin6_port);
+        }
+        return 0;
+    };
+    sockaddr_storage local{};
+    sockaddr_storage peer{};
+    socklen_t localLength = sizeof(local);
+    socklen_t peerLength = sizeof(peer);
+    return getsockname(socket, reinterpret_cast<sockaddr*>(&local), &localLength) == 0 &&
+           getpeername(socket, reinterpret_cast<sockaddr*>(&peer), &peerLength) == 0 &&
+           portOf(local) == localPort && portOf(peer) == peerPort;
+#else
+    (void)handle;
+    (void)socket;
+    return false;
+#endif
+}
+
+double LinkStats::measureSocketRoundTrip(curl_socket_t socket) {
+#ifdef __linux__
+    // A socket left by a failed connect attempt is not measured
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (socket != CURL_SOCKET_BAD && getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 &&
+        info.tcpi_state == TCP_ESTABLISHED && info.tcpi_rtt > 0) {
+        return info.tcpi_rtt / 1000.0;
+    }
+#else
+    (void)socket;
+#endif
+    return 0.0;
+}
+
+double LinkStats::measureFirstByte(CURL* handle) {
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    curl_off_t pretransfer = 0;
+    curl_off_t startTransfer = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer) == CURLE_OK &&
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer) == CURLE_OK &&
+        startTransfer > pretransfer) {
+        return static_cast<double>(startTransfer - pretransfer) / 1000.0;
+    }
+#else
+    double pretransfer = 0.0;
+    double startTransfer = 0.0;
+    if (curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME, &pretransfer) == CURLE_OK &&
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &startTransfer) == CURLE_OK &&
+        startTransfer > pretransfer) {
+        return (startTransfer - pretransfer) * 1000.0;
+    }
+#endif
+    return 0.0;
+}
+
+double LinkStats::measureHandshake(CURL* handle, std::string& host) {
+    host.clear();
+    char* url = nullptr;
+    if (curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK || !url) {
+        return 0.0;
+    }
+
+    // Only TLS schemes, scheme://[user@]host[:port]/...
+    std::string effective = url;
+    size_t schemeEnd = effective.find("://");
+    if (schemeEnd == std::string::npos) {
+        return 0.0;
+    }
+    std::string scheme = effective.substr(0, schemeEnd);
+    std::transform(scheme.begin(), scheme.end(), scheme.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (scheme != "https" && scheme != "ftps") {
+        return 0.0;
+    }
+    size_t start = schemeEnd + 3;
+    size_t end = effective.find_first_of("/?#", start);
+    std::string authority = effective.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    size_t at = authority.rfind('@');
+    host = at == std::string::npos ? authority : authority.substr(at + 1);
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    long connects = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects) != CURLE_OK || connects <= 0) {
+        return 0.0;
+    }
+#if LIBCURL_VERSION_NUM >= 0x073D00
+    curl_off_t connect = 0;
+    curl_off_t appConnect = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect) == CURLE_OK &&
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appConnect) == CURLE_OK && appConnect > connect) {
+        return static_cast<double>(appConnect - connect) / 1000.0;
+    }
+#else
+    double connect = 0.0;
+    double appConnect = 0.0;
+    if (curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect) == CURLE_OK &&
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &appConnect) == CURLE_OK && appConnect > connect) {
+        return (appConnect - connect) * 1000.0;
+    }
+#endif
+    return 0.0;
+}
+
+bool LinkStats::isNetworkLoss(CURLcode code) {
+    switch (code) {
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_GOT_NOTHING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,198 @@
+#include "core/MetadataPrefetcher.h"
+#include "core/DnsCache.h"
+#include "core/ProxyPool.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+
+namespace dm {
+namespace core {
+
+MetadataPrefetcher& MetadataPrefetcher::getInstance() {
+    static MetadataPrefetcher instance;
+    return instance;
+}
+
+MetadataPrefetcher::~MetadataPrefetcher() {
+    shutdown();
+}
+
+void MetadataPrefetcher::prefetch(const std::vector<Request>& requests) {
+    std::vector<std::string> urls;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ttlSeconds_ <= 0 || lookahead_ <= 0 || stopping_) {
+            return;
+        }
+
+        prune();
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& request : requests) {
+            if (request.url.empty() || entries_.size() >= MAX_ENTRIES) {
+                continue;
+            }
+
+            auto it = entries_.find(request.url);
+            if (it != entries_.end() && (it->second.pending || it->second.expires > now)) {
+                continue;
+            }
+
+            Entry& entry = entries_[request.url];
+            entry = Entry();
+            entry.pending = true;
+            queue_.push_back(request);
+            urls.push_back(request.url);
+        }
+
+        // Start prefetch threads as the queue needs them
+        while (workers_.size() < MAX_PREFETCH_THREADS && workers_.size() < queue_.size()) {
+            workers_.emplace_back(&MetadataPrefetcher::workerLoop, this);
+        }
+    }
+
+    if (!urls.empty()) {
+        DnsCache::getInstance().prefetch(urls);
+        changed_.notify_all();
+    }
+}
+
+bool MetadataPrefetcher::take(const std::string& url, const std::string& proxy, HttpResponse& response) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(url);
+    if (it == entries_.end() || it->second.pending) {
+        return false;
+    }
+
+    bool usable = it->second.expires > std::chrono::steady_clock::now() && it->second.proxy == proxy;
+    if (usable) {
+        response = std::move(it->second.response);
+    }
+    entries_.erase(it);
+    return usable;
+}
+
+int64_t MetadataPrefetcher::getFileSize(const std::string& url) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(url);
+    if (it == entries_.end() || it->second.pending || it->second.expires <= std::chrono::steady_clock::now()) {
+        return -1;
+    }
+    return it->second.response.contentLength;
+}
+
+void MetadataPrefetcher::setTtl(int seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ttlSeconds_ = std::max(0, seconds);
+}
+
+int MetadataPrefetcher::getTtl() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ttlSeconds_;
+}
+
+void MetadataPrefetcher::setLookahead(int count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lookahead_ = std::max(0, count);
+}
+
+int MetadataPrefetcher::getLookahead() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lookahead_;
+}
+
+size_t MetadataPrefetcher::getCachedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    return static_cast<size_t>(std::count_if(entries_.begin(), entries_.end(),
+        [now](const std::pair<const std::string, Entry>& pair) {
+            return !pair.second.pending && pair.second.expires > now;
+        }));
+}
+
+void MetadataPrefetcher::shutdown() {
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queue_.clear();
+        workers.swap(workers_);
+    }
+    changed_.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Usable again by a manager initialized later
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    stopping_ = false;
+}
+
+void MetadataPrefetcher::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        changed_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+
+        Request request = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+
+        // The same proxy the download will take, so its connection is the one warmed
+        std::string proxy = ProxyPool::getInstance().pick(request.taskId);
+        HttpResponse response = HttpClient().setProxy(proxy).setTimeout(PROBE_TIMEOUT_SECONDS).probe(request.url);
+        if (!response.success) {
+            dm::utils::Logger::debug("Prefetch probe of " + request.url + " failed: " + response.error);
+        }
+
+        lock.lock();
+        auto it = entries_.find(request.url);
+        if (it == entries_.end()) {
+            continue;
+        }
+        if (!response.success || stopping_) {
+            entries_.erase(it);
+            continue;
+        }
+        it->second.response = std::move(response);
+        it->second.proxy = proxy;
+        it->second.expires = std::chrono::steady_clock::now() + std::chrono::seconds(ttlSeconds_);
+        it->second.pending = false;
+    }
+}
+
+void MetadataPrefetcher::prune() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (!it->second.pending && it->second.expires <= now) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    while (entries_.size() > MAX_ENTRIES) {
+        auto oldest = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (!it->second.pending && (oldest == entries_.end() || it->second.expires < oldest->second.expires)) {
+                oldest = it;
+            }
+        }
+        if (oldest == entries_.end()) {
+            break;
+        }
+        entries_.erase(oldest);
+    }
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,219 @@
+#include "core/MetricsExporter.h"
+#include "core/EngineMetrics.h"
+#include "core/TransferCounters.h"
+#include "utils/ResourceMonitor.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+void writeHeader(std::ostringstream& out, const std::string& name, const char* type, const char* help) {
+    out << "# TYPE " << name << " " << type << "\n";
+    out << "# HELP " << name << " " << help << "\n";
+}
+
+const char* getLatencyHelp(LatencyMetric metric) {
+    switch (metric) {
+        case LatencyMetric::CONNECT: return "Round trip of transfer connections.";
+        case LatencyMetric::FIRST_BYTE: return "Time from request sent to first byte.";
+        case LatencyMetric::THROTTLE_WAIT: return "Time waited for bandwidth by throttled reads.";
+        case LatencyMetric::DISK_WRITE: return "Duration of writes to output files.";
+        default: return "Latency.";
+    }
+}
+
+const char* getEventHelp(EventMetric metric) {
+    switch (metric) {
+        case EventMetric::SEGMENT_RETRIES: return "Segment attempts after the first.";
+        case EventMetric::HASHED_BYTES: return "Bytes fed to streaming hashes.";
+        case EventMetric::HASH_NANOSECONDS: return "Time spent in streaming hashes.";
+        default: return "Events.";
+    }
+}
+
+} // namespace
+
+MetricsExporter::MetricsExporter(GaugeSource source)
+    : source_(std::move(source)) {
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start(const std::string& path, int intervalMs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    intervalMs_ = std::max(MIN_INTERVAL_MS, intervalMs);
+
+    if (thread_.joinable()) {
+        changed_.notify_all();
+        return true;
+    }
+
+    stopping_ = false;
+    EngineMetrics::getInstance().setEnabled(true);
+    try {
+        thread_ = std::thread(&MetricsExporter::exportLoop, this);
+    } catch (const std::system_error& e) {
+        EngineMetrics::getInstance().setEnabled(false);
+        dm::utils::Logger::error("Failed to start metrics exporter: " + std::string(e.what()));
+        return false;
+    }
+
+    dm::utils::Logger::info("Writing metrics to " + path);
+    return true;
+}
+
+void MetricsExporter::stop() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        thread = std::move(thread_);
+    }
+    changed_.notify_all();
+
+    if (thread.joinable()) {
+        thread.join();
+        EngineMetrics::getInstance().setEnabled(false);
+    }
+}
+
+bool MetricsExporter::isRunning() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return thread_.joinable() && !stopping_;
+}
+
+std::string MetricsExporter::render() const {
+    EngineMetrics& metrics = EngineMetrics::getInstance();
+    TransferTotals totals = TransferCounters::getInstance().getTotals();
+    EngineGauges gauges = source_ ? source_() : EngineGauges();
+
+    std::ostringstream out;
+
+    writeHeader(out, "dm_received_bytes", "counter", "Bytes written by segments, retries included.");
+    out << "dm_received_bytes_total " << totals.bytesReceived << "\n";
+
+    writeHeader(out, "dm_downloads", "counter", "Downloads finished, by result.");
+    out << "dm_downloads_total{result=\"completed\"} " << totals.completed << "\n";
+    out << "dm_downloads_total{result=\"failed\"} " << totals.failed << "\n";
+
+    writeHeader(out, "dm_domain_completed_bytes", "counter", "Sizes of completed downloads, by domain.");
+    for (const auto& entry : totals.domains) {
+        out << "dm_domain_completed_bytes_total{domain=\"" << escapeLabel(entry.first) << "\"} "
+            << entry.second.bytes << "\n";
+    }
+
+    for (size_t i = 0; i < static_cast<size_t>(EventMetric::COUNT); i++) {
+        EventMetric metric = static_cast<EventMetric>(i);
+        std::string name = EngineMetrics::getEventName(metric);
+        writeHeader(out, name, "counter", getEventHelp(metric));
+        int64_t value = metrics.getCount(metric);
+        if (metric == EventMetric::HASH_NANOSECONDS) {
+            out << name << "_total " << value / 1e9 << "\n";
+        } else {
+            out << name << "_total " << value << "\n";
+        }
+    }
+
+    writeHeader(out, "dm_queued_downloads", "gauge", "Downloads waiting in the queue.");
+    out << "dm_queued_downloads " << gauges.queuedDownloads << "\n";
+    writeHeader(out, "dm_active_downloads", "gauge", "Downloads transferring.");
+    out << "dm_active_downloads " << gauges.activeDownloads << "\n";
+    writeHeader(out, "dm_active_segments", "gauge", "Segment downloaders alive.");
+    out << "dm_active_segments "
+        << dm::utils::ResourceMonitor::getInstance().getSubsystemUsage(dm::utils::ResourceSubsystem::SEGMENTS).liveObjects
+        << "\n";
+    writeHeader(out, "dm_download_speed_bytes_per_second", "gauge", "Aggregate download speed.");
+    out << "dm_download_speed_bytes_per_second " << gauges.downloadSpeed << "\n";
+    writeHeader(out, "dm_bandwidth_limit_bytes_per_second", "gauge", "Global bandwidth limit, 0 for none.");
+    out << "dm_bandwidth_limit_bytes_per_second " << gauges.bandwidthLimit << "\n";
+    writeHeader(out, "dm_host_speed_bytes_per_second", "gauge", "Download speed, by host.");
+    for (const auto& entry : gauges.hostSpeeds) {
+        out << "dm_host_speed_bytes_per_second{host=\"" << escapeLabel(entry.first) << "\"} " << entry.second << "\n";
+    }
+
+    for (size_t i = 0; i < static_cast<size_t>(LatencyMetric::COUNT); i++) {
+        LatencyMetric metric = static_cast<LatencyMetric>(i);
+        std::string name = std::string(EngineMetrics::getLatencyName(metric)) + "_seconds";
+        LatencySnapshot snapshot = metrics.getLatency(metric);
+        writeHeader(out, name, "histogram", getLatencyHelp(metric));
+        for (size_t b = 0; b < EngineMetrics::BUCKET_BOUNDS.size(); b++) {
+            out << name << "_bucket{le=\"" << EngineMetrics::BUCKET_BOUNDS[b] << "\"} " << snapshot.buckets[b] << "\n";
+        }
+        out << name << "_bucket{le=\"+Inf\"} " << snapshot.count << "\n";
+        out << name << "_sum " << snapshot.sumSeconds << "\n";
+        out << name << "_count " << snapshot.count << "\n";
+    }
+
+    out << "# EOF\n";
+    return out.str();
+}
+
+bool MetricsExporter::writeNow() {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path = path_;
+    }
+    if (path.empty()) {
+        return false;
+    }
+
+    // Written beside the target and renamed over it, readers see one or the other
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out << render();
+        if (!out) {
+            dm::utils::Logger::warning("Failed to write metrics to " + tempPath);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        dm::utils::Logger::warning("Failed to replace metrics file " + path + ": " + error.message());
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::exportLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        writeNow();
+        lock.lock();
+        changed_.wait_for(lock, std::chrono::milliseconds(intervalMs_), [this] { return stopping_; });
+    }
+}
+
+std::string MetricsExporter::escapeLabel(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+} // namespace core
+} // namespace dm
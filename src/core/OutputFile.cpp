@@ -0,0 +1,553 @@
+#include "core/OutputFile.h"
+#include "core/StreamingHasher.h"
+#include "core/PieceVerifier.h"
+#include "core/ContentSniffer.h"
+#include "core/DataFilter.h"
+#include "core/DeviceIoScheduler.h"
+#include "core/EngineMetrics.h"
+#include "utils/Logger.h"
+#include "utils/Tracer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <new>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+constexpr size_t MIN_STAGING_SLAB_SIZE = 64 * 1024;
+constexpr size_t MAX_IDLE_STAGING_BYTES = 16 * 1024 * 1024;
+
+/**
+ * @brief Idle staging slabs by size, kept for the next small file
+ *
+ * Slabs come in powers of two so that files of similar size reuse them.
+ */
+class StagingSlabPool {
+public:
+    static StagingSlabPool& getInstance() {
+        static StagingSlabPool instance;
+        return instance;
+    }
+
+    std::unique_ptr<char[]> acquire(size_t size, size_t& capacity) {
+        capacity = MIN_STAGING_SLAB_SIZE;
+        while (capacity < size) {
+            capacity *= 2;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idle_.find(capacity);
+        if (it != idle_.end()) {
+            std::unique_ptr<char[]> slab = std::move(it->second);
+            idle_.erase(it);
+            idleBytes_ -= capacity;
+            return slab;
+        }
+        return std::unique_ptr<char[]>(new (std::nothrow) char[capacity]);
+    }
+
+    void release(std::unique_ptr<char[]> slab, size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (slab && idleBytes_ + capacity <= MAX_IDLE_STAGING_BYTES) {
+            idle_.emplace(capacity, std::move(slab));
+            idleBytes_ += capacity;
+        }
+    }
+
+private:
+    std::multimap<size_t, std::unique_ptr<char[]>> idle_;
+    size_t idleBytes_ = 0;
+    std::mutex mutex_;
+};
+
+// Write a whole buffer at the current position of a fresh descriptor
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int written = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+#else
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+OutputFile::OutputFile()
+    : staged_(false), stagedSize_(0) {
+}
+
+OutputFile::~OutputFile() {
+    close();
+}
+
+bool OutputFile::open(const std::string& path, bool directIo) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (fd_ >= 0 || staged_) {
+        if (path == path_) {
+            return true;
+        }
+        dm::utils::Logger::error("Output file already open: " + path_);
+        return false;
+    }
+
+#ifdef _WIN32
+    fd_ = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+#endif
+    if (fd_ < 0) {
+        dm::utils::Logger::error("Failed to open output file " + path + ": " + std::strerror(errno));
+        return false;
+    }
+
+    path_ = path;
+    backend_ = &dm::utils::DiskIoBackend::getInstance();
+#ifndef _WIN32
+    device_ = DeviceIoScheduler::getInstance().getDevice(path);
+#endif
+
+#ifdef O_DIRECT
+    if (directIo) {
+        directFd_ = ::open(path.c_str(), O_RDWR | O_DIRECT | O_CLOEXEC);
+        if (directFd_ < 0) {
+            // Not every filesystem supports it (tmpfs, some FUSE mounts)
+            dm::utils::Logger::debug("Direct I/O not available for " + path + ": " + std::strerror(errno));
+        }
+    }
+#else
+    (void)directIo;
+#endif
+
+    return true;
+}
+
+bool OutputFile::openStaged(const std::string& path, size_t capacity, bool spill) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (fd_ >= 0 || staged_) {
+        if (path == path_) {
+            return true;
+        }
+        dm::utils::Logger::error("Output file already open: " + path_);
+        return false;
+    }
+
+    staging_ = StagingSlabPool::getInstance().acquire(capacity, stagingCapacity_);
+    if (!staging_) {
+        dm::utils::Logger::error("Failed to allocate " + std::to_string(capacity) + " bytes to stage " + path);
+        return false;
+    }
+
+    path_ = path;
+    backend_ = &dm::utils::DiskIoBackend::getInstance();
+    stagingSpills_ = spill;
+    stagedSize_ = 0;
+    staged_ = true;
+    return true;
+}
+
+bool OutputFile::commit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!staged_) {
+        return true;
+    }
+
+    // One open, write and close for the whole file
+#ifdef _WIN32
+    int fd = _open(path_.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    bool success = fd >= 0 && writeAll(fd, staging_.get(), static_cast<size_t>(stagedSize_.load()));
+    int error = errno;
+    if (fd >= 0) {
+#ifdef _WIN32
+        _close(fd);
+#else
+        // Network file systems may only report a failed write here
+        if (::close(fd) != 0 && success) {
+            success = false;
+            error = errno;
+        }
+#endif
+    }
+
+    if (!success) {
+        dm::utils::Logger::error("Failed to write output file " + path_ + ": " + std::strerror(error));
+        if (fd >= 0) {
+            std::remove(path_.c_str());
+        }
+    }
+
+    releaseStagingLocked();
+    return success;
+}
+
+void OutputFile::close() {
+    // The hasher's read-back thread reads through this file
+    if (hasher_) {
+        hasher_->stopReadBack();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (staged_) {
+        releaseStagingLocked();
+    }
+
+#ifdef _WIN32
+    if (fd_ >= 0) {
+        _close(fd_);
+    }
+#else
+    if (directFd_ >= 0) {
+        ::close(directFd_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+#endif
+
+    fd_ = -1;
+    directFd_ = -1;
+    device_.reset();
+}
+
+bool OutputFile::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0 || staged_;
+}
+
+bool OutputFile::isStaged() const {
+    return staged_;
+}
+
+bool OutputFile::isDirect() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return directFd_ >= 0;
+}
+
+bool OutputFile::writeAt(const char* data, size_t size, int64_t offset) {
+    DM_TRACE_SPAN("disk write");
+    if (staged_ && offset >= 0) {
+        if (stage(data, size, offset)) {
+            notifyWritten(data, size, offset);
+            return true;
+        }
+        if (!spill()) {
+            return false;
+        }
+    }
+    if (fd_ < 0 || offset < 0) {
+        return false;
+    }
+
+    // Timed only while metrics are exported
+    EngineMetrics& metrics = EngineMetrics::getInstance();
+    int64_t started = metrics.isEnabled() ? EngineMetrics::nowNanoseconds() : 0;
+
+    bool success = writeFully(selectDescriptor(data, size, offset), data, size, offset);
+    if (started > 0) {
+        metrics.observe(LatencyMetric::DISK_WRITE, (EngineMetrics::nowNanoseconds() - started) / 1e9);
+    }
+
+    if (success) {
+        notifyWritten(data, size, offset);
+    }
+
+    return success;
+}
+
+bool OutputFile::readAt(char* data, size_t size, int64_t offset) {
+    if (staged_ && offset >= 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (staged_) {
+            if (static_cast<uint64_t>(offset) + size > static_cast<uint64_t>(stagedSize_.load())) {
+                return false;
+            }
+            std::memcpy(data, staging_.get() + offset, size);
+            return true;
+        }
+    }
+    if (fd_ < 0 || offset < 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (_lseeki64(fd_, offset, SEEK_SET) < 0) {
+        return false;
+    }
+    while (size > 0) {
+        int bytesRead = _read(fd_, data, static_cast<unsigned int>(size));
+        if (bytesRead <= 0) {
+            return false;
+        }
+        data += bytesRead;
+        size -= bytesRead;
+    }
+    return true;
+#else
+    int64_t bytesRead = backend_->read(fd_, data, size, offset);
+    if (bytesRead < 0) {
+        dm::utils::Logger::error("Failed to read output file " + path_ + ": " + std::strerror(errno));
+        return false;
+    }
+
+    // Short only past the end of the file
+    return bytesRead == static_cast<int64_t>(size);
+#endif
+}
+
+bool OutputFile::isAsync() const {
+#ifdef _WIN32
+    return false;
+#else
+    return device_ || (backend_ && backend_->isAsync());
+#endif
+}
+
+void OutputFile::queueWrite(dm::utils::DiskRequest& request) {
+    request.operation = dm::utils::DiskOperation::WRITE;
+
+    // A copy into the slab is done on the spot, finishWrite() finds it complete
+    if (staged_ && request.offset >= 0) {
+        if (stage(request.data, request.size, request.offset)) {
+            request.fd = -1;
+            request.error = 0;
+            request.pending = false;
+            return;
+        }
+        if (!spill()) {
+            request.error = EFBIG;
+            request.pending = false;
+            return;
+        }
+    }
+    request.fd = selectDescriptor(request.data, request.size, request.offset);
+
+#ifdef _WIN32
+    // Performed on the spot, finishWrite() reports the result
+    request.error = writeFully(request.fd, request.data, request.size, request.offset) ? 0 : EIO;
+    request.pending = false;
+#else
+    if (!backend_ || request.fd < 0 || request.offset < 0) {
+        request.error = EBADF;
+        request.pending = false;
+        return;
+    }
+    if (device_) {
+        device_->queue(request);
+        return;
+    }
+    backend_->queue(request);
+#endif
+}
+
+bool OutputFile::finishWrite(dm::utils::DiskRequest& request) {
+    DM_TRACE_SPAN("disk write");
+
+    // Only the time spent waiting on the disk is taken
+    EngineMetrics& metrics = EngineMetrics::getInstance();
+    int64_t started = metrics.isEnabled() ? EngineMetrics::nowNanoseconds() : 0;
+
+#ifdef _WIN32
+    bool success = request.error == 0;
+#else
+    bool success = device_ ? device_->wait(request) : backend_ ? backend_->wait(request) : request.error == 0;
+    if (!success) {
+        dm::utils::Logger::error("Failed to write output file " + path_ + ": " + std::strerror(request.error));
+    }
+#endif
+    if (started > 0) {
+        metrics.observe(LatencyMetric::DISK_WRITE, (EngineMetrics::nowNanoseconds() - started) / 1e9);
+    }
+
+    if (success) {
+        notifyWritten(request.data, request.size, request.offset);
+    }
+    return success;
+}
+
+void OutputFile::setHasher(std::shared_ptr<StreamingHasher> hasher) {
+    hasher_ = hasher;
+}
+
+void OutputFile::setPieceVerifier(std::shared_ptr<PieceVerifier> verifier) {
+    pieceVerifier_ = verifier;
+}
+
+void OutputFile::setSniffer(std::shared_ptr<ContentSniffer> sniffer) {
+    sniffer_ = sniffer;
+}
+
+void OutputFile::setFilters(std::shared_ptr<DataFilterChain> filters) {
+    std::atomic_store(&filters_, filters);
+}
+
+bool OutputFile::sync() {
+    // Keep the descriptor from being closed and reused meanwhile
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Staged data only reaches the disk on commit()
+    if (staged_) {
+        return true;
+    }
+    if (fd_ < 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    return _commit(fd_) == 0;
+#else
+    return backend_->sync(fd_);
+#endif
+}
+
+const std::string& OutputFile::getPath() const {
+    return path_;
+}
+
+size_t OutputFile::getAlignment() {
+    return 4096;
+}
+
+bool OutputFile::writeFully(int fd, const char* data, size_t size, int64_t offset) {
+#ifdef _WIN32
+    // No positional write in the CRT, serialize seek+write
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+    while (size > 0) {
+        int written = _write(fd, data, static_cast<unsigned int>(size));
+        if (written <= 0) {
+            dm::utils::Logger::error("Failed to write output file " + path_);
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+#else
+    bool written = device_ ? device_->write(fd, data, size, offset) : backend_->write(fd, data, size, offset);
+    if (!written) {
+        dm::utils::Logger::error("Failed to write output file " + path_ + ": " + std::strerror(errno));
+        return false;
+    }
+    return true;
+#endif
+}
+
+int OutputFile::selectDescriptor(const char* data, size_t size, int64_t offset) const {
+    // Direct I/O only accepts fully aligned writes
+    size_t alignment = getAlignment();
+    if (directFd_ >= 0 &&
+        reinterpret_cast<uintptr_t>(data) % alignment == 0 &&
+        size % alignment == 0 &&
+        static_cast<uint64_t>(offset) % alignment == 0) {
+        return directFd_;
+    }
+    return fd_;
+}
+
+bool OutputFile::stage(const char* data, size_t size, int64_t offset) {
+    uint64_t end = static_cast<uint64_t>(offset) + size;
+    if (end > stagingCapacity_) {
+        return false;
+    }
+
+    // Writers of disjoint ranges copy at once, only the size is shared
+    std::memcpy(staging_.get() + offset, data, size);
+    int64_t staged = stagedSize_.load();
+    while (static_cast<int64_t>(end) > staged &&
+           !stagedSize_.compare_exchange_weak(staged, static_cast<int64_t>(end))) {
+    }
+    return true;
+}
+
+bool OutputFile::spill() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!staged_) {
+        return fd_ >= 0;
+    }
+    if (!stagingSpills_) {
+        dm::utils::Logger::error("Output file " + path_ + " is larger than the " +
+                                 std::to_string(stagingCapacity_) + " bytes staged for it");
+        return false;
+    }
+
+#ifdef _WIN32
+    fd_ = _open(path_.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    if (fd_ < 0) {
+        dm::utils::Logger::error("Failed to open output file " + path_ + ": " + std::strerror(errno));
+        releaseStagingLocked();
+        return false;
+    }
+    if (!writeAll(fd_, staging_.get(), static_cast<size_t>(stagedSize_.load()))) {
+        dm::utils::Logger::error("Failed to write output file " + path_ + ": " + std::strerror(errno));
+        releaseStagingLocked();
+        return false;
+    }
+
+    dm::utils::Logger::debug("Output file " + path_ + " outgrew its staging slab, writing to disk");
+    releaseStagingLocked();
+#ifndef _WIN32
+    device_ = DeviceIoScheduler::getInstance().getDevice(path_);
+#endif
+    return true;
+}
+
+void OutputFile::releaseStagingLocked() {
+    StagingSlabPool::getInstance().release(std::move(staging_), stagingCapacity_);
+    stagingCapacity_ = 0;
+    staged_ = false;
+}
+
+void OutputFile::notifyWritten(const char* data, size_t size, int64_t offset) {
+    if (hasher_) {
+        hasher_->onWrite(*this, data, size, offset);
+    }
+    if (pieceVerifier_) {
+        pieceVerifier_->onWrite(*this, data, size, offset);
+    }
+    if (sniffer_) {
+        sniffer_->onWrite(data, size, offset);
+    }
+    std::shared_ptr<DataFilterChain> filters = std::atomic_load(&filters_);
+    if (filters) {
+        filters->onWrite(*this, data, size, offset);
+    }
+}
+
+} // namespace core
+} // namespace dm
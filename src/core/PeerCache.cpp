@@ -0,0 +1,1050 @@
+#include "core/PeerCache.h"
+#include "utils/UrlFingerprintSet.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const char* const PEER_INDEX_HEADER = "# dm peer cache 1";
+const size_t PEER_INDEX_FIELDS = 3;         // Before the path
+const char* const PEER_PATH = "/peer/";
+const size_t MAX_REQUEST_SIZE = 8192;
+const size_t SEND_CHUNK_SIZE = 256 * 1024;
+
+const char* const MDNS_ADDRESS = "224.0.0.251";
+const uint16_t MDNS_PORT = 5353;
+const char* const SERVICE_NAME = "_dmpeer._tcp.local";
+const uint16_t TYPE_PTR = 12;
+const uint16_t TYPE_SRV = 33;
+const uint16_t TYPE_ANY = 255;
+const uint16_t CLASS_IN = 1;
+const uint16_t CACHE_FLUSH = 0x8000;
+const size_t MAX_LABEL_SIZE = 63;
+const int STARTUP_ROUNDS = 3;               // Of announcing and asking, 1, 2 and 4 seconds apart
+
+bool isKeyChar(unsigned char c) {
+    return std::isalnum(c) || c == '-';
+}
+
+bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](unsigned char x, unsigned char y) {
+               return std::tolower(x) == std::tolower(y);
+           });
+}
+
+void putU16(std::string& out, uint16_t value) {
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value & 0xFF));
+}
+
+void putU32(std::string& out, uint32_t value) {
+    putU16(out, static_cast<uint16_t>(value >> 16));
+    putU16(out, static_cast<uint16_t>(value & 0xFFFF));
+}
+
+void putName(std::string& out, const std::string& name) {
+    size_t start = 0;
+    while (start < name.size()) {
+        size_t dot = name.find('.', start);
+        size_t end = dot == std::string::npos ? name.size() : dot;
+        out.push_back(static_cast<char>(end - start));
+        out.append(name, start, end - start);
+        start = end + 1;
+    }
+    out.push_back('\0');
+}
+
+bool getU16(const std::string& packet, size_t offset, uint16_t& value) {
+    if (offset + 2 > packet.size()) {
+        return false;
+    }
+    value = static_cast<uint16_t>((static_cast<uint8_t>(packet[offset]) << 8) | static_cast<uint8_t>(packet[offset + 1]));
+    return true;
+}
+
+/**
+ * @brief Read a possibly compressed name, leaving offset after it
+ */
+bool readName(const std::string& packet, size_t& offset, std::string& name) {
+    name.clear();
+    size_t position = offset;
+    bool jumped = false;
+    for (int jumps = 0; jumps < 16;) {
+        if (position >= packet.size()) {
+            return false;
+        }
+        uint8_t length = static_cast<uint8_t>(packet[position]);
+        if ((length & 0xC0) == 0xC0) {
+            if (position + 1 >= packet.size()) {
+                return false;
+            }
+            if (!jumped) {
+                offset = position + 2;
+                jumped = true;
+            }
+            position = ((length & 0x3F) << 8) | static_cast<uint8_t>(packet[position + 1]);
+            jumps++;
+            continue;
+        }
+        if (length == 0) {
+            if (!jumped) {
+                offset = position + 1;
+            }
+            return true;
+        }
+        if (position + 1 + length > packet.size()) {
+            return false;
+        }
+        if (!name.empty()) {
+            name += '.';
+        }
+        name.append(packet, position + 1, length);
+        position += 1 + length;
+    }
+    return false;
+}
+
+/**
+ * @brief Parse a "bytes=" range against the file size
+ *
+ * @return 1 for a range, 0 to send the whole file, -1 if unsatisfiable
+ */
+int parseRange(const std::string& value, int64_t size, int64_t& first, int64_t& last) {
+    if (value.compare(0, 6, "bytes=") != 0 || value.find(',') != std::string::npos) {
+        return 0;
+    }
+    std::string spec = value.substr(6);
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return 0;
+    }
+    try {
+        if (dash == 0) {
+            int64_t suffix = std::stoll(spec.substr(1));
+            if (suffix <= 0 || size == 0) {
+                return -1;
+            }
+            first = std::max<int64_t>(0, size - suffix);
+            last = size - 1;
+            return 1;
+        }
+        first = std::stoll(spec.substr(0, dash));
+        last = dash + 1 < spec.size() ? std::stoll(spec.substr(dash + 1)) : size - 1;
+    } catch (const std::exception&) {
+        return 0;
+    }
+    if (first >= size) {
+        return -1;
+    }
+    if (first < 0 || first > last) {
+        return 0;
+    }
+    last = std::min(last, size - 1);
+    return 1;
+}
+
+#ifndef _WIN32
+void closeFd(int& fd) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+/**
+ * @brief Send a range of a file, in the kernel where it can
+ */
+bool sendRange(int fd, int file, int64_t offset, int64_t length, std::atomic<int64_t>& served) {
+#ifdef __linux__
+    off_t position = static_cast<off_t>(offset);
+    while (length > 0) {
+        ssize_t sent = ::sendfile(fd, file, &position, static_cast<size_t>(std::min<int64_t>(length, SEND_CHUNK_SIZE)));
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        length -= sent;
+        served += sent;
+    }
+    return true;
+#else
+    std::vector<char> buffer(SEND_CHUNK_SIZE);
+    while (length > 0) {
+        ssize_t size = ::pread(file, buffer.data(), static_cast<size_t>(std::min<int64_t>(length, SEND_CHUNK_SIZE)),
+                               static_cast<off_t>(offset));
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0 || !sendAll(fd, buffer.data(), static_cast<size_t>(size))) {
+            return false;
+        }
+        offset += size;
+        length -= size;
+        served += size;
+    }
+    return true;
+#endif
+}
+
+// Loopback, or on the subnet of one of this host's IPv4 interfaces; the
+// endpoint serves the user's files and must not answer beyond the LAN
+bool isLocalNetworkAddress(const in_addr& address) {
+    uint32_t host = ntohl(address.s_addr);
+    if ((host >> 24) == 127) {
+        return true;
+    }
+
+    ifaddrs* interfaces = nullptr;
+    if (::getifaddrs(&interfaces) != 0) {
+        return false;
+    }
+    bool local = false;
+    for (ifaddrs* entry = interfaces; entry && !local; entry = entry->ifa_next) {
+        if (!entry->ifa_addr || !entry->ifa_netmask || entry->ifa_addr->sa_family != AF_INET ||
+            !(entry->ifa_flags & IFF_UP) || (entry->ifa_flags & IFF_POINTOPOINT)) {
+            continue;
+        }
+        uint32_t own = ntohl(reinterpret_cast<const sockaddr_in*>(entry->ifa_addr)->sin_addr.s_addr);
+        uint32_t mask = ntohl(reinterpret_cast<const sockaddr_in*>(entry->ifa_netmask)->sin_addr.s_addr);
+        local = mask != 0 && (own & mask) == (host & mask);
+    }
+    ::freeifaddrs(interfaces);
+    return local;
+}
+
+bool sendStatus(int fd, int status, const char* reason, const std::string& extraHeaders = "") {
+    std::string response = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+                           "Content-Length: 0\r\n" + extraHeaders + "\r\n";
+    return sendAll(fd, response.data(), response.size());
+}
+#endif
+
+} // anonymous namespace
+
+PeerCache& PeerCache::getInstance() {
+    static PeerCache instance;
+    return instance;
+}
+
+PeerCache::~PeerCache() {
+    stop();
+}
+
+bool PeerCache::isEnabled() const {
+    return running_;
+}
+
+void PeerCache::setStaticPeers(const std::string& list) {
+    std::map<std::string, Peer> configured;
+    std::string entry;
+    std::istringstream stream(list);
+    while (stream >> entry) {
+        std::istringstream items(entry);
+        std::string item;
+        while (std::getline(items, item, ',')) {
+            size_t colon = item.rfind(':');
+            Peer peer;
+            peer.address = item.substr(0, colon);
+            try {
+                peer.port = colon == std::string::npos ? DEFAULT_PORT : std::stoi(item.substr(colon + 1));
+            } catch (const std::exception&) {
+                peer.port = 0;
+            }
+            if (peer.address.empty() || peer.port <= 0 || peer.port > 65535) {
+                if (!item.empty()) {
+                    dm::utils::Logger::warning("Ignoring malformed peer: " + item);
+                }
+                continue;
+            }
+            configured[peer.address + ":" + std::to_string(peer.port)] = peer;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_.swap(configured);
+}
+
+std::string PeerCache::makeHashKey(dm::utils::HashAlgorithm algorithm, const std::string& hash) {
+    // A checksum is no identity
+    if (algorithm == dm::utils::HashAlgorithm::CRC32 || hash.empty() ||
+        !std::all_of(hash.begin(), hash.end(), [](unsigned char c) { return std::isxdigit(c); })) {
+        return "";
+    }
+    std::string key = "h-" + dm::utils::HashCalculator::getAlgorithmName(algorithm) + "-" + hash;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+    return key;
+}
+
+std::string PeerCache::makeUrlKey(const std::string& url, const std::string& etag) {
+    // A weak ETag does not promise the same bytes
+    if (etag.empty() || etag.compare(0, 2, "W/") == 0) {
+        return "";
+    }
+    std::ostringstream key;
+    key << "u-" << std::hex << std::setw(16) << std::setfill('0')
+        << dm::utils::UrlFingerprintSet::fingerprint(url + '\n' + etag);
+    return key.str();
+}
+
+void PeerCache::share(const std::string& filePath, const std::vector<std::string>& keys) {
+    Shared shared;
+    shared.filePath = filePath;
+    std::error_code error;
+    shared.fileSize = std::filesystem::file_size(filePath, error);
+    if (!error) {
+        shared.modified = std::filesystem::last_write_time(filePath, error);
+    }
+    if (error || shared.fileSize < static_cast<std::uintmax_t>(MIN_SHARED_SIZE)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& key : keys) {
+        if (!key.empty()) {
+            shared_[key] = shared;
+        }
+    }
+}
+
+bool PeerCache::find(const std::string& key, Shared& shared) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = shared_.find(key);
+        if (it == shared_.end()) {
+            return false;
+        }
+        shared = it->second;
+    }
+    if (isUnchanged(shared)) {
+        return true;
+    }
+
+    // Edited or deleted since, never serve other bytes under the key
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = shared_.find(key);
+    if (it != shared_.end() && it->second.filePath == shared.filePath && it->second.modified == shared.modified) {
+        shared_.erase(it);
+    }
+    return false;
+}
+
+bool PeerCache::isUnchanged(const Shared& shared) {
+    std::error_code error;
+    if (std::filesystem::file_size(shared.filePath, error) != shared.fileSize || error) {
+        return false;
+    }
+    return std::filesystem::last_write_time(shared.filePath, error) == shared.modified && !error;
+}
+
+bool PeerCache::isConfiguredPeer(const std::string& address) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::any_of(peers_.begin(), peers_.end(), [&address](const std::pair<const std::string, Peer>& peer) {
+        return peer.second.address == address;
+    });
+}
+
+std::vector<std::string> PeerCache::getSourceUrls(const std::string& key) const {
+    std::vector<std::string> urls;
+    if (key.empty() || !running_) {
+        return urls;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The configured peers come first, announcements cannot push them out
+    for (const auto& item : peers_) {
+        if (urls.size() >= MAX_PEER_SOURCES) {
+            return urls;
+        }
+        urls.push_back("http://" + item.second.address + ":" + std::to_string(item.second.port) + PEER_PATH + key);
+    }
+    for (const auto& item : discoveredPeers_) {
+        const Peer& peer = item.second;
+        if (urls.size() >= MAX_PEER_SOURCES) {
+            break;
+        }
+        if (peer.expiresAt > now) {
+            urls.push_back("http://" + peer.address + ":" + std::to_string(peer.port) + PEER_PATH + key);
+        }
+    }
+    return urls;
+}
+
+std::vector<PeerInfo> PeerCache::getPeers() const {
+    std::vector<PeerInfo> peers;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : peers_) {
+        PeerInfo info;
+        info.name = item.first;
+        info.address = item.second.address;
+        info.port = item.second.port;
+        peers.push_back(info);
+    }
+    for (const auto& item : discoveredPeers_) {
+        const Peer& peer = item.second;
+        if (peer.expiresAt <= now) {
+            continue;
+        }
+        PeerInfo info;
+        info.name = item.first;
+        info.address = peer.address;
+        info.port = peer.port;
+        info.discovered = true;
+        info.secondsLeft = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::seconds>(peer.expiresAt - now).count());
+        peers.push_back(info);
+    }
+    return peers;
+}
+
+size_t PeerCache::getSharedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return shared_.size();
+}
+
+int64_t PeerCache::getServedBytes() const {
+    return servedBytes_;
+}
+
+bool PeerCache::save(const std::string& path) {
+    std::map<std::string, Shared> shared;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shared = shared_;
+    }
+
+    // Written aside and renamed, a crash never leaves half an index
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::trunc);
+    if (!out) {
+        dm::utils::Logger::error("Failed to write peer cache index: " + path);
+        return false;
+    }
+
+    out << PEER_INDEX_HEADER << '\n';
+    for (const auto& item : shared) {
+        if (isUnchanged(item.second)) {
+            out << item.second.fileSize << '\t' << item.second.modified.time_since_epoch().count() << '\t'
+                << item.first << '\t' << item.second.filePath << '\n';
+        }
+    }
+    out.close();
+
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        dm::utils::Logger::error("Failed to write peer cache index: " + path);
+        return false;
+    }
+    return true;
+}
+
+bool PeerCache::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != PEER_INDEX_HEADER) {
+        dm::utils::Logger::warning("Ignoring peer cache index in an unknown format: " + path);
+        return false;
+    }
+
+    std::map<std::string, Shared> loaded;
+    while (std::getline(in, line)) {
+        // The path is last, it may contain anything but a newline
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (fields.size() < PEER_INDEX_FIELDS) {
+            size_t tab = line.find('\t', start);
+            if (tab == std::string::npos) {
+                break;
+            }
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        if (fields.size() < PEER_INDEX_FIELDS || start >= line.size()) {
+            continue;
+        }
+
+        Shared shared;
+        try {
+            shared.fileSize = std::stoull(fields[0]);
+            shared.modified = std::filesystem::file_time_type(
+                std::filesystem::file_time_type::duration(std::stoll(fields[1])));
+        } catch (const std::exception&) {
+            continue;
+        }
+        shared.filePath = line.substr(start);
+        if (isUnchanged(shared)) {
+            loaded[fields[2]] = shared;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& item : loaded) {
+        shared_.insert(std::move(item));
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+bool PeerCache::start(int, const std::string&) {
+    dm::utils::Logger::error("The peer cache is not available on this platform");
+    return false;
+}
+
+void PeerCache::stop() {
+}
+
+void PeerCache::acceptLoop() {
+}
+
+void PeerCache::serveConnection(Connection*) {
+}
+
+bool PeerCache::handleRequest(int, const std::string&) {
+    return false;
+}
+
+void PeerCache::discoveryLoop() {
+}
+
+void PeerCache::handlePacket(const std::string&, const std::string&) {
+}
+
+void PeerCache::sendMulticast(const std::string&) {
+}
+
+std::string PeerCache::makeAnnouncement(uint32_t) const {
+    return "";
+}
+
+#else
+
+bool PeerCache::start(int port, const std::string& name) {
+    if (running_) {
+        return true;
+    }
+
+    // One DNS label, the dots of a host name would split it
+    name_ = name.empty() ? "peer" : name.substr(0, MAX_LABEL_SIZE);
+    std::replace(name_.begin(), name_.end(), '.', '-');
+    port_ = port;
+
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+        dm::utils::Logger::error("Failed to create peer cache socket: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    ::fcntl(listenFd_, F_SETFD, FD_CLOEXEC);
+    int reuse = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd_, SOMAXCONN) != 0 || ::pipe(wakePipe_) != 0) {
+        dm::utils::Logger::error("Failed to listen for peers on port " + std::to_string(port) + ": " +
+                                 std::string(std::strerror(errno)));
+        closeFd(listenFd_);
+        return false;
+    }
+
+    // Without multicast the configured peers are still asked
+    multicastFd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (multicastFd_ >= 0) {
+        ::fcntl(multicastFd_, F_SETFD, FD_CLOEXEC);
+        ::setsockopt(multicastFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+        ::setsockopt(multicastFd_, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#endif
+        sockaddr_in group{};
+        group.sin_family = AF_INET;
+        group.sin_addr.s_addr = htonl(INADDR_ANY);
+        group.sin_port = htons(MDNS_PORT);
+        ip_mreq membership{};
+        inet_pton(AF_INET, MDNS_ADDRESS, &membership.imr_multiaddr);
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        unsigned char ttl = 255;
+        if (::bind(multicastFd_, reinterpret_cast<sockaddr*>(&group), sizeof(group)) != 0 ||
+            ::setsockopt(multicastFd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+            dm::utils::Logger::warning("Peer discovery is off, mDNS is unavailable: " +
+                                       std::string(std::strerror(errno)));
+            closeFd(multicastFd_);
+        } else {
+            ::setsockopt(multicastFd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        }
+    }
+
+    running_ = true;
+    acceptThread_ = std::thread(&PeerCache::acceptLoop, this);
+    if (multicastFd_ >= 0) {
+        discoveryThread_ = std::thread(&PeerCache::discoveryLoop, this);
+    }
+
+    dm::utils::Logger::info("Sharing downloads with the LAN on port " + std::to_string(port) + " as " + name_);
+    return true;
+}
+
+void PeerCache::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    char byte = 1;
+    ssize_t written = ::write(wakePipe_[1], &byte, 1);
+    (void)written;
+    if (acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+    if (discoveryThread_.joinable()) {
+        discoveryThread_.join();
+    }
+
+    // A peer blocked in the middle of a transfer is cut off
+    for (auto& connection : connections_) {
+        ::shutdown(connection->fd, SHUT_RDWR);
+        if (connection->thread.joinable()) {
+            connection->thread.join();
+        }
+        closeFd(connection->fd);
+    }
+    connections_.clear();
+
+    closeFd(listenFd_);
+    closeFd(multicastFd_);
+    closeFd(wakePipe_[0]);
+    closeFd(wakePipe_[1]);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        discoveredPeers_.clear();
+    }
+    dm::utils::Logger::info("Stopped sharing downloads with the LAN");
+}
+
+void PeerCache::acceptLoop() {
+    while (running_) {
+        pollfd fds[2] = {{listenFd_, POLLIN, 0}, {wakePipe_[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            dm::utils::Logger::error("Peer cache socket poll failed: " + std::string(std::strerror(errno)));
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        // Peers that hung up are reaped as new ones arrive
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if ((*it)->finished) {
+                (*it)->thread.join();
+                closeFd((*it)->fd);
+                it = connections_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        sockaddr_in client{};
+        socklen_t clientSize = sizeof(client);
+        int fd = ::accept(listenFd_, reinterpret_cast<sockaddr*>(&client), &clientSize);
+        if (fd < 0) {
+            continue;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        char address[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &client.sin_addr, address, sizeof(address));
+        if (client.sin_family != AF_INET ||
+            (!isLocalNetworkAddress(client.sin_addr) && !isConfiguredPeer(address))) {
+            dm::utils::Logger::warning("Refused peer cache connection from " + std::string(address) +
+                                       ", not on the local network");
+            ::close(fd);
+            continue;
+        }
+        if (static_cast<int>(connections_.size()) >= MAX_CONNECTIONS) {
+            sendStatus(fd, 503, "Service Unavailable", "Connection: close\r\nRetry-After: 5\r\n");
+            ::close(fd);
+            continue;
+        }
+
+        timeval timeout{};
+        timeout.tv_sec = SEND_TIMEOUT_SECONDS;
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection* raw = connection.get();
+        connections_.push_back(std::move(connection));
+        raw->thread = std::thread(&PeerCache::serveConnection, this, raw);
+    }
+}
+
+void PeerCache::serveConnection(Connection* connection) {
+    std::string buffer;
+    char chunk[4096];
+
+    while (running_) {
+        // A request may already wait behind the last one
+        size_t end = buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (buffer.size() > MAX_REQUEST_SIZE) {
+                sendStatus(connection->fd, 431, "Request Header Fields Too Large", "Connection: close\r\n");
+                break;
+            }
+            pollfd fds[2] = {{connection->fd, POLLIN, 0}, {wakePipe_[0], POLLIN, 0}};
+            int ready = ::poll(fds, 2, IDLE_TIMEOUT_MS);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0 || fds[1].revents != 0) {
+                break;
+            }
+            ssize_t received = ::recv(connection->fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(received));
+            continue;
+        }
+
+        std::string head = buffer.substr(0, end);
+        buffer.erase(0, end + 4);
+        if (!handleRequest(connection->fd, head)) {
+            break;
+        }
+    }
+
+    ::shutdown(connection->fd, SHUT_RDWR);
+    connection->finished = true;
+}
+
+bool PeerCache::handleRequest(int fd, const std::string& head) {
+    std::istringstream lines(head);
+    std::string requestLine;
+    std::getline(lines, requestLine);
+    if (!requestLine.empty() && requestLine.back() == '\r') {
+        requestLine.pop_back();
+    }
+    std::istringstream parts(requestLine);
+    std::string method, target, version;
+    parts >> method >> target >> version;
+
+    // HTTP/1.1 keeps the connection unless asked not to, 1.0 the reverse
+    bool keepAlive = version == "HTTP/1.1";
+    std::string range;
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+        std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+        if (equalsIgnoreCase(name, "range")) {
+            range = value;
+        } else if (equalsIgnoreCase(name, "connection")) {
+            keepAlive = equalsIgnoreCase(value, "keep-alive") || (keepAlive && !equalsIgnoreCase(value, "close"));
+        }
+    }
+    std::string connectionHeader = keepAlive ? "" : "Connection: close\r\n";
+
+    if (method != "GET" && method != "HEAD") {
+        sendStatus(fd, 405, "Method Not Allowed", "Allow: GET, HEAD\r\n" + connectionHeader);
+        return keepAlive;
+    }
+
+    // Only shared keys are served, nothing else of the disk can be named
+    std::string key = target.compare(0, std::strlen(PEER_PATH), PEER_PATH) == 0 ? target.substr(std::strlen(PEER_PATH)) : "";
+    Shared shared;
+    if (key.empty() || !std::all_of(key.begin(), key.end(), isKeyChar) || !find(key, shared)) {
+        return sendStatus(fd, 404, "Not Found", connectionHeader) && keepAlive;
+    }
+
+    int file = ::open(shared.filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (file < 0 || ::fstat(file, &info) != 0 || static_cast<std::uintmax_t>(info.st_size) != shared.fileSize) {
+        if (file >= 0) {
+            ::close(file);
+        }
+        return sendStatus(fd, 404, "Not Found", connectionHeader) && keepAlive;
+    }
+
+    int64_t size = static_cast<int64_t>(shared.fileSize);
+    int64_t first = 0;
+    int64_t last = size - 1;
+    int ranged = range.empty() ? 0 : parseRange(range, size, first, last);
+    if (ranged < 0) {
+        ::close(file);
+        return sendStatus(fd, 416, "Range Not Satisfiable",
+                          "Content-Range: bytes */" + std::to_string(size) + "\r\n" + connectionHeader) && keepAlive;
+    }
+
+    int64_t length = last - first + 1;
+    std::string response = ranged > 0 ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+    response += "Content-Type: application/octet-stream\r\n";
+    response += "Accept-Ranges: bytes\r\n";
+    response += "Content-Length: " + std::to_string(length) + "\r\n";
+    if (ranged > 0) {
+        response += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                    std::to_string(size) + "\r\n";
+    }
+    response += connectionHeader + "\r\n";
+
+    bool sent = sendAll(fd, response.data(), response.size());
+    if (sent && method == "GET" && length > 0) {
+        sent = sendRange(fd, file, first, length, servedBytes_);
+    }
+    ::close(file);
+    return sent && keepAlive;
+}
+
+std::string PeerCache::makeAnnouncement(uint32_t ttl) const {
+    std::string instance = name_ + "." + SERVICE_NAME;
+    std::string message;
+    putU16(message, 0);             // ID
+    putU16(message, 0x8400);        // Authoritative response
+    putU16(message, 0);
+    putU16(message, 2);             // PTR and SRV
+    putU16(message, 0);
+    putU16(message, 0);
+
+    std::string target;
+    putName(target, instance);
+    putName(message, SERVICE_NAME);
+    putU16(message, TYPE_PTR);
+    putU16(message, CLASS_IN);
+    putU32(message, ttl);
+    putU16(message, static_cast<uint16_t>(target.size()));
+    message += target;
+
+    // Peers connect to the address the announcement came from
+    std::string host;
+    putName(host, name_ + ".local");
+    putName(message, instance);
+    putU16(message, TYPE_SRV);
+    putU16(message, CACHE_FLUSH | CLASS_IN);
+    putU32(message, ttl);
+    putU16(message, static_cast<uint16_t>(6 + host.size()));
+    putU16(message, 0);             // Priority
+    putU16(message, 0);             // Weight
+    putU16(message, static_cast<uint16_t>(port_));
+    message += host;
+    return message;
+}
+
+void PeerCache::sendMulticast(const std::string& message) {
+    sockaddr_in group{};
+    group.sin_family = AF_INET;
+    group.sin_port = htons(MDNS_PORT);
+    inet_pton(AF_INET, MDNS_ADDRESS, &group.sin_addr);
+    if (::sendto(multicastFd_, message.data(), message.size(), 0,
+                 reinterpret_cast<sockaddr*>(&group), sizeof(group)) < 0) {
+        dm::utils::Logger::debug("Failed to send mDNS message: " + std::string(std::strerror(errno)));
+    }
+}
+
+void PeerCache::discoveryLoop() {
+    std::string query;
+    putU16(query, 0);
+    putU16(query, 0);
+    putU16(query, 1);
+    putU16(query, 0);
+    putU16(query, 0);
+    putU16(query, 0);
+    putName(query, SERVICE_NAME);
+    putU16(query, TYPE_PTR);
+    putU16(query, CLASS_IN);
+
+    // The first rounds follow each other quickly, as a peer that answers
+    // nothing announced just before is not asked again for a second
+    auto nextAnnounce = std::chrono::steady_clock::now();
+    int round = 0;
+    std::string packet(9000, '\0');
+    while (running_) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextAnnounce) {
+            sendMulticast(makeAnnouncement(PEER_TTL_SECONDS));
+            sendMulticast(query);
+            lastAnswer_ = now;
+            nextAnnounce = now + std::chrono::seconds(round < STARTUP_ROUNDS ? 1 << round : ANNOUNCE_INTERVAL_SECONDS);
+            round++;
+        }
+
+        int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(nextAnnounce - now).count());
+        pollfd fds[2] = {{multicastFd_, POLLIN, 0}, {wakePipe_[0], POLLIN, 0}};
+        int ready = ::poll(fds, 2, std::max(timeout, 0));
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+        if (ready <= 0 || !(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        sockaddr_in source{};
+        socklen_t sourceSize = sizeof(source);
+        ssize_t size = ::recvfrom(multicastFd_, &packet[0], packet.size(), 0,
+                                  reinterpret_cast<sockaddr*>(&source), &sourceSize);
+        if (size <= 0) {
+            continue;
+        }
+        if (!isLocalNetworkAddress(source.sin_addr)) {
+            continue;
+        }
+        char address[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &source.sin_addr, address, sizeof(address));
+        handlePacket(packet.substr(0, static_cast<size_t>(size)), address);
+    }
+
+    // Peers forget this manager at once instead of after the TTL
+    sendMulticast(makeAnnouncement(0));
+}
+
+void PeerCache::handlePacket(const std::string& packet, const std::string& address) {
+    uint16_t flags, questions, answers, authorities, additionals;
+    if (!getU16(packet, 2, flags) || !getU16(packet, 4, questions) || !getU16(packet, 6, answers) ||
+        !getU16(packet, 8, authorities) || !getU16(packet, 10, additionals)) {
+        return;
+    }
+
+    size_t offset = 12;
+    std::string name;
+    bool asked = false;
+    for (uint16_t i = 0; i < questions; i++) {
+        uint16_t type;
+        if (!readName(packet, offset, name) || !getU16(packet, offset, type)) {
+            return;
+        }
+        offset += 4;
+        asked = asked || ((type == TYPE_PTR || type == TYPE_ANY) && equalsIgnoreCase(name, SERVICE_NAME));
+    }
+
+    // The records are multicast at most once a second, several managers ask at once
+    if (!(flags & 0x8000)) {
+        auto now = std::chrono::steady_clock::now();
+        if (asked && now - lastAnswer_ >= std::chrono::seconds(1)) {
+            lastAnswer_ = now;
+            sendMulticast(makeAnnouncement(PEER_TTL_SECONDS));
+        }
+        return;
+    }
+
+    std::string suffix = std::string(".") + SERVICE_NAME;
+    int records = answers + authorities + additionals;
+    for (int i = 0; i < records; i++) {
+        uint16_t type, length, ttlHigh, ttlLow;
+        if (!readName(packet, offset, name) || !getU16(packet, offset, type) ||
+            !getU16(packet, offset + 4, ttlHigh) || !getU16(packet, offset + 6, ttlLow) ||
+            !getU16(packet, offset + 8, length) || offset + 10 + length > packet.size()) {
+            return;
+        }
+        size_t data = offset + 10;
+        offset = data + length;
+
+        uint16_t port;
+        if (type != TYPE_SRV || name.size() <= suffix.size() || !getU16(packet, data + 4, port) ||
+            !equalsIgnoreCase(name.substr(name.size() - suffix.size()), suffix)) {
+            continue;
+        }
+        std::string instance = name.substr(0, name.size() - suffix.size());
+        if (instance == name_) {
+            continue;
+        }
+
+        // Anyone on the LAN can announce, so announcements only touch
+        // announced peers and a goodbye only counts from the peer's address
+        uint32_t ttl = (static_cast<uint32_t>(ttlHigh) << 16) | ttlLow;
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = discoveredPeers_.find(instance);
+        if (ttl == 0) {
+            if (it != discoveredPeers_.end() && it->second.address == address) {
+                discoveredPeers_.erase(it);
+                dm::utils::Logger::debug("Peer " + instance + " left");
+            }
+            continue;
+        }
+        if (it == discoveredPeers_.end()) {
+            for (auto expired = discoveredPeers_.begin();
+                 discoveredPeers_.size() >= MAX_DISCOVERED_PEERS && expired != discoveredPeers_.end();) {
+                expired = expired->second.expiresAt <= now ? discoveredPeers_.erase(expired) : std::next(expired);
+            }
+            if (discoveredPeers_.size() >= MAX_DISCOVERED_PEERS) {
+                continue;
+            }
+            it = discoveredPeers_.emplace(instance, Peer()).first;
+        }
+        Peer& peer = it->second;
+        if (peer.address != address || peer.port != port) {
+            dm::utils::Logger::debug("Found peer " + instance + " at " + address + ":" + std::to_string(port));
+        }
+        peer.address = address;
+        peer.port = port;
+        peer.expiresAt = now + std::chrono::seconds(ttl);
+    }
+}
+
+#endif
+
+} // namespace core
+} // namespace dm
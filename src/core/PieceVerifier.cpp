@@ -0,0 +1,306 @@
+#include "core/PieceVerifier.h"
+#include "core/DownloadTask.h"
+#include "core/OutputFile.h"
+#include "core/EngineMetrics.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace dm {
+namespace core {
+
+PieceVerifier::PieceVerifier(const PieceMap& pieces, int64_t fileSize, const std::vector<SegmentRange>& missing)
+    : algorithm_(pieces.algorithm), pieceSize_(pieces.pieceSize), fileSize_(fileSize),
+      published_(pieces.published), hashes_(pieces.hashes), missing_(missing) {
+    hashes_.resize(PieceMap::countPieces(fileSize_, pieceSize_));
+    states_.assign(hashes_.size(), PieceState::PENDING);
+}
+
+PieceVerifier::~PieceVerifier() {
+}
+
+void PieceVerifier::onWrite(OutputFile& file, const char* data, size_t size, int64_t offset) {
+    int64_t end = offset + static_cast<int64_t>(size);
+
+    for (size_t index = static_cast<size_t>(offset / pieceSize_);
+         index < states_.size() && static_cast<int64_t>(index) * pieceSize_ < end; index++) {
+        int64_t pieceEnd = std::min(fileSize_, static_cast<int64_t>(index + 1) * pieceSize_);
+        int64_t from = std::max(offset, static_cast<int64_t>(index) * pieceSize_);
+        int64_t to = std::min(end, pieceEnd);
+
+        std::shared_ptr<Active> active;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (states_[index] != PieceState::PENDING) {
+                // Rewrite of a piece already checked (segment retry)
+                continue;
+            }
+            auto it = active_.find(index);
+            active = it != active_.end() ? it->second : activate(index);
+        }
+
+        std::string digest;
+        {
+            std::lock_guard<std::mutex> lock(active->mutex);
+            if (active->done) {
+                continue;
+            }
+
+            // Data of earlier sessions at the frontier goes first
+            bool readable = absorbWritten(file, *active);
+            if (!readable || to <= active->frontier) {
+                // Rewrite of data already hashed
+            } else if (from <= active->frontier) {
+                // Hash straight from the caller's buffer
+                update(*active, data + (active->frontier - offset), static_cast<size_t>(to - active->frontier));
+                active->frontier = to;
+                readable = absorbWritten(file, *active);
+            } else {
+                // Ahead of the frontier, merge with neighbouring ranges
+                auto next = active->written.lower_bound(from);
+                if (next != active->written.begin()) {
+                    auto prev = std::prev(next);
+                    if (prev->second >= from) {
+                        from = prev->first;
+                        to = std::max(to, prev->second);
+                        next = active->written.erase(prev);
+                    }
+                }
+                while (next != active->written.end() && next->first <= to) {
+                    to = std::max(to, next->second);
+                    next = active->written.erase(next);
+                }
+                active->written[from] = to;
+            }
+
+            if (readable && active->frontier < pieceEnd) {
+                continue;
+            }
+            active->done = true;
+            active->written.clear();
+            if (readable) {
+                digest = active->hash.finish();
+            }
+        }
+
+        complete(file, index, active, digest);
+    }
+}
+
+std::vector<size_t> PieceVerifier::takeFailed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<size_t> failed;
+    failed.swap(failed_);
+    return failed;
+}
+
+std::vector<size_t> PieceVerifier::finish(OutputFile& file) {
+    std::vector<size_t> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t index = 0; index < states_.size(); index++) {
+            if (states_[index] == PieceState::PENDING) {
+                pending.push_back(index);
+            }
+        }
+    }
+
+    // Every byte is on the disk now, whoever wrote it
+    for (size_t index : pending) {
+        std::shared_ptr<Active> active;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (states_[index] != PieceState::PENDING) {
+                continue;
+            }
+            auto it = active_.find(index);
+            active = it != active_.end() ? it->second : activate(index);
+        }
+
+        std::string digest;
+        {
+            std::lock_guard<std::mutex> lock(active->mutex);
+            if (active->done) {
+                continue;
+            }
+            active->done = true;
+            active->written.clear();
+            if (readBack(file, *active, getPieceRange(index).endByte + 1)) {
+                digest = active->hash.finish();
+            }
+        }
+
+        complete(file, index, active, digest);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_.clear();
+    std::vector<size_t> failed;
+    for (size_t index = 0; index < states_.size(); index++) {
+        if (states_[index] == PieceState::FAILED) {
+            failed.push_back(index);
+        }
+    }
+
+    if (readBackBytes_ > 0) {
+        dm::utils::Logger::debug("Piece verification of " + file.getPath() + " read back " +
+                                 std::to_string(readBackBytes_.load()) + " bytes");
+    }
+
+    return failed;
+}
+
+void PieceVerifier::refetch(size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (index >= states_.size()) {
+        return;
+    }
+    if (states_[index] == PieceState::VERIFIED) {
+        verifiedCount_--;
+    }
+    states_[index] = PieceState::PENDING;
+    active_.erase(index);
+    failed_.erase(std::remove(failed_.begin(), failed_.end(), index), failed_.end());
+    if (!published_) {
+        hashes_[index].clear();
+    }
+
+    // Nothing of it on the disk counts any more
+    missing_.push_back(getPieceRange(index));
+}
+
+SegmentRange PieceVerifier::getPieceRange(size_t index) const {
+    SegmentRange range;
+    range.startByte = static_cast<int64_t>(index) * pieceSize_;
+    range.endByte = std::min(fileSize_, range.startByte + pieceSize_) - 1;
+    return range;
+}
+
+size_t PieceVerifier::getPieceCount() const {
+    return states_.size();
+}
+
+size_t PieceVerifier::getVerifiedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return verifiedCount_;
+}
+
+PieceMap PieceVerifier::getPieceMap() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PieceMap pieces;
+    pieces.algorithm = algorithm_;
+    pieces.pieceSize = pieceSize_;
+    pieces.published = published_;
+    pieces.hashes = hashes_;
+    return pieces;
+}
+
+int64_t PieceVerifier::getReadBackBytes() const {
+    return readBackBytes_;
+}
+
+std::shared_ptr<PieceVerifier::Active> PieceVerifier::activate(size_t index) {
+    SegmentRange piece = getPieceRange(index);
+    auto active = std::make_shared<Active>(algorithm_);
+    active->frontier = piece.startByte;
+
+    // What is not missing was written by an earlier session
+    std::vector<SegmentRange> missing;
+    for (const auto& range : missing_) {
+        if (range.startByte <= piece.endByte && range.endByte >= piece.startByte) {
+            missing.push_back(range);
+        }
+    }
+    std::sort(missing.begin(), missing.end(), [](const SegmentRange& a, const SegmentRange& b) {
+        return a.startByte < b.startByte;
+    });
+    int64_t cursor = piece.startByte;
+    for (const auto& range : missing) {
+        if (range.startByte > cursor) {
+            active->written[cursor] = std::min(range.startByte, piece.endByte + 1);
+        }
+        cursor = std::max(cursor, range.endByte + 1);
+    }
+    if (cursor <= piece.endByte) {
+        active->written[cursor] = piece.endByte + 1;
+    }
+
+    active_[index] = active;
+    return active;
+}
+
+bool PieceVerifier::absorbWritten(OutputFile& file, Active& active) {
+    while (!active.written.empty() && active.written.begin()->first <= active.frontier) {
+        int64_t end = active.written.begin()->second;
+        active.written.erase(active.written.begin());
+
+        if (end > active.frontier && !readBack(file, active, end)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PieceVerifier::readBack(OutputFile& file, Active& active, int64_t end) {
+    std::vector<char> buffer(static_cast<size_t>(std::min<int64_t>(end - active.frontier, READ_BACK_CHUNK_SIZE)));
+
+    while (active.frontier < end) {
+        size_t chunk = static_cast<size_t>(std::min<int64_t>(end - active.frontier, READ_BACK_CHUNK_SIZE));
+        if (!file.readAt(buffer.data(), chunk, active.frontier)) {
+            dm::utils::Logger::error("Piece verification failed to read back " + file.getPath());
+            return false;
+        }
+
+        update(active, buffer.data(), chunk);
+        active.frontier += static_cast<int64_t>(chunk);
+        readBackBytes_ += static_cast<int64_t>(chunk);
+    }
+
+    return true;
+}
+
+void PieceVerifier::complete(const OutputFile& file, size_t index, const std::shared_ptr<Active>& active,
+                             const std::string& digest) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Fetched again meanwhile, the new data is hashed on its own
+    auto it = active_.find(index);
+    if (it == active_.end() || it->second != active) {
+        return;
+    }
+    active_.erase(it);
+
+    // An unreadable piece is fetched again like a corrupt one
+    std::string& expected = hashes_[index];
+    if (!digest.empty() && (expected.empty() || expected == digest)) {
+        expected = digest;
+        states_[index] = PieceState::VERIFIED;
+        verifiedCount_++;
+        return;
+    }
+
+    states_[index] = PieceState::FAILED;
+    failed_.push_back(index);
+    if (!digest.empty()) {
+        dm::utils::Logger::warning("Piece " + std::to_string(index) + " of " + file.getPath() +
+                                   " failed verification: expected " + expected + ", got " + digest);
+    }
+}
+
+void PieceVerifier::update(Active& active, const char* data, size_t size) {
+    EngineMetrics& metrics = EngineMetrics::getInstance();
+    if (!metrics.isEnabled()) {
+        active.hash.update(data, size);
+        return;
+    }
+
+    int64_t started = EngineMetrics::nowNanoseconds();
+    active.hash.update(data, size);
+    metrics.count(EventMetric::HASHED_BYTES, static_cast<int64_t>(size));
+    metrics.count(EventMetric::HASH_NANOSECONDS, EngineMetrics::nowNanoseconds() - started);
+}
+
+} // namespace core
+} // namespace dm
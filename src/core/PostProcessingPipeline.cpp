@@ -0,0 +1,411 @@
+#include "core/PostProcessingPipeline.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+double millisecondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+} // namespace
+
+PostProcessJob::PostProcessJob(const std::string& taskId, const std::string& filePath, const std::string& url)
+    : taskId_(taskId), url_(url), filePath_(filePath),
+      submitted_(std::chrono::steady_clock::now()) {
+}
+
+const std::string& PostProcessJob::getTaskId() const {
+    return taskId_;
+}
+
+const std::string& PostProcessJob::getUrl() const {
+    return url_;
+}
+
+std::string PostProcessJob::getFilePath() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return filePath_;
+}
+
+void PostProcessJob::setFilePath(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    filePath_ = filePath;
+}
+
+const ContentSample& PostProcessJob::getSample() {
+    // The first stage to ask takes it, the others wait for that one
+    std::call_once(sampleOnce_, [this]() {
+        ContentSample sample;
+        if (!ContentSniffer::findSample(getFilePath(), sample)) {
+            sample = ContentSample();
+        }
+        sample_ = std::move(sample);
+    });
+    return sample_;
+}
+
+void PostProcessJob::setAttribute(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    attributes_[key] = value;
+}
+
+std::string PostProcessJob::getAttribute(const std::string& key, const std::string& defaultValue) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = attributes_.find(key);
+    return it != attributes_.end() ? it->second : defaultValue;
+}
+
+StageStatus PostProcessJob::getStageStatus(const std::string& stageName) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < stageNames_.size(); i++) {
+        if (stageNames_[i] == stageName) {
+            return statuses_[i];
+        }
+    }
+    return StageStatus::SKIPPED;
+}
+
+int64_t PostProcessJob::getElapsedMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return elapsedMs_;
+}
+
+PostProcessingPipeline::PostProcessingPipeline() {
+}
+
+PostProcessingPipeline::~PostProcessingPipeline() {
+    stop();
+}
+
+bool PostProcessingPipeline::addStage(const PostProcessStage& stage) {
+    if (stage.name.empty() || !stage.run) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stageIndex_.count(stage.name) > 0) {
+        dm::utils::Logger::error("Post-processing stage declared twice: " + stage.name);
+        return false;
+    }
+
+    std::vector<size_t> dependencies;
+    for (const auto& dependency : stage.dependencies) {
+        auto it = stageIndex_.find(dependency);
+        if (it == stageIndex_.end()) {
+            dm::utils::Logger::error("Post-processing stage " + stage.name + " depends on unknown stage " + dependency);
+            return false;
+        }
+        if (std::find(dependencies.begin(), dependencies.end(), it->second) == dependencies.end()) {
+            dependencies.push_back(it->second);
+        }
+    }
+
+    size_t index = stages_.size();
+    auto created = std::make_unique<Stage>();
+    created->declaration = stage;
+    created->declaration.concurrency = std::max(1, stage.concurrency);
+    created->metrics.name = stage.name;
+    stages_.push_back(std::move(created));
+    stageIndex_[stage.name] = index;
+
+    // Keep the dependencies without duplicates, remaining_ counts them
+    stages_[index]->declaration.dependencies.clear();
+    for (size_t dependency : dependencies) {
+        stages_[index]->declaration.dependencies.push_back(stages_[dependency]->declaration.name);
+        stages_[dependency]->dependents.push_back(index);
+    }
+
+    return true;
+}
+
+bool PostProcessingPipeline::hasStage(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stageIndex_.count(name) > 0;
+}
+
+std::shared_ptr<PostProcessJob> PostProcessingPipeline::submit(const std::string& taskId, const std::string& filePath,
+                                                               const std::string& url) {
+    auto job = std::make_shared<PostProcessJob>(taskId, filePath, url);
+    std::vector<std::shared_ptr<PostProcessJob>> finished;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return nullptr;
+        }
+
+        size_t count = stages_.size();
+        {
+            std::lock_guard<std::mutex> jobLock(job->mutex_);
+            job->statuses_.assign(count, StageStatus::PENDING);
+            for (const auto& stage : stages_) {
+                job->stageNames_.push_back(stage->declaration.name);
+            }
+        }
+        job->remaining_.resize(count);
+        job->outstanding_ = count;
+
+        if (count == 0) {
+            finished.push_back(job);
+        } else {
+            pendingJobs_++;
+            startWorkers();
+            for (size_t i = 0; i < count; i++) {
+                job->remaining_[i] = static_cast<int>(stages_[i]->declaration.dependencies.size());
+                if (job->remaining_[i] == 0) {
+                    enqueue(job, i);
+                }
+            }
+        }
+    }
+
+    changed_.notify_all();
+    notifyFinished(finished);
+    return job;
+}
+
+void PostProcessingPipeline::setCompletionCallback(CompletionCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    completionCallback_ = callback;
+}
+
+std::vector<StageMetrics> PostProcessingPipeline::getMetrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<StageMetrics> metrics;
+    metrics.reserve(stages_.size());
+    for (const auto& stage : stages_) {
+        metrics.push_back(stage->metrics);
+    }
+    return metrics;
+}
+
+size_t PostProcessingPipeline::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pendingJobs_;
+}
+
+void PostProcessingPipeline::stop() {
+    std::vector<std::shared_ptr<PostProcessJob>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+
+        // Waiting stages will not run, their dependents are skipped with them
+        size_t dropped = 0;
+        for (size_t i = 0; i < stages_.size(); i++) {
+            std::deque<ReadyWork> ready;
+            ready.swap(stages_[i]->ready);
+            dropped += ready.size();
+            for (const auto& work : ready) {
+                finishStage(work.job, i, StageStatus::SKIPPED, finished);
+            }
+        }
+        if (dropped > 0) {
+            dm::utils::Logger::warning("Skipped " + std::to_string(dropped) + " post-processing stages at shutdown");
+        }
+    }
+    changed_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+
+    notifyFinished(finished);
+}
+
+void PostProcessingPipeline::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        ReadyWork work;
+        size_t index = 0;
+        if (!takeWork(work, index)) {
+            if (stopping_) {
+                // Running stages still finish on the workers that took them
+                return;
+            }
+            changed_.wait(lock);
+            continue;
+        }
+
+        Stage& stage = *stages_[index];
+        stage.active++;
+        PostProcessStage::Function run = stage.declaration.run;
+        std::string name = stage.declaration.name;
+        auto started = std::chrono::steady_clock::now();
+        stage.metrics.totalWaitMs += millisecondsBetween(work.since, started);
+        lock.unlock();
+
+        bool succeeded = false;
+        try {
+            succeeded = run(*work.job);
+        } catch (const std::exception& e) {
+            dm::utils::Logger::error("Post-processing stage " + name + " threw: " + std::string(e.what()));
+        }
+
+        double runMs = millisecondsBetween(started, std::chrono::steady_clock::now());
+        if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+            dm::utils::Logger::debug("Post-processing stage " + name + (succeeded ? " finished " : " failed on ") +
+                                     work.job->getFilePath() + " in " + std::to_string(static_cast<int64_t>(runMs)) + " ms");
+        }
+
+        std::vector<std::shared_ptr<PostProcessJob>> finished;
+        lock.lock();
+        stage.active--;
+        stage.metrics.totalRunMs += runMs;
+        stage.metrics.maxRunMs = std::max(stage.metrics.maxRunMs, runMs);
+        finishStage(work.job, index, succeeded ? StageStatus::SUCCEEDED : StageStatus::FAILED, finished);
+        lock.unlock();
+
+        // Dependents became ready, and the stage has a free slot again
+        changed_.notify_all();
+        notifyFinished(finished);
+        lock.lock();
+    }
+}
+
+bool PostProcessingPipeline::takeWork(ReadyWork& work, size_t& index) {
+    bool found = false;
+    uint64_t oldest = 0;
+
+    size_t busy = 0;
+    size_t idleStages = 0;
+    for (const auto& stage : stages_) {
+        busy += static_cast<size_t>(stage->active);
+        idleStages += stage->active == 0 ? 1 : 0;
+    }
+
+    for (size_t i = 0; i < stages_.size(); i++) {
+        const Stage& stage = *stages_[i];
+        if (stage.ready.empty() || stage.active >= stage.declaration.concurrency) {
+            continue;
+        }
+        // Every other stage with nothing running keeps a worker for itself
+        size_t reserved = idleStages - (stage.active == 0 ? 1 : 0);
+        if (busy + 1 + reserved > workers_.size()) {
+            continue;
+        }
+        if (!found || stage.ready.front().sequence < oldest) {
+            found = true;
+            oldest = stage.ready.front().sequence;
+            index = i;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+    work = std::move(stages_[index]->ready.front());
+    stages_[index]->ready.pop_front();
+    return true;
+}
+
+void PostProcessingPipeline::enqueue(const std::shared_ptr<PostProcessJob>& job, size_t index) {
+    ReadyWork work;
+    work.job = job;
+    work.sequence = nextSequence_++;
+    work.since = std::chrono::steady_clock::now();
+    stages_[index]->ready.push_back(std::move(work));
+}
+
+void PostProcessingPipeline::finishStage(const std::shared_ptr<PostProcessJob>& job, size_t index, StageStatus status,
+                                         std::vector<std::shared_ptr<PostProcessJob>>& finished) {
+    Stage& stage = *stages_[index];
+    {
+        std::lock_guard<std::mutex> jobLock(job->mutex_);
+        job->statuses_[index] = status;
+    }
+    switch (status) {
+        case StageStatus::SUCCEEDED: stage.metrics.succeeded++; break;
+        case StageStatus::FAILED: stage.metrics.failed++; break;
+        default: stage.metrics.skipped++; break;
+    }
+    job->outstanding_--;
+
+    // Stages declared after the job was submitted are not part of it
+    size_t count = job->remaining_.size();
+    for (size_t dependent : stage.dependents) {
+        if (dependent >= count) {
+            continue;
+        }
+        StageStatus current;
+        {
+            std::lock_guard<std::mutex> jobLock(job->mutex_);
+            current = job->statuses_[dependent];
+        }
+        if (current != StageStatus::PENDING) {
+            continue;
+        }
+
+        if (status != StageStatus::SUCCEEDED) {
+            finishStage(job, dependent, StageStatus::SKIPPED, finished);
+        } else if (--job->remaining_[dependent] == 0) {
+            if (stopping_) {
+                finishStage(job, dependent, StageStatus::SKIPPED, finished);
+            } else {
+                enqueue(job, dependent);
+            }
+        }
+    }
+
+    if (job->outstanding_ == 0) {
+        {
+            std::lock_guard<std::mutex> jobLock(job->mutex_);
+            job->elapsedMs_ = std::max<int64_t>(1, static_cast<int64_t>(
+                millisecondsBetween(job->submitted_, std::chrono::steady_clock::now())));
+        }
+        pendingJobs_--;
+        finished.push_back(job);
+    }
+}
+
+void PostProcessingPipeline::startWorkers() {
+    unsigned wanted = 0;
+    for (const auto& stage : stages_) {
+        wanted += static_cast<unsigned>(stage->declaration.concurrency);
+    }
+    wanted = std::min(wanted, MAX_WORKERS);
+    // At least one per stage, the reservations in takeWork() rely on it
+    wanted = std::max(wanted, static_cast<unsigned>(stages_.size()));
+
+    while (workers_.size() < wanted) {
+        workers_.emplace_back(&PostProcessingPipeline::workerLoop, this);
+    }
+}
+
+void PostProcessingPipeline::notifyFinished(const std::vector<std::shared_ptr<PostProcessJob>>& finished) {
+    if (finished.empty()) {
+        return;
+    }
+
+    CompletionCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callback = completionCallback_;
+    }
+
+    for (const auto& job : finished) {
+        if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+            dm::utils::Logger::debug("Post-processed " + job->getFilePath() + " in " +
+                                     std::to_string(job->getElapsedMs()) + " ms");
+        }
+        if (callback) {
+            callback(job);
+        }
+    }
+}
+
+} // namespace core
+} // namespace dm
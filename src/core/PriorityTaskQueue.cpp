@@ -0,0 +1,210 @@
+#include "core/PriorityTaskQueue.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+PriorityTaskQueue::PriorityTaskQueue(int64_t agingIntervalMs)
+    : agingIntervalMs_(agingIntervalMs > 0 ? agingIntervalMs : DEFAULT_AGING_INTERVAL_MS) {
+}
+
+bool PriorityTaskQueue::push(TaskHandle handle, DownloadPriority priority) {
+    return push(handle, priority, nowMs());
+}
+
+bool PriorityTaskQueue::push(TaskHandle handle, DownloadPriority priority, int64_t enqueuedMs) {
+    if (contains(handle)) {
+        return false;
+    }
+
+    if (handle >= positions_.size()) {
+        positions_.resize(static_cast<size_t>(handle) + 1, NOT_QUEUED);
+    }
+
+    Entry entry;
+    entry.enqueuedMs = enqueuedMs;
+    entry.key = makeKey(entry.enqueuedMs, priority);
+    entry.sequence = nextSequence_++;
+    entry.handle = handle;
+    entry.priority = priority;
+
+    heap_.push_back(entry);
+    positions_[handle] = heap_.size() - 1;
+    siftUp(heap_.size() - 1);
+
+    return true;
+}
+
+bool PriorityTaskQueue::update(TaskHandle handle, DownloadPriority priority) {
+    if (!contains(handle)) {
+        return false;
+    }
+
+    size_t index = positions_[handle];
+    Entry& entry = heap_[index];
+    if (entry.priority == priority) {
+        return true;
+    }
+
+    entry.priority = priority;
+    entry.key = makeKey(entry.enqueuedMs, priority);
+
+    siftUp(index);
+    siftDown(positions_[handle]);
+
+    return true;
+}
+
+bool PriorityTaskQueue::remove(TaskHandle handle) {
+    if (!contains(handle)) {
+        return false;
+    }
+
+    size_t index = positions_[handle];
+    positions_[handle] = NOT_QUEUED;
+
+    Entry last = heap_.back();
+    heap_.pop_back();
+
+    if (index < heap_.size()) {
+        place(index, last);
+        siftUp(index);
+        siftDown(positions_[last.handle]);
+    }
+
+    return true;
+}
+
+bool PriorityTaskQueue::contains(TaskHandle handle) const {
+    return handle < positions_.size() && positions_[handle] != NOT_QUEUED;
+}
+
+TaskHandle PriorityTaskQueue::top() const {
+    return heap_.front().handle;
+}
+
+std::vector<TaskHandle> PriorityTaskQueue::peek(size_t count) const {
+    std::vector<TaskHandle> handles;
+    if (heap_.empty() || count == 0) {
+        return handles;
+    }
+
+    // The next due entry is always a child of one already taken, so only
+    // the frontier of the taken subtree is compared
+    std::vector<size_t> frontier{0};
+    while (!frontier.empty() && handles.size() < count) {
+        auto best = std::min_element(frontier.begin(), frontier.end(),
+            [this](size_t a, size_t b) { return before(heap_[a], heap_[b]); });
+        size_t index = *best;
+        frontier.erase(best);
+        handles.push_back(heap_[index].handle);
+
+        for (size_t child = index * ARITY + 1; child <= index * ARITY + ARITY && child < heap_.size(); child++) {
+            frontier.push_back(child);
+        }
+    }
+    return handles;
+}
+
+DownloadPriority PriorityTaskQueue::getPriority(TaskHandle handle) const {
+    return heap_[positions_[handle]].priority;
+}
+
+int64_t PriorityTaskQueue::getEnqueuedTime(TaskHandle handle) const {
+    return heap_[positions_[handle]].enqueuedMs;
+}
+
+TaskHandle PriorityTaskQueue::pop() {
+    TaskHandle handle = heap_.front().handle;
+    remove(handle);
+    return handle;
+}
+
+size_t PriorityTaskQueue::size() const {
+    return heap_.size();
+}
+
+bool PriorityTaskQueue::empty() const {
+    return heap_.empty();
+}
+
+void PriorityTaskQueue::clear() {
+    for (const Entry& entry : heap_) {
+        positions_[entry.handle] = NOT_QUEUED;
+    }
+    heap_.clear();
+}
+
+int64_t PriorityTaskQueue::makeKey(int64_t enqueuedMs, DownloadPriority priority) const {
+    return enqueuedMs - static_cast<int64_t>(priority) * agingIntervalMs_;
+}
+
+bool PriorityTaskQueue::before(const Entry& a, const Entry& b) {
+    if (a.key != b.key) {
+        return a.key < b.key;
+    }
+    return a.sequence < b.sequence;
+}
+
+void PriorityTaskQueue::siftUp(size_t index) {
+    Entry entry = heap_[index];
+
+    while (index > 0) {
+        size_t parent = (index - 1) / ARITY;
+        if (!before(entry, heap_[parent])) {
+            break;
+        }
+        place(index, heap_[parent]);
+        index = parent;
+    }
+
+    place(index, entry);
+}
+
+void PriorityTaskQueue::siftDown(size_t index) {
+    Entry entry = heap_[index];
+    size_t count = heap_.size();
+
+    while (true) {
+        size_t first = index * ARITY + 1;
+        if (first >= count) {
+            break;
+        }
+
+        // Pick the child that is due first
+        size_t best = first;
+        size_t last = std::min(first + ARITY, count);
+        for (size_t child = first + 1; child < last; child++) {
+            if (before(heap_[child], heap_[best])) {
+                best = child;
+            }
+        }
+
+        if (!before(heap_[best], entry)) {
+            break;
+        }
+        place(index, heap_[best]);
+        index = best;
+    }
+
+    place(index, entry);
+}
+
+void PriorityTaskQueue::place(size_t index, const Entry& entry) {
+    heap_[index] = entry;
+    positions_[entry.handle] = index;
+}
+
+} // namespace core
+} // namespace dm
@@ -1,35 +1,220 @@
-#include "../../include/core/ProtocolHandler.h"
-#include "../../include/utils/Logger.h"
+#include "core/ProtocolHandler.h"
+#include "utils/Logger.h"
 
-namespace DownloadManager {
-namespace Core {
+#include <algorithm>
+#include <cctype>
 
-ProtocolHandler::ProtocolHandler(const std::string& name) : 
-    m_name(name), 
-    m_isActive(false) {
+namespace dm {
+namespace core {
+
+namespace {
+
+/**
+ * @brief Find the length of the scheme at the start of a URL
+ *
+ * @param url The URL
+ * @return size_t The length, 0 if the URL has no scheme
+ */
+size_t getSchemeLength(const std::string& url) {
+    if (url.empty() || !std::isalpha(static_cast<unsigned char>(url[0]))) {
+        return 0;
+    }
+    for (size_t i = 1; i < url.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(url[i]);
+        if (c == ':') {
+            return i;
+        }
+        if (!std::isalnum(c) && c != '+' && c != '-' && c != '.') {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+} // anonymous namespace
+
+ProtocolHandlerFactory& ProtocolHandlerFactory::getInstance() {
+    static ProtocolHandlerFactory instance;
+    return instance;
+}
+
+ProtocolHandlerFactory::ProtocolHandlerFactory() {
+    registries_.push_back(std::make_unique<Registry>());
+    registry_.store(registries_.back().get(), std::memory_order_release);
+}
+
+bool ProtocolHandlerFactory::registerHandler(std::shared_ptr<ProtocolHandler> handler) {
+    if (!handler) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Registry* current = registry_.load(std::memory_order_relaxed);
+    std::string name = handler->getProtocolName();
+    for (const auto& registered : current->handlers) {
+        if (registered->getProtocolName() == name) {
+            dm::utils::Logger::warning("Protocol handler already registered: " + name);
+            return false;
+        }
+    }
+
+    if (globalAuthCallback_) {
+        handler->setAuthCallback(globalAuthCallback_);
+    }
+
+    std::vector<std::shared_ptr<ProtocolHandler>> handlers = current->handlers;
+    handlers.push_back(std::move(handler));
+    publish(std::move(handlers));
+    dm::utils::Logger::info("Registered protocol handler: " + name);
+    return true;
+}
+
+bool ProtocolHandlerFactory::unregisterHandler(const std::string& protocolName) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Registry* current = registry_.load(std::memory_order_relaxed);
+    std::vector<std::shared_ptr<ProtocolHandler>> handlers;
+    for (const auto& handler : current->handlers) {
+        if (handler->getProtocolName() != protocolName) {
+            handlers.push_back(handler);
+        }
+    }
+    if (handlers.size() == current->handlers.size()) {
+        return false;
+    }
+
+    publish(std::move(handlers));
+    dm::utils::Logger::info("Unregistered protocol handler: " + protocolName);
+    return true;
+}
+
+std::shared_ptr<ProtocolHandler> ProtocolHandlerFactory::getHandlerForUrl(const std::string& url) {
+    ProtocolHandler* handler = findHandlerForUrl(url);
+    if (!handler) {
+        return nullptr;
+    }
+
+    const Registry* registry = registry_.load(std::memory_order_acquire);
+    for (const auto& registered : registry->handlers) {
+        if (registered.get() == handler) {
+            return registered;
+        }
+    }
+    return nullptr;
+}
+
+ProtocolHandler* ProtocolHandlerFactory::findHandlerForUrl(const std::string& url) const {
+    const Registry* registry = registry_.load(std::memory_order_acquire);
+    SchemeId id = findScheme(*registry, url.data(), getSchemeLength(url));
+    return id == INVALID_SCHEME_ID ? nullptr : registry->handlersByScheme[id];
+}
+
+SchemeId ProtocolHandlerFactory::getSchemeId(const std::string& url) const {
+    return findScheme(*registry_.load(std::memory_order_acquire), url.data(), getSchemeLength(url));
+}
+
+ProtocolHandler* ProtocolHandlerFactory::findHandler(SchemeId schemeId) const {
+    const Registry* registry = registry_.load(std::memory_order_acquire);
+    return schemeId < registry->handlersByScheme.size() ? registry->handlersByScheme[schemeId] : nullptr;
+}
+
+std::shared_ptr<ProtocolHandler> ProtocolHandlerFactory::getHandlerByName(const std::string& protocolName) {
+    const Registry* registry = registry_.load(std::memory_order_acquire);
+    for (const auto& handler : registry->handlers) {
+        if (handler->getProtocolName() == protocolName) {
+            return handler;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::shared_ptr<ProtocolHandler>> ProtocolHandlerFactory::getAllHandlers() const {
+    return registry_.load(std::memory_order_acquire)->handlers;
 }
 
-ProtocolHandler::~ProtocolHandler() {
+bool ProtocolHandlerFactory::isProtocolSupported(const std::string& protocol) const {
+    const Registry* registry = registry_.load(std::memory_order_acquire);
+    SchemeId id = findScheme(*registry, protocol.data(), protocol.size());
+    return id != INVALID_SCHEME_ID && registry->handlersByScheme[id] != nullptr;
 }
 
-std::string ProtocolHandler::getName() const {
-    return m_name;
+ProtocolOptions ProtocolHandlerFactory::getDefaultOptions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return defaultOptions_;
 }
 
-bool ProtocolHandler::isActive() const {
-    return m_isActive;
+void ProtocolHandlerFactory::setDefaultOptions(const ProtocolOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    defaultOptions_ = options;
 }
 
-void ProtocolHandler::setActive(bool active) {
-    m_isActive = active;
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        m_name + " protocol handler " + (active ? "activated" : "deactivated"));
+void ProtocolHandlerFactory::setGlobalAuthCallback(ProtocolAuthCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    globalAuthCallback_ = callback;
+    for (const auto& handler : registry_.load(std::memory_order_relaxed)->handlers) {
+        handler->setAuthCallback(callback);
+    }
 }
 
-bool ProtocolHandler::supportsScheme(const std::string& scheme) const {
-    auto supportedSchemes = getSupportedSchemes();
-    return std::find(supportedSchemes.begin(), supportedSchemes.end(), scheme) != supportedSchemes.end();
+SchemeId ProtocolHandlerFactory::findScheme(const Registry& registry, const char* scheme, size_t length) {
+    if (length == 0) {
+        return INVALID_SCHEME_ID;
+    }
+
+    // A handful of schemes, a scan beats hashing the string
+    for (size_t id = 0; id < registry.schemes.size(); id++) {
+        const std::string& interned = registry.schemes[id];
+        if (interned.size() != length) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < length && interned[i] == std::tolower(static_cast<unsigned char>(scheme[i]))) {
+            i++;
+        }
+        if (i == length) {
+            return static_cast<SchemeId>(id);
+        }
+    }
+    return INVALID_SCHEME_ID;
+}
+
+void ProtocolHandlerFactory::publish(std::vector<std::shared_ptr<ProtocolHandler>> handlers) {
+    const Registry* current = registry_.load(std::memory_order_relaxed);
+    auto registry = std::make_unique<Registry>();
+
+    // Ids stay interned once given out, callers may have cached them
+    registry->schemes = current->schemes;
+    for (const auto& handler : handlers) {
+        for (const std::string& scheme : handler->getProtocolSchemes()) {
+            std::string name = toLower(scheme);
+            if (findScheme(*registry, name.data(), name.size()) == INVALID_SCHEME_ID &&
+                registry->schemes.size() < INVALID_SCHEME_ID) {
+                registry->schemes.push_back(name);
+            }
+        }
+    }
+
+    registry->handlersByScheme.assign(registry->schemes.size(), nullptr);
+    for (const auto& handler : handlers) {
+        for (const std::string& scheme : handler->getProtocolSchemes()) {
+            std::string name = toLower(scheme);
+            SchemeId id = findScheme(*registry, name.data(), name.size());
+            if (id != INVALID_SCHEME_ID) {
+                registry->handlersByScheme[id] = handler.get();
+            }
+        }
+    }
+    registry->handlers = std::move(handlers);
+
+    // Readers may still be looking at an older registry, none is freed before the factory
+    registries_.push_back(std::move(registry));
+    registry_.store(registries_.back().get(), std::memory_order_release);
 }
 
-} // namespace Core
-} // namespace DownloadManager
\ No newline at end of file
+} // namespace core
+} // namespace dm
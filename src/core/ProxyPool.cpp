@@ -0,0 +1,546 @@
+#include "core/ProxyPool.h"
+#include "core/HttpClient.h"
+#include "utils/Logger.h"
+#include "utils/Tracer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+constexpr double SMOOTHING = 0.3;      // Weight of the newest sample
+
+double smooth(double current, double sample) {
+    return current <= 0 ? sample : current + SMOOTHING * (sample - current);
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) {
+        return -1.0;
+    }
+    size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    return values[middle];
+}
+
+} // anonymous namespace
+
+ProxyPool& ProxyPool::getInstance() {
+    static ProxyPool instance;
+    return instance;
+}
+
+ProxyPool::~ProxyPool() {
+    shutdown();
+}
+
+void ProxyPool::setProxies(const std::string& list) {
+    std::map<std::string, Proxy> proxies;
+    {
+        std::string normalized = list;
+        std::replace(normalized.begin(), normalized.end(), ',', ' ');
+        std::istringstream entries(normalized);
+        std::string entry;
+        while (entries >> entry) {
+            // url|cap|weight
+            std::string url = entry.substr(0, entry.find('|'));
+            if (url.empty()) {
+                continue;
+            }
+            Proxy proxy;
+            size_t capStart = entry.find('|');
+            if (capStart != std::string::npos) {
+                proxy.maxConnections = std::max(0, std::atoi(entry.c_str() + capStart + 1));
+                size_t weightStart = entry.find('|', capStart + 1);
+                if (weightStart != std::string::npos) {
+                    double weight = std::strtod(entry.c_str() + weightStart + 1, nullptr);
+                    proxy.weight = weight > 0 ? weight : 1.0;
+                }
+            }
+            proxies[url] = proxy;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Keep what was measured of proxies that stay, and their connections
+    for (auto& pair : proxies) {
+        auto existing = proxies_.find(pair.first);
+        if (existing != proxies_.end()) {
+            int maxConnections = pair.second.maxConnections;
+            double weight = pair.second.weight;
+            pair.second = existing->second;
+            pair.second.maxConnections = maxConnections;
+            pair.second.weight = weight;
+        }
+    }
+    proxies_.swap(proxies);
+    enabled_ = !proxies_.empty();
+    updateMedians();
+
+    if (!proxies_.empty()) {
+        dm::utils::Logger::info("Proxy pool: " + std::to_string(proxies_.size()) + " proxies");
+    }
+}
+
+bool ProxyPool::isEnabled() const {
+    return enabled_;
+}
+
+ProxyPool::Lease ProxyPool::acquire(const std::string& owner, std::string& proxy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (proxies_.empty()) {
+        return 0;
+    }
+    reinstateExpired();
+
+    Owner& stuck = owners_[owner];
+    auto it = proxies_.find(stuck.proxy);
+
+    // Stay on the proxy unless it was ejected, or is full and holds none of
+    // the download's connections; a range waits for its proxy otherwise
+    bool stay = it != proxies_.end() && !it->second.ejected &&
+                (it->second.connections < getCap(it->second) || stuck.connections > 0);
+    if (!stay) {
+        std::string next = choose(true);
+        if (next.empty()) {
+            waiting_ = true;
+            if (stuck.proxy.empty()) {
+                owners_.erase(owner);
+            }
+            return 0;
+        }
+        if (!stuck.proxy.empty() && dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+            dm::utils::Logger::debug("Download " + owner + " moves from proxy " + stuck.proxy + " to " + next);
+        }
+        stuck.proxy = next;
+        stuck.connections = 0;
+        it = proxies_.find(next);
+    }
+
+    if (it->second.connections >= getCap(it->second)) {
+        waiting_ = true;
+        return 0;
+    }
+
+    it->second.connections++;
+    stuck.connections++;
+    proxy = it->first;
+
+    Lease lease = nextLease_++;
+    leases_[lease] = LeaseInfo{it->first, owner};
+    return lease;
+}
+
+void ProxyPool::release(Lease lease) {
+    if (lease == 0) {
+        return;
+    }
+
+    ReleaseCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = leases_.find(lease);
+        if (it == leases_.end()) {
+            return;
+        }
+
+        auto proxy = proxies_.find(it->second.proxy);
+        if (proxy != proxies_.end() && proxy->second.connections > 0) {
+            proxy->second.connections--;
+        }
+        auto owner = owners_.find(it->second.owner);
+        if (owner != owners_.end() && owner->second.proxy == it->second.proxy && owner->second.connections > 0) {
+            owner->second.connections--;
+        }
+        leases_.erase(it);
+
+        if (waiting_) {
+            waiting_ = false;
+            callback = releaseCallback_;
+        }
+    }
+
+    if (callback) {
+        callback();
+    }
+}
+
+std::string ProxyPool::pick(const std::string& owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (proxies_.empty()) {
+        return std::string();
+    }
+    reinstateExpired();
+
+    Owner& stuck = owners_[owner];
+    auto it = proxies_.find(stuck.proxy);
+    if (it == proxies_.end() || it->second.ejected) {
+        stuck.proxy = choose(false);
+        stuck.connections = 0;
+    }
+    return stuck.proxy;
+}
+
+void ProxyPool::forget(const std::string& owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    owners_.erase(owner);
+}
+
+void ProxyPool::report(const std::string& proxy, bool proxyFailed, int64_t firstByteMs,
+                       int64_t bytes, int64_t elapsedMs) {
+    if (proxy.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = proxies_.find(proxy);
+    if (it == proxies_.end()) {
+        return;
+    }
+
+    Proxy& entry = it->second;
+    entry.transfers++;
+    if (proxyFailed) {
+        entry.failures++;
+        entry.consecutiveFailures++;
+        entry.consecutiveSuccesses = 0;
+    } else {
+        entry.consecutiveFailures = 0;
+        entry.consecutiveSuccesses++;
+        if (entry.consecutiveSuccesses >= MIN_SAMPLES) {
+            entry.ejectSeconds = 0;     // Steady again, the next ejection starts short
+        }
+        if (firstByteMs >= 0) {
+            entry.latencyMs = smooth(entry.latencyMs, static_cast<double>(firstByteMs));
+            entry.samples++;
+        }
+        if (bytes >= MIN_THROUGHPUT_BYTES && elapsedMs > 0) {
+            entry.throughput = smooth(entry.throughput, static_cast<double>(bytes) * 1000.0 / elapsedMs);
+        }
+    }
+
+    updateMedians();
+    judge(it->first, entry);
+}
+
+bool ProxyPool::isProxyFailure(CURLcode code, int statusCode) {
+    switch (code) {
+        case CURLE_COULDNT_RESOLVE_PROXY:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+#if LIBCURL_VERSION_NUM >= 0x074900
+        case CURLE_PROXY:
+#endif
+            return true;
+        default:
+            break;
+    }
+    // Proxy authentication, or the proxy could not reach the origin
+    return statusCode == 407 || statusCode == 502 || statusCode == 504;
+}
+
+void ProxyPool::setAssignment(ProxyAssignment assignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assignment_ = assignment;
+}
+
+ProxyAssignment ProxyPool::getAssignment() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return assignment_;
+}
+
+bool ProxyPool::parseAssignment(const std::string& name, ProxyAssignment& assignment) {
+    if (name == "least_loaded") {
+        assignment = ProxyAssignment::LEAST_LOADED;
+        return true;
+    }
+    if (name == "weighted") {
+        assignment = ProxyAssignment::WEIGHTED;
+        return true;
+    }
+    return false;
+}
+
+const char* ProxyPool::getAssignmentName(ProxyAssignment assignment) {
+    switch (assignment) {
+        case ProxyAssignment::WEIGHTED:
+            return "weighted";
+        case ProxyAssignment::LEAST_LOADED:
+        default:
+            return "least_loaded";
+    }
+}
+
+void ProxyPool::setDefaultMaxConnections(int maxConnections) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    defaultMaxConnections_ = std::max(1, maxConnections);
+}
+
+void ProxyPool::setHealthCheckUrl(const std::string& url) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        healthCheckUrl_ = url;
+        if (!url.empty() && !healthThread_) {
+            stopHealth_ = false;
+            healthThread_ = std::make_unique<std::thread>(&ProxyPool::healthThread, this);
+        }
+    }
+    healthCv_.notify_all();
+}
+
+void ProxyPool::checkHealth() {
+    std::string url;
+    std::vector<std::string> proxies;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        url = healthCheckUrl_;
+        for (const auto& pair : proxies_) {
+            proxies.push_back(pair.first);
+        }
+    }
+    if (url.empty()) {
+        return;
+    }
+
+    for (const std::string& proxy : proxies) {
+        HttpClient client;
+        client.setProxy(proxy);
+        client.setTimeout(HEALTH_CHECK_TIMEOUT_SECONDS);
+
+        auto start = std::chrono::steady_clock::now();
+        HttpResponse response = client.probe(url);
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Any reply of the origin means the proxy got through
+        bool healthy = response.statusCode > 0 && !isProxyFailure(response.curlCode, response.statusCode);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = proxies_.find(proxy);
+        if (it == proxies_.end()) {
+            continue;
+        }
+        Proxy& entry = it->second;
+        if (healthy) {
+            entry.latencyMs = smooth(entry.latencyMs, elapsedMs);
+            if (entry.ejected) {
+                entry.ejected = false;
+                entry.consecutiveFailures = 0;
+                entry.samples = 0;
+                entry.throughput = 0.0;
+                dm::utils::Logger::info("Proxy " + proxy + " passed its health check, back in the pool");
+            }
+        } else if (!entry.ejected) {
+            entry.consecutiveFailures++;
+            judge(proxy, entry);
+        }
+        updateMedians();
+
+        if (stopHealth_) {
+            return;
+        }
+    }
+}
+
+void ProxyPool::shutdown() {
+    std::unique_ptr<std::thread> thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopHealth_ = true;
+        thread = std::move(healthThread_);
+    }
+    healthCv_.notify_all();
+    if (thread && thread->joinable()) {
+        thread->join();
+    }
+}
+
+std::vector<ProxyStats> ProxyPool::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<std::string, int> owners;
+    for (const auto& pair : owners_) {
+        owners[pair.second.proxy]++;
+    }
+
+    std::vector<ProxyStats> result;
+    result.reserve(proxies_.size());
+    for (const auto& pair : proxies_) {
+        const Proxy& proxy = pair.second;
+        ProxyStats stats;
+        stats.url = pair.first;
+        stats.connections = proxy.connections;
+        stats.maxConnections = getCap(proxy);
+        stats.weight = proxy.weight;
+        stats.latencyMs = proxy.latencyMs;
+        stats.throughput = proxy.throughput;
+        stats.score = getScore(proxy);
+        stats.ejected = proxy.ejected;
+        stats.owners = owners[pair.first];
+        stats.transfers = proxy.transfers;
+        stats.failures = proxy.failures;
+        stats.ejections = proxy.ejections;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+void ProxyPool::setReleaseCallback(ReleaseCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    releaseCallback_ = callback;
+}
+
+int ProxyPool::getCap(const Proxy& proxy) const {
+    return proxy.maxConnections > 0 ? proxy.maxConnections : defaultMaxConnections_;
+}
+
+double ProxyPool::getScore(const Proxy& proxy) const {
+    double score = 1.0;
+    if (proxy.latencyMs > 0 && medianLatencyMs_ > 0) {
+        score *= medianLatencyMs_ / proxy.latencyMs;
+    }
+    if (proxy.throughput > 0 && medianThroughput_ > 0) {
+        score *= proxy.throughput / medianThroughput_;
+    }
+    return std::min(10.0, std::max(0.1, score));
+}
+
+std::string ProxyPool::choose(bool needCapacity) const {
+    const std::string* best = nullptr;
+    double bestLoad = 0.0;
+    double bestLatency = 0.0;
+
+    for (const auto& pair : proxies_) {
+        const Proxy& proxy = pair.second;
+        int cap = getCap(proxy);
+        if (proxy.ejected || (needCapacity && proxy.connections >= cap)) {
+            continue;
+        }
+
+        // Lower is better; weighted counts the connection about to be added
+        double load = assignment_ == ProxyAssignment::WEIGHTED
+                          ? (proxy.connections + 1) / (cap * proxy.weight * getScore(proxy))
+                          : static_cast<double>(proxy.connections) / cap;
+        double latency = proxy.latencyMs >= 0 ? proxy.latencyMs : medianLatencyMs_;
+        if (!best || load < bestLoad || (load == bestLoad && latency < bestLatency)) {
+            best = &pair.first;
+            bestLoad = load;
+            bestLatency = latency;
+        }
+    }
+    return best ? *best : std::string();
+}
+
+void ProxyPool::reinstateExpired() {
+    if (!healthCheckUrl_.empty()) {
+        return;     // The health check takes proxies back
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (auto& pair : proxies_) {
+        Proxy& proxy = pair.second;
+        if (proxy.ejected && now >= proxy.ejectedUntil) {
+            // On probation: one more failure ejects it again
+            proxy.ejected = false;
+            proxy.consecutiveFailures = MAX_CONSECUTIVE_FAILURES - 1;
+            proxy.samples = 0;
+            proxy.latencyMs = -1.0;
+            proxy.throughput = 0.0;
+            dm::utils::Logger::info("Proxy " + pair.first + " back in the pool on probation");
+        }
+    }
+}
+
+void ProxyPool::judge(const std::string& url, Proxy& proxy) {
+    if (proxy.ejected) {
+        return;
+    }
+
+    if (proxy.consecutiveFailures >= MAX_CONSECUTIVE_FAILURES) {
+        eject(url, proxy, std::to_string(proxy.consecutiveFailures) + " failures in a row");
+        return;
+    }
+    if (proxy.samples < MIN_SAMPLES) {
+        return;
+    }
+    if (proxy.latencyMs > 0 && medianLatencyMs_ > 0 && proxy.latencyMs > medianLatencyMs_ * SLOW_FACTOR) {
+        eject(url, proxy, "first byte after " + std::to_string(static_cast<int64_t>(proxy.latencyMs)) +
+                          " ms, the pool takes " + std::to_string(static_cast<int64_t>(medianLatencyMs_)) + " ms");
+    } else if (proxy.throughput > 0 && medianThroughput_ > 0 && proxy.throughput * SLOW_FACTOR < medianThroughput_) {
+        eject(url, proxy, std::to_string(static_cast<int64_t>(proxy.throughput / 1024)) + " KB/s, the pool does " +
+                          std::to_string(static_cast<int64_t>(medianThroughput_ / 1024)) + " KB/s");
+    }
+}
+
+void ProxyPool::eject(const std::string& url, Proxy& proxy, const std::string& reason) {
+    int healthy = 0;
+    for (const auto& pair : proxies_) {
+        if (!pair.second.ejected) {
+            healthy++;
+        }
+    }
+    if (healthy <= 1) {
+        return;     // Going slowly beats not going at all
+    }
+
+    proxy.ejected = true;
+    proxy.ejectSeconds = proxy.ejectSeconds > 0 ? std::min(proxy.ejectSeconds * 2, MAX_EJECT_SECONDS) : EJECT_SECONDS;
+    proxy.ejectedUntil = std::chrono::steady_clock::now() + std::chrono::seconds(proxy.ejectSeconds);
+    proxy.ejections++;
+    proxy.consecutiveSuccesses = 0;
+    updateMedians();
+
+    dm::utils::Logger::warning("Proxy " + url + " ejected for " + std::to_string(proxy.ejectSeconds) + " s: " + reason);
+}
+
+void ProxyPool::updateMedians() {
+    std::vector<double> latencies;
+    std::vector<double> throughputs;
+    for (const auto& pair : proxies_) {
+        const Proxy& proxy = pair.second;
+        if (proxy.ejected) {
+            continue;
+        }
+        if (proxy.latencyMs > 0) {
+            latencies.push_back(proxy.latencyMs);
+        }
+        if (proxy.throughput > 0) {
+            throughputs.push_back(proxy.throughput);
+        }
+    }
+
+    // A median of one or two says nothing about the others
+    medianLatencyMs_ = latencies.size() >= 3 ? median(std::move(latencies)) : -1.0;
+    medianThroughput_ = throughputs.size() >= 3 ? median(std::move(throughputs)) : 0.0;
+}
+
+void ProxyPool::healthThread() {
+    DM_TRACE_THREAD("proxy-health");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopHealth_ && !healthCheckUrl_.empty()) {
+        lock.unlock();
+        checkHealth();
+        lock.lock();
+        healthCv_.wait_for(lock, std::chrono::seconds(HEALTH_CHECK_INTERVAL_SECONDS), [this]() {
+            return stopHealth_ || healthCheckUrl_.empty();
+        });
+    }
+
+    // Let a later setHealthCheckUrl() start a new thread
+    if (!stopHealth_ && healthThread_) {
+        healthThread_->detach();
+        healthThread_.reset();
+    }
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,252 @@
+#include "core/RpcClient.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const uint8_t LIST_ALL = 0xFF;
+
+} // anonymous namespace
+
+RpcClient::RpcClient() {
+}
+
+RpcClient::~RpcClient() {
+    disconnect();
+}
+
+bool RpcClient::connect(const std::string& socketPath) {
+    disconnect();
+
+#ifdef _WIN32
+    (void)socketPath;
+    error_ = "The download daemon is not available on this platform";
+    return false;
+#else
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        error_ = "Socket path is too long: " + socketPath;
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        error_ = "Failed to connect to the daemon at " + socketPath + ": " + std::strerror(errno);
+        disconnect();
+        return false;
+    }
+    return true;
+#endif
+}
+
+void RpcClient::disconnect() {
+#ifndef _WIN32
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+#endif
+    fd_ = -1;
+}
+
+bool RpcClient::call(const RpcWriter& request, std::string& response) {
+    if (fd_ < 0) {
+        error_ = "Not connected to the daemon";
+        return false;
+    }
+
+    if (!RpcChannel::sendFrame(fd_, request.getPayload()) || !RpcChannel::receiveFrame(fd_, response)) {
+        error_ = "Lost the connection to the daemon";
+        disconnect();
+        return false;
+    }
+
+    RpcReader reader(response);
+    uint32_t requestId = RpcReader(request.getPayload()).getRequestId();
+    if (!reader.isValid() || reader.getRequestId() != requestId) {
+        error_ = "Unexpected response from the daemon";
+        disconnect();
+        return false;
+    }
+    if (reader.getType() == RpcMessageType::ERROR) {
+        std::string message;
+        reader.readString(message);
+        error_ = "Daemon error: " + message;
+        return false;
+    }
+    return reader.getType() == RpcMessageType::RESULT;
+}
+
+bool RpcClient::addDownloads(const std::vector<RpcDownload>& downloads, bool start,
+                             std::vector<std::string>& ids) {
+    ids.clear();
+    ids.reserve(downloads.size());
+
+    std::string response;
+    for (size_t first = 0; first < downloads.size(); first += ADD_BATCH_SIZE) {
+        size_t count = std::min(ADD_BATCH_SIZE, downloads.size() - first);
+
+        RpcWriter request(RpcMessageType::ADD, nextRequestId_++);
+        request.putU8(start ? 1 : 0);
+        request.putU32(static_cast<uint32_t>(count));
+        for (size_t i = first; i < first + count; i++) {
+            request.putString(downloads[i].url);
+            request.putString(downloads[i].destinationPath);
+            request.putString(downloads[i].filename);
+            request.putU8(static_cast<uint8_t>(downloads[i].priority));
+        }
+        if (!call(request, response)) {
+            return false;
+        }
+
+        RpcReader reader(response);
+        uint32_t answered = 0;
+        if (!reader.readU32(answered) || answered != count) {
+            error_ = "Malformed add response";
+            return false;
+        }
+        for (uint32_t i = 0; i < answered; i++) {
+            std::string id;
+            reader.readString(id);
+            ids.push_back(std::move(id));
+        }
+        if (!reader.done()) {
+            error_ = "Malformed add response";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RpcClient::control(RpcControl operation, const std::vector<std::string>& ids, std::vector<bool>& results) {
+    results.clear();
+    results.reserve(ids.size());
+
+    std::string response;
+    for (size_t first = 0; first < ids.size(); first += ADD_BATCH_SIZE) {
+        size_t count = std::min(ADD_BATCH_SIZE, ids.size() - first);
+
+        RpcWriter request(RpcMessageType::CONTROL, nextRequestId_++);
+        request.putU8(static_cast<uint8_t>(operation));
+        request.putU32(static_cast<uint32_t>(count));
+        for (size_t i = first; i < first + count; i++) {
+            request.putString(ids[i]);
+        }
+        if (!call(request, response)) {
+            return false;
+        }
+
+        RpcReader reader(response);
+        uint32_t answered = 0;
+        if (!reader.readU32(answered) || answered != count) {
+            error_ = "Malformed control response";
+            return false;
+        }
+        for (uint32_t i = 0; i < answered; i++) {
+            uint8_t success = 0;
+            reader.readU8(success);
+            results.push_back(success != 0);
+        }
+        if (!reader.done()) {
+            error_ = "Malformed control response";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RpcClient::listTasks(std::vector<RpcTaskSummary>& tasks) {
+    return list(LIST_ALL, tasks);
+}
+
+bool RpcClient::listTasks(DownloadStatus status, std::vector<RpcTaskSummary>& tasks) {
+    return list(static_cast<uint8_t>(status), tasks);
+}
+
+bool RpcClient::list(uint8_t filter, std::vector<RpcTaskSummary>& tasks) {
+    tasks.clear();
+
+    RpcWriter request(RpcMessageType::LIST, nextRequestId_++);
+    request.putU8(filter);
+    std::string response;
+    if (!call(request, response)) {
+        return false;
+    }
+
+    RpcReader reader(response);
+    uint32_t count = 0;
+    if (!reader.readU32(count)) {
+        error_ = "Malformed list response";
+        return false;
+    }
+    tasks.reserve(std::min<size_t>(count, reader.remainingItems(1)));
+    for (uint32_t i = 0; i < count; i++) {
+        RpcTaskSummary summary;
+        if (!reader.readSummary(summary)) {
+            break;
+        }
+        tasks.push_back(std::move(summary));
+    }
+    if (!reader.done()) {
+        error_ = "Malformed list response";
+        return false;
+    }
+    return true;
+}
+
+bool RpcClient::subscribe(uint32_t progressIntervalMs, RpcEventCallback callback) {
+    RpcWriter request(RpcMessageType::SUBSCRIBE, nextRequestId_++);
+    request.putU32(progressIntervalMs);
+    std::string response;
+    if (!call(request, response)) {
+        return false;
+    }
+
+    std::string event;
+    while (RpcChannel::receiveFrame(fd_, event)) {
+        RpcReader reader(event);
+        if (reader.isValid() && reader.getType() == RpcMessageType::ERROR) {
+            std::string message;
+            reader.readString(message);
+            error_ = "Daemon error: " + message;
+            break;
+        }
+
+        uint8_t kind = 0;
+        RpcTaskSummary summary;
+        if (reader.getType() != RpcMessageType::EVENT || !reader.readU8(kind) ||
+            !reader.readSummary(summary) || !reader.done()) {
+            error_ = "Malformed event from the daemon";
+            break;
+        }
+        if (!callback(static_cast<RpcEventKind>(kind), summary)) {
+            return true;
+        }
+    }
+
+    if (error_.empty()) {
+        error_ = "Lost the connection to the daemon";
+    }
+    disconnect();
+    return false;
+}
+
+bool RpcClient::shutdownDaemon() {
+    std::string response;
+    return call(RpcWriter(RpcMessageType::SHUTDOWN, nextRequestId_++), response);
+}
+
+} // namespace core
+} // namespace dm
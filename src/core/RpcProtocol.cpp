@@ -0,0 +1,207 @@
+#include "core/RpcProtocol.h"
+#include "utils/FileUtils.h"
+
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const size_t MESSAGE_HEADER_SIZE = 5;   // Type, request ID
+
+uint32_t getU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+#ifndef _WIN32
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        // A client that went away must not kill the daemon with SIGPIPE
+        ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receiveAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = ::recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+#endif
+
+} // anonymous namespace
+
+RpcWriter::RpcWriter(RpcMessageType type, uint32_t requestId) {
+    putU8(static_cast<uint8_t>(type));
+    putU32(requestId);
+}
+
+void RpcWriter::putU32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        payload_.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void RpcWriter::putI64(int64_t value) {
+    uint64_t bits = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++) {
+        payload_.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+void RpcWriter::putString(const std::string& value) {
+    putU32(static_cast<uint32_t>(value.size()));
+    payload_ += value;
+}
+
+void RpcWriter::putSummary(const RpcTaskSummary& summary) {
+    putString(summary.id);
+    putString(summary.url);
+    putString(summary.filename);
+    putU8(static_cast<uint8_t>(summary.status));
+    putI64(summary.downloadedBytes);
+    putI64(summary.totalBytes);
+    putI64(summary.speed);
+}
+
+RpcReader::RpcReader(const std::string& payload)
+    : payload_(payload) {
+    if (payload_.size() < MESSAGE_HEADER_SIZE) {
+        return;
+    }
+    type_ = static_cast<RpcMessageType>(static_cast<unsigned char>(payload_[0]));
+    requestId_ = getU32(payload_.data() + 1);
+    pos_ = MESSAGE_HEADER_SIZE;
+    valid_ = true;
+}
+
+bool RpcReader::readU8(uint8_t& value) {
+    if (!valid_ || payload_.size() - pos_ < 1) {
+        valid_ = false;
+        return false;
+    }
+    value = static_cast<uint8_t>(payload_[pos_++]);
+    return true;
+}
+
+bool RpcReader::readU32(uint32_t& value) {
+    if (!valid_ || payload_.size() - pos_ < 4) {
+        valid_ = false;
+        return false;
+    }
+    value = getU32(payload_.data() + pos_);
+    pos_ += 4;
+    return true;
+}
+
+bool RpcReader::readI64(int64_t& value) {
+    if (!valid_ || payload_.size() - pos_ < 8) {
+        valid_ = false;
+        return false;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) {
+        bits |= static_cast<uint64_t>(static_cast<unsigned char>(payload_[pos_ + i])) << (8 * i);
+    }
+    value = static_cast<int64_t>(bits);
+    pos_ += 8;
+    return true;
+}
+
+bool RpcReader::readString(std::string& value) {
+    uint32_t size = 0;
+    if (!readU32(size)) {
+        return false;
+    }
+    if (payload_.size() - pos_ < size) {
+        valid_ = false;
+        return false;
+    }
+    value.assign(payload_, pos_, size);
+    pos_ += size;
+    return true;
+}
+
+bool RpcReader::readSummary(RpcTaskSummary& summary) {
+    uint8_t status = 0;
+    bool success = readString(summary.id) && readString(summary.url) && readString(summary.filename) &&
+                   readU8(status) && readI64(summary.downloadedBytes) && readI64(summary.totalBytes) &&
+                   readI64(summary.speed);
+    summary.status = static_cast<DownloadStatus>(status);
+    return success;
+}
+
+#ifdef _WIN32
+
+// The daemon is not available on Windows yet
+bool RpcChannel::sendFrame(int, const std::string&) {
+    return false;
+}
+
+bool RpcChannel::receiveFrame(int, std::string&) {
+    return false;
+}
+
+#else
+
+bool RpcChannel::sendFrame(int fd, const std::string& payload) {
+    if (payload.size() > MAX_FRAME_SIZE) {
+        return false;
+    }
+
+    char size[4];
+    for (int i = 0; i < 4; i++) {
+        size[i] = static_cast<char>((payload.size() >> (8 * i)) & 0xFF);
+    }
+    return sendAll(fd, size, sizeof(size)) && sendAll(fd, payload.data(), payload.size());
+}
+
+bool RpcChannel::receiveFrame(int fd, std::string& payload) {
+    char size[4];
+    if (!receiveAll(fd, size, sizeof(size))) {
+        return false;
+    }
+
+    uint32_t payloadSize = getU32(size);
+    if (payloadSize > MAX_FRAME_SIZE) {
+        return false;
+    }
+    payload.resize(payloadSize);
+    return payloadSize == 0 || receiveAll(fd, &payload[0], payloadSize);
+}
+
+#endif
+
+std::string RpcChannel::getDefaultSocketPath() {
+    return utils::FileUtils::combinePaths(utils::FileUtils::getAppDataDirectory(), "daemon.sock");
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,598 @@
+#include "core/RpcServer.h"
+#include "core/DownloadManager.h"
+#include "core/DownloadTask.h"
+#include "core/TaskJournal.h"
+#include "core/MetadataPrefetcher.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const size_t MAX_PENDING_EVENTS = 65536;    // Per connection, before it is dropped
+const size_t DORMANT_PAGE_SIZE = 4096;
+const uint8_t LIST_ALL = 0xFF;
+
+// Smallest encodings, to bound counts read from a client
+const size_t MIN_DOWNLOAD_SIZE = 13;        // Three empty strings, priority
+const size_t MIN_ID_SIZE = 4;
+
+RpcTaskSummary summarize(const std::shared_ptr<DownloadTask>& task) {
+    ProgressInfo progress = task->getProgressInfo();
+
+    RpcTaskSummary summary;
+    summary.id = task->getId();
+    summary.url = task->getUrl();
+    summary.filename = task->getFilename();
+    summary.status = task->getStatus();
+    summary.downloadedBytes = progress.downloadedBytes;
+    summary.totalBytes = progress.totalBytes;
+    summary.speed = static_cast<int64_t>(progress.downloadSpeed);
+    return summary;
+}
+
+RpcTaskSummary summarize(const JournalEntry& entry) {
+    RpcTaskSummary summary;
+    summary.id = entry.id;
+    summary.url = entry.url;
+    summary.filename = entry.filename;
+    summary.status = entry.status;
+    summary.totalBytes = entry.fileSize;
+    if (summary.totalBytes <= 0 && entry.status == DownloadStatus::QUEUED) {
+        // Known before the download starts if it was probed while queued
+        summary.totalBytes = MetadataPrefetcher::getInstance().getFileSize(entry.url);
+    }
+    if (entry.status == DownloadStatus::COMPLETED) {
+        summary.downloadedBytes = entry.fileSize;
+    } else if (entry.fileSize > 0 && !entry.ranges.empty()) {
+        int64_t remaining = 0;
+        for (const auto& range : entry.ranges) {
+            remaining += range.endByte - range.startByte + 1;
+        }
+        summary.downloadedBytes = std::max<int64_t>(entry.fileSize - remaining, 0);
+    }
+    return summary;
+}
+
+std::string makeError(uint32_t requestId, const std::string& message) {
+    RpcWriter writer(RpcMessageType::ERROR, requestId);
+    writer.putString(message);
+    return writer.getPayload();
+}
+
+#ifndef _WIN32
+void closeFd(int& fd) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool openPipe(int fds[2]) {
+    if (::pipe(fds) != 0) {
+        return false;
+    }
+    // Wake-ups are coalesced, a full pipe already wakes the reader
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    ::fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+void wake(int fd) {
+    char byte = 1;
+    ssize_t written = ::write(fd, &byte, 1);
+    (void)written;
+}
+
+void drain(int fd) {
+    char buffer[64];
+    while (::read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+}
+#endif
+
+} // anonymous namespace
+
+RpcServer::RpcServer(DownloadManager& manager)
+    : manager_(manager) {
+}
+
+RpcServer::~RpcServer() {
+    stop();
+}
+
+#ifdef _WIN32
+
+bool RpcServer::start(const std::string&) {
+    utils::Logger::error("The download daemon is not available on this platform");
+    return false;
+}
+
+void RpcServer::stop() {
+}
+
+void RpcServer::acceptLoop() {
+}
+
+void RpcServer::serveConnection(Connection*) {
+}
+
+bool RpcServer::sendProgress(Connection*) {
+    return false;
+}
+
+void RpcServer::queueEvent(Connection*, std::string) {
+}
+
+void RpcServer::closeConnection(Connection*) {
+}
+
+#else
+
+bool RpcServer::start(const std::string& socketPath) {
+    if (running_) {
+        return true;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        utils::Logger::error("Daemon socket path is too long: " + socketPath);
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    // A socket nobody answers on was left by a daemon that died
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0) {
+        bool inUse = ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        ::close(probe);
+        if (inUse) {
+            utils::Logger::error("Another daemon is already listening on " + socketPath);
+            return false;
+        }
+    }
+    ::unlink(socketPath.c_str());
+
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+        utils::Logger::error("Failed to create daemon socket: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    ::fcntl(listenFd_, F_SETFD, FD_CLOEXEC);
+
+    // Created owner-only, no other user may control the downloads
+    mode_t previousMask = ::umask(0177);
+    bool bound = ::bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    int bindError = errno;
+    ::umask(previousMask);
+
+    if (!bound || ::listen(listenFd_, SOMAXCONN) != 0 || !openPipe(wakePipe_)) {
+        utils::Logger::error("Failed to listen on " + socketPath + ": " +
+                             std::string(std::strerror(bound ? errno : bindError)));
+        closeFd(listenFd_);
+        if (bound) {
+            ::unlink(socketPath.c_str());
+        }
+        return false;
+    }
+
+    socketPath_ = socketPath;
+    {
+        std::lock_guard<std::mutex> lock(shutdownMutex_);
+        shutdownRequested_ = false;
+    }
+    running_ = true;
+    acceptThread_ = std::thread(&RpcServer::acceptLoop, this);
+
+    utils::Logger::info("Daemon listening on " + socketPath);
+    return true;
+}
+
+void RpcServer::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    wake(wakePipe_[1]);
+    if (acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+
+    for (auto& connection : connections_) {
+        closeConnection(connection.get());
+    }
+    connections_.clear();
+
+    closeFd(listenFd_);
+    closeFd(wakePipe_[0]);
+    closeFd(wakePipe_[1]);
+    ::unlink(socketPath_.c_str());
+
+    requestShutdown();
+    utils::Logger::info("Daemon stopped listening");
+}
+
+void RpcServer::acceptLoop() {
+    while (running_) {
+        pollfd fds[2] = {{listenFd_, POLLIN, 0}, {wakePipe_[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            utils::Logger::error("Daemon socket poll failed: " + std::string(std::strerror(errno)));
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        // Clients that hung up are reaped as new ones arrive
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if ((*it)->finished) {
+                closeConnection(it->get());
+                it = connections_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = ::accept(listenFd_, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            if (!openPipe(connection->wakePipe)) {
+                ::close(fd);
+                continue;
+            }
+            Connection* raw = connection.get();
+            connections_.push_back(std::move(connection));
+            raw->thread = std::thread(&RpcServer::serveConnection, this, raw);
+        }
+    }
+}
+
+void RpcServer::serveConnection(Connection* connection) {
+    std::string request;
+    std::string response;
+    auto nextProgress = std::chrono::steady_clock::now();
+
+    while (running_) {
+        int timeout = -1;
+        uint32_t interval = 0;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            interval = connection->progressIntervalMs;
+        }
+        if (interval > 0) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                nextProgress - std::chrono::steady_clock::now()).count();
+            timeout = static_cast<int>(std::max<int64_t>(wait, 0));
+        }
+
+        pollfd fds[2] = {{connection->fd, POLLIN, 0}, {connection->wakePipe[0], POLLIN, 0}};
+        if (::poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            break;
+        }
+        if (!running_) {
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            drain(connection->wakePipe[0]);
+
+            std::deque<std::string> events;
+            bool overflowed = false;
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                events.swap(connection->events);
+                overflowed = connection->overflowed;
+            }
+            if (overflowed) {
+                utils::Logger::warning("Daemon client fell behind on events, disconnecting it");
+                RpcChannel::sendFrame(connection->fd, makeError(0, "Too many events pending"));
+                break;
+            }
+
+            bool sent = true;
+            for (const auto& event : events) {
+                if (!(sent = RpcChannel::sendFrame(connection->fd, event))) {
+                    break;
+                }
+            }
+            if (!sent) {
+                break;
+            }
+        }
+
+        if (interval > 0 && std::chrono::steady_clock::now() >= nextProgress) {
+            if (!sendProgress(connection)) {
+                break;
+            }
+            nextProgress = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval);
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!RpcChannel::receiveFrame(connection->fd, request)) {
+                break;
+            }
+            bool keepOpen = handleRequest(connection, request, response);
+            if (!RpcChannel::sendFrame(connection->fd, response) || !keepOpen) {
+                break;
+            }
+        }
+    }
+
+    // The listener is removed here so no more events are queued for a
+    // client that is gone; the fd is closed when the connection is reaped
+    int listenerId = -1;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        listenerId = connection->listenerId;
+        connection->listenerId = -1;
+        connection->progressIntervalMs = 0;
+    }
+    if (listenerId >= 0) {
+        manager_.removeTaskStatusListener(listenerId);
+    }
+    connection->finished = true;
+}
+
+bool RpcServer::sendProgress(Connection* connection) {
+    for (const auto& task : manager_.getAllDownloadTasks()) {
+        DownloadStatus status = task->getStatus();
+        if (status != DownloadStatus::DOWNLOADING && status != DownloadStatus::CONNECTING) {
+            continue;
+        }
+
+        RpcWriter writer(RpcMessageType::EVENT, 0);
+        writer.putU8(static_cast<uint8_t>(RpcEventKind::PROGRESS));
+        writer.putSummary(summarize(task));
+        if (!RpcChannel::sendFrame(connection->fd, writer.getPayload())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RpcServer::queueEvent(Connection* connection, std::string event) {
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (connection->overflowed) {
+            return;
+        }
+        if (connection->events.size() >= MAX_PENDING_EVENTS) {
+            connection->overflowed = true;
+            connection->events.clear();
+        } else {
+            connection->events.push_back(std::move(event));
+        }
+    }
+    wake(connection->wakePipe[1]);
+}
+
+void RpcServer::closeConnection(Connection* connection) {
+    // Wakes a connection thread still serving, on stop, even from a send
+    // to a client that stopped reading
+    wake(connection->wakePipe[1]);
+    ::shutdown(connection->fd, SHUT_RDWR);
+    if (connection->thread.joinable()) {
+        connection->thread.join();
+    }
+
+    closeFd(connection->fd);
+    closeFd(connection->wakePipe[0]);
+    closeFd(connection->wakePipe[1]);
+}
+
+#endif
+
+void RpcServer::waitForShutdown() {
+    std::unique_lock<std::mutex> lock(shutdownMutex_);
+    shutdownCondition_.wait(lock, [this]() { return shutdownRequested_; });
+}
+
+void RpcServer::requestShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(shutdownMutex_);
+        shutdownRequested_ = true;
+    }
+    shutdownCondition_.notify_all();
+}
+
+bool RpcServer::handleRequest(Connection* connection, const std::string& request, std::string& response) {
+    RpcReader reader(request);
+    if (!reader.isValid()) {
+        response = makeError(0, "Malformed request");
+        return false;
+    }
+
+    switch (reader.getType()) {
+        case RpcMessageType::ADD:
+            response = handleAdd(reader);
+            break;
+        case RpcMessageType::CONTROL:
+            response = handleControl(reader);
+            break;
+        case RpcMessageType::LIST:
+            response = handleList(reader);
+            break;
+        case RpcMessageType::SUBSCRIBE:
+            response = handleSubscribe(connection, reader);
+            break;
+        case RpcMessageType::SHUTDOWN:
+            utils::Logger::info("Daemon shutdown requested by a client");
+            response = RpcWriter(RpcMessageType::RESULT, reader.getRequestId()).getPayload();
+            requestShutdown();
+            return true;
+        default:
+            response = makeError(reader.getRequestId(), "Unknown request type");
+            break;
+    }
+    return true;
+}
+
+std::string RpcServer::handleAdd(RpcReader& reader) {
+    uint8_t start = 0;
+    uint32_t count = 0;
+    if (!reader.readU8(start) || !reader.readU32(count) || count > reader.remainingItems(MIN_DOWNLOAD_SIZE)) {
+        return makeError(reader.getRequestId(), "Malformed add request");
+    }
+
+    std::vector<RpcDownload> downloads(count);
+    for (auto& download : downloads) {
+        uint8_t priority = 0;
+        reader.readString(download.url);
+        reader.readString(download.destinationPath);
+        reader.readString(download.filename);
+        reader.readU8(priority);
+        download.priority = priority <= static_cast<uint8_t>(DownloadPriority::HIGH)
+                                ? static_cast<DownloadPriority>(priority)
+                                : DownloadPriority::NORMAL;
+    }
+    if (!reader.done()) {
+        return makeError(reader.getRequestId(), "Malformed add request");
+    }
+
+    // Queued as records, a batch of any size costs no probes up front
+    RpcWriter writer(RpcMessageType::RESULT, reader.getRequestId());
+    writer.putU32(count);
+    for (const auto& download : downloads) {
+        writer.putString(manager_.queueDownload(download.url, download.destinationPath, download.filename,
+                                                download.priority, start != 0));
+    }
+    return writer.getPayload();
+}
+
+std::string RpcServer::handleControl(RpcReader& reader) {
+    uint8_t operation = 0;
+    uint32_t count = 0;
+    if (!reader.readU8(operation) || operation > static_cast<uint8_t>(RpcControl::REMOVE) ||
+        !reader.readU32(count) || count > reader.remainingItems(MIN_ID_SIZE)) {
+        return makeError(reader.getRequestId(), "Malformed control request");
+    }
+
+    std::vector<std::string> ids(count);
+    for (auto& id : ids) {
+        reader.readString(id);
+    }
+    if (!reader.done()) {
+        return makeError(reader.getRequestId(), "Malformed control request");
+    }
+
+    // Each batch is one bulk operation, with one journal write and one event
+    std::vector<bool> results;
+    switch (static_cast<RpcControl>(operation)) {
+        case RpcControl::START:
+            results = manager_.startDownloads(ids);
+            break;
+        case RpcControl::PAUSE:
+            results = manager_.pauseDownloads(ids);
+            break;
+        case RpcControl::RESUME:
+            results = manager_.resumeDownloads(ids);
+            break;
+        case RpcControl::CANCEL:
+            results = manager_.cancelDownloads(ids);
+            break;
+        case RpcControl::REMOVE:
+            results = manager_.removeDownloads(ids);
+            break;
+    }
+
+    RpcWriter writer(RpcMessageType::RESULT, reader.getRequestId());
+    writer.putU32(count);
+    for (bool success : results) {
+        writer.putU8(success ? 1 : 0);
+    }
+    return writer.getPayload();
+}
+
+std::string RpcServer::handleList(RpcReader& reader) {
+    uint8_t filter = LIST_ALL;
+    if (!reader.readU8(filter) || !reader.done()) {
+        return makeError(reader.getRequestId(), "Malformed list request");
+    }
+
+    std::vector<RpcTaskSummary> summaries;
+    for (const auto& task : manager_.getAllDownloadTasks()) {
+        RpcTaskSummary summary = summarize(task);
+        if (filter == LIST_ALL || static_cast<uint8_t>(summary.status) == filter) {
+            summaries.push_back(std::move(summary));
+        }
+    }
+
+    // Records are read a page at a time, not all copied at once
+    for (size_t offset = 0;; offset += DORMANT_PAGE_SIZE) {
+        std::vector<JournalEntry> page = manager_.getDormantTasks(offset, DORMANT_PAGE_SIZE);
+        for (const auto& entry : page) {
+            if (filter == LIST_ALL || static_cast<uint8_t>(entry.status) == filter) {
+                summaries.push_back(summarize(entry));
+            }
+        }
+        if (page.size() < DORMANT_PAGE_SIZE) {
+            break;
+        }
+    }
+
+    RpcWriter writer(RpcMessageType::RESULT, reader.getRequestId());
+    writer.putU32(static_cast<uint32_t>(summaries.size()));
+    for (const auto& summary : summaries) {
+        writer.putSummary(summary);
+    }
+    if (writer.getPayload().size() > RpcChannel::MAX_FRAME_SIZE) {
+        return makeError(reader.getRequestId(), "Too many tasks to list, filter by status");
+    }
+    return writer.getPayload();
+}
+
+std::string RpcServer::handleSubscribe(Connection* connection, RpcReader& reader) {
+    uint32_t interval = 0;
+    if (!reader.readU32(interval) || !reader.done()) {
+        return makeError(reader.getRequestId(), "Malformed subscribe request");
+    }
+
+    bool subscribed = false;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->progressIntervalMs = interval;
+        subscribed = connection->listenerId >= 0;
+    }
+
+    if (!subscribed) {
+        int listenerId = manager_.addTaskStatusListener(
+            [this, connection](std::shared_ptr<DownloadTask> task, DownloadStatus) {
+                RpcWriter writer(RpcMessageType::EVENT, 0);
+                writer.putU8(static_cast<uint8_t>(RpcEventKind::STATUS));
+                writer.putSummary(summarize(task));
+                queueEvent(connection, writer.getPayload());
+            });
+
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->listenerId = listenerId;
+    }
+
+    return RpcWriter(RpcMessageType::RESULT, reader.getRequestId()).getPayload();
+}
+
+} // namespace core
+} // namespace dm
@@ -1,15 +1,84 @@
 #include "core/SegmentDownloader.h"
+#include "core/TransferCounters.h"
+#include "core/EngineMetrics.h"
+#include "core/ProxyPool.h"
 #include "utils/Logger.h"
+#include "utils/Tracer.h"
+#include "utils/ResourceMonitor.h"
 
-#include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
-#include <unistd.h>
+#include <random>
 
 namespace dm {
 namespace core {
 
+namespace {
+
+const int64_t RETRY_BASE_DELAY_MS = 500;
+const int64_t RETRY_MAX_DELAY_MS = 30000;
+const int64_t RETRY_AFTER_MAX_MS = 300000;      // Longer Retry-After waits are cut short
+const int64_t RETRY_WAIT_SLICE_MS = 100;
+
+// What a retry can expect after a failed attempt
+enum class FailureClass {
+    FATAL,          // Fails the same way again
+    DROPPED,        // The connection broke during the transfer
+    TRANSIENT       // May work after a while
+};
+
+FailureClass classifyFailure(CURLcode curlCode, int statusCode, bool ftp) {
+    switch (curlCode) {
+        case CURLE_OK:
+        case CURLE_WRITE_ERROR:             // Stopped from the data callback
+        case CURLE_ABORTED_BY_CALLBACK:
+            break;
+        case CURLE_RECV_ERROR:
+        case CURLE_SEND_ERROR:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_GOT_NOTHING:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return FailureClass::DROPPED;
+        case CURLE_UNSUPPORTED_PROTOCOL:
+        case CURLE_URL_MALFORMAT:
+        case CURLE_NOT_BUILT_IN:
+        case CURLE_REMOTE_ACCESS_DENIED:
+        case CURLE_LOGIN_DENIED:
+        case CURLE_REMOTE_FILE_NOT_FOUND:
+        case CURLE_TOO_MANY_REDIRECTS:
+        case CURLE_PEER_FAILED_VERIFICATION:
+        case CURLE_SSL_CERTPROBLEM:
+        case CURLE_SSL_CACERT_BADFILE:
+        case CURLE_RANGE_ERROR:
+        case CURLE_BAD_CONTENT_ENCODING:
+        case CURLE_FILESIZE_EXCEEDED:
+            return FailureClass::FATAL;
+        default:
+            return FailureClass::TRANSIENT;
+    }
+    
+    // FTP replies arrive as CURL errors, HTTP ones as status codes
+    if (ftp || statusCode < 400) {
+        return FailureClass::TRANSIENT;
+    }
+    if (statusCode == 408 || statusCode == 425 || statusCode == 429 || statusCode >= 500) {
+        return FailureClass::TRANSIENT;
+    }
+    return FailureClass::FATAL;
+}
+
+// Somewhere in the upper half of the delay, so segments failing together do not retry together
+int64_t withJitter(int64_t delayMs) {
+    thread_local std::mt19937 generator(std::random_device{}());
+    std::uniform_int_distribution<int64_t> distribution(0, delayMs / 2);
+    return delayMs - delayMs / 2 + distribution(generator);
+}
+
+} // anonymous namespace
+
 SegmentDownloader::SegmentDownloader(const std::string& url, 
                                    const std::string& filePath,
                                    int64_t startByte, 
@@ -24,24 +93,46 @@ SegmentDownloader::SegmentDownloader(const std::string& url,
     // Initialize timestamps
     lastSpeedUpdateTime_ = std::chrono::system_clock::now();
     
+    dm::utils::ResourceMonitor::getInstance().recordAllocation(
+        dm::utils::ResourceSubsystem::SEGMENTS, static_cast<int64_t>(sizeof(SegmentDownloader)));
+    
     // Log segment creation
-    std::ostringstream log;
-    log << "Created segment " << id_ << " for " << url_ 
-        << " [" << startByte_ << "-" << endByte_ << "]";
-    dm::utils::Logger::debug(log.str());
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        std::ostringstream log;
+        log << "Created segment " << id_ << " for " << url_ 
+            << " [" << startByte_ << "-" << endByte_ << "]";
+        dm::utils::Logger::debug(log.str());
+    }
 }
 
 SegmentDownloader::~SegmentDownloader() {
-    // Make sure thread is stopped
+    // Make sure the engine transfer is removed
+    TransferId transferId = transferId_.exchange(0);
+    if (transferId != 0) {
+        stopRequested_ = true;
+        TransferEngine::getInstance().cancel(transferId);
+    }
+    
+    // Make sure thread is stopped; the last reference may be the thread's own
     if (thread_ && thread_->joinable()) {
         stopRequested_ = true;
-        thread_->join();
+        if (thread_->get_id() == std::this_thread::get_id()) {
+            thread_->detach();
+        } else {
+            thread_->join();
+        }
     }
+    detachThrottler();
+    
+    dm::utils::ResourceMonitor::getInstance().recordRelease(
+        dm::utils::ResourceSubsystem::SEGMENTS, static_cast<int64_t>(sizeof(SegmentDownloader)));
     
     // Log segment destruction
-    std::ostringstream log;
-    log << "Destroyed segment " << id_ << " for " << url_;
-    dm::utils::Logger::debug(log.str());
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        std::ostringstream log;
+        log << "Destroyed segment " << id_ << " for " << url_;
+        dm::utils::Logger::debug(log.str());
+    }
 }
 
 bool SegmentDownloader::start() {
@@ -55,17 +146,56 @@ bool SegmentDownloader::start() {
     // Reset stop flag
     stopRequested_ = false;
     
+    if (!openOutputFile()) {
+        setStatus(SegmentStatus::SEGMENT_ERROR);
+        return false;
+    }
+    
+    // Event loop mode hands the segment to the shared engine
+    if (transferMode_ == TransferMode::EVENT_LOOP) {
+        retryCount_ = 0;
+        failures_ = 0;
+        attachThrottler();
+        if (!submitTransfer(0)) {
+            detachThrottler();
+            return false;
+        }
+        
+        setStatus(SegmentStatus::DOWNLOADING);
+        
+        if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+            std::ostringstream log;
+            log << "Started segment " << id_ << " for " << url_ << " on transfer engine";
+            dm::utils::Logger::debug(log.str());
+        }
+        
+        return true;
+    }
+    
+    // Reap a previous thread that has already finished
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+    
     // Create download thread
     try {
-        thread_ = std::make_unique<std::thread>(&SegmentDownloader::downloadThread, this);
+        setStatus(SegmentStatus::DOWNLOADING);
+        attachThrottler();
+        // The thread owns the segment until it returns, so a callback that
+        // drops the last other reference cannot free it underneath
+        thread_ = std::make_unique<std::thread>([self = shared_from_this()]() { self->downloadThread(); });
         
         // Log segment start
-        std::ostringstream log;
-        log << "Started segment " << id_ << " for " << url_;
-        dm::utils::Logger::debug(log.str());
+        if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+            std::ostringstream log;
+            log << "Started segment " << id_ << " for " << url_;
+            dm::utils::Logger::debug(log.str());
+        }
         
         return true;
     } catch (const std::exception& e) {
+        setStatus(SegmentStatus::SEGMENT_ERROR);
+        detachThrottler();
         dm::utils::Logger::error("Failed to create download thread: " + std::string(e.what()));
         return false;
     }
@@ -82,27 +212,45 @@ bool SegmentDownloader::pause() {
     // Set stop flag
     stopRequested_ = true;
     
-    // Wait for thread to finish
+    // Remove the engine transfer, no callbacks fire for it afterwards
+    TransferId transferId = transferId_.exchange(0);
+    if (transferId != 0) {
+        TransferEngine::getInstance().cancel(transferId);
+    }
+    // Wake the client if it is waiting on the throttler
+    httpClient_->abort();
+    
+    // Wait for thread to finish, unless this is that thread dropping the task
     if (thread_ && thread_->joinable()) {
-        thread_->join();
+        if (thread_->get_id() == std::this_thread::get_id()) {
+            thread_->detach();
+        } else {
+            thread_->join();
+        }
         thread_.reset();
     }
+    detachThrottler();
+    
+    // Write out whatever is still buffered
+    if (writer_) {
+        writer_->release();
+    }
     
     // Set status to paused
     setStatus(SegmentStatus::PAUSED);
     
     // Log segment pause
-    std::ostringstream log;
-    log << "Paused segment " << id_ << " for " << url_;
-    dm::utils::Logger::debug(log.str());
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        std::ostringstream log;
+        log << "Paused segment " << id_ << " for " << url_;
+        dm::utils::Logger::debug(log.str());
+    }
     
     return true;
 }
 
 bool SegmentDownloader::resume() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    // Check if paused
+    // Check if paused (start() takes the lock itself)
     if (status_ != SegmentStatus::PAUSED) {
         return false;
     }
@@ -117,16 +265,36 @@ bool SegmentDownloader::cancel() {
     // Set stop flag
     stopRequested_ = true;
     
-    // Wait for thread to finish
+    // Remove the engine transfer
+    TransferId transferId = transferId_.exchange(0);
+    if (transferId != 0) {
+        TransferEngine::getInstance().cancel(transferId);
+    }
+    // Wake the client if it is waiting on the throttler
+    httpClient_->abort();
+    
+    // Wait for thread to finish, unless this is that thread dropping the task
     if (thread_ && thread_->joinable()) {
-        thread_->join();
+        if (thread_->get_id() == std::this_thread::get_id()) {
+            thread_->detach();
+        } else {
+            thread_->join();
+        }
         thread_.reset();
     }
+    detachThrottler();
+    
+    // Write out whatever is still buffered
+    if (writer_) {
+        writer_->release();
+    }
     
     // Log segment cancellation
-    std::ostringstream log;
-    log << "Canceled segment " << id_ << " for " << url_;
-    dm::utils::Logger::debug(log.str());
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        std::ostringstream log;
+        log << "Canceled segment " << id_ << " for " << url_;
+        dm::utils::Logger::debug(log.str());
+    }
     
     return true;
 }
@@ -141,6 +309,11 @@ void SegmentDownloader::setErrorCallback(SegmentErrorCallback callback) {
     errorCallback_ = callback;
 }
 
+void SegmentDownloader::setBackoffCallback(SegmentBackoffCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    backoffCallback_ = callback;
+}
+
 SegmentStatus SegmentDownloader::getStatus() const {
     return status_;
 }
@@ -169,6 +342,118 @@ int64_t SegmentDownloader::getEndByte() const {
     return endByte_;
 }
 
+int64_t SegmentDownloader::getRemainingBytes() const {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    
+    if (endByte_ < 0) {
+        return 0;
+    }
+    
+    int64_t position = getPosition();
+    return std::max<int64_t>(0, endByte_ + 1 - position);
+}
+
+int64_t SegmentDownloader::getSavedPosition() const {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    return writer_ ? std::max(writer_->getFlushedOffset(), startByte_) : startByte_;
+}
+
+bool SegmentDownloader::shrinkEnd(int64_t newEndByte) {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    
+    int64_t position = getPosition();
+    if (endByte_ < 0 || newEndByte >= endByte_ || newEndByte < position) {
+        return false;
+    }
+    
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        std::ostringstream log;
+        log << "Segment " << id_ << " shrunk from end " << endByte_ << " to " << newEndByte;
+        dm::utils::Logger::debug(log.str());
+    }
+    
+    endByte_ = newEndByte;
+    return true;
+}
+
+int64_t SegmentDownloader::getPosition() const {
+    // The writer is only positioned once the first attempt begins
+    return writer_ ? std::max(writer_->getOffset(), startByte_) : startByte_;
+}
+
+bool SegmentDownloader::writeData(const char* data, size_t size) {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    
+    if (firstByteMs_ < 0) {
+        firstByteMs_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - attemptStartedAt_).count();
+    }
+    
+    // Clip to the range, it may have shrunk since the request was sent
+    bool clipped = false;
+    if (endByte_ >= 0) {
+        int64_t allowed = endByte_ + 1 - writer_->getOffset();
+        if (allowed <= 0) {
+            return false;
+        }
+        if (static_cast<int64_t>(size) > allowed) {
+            size = static_cast<size_t>(allowed);
+            clipped = true;
+        }
+    }
+    
+    if (!writer_->write(data, size)) {
+        writeFailed_ = true;
+        return false;
+    }
+    
+    downloadedBytes_ += static_cast<int64_t>(size);
+    TransferCounters::getInstance().addBytes(static_cast<int64_t>(size));
+    return !clipped;
+}
+
+int64_t SegmentDownloader::resumeWriter() {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    
+    // Whatever an earlier attempt wrote out is not fetched again
+    int64_t rangeStart = startByte_ > 0 ? startByte_ : 0;
+    int64_t position = resumable_ ? std::max(writer_->getFlushedOffset(), rangeStart) : rangeStart;
+    writer_->reset(position);
+    
+    attemptStart_ = position;
+    attemptStartedAt_ = std::chrono::steady_clock::now();
+    firstByteMs_ = -1;
+    writeFailed_ = false;
+    downloadedBytes_ = position - rangeStart;
+    return position;
+}
+
+void SegmentDownloader::reportProxy(CURLcode curlCode, int statusCode) {
+    if (proxy_.empty()) {
+        return;
+    }
+    
+    int64_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(rangeMutex_);
+        bytes = writer_ ? writer_->getOffset() - attemptStart_ : 0;
+    }
+    int64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - attemptStartedAt_).count();
+    
+    // A throttled transfer measures the limit, not the proxy
+    if (throttler_ && throttler_->getMaxBandwidth() > 0) {
+        bytes = 0;
+    }
+    ProxyPool::getInstance().report(proxy_, ProxyPool::isProxyFailure(curlCode, statusCode),
+                                    firstByteMs_, bytes, elapsedMs);
+}
+
+bool SegmentDownloader::isRangeFilled() const {
+    std::lock_guard<std::mutex> lock(rangeMutex_);
+    return endByte_ >= 0 && writer_ && writer_->getOffset() == endByte_ + 1;
+}
+
 const std::string& SegmentDownloader::getFilePath() const {
     return filePath_;
 }
@@ -177,105 +462,389 @@ const std::string& SegmentDownloader::getUrl() const {
     return url_;
 }
 
-void SegmentDownloader::logMemoryUsage(const std::string& prefix) {
-#ifdef __linux__
-    std::ifstream statm("/proc/self/statm");
-    long size = 0, resident = 0;
-    statm >> size >> resident;
-    std::ostringstream log;
-    log << prefix << " [PID " << getpid() << "] Memory usage: "
-        << "size=" << size << " pages, resident=" << resident << " pages";
-    dm::utils::Logger::debug(log.str());
-#endif
-}
-
 void SegmentDownloader::downloadThread() {
-    int attempt = 0;
+    DM_TRACE_THREAD("segment");
     bool success = false;
+    bool parked = false;
     std::string lastError;
-    logMemoryUsage("[Segment " + std::to_string(id_) + "] Start download");
-    while (attempt < maxRetries_ && !stopRequested_) {
+    retryCount_ = 0;
+    failures_ = 0;
+    while (!stopRequested_) {
+        CURLcode curlCode = CURLE_OK;
+        int statusCode = 0;
+        int retryAfter = -1;
         try {
-            attempt++;
-            retryCount_ = attempt;
-            std::ostringstream log;
-            log << "Attempt " << attempt << "/" << maxRetries_ << " for segment " << id_ << " (" << url_ << ")";
-            dm::utils::Logger::info(log.str());
-            // Calculate bytes to download
-            int64_t bytesToDownload = endByte_ - startByte_ + 1;
-            downloadedBytes_ = 0;
-            lastDownloadedBytes_ = 0;
+            DM_TRACE_SPAN("segment attempt");
+            retryCount_++;
+            int64_t position = resumeWriter();
+            lastDownloadedBytes_ = downloadedBytes_;
+            if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::INFO)) {
+                std::ostringstream log;
+                log << "Attempt " << retryCount_ << " for segment " << id_ << " (" << url_ << ") from byte " << position;
+                dm::utils::Logger::info(log.str());
+            }
+            httpClient_->setThrottler(throttler_);
+            httpClient_->setProxy(proxy_);
+            httpClient_->setDataCallback([this](const char* data, size_t size) -> bool {
+                return writeData(data, size);
+            });
             httpClient_->setProgressCallback(
                 [this](int64_t downloadTotal, int64_t downloadedNow, int64_t uploadTotal, int64_t uploadedNow) -> bool {
                     return this->onProgress(downloadTotal, downloadedNow, uploadTotal, uploadedNow);
                 }
             );
-            success = httpClient_->downloadFileSegment(
-                url_,
-                filePath_,
-                startByte_,
-                endByte_,
-                nullptr
-            );
+            // Earlier attempts may have written the whole range already
+            HttpResponse response;
+            if (!isRangeFilled()) {
+                response = httpClient_->getRange(url_, position, requestEndByte());
+                reportProxy(response.curlCode, response.statusCode);
+            }
+            curlCode = response.curlCode;
+            statusCode = response.statusCode;
+            retryAfter = response.retryAfter;
+            // A shrunk range is aborted on purpose once it is filled
+            bool filled = isRangeFilled();
+            bool flushed = writer_->release();
+            if (!flushed) {
+                writeFailed_ = true;
+            }
+            success = flushed && (response.success || filled);
             if (success && !stopRequested_) {
                 setStatus(SegmentStatus::COMPLETED);
-                downloadedBytes_ = bytesToDownload;
+                if (endByte_ >= startByte_) {
+                    downloadedBytes_ = getTotalBytes();
+                }
                 if (completionCallback_) {
                     completionCallback_(shared_from_this());
                 }
-                std::ostringstream log;
-                log << "Completed segment " << id_ << " for " << url_ << " on attempt " << attempt;
-                dm::utils::Logger::debug(log.str());
+                if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+                    std::ostringstream log;
+                    log << "Completed segment " << id_ << " for " << url_ << " on attempt " << retryCount_;
+                    dm::utils::Logger::debug(log.str());
+                }
                 break;
             } else if (stopRequested_) {
                 setStatus(SegmentStatus::PAUSED);
-                std::ostringstream log;
-                log << "Paused segment " << id_ << " for " << url_;
-                dm::utils::Logger::debug(log.str());
+                if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+                    std::ostringstream log;
+                    log << "Paused segment " << id_ << " for " << url_;
+                    dm::utils::Logger::debug(log.str());
+                }
+                break;
+            } else if (backOff(response.statusCode)) {
+                setStatus(SegmentStatus::PAUSED);
+                parked = true;
                 break;
             } else {
                 setStatus(SegmentStatus::SEGMENT_ERROR);
-                lastError = "Download failed";
+                lastError = !flushed ? "Failed to write segment data" :
+                            response.error.empty() ? "Download failed" : response.error;
                 std::ostringstream log;
-                log << "Failed to download segment " << id_ << " for " << url_ << " (attempt " << attempt << ")";
+                log << "Failed to download segment " << id_ << " for " << url_ << " (attempt " << retryCount_ << "): "
+                    << lastError;
                 dm::utils::Logger::error(log.str());
-                if (errorCallback_) {
-                    errorCallback_(shared_from_this(), "Download failed");
-                }
             }
         } catch (const std::exception& e) {
             setStatus(SegmentStatus::SEGMENT_ERROR);
             lastError = e.what();
             std::ostringstream log;
-            log << "Exception in segment " << id_ << " for " << url_ << " (attempt " << attempt << "): " << e.what();
+            log << "Exception in segment " << id_ << " for " << url_ << " (attempt " << retryCount_ << "): " << e.what();
             dm::utils::Logger::error(log.str());
-            if (errorCallback_) {
-                errorCallback_(shared_from_this(), e.what());
-            }
         }
-        if (attempt < maxRetries_ && !stopRequested_) {
-            std::ostringstream log;
-            log << "Retrying segment " << id_ << " for " << url_ << " (attempt " << (attempt+1) << ")";
-            dm::utils::Logger::warning(log.str());
-            std::this_thread::sleep_for(std::chrono::seconds(2));
+        
+        int64_t delayMs = planRetry(curlCode, statusCode, retryAfter);
+        if (delayMs < 0 || stopRequested_) {
+            break;
         }
+        std::ostringstream log;
+        log << "Retrying segment " << id_ << " for " << url_ << " (attempt " << (retryCount_ + 1) << ") in "
+            << delayMs << " ms";
+        dm::utils::Logger::warning(log.str());
+        EngineMetrics::getInstance().count(EventMetric::SEGMENT_RETRIES);
+        waitForRetry(delayMs);
     }
-    if (!success && !stopRequested_) {
+    if (!success && !parked && !stopRequested_) {
         setStatus(SegmentStatus::SEGMENT_ERROR);
         if (errorCallback_) {
             errorCallback_(shared_from_this(), lastError.empty() ? "Download failed after retries" : lastError);
         }
         std::ostringstream log;
-        log << "Segment " << id_ << " failed after " << attempt << " attempts for " << url_;
+        log << "Segment " << id_ << " failed after " << retryCount_ << " attempts for " << url_;
         dm::utils::Logger::error(log.str());
     }
-    logMemoryUsage("[Segment " + std::to_string(id_) + "] End download");
+    detachThrottler();
+}
+
+void SegmentDownloader::setThrottler(std::shared_ptr<Throttler> throttler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    throttler_ = throttler;
+}
+
+void SegmentDownloader::setOutputFile(std::shared_ptr<OutputFile> file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    outputFile_ = file;
+    writer_.reset();
+}
+
+void SegmentDownloader::setWriteBufferPool(std::shared_ptr<WriteBufferPool> pool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeBufferPool_ = pool;
+    writer_.reset();
+}
+
+bool SegmentDownloader::openOutputFile() {
+    if (!outputFile_) {
+        outputFile_ = std::make_shared<OutputFile>();
+    }
+    
+    if (!outputFile_->isOpen() && !outputFile_->open(filePath_)) {
+        return false;
+    }
+    
+    if (!writer_) {
+        writer_ = std::make_unique<BufferedFileWriter>(outputFile_, writeBufferPool_);
+    }
+    
+    return true;
+}
+
+void SegmentDownloader::attachThrottler() {
+    if (throttler_ && !throttlerAttached_.exchange(true)) {
+        throttler_->attach();
+    }
+}
+
+void SegmentDownloader::detachThrottler() {
+    if (throttler_ && throttlerAttached_.exchange(false)) {
+        throttler_->detach();
+    }
+}
+
+bool SegmentDownloader::submitTransfer(int64_t delayMs) {
+    retryCount_++;
+    
+    int64_t position = resumeWriter();
+    lastDownloadedBytes_ = downloadedBytes_;
+    lastSpeedUpdateTime_ = std::chrono::system_clock::now();
+    attemptStartedAt_ += std::chrono::milliseconds(delayMs);    // The wait is not the proxy's
+    
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::INFO)) {
+        std::ostringstream log;
+        log << "Attempt " << retryCount_ << " for segment " << id_ << " (" << url_ << ") from byte " << position;
+        dm::utils::Logger::info(log.str());
+    }
+    
+    TransferRequest request;
+    request.url = url_;
+    request.startByte = position;
+    request.endByte = requestEndByte();
+    request.startDelayMs = delayMs;
+    request.maxRecvSpeed = throttler_ ? throttler_->getFairShare() : 0;
+    request.throttler = throttler_;
+    request.multiplex = multiplex_;
+    request.proxy = proxy_;
+    
+    // The engine may outlive this segment
+    std::weak_ptr<SegmentDownloader> weakSelf = shared_from_this();
+    request.dataCallback = [weakSelf](const char* data, size_t size) -> bool {
+        auto self = weakSelf.lock();
+        return self && self->onTransferData(data, size);
+    };
+    request.completionCallback = [weakSelf](TransferId, const TransferResult& result) {
+        if (auto self = weakSelf.lock()) {
+            self->onTransferCompleted(result);
+        }
+    };
+    
+    TransferId transferId = TransferEngine::getInstance().submit(std::move(request));
+    if (transferId == 0) {
+        dm::utils::Logger::error("Failed to submit segment " + std::to_string(id_) + " to transfer engine");
+        return false;
+    }
+    
+    transferId_ = transferId;
+    return true;
+}
+
+bool SegmentDownloader::onTransferData(const char* data, size_t size) {
+    if (stopRequested_) {
+        return false;
+    }
+    
+    if (!writeData(data, size)) {
+        return false;
+    }
+    
+    updateDownloadSpeed();
+    
+    return true;
+}
+
+void SegmentDownloader::onTransferCompleted(const TransferResult& result) {
+    reportProxy(result.curlCode, result.statusCode);
+    
+    // Let the owner take a busy server off this connection (outside the lock)
+    if (!result.success && !stopRequested_ && !isRangeFilled() && backOff(result.statusCode)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        transferId_ = 0;
+        writer_->release();
+        detachThrottler();
+        setStatus(SegmentStatus::PAUSED);
+        return;
+    }
+    
+    bool completed = false;
+    bool failed = false;
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        transferId_ = 0;
+        
+        // Flush before reporting, a failed flush fails the attempt
+        bool filled = isRangeFilled();
+        bool flushed = writer_->release();
+        if (!flushed) {
+            writeFailed_ = true;
+        }
+        error = flushed ? result.error : "Failed to write segment data";
+        
+        if ((result.success || filled) && flushed && !stopRequested_) {
+            if (endByte_ >= startByte_) {
+                downloadedBytes_ = getTotalBytes();
+            }
+            setStatus(SegmentStatus::COMPLETED);
+            completed = true;
+            
+            if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+                std::ostringstream log;
+                log << "Completed segment " << id_ << " for " << url_ << " on attempt " << retryCount_;
+                dm::utils::Logger::debug(log.str());
+            }
+        } else if (stopRequested_) {
+            setStatus(SegmentStatus::PAUSED);
+            
+            if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+                std::ostringstream log;
+                log << "Paused segment " << id_ << " for " << url_;
+                dm::utils::Logger::debug(log.str());
+            }
+        } else {
+            std::ostringstream log;
+            log << "Failed to download segment " << id_ << " for " << url_ 
+                << " (attempt " << retryCount_ << "): " << error;
+            dm::utils::Logger::error(log.str());
+            
+            // Retry through the engine instead of sleeping on a thread
+            int64_t delayMs = planRetry(result.curlCode, result.statusCode, result.retryAfter);
+            if (delayMs >= 0) {
+                std::ostringstream retryLog;
+                retryLog << "Retrying segment " << id_ << " for " << url_ << " (attempt " << (retryCount_ + 1)
+                         << ") in " << delayMs << " ms";
+                dm::utils::Logger::warning(retryLog.str());
+                EngineMetrics::getInstance().count(EventMetric::SEGMENT_RETRIES);
+                
+                if (submitTransfer(delayMs)) {
+                    return;
+                }
+            }
+            
+            setStatus(SegmentStatus::SEGMENT_ERROR);
+            failed = true;
+        }
+        
+        detachThrottler();
+    }
+    
+    // Callbacks run without the lock held
+    if (completed && completionCallback_) {
+        completionCallback_(shared_from_this());
+    } else if (failed && errorCallback_) {
+        errorCallback_(shared_from_this(), error.empty() ? "Download failed after retries" : error);
+    }
 }
 
 void SegmentDownloader::setStatus(SegmentStatus status) {
     status_ = status;
 }
 
+int64_t SegmentDownloader::requestEndByte() const {
+    // Writes are clipped to the range, so a tail stolen later still ends in place
+    int64_t endByte = endByte_;
+    return openEndedTail_ >= 0 && endByte == openEndedTail_ ? -1 : endByte;
+}
+
+bool SegmentDownloader::backOff(int statusCode) {
+    // FTP servers answer 421 when a user has too many sessions
+    bool busy = statusCode == 429 || statusCode == 503 ||
+                (statusCode == 421 && HttpClient::isFtpUrl(url_));
+    if (!busy || !backoffCallback_) {
+        return false;
+    }
+    
+    if (!backoffCallback_(shared_from_this(), statusCode)) {
+        return false;
+    }
+    
+    if (dm::utils::Logger::isEnabled(dm::utils::LogLevel::DEBUG)) {
+        std::ostringstream log;
+        log << "Parked segment " << id_ << " for " << url_ << " after status " << statusCode;
+        dm::utils::Logger::debug(log.str());
+    }
+    
+    return true;
+}
+
+int64_t SegmentDownloader::planRetry(CURLcode curlCode, int statusCode, int retryAfter) {
+    bool ftp = HttpClient::isFtpUrl(url_);
+    bool advanced = getSavedPosition() > attemptStart_;
+    if (advanced) {
+        failures_ = 0;
+    }
+    failures_++;
+    
+    // The data has nowhere to go, the disk is full or failing
+    if (writeFailed_) {
+        return -1;
+    }
+    
+    // The server sends whole files only, so the attempt cannot be continued
+    if (!ftp && statusCode == 200 && attemptStart_ > 0) {
+        if (startByte_ > 0) {
+            return -1;
+        }
+        resumable_ = false;
+        dm::utils::Logger::warning("Server ignored range request for " + url_ + ", segment " +
+                                   std::to_string(id_) + " starts over");
+        return failures_ < maxRetries_ ? 0 : -1;
+    }
+    
+    FailureClass failure = classifyFailure(curlCode, statusCode, ftp);
+    if (failure == FailureClass::FATAL || failures_ >= maxRetries_) {
+        return -1;
+    }
+    if (failure == FailureClass::DROPPED && advanced) {
+        return 0;
+    }
+    if ((statusCode == 429 || statusCode == 503) && retryAfter >= 0) {
+        return std::min<int64_t>(static_cast<int64_t>(retryAfter) * 1000, RETRY_AFTER_MAX_MS);
+    }
+    
+    int64_t delayMs = RETRY_BASE_DELAY_MS << std::min(failures_ - 1, 8);
+    return withJitter(std::min(delayMs, RETRY_MAX_DELAY_MS));
+}
+
+void SegmentDownloader::waitForRetry(int64_t delayMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+    while (!stopRequested_) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::min<int64_t>(remaining, RETRY_WAIT_SLICE_MS)));
+    }
+}
+
 void SegmentDownloader::updateDownloadSpeed() {
     auto now = std::chrono::system_clock::now();
     
@@ -303,9 +872,6 @@ bool SegmentDownloader::onProgress(int64_t downloadTotal, int64_t downloadedNow,
         return false;
     }
     
-    // Update downloaded bytes
-    downloadedBytes_ = downloadedNow;
-    
     // Update download speed
     updateDownloadSpeed();
     
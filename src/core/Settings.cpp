@@ -6,6 +6,7 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <vector>
 
 namespace dm {
 namespace core {
@@ -19,6 +20,135 @@ static std::string trim(const std::string& str) {
     return (start < end) ? std::string(start, end) : std::string();
 }
 
+static bool parseBoolValue(std::string value, bool defaultValue) {
+    if (value.empty()) {
+        return defaultValue;
+    }
+    
+    // Convert to lowercase
+    std::transform(value.begin(), value.end(), value.begin(), 
+                   [](unsigned char c) { return std::tolower(c); });
+    
+    return value == "true" || value == "yes" || value == "1" || value == "on";
+}
+
+static int parseIntValue(const std::string& value, int defaultValue) {
+    if (value.empty()) {
+        return defaultValue;
+    }
+    
+    try {
+        return std::stoi(value);
+    } catch (...) {
+        return defaultValue;
+    }
+}
+
+// Fields keep their defaults for keys that are missing or do not parse
+static void parseString(const std::map<std::string, std::string>& settings, const char* key, std::string& field) {
+    auto it = settings.find(key);
+    if (it != settings.end()) {
+        field = it->second;
+    }
+}
+
+static void parseInt(const std::map<std::string, std::string>& settings, const char* key, int& field) {
+    auto it = settings.find(key);
+    if (it != settings.end()) {
+        field = parseIntValue(it->second, field);
+    }
+}
+
+static void parseBool(const std::map<std::string, std::string>& settings, const char* key, bool& field) {
+    auto it = settings.find(key);
+    if (it != settings.end()) {
+        field = parseBoolValue(it->second, field);
+    }
+}
+
+static std::shared_ptr<const SettingsSnapshot> buildSnapshot(const std::map<std::string, std::string>& settings) {
+    auto snapshot = std::make_shared<SettingsSnapshot>();
+    
+    snapshot->downloadDirectory = dm::utils::FileUtils::getDefaultDownloadDirectory();
+    parseString(settings, "download_directory", snapshot->downloadDirectory);
+    
+    std::string transferEngine;
+    parseString(settings, "transfer_engine", transferEngine);
+    snapshot->transferMode = transferEngine == "event_loop" ? TransferMode::EVENT_LOOP : TransferMode::THREADED;
+    
+    parseInt(settings, "max_concurrent_downloads", snapshot->maxConcurrentDownloads);
+    parseInt(settings, "segment_count", snapshot->segmentCount);
+    parseBool(settings, "close_to_tray", snapshot->closeToTray);
+    parseBool(settings, "show_notifications", snapshot->showNotifications);
+    parseBool(settings, "start_with_system", snapshot->startWithSystem);
+    parseBool(settings, "start_minimized", snapshot->startMinimized);
+    parseBool(settings, "auto_start_downloads", snapshot->autoStartDownloads);
+    parseInt(settings, "max_download_speed", snapshot->maxDownloadSpeed);
+    parseBool(settings, "direct_io", snapshot->directIo);
+    std::string diskIo;
+    parseString(settings, "disk_io", diskIo);
+    dm::utils::DiskIoBackend::parseType(diskIo, snapshot->diskIoBackend);
+    parseInt(settings, "write_buffer_size", snapshot->writeBufferSize);
+    parseBool(settings, "dynamic_splitting", snapshot->dynamicSplitting);
+    parseBool(settings, "adaptive_segments", snapshot->adaptiveSegments);
+    parseString(settings, "streaming_hash", snapshot->streamingHash);
+    parseBool(settings, "revalidate_downloads", snapshot->revalidateDownloads);
+    parseString(settings, "content_store", snapshot->contentStore);
+    parseBool(settings, "content_store_hard_links", snapshot->contentStoreHardLinks);
+    parseBool(settings, "checksum_sidecars", snapshot->checksumSidecars);
+    parseBool(settings, "http_multiplexing", snapshot->httpMultiplexing);
+    parseBool(settings, "http3", snapshot->http3);
+    parseInt(settings, "max_streams_per_connection", snapshot->maxStreamsPerConnection);
+    parseInt(settings, "dns_cache_ttl", snapshot->dnsCacheTtl);
+    parseInt(settings, "happy_eyeballs_timeout", snapshot->happyEyeballsTimeout);
+    parseInt(settings, "max_connections_per_host", snapshot->maxConnectionsPerHost);
+    parseInt(settings, "max_connections_per_address", snapshot->maxConnectionsPerAddress);
+    parseInt(settings, "max_connections", snapshot->maxConnections);
+    parseBool(settings, "adaptive_concurrency", snapshot->adaptiveConcurrency);
+    parseInt(settings, "resource_sample_interval", snapshot->resourceSampleInterval);
+    parseString(settings, "metrics_file", snapshot->metricsFile);
+    parseInt(settings, "metrics_interval", snapshot->metricsInterval);
+    parseInt(settings, "plugin_call_budget", snapshot->pluginCallBudget);
+    std::string socketProfile;
+    parseString(settings, "socket_profile", socketProfile);
+    SocketTuner::parseProfile(socketProfile, snapshot->socketProfile);
+    parseBool(settings, "stream_media", snapshot->streamMedia);
+    // io_uring queues writes itself: a device queue in front of it costs a
+    // thread hop per block and the batching of deferred submission
+    snapshot->deviceIoScheduling = snapshot->diskIoBackend == dm::utils::DiskIoBackendType::PORTABLE;
+    auto deviceIoScheduling = settings.find("device_io_scheduling");
+    if (deviceIoScheduling != settings.end() && deviceIoScheduling->second != "auto") {
+        snapshot->deviceIoScheduling = parseBoolValue(deviceIoScheduling->second, snapshot->deviceIoScheduling);
+    }
+    parseInt(settings, "ssd_max_writers", snapshot->ssdMaxWriters);
+    parseInt(settings, "hdd_max_writers", snapshot->hddMaxWriters);
+    parseInt(settings, "network_max_writers", snapshot->networkMaxWriters);
+    parseBool(settings, "reserve_disk_space", snapshot->reserveDiskSpace);
+    parseInt(settings, "disk_space_margin", snapshot->diskSpaceMargin);
+    parseInt(settings, "small_file_threshold", snapshot->smallFileThreshold);
+    parseString(settings, "proxy_pool", snapshot->proxyPool);
+    std::string proxyAssignment;
+    parseString(settings, "proxy_assignment", proxyAssignment);
+    ProxyPool::parseAssignment(proxyAssignment, snapshot->proxyAssignment);
+    parseInt(settings, "proxy_max_connections", snapshot->proxyMaxConnections);
+    parseString(settings, "proxy_health_url", snapshot->proxyHealthUrl);
+    parseString(settings, "cluster_directory", snapshot->clusterDirectory);
+    parseString(settings, "cluster_node_id", snapshot->clusterNodeId);
+    parseInt(settings, "cluster_lease_seconds", snapshot->clusterLeaseSeconds);
+    parseInt(settings, "cluster_split_size", snapshot->clusterSplitSize);
+    parseInt(settings, "cluster_piece_size", snapshot->clusterPieceSize);
+    parseBool(settings, "peer_cache", snapshot->peerCache);
+    parseInt(settings, "peer_cache_port", snapshot->peerCachePort);
+    parseString(settings, "peer_cache_peers", snapshot->peerCachePeers);
+    parseInt(settings, "prefetch_queued_tasks", snapshot->prefetchQueuedTasks);
+    parseInt(settings, "prefetch_ttl", snapshot->prefetchTtl);
+    parseInt(settings, "thread_stack_size", snapshot->threadStackSize);
+    parseInt(settings, "write_buffer_budget", snapshot->writeBufferBudget);
+    parseInt(settings, "piece_hash_size", snapshot->pieceHashSize);
+    
+    return snapshot;
+}
+
 Settings::Settings() {
     // Set default values
     resetToDefaults();
@@ -29,7 +159,7 @@ Settings::~Settings() {
 }
 
 bool Settings::load() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
     
     std::string settingsFile = getSettingsFilePath();
     
@@ -70,6 +200,7 @@ bool Settings::load() {
         }
         
         dm::utils::Logger::info("Settings loaded from " + settingsFile);
+        publishSnapshot(lock);
         return true;
     } catch (const std::exception& e) {
         dm::utils::Logger::error("Exception while loading settings: " + std::string(e.what()));
@@ -117,7 +248,7 @@ bool Settings::save() {
 }
 
 void Settings::resetToDefaults() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
     
     settings_.clear();
     
@@ -131,10 +262,92 @@ void Settings::resetToDefaults() {
     settings_["start_minimized"] = "false";
     settings_["auto_start_downloads"] = "true";
     settings_["max_download_speed"] = "0"; // 0 means unlimited
+    settings_["transfer_engine"] = "threaded";
+    settings_["direct_io"] = "false";
+    settings_["disk_io"] = "portable"; // or "io_uring" (Linux)
+    settings_["write_buffer_size"] = "1024"; // KB per segment
+    settings_["dynamic_splitting"] = "true";
+    settings_["adaptive_segments"] = "false"; // segment_count becomes the upper bound
+    settings_["streaming_hash"] = ""; // e.g. "SHA256", empty disables
+    settings_["revalidate_downloads"] = "false";
+    settings_["content_store"] = ""; // directory, empty disables
+    settings_["content_store_hard_links"] = "false"; // copies share edits without reflinks
+    settings_["checksum_sidecars"] = "false";
+    settings_["http_multiplexing"] = "false"; // event loop mode only
+    settings_["http3"] = "false";
+    settings_["max_streams_per_connection"] = "100";
+    settings_["dns_cache_ttl"] = "300"; // seconds, 0 disables
+    settings_["happy_eyeballs_timeout"] = "200"; // ms
+    settings_["max_connections_per_host"] = "8";
+    settings_["max_connections_per_address"] = "16";
+    settings_["max_connections"] = "64";
+    settings_["adaptive_concurrency"] = "false"; // max_connections becomes the upper bound
+    settings_["resource_sample_interval"] = "1000"; // ms
+    settings_["metrics_file"] = ""; // empty disables the exporter
+    settings_["metrics_interval"] = "15000"; // ms
+    settings_["plugin_call_budget"] = "20"; // ms per data filter call, 0 disables
+    settings_["socket_profile"] = "auto"; // or "standard", "high_bdp"
+    settings_["stream_media"] = "false"; // audio and video fetched head first
+    settings_["device_io_scheduling"] = "auto"; // writes queued per destination device, off with io_uring
+    settings_["ssd_max_writers"] = "8";
+    settings_["hdd_max_writers"] = "1";
+    settings_["network_max_writers"] = "4";
+    settings_["reserve_disk_space"] = "true"; // queued downloads wait for space
+    settings_["disk_space_margin"] = "64"; // MB
+    settings_["small_file_threshold"] = "256"; // KB staged in memory, 0 disables
+    settings_["proxy_pool"] = ""; // "url|cap|weight,...", empty connects directly
+    settings_["proxy_assignment"] = "least_loaded"; // or "weighted"
+    settings_["proxy_max_connections"] = "8";
+    settings_["proxy_health_url"] = "";
+    settings_["cluster_directory"] = ""; // shared by the nodes, empty works alone
+    settings_["cluster_node_id"] = ""; // host name and process ID
+    settings_["cluster_lease_seconds"] = "60";
+    settings_["cluster_split_size"] = "1024"; // MB, 0 never splits
+    settings_["cluster_piece_size"] = "64"; // MB
+    settings_["peer_cache"] = "false"; // share finished downloads with the LAN
+    settings_["peer_cache_port"] = "47810";
+    settings_["peer_cache_peers"] = ""; // "host:port,...", besides mDNS
+    settings_["prefetch_queued_tasks"] = "4"; // probe the downloads due next, 0 disables
+    settings_["prefetch_ttl"] = "30"; // seconds
+    settings_["thread_stack_size"] = "0"; // KB, 0 for the system default
+    settings_["write_buffer_budget"] = "0"; // KB of all downloads, 0 for no limit
+    settings_["piece_hash_size"] = "0"; // KB, hash resumable downloads in pieces of this size, 0 disables
+    
+#ifdef DM_EMBEDDED
+    // Small devices trade throughput for a bounded footprint, see "Embedded
+    // build" in README.md for what each active download costs
+    settings_["max_concurrent_downloads"] = "2";
+    settings_["segment_count"] = "2";
+    settings_["write_buffer_size"] = "128";
+    settings_["max_connections"] = "16";
+    settings_["small_file_threshold"] = "32";
+    settings_["socket_profile"] = "standard";
+    settings_["prefetch_queued_tasks"] = "1";
+    settings_["thread_stack_size"] = std::to_string(DM_THREAD_STACK_SIZE);
+    settings_["write_buffer_budget"] = std::to_string(DM_WRITE_BUFFER_BUDGET);
+#endif
+    
+    publishSnapshot(lock);
+}
+
+std::shared_ptr<const SettingsSnapshot> Settings::getSnapshot() const {
+    return std::atomic_load(&snapshot_);
+}
+
+int Settings::addChangeCallback(SettingsChangeCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int callbackId = nextCallbackId_++;
+    changeCallbacks_[callbackId] = std::move(callback);
+    return callbackId;
+}
+
+void Settings::removeChangeCallback(int callbackId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    changeCallbacks_.erase(callbackId);
 }
 
 std::string Settings::getDownloadDirectory() const {
-    return getStringSetting("download_directory", dm::utils::FileUtils::getDefaultDownloadDirectory());
+    return getSnapshot()->downloadDirectory;
 }
 
 void Settings::setDownloadDirectory(const std::string& directory) {
@@ -142,7 +355,7 @@ void Settings::setDownloadDirectory(const std::string& directory) {
 }
 
 int Settings::getMaxConcurrentDownloads() const {
-    return getIntSetting("max_concurrent_downloads", 3);
+    return getSnapshot()->maxConcurrentDownloads;
 }
 
 void Settings::setMaxConcurrentDownloads(int max) {
@@ -150,7 +363,7 @@ void Settings::setMaxConcurrentDownloads(int max) {
 }
 
 int Settings::getSegmentCount() const {
-    return getIntSetting("segment_count", 4);
+    return getSnapshot()->segmentCount;
 }
 
 void Settings::setSegmentCount(int count) {
@@ -158,7 +371,7 @@ void Settings::setSegmentCount(int count) {
 }
 
 bool Settings::getCloseToTray() const {
-    return getBoolSetting("close_to_tray", true);
+    return getSnapshot()->closeToTray;
 }
 
 void Settings::setCloseToTray(bool enabled) {
@@ -166,7 +379,7 @@ void Settings::setCloseToTray(bool enabled) {
 }
 
 bool Settings::getShowNotifications() const {
-    return getBoolSetting("show_notifications", true);
+    return getSnapshot()->showNotifications;
 }
 
 void Settings::setShowNotifications(bool enabled) {
@@ -174,7 +387,7 @@ void Settings::setShowNotifications(bool enabled) {
 }
 
 bool Settings::getStartWithSystem() const {
-    return getBoolSetting("start_with_system", false);
+    return getSnapshot()->startWithSystem;
 }
 
 void Settings::setStartWithSystem(bool enabled) {
@@ -182,7 +395,7 @@ void Settings::setStartWithSystem(bool enabled) {
 }
 
 bool Settings::getStartMinimized() const {
-    return getBoolSetting("start_minimized", false);
+    return getSnapshot()->startMinimized;
 }
 
 void Settings::setStartMinimized(bool enabled) {
@@ -190,7 +403,7 @@ void Settings::setStartMinimized(bool enabled) {
 }
 
 bool Settings::getAutoStartDownloads() const {
-    return getBoolSetting("auto_start_downloads", true);
+    return getSnapshot()->autoStartDownloads;
 }
 
 void Settings::setAutoStartDownloads(bool enabled) {
@@ -198,13 +411,415 @@ void Settings::setAutoStartDownloads(bool enabled) {
 }
 
 int Settings::getMaxDownloadSpeed() const {
-    return getIntSetting("max_download_speed", 0);
+    return getSnapshot()->maxDownloadSpeed;
 }
 
 void Settings::setMaxDownloadSpeed(int speed) {
     setIntSetting("max_download_speed", speed);
 }
 
+TransferMode Settings::getTransferMode() const {
+    return getSnapshot()->transferMode;
+}
+
+void Settings::setTransferMode(TransferMode mode) {
+    setStringSetting("transfer_engine", mode == TransferMode::EVENT_LOOP ? "event_loop" : "threaded");
+}
+
+bool Settings::getDirectIo() const {
+    return getSnapshot()->directIo;
+}
+
+void Settings::setDirectIo(bool enabled) {
+    setBoolSetting("direct_io", enabled);
+}
+
+dm::utils::DiskIoBackendType Settings::getDiskIoBackend() const {
+    return getSnapshot()->diskIoBackend;
+}
+
+void Settings::setDiskIoBackend(dm::utils::DiskIoBackendType type) {
+    setStringSetting("disk_io", dm::utils::DiskIoBackend::getTypeName(type));
+}
+
+int Settings::getWriteBufferSize() const {
+    return getSnapshot()->writeBufferSize;
+}
+
+void Settings::setWriteBufferSize(int size) {
+    setIntSetting("write_buffer_size", size);
+}
+
+bool Settings::getDynamicSplitting() const {
+    return getSnapshot()->dynamicSplitting;
+}
+
+void Settings::setDynamicSplitting(bool enabled) {
+    setBoolSetting("dynamic_splitting", enabled);
+}
+
+bool Settings::getAdaptiveSegments() const {
+    return getSnapshot()->adaptiveSegments;
+}
+
+void Settings::setAdaptiveSegments(bool enabled) {
+    setBoolSetting("adaptive_segments", enabled);
+}
+
+std::string Settings::getStreamingHash() const {
+    return getSnapshot()->streamingHash;
+}
+
+void Settings::setStreamingHash(const std::string& algorithm) {
+    setStringSetting("streaming_hash", algorithm);
+}
+
+bool Settings::getRevalidateDownloads() const {
+    return getSnapshot()->revalidateDownloads;
+}
+
+void Settings::setRevalidateDownloads(bool enabled) {
+    setBoolSetting("revalidate_downloads", enabled);
+}
+
+std::string Settings::getContentStore() const {
+    return getSnapshot()->contentStore;
+}
+
+void Settings::setContentStore(const std::string& directory) {
+    setStringSetting("content_store", directory);
+}
+
+bool Settings::getContentStoreHardLinks() const {
+    return getSnapshot()->contentStoreHardLinks;
+}
+
+void Settings::setContentStoreHardLinks(bool enabled) {
+    setBoolSetting("content_store_hard_links", enabled);
+}
+
+bool Settings::getChecksumSidecars() const {
+    return getSnapshot()->checksumSidecars;
+}
+
+void Settings::setChecksumSidecars(bool enabled) {
+    setBoolSetting("checksum_sidecars", enabled);
+}
+
+bool Settings::getHttpMultiplexing() const {
+    return getSnapshot()->httpMultiplexing;
+}
+
+void Settings::setHttpMultiplexing(bool enabled) {
+    setBoolSetting("http_multiplexing", enabled);
+}
+
+bool Settings::getHttp3() const {
+    return getSnapshot()->http3;
+}
+
+void Settings::setHttp3(bool enabled) {
+    setBoolSetting("http3", enabled);
+}
+
+int Settings::getMaxStreamsPerConnection() const {
+    return getSnapshot()->maxStreamsPerConnection;
+}
+
+void Settings::setMaxStreamsPerConnection(int count) {
+    setIntSetting("max_streams_per_connection", count);
+}
+
+int Settings::getDnsCacheTtl() const {
+    return getSnapshot()->dnsCacheTtl;
+}
+
+void Settings::setDnsCacheTtl(int seconds) {
+    setIntSetting("dns_cache_ttl", seconds);
+}
+
+int Settings::getHappyEyeballsTimeout() const {
+    return getSnapshot()->happyEyeballsTimeout;
+}
+
+void Settings::setHappyEyeballsTimeout(int timeoutMs) {
+    setIntSetting("happy_eyeballs_timeout", timeoutMs);
+}
+
+int Settings::getMaxConnectionsPerHost() const {
+    return getSnapshot()->maxConnectionsPerHost;
+}
+
+void Settings::setMaxConnectionsPerHost(int max) {
+    setIntSetting("max_connections_per_host", max);
+}
+
+int Settings::getMaxConnectionsPerAddress() const {
+    return getSnapshot()->maxConnectionsPerAddress;
+}
+
+void Settings::setMaxConnectionsPerAddress(int max) {
+    setIntSetting("max_connections_per_address", max);
+}
+
+int Settings::getMaxConnections() const {
+    return getSnapshot()->maxConnections;
+}
+
+void Settings::setMaxConnections(int max) {
+    setIntSetting("max_connections", max);
+}
+
+bool Settings::getAdaptiveConcurrency() const {
+    return getSnapshot()->adaptiveConcurrency;
+}
+
+void Settings::setAdaptiveConcurrency(bool enabled) {
+    setBoolSetting("adaptive_concurrency", enabled);
+}
+
+int Settings::getResourceSampleInterval() const {
+    return getSnapshot()->resourceSampleInterval;
+}
+
+void Settings::setResourceSampleInterval(int intervalMs) {
+    setIntSetting("resource_sample_interval", intervalMs);
+}
+
+std::string Settings::getMetricsFile() const {
+    return getSnapshot()->metricsFile;
+}
+
+void Settings::setMetricsFile(const std::string& path) {
+    setStringSetting("metrics_file", path);
+}
+
+int Settings::getMetricsInterval() const {
+    return getSnapshot()->metricsInterval;
+}
+
+void Settings::setMetricsInterval(int intervalMs) {
+    setIntSetting("metrics_interval", intervalMs);
+}
+
+int Settings::getPluginCallBudget() const {
+    return getSnapshot()->pluginCallBudget;
+}
+
+void Settings::setPluginCallBudget(int milliseconds) {
+    setIntSetting("plugin_call_budget", milliseconds);
+}
+
+SocketProfile Settings::getSocketProfile() const {
+    return getSnapshot()->socketProfile;
+}
+
+void Settings::setSocketProfile(SocketProfile profile) {
+    setStringSetting("socket_profile", SocketTuner::getProfileName(profile));
+}
+
+bool Settings::getStreamMedia() const {
+    return getSnapshot()->streamMedia;
+}
+
+void Settings::setStreamMedia(bool enabled) {
+    setBoolSetting("stream_media", enabled);
+}
+
+bool Settings::getDeviceIoScheduling() const {
+    return getSnapshot()->deviceIoScheduling;
+}
+
+void Settings::setDeviceIoScheduling(bool enabled) {
+    setBoolSetting("device_io_scheduling", enabled);
+}
+
+int Settings::getMaxDeviceWriters(StorageKind kind) const {
+    auto snapshot = getSnapshot();
+    switch (kind) {
+        case StorageKind::HDD:
+            return snapshot->hddMaxWriters;
+        case StorageKind::NETWORK:
+            return snapshot->networkMaxWriters;
+        default:
+            return snapshot->ssdMaxWriters;
+    }
+}
+
+void Settings::setMaxDeviceWriters(StorageKind kind, int writers) {
+    switch (kind) {
+        case StorageKind::HDD:
+            setIntSetting("hdd_max_writers", writers);
+            break;
+        case StorageKind::NETWORK:
+            setIntSetting("network_max_writers", writers);
+            break;
+        default:
+            setIntSetting("ssd_max_writers", writers);
+            break;
+    }
+}
+
+bool Settings::getReserveDiskSpace() const {
+    return getSnapshot()->reserveDiskSpace;
+}
+
+void Settings::setReserveDiskSpace(bool enabled) {
+    setBoolSetting("reserve_disk_space", enabled);
+}
+
+int Settings::getDiskSpaceMargin() const {
+    return getSnapshot()->diskSpaceMargin;
+}
+
+void Settings::setDiskSpaceMargin(int megabytes) {
+    setIntSetting("disk_space_margin", megabytes);
+}
+
+int Settings::getSmallFileThreshold() const {
+    return getSnapshot()->smallFileThreshold;
+}
+
+void Settings::setSmallFileThreshold(int kilobytes) {
+    setIntSetting("small_file_threshold", kilobytes);
+}
+
+std::string Settings::getProxyPool() const {
+    return getSnapshot()->proxyPool;
+}
+
+void Settings::setProxyPool(const std::string& proxies) {
+    setStringSetting("proxy_pool", proxies);
+}
+
+ProxyAssignment Settings::getProxyAssignment() const {
+    return getSnapshot()->proxyAssignment;
+}
+
+void Settings::setProxyAssignment(ProxyAssignment assignment) {
+    setStringSetting("proxy_assignment", ProxyPool::getAssignmentName(assignment));
+}
+
+int Settings::getProxyMaxConnections() const {
+    return getSnapshot()->proxyMaxConnections;
+}
+
+void Settings::setProxyMaxConnections(int maxConnections) {
+    setIntSetting("proxy_max_connections", maxConnections);
+}
+
+std::string Settings::getProxyHealthUrl() const {
+    return getSnapshot()->proxyHealthUrl;
+}
+
+void Settings::setProxyHealthUrl(const std::string& url) {
+    setStringSetting("proxy_health_url", url);
+}
+
+std::string Settings::getClusterDirectory() const {
+    return getSnapshot()->clusterDirectory;
+}
+
+void Settings::setClusterDirectory(const std::string& directory) {
+    setStringSetting("cluster_directory", directory);
+}
+
+std::string Settings::getClusterNodeId() const {
+    return getSnapshot()->clusterNodeId;
+}
+
+void Settings::setClusterNodeId(const std::string& id) {
+    setStringSetting("cluster_node_id", id);
+}
+
+int Settings::getClusterLeaseSeconds() const {
+    return getSnapshot()->clusterLeaseSeconds;
+}
+
+void Settings::setClusterLeaseSeconds(int seconds) {
+    setIntSetting("cluster_lease_seconds", seconds);
+}
+
+int Settings::getClusterSplitSize() const {
+    return getSnapshot()->clusterSplitSize;
+}
+
+void Settings::setClusterSplitSize(int megabytes) {
+    setIntSetting("cluster_split_size", megabytes);
+}
+
+int Settings::getClusterPieceSize() const {
+    return getSnapshot()->clusterPieceSize;
+}
+
+void Settings::setClusterPieceSize(int megabytes) {
+    setIntSetting("cluster_piece_size", megabytes);
+}
+
+bool Settings::getPeerCache() const {
+    return getSnapshot()->peerCache;
+}
+
+void Settings::setPeerCache(bool enabled) {
+    setBoolSetting("peer_cache", enabled);
+}
+
+int Settings::getPeerCachePort() const {
+    return getSnapshot()->peerCachePort;
+}
+
+void Settings::setPeerCachePort(int port) {
+    setIntSetting("peer_cache_port", port);
+}
+
+std::string Settings::getPeerCachePeers() const {
+    return getSnapshot()->peerCachePeers;
+}
+
+void Settings::setPeerCachePeers(const std::string& peers) {
+    setStringSetting("peer_cache_peers", peers);
+}
+
+int Settings::getPrefetchQueuedTasks() const {
+    return getSnapshot()->prefetchQueuedTasks;
+}
+
+void Settings::setPrefetchQueuedTasks(int count) {
+    setIntSetting("prefetch_queued_tasks", count);
+}
+
+int Settings::getPrefetchTtl() const {
+    return getSnapshot()->prefetchTtl;
+}
+
+void Settings::setPrefetchTtl(int seconds) {
+    setIntSetting("prefetch_ttl", seconds);
+}
+
+int Settings::getThreadStackSize() const {
+    return getSnapshot()->threadStackSize;
+}
+
+void Settings::setThreadStackSize(int size) {
+    setIntSetting("thread_stack_size", size);
+}
+
+int Settings::getWriteBufferBudget() const {
+    return getSnapshot()->writeBufferBudget;
+}
+
+void Settings::setWriteBufferBudget(int budget) {
+    setIntSetting("write_buffer_budget", budget);
+}
+
+int Settings::getPieceHashSize() const {
+    return getSnapshot()->pieceHashSize;
+}
+
+void Settings::setPieceHashSize(int size) {
+    setIntSetting("piece_hash_size", size);
+}
+
 std::string Settings::getStringSetting(const std::string& key, const std::string& defaultValue) const {
     std::lock_guard<std::mutex> lock(mutex_);
     
@@ -217,22 +832,19 @@ std::string Settings::getStringSetting(const std::string& key, const std::string
 }
 
 void Settings::setStringSetting(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    auto it = settings_.find(key);
+    if (it != settings_.end() && it->second == value) {
+        return;
+    }
     settings_[key] = value;
+    
+    publishSnapshot(lock);
 }
 
 int Settings::getIntSetting(const std::string& key, int defaultValue) const {
-    std::string value = getStringSetting(key, "");
-    
-    if (value.empty()) {
-        return defaultValue;
-    }
-    
-    try {
-        return std::stoi(value);
-    } catch (...) {
-        return defaultValue;
-    }
+    return parseIntValue(getStringSetting(key, ""), defaultValue);
 }
 
 void Settings::setIntSetting(const std::string& key, int value) {
@@ -240,17 +852,7 @@ void Settings::setIntSetting(const std::string& key, int value) {
 }
 
 bool Settings::getBoolSetting(const std::string& key, bool defaultValue) const {
-    std::string value = getStringSetting(key, "");
-    
-    if (value.empty()) {
-        return defaultValue;
-    }
-    
-    // Convert to lowercase
-    std::transform(value.begin(), value.end(), value.begin(), 
-                   [](unsigned char c) { return std::tolower(c); });
-    
-    return value == "true" || value == "yes" || value == "1" || value == "on";
+    return parseBoolValue(getStringSetting(key, ""), defaultValue);
 }
 
 void Settings::setBoolSetting(const std::string& key, bool value) {
@@ -261,5 +863,55 @@ std::string Settings::getSettingsFilePath() const {
     return dm::utils::FileUtils::getAppDataDirectory() + "/settings.ini";
 }
 
+void Settings::publishSnapshot(std::unique_lock<std::mutex>& lock) {
+    std::shared_ptr<const SettingsSnapshot> current = buildSnapshot(settings_);
+    std::shared_ptr<const SettingsSnapshot> previous = std::atomic_exchange(&snapshot_, current);
+    generation_++;
+    if (!previous) {
+        delivered_ = current;
+        deliveredGeneration_ = generation_;
+        return;
+    }
+    lock.unlock();
+    
+    // A callback changing settings, the delivery under way picks it up next
+    if (deliveringThread_.load() == std::this_thread::get_id()) {
+        return;
+    }
+    
+    // Whoever delivers takes every change published meanwhile, in order
+    std::lock_guard<std::mutex> delivery(deliveryMutex_);
+    deliveringThread_.store(std::this_thread::get_id());
+    try {
+        while (true) {
+            std::shared_ptr<const SettingsSnapshot> from;
+            std::shared_ptr<const SettingsSnapshot> to;
+            std::vector<SettingsChangeCallback> callbacks;
+            {
+                std::lock_guard<std::mutex> settingsLock(mutex_);
+                if (deliveredGeneration_ == generation_) {
+                    break;
+                }
+                from = delivered_;
+                to = std::atomic_load(&snapshot_);
+                delivered_ = to;
+                deliveredGeneration_ = generation_;
+                for (const auto& pair : changeCallbacks_) {
+                    callbacks.push_back(pair.second);
+                }
+            }
+            
+            // Callbacks may read settings or change them
+            for (const auto& callback : callbacks) {
+                callback(*from, *to);
+            }
+        }
+    } catch (...) {
+        deliveringThread_.store(std::thread::id());
+        throw;
+    }
+    deliveringThread_.store(std::thread::id());
+}
+
 } // namespace core
 } // namespace dm
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "core/SocketTuner.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const char CONGESTION_CONTROL[] = "bbr";
+
+std::atomic<bool> congestionWarned{false};
+
+/**
+ * @brief Read one of the numbers in a /proc/sys file
+ *
+ * @param path The path
+ * @param index Which number
+ * @return int64_t The number, 0 if unreadable
+ */
+int64_t readSysctl(const char* path, int index) {
+    std::ifstream file(path);
+    int64_t value = 0;
+    for (int i = 0; i <= index; i++) {
+        if (!(file >> value)) {
+            return 0;
+        }
+    }
+    return value;
+}
+
+int setSocketOption(curl_socket_t socket, int level, int name, const void* value, size_t length) {
+#ifdef _WIN32
+    return setsockopt(socket, level, name, static_cast<const char*>(value), static_cast<int>(length));
+#else
+    return setsockopt(socket, level, name, value, static_cast<socklen_t>(length));
+#endif
+}
+
+} // anonymous namespace
+
+SocketTuner& SocketTuner::getInstance() {
+    static SocketTuner instance;
+    return instance;
+}
+
+void SocketTuner::setProfile(SocketProfile profile) {
+    profile_.store(profile);
+    if (profile != SocketProfile::AUTO) {
+        active_.store(profile);
+    }
+}
+
+SocketProfile SocketTuner::getProfile() const {
+    return profile_.load();
+}
+
+SocketProfile SocketTuner::getActiveProfile() const {
+    return active_.load();
+}
+
+void SocketTuner::update(double throughput, double latencyMs) {
+    if (profile_.load() != SocketProfile::AUTO || latencyMs <= 0.0) {
+        return;
+    }
+
+    // Bytes in flight to fill the link, as the downloads see it
+    double bdp = throughput * latencyMs / 1000.0;
+    SocketProfile active = active_.load();
+    SocketProfile next = active;
+    if (active == SocketProfile::STANDARD && latencyMs >= HIGH_BDP_MIN_LATENCY_MS && bdp >= HIGH_BDP_ENTER_BYTES) {
+        next = SocketProfile::HIGH_BDP;
+    } else if (active == SocketProfile::HIGH_BDP && bdp < HIGH_BDP_LEAVE_BYTES) {
+        next = SocketProfile::STANDARD;
+    }
+
+    if (next != active && active_.compare_exchange_strong(active, next)) {
+        dm::utils::Logger::info(std::string("Socket profile ") + getProfileName(next) + ": " +
+                                std::to_string(static_cast<int64_t>(bdp / 1024)) + " KB in flight at " +
+                                std::to_string(static_cast<int>(latencyMs)) + " ms");
+    }
+}
+
+void SocketTuner::apply(CURL* handle) {
+    if (active_.load() != SocketProfile::HIGH_BDP) {
+        return;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_BUFFERSIZE, HIGH_BDP_CURL_BUFFER_SIZE);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTFUNCTION, &SocketTuner::socketOptionCallback);
+    curl_easy_setopt(handle, CURLOPT_SOCKOPTDATA, nullptr);
+}
+
+bool SocketTuner::parseProfile(const std::string& name, SocketProfile& profile) {
+    if (name == "auto") {
+        profile = SocketProfile::AUTO;
+        return true;
+    }
+    if (name == "standard") {
+        profile = SocketProfile::STANDARD;
+        return true;
+    }
+    if (name == "high_bdp") {
+        profile = SocketProfile::HIGH_BDP;
+        return true;
+    }
+    return false;
+}
+
+const char* SocketTuner::getProfileName(SocketProfile profile) {
+    switch (profile) {
+        case SocketProfile::STANDARD:
+            return "standard";
+        case SocketProfile::HIGH_BDP:
+            return "high_bdp";
+        case SocketProfile::AUTO:
+        default:
+            return "auto";
+    }
+}
+
+int SocketTuner::socketOptionCallback(void* clientp, curl_socket_t socket, curlsocktype purpose) {
+    (void)clientp;
+    if (purpose != CURLSOCKTYPE_IPCXN) {
+        return CURL_SOCKOPT_OK;
+    }
+
+    // Before connect, so the window scale offered in the SYN covers it
+    int receiveBuffer = getReceiveBufferSize();
+    if (receiveBuffer > 0) {
+        setSocketOption(socket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    }
+
+#ifdef TCP_NOTSENT_LOWAT
+    int lowat = HIGH_BDP_NOTSENT_LOWAT;
+    setSocketOption(socket, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+#endif
+
+#ifdef TCP_CONGESTION
+    // Not loaded, or not in net.ipv4.tcp_allowed_congestion_control
+    if (setSocketOption(socket, IPPROTO_TCP, TCP_CONGESTION, CONGESTION_CONTROL, sizeof(CONGESTION_CONTROL) - 1) != 0 &&
+        !congestionWarned.exchange(true)) {
+        dm::utils::Logger::debug(std::string("Congestion control ") + CONGESTION_CONTROL +
+                                 " not available, keeping the system default");
+    }
+#endif
+
+    return CURL_SOCKOPT_OK;
+}
+
+int SocketTuner::getReceiveBufferSize() {
+#ifdef __linux__
+    // The kernel doubles SO_RCVBUF for its bookkeeping and caps it at rmem_max
+    static const int size = [] {
+        int64_t autotuned = readSysctl("/proc/sys/net/ipv4/tcp_rmem", 2);
+        int64_t limit = readSysctl("/proc/sys/net/core/rmem_max", 0);
+        int64_t fixed = std::min<int64_t>(HIGH_BDP_RECEIVE_BUFFER, limit);
+        return fixed > autotuned / 2 ? static_cast<int>(fixed) : 0;
+    }();
+    return size;
+#else
+    return HIGH_BDP_RECEIVE_BUFFER;
+#endif
+}
+
+} // namespace core
+} // namespace dm
@@ -3,6 +3,7 @@
 #include "../../include/utils/DatabaseManager.h"
 #include "../../include/utils/TimeUtils.h"
 #include "../../include/utils/StringUtils.h"
+#include "../../include/utils/ResourceMonitor.h"
 
 #include <sstream>
 #include <iomanip>
@@ -207,17 +208,18 @@ void Statistics::saveStatistics() {
             "average_speed = ? "
             "WHERE date = ?";
         
-        auto stmt = db.prepare(updateSql);
-        stmt->bindInt(1, m_dailyStats.totalDownloads);
-        stmt->bindInt(2, m_dailyStats.successfulDownloads);
-        stmt->bindInt(3, m_dailyStats.failedDownloads);
-        stmt->bindInt64(4, m_dailyStats.totalBytesDownloaded);
-        stmt->bindInt(5, avgSpeed);
-        stmt->bindInt64(6, todayStart);
-        
-        stmt->step();
-        
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, "Statistics saved to database");
+        // Queued for the database writer, a newer save of the day replaces it
+        auto stats = m_dailyStats;
+        db.enqueueWrite(updateSql, [stats, avgSpeed, todayStart](Utils::Statement& stmt) {
+            stmt.bindInt(1, stats.totalDownloads);
+            stmt.bindInt(2, stats.successfulDownloads);
+            stmt.bindInt(3, stats.failedDownloads);
+            stmt.bindInt64(4, stats.totalBytesDownloaded);
+            stmt.bindInt(5, avgSpeed);
+            stmt.bindInt64(6, todayStart);
+        }, "statistics:" + std::to_string(todayStart));
+        
+        Utils::Logger::instance().log(Utils::LogLevel::DEBUG, "Statistics queued for the database");
     } 
     catch (const std::exception& e) {
         Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
@@ -258,8 +260,9 @@ void Statistics::resetAllStatistics() {
     m_dailyDownloadHistory.clear();
     
     try {
-        // Clear database statistics
+        // Clear database statistics, after any update still queued
         auto& db = Utils::DatabaseManager::instance();
+        db.flushWrites();
         db.execute("DELETE FROM statistics");
         
         // Create new entry for today
@@ -718,6 +721,26 @@ std::string Statistics::getStatsReport() const {
     for (const auto& pair : m_fileTypeStats) {
         ss << pair.first << ": " << Utils::StringUtils::formatFileSize(pair.second) << std::endl;
     }
+    ss << std::endl;
+    
+    // Published by the resource sampler, nothing is read from the OS here
+    auto& monitor = dm::utils::ResourceMonitor::getInstance();
+    dm::utils::ResourceUsage usage = monitor.getUsage();
+    
+    ss << "Process Resources:" << std::endl;
+    ss << "-----------------" << std::endl;
+    ss << "Resident Memory: " << Utils::StringUtils::formatFileSize(usage.residentBytes)
+       << " (peak " << Utils::StringUtils::formatFileSize(usage.peakResidentBytes) << ")" << std::endl;
+    ss << "Open Files: " << usage.openFiles << std::endl;
+    ss << "Threads: " << usage.threadCount << std::endl;
+    
+    for (int i = 0; i < static_cast<int>(dm::utils::ResourceSubsystem::COUNT); i++) {
+        auto subsystem = static_cast<dm::utils::ResourceSubsystem>(i);
+        dm::utils::SubsystemUsage counters = monitor.getSubsystemUsage(subsystem);
+        ss << dm::utils::ResourceMonitor::getSubsystemName(subsystem) << ": " << counters.liveObjects
+           << " live, " << Utils::StringUtils::formatFileSize(counters.liveBytes)
+           << ", " << counters.totalAllocations << " allocated" << std::endl;
+    }
     
     return ss.str();
 }
@@ -0,0 +1,586 @@
+#include "core/StreamDownloader.h"
+#include "core/HttpClient.h"
+#include "core/OutputFile.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const char PROGRESS_SUFFIX[] = ".stream";
+
+// A failure that fails the same way when retried
+bool isFatalFailure(const TransferResult& result) {
+    switch (result.curlCode) {
+        case CURLE_UNSUPPORTED_PROTOCOL:
+        case CURLE_URL_MALFORMAT:
+        case CURLE_NOT_BUILT_IN:
+        case CURLE_REMOTE_ACCESS_DENIED:
+        case CURLE_LOGIN_DENIED:
+        case CURLE_REMOTE_FILE_NOT_FOUND:
+        case CURLE_TOO_MANY_REDIRECTS:
+        case CURLE_PEER_FAILED_VERIFICATION:
+        case CURLE_SSL_CERTPROBLEM:
+        case CURLE_SSL_CACERT_BADFILE:
+            return true;
+        default:
+            break;
+    }
+    int status = result.statusCode;
+    return status >= 400 && status != 408 && status != 425 && status != 429 && status < 500;
+}
+
+// Somewhere in the upper half of the delay, so segments failing together do not retry together
+int64_t withJitter(int64_t delayMs) {
+    thread_local std::mt19937 generator(std::random_device{}());
+    std::uniform_int_distribution<int64_t> distribution(0, delayMs / 2);
+    return delayMs - delayMs / 2 + distribution(generator);
+}
+
+std::string describeSegment(const StreamSegment& segment, bool init) {
+    return init ? "initialization segment " + segment.url
+                : "segment " + std::to_string(segment.sequence) + " (" + segment.url + ")";
+}
+
+} // anonymous namespace
+
+StreamDownloader::StreamDownloader()
+    : segmentsWritten_(0), segmentsTotal_(0), bytesWritten_(0), running_(false), stopRequested_(false) {
+}
+
+StreamDownloader::~StreamDownloader() {
+    stop();
+}
+
+bool StreamDownloader::start(const std::string& manifestUrl, const std::string& outputPath,
+                             const StreamDownloadOptions& options,
+                             StreamProgressCallback progressCallback,
+                             StreamCompletionCallback completionCallback) {
+    if (running_ || manifestUrl.empty() || outputPath.empty()) {
+        return false;
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    options_ = options;
+    options_.maxSegmentsInFlight = std::max(1, options_.maxSegmentsInFlight);
+    progressCallback_ = progressCallback;
+    completionCallback_ = completionCallback;
+    manifestUrl_ = manifestUrl;
+    outputPath_ = outputPath;
+    variantUrl_.clear();
+    items_.clear();
+    segmentsWritten_ = 0;
+    segmentsTotal_ = 0;
+    bytesWritten_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        outputs_.clear();
+        error_.clear();
+        succeeded_ = false;
+    }
+
+    stopRequested_ = false;
+    running_ = true;
+    thread_ = std::thread(&StreamDownloader::run, this);
+    return true;
+}
+
+void StreamDownloader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex_);
+        stopRequested_ = true;
+    }
+    fetchChanged_.notify_all();
+
+    if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+    }
+}
+
+bool StreamDownloader::wait() {
+    if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return succeeded_;
+}
+
+bool StreamDownloader::isRunning() const {
+    return running_;
+}
+
+void StreamDownloader::getStatistics(int& segmentsWritten, int& segmentsTotal, int64_t& bytesWritten) const {
+    segmentsWritten = segmentsWritten_;
+    segmentsTotal = segmentsTotal_;
+    bytesWritten = bytesWritten_;
+}
+
+std::string StreamDownloader::getError() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return error_;
+}
+
+std::vector<std::string> StreamDownloader::getOutputFiles() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    std::vector<std::string> paths;
+    for (const auto& output : outputs_) {
+        paths.push_back(output.path);
+    }
+    return paths;
+}
+
+void StreamDownloader::run() {
+    StreamManifest manifest;
+    bool success = loadManifest(manifest) && prepare(manifest) && transfer();
+
+    if (success) {
+        std::error_code error;
+        std::filesystem::remove(outputPath_ + PROGRESS_SUFFIX, error);
+        dm::utils::Logger::info("Stream downloaded: " + manifestUrl_ + " (" +
+                                std::to_string(segmentsWritten_.load()) + " segments, " +
+                                std::to_string(bytesWritten_.load()) + " bytes)");
+    } else if (stopRequested_) {
+        setError("Stopped");
+    } else {
+        dm::utils::Logger::error("Stream download failed: " + manifestUrl_ + ": " + getError());
+    }
+
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        succeeded_ = success;
+        error = error_;
+    }
+    running_ = false;
+
+    if (completionCallback_) {
+        completionCallback_(success, error);
+    }
+}
+
+bool StreamDownloader::loadManifest(StreamManifest& manifest) {
+    StreamManifest top;
+    if (!fetchManifest(manifestUrl_, top)) {
+        return false;
+    }
+
+    if (top.variants.empty()) {
+        manifest = std::move(top);
+        variantUrl_ = manifestUrl_;
+    } else {
+        const StreamVariant& variant = top.variants[StreamManifestParser::selectVariant(top, options_.maxBandwidth)];
+        dm::utils::Logger::info("Stream variant " + variant.url + " at " + std::to_string(variant.bandwidth) +
+                                " bit/s" + (variant.resolution.empty() ? "" : ", " + variant.resolution));
+        if (!fetchManifest(variant.url, manifest)) {
+            return false;
+        }
+        if (manifest.tracks.empty()) {
+            setError("Variant playlist has no segments: " + variant.url);
+            return false;
+        }
+        variantUrl_ = variant.url;
+
+        // An audio rendition of its own becomes a second track
+        if (!variant.audioUrl.empty()) {
+            StreamManifest audio;
+            if (!fetchManifest(variant.audioUrl, audio)) {
+                return false;
+            }
+            if (!audio.tracks.empty()) {
+                manifest.tracks.front().name = "video";
+                audio.tracks.front().name = "audio";
+                manifest.tracks.push_back(std::move(audio.tracks.front()));
+                manifest.live = manifest.live || audio.live;
+                manifest.encrypted = manifest.encrypted || audio.encrypted;
+            }
+        }
+    }
+
+    if (manifest.live) {
+        setError("Live streams are not supported");
+        return false;
+    }
+    if (manifest.encrypted) {
+        setError("Encrypted streams are not supported");
+        return false;
+    }
+    return true;
+}
+
+bool StreamDownloader::fetchManifest(const std::string& url, StreamManifest& manifest) {
+    HttpClient client;
+    client.setUserAgent(options_.userAgent).setMaxBodySize(MAX_MANIFEST_SIZE).setAcceptCompression(true);
+    for (const auto& header : options_.headers) {
+        client.setHeader(header.first, header.second);
+    }
+
+    HttpResponse response = client.get(url);
+    if (!response.success) {
+        setError("Failed to fetch manifest " + url + ": " +
+                 (response.error.empty() ? "HTTP error " + std::to_string(response.statusCode) : response.error));
+        return false;
+    }
+
+    std::string text(response.body.begin(), response.body.end());
+    std::string base = response.effectiveUrl.empty() ? url : response.effectiveUrl;
+    if (!StreamManifestParser::parse(text, base, manifest)) {
+        setError("Not an HLS playlist or DASH manifest: " + url);
+        return false;
+    }
+    return true;
+}
+
+bool StreamDownloader::prepare(const StreamManifest& manifest) {
+    // Further tracks are named after the first: movie.mp4, movie.audio.m4a
+    std::string stem = outputPath_;
+    size_t slash = stem.find_last_of("/\\");
+    size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        stem = stem.substr(0, dot);
+    }
+
+    std::vector<TrackOutput> saved = loadProgress();
+    bool resumed = saved.size() == manifest.tracks.size();
+
+    std::vector<TrackOutput> outputs;
+    for (size_t i = 0; i < manifest.tracks.size(); i++) {
+        const StreamTrack& track = manifest.tracks[i];
+        TrackOutput output = resumed ? saved[i] : TrackOutput();
+        output.path = i == 0 ? outputPath_ : stem + "." + track.name + "." + track.extension;
+
+        std::error_code error;
+        if (resumed && (!std::filesystem::exists(output.path, error) ||
+                        static_cast<int64_t>(std::filesystem::file_size(output.path, error)) < output.offset)) {
+            dm::utils::Logger::warning("Stream output changed since it was recorded, starting over: " + output.path);
+            output = TrackOutput();
+            output.path = i == 0 ? outputPath_ : stem + "." + track.name + "." + track.extension;
+        }
+
+        // Anything past the last segment recorded is a segment cut short
+        if (!std::filesystem::exists(output.path, error)) {
+            std::ofstream(output.path, std::ios::binary);
+        }
+        std::filesystem::resize_file(output.path, static_cast<uintmax_t>(output.offset), error);
+        if (error) {
+            setError("Failed to prepare output file " + output.path + ": " + error.message());
+            return false;
+        }
+
+        segmentsTotal_ += static_cast<int>(track.segments.size()) + (track.hasInit ? 1 : 0);
+        bytesWritten_ += output.offset;
+        if (track.hasInit) {
+            if (output.initWritten) {
+                segmentsWritten_++;
+            } else {
+                items_.push_back({i, track.init, true});
+            }
+        }
+        for (const auto& segment : track.segments) {
+            if (output.nextSequence >= 0 && segment.sequence < output.nextSequence) {
+                segmentsWritten_++;
+            } else {
+                items_.push_back({i, segment, false});
+            }
+        }
+        outputs.push_back(std::move(output));
+    }
+
+    if (segmentsWritten_ > 0) {
+        dm::utils::Logger::info("Resuming stream " + manifestUrl_ + " at segment " +
+                                std::to_string(segmentsWritten_.load()) + " of " + std::to_string(segmentsTotal_.load()));
+    }
+
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    outputs_ = std::move(outputs);
+    return true;
+}
+
+bool StreamDownloader::transfer() {
+    files_.clear();
+    for (const auto& output : outputs_) {
+        auto file = std::make_unique<OutputFile>();
+        if (!file->open(output.path)) {
+            setError("Failed to open output file " + output.path);
+            return false;
+        }
+        files_.push_back(std::move(file));
+    }
+    saveProgress();
+
+    size_t nextSubmit = 0;
+    size_t nextWrite = 0;
+    bool failed = false;
+    size_t window = static_cast<size_t>(options_.maxSegmentsInFlight);
+
+    std::unique_lock<std::mutex> lock(fetchMutex_);
+    while (nextWrite < items_.size() && !failed && !stopRequested_) {
+        // Segments held for writing count against the window too, memory stays bounded behind a slow one
+        while (nextSubmit < items_.size() && nextSubmit - nextWrite < window) {
+            auto fetch = std::make_shared<Fetch>();
+            fetch->index = nextSubmit++;
+            fetches_[fetch->index] = fetch;
+            if (!submit(fetch, 0)) {
+                failed = true;
+                break;
+            }
+        }
+
+        for (auto& entry : fetches_) {
+            Fetch& fetch = *entry.second;
+            if (!fetch.failed || failed) {
+                continue;
+            }
+            const Item& item = items_[fetch.index];
+            int64_t delayMs = getRetryDelay(fetch);
+            std::string reason = fetch.result.error.empty() ? "incomplete" : fetch.result.error;
+            if (delayMs < 0) {
+                setError("Failed to fetch " + describeSegment(item.segment, item.init) + ": " + reason);
+                failed = true;
+                break;
+            }
+            dm::utils::Logger::debug("Retrying " + describeSegment(item.segment, item.init) + " in " +
+                                     std::to_string(delayMs) + " ms: " + reason);
+            fetch.attempts++;
+            fetch.failed = false;
+            fetch.data.clear();
+            if (!submit(entry.second, delayMs)) {
+                failed = true;
+                break;
+            }
+        }
+        if (failed) {
+            break;
+        }
+
+        auto head = fetches_.find(nextWrite);
+        if (head != fetches_.end() && head->second->done) {
+            std::shared_ptr<Fetch> fetch = head->second;
+            fetches_.erase(head);
+            lock.unlock();
+            bool written = write(*fetch);
+            lock.lock();
+            if (!written) {
+                failed = true;
+            }
+            nextWrite++;
+            continue;
+        }
+
+        fetchChanged_.wait(lock, [this, nextWrite] {
+            if (stopRequested_) {
+                return true;
+            }
+            auto it = fetches_.find(nextWrite);
+            if (it != fetches_.end() && it->second->done) {
+                return true;
+            }
+            return std::any_of(fetches_.begin(), fetches_.end(),
+                               [](const auto& entry) { return entry.second->failed; });
+        });
+    }
+
+    // No callback runs once a transfer is canceled, the fetches can go
+    std::vector<TransferId> transfers;
+    for (const auto& entry : fetches_) {
+        if (entry.second->transfer != 0) {
+            transfers.push_back(entry.second->transfer);
+        }
+    }
+    lock.unlock();
+    for (TransferId id : transfers) {
+        TransferEngine::getInstance().cancel(id);
+    }
+    lock.lock();
+    fetches_.clear();
+    lock.unlock();
+
+    bool complete = !failed && nextWrite == items_.size();
+    for (auto& file : files_) {
+        if (complete) {
+            file->sync();
+        }
+        file->close();
+    }
+    files_.clear();
+    return complete;
+}
+
+bool StreamDownloader::submit(const std::shared_ptr<Fetch>& fetch, int64_t delayMs) {
+    const StreamSegment& segment = items_[fetch->index].segment;
+
+    TransferRequest request;
+    request.url = segment.url;
+    request.startByte = segment.rangeStart;
+    request.endByte = segment.rangeStart >= 0 ? segment.rangeEnd : -1;
+    request.headers = options_.headers;
+    request.userAgent = options_.userAgent;
+    request.multiplex = options_.multiplex;
+    request.startDelayMs = delayMs;
+
+    // Both run on the engine thread, the data only changes hands under fetchMutex_
+    int64_t maxSize = options_.maxSegmentSize;
+    Fetch* raw = fetch.get();
+    request.dataCallback = [raw, maxSize](const char* data, size_t size) {
+        if (static_cast<int64_t>(raw->data.size() + size) > maxSize) {
+            return false;
+        }
+        raw->data.insert(raw->data.end(), data, data + size);
+        return true;
+    };
+    request.completionCallback = [this, fetch](TransferId, const TransferResult& result) {
+        const StreamSegment& segment = items_[fetch->index].segment;
+        std::lock_guard<std::mutex> lock(fetchMutex_);
+        fetch->transfer = 0;
+        fetch->result = result;
+
+        bool complete = result.success;
+        if (complete && segment.rangeStart >= 0) {
+            // A 200 to a range from the start carries the range first, then the rest
+            size_t expected = static_cast<size_t>(segment.rangeEnd - segment.rangeStart + 1);
+            if (result.statusCode == 200 && segment.rangeStart == 0 && fetch->data.size() > expected) {
+                fetch->data.resize(expected);
+            }
+            complete = fetch->data.size() == expected;
+        }
+        if (complete) {
+            fetch->done = true;
+        } else {
+            fetch->failed = true;
+        }
+        fetchChanged_.notify_all();
+    };
+
+    fetch->transfer = TransferEngine::getInstance().submit(std::move(request));
+    if (fetch->transfer == 0) {
+        setError("Transfer engine is not running");
+        return false;
+    }
+    return true;
+}
+
+int64_t StreamDownloader::getRetryDelay(const Fetch& fetch) const {
+    const TransferResult& result = fetch.result;
+    if (fetch.attempts >= options_.maxRetries || isFatalFailure(result) ||
+        static_cast<int64_t>(fetch.data.size()) >= options_.maxSegmentSize) {
+        return -1;
+    }
+    if ((result.statusCode == 429 || result.statusCode == 503) && result.retryAfter >= 0) {
+        return std::min<int64_t>(static_cast<int64_t>(result.retryAfter) * 1000, RETRY_MAX_DELAY_MS);
+    }
+
+    int64_t delayMs = RETRY_BASE_DELAY_MS << std::min(fetch.attempts, 8);
+    return withJitter(std::min(delayMs, RETRY_MAX_DELAY_MS));
+}
+
+bool StreamDownloader::write(Fetch& fetch) {
+    const Item& item = items_[fetch.index];
+    TrackOutput& output = outputs_[item.track];
+
+    if (!fetch.data.empty() &&
+        !files_[item.track]->writeAt(fetch.data.data(), fetch.data.size(), output.offset)) {
+        setError("Failed to write " + output.path);
+        return false;
+    }
+
+    int64_t size = static_cast<int64_t>(fetch.data.size());
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        output.offset += size;
+        if (item.init) {
+            output.initWritten = true;
+        } else {
+            output.nextSequence = item.segment.sequence + 1;
+        }
+    }
+    bytesWritten_ += size;
+    segmentsWritten_++;
+    saveProgress();
+
+    if (progressCallback_) {
+        progressCallback_(segmentsWritten_, segmentsTotal_, bytesWritten_);
+    }
+    return true;
+}
+
+void StreamDownloader::saveProgress() {
+    std::string path = outputPath_ + PROGRESS_SUFFIX;
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        file << "manifest=" << manifestUrl_ << std::endl;
+        file << "variant=" << variantUrl_ << std::endl;
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        for (const auto& output : outputs_) {
+            file << "track=" << output.nextSequence << " " << output.offset << " "
+                 << (output.initWritten ? 1 : 0) << std::endl;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        dm::utils::Logger::warning("Failed to record stream progress " + path + ": " + error.message());
+    }
+}
+
+std::vector<StreamDownloader::TrackOutput> StreamDownloader::loadProgress() const {
+    std::ifstream file(outputPath_ + PROGRESS_SUFFIX, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+
+    std::vector<TrackOutput> outputs;
+    std::string manifest;
+    std::string variant;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+        if (key == "manifest") {
+            manifest = value;
+        } else if (key == "variant") {
+            variant = value;
+        } else if (key == "track") {
+            TrackOutput output;
+            int initWritten = 0;
+            std::istringstream fields(value);
+            if (!(fields >> output.nextSequence >> output.offset >> initWritten) || output.offset < 0) {
+                return {};
+            }
+            output.initWritten = initWritten != 0;
+            outputs.push_back(output);
+        }
+    }
+
+    // Another stream, or another variant of it, cannot be continued
+    if (manifest != manifestUrl_ || variant != variantUrl_) {
+        return {};
+    }
+    return outputs;
+}
+
+void StreamDownloader::setError(const std::string& error) {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    if (error_.empty()) {
+        error_ = error;
+    }
+}
+
+} // namespace core
+} // namespace dm
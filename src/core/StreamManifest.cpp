@@ -0,0 +1,803 @@
+#include "core/StreamManifest.h"
+#include "utils/Logger.h"
+#include "utils/UrlParser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+// Guards against a timeline that would expand into an absurd number of segments
+const size_t MAX_SEGMENTS_PER_TRACK = 1000000;
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n\f");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r\n\f");
+    return text.substr(start, end - start + 1);
+}
+
+bool startsWith(const std::string& text, const char* prefix) {
+    return text.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+// The lowercase extension of the path of a URL, without the dot
+std::string getUrlExtension(const std::string& url) {
+    std::string path = url.substr(0, url.find_first_of("?#"));
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return "";
+    }
+    return toLower(path.substr(dot + 1));
+}
+
+// Parse an HLS attribute list: KEY=VALUE,KEY="quoted, value",...
+std::map<std::string, std::string> parseAttributes(const std::string& text) {
+    std::map<std::string, std::string> attributes;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t equals = text.find('=', pos);
+        if (equals == std::string::npos) {
+            break;
+        }
+        std::string name = trim(text.substr(pos, equals - pos));
+        std::string value;
+        pos = equals + 1;
+        if (pos < text.size() && text[pos] == '"') {
+            size_t close = text.find('"', pos + 1);
+            if (close == std::string::npos) {
+                close = text.size();
+            }
+            value = text.substr(pos + 1, close - pos - 1);
+            pos = text.find(',', close);
+        } else {
+            size_t comma = text.find(',', pos);
+            value = trim(text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos));
+            pos = comma;
+        }
+        attributes[name] = value;
+        if (pos == std::string::npos) {
+            break;
+        }
+        pos++;
+    }
+    return attributes;
+}
+
+// Parse an HLS byte range "length[@offset]", continuing from the previous range without an offset
+bool parseByteRange(const std::string& text, int64_t previousEnd, int64_t& start, int64_t& end) {
+    char* rest = nullptr;
+    long long length = std::strtoll(text.c_str(), &rest, 10);
+    if (rest == text.c_str() || length <= 0) {
+        return false;
+    }
+    int64_t offset = previousEnd + 1;
+    if (*rest == '@') {
+        offset = std::strtoll(rest + 1, nullptr, 10);
+    }
+    start = offset;
+    end = offset + length - 1;
+    return true;
+}
+
+// Parse a DASH byte range "first-last"
+bool parseDashRange(const std::string& text, int64_t& start, int64_t& end) {
+    size_t dash = text.find('-');
+    if (text.empty() || dash == std::string::npos) {
+        return false;
+    }
+    start = std::strtoll(text.c_str(), nullptr, 10);
+    end = std::strtoll(text.c_str() + dash + 1, nullptr, 10);
+    return start >= 0 && end >= start;
+}
+
+/**
+ * @brief Element of the small XML tree an MPD is read into
+ */
+struct XmlNode {
+    std::string name;                               // Without a namespace prefix
+    std::map<std::string, std::string> attributes;
+    std::vector<XmlNode> children;
+    std::string text;
+
+    const XmlNode* child(const char* childName) const {
+        for (const auto& node : children) {
+            if (node.name == childName) {
+                return &node;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string attribute(const char* attributeName, const std::string& fallback = "") const {
+        auto it = attributes.find(attributeName);
+        return it != attributes.end() ? it->second : fallback;
+    }
+};
+
+std::string decodeEntities(const std::string& text) {
+    if (text.find('&') == std::string::npos) {
+        return text;
+    }
+    static const std::pair<const char*, char> ENTITIES[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        bool replaced = false;
+        if (text[i] == '&') {
+            for (const auto& entity : ENTITIES) {
+                size_t length = std::char_traits<char>::length(entity.first);
+                if (text.compare(i, length, entity.first) == 0) {
+                    result += entity.second;
+                    i += length - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) {
+            result += text[i];
+        }
+    }
+    return result;
+}
+
+std::string stripPrefix(const std::string& name) {
+    size_t colon = name.find(':');
+    return colon == std::string::npos ? name : name.substr(colon + 1);
+}
+
+// Read an XML document into a tree, enough for an MPD: no DTDs, entities beyond the predefined ones
+bool parseXml(const std::string& text, XmlNode& root) {
+    std::vector<XmlNode*> open;
+    bool haveRoot = false;
+    size_t pos = 0;
+
+    while (pos < text.size()) {
+        size_t lt = text.find('<', pos);
+        if (lt == std::string::npos) {
+            break;
+        }
+        if (!open.empty()) {
+            open.back()->text += decodeEntities(text.substr(pos, lt - pos));
+        }
+
+        if (text.compare(lt, 4, "<!--") == 0) {
+            size_t close = text.find("-->", lt + 4);
+            pos = close == std::string::npos ? text.size() : close + 3;
+            continue;
+        }
+        if (text.compare(lt, 9, "<![CDATA[") == 0) {
+            size_t close = text.find("]]>", lt + 9);
+            if (close == std::string::npos) {
+                return false;
+            }
+            if (!open.empty()) {
+                open.back()->text += text.substr(lt + 9, close - lt - 9);
+            }
+            pos = close + 3;
+            continue;
+        }
+        if (text.compare(lt, 2, "<?") == 0 || text.compare(lt, 2, "<!") == 0) {
+            size_t close = text.find('>', lt);
+            pos = close == std::string::npos ? text.size() : close + 1;
+            continue;
+        }
+
+        size_t gt = lt + 1;
+        char quote = 0;
+        while (gt < text.size() && (quote || text[gt] != '>')) {
+            if (quote && text[gt] == quote) {
+                quote = 0;
+            } else if (!quote && (text[gt] == '"' || text[gt] == '\'')) {
+                quote = text[gt];
+            }
+            gt++;
+        }
+        if (gt >= text.size()) {
+            return false;
+        }
+        pos = gt + 1;
+
+        if (text[lt + 1] == '/') {
+            if (open.empty()) {
+                return false;
+            }
+            open.pop_back();
+            continue;
+        }
+
+        bool selfClosing = text[gt - 1] == '/';
+        std::string tag = text.substr(lt + 1, gt - lt - 1 - (selfClosing ? 1 : 0));
+        size_t nameEnd = tag.find_first_of(" \t\r\n");
+        XmlNode node;
+        node.name = stripPrefix(tag.substr(0, nameEnd));
+
+        size_t i = nameEnd == std::string::npos ? tag.size() : nameEnd;
+        while (i < tag.size()) {
+            size_t nameStart = tag.find_first_not_of(" \t\r\n", i);
+            if (nameStart == std::string::npos) {
+                break;
+            }
+            size_t equals = tag.find('=', nameStart);
+            if (equals == std::string::npos) {
+                break;
+            }
+            size_t valueStart = tag.find_first_of("\"'", equals);
+            if (valueStart == std::string::npos) {
+                break;
+            }
+            size_t valueEnd = tag.find(tag[valueStart], valueStart + 1);
+            if (valueEnd == std::string::npos) {
+                break;
+            }
+            node.attributes[stripPrefix(trim(tag.substr(nameStart, equals - nameStart)))] =
+                decodeEntities(tag.substr(valueStart + 1, valueEnd - valueStart - 1));
+            i = valueEnd + 1;
+        }
+
+        XmlNode* added;
+        if (open.empty()) {
+            if (haveRoot) {
+                return false;
+            }
+            root = std::move(node);
+            haveRoot = true;
+            added = &root;
+        } else {
+            // Siblings only move once this element is closed again
+            open.back()->children.push_back(std::move(node));
+            added = &open.back()->children.back();
+        }
+        if (!selfClosing) {
+            open.push_back(added);
+        }
+    }
+    return haveRoot;
+}
+
+// Resolve the BaseURL child of an element, if any, against the enclosing base
+std::string resolveBase(const std::string& base, const XmlNode& node) {
+    const XmlNode* baseUrl = node.child("BaseURL");
+    if (!baseUrl) {
+        return base;
+    }
+    std::string resolved = StreamManifestParser::resolveUrl(base, trim(baseUrl->text));
+    return resolved.empty() ? base : resolved;
+}
+
+// Expand a SegmentTemplate identifier string for one segment
+std::string fillTemplate(const std::string& pattern, const std::string& representationId,
+                         int64_t bandwidth, int64_t number, int64_t time) {
+    std::string result;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        size_t open = pattern.find('$', pos);
+        if (open == std::string::npos) {
+            result += pattern.substr(pos);
+            break;
+        }
+        result += pattern.substr(pos, open - pos);
+        size_t close = pattern.find('$', open + 1);
+        if (close == std::string::npos) {
+            result += pattern.substr(open);
+            break;
+        }
+        pos = close + 1;
+
+        std::string identifier = pattern.substr(open + 1, close - open - 1);
+        if (identifier.empty()) {
+            result += '$';
+            continue;
+        }
+
+        // An optional printf width, only %0<n>d is allowed
+        int width = 0;
+        size_t percent = identifier.find('%');
+        if (percent != std::string::npos) {
+            width = std::atoi(identifier.c_str() + percent + 1);
+            identifier = identifier.substr(0, percent);
+        }
+
+        long long value;
+        if (identifier == "RepresentationID") {
+            result += representationId;
+            continue;
+        } else if (identifier == "Number") {
+            value = number;
+        } else if (identifier == "Time") {
+            value = time;
+        } else if (identifier == "Bandwidth") {
+            value = bandwidth;
+        } else {
+            result += pattern.substr(open, close - open + 1);
+            continue;
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%0*lld", width, value);
+        result += buffer;
+    }
+    return result;
+}
+
+// Merge the SegmentTemplate of a representation over the one it inherits
+bool getSegmentTemplate(const XmlNode& period, const XmlNode& adaptationSet,
+                        const XmlNode& representation, XmlNode& merged) {
+    bool found = false;
+    for (const XmlNode* level : {&period, &adaptationSet, &representation}) {
+        const XmlNode* segmentTemplate = level->child("SegmentTemplate");
+        if (!segmentTemplate) {
+            continue;
+        }
+        for (const auto& attribute : segmentTemplate->attributes) {
+            merged.attributes[attribute.first] = attribute.second;
+        }
+        if (const XmlNode* timeline = segmentTemplate->child("SegmentTimeline")) {
+            merged.children.clear();
+            merged.children.push_back(*timeline);
+        }
+        found = true;
+    }
+    return found;
+}
+
+std::string getMimeExtension(const std::string& mimeType) {
+    static const std::map<std::string, std::string> EXTENSIONS = {
+        {"video/mp4", "mp4"}, {"audio/mp4", "m4a"}, {"video/webm", "webm"}, {"audio/webm", "weba"},
+        {"video/mp2t", "ts"}, {"text/vtt", "vtt"}, {"application/mp4", "mp4"}, {"application/ttml+xml", "ttml"}};
+    auto it = EXTENSIONS.find(toLower(mimeType));
+    return it != EXTENSIONS.end() ? it->second : "";
+}
+
+// Expand the segments of one representation into a track
+bool expandRepresentation(const XmlNode& period, const XmlNode& adaptationSet,
+                          const XmlNode& representation, const std::string& base,
+                          double periodDuration, StreamTrack& track) {
+    std::string representationId = representation.attribute("id");
+    int64_t bandwidth = std::strtoll(representation.attribute("bandwidth", "0").c_str(), nullptr, 10);
+
+    XmlNode segmentTemplate;
+    if (getSegmentTemplate(period, adaptationSet, representation, segmentTemplate)) {
+        int64_t timescale = std::max<int64_t>(1, std::strtoll(segmentTemplate.attribute("timescale", "1").c_str(), nullptr, 10));
+        int64_t number = std::strtoll(segmentTemplate.attribute("startNumber", "1").c_str(), nullptr, 10);
+        std::string media = segmentTemplate.attribute("media");
+        std::string initialization = segmentTemplate.attribute("initialization");
+        if (media.empty()) {
+            return false;
+        }
+
+        if (!initialization.empty()) {
+            track.hasInit = true;
+            track.init.url = StreamManifestParser::resolveUrl(
+                base, fillTemplate(initialization, representationId, bandwidth, 0, 0));
+            track.init.sequence = -1;
+        }
+
+        auto addSegment = [&](int64_t time, int64_t duration) {
+            StreamSegment segment;
+            segment.url = StreamManifestParser::resolveUrl(
+                base, fillTemplate(media, representationId, bandwidth, number, time));
+            segment.sequence = number++;
+            segment.duration = static_cast<double>(duration) / timescale;
+            track.segments.push_back(std::move(segment));
+        };
+
+        int64_t periodEnd = periodDuration > 0.0 ? static_cast<int64_t>(std::llround(periodDuration * timescale)) : -1;
+        if (!segmentTemplate.children.empty()) {
+            const XmlNode& timeline = segmentTemplate.children.front();
+            int64_t time = 0;
+            for (size_t i = 0; i < timeline.children.size(); i++) {
+                const XmlNode& entry = timeline.children[i];
+                if (entry.name != "S") {
+                    continue;
+                }
+                if (entry.attributes.count("t")) {
+                    time = std::strtoll(entry.attribute("t").c_str(), nullptr, 10);
+                }
+                int64_t duration = std::strtoll(entry.attribute("d", "0").c_str(), nullptr, 10);
+                int64_t repeat = std::strtoll(entry.attribute("r", "0").c_str(), nullptr, 10);
+                if (duration <= 0) {
+                    return false;
+                }
+                if (repeat < 0) {
+                    // Repeats up to the next entry's start, or the end of the period
+                    int64_t until = periodEnd;
+                    for (size_t j = i + 1; j < timeline.children.size(); j++) {
+                        if (timeline.children[j].name == "S" && timeline.children[j].attributes.count("t")) {
+                            until = std::strtoll(timeline.children[j].attribute("t").c_str(), nullptr, 10);
+                            break;
+                        }
+                    }
+                    repeat = until > time ? (until - time + duration - 1) / duration - 1 : 0;
+                }
+                for (int64_t r = 0; r <= repeat; r++) {
+                    if (track.segments.size() >= MAX_SEGMENTS_PER_TRACK) {
+                        return false;
+                    }
+                    addSegment(time, duration);
+                    time += duration;
+                }
+            }
+        } else {
+            int64_t duration = std::strtoll(segmentTemplate.attribute("duration", "0").c_str(), nullptr, 10);
+            if (duration <= 0 || periodEnd <= 0) {
+                return false;
+            }
+            int64_t count = (periodEnd + duration - 1) / duration;
+            if (count > static_cast<int64_t>(MAX_SEGMENTS_PER_TRACK)) {
+                return false;
+            }
+            for (int64_t i = 0; i < count; i++) {
+                addSegment(i * duration, std::min(duration, periodEnd - i * duration));
+            }
+        }
+        return !track.segments.empty();
+    }
+
+    const XmlNode* segmentList = representation.child("SegmentList");
+    if (!segmentList) {
+        segmentList = adaptationSet.child("SegmentList");
+    }
+    if (segmentList) {
+        int64_t number = std::strtoll(segmentList->attribute("startNumber", "1").c_str(), nullptr, 10);
+        int64_t timescale = std::max<int64_t>(1, std::strtoll(segmentList->attribute("timescale", "1").c_str(), nullptr, 10));
+        double duration = std::strtod(segmentList->attribute("duration", "0").c_str(), nullptr) / timescale;
+        for (const auto& node : segmentList->children) {
+            StreamSegment segment;
+            if (node.name == "Initialization") {
+                track.hasInit = true;
+                track.init.url = StreamManifestParser::resolveUrl(base, node.attribute("sourceURL"));
+                track.init.sequence = -1;
+                parseDashRange(node.attribute("range"), track.init.rangeStart, track.init.rangeEnd);
+            } else if (node.name == "SegmentURL") {
+                segment.url = StreamManifestParser::resolveUrl(base, node.attribute("media"));
+                segment.sequence = number++;
+                segment.duration = duration;
+                parseDashRange(node.attribute("mediaRange"), segment.rangeStart, segment.rangeEnd);
+                track.segments.push_back(std::move(segment));
+            }
+        }
+        return !track.segments.empty();
+    }
+
+    // SegmentBase or a lone BaseURL: the whole representation is one file
+    StreamSegment segment;
+    segment.url = base;
+    segment.sequence = 0;
+    segment.duration = periodDuration;
+    track.segments.push_back(std::move(segment));
+    return true;
+}
+
+} // anonymous namespace
+
+bool StreamManifestParser::parse(const std::string& text, const std::string& baseUrl, StreamManifest& manifest) {
+    std::string start = trim(text.substr(0, 1024));
+    // A UTF-8 byte order mark is allowed ahead of either
+    if (startsWith(start, "\xEF\xBB\xBF")) {
+        start = start.substr(3);
+    }
+    if (startsWith(start, "#EXTM3U")) {
+        return parseHls(text, baseUrl, manifest);
+    }
+    if (text.find("<MPD") != std::string::npos || text.find(":MPD") != std::string::npos) {
+        return parseDash(text, baseUrl, manifest);
+    }
+    return false;
+}
+
+bool StreamManifestParser::parseHls(const std::string& text, const std::string& baseUrl, StreamManifest& manifest) {
+    manifest = StreamManifest();
+    manifest.type = StreamManifestType::HLS;
+
+    std::istringstream stream(text);
+    std::string line;
+    bool header = false;
+    bool endList = false;
+    bool vod = false;
+    int64_t mediaSequence = 0;
+
+    StreamTrack track;
+    StreamSegment pending;
+    std::map<std::string, int64_t> rangeEnds;       // Last byte range end per URL
+
+    StreamVariant variant;
+    bool pendingVariant = false;
+    std::map<std::string, std::string> audioGroups;  // Group ID -> rendition playlist
+    std::map<std::string, std::string> variantAudio;  // Variant URL -> group ID
+
+    while (std::getline(stream, line)) {
+        line = trim(line);
+        if (startsWith(line, "\xEF\xBB\xBF")) {
+            line = line.substr(3);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (!header) {
+            if (line != "#EXTM3U") {
+                return false;
+            }
+            header = true;
+            continue;
+        }
+
+        if (line[0] != '#') {
+            std::string url = resolveUrl(baseUrl, line);
+            if (url.empty()) {
+                continue;
+            }
+            if (pendingVariant) {
+                variant.url = url;
+                manifest.variants.push_back(variant);
+                pendingVariant = false;
+            } else {
+                pending.url = url;
+                pending.sequence = mediaSequence + static_cast<int64_t>(track.segments.size());
+                if (pending.rangeStart >= 0) {
+                    rangeEnds[url] = pending.rangeEnd;
+                }
+                track.segments.push_back(pending);
+                pending = StreamSegment();
+            }
+            continue;
+        }
+
+        size_t colon = line.find(':');
+        std::string tag = line.substr(0, colon);
+        std::string value = colon == std::string::npos ? "" : line.substr(colon + 1);
+
+        if (tag == "#EXTINF") {
+            pending.duration = std::strtod(value.c_str(), nullptr);
+        } else if (tag == "#EXT-X-BYTERANGE") {
+            // Continues after the previous range of the same URL, which is only known once its URI line comes
+            int64_t previousEnd = -1;
+            if (!track.segments.empty()) {
+                auto it = rangeEnds.find(track.segments.back().url);
+                previousEnd = it != rangeEnds.end() ? it->second : -1;
+            }
+            if (!parseByteRange(value, previousEnd, pending.rangeStart, pending.rangeEnd)) {
+                return false;
+            }
+        } else if (tag == "#EXT-X-MEDIA-SEQUENCE") {
+            mediaSequence = std::strtoll(value.c_str(), nullptr, 10);
+        } else if (tag == "#EXT-X-ENDLIST") {
+            endList = true;
+        } else if (tag == "#EXT-X-PLAYLIST-TYPE") {
+            vod = value == "VOD";
+        } else if (tag == "#EXT-X-KEY") {
+            auto attributes = parseAttributes(value);
+            if (attributes["METHOD"] != "NONE") {
+                manifest.encrypted = true;
+            }
+        } else if (tag == "#EXT-X-MAP" && !track.hasInit) {
+            // Only the first map is kept, the segments are concatenated as they are
+            auto attributes = parseAttributes(value);
+            track.init.url = resolveUrl(baseUrl, attributes["URI"]);
+            track.init.sequence = -1;
+            track.hasInit = !track.init.url.empty();
+            if (attributes.count("BYTERANGE")) {
+                parseByteRange(attributes["BYTERANGE"], -1, track.init.rangeStart, track.init.rangeEnd);
+            }
+        } else if (tag == "#EXT-X-STREAM-INF") {
+            auto attributes = parseAttributes(value);
+            variant = StreamVariant();
+            variant.bandwidth = std::strtoll(attributes["BANDWIDTH"].c_str(), nullptr, 10);
+            variant.resolution = attributes["RESOLUTION"];
+            variant.codecs = attributes["CODECS"];
+            variant.audioUrl = attributes["AUDIO"];     // The group for now, resolved below
+            pendingVariant = true;
+        } else if (tag == "#EXT-X-MEDIA") {
+            auto attributes = parseAttributes(value);
+            const std::string& group = attributes["GROUP-ID"];
+            if (attributes["TYPE"] == "AUDIO" && attributes.count("URI") &&
+                (!audioGroups.count(group) || attributes["DEFAULT"] == "YES")) {
+                audioGroups[group] = resolveUrl(baseUrl, attributes["URI"]);
+            }
+        }
+    }
+
+    if (!header) {
+        return false;
+    }
+
+    if (!manifest.variants.empty()) {
+        for (auto& entry : manifest.variants) {
+            auto it = audioGroups.find(entry.audioUrl);
+            entry.audioUrl = it != audioGroups.end() ? it->second : "";
+        }
+        return true;
+    }
+
+    if (track.segments.empty()) {
+        return false;
+    }
+    track.extension = getUrlExtension(track.segments.front().url);
+    if (track.extension.empty() || track.extension.size() > 4) {
+        track.extension = track.hasInit ? "mp4" : "ts";
+    }
+    for (const auto& segment : track.segments) {
+        manifest.duration += segment.duration;
+    }
+    manifest.live = !endList && !vod;
+    manifest.tracks.push_back(std::move(track));
+    return true;
+}
+
+bool StreamManifestParser::parseDash(const std::string& text, const std::string& baseUrl, StreamManifest& manifest) {
+    manifest = StreamManifest();
+    manifest.type = StreamManifestType::DASH;
+
+    XmlNode root;
+    if (!parseXml(text, root) || root.name != "MPD") {
+        return false;
+    }
+
+    manifest.live = root.attribute("type") == "dynamic";
+    parseDuration(root.attribute("mediaPresentationDuration"), manifest.duration);
+
+    std::string mpdBase = resolveBase(baseUrl, root);
+    const XmlNode* period = root.child("Period");
+    if (!period) {
+        return false;
+    }
+    int periods = 0;
+    for (const auto& node : root.children) {
+        periods += node.name == "Period";
+    }
+    if (periods > 1) {
+        dm::utils::Logger::warning("MPD has " + std::to_string(periods) + " periods, only the first is downloaded");
+    }
+
+    double periodDuration = 0.0;
+    if (!parseDuration(period->attribute("duration"), periodDuration) && periods == 1) {
+        periodDuration = manifest.duration;
+    }
+    std::string periodBase = resolveBase(mpdBase, *period);
+
+    std::map<std::string, int> names;
+    for (const auto& adaptationSet : period->children) {
+        if (adaptationSet.name != "AdaptationSet") {
+            continue;
+        }
+        if (adaptationSet.child("ContentProtection")) {
+            manifest.encrypted = true;
+        }
+
+        const XmlNode* best = nullptr;
+        int64_t bestBandwidth = -1;
+        for (const auto& representation : adaptationSet.children) {
+            if (representation.name != "Representation") {
+                continue;
+            }
+            int64_t bandwidth = std::strtoll(representation.attribute("bandwidth", "0").c_str(), nullptr, 10);
+            if (bandwidth > bestBandwidth) {
+                best = &representation;
+                bestBandwidth = bandwidth;
+            }
+        }
+        if (!best) {
+            continue;
+        }
+        if (best->child("ContentProtection")) {
+            manifest.encrypted = true;
+        }
+
+        StreamTrack track;
+        track.bandwidth = bestBandwidth;
+        std::string base = resolveBase(resolveBase(periodBase, adaptationSet), *best);
+        if (!expandRepresentation(*period, adaptationSet, *best, base, periodDuration, track)) {
+            dm::utils::Logger::warning("Skipping adaptation set without segments to fetch in " + baseUrl);
+            continue;
+        }
+
+        std::string mimeType = best->attribute("mimeType", adaptationSet.attribute("mimeType"));
+        std::string contentType = adaptationSet.attribute("contentType", mimeType.substr(0, mimeType.find('/')));
+        if (contentType.empty()) {
+            contentType = "track";
+        }
+        int count = ++names[contentType];
+        track.name = count == 1 ? contentType : contentType + std::to_string(count);
+        track.extension = getMimeExtension(mimeType);
+        if (track.extension.empty()) {
+            track.extension = getUrlExtension(track.segments.front().url);
+        }
+        manifest.tracks.push_back(std::move(track));
+    }
+
+    // The video track first, it takes the output name as given
+    std::stable_sort(manifest.tracks.begin(), manifest.tracks.end(),
+                     [](const StreamTrack& a, const StreamTrack& b) {
+                         return (a.name == "video") > (b.name == "video");
+                     });
+    return !manifest.tracks.empty();
+}
+
+int StreamManifestParser::selectVariant(const StreamManifest& manifest, int64_t maxBandwidth) {
+    int best = -1;
+    int lowest = -1;
+    for (size_t i = 0; i < manifest.variants.size(); i++) {
+        int64_t bandwidth = manifest.variants[i].bandwidth;
+        if ((maxBandwidth <= 0 || bandwidth <= maxBandwidth) &&
+            (best < 0 || bandwidth > manifest.variants[best].bandwidth)) {
+            best = static_cast<int>(i);
+        }
+        if (lowest < 0 || bandwidth < manifest.variants[lowest].bandwidth) {
+            lowest = static_cast<int>(i);
+        }
+    }
+    // Nothing fits under the cap, the smallest comes closest
+    return best >= 0 ? best : lowest;
+}
+
+bool StreamManifestParser::isManifestUrl(const std::string& url) {
+    std::string extension = getUrlExtension(url);
+    return extension == "m3u8" || extension == "mpd";
+}
+
+std::string StreamManifestParser::resolveUrl(const std::string& baseUrl, const std::string& link) {
+    if (link.empty()) {
+        return baseUrl;
+    }
+    return dm::utils::UrlParser::resolve(baseUrl, link);
+}
+
+bool StreamManifestParser::parseDuration(const std::string& text, double& seconds) {
+    if (text.size() < 2 || text[0] != 'P') {
+        return false;
+    }
+
+    double total = 0.0;
+    bool time = false;
+    bool any = false;
+    const char* pos = text.c_str() + 1;
+    while (*pos) {
+        if (*pos == 'T') {
+            time = true;
+            pos++;
+            continue;
+        }
+        char* end = nullptr;
+        double value = std::strtod(pos, &end);
+        if (end == pos || !*end) {
+            return false;
+        }
+        switch (*end) {
+            case 'Y': total += value * 365 * 86400; break;
+            case 'M': total += time ? value * 60 : value * 30 * 86400; break;
+            case 'W': total += value * 7 * 86400; break;
+            case 'D': total += value * 86400; break;
+            case 'H': total += value * 3600; break;
+            case 'S': total += value; break;
+            default: return false;
+        }
+        any = true;
+        pos = end + 1;
+    }
+    if (any) {
+        seconds = total;
+    }
+    return any;
+}
+
+} // namespace core
+} // namespace dm
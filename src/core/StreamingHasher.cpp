@@ -0,0 +1,211 @@
+#include "core/StreamingHasher.h"
+#include "core/OutputFile.h"
+#include "core/EngineMetrics.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace dm {
+namespace core {
+
+StreamingHasher::StreamingHasher(dm::utils::HashAlgorithm algorithm)
+    : hash_(algorithm) {
+}
+
+StreamingHasher::~StreamingHasher() {
+    joinReadBack();
+}
+
+void StreamingHasher::onWrite(OutputFile& file, const char* data, size_t size, int64_t offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (failed_ || !digest_.empty()) {
+        return;
+    }
+
+    int64_t end = offset + static_cast<int64_t>(size);
+    if (end <= frontier_) {
+        // Rewrite of data already hashed (segment retry)
+        return;
+    }
+
+    if (offset <= frontier_ && !readingBack_) {
+        // Hash straight from the caller's buffer
+        int64_t skip = frontier_ - offset;
+        update(data + skip, static_cast<size_t>(end - frontier_));
+        frontier_ = end;
+
+        // Data written ahead is read back off the write path
+        if (reachedWritten() && !stopRequested_) {
+            if (readBackThread_.joinable()) {
+                readBackThread_.join();
+            }
+            readingBack_ = true;
+            OutputFile* target = &file;
+            readBackThread_ = std::thread([this, target]() { runReadBack(target); });
+        }
+        return;
+    }
+
+    // Ahead of the frontier or behind the read-back, merge with neighbouring ranges
+    auto next = written_.lower_bound(offset);
+    if (next != written_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->second >= offset) {
+            offset = prev->first;
+            end = std::max(end, prev->second);
+            next = written_.erase(prev);
+        }
+    }
+    while (next != written_.end() && next->first <= end) {
+        end = std::max(end, next->second);
+        next = written_.erase(next);
+    }
+    written_[offset] = end;
+}
+
+bool StreamingHasher::finish(OutputFile& file, int64_t totalSize) {
+    joinReadBack();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopRequested_ = false;
+
+    if (!digest_.empty()) {
+        return true;
+    }
+
+    if (!failed_ && totalSize > frontier_) {
+        readBack(file, totalSize);
+    }
+    if (failed_) {
+        return false;
+    }
+
+    written_.clear();
+    std::vector<char>().swap(readBuffer_);
+    digest_ = hash_.finish();
+
+    if (readBackBytes_ > 0) {
+        dm::utils::Logger::debug("Streaming hash of " + file.getPath() + " read back " +
+                                 std::to_string(readBackBytes_) + " bytes");
+    }
+
+    return true;
+}
+
+void StreamingHasher::stopReadBack() {
+    joinReadBack();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopRequested_ = false;
+}
+
+void StreamingHasher::restart() {
+    joinReadBack();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopRequested_ = false;
+
+    hash_.reset();
+    frontier_ = 0;
+    written_.clear();
+    failed_ = false;
+    digest_.clear();
+}
+
+std::string StreamingHasher::getDigest() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return digest_;
+}
+
+dm::utils::HashAlgorithm StreamingHasher::getAlgorithm() const {
+    return hash_.getAlgorithm();
+}
+
+int64_t StreamingHasher::getReadBackBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return readBackBytes_;
+}
+
+bool StreamingHasher::readBack(OutputFile& file, int64_t end) {
+    readBuffer_.resize(READ_BACK_CHUNK_SIZE);
+
+    while (frontier_ < end) {
+        size_t chunk = static_cast<size_t>(std::min<int64_t>(end - frontier_, READ_BACK_CHUNK_SIZE));
+        if (!file.readAt(readBuffer_.data(), chunk, frontier_)) {
+            dm::utils::Logger::error("Streaming hash failed to read back " + file.getPath());
+            failed_ = true;
+            written_.clear();
+            return false;
+        }
+
+        update(readBuffer_.data(), chunk);
+        frontier_ += static_cast<int64_t>(chunk);
+        readBackBytes_ += static_cast<int64_t>(chunk);
+    }
+
+    return true;
+}
+
+void StreamingHasher::joinReadBack() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopRequested_ = true;
+        thread = std::move(readBackThread_);
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool StreamingHasher::reachedWritten() {
+    while (!written_.empty() && written_.begin()->second <= frontier_) {
+        written_.erase(written_.begin());
+    }
+    return !written_.empty() && written_.begin()->first <= frontier_;
+}
+
+void StreamingHasher::runReadBack(OutputFile* file) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    readBuffer_.resize(READ_BACK_CHUNK_SIZE);
+
+    while (!stopRequested_ && !failed_ && reachedWritten()) {
+        int64_t offset = frontier_;
+        size_t chunk = static_cast<size_t>(
+            std::min<int64_t>(written_.begin()->second - offset, READ_BACK_CHUNK_SIZE));
+
+        // Writers only record ranges meanwhile, the hash is this thread's
+        lock.unlock();
+        bool read = file->readAt(readBuffer_.data(), chunk, offset);
+        if (read) {
+            update(readBuffer_.data(), chunk);
+        }
+        lock.lock();
+
+        if (!read) {
+            dm::utils::Logger::error("Streaming hash failed to read back " + file->getPath());
+            failed_ = true;
+            written_.clear();
+            break;
+        }
+        frontier_ += static_cast<int64_t>(chunk);
+        readBackBytes_ += static_cast<int64_t>(chunk);
+    }
+
+    readingBack_ = false;
+}
+
+void StreamingHasher::update(const char* data, size_t size) {
+    EngineMetrics& metrics = EngineMetrics::getInstance();
+    if (!metrics.isEnabled()) {
+        hash_.update(data, size);
+        return;
+    }
+
+    int64_t started = EngineMetrics::nowNanoseconds();
+    hash_.update(data, size);
+    metrics.count(EventMetric::HASHED_BYTES, static_cast<int64_t>(size));
+    metrics.count(EventMetric::HASH_NANOSECONDS, EngineMetrics::nowNanoseconds() - started);
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,669 @@
+#include "core/TaskJournal.h"
+#include "utils/HashCalculator.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const char JOURNAL_MAGIC[4] = {'D', 'M', 'J', '1'};
+const size_t RECORD_HEADER_SIZE = 9;    // Payload size, checksum, type
+
+// Records are little-endian whatever the host
+void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void putI64(std::string& out, int64_t value) {
+    uint64_t bits = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+void putString(std::string& out, const std::string& value) {
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+void putRanges(std::string& out, const std::vector<SegmentRange>& ranges) {
+    putU32(out, static_cast<uint32_t>(ranges.size()));
+    for (const auto& range : ranges) {
+        putI64(out, range.startByte);
+        putI64(out, range.endByte);
+    }
+}
+
+uint32_t getU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+// Bounds-checked reader over one record payload
+struct PayloadReader {
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+
+    bool readU8(uint8_t& value) {
+        if (size - pos < 1) {
+            return false;
+        }
+        value = static_cast<uint8_t>(data[pos++]);
+        return true;
+    }
+
+    bool readU32(uint32_t& value) {
+        if (size - pos < 4) {
+            return false;
+        }
+        value = getU32(data + pos);
+        pos += 4;
+        return true;
+    }
+
+    bool readI64(int64_t& value) {
+        if (size - pos < 8) {
+            return false;
+        }
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++) {
+            bits |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos + i])) << (8 * i);
+        }
+        value = static_cast<int64_t>(bits);
+        pos += 8;
+        return true;
+    }
+
+    bool readString(std::string& value) {
+        uint32_t length = 0;
+        if (!readU32(length) || size - pos < length) {
+            return false;
+        }
+        value.assign(data + pos, length);
+        pos += length;
+        return true;
+    }
+
+    bool readRanges(std::vector<SegmentRange>& ranges) {
+        uint32_t count = 0;
+        if (!readU32(count) || (size - pos) / 16 < count) {
+            return false;
+        }
+        ranges.resize(count);
+        for (auto& range : ranges) {
+            readI64(range.startByte);
+            readI64(range.endByte);
+        }
+        return true;
+    }
+
+    bool done() const {
+        return pos == size;
+    }
+};
+
+bool sameRanges(const std::vector<SegmentRange>& a, const std::vector<SegmentRange>& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](const SegmentRange& x, const SegmentRange& y) {
+               return x.startByte == y.startByte && x.endByte == y.endByte;
+           });
+}
+
+} // namespace
+
+TaskJournal::TaskJournal(const std::string& path)
+    : path_(path) {
+}
+
+TaskJournal::~TaskJournal() {
+    close();
+}
+
+bool TaskJournal::open(std::vector<JournalEntry>& entries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (fd_ >= 0) {
+        return false;
+    }
+
+    live_.clear();
+    recordCount_ = 0;
+
+    std::string data;
+    {
+        std::ifstream file(path_, std::ios::binary);
+        if (file) {
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+    }
+
+    bool fresh = data.size() < sizeof(JOURNAL_MAGIC) ||
+                 std::memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0;
+    if (fresh && !data.empty()) {
+        dm::utils::Logger::warning("Task journal " + path_ + " has no valid header, starting a new one");
+    }
+
+    if (!fresh) {
+        // Replay up to the first torn or corrupt record
+        size_t pos = sizeof(JOURNAL_MAGIC);
+        while (data.size() - pos >= RECORD_HEADER_SIZE) {
+            uint32_t payloadSize = getU32(data.data() + pos);
+            uint32_t checksum = getU32(data.data() + pos + 4);
+            if (payloadSize > MAX_RECORD_SIZE || data.size() - pos - RECORD_HEADER_SIZE < payloadSize) {
+                break;
+            }
+
+            const char* body = data.data() + pos + 8;
+            if (dm::utils::HashCalculator::crc32(body, payloadSize + 1) != checksum ||
+                !apply(static_cast<uint8_t>(body[0]), body + 1, payloadSize)) {
+                break;
+            }
+
+            pos += RECORD_HEADER_SIZE + payloadSize;
+            recordCount_++;
+        }
+
+        fileBytes_ = pos;
+        if (pos < data.size()) {
+            dm::utils::Logger::warning("Task journal " + path_ + " has a damaged tail, dropping " +
+                                       std::to_string(data.size() - pos) + " bytes");
+            std::error_code error;
+            std::filesystem::resize_file(path_, pos, error);
+            if (error) {
+                dm::utils::Logger::error("Failed to truncate task journal " + path_ + ": " + error.message());
+                return false;
+            }
+        }
+    }
+
+    fd_ = openFile(path_, fresh);
+    if (fd_ < 0) {
+        dm::utils::Logger::error("Failed to open task journal " + path_ + ": " + std::strerror(errno));
+        return false;
+    }
+
+    if (fresh) {
+        if (!writeAll(fd_, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC))) {
+            dm::utils::Logger::error("Failed to write task journal " + path_);
+            closeFile();
+            return false;
+        }
+        fileBytes_ = sizeof(JOURNAL_MAGIC);
+    }
+
+    entries.clear();
+    entries.reserve(live_.size());
+    for (const auto& pair : live_) {
+        entries.push_back(pair.second);
+    }
+
+    return true;
+}
+
+void TaskJournal::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (fd_ >= 0) {
+        writePending();
+        syncFile(fd_);
+        closeFile();
+    }
+}
+
+bool TaskJournal::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0;
+}
+
+bool TaskJournal::recordAdd(const JournalEntry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!append(RecordType::ADD, encodeAdd(entry))) {
+        return false;
+    }
+
+    std::string pieces = encodePieces(entry.id, entry.pieces, PieceMap());
+    return pieces.empty() || append(RecordType::PIECES, pieces);
+}
+
+bool TaskJournal::recordStatus(const std::string& id, DownloadStatus status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = live_.find(id);
+    if (it == live_.end() || it->second.status == status) {
+        return true;
+    }
+
+    std::string payload;
+    putString(payload, id);
+    payload.push_back(static_cast<char>(status));
+
+    return append(RecordType::STATUS, payload);
+}
+
+bool TaskJournal::recordProgress(const std::string& id, int64_t fileSize, bool supportsResume,
+                                 const std::vector<SegmentRange>& ranges) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = live_.find(id);
+    if (it == live_.end() ||
+        (it->second.fileSize == fileSize && it->second.supportsResume == supportsResume &&
+         sameRanges(it->second.ranges, ranges))) {
+        return true;
+    }
+
+    std::string payload;
+    putString(payload, id);
+    putI64(payload, fileSize);
+    payload.push_back(supportsResume ? 1 : 0);
+    putRanges(payload, ranges);
+
+    return append(RecordType::PROGRESS, payload);
+}
+
+bool TaskJournal::recordPieces(const std::string& id, const PieceMap& pieces) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = live_.find(id);
+    if (it == live_.end()) {
+        return true;
+    }
+
+    std::string payload = encodePieces(id, pieces, it->second.pieces);
+    return payload.empty() || append(RecordType::PIECES, payload);
+}
+
+bool TaskJournal::recordRemove(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (live_.find(id) == live_.end()) {
+        return true;
+    }
+
+    std::string payload;
+    putString(payload, id);
+
+    return append(RecordType::REMOVE, payload);
+}
+
+void TaskJournal::beginBatch() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batchDepth_++;
+}
+
+bool TaskJournal::endBatch() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (batchDepth_ == 0 || --batchDepth_ > 0) {
+        return true;
+    }
+
+    bool written = writePending();
+    if (recordCount_ > std::max(MIN_COMPACT_RECORDS, COMPACT_RATIO * live_.size())) {
+        compactLocked();
+    }
+    return written;
+}
+
+bool TaskJournal::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compactLocked();
+}
+
+bool TaskJournal::sync() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0 && writePending() && syncFile(fd_);
+}
+
+const std::string& TaskJournal::getPath() const {
+    return path_;
+}
+
+bool TaskJournal::apply(uint8_t type, const char* payload, size_t size) {
+    PayloadReader reader{payload, size};
+    std::string id;
+    if (!reader.readString(id)) {
+        return false;
+    }
+
+    uint8_t value = 0;
+    switch (static_cast<RecordType>(type)) {
+        case RecordType::ADD: {
+            JournalEntry entry;
+            entry.id = id;
+            uint8_t priority = 0;
+            uint8_t supportsResume = 0;
+            if (!reader.readString(entry.url) || !reader.readString(entry.destinationPath) ||
+                !reader.readString(entry.filename) || !reader.readU8(value) || !reader.readU8(priority) ||
+                !reader.readI64(entry.fileSize) || !reader.readU8(supportsResume) ||
+                !reader.readRanges(entry.ranges) || !reader.done()) {
+                return false;
+            }
+            entry.status = static_cast<DownloadStatus>(value);
+            entry.priority = static_cast<DownloadPriority>(priority);
+            entry.supportsResume = supportsResume != 0;
+            if (entry.status == DownloadStatus::COMPLETED) {
+                live_.erase(id);
+            } else {
+                live_[id] = std::move(entry);
+            }
+            return true;
+        }
+
+        case RecordType::STATUS: {
+            if (!reader.readU8(value) || !reader.done()) {
+                return false;
+            }
+            auto it = live_.find(id);
+            if (it != live_.end()) {
+                it->second.status = static_cast<DownloadStatus>(value);
+                if (it->second.status == DownloadStatus::COMPLETED) {
+                    live_.erase(it);
+                }
+            }
+            return true;
+        }
+
+        case RecordType::PROGRESS: {
+            int64_t fileSize = 0;
+            std::vector<SegmentRange> ranges;
+            if (!reader.readI64(fileSize) || !reader.readU8(value) || !reader.readRanges(ranges) || !reader.done()) {
+                return false;
+            }
+            auto it = live_.find(id);
+            if (it != live_.end()) {
+                it->second.fileSize = fileSize;
+                it->second.supportsResume = value != 0;
+                it->second.ranges = std::move(ranges);
+            }
+            return true;
+        }
+
+        case RecordType::PIECES: {
+            PieceMap pieces;
+            uint8_t published = 0;
+            uint32_t total = 0;
+            uint32_t count = 0;
+            if (!reader.readU8(value) || !reader.readI64(pieces.pieceSize) || !reader.readU8(published) ||
+                !reader.readU32(total) || !reader.readU32(count) || (size - reader.pos) / 8 < count) {
+                return false;
+            }
+            pieces.algorithm = static_cast<dm::utils::HashAlgorithm>(value);
+            pieces.published = published != 0;
+
+            auto it = live_.find(id);
+            PieceMap ignored;
+            PieceMap& target = it != live_.end() ? it->second.pieces : ignored;
+            if (target.algorithm != pieces.algorithm || target.pieceSize != pieces.pieceSize ||
+                target.published != pieces.published || target.hashes.size() != total) {
+                pieces.hashes.resize(total);
+                target = std::move(pieces);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t index = 0;
+                std::string hash;
+                if (!reader.readU32(index) || index >= total || !reader.readString(hash)) {
+                    return false;
+                }
+                target.hashes[index] = std::move(hash);
+            }
+            return reader.done();
+        }
+
+        case RecordType::REMOVE:
+            if (!reader.done()) {
+                return false;
+            }
+            live_.erase(id);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool TaskJournal::append(RecordType type, const std::string& payload) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    // Inside a batch the record is applied now and written at its end
+    if (batchDepth_ > 0) {
+        frame(type, payload, pendingRecords_);
+        apply(static_cast<uint8_t>(type), payload.data(), payload.size());
+        recordCount_++;
+        return true;
+    }
+
+    std::string record;
+    frame(type, payload, record);
+
+    if (!writeAll(fd_, record.data(), record.size())) {
+        dm::utils::Logger::error("Failed to append to task journal " + path_ + ": " + std::strerror(errno));
+        // A partial record would hide every record appended after it
+        std::error_code error;
+        std::filesystem::resize_file(path_, fileBytes_, error);
+        return false;
+    }
+    fileBytes_ += record.size();
+
+    apply(static_cast<uint8_t>(type), payload.data(), payload.size());
+    recordCount_++;
+
+    // Most records are stale once the same tasks have checkpointed many times
+    if (recordCount_ > std::max(MIN_COMPACT_RECORDS, COMPACT_RATIO * live_.size())) {
+        compactLocked();
+    }
+
+    return true;
+}
+
+bool TaskJournal::writePending() {
+    if (pendingRecords_.empty()) {
+        return true;
+    }
+    if (fd_ < 0) {
+        return false;
+    }
+
+    bool written = writeAll(fd_, pendingRecords_.data(), pendingRecords_.size());
+    if (!written) {
+        dm::utils::Logger::error("Failed to append to task journal " + path_ + ": " + std::strerror(errno));
+        std::error_code error;
+        std::filesystem::resize_file(path_, fileBytes_, error);
+        // The records are applied already, a rewrite of the live state saves them
+        return compactLocked();
+    }
+
+    fileBytes_ += pendingRecords_.size();
+    pendingRecords_.clear();
+    return true;
+}
+
+bool TaskJournal::compactLocked() {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    std::string data(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    size_t records = 0;
+    for (const auto& pair : live_) {
+        frame(RecordType::ADD, encodeAdd(pair.second), data);
+        std::string pieces = encodePieces(pair.first, pair.second.pieces, PieceMap());
+        if (!pieces.empty()) {
+            frame(RecordType::PIECES, pieces, data);
+            records++;
+        }
+        records++;
+    }
+
+    // Write the new journal beside the old one, then swap it in
+    std::string tempPath = path_ + ".tmp";
+    int tempFd = openFile(tempPath, true);
+    bool written = tempFd >= 0 && writeAll(tempFd, data.data(), data.size()) && syncFile(tempFd);
+    if (tempFd >= 0) {
+#ifdef _WIN32
+        _close(tempFd);
+#else
+        ::close(tempFd);
+#endif
+    }
+
+    std::error_code error;
+    if (!written) {
+        dm::utils::Logger::error("Failed to write compacted task journal " + tempPath);
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    // Windows cannot replace a file that is still open
+    closeFile();
+
+    std::filesystem::rename(tempPath, path_, error);
+    if (error) {
+        dm::utils::Logger::error("Failed to replace task journal " + path_ + ": " + error.message());
+        std::error_code ignored;
+        std::filesystem::remove(tempPath, ignored);
+    } else {
+        recordCount_ = records;
+        fileBytes_ = data.size();
+        pendingRecords_.clear();
+    }
+
+    fd_ = openFile(path_, false);
+    if (fd_ < 0) {
+        dm::utils::Logger::error("Failed to reopen task journal " + path_ + ": " + std::strerror(errno));
+        return false;
+    }
+
+    return !error;
+}
+
+std::string TaskJournal::encodeAdd(const JournalEntry& entry) {
+    std::string payload;
+    putString(payload, entry.id);
+    putString(payload, entry.url);
+    putString(payload, entry.destinationPath);
+    putString(payload, entry.filename);
+    payload.push_back(static_cast<char>(entry.status));
+    payload.push_back(static_cast<char>(entry.priority));
+    putI64(payload, entry.fileSize);
+    payload.push_back(entry.supportsResume ? 1 : 0);
+    putRanges(payload, entry.ranges);
+    return payload;
+}
+
+std::string TaskJournal::encodePieces(const std::string& id, const PieceMap& pieces, const PieceMap& previous) {
+    // A map of another layout replaces the recorded one, hashes and all
+    bool sameLayout = pieces.algorithm == previous.algorithm && pieces.pieceSize == previous.pieceSize &&
+                      pieces.published == previous.published && pieces.hashes.size() == previous.hashes.size();
+    if (sameLayout && pieces.hashes == previous.hashes) {
+        return std::string();
+    }
+
+    std::vector<uint32_t> changed;
+    for (size_t i = 0; i < pieces.hashes.size(); i++) {
+        if (sameLayout ? pieces.hashes[i] != previous.hashes[i] : !pieces.hashes[i].empty()) {
+            changed.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    std::string payload;
+    putString(payload, id);
+    payload.push_back(static_cast<char>(pieces.algorithm));
+    putI64(payload, pieces.pieceSize);
+    payload.push_back(pieces.published ? 1 : 0);
+    putU32(payload, static_cast<uint32_t>(pieces.hashes.size()));
+    putU32(payload, static_cast<uint32_t>(changed.size()));
+    for (uint32_t index : changed) {
+        putU32(payload, index);
+        putString(payload, pieces.hashes[index]);
+    }
+    return payload;
+}
+
+void TaskJournal::frame(RecordType type, const std::string& payload, std::string& out) {
+    size_t start = out.size();
+    putU32(out, static_cast<uint32_t>(payload.size()));
+    putU32(out, 0);
+    out.push_back(static_cast<char>(type));
+    out += payload;
+
+    // The checksum covers the type and the payload
+    uint32_t checksum = dm::utils::HashCalculator::crc32(out.data() + start + 8, payload.size() + 1);
+    for (int i = 0; i < 4; i++) {
+        out[start + 4 + i] = static_cast<char>((checksum >> (8 * i)) & 0xFF);
+    }
+}
+
+void TaskJournal::closeFile() {
+    if (fd_ < 0) {
+        return;
+    }
+
+#ifdef _WIN32
+    _close(fd_);
+#else
+    ::close(fd_);
+#endif
+    fd_ = -1;
+}
+
+bool TaskJournal::writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int written = _write(fd, data, static_cast<unsigned int>(size));
+#else
+        ssize_t written = ::write(fd, data, size);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+int TaskJournal::openFile(const std::string& path, bool truncate) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (truncate ? _O_TRUNC : 0),
+                 _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+#endif
+}
+
+bool TaskJournal::syncFile(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+} // namespace core
+} // namespace dm
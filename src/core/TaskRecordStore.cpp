@@ -0,0 +1,339 @@
+#include "core/TaskRecordStore.h"
+
+#include <cstring>
+#include <limits>
+
+namespace dm {
+namespace core {
+
+TaskRecordStore::TaskRecordStore() {
+}
+
+bool TaskRecordStore::add(const JournalEntry& entry) {
+    uint64_t id;
+    if (!packId(entry.id, id) || slots_.find(id) != slots_.end()) {
+        return false;
+    }
+
+    // Offsets are 32 bits, drop dead strings before giving up on a full arena
+    size_t needed = entry.url.size() + entry.destinationPath.size() + entry.filename.size() + 3;
+    if (strings_.size() + needed > std::numeric_limits<uint32_t>::max()) {
+        compactStrings();
+        if (strings_.size() + needed > std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+    }
+
+    Record record;
+    record.id = id;
+    record.fileSize = entry.fileSize;
+    record.url = appendString(entry.url);
+    record.destination = internDirectory(entry.destinationPath);
+    record.filename = appendString(entry.filename);
+    record.status = static_cast<uint8_t>(entry.status);
+    record.priority = static_cast<uint8_t>(entry.priority);
+    record.flags = FLAG_USED;
+    if (entry.supportsResume) {
+        record.flags |= FLAG_SUPPORTS_RESUME;
+    }
+
+    uint32_t slot;
+    if (!freeSlots_.empty()) {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        records_[slot] = record;
+    } else {
+        slot = static_cast<uint32_t>(records_.size());
+        records_.push_back(record);
+    }
+    slots_[id] = slot;
+
+    // Most downloads have no partial file, their ranges are not kept at all
+    if (!entry.ranges.empty()) {
+        records_[slot].flags |= FLAG_HAS_RANGES;
+        ranges_[slot] = entry.ranges;
+    }
+    if (!entry.pieces.empty()) {
+        records_[slot].flags |= FLAG_HAS_PIECES;
+        pieces_[slot] = entry.pieces;
+    }
+
+    if (entry.status == DownloadStatus::QUEUED) {
+        queued_.push(slot, entry.priority);
+    }
+    return true;
+}
+
+bool TaskRecordStore::contains(const std::string& id) const {
+    uint32_t slot;
+    return find(id, slot);
+}
+
+bool TaskRecordStore::get(const std::string& id, JournalEntry& entry) const {
+    uint32_t slot;
+    if (!find(id, slot)) {
+        return false;
+    }
+    entry = unpack(slot);
+    return true;
+}
+
+bool TaskRecordStore::take(const std::string& id, JournalEntry& entry) {
+    uint32_t slot;
+    if (!find(id, slot)) {
+        return false;
+    }
+    entry = unpack(slot);
+    release(slot);
+    return true;
+}
+
+bool TaskRecordStore::takeNextQueued(JournalEntry& entry) {
+    if (queued_.empty()) {
+        return false;
+    }
+    uint32_t slot = queued_.pop();
+    entry = unpack(slot);
+    release(slot);
+    return true;
+}
+
+std::vector<JournalEntry> TaskRecordStore::peekQueued(size_t count) const {
+    std::vector<JournalEntry> entries;
+    for (uint32_t slot : queued_.peek(count)) {
+        entries.push_back(unpack(slot));
+    }
+    return entries;
+}
+
+bool TaskRecordStore::setStatus(const std::string& id, DownloadStatus status) {
+    uint32_t slot;
+    if (!find(id, slot)) {
+        return false;
+    }
+
+    Record& record = records_[slot];
+    record.status = static_cast<uint8_t>(status);
+    if (status == DownloadStatus::QUEUED) {
+        queued_.push(slot, static_cast<DownloadPriority>(record.priority));
+    } else {
+        queued_.remove(slot);
+    }
+    return true;
+}
+
+void TaskRecordStore::setStatusWhere(DownloadStatus from, DownloadStatus to, std::vector<std::string>* changed) {
+    if (from == to) {
+        return;
+    }
+
+    for (uint32_t slot = 0; slot < records_.size(); slot++) {
+        Record& record = records_[slot];
+        if (!(record.flags & FLAG_USED) || record.status != static_cast<uint8_t>(from)) {
+            continue;
+        }
+
+        record.status = static_cast<uint8_t>(to);
+        if (to == DownloadStatus::QUEUED) {
+            queued_.push(slot, static_cast<DownloadPriority>(record.priority));
+        } else {
+            queued_.remove(slot);
+        }
+        if (changed) {
+            changed->push_back(unpackId(record.id));
+        }
+    }
+}
+
+bool TaskRecordStore::setPriority(const std::string& id, DownloadPriority priority) {
+    uint32_t slot;
+    if (!find(id, slot)) {
+        return false;
+    }
+    records_[slot].priority = static_cast<uint8_t>(priority);
+    queued_.update(slot, priority);
+    return true;
+}
+
+std::vector<JournalEntry> TaskRecordStore::list(size_t offset, size_t count) const {
+    std::vector<JournalEntry> entries;
+    for (uint32_t slot = 0; slot < records_.size() && entries.size() < count; slot++) {
+        if (!(records_[slot].flags & FLAG_USED)) {
+            continue;
+        }
+        if (offset > 0) {
+            offset--;
+            continue;
+        }
+        entries.push_back(unpack(slot));
+    }
+    return entries;
+}
+
+size_t TaskRecordStore::size() const {
+    return slots_.size();
+}
+
+size_t TaskRecordStore::queuedCount() const {
+    return queued_.size();
+}
+
+size_t TaskRecordStore::memoryUsage() const {
+    // Hash nodes are counted at their payload plus a pointer
+    size_t bytes = records_.capacity() * sizeof(Record) +
+                   freeSlots_.capacity() * sizeof(uint32_t) +
+                   strings_.capacity() +
+                   slots_.size() * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(void*)) +
+                   slots_.bucket_count() * sizeof(void*);
+    for (const auto& directory : directories_) {
+        bytes += directory.first.capacity() + sizeof(directory) + sizeof(void*);
+    }
+    for (const auto& ranges : ranges_) {
+        bytes += ranges.second.capacity() * sizeof(SegmentRange) + sizeof(ranges) + sizeof(void*);
+    }
+    for (const auto& pieces : pieces_) {
+        bytes += sizeof(pieces) + sizeof(void*) + pieces.second.hashes.capacity() * sizeof(std::string);
+        for (const auto& hash : pieces.second.hashes) {
+            bytes += hash.capacity();
+        }
+    }
+    return bytes;
+}
+
+void TaskRecordStore::clear() {
+    records_.clear();
+    freeSlots_.clear();
+    slots_.clear();
+    strings_.clear();
+    wastedBytes_ = 0;
+    directories_.clear();
+    ranges_.clear();
+    pieces_.clear();
+    queued_.clear();
+}
+
+bool TaskRecordStore::canStore(const std::string& id) {
+    uint64_t value;
+    return packId(id, value);
+}
+
+bool TaskRecordStore::find(const std::string& id, uint32_t& slot) const {
+    uint64_t value;
+    if (!packId(id, value)) {
+        return false;
+    }
+    auto it = slots_.find(value);
+    if (it == slots_.end()) {
+        return false;
+    }
+    slot = it->second;
+    return true;
+}
+
+JournalEntry TaskRecordStore::unpack(uint32_t slot) const {
+    const Record& record = records_[slot];
+
+    JournalEntry entry;
+    entry.id = unpackId(record.id);
+    entry.url = &strings_[record.url];
+    entry.destinationPath = &strings_[record.destination];
+    entry.filename = &strings_[record.filename];
+    entry.status = static_cast<DownloadStatus>(record.status);
+    entry.priority = static_cast<DownloadPriority>(record.priority);
+    entry.fileSize = record.fileSize;
+    entry.supportsResume = (record.flags & FLAG_SUPPORTS_RESUME) != 0;
+    if (record.flags & FLAG_HAS_RANGES) {
+        entry.ranges = ranges_.at(slot);
+    }
+    if (record.flags & FLAG_HAS_PIECES) {
+        entry.pieces = pieces_.at(slot);
+    }
+    return entry;
+}
+
+void TaskRecordStore::release(uint32_t slot) {
+    Record& record = records_[slot];
+
+    // Directories stay interned until the next compaction
+    wastedBytes_ += std::strlen(&strings_[record.url]) + std::strlen(&strings_[record.filename]) + 2;
+
+    queued_.remove(slot);
+    ranges_.erase(slot);
+    pieces_.erase(slot);
+    slots_.erase(record.id);
+    record = Record();
+    freeSlots_.push_back(slot);
+
+    if (slots_.empty()) {
+        clear();
+    } else if (wastedBytes_ >= MIN_COMPACT_BYTES && wastedBytes_ * 2 >= strings_.size()) {
+        compactStrings();
+    }
+}
+
+uint32_t TaskRecordStore::appendString(const std::string& text) {
+    uint32_t offset = static_cast<uint32_t>(strings_.size());
+    strings_.insert(strings_.end(), text.begin(), text.end());
+    strings_.push_back('\0');
+    return offset;
+}
+
+uint32_t TaskRecordStore::internDirectory(const std::string& directory) {
+    auto it = directories_.find(directory);
+    if (it != directories_.end()) {
+        return it->second;
+    }
+    uint32_t offset = appendString(directory);
+    directories_[directory] = offset;
+    return offset;
+}
+
+void TaskRecordStore::compactStrings() {
+    std::vector<char> old;
+    old.swap(strings_);
+    directories_.clear();
+    wastedBytes_ = 0;
+
+    for (auto& record : records_) {
+        if (!(record.flags & FLAG_USED)) {
+            continue;
+        }
+        record.url = appendString(&old[record.url]);
+        record.destination = internDirectory(&old[record.destination]);
+        record.filename = appendString(&old[record.filename]);
+    }
+    strings_.shrink_to_fit();
+}
+
+bool TaskRecordStore::packId(const std::string& id, uint64_t& value) {
+    if (id.size() != 16) {
+        return false;
+    }
+
+    value = 0;
+    for (char c : id) {
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit);
+    }
+    return true;
+}
+
+std::string TaskRecordStore::unpackId(uint64_t value) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string id(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        id[i] = DIGITS[value & 0xF];
+        value >>= 4;
+    }
+    return id;
+}
+
+} // namespace core
+} // namespace dm
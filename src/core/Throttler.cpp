@@ -1,5 +1,7 @@
 #include "core/Throttler.h"
+#include "core/EngineMetrics.h"
 #include "utils/Logger.h"
+#include "utils/Tracer.h"
 
 #include <thread>
 #include <sstream>
@@ -9,10 +11,11 @@ namespace dm {
 namespace core {
 
 Throttler::Throttler(int64_t bytesPerSecond, int64_t burstSize)
-    : maxBandwidth_(bytesPerSecond), burstSize_(burstSize), tokens_(0), enabled_(bytesPerSecond > 0) {
+    : maxBandwidth_(bytesPerSecond), burstSize_(burstSize), tokens_(0), enabled_(bytesPerSecond > 0),
+      lastFillTime_(0), activeConsumers_(0) {
     
     // Initialize the token bucket
-    lastFillTime_ = std::chrono::steady_clock::now();
+    lastFillTime_ = nowNanoseconds();
     tokens_ = getMaxTokens();
     
     // Log throttler creation
@@ -28,7 +31,8 @@ Throttler::~Throttler() {
 }
 
 void Throttler::setMaxBandwidth(int64_t bytesPerSecond) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // Refill at the old rate before switching
+    fillBucket();
     
     // Set max bandwidth
     maxBandwidth_ = bytesPerSecond;
@@ -36,11 +40,17 @@ void Throttler::setMaxBandwidth(int64_t bytesPerSecond) {
     // Enable/disable throttling
     enabled_ = bytesPerSecond > 0;
     
-    // Refill bucket
-    fillBucket();
+    // Clamp the bucket to the new capacity
+    int64_t maxTokens = getMaxTokens();
+    int64_t current = tokens_.load();
+    while (current > maxTokens && !tokens_.compare_exchange_weak(current, maxTokens)) {
+    }
     
     // Wake up all waiting threads
-    cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_all();
+    }
     
     // Log bandwidth change
     std::ostringstream log;
@@ -53,7 +63,6 @@ int64_t Throttler::getMaxBandwidth() const {
 }
 
 void Throttler::setBurstSize(int64_t burstSize) {
-    std::lock_guard<std::mutex> lock(mutex_);
     burstSize_ = burstSize;
     
     // Log burst size change
@@ -67,120 +76,59 @@ int64_t Throttler::getBurstSize() const {
 }
 
 void Throttler::request(int64_t bytes) {
-    // If throttling is disabled, return immediately
-    if (!enabled_) {
-        return;
-    }
-    
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    // Fill the bucket
-    fillBucket();
+    // Take tokens from this level, then from the parent
+    acquire(bytes, nullptr);
     
-    // Wait until enough tokens are available
-    while (tokens_ < bytes && enabled_) {
-        // Calculate time to wait for enough tokens
-        int64_t tokensNeeded = bytes - tokens_;
-        int64_t bw = maxBandwidth_.load();
-        
-        if (bw <= 0) {
-            break; // Unlimited bandwidth
-        }
-        
-        // Calculate milliseconds to wait
-        int64_t millisecondsToWait = (tokensNeeded * 1000) / bw + 1;
-        
-        // Wait for tokens
-        cv_.wait_for(lock, std::chrono::milliseconds(millisecondsToWait));
-        
-        // Refill bucket after wait
-        fillBucket();
+    if (parent_) {
+        parent_->request(bytes);
     }
-    
-    // If throttling is disabled, return immediately
-    if (!enabled_) {
-        return;
-    }
-    
-    // Consume tokens
-    tokens_ -= bytes;
 }
 
 bool Throttler::requestWithTimeout(int64_t bytes, int timeoutMs) {
-    // If throttling is disabled, return immediately
-    if (!enabled_) {
-        return true;
-    }
-    
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    // Fill the bucket
-    fillBucket();
-    
-    // Check if enough tokens are available immediately
-    if (tokens_ >= bytes) {
-        tokens_ -= bytes;
-        return true;
-    }
-    
     // Calculate deadline
     auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
     
-    // Wait until enough tokens are available or timeout expires
-    while (tokens_ < bytes && enabled_) {
-        // Calculate time to wait for enough tokens
-        int64_t tokensNeeded = bytes - tokens_;
-        int64_t bw = maxBandwidth_.load();
-        
-        if (bw <= 0) {
-            break; // Unlimited bandwidth
-        }
-        
-        // Calculate milliseconds to wait
-        int64_t millisecondsToWait = (tokensNeeded * 1000) / bw + 1;
-        
-        // Wait for tokens with timeout
-        auto status = cv_.wait_until(lock, deadline);
+    if (!acquire(bytes, &deadline)) {
+        return false;
+    }
+    
+    if (parent_) {
+        int remainingMs = static_cast<int>(std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count()));
         
-        // Check if timeout expired
-        if (status == std::cv_status::timeout || std::chrono::steady_clock::now() >= deadline) {
+        if (!parent_->requestWithTimeout(bytes, remainingMs)) {
+            // Give the tokens back so a retry is not charged twice
+            if (enabled_) {
+                tokens_ += bytes;
+            }
             return false;
         }
-        
-        // Refill bucket after wait
-        fillBucket();
-    }
-    
-    // If throttling is disabled, return immediately
-    if (!enabled_) {
-        return true;
     }
     
-    // Consume tokens
-    tokens_ -= bytes;
     return true;
 }
 
 void Throttler::reset() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
     // Reset token bucket
-    lastFillTime_ = std::chrono::steady_clock::now();
+    lastFillTime_ = nowNanoseconds();
     tokens_ = getMaxTokens();
     
     // Wake up all waiting threads
-    cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_all();
+    }
     
     // Log reset
     dm::utils::Logger::debug("Throttler reset");
 }
 
 void Throttler::setEnabled(bool enabled) {
-    std::lock_guard<std::mutex> lock(mutex_);
     enabled_ = enabled && (maxBandwidth_ > 0);
     
     // Wake up all waiting threads if disabled
     if (!enabled_) {
+        std::lock_guard<std::mutex> lock(mutex_);
         cv_.notify_all();
     }
     
@@ -194,23 +142,140 @@ bool Throttler::isEnabled() const {
     return enabled_;
 }
 
+void Throttler::setParent(std::shared_ptr<Throttler> parent) {
+    parent_ = parent;
+}
+
+std::shared_ptr<Throttler> Throttler::getParent() const {
+    return parent_;
+}
+
+void Throttler::attach() {
+    if (activeConsumers_.fetch_add(1) == 0 && parent_) {
+        parent_->attach();
+    }
+}
+
+void Throttler::detach() {
+    int previous = activeConsumers_.load();
+    while (previous > 0 && !activeConsumers_.compare_exchange_weak(previous, previous - 1)) {
+    }
+    
+    if (previous == 1 && parent_) {
+        parent_->detach();
+    }
+}
+
+int Throttler::getActiveConsumers() const {
+    return activeConsumers_;
+}
+
+int64_t Throttler::getFairShare() const {
+    int64_t bandwidth = enabled_ ? maxBandwidth_.load() : 0;
+    
+    // The parent may be the tighter limit
+    if (parent_) {
+        int64_t parentShare = parent_->getFairShare();
+        if (parentShare > 0 && (bandwidth <= 0 || parentShare < bandwidth)) {
+            bandwidth = parentShare;
+        }
+    }
+    
+    if (bandwidth <= 0) {
+        return 0;
+    }
+    
+    int consumers = std::max(1, activeConsumers_.load());
+    return std::max<int64_t>(1, bandwidth / consumers);
+}
+
+bool Throttler::acquire(int64_t bytes, const std::chrono::steady_clock::time_point* deadline) {
+    // Only requests that had to wait are timed, and only while metrics are exported
+    int64_t waitStarted = 0;
+    auto finish = [&waitStarted](bool acquired) {
+        if (waitStarted > 0) {
+            EngineMetrics::getInstance().observe(LatencyMetric::THROTTLE_WAIT,
+                                                 (EngineMetrics::nowNanoseconds() - waitStarted) / 1e9);
+        }
+        return acquired;
+    };
+    
+    while (enabled_) {
+        fillBucket();
+        
+        // Requests larger than the bucket are let through once it is full
+        // and leave it in debt, which later requests wait out
+        int64_t needed = std::min(bytes, std::max<int64_t>(1, getMaxTokens()));
+        
+        int64_t current = tokens_.load();
+        if (current >= needed) {
+            if (tokens_.compare_exchange_weak(current, current - bytes)) {
+                return finish(true);
+            }
+            continue;
+        }
+        
+        int64_t bw = maxBandwidth_.load();
+        if (bw <= 0) {
+            break; // Unlimited bandwidth
+        }
+        
+        // Calculate milliseconds to wait, capped so limit changes are picked up
+        int64_t millisecondsToWait = ((needed - current) * 1000) / bw + 1;
+        millisecondsToWait = std::min<int64_t>(millisecondsToWait, 100);
+        
+        auto wakeTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(millisecondsToWait);
+        if (deadline) {
+            if (std::chrono::steady_clock::now() >= *deadline) {
+                return finish(false);
+            }
+            wakeTime = std::min(wakeTime, *deadline);
+        }
+        
+        if (waitStarted == 0 && EngineMetrics::getInstance().isEnabled()) {
+            waitStarted = EngineMetrics::nowNanoseconds();
+        }
+        
+        // Wait for tokens
+        DM_TRACE_SPAN("throttle wait");
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_until(lock, wakeTime);
+    }
+    
+    return finish(true);
+}
+
+int64_t Throttler::nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void Throttler::fillBucket() {
-    // Get current time
-    auto now = std::chrono::steady_clock::now();
+    int64_t bw = maxBandwidth_.load();
+    if (bw <= 0) {
+        return;
+    }
     
     // Calculate time difference in seconds
-    double elapsedSeconds = std::chrono::duration<double>(now - lastFillTime_).count();
+    int64_t now = nowNanoseconds();
+    int64_t last = lastFillTime_.load();
+    double elapsedSeconds = static_cast<double>(now - last) / 1e9;
     
     // Calculate tokens to add
-    int64_t bw = maxBandwidth_.load();
     int64_t tokensToAdd = static_cast<int64_t>(elapsedSeconds * bw);
+    if (tokensToAdd <= 0) {
+        return;
+    }
     
-    if (tokensToAdd > 0) {
-        // Add tokens to bucket
-        tokens_ = std::min(tokens_ + tokensToAdd, getMaxTokens());
-        
-        // Update last fill time
-        lastFillTime_ = now;
+    // Claim the interval, whoever loses the race has had it refilled for them
+    if (!lastFillTime_.compare_exchange_strong(last, now)) {
+        return;
+    }
+    
+    // Add tokens to bucket
+    int64_t maxTokens = getMaxTokens();
+    int64_t current = tokens_.load();
+    while (!tokens_.compare_exchange_weak(current, std::min(current + tokensToAdd, maxTokens))) {
     }
 }
 
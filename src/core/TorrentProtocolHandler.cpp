@@ -1,6 +1,7 @@
 #include "../../include/core/TorrentProtocolHandler.h"
 #include "../../include/utils/Logger.h"
 #include "../../include/utils/FileUtils.h"
+#include "../../include/core/NetworkMonitor.h"
 
 #include <fstream>
 #include <sstream>
@@ -9,6 +10,8 @@
 #include <chrono>
 #include <thread>
 #include <cstring>
+#include <map>
+#include <vector>
 
 // Include libtorrent headers
 #include <libtorrent/session.hpp>
@@ -21,18 +24,171 @@
 #include <libtorrent/magnet_uri.hpp>
 #include <libtorrent/read_resume_data.hpp>
 #include <libtorrent/write_resume_data.hpp>
+#include <libtorrent/session_params.hpp>
+#include <libtorrent/settings_pack.hpp>
+#include <libtorrent/version.hpp>
+#if LIBTORRENT_VERSION_NUM >= 20000
+#include <libtorrent/mmap_disk_io.hpp>
+#include <libtorrent/posix_disk_io.hpp>
+#endif
 
 namespace DownloadManager {
 namespace Core {
 
+namespace {
+
+// How often the session is asked for the torrents whose status changed
+const int STATUS_UPDATE_INTERVAL_MS = 500;
+
+// Round trip assumed when the network monitor has not measured one
+const double DEFAULT_PEER_RTT_MS = 100.0;
+
+// Pieces ahead of the first missing one that streaming torrents give a
+// deadline, each one STREAMING_DEADLINE_STEP_MS after the one before it
+const int64_t STREAMING_WINDOW_BYTES = 16 * 1024 * 1024;
+const int MIN_STREAMING_WINDOW_PIECES = 4;
+const int STREAMING_DEADLINE_STEP_MS = 250;
+
+/**
+ * @brief Tuning for one kind of machine and workload
+ */
+struct SessionPreset {
+    const char* name;
+    int cacheSizeMiB;                   // Disk cache, libtorrent 1.x only
+    int aioThreads;
+    int hashingThreads;
+    int sendBufferWatermarkKiB;
+    int maxSendBufferWatermarkKiB;      // Validation may raise the watermark up to this
+    int sendBufferLowWatermarkKiB;
+    int sendBufferWatermarkFactor;      // Percent of the peer's rate kept queued
+    bool mmapStorage;                   // mmap storage, or pread/pwrite storage
+    int activeDownloads;
+    int activeSeeds;
+    int activeLimit;
+    int connectionsLimit;
+    int unchokeSlots;
+    double minBandwidth;                // Bytes/second the preset is meant for
+};
+
+const SessionPreset SESSION_PRESETS[] = {
+    // libtorrent's own defaults, apart from the connection limit
+    {"default",                    32,  10, 1,   500,   500,   10,  50,  true,   3,   5,   15,  200,   8, 0.0},
+    // Few fast peers: deep send buffers, mmap over the page cache
+    {"high_throughput_seedbox",  1024,  16, 4,  8192, 65536, 1024, 150,  true,  10, 200,  500, 2000, 100, 12.5e6},
+    // Small buffers and pread so nothing is mapped into the address space
+    {"low_memory",                  4,   2, 1,   128,   128,   16,  20, false,   2,   2,    4,   50,   4, 0.0},
+    // Thousands of files open: pread instead of a mapping per file
+    {"many_torrents",             256,   8, 2,  1024,  8192,   64,  50, false,  20, 500, 1000, 1500,  50, 0.0}
+};
+
+const SessionPreset* findSessionPreset(const std::string& name) {
+    for (const auto& preset : SESSION_PRESETS) {
+        if (name == preset.name) {
+            return &preset;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Fill a settings pack from a preset, validated against the measured bandwidth
+ */
+void applySessionPreset(const SessionPreset& preset, NetworkMonitor* networkMonitor,
+                        libtorrent::settings_pack& pack) {
+    int watermarkKiB = preset.sendBufferWatermarkKiB;
+    int hashingThreads = std::min<int>(preset.hashingThreads,
+                                       std::max(1u, std::thread::hardware_concurrency()));
+    
+    // A peer gets at most one send buffer per round trip, so the unchoked
+    // peers together cannot upload faster than this
+    if (networkMonitor) {
+        NetworkSpeed speed = networkMonitor->getCurrentNetworkSpeed();
+        double bandwidth = std::max(speed.downloadSpeed, speed.uploadSpeed);
+        double rttSeconds = (speed.latency > 0.0 ? speed.latency : DEFAULT_PEER_RTT_MS) / 1000.0;
+        
+        if (bandwidth > 0.0) {
+            double perPeerBytes = bandwidth * rttSeconds / preset.unchokeSlots;
+            int neededKiB = static_cast<int>(perPeerBytes / 1024.0) + 1;
+            
+            if (neededKiB > watermarkKiB) {
+                watermarkKiB = std::min(neededKiB, preset.maxSendBufferWatermarkKiB);
+            }
+            
+            if (neededKiB > watermarkKiB) {
+                Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
+                    "Session preset " + std::string(preset.name) + " caps throughput at " +
+                    std::to_string(static_cast<int64_t>(watermarkKiB * 1024.0 * preset.unchokeSlots / rttSeconds)) +
+                    " B/s, below the measured " + std::to_string(static_cast<int64_t>(bandwidth)) + " B/s");
+            }
+            
+            if (bandwidth < preset.minBandwidth) {
+                Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
+                    "Session preset " + std::string(preset.name) + " is meant for links of at least " +
+                    std::to_string(static_cast<int64_t>(preset.minBandwidth)) + " B/s, measured " +
+                    std::to_string(static_cast<int64_t>(bandwidth)) + " B/s");
+            }
+        }
+    }
+    
+#if LIBTORRENT_VERSION_NUM < 20000
+    // In 16 KiB blocks; libtorrent 2 leaves caching to the page cache
+    pack.set_int(libtorrent::settings_pack::cache_size, preset.cacheSizeMiB * 64);
+#endif
+    pack.set_int(libtorrent::settings_pack::aio_threads, preset.aioThreads);
+    pack.set_int(libtorrent::settings_pack::hashing_threads, hashingThreads);
+    pack.set_int(libtorrent::settings_pack::send_buffer_watermark, watermarkKiB * 1024);
+    pack.set_int(libtorrent::settings_pack::send_buffer_low_watermark, preset.sendBufferLowWatermarkKiB * 1024);
+    pack.set_int(libtorrent::settings_pack::send_buffer_watermark_factor, preset.sendBufferWatermarkFactor);
+    pack.set_int(libtorrent::settings_pack::active_downloads, preset.activeDownloads);
+    pack.set_int(libtorrent::settings_pack::active_seeds, preset.activeSeeds);
+    pack.set_int(libtorrent::settings_pack::active_limit, preset.activeLimit);
+    pack.set_int(libtorrent::settings_pack::connections_limit, preset.connectionsLimit);
+    pack.set_int(libtorrent::settings_pack::unchoke_slots_limit, preset.unchokeSlots);
+}
+
+/**
+ * @brief Slide the deadline window of a streaming torrent up to its first missing piece
+ *
+ * @return int64_t The bytes readable from the start of the torrent
+ */
+int64_t advanceStreamingWindow(const libtorrent::torrent_handle& handle) {
+    std::shared_ptr<const libtorrent::torrent_info> info = handle.torrent_file();
+    if (!info) {
+        return 0;
+    }
+    
+    libtorrent::torrent_status status = handle.status(libtorrent::torrent_handle::query_pieces);
+    int pieces = info->num_pieces();
+    int first = 0;
+    while (first < pieces && status.pieces.get_bit(libtorrent::piece_index_t(first))) {
+        first++;
+    }
+    
+    // Deadlines count from now, so each update renews them as the window moves
+    int pieceLength = info->piece_length();
+    int window = std::max<int>(MIN_STREAMING_WINDOW_PIECES, static_cast<int>(STREAMING_WINDOW_BYTES / pieceLength));
+    for (int piece = first; piece < std::min(pieces, first + window); piece++) {
+        if (!status.pieces.get_bit(libtorrent::piece_index_t(piece))) {
+            handle.set_piece_deadline(libtorrent::piece_index_t(piece), (piece - first + 1) * STREAMING_DEADLINE_STEP_MS);
+        }
+    }
+    
+    return std::min<int64_t>(static_cast<int64_t>(first) * pieceLength, info->total_size());
+}
+
+} // namespace
+
 TorrentProtocolHandler::TorrentProtocolHandler() 
     : ProtocolHandler("BitTorrent"), 
       m_session(nullptr),
       m_isRunning(false),
-      m_alertThread(nullptr)
+      m_alertThread(nullptr),
+      m_networkMonitor(nullptr),
+      m_sessionPreset("default"),
+      m_mmapStorage(true)
 {
     // Initialize libtorrent session
-    m_session = std::make_unique<libtorrent::session>();
+    m_session = createSession(true);
     initSession();
 }
 
@@ -571,6 +727,46 @@ void TorrentProtocolHandler::setPriority(const std::string& taskHash, int priori
     handle.set_priority(ltPriority);
 }
 
+void TorrentProtocolHandler::setStreaming(const std::string& taskHash, bool enabled) {
+    if (!m_session) {
+        return;
+    }
+    
+    // Find torrent
+    libtorrent::torrent_handle handle;
+    {
+        std::lock_guard<std::mutex> lock(m_torrentsMutex);
+        auto it = m_torrents.find(taskHash);
+        if (it == m_torrents.end()) {
+            Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
+                "Torrent not found: " + taskHash);
+            return;
+        }
+        
+        it->second.streaming = enabled;
+        handle = it->second.handle;
+    }
+    
+    if (!handle.is_valid()) {
+        return;
+    }
+    
+    // Beyond the deadline window pieces still come in file order
+    if (enabled) {
+        handle.set_flags(libtorrent::torrent_flags::sequential_download);
+    } else {
+        handle.unset_flags(libtorrent::torrent_flags::sequential_download);
+    }
+    
+    if (enabled) {
+        if (handle.has_metadata()) {
+            advanceStreamingWindow(handle);
+        }
+    } else {
+        handle.clear_piece_deadlines();
+    }
+}
+
 void TorrentProtocolHandler::setFileDownloadPriority(const std::string& taskHash, int fileIndex, int priority) {
     if (!m_session) {
         return;
@@ -692,6 +888,22 @@ std::vector<TorrentFileInfo> TorrentProtocolHandler::getTorrentFiles(const std::
     return result;
 }
 
+std::unique_ptr<libtorrent::session> TorrentProtocolHandler::createSession(bool mmapStorage) {
+    libtorrent::session_params params;
+    
+#if LIBTORRENT_VERSION_NUM >= 20000
+    // The storage backend can only be chosen when the session is created
+    params.disk_io_constructor = mmapStorage
+        ? libtorrent::mmap_disk_io_constructor
+        : libtorrent::posix_disk_io_constructor;
+#else
+    (void)mmapStorage;
+#endif
+    
+    m_mmapStorage = mmapStorage;
+    return std::make_unique<libtorrent::session>(std::move(params));
+}
+
 void TorrentProtocolHandler::initSession() {
     try {
         // Set session settings
@@ -709,12 +921,12 @@ void TorrentProtocolHandler::initSession() {
         // Enable NAT-PMP
         settings.set_bool(libtorrent::settings_pack::enable_natpmp, true);
         
-        // Set connection limits
-        settings.set_int(libtorrent::settings_pack::connections_limit, 200);
-        
         // Set username and client info
         settings.set_str(libtorrent::settings_pack::user_agent, "DownloadManager/1.0");
         
+        // Connection limits, disk threads and buffers
+        applySessionPreset(*findSessionPreset("default"), m_networkMonitor, settings);
+        
         // Apply settings
         m_session->apply_settings(settings);
         
@@ -727,6 +939,136 @@ void TorrentProtocolHandler::initSession() {
     }
 }
 
+void TorrentProtocolHandler::setNetworkMonitor(NetworkMonitor* networkMonitor) {
+    m_networkMonitor = networkMonitor;
+}
+
+std::vector<std::string> TorrentProtocolHandler::getSessionPresets() {
+    std::vector<std::string> names;
+    for (const auto& preset : SESSION_PRESETS) {
+        names.push_back(preset.name);
+    }
+    return names;
+}
+
+bool TorrentProtocolHandler::setSessionSettings(const std::map<std::string, std::string>& settings) {
+    try {
+        libtorrent::settings_pack pack;
+        
+        // The preset goes first so individual settings can override it
+        auto presetIt = settings.find("preset");
+        if (presetIt != settings.end()) {
+            const SessionPreset* preset = findSessionPreset(presetIt->second);
+            if (!preset) {
+                Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
+                    "Unknown session preset: " + presetIt->second);
+                return false;
+            }
+            
+            applySessionPreset(*preset, m_networkMonitor, pack);
+            m_sessionPreset = preset->name;
+            
+            if (preset->mmapStorage != m_mmapStorage && !switchStorage(preset->mmapStorage)) {
+                Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
+                    "Keeping the current storage backend until all torrents are removed");
+            }
+        }
+        
+        // Anything else is a libtorrent setting by name
+        for (const auto& pair : settings) {
+            if (pair.first == "preset") {
+                continue;
+            }
+            
+            int setting = libtorrent::setting_by_name(pair.first);
+            if (setting < 0) {
+                Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
+                    "Unknown session setting: " + pair.first);
+                return false;
+            }
+            
+            switch (setting & libtorrent::settings_pack::type_mask) {
+                case libtorrent::settings_pack::string_type_base:
+                    pack.set_str(setting, pair.second);
+                    break;
+                case libtorrent::settings_pack::int_type_base:
+                    pack.set_int(setting, std::stoi(pair.second));
+                    break;
+                case libtorrent::settings_pack::bool_type_base:
+                    pack.set_bool(setting, pair.second == "true" || pair.second == "1");
+                    break;
+            }
+        }
+        
+        m_session->apply_settings(pack);
+        
+        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
+            "Applied BitTorrent session settings (preset: " + m_sessionPreset + ")");
+        return true;
+    } 
+    catch (const std::exception& e) {
+        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
+            "Exception in setSessionSettings: " + std::string(e.what()));
+        return false;
+    }
+}
+
+std::map<std::string, std::string> TorrentProtocolHandler::getSessionSettings() {
+    std::map<std::string, std::string> result;
+    result["preset"] = m_sessionPreset;
+    result["storage"] = m_mmapStorage ? "mmap" : "pread";
+    
+    libtorrent::settings_pack current = m_session->get_settings();
+    
+    // The settings the presets manage
+    const int settings[] = {
+        libtorrent::settings_pack::aio_threads,
+        libtorrent::settings_pack::hashing_threads,
+        libtorrent::settings_pack::send_buffer_watermark,
+        libtorrent::settings_pack::send_buffer_low_watermark,
+        libtorrent::settings_pack::send_buffer_watermark_factor,
+        libtorrent::settings_pack::active_downloads,
+        libtorrent::settings_pack::active_seeds,
+        libtorrent::settings_pack::active_limit,
+        libtorrent::settings_pack::connections_limit,
+        libtorrent::settings_pack::unchoke_slots_limit,
+#if LIBTORRENT_VERSION_NUM < 20000
+        libtorrent::settings_pack::cache_size,
+#endif
+    };
+    
+    for (int setting : settings) {
+        result[libtorrent::name_for_setting(setting)] = std::to_string(current.get_int(setting));
+    }
+    
+    return result;
+}
+
+bool TorrentProtocolHandler::switchStorage(bool mmapStorage) {
+    // Torrents keep their storage, so the session is only replaced while empty
+    {
+        std::lock_guard<std::mutex> lock(m_torrentsMutex);
+        if (!m_torrents.empty()) {
+            return false;
+        }
+    }
+    
+    bool wasRunning = m_isRunning;
+    stopAlertHandling();
+    
+    libtorrent::settings_pack settings = m_session->get_settings();
+    m_session = createSession(mmapStorage);
+    m_session->apply_settings(settings);
+    
+    if (wasRunning) {
+        startAlertHandling();
+    }
+    
+    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
+        std::string("Switched BitTorrent storage to ") + (mmapStorage ? "mmap" : "pread"));
+    return true;
+}
+
 void TorrentProtocolHandler::startAlertHandling() {
     if (m_isRunning) {
         return;
@@ -746,6 +1088,9 @@ void TorrentProtocolHandler::stopAlertHandling() {
     
     m_isRunning = false;
     
+    // Any alert wakes the thread out of wait_for_alert
+    m_session->post_torrent_updates();
+    
     if (m_alertThread && m_alertThread->joinable()) {
         m_alertThread->join();
     }
@@ -757,20 +1102,45 @@ void TorrentProtocolHandler::stopAlertHandling() {
 void TorrentProtocolHandler::alertThreadFunc() {
     using namespace libtorrent;
     
-    // Set up alert mask
+    // Progress comes from batched state updates, so the per-piece
+    // progress and per-torrent stats alerts are left off
     m_session->set_alert_mask(
         alert::status_notification |
         alert::error_notification |
-        alert::storage_notification |
-        alert::progress_notification
+        alert::storage_notification
     );
     
+    auto nextUpdate = std::chrono::steady_clock::now();
+    std::vector<alert*> alerts;
+    
     while (m_isRunning) {
-        std::vector<alert*> alerts;
+        // Answered by one state_update_alert holding every torrent whose
+        // status changed since the last request
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextUpdate) {
+            m_session->post_torrent_updates();
+            nextUpdate = now + std::chrono::milliseconds(STATUS_UPDATE_INTERVAL_MS);
+        }
+        
+        // Sleep until an alert arrives or the next update is due
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextUpdate - now);
+        if (!m_session->wait_for_alert(wait)) {
+            continue;
+        }
+        
         m_session->pop_alerts(&alerts);
         
         for (alert* a : alerts) {
             switch (a->type()) {
+                case state_update_alert::alert_type:
+                {
+                    // Status of the torrents that changed
+                    state_update_alert* update = alert_cast<state_update_alert>(a);
+                    if (update) {
+                        handleStateUpdate(update);
+                    }
+                    break;
+                }
                 case torrent_finished_alert::alert_type:
                 {
                     // Torrent finished
@@ -816,23 +1186,8 @@ void TorrentProtocolHandler::alertThreadFunc() {
                     }
                     break;
                 }
-                case stats_alert::alert_type:
-                {
-                    // Stats updated
-                    stats_alert* stats = alert_cast<stats_alert>(a);
-                    if (stats) {
-                        handleStatsUpdated(stats);
-                    }
-                    break;
-                }
             }
         }
-        
-        // Update all torrents
-        updateAllTorrents();
-        
-        // Sleep for a bit
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 }
 
@@ -983,83 +1338,83 @@ void TorrentProtocolHandler::handleMetadataReceived(libtorrent::metadata_receive
     }
 }
 
-void TorrentProtocolHandler::handleStatsUpdated(libtorrent::stats_alert* alert) {
-    // This is just for monitoring, we don't need to do anything with it
-}
-
-void TorrentProtocolHandler::updateAllTorrents() {
-    std::vector<std::string> toRemove;
+void TorrentProtocolHandler::handleStateUpdate(libtorrent::state_update_alert* alert) {
+    struct Update {
+        std::string hash;
+        std::shared_ptr<DownloadTask> task;
+        ProgressCallback progressCallback;
+        const libtorrent::torrent_status* status;
+        bool streaming;
+    };
     
+    std::vector<Update> updates;
+    updates.reserve(alert->status.size());
+    
+    // Only match the changed torrents to their tasks under the lock
     {
         std::lock_guard<std::mutex> lock(m_torrentsMutex);
         
-        for (auto& pair : m_torrents) {
-            std::string taskHash = pair.first;
-            TorrentInfo& info = pair.second;
-            
-            // Skip invalid handles
-            if (!info.handle.is_valid()) {
-                continue;
+        std::map<libtorrent::torrent_handle, const libtorrent::torrent_status*> changed;
+        for (const auto& status : alert->status) {
+            changed[status.handle] = &status;
+        }
+        
+        for (const auto& pair : m_torrents) {
+            auto it = changed.find(pair.second.handle);
+            if (it != changed.end()) {
+                updates.push_back(Update{pair.first, pair.second.task, pair.second.progressCallback, it->second,
+                                         pair.second.streaming});
             }
+        }
+    }
+    
+    std::vector<std::string> toRemove;
+    
+    for (const auto& update : updates) {
+        const libtorrent::torrent_status& status = *update.status;
+        
+        if (update.task) {
+            // Publish into the task's progress snapshot, like HTTP segments do
+            int64_t downloadedBytes = status.total_wanted_done;
+            int64_t readableBytes = -1;
+            if (update.streaming && status.has_metadata) {
+                readableBytes = advanceStreamingWindow(status.handle);
+            }
+            update.task->publishProgress(downloadedBytes, status.total_wanted, status.download_rate, readableBytes);
             
-            // Get status
-            libtorrent::torrent_status status;
-            try {
-                status = info.handle.status();
-            } 
-            catch (const std::exception& e) {
-                Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                    "Exception getting torrent status: " + std::string(e.what()));
-                continue;
+            // Update task status based on torrent state
+            switch (status.state) {
+                case libtorrent::torrent_status::checking_files:
+                case libtorrent::torrent_status::downloading_metadata:
+                case libtorrent::torrent_status::downloading:
+                case libtorrent::torrent_status::finished:
+                    update.task->setStatus(DownloadStatus::DOWNLOADING);
+                    break;
+                case libtorrent::torrent_status::seeding:
+                    update.task->setStatus(DownloadStatus::COMPLETED);
+                    break;
+                case libtorrent::torrent_status::checking_resume_data:
+                    // Keep current status
+                    break;
+                case libtorrent::torrent_status::paused:
+                    update.task->setStatus(DownloadStatus::PAUSED);
+                    break;
+                default:
+                    break;
             }
             
-            // Update task
-            if (info.task) {
-                // Update download progress
-                if (status.total_wanted > 0) {
-                    int64_t downloadedBytes = static_cast<int64_t>(status.total_wanted * status.progress);
-                    info.task->setDownloadedBytes(downloadedBytes);
-                    info.task->setFileSize(status.total_wanted);
-                }
-                
-                // Update download speed
-                info.task->setCurrentSpeed(status.download_rate);
-                
-                // Update task status based on torrent state
-                switch (status.state) {
-                    case libtorrent::torrent_status::checking_files:
-                    case libtorrent::torrent_status::downloading_metadata:
-                    case libtorrent::torrent_status::downloading:
-                    case libtorrent::torrent_status::finished:
-                        info.task->setStatus(DownloadStatus::DOWNLOADING);
-                        break;
-                    case libtorrent::torrent_status::seeding:
-                        info.task->setStatus(DownloadStatus::COMPLETED);
-                        break;
-                    case libtorrent::torrent_status::checking_resume_data:
-                        // Keep current status
-                        break;
-                    case libtorrent::torrent_status::paused:
-                        info.task->setStatus(DownloadStatus::PAUSED);
-                        break;
-                }
-                
-                // Call progress callback
-                if (info.progressCallback && status.total_wanted > 0) {
-                    info.progressCallback(
-                        static_cast<int64_t>(status.total_wanted * status.progress),
-                        status.total_wanted
-                    );
-                }
+            // Call progress callback
+            if (update.progressCallback && status.total_wanted > 0) {
+                update.progressCallback(downloadedBytes, status.total_wanted);
             }
+        }
+        
+        // Check if torrent is complete and seeding is disabled
+        if (status.is_finished && !isSeedingEnabled()) {
+            toRemove.push_back(update.hash);
             
-            // Check if torrent is complete and seeding is disabled
-            if (status.is_finished && !isSeedingEnabled()) {
-                toRemove.push_back(taskHash);
-                
-                if (info.task) {
-                    info.task->setStatus(DownloadStatus::COMPLETED);
-                }
+            if (update.task) {
+                update.task->setStatus(DownloadStatus::COMPLETED);
             }
         }
     }
@@ -0,0 +1,121 @@
+#include "core/TransferCounters.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+void count(std::vector<DownloadCounts>& table, uint32_t id, int64_t bytes, bool succeeded) {
+    if (id >= table.size()) {
+        table.resize(id + 1);
+    }
+    DownloadCounts& counts = table[id];
+    if (succeeded) {
+        counts.completed++;
+        counts.bytes += bytes;
+    } else {
+        counts.failed++;
+    }
+}
+
+void mergeInto(std::map<std::string, DownloadCounts>& totals, const std::vector<DownloadCounts>& table,
+               const std::vector<std::string>& names) {
+    for (size_t id = 0; id < table.size() && id < names.size(); id++) {
+        const DownloadCounts& counts = table[id];
+        if (counts.completed == 0 && counts.failed == 0) {
+            continue;
+        }
+        DownloadCounts& total = totals[names[id]];
+        total.completed += counts.completed;
+        total.failed += counts.failed;
+        total.bytes += counts.bytes;
+    }
+}
+
+} // namespace
+
+TransferCounters& TransferCounters::getInstance() {
+    static TransferCounters instance;
+    return instance;
+}
+
+uint32_t TransferCounters::internDomain(const std::string& domain) {
+    return intern(toLower(domain), domainIds_, domainNames_);
+}
+
+uint32_t TransferCounters::internFileType(const std::string& fileType) {
+    return intern(toLower(fileType), fileTypeIds_, fileTypeNames_);
+}
+
+void TransferCounters::recordDownload(uint32_t domainId, uint32_t fileTypeId, int64_t bytes, bool succeeded) {
+    Shard& shard = localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    count(shard.domains, domainId, bytes, succeeded);
+    count(shard.fileTypes, fileTypeId, bytes, succeeded);
+}
+
+int64_t TransferCounters::getBytesReceived() const {
+    int64_t bytes = 0;
+    for (const auto& shard : shards_) {
+        bytes += shard.bytes.load(std::memory_order_relaxed);
+    }
+    return bytes;
+}
+
+TransferTotals TransferCounters::getTotals() const {
+    TransferTotals totals;
+    totals.bytesReceived = getBytesReceived();
+
+    // Names are copied first, ids handed out later are not in any shard yet
+    std::vector<std::string> domainNames;
+    std::vector<std::string> fileTypeNames;
+    {
+        std::lock_guard<std::mutex> lock(keysMutex_);
+        domainNames = domainNames_;
+        fileTypeNames = fileTypeNames_;
+    }
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        mergeInto(totals.domains, shard.domains, domainNames);
+        mergeInto(totals.fileTypes, shard.fileTypes, fileTypeNames);
+    }
+
+    // Every download has exactly one file type, so those add up to the totals
+    for (const auto& entry : totals.fileTypes) {
+        totals.completed += entry.second.completed;
+        totals.failed += entry.second.failed;
+    }
+    return totals;
+}
+
+TransferCounters::Shard& TransferCounters::localShard() {
+    // Threads are spread round-robin, so at most a few share a shard
+    thread_local size_t index = nextShard_.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return shards_[index];
+}
+
+uint32_t TransferCounters::intern(const std::string& key, std::unordered_map<std::string, uint32_t>& ids,
+                                  std::vector<std::string>& names) {
+    std::lock_guard<std::mutex> lock(keysMutex_);
+    auto it = ids.find(key);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(names.size());
+    ids.emplace(key, id);
+    names.push_back(key);
+    return id;
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,768 @@
+#include "core/TransferEngine.h"
+#include "core/CurlHandlePool.h"
+#include "core/DnsCache.h"
+#include "core/LinkStats.h"
+#include "core/SocketTuner.h"
+#include "core/Throttler.h"
+#include "utils/DiskIo.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace core {
+
+/**
+ * @brief Internal state of a submitted transfer
+ */
+struct TransferEngine::Transfer {
+    TransferId id = 0;
+    TransferRequest request;
+    CURL* handle = nullptr;
+    struct curl_slist* headerList = nullptr;
+    struct curl_slist* resolveList = nullptr;
+    std::string range;
+    std::chrono::steady_clock::time_point startAt;
+    std::chrono::steady_clock::time_point resumeAt;
+    std::chrono::steady_clock::time_point nextLinkSample;
+    curl_socket_t socket = CURL_SOCKET_BAD;    // Last socket curl watched for it
+    TransferEngine* engine = nullptr;
+    std::atomic<bool> cancelled{false};
+    bool paused = false;
+    bool aborted = false;
+    bool rangeChecked = false;
+    std::string error;
+    HttpHeaders headers;
+};
+
+TransferEngine& TransferEngine::getInstance() {
+    static TransferEngine instance;
+    return instance;
+}
+
+TransferEngine::TransferEngine()
+    : running_(false), threadId_(std::thread::id()), nextId_(1) {
+    // Make sure the handle pool outlives the engine
+    CurlHandlePool::getInstance();
+}
+
+TransferEngine::~TransferEngine() {
+    stop();
+}
+
+bool TransferEngine::start() {
+    std::lock_guard<std::mutex> lock(startMutex_);
+
+    if (running_) {
+        return true;
+    }
+
+    multi_ = curl_multi_init();
+    if (!multi_) {
+        dm::utils::Logger::error("Failed to initialize CURL multi handle");
+        return false;
+    }
+
+#ifdef __linux__
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd_ < 0) {
+        dm::utils::Logger::error("Failed to create transfer engine event descriptors: " +
+                                 std::string(std::strerror(errno)));
+        if (epollFd_ >= 0) close(epollFd_);
+        if (wakeFd_ >= 0) close(wakeFd_);
+        epollFd_ = wakeFd_ = -1;
+        curl_multi_cleanup(multi_);
+        multi_ = nullptr;
+        return false;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, socketCallback);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, timerCallback);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+#endif
+
+    applyMultiplexing();
+
+    timerArmed_ = false;
+    running_ = true;
+    thread_ = std::make_unique<std::thread>(&TransferEngine::engineThread, this);
+
+    dm::utils::Logger::info("Transfer engine started");
+    return true;
+}
+
+void TransferEngine::stop() {
+    {
+        std::lock_guard<std::mutex> lock(startMutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+
+    wakeup();
+    if (thread_ && thread_->joinable()) {
+        thread_->join();
+    }
+    thread_.reset();
+    threadId_ = std::thread::id();
+
+    // Abort everything that is still in flight
+    std::vector<std::shared_ptr<Transfer>> inFlight;
+    for (auto& pair : inMulti_) {
+        inFlight.push_back(pair.second);
+    }
+    for (auto& transfer : inFlight) {
+        removeFromMulti(transfer);
+    }
+    delayed_.clear();
+    paused_.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingAdds_.clear();
+        pendingCancels_.clear();
+        transfers_.clear();
+    }
+    cancelCv_.notify_all();
+
+    curl_multi_cleanup(multi_);
+    multi_ = nullptr;
+
+#ifdef __linux__
+    close(epollFd_);
+    close(wakeFd_);
+    epollFd_ = wakeFd_ = -1;
+#endif
+
+    dm::utils::Logger::info("Transfer engine stopped");
+}
+
+TransferId TransferEngine::submit(TransferRequest request) {
+    if (!start()) {
+        return 0;
+    }
+
+    auto transfer = std::make_shared<Transfer>();
+    transfer->id = nextId_++;
+    transfer->engine = this;
+    transfer->startAt = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(std::max<int64_t>(0, request.startDelayMs));
+    transfer->request = std::move(request);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        transfers_[transfer->id] = transfer;
+        pendingAdds_.push_back(transfer);
+    }
+
+    wakeup();
+    return transfer->id;
+}
+
+bool TransferEngine::cancel(TransferId id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto it = transfers_.find(id);
+    if (it == transfers_.end()) {
+        return false;
+    }
+
+    auto transfer = it->second;
+    transfer->cancelled = true;
+    pendingCancels_.push_back(transfer);
+
+    if (isEngineThread()) {
+        // The handle may be inside a callback right now, it is removed on the next pass
+        transfers_.erase(it);
+        return true;
+    }
+
+    lock.unlock();
+    wakeup();
+    lock.lock();
+
+    cancelCv_.wait(lock, [this, id]() {
+        return !running_ || transfers_.find(id) == transfers_.end();
+    });
+
+    return true;
+}
+
+size_t TransferEngine::getActiveTransferCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transfers_.size();
+}
+
+bool TransferEngine::isEngineThread() const {
+    return std::this_thread::get_id() == threadId_.load();
+}
+
+void TransferEngine::wakeup() {
+#ifdef __linux__
+    if (wakeFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd_, &one, sizeof(one));
+        (void)written;
+    }
+#else
+    if (multi_) {
+        curl_multi_wakeup(multi_);
+    }
+#endif
+}
+
+void TransferEngine::engineThread() {
+    threadId_ = std::this_thread::get_id();
+
+    // Blocks written during an iteration are submitted together
+    dm::utils::DiskIoBackend::setDeferredSubmission(true);
+
+    while (running_) {
+        processCommands();
+        startDueTransfers();
+        resumePausedTransfers();
+
+        int runningHandles = 0;
+        int waitMs = nextWaitMs();
+        dm::utils::DiskIoBackend::getInstance().submit();
+
+#ifdef __linux__
+        epoll_event events[64];
+        int count = epoll_wait(epollFd_, events, 64, waitMs);
+        if (count < 0 && errno != EINTR) {
+            dm::utils::Logger::error("Transfer engine epoll_wait failed: " + std::string(std::strerror(errno)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == wakeFd_) {
+                uint64_t value = 0;
+                while (read(wakeFd_, &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
+
+            int flags = 0;
+            if (events[i].events & EPOLLIN) flags |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+
+            curl_multi_socket_action(multi_, fd, flags, &runningHandles);
+        }
+
+        // Fire the CURL timer if it expired
+        if (timerArmed_ && std::chrono::steady_clock::now() >= timerDeadline_) {
+            timerArmed_ = false;
+            curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &runningHandles);
+        }
+#else
+        curl_multi_perform(multi_, &runningHandles);
+        checkMultiInfo();
+        curl_multi_poll(multi_, nullptr, 0, waitMs < 0 ? 1000 : std::min(waitMs, 1000), nullptr);
+        curl_multi_perform(multi_, &runningHandles);
+#endif
+
+        checkMultiInfo();
+    }
+}
+
+void TransferEngine::setMultiplexing(int maxStreamsPerConnection, bool preferHttp3) {
+    maxStreams_ = std::max(1, maxStreamsPerConnection);
+    preferHttp3_ = preferHttp3 && supportsHttp3();
+    if (!supportsMultiplexing()) {
+        dm::utils::Logger::warning(std::string("HTTP multiplexing disabled, libcurl ") +
+                                   curl_version_info(CURLVERSION_NOW)->version + " is too old");
+    } else if (preferHttp3 && !preferHttp3_) {
+        dm::utils::Logger::warning("HTTP/3 requested but not supported by libcurl, using HTTP/2");
+    }
+
+    // The multi handle is only touched on the engine thread
+    multiplexChanged_ = true;
+    wakeup();
+}
+
+bool TransferEngine::supportsMultiplexing() {
+    const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    return (info->features & CURL_VERSION_HTTP2) != 0 && info->version_num >= 0x080100;
+}
+
+bool TransferEngine::supportsHttp3() {
+#if LIBCURL_VERSION_NUM >= 0x075800
+    // Before 7.88 CURL_HTTP_VERSION_3 did not fall back to older versions
+    return (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP3) != 0;
+#else
+    return false;
+#endif
+}
+
+void TransferEngine::applyMultiplexing() {
+    multiplexChanged_ = false;
+
+    // Old libcurl would stack unflagged HTTP/2 transfers on one connection too
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING,
+                      supportsMultiplexing() ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#if LIBCURL_VERSION_NUM >= 0x074300
+    curl_multi_setopt(multi_, CURLMOPT_MAX_CONCURRENT_STREAMS, static_cast<long>(maxStreams_.load()));
+#endif
+}
+
+void TransferEngine::processCommands() {
+    if (multiplexChanged_) {
+        applyMultiplexing();
+    }
+
+    std::vector<std::shared_ptr<Transfer>> adds;
+    std::vector<std::shared_ptr<Transfer>> cancels;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        adds.swap(pendingAdds_);
+        cancels.swap(pendingCancels_);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (auto& transfer : adds) {
+        if (transfer->cancelled) {
+            continue;
+        }
+
+        if (transfer->startAt > now) {
+            delayed_.push_back(transfer);
+        } else {
+            addToMulti(transfer);
+        }
+    }
+
+    if (cancels.empty()) {
+        return;
+    }
+
+    for (auto& transfer : cancels) {
+        if (transfer->handle) {
+            removeFromMulti(transfer);
+        } else {
+            delayed_.erase(std::remove(delayed_.begin(), delayed_.end(), transfer), delayed_.end());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& transfer : cancels) {
+            transfers_.erase(transfer->id);
+        }
+    }
+    cancelCv_.notify_all();
+}
+
+void TransferEngine::startDueTransfers() {
+    if (delayed_.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Transfer>> due;
+
+    auto it = std::partition(delayed_.begin(), delayed_.end(),
+                             [now](const std::shared_ptr<Transfer>& t) { return t->startAt > now; });
+    due.assign(it, delayed_.end());
+    delayed_.erase(it, delayed_.end());
+
+    for (auto& transfer : due) {
+        if (!transfer->cancelled) {
+            addToMulti(transfer);
+        }
+    }
+}
+
+void TransferEngine::resumePausedTransfers() {
+    if (paused_.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto it = std::partition(paused_.begin(), paused_.end(),
+                             [now](const std::shared_ptr<Transfer>& t) { return t->resumeAt > now; });
+    std::vector<std::shared_ptr<Transfer>> due(it, paused_.end());
+    paused_.erase(it, paused_.end());
+
+    // Unpausing may call the write callback, which can pause the transfer again
+    for (auto& transfer : due) {
+        transfer->paused = false;
+        if (!transfer->handle) {
+            continue;
+        }
+
+        // A callback failing during the unpause ends the transfer without a
+        // CURLMSG_DONE, so report it here
+        CURLcode code = curl_easy_pause(transfer->handle, CURLPAUSE_CONT);
+        if (code != CURLE_OK) {
+            completeTransfer(transfer, code);
+        }
+    }
+}
+
+int TransferEngine::nextWaitMs() {
+    auto now = std::chrono::steady_clock::now();
+    int64_t waitMs = -1;
+
+    if (timerArmed_) {
+        waitMs = std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(timerDeadline_ - now).count());
+    }
+
+    for (const auto& transfer : delayed_) {
+        int64_t delay = std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(transfer->startAt - now).count());
+        if (waitMs < 0 || delay < waitMs) {
+            waitMs = delay;
+        }
+    }
+
+    for (const auto& transfer : paused_) {
+        int64_t delay = std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(transfer->resumeAt - now).count());
+        if (waitMs < 0 || delay < waitMs) {
+            waitMs = delay;
+        }
+    }
+
+    return static_cast<int>(waitMs);
+}
+
+void TransferEngine::addToMulti(const std::shared_ptr<Transfer>& transfer) {
+    const TransferRequest& request = transfer->request;
+
+    // Multiplexed streams must not pick up a connection another thread's
+    // blocking transfer opened: its socket is not watched by this loop
+    bool multiplex = request.multiplex && supportsMultiplexing();
+    CURL* curl = CurlHandlePool::getInstance().acquire(request.url, !multiplex, request.proxy);
+    if (!curl) {
+        TransferResult result;
+        result.error = "Failed to initialize CURL";
+
+        bool deliver;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            transfers_.erase(transfer->id);
+            deliver = !transfer->cancelled;
+        }
+        cancelCv_.notify_all();
+
+        if (deliver && request.completionCallback) {
+            request.completionCallback(transfer->id, result);
+        }
+        return;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, request.userAgent.c_str());
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, static_cast<long>(request.connectTimeoutSeconds));
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(request.lowSpeedTimeSeconds));
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, request.followRedirects ? 1L : 0L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 10L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (!request.proxy.empty()) {
+        curl_easy_setopt(curl, CURLOPT_PROXY, request.proxy.c_str());
+    }
+    SocketTuner::getInstance().apply(curl);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    CurlHandlePool::enableEarlyData(curl);
+
+    // Multiplexed transfers wait for a connection that can carry another
+    // stream instead of opening their own
+    if (multiplex) {
+#if LIBCURL_VERSION_NUM >= 0x075800
+        long version = preferHttp3_ ? CURL_HTTP_VERSION_3 : CURL_HTTP_VERSION_2TLS;
+#else
+        long version = CURL_HTTP_VERSION_2TLS;
+#endif
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, version);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_NONE));
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 0L);
+    }
+    
+    // Rate limiting cannot block the shared thread, let CURL pace the socket
+    if (request.maxRecvSpeed > 0) {
+        curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, static_cast<curl_off_t>(request.maxRecvSpeed));
+    }
+
+    for (const auto& header : request.headers) {
+        std::string headerStr = header.first + ": " + header.second;
+        transfer->headerList = curl_slist_append(transfer->headerList, headerStr.c_str());
+    }
+    if (transfer->headerList) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headerList);
+    }
+    
+    // Skip the resolver for prefetched hosts
+    transfer->resolveList = DnsCache::getInstance().apply(curl, request.url);
+
+    if (request.startByte > 0 || request.endByte >= 0) {
+        transfer->range = std::to_string(std::max<int64_t>(0, request.startByte)) + "-";
+        if (request.endByte >= 0) {
+            transfer->range += std::to_string(request.endByte);
+        }
+        curl_easy_setopt(curl, CURLOPT_RANGE, transfer->range.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+    if (request.keepHeaders) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, transfer.get());
+    }
+    // Long transfers feed the link figures while they run
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, transfer.get());
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+
+    transfer->handle = curl;
+    inMulti_[curl] = transfer;
+    curl_multi_add_handle(multi_, curl);
+}
+
+void TransferEngine::removeFromMulti(const std::shared_ptr<Transfer>& transfer) {
+    if (!transfer->handle) {
+        return;
+    }
+
+    curl_multi_remove_handle(multi_, transfer->handle);
+    inMulti_.erase(transfer->handle);
+    if (transfer->paused) {
+        paused_.erase(std::remove(paused_.begin(), paused_.end(), transfer), paused_.end());
+        transfer->paused = false;
+    }
+    CurlHandlePool::getInstance().release(transfer->request.url, transfer->handle, transfer->request.proxy);
+    transfer->handle = nullptr;
+
+    if (transfer->headerList) {
+        curl_slist_free_all(transfer->headerList);
+        transfer->headerList = nullptr;
+    }
+    if (transfer->resolveList) {
+        curl_slist_free_all(transfer->resolveList);
+        transfer->resolveList = nullptr;
+    }
+}
+
+void TransferEngine::checkMultiInfo() {
+    CURLMsg* message = nullptr;
+    int remaining = 0;
+
+    while ((message = curl_multi_info_read(multi_, &remaining)) != nullptr) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        auto it = inMulti_.find(message->easy_handle);
+        if (it == inMulti_.end()) {
+            continue;
+        }
+
+        // Copy first, completing erases the map entry
+        std::shared_ptr<Transfer> transfer = it->second;
+        completeTransfer(transfer, message->data.result);
+    }
+}
+
+void TransferEngine::completeTransfer(const std::shared_ptr<Transfer>& transfer, CURLcode code) {
+    LinkStats::getInstance().recordTransfer(transfer->handle, code);
+    
+    TransferResult result;
+    long statusCode = 0;
+    curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &statusCode);
+    result.statusCode = static_cast<int>(statusCode);
+    result.curlCode = code;
+    result.aborted = transfer->aborted;
+#if LIBCURL_VERSION_NUM >= 0x074200
+    curl_off_t retryAfter = 0;
+    if (curl_easy_getinfo(transfer->handle, CURLINFO_RETRY_AFTER, &retryAfter) == CURLE_OK && retryAfter > 0) {
+        result.retryAfter = static_cast<int>(std::min<curl_off_t>(retryAfter, INT32_MAX));
+    }
+#endif
+
+    // FTP failures are reported as CURL errors, not reply codes
+    if (result.curlCode == CURLE_OK && (statusCode < 400 || HttpClient::isFtpUrl(transfer->request.url))) {
+        result.success = true;
+    } else if (!transfer->error.empty()) {
+        result.error = transfer->error;
+    } else if (transfer->aborted) {
+        result.error = "Transfer aborted";
+    } else if (result.curlCode != CURLE_OK) {
+        result.error = curl_easy_strerror(result.curlCode);
+    } else {
+        result.error = "HTTP error " + std::to_string(statusCode);
+    }
+    
+    if (transfer->request.keepHeaders) {
+        result.headers = std::move(transfer->headers);
+        char* effectiveUrl = nullptr;
+        if (curl_easy_getinfo(transfer->handle, CURLINFO_EFFECTIVE_URL, &effectiveUrl) == CURLE_OK && effectiveUrl) {
+            result.effectiveUrl = effectiveUrl;
+        }
+    }
+
+    removeFromMulti(transfer);
+
+    bool deliver;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        transfers_.erase(transfer->id);
+        deliver = !transfer->cancelled;
+    }
+    cancelCv_.notify_all();
+
+    if (deliver && transfer->request.completionCallback) {
+        try {
+            transfer->request.completionCallback(transfer->id, result);
+        } catch (const std::exception& e) {
+            dm::utils::Logger::error("Exception in transfer completion callback: " + std::string(e.what()));
+        }
+    }
+}
+
+int TransferEngine::socketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp) {
+    TransferEngine* engine = static_cast<TransferEngine*>(userp);
+
+    // libcurl names a transfer's socket only once it is done, the link samples need it before
+    auto it = engine->inMulti_.find(easy);
+    if (it != engine->inMulti_.end()) {
+        it->second->socket = what == CURL_POLL_REMOVE ? CURL_SOCKET_BAD : s;
+    }
+
+#ifdef __linux__
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(engine->epollFd_, EPOLL_CTL_DEL, s, nullptr);
+        return 0;
+    }
+
+    epoll_event ev{};
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+
+    if (socketp) {
+        epoll_ctl(engine->epollFd_, EPOLL_CTL_MOD, s, &ev);
+    } else {
+        epoll_ctl(engine->epollFd_, EPOLL_CTL_ADD, s, &ev);
+        curl_multi_assign(engine->multi_, s, engine);
+    }
+#else
+    (void)socketp;
+#endif
+    return 0;
+}
+
+int TransferEngine::timerCallback(CURLM* multi, long timeoutMs, void* userp) {
+    (void)multi;
+    TransferEngine* engine = static_cast<TransferEngine*>(userp);
+
+    if (timeoutMs < 0) {
+        engine->timerArmed_ = false;
+    } else {
+        engine->timerArmed_ = true;
+        engine->timerDeadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    }
+
+    return 0;
+}
+
+size_t TransferEngine::writeCallback(char* data, size_t size, size_t nmemb, void* userp) {
+    size_t realSize = size * nmemb;
+    Transfer* transfer = static_cast<Transfer*>(userp);
+
+    if (transfer->cancelled) {
+        return 0;
+    }
+
+    // A 200 reply to a range request carries the whole file, not our segment
+    if (!transfer->rangeChecked) {
+        transfer->rangeChecked = true;
+        long statusCode = 0;
+        curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &statusCode);
+        if (transfer->request.startByte > 0 && statusCode == 200) {
+            transfer->aborted = true;
+            transfer->error = "Server ignored range request";
+            return 0;
+        }
+    }
+
+    // Out of bandwidth: pause and let the loop retry the same chunk shortly
+    if (transfer->request.throttler && !transfer->request.throttler->requestWithTimeout(
+            static_cast<int64_t>(realSize), 0)) {
+        auto it = transfer->engine->inMulti_.find(transfer->handle);
+        if (it != transfer->engine->inMulti_.end()) {
+            transfer->paused = true;
+            transfer->resumeAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+            transfer->engine->paused_.push_back(it->second);
+            return CURL_WRITEFUNC_PAUSE;
+        }
+    }
+
+    try {
+        if (transfer->request.dataCallback && !transfer->request.dataCallback(data, realSize)) {
+            transfer->aborted = true;
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        transfer->aborted = true;
+        transfer->error = "Exception in data callback: " + std::string(e.what());
+        return 0;
+    }
+
+    return realSize;
+}
+
+int TransferEngine::progressCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    Transfer* transfer = static_cast<Transfer*>(clientp);
+    LinkStats::getInstance().sampleTransfer(transfer->handle, &transfer->socket,
+                                            transfer->socket != CURL_SOCKET_BAD ? 1 : 0, transfer->nextLinkSample);
+    return 0;
+}
+
+size_t TransferEngine::headerCallback(char* data, size_t size, size_t nmemb, void* userp) {
+    size_t realSize = size * nmemb;
+    Transfer* transfer = static_cast<Transfer*>(userp);
+
+    if (transfer->cancelled) {
+        return 0;
+    }
+
+    try {
+        transfer->headers.addLine(std::string_view(data, realSize));
+    } catch (const std::exception& e) {
+        transfer->aborted = true;
+        transfer->error = "Exception in header callback: " + std::string(e.what());
+        return 0;
+    }
+
+    return realSize;
+}
+
+} // namespace core
+} // namespace dm
@@ -0,0 +1,185 @@
+#include "core/ValidatorCache.h"
+#include "utils/Logger.h"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+const char VALIDATOR_CACHE_HEADER[] = "# dm validator cache 1";
+const size_t VALIDATOR_CACHE_FIELDS = 7;        // Before the path, which is last
+
+} // anonymous namespace
+
+ValidatorCache& ValidatorCache::getInstance() {
+    static ValidatorCache instance;
+    return instance;
+}
+
+void ValidatorCache::record(const std::string& url, const std::string& filePath, const std::string& etag,
+                            const std::string& lastModified, dm::utils::HashAlgorithm hashAlgorithm,
+                            const std::string& hash) {
+    if (etag.empty() && lastModified.empty()) {
+        forget(url);
+        return;
+    }
+
+    CachedValidators validators;
+    validators.etag = etag;
+    validators.lastModified = lastModified;
+    validators.filePath = filePath;
+    validators.hashAlgorithm = hashAlgorithm;
+    validators.hash = hash;
+
+    std::error_code error;
+    validators.fileSize = std::filesystem::file_size(filePath, error);
+    if (!error) {
+        validators.modified = std::filesystem::last_write_time(filePath, error);
+    }
+    if (error) {
+        dm::utils::Logger::warning("Not recording validators for " + url + ": " + error.message());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[url] = std::move(validators);
+}
+
+bool ValidatorCache::find(const std::string& url, CachedValidators& validators) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(url);
+        if (it == entries_.end()) {
+            return false;
+        }
+        validators = it->second;
+    }
+
+    // A copy edited or removed since says nothing about the server's version
+    if (!isUnchanged(validators)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(url);
+        if (it != entries_.end() && it->second.filePath == validators.filePath &&
+            it->second.modified == validators.modified) {
+            entries_.erase(it);
+        }
+        return false;
+    }
+    return true;
+}
+
+void ValidatorCache::forget(const std::string& url) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(url);
+}
+
+bool ValidatorCache::isUnchanged(const CachedValidators& validators) {
+    std::error_code error;
+    if (std::filesystem::file_size(validators.filePath, error) != validators.fileSize || error) {
+        return false;
+    }
+    return std::filesystem::last_write_time(validators.filePath, error) == validators.modified && !error;
+}
+
+bool ValidatorCache::save(const std::string& path) {
+    std::map<std::string, CachedValidators> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries = entries_;
+    }
+
+    // Written aside and renamed, a crash never leaves half a cache
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::trunc);
+    if (!out) {
+        dm::utils::Logger::error("Failed to write validator cache: " + path);
+        return false;
+    }
+
+    out << VALIDATOR_CACHE_HEADER << '\n';
+    size_t written = 0;
+    for (const auto& item : entries) {
+        const CachedValidators& validators = item.second;
+        if (!isUnchanged(validators)) {
+            continue;
+        }
+
+        // URLs, ETags and HTTP dates never contain tabs
+        out << validators.fileSize << '\t' << validators.modified.time_since_epoch().count() << '\t'
+            << dm::utils::HashCalculator::getAlgorithmName(validators.hashAlgorithm) << '\t'
+            << validators.hash << '\t' << validators.etag << '\t' << validators.lastModified << '\t'
+            << item.first << '\t' << validators.filePath << '\n';
+        written++;
+    }
+    out.close();
+
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        dm::utils::Logger::error("Failed to write validator cache: " + path);
+        return false;
+    }
+
+    dm::utils::Logger::debug("Saved validators of " + std::to_string(written) + " downloads to " + path);
+    return true;
+}
+
+bool ValidatorCache::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != VALIDATOR_CACHE_HEADER) {
+        dm::utils::Logger::warning("Ignoring validator cache in an unknown format: " + path);
+        return false;
+    }
+
+    std::vector<std::pair<std::string, CachedValidators>> entries;
+    while (std::getline(in, line)) {
+        // The path is last, it may contain anything but a newline
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (fields.size() < VALIDATOR_CACHE_FIELDS) {
+            size_t tab = line.find('\t', start);
+            if (tab == std::string::npos) {
+                break;
+            }
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+
+        CachedValidators validators;
+        if (fields.size() < VALIDATOR_CACHE_FIELDS ||
+            !dm::utils::HashCalculator::parseAlgorithm(fields[2], validators.hashAlgorithm)) {
+            continue;
+        }
+        try {
+            validators.fileSize = std::stoull(fields[0]);
+            validators.modified = std::filesystem::file_time_type(
+                std::filesystem::file_time_type::duration(std::stoll(fields[1])));
+        } catch (const std::exception&) {
+            continue;
+        }
+        validators.hash = fields[3];
+        validators.etag = fields[4];
+        validators.lastModified = fields[5];
+        validators.filePath = line.substr(start);
+        entries.emplace_back(fields[6], std::move(validators));
+    }
+
+    // Entries recorded during this run are newer
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries) {
+        entries_.emplace(std::move(entry));
+    }
+    dm::utils::Logger::debug("Loaded validators of " + std::to_string(entries.size()) + " downloads from " + path);
+    return true;
+}
+
+} // namespace core
+} // namespace dm
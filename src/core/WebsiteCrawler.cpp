@@ -1,645 +1,1202 @@
-#include "../../include/core/WebsiteCrawler.h"
-#include "../../include/utils/Logger.h"
-#include "../../include/utils/UrlParser.h"
-#include "../../include/core/HttpClient.h"
-
-#include <regex>
-#include <queue>
-#include <set>
+#include "core/WebsiteCrawler.h"
+#include "core/DownloadManager.h"
+#include "core/HttpClient.h"
+#include "core/DnsCache.h"
+#include "utils/Logger.h"
+#include "utils/HtmlLinkScanner.h"
+#include "utils/UrlFingerprintSet.h"
+#include "utils/FileUtils.h"
+#include "utils/UrlParser.h"
+
+#include <curl/curl.h>
 #include <algorithm>
-#include <thread>
-#include <chrono>
-#include <functional>
-
-namespace DownloadManager {
-namespace Core {
-
-WebsiteCrawler::WebsiteCrawler() :
-    m_isRunning(false),
-    m_maxDepth(3),
-    m_maxPages(100),
-    m_delay(0),
-    m_followExternalLinks(false),
-    m_respectRobotsTxt(true),
-    m_crawlerThread(nullptr)
-{
-    // Initialize default file extension patterns
-    m_fileExtensions = {
-        ".zip", ".rar", ".7z", ".tar", ".gz", ".bz2", ".xz",
-        ".exe", ".msi", ".dmg", ".pkg", ".deb", ".rpm",
-        ".pdf", ".doc", ".docx", ".xls", ".xlsx", ".ppt", ".pptx",
-        ".mp3", ".mp4", ".avi", ".mkv", ".mov", ".flv", ".wmv",
-        ".jpg", ".jpeg", ".png", ".gif", ".bmp", ".svg", ".tif", ".tiff",
-        ".iso", ".img"
-    };
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+namespace dm {
+namespace core {
+
+namespace {
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+bool startsWith(const std::string& text, const std::string& prefix) {
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Trim whitespace, which HTML allows around attribute URLs
+std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n\f");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r\n\f");
+    return text.substr(start, end - start + 1);
+}
+
+// An absolute http(s) URL with nothing for libcurl to escape
+bool isPlainHttpUrl(const std::string& url) {
+    std::string scheme = toLower(url.substr(0, 8));
+    if (!startsWith(scheme, "http://") && !startsWith(scheme, "https://")) {
+        return false;
+    }
+    return std::all_of(url.begin(), url.end(), [](char c) { return c > 0x20 && c < 0x7f && c != '\\'; });
+}
+
+// The robots.txt URL of the origin serving a URL
+std::string getRobotsUrl(const std::string& url) {
+    CURLU* handle = curl_url();
+    if (!handle) {
+        return "";
+    }
+
+    std::string robotsUrl;
+    if (curl_url_set(handle, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK &&
+        curl_url_set(handle, CURLUPART_PATH, "/robots.txt", 0) == CURLUE_OK &&
+        curl_url_set(handle, CURLUPART_QUERY, nullptr, 0) == CURLUE_OK &&
+        curl_url_set(handle, CURLUPART_FRAGMENT, nullptr, 0) == CURLUE_OK) {
+        robotsUrl = dm::utils::UrlParser::getPart(handle, CURLUPART_URL);
+    }
+    curl_url_cleanup(handle);
+    return robotsUrl;
+}
+
+bool isHtmlContentType(const std::string& contentType) {
+    std::string type = toLower(contentType);
+    return type.find("text/html") != std::string::npos ||
+           type.find("application/xhtml") != std::string::npos;
+}
+
+// Robots files are only parsed up to this size
+const size_t MAX_ROBOTS_SIZE = 512 * 1024;
+
+// Fetch a robots.txt, false if there is none to obey
+bool fetchRobotsTxt(HttpClient& client, const std::string& robotsUrl, std::string& content) {
+    content.clear();
+    bool tooLarge = false;
+    HttpResponse response = client.get(robotsUrl, [&content, &tooLarge](const char* data, size_t size) -> bool {
+        size_t room = MAX_ROBOTS_SIZE - content.size();
+        content.append(data, std::min(size, room));
+        tooLarge = size > room;
+        return !tooLarge;
+    });
+    return (response.success || tooLarge) && response.statusCode == 200;
+}
+
+} // namespace
+
+WebsiteCrawler::WebsiteCrawler(DownloadManager& downloadManager)
+    : downloadManager_(downloadManager),
+      running_(false),
+      paused_(false),
+      stopRequested_(false),
+      pagesVisited_(0),
+      totalUrls_(0),
+      resourcesFound_(0),
+      downloadQueued_(0),
+      visited_(new dm::utils::UrlFingerprintSet()) {
 }
 
 WebsiteCrawler::~WebsiteCrawler() {
-    stop();
+    stopCrawling();
+    joinWorkers();
+
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    clearFoundUrls();
 }
 
-void WebsiteCrawler::start(const std::string& startUrl) {
-    if (m_isRunning) {
-        Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-            "Crawler already running");
-        return;
+bool WebsiteCrawler::startCrawling(const std::string& startUrl,
+                                  const CrawlOptions& options,
+                                  CrawlProgressCallback progressCallback) {
+    if (running_) {
+        dm::utils::Logger::warning("Crawler is already running");
+        return false;
     }
-    
-    // Validate starting URL
-    Utils::UrlParser urlParser;
-    auto parsedUrl = urlParser.parse(startUrl);
-    
-    if (!parsedUrl.valid) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Invalid starting URL: " + startUrl);
-        return;
+
+    // Threads of a finished crawl may still be winding down
+    joinWorkers();
+
+    std::string normalized;
+    std::string host;
+    if (!normalizeUrl(startUrl, "", normalized, host)) {
+        dm::utils::Logger::error("Invalid start URL: " + startUrl);
+        return false;
     }
-    
-    // Clear previous results
+
+    // Reset state
+    options_ = options;
+    options_.maxConcurrent = std::max(1, options_.maxConcurrent);
+    options_.maxConnectionsPerHost = std::max(1, options_.maxConnectionsPerHost);
+    progressCallback_ = progressCallback;
+    startUrl_ = normalized;
+    limiterOwner_ = "crawler:" + std::to_string(reinterpret_cast<uintptr_t>(this));
+    startHost_ = host;
+    baseDomain_ = startsWith(host, "www.") ? host.substr(4) : host;
+    includePatterns_ = compilePatterns(options_.includePatterns);
+    excludePatterns_ = compilePatterns(options_.excludePatterns);
+    allowedDomains_ = dm::utils::DomainMatcher(options_.allowedDomains);
+
+    pagesVisited_ = 0;
+    totalUrls_ = 0;
+    resourcesFound_ = 0;
+    downloadQueued_ = 0;
+    pagesDropped_ = 0;
+    pagesStarted_ = 0;
+    pendingPages_ = 0;
+    finished_ = false;
+    paused_ = false;
+    stopRequested_ = false;
+
     {
-        std::lock_guard<std::mutex> lock(m_crawlMutex);
-        m_foundUrls.clear();
-        m_visitedUrls.clear();
-        m_downloadableFiles.clear();
-        m_baseUrl = parsedUrl.scheme + "://" + parsedUrl.host;
-        m_baseDomain = parsedUrl.host;
-    }
-    
-    m_isRunning = true;
-    m_crawlerThread = std::make_unique<std::thread>(&WebsiteCrawler::crawl, this, startUrl);
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-        "Website crawler started with URL: " + startUrl);
-}
-
-void WebsiteCrawler::stop() {
-    if (!m_isRunning) {
-        return;
+        std::lock_guard<std::mutex> lock(frontierMutex_);
+        hosts_.clear();
+        readyHosts_ = decltype(readyHosts_)();
+        frontierSize_ = 0;
     }
-    
-    m_isRunning = false;
-    if (m_crawlerThread && m_crawlerThread->joinable()) {
-        m_crawlerThread->join();
+    {
+        std::lock_guard<std::mutex> lock(parseMutex_);
+        parseQueue_.clear();
+        parseQueueCapacity_ = static_cast<size_t>(options_.maxConcurrent) * 2;
     }
-    
-    Utils::Logger::instance().log(Utils::LogLevel::INFO, "Website crawler stopped");
+    {
+        std::lock_guard<std::mutex> lock(resourceMutex_);
+        resourceQueue_.clear();
+    }
+    // Replacing the set deletes the last crawl's spill files
+    visited_.reset();
+    visited_.reset(new dm::utils::UrlFingerprintSet(options_.maxUrlMemory, options_.spillDirectory));
+    {
+        std::lock_guard<std::mutex> lock(resultsMutex_);
+        clearFoundUrls();
+        downloadedResources_.clear();
+        errors_.clear();
+
+        if (!options_.spillDirectory.empty() && dm::utils::FileUtils::createDirectory(options_.spillDirectory)) {
+            std::string name = "crawl-" + std::to_string(
+                std::chrono::steady_clock::now().time_since_epoch().count()) + "-found.txt";
+            foundUrlsPath_ = dm::utils::FileUtils::combinePaths(options_.spillDirectory, name);
+            foundUrlsFile_ = std::fopen(foundUrlsPath_.c_str(), "w+b");
+            if (!foundUrlsFile_) {
+                dm::utils::Logger::warning("Cannot create " + foundUrlsPath_ + ", keeping found URLs in memory");
+                foundUrlsPath_.clear();
+            }
+        }
+    }
+
+    markVisited(normalized);
+    {
+        std::lock_guard<std::mutex> lock(resultsMutex_);
+        appendFoundUrls({normalized});
+    }
+    totalUrls_ = 1;
+
+    if (options_.maxPages <= 0 || !addToFrontier(FrontierEntry{normalized, host, 0})) {
+        dm::utils::Logger::error("Nothing to crawl at " + startUrl);
+        return false;
+    }
+
+    running_ = true;
+
+    // Parsing is cheaper than fetching, fewer threads keep up
+    int parseWorkers = std::max(1, options_.maxConcurrent / 2);
+    try {
+        for (int i = 0; i < options_.maxConcurrent; i++) {
+            workerThreads_.emplace_back(&WebsiteCrawler::fetchWorker, this);
+        }
+        for (int i = 0; i < parseWorkers; i++) {
+            workerThreads_.emplace_back(&WebsiteCrawler::parseWorker, this);
+        }
+        workerThreads_.emplace_back(&WebsiteCrawler::resourceWorker, this);
+    } catch (const std::system_error& e) {
+        dm::utils::Logger::error("Failed to start crawler threads: " + std::string(e.what()));
+        stopCrawling();
+        return false;
+    }
+
+    dm::utils::Logger::info("Started crawling " + normalized + " with " +
+                            std::to_string(options_.maxConcurrent) + " fetch and " +
+                            std::to_string(parseWorkers) + " parse workers");
+    return true;
 }
 
-bool WebsiteCrawler::isRunning() const {
-    return m_isRunning;
+bool WebsiteCrawler::pauseCrawling() {
+    if (!running_ || paused_) {
+        return false;
+    }
+
+    paused_ = true;
+    dm::utils::Logger::info("Crawler paused");
+    return true;
 }
 
-void WebsiteCrawler::setMaxDepth(int depth) {
-    if (depth >= 0) {
-        m_maxDepth = depth;
+bool WebsiteCrawler::resumeCrawling() {
+    if (!running_ || !paused_) {
+        return false;
     }
+
+    paused_ = false;
+    notifyAll();
+    dm::utils::Logger::info("Crawler resumed");
+    return true;
 }
 
-int WebsiteCrawler::getMaxDepth() const {
-    return m_maxDepth;
+bool WebsiteCrawler::stopCrawling() {
+    if (!running_) {
+        return false;
+    }
+
+    stopRequested_ = true;
+    paused_ = false;
+    notifyAll();
+    joinWorkers();
+    HostConnectionLimiter::getInstance().withdraw(limiterOwner_);
+
+    running_ = false;
+    dm::utils::Logger::info("Crawler stopped");
+    return true;
+}
+
+bool WebsiteCrawler::isRunning() const {
+    return running_;
+}
+
+bool WebsiteCrawler::isPaused() const {
+    return paused_;
+}
+
+void WebsiteCrawler::getStatistics(int& pagesVisited, int& totalUrls,
+                                  int& resourcesFound, int& downloadQueued) const {
+    pagesVisited = pagesVisited_;
+    totalUrls = totalUrls_;
+    resourcesFound = resourcesFound_;
+    downloadQueued = downloadQueued_;
+}
+
+int WebsiteCrawler::getDroppedPages() const {
+    return pagesDropped_;
 }
 
-void WebsiteCrawler::setMaxPages(int pages) {
-    if (pages >= 0) {
-        m_maxPages = pages;
+std::vector<std::string> WebsiteCrawler::getFoundUrls() const {
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+
+    std::vector<std::string> urls;
+    if (foundUrlsFile_) {
+        std::fflush(foundUrlsFile_);
+        std::ifstream file(foundUrlsPath_, std::ios::binary);
+        std::string line;
+        while (std::getline(file, line)) {
+            urls.push_back(line);
+        }
+        return urls;
+    }
+
+    size_t start = 0;
+    while (start < foundUrls_.size()) {
+        size_t end = foundUrls_.find('\n', start);
+        urls.push_back(foundUrls_.substr(start, end - start));
+        start = end + 1;
     }
+    return urls;
 }
 
-int WebsiteCrawler::getMaxPages() const {
-    return m_maxPages;
+std::vector<std::string> WebsiteCrawler::getDownloadedResources() const {
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    return downloadedResources_;
 }
 
-void WebsiteCrawler::setDelay(int milliseconds) {
-    if (milliseconds >= 0) {
-        m_delay = milliseconds;
+std::map<std::string, std::string> WebsiteCrawler::getErrors() const {
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    return errors_;
+}
+
+bool WebsiteCrawler::isAllowedByRobotsTxt(const std::string& url, const std::string& userAgent) {
+    std::string robotsUrl = getRobotsUrl(url);
+    if (robotsUrl.empty()) {
+        return true;
+    }
+
+    HttpClient client;
+    client.setUserAgent(userAgent);
+    client.setTimeout(FETCH_TIMEOUT_SECONDS);
+    client.setAcceptCompression(true);
+
+    std::string content;
+    if (!fetchRobotsTxt(client, robotsUrl, content)) {
+        // No robots.txt means no restrictions
+        return true;
     }
+
+    return matchesRobotsRules(getPath(url), parseRobotsTxt(content, userAgent));
 }
 
-int WebsiteCrawler::getDelay() const {
-    return m_delay;
+ResourceType WebsiteCrawler::detectResourceType(const std::string& url, const std::string& contentType) {
+    std::string type = toLower(contentType);
+    if (!type.empty()) {
+        if (isHtmlContentType(type)) {
+            return ResourceType::HTML_PAGE;
+        }
+        if (startsWith(type, "image/")) {
+            return ResourceType::IMAGE;
+        }
+        if (startsWith(type, "video/")) {
+            return ResourceType::VIDEO;
+        }
+        if (startsWith(type, "audio/")) {
+            return ResourceType::AUDIO;
+        }
+        if (type.find("pdf") != std::string::npos || type.find("msword") != std::string::npos ||
+            type.find("officedocument") != std::string::npos || startsWith(type, "text/plain")) {
+            return ResourceType::DOCUMENT;
+        }
+        if (type.find("zip") != std::string::npos || type.find("rar") != std::string::npos ||
+            type.find("tar") != std::string::npos || type.find("7z") != std::string::npos) {
+            return ResourceType::ARCHIVE;
+        }
+        if (type.find("msdownload") != std::string::npos || type.find("executable") != std::string::npos) {
+            return ResourceType::EXECUTABLE;
+        }
+    }
+
+    static const std::vector<std::pair<ResourceType, std::vector<std::string>>> extensions = {
+        {ResourceType::HTML_PAGE, {"html", "htm", "xhtml", "php", "asp", "aspx", "jsp"}},
+        {ResourceType::IMAGE, {"jpg", "jpeg", "png", "gif", "bmp", "webp", "svg", "ico", "tiff"}},
+        {ResourceType::VIDEO, {"mp4", "mkv", "avi", "mov", "wmv", "flv", "webm", "m4v"}},
+        {ResourceType::AUDIO, {"mp3", "wav", "ogg", "flac", "aac", "m4a", "wma"}},
+        {ResourceType::DOCUMENT, {"pdf", "doc", "docx", "xls", "xlsx", "ppt", "pptx", "txt", "rtf", "odt"}},
+        {ResourceType::ARCHIVE, {"zip", "rar", "7z", "tar", "gz", "bz2", "xz", "iso"}},
+        {ResourceType::EXECUTABLE, {"exe", "msi", "dmg", "deb", "rpm", "apk", "appimage"}}
+    };
+
+    for (const auto& group : extensions) {
+        for (const auto& extension : group.second) {
+            if (hasFileExtension(url, extension)) {
+                return group.first;
+            }
+        }
+    }
+
+    if (!type.empty()) {
+        return ResourceType::OTHER;
+    }
+
+    // Without a content type, a path with no extension is most likely a page
+    std::string path = url.substr(0, url.find_first_of("?#"));
+    size_t slash = path.rfind('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return name.find('.') == std::string::npos ? ResourceType::HTML_PAGE : ResourceType::OTHER;
 }
 
-void WebsiteCrawler::setFollowExternalLinks(bool follow) {
-    m_followExternalLinks = follow;
+bool WebsiteCrawler::hasFileExtension(const std::string& url, const std::string& extension) {
+    std::string wanted = toLower(extension);
+    if (!wanted.empty() && wanted.front() == '.') {
+        wanted.erase(0, 1);
+    }
+    if (wanted.empty()) {
+        return false;
+    }
+
+    // Only the last path segment counts, not the query
+    std::string path = url.substr(0, url.find_first_of("?#"));
+    size_t slash = path.rfind('/');
+    size_t schemeEnd = path.find("://");
+    if (slash == std::string::npos || (schemeEnd != std::string::npos && slash < schemeEnd + 3)) {
+        return false;
+    }
+    std::string name = toLower(path.substr(slash + 1));
+
+    return name.size() > wanted.size() &&
+           name.compare(name.size() - wanted.size(), wanted.size(), wanted) == 0 &&
+           name[name.size() - wanted.size() - 1] == '.';
 }
 
-bool WebsiteCrawler::getFollowExternalLinks() const {
-    return m_followExternalLinks;
+void WebsiteCrawler::fetchWorker() {
+    HttpClient client;
+    client.setUserAgent(options_.userAgent);
+    client.setTimeout(FETCH_TIMEOUT_SECONDS);
+    client.setAcceptCompression(options_.acceptCompression);
+    client.followRedirects(true);
+
+    dm::utils::HtmlLinkScanner scanner;
+    FrontierEntry entry;
+    while (takeFromFrontier(entry)) {
+        // Claim a slot against the page limit
+        if (pagesStarted_.fetch_add(1) >= options_.maxPages) {
+            releaseHost(entry);
+            clearFrontier();
+            finishPage();
+            continue;
+        }
+
+        fetchPage(client, scanner, entry);
+    }
 }
 
-void WebsiteCrawler::setRespectRobotsTxt(bool respect) {
-    m_respectRobotsTxt = respect;
+void WebsiteCrawler::parseWorker() {
+    std::unique_lock<std::mutex> lock(parseMutex_);
+
+    while (true) {
+        parseChanged_.wait(lock, [this]() {
+            return stopRequested_ || finished_ || !parseQueue_.empty();
+        });
+        if (stopRequested_ || parseQueue_.empty()) {
+            return;
+        }
+
+        FetchedPage page = std::move(parseQueue_.front());
+        parseQueue_.pop_front();
+        lock.unlock();
+
+        // A fetch worker may be waiting for room
+        parseChanged_.notify_all();
+
+        processPage(page);
+        finishPage();
+
+        lock.lock();
+    }
 }
 
-bool WebsiteCrawler::getRespectRobotsTxt() const {
-    return m_respectRobotsTxt;
+void WebsiteCrawler::resourceWorker() {
+    std::unique_lock<std::mutex> lock(resourceMutex_);
+
+    while (true) {
+        resourceChanged_.wait(lock, [this]() {
+            return stopRequested_ || finished_ || !resourceQueue_.empty();
+        });
+        if (stopRequested_ || resourceQueue_.empty()) {
+            break;
+        }
+
+        FoundResource resource = std::move(resourceQueue_.front());
+        resourceQueue_.pop_front();
+        lock.unlock();
+
+        handleResource(resource);
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    updateStatistics();
+
+    if (!stopRequested_) {
+        dm::utils::Logger::info("Crawling finished: " + std::to_string(pagesVisited_) + " pages, " +
+                                std::to_string(resourcesFound_) + " resources");
+        running_ = false;
+        if (options_.finishedHandler) {
+            options_.finishedHandler();
+        }
+    }
 }
 
-void WebsiteCrawler::setFileExtensions(const std::set<std::string>& extensions) {
-    m_fileExtensions = extensions;
+void WebsiteCrawler::fetchPage(HttpClient& client, dm::utils::HtmlLinkScanner& scanner,
+                               const FrontierEntry& entry) {
+    if (options_.respectRobotsTxt && !isAllowed(client, entry)) {
+        releaseHost(entry);
+        dm::utils::Logger::debug("Skipping URL disallowed by robots.txt: " + entry.url);
+        finishPage();
+        return;
+    }
+
+    // Scan the page as it arrives instead of buffering it, and skip
+    // bodies that are not HTML altogether
+    bool isHtml = true;
+    bool tooLarge = false;
+    size_t received = 0;
+    scanner.reset();
+
+    client.setHeadersCallback([&isHtml](const HttpHeaders& headers) -> bool {
+        std::string contentType(headers.getContentType());
+        isHtml = contentType.empty() || isHtmlContentType(contentType);
+        return isHtml;
+    });
+    auto scanData = [this, &scanner, &received, &tooLarge](const char* data, size_t size) -> bool {
+        if (stopRequested_) {
+            return false;
+        }
+        if (received + size > MAX_PAGE_SIZE) {
+            tooLarge = true;
+            return false;
+        }
+        received += size;
+        scanner.feed(data, size);
+        return true;
+    };
+
+    HttpResponse response = client.get(entry.url, scanData);
+    client.setHeadersCallback(nullptr);
+    releaseHost(entry);
+
+    if (stopRequested_) {
+        finishPage();
+        return;
+    }
+
+    if (!response.success && !tooLarge) {
+        recordError(entry.url, response.error.empty() ?
+                    "HTTP error " + std::to_string(response.statusCode) : response.error);
+        finishPage();
+        return;
+    }
+
+    pagesVisited_++;
+    std::string pageUrl = response.effectiveUrl.empty() ? entry.url : response.effectiveUrl;
+
+    if (!isHtml) {
+        // A linked file rather than a page
+        queueResource(FoundResource{pageUrl, std::string(response.headers.getContentType()),
+                                    response.contentLength});
+        updateStatistics();
+        finishPage();
+        return;
+    }
+
+    if (tooLarge) {
+        dm::utils::Logger::debug("Page larger than " + std::to_string(MAX_PAGE_SIZE) +
+                                 " bytes, using the links found so far: " + entry.url);
+    }
+
+    FetchedPage page;
+    page.url = pageUrl;
+    page.depth = entry.depth;
+    scanner.takeResults(page.links, page.resources, page.baseHref);
+
+    updateStatistics();
+
+    std::unique_lock<std::mutex> lock(parseMutex_);
+    parseChanged_.wait(lock, [this]() {
+        return stopRequested_ || parseQueue_.size() < parseQueueCapacity_;
+    });
+    if (stopRequested_) {
+        lock.unlock();
+        finishPage();
+        return;
+    }
+    parseQueue_.push_back(std::move(page));
+    lock.unlock();
+    parseChanged_.notify_all();
 }
 
-std::set<std::string> WebsiteCrawler::getFileExtensions() const {
-    return m_fileExtensions;
+void WebsiteCrawler::processPage(const FetchedPage& page) {
+    std::string baseUrl = page.url;
+    std::string host;
+    if (!page.baseHref.empty()) {
+        std::string resolved;
+        if (normalizeUrl(page.baseHref, page.url, resolved, host)) {
+            baseUrl = resolved;
+        }
+    }
+
+    bool followLinks = page.depth < options_.maxDepth;
+    std::vector<std::string> found;
+
+    for (const auto& link : page.links) {
+        std::string url;
+        if (!normalizeUrl(link, baseUrl, url, host)) {
+            continue;
+        }
+
+        // Links straight to known file types are resources, not pages
+        ResourceType type = detectResourceType(url, "");
+        if (type != ResourceType::HTML_PAGE && type != ResourceType::OTHER) {
+            if (markVisited(url)) {
+                found.push_back(url);
+                queueResource(FoundResource{url, "", -1});
+            }
+            continue;
+        }
+
+        if (!followLinks || !shouldCrawl(url, host) || !markVisited(url)) {
+            continue;
+        }
+
+        if (!addToFrontier(FrontierEntry{url, host, page.depth + 1})) {
+            pagesDropped_++;
+            dm::utils::Logger::debug("Crawl frontier full, dropping " + url);
+            continue;
+        }
+        found.push_back(url);
+    }
+
+    for (const auto& resource : page.resources) {
+        std::string url;
+        if (normalizeUrl(resource, baseUrl, url, host) && markVisited(url)) {
+            found.push_back(url);
+            queueResource(FoundResource{url, "", -1});
+        }
+    }
+
+    if (!found.empty()) {
+        totalUrls_ += static_cast<int>(found.size());
+        std::lock_guard<std::mutex> lock(resultsMutex_);
+        appendFoundUrls(found);
+    }
+
+    updateStatistics();
 }
 
-void WebsiteCrawler::addFileExtension(const std::string& extension) {
-    // Ensure extension starts with a dot
-    std::string ext = extension;
-    if (!ext.empty() && ext[0] != '.') {
-        ext = "." + ext;
+bool WebsiteCrawler::takeFromFrontier(FrontierEntry& entry) {
+    std::unique_lock<std::mutex> lock(frontierMutex_);
+
+    while (true) {
+        if (stopRequested_ || finished_) {
+            return false;
+        }
+
+        if (paused_ || readyHosts_.empty()) {
+            frontierChanged_.wait(lock);
+            continue;
+        }
+
+        // Wait for the host whose delay runs out first
+        ReadyHost ready = readyHosts_.top();
+        auto now = std::chrono::steady_clock::now();
+        if (ready.first > now) {
+            frontierChanged_.wait_until(lock, ready.first);
+            continue;
+        }
+        readyHosts_.pop();
+
+        auto it = hosts_.find(ready.second);
+        if (it == hosts_.end()) {
+            continue;
+        }
+        HostQueue& host = it->second;
+        host.scheduled = false;
+        if (host.urls.empty() || host.inFlight >= options_.maxConnectionsPerHost) {
+            // Rescheduled when a request to the host finishes
+            continue;
+        }
+
+        // Downloads share the host's connections, a busy host is retried shortly
+        HostConnectionLimiter::Lease lease =
+            HostConnectionLimiter::getInstance().acquire(host.urls.front().url, limiterOwner_);
+        if (lease == 0) {
+            host.nextFetch = now + std::chrono::milliseconds(HOST_BUSY_RETRY_MS);
+            scheduleHost(ready.second, host);
+            continue;
+        }
+
+        entry = std::move(host.urls.front());
+        entry.lease = lease;
+        host.urls.pop_front();
+        frontierSize_--;
+        host.inFlight++;
+        host.nextFetch = now + options_.requestDelay;
+        scheduleHost(ready.second, host);
+        return true;
     }
-    
-    m_fileExtensions.insert(ext);
 }
 
-void WebsiteCrawler::removeFileExtension(const std::string& extension) {
-    // Ensure extension starts with a dot
-    std::string ext = extension;
-    if (!ext.empty() && ext[0] != '.') {
-        ext = "." + ext;
+bool WebsiteCrawler::addToFrontier(FrontierEntry entry) {
+    bool newHost = false;
+    std::string url = entry.url;
+    {
+        std::lock_guard<std::mutex> lock(frontierMutex_);
+        if (stopRequested_ || frontierSize_ >= options_.maxFrontierSize ||
+            pagesStarted_ >= options_.maxPages) {
+            return false;
+        }
+
+        auto it = hosts_.find(entry.host);
+        if (it == hosts_.end()) {
+            it = hosts_.emplace(entry.host, HostQueue()).first;
+            newHost = true;
+        }
+
+        std::string host = entry.host;
+        it->second.urls.push_back(std::move(entry));
+        frontierSize_++;
+        pendingPages_++;
+        scheduleHost(host, it->second);
+    }
+    frontierChanged_.notify_one();
+
+    // Resolve the host while its first page waits in the queue
+    if (newHost) {
+        DnsCache::getInstance().prefetch(url);
     }
-    
-    m_fileExtensions.erase(ext);
+    return true;
 }
 
-void WebsiteCrawler::addUrlFilter(const std::string& pattern) {
-    try {
-        std::regex re(pattern);
-        m_urlFilters.push_back(pattern);
-    } 
-    catch (const std::regex_error& e) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Invalid regex pattern: " + pattern + " (" + e.what() + ")");
+void WebsiteCrawler::releaseHost(const FrontierEntry& entry) {
+    HostConnectionLimiter::getInstance().release(entry.lease);
+
+    {
+        std::lock_guard<std::mutex> lock(frontierMutex_);
+        auto it = hosts_.find(entry.host);
+        if (it == hosts_.end()) {
+            return;
+        }
+        it->second.inFlight--;
+        scheduleHost(entry.host, it->second);
     }
+    frontierChanged_.notify_one();
 }
 
-void WebsiteCrawler::clearUrlFilters() {
-    m_urlFilters.clear();
+void WebsiteCrawler::scheduleHost(const std::string& name, HostQueue& host) {
+    if (host.scheduled || host.urls.empty() || host.inFlight >= options_.maxConnectionsPerHost) {
+        return;
+    }
+
+    host.scheduled = true;
+    readyHosts_.emplace(host.nextFetch, name);
 }
 
-std::vector<std::string> WebsiteCrawler::getUrlFilters() const {
-    return m_urlFilters;
+void WebsiteCrawler::clearFrontier() {
+    size_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(frontierMutex_);
+        for (auto& pair : hosts_) {
+            dropped += pair.second.urls.size();
+            pair.second.urls.clear();
+        }
+        frontierSize_ = 0;
+    }
+
+    for (size_t i = 0; i < dropped; i++) {
+        finishPage();
+    }
 }
 
-std::vector<std::string> WebsiteCrawler::getDownloadableFiles() const {
-    std::lock_guard<std::mutex> lock(m_crawlMutex);
-    return std::vector<std::string>(m_downloadableFiles.begin(), m_downloadableFiles.end());
+void WebsiteCrawler::finishPage() {
+    if (pendingPages_.fetch_sub(1) == 1) {
+        finished_ = true;
+        notifyAll();
+    }
 }
 
-std::vector<std::string> WebsiteCrawler::getVisitedUrls() const {
-    std::lock_guard<std::mutex> lock(m_crawlMutex);
-    return std::vector<std::string>(m_visitedUrls.begin(), m_visitedUrls.end());
+void WebsiteCrawler::queueResource(FoundResource resource) {
+    {
+        std::lock_guard<std::mutex> lock(resourceMutex_);
+        resourceQueue_.push_back(std::move(resource));
+    }
+    resourceChanged_.notify_one();
 }
 
-void WebsiteCrawler::addCrawlProgressCallback(const CrawlProgressCallback& callback) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    m_progressCallbacks.push_back(callback);
+bool WebsiteCrawler::markVisited(const std::string& url) {
+    return visited_->insert(url);
 }
 
-void WebsiteCrawler::addFileFoundCallback(const FileFoundCallback& callback) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    m_fileFoundCallbacks.push_back(callback);
+bool WebsiteCrawler::normalizeUrl(const std::string& url, const std::string& baseUrl,
+                                  std::string& normalized, std::string& host) {
+    // Absolute links go straight to the canonicalizer
+    if (isPlainHttpUrl(url)) {
+        if (!dm::utils::UrlParser::canonicalize(url, normalized)) {
+            return false;
+        }
+        host = dm::utils::UrlParser::extractDomain(normalized);
+        return !host.empty();
+    }
+
+    // Relative ones are resolved by libcurl first
+    CURLU* handle = curl_url();
+    if (!handle) {
+        return false;
+    }
+
+    bool valid = true;
+    if (!baseUrl.empty()) {
+        valid = curl_url_set(handle, CURLUPART_URL, baseUrl.c_str(), 0) == CURLUE_OK;
+    }
+
+    // With a base set, a relative URL is resolved against it
+    unsigned int flags = baseUrl.empty() ? CURLU_DEFAULT_SCHEME : 0;
+    valid = valid && curl_url_set(handle, CURLUPART_URL, url.c_str(), flags) == CURLUE_OK;
+
+    std::string scheme = valid ? toLower(dm::utils::UrlParser::getPart(handle, CURLUPART_SCHEME)) : "";
+    if (scheme != "http" && scheme != "https") {
+        curl_url_cleanup(handle);
+        return false;
+    }
+
+    std::string resolved = dm::utils::UrlParser::getPart(handle, CURLUPART_URL);
+    curl_url_cleanup(handle);
+
+    // The same canonical form as absolute links, so both dedupe together
+    if (!dm::utils::UrlParser::canonicalize(resolved, normalized)) {
+        return false;
+    }
+    host = dm::utils::UrlParser::extractDomain(normalized);
+    return !host.empty();
 }
 
-void WebsiteCrawler::crawl(const std::string& startUrl) {
-    try {
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Starting crawl from URL: " + startUrl);
-        
-        // Parse robots.txt if needed
-        std::set<std::string> disallowedPaths;
-        if (m_respectRobotsTxt) {
-            parseRobotsTxt(m_baseUrl, disallowedPaths);
-        }
-        
-        // Create a queue of URLs to visit with their depth
-        std::queue<std::pair<std::string, int>> urlQueue;
-        
-        // Add the starting URL to the queue at depth 0
-        urlQueue.push(std::make_pair(startUrl, 0));
-        
-        // Keep track of URLs we've already queued to avoid duplication
-        std::set<std::string> queuedUrls;
-        queuedUrls.insert(startUrl);
-        
-        // Initialize HTTP client
-        HttpClient httpClient;
-        
-        int pagesVisited = 0;
-        
-        // Process the queue
-        while (m_isRunning && !urlQueue.empty()) {
-            // Check if we've reached the maximum number of pages
-            if (m_maxPages > 0 && pagesVisited >= m_maxPages) {
-                Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                    "Reached maximum pages limit: " + std::to_string(m_maxPages));
-                break;
+bool WebsiteCrawler::shouldCrawl(const std::string& url, const std::string& host) const {
+    switch (options_.mode) {
+        case CrawlMode::SAME_DOMAIN:
+            if (host != baseDomain_ &&
+                !(host.size() > baseDomain_.size() &&
+                  host.compare(host.size() - baseDomain_.size(), baseDomain_.size(), baseDomain_) == 0 &&
+                  host[host.size() - baseDomain_.size() - 1] == '.')) {
+                return false;
             }
-            
-            // Get the next URL and its depth from the queue
-            auto current = urlQueue.front();
-            std::string currentUrl = current.first;
-            int currentDepth = current.second;
-            urlQueue.pop();
-            
-            // Skip this URL if it's disallowed by robots.txt
-            if (m_respectRobotsTxt && isPathDisallowed(currentUrl, disallowedPaths)) {
-                Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                    "Skipping URL disallowed by robots.txt: " + currentUrl);
-                continue;
+            break;
+        case CrawlMode::SAME_HOST:
+            if (host != startHost_) {
+                return false;
             }
-            
-            // Add to visited list
-            {
-                std::lock_guard<std::mutex> lock(m_crawlMutex);
-                m_visitedUrls.insert(currentUrl);
+            break;
+        case CrawlMode::SPECIFIED_DOMAINS:
+            if (!allowedDomains_.matches(host)) {
+                return false;
             }
-            
-            // Increment pages visited counter
-            pagesVisited++;
-            
-            // Notify progress
-            notifyCrawlProgress(pagesVisited, urlQueue.size(), currentUrl);
-            
-            Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                "Crawling URL (" + std::to_string(pagesVisited) + "): " + currentUrl);
-            
-            // Check if this is a downloadable file
-            if (isDownloadableFile(currentUrl)) {
-                Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                    "Found downloadable file: " + currentUrl);
-                
-                // Add to downloadable files list
-                {
-                    std::lock_guard<std::mutex> lock(m_crawlMutex);
-                    m_downloadableFiles.insert(currentUrl);
-                }
-                
-                // Notify file found
-                notifyFileFound(currentUrl);
-                
-                // Don't extract links from downloadable files
-                continue;
+            break;
+        case CrawlMode::FOLLOW_ALL:
+            break;
+    }
+
+    if (!includePatterns_.empty() && !matchesAny(url, includePatterns_)) {
+        return false;
+    }
+    if (matchesAny(url, excludePatterns_)) {
+        return false;
+    }
+
+    return !options_.urlFilter || options_.urlFilter(url);
+}
+
+bool WebsiteCrawler::shouldDownloadResource(const std::string& url, const std::string& contentType,
+                                            int64_t contentLength) const {
+    if (!options_.fileTypesToDownload.empty() &&
+        std::none_of(options_.fileTypesToDownload.begin(), options_.fileTypesToDownload.end(),
+                     [&url](const std::string& extension) { return hasFileExtension(url, extension); })) {
+        return false;
+    }
+
+    if (matchesAny(url, excludePatterns_)) {
+        return false;
+    }
+
+    if (options_.urlFilter && !options_.urlFilter(url)) {
+        return false;
+    }
+
+    return !options_.contentFilter || options_.contentFilter(url, contentType, contentLength);
+}
+
+void WebsiteCrawler::handleResource(const FoundResource& resource) {
+    if (!shouldDownloadResource(resource.url, resource.contentType, resource.contentLength)) {
+        return;
+    }
+
+    resourcesFound_++;
+    ResourceType type = detectResourceType(resource.url, resource.contentType);
+
+    if (options_.resourceHandler) {
+        options_.resourceHandler(resource.url, type);
+    } else if (options_.downloadResources) {
+        if (downloadManager_.addDownload(resource.url, options_.downloadDirectory)) {
+            downloadQueued_++;
+            std::lock_guard<std::mutex> lock(resultsMutex_);
+            downloadedResources_.push_back(resource.url);
+        } else {
+            recordError(resource.url, "Failed to queue download");
+        }
+    }
+
+    updateStatistics();
+}
+
+std::vector<WebsiteCrawler::UrlPattern> WebsiteCrawler::compilePatterns(const std::vector<std::string>& patterns) {
+    std::vector<UrlPattern> compiled;
+
+    for (const auto& pattern : patterns) {
+        if (pattern.empty()) {
+            continue;
+        }
+
+        UrlPattern urlPattern;
+        urlPattern.anchoredStart = pattern.front() != '*';
+        urlPattern.anchoredEnd = pattern.back() != '*';
+
+        size_t start = 0;
+        while (start <= pattern.size()) {
+            size_t star = pattern.find('*', start);
+            if (star == std::string::npos) {
+                star = pattern.size();
             }
-            
-            // Don't crawl deeper than max depth
-            if (currentDepth >= m_maxDepth) {
-                continue;
+            if (star > start) {
+                urlPattern.parts.push_back(pattern.substr(start, star - start));
             }
-            
-            // Add delay if specified
-            if (m_delay > 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(m_delay));
+            start = star + 1;
+        }
+
+        compiled.push_back(std::move(urlPattern));
+    }
+
+    return compiled;
+}
+
+bool WebsiteCrawler::matchesAny(const std::string& url, const std::vector<UrlPattern>& patterns) {
+    for (const auto& pattern : patterns) {
+        const auto& parts = pattern.parts;
+        if (parts.empty()) {
+            // Only wildcards
+            return true;
+        }
+
+        size_t pos = 0;
+        size_t first = 0;
+        size_t last = parts.size();
+
+        if (pattern.anchoredStart) {
+            if (!startsWith(url, parts.front())) {
+                continue;
             }
-            
-            // Download the page
-            try {
-                HttpRequestOptions options;
-                options.timeout = 30000; // 30 seconds timeout
-                
-                HttpResponse response = httpClient.sendGet(currentUrl, options);
-                
-                if (response.statusCode == 200) {
-                    // Extract links from the page content
-                    std::vector<std::string> links = extractLinks(response.body, currentUrl);
-                    
-                    // Process each link
-                    for (const auto& link : links) {
-                        // Normalize URL
-                        std::string normalizedUrl = normalizeUrl(link, currentUrl);
-                        
-                        // Skip empty or invalid URLs
-                        if (normalizedUrl.empty()) {
-                            continue;
-                        }
-                        
-                        // Check if URL matches any filters
-                        if (!m_urlFilters.empty() && !matchesFilter(normalizedUrl)) {
-                            continue;
-                        }
-                        
-                        // Check if it's an external link
-                        bool isExternal = isExternalLink(normalizedUrl);
-                        
-                        // Skip external links if we're not following them
-                        if (isExternal && !m_followExternalLinks) {
-                            continue;
-                        }
-                        
-                        // Check if we've already queued this URL
-                        if (queuedUrls.find(normalizedUrl) != queuedUrls.end()) {
-                            continue;
-                        }
-                        
-                        // Add URL to queue
-                        urlQueue.push(std::make_pair(normalizedUrl, currentDepth + 1));
-                        queuedUrls.insert(normalizedUrl);
-                        
-                        // Add to found URLs
-                        {
-                            std::lock_guard<std::mutex> lock(m_crawlMutex);
-                            m_foundUrls.insert(normalizedUrl);
-                        }
-                    }
-                } 
-                else {
-                    Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                        "Failed to download page: " + currentUrl + 
-                        " (Status code: " + std::to_string(response.statusCode) + ")");
-                }
-            } 
-            catch (const std::exception& e) {
-                Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                    "Exception downloading page: " + currentUrl + " (" + e.what() + ")");
+            pos = parts.front().size();
+            first = 1;
+        }
+
+        // The last part must sit at the very end, after everything before it
+        size_t tailStart = url.size();
+        if (pattern.anchoredEnd && last > first) {
+            const std::string& tail = parts.back();
+            if (tail.size() > url.size() - pos ||
+                url.compare(url.size() - tail.size(), tail.size(), tail) != 0) {
+                continue;
             }
+            tailStart = url.size() - tail.size();
+            last--;
+        } else if (pattern.anchoredEnd && pos != url.size()) {
+            continue;
         }
-        
-        if (m_isRunning) {
-            Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                "Crawl completed. Visited " + std::to_string(pagesVisited) + " pages, " +
-                "found " + std::to_string(m_downloadableFiles.size()) + " downloadable files.");
-        } else {
-            Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                "Crawl stopped. Visited " + std::to_string(pagesVisited) + " pages, " +
-                "found " + std::to_string(m_downloadableFiles.size()) + " downloadable files.");
+
+        // Leftmost matches of the middle parts leave the most room for the rest
+        bool matched = true;
+        for (size_t i = first; i < last && matched; i++) {
+            size_t found = url.find(parts[i], pos);
+            if (found == std::string::npos || found + parts[i].size() > tailStart) {
+                matched = false;
+            } else {
+                pos = found + parts[i].size();
+            }
         }
-    } 
-    catch (const std::exception& e) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Exception in crawl: " + std::string(e.what()));
-    }
-    
-    m_isRunning = false;
-}
 
-bool WebsiteCrawler::isDownloadableFile(const std::string& url) {
-    // Parse URL
-    Utils::UrlParser urlParser;
-    auto parsedUrl = urlParser.parse(url);
-    
-    if (!parsedUrl.valid) {
-        return false;
-    }
-    
-    // Extract file path
-    std::string path = parsedUrl.path;
-    
-    // Check if the URL path ends with a known file extension
-    for (const auto& ext : m_fileExtensions) {
-        if (path.length() >= ext.length() && 
-            std::equal(ext.rbegin(), ext.rend(), path.rbegin(), 
-                     [](char a, char b) { return std::tolower(a) == std::tolower(b); })) {
+        if (matched) {
             return true;
         }
     }
-    
+
     return false;
 }
 
-std::vector<std::string> WebsiteCrawler::extractLinks(const std::string& html, const std::string& baseUrl) {
-    std::vector<std::string> links;
-    
-    try {
-        // Regular expression to find links in HTML
-        // Look for href attributes in anchor tags
-        std::regex hrefRegex("<a[^>]*href=[\"']([^\"']+)[\"'][^>]*>");
-        
-        // Also search for image sources which might be downloadable
-        std::regex imgRegex("<img[^>]*src=[\"']([^\"']+)[\"'][^>]*>");
-        
-        // Search for href links
-        std::smatch hrefMatch;
-        std::string::const_iterator searchStart(html.cbegin());
-        
-        while (std::regex_search(searchStart, html.cend(), hrefMatch, hrefRegex)) {
-            std::string link = hrefMatch[1];
-            links.push_back(link);
-            searchStart = hrefMatch.suffix().first;
-        }
-        
-        // Search for image sources
-        std::smatch imgMatch;
-        searchStart = html.cbegin();
-        
-        while (std::regex_search(searchStart, html.cend(), imgMatch, imgRegex)) {
-            std::string link = imgMatch[1];
-            links.push_back(link);
-            searchStart = imgMatch.suffix().first;
-        }
-    } 
-    catch (const std::exception& e) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Exception extracting links: " + std::string(e.what()));
-    }
-    
-    return links;
-}
-
-std::string WebsiteCrawler::normalizeUrl(const std::string& url, const std::string& baseUrl) {
-    // Parse the base URL
-    Utils::UrlParser urlParser;
-    auto parsedBase = urlParser.parse(baseUrl);
-    
-    if (!parsedBase.valid) {
-        return "";
+bool WebsiteCrawler::isAllowed(HttpClient& client, const FrontierEntry& entry) {
+    {
+        std::lock_guard<std::mutex> lock(frontierMutex_);
+        auto it = hosts_.find(entry.host);
+        if (it != hosts_.end() && it->second.robotsLoaded) {
+            return matchesRobotsRules(getPath(entry.url), it->second.robotsRules);
+        }
     }
-    
-    // Handle different URL formats
-    
-    // If the URL is empty, return empty string
-    if (url.empty()) {
-        return "";
+
+    std::vector<std::pair<std::string, bool>> rules;
+    std::string robotsUrl = getRobotsUrl(entry.url);
+    if (!robotsUrl.empty()) {
+        std::string content;
+        if (fetchRobotsTxt(client, robotsUrl, content)) {
+            rules = parseRobotsTxt(content, options_.userAgent);
+        }
     }
-    
-    // If the URL is just a fragment, ignore it
-    if (url[0] == '#') {
-        return "";
+
+    bool allowed = matchesRobotsRules(getPath(entry.url), rules);
+
+    std::lock_guard<std::mutex> lock(frontierMutex_);
+    HostQueue& host = hosts_[entry.host];
+    host.robotsLoaded = true;
+    host.robotsRules = std::move(rules);
+    return allowed;
+}
+
+std::vector<std::pair<std::string, bool>> WebsiteCrawler::parseRobotsTxt(const std::string& content,
+                                                                        const std::string& userAgent) {
+    // Product token of the user agent, e.g. "downloadmanager" for "DownloadManager/1.0"
+    std::string agent = toLower(userAgent.substr(0, userAgent.find_first_of("/ ")));
+
+    std::vector<std::pair<std::string, bool>> specific;
+    std::vector<std::pair<std::string, bool>> generic;
+    bool inSpecific = false;
+    bool inGeneric = false;
+    bool lastWasAgent = false;
+
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos) {
+            end = content.size();
+        }
+        std::string line = content.substr(start, end - start);
+        start = end + 1;
+
+        line = trim(line.substr(0, line.find('#')));
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string field = toLower(trim(line.substr(0, colon)));
+        std::string value = trim(line.substr(colon + 1));
+
+        if (field == "user-agent") {
+            // Consecutive user-agent lines share one group
+            if (!lastWasAgent) {
+                inSpecific = false;
+                inGeneric = false;
+            }
+            std::string name = toLower(value);
+            if (name == "*") {
+                inGeneric = true;
+            } else if (!agent.empty() && agent.find(name) != std::string::npos) {
+                inSpecific = true;
+            }
+            lastWasAgent = true;
+            continue;
+        }
+        lastWasAgent = false;
+
+        if (field != "disallow" && field != "allow") {
+            continue;
+        }
+        // An empty Disallow allows everything
+        if (value.empty()) {
+            continue;
+        }
+
+        std::pair<std::string, bool> rule(value, field == "allow");
+        if (inSpecific) {
+            specific.push_back(rule);
+        }
+        if (inGeneric) {
+            generic.push_back(rule);
+        }
     }
-    
-    // If the URL is a javascript: or mailto: link, ignore it
-    if (url.substr(0, 11) == "javascript:" || url.substr(0, 7) == "mailto:") {
-        return "";
+
+    // A group naming this agent replaces the generic one
+    return specific.empty() ? generic : specific;
+}
+
+bool WebsiteCrawler::matchesRobotsRules(const std::string& path,
+                                        const std::vector<std::pair<std::string, bool>>& rules) {
+    size_t bestLength = 0;
+    bool allowed = true;
+
+    for (const auto& rule : rules) {
+        std::string prefix = rule.first;
+        bool anchored = !prefix.empty() && prefix.back() == '$';
+        if (anchored) {
+            prefix.pop_back();
+        }
+
+        // Only a trailing '*' is supported, which is the same as a prefix
+        while (!prefix.empty() && prefix.back() == '*') {
+            prefix.pop_back();
+        }
+        if (prefix.find('*') != std::string::npos) {
+            continue;
+        }
+
+        bool matches = anchored ? path == prefix : startsWith(path, prefix);
+        // The longest match wins, Allow wins a tie
+        if (matches && (rule.first.size() > bestLength || (rule.first.size() == bestLength && rule.second))) {
+            bestLength = rule.first.size();
+            allowed = rule.second;
+        }
     }
-    
-    // If the URL is already absolute (starts with http:// or https://), return it as is
-    if (url.substr(0, 7) == "http://" || url.substr(0, 8) == "https://") {
-        return url;
-    }
-    
-    // If the URL is protocol-relative (starts with //), add the scheme from the base URL
-    if (url.substr(0, 2) == "//") {
-        return parsedBase.scheme + ":" + url;
-    }
-    
-    // At this point, the URL is relative
-    
-    // If the URL is root-relative (starts with /), append it to the base domain
-    if (url[0] == '/') {
-        return parsedBase.scheme + "://" + parsedBase.host + url;
-    }
-    
-    // If the URL is relative to the current path, resolve it
-    std::string basePath = parsedBase.path;
-    
-    // Remove filename component from base path
-    size_t lastSlash = basePath.find_last_of('/');
-    if (lastSlash != std::string::npos) {
-        basePath = basePath.substr(0, lastSlash + 1);
-    } else {
-        basePath = "/";
-    }
-    
-    return parsedBase.scheme + "://" + parsedBase.host + basePath + url;
-}
-
-bool WebsiteCrawler::isExternalLink(const std::string& url) {
-    Utils::UrlParser urlParser;
-    auto parsedUrl = urlParser.parse(url);
-    
-    if (!parsedUrl.valid) {
-        return false;
+
+    return allowed;
+}
+
+std::string WebsiteCrawler::getPath(const std::string& url) {
+    size_t schemeEnd = url.find("://");
+    size_t pathStart = url.find('/', schemeEnd == std::string::npos ? 0 : schemeEnd + 3);
+    if (pathStart == std::string::npos) {
+        return "/";
     }
-    
-    // Check if the hostname matches the base domain
-    return parsedUrl.host != m_baseDomain;
+    return url.substr(pathStart, url.find('#', pathStart) - pathStart);
 }
 
-bool WebsiteCrawler::matchesFilter(const std::string& url) {
-    if (m_urlFilters.empty()) {
-        return true;
+void WebsiteCrawler::appendFoundUrls(const std::vector<std::string>& urls) {
+    size_t start = foundUrls_.size();
+    for (const auto& url : urls) {
+        foundUrls_ += url;
+        foundUrls_ += '\n';
     }
-    
-    for (const auto& pattern : m_urlFilters) {
-        try {
-            std::regex re(pattern);
-            if (std::regex_search(url, re)) {
-                return true;
-            }
-        } 
-        catch (const std::regex_error& e) {
-            Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-                "Error in regex pattern " + pattern + ": " + e.what());
+
+    // With a spill file the buffer only batches one write
+    if (foundUrlsFile_) {
+        if (std::fwrite(foundUrls_.data() + start, 1, foundUrls_.size() - start, foundUrlsFile_) !=
+            foundUrls_.size() - start) {
+            dm::utils::Logger::warning("Failed to write found URLs to " + foundUrlsPath_);
         }
+        foundUrls_.clear();
     }
-    
-    return false;
 }
 
-void WebsiteCrawler::parseRobotsTxt(const std::string& baseUrl, std::set<std::string>& disallowedPaths) {
-    try {
-        std::string robotsUrl = baseUrl + "/robots.txt";
-        
-        Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-            "Downloading robots.txt: " + robotsUrl);
-        
-        // Download robots.txt
-        HttpClient httpClient;
-        HttpRequestOptions options;
-        options.timeout = 10000; // 10 seconds timeout
-        
-        HttpResponse response = httpClient.sendGet(robotsUrl, options);
-        
-        if (response.statusCode == 200) {
-            // Parse the robots.txt content
-            std::istringstream stream(response.body);
-            std::string line;
-            
-            bool relevantUserAgent = false;
-            
-            while (std::getline(stream, line)) {
-                // Trim whitespace
-                line.erase(0, line.find_first_not_of(" \t\r\n"));
-                line.erase(line.find_last_not_of(" \t\r\n") + 1);
-                
-                // Skip empty lines and comments
-                if (line.empty() || line[0] == '#') {
-                    continue;
-                }
-                
-                // Look for user-agent lines
-                if (line.substr(0, 11) == "User-agent:") {
-                    std::string agent = line.substr(11);
-                    agent.erase(0, agent.find_first_not_of(" \t"));
-                    
-                    // Check if this section applies to our crawler or all crawlers (*)
-                    relevantUserAgent = (agent == "*" || agent == "DownloadManager");
-                } 
-                // Look for disallow lines if we're in a relevant section
-                else if (relevantUserAgent && line.substr(0, 9) == "Disallow:") {
-                    std::string path = line.substr(9);
-                    path.erase(0, path.find_first_not_of(" \t"));
-                    
-                    if (!path.empty()) {
-                        disallowedPaths.insert(path);
-                    }
-                }
-            }
-            
-            Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                "Parsed robots.txt, found " + std::to_string(disallowedPaths.size()) + " disallowed paths");
-        } 
-        else if (response.statusCode == 404) {
-            Utils::Logger::instance().log(Utils::LogLevel::INFO, 
-                "No robots.txt found at: " + robotsUrl);
-        } 
-        else {
-            Utils::Logger::instance().log(Utils::LogLevel::WARNING, 
-                "Failed to download robots.txt: " + robotsUrl + 
-                " (Status code: " + std::to_string(response.statusCode) + ")");
-        }
-    } 
-    catch (const std::exception& e) {
-        Utils::Logger::instance().log(Utils::LogLevel::ERROR, 
-            "Exception downloading robots.txt: " + std::string(e.what()));
-    }
-}
-
-bool WebsiteCrawler::isPathDisallowed(const std::string& url, const std::set<std::string>& disallowedPaths) {
-    // Parse URL to get the path
-    Utils::UrlParser urlParser;
-    auto parsedUrl = urlParser.parse(url);
-    
-    if (!parsedUrl.valid) {
-        return false;
+void WebsiteCrawler::clearFoundUrls() {
+    foundUrls_.clear();
+    foundUrls_.shrink_to_fit();
+
+    if (foundUrlsFile_) {
+        std::fclose(foundUrlsFile_);
+        foundUrlsFile_ = nullptr;
+        dm::utils::FileUtils::deleteFile(foundUrlsPath_);
     }
-    
-    std::string path = parsedUrl.path;
-    
-    // Check against disallowed paths
-    for (const auto& disallowedPath : disallowedPaths) {
-        // If the disallowed path ends with *, it's a prefix match
-        if (disallowedPath.back() == '*') {
-            std::string prefix = disallowedPath.substr(0, disallowedPath.length() - 1);
-            if (path.substr(0, prefix.length()) == prefix) {
-                return true;
-            }
-        } 
-        // Otherwise, it's an exact match or path prefix
-        else {
-            if (path == disallowedPath || 
-                (disallowedPath.back() == '/' && path.substr(0, disallowedPath.length()) == disallowedPath)) {
-                return true;
-            }
-        }
+    foundUrlsPath_.clear();
+}
+
+void WebsiteCrawler::recordError(const std::string& url, const std::string& error) {
+    dm::utils::Logger::warning("Crawl error for " + url + ": " + error);
+
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    errors_[url] = error;
+}
+
+void WebsiteCrawler::updateStatistics() {
+    if (!progressCallback_) {
+        return;
     }
-    
-    return false;
+
+    // Workers report concurrently, keep the callback single threaded
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    progressCallback_(pagesVisited_, totalUrls_, resourcesFound_, downloadQueued_);
 }
 
-void WebsiteCrawler::notifyCrawlProgress(int pagesVisited, int queueSize, const std::string& currentUrl) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    for (const auto& callback : m_progressCallbacks) {
-        callback(pagesVisited, queueSize, currentUrl, m_downloadableFiles.size());
+void WebsiteCrawler::notifyAll() {
+    // Taking each lock orders the wakeup after a waiter's predicate check
+    {
+        std::lock_guard<std::mutex> lock(frontierMutex_);
     }
+    frontierChanged_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(parseMutex_);
+    }
+    parseChanged_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(resourceMutex_);
+    }
+    resourceChanged_.notify_all();
 }
 
-void WebsiteCrawler::notifyFileFound(const std::string& fileUrl) {
-    std::lock_guard<std::mutex> lock(m_callbackMutex);
-    for (const auto& callback : m_fileFoundCallbacks) {
-        callback(fileUrl);
+void WebsiteCrawler::joinWorkers() {
+    // A callback stopping the crawl runs on a crawler thread, possibly with
+    // a lock the others wait for; they are joined by the next start instead
+    for (const auto& thread : workerThreads_) {
+        if (thread.get_id() == std::this_thread::get_id()) {
+            return;
+        }
+    }
+
+    for (auto& thread : workerThreads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
+    workerThreads_.clear();
 }
 
-} // namespace Core
-} // namespace DownloadManager
\ No newline at end of file
+} // namespace core
+} // namespace dm
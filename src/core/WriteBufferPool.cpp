@@ -0,0 +1,270 @@
+#include "core/WriteBufferPool.h"
+#include "utils/Logger.h"
+#include "utils/ResourceMonitor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace dm {
+namespace core {
+
+namespace {
+
+char* allocateAligned(size_t size, size_t alignment) {
+#ifdef _WIN32
+    return static_cast<char*>(_aligned_malloc(size, alignment));
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return nullptr;
+    }
+    return static_cast<char*>(ptr);
+#endif
+}
+
+void freeAligned(char* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+} // namespace
+
+std::atomic<size_t> WriteBufferPool::budget_{0};
+std::atomic<size_t> WriteBufferPool::allocatedBytes_{0};
+
+WriteBufferPool::WriteBufferPool(size_t bufferSize)
+    : backend_(dm::utils::DiskIoBackend::getInstance()) {
+    size_t alignment = OutputFile::getAlignment();
+    bufferSize = std::min(std::max(bufferSize, alignment), MAX_BUFFER_SIZE);
+    bufferSize_ = (bufferSize + alignment - 1) / alignment * alignment;
+}
+
+WriteBufferPool::~WriteBufferPool() {
+    trim();
+}
+
+char* WriteBufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idleBuffers_.empty()) {
+            char* buffer = idleBuffers_.back();
+            idleBuffers_.pop_back();
+            return buffer;
+        }
+    }
+
+    // Reserved before allocating, so racing pools cannot overshoot the budget
+    size_t budget = budget_.load(std::memory_order_relaxed);
+    size_t allocated = allocatedBytes_.fetch_add(bufferSize_, std::memory_order_relaxed);
+    if (budget > 0 && allocated + bufferSize_ > budget) {
+        allocatedBytes_.fetch_sub(bufferSize_, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        allocatedCount_++;
+    }
+
+    char* buffer = allocateAligned(bufferSize_, OutputFile::getAlignment());
+    if (!buffer) {
+        dm::utils::Logger::error("Failed to allocate " + std::to_string(bufferSize_) + " byte write buffer");
+        allocatedBytes_.fetch_sub(bufferSize_, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex_);
+        allocatedCount_--;
+    } else {
+        dm::utils::ResourceMonitor::getInstance().recordAllocation(
+            dm::utils::ResourceSubsystem::WRITE_BUFFERS, static_cast<int64_t>(bufferSize_));
+
+        // Registered once, its pages stay pinned for every write from it
+        int slot = backend_.registerBuffer(buffer, bufferSize_);
+        if (slot >= 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[buffer] = slot;
+        }
+    }
+    return buffer;
+}
+
+void WriteBufferPool::release(char* buffer) {
+    if (!buffer) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    idleBuffers_.push_back(buffer);
+}
+
+void WriteBufferPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (char* buffer : idleBuffers_) {
+        auto slot = slots_.find(buffer);
+        if (slot != slots_.end()) {
+            backend_.unregisterBuffer(slot->second);
+            slots_.erase(slot);
+        }
+        freeAligned(buffer);
+        allocatedCount_--;
+        allocatedBytes_.fetch_sub(bufferSize_, std::memory_order_relaxed);
+        dm::utils::ResourceMonitor::getInstance().recordRelease(
+            dm::utils::ResourceSubsystem::WRITE_BUFFERS, static_cast<int64_t>(bufferSize_));
+    }
+    idleBuffers_.clear();
+}
+
+size_t WriteBufferPool::getBufferSize() const {
+    return bufferSize_;
+}
+
+size_t WriteBufferPool::getAllocatedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocatedCount_;
+}
+
+void WriteBufferPool::setBudget(size_t bytes) {
+    budget_.store(bytes, std::memory_order_relaxed);
+}
+
+size_t WriteBufferPool::getBudget() {
+    return budget_.load(std::memory_order_relaxed);
+}
+
+size_t WriteBufferPool::getAllocatedBytes() {
+    return allocatedBytes_.load(std::memory_order_relaxed);
+}
+
+int WriteBufferPool::getBufferSlot(const char* buffer) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto slot = slots_.find(buffer);
+    return slot != slots_.end() ? slot->second : -1;
+}
+
+BufferedFileWriter::BufferedFileWriter(std::shared_ptr<OutputFile> file, std::shared_ptr<WriteBufferPool> pool)
+    : file_(file), pool_(pool), async_(pool && file->isAsync()) {
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+    release();
+}
+
+void BufferedFileWriter::reset(int64_t offset) {
+    // The buffer in flight cannot be reused before it lands
+    finishPending();
+    used_ = 0;
+    offset_ = offset;
+    limit_ = 0;
+}
+
+bool BufferedFileWriter::write(const char* data, size_t size) {
+    if (!pool_) {
+        bool success = file_->writeAt(data, size, offset_);
+        if (success) {
+            offset_ += static_cast<int64_t>(size);
+        }
+        return success;
+    }
+
+    while (size > 0) {
+        if (!buffer_) {
+            buffer_ = pool_->acquire();
+            if (!buffer_) {
+                // Out of memory or budget, fall back to writing through
+                bool success = file_->writeAt(data, size, offset_);
+                if (success) {
+                    offset_ += static_cast<int64_t>(size);
+                }
+                return success;
+            }
+        }
+
+        // Stop the first block at an aligned offset
+        if (used_ == 0) {
+            size_t alignment = OutputFile::getAlignment();
+            limit_ = pool_->getBufferSize() - static_cast<size_t>(offset_ % static_cast<int64_t>(alignment));
+        }
+
+        size_t chunk = std::min(size, limit_ - used_);
+        std::memcpy(buffer_ + used_, data, chunk);
+        used_ += chunk;
+        data += chunk;
+        size -= chunk;
+
+        if (used_ == limit_ && !submit()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BufferedFileWriter::flush() {
+    return submit() && finishPending();
+}
+
+bool BufferedFileWriter::submit() {
+    if (!finishPending()) {
+        return false;
+    }
+    if (!buffer_ || used_ == 0) {
+        return true;
+    }
+
+    if (!async_) {
+        if (!file_->writeAt(buffer_, used_, offset_)) {
+            return false;
+        }
+    } else {
+        // Fill another buffer while this one is written
+        pending_.data = buffer_;
+        pending_.size = used_;
+        pending_.offset = offset_;
+        pending_.bufferSlot = pool_->getBufferSlot(buffer_);
+        file_->queueWrite(pending_);
+        pendingBuffer_ = buffer_;
+        buffer_ = nullptr;
+    }
+
+    offset_ += static_cast<int64_t>(used_);
+    used_ = 0;
+    return true;
+}
+
+bool BufferedFileWriter::finishPending() {
+    if (!pendingBuffer_) {
+        return true;
+    }
+
+    bool success = file_->finishWrite(pending_);
+    pool_->release(pendingBuffer_);
+    pendingBuffer_ = nullptr;
+
+    if (!success) {
+        // Nothing past the failed block reached the file
+        offset_ = pending_.offset;
+        used_ = 0;
+    }
+    return success;
+}
+
+bool BufferedFileWriter::release() {
+    bool success = flush();
+
+    if (buffer_) {
+        pool_->release(buffer_);
+        buffer_ = nullptr;
+    }
+    used_ = 0;
+
+    return success;
+}
+
+} // namespace core
+} // namespace dm
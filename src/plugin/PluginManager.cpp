@@ -92,6 +92,11 @@ void PluginManager::shutdown() {
         }
     }
     
+    // Stop feeding downloads to the plugins
+    for (const auto& pair : plugins_) {
+        dm::core::DataFilterRegistry::getInstance().removeFilter(pair.first);
+    }
+    
     // Clear plugins
     plugins_.clear();
     
@@ -301,6 +306,11 @@ bool PluginManager::registerPlugin(std::shared_ptr<Plugin> plugin) {
     // Register plugin
     plugins_[info.id] = plugin;
     
+    // Feed downloads to the plugin's data filter
+    if (auto filter = plugin->getDataFilter()) {
+        dm::core::DataFilterRegistry::getInstance().addFilter(info.id, filter);
+    }
+    
     // Log plugin registered
     dm::utils::Logger::info("Registered plugin: " + info.name + " (ID: " + info.id + ")");
     
@@ -369,6 +379,9 @@ bool PluginManager::unregisterPlugin(const std::string& pluginId) {
         pluginCallback_(plugin, "unregistered");
     }
     
+    // Downloads started from now on are not fed to it
+    dm::core::DataFilterRegistry::getInstance().removeFilter(pluginId);
+    
     // Remove plugin
     plugins_.erase(it);
     
@@ -448,6 +461,11 @@ bool PluginManager::enablePlugin(const std::string& pluginId) {
     // Update enabled status
     info.enabled = true;
     
+    // Feed downloads to the plugin's data filter
+    if (auto filter = plugin->getDataFilter()) {
+        dm::core::DataFilterRegistry::getInstance().addFilter(info.id, filter);
+    }
+    
     // Call plugin callback if set
     if (pluginCallback_) {
         pluginCallback_(plugin, "enabled");
@@ -518,6 +536,9 @@ bool PluginManager::disablePlugin(const std::string& pluginId) {
     // Update enabled status
     info.enabled = false;
     
+    // Downloads started from now on are not fed to it
+    dm::core::DataFilterRegistry::getInstance().removeFilter(pluginId);
+    
     // Call plugin callback if set
     if (pluginCallback_) {
         pluginCallback_(plugin, "disabled");
@@ -120,6 +120,7 @@ void PluginManager::shutdown() {
         }
         
         // Erase from map
+        dm::core::DataFilterRegistry::getInstance().removeFilter(pluginId);
         it = plugins_.erase(it);
     }
     
@@ -284,6 +285,11 @@ bool PluginManager::registerPlugin(std::shared_ptr<Plugin> plugin) {
     // Register plugin
     plugins_[info.id] = plugin;
     
+    // Feed downloads to the plugin's data filter
+    if (auto filter = plugin->getDataFilter()) {
+        dm::core::DataFilterRegistry::getInstance().addFilter(info.id, filter);
+    }
+    
     // Log success
     utils::Logger::info("Plugin registered: " + info.name + " (" + info.id + ") version " + info.version);
     
@@ -321,6 +327,7 @@ bool PluginManager::unregisterPlugin(const std::string& pluginId) {
     }
     
     // Remove from map
+    dm::core::DataFilterRegistry::getInstance().removeFilter(pluginId);
     plugins_.erase(it);
     
     utils::Logger::info("Plugin unregistered: " + pluginId);
@@ -384,6 +391,11 @@ bool PluginManager::enablePlugin(const std::string& pluginId) {
     // Update enabled state
     info.enabled = true;
     
+    // Feed downloads to the plugin's data filter
+    if (auto filter = plugin->getDataFilter()) {
+        dm::core::DataFilterRegistry::getInstance().addFilter(pluginId, filter);
+    }
+    
     // Set new plugin info (this is a bit of a hack since we can't modify the PluginInfo directly)
     // In a real implementation, we would have a setEnabled method on the Plugin interface
     std::map<std::string, std::string> config = plugin->getConfiguration();
@@ -420,6 +432,9 @@ bool PluginManager::disablePlugin(const std::string& pluginId) {
     // Update enabled state
     info.enabled = false;
     
+    // Downloads started from now on are not fed to it
+    dm::core::DataFilterRegistry::getInstance().removeFilter(pluginId);
+    
     // Set new plugin info (this is a bit of a hack since we can't modify the PluginInfo directly)
     // In a real implementation, we would have a setEnabled method on the Plugin interface
     std::map<std::string, std::string> config = plugin->getConfiguration();
@@ -1,4 +1,5 @@
 #include "ui/DownloadItemWidget.h"
+#include "ui/FrameClock.h"
 #include "utils/FileUtils.h"
 
 #include <QVBoxLayout>
@@ -27,20 +28,14 @@ DownloadItemWidget::DownloadItemWidget(std::shared_ptr<dm::core::DownloadTask> t
     connect(removeButton_, &QPushButton::clicked, this, &DownloadItemWidget::onRemoveClicked);
     connect(openButton_, &QPushButton::clicked, this, &DownloadItemWidget::onOpenClicked);
     
-    // Create update timer
-    updateTimer_ = new QTimer(this);
-    connect(updateTimer_, &QTimer::timeout, this, &DownloadItemWidget::onUpdateTimer);
-    updateTimer_->start(500);  // Update every 500ms
+    // All items refresh together on the shared clock
+    connect(&FrameClock::getInstance(), &FrameClock::refresh, this, &DownloadItemWidget::onRefresh);
     
     // Initial update
     update();
 }
 
 DownloadItemWidget::~DownloadItemWidget() {
-    // Stop update timer
-    if (updateTimer_) {
-        updateTimer_->stop();
-    }
 }
 
 std::shared_ptr<dm::core::DownloadTask> DownloadItemWidget::getTask() const {
@@ -53,9 +48,23 @@ void DownloadItemWidget::update() {
     }
     
     // Get task info
-    std::string filename = task_->getFilename();
     dm::core::DownloadStatus status = task_->getStatus();
     dm::core::ProgressInfo progress = task_->getProgressInfo();
+    int64_t fileSize = task_->getFileSize();
+    
+    // Nothing changed since the last update
+    if (shown_ && status == shownStatus_ && fileSize == shownFileSize_ &&
+        progress.downloadedBytes == shownProgress_.downloadedBytes &&
+        progress.downloadSpeed == shownProgress_.downloadSpeed &&
+        progress.timeRemaining == shownProgress_.timeRemaining) {
+        return;
+    }
+    bool statusChanged = !shown_ || status != shownStatus_;
+    shown_ = true;
+    shownStatus_ = status;
+    shownFileSize_ = fileSize;
+    shownProgress_ = progress;
+    std::string filename = task_->getFilename();
     
     // Update labels
     nameLabel_->setText(QString::fromStdString(filename));
@@ -103,13 +112,17 @@ void DownloadItemWidget::update() {
             break;
     }
     
-    statusLabel_->setText(statusText);
-    QPalette palette = statusLabel_->palette();
-    palette.setColor(QPalette::WindowText, statusColor);
-    statusLabel_->setPalette(palette);
+    if (statusChanged) {
+        statusLabel_->setText(statusText);
+        QPalette palette = statusLabel_->palette();
+        palette.setColor(QPalette::WindowText, statusColor);
+        statusLabel_->setPalette(palette);
+        
+        // Animate only what is moving
+        progressBar_->setAnimated(status == dm::core::DownloadStatus::DOWNLOADING);
+    }
     
     // Update size
-    int64_t fileSize = task_->getFileSize();
     int64_t downloadedBytes = progress.downloadedBytes;
     
     if (fileSize > 0) {
@@ -119,7 +132,8 @@ void DownloadItemWidget::update() {
     }
     
     // Update progress
-    progressBar_->setValue(static_cast<int>(progress.progressPercent));
+    progressBar_->setProgress(progress.progressPercent);
+    progressBar_->setSpeed(status == dm::core::DownloadStatus::DOWNLOADING ? progress.downloadSpeed : 0.0);
     
     // Update speed
     if (status == dm::core::DownloadStatus::DOWNLOADING) {
@@ -136,7 +150,9 @@ void DownloadItemWidget::update() {
     }
     
     // Update button states
-    updateButtonStates();
+    if (statusChanged) {
+        updateButtonStates();
+    }
 }
 
 void DownloadItemWidget::onStartClicked() {
@@ -177,8 +193,11 @@ void DownloadItemWidget::onOpenClicked() {
     emit openClicked();
 }
 
-void DownloadItemWidget::onUpdateTimer() {
-    update();
+void DownloadItemWidget::onRefresh() {
+    // Hidden items catch up when they are shown again
+    if (isVisible()) {
+        update();
+    }
 }
 
 void DownloadItemWidget::setupUi() {
@@ -203,7 +222,6 @@ void DownloadItemWidget::setupUi() {
     // Create progress bar
     progressBar_ = new ProgressBar(this);
     progressBar_->setShowSpeed(true);
-    progressBar_->setAnimated(true);
     
     // Add labels to info layout
     infoLayout->addWidget(nameLabel_, 0, 0, 1, 3);
@@ -0,0 +1,335 @@
+#include "ui/DownloadListModel.h"
+#include "utils/FileUtils.h"
+
+#include <QBrush>
+#include <QTime>
+#include <algorithm>
+#include <cmath>
+
+namespace dm {
+namespace ui {
+
+DownloadListModel::DownloadListModel(QObject* parent)
+    : QAbstractTableModel(parent) {
+}
+
+int DownloadListModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(rows_.size());
+}
+
+int DownloadListModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : COLUMN_COUNT;
+}
+
+QVariant DownloadListModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= static_cast<int>(rows_.size())) {
+        return QVariant();
+    }
+
+    const Row& row = rows_[index.row()];
+    bool downloading = row.status == dm::core::DownloadStatus::DOWNLOADING;
+
+    if (role == TASK_ID_ROLE) {
+        return row.id;
+    }
+
+    if (role == SORT_ROLE) {
+        switch (index.column()) {
+            case NAME_COLUMN: return row.name;
+            case STATUS_COLUMN: return static_cast<int>(row.status);
+            case SIZE_COLUMN: return static_cast<qlonglong>(row.fileSize);
+            case PROGRESS_COLUMN: return row.progressPercent;
+            case SPEED_COLUMN: return downloading ? row.downloadSpeed : 0.0;
+            case ETA_COLUMN: return static_cast<qlonglong>(downloading ? row.timeRemaining : 0);
+            case URL_COLUMN: return row.url;
+            default: return QVariant();
+        }
+    }
+
+    if (role == Qt::ForegroundRole) {
+        switch (row.status) {
+            case dm::core::DownloadStatus::COMPLETED: return QBrush(Qt::darkGreen);
+            case dm::core::DownloadStatus::DOWNLOAD_ERROR: return QBrush(Qt::red);
+            case dm::core::DownloadStatus::PAUSED: return QBrush(Qt::darkYellow);
+            case dm::core::DownloadStatus::CANCELED: return QBrush(Qt::gray);
+            default: return QBrush(Qt::black);
+        }
+    }
+
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (index.column()) {
+        case NAME_COLUMN:
+            return row.name;
+
+        case STATUS_COLUMN:
+            return getStatusText(row.status);
+
+        case SIZE_COLUMN:
+            if (row.fileSize > 0) {
+                return QString::fromStdString(dm::utils::FileUtils::formatFileSize(row.fileSize));
+            }
+            return QString("Unknown");
+
+        case PROGRESS_COLUMN:
+            return QString("%1%").arg(row.progressPercent, 0, 'f', 1);
+
+        case SPEED_COLUMN:
+            if (downloading) {
+                return QString::fromStdString(
+                    dm::utils::FileUtils::formatFileSize(static_cast<int64_t>(row.downloadSpeed))) + "/s";
+            }
+            return QString("-");
+
+        case ETA_COLUMN: {
+            if (!downloading || row.timeRemaining <= 0) {
+                return QString("-");
+            }
+            int seconds = static_cast<int>(row.timeRemaining);
+            QTime time = QTime(0, 0).addSecs(seconds);
+            if (seconds < 60) {
+                return time.toString("ss") + "s";
+            } else if (seconds < 3600) {
+                return time.toString("mm:ss");
+            }
+            return time.toString("hh:mm:ss");
+        }
+
+        case URL_COLUMN:
+            return row.url;
+
+        default:
+            return QVariant();
+    }
+}
+
+QVariant DownloadListModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case NAME_COLUMN: return QString("Name");
+        case STATUS_COLUMN: return QString("Status");
+        case SIZE_COLUMN: return QString("Size");
+        case PROGRESS_COLUMN: return QString("Progress");
+        case SPEED_COLUMN: return QString("Speed");
+        case ETA_COLUMN: return QString("ETA");
+        case URL_COLUMN: return QString("URL");
+        default: return QVariant();
+    }
+}
+
+void DownloadListModel::addTask(std::shared_ptr<dm::core::DownloadTask> task) {
+    if (!task) {
+        return;
+    }
+
+    // A record that was dispatched comes back as a task
+    QString taskId = QString::fromStdString(task->getId());
+    auto it = rowsById_.constFind(taskId);
+    if (it != rowsById_.constEnd()) {
+        int index = it.value();
+        Row& row = rows_[index];
+        row.task = task;
+        if (readTask(row, *task)) {
+            emit dataChanged(this->index(index, 0), this->index(index, COLUMN_COUNT - 1));
+        }
+        return;
+    }
+
+    Row row;
+    row.id = taskId;
+    row.name = QString::fromStdString(task->getFilename());
+    row.url = QString::fromStdString(task->getUrl());
+    row.task = task;
+    statusCounts_[row.status]++;
+    readTask(row, *task);
+
+    int index = static_cast<int>(rows_.size());
+    beginInsertRows(QModelIndex(), index, index);
+    rows_.push_back(std::move(row));
+    rowsById_.insert(taskId, index);
+    endInsertRows();
+}
+
+void DownloadListModel::addRecords(const std::vector<dm::core::JournalEntry>& entries) {
+    std::vector<Row> added;
+    added.reserve(entries.size());
+
+    for (const auto& entry : entries) {
+        QString taskId = QString::fromStdString(entry.id);
+        if (rowsById_.contains(taskId)) {
+            continue;
+        }
+
+        Row row;
+        row.id = taskId;
+        row.name = QString::fromStdString(entry.filename);
+        row.url = QString::fromStdString(entry.url);
+        row.status = entry.status;
+        row.fileSize = entry.fileSize;
+        if (entry.status == dm::core::DownloadStatus::COMPLETED) {
+            row.downloadedBytes = entry.fileSize;
+            row.progressPercent = 100.0;
+        }
+        added.push_back(std::move(row));
+    }
+
+    if (added.empty()) {
+        return;
+    }
+
+    int first = static_cast<int>(rows_.size());
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(added.size()) - 1);
+    rows_.reserve(rows_.size() + added.size());
+    for (auto& row : added) {
+        statusCounts_[row.status]++;
+        rowsById_.insert(row.id, static_cast<int>(rows_.size()));
+        rows_.push_back(std::move(row));
+    }
+    endInsertRows();
+}
+
+void DownloadListModel::removeTask(const QString& taskId) {
+    auto it = rowsById_.find(taskId);
+    if (it == rowsById_.end()) {
+        return;
+    }
+
+    int index = it.value();
+    beginRemoveRows(QModelIndex(), index, index);
+    statusCounts_[rows_[index].status]--;
+    rows_.erase(rows_.begin() + index);
+    rowsById_.erase(it);
+    for (int i = index; i < static_cast<int>(rows_.size()); i++) {
+        rowsById_[rows_[i].id] = i;
+    }
+    endRemoveRows();
+}
+
+void DownloadListModel::refreshTask(const QString& taskId) {
+    auto it = rowsById_.constFind(taskId);
+    if (it != rowsById_.constEnd()) {
+        refreshRows({it.value()});
+    }
+}
+
+void DownloadListModel::refreshTasks(const QStringList& taskIds) {
+    std::vector<int> rows;
+    rows.reserve(taskIds.size());
+    for (const QString& taskId : taskIds) {
+        auto it = rowsById_.constFind(taskId);
+        if (it != rowsById_.constEnd()) {
+            rows.push_back(it.value());
+        }
+    }
+    refreshRows(std::move(rows));
+}
+
+void DownloadListModel::refreshRows(std::vector<int> rows) {
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    // One dataChanged per run of adjacent changed rows
+    int runStart = -1;
+    int runEnd = -1;
+    for (int index : rows) {
+        if (index < 0 || index >= static_cast<int>(rows_.size())) {
+            continue;
+        }
+
+        Row& row = rows_[index];
+        std::shared_ptr<dm::core::DownloadTask> task = row.task.lock();
+        if (!task || !readTask(row, *task)) {
+            continue;
+        }
+
+        if (runStart >= 0 && index == runEnd + 1) {
+            runEnd = index;
+            continue;
+        }
+        if (runStart >= 0) {
+            emit dataChanged(this->index(runStart, 0), this->index(runEnd, COLUMN_COUNT - 1));
+        }
+        runStart = runEnd = index;
+    }
+
+    if (runStart >= 0) {
+        emit dataChanged(this->index(runStart, 0), this->index(runEnd, COLUMN_COUNT - 1));
+    }
+}
+
+QString DownloadListModel::getTaskId(int row) const {
+    if (row < 0 || row >= static_cast<int>(rows_.size())) {
+        return QString();
+    }
+    return rows_[row].id;
+}
+
+dm::core::DownloadStatus DownloadListModel::getStatus(int row) const {
+    if (row < 0 || row >= static_cast<int>(rows_.size())) {
+        return dm::core::DownloadStatus::NONE;
+    }
+    return rows_[row].status;
+}
+
+int DownloadListModel::getStatusCount(dm::core::DownloadStatus status) const {
+    auto it = statusCounts_.find(status);
+    return it != statusCounts_.end() ? it->second : 0;
+}
+
+bool DownloadListModel::readTask(Row& row, const dm::core::DownloadTask& task) {
+    dm::core::DownloadStatus status = task.getStatus();
+    dm::core::ProgressInfo progress = task.getProgressInfo();
+    int64_t fileSize = task.getFileSize();
+    if (status == dm::core::DownloadStatus::COMPLETED) {
+        progress.progressPercent = 100.0;
+        progress.downloadedBytes = fileSize;
+    }
+
+    // Progress is shown to a tenth of a percent, smaller steps are not repainted
+    bool changed = status != row.status ||
+                   fileSize != row.fileSize ||
+                   std::lround(progress.progressPercent * 10.0) != std::lround(row.progressPercent * 10.0) ||
+                   progress.downloadSpeed != row.downloadSpeed ||
+                   progress.timeRemaining != row.timeRemaining;
+    if (!changed) {
+        return false;
+    }
+
+    countStatus(row.status, status);
+    row.status = status;
+    row.fileSize = fileSize;
+    row.downloadedBytes = progress.downloadedBytes;
+    row.progressPercent = progress.progressPercent;
+    row.downloadSpeed = progress.downloadSpeed;
+    row.timeRemaining = progress.timeRemaining;
+    return true;
+}
+
+void DownloadListModel::countStatus(dm::core::DownloadStatus from, dm::core::DownloadStatus to) {
+    if (from != to) {
+        statusCounts_[from]--;
+        statusCounts_[to]++;
+    }
+}
+
+QString DownloadListModel::getStatusText(dm::core::DownloadStatus status) {
+    switch (status) {
+        case dm::core::DownloadStatus::NONE: return "Not Started";
+        case dm::core::DownloadStatus::QUEUED: return "Queued";
+        case dm::core::DownloadStatus::CONNECTING: return "Connecting...";
+        case dm::core::DownloadStatus::DOWNLOADING: return "Downloading";
+        case dm::core::DownloadStatus::PAUSED: return "Paused";
+        case dm::core::DownloadStatus::COMPLETED: return "Completed";
+        case dm::core::DownloadStatus::DOWNLOAD_ERROR: return "Error";
+        case dm::core::DownloadStatus::CANCELED: return "Canceled";
+        default: return "Unknown";
+    }
+}
+
+} // namespace ui
+} // namespace dm
@@ -0,0 +1,48 @@
+#include "ui/FrameClock.h"
+
+#include <QCoreApplication>
+
+namespace dm {
+namespace ui {
+
+FrameClock& FrameClock::getInstance() {
+    // Owned by the application, so its timer goes away with the event loop
+    static FrameClock* instance = new FrameClock(QCoreApplication::instance());
+    return *instance;
+}
+
+FrameClock::FrameClock(QObject* parent)
+    : QObject(parent) {
+    timer_.setInterval(FRAME_INTERVAL_MS);
+    timer_.setTimerType(Qt::CoarseTimer);
+    connect(&timer_, &QTimer::timeout, this, &FrameClock::onTimer);
+}
+
+void FrameClock::connectNotify(const QMetaMethod& signal) {
+    if ((signal == QMetaMethod::fromSignal(&FrameClock::frame) ||
+         signal == QMetaMethod::fromSignal(&FrameClock::refresh)) && !timer_.isActive()) {
+        timer_.start();
+    }
+}
+
+void FrameClock::onTimer() {
+    // Receivers that were destroyed disconnect without telling us, so check here
+    bool framed = isSignalConnected(QMetaMethod::fromSignal(&FrameClock::frame));
+    bool refreshed = isSignalConnected(QMetaMethod::fromSignal(&FrameClock::refresh));
+    if (!framed && !refreshed) {
+        timer_.stop();
+        return;
+    }
+
+    if (framed) {
+        emit frame();
+    }
+
+    frameCount_ = (frameCount_ + 1) % FRAMES_PER_REFRESH;
+    if (frameCount_ == 0 && refreshed) {
+        emit refresh();
+    }
+}
+
+} // namespace ui
+} // namespace dm
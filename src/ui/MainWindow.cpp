@@ -57,8 +57,10 @@ MainWindow::MainWindow(QWidget* parent)
     // Connect signals and slots
     connectSignals();
     
-    // Load tasks
-    loadTasks();
+    // Load tasks once the manager has them, the window shows before that
+    downloadManager_.whenTasksLoaded([this]() {
+        QMetaObject::invokeMethod(this, [this]() { loadTasks(); }, Qt::QueuedConnection);
+    });
     
     // Start update timer
     updateTimer_ = new QTimer(this);
@@ -101,38 +103,45 @@ void MainWindow::closeEvent(QCloseEvent* event) {
 }
 
 void MainWindow::setupUi() {
-    // Create download list
-    downloadList_ = new QTreeWidget(this);
+    // Create download list, the proxy sorts and filters without copying rows
+    downloadModel_ = new DownloadListModel(this);
+    proxyModel_ = new QSortFilterProxyModel(this);
+    proxyModel_->setSourceModel(downloadModel_);
+    proxyModel_->setSortRole(DownloadListModel::SORT_ROLE);
+    proxyModel_->setFilterKeyColumn(DownloadListModel::NAME_COLUMN);
+    proxyModel_->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    proxyModel_->setDynamicSortFilter(true);
+    
+    downloadList_ = new QTreeView(this);
+    downloadList_->setModel(proxyModel_);
     downloadList_->setRootIsDecorated(false);
+    downloadList_->setUniformRowHeights(true);  // Lets the view lay out 100k rows without measuring them
     downloadList_->setAlternatingRowColors(true);
     downloadList_->setSortingEnabled(true);
+    downloadList_->sortByColumn(DownloadListModel::NAME_COLUMN, Qt::AscendingOrder);
     downloadList_->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    downloadList_->setSelectionBehavior(QAbstractItemView::SelectRows);
     downloadList_->setContextMenuPolicy(Qt::CustomContextMenu);
     
-    // Set up columns
-    QStringList headers;
-    headers << "Name" << "Status" << "Size" << "Progress" << "Speed" << "ETA" << "URL";
-    downloadList_->setHeaderLabels(headers);
-    
     // Set column widths
     downloadList_->header()->setSectionResizeMode(QHeaderView::Interactive);
     downloadList_->header()->setStretchLastSection(true);
-    downloadList_->setColumnWidth(0, 200);  // Name
-    downloadList_->setColumnWidth(1, 100);  // Status
-    downloadList_->setColumnWidth(2, 80);   // Size
-    downloadList_->setColumnWidth(3, 150);  // Progress
-    downloadList_->setColumnWidth(4, 100);  // Speed
-    downloadList_->setColumnWidth(5, 100);  // ETA
+    downloadList_->setColumnWidth(DownloadListModel::NAME_COLUMN, 200);
+    downloadList_->setColumnWidth(DownloadListModel::STATUS_COLUMN, 100);
+    downloadList_->setColumnWidth(DownloadListModel::SIZE_COLUMN, 80);
+    downloadList_->setColumnWidth(DownloadListModel::PROGRESS_COLUMN, 150);
+    downloadList_->setColumnWidth(DownloadListModel::SPEED_COLUMN, 100);
+    downloadList_->setColumnWidth(DownloadListModel::ETA_COLUMN, 100);
     
     // Set central widget
     setCentralWidget(downloadList_);
     
     // Connect signals
-    connect(downloadList_, &QTreeWidget::itemSelectionChanged, 
+    connect(downloadList_->selectionModel(), &QItemSelectionModel::selectionChanged,
            this, &MainWindow::onDownloadItemSelected);
-    connect(downloadList_, &QTreeWidget::itemDoubleClicked, 
+    connect(downloadList_, &QTreeView::doubleClicked,
            this, &MainWindow::onDownloadItemDoubleClicked);
-    connect(downloadList_, &QTreeWidget::customContextMenuRequested,
+    connect(downloadList_, &QTreeView::customContextMenuRequested,
            this, &MainWindow::showContextMenu);
 }
 
@@ -271,6 +280,15 @@ void MainWindow::createToolBars() {
     mainToolBar_->addAction(pauseAllAction_);
     mainToolBar_->addSeparator();
     mainToolBar_->addAction(settingsAction_);
+    mainToolBar_->addSeparator();
+    
+    // Filter box
+    filterEdit_ = new QLineEdit(this);
+    filterEdit_->setPlaceholderText("Filter by name");
+    filterEdit_->setClearButtonEnabled(true);
+    filterEdit_->setMaximumWidth(250);
+    mainToolBar_->addWidget(filterEdit_);
+    connect(filterEdit_, &QLineEdit::textChanged, this, &MainWindow::onFilterChanged);
 }
 
 void MainWindow::createStatusBar() {
@@ -294,15 +312,27 @@ void MainWindow::createTrayIcon() {
 }
 
 void MainWindow::connectSignals() {
-    // Connect to download manager signals
-    downloadManager_.setTaskAddedCallback(
-        std::bind(&MainWindow::onTaskAdded, this, std::placeholders::_1));
+    // The manager calls back on its own threads, the model lives on this one
+    downloadManager_.setTaskAddedCallback([this](std::shared_ptr<dm::core::DownloadTask> task) {
+        QMetaObject::invokeMethod(this, [this, task]() { onTaskAdded(task); }, Qt::QueuedConnection);
+    });
     
-    downloadManager_.setTaskRemovedCallback(
-        std::bind(&MainWindow::onTaskRemoved, this, std::placeholders::_1));
+    downloadManager_.setTaskRemovedCallback([this](std::shared_ptr<dm::core::DownloadTask> task) {
+        QMetaObject::invokeMethod(this, [this, task]() { onTaskRemoved(task); }, Qt::QueuedConnection);
+    });
     
     downloadManager_.setTaskStatusChangedCallback(
-        std::bind(&MainWindow::onTaskStatusChanged, this, std::placeholders::_1, std::placeholders::_2));
+        [this](std::shared_ptr<dm::core::DownloadTask> task, dm::core::DownloadStatus status) {
+            QMetaObject::invokeMethod(this, [this, task, status]() { onTaskStatusChanged(task, status); },
+                                      Qt::QueuedConnection);
+        });
+    
+    // A bulk operation is one event, not one per task
+    downloadManager_.setBulkStatusChangedCallback(
+        [this](const std::vector<dm::core::TaskStatusChange>& changes) {
+            QMetaObject::invokeMethod(this, [this, changes]() { onBulkStatusChanged(changes); },
+                                      Qt::QueuedConnection);
+        });
 }
 
 void MainWindow::loadTasks() {
@@ -313,6 +343,20 @@ void MainWindow::loadTasks() {
     for (const auto& task : tasks) {
         addDownloadToUi(task);
     }
+    
+    // Downloads kept as records are listed without turning them into tasks
+    loadDormantTasks(0);
+    updateUiState();
+}
+
+void MainWindow::loadDormantTasks(size_t offset) {
+    std::vector<dm::core::JournalEntry> records = downloadManager_.getDormantTasks(offset, DORMANT_PAGE_SIZE);
+    downloadModel_->addRecords(records);
+    
+    // A page per turn of the event loop, the window stays responsive over a long list
+    if (records.size() == DORMANT_PAGE_SIZE) {
+        QTimer::singleShot(0, this, [this, offset]() { loadDormantTasks(offset + DORMANT_PAGE_SIZE); });
+    }
 }
 
 void MainWindow::addDownload() {
@@ -439,40 +483,25 @@ void MainWindow::pasteUrlAndDownload() {
 }
 
 void MainWindow::startDownload() {
-    // Get selected tasks
-    auto tasks = getSelectedDownloadTasks();
-    
-    // Start tasks
-    for (const auto& task : tasks) {
-        downloadManager_.startDownload(task->getId());
-    }
+    // One bulk operation for the whole selection
+    downloadManager_.startDownloads(getSelectedTaskIds());
 }
 
 void MainWindow::pauseDownload() {
-    // Get selected tasks
-    auto tasks = getSelectedDownloadTasks();
-    
-    // Pause tasks
-    for (const auto& task : tasks) {
-        downloadManager_.pauseDownload(task->getId());
-    }
+    // One bulk operation for the whole selection
+    downloadManager_.pauseDownloads(getSelectedTaskIds());
 }
 
 void MainWindow::resumeDownload() {
-    // Get selected tasks
-    auto tasks = getSelectedDownloadTasks();
-    
-    // Resume tasks
-    for (const auto& task : tasks) {
-        downloadManager_.resumeDownload(task->getId());
-    }
+    // One bulk operation for the whole selection
+    downloadManager_.resumeDownloads(getSelectedTaskIds());
 }
 
 void MainWindow::cancelDownload() {
     // Get selected tasks
-    auto tasks = getSelectedDownloadTasks();
+    std::vector<std::string> taskIds = getSelectedTaskIds();
     
-    if (tasks.empty()) {
+    if (taskIds.empty()) {
         return;
     }
     
@@ -487,16 +516,14 @@ void MainWindow::cancelDownload() {
     }
     
     // Cancel tasks
-    for (const auto& task : tasks) {
-        downloadManager_.cancelDownload(task->getId());
-    }
+    downloadManager_.cancelDownloads(taskIds);
 }
 
 void MainWindow::removeDownload() {
     // Get selected tasks
-    auto tasks = getSelectedDownloadTasks();
+    std::vector<std::string> taskIds = getSelectedTaskIds();
     
-    if (tasks.empty()) {
+    if (taskIds.empty()) {
         return;
     }
     
@@ -511,10 +538,14 @@ void MainWindow::removeDownload() {
         return;
     }
     
-    // Remove tasks
-    for (const auto& task : tasks) {
-        downloadManager_.removeDownload(task->getId(), false);
+    // Remove tasks; records have no removed callback, their rows go here
+    std::vector<bool> removed = downloadManager_.removeDownloads(taskIds, false);
+    for (size_t i = 0; i < taskIds.size(); i++) {
+        if (removed[i]) {
+            downloadModel_->removeTask(QString::fromStdString(taskIds[i]));
+        }
     }
+    updateUiState();
 }
 
 void MainWindow::startAllDownloads() {
@@ -557,26 +588,15 @@ void MainWindow::trayIconActivated(QSystemTrayIcon::ActivationReason reason) {
 }
 
 void MainWindow::updateDownloadItems() {
-    // Get all tasks
-    std::vector<std::shared_ptr<dm::core::DownloadTask>> tasks = downloadManager_.getAllDownloadTasks();
-    
-    // Update task items
-    for (const auto& task : tasks) {
-        updateDownloadInUi(task);
+    // Rows off screen are refreshed when they scroll in or change status
+    if (isVisible()) {
+        downloadModel_->refreshRows(getVisibleRows());
     }
     
     // Update status bar
-    int totalTasks = static_cast<int>(tasks.size());
-    int activeTasks = 0;
-    int completedTasks = 0;
-    
-    for (const auto& task : tasks) {
-        if (task->getStatus() == dm::core::DownloadStatus::DOWNLOADING) {
-            activeTasks++;
-        } else if (task->getStatus() == dm::core::DownloadStatus::COMPLETED) {
-            completedTasks++;
-        }
-    }
+    int totalTasks = downloadModel_->rowCount();
+    int activeTasks = downloadModel_->getStatusCount(dm::core::DownloadStatus::DOWNLOADING);
+    int completedTasks = downloadModel_->getStatusCount(dm::core::DownloadStatus::COMPLETED);
     
     statusLabel_->setText(QString("Total: %1 | Active: %2 | Completed: %3")
                          .arg(totalTasks).arg(activeTasks).arg(completedTasks));
@@ -585,17 +605,21 @@ void MainWindow::updateDownloadItems() {
     updateUiState();
 }
 
+void MainWindow::onFilterChanged(const QString& text) {
+    proxyModel_->setFilterFixedString(text);
+}
+
 void MainWindow::onDownloadItemSelected() {
     updateUiState();
 }
 
-void MainWindow::onDownloadItemDoubleClicked(QTreeWidgetItem* item, int column) {
-    if (!item) {
+void MainWindow::onDownloadItemDoubleClicked(const QModelIndex& index) {
+    if (!index.isValid()) {
         return;
     }
     
     // Get task ID
-    QString taskId = item->data(0, Qt::UserRole).toString();
+    QString taskId = index.data(DownloadListModel::TASK_ID_ROLE).toString();
     
     // Get task
     auto task = downloadManager_.getDownloadTask(taskId.toStdString());
@@ -616,28 +640,13 @@ void MainWindow::onDownloadItemDoubleClicked(QTreeWidgetItem* item, int column)
 
 void MainWindow::showContextMenu(const QPoint& pos) {
     // Show context menu if items are selected
-    if (!downloadList_->selectedItems().isEmpty()) {
-        contextMenu_->exec(downloadList_->mapToGlobal(pos));
+    if (downloadList_->selectionModel()->hasSelection()) {
+        contextMenu_->exec(downloadList_->viewport()->mapToGlobal(pos));
     }
 }
 
 void MainWindow::addDownloadToUi(std::shared_ptr<dm::core::DownloadTask> task) {
-    if (!task) {
-        return;
-    }
-    
-    // Create item
-    QTreeWidgetItem* item = new QTreeWidgetItem(downloadList_);
-    
-    // Set item data
-    QString taskId = QString::fromStdString(task->getId());
-    item->setData(0, Qt::UserRole, taskId);
-    
-    // Update item
-    updateDownloadInUi(task);
-    
-    // Add to map
-    downloadItems_[taskId] = item;
+    downloadModel_->addTask(task);
 }
 
 void MainWindow::updateDownloadInUi(std::shared_ptr<dm::core::DownloadTask> task) {
@@ -645,123 +654,7 @@ void MainWindow::updateDownloadInUi(std::shared_ptr<dm::core::DownloadTask> task
         return;
     }
     
-    // Get item
-    QString taskId = QString::fromStdString(task->getId());
-    if (!downloadItems_.contains(taskId)) {
-        return;
-    }
-    
-    QTreeWidgetItem* item = downloadItems_[taskId];
-    
-    // Get task info
-    QString filename = QString::fromStdString(task->getFilename());
-    QString url = QString::fromStdString(task->getUrl());
-    dm::core::DownloadStatus status = task->getStatus();
-    dm::core::ProgressInfo progress = task->getProgressInfo();
-    
-    // Set item text
-    item->setText(0, filename);
-    
-    // Set status
-    QString statusText;
-    switch (status) {
-        case dm::core::DownloadStatus::NONE:
-            statusText = "Not Started";
-            break;
-        case dm::core::DownloadStatus::QUEUED:
-            statusText = "Queued";
-            break;
-        case dm::core::DownloadStatus::CONNECTING:
-            statusText = "Connecting...";
-            break;
-        case dm::core::DownloadStatus::DOWNLOADING:
-            statusText = "Downloading";
-            break;
-        case dm::core::DownloadStatus::PAUSED:
-            statusText = "Paused";
-            break;
-        case dm::core::DownloadStatus::COMPLETED:
-            statusText = "Completed";
-            break;
-        case dm::core::DownloadStatus::DOWNLOAD_ERROR:
-            statusText = "Error";
-            break;
-        case dm::core::DownloadStatus::CANCELED:
-            statusText = "Canceled";
-            break;
-        default:
-            statusText = "Unknown";
-            break;
-    }
-    item->setText(1, statusText);
-    
-    // Set size
-    QString sizeText;
-    if (task->getFileSize() > 0) {
-        sizeText = QString::fromStdString(dm::utils::FileUtils::formatFileSize(task->getFileSize()));
-    } else {
-        sizeText = "Unknown";
-    }
-    item->setText(2, sizeText);
-    
-    // Set progress
-    QString progressText = QString("%1%").arg(progress.progressPercent, 0, 'f', 1);
-    item->setText(3, progressText);
-    
-    // Set speed
-    QString speedText;
-    if (status == dm::core::DownloadStatus::DOWNLOADING) {
-        speedText = QString::fromStdString(dm::utils::FileUtils::formatFileSize(progress.downloadSpeed)) + "/s";
-    } else {
-        speedText = "-";
-    }
-    item->setText(4, speedText);
-    
-    // Set ETA
-    QString etaText;
-    if (status == dm::core::DownloadStatus::DOWNLOADING && progress.timeRemaining > 0) {
-        int seconds = static_cast<int>(progress.timeRemaining);
-        QTime time(0, 0);
-        time = time.addSecs(seconds);
-        
-        if (seconds < 60) {
-            etaText = time.toString("ss") + "s";
-        } else if (seconds < 3600) {
-            etaText = time.toString("mm:ss");
-        } else {
-            etaText = time.toString("hh:mm:ss");
-        }
-    } else {
-        etaText = "-";
-    }
-    item->setText(5, etaText);
-    
-    // Set URL
-    item->setText(6, url);
-    
-    // Set item colors based on status
-    QBrush textBrush;
-    switch (status) {
-        case dm::core::DownloadStatus::COMPLETED:
-            textBrush = QBrush(Qt::darkGreen);
-            break;
-        case dm::core::DownloadStatus::DOWNLOAD_ERROR:
-            textBrush = QBrush(Qt::red);
-            break;
-        case dm::core::DownloadStatus::PAUSED:
-            textBrush = QBrush(Qt::darkYellow);
-            break;
-        case dm::core::DownloadStatus::CANCELED:
-            textBrush = QBrush(Qt::gray);
-            break;
-        default:
-            textBrush = QBrush(Qt::black);
-            break;
-    }
-    
-    for (int i = 0; i < 7; i++) {
-        item->setForeground(i, textBrush);
-    }
+    downloadModel_->refreshTask(QString::fromStdString(task->getId()));
 }
 
 void MainWindow::removeDownloadFromUi(std::shared_ptr<dm::core::DownloadTask> task) {
@@ -769,53 +662,61 @@ void MainWindow::removeDownloadFromUi(std::shared_ptr<dm::core::DownloadTask> ta
         return;
     }
     
-    // Get item
-    QString taskId = QString::fromStdString(task->getId());
-    if (!downloadItems_.contains(taskId)) {
-        return;
+    downloadModel_->removeTask(QString::fromStdString(task->getId()));
+}
+
+std::vector<int> MainWindow::getVisibleRows() const {
+    std::vector<int> rows;
+    int count = proxyModel_->rowCount();
+    if (count == 0) {
+        return rows;
     }
     
-    // Remove item
-    QTreeWidgetItem* item = downloadItems_[taskId];
-    delete item;
+    // Rows have a uniform height, so the first and last on screen bound the rest
+    QModelIndex top = downloadList_->indexAt(QPoint(0, 0));
+    QModelIndex bottom = downloadList_->indexAt(QPoint(0, downloadList_->viewport()->height() - 1));
+    int first = top.isValid() ? top.row() : 0;
+    int last = bottom.isValid() ? bottom.row() : count - 1;
     
-    // Remove from map
-    downloadItems_.remove(taskId);
+    rows.reserve(last - first + 1);
+    for (int row = first; row <= last; row++) {
+        rows.push_back(proxyModel_->mapToSource(proxyModel_->index(row, 0)).row());
+    }
+    return rows;
+}
+
+std::vector<int> MainWindow::getSelectedRows() const {
+    std::vector<int> rows;
+    const QModelIndexList selected = downloadList_->selectionModel()->selectedRows();
+    rows.reserve(selected.size());
+    for (const QModelIndex& index : selected) {
+        rows.push_back(proxyModel_->mapToSource(index).row());
+    }
+    return rows;
 }
 
 std::shared_ptr<dm::core::DownloadTask> MainWindow::getSelectedDownloadTask() {
-    // Get selected items
-    QList<QTreeWidgetItem*> selectedItems = downloadList_->selectedItems();
-    
-    if (selectedItems.isEmpty()) {
+    QModelIndex current = downloadList_->selectionModel()->currentIndex();
+    if (!current.isValid() || !downloadList_->selectionModel()->isRowSelected(current.row(), QModelIndex())) {
         return nullptr;
     }
     
     // Get task ID
-    QString taskId = selectedItems.first()->data(0, Qt::UserRole).toString();
+    QString taskId = current.data(DownloadListModel::TASK_ID_ROLE).toString();
     
     // Get task
     return downloadManager_.getDownloadTask(taskId.toStdString());
 }
 
-std::vector<std::shared_ptr<dm::core::DownloadTask>> MainWindow::getSelectedDownloadTasks() {
-    std::vector<std::shared_ptr<dm::core::DownloadTask>> tasks;
-    
-    // Get selected items
-    QList<QTreeWidgetItem*> selectedItems = downloadList_->selectedItems();
-    
-    for (QTreeWidgetItem* item : selectedItems) {
-        // Get task ID
-        QString taskId = item->data(0, Qt::UserRole).toString();
-        
-        // Get task
-        auto task = downloadManager_.getDownloadTask(taskId.toStdString());
-        if (task) {
-            tasks.push_back(task);
+std::vector<std::string> MainWindow::getSelectedTaskIds() const {
+    std::vector<std::string> taskIds;
+    for (int row : getSelectedRows()) {
+        QString taskId = downloadModel_->getTaskId(row);
+        if (!taskId.isEmpty()) {
+            taskIds.push_back(taskId.toStdString());
         }
     }
-    
-    return tasks;
+    return taskIds;
 }
 
 void MainWindow::onTaskAdded(std::shared_ptr<dm::core::DownloadTask> task) {
@@ -853,12 +754,23 @@ void MainWindow::onTaskStatusChanged(std::shared_ptr<dm::core::DownloadTask> tas
     }
 }
 
+void MainWindow::onBulkStatusChanged(const std::vector<dm::core::TaskStatusChange>& changes) {
+    QStringList taskIds;
+    taskIds.reserve(static_cast<int>(changes.size()));
+    for (const auto& change : changes) {
+        taskIds.append(QString::fromStdString(change.task->getId()));
+    }
+    downloadModel_->refreshTasks(taskIds);
+    
+    updateUiState();
+}
+
 void MainWindow::updateUiState() {
-    // Get selected tasks
-    auto tasks = getSelectedDownloadTasks();
+    // Statuses come from the model, records are not turned into tasks for this
+    std::vector<int> rows = getSelectedRows();
     
     // Enable/disable actions based on selection
-    bool hasSelection = !tasks.empty();
+    bool hasSelection = !rows.empty();
     startAction_->setEnabled(hasSelection);
     pauseAction_->setEnabled(hasSelection);
     resumeAction_->setEnabled(hasSelection);
@@ -872,8 +784,8 @@ void MainWindow::updateUiState() {
         bool canResume = false;
         bool canCancel = false;
         
-        for (const auto& task : tasks) {
-            dm::core::DownloadStatus status = task->getStatus();
+        for (int row : rows) {
+            dm::core::DownloadStatus status = downloadModel_->getStatus(row);
             
             if (status == dm::core::DownloadStatus::NONE ||
                 status == dm::core::DownloadStatus::QUEUED ||
@@ -890,6 +802,10 @@ void MainWindow::updateUiState() {
                 canResume = true;
                 canCancel = true;
             }
+            
+            if (canStart && canPause && canResume) {
+                break;
+            }
         }
         
         startAction_->setEnabled(canStart);
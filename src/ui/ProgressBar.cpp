@@ -1,4 +1,5 @@
 #include "ui/ProgressBar.h"
+#include "ui/FrameClock.h"
 #include "utils/FileUtils.h"
 
 #include <QPainter>
@@ -6,6 +7,7 @@
 #include <QStyleOptionProgressBar>
 #include <QApplication>
 #include <QStyle>
+#include <algorithm>
 
 namespace dm {
 namespace ui {
@@ -20,22 +22,18 @@ ProgressBar::ProgressBar(QWidget* parent)
       showSpeed_(false),
       animated_(false),
       bytesPerSecond_(0),
+      progress_(0),
+      paintedWidth_(-1),
       animationOffset_(0) {
     
-    // Set up animation timer
-    animationTimer_ = new QTimer(this);
-    connect(animationTimer_, &QTimer::timeout, this, &ProgressBar::onAnimationTimer);
-    
     // Set default appearance
     setTextVisible(true);
     setFixedHeight(20);
 }
 
 ProgressBar::~ProgressBar() {
-    // Stop animation timer
-    if (animationTimer_) {
-        animationTimer_->stop();
-    }
+    // Stop animation
+    disconnect(frameConnection_);
 }
 
 QColor ProgressBar::barColor() const {
@@ -89,6 +87,7 @@ bool ProgressBar::showSpeed() const {
 
 void ProgressBar::setShowSpeed(bool show) {
     showSpeed_ = show;
+    speedText_ = showSpeed_ && bytesPerSecond_ > 0 ? formatSpeed(bytesPerSecond_) : QString();
     update();
 }
 
@@ -97,25 +96,55 @@ bool ProgressBar::isAnimated() const {
 }
 
 void ProgressBar::setAnimated(bool animated) {
+    if (animated == animated_) {
+        return;
+    }
     animated_ = animated;
     
     if (animated_) {
-        animationTimer_->start(50);  // 20 fps
+        frameConnection_ = connect(&FrameClock::getInstance(), &FrameClock::frame, this, &ProgressBar::onFrame);
     } else {
-        animationTimer_->stop();
+        disconnect(frameConnection_);
     }
     
     update();
 }
 
 void ProgressBar::setSegments(const std::vector<int>& segments) {
+    if (segments == segments_) {
+        return;
+    }
     segments_ = segments;
     update();
 }
 
+void ProgressBar::setProgress(double percent) {
+    percent = std::max(0.0, std::min(100.0, percent));
+    progress_ = percent;
+    
+    // setValue repaints at once, so only call it for a change that shows
+    int value = static_cast<int>(percent);
+    if (value == this->value() && getProgressWidth(percent) == paintedWidth_) {
+        return;
+    }
+    if (value == this->value()) {
+        update();
+    } else {
+        setValue(value);
+    }
+}
+
 void ProgressBar::setSpeed(double bytesPerSecond) {
     bytesPerSecond_ = bytesPerSecond;
-    update();
+    
+    if (!showSpeed_) {
+        return;
+    }
+    QString speedText = bytesPerSecond_ > 0 ? formatSpeed(bytesPerSecond_) : QString();
+    if (speedText != speedText_) {
+        speedText_ = speedText;
+        update();
+    }
 }
 
 void ProgressBar::setFormat(const QString& format) {
@@ -128,8 +157,8 @@ QString ProgressBar::text() const {
     QString result = QProgressBar::text();
     
     // Add speed if enabled
-    if (showSpeed_ && bytesPerSecond_ > 0) {
-        result += " - " + formatSpeed(bytesPerSecond_);
+    if (!speedText_.isEmpty()) {
+        result += " - " + speedText_;
     }
     
     return result;
@@ -147,9 +176,13 @@ void ProgressBar::paintEvent(QPaintEvent* event) {
     painter.setPen(borderColor_);
     painter.drawRoundedRect(rect.adjusted(0, 0, -1, -1), 3, 3);
     
-    // Calculate progress width
+    // Calculate progress width, finer than value() when setProgress was used
     double progress = static_cast<double>(value() - minimum()) / (maximum() - minimum());
+    if (static_cast<int>(progress_) == value() && minimum() == 0 && maximum() == 100) {
+        progress = progress_ / 100.0;
+    }
     int progressWidth = static_cast<int>(rect.width() * progress);
+    paintedWidth_ = progressWidth;
     
     // Create progress rect
     QRect progressRect = rect.adjusted(0, 0, -rect.width() + progressWidth, 0);
@@ -191,9 +224,10 @@ void ProgressBar::paintEvent(QPaintEvent* event) {
     }
     
     // Draw text
-    if (isTextVisible() && !text().isEmpty()) {
+    QString label = isTextVisible() ? text() : QString();
+    if (!label.isEmpty()) {
         painter.setPen(textColor_);
-        painter.drawText(rect, Qt::AlignCenter, text());
+        painter.drawText(rect, Qt::AlignCenter, label);
     }
 }
 
@@ -205,7 +239,7 @@ QSize ProgressBar::minimumSizeHint() const {
     return QSize(100, 20);
 }
 
-void ProgressBar::onAnimationTimer() {
+void ProgressBar::onFrame() {
     // Update animation offset
     animationOffset_ = (animationOffset_ + 1) % 100;
     
@@ -219,5 +253,9 @@ QString ProgressBar::formatSpeed(double bytesPerSecond) const {
     return QString::fromStdString(dm::utils::FileUtils::formatFileSize(bytesPerSecond)) + "/s";
 }
 
+int ProgressBar::getProgressWidth(double percent) const {
+    return static_cast<int>(rect().width() * percent / 100.0);
+}
+
 } // namespace ui
 } // namespace dm
\ No newline at end of file
@@ -108,6 +108,8 @@ void SettingsDialog::applySettings() {
     // Update download manager
     dm::core::DownloadManager::getInstance().setMaxConcurrentDownloads(
         settings_.getMaxConcurrentDownloads());
+    dm::core::DownloadManager::getInstance().setMaxDownloadSpeed(
+        settings_.getMaxDownloadSpeed());
     dm::core::DownloadManager::getInstance().setDefaultDownloadDirectory(
         settings_.getDownloadDirectory());
     
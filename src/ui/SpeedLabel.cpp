@@ -1,8 +1,10 @@
 #include "ui/SpeedLabel.h"
+#include "ui/FrameClock.h"
 #include "utils/FileUtils.h"
 
 #include <QFontMetrics>
 #include <cmath>
+#include <algorithm>
 
 namespace dm {
 namespace ui {
@@ -13,6 +15,8 @@ SpeedLabel::SpeedLabel(QWidget* parent)
       showUnits_(true),
       animateChanges_(true),
       decimals_(2),
+      shownUnit_(0),
+      shownDigits_(0),
       targetSpeed_(0),
       displaySpeed_(0),
       speedChanging_(false) {
@@ -22,17 +26,11 @@ SpeedLabel::SpeedLabel(QWidget* parent)
     
     // Set alignment
     setAlignment(Qt::AlignRight | Qt::AlignVCenter);
-    
-    // Create animation timer
-    animationTimer_ = new QTimer(this);
-    connect(animationTimer_, &QTimer::timeout, this, &SpeedLabel::onAnimationTimer);
 }
 
 SpeedLabel::~SpeedLabel() {
-    // Stop animation timer
-    if (animationTimer_) {
-        animationTimer_->stop();
-    }
+    // Stop animation
+    disconnect(frameConnection_);
 }
 
 void SpeedLabel::setSpeed(double bytesPerSecond) {
@@ -47,11 +45,12 @@ void SpeedLabel::setSpeed(double bytesPerSecond) {
         if (!speedChanging_) {
             displaySpeed_ = bytesPerSecond_;
             speedChanging_ = true;
-            animationTimer_->start(50);  // 20 fps
+            frameConnection_ = connect(&FrameClock::getInstance(), &FrameClock::frame,
+                                       this, &SpeedLabel::onFrame);
         }
     } else {
         // Update immediately
-        setText(formatSpeed(bytesPerSecond_));
+        showSpeed(bytesPerSecond_);
     }
 }
 
@@ -61,7 +60,8 @@ double SpeedLabel::getSpeed() const {
 
 void SpeedLabel::setShowUnits(bool show) {
     showUnits_ = show;
-    setText(formatSpeed(bytesPerSecond_));
+    invalidateShownSpeed();
+    showSpeed(bytesPerSecond_);
 }
 
 bool SpeedLabel::showUnits() const {
@@ -71,10 +71,10 @@ bool SpeedLabel::showUnits() const {
 void SpeedLabel::setAnimateChanges(bool animate) {
     animateChanges_ = animate;
     
-    if (!animateChanges_ && animationTimer_->isActive()) {
-        animationTimer_->stop();
+    if (!animateChanges_ && speedChanging_) {
+        disconnect(frameConnection_);
         speedChanging_ = false;
-        setText(formatSpeed(bytesPerSecond_));
+        showSpeed(bytesPerSecond_);
     }
 }
 
@@ -84,14 +84,15 @@ bool SpeedLabel::animateChanges() const {
 
 void SpeedLabel::setDecimals(int decimals) {
     decimals_ = decimals;
-    setText(formatSpeed(bytesPerSecond_));
+    invalidateShownSpeed();
+    showSpeed(bytesPerSecond_);
 }
 
 int SpeedLabel::decimals() const {
     return decimals_;
 }
 
-void SpeedLabel::onAnimationTimer() {
+void SpeedLabel::onFrame() {
     // Calculate new display speed (smooth transition)
     double diff = targetSpeed_ - displaySpeed_;
     
@@ -99,14 +100,16 @@ void SpeedLabel::onAnimationTimer() {
         // Close enough, set to target
         displaySpeed_ = targetSpeed_;
         speedChanging_ = false;
-        animationTimer_->stop();
+        disconnect(frameConnection_);
     } else {
         // Move 10% closer to target each step
         displaySpeed_ += diff * 0.1;
     }
     
     // Update text
-    setText(formatSpeed(displaySpeed_));
+    if (isVisible() || !speedChanging_) {
+        showSpeed(displaySpeed_);
+    }
 }
 
 QString SpeedLabel::formatSpeed(double bytesPerSecond) const {
@@ -132,5 +135,28 @@ QString SpeedLabel::formatSpeed(double bytesPerSecond) const {
     }
 }
 
+void SpeedLabel::showSpeed(double bytesPerSecond) {
+    // Same unit choice and rounding as FileUtils::formatFileSize
+    int64_t bytes = bytesPerSecond > 0 ? static_cast<int64_t>(bytesPerSecond) : 0;
+    int unit = 0;
+    int64_t digits = 0;
+    if (bytes > 0) {
+        unit = std::min(static_cast<int>(std::log10(static_cast<double>(bytes)) / 3), 8);
+        digits = std::llround(bytes / std::pow(1000.0, unit) * std::pow(10.0, decimals_));
+    }
+    
+    if (unit == shownUnit_ && digits == shownDigits_) {
+        return;
+    }
+    shownUnit_ = unit;
+    shownDigits_ = digits;
+    setText(formatSpeed(bytesPerSecond));
+}
+
+void SpeedLabel::invalidateShownSpeed() {
+    shownUnit_ = -1;
+    shownDigits_ = -1;
+}
+
 } // namespace ui
 } // namespace dm
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "../../include/utils/Logger.h"
 #include "../../include/utils/StringUtils.h"
 #include "../../include/utils/TimeUtils.h"
+#include "../../include/utils/ResourceMonitor.h"
 #include "../../include/core/Statistics.h"
 
 #include <QVBoxLayout>
@@ -212,6 +213,48 @@ void StatisticsDialog::createUI() {
     dailyLayout->addWidget(dailyPeakSpeedLabel, 1, 4);
     dailyLayout->addWidget(m_dailyPeakSpeedValue, 1, 5);
     
+    // Process resources
+    QGroupBox* resourcesGroup = new QGroupBox(tr("Process Resources"), this);
+    QGridLayout* resourcesLayout = new QGridLayout(resourcesGroup);
+    
+    QLabel* residentMemoryLabel = new QLabel(tr("Memory:"), this);
+    residentMemoryLabel->setFont(boldFont);
+    m_residentMemoryValue = new QLabel("0 bytes", this);
+    
+    QLabel* openFilesLabel = new QLabel(tr("Open Files:"), this);
+    openFilesLabel->setFont(boldFont);
+    m_openFilesValue = new QLabel("0", this);
+    
+    QLabel* threadCountLabel = new QLabel(tr("Threads:"), this);
+    threadCountLabel->setFont(boldFont);
+    m_threadCountValue = new QLabel("0", this);
+    
+    QLabel* writeBuffersLabel = new QLabel(tr("Write Buffers:"), this);
+    writeBuffersLabel->setFont(boldFont);
+    m_writeBuffersValue = new QLabel("0 bytes", this);
+    
+    QLabel* curlHandlesLabel = new QLabel(tr("CURL Handles:"), this);
+    curlHandlesLabel->setFont(boldFont);
+    m_curlHandlesValue = new QLabel("0", this);
+    
+    QLabel* segmentsLabel = new QLabel(tr("Segments:"), this);
+    segmentsLabel->setFont(boldFont);
+    m_segmentsValue = new QLabel("0", this);
+    
+    resourcesLayout->addWidget(residentMemoryLabel, 0, 0);
+    resourcesLayout->addWidget(m_residentMemoryValue, 0, 1);
+    resourcesLayout->addWidget(openFilesLabel, 0, 2);
+    resourcesLayout->addWidget(m_openFilesValue, 0, 3);
+    resourcesLayout->addWidget(threadCountLabel, 0, 4);
+    resourcesLayout->addWidget(m_threadCountValue, 0, 5);
+    
+    resourcesLayout->addWidget(writeBuffersLabel, 1, 0);
+    resourcesLayout->addWidget(m_writeBuffersValue, 1, 1);
+    resourcesLayout->addWidget(curlHandlesLabel, 1, 2);
+    resourcesLayout->addWidget(m_curlHandlesValue, 1, 3);
+    resourcesLayout->addWidget(segmentsLabel, 1, 4);
+    resourcesLayout->addWidget(m_segmentsValue, 1, 5);
+    
     // Summary charts
     QHBoxLayout* chartsLayout = new QHBoxLayout();
     
@@ -256,6 +299,7 @@ void StatisticsDialog::createUI() {
     // Add widgets to scroll layout
     scrollLayout->addWidget(downloadsGroup);
     scrollLayout->addWidget(dailyGroup);
+    scrollLayout->addWidget(resourcesGroup);
     scrollLayout->addLayout(chartsLayout);
     scrollLayout->addStretch();
     
@@ -512,6 +556,26 @@ void StatisticsDialog::updateStatistics() {
     );
     m_dailyPeakSpeedValue->setText(dailyPeakSpeedStr);
     
+    // Update process resources from the sampler's last reading
+    auto& monitor = dm::utils::ResourceMonitor::getInstance();
+    dm::utils::ResourceUsage usage = monitor.getUsage();
+    
+    m_residentMemoryValue->setText(QString::fromStdString(
+        Utils::StringUtils::formatFileSize(usage.residentBytes) + " (peak " +
+        Utils::StringUtils::formatFileSize(usage.peakResidentBytes) + ")"
+    ));
+    m_openFilesValue->setText(QString::number(usage.openFiles));
+    m_threadCountValue->setText(QString::number(usage.threadCount));
+    
+    dm::utils::SubsystemUsage writeBuffers = monitor.getSubsystemUsage(dm::utils::ResourceSubsystem::WRITE_BUFFERS);
+    m_writeBuffersValue->setText(QString::fromStdString(
+        Utils::StringUtils::formatFileSize(writeBuffers.liveBytes)
+    ));
+    m_curlHandlesValue->setText(QString::number(
+        monitor.getSubsystemUsage(dm::utils::ResourceSubsystem::CURL_HANDLES).liveObjects));
+    m_segmentsValue->setText(QString::number(
+        monitor.getSubsystemUsage(dm::utils::ResourceSubsystem::SEGMENTS).liveObjects));
+    
     // Update charts
     updateStatusChart();
     updateTypeChart();
@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <chrono>
 
 namespace DownloadManager {
 namespace Utils {
@@ -36,6 +38,18 @@ DatabaseManager::DatabaseManager(const std::string& dbPath) : m_db(nullptr) {
 }
 
 DatabaseManager::~DatabaseManager() {
+    // Let the writer finish its batch, then commit what is left
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_stopWriter = true;
+    }
+    m_writeChanged.notify_all();
+    
+    if (m_writerThread.joinable()) {
+        m_writerThread.join();
+    }
+    
+    flushWrites();
     closeDatabase();
 }
 
@@ -64,9 +78,18 @@ void DatabaseManager::openDatabase(const std::string& dbPath) {
     
     // Enable foreign keys
     execute("PRAGMA foreign_keys = ON;");
+    
+    // WAL keeps readers off the writer's back, NORMAL syncs only at checkpoints
+    execute("PRAGMA journal_mode = WAL;");
+    execute("PRAGMA synchronous = NORMAL;");
 }
 
 void DatabaseManager::closeDatabase() {
+    std::lock_guard<std::mutex> lock(m_dbMutex);
+    
+    // Open statements would keep the connection from closing
+    m_statementCache.clear();
+    
     if (m_db) {
         sqlite3_close(m_db);
         m_db = nullptr;
@@ -301,7 +324,8 @@ void DatabaseManager::restore(const std::string& backupPath) {
         throw std::runtime_error(errorMsg);
     }
     
-    // Close the current database
+    // Close the current database, queued writes go to it first
+    flushWrites();
     closeDatabase();
     
     // Open the backup database
@@ -402,6 +426,121 @@ bool DatabaseManager::deleteSetting(const std::string& key) {
     return sqlite3_changes(m_db) > 0;
 }
 
+void DatabaseManager::enqueueWrite(const std::string& sql, std::function<void(Statement&)> bind,
+                                   const std::string& key) {
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        
+        if (!key.empty()) {
+            m_pendingWrites.erase(std::remove_if(m_pendingWrites.begin(), m_pendingWrites.end(),
+                [&key](const PendingWrite& write) { return write.key == key; }),
+                m_pendingWrites.end());
+        }
+        m_pendingWrites.push_back(PendingWrite{sql, std::move(bind), key});
+        
+        // Start the writer on first use
+        if (!m_writerThread.joinable() && !m_stopWriter) {
+            m_writerThread = std::thread(&DatabaseManager::writerLoop, this);
+        }
+    }
+    
+    m_writeChanged.notify_one();
+}
+
+void DatabaseManager::flushWrites() {
+    std::lock_guard<std::mutex> lock(m_dbMutex);
+    commitPendingWrites();
+}
+
+void DatabaseManager::setWriteBatchInterval(int milliseconds) {
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    m_writeBatchIntervalMs = std::max(0, milliseconds);
+}
+
+void DatabaseManager::writerLoop() {
+    std::unique_lock<std::mutex> lock(m_writeMutex);
+    
+    while (true) {
+        m_writeChanged.wait(lock, [this]() { return m_stopWriter || !m_pendingWrites.empty(); });
+        
+        // Collect whatever else arrives within the interval
+        if (!m_stopWriter) {
+            m_writeChanged.wait_for(lock, std::chrono::milliseconds(m_writeBatchIntervalMs),
+                                    [this]() { return m_stopWriter; });
+        }
+        bool stopping = m_stopWriter;
+        lock.unlock();
+        
+        {
+            std::lock_guard<std::mutex> dbLock(m_dbMutex);
+            commitPendingWrites();
+        }
+        
+        if (stopping) {
+            return;
+        }
+        lock.lock();
+    }
+}
+
+void DatabaseManager::commitPendingWrites() {
+    std::deque<PendingWrite> writes;
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        writes.swap(m_pendingWrites);
+    }
+    
+    if (writes.empty() || !m_db) {
+        return;
+    }
+    
+    try {
+        execute("BEGIN TRANSACTION;");
+    } catch (const std::exception& e) {
+        Logger::instance().log(LogLevel::LOG_ERROR, "Failed to start write batch: " + std::string(e.what()));
+        return;
+    }
+    
+    // A failing write is logged and skipped, the rest of the batch still commits
+    for (auto& write : writes) {
+        try {
+            auto stmt = prepareCached(write.sql);
+            if (write.bind) {
+                write.bind(*stmt);
+            }
+            
+            int result = stmt->step();
+            if (result != SQLITE_DONE && result != SQLITE_ROW) {
+                Logger::instance().log(LogLevel::LOG_ERROR, "Queued write failed: " +
+                    std::string(sqlite3_errmsg(m_db)) + " (SQL: " + write.sql + ")");
+            }
+            stmt->reset();
+        } catch (const std::exception& e) {
+            Logger::instance().log(LogLevel::LOG_ERROR, "Queued write failed: " + std::string(e.what()));
+        }
+    }
+    
+    try {
+        execute("COMMIT;");
+    } catch (const std::exception& e) {
+        Logger::instance().log(LogLevel::LOG_ERROR, "Failed to commit write batch: " + std::string(e.what()));
+        sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+}
+
+std::shared_ptr<Statement> DatabaseManager::prepareCached(const std::string& sql) {
+    auto it = m_statementCache.find(sql);
+    if (it != m_statementCache.end()) {
+        it->second->reset();
+        it->second->clearBindings();
+        return it->second;
+    }
+    
+    auto stmt = prepare(sql);
+    m_statementCache[sql] = stmt;
+    return stmt;
+}
+
 // Statement class implementation
 
 Statement::Statement(sqlite3_stmt* stmt) : m_stmt(stmt) {
@@ -0,0 +1,702 @@
+#include "utils/DiskIo.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_RSRC_REGISTER_SPARSE)
+#define DM_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+thread_local bool deferredSubmission = false;
+
+/**
+ * Performs every request on the spot with blocking positional calls.
+ */
+class PortableDiskIo : public DiskIoBackend {
+public:
+    DiskIoBackendType getType() const override {
+        return DiskIoBackendType::PORTABLE;
+    }
+
+    bool isAsync() const override {
+        return false;
+    }
+
+    void queue(DiskRequest& request) override {
+        request.transferred = 0;
+        request.error = 0;
+        request.endOfFile = false;
+        request.synced = false;
+        request.pending = false;
+
+        if (request.operation != DiskOperation::SYNC && !transfer(request)) {
+            return;
+        }
+        if (request.operation == DiskOperation::SYNC ||
+            (request.operation == DiskOperation::WRITE && request.sync)) {
+#ifdef _WIN32
+            if (_commit(request.fd) != 0) {
+#else
+            if (fdatasync(request.fd) != 0) {
+#endif
+                request.error = errno;
+                return;
+            }
+            request.synced = true;
+        }
+    }
+
+    void submit() override {
+    }
+
+    bool wait(DiskRequest& request) override {
+        return request.error == 0;
+    }
+
+    int registerBuffer(char*, size_t) override {
+        return -1;
+    }
+
+    void unregisterBuffer(int) override {
+    }
+
+private:
+    bool transfer(DiskRequest& request) {
+#ifdef _WIN32
+        // No positional calls in the CRT, serialize seek+transfer
+        std::lock_guard<std::mutex> lock(seekMutex_);
+        if (_lseeki64(request.fd, request.offset, SEEK_SET) < 0) {
+            request.error = errno;
+            return false;
+        }
+#endif
+        while (request.transferred < request.size) {
+            char* data = request.data + request.transferred;
+            size_t size = request.size - request.transferred;
+#ifdef _WIN32
+            unsigned int chunk = static_cast<unsigned int>(std::min<size_t>(size, 1u << 30));
+            int done = request.operation == DiskOperation::READ ? _read(request.fd, data, chunk)
+                                                                 : _write(request.fd, data, chunk);
+#else
+            off_t offset = static_cast<off_t>(request.offset + static_cast<int64_t>(request.transferred));
+            ssize_t done = request.operation == DiskOperation::READ ? pread(request.fd, data, size, offset)
+                                                                     : pwrite(request.fd, data, size, offset);
+#endif
+            if (done < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                request.error = errno;
+                return false;
+            }
+            if (done == 0) {
+                if (request.operation == DiskOperation::READ) {
+                    request.endOfFile = true;
+                    return true;
+                }
+                request.error = EIO;
+                return false;
+            }
+            request.transferred += static_cast<size_t>(done);
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+    std::mutex seekMutex_;
+#endif
+};
+
+#ifdef DM_HAVE_IO_URING
+
+const unsigned RING_ENTRIES = 256;
+const unsigned MAX_REGISTERED_BUFFERS = 1024;
+const size_t MAX_TRANSFER_SIZE = 1u << 30;      // Longer requests complete short and are resubmitted
+const uint64_t SYNC_TAG = 1;                    // Marks the linked sync of a request in user_data
+
+/**
+ * One ring shared by all threads. Submission and completion bookkeeping
+ * happen under the mutex; a single thread at a time blocks in the kernel
+ * for completions and reaps them for everybody. Nobody else drains the
+ * completion ring meanwhile: the kernel only returns once an entry is
+ * there, and one taken under it would leave it waiting for another.
+ */
+class IoUringDiskIo : public DiskIoBackend {
+public:
+    IoUringDiskIo() {
+        setup();
+    }
+
+    ~IoUringDiskIo() override {
+        if (sqes_) {
+            munmap(sqes_, sqesSize_);
+        }
+        if (cqRing_ && cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        if (sqRing_) {
+            munmap(sqRing_, sqRingSize_);
+        }
+        if (ringFd_ >= 0) {
+            ::close(ringFd_);
+        }
+    }
+
+    bool isReady() const {
+        return ringFd_ >= 0;
+    }
+
+    DiskIoBackendType getType() const override {
+        return DiskIoBackendType::IO_URING;
+    }
+
+    bool isAsync() const override {
+        return true;
+    }
+
+    void queue(DiskRequest& request) override {
+        request.transferred = 0;
+        request.error = 0;
+        request.endOfFile = false;
+        request.synced = false;
+        request.operations = 0;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        unsigned needed = countOperations(request);
+        if (needed == 0) {
+            request.pending = false;
+            return;
+        }
+
+        request.pending = true;
+        reserveLocked(lock, needed);
+        prepareLocked(request);
+        if (!isSubmissionDeferred()) {
+            flushLocked();
+        }
+    }
+
+    void submit() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flushLocked();
+    }
+
+    bool wait(DiskRequest& request) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (request.pending) {
+            // Reaped first, so reads and writes that came up short are resubmitted
+            reapLocked();
+            flushLocked();
+            if (!request.pending) {
+                break;
+            }
+            waitForCompletionLocked(lock);
+        }
+        return request.error == 0;
+    }
+
+    int registerBuffer(char* data, size_t size) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto slot = std::find_if(buffers_.begin(), buffers_.end(),
+                                 [](const std::pair<char*, size_t>& buffer) { return buffer.first == nullptr; });
+        if (slot == buffers_.end()) {
+            return -1;
+        }
+
+        int index = static_cast<int>(slot - buffers_.begin());
+        if (!updateBuffer(index, data, size)) {
+            // Pinned pages count against RLIMIT_MEMLOCK
+            Logger::debug("Could not register a " + std::to_string(size) + " byte I/O buffer: " +
+                          std::strerror(errno));
+            return -1;
+        }
+        *slot = std::make_pair(data, size);
+        return index;
+    }
+
+    void unregisterBuffer(int slot) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (slot < 0 || static_cast<size_t>(slot) >= buffers_.size() || !buffers_[slot].first) {
+            return;
+        }
+
+        // Requests already submitted keep the pages pinned until they complete
+        updateBuffer(slot, nullptr, 0);
+        buffers_[slot] = std::make_pair(nullptr, 0);
+    }
+
+private:
+    void setup() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+        if (fd < 0) {
+            Logger::debug(std::string("io_uring not available: ") + std::strerror(errno));
+            return;
+        }
+
+        // Plain offset reads and writes came with the same kernel (5.6)
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_NODROP)) {
+            Logger::debug("io_uring not available: kernel too old");
+            ::close(fd);
+            return;
+        }
+
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+
+        void* sqRing = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQ_RING);
+        void* cqRing = singleMap ? sqRing
+                                 : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        fd, IORING_OFF_CQ_RING);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                          IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+            Logger::debug(std::string("Failed to map the io_uring rings: ") + std::strerror(errno));
+            if (sqes != MAP_FAILED) {
+                munmap(sqes, sqesSize_);
+            }
+            if (cqRing != MAP_FAILED && cqRing != sqRing) {
+                munmap(cqRing, cqRingSize_);
+            }
+            if (sqRing != MAP_FAILED) {
+                munmap(sqRing, sqRingSize_);
+            }
+            ::close(fd);
+            return;
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqRing_ = sqRing;
+        cqRing_ = cqRing;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries_ = params.sq_entries;
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqEntries_ = params.cq_entries;
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqTailLocal_ = *sqTail_;
+
+        // Entries are filled in ring order, so the index array never changes
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sqEntries_; i++) {
+            array[i] = i;
+        }
+        ringFd_ = fd;
+
+        // A sparse table lets buffers come and go one at a time (5.19)
+        io_uring_rsrc_register table;
+        std::memset(&table, 0, sizeof(table));
+        table.nr = MAX_REGISTERED_BUFFERS;
+        table.flags = IORING_RSRC_REGISTER_SPARSE;
+        if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS2, &table, sizeof(table)) == 0) {
+            buffers_.assign(MAX_REGISTERED_BUFFERS, std::make_pair(nullptr, 0));
+        } else {
+            Logger::debug(std::string("io_uring buffer registration not available: ") + std::strerror(errno));
+        }
+    }
+
+    bool updateBuffer(int slot, char* data, size_t size) {
+        iovec vector;
+        vector.iov_base = data;
+        vector.iov_len = size;
+
+        io_uring_rsrc_update2 update;
+        std::memset(&update, 0, sizeof(update));
+        update.offset = static_cast<uint32_t>(slot);
+        update.data = reinterpret_cast<uint64_t>(&vector);
+        update.nr = 1;
+        return syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) >= 0;
+    }
+
+    static bool needsTransfer(const DiskRequest& request) {
+        return request.operation != DiskOperation::SYNC && request.transferred < request.size && !request.endOfFile;
+    }
+
+    static bool needsSync(const DiskRequest& request) {
+        return (request.operation == DiskOperation::SYNC ||
+                (request.operation == DiskOperation::WRITE && request.sync)) && !request.synced;
+    }
+
+    static unsigned countOperations(const DiskRequest& request) {
+        return (needsTransfer(request) ? 1 : 0) + (needsSync(request) ? 1 : 0);
+    }
+
+    unsigned getFreeEntriesLocked() const {
+        return sqEntries_ - (sqTailLocal_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE));
+    }
+
+    unsigned getUnsubmittedLocked() const {
+        return sqTailLocal_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    }
+
+    bool hasRoomLocked(unsigned needed) const {
+        // Completions of everything in flight must fit the completion ring
+        return getFreeEntriesLocked() >= needed && inFlight_ + needed <= cqEntries_;
+    }
+
+    void reserveLocked(std::unique_lock<std::mutex>& lock, unsigned needed) {
+        while (!hasRoomLocked(needed)) {
+            reapLocked();
+            flushLocked();
+            if (hasRoomLocked(needed)) {
+                break;
+            }
+            waitForCompletionLocked(lock);
+        }
+    }
+
+    io_uring_sqe* nextEntryLocked() {
+        io_uring_sqe* sqe = &sqes_[sqTailLocal_ & sqMask_];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqTailLocal_++;
+        return sqe;
+    }
+
+    bool isRegisteredLocked(int slot, const char* data, size_t size) const {
+        if (slot < 0 || static_cast<size_t>(slot) >= buffers_.size()) {
+            return false;
+        }
+        const std::pair<char*, size_t>& buffer = buffers_[slot];
+        return buffer.first && data >= buffer.first && data + size <= buffer.first + buffer.second;
+    }
+
+    void prepareLocked(DiskRequest& request) {
+        uint64_t userData = reinterpret_cast<uint64_t>(&request);
+        io_uring_sqe* sqe = nullptr;
+
+        if (needsTransfer(request)) {
+            char* data = request.data + request.transferred;
+            size_t size = std::min(request.size - request.transferred, MAX_TRANSFER_SIZE);
+            bool fixed = isRegisteredLocked(request.bufferSlot, data, size);
+            bool read = request.operation == DiskOperation::READ;
+
+            sqe = nextEntryLocked();
+            if (read) {
+                sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            } else {
+                sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            }
+            sqe->fd = request.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(data);
+            sqe->len = static_cast<uint32_t>(size);
+            sqe->off = static_cast<uint64_t>(request.offset + static_cast<int64_t>(request.transferred));
+            if (fixed) {
+                sqe->buf_index = static_cast<uint16_t>(request.bufferSlot);
+            }
+            sqe->user_data = userData;
+            request.operations++;
+        }
+
+        if (needsSync(request)) {
+            // Runs once the write before it completed in full
+            if (sqe) {
+                sqe->flags |= IOSQE_IO_LINK;
+            }
+            sqe = nextEntryLocked();
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = request.fd;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe->user_data = userData | SYNC_TAG;
+            request.operations++;
+        }
+
+        inFlight_ += request.operations;
+        __atomic_store_n(sqTail_, sqTailLocal_, __ATOMIC_RELEASE);
+    }
+
+    void flushLocked() {
+        // Requests that completed short go back on the ring first
+        while (!retries_.empty() && hasRoomLocked(countOperations(*retries_.back()))) {
+            DiskRequest* request = retries_.back();
+            retries_.pop_back();
+            prepareLocked(*request);
+        }
+
+        unsigned count = getUnsubmittedLocked();
+        while (count > 0) {
+            long submitted = syscall(__NR_io_uring_enter, ringFd_, count, 0, 0, nullptr, 0);
+            if (submitted < 0) {
+                // EAGAIN/EBUSY: the kernel is short of room, retried after reaping
+                if (errno != EINTR) {
+                    break;
+                }
+                continue;
+            }
+            count = getUnsubmittedLocked();
+            if (submitted == 0) {
+                break;
+            }
+        }
+    }
+
+    void waitForCompletionLocked(std::unique_lock<std::mutex>& lock) {
+        // One thread blocks in the kernel, the others wait for it to reap
+        if (reaping_) {
+            completed_.wait(lock);
+            return;
+        }
+
+        // Nothing to wait for in the kernel when completions are there already,
+        // or when nothing could complete
+        unsigned count = getUnsubmittedLocked();
+        if (*cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) || (inFlight_ == 0 && count == 0)) {
+            reapLocked();
+            completed_.notify_all();
+            return;
+        }
+
+        reaping_ = true;
+        lock.unlock();
+        long result = syscall(__NR_io_uring_enter, ringFd_, count, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        int error = errno;
+        lock.lock();
+        reaping_ = false;
+
+        if (result < 0 && error != EINTR && error != EAGAIN && error != EBUSY) {
+            Logger::error(std::string("io_uring wait failed: ") + std::strerror(error));
+        }
+        reapLocked();
+        completed_.notify_all();
+    }
+
+    void reapLocked() {
+        // The thread in the kernel reaps once it is back
+        if (reaping_) {
+            return;
+        }
+
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            completeLocked(cqe.user_data, cqe.res);
+            head++;
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+
+    void completeLocked(uint64_t userData, int32_t result) {
+        DiskRequest& request = *reinterpret_cast<DiskRequest*>(userData & ~SYNC_TAG);
+        inFlight_--;
+        request.operations--;
+
+        if (userData & SYNC_TAG) {
+            // Canceled when the write linked before it came up short
+            if (result == 0) {
+                request.synced = true;
+            } else if (result != -ECANCELED && result != -EINTR && result != -EAGAIN && request.error == 0) {
+                request.error = -result;
+            }
+        } else if (result < 0) {
+            if (result != -EINTR && result != -EAGAIN) {
+                request.error = -result;
+            }
+        } else if (result == 0) {
+            if (request.operation == DiskOperation::READ) {
+                request.endOfFile = true;
+            } else {
+                request.error = EIO;
+            }
+        } else {
+            request.transferred += static_cast<size_t>(result);
+        }
+
+        if (request.operations > 0) {
+            return;
+        }
+        if (request.error == 0 && countOperations(request) > 0) {
+            retries_.push_back(&request);
+            return;
+        }
+        request.pending = false;
+    }
+
+    // Member variables
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    size_t sqesSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned sqTailLocal_ = 0;      // Entries filled so far
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    unsigned cqEntries_ = 0;
+    unsigned inFlight_ = 0;         // Operations on the ring whose completion is not reaped
+    bool reaping_ = false;
+    std::vector<DiskRequest*> retries_;
+    std::vector<std::pair<char*, size_t>> buffers_;     // By slot, empty without registration support
+    std::mutex mutex_;
+    std::condition_variable completed_;
+};
+
+IoUringDiskIo* getIoUring() {
+    static IoUringDiskIo backend;
+    return backend.isReady() ? &backend : nullptr;
+}
+
+#endif // DM_HAVE_IO_URING
+
+PortableDiskIo& getPortable() {
+    static PortableDiskIo backend;
+    return backend;
+}
+
+std::atomic<DiskIoBackend*> selectedBackend{nullptr};
+
+} // anonymous namespace
+
+DiskIoBackend& DiskIoBackend::getInstance() {
+    DiskIoBackend* backend = selectedBackend.load(std::memory_order_acquire);
+    return backend ? *backend : getPortable();
+}
+
+bool DiskIoBackend::select(DiskIoBackendType type) {
+    DiskIoBackend* backend = &getPortable();
+#ifdef DM_HAVE_IO_URING
+    if (type == DiskIoBackendType::IO_URING && getIoUring()) {
+        backend = getIoUring();
+    }
+#endif
+    selectedBackend.store(backend, std::memory_order_release);
+
+    if (backend->getType() != type) {
+        Logger::warning(std::string("Disk I/O backend ") + getTypeName(type) + " not available, using " +
+                        getTypeName(backend->getType()));
+        return false;
+    }
+    Logger::debug(std::string("Disk I/O backend: ") + getTypeName(type));
+    return true;
+}
+
+bool DiskIoBackend::isAvailable(DiskIoBackendType type) {
+    if (type == DiskIoBackendType::PORTABLE) {
+        return true;
+    }
+#ifdef DM_HAVE_IO_URING
+    return getIoUring() != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool DiskIoBackend::parseType(const std::string& name, DiskIoBackendType& type) {
+    if (name == "portable") {
+        type = DiskIoBackendType::PORTABLE;
+        return true;
+    }
+    if (name == "io_uring") {
+        type = DiskIoBackendType::IO_URING;
+        return true;
+    }
+    return false;
+}
+
+const char* DiskIoBackend::getTypeName(DiskIoBackendType type) {
+    switch (type) {
+        case DiskIoBackendType::IO_URING:
+            return "io_uring";
+        case DiskIoBackendType::PORTABLE:
+        default:
+            return "portable";
+    }
+}
+
+void DiskIoBackend::setDeferredSubmission(bool deferred) {
+    deferredSubmission = deferred;
+}
+
+bool DiskIoBackend::isSubmissionDeferred() {
+    return deferredSubmission;
+}
+
+bool DiskIoBackend::write(int fd, const char* data, size_t size, int64_t offset) {
+    DiskRequest request;
+    request.operation = DiskOperation::WRITE;
+    request.fd = fd;
+    request.data = const_cast<char*>(data);
+    request.size = size;
+    request.offset = offset;
+    queue(request);
+    if (!wait(request)) {
+        errno = request.error;
+        return false;
+    }
+    return true;
+}
+
+int64_t DiskIoBackend::read(int fd, char* data, size_t size, int64_t offset) {
+    DiskRequest request;
+    request.operation = DiskOperation::READ;
+    request.fd = fd;
+    request.data = data;
+    request.size = size;
+    request.offset = offset;
+    queue(request);
+    if (!wait(request)) {
+        errno = request.error;
+        return -1;
+    }
+    return static_cast<int64_t>(request.transferred);
+}
+
+bool DiskIoBackend::sync(int fd) {
+    DiskRequest request;
+    request.operation = DiskOperation::SYNC;
+    request.fd = fd;
+    queue(request);
+    if (!wait(request)) {
+        errno = request.error;
+        return false;
+    }
+    return true;
+}
+
+} // namespace utils
+} // namespace dm
@@ -0,0 +1,379 @@
+#include "utils/DomainMatcher.h"
+#include "utils/HashCalculator.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+// Native byte order, the cache is never moved between machines
+const char CACHE_MAGIC[4] = {'D', 'M', 'D', '1'};
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t crc;               // Of everything after the header
+    uint64_t sourceStamp;
+    uint64_t patternCount;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t labelBytes;
+    uint32_t reserved;
+};
+
+// Host names every hosts file maps, not domains to block
+bool isHostsFileName(const std::string& name) {
+    return name == "localhost" || name == "localhost.localdomain" || name == "local" ||
+           name == "broadcasthost" || name.compare(0, 4, "ip6-") == 0;
+}
+
+} // anonymous namespace
+
+DomainMatcher::DomainMatcher() : nodes_(1) {
+}
+
+DomainMatcher::DomainMatcher(const std::vector<std::string>& patterns) {
+    struct BuildNode {
+        std::map<std::string, uint32_t> children;
+        uint32_t wildcard = NO_NODE;
+        uint32_t flags = 0;
+    };
+    std::vector<BuildNode> build(1);
+
+    for (const auto& pattern : patterns) {
+        std::string text = normalize(pattern);
+        uint32_t flags = MATCH_SELF | MATCH_SUBDOMAINS;
+        std::string_view rest = text;
+        if (rest == "*") {
+            flags = MATCH_SUBDOMAINS;
+            rest = std::string_view();
+        } else if (rest.compare(0, 2, "*.") == 0) {
+            flags = MATCH_SUBDOMAINS;
+            rest.remove_prefix(2);
+            if (rest.empty()) {
+                continue;
+            }
+        } else if (!rest.empty() && rest.front() == '.') {
+            rest.remove_prefix(1);
+        }
+        if (rest.empty() && flags != MATCH_SUBDOMAINS) {
+            continue;
+        }
+
+        // Walk the labels from the right
+        uint32_t node = 0;
+        bool valid = true;
+        size_t end = rest.size();
+        while (end > 0) {
+            size_t dot = rest.rfind('.', end - 1);
+            size_t start = dot == std::string_view::npos ? 0 : dot + 1;
+            std::string_view label = rest.substr(start, end - start);
+            if (label.empty()) {
+                valid = false;
+                break;
+            }
+
+            uint32_t id = static_cast<uint32_t>(build.size());
+            uint32_t next;
+            bool added;
+            if (label == "*") {
+                added = build[node].wildcard == NO_NODE;
+                if (added) {
+                    build[node].wildcard = id;
+                }
+                next = build[node].wildcard;
+            } else {
+                auto result = build[node].children.emplace(std::string(label), id);
+                added = result.second;
+                next = result.first->second;
+            }
+            if (added) {
+                build.emplace_back();
+            }
+
+            node = next;
+            end = dot == std::string_view::npos ? 0 : dot;
+        }
+        if (!valid) {
+            continue;
+        }
+
+        if ((build[node].flags & flags) != flags) {
+            build[node].flags |= flags;
+            patternCount_++;
+        }
+    }
+
+    // Flatten breadth first, so the edges of each node are contiguous;
+    // every build node has one parent, so each is queued exactly once
+    std::vector<uint32_t> order{0};
+    order.reserve(build.size());
+    nodes_.reserve(build.size());
+    edges_.reserve(build.size() - 1);
+    for (size_t i = 0; i < order.size(); i++) {
+        const BuildNode& source = build[order[i]];
+        Node node;
+        node.flags = source.flags;
+        node.firstEdge = static_cast<uint32_t>(edges_.size());
+        node.edgeCount = static_cast<uint32_t>(source.children.size());
+        for (const auto& child : source.children) {
+            Edge edge;
+            edge.labelOffset = static_cast<uint32_t>(labels_.size());
+            edge.labelLength = static_cast<uint32_t>(child.first.size());
+            edge.node = static_cast<uint32_t>(order.size());
+            labels_ += child.first;
+            edges_.push_back(edge);
+            order.push_back(child.second);
+        }
+        if (source.wildcard != NO_NODE) {
+            node.wildcard = static_cast<uint32_t>(order.size());
+            order.push_back(source.wildcard);
+        }
+        nodes_.push_back(node);
+    }
+}
+
+bool DomainMatcher::matches(std::string_view domain) const {
+    while (!domain.empty() && std::isspace(static_cast<unsigned char>(domain.front()))) {
+        domain.remove_prefix(1);
+    }
+    while (!domain.empty() && (domain.back() == '.' || std::isspace(static_cast<unsigned char>(domain.back())))) {
+        domain.remove_suffix(1);
+    }
+    if (domain.empty() || patternCount_ == 0) {
+        return false;
+    }
+
+    // Lowercase on the stack, a host name is at most 253 characters
+    bool lower = std::none_of(domain.begin(), domain.end(),
+                              [](unsigned char c) { return std::isupper(c); });
+    if (lower) {
+        return matchFrom(0, domain, domain.size());
+    }
+    char buffer[256];
+    if (domain.size() > sizeof(buffer)) {
+        return false;
+    }
+    std::transform(domain.begin(), domain.end(), buffer,
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return matchFrom(0, std::string_view(buffer, domain.size()), domain.size());
+}
+
+size_t DomainMatcher::getMemoryUsage() const {
+    return nodes_.capacity() * sizeof(Node) + edges_.capacity() * sizeof(Edge) + labels_.capacity();
+}
+
+bool DomainMatcher::saveCache(const std::string& path, uint64_t sourceStamp) const {
+    std::string body;
+    body.append(reinterpret_cast<const char*>(nodes_.data()), nodes_.size() * sizeof(Node));
+    body.append(reinterpret_cast<const char*>(edges_.data()), edges_.size() * sizeof(Edge));
+    body.append(labels_);
+
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.crc = HashCalculator::crc32(body.data(), body.size());
+    header.sourceStamp = sourceStamp;
+    header.patternCount = patternCount_;
+    header.nodeCount = static_cast<uint32_t>(nodes_.size());
+    header.edgeCount = static_cast<uint32_t>(edges_.size());
+    header.labelBytes = static_cast<uint32_t>(labels_.size());
+
+    // Written aside and renamed, a reader never sees half a cache
+    std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        Logger::error("Failed to write domain cache: " + path);
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(body.data(), 1, body.size(), file) == body.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        Logger::error("Failed to write domain cache: " + path);
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const DomainMatcher> DomainMatcher::loadCache(const std::string& path, uint64_t sourceStamp) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return nullptr;
+    }
+
+    CacheHeader header{};
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+              header.sourceStamp == sourceStamp && header.nodeCount > 0;
+
+    std::string body;
+    if (ok) {
+        body.resize(static_cast<size_t>(header.nodeCount) * sizeof(Node) +
+                    static_cast<size_t>(header.edgeCount) * sizeof(Edge) + header.labelBytes);
+        ok = std::fread(&body[0], 1, body.size(), file) == body.size() &&
+             std::fgetc(file) == EOF &&
+             HashCalculator::crc32(body.data(), body.size()) == header.crc;
+    }
+    std::fclose(file);
+    if (!ok) {
+        return nullptr;
+    }
+
+    auto matcher = std::make_shared<DomainMatcher>();
+    matcher->nodes_.resize(header.nodeCount);
+    matcher->edges_.resize(header.edgeCount);
+    const char* data = body.data();
+    std::memcpy(matcher->nodes_.data(), data, header.nodeCount * sizeof(Node));
+    data += header.nodeCount * sizeof(Node);
+    std::memcpy(matcher->edges_.data(), data, header.edgeCount * sizeof(Edge));
+    data += header.edgeCount * sizeof(Edge);
+    matcher->labels_.assign(data, header.labelBytes);
+    matcher->patternCount_ = header.patternCount;
+
+    // A stale build could still pass the checksum, lookups must stay in bounds
+    for (const Node& node : matcher->nodes_) {
+        if (static_cast<uint64_t>(node.firstEdge) + node.edgeCount > header.edgeCount ||
+            (node.wildcard != NO_NODE && node.wildcard >= header.nodeCount)) {
+            return nullptr;
+        }
+    }
+    for (const Edge& edge : matcher->edges_) {
+        if (edge.node >= header.nodeCount ||
+            static_cast<uint64_t>(edge.labelOffset) + edge.labelLength > header.labelBytes) {
+            return nullptr;
+        }
+    }
+
+    return matcher;
+}
+
+std::shared_ptr<const DomainMatcher> DomainMatcher::loadList(const std::string& listPath,
+                                                             const std::string& cachePath) {
+    uint64_t stamp = 0;
+    if (!getSourceStamp(listPath, stamp)) {
+        Logger::error("Domain list not found: " + listPath);
+        return nullptr;
+    }
+
+    if (!cachePath.empty()) {
+        if (auto cached = loadCache(cachePath, stamp)) {
+            Logger::debug("Loaded " + std::to_string(cached->size()) + " domains from cache " + cachePath);
+            return cached;
+        }
+    }
+
+    std::ifstream in(listPath);
+    if (!in) {
+        Logger::error("Failed to read domain list: " + listPath);
+        return nullptr;
+    }
+
+    std::vector<std::string> patterns;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+
+        // A hosts file line puts an address before its names
+        std::istringstream tokens(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (tokens >> field) {
+            fields.push_back(std::move(field));
+        }
+        for (size_t i = fields.size() > 1 ? 1 : 0; i < fields.size(); i++) {
+            if (!isHostsFileName(fields[i])) {
+                patterns.push_back(std::move(fields[i]));
+            }
+        }
+    }
+
+    auto matcher = std::make_shared<const DomainMatcher>(patterns);
+    Logger::info("Compiled " + std::to_string(matcher->size()) + " domains from " + listPath);
+    if (!cachePath.empty()) {
+        matcher->saveCache(cachePath, stamp);
+    }
+    return matcher;
+}
+
+std::string DomainMatcher::normalize(std::string_view text) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == '.' || std::isspace(static_cast<unsigned char>(text.back())))) {
+        text.remove_suffix(1);
+    }
+
+    std::string normalized(text);
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return normalized;
+}
+
+bool DomainMatcher::matchFrom(uint32_t index, std::string_view domain, size_t end) const {
+    const Node& node = nodes_[index];
+    if (end == 0) {
+        return (node.flags & MATCH_SELF) != 0;
+    }
+    if (node.flags & MATCH_SUBDOMAINS) {
+        return true;
+    }
+
+    size_t dot = domain.rfind('.', end - 1);
+    size_t start = dot == std::string_view::npos ? 0 : dot + 1;
+    std::string_view label = domain.substr(start, end - start);
+    if (label.empty()) {
+        return false;
+    }
+    size_t next = dot == std::string_view::npos ? 0 : dot;
+
+    uint32_t child = findChild(node, label);
+    if (child != NO_NODE && matchFrom(child, domain, next)) {
+        return true;
+    }
+    return node.wildcard != NO_NODE && matchFrom(node.wildcard, domain, next);
+}
+
+uint32_t DomainMatcher::findChild(const Node& node, std::string_view label) const {
+    auto labelOf = [this](const Edge& edge) {
+        return std::string_view(labels_.data() + edge.labelOffset, edge.labelLength);
+    };
+
+    const Edge* first = edges_.data() + node.firstEdge;
+    const Edge* last = first + node.edgeCount;
+    const Edge* it = std::lower_bound(first, last, label, [&labelOf](const Edge& edge, std::string_view wanted) {
+        return labelOf(edge) < wanted;
+    });
+    return it != last && labelOf(*it) == label ? it->node : NO_NODE;
+}
+
+bool DomainMatcher::getSourceStamp(const std::string& path, uint64_t& stamp) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+    auto modified = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return false;
+    }
+
+    stamp = static_cast<uint64_t>(size) * 0x9E3779B97F4A7C15ULL ^
+            static_cast<uint64_t>(modified.time_since_epoch().count());
+    return true;
+}
+
+} // namespace utils
+} // namespace dm
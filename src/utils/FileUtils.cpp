@@ -13,21 +13,130 @@
 
 #ifdef _WIN32
 #include <direct.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
 #include <windows.h>
 #include <shlobj.h>
 #define PATH_SEPARATOR "\\"
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
+#include <utime.h>
 #include <dirent.h>
 #include <pwd.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
 #define PATH_SEPARATOR "/"
 #endif
 
 namespace dm {
 namespace utils {
 
+namespace {
+
+const size_t COPY_BUFFER_SIZE = 1024 * 1024;
+
+#ifndef _WIN32
+// Copy a range between descriptors, preferring the fastest way the kernel offers
+bool copyDescriptorRange(int source, int64_t sourceOffset, int dest, int64_t destOffset, int64_t length) {
+    int64_t copied = 0;
+    
+#ifdef FICLONERANGE
+    // Shares extents on btrfs and XFS, offsets must be block aligned
+    struct file_clone_range range;
+    range.src_fd = source;
+    range.src_offset = static_cast<uint64_t>(sourceOffset);
+    range.src_length = static_cast<uint64_t>(length);
+    range.dest_offset = static_cast<uint64_t>(destOffset);
+    if (length > 0 && ioctl(dest, FICLONERANGE, &range) == 0) {
+        return true;
+    }
+#endif
+    
+#if defined(__linux__) && defined(__NR_copy_file_range)
+    // Copied inside the kernel, or on the server for NFS and SMB
+    while (copied < length) {
+        loff_t from = sourceOffset + copied;
+        loff_t to = destOffset + copied;
+        ssize_t result = syscall(__NR_copy_file_range, source, &from, dest, &to,
+                                 static_cast<size_t>(length - copied), 0u);
+        if (result > 0) {
+            copied += result;
+        } else if (result == 0) {
+            return false;
+        } else if (errno != EINTR) {
+            // Kernels before 5.3 refuse to copy across filesystems
+            if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF) {
+                return false;
+            }
+            break;
+        }
+    }
+    
+    if (copied < length && lseek(dest, static_cast<off_t>(destOffset + copied), SEEK_SET) >= 0) {
+        while (copied < length) {
+            off_t from = static_cast<off_t>(sourceOffset + copied);
+            ssize_t result = sendfile(dest, source, &from,
+                                      static_cast<size_t>(std::min<int64_t>(length - copied, 0x7ffff000)));
+            if (result > 0) {
+                copied += result;
+            } else if (result == 0) {
+                return false;
+            } else if (errno != EINTR) {
+                if (errno != EINVAL && errno != ENOSYS) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+#endif
+    
+    // Buffered copy through user space
+    std::vector<char> buffer(static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(length - copied, 1),
+                                                                   COPY_BUFFER_SIZE)));
+    while (copied < length) {
+        ssize_t bytesRead = pread(source, buffer.data(),
+                                  static_cast<size_t>(std::min<int64_t>(length - copied, buffer.size())),
+                                  static_cast<off_t>(sourceOffset + copied));
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            return false;
+        }
+        
+        ssize_t bytesWritten = 0;
+        while (bytesWritten < bytesRead) {
+            ssize_t result = pwrite(dest, buffer.data() + bytesWritten, static_cast<size_t>(bytesRead - bytesWritten),
+                                    static_cast<off_t>(destOffset + copied + bytesWritten));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                return false;
+            }
+            bytesWritten += result;
+        }
+        copied += bytesRead;
+    }
+    
+    return true;
+}
+#endif
+
+} // anonymous namespace
+
 bool FileUtils::fileExists(const std::string& filePath) {
     std::ifstream file(filePath);
     return file.good();
@@ -42,6 +151,36 @@ int64_t FileUtils::getFileSize(const std::string& filePath) {
     return static_cast<int64_t>(file.tellg());
 }
 
+int64_t FileUtils::getModificationTime(const std::string& filePath) {
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(filePath.c_str(), &info) != 0) {
+        return -1;
+    }
+#else
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0) {
+        return -1;
+    }
+#endif
+    
+    return static_cast<int64_t>(info.st_mtime);
+}
+
+bool FileUtils::setModificationTime(const std::string& filePath, int64_t seconds) {
+#ifdef _WIN32
+    struct __utimbuf64 times;
+    times.actime = static_cast<__time64_t>(seconds);
+    times.modtime = static_cast<__time64_t>(seconds);
+    return _utime64(filePath.c_str(), &times) == 0;
+#else
+    struct utimbuf times;
+    times.actime = static_cast<time_t>(seconds);
+    times.modtime = static_cast<time_t>(seconds);
+    return utime(filePath.c_str(), &times) == 0;
+#endif
+}
+
 bool FileUtils::createDirectory(const std::string& dirPath) {
     // If directory already exists, return true
     if (fileExists(dirPath)) {
@@ -81,28 +220,236 @@ bool FileUtils::deleteFile(const std::string& filePath) {
     return std::remove(filePath.c_str()) == 0;
 }
 
+bool FileUtils::preallocateFile(const std::string& filePath, int64_t size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        Logger::error("Failed to create file: " + filePath);
+        return false;
+    }
+    
+    bool success = true;
+    if (size > 0) {
+        // SetEndOfFile allocates the clusters and fails if the volume is full
+        LARGE_INTEGER position;
+        position.QuadPart = size;
+        success = SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+        if (success) {
+            // Skips zero filling, only works with SE_MANAGE_VOLUME_NAME
+            SetFileValidData(file, size);
+        } else {
+            Logger::error("Failed to allocate " + std::to_string(size) + " bytes for " + filePath);
+        }
+    }
+    
+    CloseHandle(file);
+    return success;
+#else
+    int fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::error("Failed to create file " + filePath + ": " + std::strerror(errno));
+        return false;
+    }
+    
+    if (size <= 0) {
+        ::close(fd);
+        return true;
+    }
+    
+    int result = -1;
+    int error = EOPNOTSUPP;
+    
+#if defined(__linux__)
+    // Reserve extents without changing the size, then extend
+    result = fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+    error = result == 0 ? 0 : errno;
+#elif defined(__APPLE__)
+    fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0};
+    result = fcntl(fd, F_PREALLOCATE, &store);
+    if (result == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        result = fcntl(fd, F_PREALLOCATE, &store);
+    }
+    error = result == 0 ? 0 : errno;
+#endif
+    
+    if (result != 0 && error != ENOSPC && error != EDQUOT) {
+        // Filesystem cannot reserve space, at least make sure it fits
+        struct statvfs stats;
+        if (fstatvfs(fd, &stats) == 0 &&
+            static_cast<int64_t>(stats.f_bavail) * static_cast<int64_t>(stats.f_frsize) < size) {
+            error = ENOSPC;
+        } else {
+            Logger::debug("Preallocation not supported for " + filePath + ", file will be sparse");
+            result = 0;
+        }
+    }
+    
+    if (result == 0 && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        result = -1;
+        error = errno;
+    }
+    
+    ::close(fd);
+    
+    if (result != 0) {
+        Logger::error("Failed to allocate " + std::to_string(size) + " bytes for " + filePath +
+                      ": " + std::strerror(error));
+        std::remove(filePath.c_str());
+        return false;
+    }
+    
+    return true;
+#endif
+}
+
 bool FileUtils::renameFile(const std::string& oldPath, const std::string& newPath) {
     return std::rename(oldPath.c_str(), newPath.c_str()) == 0;
 }
 
 bool FileUtils::copyFile(const std::string& sourcePath, const std::string& destPath) {
-    // Open source file
+#ifdef _WIN32
+    // Overwrites the destination, copies on the server for network shares
+    return CopyFileExA(sourcePath.c_str(), destPath.c_str(), nullptr, nullptr, nullptr, 0) != 0;
+#else
+    if (cloneFile(sourcePath, destPath)) {
+        return true;
+    }
+    
+    int source = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) {
+        return false;
+    }
+    
+    struct stat stats;
+    if (fstat(source, &stats) != 0) {
+        ::close(source);
+        return false;
+    }
+    
+    int dest = ::open(destPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, stats.st_mode & 0777);
+    if (dest < 0) {
+        ::close(source);
+        return false;
+    }
+    
+    bool success = copyDescriptorRange(source, 0, dest, 0, static_cast<int64_t>(stats.st_size));
+    
+    ::close(source);
+    if (::close(dest) != 0) {
+        success = false;
+    }
+    if (!success) {
+        std::remove(destPath.c_str());
+    }
+    return success;
+#endif
+}
+
+bool FileUtils::cloneFile(const std::string& sourcePath, const std::string& destPath) {
+#if defined(__APPLE__)
+    // Refuses an existing destination
+    std::remove(destPath.c_str());
+    return clonefile(sourcePath.c_str(), destPath.c_str(), 0) == 0;
+#elif defined(FICLONE)
+    int source = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) {
+        return false;
+    }
+    
+    struct stat stats;
+    int dest = -1;
+    if (fstat(source, &stats) == 0) {
+        dest = ::open(destPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, stats.st_mode & 0777);
+    }
+    if (dest < 0) {
+        ::close(source);
+        return false;
+    }
+    
+    bool success = ioctl(dest, FICLONE, source) == 0;
+    ::close(source);
+    if (::close(dest) != 0) {
+        success = false;
+    }
+    if (!success) {
+        std::remove(destPath.c_str());
+    }
+    return success;
+#else
+    return false;
+#endif
+}
+
+bool FileUtils::copyFileRange(const std::string& sourcePath, int64_t sourceOffset, int64_t length,
+                              const std::string& destPath, int64_t destOffset) {
+#ifdef _WIN32
     std::ifstream source(sourcePath, std::ios::binary);
     if (!source.is_open()) {
         return false;
     }
     
-    // Open destination file
-    std::ofstream dest(destPath, std::ios::binary);
+    // Open without truncating, creating the file first if needed
+    std::fstream dest(destPath, std::ios::binary | std::ios::in | std::ios::out);
     if (!dest.is_open()) {
+        std::ofstream(destPath, std::ios::binary);
+        dest.open(destPath, std::ios::binary | std::ios::in | std::ios::out);
+        if (!dest.is_open()) {
+            return false;
+        }
+    }
+    
+    if (length < 0) {
+        source.seekg(0, std::ios::end);
+        length = std::max<int64_t>(static_cast<int64_t>(source.tellg()) - sourceOffset, 0);
+    }
+    source.seekg(sourceOffset);
+    dest.seekp(destOffset);
+    
+    std::vector<char> buffer(static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(length, 1),
+                                                                   COPY_BUFFER_SIZE)));
+    while (length > 0) {
+        source.read(buffer.data(), static_cast<std::streamsize>(std::min<int64_t>(length, buffer.size())));
+        std::streamsize bytesRead = source.gcount();
+        if (bytesRead <= 0) {
+            return false;
+        }
+        dest.write(buffer.data(), bytesRead);
+        length -= bytesRead;
+    }
+    
+    dest.close();
+    return !dest.fail();
+#else
+    int source = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) {
         return false;
     }
     
-    // Copy file
-    dest << source.rdbuf();
+    if (length < 0) {
+        struct stat stats;
+        if (fstat(source, &stats) != 0) {
+            ::close(source);
+            return false;
+        }
+        length = std::max<int64_t>(static_cast<int64_t>(stats.st_size) - sourceOffset, 0);
+    }
+    
+    int dest = ::open(destPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (dest < 0) {
+        ::close(source);
+        return false;
+    }
+    
+    bool success = copyDescriptorRange(source, sourceOffset, dest, destOffset, length);
     
-    // Check for errors
-    return source.good() && dest.good();
+    ::close(source);
+    if (::close(dest) != 0) {
+        success = false;
+    }
+    return success;
+#endif
 }
 
 std::string FileUtils::getDirectory(const std::string& path) {
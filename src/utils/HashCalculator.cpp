@@ -1,7 +1,11 @@
 #include "utils/HashCalculator.h"
 #include "utils/Logger.h"
 #include "utils/FileUtils.h"
+#include "utils/IoTaskExecutor.h"
+#include "utils/DiskIo.h"
+#include "utils/Tracer.h"
 
+#include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 #include <fstream>
@@ -11,6 +15,38 @@
 #include <cstring>
 #include <stdexcept>
 #include <algorithm>
+#include <map>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#define DM_HAVE_PCLMUL_CRC32 1
+#if defined(__GNUC__)
+#define DM_TARGET_PCLMUL __attribute__((target("pclmul,sse2")))
+#else
+#define DM_TARGET_PCLMUL
+#endif
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define DM_HAVE_ARM_CRC32 1
+#endif
 
 namespace dm {
 namespace utils {
@@ -51,6 +87,530 @@ const uint32_t CRC32_TABLE[256] = {
     0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
 };
 
+namespace {
+
+uint32_t updateCrc32Table(uint32_t crc, const unsigned char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef DM_HAVE_PCLMUL_CRC32
+
+bool hasPclmul() {
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) != 0;
+#endif
+}
+
+/**
+ * Folds 64 bytes per iteration with carry-less multiplication (Intel,
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"), then
+ * Barrett-reduces to 32 bits. SSE4.2's crc32 instruction would compute
+ * CRC32C, a different polynomial.
+ * Requires size >= 64 and a multiple of 16.
+ */
+DM_TARGET_PCLMUL
+uint32_t updateCrc32Pclmul(uint32_t crc, const unsigned char* data, size_t size) {
+    const __m128i k1k2 = _mm_set_epi64x(0x00000001c6e41596LL, 0x0000000154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00000000ccaa009eLL, 0x00000001751997d0LL);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0000000163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x00000001f7011641LL, 0x00000001db710641LL);
+    const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+
+    const __m128i* block = reinterpret_cast<const __m128i*>(data);
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128(block), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    __m128i x2 = _mm_loadu_si128(block + 1);
+    __m128i x3 = _mm_loadu_si128(block + 2);
+    __m128i x4 = _mm_loadu_si128(block + 3);
+    block += 4;
+    size -= 64;
+
+    // Fold four lanes by 64 bytes at a time
+    while (size >= 64) {
+        __m128i y1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        __m128i y2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        __m128i y3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        __m128i y4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), _mm_loadu_si128(block));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, y2), _mm_loadu_si128(block + 1));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, y3), _mm_loadu_si128(block + 2));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, y4), _mm_loadu_si128(block + 3));
+        block += 4;
+        size -= 64;
+    }
+
+    // Fold the lanes into one
+    for (__m128i next : {x2, x3, x4}) {
+        __m128i y = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, y), next);
+    }
+
+    // Fold the remaining 16 byte blocks
+    while (size >= 16) {
+        __m128i y = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, y), _mm_loadu_si128(block));
+        block++;
+        size -= 16;
+    }
+
+    // 128 to 64 bits
+    __m128i y = _mm_clmulepi64_si128(k3k4, x1, 0x01);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), y);
+
+    // 64 to 32 bits
+    y = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00);
+    x1 = _mm_xor_si128(x1, y);
+
+    // Barrett reduction
+    y = x1;
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, y);
+
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+const bool USE_PCLMUL = hasPclmul();
+
+#endif
+
+uint32_t updateCrc32(uint32_t crc, const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+#if defined(DM_HAVE_PCLMUL_CRC32)
+    if (USE_PCLMUL && size >= 64) {
+        size_t folded = size & ~static_cast<size_t>(15);
+        crc = updateCrc32Pclmul(crc, bytes, folded);
+        bytes += folded;
+        size -= folded;
+    }
+#elif defined(DM_HAVE_ARM_CRC32)
+    while (size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        crc = __crc32d(crc, word);
+        bytes += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = __crc32b(crc, *bytes++);
+        size--;
+    }
+#endif
+
+    return updateCrc32Table(crc, bytes, size);
+}
+
+/**
+ * Large sequential reads into an aligned buffer, with a readahead hint.
+ * Plain reads rather than mmap, so a file truncated while it is hashed
+ * fails the read instead of raising SIGBUS. A read is started before the
+ * previous chunk is hashed and finished when its data is needed, which
+ * overlaps the two when the disk I/O backend is asynchronous.
+ */
+class ChunkReader {
+public:
+    explicit ChunkReader(const std::string& filePath)
+        : backend_(DiskIoBackend::getInstance()) {
+#ifdef _WIN32
+        file_.open(filePath, std::ios::binary);
+        if (file_) {
+            file_.seekg(0, std::ios::end);
+            size_ = static_cast<int64_t>(file_.tellg());
+            file_.seekg(0, std::ios::beg);
+        }
+#else
+        fd_ = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (fd_ >= 0 && fstat(fd_, &info) == 0) {
+            size_ = static_cast<int64_t>(info.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        }
+#endif
+    }
+
+    ~ChunkReader() {
+        // The kernel may still be writing into the buffer
+        finish();
+#ifndef _WIN32
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+    }
+
+    bool isOpen() const {
+        return size_ >= 0;
+    }
+
+    int64_t getSize() const {
+        return size_;
+    }
+
+    // Starts filling the buffer with the next chunk
+    void start(char* buffer, size_t size, int bufferSlot = -1) {
+        finish();
+        started_ = true;
+#ifdef _WIN32
+        (void)bufferSlot;
+        file_.read(buffer, static_cast<std::streamsize>(size));
+        result_ = file_.bad() ? -1 : static_cast<int64_t>(file_.gcount());
+#else
+        request_.operation = DiskOperation::READ;
+        request_.fd = fd_;
+        request_.data = buffer;
+        request_.size = size;
+        request_.offset = position_;
+        request_.bufferSlot = bufferSlot;
+        backend_.queue(request_);
+#endif
+    }
+
+    // Size of the chunk started last, short only at the end of the file, -1 on error
+    int64_t finish() {
+        if (!started_) {
+            return 0;
+        }
+        started_ = false;
+#ifndef _WIN32
+        if (!backend_.wait(request_)) {
+            result_ = -1;
+        } else {
+            result_ = static_cast<int64_t>(request_.transferred);
+            position_ += result_;
+        }
+#endif
+        return result_;
+    }
+
+private:
+    DiskIoBackend& backend_;
+#ifdef _WIN32
+    std::ifstream file_;
+#else
+    int fd_ = -1;
+    int64_t position_ = 0;
+    DiskRequest request_;
+#endif
+    int64_t size_ = -1;
+    bool started_ = false;
+    int64_t result_ = 0;
+};
+
+/**
+ * Frees a read buffer, unregistering it from the backend it was registered with.
+ */
+struct AlignedDeleter {
+    DiskIoBackend* backend = nullptr;
+    int slot = -1;
+
+    void operator()(char* ptr) const {
+        if (backend && slot >= 0) {
+            backend->unregisterBuffer(slot);
+        }
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+};
+
+using AlignedBuffer = std::unique_ptr<char, AlignedDeleter>;
+
+AlignedBuffer allocateReadBuffer(size_t size) {
+    const size_t alignment = 4096;
+#ifdef _WIN32
+    return AlignedBuffer(static_cast<char*>(_aligned_malloc(size, alignment)));
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return AlignedBuffer();
+    }
+
+    // Registered, reads into it skip pinning its pages every time
+    DiskIoBackend& backend = DiskIoBackend::getInstance();
+    AlignedDeleter deleter;
+    deleter.slot = backend.registerBuffer(static_cast<char*>(ptr), size);
+    if (deleter.slot >= 0) {
+        deleter.backend = &backend;
+    }
+    return AlignedBuffer(static_cast<char*>(ptr), deleter);
+#endif
+}
+
+// Starts reading the next chunk into a buffer from allocateReadBuffer()
+void startRead(ChunkReader& reader, AlignedBuffer& buffer, size_t size) {
+    reader.start(buffer.get(), size, buffer.get_deleter().slot);
+}
+
+// Read buffers of calculateHashes(), the workers may lag this many minus one chunks
+constexpr size_t MULTI_HASH_BUFFERS = 3;
+
+/**
+ * @brief One thread per extra algorithm of a calculateHashes() pass
+ *
+ * The workers live for the whole file. Each has a queue of the buffers it
+ * still has to hash; a buffer is read into again only once every worker
+ * is done with it, which bounds the queues by MULTI_HASH_BUFFERS.
+ */
+class HashWorkers {
+public:
+    HashWorkers(std::vector<IncrementalHash*> hashes, const AlignedBuffer* buffers)
+        : buffers_(buffers), queues_(hashes.size()) {
+        for (size_t i = 0; i < hashes.size(); i++) {
+            threads_.emplace_back([this, i, hash = hashes[i]]() { run(i, *hash); });
+        }
+    }
+
+    ~HashWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing_ = true;
+        }
+        changed_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // Hands a filled buffer to every worker
+    void submit(size_t buffer, size_t size) {
+        if (threads_.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sizes_[buffer] = size;
+            users_[buffer] = static_cast<int>(threads_.size());
+            for (auto& queue : queues_) {
+                queue.push_back(buffer);
+            }
+        }
+        changed_.notify_all();
+    }
+
+    // Waits until no worker still hashes a buffer
+    void waitFree(size_t buffer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this, buffer]() { return users_[buffer] == 0; });
+    }
+
+private:
+    void run(size_t index, IncrementalHash& hash) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            changed_.wait(lock, [this, index]() { return !queues_[index].empty() || closing_; });
+            if (queues_[index].empty()) {
+                return;
+            }
+            size_t buffer = queues_[index].front();
+            queues_[index].pop_front();
+            size_t size = sizes_[buffer];
+
+            lock.unlock();
+            hash.update(buffers_[buffer].get(), size);
+            lock.lock();
+
+            if (--users_[buffer] == 0) {
+                changed_.notify_all();
+            }
+        }
+    }
+
+    const AlignedBuffer* buffers_;
+    std::vector<std::deque<size_t>> queues_;
+    size_t sizes_[MULTI_HASH_BUFFERS] = {};
+    int users_[MULTI_HASH_BUFFERS] = {};
+    std::vector<std::thread> threads_;
+    bool closing_ = false;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+std::string toHex(const unsigned char* digest, size_t length) {
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0');
+    for (size_t i = 0; i < length; i++) {
+        ss << std::setw(2) << static_cast<int>(digest[i]);
+    }
+    return ss.str();
+}
+
+struct StreamedHash {
+    std::string hash;
+    std::uintmax_t fileSize = 0;
+    std::filesystem::file_time_type modified;
+    uint64_t sequence = 0;      // Order of recording, oldest go first when pruning
+};
+
+std::mutex streamedHashesMutex;
+std::map<std::pair<std::string, HashAlgorithm>, StreamedHash> streamedHashes;
+uint64_t nextStreamedHashSequence = 0;
+std::string manifestPath;           // Set by loadHashManifest(), saved to as entries change
+bool manifestSavePending = false;
+
+constexpr size_t MAX_STREAMED_HASHES = 4096;   // Pruned back to 3/4 of this once exceeded
+
+/**
+ * @brief Check that a recorded hash still matches its file
+ */
+bool isCurrent(const std::string& filePath, const StreamedHash& entry) {
+    std::error_code error;
+    return std::filesystem::file_size(filePath, error) == entry.fileSize && !error &&
+           std::filesystem::last_write_time(filePath, error) == entry.modified && !error;
+}
+
+/**
+ * @brief Drop entries of changed or deleted files, then the oldest ones
+ *
+ * Called with streamedHashesMutex held, once the table is over its limit.
+ */
+void pruneStreamedHashes() {
+    for (auto it = streamedHashes.begin(); it != streamedHashes.end();) {
+        it = isCurrent(it->first.first, it->second) ? std::next(it) : streamedHashes.erase(it);
+    }
+
+    size_t target = MAX_STREAMED_HASHES * 3 / 4;
+    if (streamedHashes.size() <= target) {
+        return;
+    }
+    std::vector<std::pair<uint64_t, std::pair<std::string, HashAlgorithm>>> order;
+    order.reserve(streamedHashes.size());
+    for (const auto& item : streamedHashes) {
+        order.emplace_back(item.second.sequence, item.first);
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i = 0; i < order.size() - target; i++) {
+        streamedHashes.erase(order[i].second);
+    }
+}
+
+/**
+ * @brief Claim the next manifest save, coalescing changes until it runs
+ *
+ * Called with streamedHashesMutex held.
+ *
+ * @return std::string The manifest to save, empty if none or a save is queued
+ */
+std::string claimManifestSave() {
+    if (manifestPath.empty() || manifestSavePending) {
+        return "";
+    }
+    manifestSavePending = true;
+    return manifestPath;
+}
+
+/**
+ * @brief Save the manifest on the I/O pool, off the thread recording hashes
+ */
+void queueManifestSave(const std::string& path) {
+    IoTaskExecutor::getInstance().submit(path, [path]() {
+        {
+            std::lock_guard<std::mutex> lock(streamedHashesMutex);
+            manifestSavePending = false;
+        }
+        HashCalculator::saveHashManifest(path);
+    });
+}
+
+/**
+ * @brief Get the OpenSSL digest of an algorithm
+ *
+ * @return const EVP_MD* The digest, nullptr for CRC32
+ */
+const EVP_MD* getDigest(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::MD5:
+            return EVP_md5();
+        case HashAlgorithm::SHA1:
+            return EVP_sha1();
+        case HashAlgorithm::SHA256:
+            return EVP_sha256();
+        case HashAlgorithm::SHA512:
+            return EVP_sha512();
+        case HashAlgorithm::CRC32:
+            break;
+    }
+    return nullptr;
+}
+
+// One tab separated entry per line after it: size, modification time in
+// ticks of the file clock, algorithm, hash, path
+const char HASH_MANIFEST_HEADER[] = "# dm hash manifest 1";
+
+} // namespace
+
+struct IncrementalHash::Context {
+    EVP_MD_CTX* digest = nullptr;   // Unused for CRC32
+    uint32_t crc32 = 0xFFFFFFFF;
+};
+
+IncrementalHash::IncrementalHash(HashAlgorithm algorithm)
+    : algorithm_(algorithm), context_(std::make_unique<Context>()) {
+    if (getDigest(algorithm_)) {
+        context_->digest = EVP_MD_CTX_new();
+        if (!context_->digest) {
+            throw std::runtime_error("Failed to create hash context");
+        }
+    }
+    reset();
+}
+
+IncrementalHash::~IncrementalHash() {
+    EVP_MD_CTX_free(context_->digest);
+}
+
+void IncrementalHash::reset() {
+    if (context_->digest) {
+        EVP_DigestInit_ex(context_->digest, getDigest(algorithm_), nullptr);
+    } else {
+        context_->crc32 = 0xFFFFFFFF;
+    }
+}
+
+void IncrementalHash::update(const char* data, size_t size) {
+    if (context_->digest) {
+        EVP_DigestUpdate(context_->digest, data, size);
+    } else {
+        context_->crc32 = updateCrc32(context_->crc32, data, size);
+    }
+}
+
+std::string IncrementalHash::finish() {
+    if (!context_->digest) {
+        std::stringstream ss;
+        ss << std::hex << std::setfill('0') << std::setw(8) << (context_->crc32 ^ 0xFFFFFFFF);
+        return ss.str();
+    }
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(context_->digest, digest, &length) != 1) {
+        return "";
+    }
+    return toHex(digest, length);
+}
+
+HashAlgorithm IncrementalHash::getAlgorithm() const {
+    return algorithm_;
+}
+
 HashCalculator::HashCalculator()
     : cancelled_(false), calculating_(false) {
 }
@@ -59,10 +619,9 @@ HashCalculator::~HashCalculator() {
     // Cancel any running calculations
     cancel();
     
-    // Wait for thread to finish
-    if (thread_ && thread_->joinable()) {
-        thread_->join();
-    }
+    // Wait for the job to finish
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this]() { return !calculating_; });
 }
 
 std::string HashCalculator::calculateHash(const std::string& filePath, HashAlgorithm algorithm) {
@@ -93,45 +652,48 @@ void HashCalculator::calculateHashAsync(const std::string& filePath,
                                       HashProgressCallback progressCallback,
                                       HashCompletionCallback completionCallback,
                                       HashErrorCallback errorCallback) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
     
     // Cancel any existing calculation
     cancel();
     
-    // Wait for thread to finish
-    if (thread_ && thread_->joinable()) {
-        thread_->join();
-    }
+    // Wait for its job to finish
+    finished_.wait(lock, [this]() { return !calculating_; });
     
     // Reset cancelled flag
     cancelled_ = false;
     calculating_ = true;
     
-    // Start new thread for calculation
-    thread_ = std::make_unique<std::thread>([this, filePath, algorithm, 
-                                            progressCallback, completionCallback, errorCallback]() {
+    // Queue the calculation on the shared post-processing pool
+    IoTaskExecutor::getInstance().submit(filePath, [this, filePath, algorithm, 
+                                                   progressCallback, completionCallback, errorCallback]() {
+        std::string hash;
+        std::string error;
         try {
             // Calculate hash
-            std::string hash = calculateHash(filePath, algorithm);
-            
-            // Check if cancelled
-            if (cancelled_) {
-                calculating_ = false;
-                return;
-            }
-            
-            // Call completion callback
-            if (completionCallback) {
-                completionCallback(hash);
-            }
+            hash = calculateHash(filePath, algorithm);
         } catch (const std::exception& e) {
+            error = e.what();
+        }
+        bool cancelled = cancelled_;
+        
+        // Done with this object; the callbacks may start a new calculation.
+        // Notify under the lock so a waiting destructor cannot finish first.
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            calculating_ = false;
+            finished_.notify_all();
+        }
+        
+        if (!error.empty()) {
             // Call error callback
             if (errorCallback) {
-                errorCallback(e.what());
+                errorCallback(error);
             }
+        } else if (!cancelled && completionCallback) {
+            // Call completion callback
+            completionCallback(hash);
         }
-        
-        calculating_ = false;
     });
 }
 
@@ -160,6 +722,205 @@ std::string HashCalculator::getAlgorithmName(HashAlgorithm algorithm) {
     }
 }
 
+bool HashCalculator::parseAlgorithm(const std::string& name, HashAlgorithm& algorithm) {
+    std::string normalized;
+    for (char c : name) {
+        if (c != '-') {
+            normalized += static_cast<char>(::toupper(static_cast<unsigned char>(c)));
+        }
+    }
+    
+    for (HashAlgorithm candidate : {HashAlgorithm::MD5, HashAlgorithm::SHA1, HashAlgorithm::SHA256,
+                                    HashAlgorithm::SHA512, HashAlgorithm::CRC32}) {
+        if (normalized == getAlgorithmName(candidate)) {
+            algorithm = candidate;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void HashCalculator::recordStreamedHash(const std::string& filePath, HashAlgorithm algorithm, const std::string& hash) {
+    std::error_code error;
+    StreamedHash entry;
+    entry.hash = hash;
+    entry.fileSize = std::filesystem::file_size(filePath, error);
+    if (!error) {
+        entry.modified = std::filesystem::last_write_time(filePath, error);
+    }
+    if (error) {
+        Logger::warning("Not recording streamed hash for " + filePath + ": " + error.message());
+        return;
+    }
+    
+    std::string manifest;
+    {
+        std::lock_guard<std::mutex> lock(streamedHashesMutex);
+        entry.sequence = nextStreamedHashSequence++;
+        streamedHashes[std::make_pair(filePath, algorithm)] = entry;
+        if (streamedHashes.size() > MAX_STREAMED_HASHES) {
+            pruneStreamedHashes();
+        }
+        manifest = claimManifestSave();
+    }
+    if (!manifest.empty()) {
+        queueManifestSave(manifest);
+    }
+}
+
+std::string HashCalculator::findStreamedHash(const std::string& filePath, HashAlgorithm algorithm) {
+    StreamedHash entry;
+    {
+        std::lock_guard<std::mutex> lock(streamedHashesMutex);
+        auto it = streamedHashes.find(std::make_pair(filePath, algorithm));
+        if (it == streamedHashes.end()) {
+            return "";
+        }
+        entry = it->second;
+    }
+    
+    // Only trust the hash while the file is unchanged
+    if (!isCurrent(filePath, entry)) {
+        std::lock_guard<std::mutex> lock(streamedHashesMutex);
+        streamedHashes.erase(std::make_pair(filePath, algorithm));
+        return "";
+    }
+    
+    return entry.hash;
+}
+
+std::string HashCalculator::calculateHashCached(const std::string& filePath, HashAlgorithm algorithm) {
+    std::string hash = findStreamedHash(filePath, algorithm);
+    if (!hash.empty()) {
+        return hash;
+    }
+    
+    hash = calculateHash(filePath, algorithm);
+    if (!hash.empty()) {
+        recordStreamedHash(filePath, algorithm, hash);
+    }
+    return hash;
+}
+
+bool HashCalculator::saveHashManifest(const std::string& path) {
+    std::map<std::pair<std::string, HashAlgorithm>, StreamedHash> entries;
+    {
+        std::lock_guard<std::mutex> lock(streamedHashesMutex);
+        entries = streamedHashes;
+    }
+    
+    // Written aside and renamed, a crash never leaves half a manifest
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::trunc);
+    if (!out) {
+        Logger::error("Failed to write hash manifest: " + path);
+        return false;
+    }
+    
+    out << HASH_MANIFEST_HEADER << '\n';
+    size_t written = 0;
+    std::vector<std::pair<std::string, HashAlgorithm>> stale;
+    for (const auto& item : entries) {
+        const std::string& filePath = item.first.first;
+        const StreamedHash& entry = item.second;
+        if (!isCurrent(filePath, entry)) {
+            stale.push_back(item.first);
+            continue;
+        }
+        
+        out << entry.fileSize << '\t' << entry.modified.time_since_epoch().count() << '\t'
+            << getAlgorithmName(item.first.second) << '\t' << entry.hash << '\t' << filePath << '\n';
+        written++;
+    }
+    out.close();
+    
+    // Those are looked up in vain from now on
+    {
+        std::lock_guard<std::mutex> lock(streamedHashesMutex);
+        for (const auto& key : stale) {
+            auto it = streamedHashes.find(key);
+            if (it != streamedHashes.end() && it->second.sequence == entries[key].sequence) {
+                streamedHashes.erase(it);
+            }
+        }
+    }
+    
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        Logger::error("Failed to write hash manifest: " + path);
+        return false;
+    }
+    
+    Logger::debug("Saved " + std::to_string(written) + " file hashes to " + path);
+    return true;
+}
+
+bool HashCalculator::loadHashManifest(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(streamedHashesMutex);
+        manifestPath = path;
+    }
+    
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    
+    std::string line;
+    if (!std::getline(in, line) || line != HASH_MANIFEST_HEADER) {
+        Logger::warning("Ignoring hash manifest in an unknown format: " + path);
+        return false;
+    }
+    
+    std::vector<std::pair<std::pair<std::string, HashAlgorithm>, StreamedHash>> entries;
+    while (std::getline(in, line)) {
+        // The path is last, it may contain anything but a newline
+        size_t fields[4];
+        size_t start = 0;
+        bool valid = true;
+        for (size_t& field : fields) {
+            field = line.find('\t', start);
+            if (field == std::string::npos) {
+                valid = false;
+                break;
+            }
+            start = field + 1;
+        }
+        
+        HashAlgorithm algorithm;
+        if (!valid || !parseAlgorithm(line.substr(fields[1] + 1, fields[2] - fields[1] - 1), algorithm)) {
+            continue;
+        }
+        
+        StreamedHash entry;
+        try {
+            entry.fileSize = std::stoull(line.substr(0, fields[0]));
+            entry.modified = std::filesystem::file_time_type(std::filesystem::file_time_type::duration(
+                std::stoll(line.substr(fields[0] + 1, fields[1] - fields[0] - 1))));
+        } catch (const std::exception&) {
+            continue;
+        }
+        entry.hash = line.substr(fields[2] + 1, fields[3] - fields[2] - 1);
+        entries.emplace_back(std::make_pair(line.substr(fields[3] + 1), algorithm), std::move(entry));
+    }
+    
+    std::lock_guard<std::mutex> lock(streamedHashesMutex);
+    for (auto& entry : entries) {
+        entry.second.sequence = nextStreamedHashSequence++;
+        streamedHashes.emplace(std::move(entry));
+    }
+    if (streamedHashes.size() > MAX_STREAMED_HASHES) {
+        pruneStreamedHashes();
+    }
+    Logger::debug("Loaded " + std::to_string(entries.size()) + " file hashes from " + path);
+    return true;
+}
+
+uint32_t HashCalculator::crc32(const void* data, size_t size, uint32_t crc) {
+    return updateCrc32(crc ^ 0xFFFFFFFF, static_cast<const char*>(data), size) ^ 0xFFFFFFFF;
+}
+
 bool HashCalculator::verifyHash(const std::string& filePath, 
                               const std::string& expectedHash, 
                               HashAlgorithm algorithm) {
@@ -332,9 +1093,7 @@ std::string HashCalculator::calculateCRC32(const std::string& filePath,
     // Process the file
     if (!processFile(filePath, 
                     [&crc](const char* data, size_t size) {
-                        for (size_t i = 0; i < size; i++) {
-                            crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
-                        }
+                        crc = updateCrc32(crc, data, size);
                     },
                     progressCallback)) {
         throw std::runtime_error("Failed to process file: " + filePath);
@@ -353,44 +1112,135 @@ std::string HashCalculator::calculateCRC32(const std::string& filePath,
 bool HashCalculator::processFile(const std::string& filePath, 
                                std::function<void(const char* data, size_t size)> processFunction,
                                HashProgressCallback progressCallback) {
-    // Open the file
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
+    DM_TRACE_SPAN("hash file");
+
+    // The buffers outlive the reader, which may have a read in flight
+    AlignedBuffer buffers[2] = {allocateReadBuffer(READ_BUFFER_SIZE), allocateReadBuffer(READ_BUFFER_SIZE)};
+    if (!buffers[0] || !buffers[1]) {
         return false;
     }
     
-    // Get file size
-    file.seekg(0, std::ios::end);
-    std::streamsize fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+    // Open the file
+    ChunkReader reader(filePath);
+    if (!reader.isOpen()) {
+        return false;
+    }
     
     // Process the file in chunks
-    const size_t bufferSize = 8192;
-    char buffer[bufferSize];
-    std::streamsize totalRead = 0;
+    int64_t fileSize = reader.getSize();
+    int64_t totalRead = 0;
+    int current = 0;
+    startRead(reader, buffers[current], READ_BUFFER_SIZE);
+    
+    while (!cancelled_) {
+        int64_t bytesRead = reader.finish();
+        if (bytesRead < 0) {
+            return false;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        
+        // Read ahead into the other buffer while this one is processed
+        startRead(reader, buffers[1 - current], READ_BUFFER_SIZE);
+        processFunction(buffers[current].get(), static_cast<size_t>(bytesRead));
+        
+        // Update progress
+        totalRead += bytesRead;
+        if (progressCallback && fileSize > 0) {
+            progressCallback(static_cast<double>(totalRead) / fileSize);
+        }
+        current = 1 - current;
+    }
     
-    while (file && !file.eof() && !cancelled_) {
-        file.read(buffer, bufferSize);
-        std::streamsize bytesRead = file.gcount();
+    // Return false if cancelled
+    if (cancelled_) {
+        return false;
+    }
+    
+    return true;
+}
+
+std::map<HashAlgorithm, std::string> HashCalculator::calculateHashes(const std::string& filePath,
+                                                                     const std::vector<HashAlgorithm>& algorithms,
+                                                                     HashProgressCallback progressCallback) {
+    std::map<HashAlgorithm, std::string> result;
+    if (algorithms.empty()) {
+        return result;
+    }
+    
+    // Check if file exists
+    if (!FileUtils::fileExists(filePath)) {
+        throw std::runtime_error("File not found: " + filePath);
+    }
+    
+    std::vector<std::unique_ptr<IncrementalHash>> hashes;
+    for (HashAlgorithm algorithm : algorithms) {
+        if (result.emplace(algorithm, "").second) {
+            hashes.push_back(std::make_unique<IncrementalHash>(algorithm));
+        }
+    }
+    
+    // The buffers outlive the reader, which may have a read in flight, and the workers
+    AlignedBuffer buffers[MULTI_HASH_BUFFERS];
+    for (auto& buffer : buffers) {
+        buffer = allocateReadBuffer(READ_BUFFER_SIZE);
+        if (!buffer) {
+            throw std::runtime_error("Failed to process file: " + filePath);
+        }
+    }
+    ChunkReader reader(filePath);
+    if (!reader.isOpen()) {
+        throw std::runtime_error("Failed to process file: " + filePath);
+    }
+    
+    int64_t fileSize = reader.getSize();
+    int64_t totalRead = 0;
+    size_t current = 0;
+    startRead(reader, buffers[current], READ_BUFFER_SIZE);
+    int64_t bytesRead = reader.finish();
+    
+    {
+        // Every algorithm but the first hashes on a worker of its own
+        std::vector<IncrementalHash*> others;
+        for (size_t i = 1; i < hashes.size(); i++) {
+            others.push_back(hashes[i].get());
+        }
+        HashWorkers workers(others, buffers);
         
-        if (bytesRead > 0) {
-            // Process the data
-            processFunction(buffer, bytesRead);
+        while (bytesRead > 0 && !cancelled_) {
+            size_t size = static_cast<size_t>(bytesRead);
+            workers.submit(current, size);
+            
+            // Read ahead into a buffer the workers are done with, then take the first algorithm
+            size_t next = (current + 1) % MULTI_HASH_BUFFERS;
+            workers.waitFree(next);
+            startRead(reader, buffers[next], READ_BUFFER_SIZE);
+            hashes[0]->update(buffers[current].get(), size);
+            int64_t nextRead = reader.finish();
             
             // Update progress
             totalRead += bytesRead;
             if (progressCallback && fileSize > 0) {
                 progressCallback(static_cast<double>(totalRead) / fileSize);
             }
+            
+            bytesRead = nextRead;
+            current = next;
         }
+        
+        // Leaving the scope waits for the workers to hash what they were handed
     }
     
-    // Return false if cancelled
-    if (cancelled_) {
-        return false;
+    if (bytesRead < 0 || cancelled_) {
+        throw std::runtime_error("Failed to process file: " + filePath);
     }
     
-    return true;
+    for (auto& hash : hashes) {
+        result[hash->getAlgorithm()] = hash->finish();
+    }
+    
+    return result;
 }
 
 } // namespace utils
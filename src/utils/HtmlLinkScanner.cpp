@@ -0,0 +1,386 @@
+#include "utils/HtmlLinkScanner.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+inline char lower(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+bool startsWithNoCase(const std::string& text, const char* prefix) {
+    size_t length = std::strlen(prefix);
+    if (text.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (lower(text[i]) != prefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+HtmlLinkScanner::HtmlLinkScanner() {
+}
+
+void HtmlLinkScanner::reset() {
+    state_ = State::TEXT;
+    target_ = Target::NONE;
+    tagName_.clear();
+    attributeName_.clear();
+    value_.clear();
+    valueTooLong_ = false;
+    dashes_ = 0;
+    rawTextMatched_ = 0;
+    links_.clear();
+    resources_.clear();
+    baseHref_.clear();
+}
+
+void HtmlLinkScanner::takeResults(std::vector<std::string>& links, std::vector<std::string>& resources,
+                                  std::string& baseHref) {
+    links = std::move(links_);
+    resources = std::move(resources_);
+    baseHref = std::move(baseHref_);
+    links_.clear();
+    resources_.clear();
+    baseHref_.clear();
+}
+
+void HtmlLinkScanner::feed(const char* data, size_t size) {
+    const char* pos = data;
+    const char* end = data + size;
+
+    while (pos < end) {
+        char c = *pos;
+
+        switch (state_) {
+            case State::TEXT: {
+                // Most of a page is text, jump straight to the next tag
+                const char* tag = static_cast<const char*>(std::memchr(pos, '<', end - pos));
+                if (!tag) {
+                    return;
+                }
+                pos = tag + 1;
+                state_ = State::TAG_OPEN;
+                continue;
+            }
+
+            case State::TAG_OPEN:
+                if (std::isalpha(static_cast<unsigned char>(c))) {
+                    tagName_.assign(1, lower(c));
+                    state_ = State::TAG_NAME;
+                } else if (c == '!') {
+                    dashes_ = 0;
+                    state_ = State::MARKUP_DECLARATION;
+                } else if (c == '/' || c == '?') {
+                    state_ = State::SKIP_TAG;
+                } else {
+                    // A literal '<' in text
+                    state_ = State::TEXT;
+                    continue;
+                }
+                break;
+
+            case State::TAG_NAME:
+                if (std::isalnum(static_cast<unsigned char>(c))) {
+                    if (tagName_.size() < 16) {
+                        tagName_ += lower(c);
+                    }
+                } else if (c == '>') {
+                    endTag();
+                } else {
+                    state_ = State::IN_TAG;
+                }
+                break;
+
+            case State::MARKUP_DECLARATION:
+                if (c == '-' && ++dashes_ == 2) {
+                    dashes_ = 0;
+                    state_ = State::COMMENT;
+                } else if (c != '-') {
+                    state_ = c == '>' ? State::TEXT : State::SKIP_TAG;
+                }
+                break;
+
+            case State::COMMENT:
+                if (c == '-') {
+                    dashes_++;
+                } else if (c == '>' && dashes_ >= 2) {
+                    state_ = State::TEXT;
+                } else {
+                    dashes_ = 0;
+                }
+                break;
+
+            case State::SKIP_TAG: {
+                const char* close = static_cast<const char*>(std::memchr(pos, '>', end - pos));
+                if (!close) {
+                    return;
+                }
+                pos = close + 1;
+                state_ = State::TEXT;
+                continue;
+            }
+
+            case State::IN_TAG:
+                if (c == '>') {
+                    endTag();
+                } else if (!isSpace(c) && c != '/') {
+                    attributeName_.assign(1, lower(c));
+                    state_ = State::ATTRIBUTE_NAME;
+                }
+                break;
+
+            case State::ATTRIBUTE_NAME:
+                if (c == '=') {
+                    state_ = State::BEFORE_VALUE;
+                } else if (c == '>') {
+                    endTag();
+                } else if (isSpace(c)) {
+                    state_ = State::AFTER_ATTRIBUTE_NAME;
+                } else if (c == '/') {
+                    state_ = State::IN_TAG;
+                } else if (attributeName_.size() < 16) {
+                    attributeName_ += lower(c);
+                }
+                break;
+
+            case State::AFTER_ATTRIBUTE_NAME:
+                if (c == '=') {
+                    state_ = State::BEFORE_VALUE;
+                } else if (c == '>') {
+                    endTag();
+                } else if (!isSpace(c) && c != '/') {
+                    // The previous attribute had no value
+                    attributeName_.assign(1, lower(c));
+                    state_ = State::ATTRIBUTE_NAME;
+                }
+                break;
+
+            case State::BEFORE_VALUE:
+                if (isSpace(c)) {
+                    break;
+                }
+                if (c == '>') {
+                    endTag();
+                    break;
+                }
+                beginValue();
+                if (c == '"' || c == '\'') {
+                    quote_ = c;
+                    state_ = State::QUOTED_VALUE;
+                    break;
+                }
+                state_ = State::UNQUOTED_VALUE;
+                continue;
+
+            case State::QUOTED_VALUE: {
+                const char* close = static_cast<const char*>(std::memchr(pos, quote_, end - pos));
+                const char* stop = close ? close : end;
+                if (target_ != Target::NONE && !valueTooLong_) {
+                    if (value_.size() + (stop - pos) > MAX_VALUE_LENGTH) {
+                        valueTooLong_ = true;
+                    } else {
+                        value_.append(pos, stop);
+                    }
+                }
+                if (!close) {
+                    return;
+                }
+                endValue();
+                pos = close + 1;
+                state_ = State::IN_TAG;
+                continue;
+            }
+
+            case State::UNQUOTED_VALUE:
+                if (isSpace(c) || c == '>') {
+                    endValue();
+                    if (c == '>') {
+                        endTag();
+                    } else {
+                        state_ = State::IN_TAG;
+                    }
+                } else if (target_ != Target::NONE && !valueTooLong_) {
+                    if (value_.size() >= MAX_VALUE_LENGTH) {
+                        valueTooLong_ = true;
+                    } else {
+                        value_ += c;
+                    }
+                }
+                break;
+
+            case State::RAW_TEXT:
+                if (rawTextMatched_ == 0) {
+                    const char* tag = static_cast<const char*>(std::memchr(pos, '<', end - pos));
+                    if (!tag) {
+                        return;
+                    }
+                    pos = tag + 1;
+                    rawTextMatched_ = 1;
+                    continue;
+                }
+                if (lower(c) == rawTextEnd_[rawTextMatched_]) {
+                    if (rawTextEnd_[++rawTextMatched_] == '\0') {
+                        rawTextMatched_ = 0;
+                        state_ = State::SKIP_TAG;
+                    }
+                } else {
+                    rawTextMatched_ = 0;
+                    continue;
+                }
+                break;
+        }
+
+        pos++;
+    }
+}
+
+void HtmlLinkScanner::endTag() {
+    // Script and style bodies are not markup
+    if (tagName_ == "script") {
+        rawTextEnd_ = "</script";
+        rawTextMatched_ = 0;
+        state_ = State::RAW_TEXT;
+    } else if (tagName_ == "style") {
+        rawTextEnd_ = "</style";
+        rawTextMatched_ = 0;
+        state_ = State::RAW_TEXT;
+    } else {
+        state_ = State::TEXT;
+    }
+}
+
+void HtmlLinkScanner::beginValue() {
+    const std::string& tag = tagName_;
+    const std::string& attribute = attributeName_;
+
+    target_ = Target::NONE;
+    if (attribute == "href") {
+        if (tag == "a" || tag == "area") {
+            target_ = Target::LINK;
+        } else if (tag == "link") {
+            target_ = Target::RESOURCE;
+        } else if (tag == "base" && baseHref_.empty()) {
+            target_ = Target::BASE;
+        }
+    } else if (attribute == "src") {
+        if (tag == "iframe" || tag == "frame") {
+            target_ = Target::LINK;
+        } else if (tag == "img" || tag == "script" || tag == "source" || tag == "audio" ||
+                   tag == "video" || tag == "embed") {
+            target_ = Target::RESOURCE;
+        }
+    }
+
+    value_.clear();
+    valueTooLong_ = false;
+}
+
+void HtmlLinkScanner::endValue() {
+    if (target_ == Target::NONE || valueTooLong_) {
+        target_ = Target::NONE;
+        return;
+    }
+
+    // HTML allows whitespace around attribute URLs
+    size_t start = 0;
+    size_t length = value_.size();
+    while (start < length && isSpace(value_[start])) {
+        start++;
+    }
+    while (length > start && isSpace(value_[length - 1])) {
+        length--;
+    }
+    std::string value = value_.substr(start, length - start);
+    if (value.find('&') != std::string::npos) {
+        value = decodeEntities(value);
+    }
+
+    if (!value.empty() && value[0] != '#' && !startsWithNoCase(value, "javascript:") &&
+        !startsWithNoCase(value, "mailto:") && !startsWithNoCase(value, "data:")) {
+        switch (target_) {
+            case Target::LINK:
+                links_.push_back(std::move(value));
+                break;
+            case Target::RESOURCE:
+                resources_.push_back(std::move(value));
+                break;
+            case Target::BASE:
+                baseHref_ = std::move(value);
+                break;
+            case Target::NONE:
+                break;
+        }
+    }
+
+    target_ = Target::NONE;
+}
+
+std::string HtmlLinkScanner::decodeEntities(const std::string& value) {
+    static const struct {
+        const char* name;
+        char character;
+    } entities[] = {
+        {"amp;", '&'}, {"quot;", '"'}, {"apos;", '\''}, {"lt;", '<'}, {"gt;", '>'}
+    };
+
+    std::string decoded;
+    decoded.reserve(value.size());
+
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] != '&') {
+            decoded += value[i];
+            continue;
+        }
+
+        bool replaced = false;
+        for (const auto& entity : entities) {
+            size_t length = std::strlen(entity.name);
+            if (value.compare(i + 1, length, entity.name) == 0) {
+                decoded += entity.character;
+                i += length;
+                replaced = true;
+                break;
+            }
+        }
+
+        // Numeric references to ASCII characters, e.g. "&#38;" or "&#x26;"
+        if (!replaced && i + 2 < value.size() && value[i + 1] == '#') {
+            bool hex = value[i + 2] == 'x' || value[i + 2] == 'X';
+            size_t digits = i + (hex ? 3 : 2);
+            size_t semicolon = value.find(';', digits);
+            if (semicolon != std::string::npos && semicolon > digits && semicolon - digits <= 6) {
+                char* parsedEnd = nullptr;
+                long code = std::strtol(value.c_str() + digits, &parsedEnd, hex ? 16 : 10);
+                if (parsedEnd == value.c_str() + semicolon && code > 0 && code < 128) {
+                    decoded += static_cast<char>(code);
+                    i = semicolon;
+                    replaced = true;
+                }
+            }
+        }
+
+        if (!replaced) {
+            decoded += '&';
+        }
+    }
+
+    return decoded;
+}
+
+} // namespace utils
+} // namespace dm
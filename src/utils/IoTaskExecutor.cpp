@@ -0,0 +1,220 @@
+#include "utils/IoTaskExecutor.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <exception>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#endif
+
+namespace dm {
+namespace utils {
+
+IoTaskExecutor& IoTaskExecutor::getInstance() {
+    static IoTaskExecutor instance;
+    return instance;
+}
+
+IoTaskExecutor::IoTaskExecutor() {
+}
+
+IoTaskExecutor::~IoTaskExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void IoTaskExecutor::submit(const std::string& filePath, std::function<void()> job, bool urgent) {
+    if (!job) {
+        return;
+    }
+
+    bool rotational = false;
+    std::string deviceKey = getDeviceKey(filePath, rotational);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        startWorkers();
+
+        Device& device = devices_[deviceKey];
+        device.rotational = rotational;
+
+        Job entry;
+        entry.filePath = filePath;
+        entry.work = std::move(job);
+        entry.sequence = nextSequence_++;
+        (urgent ? device.urgent : device.normal).push_back(std::move(entry));
+        pending_++;
+    }
+
+    changed_.notify_one();
+}
+
+bool IoTaskExecutor::prioritize(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bool found = false;
+    for (auto& pair : devices_) {
+        Device& device = pair.second;
+        for (auto it = device.normal.begin(); it != device.normal.end();) {
+            if (it->filePath == filePath) {
+                device.urgent.push_back(std::move(*it));
+                it = device.normal.erase(it);
+                found = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    return found;
+}
+
+void IoTaskExecutor::setDeviceConcurrency(int count) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        deviceConcurrency_ = std::max(1, count);
+    }
+    changed_.notify_all();
+}
+
+size_t IoTaskExecutor::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+void IoTaskExecutor::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        Job job;
+        std::string deviceKey;
+        changed_.wait(lock, [&]() {
+            return takeJob(job, deviceKey) || (stopping_ && pending_ == 0);
+        });
+        if (!job.work) {
+            return;
+        }
+
+        lock.unlock();
+        try {
+            job.work();
+        } catch (const std::exception& e) {
+            Logger::error("Post-processing job for " + job.filePath + " failed: " + e.what());
+        }
+        job.work = nullptr;
+        lock.lock();
+
+        devices_[deviceKey].active--;
+        pending_--;
+
+        // A device slot opened up
+        changed_.notify_all();
+    }
+}
+
+bool IoTaskExecutor::takeJob(Job& job, std::string& deviceKey) {
+    // Urgent jobs first, then the oldest job of any device with a free slot
+    Device* best = nullptr;
+    bool bestUrgent = false;
+    uint64_t bestSequence = 0;
+
+    for (auto& pair : devices_) {
+        Device& device = pair.second;
+        if (device.active >= getLimit(device)) {
+            continue;
+        }
+
+        bool urgent = !device.urgent.empty();
+        if (!urgent && device.normal.empty()) {
+            continue;
+        }
+
+        uint64_t sequence = urgent ? device.urgent.front().sequence : device.normal.front().sequence;
+        if (!best || (urgent && !bestUrgent) || (urgent == bestUrgent && sequence < bestSequence)) {
+            best = &device;
+            bestUrgent = urgent;
+            bestSequence = sequence;
+            deviceKey = pair.first;
+        }
+    }
+
+    if (!best) {
+        return false;
+    }
+
+    std::deque<Job>& queue = bestUrgent ? best->urgent : best->normal;
+    job = std::move(queue.front());
+    queue.pop_front();
+    best->active++;
+
+    return true;
+}
+
+void IoTaskExecutor::startWorkers() {
+    if (!workers_.empty()) {
+        return;
+    }
+
+    unsigned count = std::min(MAX_WORKERS, std::max(2u, std::thread::hardware_concurrency()));
+    for (unsigned i = 0; i < count; i++) {
+        workers_.emplace_back(&IoTaskExecutor::workerLoop, this);
+    }
+}
+
+int IoTaskExecutor::getLimit(const Device& device) const {
+    return device.rotational ? 1 : deviceConcurrency_;
+}
+
+std::string IoTaskExecutor::getDeviceKey(const std::string& filePath, bool& rotational) {
+    rotational = false;
+
+#ifdef _WIN32
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::absolute(filePath, error);
+    return error ? std::string() : path.root_name().string();
+#else
+    // The file may not exist yet, fall back to its directory
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0) {
+        std::string parent = std::filesystem::path(filePath).parent_path().string();
+        if (parent.empty() || stat(parent.c_str(), &info) != 0) {
+            return std::string();
+        }
+    }
+
+#ifdef __linux__
+    // Partitions have no queue of their own, ask the whole disk
+    std::string base = "/sys/dev/block/" + std::to_string(major(info.st_dev)) + ":" +
+                       std::to_string(minor(info.st_dev));
+    for (const char* queue : {"/queue/rotational", "/../queue/rotational"}) {
+        std::ifstream file(base + queue);
+        int value = 0;
+        if (file >> value) {
+            rotational = value == 1;
+            break;
+        }
+    }
+#endif
+
+    return std::to_string(static_cast<uint64_t>(info.st_dev));
+#endif
+}
+
+} // namespace utils
+} // namespace dm
@@ -3,59 +3,104 @@
 
 #include <iostream>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <ctime>
+#include <cstdio>
 #include <vector>
 #include <algorithm>
+#include <system_error>
 
 namespace dm {
 namespace utils {
 
+/**
+ * @brief A queue cell, its sequence tells producers and the writer whose turn it is
+ */
+struct Logger::QueueSlot {
+    std::atomic<uint64_t> sequence{0};
+    LogRecord record;
+};
+
 // Initialize static member variables
 std::string Logger::logFile_;
 std::ofstream Logger::logStream_;
 std::mutex Logger::mutex_;
-LogLevel Logger::logLevel_ = LogLevel::INFO;
+std::atomic<LogLevel> Logger::logLevel_{LogLevel::INFO};
 size_t Logger::maxFileSize_ = 5 * 1024 * 1024; // 5 MB default
+size_t Logger::fileSize_ = 0;
 int Logger::maxFiles_ = 5;
 bool Logger::initialized_ = false;
 bool Logger::consoleLoggingEnabled_ = true;
 bool Logger::fileLoggingEnabled_ = true;
 LogCallback Logger::logCallback_ = nullptr;
 
+std::unique_ptr<Logger::QueueSlot[]> Logger::queue_;
+std::atomic<uint64_t> Logger::enqueuePosition_{0};
+uint64_t Logger::dequeuePosition_ = 0;
+std::thread Logger::writerThread_;
+std::atomic<std::thread::id> Logger::writerThreadId_{std::thread::id()};
+std::atomic<bool> Logger::writerRunning_{false};
+std::atomic<bool> Logger::asyncEnabled_{true};
+std::atomic<bool> Logger::writerIdle_{false};
+std::atomic<int> Logger::activeProducers_{0};
+bool Logger::writerStopping_ = false;
+std::mutex Logger::wakeMutex_;
+std::condition_variable Logger::wakeCondition_;
+std::condition_variable Logger::flushedCondition_;
+std::atomic<uint64_t> Logger::writtenCount_{0};
+std::atomic<LogOverflowPolicy> Logger::overflowPolicy_{LogOverflowPolicy::DROP};
+std::atomic<uint64_t> Logger::droppedCount_{0};
+std::atomic<uint64_t> Logger::unreportedDrops_{0};
+
+namespace {
+
+// Defined after the members above so it runs first at exit, a joinable
+// writer thread must not outlive them
+struct WriterShutdown {
+    ~WriterShutdown() {
+        Logger::shutdown();
+    }
+} writerShutdown;
+
+} // namespace
+
 bool Logger::initialize(const std::string& logFile, size_t maxFileSize, int maxFiles) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    // Check if already initialized
-    if (initialized_) {
-        // Close existing log file
-        if (logStream_.is_open()) {
-            logStream_.close();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        // Check if already initialized
+        if (initialized_) {
+            // Close existing log file
+            if (logStream_.is_open()) {
+                logStream_.close();
+            }
+            initialized_ = false;
         }
+        
+        // Set parameters
+        logFile_ = logFile;
+        maxFileSize_ = maxFileSize;
+        maxFiles_ = maxFiles;
+        
+        // Create directory if needed
+        std::string directory = FileUtils::getDirectory(logFile_);
+        if (!directory.empty() && !FileUtils::createDirectory(directory)) {
+            std::cerr << "Failed to create log directory: " << directory << std::endl;
+            return false;
+        }
+        
+        // Open log file
+        logStream_.open(logFile_, std::ios::app);
+        if (!logStream_.is_open()) {
+            std::cerr << "Failed to open log file: " << logFile_ << std::endl;
+            return false;
+        }
+        fileSize_ = static_cast<size_t>(std::max<int64_t>(0, FileUtils::getFileSize(logFile_)));
+        
+        // Set initialized flag
+        initialized_ = true;
+        asyncEnabled_ = true;
     }
     
-    // Set parameters
-    logFile_ = logFile;
-    maxFileSize_ = maxFileSize;
-    maxFiles_ = maxFiles;
-    
-    // Create directory if needed
-    std::string directory = FileUtils::getDirectory(logFile_);
-    if (!directory.empty() && !FileUtils::createDirectory(directory)) {
-        std::cerr << "Failed to create log directory: " << directory << std::endl;
-        return false;
-    }
-    
-    // Open log file
-    logStream_.open(logFile_, std::ios::app);
-    if (!logStream_.is_open()) {
-        std::cerr << "Failed to open log file: " << logFile_ << std::endl;
-        return false;
-    }
-    
-    // Set initialized flag
-    initialized_ = true;
-    
     // Log initialization
     info("Logger initialized");
     
@@ -63,86 +108,138 @@ bool Logger::initialize(const std::string& logFile, size_t maxFileSize, int maxF
 }
 
 void Logger::shutdown() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    bool initialized = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        initialized = initialized_;
+    }
     
-    if (initialized_) {
-        // Log shutdown
+    // Log shutdown
+    if (initialized) {
         info("Logger shutdown");
+    }
+    
+    // Write what is queued, later messages are written synchronously
+    asyncEnabled_ = false;
+    stopWriter();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Close log file
+    if (logStream_.is_open()) {
+        logStream_.close();
+    }
+    
+    // Reset initialized flag
+    initialized_ = false;
+}
+
+void Logger::flush() {
+    if (writerRunning_.load(std::memory_order_acquire) &&
+        writerThreadId_.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+        uint64_t target = enqueuePosition_.load(std::memory_order_acquire);
+        wakeWriter();
         
-        // Close log file
-        if (logStream_.is_open()) {
-            logStream_.close();
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        while (writtenCount_.load(std::memory_order_acquire) < target &&
+               writerRunning_.load(std::memory_order_acquire)) {
+            flushedCondition_.wait_for(lock, std::chrono::milliseconds(WRITER_IDLE_TIMEOUT_MS));
         }
-        
-        // Reset initialized flag
-        initialized_ = false;
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout.flush();
+    if (logStream_.is_open()) {
+        logStream_.flush();
     }
 }
 
-void Logger::debug(const std::string& message) {
-    log(LogLevel::DEBUG, message);
+void Logger::debug(std::string message) {
+    log(LogLevel::DEBUG, std::move(message));
 }
 
-void Logger::info(const std::string& message) {
-    log(LogLevel::INFO, message);
+void Logger::info(std::string message) {
+    log(LogLevel::INFO, std::move(message));
 }
 
-void Logger::warning(const std::string& message) {
-    log(LogLevel::WARNING, message);
+void Logger::warning(std::string message) {
+    log(LogLevel::WARNING, std::move(message));
 }
 
-void Logger::error(const std::string& message) {
-    log(LogLevel::LOG_ERROR, message);
+void Logger::error(std::string message) {
+    log(LogLevel::LOG_ERROR, std::move(message));
 }
 
-void Logger::critical(const std::string& message) {
-    log(LogLevel::CRITICAL, message);
+void Logger::critical(std::string message) {
+    log(LogLevel::CRITICAL, std::move(message));
 }
 
-void Logger::log(LogLevel level, const std::string& message) {
+void Logger::log(LogLevel level, std::string message) {
     // Check if level is enabled
-    if (level < logLevel_) {
+    if (!isEnabled(level)) {
         return;
     }
     
-    // Format log message
-    std::string timestamp = getCurrentTimestamp();
-    std::string levelStr = logLevelToString(level);
-    std::string formattedMessage = timestamp + " [" + levelStr + "] " + message;
+    // Formatting is left to the writer thread
+    LogRecord record;
+    record.time = std::chrono::system_clock::now();
+    record.level = level;
+    record.message = std::move(message);
     
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        // Write to console if enabled
-        if (consoleLoggingEnabled_) {
-            // Set output color based on log level
-            if (level == LogLevel::LOG_ERROR || level == LogLevel::CRITICAL) {
-                std::cerr << formattedMessage << std::endl;
-            } else {
-                std::cout << formattedMessage << std::endl;
+    if (!writerRunning_.load(std::memory_order_acquire) && asyncEnabled_.load(std::memory_order_relaxed)) {
+        startWriter();
+    }
+    
+    // Registered before looking at the writer, so stopWriter() drains after our push
+    activeProducers_.fetch_add(1);
+    
+    // The writer thread logs from the callback synchronously, it cannot wait on itself
+    if (writerRunning_.load() &&
+        writerThreadId_.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+        while (true) {
+            if (enqueue(record)) {
+                activeProducers_.fetch_sub(1, std::memory_order_release);
+                wakeWriter();
+                
+                // A critical message often comes right before an abort
+                if (level == LogLevel::CRITICAL) {
+                    flush();
+                }
+                return;
+            }
+            
+            if (overflowPolicy_.load(std::memory_order_relaxed) == LogOverflowPolicy::DROP) {
+                activeProducers_.fetch_sub(1, std::memory_order_release);
+                droppedCount_.fetch_add(1, std::memory_order_relaxed);
+                unreportedDrops_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            
+            // The writer signals each batch it takes out
+            wakeWriter();
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            flushedCondition_.wait_for(lock, std::chrono::milliseconds(WRITER_IDLE_TIMEOUT_MS), []() {
+                return hasQueueSpace() || !writerRunning_.load(std::memory_order_acquire);
+            });
+            if (!writerRunning_.load(std::memory_order_acquire)) {
+                break;
             }
-        }
-        
-        // Write to file if enabled and initialized
-        if (fileLoggingEnabled_ && initialized_) {
-            writeToFile(formattedMessage);
         }
     }
+    activeProducers_.fetch_sub(1, std::memory_order_release);
     
-    // Call log callback if set
-    if (logCallback_) {
-        logCallback_(level, message);
-    }
+    std::vector<LogRecord> batch;
+    batch.push_back(std::move(record));
+    writeRecords(batch);
 }
 
 void Logger::setLogLevel(LogLevel level) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    logLevel_ = level;
+    logLevel_.store(level, std::memory_order_relaxed);
 }
 
 LogLevel Logger::getLogLevel() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return logLevel_;
+    return logLevel_.load(std::memory_order_relaxed);
 }
 
 void Logger::setLogCallback(LogCallback callback) {
@@ -160,22 +257,321 @@ void Logger::enableFileLogging(bool enable) {
     fileLoggingEnabled_ = enable;
 }
 
-std::string Logger::getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    auto now_tm = std::localtime(&now_time_t);
+void Logger::setOverflowPolicy(LogOverflowPolicy policy) {
+    overflowPolicy_.store(policy, std::memory_order_relaxed);
+}
+
+LogOverflowPolicy Logger::getOverflowPolicy() {
+    return overflowPolicy_.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::getDroppedCount() {
+    return droppedCount_.load(std::memory_order_relaxed);
+}
+
+bool Logger::enqueue(LogRecord& record) {
+    // Bounded multi-producer queue, a producer claims a position and fills
+    // its slot once the writer has emptied it
+    uint64_t position = enqueuePosition_.load(std::memory_order_relaxed);
+    QueueSlot* slot = nullptr;
+    
+    while (true) {
+        slot = &queue_[position & (QUEUE_CAPACITY - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence - position);
+        
+        if (difference == 0) {
+            if (enqueuePosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The writer has not emptied this slot yet, the queue is full
+            return false;
+        } else {
+            position = enqueuePosition_.load(std::memory_order_relaxed);
+        }
+    }
+    
+    slot->record = std::move(record);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+void Logger::dequeue(std::vector<LogRecord>& batch, size_t maxRecords) {
+    size_t taken = 0;
+    while (taken < maxRecords) {
+        QueueSlot& slot = queue_[dequeuePosition_ & (QUEUE_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition_ + 1) {
+            break;
+        }
+        
+        batch.push_back(std::move(slot.record));
+        slot.sequence.store(dequeuePosition_ + QUEUE_CAPACITY, std::memory_order_release);
+        dequeuePosition_++;
+        taken++;
+    }
+}
+
+bool Logger::hasQueuedRecord() {
+    const QueueSlot& slot = queue_[dequeuePosition_ & (QUEUE_CAPACITY - 1)];
+    return slot.sequence.load(std::memory_order_acquire) == dequeuePosition_ + 1;
+}
+
+bool Logger::hasQueueSpace() {
+    uint64_t position = enqueuePosition_.load(std::memory_order_relaxed);
+    const QueueSlot& slot = queue_[position & (QUEUE_CAPACITY - 1)];
+    return static_cast<int64_t>(slot.sequence.load(std::memory_order_acquire) - position) >= 0;
+}
+
+void Logger::wakeWriter() {
+    // Pairs with the fence in writerLoop, either the writer sees the new
+    // record or we see it idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writerIdle_.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+        }
+        wakeCondition_.notify_one();
+    }
+}
+
+void Logger::startWriter() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (writerRunning_.load(std::memory_order_relaxed) || !asyncEnabled_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    
+    // The queue outlives restarts, positions carry on where they stopped
+    if (!queue_) {
+        queue_.reset(new QueueSlot[QUEUE_CAPACITY]);
+        for (size_t i = 0; i < QUEUE_CAPACITY; i++) {
+            queue_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
     
-    auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
+    {
+        std::lock_guard<std::mutex> wakeLock(wakeMutex_);
+        writerStopping_ = false;
+    }
     
-    std::stringstream ss;
-    ss << std::put_time(now_tm, "%Y-%m-%d %H:%M:%S.");
-    ss << std::setfill('0') << std::setw(3) << now_ms.count();
+    try {
+        writerThread_ = std::thread(&Logger::writerLoop);
+    } catch (const std::system_error& e) {
+        // Keep logging synchronously
+        asyncEnabled_ = false;
+        std::cerr << "Failed to start log writer thread: " << e.what() << std::endl;
+        return;
+    }
     
-    return ss.str();
+    writerThreadId_.store(writerThread_.get_id(), std::memory_order_relaxed);
+    writerRunning_.store(true, std::memory_order_release);
 }
 
-std::string Logger::logLevelToString(LogLevel level) {
+void Logger::stopWriter() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!writerThread_.joinable()) {
+            return;
+        }
+        thread = std::move(writerThread_);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        writerStopping_ = true;
+    }
+    wakeCondition_.notify_one();
+    
+    if (thread.get_id() == std::this_thread::get_id()) {
+        // Shutdown from the log callback, the loop ends on its own
+        thread.detach();
+        writerRunning_.store(false, std::memory_order_release);
+        return;
+    }
+    thread.join();
+    
+    writerRunning_.store(false);
+    writerThreadId_.store(std::thread::id(), std::memory_order_relaxed);
+    
+    // Producers that saw the writer running finish their push, or stop
+    // waiting for room and write synchronously
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+    }
+    flushedCondition_.notify_all();
+    while (activeProducers_.load() > 0) {
+        std::this_thread::yield();
+    }
+    
+    // Records pushed while the writer was finishing
+    std::vector<LogRecord> batch;
+    while (true) {
+        batch.clear();
+        dequeue(batch, MAX_BATCH_SIZE);
+        if (batch.empty()) {
+            break;
+        }
+        writeRecords(batch);
+        writtenCount_.fetch_add(batch.size(), std::memory_order_release);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+    }
+    flushedCondition_.notify_all();
+}
+
+void Logger::writerLoop() {
+    std::vector<LogRecord> batch;
+    batch.reserve(MAX_BATCH_SIZE + 1);
+    
+    while (true) {
+        batch.clear();
+        
+        uint64_t dropped = unreportedDrops_.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            LogRecord record;
+            record.time = std::chrono::system_clock::now();
+            record.level = LogLevel::WARNING;
+            record.message = "Dropped " + std::to_string(dropped) + " log messages, the log queue was full";
+            batch.push_back(std::move(record));
+        }
+        
+        dequeue(batch, MAX_BATCH_SIZE);
+        size_t taken = batch.size() - (dropped > 0 ? 1 : 0);
+        
+        if (!batch.empty()) {
+            writeRecords(batch);
+            if (taken > 0) {
+                writtenCount_.fetch_add(taken, std::memory_order_release);
+                {
+                    std::lock_guard<std::mutex> lock(wakeMutex_);
+                }
+                flushedCondition_.notify_all();
+            }
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        if (writerStopping_) {
+            break;
+        }
+        
+        writerIdle_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasQueuedRecord() && unreportedDrops_.load(std::memory_order_relaxed) == 0) {
+            wakeCondition_.wait_for(lock, std::chrono::milliseconds(WRITER_IDLE_TIMEOUT_MS));
+        }
+        writerIdle_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::writeRecords(const std::vector<LogRecord>& batch) {
+    LogCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        bool toConsole = consoleLoggingEnabled_;
+        bool toFile = fileLoggingEnabled_ && initialized_ && logStream_.is_open();
+        bool wroteFile = toFile;
+        bool consoleIsError = false;
+        std::string console;
+        std::string file;
+        std::string line;
+        
+        for (const auto& record : batch) {
+            line.clear();
+            appendTimestamp(line, record.time);
+            line += " [";
+            line += logLevelToString(record.level);
+            line += "] ";
+            line += record.message;
+            line += '\n';
+            
+            if (toConsole) {
+                // Errors go to stderr, keep their order relative to stdout
+                bool isError = record.level == LogLevel::LOG_ERROR || record.level == LogLevel::CRITICAL;
+                if (isError != consoleIsError && !console.empty()) {
+                    (consoleIsError ? std::cerr : std::cout) << console;
+                    console.clear();
+                }
+                consoleIsError = isError;
+                console += line;
+            }
+            
+            if (toFile) {
+                file += line;
+                fileSize_ += line.size();
+                
+                // Check if file rotation is needed
+                if (fileSize_ > maxFileSize_) {
+                    logStream_ << file;
+                    file.clear();
+                    rotateLogFiles();
+                    toFile = logStream_.is_open();
+                }
+            }
+        }
+        
+        // One flush per batch instead of per line
+        if (!console.empty()) {
+            (consoleIsError ? std::cerr : std::cout) << console;
+        }
+        if (toConsole) {
+            std::cout.flush();
+        }
+        if (toFile && !file.empty()) {
+            logStream_ << file;
+        }
+        if (wroteFile && logStream_.is_open()) {
+            logStream_.flush();
+        }
+        
+        callback = logCallback_;
+    }
+    
+    // Call log callback if set
+    if (callback) {
+        for (const auto& record : batch) {
+            callback(record.level, record.message);
+        }
+    }
+}
+
+void Logger::appendTimestamp(std::string& line, std::chrono::system_clock::time_point time) {
+    // Calendar conversion once per second, the writer formats many lines per second
+    static std::time_t cachedSecond = -1;
+    static char cachedText[32] = {};
+    
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    if (seconds != cachedSecond) {
+        std::tm parts{};
+#ifdef _WIN32
+        localtime_s(&parts, &seconds);
+#else
+        localtime_r(&seconds, &parts);
+#endif
+        if (std::strftime(cachedText, sizeof(cachedText), "%Y-%m-%d %H:%M:%S", &parts) == 0) {
+            cachedText[0] = '\0';
+        }
+        cachedSecond = seconds;
+    }
+    
+    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch()).count() % 1000;
+    if (milliseconds < 0) {
+        milliseconds += 1000;
+    }
+    
+    char fraction[8];
+    std::snprintf(fraction, sizeof(fraction), ".%03d", static_cast<int>(milliseconds));
+    line += cachedText;
+    line += fraction;
+}
+
+const char* Logger::logLevelToString(LogLevel level) {
     switch (level) {
         case LogLevel::DEBUG:
             return "DEBUG";
@@ -192,17 +588,6 @@ std::string Logger::logLevelToString(LogLevel level) {
     }
 }
 
-void Logger::writeToFile(const std::string& message) {
-    // Check if file rotation is needed
-    if (FileUtils::getFileSize(logFile_) > static_cast<int64_t>(maxFileSize_)) {
-        rotateLogFiles();
-    }
-    
-    // Write to log file
-    logStream_ << message << std::endl;
-    logStream_.flush();
-}
-
 void Logger::rotateLogFiles() {
     // Close current log file
     if (logStream_.is_open()) {
@@ -232,6 +617,7 @@ void Logger::rotateLogFiles() {
     
     // Open new log file
     logStream_.open(logFile_, std::ios::app);
+    fileSize_ = 0;
     if (!logStream_.is_open()) {
         std::cerr << "Failed to open rotated log file: " << logFile_ << std::endl;
     }
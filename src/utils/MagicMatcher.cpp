@@ -0,0 +1,211 @@
+#include "utils/MagicMatcher.h"
+
+#include <algorithm>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+constexpr int X = MagicMatcher::ANY_BYTE;
+
+/**
+ * @brief Pattern from a literal, for signatures that are plain text
+ */
+std::vector<int> text(const char* literal) {
+    std::vector<int> pattern;
+    for (const char* c = literal; *c; ++c) {
+        pattern.push_back(static_cast<uint8_t>(*c));
+    }
+    return pattern;
+}
+
+} // namespace
+
+const MagicMatcher& MagicMatcher::getInstance() {
+    static const MagicMatcher instance;
+    return instance;
+}
+
+MagicMatcher::MagicMatcher() {
+    signatures_ = {
+        // Images
+        {0, {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A}, {"image/png", "png", "PNG image", std::string("IEND\xAE\x42\x60\x82", 8)}},
+        {0, {0xFF, 0xD8, 0xFF}, {"image/jpeg", "jpg", "JPEG image", "\xFF\xD9"}},
+        {0, text("GIF87a"), {"image/gif", "gif", "GIF image", "\x3B"}},
+        {0, text("GIF89a"), {"image/gif", "gif", "GIF image", "\x3B"}},
+        {0, text("BM"), {"image/bmp", "bmp", "Bitmap image", ""}},
+        {0, {0x52, 0x49, 0x46, 0x46, X, X, X, X, 0x57, 0x45, 0x42, 0x50}, {"image/webp", "webp", "WebP image", ""}},
+        {0, {0x00, 0x00, 0x01, 0x00}, {"image/x-icon", "ico", "Icon", ""}},
+        {0, {0x49, 0x49, 0x2A, 0x00}, {"image/tiff", "tif", "TIFF image", ""}},
+        {0, {0x4D, 0x4D, 0x00, 0x2A}, {"image/tiff", "tif", "TIFF image", ""}},
+
+        // Audio and video
+        {0, {0x52, 0x49, 0x46, 0x46, X, X, X, X, 0x57, 0x41, 0x56, 0x45}, {"audio/wav", "wav", "WAVE audio", ""}},
+        {0, {0x52, 0x49, 0x46, 0x46, X, X, X, X, 0x41, 0x56, 0x49, 0x20}, {"video/x-msvideo", "avi", "AVI video", ""}},
+        {0, text("ID3"), {"audio/mpeg", "mp3", "MP3 audio", ""}},
+        {0, {0xFF, 0xFB}, {"audio/mpeg", "mp3", "MP3 audio", ""}},
+        {0, {0xFF, 0xF3}, {"audio/mpeg", "mp3", "MP3 audio", ""}},
+        {0, text("OggS"), {"audio/ogg", "ogg", "Ogg media", ""}},
+        {0, text("fLaC"), {"audio/flac", "flac", "FLAC audio", ""}},
+        {0, {0x1A, 0x45, 0xDF, 0xA3}, {"video/x-matroska", "mkv", "Matroska video", ""}},
+        {0, text("FLV"), {"video/x-flv", "flv", "Flash video", ""}},
+        {0, {0x00, 0x00, 0x01, 0xBA}, {"video/mpeg", "mpg", "MPEG program stream", ""}},
+        {4, text("ftyp"), {"video/mp4", "mp4", "MPEG-4 media", ""}},
+        {4, text("ftypqt  "), {"video/quicktime", "mov", "QuickTime video", ""}},
+        {4, text("ftypM4A "), {"audio/mp4", "m4a", "MPEG-4 audio", ""}},
+        {4, text("ftypheic"), {"image/heic", "heic", "HEIC image", ""}},
+
+        // Documents
+        {0, text("%PDF-"), {"application/pdf", "pdf", "PDF document", "%%EOF"}},
+        {0, text("{\\rtf"), {"application/rtf", "rtf", "RTF document", ""}},
+        {0, text("<?xml"), {"text/xml", "xml", "XML document", ""}},
+        {0, text("<!DOCTYPE html"), {"text/html", "html", "HTML document", ""}},
+        {0, text("<html"), {"text/html", "html", "HTML document", ""}},
+        {0, text("SQLite format 3"), {"application/vnd.sqlite3", "sqlite", "SQLite database", ""}},
+        {0, {0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1}, {"application/x-ole-storage", "msi", "OLE compound document", ""}},
+
+        // Archives
+        {0, {0x50, 0x4B, 0x03, 0x04}, {"application/zip", "zip", "ZIP archive", "PK\x05\x06"}},
+        {0, {0x50, 0x4B, 0x05, 0x06}, {"application/zip", "zip", "ZIP archive", ""}},
+        {0, {0x52, 0x61, 0x72, 0x21, 0x1A, 0x07}, {"application/vnd.rar", "rar", "RAR archive", ""}},
+        {0, {0x37, 0x7A, 0xBC, 0xAF, 0x27, 0x1C}, {"application/x-7z-compressed", "7z", "7-Zip archive", ""}},
+        {0, {0x1F, 0x8B}, {"application/gzip", "gz", "Gzip archive", ""}},
+        {0, text("BZh"), {"application/x-bzip2", "bz2", "Bzip2 archive", ""}},
+        {0, {0xFD, 0x37, 0x7A, 0x58, 0x5A, 0x00}, {"application/x-xz", "xz", "XZ archive", std::string("YZ", 2)}},
+        {0, {0x28, 0xB5, 0x2F, 0xFD}, {"application/zstd", "zst", "Zstandard archive", ""}},
+        {0, text("MSCF"), {"application/vnd.ms-cab-compressed", "cab", "Cabinet archive", ""}},
+        {257, text("ustar"), {"application/x-tar", "tar", "Tar archive", ""}},
+        {0, text("!<arch>\n"), {"application/x-archive", "a", "ar archive", ""}},
+        {0, text("!<arch>\ndebian"), {"application/vnd.debian.binary-package", "deb", "Debian package", ""}},
+        {0, {0xED, 0xAB, 0xEE, 0xDB}, {"application/x-rpm", "rpm", "RPM package", ""}},
+
+        // Executables
+        {0, text("MZ"), {"application/x-msdownload", "exe", "Windows executable", ""}},
+        {0, {0x7F, 0x45, 0x4C, 0x46}, {"application/x-elf", "", "ELF executable", ""}},
+        {0, {0xCF, 0xFA, 0xED, 0xFE}, {"application/x-mach-binary", "", "Mach-O executable", ""}},
+        {0, {0xFE, 0xED, 0xFA, 0xCF}, {"application/x-mach-binary", "", "Mach-O executable", ""}},
+        {0, {0x00, 0x61, 0x73, 0x6D}, {"application/wasm", "wasm", "WebAssembly module", ""}},
+        {0, text("#!"), {"text/x-shellscript", "sh", "Script", ""}},
+    };
+
+    nodes_.reserve(256);
+    for (size_t i = 0; i < signatures_.size(); i++) {
+        insert(static_cast<int32_t>(i));
+    }
+}
+
+FileSignature MagicMatcher::match(const char* data, size_t size) const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    int32_t best = -1;
+    size_t bestLength = 0;
+
+    for (const Trie& trie : tries_) {
+        if (trie.offset >= size) {
+            continue;
+        }
+        int32_t first = trie.root[bytes[trie.offset]];
+        if (first >= 0) {
+            walk(first, bytes, size, trie.offset + 1, best, bestLength);
+        }
+        if (trie.rootAny >= 0) {
+            walk(trie.rootAny, bytes, size, trie.offset + 1, best, bestLength);
+        }
+    }
+
+    return best >= 0 ? signatures_[best].type : FileSignature();
+}
+
+FileSignature MagicMatcher::match(const std::string& head) const {
+    return match(head.data(), head.size());
+}
+
+bool MagicMatcher::hasFooter(const FileSignature& signature, const std::string& tail) {
+    // Trailing padding, newlines or archive comments may follow the footer
+    return signature.footer.empty() || tail.rfind(signature.footer) != std::string::npos;
+}
+
+size_t MagicMatcher::getMaxSignatureEnd() const {
+    return maxSignatureEnd_;
+}
+
+void MagicMatcher::insert(int32_t index) {
+    const Signature& signature = signatures_[index];
+    maxSignatureEnd_ = std::max(maxSignatureEnd_, signature.offset + signature.pattern.size());
+
+    auto trie = std::find_if(tries_.begin(), tries_.end(),
+                             [&](const Trie& t) { return t.offset == signature.offset; });
+    if (trie == tries_.end()) {
+        Trie created;
+        created.offset = signature.offset;
+        created.root.fill(-1);
+        tries_.push_back(created);
+        trie = tries_.end() - 1;
+    }
+
+    // The first byte goes through the jump table
+    int first = signature.pattern.front();
+    int32_t& root = first == ANY_BYTE ? trie->rootAny : trie->root[first];
+    if (root < 0) {
+        root = static_cast<int32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+
+    int32_t node = root;
+    for (size_t i = 1; i < signature.pattern.size(); i++) {
+        node = child(node, signature.pattern[i]);
+    }
+    nodes_[node].signature = index;
+}
+
+int32_t MagicMatcher::child(int32_t node, int value) {
+    if (value == ANY_BYTE) {
+        if (nodes_[node].any < 0) {
+            int32_t created = static_cast<int32_t>(nodes_.size());
+            nodes_.emplace_back();
+            nodes_[node].any = created;
+        }
+        return nodes_[node].any;
+    }
+
+    uint8_t byte = static_cast<uint8_t>(value);
+    auto& edges = nodes_[node].edges;
+    auto it = std::lower_bound(edges.begin(), edges.end(), byte,
+                               [](const std::pair<uint8_t, int32_t>& edge, uint8_t b) { return edge.first < b; });
+    if (it != edges.end() && it->first == byte) {
+        return it->second;
+    }
+
+    int32_t created = static_cast<int32_t>(nodes_.size());
+    edges.insert(it, std::make_pair(byte, created));
+    nodes_.emplace_back();
+    return created;
+}
+
+void MagicMatcher::walk(int32_t node, const uint8_t* data, size_t size, size_t position,
+                        int32_t& best, size_t& bestLength) const {
+    const Node& current = nodes_[node];
+    if (current.signature >= 0) {
+        size_t length = signatures_[current.signature].pattern.size();
+        if (length > bestLength) {
+            best = current.signature;
+            bestLength = length;
+        }
+    }
+    if (position >= size) {
+        return;
+    }
+
+    uint8_t byte = data[position];
+    auto it = std::lower_bound(current.edges.begin(), current.edges.end(), byte,
+                               [](const std::pair<uint8_t, int32_t>& edge, uint8_t b) { return edge.first < b; });
+    if (it != current.edges.end() && it->first == byte) {
+        walk(it->second, data, size, position + 1, best, bestLength);
+    }
+    if (current.any >= 0) {
+        walk(current.any, data, size, position + 1, best, bestLength);
+    }
+}
+
+} // namespace utils
+} // namespace dm
@@ -0,0 +1,334 @@
+#include "utils/MetalinkParser.h"
+#include "utils/FileUtils.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+// Priorities run from 1 (most preferred) to 999999
+constexpr int LOWEST_PRIORITY = 999999;
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+std::string trim(const std::string& text) {
+    size_t start = 0;
+    while (start < text.size() && isSpace(text[start])) {
+        start++;
+    }
+    size_t end = text.size();
+    while (end > start && isSpace(text[end - 1])) {
+        end--;
+    }
+    return text.substr(start, end - start);
+}
+
+// Replace the predefined and numeric character references
+std::string decodeEntities(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); i++) {
+        size_t semicolon;
+        if (text[i] != '&' || (semicolon = text.find(';', i)) == std::string::npos) {
+            result += text[i];
+            continue;
+        }
+
+        std::string entity = text.substr(i + 1, semicolon - i - 1);
+        if (entity == "amp") {
+            result += '&';
+        } else if (entity == "lt") {
+            result += '<';
+        } else if (entity == "gt") {
+            result += '>';
+        } else if (entity == "quot") {
+            result += '"';
+        } else if (entity == "apos") {
+            result += '\'';
+        } else if (entity.size() > 1 && entity[0] == '#') {
+            long code = entity[1] == 'x' ? std::strtol(entity.c_str() + 2, nullptr, 16)
+                                         : std::strtol(entity.c_str() + 1, nullptr, 10);
+            if (code > 0 && code < 0x80) {
+                result += static_cast<char>(code);
+            } else if (code >= 0x80 && code < 0x800) {
+                result += static_cast<char>(0xC0 | (code >> 6));
+                result += static_cast<char>(0x80 | (code & 0x3F));
+            } else if (code >= 0x800 && code < 0x10000) {
+                result += static_cast<char>(0xE0 | (code >> 12));
+                result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                result += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        } else {
+            result += text.substr(i, semicolon - i + 1);
+        }
+        i = semicolon;
+    }
+
+    return result;
+}
+
+// Element name without its namespace prefix
+std::string localName(const std::string& name) {
+    size_t colon = name.find(':');
+    return colon == std::string::npos ? name : name.substr(colon + 1);
+}
+
+// Attributes of a start tag body ("url priority="1" location="de"")
+std::map<std::string, std::string> parseAttributes(const std::string& tag, size_t pos) {
+    std::map<std::string, std::string> attributes;
+
+    while (pos < tag.size()) {
+        while (pos < tag.size() && isSpace(tag[pos])) {
+            pos++;
+        }
+        size_t nameStart = pos;
+        while (pos < tag.size() && tag[pos] != '=' && !isSpace(tag[pos])) {
+            pos++;
+        }
+        std::string name = tag.substr(nameStart, pos - nameStart);
+        while (pos < tag.size() && isSpace(tag[pos])) {
+            pos++;
+        }
+        if (pos >= tag.size() || tag[pos] != '=') {
+            break;
+        }
+        pos++;
+        while (pos < tag.size() && isSpace(tag[pos])) {
+            pos++;
+        }
+        if (pos >= tag.size() || (tag[pos] != '"' && tag[pos] != '\'')) {
+            break;
+        }
+        char quote = tag[pos++];
+        size_t valueEnd = tag.find(quote, pos);
+        if (valueEnd == std::string::npos) {
+            break;
+        }
+        attributes[toLower(localName(name))] = decodeEntities(tag.substr(pos, valueEnd - pos));
+        pos = valueEnd + 1;
+    }
+
+    return attributes;
+}
+
+} // anonymous namespace
+
+bool MetalinkParser::parse(const std::string& xml, std::vector<MetalinkFile>& files) {
+    files.clear();
+
+    struct LinkUrl {
+        std::string url;
+        int priority;
+        size_t order;
+    };
+
+    bool isMetalink = false;
+    std::vector<std::string> elements;         // Open elements, innermost last
+    std::string text;
+    MetalinkFile file;
+    std::vector<LinkUrl> urls;
+    std::map<std::string, std::string> attributes;  // Of the innermost open element
+    bool readingPieces = false;                     // In the first <pieces> of the file
+
+    size_t pos = 0;
+    while (pos < xml.size()) {
+        size_t open = xml.find('<', pos);
+        if (open == std::string::npos) {
+            break;
+        }
+        text.append(xml, pos, open - pos);
+
+        // Comments, CDATA sections, declarations and processing instructions
+        if (xml.compare(open, 4, "<!--") == 0) {
+            size_t end = xml.find("-->", open + 4);
+            pos = end == std::string::npos ? xml.size() : end + 3;
+            continue;
+        }
+        if (xml.compare(open, 9, "<![CDATA[") == 0) {
+            size_t end = xml.find("]]>", open + 9);
+            if (end == std::string::npos) {
+                break;
+            }
+            text.append(xml, open + 9, end - open - 9);
+            pos = end + 3;
+            continue;
+        }
+
+        size_t close = xml.find('>', open + 1);
+        if (close == std::string::npos) {
+            break;
+        }
+        std::string tag = xml.substr(open + 1, close - open - 1);
+        pos = close + 1;
+
+        if (tag.empty() || tag[0] == '?' || tag[0] == '!') {
+            continue;
+        }
+
+        if (tag[0] == '/') {
+            // End tag: the text collected since the start tag is its content
+            std::string name = toLower(localName(trim(tag.substr(1))));
+            std::string parent = elements.size() >= 2 ? elements[elements.size() - 2] : "";
+            std::string value = trim(decodeEntities(text));
+            text.clear();
+
+            if (parent == "file") {
+                if (name == "size") {
+                    char* end = nullptr;
+                    long long size = std::strtoll(value.c_str(), &end, 10);
+                    if (end && *end == '\0' && size >= 0) {
+                        file.size = size;
+                    }
+                } else if (name == "hash") {
+                    // Whole-file hashes only, piece hashes sit inside <pieces>
+                    auto type = attributes.find("type");
+                    if (type != attributes.end() && !value.empty()) {
+                        file.hashes[toLower(type->second)] = toLower(value);
+                    }
+                } else if (name == "url" && !value.empty()) {
+                    int priority = LOWEST_PRIORITY;
+                    auto attribute = attributes.find("priority");
+                    if (attribute != attributes.end()) {
+                        priority = std::max(1, std::min(LOWEST_PRIORITY, std::atoi(attribute->second.c_str())));
+                    }
+                    urls.push_back(LinkUrl{value, priority, urls.size()});
+                }
+            } else if (parent == "pieces" && name == "hash" && readingPieces) {
+                file.pieceHashes.push_back(toLower(value));
+            }
+
+            if (name == "file") {
+                std::stable_sort(urls.begin(), urls.end(), [](const LinkUrl& a, const LinkUrl& b) {
+                    return a.priority < b.priority;
+                });
+                for (const auto& url : urls) {
+                    file.urls.push_back(url.url);
+                }
+
+                if (!isSafeName(file.name)) {
+                    Logger::warning("Skipping Metalink file with unsafe name: " + file.name);
+                } else if (file.urls.empty()) {
+                    Logger::warning("Skipping Metalink file without URLs: " + file.name);
+                } else {
+                    files.push_back(file);
+                }
+                file = MetalinkFile();
+                urls.clear();
+            }
+            if (name == "pieces") {
+                readingPieces = false;
+            }
+
+            // Pop up to and including the matching element
+            while (!elements.empty()) {
+                bool match = elements.back() == name;
+                elements.pop_back();
+                if (match) {
+                    break;
+                }
+            }
+            attributes.clear();
+            continue;
+        }
+
+        // Start tag
+        bool selfClosing = tag.back() == '/';
+        if (selfClosing) {
+            tag.pop_back();
+        }
+        size_t nameEnd = 0;
+        while (nameEnd < tag.size() && !isSpace(tag[nameEnd])) {
+            nameEnd++;
+        }
+        std::string name = toLower(localName(tag.substr(0, nameEnd)));
+        text.clear();
+
+        if (name == "metalink") {
+            isMetalink = true;
+        }
+        if (selfClosing) {
+            continue;
+        }
+
+        elements.push_back(name);
+        attributes = parseAttributes(tag, nameEnd);
+        if (name == "file") {
+            file = MetalinkFile();
+            auto fileName = attributes.find("name");
+            if (fileName != attributes.end()) {
+                file.name = fileName->second;
+            }
+            urls.clear();
+        } else if (name == "pieces" && elements.size() >= 2 && elements[elements.size() - 2] == "file" &&
+                   file.pieceHashes.empty()) {
+            // The hashes of one type are enough
+            auto length = attributes.find("length");
+            auto type = attributes.find("type");
+            char* end = nullptr;
+            long long pieceLength = length != attributes.end() ? std::strtoll(length->second.c_str(), &end, 10) : 0;
+            readingPieces = end && *end == '\0' && pieceLength > 0 && type != attributes.end();
+            if (readingPieces) {
+                file.pieceLength = pieceLength;
+                file.pieceHashType = toLower(type->second);
+            }
+        }
+    }
+
+    return isMetalink && !files.empty();
+}
+
+bool MetalinkParser::parseFile(const std::string& path, std::vector<MetalinkFile>& files) {
+    std::string xml = FileUtils::readTextFile(path);
+    if (xml.empty()) {
+        Logger::error("Failed to read Metalink file: " + path);
+        return false;
+    }
+
+    if (!parse(xml, files)) {
+        Logger::error("No downloadable files in Metalink file: " + path);
+        return false;
+    }
+
+    return true;
+}
+
+bool MetalinkParser::isSafeName(const std::string& name) {
+    if (name.empty() || name[0] == '/' || name[0] == '\\' ||
+        (name.size() > 1 && name[1] == ':')) {
+        return false;
+    }
+
+    // No component may climb out of the directory
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find_first_of("/\\", start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        std::string component = name.substr(start, end - start);
+        if (component.empty() || component == "." || component == "..") {
+            return false;
+        }
+        start = end + 1;
+    }
+
+    return true;
+}
+
+} // namespace utils
+} // namespace dm
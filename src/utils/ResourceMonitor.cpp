@@ -0,0 +1,246 @@
+#include "utils/ResourceMonitor.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+#ifdef __linux__
+// Read a small /proc file without going through iostreams
+bool readProcFile(const char* path, char* buffer, size_t size) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    ssize_t length = ::read(fd, buffer, size - 1);
+    ::close(fd);
+    if (length <= 0) {
+        return false;
+    }
+
+    buffer[length] = '\0';
+    return true;
+}
+#endif
+
+} // namespace
+
+ResourceMonitor& ResourceMonitor::getInstance() {
+    static ResourceMonitor instance;
+    return instance;
+}
+
+ResourceMonitor::ResourceMonitor() {
+}
+
+ResourceMonitor::~ResourceMonitor() {
+    stop();
+}
+
+void ResourceMonitor::start(int intervalMs) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        intervalMs_ = std::max(MIN_SAMPLE_INTERVAL_MS, intervalMs);
+
+        if (!thread_.joinable()) {
+            stopping_ = false;
+            try {
+                thread_ = std::thread(&ResourceMonitor::samplerLoop, this);
+            } catch (const std::system_error& e) {
+                Logger::error("Failed to start resource sampler: " + std::string(e.what()));
+            }
+            return;
+        }
+    }
+
+    // Pick up the new interval
+    changed_.notify_all();
+}
+
+void ResourceMonitor::stop() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!thread_.joinable()) {
+            return;
+        }
+        stopping_ = true;
+        thread = std::move(thread_);
+    }
+    changed_.notify_all();
+    thread.join();
+}
+
+bool ResourceMonitor::isRunning() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return thread_.joinable();
+}
+
+void ResourceMonitor::sampleNow() {
+    ResourceUsage usage;
+    if (!readProcessUsage(usage)) {
+        return;
+    }
+
+    residentBytes_.store(usage.residentBytes, std::memory_order_relaxed);
+    virtualBytes_.store(usage.virtualBytes, std::memory_order_relaxed);
+    openFiles_.store(usage.openFiles, std::memory_order_relaxed);
+    threadCount_.store(usage.threadCount, std::memory_order_relaxed);
+
+    int64_t peak = peakResidentBytes_.load(std::memory_order_relaxed);
+    while (usage.residentBytes > peak &&
+           !peakResidentBytes_.compare_exchange_weak(peak, usage.residentBytes, std::memory_order_relaxed)) {
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    sampledAtMs_.store(now.count(), std::memory_order_release);
+}
+
+ResourceUsage ResourceMonitor::getUsage() const {
+    ResourceUsage usage;
+    usage.sampledAt = std::chrono::system_clock::time_point(
+        std::chrono::milliseconds(sampledAtMs_.load(std::memory_order_acquire)));
+    usage.residentBytes = residentBytes_.load(std::memory_order_relaxed);
+    usage.peakResidentBytes = peakResidentBytes_.load(std::memory_order_relaxed);
+    usage.virtualBytes = virtualBytes_.load(std::memory_order_relaxed);
+    usage.openFiles = openFiles_.load(std::memory_order_relaxed);
+    usage.threadCount = threadCount_.load(std::memory_order_relaxed);
+    return usage;
+}
+
+SubsystemUsage ResourceMonitor::getSubsystemUsage(ResourceSubsystem subsystem) const {
+    const Counters& counters = counters_[static_cast<size_t>(subsystem)];
+
+    SubsystemUsage usage;
+    usage.liveObjects = counters.liveObjects.load(std::memory_order_relaxed);
+    usage.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+    usage.totalAllocations = counters.totalAllocations.load(std::memory_order_relaxed);
+    return usage;
+}
+
+const char* ResourceMonitor::getSubsystemName(ResourceSubsystem subsystem) {
+    switch (subsystem) {
+        case ResourceSubsystem::WRITE_BUFFERS:
+            return "Write buffers";
+        case ResourceSubsystem::CURL_HANDLES:
+            return "CURL handles";
+        case ResourceSubsystem::SEGMENTS:
+            return "Segments";
+        default:
+            return "Unknown";
+    }
+}
+
+void ResourceMonitor::samplerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stopping_) {
+        lock.unlock();
+        sampleNow();
+        lock.lock();
+
+        changed_.wait_for(lock, std::chrono::milliseconds(intervalMs_));
+    }
+}
+
+bool ResourceMonitor::readProcessUsage(ResourceUsage& usage) {
+#ifdef _WIN32
+    HANDLE process = GetCurrentProcess();
+
+    PROCESS_MEMORY_COUNTERS memory;
+    if (!GetProcessMemoryInfo(process, &memory, sizeof(memory))) {
+        return false;
+    }
+    usage.residentBytes = static_cast<int64_t>(memory.WorkingSetSize);
+    usage.peakResidentBytes = static_cast<int64_t>(memory.PeakWorkingSetSize);
+    usage.virtualBytes = static_cast<int64_t>(memory.PagefileUsage);
+
+    DWORD handles = 0;
+    if (GetProcessHandleCount(process, &handles)) {
+        usage.openFiles = static_cast<int>(handles);
+    }
+
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        DWORD processId = GetCurrentProcessId();
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry)) {
+            if (entry.th32OwnerProcessID == processId) {
+                usage.threadCount++;
+            }
+        }
+        CloseHandle(snapshot);
+    }
+
+    return true;
+#elif defined(__linux__)
+    static const long pageSize = sysconf(_SC_PAGESIZE);
+
+    // "size resident shared text lib data dt" in pages
+    char buffer[512];
+    if (!readProcFile("/proc/self/statm", buffer, sizeof(buffer))) {
+        return false;
+    }
+    long long pages = 0;
+    long long residentPages = 0;
+    if (std::sscanf(buffer, "%lld %lld", &pages, &residentPages) != 2) {
+        return false;
+    }
+    usage.virtualBytes = pages * pageSize;
+    usage.residentBytes = residentPages * pageSize;
+    usage.peakResidentBytes = usage.residentBytes;
+
+    // The command name may hold spaces, fields are counted after its ')'
+    if (readProcFile("/proc/self/stat", buffer, sizeof(buffer))) {
+        const char* field = std::strrchr(buffer, ')');
+        // num_threads is field 20, the 18th after the command name
+        for (int i = 0; field && i < 18; i++) {
+            field = std::strchr(field + 1, ' ');
+        }
+        if (field) {
+            usage.threadCount = std::atoi(field + 1);
+        }
+    }
+
+    DIR* directory = opendir("/proc/self/fd");
+    if (directory) {
+        int count = 0;
+        while (struct dirent* entry = readdir(directory)) {
+            if (entry->d_name[0] != '.') {
+                count++;
+            }
+        }
+        closedir(directory);
+        // Not counting the descriptor used for the listing itself
+        usage.openFiles = std::max(0, count - 1);
+    }
+
+    return true;
+#else
+    (void)usage;
+    return false;
+#endif
+}
+
+} // namespace utils
+} // namespace dm
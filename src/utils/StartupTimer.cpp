@@ -0,0 +1,92 @@
+#include "utils/StartupTimer.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+double toMilliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // anonymous namespace
+
+StartupTimer& StartupTimer::getInstance() {
+    static StartupTimer instance;
+    return instance;
+}
+
+StartupTimer::StartupTimer()
+    : origin_(std::chrono::steady_clock::now()), mainThread_(std::this_thread::get_id()) {
+}
+
+void StartupTimer::recordStage(const std::string& name, std::chrono::steady_clock::time_point start,
+                               std::chrono::steady_clock::time_point end) {
+    Entry entry;
+    entry.name = name;
+    entry.start = start - origin_;
+    entry.duration = end - start;
+    entry.background = std::this_thread::get_id() != mainThread_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(std::move(entry));
+}
+
+void StartupTimer::markMilestone(const std::string& name) {
+    Entry entry;
+    entry.name = name;
+    entry.start = std::chrono::steady_clock::now() - origin_;
+    entry.milestone = true;
+    entry.background = std::this_thread::get_id() != mainThread_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(std::move(entry));
+}
+
+std::string StartupTimer::getReport() const {
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries = entries_;
+    }
+
+    // Stages are recorded as they finish, listed as they started
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry& a, const Entry& b) { return a.start < b.start; });
+
+    std::string report = "Startup timings (start, duration):";
+    char line[64];
+    for (const auto& entry : entries) {
+        if (entry.milestone) {
+            std::snprintf(line, sizeof(line), "\n  %9.1f ms  %11s  ", toMilliseconds(entry.start), "--");
+        } else {
+            std::snprintf(line, sizeof(line), "\n  %9.1f ms  %8.1f ms  ", toMilliseconds(entry.start),
+                          toMilliseconds(entry.duration));
+        }
+        report += line;
+        report += entry.name;
+        if (entry.background) {
+            report += " (background)";
+        }
+    }
+    return report;
+}
+
+void StartupTimer::logReport() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reported_) {
+            return;
+        }
+        reported_ = true;
+    }
+
+    Logger::info(getReport());
+}
+
+} // namespace utils
+} // namespace dm
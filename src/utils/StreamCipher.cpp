@@ -0,0 +1,328 @@
+#include "utils/StreamCipher.h"
+#include "utils/Logger.h"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+// Header: magic, frame size (little endian), nonce prefix, source tag
+// (zero for a stream not bound to a file)
+const char STREAM_MAGIC[4] = {'D', 'M', 'C', '2'};
+const size_t NONCE_PREFIX_SIZE = 8;
+const size_t SOURCE_TAG_OFFSET = 16;
+const size_t NONCE_SIZE = 12;
+const size_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+bool isValidFrameSize(size_t frameSize) {
+    return frameSize > 0 && frameSize <= MAX_FRAME_SIZE;
+}
+
+uint64_t getFrameCount(int64_t plainSize, size_t frameSize) {
+    // An empty stream still has one, empty, last frame
+    if (plainSize <= 0) {
+        return 1;
+    }
+    return (static_cast<uint64_t>(plainSize) + frameSize - 1) / frameSize;
+}
+
+} // anonymous namespace
+
+StreamCipher::StreamCipher(const std::vector<uint8_t>& key) {
+    if (key.size() != KEY_SIZE) {
+        throw std::invalid_argument("Stream cipher key must be " + std::to_string(KEY_SIZE) + " bytes");
+    }
+    std::memcpy(key_, key.data(), KEY_SIZE);
+
+    context_ = EVP_CIPHER_CTX_new();
+    if (!context_) {
+        OPENSSL_cleanse(key_, KEY_SIZE);
+        throw std::runtime_error("Failed to create cipher context");
+    }
+}
+
+StreamCipher::~StreamCipher() {
+    EVP_CIPHER_CTX_free(context_);
+    OPENSSL_cleanse(key_, KEY_SIZE);
+}
+
+bool StreamCipher::startEncryption(size_t frameSize) {
+    if (!isValidFrameSize(frameSize)) {
+        Logger::error("Invalid stream cipher frame size: " + std::to_string(frameSize));
+        return false;
+    }
+
+    uint8_t header[HEADER_SIZE] = {};
+    std::memcpy(header, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    for (int i = 0; i < 4; i++) {
+        header[4 + i] = static_cast<uint8_t>(frameSize >> (8 * i));
+    }
+    if (RAND_bytes(header + 8, NONCE_PREFIX_SIZE) != 1) {
+        Logger::error("Failed to generate a stream nonce");
+        return false;
+    }
+
+    return startStream(header);
+}
+
+bool StreamCipher::startStream(const uint8_t* header) {
+    if (std::memcmp(header, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0) {
+        return false;
+    }
+
+    size_t frameSize = 0;
+    for (int i = 0; i < 4; i++) {
+        frameSize |= static_cast<size_t>(header[4 + i]) << (8 * i);
+    }
+    if (!isValidFrameSize(frameSize)) {
+        return false;
+    }
+
+    std::memcpy(header_, header, HEADER_SIZE);
+    frameSize_ = frameSize;
+    return true;
+}
+
+bool StreamCipher::startFrame(uint64_t index, bool last, bool encrypt) {
+    if (frameSize_ == 0 || index > 0xFFFFFFFFull) {
+        return false;
+    }
+
+    uint8_t nonce[NONCE_SIZE];
+    std::memcpy(nonce, header_ + 8, NONCE_PREFIX_SIZE);
+    for (int i = 0; i < 4; i++) {
+        nonce[NONCE_PREFIX_SIZE + i] = static_cast<uint8_t>(index >> (8 * (3 - i)));
+    }
+
+    // The header and the last frame flag are authenticated with every frame
+    uint8_t lastFlag = last ? 1 : 0;
+    int length = 0;
+    return EVP_CipherInit_ex(context_, EVP_aes_256_gcm(), nullptr, key_, nonce, encrypt ? 1 : 0) == 1 &&
+           EVP_CipherUpdate(context_, nullptr, &length, header_, HEADER_SIZE) == 1 &&
+           EVP_CipherUpdate(context_, nullptr, &length, &lastFlag, 1) == 1;
+}
+
+bool StreamCipher::encryptFrame(uint64_t index, const uint8_t* data, size_t size, bool last, uint8_t* out) {
+    if (size > frameSize_ || (!last && size != frameSize_) || !startFrame(index, last, true)) {
+        return false;
+    }
+
+    int length = 0;
+    int finalLength = 0;
+    if ((size > 0 && EVP_EncryptUpdate(context_, out, &length, data, static_cast<int>(size)) != 1) ||
+        EVP_EncryptFinal_ex(context_, out + length, &finalLength) != 1) {
+        return false;
+    }
+
+    return EVP_CIPHER_CTX_ctrl(context_, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, out + size) == 1;
+}
+
+bool StreamCipher::decryptFrame(uint64_t index, const uint8_t* data, size_t size, bool last, uint8_t* out) {
+    if (size < TAG_SIZE) {
+        return false;
+    }
+    size_t plainSize = size - TAG_SIZE;
+    if (plainSize > frameSize_ || (!last && plainSize != frameSize_) || !startFrame(index, last, false)) {
+        return false;
+    }
+
+    int length = 0;
+    int finalLength = 0;
+    if ((plainSize > 0 && EVP_DecryptUpdate(context_, out, &length, data, static_cast<int>(plainSize)) != 1) ||
+        EVP_CIPHER_CTX_ctrl(context_, EVP_CTRL_GCM_SET_TAG, TAG_SIZE,
+                            const_cast<uint8_t*>(data + plainSize)) != 1) {
+        return false;
+    }
+
+    return EVP_DecryptFinal_ex(context_, out + length, &finalLength) == 1;
+}
+
+bool StreamCipher::encryptFile(const std::string& inputPath, const std::string& outputPath, bool resume) {
+    std::error_code error;
+    int64_t plainSize = static_cast<int64_t>(std::filesystem::file_size(inputPath, error));
+    int64_t modified = error ? 0 : static_cast<int64_t>(
+        std::filesystem::last_write_time(inputPath, error).time_since_epoch().count());
+    std::ifstream input(inputPath, std::ios::binary);
+    if (error || !input) {
+        Logger::error("Failed to open file to encrypt: " + inputPath);
+        return false;
+    }
+
+    // Whole frames of an interrupted run are kept and the rest written again;
+    // an output of the full stream size is already complete
+    uint64_t firstFrame = 0;
+    if (resume) {
+        std::ifstream existing(outputPath, std::ios::binary);
+        uint8_t header[HEADER_SIZE];
+        uint8_t tag[SOURCE_TAG_SIZE];
+        bool stream = existing.read(reinterpret_cast<char*>(header), HEADER_SIZE) && startStream(header);
+        existing.close();
+
+        // Re-encrypting frames of another plaintext under the same nonces
+        // leaks both plaintexts and GCM's authentication key, a changed
+        // source starts a new stream
+        bool sameSource = stream && computeSourceTag(plainSize, modified, tag) &&
+                          CRYPTO_memcmp(tag, header + SOURCE_TAG_OFFSET, SOURCE_TAG_SIZE) == 0;
+        if (stream && !sameSource) {
+            Logger::info("Source of " + outputPath + " changed, encrypting it afresh");
+        }
+        if (sameSource) {
+            int64_t existingSize = static_cast<int64_t>(std::filesystem::file_size(outputPath, error));
+            if (!error && existingSize == getEncryptedSize(plainSize, frameSize_) &&
+                isCompleteStream(outputPath, plainSize)) {
+                return true;
+            }
+            if (!error) {
+                uint64_t wholeFrames = static_cast<uint64_t>(existingSize - HEADER_SIZE) / (frameSize_ + TAG_SIZE);
+                firstFrame = std::min(wholeFrames, getFrameCount(plainSize, frameSize_) - 1);
+            }
+        }
+
+        if (firstFrame > 0) {
+            std::filesystem::resize_file(outputPath, getFrameOffset(firstFrame, frameSize_), error);
+            if (error) {
+                firstFrame = 0;
+            }
+        }
+    }
+
+    std::ofstream output;
+    if (firstFrame > 0) {
+        output.open(outputPath, std::ios::binary | std::ios::app);
+        input.seekg(static_cast<std::streamoff>(firstFrame * frameSize_));
+    } else {
+        if (!startEncryption() || !computeSourceTag(plainSize, modified, header_ + SOURCE_TAG_OFFSET)) {
+            return false;
+        }
+        output.open(outputPath, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(header_), HEADER_SIZE);
+    }
+    if (!output || !input) {
+        Logger::error("Failed to write encrypted file: " + outputPath);
+        return false;
+    }
+
+    uint64_t frameCount = getFrameCount(plainSize, frameSize_);
+    std::vector<uint8_t> plain(frameSize_);
+    std::vector<uint8_t> sealed(frameSize_ + TAG_SIZE);
+    for (uint64_t index = firstFrame; index < frameCount; index++) {
+        bool last = index + 1 == frameCount;
+        size_t size = last ? static_cast<size_t>(plainSize - static_cast<int64_t>(index * frameSize_)) : frameSize_;
+
+        if (!input.read(reinterpret_cast<char*>(plain.data()), static_cast<std::streamsize>(size)) ||
+            !encryptFrame(index, plain.data(), size, last, sealed.data()) ||
+            !output.write(reinterpret_cast<const char*>(sealed.data()), static_cast<std::streamsize>(size + TAG_SIZE))) {
+            Logger::error("Failed to encrypt " + inputPath + " at frame " + std::to_string(index));
+            OPENSSL_cleanse(plain.data(), plain.size());
+            return false;
+        }
+    }
+
+    OPENSSL_cleanse(plain.data(), plain.size());
+    output.close();
+    return static_cast<bool>(output);
+}
+
+bool StreamCipher::decryptFile(const std::string& inputPath, const std::string& outputPath) {
+    std::error_code error;
+    int64_t streamSize = static_cast<int64_t>(std::filesystem::file_size(inputPath, error));
+    std::ifstream input(inputPath, std::ios::binary);
+    uint8_t header[HEADER_SIZE];
+    if (error || !input || !input.read(reinterpret_cast<char*>(header), HEADER_SIZE) || !startStream(header)) {
+        Logger::error("Not an encrypted stream: " + inputPath);
+        return false;
+    }
+
+    uint64_t payload = static_cast<uint64_t>(streamSize) - HEADER_SIZE;
+    size_t sealedFrameSize = frameSize_ + TAG_SIZE;
+    uint64_t frameCount = (payload + sealedFrameSize - 1) / sealedFrameSize;
+    if (frameCount == 0 || payload - (frameCount - 1) * sealedFrameSize < TAG_SIZE) {
+        Logger::error("Encrypted stream is truncated: " + inputPath);
+        return false;
+    }
+
+    std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        Logger::error("Failed to write decrypted file: " + outputPath);
+        return false;
+    }
+
+    std::vector<uint8_t> sealed(sealedFrameSize);
+    std::vector<uint8_t> plain(frameSize_);
+    bool success = true;
+    for (uint64_t index = 0; index < frameCount && success; index++) {
+        bool last = index + 1 == frameCount;
+        size_t size = last ? static_cast<size_t>(payload - index * sealedFrameSize) : sealedFrameSize;
+
+        success = input.read(reinterpret_cast<char*>(sealed.data()), static_cast<std::streamsize>(size)) &&
+                  decryptFrame(index, sealed.data(), size, last, plain.data()) &&
+                  output.write(reinterpret_cast<const char*>(plain.data()),
+                               static_cast<std::streamsize>(size - TAG_SIZE));
+        if (!success) {
+            Logger::error("Failed to decrypt " + inputPath + " at frame " + std::to_string(index));
+        }
+    }
+
+    OPENSSL_cleanse(plain.data(), plain.size());
+    output.close();
+    if (!success || !output) {
+        std::remove(outputPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool StreamCipher::computeSourceTag(int64_t size, int64_t modified, uint8_t* tag) const {
+    // Keyed, so the header says nothing about the source; the nonce prefix
+    // makes it differ between streams of the same file
+    uint8_t message[NONCE_PREFIX_SIZE + 16];
+    std::memcpy(message, header_ + 8, NONCE_PREFIX_SIZE);
+    for (int i = 0; i < 8; i++) {
+        message[NONCE_PREFIX_SIZE + i] = static_cast<uint8_t>(static_cast<uint64_t>(size) >> (8 * i));
+        message[NONCE_PREFIX_SIZE + 8 + i] = static_cast<uint8_t>(static_cast<uint64_t>(modified) >> (8 * i));
+    }
+
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (frameSize_ == 0 ||
+        !HMAC(EVP_sha256(), key_, KEY_SIZE, message, sizeof(message), digest, &length) ||
+        length < SOURCE_TAG_SIZE) {
+        return false;
+    }
+    std::memcpy(tag, digest, SOURCE_TAG_SIZE);
+    return true;
+}
+
+bool StreamCipher::isCompleteStream(const std::string& path, int64_t plainSize) {
+    uint64_t last = getFrameCount(plainSize, frameSize_) - 1;
+    size_t size = static_cast<size_t>(plainSize - static_cast<int64_t>(last * frameSize_)) + TAG_SIZE;
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> sealed(size);
+    std::vector<uint8_t> plain(size);
+    file.seekg(static_cast<std::streamoff>(getFrameOffset(last, frameSize_)));
+    bool authentic = file.read(reinterpret_cast<char*>(sealed.data()), static_cast<std::streamsize>(size)) &&
+                     decryptFrame(last, sealed.data(), size, true, plain.data());
+    OPENSSL_cleanse(plain.data(), plain.size());
+    return authentic;
+}
+
+int64_t StreamCipher::getEncryptedSize(int64_t plainSize, size_t frameSize) {
+    return static_cast<int64_t>(HEADER_SIZE) + std::max<int64_t>(plainSize, 0) +
+           static_cast<int64_t>(getFrameCount(plainSize, frameSize) * TAG_SIZE);
+}
+
+} // namespace utils
+} // namespace dm
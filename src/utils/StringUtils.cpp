@@ -1,38 +1,413 @@
 #include "utils/StringUtils.h"
+#include "utils/UrlParser.h"
 #include <iomanip>
 #include <random>
 #include <ctime>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace DownloadManager {
 namespace Utils {
 
-std::string StringUtils::trimLeft(const std::string& str) {
-    size_t start = 0;
-    while (start < str.length() && std::isspace(str[start])) {
-        ++start;
+namespace {
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DM_STRING_SSE2 1
+#if defined(__GNUC__)
+#define DM_TARGET_AVX2 __attribute__((target("avx2")))
+#define DM_STRING_AVX2 1
+#elif defined(__AVX2__)
+#define DM_TARGET_AVX2
+#define DM_STRING_AVX2 1
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define DM_STRING_NEON 1
+#endif
+
+/**
+ * @brief The string kernels of one instruction set
+ */
+struct StringKernels {
+    void (*toLower)(const char* in, char* out, size_t size);
+    size_t (*findByte)(const char* data, size_t size, char byte);     // size if absent
+    size_t (*skipSpace)(const char* data, size_t size);               // Index of the first non-space
+    size_t (*skipSpaceBack)(const char* data, size_t size);           // Length without trailing space
+    const char* name;
+};
+
+inline bool isSpaceByte(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline char toLowerByte(unsigned char c) {
+    return static_cast<char>(static_cast<unsigned>(c - 'A') < 26u ? c | 0x20 : c);
+}
+
+void toLowerPortable(const char* in, char* out, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        out[i] = toLowerByte(static_cast<unsigned char>(in[i]));
+    }
+}
+
+size_t findBytePortable(const char* data, size_t size, char byte) {
+    const void* found = size > 0 ? std::memchr(data, byte, size) : nullptr;
+    return found ? static_cast<size_t>(static_cast<const char*>(found) - data) : size;
+}
+
+size_t skipSpacePortable(const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size && isSpaceByte(static_cast<unsigned char>(data[i]))) {
+        i++;
+    }
+    return i;
+}
+
+size_t skipSpaceBackPortable(const char* data, size_t size) {
+    while (size > 0 && isSpaceByte(static_cast<unsigned char>(data[size - 1]))) {
+        size--;
+    }
+    return size;
+}
+
+#if defined(DM_STRING_SSE2) || defined(DM_STRING_NEON)
+
+inline int countTrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+inline int countLeadingZeros(uint64_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return 63 - static_cast<int>(index);
+#else
+    return __builtin_clzll(mask);
+#endif
+}
+
+#endif
+
+#ifdef DM_STRING_SSE2
+
+// SSE2 is part of x86-64, no dispatch needed
+
+inline __m128i spaceMask16(__m128i x) {
+    __m128i control = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('\t' - 1)),
+                                    _mm_cmplt_epi8(x, _mm_set1_epi8('\r' + 1)));
+    return _mm_or_si128(control, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+void toLowerSse2(const char* in, char* out, size_t size) {
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        // Bytes of 0x80 and up are negative here and never upper case
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, beforeA), _mm_cmplt_epi8(x, afterZ));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(x, _mm_and_si128(upper, caseBit)));
+    }
+    toLowerPortable(in + i, out + i, size - i);
+}
+
+size_t findByteSse2(const char* data, size_t size, char byte) {
+    const __m128i needle = _mm_set1_epi8(byte);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, needle)));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return i + findBytePortable(data + i, size - i, byte);
+}
+
+size_t skipSpaceSse2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        uint32_t other = ~static_cast<uint32_t>(_mm_movemask_epi8(spaceMask16(x))) & 0xFFFF;
+        if (other != 0) {
+            return i + countTrailingZeros(other);
+        }
+    }
+    return i + skipSpacePortable(data + i, size - i);
+}
+
+size_t skipSpaceBackSse2(const char* data, size_t size) {
+    for (; size >= 16; size -= 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + size - 16));
+        uint32_t other = ~static_cast<uint32_t>(_mm_movemask_epi8(spaceMask16(x))) & 0xFFFF;
+        if (other != 0) {
+            return size - 16 + (64 - countLeadingZeros(other));
+        }
+    }
+    return skipSpaceBackPortable(data, size);
+}
+
+#endif // DM_STRING_SSE2
+
+#ifdef DM_STRING_AVX2
+
+bool hasAvx2() {
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return true;    // Built with /arch:AVX2
+#endif
+}
+
+DM_TARGET_AVX2
+inline __m256i spaceMask32(__m256i x) {
+    __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('\t' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), x));
+    return _mm256_or_si256(control, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+DM_TARGET_AVX2
+void toLowerAvx2(const char* in, char* out, size_t size) {
+    const __m256i beforeA = _mm256_set1_epi8('A' - 1);
+    const __m256i afterZ = _mm256_set1_epi8('Z' + 1);
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, beforeA), _mm256_cmpgt_epi8(afterZ, x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(x, _mm256_and_si256(upper, caseBit)));
+    }
+    toLowerSse2(in + i, out + i, size - i);
+}
+
+DM_TARGET_AVX2
+size_t findByteAvx2(const char* data, size_t size, char byte) {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle)));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return i + findByteSse2(data + i, size - i, byte);
+}
+
+DM_TARGET_AVX2
+size_t skipSpaceAvx2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(spaceMask32(x)));
+        if (other != 0) {
+            return i + countTrailingZeros(other);
+        }
+    }
+    return i + skipSpaceSse2(data + i, size - i);
+}
+
+DM_TARGET_AVX2
+size_t skipSpaceBackAvx2(const char* data, size_t size) {
+    for (; size >= 32; size -= 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + size - 32));
+        uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(spaceMask32(x)));
+        if (other != 0) {
+            return size - 32 + (64 - countLeadingZeros(other));
+        }
+    }
+    return skipSpaceBackSse2(data, size);
+}
+
+#endif // DM_STRING_AVX2
+
+#ifdef DM_STRING_NEON
+
+// NEON is part of AArch64; a compare result narrows to 4 bits per byte
+
+inline uint64_t nibbleMask(uint8x16_t compare) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(compare), 4)), 0);
+}
+
+inline uint8x16_t spaceMaskNeon(uint8x16_t x) {
+    uint8x16_t control = vcleq_u8(vsubq_u8(x, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t'));
+    return vorrq_u8(control, vceqq_u8(x, vdupq_n_u8(' ')));
+}
+
+void toLowerNeon(const char* in, char* out, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(in + i));
+        uint8x16_t upper = vcleq_u8(vsubq_u8(x, vdupq_n_u8('A')), vdupq_n_u8('Z' - 'A'));
+        vst1q_u8(reinterpret_cast<uint8_t*>(out + i), vorrq_u8(x, vandq_u8(upper, vdupq_n_u8(0x20))));
     }
+    toLowerPortable(in + i, out + i, size - i);
+}
+
+size_t findByteNeon(const char* data, size_t size, char byte) {
+    const uint8x16_t needle = vdupq_n_u8(static_cast<uint8_t>(byte));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+        uint64_t mask = nibbleMask(vceqq_u8(x, needle));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask) / 4;
+        }
+    }
+    return i + findBytePortable(data + i, size - i, byte);
+}
+
+size_t skipSpaceNeon(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+        uint64_t other = ~nibbleMask(spaceMaskNeon(x));
+        if (other != 0) {
+            return i + countTrailingZeros(other) / 4;
+        }
+    }
+    return i + skipSpacePortable(data + i, size - i);
+}
+
+size_t skipSpaceBackNeon(const char* data, size_t size) {
+    for (; size >= 16; size -= 16) {
+        uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(data + size - 16));
+        uint64_t other = ~nibbleMask(spaceMaskNeon(x));
+        if (other != 0) {
+            return size - 16 + (16 - countLeadingZeros(other) / 4);
+        }
+    }
+    return skipSpaceBackPortable(data, size);
+}
+
+#endif // DM_STRING_NEON
+
+StringKernels selectKernels() {
+#ifdef DM_STRING_AVX2
+    if (hasAvx2()) {
+        return {toLowerAvx2, findByteAvx2, skipSpaceAvx2, skipSpaceBackAvx2, "avx2"};
+    }
+#endif
+#if defined(DM_STRING_SSE2)
+    return {toLowerSse2, findByteSse2, skipSpaceSse2, skipSpaceBackSse2, "sse2"};
+#elif defined(DM_STRING_NEON)
+    return {toLowerNeon, findByteNeon, skipSpaceNeon, skipSpaceBackNeon, "neon"};
+#else
+    return {toLowerPortable, findBytePortable, skipSpacePortable, skipSpaceBackPortable, "portable"};
+#endif
+}
+
+const StringKernels& kernels() {
+    static const StringKernels selected = selectKernels();
+    return selected;
+}
+
+/**
+ * @brief Find a delimiter, scanning for its first byte with the kernel
+ *
+ * @return size_t The position, npos if absent
+ */
+size_t findDelimiter(std::string_view str, size_t from, std::string_view delimiter) {
+    const StringKernels& k = kernels();
+    while (from + delimiter.size() <= str.size()) {
+        size_t limit = str.size() - delimiter.size() + 1;
+        size_t pos = from + k.findByte(str.data() + from, limit - from, delimiter[0]);
+        if (pos == limit) {
+            return std::string_view::npos;
+        }
+        if (str.compare(pos + 1, delimiter.size() - 1, delimiter.substr(1)) == 0) {
+            return pos;
+        }
+        from = pos + 1;
+    }
+    return std::string_view::npos;
+}
+
+/**
+ * @brief Find a substring regardless of ASCII case, lowercasing the
+ * haystack a window at a time on the stack
+ */
+bool containsIgnoreCase(std::string_view str, std::string_view substring) {
+    constexpr size_t WINDOW = 512;
+    if (substring.empty()) {
+        return true;
+    }
+    if (substring.size() > str.size()) {
+        return false;
+    }
+    if (substring.size() > WINDOW / 2) {
+        std::string lowerStr(str);
+        std::string lowerSub(substring);
+        kernels().toLower(lowerStr.data(), lowerStr.data(), lowerStr.size());
+        kernels().toLower(lowerSub.data(), lowerSub.data(), lowerSub.size());
+        return lowerStr.find(lowerSub) != std::string::npos;
+    }
+
+    char needle[WINDOW / 2];
+    char window[WINDOW];
+    kernels().toLower(substring.data(), needle, substring.size());
+    std::string_view lowerSub(needle, substring.size());
+
+    // Consecutive windows overlap by one byte less than the substring
+    size_t step = WINDOW - substring.size() + 1;
+    for (size_t start = 0; start + substring.size() <= str.size(); start += step) {
+        size_t length = std::min(WINDOW, str.size() - start);
+        kernels().toLower(str.data() + start, window, length);
+        if (std::string_view(window, length).find(lowerSub) != std::string_view::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+std::string StringUtils::trimLeft(const std::string& str) {
+    size_t start = kernels().skipSpace(str.data(), str.size());
     return (start == 0) ? str : str.substr(start);
 }
 
 std::string StringUtils::trimRight(const std::string& str) {
-    size_t end = str.length();
-    while (end > 0 && std::isspace(str[end - 1])) {
-        --end;
-    }
+    size_t end = kernels().skipSpaceBack(str.data(), str.size());
     return (end == str.length()) ? str : str.substr(0, end);
 }
 
 std::string StringUtils::trim(const std::string& str) {
-    return trimLeft(trimRight(str));
+    return std::string(trimView(str));
+}
+
+std::string_view StringUtils::trimView(std::string_view str) {
+    size_t end = kernels().skipSpaceBack(str.data(), str.size());
+    size_t start = kernels().skipSpace(str.data(), end);
+    return str.substr(start, end - start);
 }
 
 std::string StringUtils::toLowerCase(const std::string& str) {
     std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(),
-                  [](unsigned char c) { return std::tolower(c); });
+    toLowerCaseInPlace(result);
     return result;
 }
 
+void StringUtils::toLowerCaseInPlace(std::string& str) {
+    kernels().toLower(str.data(), str.data(), str.size());
+}
+
 std::string StringUtils::toUpperCase(const std::string& str) {
     std::string result = str;
     std::transform(result.begin(), result.end(), result.begin(),
@@ -43,35 +418,42 @@ std::string StringUtils::toUpperCase(const std::string& str) {
 std::vector<std::string> StringUtils::split(const std::string& str, 
                                          const std::string& delimiter,
                                          bool skipEmpty) {
-    std::vector<std::string> tokens;
+    std::vector<std::string_view> views;
+    splitView(str, delimiter, views, skipEmpty);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+size_t StringUtils::splitView(std::string_view str,
+                            std::string_view delimiter,
+                            std::vector<std::string_view>& tokens,
+                            bool skipEmpty) {
+    tokens.clear();
     
     if (str.empty()) {
-        return tokens;
+        return 0;
     }
     
     if (delimiter.empty()) {
         tokens.push_back(str);
-        return tokens;
+        return tokens.size();
     }
     
     size_t start = 0;
-    size_t end = str.find(delimiter);
+    size_t end = findDelimiter(str, 0, delimiter);
     
-    while (end != std::string::npos) {
-        std::string token = str.substr(start, end - start);
-        if (!skipEmpty || !token.empty()) {
-            tokens.push_back(token);
+    while (end != std::string_view::npos) {
+        if (!skipEmpty || end > start) {
+            tokens.push_back(str.substr(start, end - start));
         }
         start = end + delimiter.length();
-        end = str.find(delimiter, start);
+        end = findDelimiter(str, start, delimiter);
     }
     
-    std::string token = str.substr(start);
-    if (!skipEmpty || !token.empty()) {
-        tokens.push_back(token);
+    if (!skipEmpty || start < str.size()) {
+        tokens.push_back(str.substr(start));
     }
     
-    return tokens;
+    return tokens.size();
 }
 
 std::vector<std::string> StringUtils::splitByWhitespace(const std::string& str,
@@ -110,19 +492,55 @@ std::string StringUtils::join(const std::vector<std::string>& tokens,
 std::string StringUtils::replace(const std::string& str,
                                const std::string& from,
                                const std::string& to) {
+    std::string result = str;
+    replaceInPlace(result, from, to);
+    return result;
+}
+
+size_t StringUtils::replaceInPlace(std::string& str,
+                                 std::string_view from,
+                                 std::string_view to) {
     if (from.empty()) {
-        return str;
+        return 0;
+    }
+    
+    size_t pos = findDelimiter(str, 0, from);
+    if (pos == std::string_view::npos) {
+        return 0;
+    }
+    
+    size_t count = 0;
+    if (to.size() <= from.size()) {
+        // Compact towards the front, the string only shrinks
+        size_t out = pos;
+        size_t in = pos;
+        while (pos != std::string_view::npos) {
+            std::memmove(&str[out], str.data() + in, pos - in);
+            out += pos - in;
+            std::memcpy(&str[out], to.data(), to.size());
+            out += to.size();
+            in = pos + from.size();
+            count++;
+            pos = findDelimiter(str, in, from);
+        }
+        std::memmove(&str[out], str.data() + in, str.size() - in);
+        str.resize(out + str.size() - in);
+        return count;
     }
     
-    std::string result = str;
-    size_t pos = 0;
-    
-    while ((pos = result.find(from, pos)) != std::string::npos) {
-        result.replace(pos, from.length(), to);
-        pos += to.length();
+    std::string result;
+    result.reserve(str.size() + (to.size() - from.size()) * 4);
+    size_t in = 0;
+    while (pos != std::string_view::npos) {
+        result.append(str, in, pos - in);
+        result.append(to);
+        in = pos + from.size();
+        count++;
+        pos = findDelimiter(str, in, from);
     }
-    
-    return result;
+    result.append(str, in, std::string::npos);
+    str.swap(result);
+    return count;
 }
 
 bool StringUtils::startsWith(const std::string& str,
@@ -153,13 +571,13 @@ bool StringUtils::endsWith(const std::string& str,
     }
 }
 
-bool StringUtils::contains(const std::string& str,
-                          const std::string& substring,
+bool StringUtils::contains(std::string_view str,
+                          std::string_view substring,
                           bool caseSensitive) {
     if (caseSensitive) {
-        return str.find(substring) != std::string::npos;
+        return substring.empty() || findDelimiter(str, 0, substring) != std::string_view::npos;
     } else {
-        return toLowerCase(str).find(toLowerCase(substring)) != std::string::npos;
+        return containsIgnoreCase(str, substring);
     }
 }
 
@@ -270,29 +688,7 @@ std::string StringUtils::formatPercentage(double value, bool includeSymbol) {
 }
 
 std::string StringUtils::extractDomain(const std::string& url) {
-    // Simple domain extraction - more robust implementation would use proper URL parsing
-    std::string domain;
-    
-    // Remove protocol
-    size_t protocolEnd = url.find("://");
-    size_t start = (protocolEnd != std::string::npos) ? protocolEnd + 3 : 0;
-    
-    // Find end of domain (first slash after protocol)
-    size_t end = url.find('/', start);
-    
-    if (end != std::string::npos) {
-        domain = url.substr(start, end - start);
-    } else {
-        domain = url.substr(start);
-    }
-    
-    // Remove port if present
-    size_t portPos = domain.find(':');
-    if (portPos != std::string::npos) {
-        domain = domain.substr(0, portPos);
-    }
-    
-    return domain;
+    return dm::utils::UrlParser::extractDomain(url);
 }
 
 std::string StringUtils::extractFileName(const std::string& urlOrPath) {
@@ -331,9 +727,9 @@ std::string StringUtils::extractFileExtension(const std::string& urlOrPath) {
            "";
 }
 
-bool StringUtils::isValidUrl(const std::string& str) {
-    // Basic URL validation using regex
-    std::regex urlRegex(
+bool StringUtils::isValidUrl(std::string_view str) {
+    // Basic URL validation using regex, compiled once
+    static const std::regex urlRegex(
         R"(^(https?|ftp)://)"  // protocol
         R"(([a-zA-Z0-9_\-\.]+))"  // domain name
         R"((\.[a-zA-Z]{2,}))"  // top level domain
@@ -341,7 +737,12 @@ bool StringUtils::isValidUrl(const std::string& str) {
         R"((\/[^\/][a-zA-Z0-9\/_\.:-]*)?$)"  // path (optional)
     );
     
-    return std::regex_match(str, urlRegex);
+    // Most non-URLs fail on the scheme, before the regex
+    if (str.size() < 6 || (str[0] != 'h' && str[0] != 'f') || findDelimiter(str, 0, "://") == std::string_view::npos) {
+        return false;
+    }
+    
+    return std::regex_match(str.begin(), str.end(), urlRegex);
 }
 
 bool StringUtils::isValidEmail(const std::string& str) {
@@ -572,4 +973,11 @@ std::string StringUtils::base64Decode(const std::string& str) {
     }
     
     return result;
-}
\ No newline at end of file
+}
+
+const char* StringUtils::getKernelName() {
+    return kernels().name;
+}
+
+} // namespace Utils
+} // namespace DownloadManager
@@ -0,0 +1,74 @@
+#include "utils/ThreadStack.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <mutex>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+#ifdef __linux__
+std::mutex stackMutex;
+size_t initialSize = 0;     // Before the first change, 0 until then
+#endif
+
+} // anonymous namespace
+
+bool ThreadStack::setDefaultSize(size_t bytes) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(stackMutex);
+
+    pthread_attr_t attr;
+    if (pthread_getattr_default_np(&attr) != 0) {
+        return false;
+    }
+
+    size_t current = 0;
+    pthread_attr_getstacksize(&attr, &current);
+    if (initialSize == 0) {
+        initialSize = current;
+    }
+
+    size_t size = bytes == 0 ? initialSize : std::max(bytes, MIN_STACK_SIZE);
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (size + page - 1) / page * page;
+
+    bool applied = pthread_attr_setstacksize(&attr, size) == 0 && pthread_setattr_default_np(&attr) == 0;
+    pthread_attr_destroy(&attr);
+
+    if (!applied) {
+        Logger::warning("Failed to set the thread stack size to " + std::to_string(size) + " bytes");
+    } else if (size != current) {
+        Logger::info("Thread stack size: " + std::to_string(size / 1024) + " KB");
+    }
+    return applied;
+#else
+    (void)bytes;
+    return false;
+#endif
+}
+
+size_t ThreadStack::getDefaultSize() {
+#ifdef __linux__
+    pthread_attr_t attr;
+    if (pthread_getattr_default_np(&attr) != 0) {
+        return 0;
+    }
+    size_t size = 0;
+    pthread_attr_getstacksize(&attr, &size);
+    pthread_attr_destroy(&attr);
+    return size;
+#else
+    return 0;
+#endif
+}
+
+} // namespace utils
+} // namespace dm
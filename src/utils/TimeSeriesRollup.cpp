@@ -0,0 +1,469 @@
+#include "utils/TimeSeriesRollup.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+constexpr RollupResolution RESOLUTIONS[] = {RollupResolution::SECOND, RollupResolution::MINUTE,
+                                            RollupResolution::HOUR, RollupResolution::DAY};
+constexpr size_t HOUR_LEVEL = static_cast<size_t>(RollupResolution::HOUR);
+constexpr size_t DAY_LEVEL = static_cast<size_t>(RollupResolution::DAY);
+
+const char ARCHIVE_MAGIC[4] = {'D', 'M', 'R', '1'};
+
+// Start of the bucket holding a timestamp, also for times before the epoch
+int64_t bucketStart(int64_t timestamp, int64_t width) {
+    int64_t start = timestamp - timestamp % width;
+    return start > timestamp ? start - width : start;
+}
+
+// Records are little-endian whatever the host
+void putU64(char* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t getU64(const char* data) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+void putDouble(char* out, double value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putU64(out, bits);
+}
+
+double getDouble(const char* data) {
+    uint64_t bits = getU64(data);
+    double value = 0.0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void encodeBucket(const TimeBucket& bucket, char* out) {
+    putU64(out, static_cast<uint64_t>(bucket.start));
+    for (int i = 0; i < 4; i++) {
+        out[8 + i] = static_cast<char>((bucket.count >> (8 * i)) & 0xFF);
+    }
+    putDouble(out + 12, bucket.sum);
+    putDouble(out + 20, bucket.min);
+    putDouble(out + 28, bucket.max);
+}
+
+TimeBucket decodeBucket(const char* data) {
+    TimeBucket bucket;
+    bucket.start = static_cast<int64_t>(getU64(data));
+    for (int i = 0; i < 4; i++) {
+        bucket.count |= static_cast<uint32_t>(static_cast<unsigned char>(data[8 + i])) << (8 * i);
+    }
+    bucket.sum = getDouble(data + 12);
+    bucket.min = getDouble(data + 20);
+    bucket.max = getDouble(data + 28);
+    return bucket;
+}
+
+std::streamoff recordOffset(uint64_t index) {
+    return static_cast<std::streamoff>(sizeof(ARCHIVE_MAGIC) + index * TimeSeriesRollup::ARCHIVE_RECORD_SIZE);
+}
+
+} // namespace
+
+void TimeSeriesRollup::Level::reset(size_t capacity) {
+    capacity = std::max<size_t>(1, capacity);
+    starts.assign(capacity, 0);
+    counts.assign(capacity, 0);
+    sums.assign(capacity, 0.0);
+    mins.assign(capacity, 0.0);
+    maxs.assign(capacity, 0.0);
+    head = 0;
+    size = 0;
+}
+
+TimeBucket TimeSeriesRollup::Level::bucketAt(size_t index) const {
+    size_t s = slot(index);
+    TimeBucket bucket;
+    bucket.start = starts[s];
+    bucket.count = counts[s];
+    bucket.sum = sums[s];
+    bucket.min = mins[s];
+    bucket.max = maxs[s];
+    return bucket;
+}
+
+size_t TimeSeriesRollup::Level::lowerBound(int64_t start) const {
+    size_t low = 0;
+    size_t high = size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (startAt(mid) < start) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void TimeSeriesRollup::Level::merge(size_t index, double value) {
+    size_t s = slot(index);
+    if (counts[s] == 0) {
+        mins[s] = maxs[s] = value;
+    } else {
+        mins[s] = std::min(mins[s], value);
+        maxs[s] = std::max(maxs[s], value);
+    }
+    counts[s]++;
+    sums[s] += value;
+}
+
+void TimeSeriesRollup::Level::push(const TimeBucket& bucket) {
+    // When full the oldest bucket is overwritten
+    size_t s;
+    if (size < capacity()) {
+        s = slot(size);
+        size++;
+    } else {
+        s = head;
+        head = (head + 1) % capacity();
+    }
+    starts[s] = bucket.start;
+    counts[s] = bucket.count;
+    sums[s] = bucket.sum;
+    mins[s] = bucket.min;
+    maxs[s] = bucket.max;
+}
+
+TimeSeriesRollup::TimeSeriesRollup(size_t secondBuckets, size_t minuteBuckets, size_t hourBuckets, size_t dayBuckets) {
+    levels_[0].reset(secondBuckets);
+    levels_[1].reset(minuteBuckets);
+    levels_[2].reset(hourBuckets);
+    levels_[3].reset(dayBuckets);
+}
+
+bool TimeSeriesRollup::openArchive(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    archivePath_.clear();
+    archivedCount_ = 0;
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        if (!out) {
+            Logger::error("Failed to create history archive: " + path);
+            return false;
+        }
+        archivePath_ = path;
+        return true;
+    }
+
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(ARCHIVE_MAGIC) || std::memcmp(data.data(), ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0) {
+        Logger::error("Not a history archive: " + path);
+        return false;
+    }
+
+    // A torn last record is left out and overwritten by the next one
+    uint64_t count = (data.size() - sizeof(ARCHIVE_MAGIC)) / ARCHIVE_RECORD_SIZE;
+    for (uint64_t i = 0; i < count; i++) {
+        TimeBucket bucket = decodeBucket(data.data() + recordOffset(i));
+        if (i == 0) {
+            firstArchivedStart_ = bucket.start;
+        }
+        lastArchivedStart_ = bucket.start;
+        levels_[HOUR_LEVEL].push(bucket);
+        mergeBucket(levels_[DAY_LEVEL], bucket, getBucketSeconds(RollupResolution::DAY));
+    }
+
+    archivePath_ = path;
+    archivedCount_ = count;
+    return true;
+}
+
+void TimeSeriesRollup::add(int64_t timestamp, double value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (size_t i = 0; i < RESOLUTION_COUNT; i++) {
+        Level& level = levels_[i];
+        int64_t start = bucketStart(timestamp, getBucketSeconds(RESOLUTIONS[i]));
+
+        if (level.size == 0 || level.startAt(level.size - 1) < start) {
+            // The previous hour is complete once a later one starts
+            if (i == HOUR_LEVEL && level.size > 0) {
+                archive(level.bucketAt(level.size - 1));
+            }
+            TimeBucket bucket;
+            bucket.start = start;
+            bucket.count = 1;
+            bucket.sum = bucket.min = bucket.max = value;
+            level.push(bucket);
+            continue;
+        }
+
+        // Usually the current bucket; a late sample is merged where it belongs
+        size_t index = level.size - 1;
+        if (level.startAt(index) != start) {
+            index = level.lowerBound(start);
+            if (index >= level.size || level.startAt(index) != start) {
+                continue;
+            }
+        }
+        level.merge(index, value);
+    }
+}
+
+std::vector<TimeBucket> TimeSeriesRollup::getBuckets(RollupResolution resolution, int64_t from, int64_t to) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t index = static_cast<size_t>(resolution);
+    const Level& level = levels_[index];
+    std::vector<TimeBucket> buckets;
+
+    // Hours older than the ring come from the archive
+    if (index == HOUR_LEVEL && archivedCount_ > 0) {
+        int64_t ringStart = level.size > 0 ? level.startAt(0) : std::numeric_limits<int64_t>::max();
+        if (from < ringStart) {
+            readArchive(from, std::min(to, ringStart - 1), buckets);
+        }
+    }
+
+    for (size_t i = level.lowerBound(from); i < level.size && level.startAt(i) <= to; i++) {
+        buckets.push_back(level.bucketAt(i));
+    }
+    return buckets;
+}
+
+std::vector<TimeBucket> TimeSeriesRollup::query(int64_t from, int64_t to, size_t maxPoints, bool downsample) const {
+    size_t level = static_cast<size_t>(chooseResolution(from, to, maxPoints));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (level + 1 < RESOLUTION_COUNT) {
+            int64_t finer = 0;
+            int64_t coarser = 0;
+            bool hasFiner = getOldestStart(level, finer);
+            if (hasFiner && finer <= from) {
+                break;
+            }
+            if (!getOldestStart(level + 1, coarser)) {
+                break;
+            }
+            // Only when the coarser one reaches back further than the finer
+            if (hasFiner && coarser >= bucketStart(finer, getBucketSeconds(RESOLUTIONS[level + 1]))) {
+                break;
+            }
+            level++;
+        }
+    }
+
+    std::vector<TimeBucket> buckets = getBuckets(RESOLUTIONS[level], from, to);
+    if (downsample && maxPoints > 0 && buckets.size() > maxPoints) {
+        return TimeSeriesRollup::downsample(buckets, maxPoints);
+    }
+    return buckets;
+}
+
+RollupResolution TimeSeriesRollup::chooseResolution(int64_t from, int64_t to, size_t maxPoints) {
+    if (maxPoints == 0) {
+        return RollupResolution::SECOND;
+    }
+    for (RollupResolution resolution : RESOLUTIONS) {
+        int64_t width = getBucketSeconds(resolution);
+        int64_t buckets = (std::max<int64_t>(0, to - from) + width) / width;
+        if (static_cast<uint64_t>(buckets) <= maxPoints) {
+            return resolution;
+        }
+    }
+    return RollupResolution::DAY;
+}
+
+std::vector<TimeBucket> TimeSeriesRollup::downsample(const std::vector<TimeBucket>& buckets, size_t maxPoints) {
+    if (maxPoints < 3 || buckets.size() <= maxPoints) {
+        return buckets;
+    }
+
+    std::vector<TimeBucket> result;
+    result.reserve(maxPoints);
+    result.push_back(buckets.front());
+
+    // The points between first and last are split into maxPoints - 2 groups
+    double groupSize = static_cast<double>(buckets.size() - 2) / (maxPoints - 2);
+    size_t picked = 0;
+
+    for (size_t group = 0; group < maxPoints - 2; group++) {
+        size_t begin = static_cast<size_t>(std::floor(group * groupSize)) + 1;
+        size_t end = std::min(static_cast<size_t>(std::floor((group + 1) * groupSize)) + 1, buckets.size() - 1);
+
+        // Average of the next group, the last point for the last group
+        size_t nextBegin = end;
+        size_t nextEnd = std::min(static_cast<size_t>(std::floor((group + 2) * groupSize)) + 1, buckets.size());
+        if (group + 1 == maxPoints - 2) {
+            nextBegin = buckets.size() - 1;
+            nextEnd = buckets.size();
+        }
+        double nextX = 0.0;
+        double nextY = 0.0;
+        for (size_t i = nextBegin; i < nextEnd; i++) {
+            nextX += static_cast<double>(buckets[i].start);
+            nextY += buckets[i].getAverage();
+        }
+        size_t nextCount = std::max<size_t>(1, nextEnd - nextBegin);
+        nextX /= nextCount;
+        nextY /= nextCount;
+
+        double baseX = static_cast<double>(buckets[picked].start);
+        double baseY = buckets[picked].getAverage();
+        double bestArea = -1.0;
+        size_t best = begin;
+        for (size_t i = begin; i < end; i++) {
+            double area = std::abs((baseX - nextX) * (buckets[i].getAverage() - baseY) -
+                                   (baseX - static_cast<double>(buckets[i].start)) * (nextY - baseY));
+            if (area > bestArea) {
+                bestArea = area;
+                best = i;
+            }
+        }
+
+        result.push_back(buckets[best]);
+        picked = best;
+    }
+
+    result.push_back(buckets.back());
+    return result;
+}
+
+int64_t TimeSeriesRollup::getBucketSeconds(RollupResolution resolution) {
+    switch (resolution) {
+        case RollupResolution::SECOND: return 1;
+        case RollupResolution::MINUTE: return 60;
+        case RollupResolution::HOUR: return 3600;
+        default: return 86400;
+    }
+}
+
+void TimeSeriesRollup::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& level : levels_) {
+        level.head = 0;
+        level.size = 0;
+    }
+}
+
+void TimeSeriesRollup::mergeBucket(Level& level, TimeBucket bucket, int64_t width) {
+    bucket.start = bucketStart(bucket.start, width);
+    if (level.size == 0 || level.startAt(level.size - 1) < bucket.start) {
+        level.push(bucket);
+        return;
+    }
+
+    size_t index = level.lowerBound(bucket.start);
+    if (index >= level.size || level.startAt(index) != bucket.start || bucket.count == 0) {
+        return;
+    }
+    size_t s = level.slot(index);
+    if (level.counts[s] == 0) {
+        level.mins[s] = bucket.min;
+        level.maxs[s] = bucket.max;
+    } else {
+        level.mins[s] = std::min(level.mins[s], bucket.min);
+        level.maxs[s] = std::max(level.maxs[s], bucket.max);
+    }
+    level.counts[s] += bucket.count;
+    level.sums[s] += bucket.sum;
+}
+
+void TimeSeriesRollup::archive(const TimeBucket& bucket) {
+    // Starts only grow, an hour seen again after the clock went back is kept in memory
+    if (archivePath_.empty() || (archivedCount_ > 0 && bucket.start <= lastArchivedStart_)) {
+        return;
+    }
+
+    char record[ARCHIVE_RECORD_SIZE];
+    encodeBucket(bucket, record);
+
+    std::fstream out(archivePath_, std::ios::binary | std::ios::in | std::ios::out);
+    out.seekp(recordOffset(archivedCount_));
+    out.write(record, sizeof(record));
+    out.flush();
+    if (!out) {
+        Logger::warning("Failed to write history archive: " + archivePath_);
+        return;
+    }
+
+    if (archivedCount_ == 0) {
+        firstArchivedStart_ = bucket.start;
+    }
+    lastArchivedStart_ = bucket.start;
+    archivedCount_++;
+}
+
+void TimeSeriesRollup::readArchive(int64_t from, int64_t to, std::vector<TimeBucket>& buckets) const {
+    if (from > to || from > lastArchivedStart_ || to < firstArchivedStart_) {
+        return;
+    }
+
+    std::ifstream in(archivePath_, std::ios::binary);
+    if (!in) {
+        return;
+    }
+
+    char record[ARCHIVE_RECORD_SIZE];
+    auto readRecord = [&](uint64_t index) {
+        in.seekg(recordOffset(index));
+        return static_cast<bool>(in.read(record, sizeof(record)));
+    };
+
+    // Records are fixed-size and in start order, so the first one is found by bisection
+    uint64_t low = 0;
+    uint64_t high = archivedCount_;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (!readRecord(mid)) {
+            return;
+        }
+        if (decodeBucket(record).start < from) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    in.seekg(recordOffset(low));
+    for (uint64_t i = low; i < archivedCount_ && in.read(record, sizeof(record)); i++) {
+        TimeBucket bucket = decodeBucket(record);
+        if (bucket.start > to) {
+            break;
+        }
+        buckets.push_back(bucket);
+    }
+}
+
+bool TimeSeriesRollup::getOldestStart(size_t index, int64_t& start) const {
+    if (index == HOUR_LEVEL && archivedCount_ > 0) {
+        start = firstArchivedStart_;
+        return true;
+    }
+    if (levels_[index].size == 0) {
+        return false;
+    }
+    start = levels_[index].startAt(0);
+    return true;
+}
+
+} // namespace utils
+} // namespace dm
@@ -0,0 +1,150 @@
+#include "utils/Tracer.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+void writeJsonString(std::ofstream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+Tracer& Tracer::getInstance() {
+    static Tracer instance;
+    return instance;
+}
+
+void Tracer::record(const char* name, int64_t startNs, int64_t durationNs) {
+    ThreadBuffer& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events[buffer.next] = TraceEvent{name, startNs, durationNs};
+    if (++buffer.next == buffer.events.size()) {
+        buffer.next = 0;
+        buffer.wrapped = true;
+    }
+}
+
+void Tracer::setThreadName(const char* name) {
+    ThreadBuffer& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.threadName = name;
+}
+
+bool Tracer::writeChromeTrace(const std::string& path) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex_);
+        buffers = buffers_;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        Logger::error("Failed to open trace file: " + path);
+        return false;
+    }
+
+    // Timestamps are microseconds from the earliest span kept; spans are
+    // recorded as they end, so an outer span comes after the ones inside it
+    int64_t origin = std::numeric_limits<int64_t>::max();
+    for (const auto& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        size_t count = buffer->wrapped ? buffer->events.size() : buffer->next;
+        for (size_t i = 0; i < count; i++) {
+            origin = std::min(origin, buffer->events[i].startNs);
+        }
+    }
+    out << std::fixed << std::setprecision(3);
+
+    size_t written = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (const auto& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        if (buffer->threadName) {
+            out << (written++ ? ",\n" : "\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"args\":{\"name\":";
+            writeJsonString(out, buffer->threadName);
+            out << "}}";
+        }
+
+        size_t count = buffer->wrapped ? buffer->events.size() : buffer->next;
+        size_t first = buffer->wrapped ? buffer->next : 0;
+        for (size_t i = 0; i < count; i++) {
+            const TraceEvent& event = buffer->events[(first + i) % buffer->events.size()];
+            out << (written++ ? ",\n" : "\n") << "{\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"ts\":" << (event.startNs - origin) / 1000.0
+                << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        Logger::error("Failed to write trace file: " + path);
+        return false;
+    }
+
+    // Buffers of threads that have exited are dropped once dumped
+    buffers.clear();
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex_);
+        buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                      [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer.use_count() == 1; }),
+                       buffers_.end());
+    }
+
+    Logger::info("Wrote " + std::to_string(written) + " trace events to " + path);
+    return true;
+}
+
+Tracer::ThreadBuffer& Tracer::localBuffer() {
+    // The thread holds one reference, the tracer the other
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(buffersMutex_);
+        buffer = reuseExitedBuffer();
+        if (!buffer) {
+            buffer = std::make_shared<ThreadBuffer>();
+            buffer->events.resize(EVENTS_PER_THREAD);
+        }
+        buffer->threadId = nextThreadId_++;
+        buffers_.push_back(buffer);
+    }
+    return *buffer;
+}
+
+std::shared_ptr<Tracer::ThreadBuffer> Tracer::reuseExitedBuffer() {
+    // Buffers are kept in the order their threads started, the first exited one goes
+    auto exited = [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer.use_count() == 1; };
+    if (static_cast<size_t>(std::count_if(buffers_.begin(), buffers_.end(), exited)) < MAX_EXITED_BUFFERS) {
+        return nullptr;
+    }
+    auto it = std::find_if(buffers_.begin(), buffers_.end(), exited);
+    std::shared_ptr<ThreadBuffer> buffer = std::move(*it);
+    buffers_.erase(it);
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->next = 0;
+    buffer->wrapped = false;
+    buffer->threadName = nullptr;
+    return buffer;
+}
+
+} // namespace utils
+} // namespace dm
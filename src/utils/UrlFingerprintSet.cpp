@@ -0,0 +1,417 @@
+#include "utils/UrlFingerprintSet.h"
+#include "utils/FileUtils.h"
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+namespace dm {
+namespace utils {
+
+namespace {
+
+// Spreads the bits so table slots and Bloom positions look independent
+inline uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Seeks with a 64-bit offset, long is 32 bits on Windows
+inline int seekTo(std::FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+// Reads a run file front to back in blocks, for merging
+struct RunReader {
+    std::FILE* file = nullptr;
+    std::vector<uint64_t> buffer;
+    size_t position = 0;
+    uint64_t remaining = 0;
+
+    bool next(uint64_t& key) {
+        if (position == buffer.size()) {
+            if (remaining == 0) {
+                return false;
+            }
+            size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, UrlFingerprintSet::RUN_BLOCK_KEYS * 8));
+            buffer.resize(count);
+            if (std::fread(buffer.data(), sizeof(uint64_t), count, file) != count) {
+                return false;
+            }
+            remaining -= count;
+            position = 0;
+        }
+        key = buffer[position++];
+        return true;
+    }
+};
+
+} // namespace
+
+UrlFingerprintSet::UrlFingerprintSet(size_t memoryLimit, const std::string& spillDirectory)
+    : shards_(new Shard[SHARD_COUNT]),
+      shardMemoryLimit_(memoryLimit / SHARD_COUNT),
+      spillDirectory_(spillDirectory) {
+    // Keep run files of several sets in one directory apart
+    auto nonce = std::chrono::steady_clock::now().time_since_epoch().count();
+    filePrefix_ = "urlset-" + std::to_string(nonce) + "-" +
+                  std::to_string(reinterpret_cast<uintptr_t>(this) & 0xffffff);
+
+    if (!spillDirectory_.empty() && shardMemoryLimit_ > 0 && !FileUtils::createDirectory(spillDirectory_)) {
+        Logger::warning("Cannot create URL spill directory, keeping URLs in memory: " + spillDirectory_);
+        spillDirectory_.clear();
+    }
+}
+
+UrlFingerprintSet::~UrlFingerprintSet() {
+    clear();
+}
+
+bool UrlFingerprintSet::insert(const std::string& url) {
+    uint64_t key = fingerprint(url);
+    size_t index = key % SHARD_COUNT;
+    Shard& shard = shards_[index];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (containsLocked(shard, key)) {
+        return false;
+    }
+
+    addToTable(shard, index, key);
+    return true;
+}
+
+bool UrlFingerprintSet::contains(const std::string& url) const {
+    uint64_t key = fingerprint(url);
+    const Shard& shard = shards_[key % SHARD_COUNT];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return containsLocked(shard, key);
+}
+
+void UrlFingerprintSet::clear() {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        for (auto& run : shard.runs) {
+            removeRun(run);
+        }
+        shard.runs.clear();
+        shard.bloom.clear();
+        shard.table.clear();
+        shard.table.shrink_to_fit();
+        shard.tableCount = 0;
+        shard.spilledCount = 0;
+    }
+}
+
+size_t UrlFingerprintSet::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        total += shards_[i].tableCount + shards_[i].spilledCount;
+    }
+    return total;
+}
+
+size_t UrlFingerprintSet::getMemoryUsage() const {
+    size_t total = 0;
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        const Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        total += shard.table.capacity() * sizeof(uint64_t);
+        for (const auto& stage : shard.bloom) {
+            total += stage.bits.capacity() * sizeof(uint64_t);
+        }
+        for (const auto& run : shard.runs) {
+            total += run.index.capacity() * sizeof(uint64_t);
+        }
+    }
+    return total;
+}
+
+uint64_t UrlFingerprintSet::fingerprint(const std::string& url) {
+    // FNV-1a, finished with a mixer since FNV's low bits are weak
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : url) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    hash = mix(hash);
+    return hash == 0 ? 1 : hash;
+}
+
+bool UrlFingerprintSet::containsLocked(const Shard& shard, uint64_t key) const {
+    if (!shard.table.empty() && tableContains(shard.table, key)) {
+        return true;
+    }
+
+    // Only keys the Bloom filter may hold are worth a disk read
+    if (shard.runs.empty() || !bloomMayContain(shard, key)) {
+        return false;
+    }
+
+    for (const auto& run : shard.runs) {
+        if (runContains(run, key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void UrlFingerprintSet::addToTable(Shard& shard, size_t shardIndex, uint64_t key) {
+    if (shard.table.empty()) {
+        shard.table.assign(INITIAL_SHARD_CAPACITY, 0);
+    }
+
+    // Grow at three quarters full
+    if ((shard.tableCount + 1) * 4 > shard.table.size() * 3) {
+        size_t grownBytes = shard.table.size() * 2 * sizeof(uint64_t);
+        bool canSpill = !spillDirectory_.empty() && shardMemoryLimit_ > 0;
+
+        if (canSpill && grownBytes > shardMemoryLimit_ && spill(shard, shardIndex)) {
+            // The table is empty again at its current size
+        } else {
+            std::vector<uint64_t> grown(shard.table.size() * 2, 0);
+            for (uint64_t existing : shard.table) {
+                if (existing != 0) {
+                    tableInsert(grown, existing);
+                }
+            }
+            shard.table.swap(grown);
+        }
+    }
+
+    tableInsert(shard.table, key);
+    shard.tableCount++;
+}
+
+bool UrlFingerprintSet::spill(Shard& shard, size_t shardIndex) {
+    std::vector<uint64_t> keys;
+    keys.reserve(shard.tableCount);
+    for (uint64_t key : shard.table) {
+        if (key != 0) {
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    Run run;
+    run.path = FileUtils::combinePaths(spillDirectory_, filePrefix_ + "-" + std::to_string(shardIndex) +
+                                       "-" + std::to_string(shard.nextRunId++) + ".bin");
+    run.file = std::fopen(run.path.c_str(), "w+b");
+    if (!run.file) {
+        Logger::warning("Cannot create URL spill file, keeping URLs in memory: " + run.path);
+        return false;
+    }
+
+    if (std::fwrite(keys.data(), sizeof(uint64_t), keys.size(), run.file) != keys.size() ||
+        std::fflush(run.file) != 0) {
+        Logger::warning("Failed to write URL spill file: " + run.path);
+        removeRun(run);
+        return false;
+    }
+
+    run.keyCount = keys.size();
+    for (size_t i = 0; i < keys.size(); i += RUN_BLOCK_KEYS) {
+        run.index.push_back(keys[i]);
+    }
+
+    for (uint64_t key : keys) {
+        bloomAdd(shard, key);
+    }
+
+    shard.runs.push_back(std::move(run));
+    shard.spilledCount += keys.size();
+    std::fill(shard.table.begin(), shard.table.end(), 0);
+    shard.tableCount = 0;
+
+    if (shard.runs.size() > MAX_RUNS_PER_SHARD) {
+        mergeRuns(shard, shardIndex);
+    }
+    return true;
+}
+
+bool UrlFingerprintSet::mergeRuns(Shard& shard, size_t shardIndex) {
+    Run merged;
+    merged.path = FileUtils::combinePaths(spillDirectory_, filePrefix_ + "-" + std::to_string(shardIndex) +
+                                          "-" + std::to_string(shard.nextRunId++) + ".bin");
+    merged.file = std::fopen(merged.path.c_str(), "w+b");
+    if (!merged.file) {
+        Logger::warning("Cannot create URL spill file: " + merged.path);
+        return false;
+    }
+
+    std::vector<RunReader> readers(shard.runs.size());
+    std::vector<uint64_t> heads(shard.runs.size());
+    std::vector<bool> live(shard.runs.size());
+    for (size_t i = 0; i < shard.runs.size(); i++) {
+        readers[i].file = shard.runs[i].file;
+        readers[i].remaining = shard.runs[i].keyCount;
+        std::fseek(readers[i].file, 0, SEEK_SET);
+        live[i] = readers[i].next(heads[i]);
+    }
+
+    // Few runs, a linear scan for the smallest head beats a heap
+    std::vector<uint64_t> output;
+    output.reserve(RUN_BLOCK_KEYS * 8);
+    bool ok = true;
+    while (ok) {
+        size_t smallest = readers.size();
+        for (size_t i = 0; i < readers.size(); i++) {
+            if (live[i] && (smallest == readers.size() || heads[i] < heads[smallest])) {
+                smallest = i;
+            }
+        }
+        if (smallest == readers.size()) {
+            break;
+        }
+
+        if (merged.keyCount % RUN_BLOCK_KEYS == 0) {
+            merged.index.push_back(heads[smallest]);
+        }
+        output.push_back(heads[smallest]);
+        merged.keyCount++;
+        live[smallest] = readers[smallest].next(heads[smallest]);
+
+        if (output.size() == output.capacity()) {
+            ok = std::fwrite(output.data(), sizeof(uint64_t), output.size(), merged.file) == output.size();
+            output.clear();
+        }
+    }
+
+    ok = ok && std::fwrite(output.data(), sizeof(uint64_t), output.size(), merged.file) == output.size() &&
+         std::fflush(merged.file) == 0 && merged.keyCount == shard.spilledCount;
+    if (!ok) {
+        Logger::warning("Failed to merge URL spill files into " + merged.path);
+        removeRun(merged);
+        return false;
+    }
+
+    for (auto& run : shard.runs) {
+        removeRun(run);
+    }
+    shard.runs.clear();
+    shard.runs.push_back(std::move(merged));
+    return true;
+}
+
+void UrlFingerprintSet::removeRun(Run& run) {
+    if (run.file) {
+        std::fclose(run.file);
+        run.file = nullptr;
+    }
+    if (!run.path.empty()) {
+        FileUtils::deleteFile(run.path);
+    }
+}
+
+bool UrlFingerprintSet::runContains(const Run& run, uint64_t key) {
+    // The block whose first key is the last one not above the key
+    auto it = std::upper_bound(run.index.begin(), run.index.end(), key);
+    if (it == run.index.begin()) {
+        return false;
+    }
+    uint64_t block = static_cast<uint64_t>(it - run.index.begin()) - 1;
+    if (*(it - 1) == key) {
+        return true;
+    }
+
+    uint64_t first = block * RUN_BLOCK_KEYS;
+    size_t count = static_cast<size_t>(std::min<uint64_t>(RUN_BLOCK_KEYS, run.keyCount - first));
+    uint64_t keys[RUN_BLOCK_KEYS];
+    if (seekTo(run.file, first * sizeof(uint64_t)) != 0 ||
+        std::fread(keys, sizeof(uint64_t), count, run.file) != count) {
+        return false;
+    }
+    return std::binary_search(keys, keys + count, key);
+}
+
+bool UrlFingerprintSet::tableInsert(std::vector<uint64_t>& table, uint64_t key) {
+    size_t mask = table.size() - 1;
+    // The shard was picked with key % SHARD_COUNT, the slot uses other bits
+    for (size_t slot = (key >> 8) & mask;; slot = (slot + 1) & mask) {
+        if (table[slot] == key) {
+            return false;
+        }
+        if (table[slot] == 0) {
+            table[slot] = key;
+            return true;
+        }
+    }
+}
+
+bool UrlFingerprintSet::tableContains(const std::vector<uint64_t>& table, uint64_t key) {
+    size_t mask = table.size() - 1;
+    for (size_t slot = (key >> 8) & mask;; slot = (slot + 1) & mask) {
+        if (table[slot] == key) {
+            return true;
+        }
+        if (table[slot] == 0) {
+            return false;
+        }
+    }
+}
+
+void UrlFingerprintSet::bloomAdd(Shard& shard, uint64_t key) {
+    if (shard.bloom.empty() || shard.bloom.back().count >= shard.bloom.back().capacity) {
+        // Each stage holds twice the keys of the last at half the error
+        // rate, which keeps the total error below twice the first's
+        size_t stageIndex = shard.bloom.size();
+        BloomStage stage;
+        stage.capacity = stageIndex == 0 ? std::max<size_t>(shard.tableCount, INITIAL_SHARD_CAPACITY)
+                                         : shard.bloom.back().capacity * 2;
+        double errorRate = BLOOM_ERROR_RATE * std::pow(0.5, static_cast<double>(stageIndex));
+        double bitsPerKey = -std::log(errorRate) / (std::log(2.0) * std::log(2.0));
+
+        stage.bitCount = std::max<uint64_t>(64, static_cast<uint64_t>(std::ceil(stage.capacity * bitsPerKey)));
+        stage.hashCount = std::max(1, static_cast<int>(std::ceil(bitsPerKey * std::log(2.0))));
+        stage.bits.assign((stage.bitCount + 63) / 64, 0);
+        shard.bloom.push_back(std::move(stage));
+    }
+
+    // Double hashing gives each stage as many positions as it needs
+    BloomStage& stage = shard.bloom.back();
+    uint64_t h1 = key;
+    uint64_t h2 = mix(key) | 1;
+    for (int i = 0; i < stage.hashCount; i++) {
+        uint64_t bit = (h1 + static_cast<uint64_t>(i) * h2) % stage.bitCount;
+        stage.bits[bit / 64] |= 1ULL << (bit % 64);
+    }
+    stage.count++;
+}
+
+bool UrlFingerprintSet::bloomMayContain(const Shard& shard, uint64_t key) {
+    uint64_t h1 = key;
+    uint64_t h2 = mix(key) | 1;
+
+    for (const auto& stage : shard.bloom) {
+        bool present = true;
+        for (int i = 0; i < stage.hashCount && present; i++) {
+            uint64_t bit = (h1 + static_cast<uint64_t>(i) * h2) % stage.bitCount;
+            present = (stage.bits[bit / 64] & (1ULL << (bit % 64))) != 0;
+        }
+        if (present) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace utils
+} // namespace dm
@@ -11,235 +11,227 @@
 namespace dm {
 namespace utils {
 
-UrlInfo UrlParser::parse(const std::string& url) {
-    UrlInfo info;
-    
-    if (url.empty()) {
-        return info;
+namespace {
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](unsigned char x, unsigned char y) {
+               return std::tolower(x) == std::tolower(y);
+           });
+}
+
+// Port a scheme uses when none is given, empty if unknown
+std::string_view defaultPort(std::string_view scheme) {
+    if (equalsIgnoreCase(scheme, "http")) {
+        return "80";
+    } else if (equalsIgnoreCase(scheme, "https")) {
+        return "443";
+    } else if (equalsIgnoreCase(scheme, "ftp")) {
+        return "21";
+    } else if (equalsIgnoreCase(scheme, "ftps")) {
+        return "990";
     }
+    return {};
+}
+
+void appendLower(std::string& out, std::string_view text) {
+    for (char c : text) {
+        out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+}
+
+// Append an absolute path with its dot segments removed (RFC 3986 5.2.4)
+void appendPath(std::string& out, std::string_view path) {
+    const size_t root = out.size();
+    out += '/';
     
-    try {
-        // Parse protocol
-        size_t protocolEnd = url.find("://");
-        if (protocolEnd != std::string::npos) {
-            info.protocol = url.substr(0, protocolEnd);
-            protocolEnd += 3;  // Skip "://"
-        } else {
-            // Default to HTTP if no protocol specified
-            info.protocol = "http";
-            protocolEnd = 0;
-        }
-        
-        // Extract authentication info (username:password@)
-        size_t authEnd = url.find('@', protocolEnd);
-        size_t hostStart;
-        
-        if (authEnd != std::string::npos) {
-            std::string authInfo = url.substr(protocolEnd, authEnd - protocolEnd);
-            size_t colonPos = authInfo.find(':');
-            
-            if (colonPos != std::string::npos) {
-                info.username = authInfo.substr(0, colonPos);
-                info.password = authInfo.substr(colonPos + 1);
-            } else {
-                info.username = authInfo;
+    size_t pos = path.empty() ? 0 : 1;
+    while (true) {
+        size_t slash = path.find('/', pos);
+        bool last = slash == std::string_view::npos;
+        std::string_view segment = path.substr(pos, last ? std::string_view::npos : slash - pos);
+        
+        if (segment == "..") {
+            // out ends with '/', drop the segment before it
+            if (out.size() > root + 1) {
+                out.pop_back();
+                out.resize(out.rfind('/') + 1);
             }
-            
-            hostStart = authEnd + 1;
-        } else {
-            hostStart = protocolEnd;
-        }
-        
-        // Extract host and port
-        size_t pathStart = url.find('/', hostStart);
-        size_t queryStart = url.find('?', hostStart);
-        size_t fragmentStart = url.find('#', hostStart);
-        
-        size_t hostEnd = std::min({
-            pathStart != std::string::npos ? pathStart : std::string::npos,
-            queryStart != std::string::npos ? queryStart : std::string::npos,
-            fragmentStart != std::string::npos ? fragmentStart : std::string::npos
-        });
-        
-        std::string hostPort = url.substr(hostStart, hostEnd != std::string::npos ? hostEnd - hostStart : std::string::npos);
-        size_t portPos = hostPort.find(':');
-        
-        if (portPos != std::string::npos) {
-            info.host = hostPort.substr(0, portPos);
-            info.port = hostPort.substr(portPos + 1);
-        } else {
-            info.host = hostPort;
-            
-            // Set default port based on protocol
-            if (info.protocol == "http") {
-                info.port = "80";
-            } else if (info.protocol == "https") {
-                info.port = "443";
-            } else if (info.protocol == "ftp") {
-                info.port = "21";
-            } else if (info.protocol == "ftps") {
-                info.port = "990";
+        } else if (segment != ".") {
+            out += segment;
+            if (!last) {
+                out += '/';
             }
         }
         
-        // Extract path
-        if (pathStart != std::string::npos) {
-            size_t pathEnd = std::min(
-                queryStart != std::string::npos ? queryStart : std::string::npos,
-                fragmentStart != std::string::npos ? fragmentStart : std::string::npos
-            );
-            
-            info.path = url.substr(pathStart, pathEnd != std::string::npos ? pathEnd - pathStart : std::string::npos);
-        } else {
-            info.path = "/";
-        }
-        
-        // Extract query
-        if (queryStart != std::string::npos) {
-            size_t queryEnd = fragmentStart != std::string::npos ? fragmentStart : std::string::npos;
-            info.query = url.substr(queryStart, queryEnd != std::string::npos ? queryEnd - queryStart : std::string::npos);
+        if (last) {
+            break;
         }
-        
-        // Extract fragment
-        if (fragmentStart != std::string::npos) {
-            info.fragment = url.substr(fragmentStart);
+        pos = slash + 1;
+    }
+}
+
+} // anonymous namespace
+
+UrlView UrlParser::parseView(std::string_view url) {
+    UrlView view;
+    
+    // A "://" after the path has started is not a scheme
+    size_t authorityStart = 0;
+    size_t schemeEnd = url.find("://");
+    if (schemeEnd != std::string_view::npos && schemeEnd < url.find_first_of("/?#")) {
+        view.scheme = url.substr(0, schemeEnd);
+        authorityStart = schemeEnd + 3;
+    }
+    
+    size_t authorityEnd = url.find_first_of("/?#", authorityStart);
+    if (authorityEnd == std::string_view::npos) {
+        authorityEnd = url.size();
+    }
+    std::string_view authority = url.substr(authorityStart, authorityEnd - authorityStart);
+    
+    // Credentials end at the last '@', a password may contain one
+    size_t at = authority.rfind('@');
+    if (at != std::string_view::npos) {
+        std::string_view userInfo = authority.substr(0, at);
+        size_t colon = userInfo.find(':');
+        view.username = userInfo.substr(0, colon);
+        if (colon != std::string_view::npos) {
+            view.password = userInfo.substr(colon + 1);
         }
-        
-        // Extract filename from path
-        info.filename = extractFilename(url);
-        
-    } catch (const std::exception& e) {
-        Logger::error("Error parsing URL: " + url + " - " + e.what());
-        info = UrlInfo(); // Reset info
+        authority.remove_prefix(at + 1);
+    }
+    
+    // IPv6 literals are bracketed and full of colons
+    size_t colon = authority.rfind(':');
+    size_t bracket = authority.rfind(']');
+    if (colon != std::string_view::npos && (bracket == std::string_view::npos || colon > bracket)) {
+        view.host = authority.substr(0, colon);
+        view.port = authority.substr(colon + 1);
+    } else {
+        view.host = authority;
+    }
+    
+    size_t fragmentStart = url.find('#', authorityEnd);
+    size_t end = fragmentStart == std::string_view::npos ? url.size() : fragmentStart;
+    size_t queryStart = url.find('?', authorityEnd);
+    if (queryStart > end) {
+        queryStart = std::string_view::npos;
+    }
+    
+    view.path = url.substr(authorityEnd, (queryStart == std::string_view::npos ? end : queryStart) - authorityEnd);
+    if (queryStart != std::string_view::npos) {
+        view.hasQuery = true;
+        view.query = url.substr(queryStart + 1, end - queryStart - 1);
+    }
+    if (fragmentStart != std::string_view::npos) {
+        view.hasFragment = true;
+        view.fragment = url.substr(fragmentStart + 1);
+    }
+    
+    return view;
+}
+
+UrlInfo UrlParser::parse(const std::string& url) {
+    UrlInfo info;
+    
+    if (url.empty()) {
+        return info;
+    }
+    
+    UrlView view = parseView(url);
+    
+    // Default to HTTP if no protocol specified
+    info.protocol = view.scheme.empty() ? "http" : std::string(view.scheme);
+    info.username = std::string(view.username);
+    info.password = std::string(view.password);
+    info.host = std::string(view.host);
+    info.port = std::string(view.port.empty() ? defaultPort(info.protocol) : view.port);
+    info.path = view.path.empty() ? "/" : std::string(view.path);
+    
+    // The query and fragment keep their delimiters
+    if (view.hasQuery) {
+        info.query = "?" + std::string(view.query);
+    }
+    if (view.hasFragment) {
+        info.fragment = "#" + std::string(view.fragment);
+    }
+    
+    // Extract filename from path, the host if the path has none
+    size_t lastSlash = info.path.find_last_of('/');
+    if (lastSlash != std::string::npos && lastSlash < info.path.length() - 1) {
+        info.filename = decode(info.path.substr(lastSlash + 1));
+    } else {
+        info.filename = info.host;
     }
     
     return info;
 }
 
-std::string UrlParser::extractFilename(const std::string& url) {
-    try {
-        // Parse URL
-        UrlInfo info = parse(url);
-        
-        // Get the path part
-        std::string path = info.path;
-        
-        // Remove query parameters
-        size_t queryPos = path.find('?');
-        if (queryPos != std::string::npos) {
-            path = path.substr(0, queryPos);
-        }
-        
-        // Remove fragment
-        size_t fragmentPos = path.find('#');
-        if (fragmentPos != std::string::npos) {
-            path = path.substr(0, fragmentPos);
-        }
-        
-        // Find the last slash
-        size_t lastSlash = path.find_last_of('/');
-        if (lastSlash != std::string::npos && lastSlash < path.length() - 1) {
-            // Extract filename
-            std::string filename = path.substr(lastSlash + 1);
-            
-            // URL decode the filename
-            return decode(filename);
-        }
-        
-        // If no filename found, try to use the hostname
-        if (!info.host.empty()) {
-            return info.host;
+std::string UrlParser::extractDomain(std::string_view url) {
+    std::string_view host = parseView(url).host;
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    
+    std::string domain;
+    domain.reserve(host.size());
+    appendLower(domain, host);
+    return domain;
+}
+
+bool UrlParser::canonicalize(std::string_view url, std::string& out, bool keepFragment) {
+    out.clear();
+    
+    UrlView view = parseView(url);
+    if (view.host.empty()) {
+        return false;
+    }
+    
+    std::string_view scheme = view.scheme.empty() ? std::string_view("http") : view.scheme;
+    appendLower(out, scheme);
+    out += "://";
+    
+    if (!view.username.empty()) {
+        out += view.username;
+        if (!view.password.empty()) {
+            out += ':';
+            out += view.password;
         }
-    } catch (const std::exception& e) {
-        Logger::error("Error extracting filename from URL: " + url + " - " + e.what());
+        out += '@';
+    }
+    
+    appendLower(out, view.host);
+    if (!view.port.empty() && view.port != defaultPort(scheme)) {
+        out += ':';
+        out += view.port;
+    }
+    
+    appendPath(out, view.path);
+    
+    if (!view.query.empty()) {
+        out += '?';
+        out += view.query;
+    }
+    if (keepFragment && !view.fragment.empty()) {
+        out += '#';
+        out += view.fragment;
     }
     
-    return "";
+    return true;
+}
+
+std::string UrlParser::extractFilename(const std::string& url) {
+    // Query and fragment are already split off the path by parse()
+    return parse(url).filename;
 }
 
 std::string UrlParser::normalize(const std::string& url) {
-    try {
-        // Parse URL
-        UrlInfo info = parse(url);
-        
-        // Build normalized URL
-        std::ostringstream oss;
-        
-        // Add protocol
-        oss << info.protocol << "://";
-        
-        // Add authentication info if present
-        if (!info.username.empty()) {
-            oss << info.username;
-            
-            if (!info.password.empty()) {
-                oss << ":" << info.password;
-            }
-            
-            oss << "@";
-        }
-        
-        // Add host
-        oss << info.host;
-        
-        // Add port if not default
-        if (!(info.protocol == "http" && info.port == "80") &&
-            !(info.protocol == "https" && info.port == "443") &&
-            !(info.protocol == "ftp" && info.port == "21") &&
-            !(info.protocol == "ftps" && info.port == "990") &&
-            !info.port.empty()) {
-            oss << ":" << info.port;
-        }
-        
-        // Process path
-        std::string path = info.path;
-        
-        // If no path, use root
-        if (path.empty()) {
-            path = "/";
-        }
-        
-        // Normalize the path
-        std::vector<std::string> segments;
-        std::istringstream pathStream(path);
-        std::string segment;
-        
-        while (std::getline(pathStream, segment, '/')) {
-            if (segment.empty() || segment == ".") {
-                continue;
-            } else if (segment == "..") {
-                if (!segments.empty()) {
-                    segments.pop_back();
-                }
-            } else {
-                segments.push_back(segment);
-            }
-        }
-        
-        // Build normalized path
-        oss << "/";
-        for (size_t i = 0; i < segments.size(); ++i) {
-            if (i > 0) {
-                oss << "/";
-            }
-            oss << segments[i];
-        }
-        
-        // Add query string
-        if (!info.query.empty()) {
-            oss << info.query;
-        }
-        
-        // Add fragment
-        if (!info.fragment.empty()) {
-            oss << info.fragment;
-        }
-        
-        return oss.str();
-    } catch (const std::exception& e) {
-        Logger::error("Error normalizing URL: " + url + " - " + e.what());
+    std::string normalized;
+    if (!canonicalize(url, normalized, true)) {
         return url;
     }
+    return normalized;
 }
 
 std::string UrlParser::encode(const std::string& text) {
@@ -359,5 +351,35 @@ std::string UrlParser::combine(const std::string& baseUrl, const std::string& re
     return normalize(result.str());
 }
 
+std::string UrlParser::resolve(const std::string& baseUrl, const std::string& link) {
+    CURLU* handle = curl_url();
+    if (!handle) {
+        return "";
+    }
+
+    std::string url;
+    bool parsed = baseUrl.empty() ||
+                  curl_url_set(handle, CURLUPART_URL, baseUrl.c_str(), 0) == CURLUE_OK;
+    if (parsed && curl_url_set(handle, CURLUPART_URL, link.c_str(), 0) == CURLUE_OK) {
+        std::string scheme = getPart(handle, CURLUPART_SCHEME);
+        if (scheme == "http" || scheme == "https" || scheme == "ftp" || scheme == "ftps") {
+            curl_url_set(handle, CURLUPART_FRAGMENT, nullptr, 0);
+            url = getPart(handle, CURLUPART_URL);
+        }
+    }
+    curl_url_cleanup(handle);
+    return url;
+}
+
+std::string UrlParser::getPart(CURLU* handle, CURLUPart part, unsigned int flags) {
+    char* value = nullptr;
+    if (curl_url_get(handle, part, &value, flags) != CURLUE_OK || !value) {
+        return "";
+    }
+    std::string result(value);
+    curl_free(value);
+    return result;
+}
+
 } // namespace utils
 } // namespace dm
\ No newline at end of file
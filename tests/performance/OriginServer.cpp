@@ -0,0 +1,499 @@
+#include "OriginServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace dm {
+namespace bench {
+
+namespace {
+
+// Content repeats with a prime period, so no power-of-two block size lines up with it
+constexpr size_t PATTERN_PERIOD = 65521;
+
+// Twice the period, any offset has a whole period ahead of it
+const std::vector<char>& getPattern() {
+    static const std::vector<char> pattern = [] {
+        std::vector<char> bytes(PATTERN_PERIOD * 2);
+        uint32_t state = 0x9E3779B9u;
+        for (size_t i = 0; i < PATTERN_PERIOD; i++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            bytes[i] = static_cast<char>(state >> 24);
+        }
+        std::copy(bytes.begin(), bytes.begin() + PATTERN_PERIOD, bytes.begin() + PATTERN_PERIOD);
+        return bytes;
+    }();
+    return pattern;
+}
+
+std::string toLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+std::string trim(const std::string& value) {
+    size_t first = value.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        return "";
+    }
+    return value.substr(first, value.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// Read up to and including the delimiter, keeping what follows for the next call
+bool readUntil(int fd, std::string& buffer, const std::string& delimiter, std::string& out) {
+    char chunk[4096];
+    while (true) {
+        size_t end = buffer.find(delimiter);
+        if (end != std::string::npos) {
+            out = buffer.substr(0, end);
+            buffer.erase(0, end + delimiter.size());
+            return true;
+        }
+        if (buffer.size() > 64 * 1024) {
+            return false;
+        }
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+    }
+}
+
+void sleepMs(int ms) {
+    if (ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+} // namespace
+
+OriginServer::OriginServer(uint32_t seed)
+    : random_(seed) {
+}
+
+OriginServer::~OriginServer() {
+    stop();
+}
+
+bool OriginServer::start() {
+    if (running_) {
+        return true;
+    }
+
+    httpFd_ = listenLoopback(httpPort_);
+    ftpFd_ = listenLoopback(ftpPort_);
+    if (httpFd_ < 0 || ftpFd_ < 0) {
+        stop();
+        return false;
+    }
+
+    running_ = true;
+    httpAcceptThread_ = std::thread(&OriginServer::acceptLoop, this, httpFd_, false);
+    ftpAcceptThread_ = std::thread(&OriginServer::acceptLoop, this, ftpFd_, true);
+    return true;
+}
+
+void OriginServer::stop() {
+    running_ = false;
+
+    // Shutting the sockets down wakes the threads blocked on them
+    for (int* fd : {&httpFd_, &ftpFd_}) {
+        if (*fd >= 0) {
+            shutdown(*fd, SHUT_RDWR);
+        }
+    }
+    if (httpAcceptThread_.joinable()) {
+        httpAcceptThread_.join();
+    }
+    if (ftpAcceptThread_.joinable()) {
+        ftpAcceptThread_.join();
+    }
+    for (int* fd : {&httpFd_, &ftpFd_}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+
+    std::list<Connection> connections;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& connection : connections_) {
+            shutdown(connection.fd, SHUT_RDWR);
+        }
+        connections.splice(connections.end(), connections_);
+    }
+    for (auto& connection : connections) {
+        connection.thread.join();
+        close(connection.fd);
+    }
+}
+
+void OriginServer::setBehavior(const OriginBehavior& behavior) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    behavior_ = behavior;
+}
+
+OriginBehavior OriginServer::getBehavior() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return behavior_;
+}
+
+std::string OriginServer::getUrl(int64_t size, const std::string& name, bool ftp) const {
+    std::ostringstream url;
+    url << (ftp ? "ftp" : "http") << "://127.0.0.1:" << (ftp ? ftpPort_ : httpPort_)
+        << "/blob/" << size << "/" << name;
+    return url.str();
+}
+
+char OriginServer::contentByte(int64_t offset) {
+    return getPattern()[static_cast<size_t>(offset % static_cast<int64_t>(PATTERN_PERIOD))];
+}
+
+void OriginServer::acceptLoop(int listenFd, bool ftp) {
+    while (running_) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (!running_) {
+                break;
+            }
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if (it->done) {
+                it->thread.join();
+                close(it->fd);
+                it = connections_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        connections_.emplace_back();
+        Connection& connection = connections_.back();
+        connection.fd = fd;
+        connection.thread = std::thread([this, fd, ftp, &connection]() {
+            if (ftp) {
+                serveFtp(fd);
+            } else {
+                serveHttp(fd);
+            }
+            // The peer sees the close now, the descriptor is closed when reaped
+            shutdown(fd, SHUT_RDWR);
+            connection.done = true;
+        });
+    }
+}
+
+void OriginServer::serveHttp(int fd) {
+    std::string buffer;
+    std::string head;
+    while (running_ && readUntil(fd, buffer, "\r\n\r\n", head)) {
+        std::istringstream lines(head);
+        std::string requestLine;
+        std::getline(lines, requestLine);
+        std::istringstream request(requestLine);
+        std::string method, path, version;
+        request >> method >> path >> version;
+
+        std::string range;
+        bool keepAlive = version != "HTTP/1.0";
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = toLower(trim(line.substr(0, colon)));
+            std::string value = trim(line.substr(colon + 1));
+            if (name == "range") {
+                range = value;
+            } else if (name == "connection") {
+                keepAlive = toLower(value) != "close";
+            }
+        }
+
+        OriginBehavior behavior = getBehavior();
+        sleepMs(behavior.latencyMs);
+
+        int64_t size = 0;
+        if ((method != "GET" && method != "HEAD") || !parseBlobPath(path, size)) {
+            const char* notFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+            if (!sendAll(fd, notFound, strlen(notFound))) {
+                return;
+            }
+            continue;
+        }
+
+        // Only single ranges, which is all the engine asks for
+        int64_t first = 0;
+        int64_t last = size - 1;
+        bool partial = false;
+        if (behavior.rangeSupport && range.compare(0, 6, "bytes=") == 0 && range.find(',') == std::string::npos) {
+            std::string spec = range.substr(6);
+            size_t dash = spec.find('-');
+            if (dash != std::string::npos && dash > 0) {
+                first = std::stoll(spec.substr(0, dash));
+                if (dash + 1 < spec.size()) {
+                    last = std::min(last, static_cast<int64_t>(std::stoll(spec.substr(dash + 1))));
+                }
+                partial = true;
+            }
+        }
+
+        std::ostringstream response;
+        if (partial && (first >= size || first > last)) {
+            response << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << size
+                     << "\r\nContent-Length: 0\r\n\r\n";
+            std::string text = response.str();
+            if (!sendAll(fd, text.data(), text.size())) {
+                return;
+            }
+            continue;
+        }
+
+        int64_t length = last - first + 1;
+        response << (partial ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n");
+        response << "Content-Type: application/octet-stream\r\n";
+        response << "Content-Length: " << length << "\r\n";
+        if (partial) {
+            response << "Content-Range: bytes " << first << "-" << last << "/" << size << "\r\n";
+        }
+        if (behavior.rangeSupport) {
+            response << "Accept-Ranges: bytes\r\n";
+        }
+        response << (keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n") << "\r\n";
+        std::string text = response.str();
+        if (!sendAll(fd, text.data(), text.size())) {
+            return;
+        }
+
+        if (method == "GET" && !sendContent(fd, first, length, behavior)) {
+            return;
+        }
+        if (!keepAlive) {
+            return;
+        }
+    }
+}
+
+void OriginServer::serveFtp(int fd) {
+    auto reply = [fd](const std::string& text) {
+        std::string line = text + "\r\n";
+        return sendAll(fd, line.data(), line.size());
+    };
+
+    if (!reply("220 dm_bench origin")) {
+        return;
+    }
+
+    std::string buffer;
+    std::string line;
+    std::string directory = "/";
+    int64_t restart = 0;
+    int dataListenFd = -1;
+    auto closeDataListener = [&dataListenFd]() {
+        if (dataListenFd >= 0) {
+            close(dataListenFd);
+            dataListenFd = -1;
+        }
+    };
+
+    while (running_ && readUntil(fd, buffer, "\r\n", line)) {
+        size_t space = line.find(' ');
+        std::string command = toLower(line.substr(0, space));
+        std::string argument = space == std::string::npos ? "" : trim(line.substr(space + 1));
+        std::string path = argument.empty() || argument[0] == '/' ? argument
+                           : (directory == "/" ? "/" : directory + "/") + argument;
+        int64_t size = 0;
+        bool sent = true;
+
+        if (command == "user") {
+            sent = reply("331 Any password will do");
+        } else if (command == "pass") {
+            sent = reply("230 Logged in");
+        } else if (command == "syst") {
+            sent = reply("215 UNIX Type: L8");
+        } else if (command == "pwd") {
+            sent = reply("257 \"" + directory + "\"");
+        } else if (command == "cwd") {
+            directory = path.size() > 1 && path.back() == '/' ? path.substr(0, path.size() - 1) : path;
+            sent = reply("250 Directory changed");
+        } else if (command == "type" || command == "mode" || command == "stru" || command == "noop") {
+            sent = reply("200 OK");
+        } else if (command == "size") {
+            sent = parseBlobPath(path, size) ? reply("213 " + std::to_string(size)) : reply("550 No such file");
+        } else if (command == "mdtm") {
+            sent = reply("213 20260101000000");
+        } else if (command == "rest") {
+            if (!getBehavior().rangeSupport) {
+                sent = reply("502 REST not supported");
+            } else {
+                restart = argument.empty() ? 0 : std::stoll(argument);
+                sent = reply("350 Restarting at " + std::to_string(restart));
+            }
+        } else if (command == "epsv" || command == "pasv") {
+            closeDataListener();
+            int port = 0;
+            dataListenFd = listenLoopback(port);
+            if (dataListenFd < 0) {
+                sent = reply("425 Cannot open data connection");
+            } else if (command == "epsv") {
+                sent = reply("229 Entering Extended Passive Mode (|||" + std::to_string(port) + "|)");
+            } else {
+                sent = reply("227 Entering Passive Mode (127,0,0,1," + std::to_string(port >> 8) + "," +
+                             std::to_string(port & 0xff) + ")");
+            }
+        } else if (command == "retr") {
+            if (!parseBlobPath(path, size) || restart > size) {
+                sent = reply("550 No such file");
+            } else if (dataListenFd < 0) {
+                sent = reply("425 Use PASV first");
+            } else {
+                pollfd pending{dataListenFd, POLLIN, 0};
+                int dataFd = poll(&pending, 1, 10000) > 0 ? accept(dataListenFd, nullptr, nullptr) : -1;
+                closeDataListener();
+                if (dataFd < 0) {
+                    sent = reply("425 No data connection");
+                } else {
+                    OriginBehavior behavior = getBehavior();
+                    sleepMs(behavior.latencyMs);
+                    sent = reply("150 Opening BINARY mode data connection");
+                    bool complete = sent && sendContent(dataFd, restart, size - restart, behavior);
+                    close(dataFd);
+                    if (sent) {
+                        sent = reply(complete ? "226 Transfer complete" : "426 Transfer aborted");
+                    }
+                }
+            }
+            restart = 0;
+        } else if (command == "abor") {
+            sent = reply("226 Abort successful");
+        } else if (command == "quit") {
+            reply("221 Goodbye");
+            break;
+        } else {
+            sent = reply("502 Command not implemented");
+        }
+
+        if (!sent) {
+            break;
+        }
+    }
+    closeDataListener();
+}
+
+bool OriginServer::sendContent(int fd, int64_t offset, int64_t length, const OriginBehavior& behavior) {
+    const std::vector<char>& pattern = getPattern();
+    int64_t cutoff = chooseCutoff(length, behavior);
+
+    // A capped connection sends in blocks of a twentieth of a second
+    int64_t blockSize = static_cast<int64_t>(PATTERN_PERIOD);
+    if (behavior.bandwidthPerConnection > 0) {
+        blockSize = std::max<int64_t>(1024, std::min(blockSize, behavior.bandwidthPerConnection / 20));
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    int64_t sent = 0;
+    while (sent < cutoff) {
+        if (!running_) {
+            return false;
+        }
+        size_t start = static_cast<size_t>((offset + sent) % static_cast<int64_t>(PATTERN_PERIOD));
+        size_t size = static_cast<size_t>(std::min(blockSize, cutoff - sent));
+        if (!sendAll(fd, pattern.data() + start, size)) {
+            return false;
+        }
+        sent += static_cast<int64_t>(size);
+
+        if (behavior.bandwidthPerConnection > 0) {
+            auto due = started + std::chrono::microseconds(sent * 1000000 / behavior.bandwidthPerConnection);
+            std::this_thread::sleep_until(due);
+        }
+    }
+
+    if (cutoff < length) {
+        droppedResponses_++;
+        return false;
+    }
+    return true;
+}
+
+int64_t OriginServer::chooseCutoff(int64_t length, const OriginBehavior& behavior) {
+    if (behavior.dropRate <= 0.0 || length <= 1) {
+        return length;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::uniform_real_distribution<double>(0.0, 1.0)(random_) >= behavior.dropRate) {
+        return length;
+    }
+    return std::uniform_int_distribution<int64_t>(0, length - 1)(random_);
+}
+
+bool OriginServer::parseBlobPath(const std::string& path, int64_t& size) {
+    const std::string prefix = "/blob/";
+    if (path.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    size_t end = path.find('/', prefix.size());
+    std::string digits = path.substr(prefix.size(), end == std::string::npos ? std::string::npos : end - prefix.size());
+    if (digits.empty() || digits.size() > 15 || !std::all_of(digits.begin(), digits.end(), ::isdigit)) {
+        return false;
+    }
+    size = std::stoll(digits);
+    return true;
+}
+
+int OriginServer::listenLoopback(int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 128) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        close(fd);
+        return -1;
+    }
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+bool OriginServer::sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace bench
+} // namespace dm
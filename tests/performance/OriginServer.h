@@ -0,0 +1,199 @@
+#ifndef ORIGIN_SERVER_H
+#define ORIGIN_SERVER_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <cstdint>
+
+namespace dm {
+namespace bench {
+
+/**
+ * @brief How the origin treats every request
+ */
+struct OriginBehavior {
+    int latencyMs = 0;                      // Delay before each response
+    int64_t bandwidthPerConnection = 0;     // Bytes/second, 0 for no cap
+    bool rangeSupport = true;               // Honour Range and REST
+    double dropRate = 0.0;                  // Chance a body is cut off part way
+};
+
+/**
+ * @brief Local HTTP and FTP origin for the benchmarks
+ *
+ * Serves generated content from 127.0.0.1, so runs read no disk on the
+ * server side and depend on nothing outside the machine. A path of the
+ * form /blob/<size>/<name> is a file of that many bytes whose content is
+ * contentByte() of each offset; the name only tells files apart. Each
+ * connection gets its own thread and the behavior in force when its
+ * request arrives.
+ */
+class OriginServer {
+public:
+    /**
+     * @brief Construct a new OriginServer
+     *
+     * @param seed Seed of the connection drops
+     */
+    explicit OriginServer(uint32_t seed = 1);
+
+    /**
+     * @brief Destroy the OriginServer, stopping it
+     */
+    ~OriginServer();
+
+    /**
+     * @brief Listen on ephemeral loopback ports
+     *
+     * @return true if both listeners are up, false otherwise
+     */
+    bool start();
+
+    /**
+     * @brief Close the listeners and every connection
+     */
+    void stop();
+
+    /**
+     * @brief Change the behavior for requests from now on
+     *
+     * @param behavior The behavior
+     */
+    void setBehavior(const OriginBehavior& behavior);
+
+    /**
+     * @brief Get the URL of a generated file
+     *
+     * @param size The file size in bytes
+     * @param name The file name
+     * @param ftp True for the FTP listener
+     * @return std::string The URL
+     */
+    std::string getUrl(int64_t size, const std::string& name, bool ftp = false) const;
+
+    /**
+     * @brief Get the number of bodies cut off so far
+     *
+     * @return int64_t The count
+     */
+    int64_t getDroppedResponses() const { return droppedResponses_.load(); }
+
+    /**
+     * @brief Get the generated content at an offset
+     *
+     * @param offset The byte offset
+     * @return char The byte
+     */
+    static char contentByte(int64_t offset);
+
+private:
+    struct Connection {
+        std::thread thread;
+        int fd = -1;
+        std::atomic<bool> done{false};
+    };
+
+    /**
+     * @brief Accept connections until stopped
+     *
+     * @param listenFd The listening socket
+     * @param ftp True for FTP control connections
+     */
+    void acceptLoop(int listenFd, bool ftp);
+
+    /**
+     * @brief Answer HTTP requests on a connection until it closes
+     *
+     * @param fd The connection
+     */
+    void serveHttp(int fd);
+
+    /**
+     * @brief Run an FTP control session
+     *
+     * @param fd The control connection
+     */
+    void serveFtp(int fd);
+
+    /**
+     * @brief Send part of a generated file at the configured pace
+     *
+     * @param fd The connection
+     * @param offset The first byte
+     * @param length The byte count
+     * @param behavior The behavior of the request
+     * @return true if all of it was sent, false if cut off or closed
+     */
+    bool sendContent(int fd, int64_t offset, int64_t length, const OriginBehavior& behavior);
+
+    /**
+     * @brief Decide where a body is cut off
+     *
+     * @param length The body length
+     * @param behavior The behavior of the request
+     * @return int64_t The byte count to send, length if not cut off
+     */
+    int64_t chooseCutoff(int64_t length, const OriginBehavior& behavior);
+
+    /**
+     * @brief Get the behavior in force
+     *
+     * @return OriginBehavior The behavior
+     */
+    OriginBehavior getBehavior() const;
+
+    /**
+     * @brief Parse a generated file path
+     *
+     * @param path The path, /blob/<size>/<name>
+     * @param size The file size, set on success
+     * @return true if the path names a generated file, false otherwise
+     */
+    static bool parseBlobPath(const std::string& path, int64_t& size);
+
+    /**
+     * @brief Open a listening socket on an ephemeral loopback port
+     *
+     * @param port The port, set on success
+     * @return int The socket, -1 on failure
+     */
+    static int listenLoopback(int& port);
+
+    /**
+     * @brief Send all of a buffer
+     *
+     * @param fd The connection
+     * @param data The data
+     * @param size The byte count
+     * @return true if sent, false if the peer went away
+     */
+    static bool sendAll(int fd, const char* data, size_t size);
+
+    // Prevent copying
+    OriginServer(const OriginServer&) = delete;
+    OriginServer& operator=(const OriginServer&) = delete;
+
+    // Member variables
+    OriginBehavior behavior_;
+    std::mt19937 random_;
+    int httpFd_ = -1;
+    int ftpFd_ = -1;
+    int httpPort_ = 0;
+    int ftpPort_ = 0;
+    std::atomic<bool> running_{false};
+    std::atomic<int64_t> droppedResponses_{0};
+    std::thread httpAcceptThread_;
+    std::thread ftpAcceptThread_;
+    std::list<Connection> connections_;     // Reaped as new ones arrive
+    mutable std::mutex mutex_;
+};
+
+} // namespace bench
+} // namespace dm
+
+#endif // ORIGIN_SERVER_H
@@ -0,0 +1,636 @@
+/**
+ * @file download_benchmark.cpp
+ * @brief dm_bench, reproducible benchmarks of the download engine
+ *
+ * Runs fixed scenarios against a local origin and prints one JSON
+ * document with throughput, completion time percentiles, CPU time per
+ * GB, file read/write syscalls, context switches and peak RSS for each. The application data
+ * directory is redirected to a scratch directory, so a run neither sees
+ * nor touches the user's downloads and settings.
+ *
+ * The resident memory each download added at the peak is reported too;
+ * with --memory-budget (set by default in the embedded build) a scenario
+ * over it fails the run.
+ *
+ * Usage: dm_bench [--scenario name[,name...]] [--iterations n] [--scale f]
+ *                 [--memory-budget kb] [--output file] [--list] [--keep]
+ */
+
+#include "OriginServer.h"
+
+#include "core/DownloadManager.h"
+#include "core/BatchDownloader.h"
+#include "core/SegmentDownloader.h"
+#include "core/OutputFile.h"
+#include "utils/Logger.h"
+#include "utils/FileUtils.h"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace dm {
+namespace bench {
+
+namespace {
+
+constexpr int64_t MiB = 1024 * 1024;
+constexpr auto SCENARIO_TIMEOUT = std::chrono::minutes(10);
+
+// Resident memory the embedded build allows each download
+#ifdef DM_DOWNLOAD_MEMORY_BUDGET
+constexpr int64_t DEFAULT_MEMORY_BUDGET = int64_t(DM_DOWNLOAD_MEMORY_BUDGET) * 1024;
+#else
+constexpr int64_t DEFAULT_MEMORY_BUDGET = 0;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief What drives the downloads of a scenario
+ */
+enum class Driver {
+    MANAGER,    // One DownloadManager task per file
+    SEGMENTS,   // SegmentDownloaders sharing one output file, no task around them
+    BATCH       // A BatchDownloader job over all files
+};
+
+struct Scenario {
+    const char* name;
+    const char* description;
+    Driver driver;
+    OriginBehavior behavior;
+    int64_t fileSize;       // Before scaling
+    int fileCount;          // Files per iteration
+    bool ftp;
+};
+
+const std::vector<Scenario>& getScenarios() {
+    static const std::vector<Scenario> scenarios = {
+        {"large-file", "One large file over a fast link", Driver::MANAGER, {}, 256 * MiB, 1, false},
+        {"high-latency", "50 ms per request, 8 MiB/s per connection", Driver::MANAGER,
+         {50, 8 * MiB, true, 0.0}, 64 * MiB, 1, false},
+        {"no-ranges", "Server without range support, one stream", Driver::MANAGER,
+         {0, 0, false, 0.0}, 64 * MiB, 1, false},
+        {"flaky", "One response in ten cut off part way", Driver::MANAGER,
+         {0, 0, true, 0.1}, 64 * MiB, 1, false},
+        {"ftp", "One large file over FTP", Driver::MANAGER, {}, 64 * MiB, 1, true},
+        {"segments", "Eight SegmentDownloaders without a task", Driver::SEGMENTS, {}, 256 * MiB, 1, false},
+        {"concurrent", "Eight 32 MiB files queued at once", Driver::MANAGER, {}, 32 * MiB, 8, false},
+        {"small-files", "A batch of many 16 KiB files", Driver::BATCH, {2, 0, true, 0.0}, 16 * 1024, 500, false},
+    };
+    return scenarios;
+}
+
+/**
+ * @brief Process counters read before and after a scenario
+ */
+struct ProcessSample {
+    Clock::time_point at;
+    double cpuSeconds = 0.0;
+    int64_t readSyscalls = 0;
+    int64_t writeSyscalls = 0;
+    int64_t contextSwitches = 0;
+    int64_t peakResidentBytes = 0;
+};
+
+int64_t readStatusBytes(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t length = std::strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, length, field) == 0) {
+            return std::atoll(line.c_str() + length) * 1024;
+        }
+    }
+    return 0;
+}
+
+int64_t readPeakResident() {
+    return readStatusBytes("VmHWM:");
+}
+
+int64_t readResident() {
+    return readStatusBytes("VmRSS:");
+}
+
+ProcessSample sampleProcess() {
+    ProcessSample sample;
+    sample.at = Clock::now();
+
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        sample.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        sample.contextSwitches = usage.ru_nvcsw + usage.ru_nivcsw;
+    }
+
+    // Linux counts the read and write calls that go through the file layer:
+    // disk and pipe I/O, but not the recv and send calls of sockets
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    int64_t value = 0;
+    while (io >> key >> value) {
+        if (key == "syscr:") {
+            sample.readSyscalls = value;
+        } else if (key == "syscw:") {
+            sample.writeSyscalls = value;
+        }
+    }
+    sample.peakResidentBytes = readPeakResident();
+    return sample;
+}
+
+// Start peak RSS over from the current RSS; kernels before 4.0 ignore this
+void resetPeakResident() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[std::min(rank, values.size() - 1)];
+}
+
+// Checked after the clock stops, so it costs the scenario nothing
+bool verifyContent(const std::string& path, int64_t size) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(MiB);
+    int64_t offset = 0;
+    while (file && offset < size) {
+        file.read(buffer.data(), static_cast<std::streamsize>(std::min<int64_t>(MiB, size - offset)));
+        std::streamsize read = file.gcount();
+        for (std::streamsize i = 0; i < read; i++) {
+            if (buffer[i] != OriginServer::contentByte(offset + i)) {
+                return false;
+            }
+        }
+        offset += read;
+    }
+    file.peek();
+    return offset == size && file.eof();
+}
+
+/**
+ * @brief Completion times of the downloads of one run
+ */
+struct RunResult {
+    ProcessSample finished;     // Taken before the content is checked
+    std::vector<double> completionSeconds;
+    int failures = 0;
+    int corrupt = 0;
+    int64_t bytes = 0;
+};
+
+/**
+ * @brief Follows task status events of the download manager
+ */
+class TaskWatcher {
+public:
+    TaskWatcher() {
+        listenerId_ = core::DownloadManager::getInstance().addTaskStatusListener(
+            [this](std::shared_ptr<core::DownloadTask> task, core::DownloadStatus status) {
+                onStatus(task, status);
+            });
+    }
+
+    ~TaskWatcher() {
+        core::DownloadManager::getInstance().removeTaskStatusListener(listenerId_);
+    }
+
+    // Downloads added by the caller are timed from here, others from their first event
+    void expect(const std::string& filename) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        started_[filename] = Clock::now();
+    }
+
+    bool waitFor(size_t count, Clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_until(lock, deadline, [this, count] { return finished_.size() >= count; });
+    }
+
+    struct Finished {
+        std::string taskId;
+        std::string path;
+        double seconds;
+        bool succeeded;
+    };
+
+    std::vector<Finished> getFinished() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return finished_;
+    }
+
+private:
+    void onStatus(const std::shared_ptr<core::DownloadTask>& task, core::DownloadStatus status) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto started = started_.emplace(task->getFilename(), Clock::now()).first->second;
+        if (status == core::DownloadStatus::COMPLETED || status == core::DownloadStatus::DOWNLOAD_ERROR) {
+            double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+            finished_.push_back({task->getId(), task->getDestinationPath() + "/" + task->getFilename(), seconds,
+                                 status == core::DownloadStatus::COMPLETED});
+            changed_.notify_all();
+        }
+    }
+
+    int listenerId_ = 0;
+    std::map<std::string, Clock::time_point> started_;
+    std::vector<Finished> finished_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+RunResult runWithManager(const Scenario& scenario, OriginServer& origin, int64_t fileSize, int fileCount,
+                         const std::string& directory, int iteration, bool batch) {
+    auto& manager = core::DownloadManager::getInstance();
+    TaskWatcher watcher;
+    RunResult result;
+
+    std::vector<std::string> urls;
+    for (int i = 0; i < fileCount; i++) {
+        std::string name = std::string(scenario.name) + "-" + std::to_string(iteration) + "-" + std::to_string(i) + ".bin";
+        urls.push_back(origin.getUrl(fileSize, name, scenario.ftp));
+    }
+
+    core::BatchDownloader batchDownloader(manager);
+    if (batch) {
+        core::BatchDownloadConfig config;
+        config.sourceType = core::BatchUrlSourceType::URL_LIST;
+        config.urls = urls;
+        config.maxConcurrentFiles = 8;
+        config.destinationDirectory = directory;
+        if (!batchDownloader.startBatchJob(config)) {
+            result.failures = fileCount;
+            return result;
+        }
+    } else {
+        for (const auto& url : urls) {
+            std::string name = url.substr(url.rfind('/') + 1);
+            watcher.expect(name);
+            if (!manager.addDownload(url, directory, name, true)) {
+                result.failures++;
+            }
+        }
+    }
+
+    watcher.waitFor(urls.size() - result.failures, Clock::now() + SCENARIO_TIMEOUT);
+    result.finished = sampleProcess();
+    if (batch) {
+        batchDownloader.cancelBatchJob();
+    }
+
+    std::vector<TaskWatcher::Finished> finished = watcher.getFinished();
+    result.failures += static_cast<int>(urls.size()) - result.failures - static_cast<int>(finished.size());
+    for (const auto& entry : finished) {
+        if (entry.succeeded) {
+            result.completionSeconds.push_back(entry.seconds);
+            result.bytes += fileSize;
+        } else {
+            result.failures++;
+        }
+    }
+
+    // Checked and cleaned up after the caller has stopped the clock
+    for (const auto& entry : finished) {
+        if (entry.succeeded && !verifyContent(entry.path, fileSize)) {
+            result.corrupt++;
+        }
+        manager.removeDownload(entry.taskId, true);
+    }
+    return result;
+}
+
+RunResult runSegments(const Scenario& scenario, OriginServer& origin, int64_t fileSize,
+                      const std::string& directory, int iteration) {
+    constexpr int SEGMENTS = 8;
+    RunResult result;
+    std::string path = directory + "/" + scenario.name + "-" + std::to_string(iteration) + ".bin";
+    std::string url = origin.getUrl(fileSize, scenario.name + std::string(".bin"));
+
+    auto file = std::make_shared<core::OutputFile>();
+    if (!file->open(path)) {
+        result.failures = 1;
+        return result;
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    int remaining = SEGMENTS;
+    bool failed = false;
+
+    auto started = Clock::now();
+    std::vector<std::shared_ptr<core::SegmentDownloader>> segments;
+    int64_t segmentSize = (fileSize + SEGMENTS - 1) / SEGMENTS;
+    for (int i = 0; i < SEGMENTS; i++) {
+        int64_t first = i * segmentSize;
+        int64_t last = std::min(fileSize, first + segmentSize) - 1;
+        auto segment = std::make_shared<core::SegmentDownloader>(url, path, first, last, i);
+        segment->setOutputFile(file);
+        auto finish = [&](bool succeeded) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = failed || !succeeded;
+            remaining--;
+            changed.notify_all();
+        };
+        segment->setCompletionCallback([finish](std::shared_ptr<core::SegmentDownloader>) { finish(true); });
+        segment->setErrorCallback([finish](std::shared_ptr<core::SegmentDownloader>, const std::string&) {
+            finish(false);
+        });
+        segments.push_back(segment);
+    }
+    for (auto& segment : segments) {
+        segment->start();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!changed.wait_for(lock, SCENARIO_TIMEOUT, [&remaining] { return remaining == 0; })) {
+            failed = true;
+        }
+    }
+    result.finished = sampleProcess();
+    double seconds = std::chrono::duration<double>(result.finished.at - started).count();
+    for (auto& segment : segments) {
+        segment->cancel();
+    }
+    segments.clear();
+    file->close();
+
+    if (failed) {
+        result.failures = 1;
+    } else {
+        result.completionSeconds.push_back(seconds);
+        result.bytes = fileSize;
+        if (!verifyContent(path, fileSize)) {
+            result.corrupt = 1;
+        }
+    }
+    dm::utils::FileUtils::deleteFile(path);
+    return result;
+}
+
+// Downloads the memory of a scenario's peak is shared by: those running at
+// once, or for a batch all its files, whose tasks are kept until it ends
+int countMeasuredDownloads(const Scenario& scenario, int fileCount) {
+    if (scenario.driver == Driver::SEGMENTS) {
+        return 1;
+    }
+    if (scenario.driver == Driver::BATCH) {
+        return std::max(1, fileCount);
+    }
+    int limit = core::DownloadManager::getInstance().getMaxConcurrentDownloads();
+    return std::max(1, std::min(fileCount, limit));
+}
+
+Json::Value runScenario(const Scenario& scenario, OriginServer& origin, int iterations, double scale,
+                        const std::string& directory, int64_t memoryBudget) {
+    int64_t fileSize = std::max<int64_t>(1, static_cast<int64_t>(scenario.fileSize * scale));
+    int fileCount = scenario.driver == Driver::BATCH
+        ? std::max(1, static_cast<int>(scenario.fileCount * scale)) : scenario.fileCount;
+    origin.setBehavior(scenario.behavior);
+    int64_t droppedBefore = origin.getDroppedResponses();
+
+    std::vector<double> completions;
+    double measuredSeconds = 0.0;
+    double cpuSeconds = 0.0;
+    int64_t readSyscalls = 0;
+    int64_t writeSyscalls = 0;
+    int64_t contextSwitches = 0;
+    int64_t bytes = 0;
+    int failures = 0;
+    int corrupt = 0;
+
+    resetPeakResident();
+    int64_t baselineResident = readResident();
+    int64_t peakResident = 0;
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        ProcessSample before = sampleProcess();
+        RunResult run;
+        if (scenario.driver == Driver::SEGMENTS) {
+            run = runSegments(scenario, origin, fileSize, directory, iteration);
+        } else {
+            run = runWithManager(scenario, origin, fileSize, fileCount, directory, iteration,
+                                 scenario.driver == Driver::BATCH);
+        }
+        // Runs that could not start have no sample of their own
+        ProcessSample after = run.finished.at == Clock::time_point() ? sampleProcess() : run.finished;
+
+        double runSeconds = run.completionSeconds.empty() ? 0.0
+            : *std::max_element(run.completionSeconds.begin(), run.completionSeconds.end());
+        measuredSeconds += scenario.driver == Driver::BATCH
+            ? std::chrono::duration<double>(after.at - before.at).count() : runSeconds;
+        cpuSeconds += after.cpuSeconds - before.cpuSeconds;
+        readSyscalls += after.readSyscalls - before.readSyscalls;
+        writeSyscalls += after.writeSyscalls - before.writeSyscalls;
+        contextSwitches += after.contextSwitches - before.contextSwitches;
+        peakResident = std::max(peakResident, after.peakResidentBytes);
+        completions.insert(completions.end(), run.completionSeconds.begin(), run.completionSeconds.end());
+        bytes += run.bytes;
+        failures += run.failures;
+        corrupt += run.corrupt;
+    }
+
+    double gigabytes = bytes / 1e9;
+    Json::Value result;
+    result["name"] = scenario.name;
+    result["description"] = scenario.description;
+    result["iterations"] = iterations;
+    result["file_size_bytes"] = Json::Int64(fileSize);
+    result["files_per_iteration"] = fileCount;
+    result["bytes"] = Json::Int64(bytes);
+    result["failures"] = failures;
+    result["corrupt_files"] = corrupt;
+    result["dropped_responses"] = Json::Int64(origin.getDroppedResponses() - droppedBefore);
+    result["seconds"] = measuredSeconds;
+    result["throughput_bytes_per_second"] = measuredSeconds > 0.0 ? bytes / measuredSeconds : 0.0;
+    result["completion_seconds"]["p50"] = percentile(completions, 0.50);
+    result["completion_seconds"]["p99"] = percentile(completions, 0.99);
+    result["completion_seconds"]["max"] = percentile(completions, 1.0);
+    result["cpu_seconds"] = cpuSeconds;
+    result["cpu_seconds_per_gb"] = gigabytes > 0.0 ? cpuSeconds / gigabytes : 0.0;
+    result["syscalls"]["read"] = Json::Int64(readSyscalls);
+    result["syscalls"]["write"] = Json::Int64(writeSyscalls);
+    result["context_switches"] = Json::Int64(contextSwitches);
+    result["peak_rss_bytes"] = Json::Int64(readPeakResident());
+
+    // Sampled as the downloads finished, before the content check reads the files
+    int measuredDownloads = countMeasuredDownloads(scenario, fileCount);
+    int64_t perDownload = std::max<int64_t>(0, peakResident - baselineResident) / measuredDownloads;
+    result["measured_downloads"] = measuredDownloads;
+    result["memory_per_download_bytes"] = Json::Int64(perDownload);
+    if (memoryBudget > 0) {
+        result["memory_budget_bytes"] = Json::Int64(memoryBudget);
+        result["within_memory_budget"] = perDownload <= memoryBudget;
+    }
+    return result;
+}
+
+char scratchDirectory[] = "/tmp/dm_bench.XXXXXX";
+
+void removeScratchDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(scratchDirectory, error);
+}
+
+void printUsage() {
+    std::cerr << "Usage: dm_bench [--scenario name[,name...]] [--iterations n] [--scale f]\n"
+                 "                [--memory-budget kb] [--output file] [--list] [--keep]\n"
+                 "  --scenario       Scenarios to run, all by default\n"
+                 "  --iterations     Runs of each scenario (default 5)\n"
+                 "  --scale          Multiplier of file sizes and batch lengths (default 1)\n"
+                 "  --memory-budget  Resident KB allowed per download, 0 for no check\n"
+                 "                   (default " << DEFAULT_MEMORY_BUDGET / 1024 << ")\n"
+                 "  --output         Write the JSON report to a file instead of stdout\n"
+                 "  --list           List the scenarios\n"
+                 "  --keep           Keep the scratch directory\n";
+}
+
+} // namespace
+
+int run(int argc, char* argv[]) {
+    std::vector<std::string> selected;
+    std::string outputPath;
+    int iterations = 5;
+    double scale = 1.0;
+    int64_t memoryBudget = DEFAULT_MEMORY_BUDGET;
+    bool keep = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue) {
+            std::istringstream names(argv[++i]);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                selected.push_back(name);
+            }
+        } else if (arg == "--iterations" && hasValue) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--scale" && hasValue) {
+            scale = std::max(0.001, std::atof(argv[++i]));
+        } else if (arg == "--memory-budget" && hasValue) {
+            memoryBudget = std::max<int64_t>(0, std::atoll(argv[++i])) * 1024;
+        } else if (arg == "--output" && hasValue) {
+            outputPath = argv[++i];
+        } else if (arg == "--keep") {
+            keep = true;
+        } else if (arg == "--list") {
+            for (const auto& scenario : getScenarios()) {
+                std::cout << scenario.name << "\t" << scenario.description << "\n";
+            }
+            return 0;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    std::vector<const Scenario*> scenarios;
+    for (const auto& scenario : getScenarios()) {
+        if (selected.empty() || std::find(selected.begin(), selected.end(), scenario.name) != selected.end()) {
+            scenarios.push_back(&scenario);
+        }
+    }
+    if (scenarios.size() < std::max<size_t>(1, selected.size())) {
+        std::cerr << "Unknown scenario, see --list" << std::endl;
+        return 2;
+    }
+
+    // Settings, journal and history of the run live in a scratch home
+    if (!mkdtemp(scratchDirectory)) {
+        std::cerr << "Failed to create a scratch directory" << std::endl;
+        return 1;
+    }
+    std::string scratch = scratchDirectory;
+    std::string downloads = scratch + "/downloads";
+    setenv("HOME", scratch.c_str(), 1);
+    dm::utils::FileUtils::createDirectory(downloads);
+
+    // Registered before the singletons exist, so it runs after they have
+    // saved their state on the way out
+    if (!keep) {
+        std::atexit(removeScratchDirectory);
+    }
+
+    dm::utils::Logger::initialize(scratch + "/bench.log");
+    dm::utils::Logger::enableConsoleLogging(false);
+    dm::utils::Logger::setLogLevel(dm::utils::LogLevel::WARNING);
+
+    OriginServer origin;
+    auto& manager = core::DownloadManager::getInstance();
+    if (!origin.start() || !manager.initialize()) {
+        std::cerr << "Failed to start the origin or the download manager" << std::endl;
+        return 1;
+    }
+    manager.setDefaultDownloadDirectory(downloads);
+
+    // Engine and library setup done on first use is not billed to the first scenario
+    const Scenario warmUp{"warm-up", "", Driver::MANAGER, {}, MiB, 1, false};
+    runWithManager(warmUp, origin, MiB, 1, downloads, 0, false);
+
+    Json::Value report;
+    report["version"] = 1;
+    report["hardware_concurrency"] = std::thread::hardware_concurrency();
+    report["iterations"] = iterations;
+    report["scale"] = scale;
+    report["memory_budget_bytes"] = Json::Int64(memoryBudget);
+    report["scenarios"] = Json::Value(Json::arrayValue);
+    int failures = 0;
+    for (const Scenario* scenario : scenarios) {
+        std::cerr << "Running " << scenario->name << "..." << std::endl;
+        Json::Value result = runScenario(*scenario, origin, iterations, scale, downloads, memoryBudget);
+        failures += result["failures"].asInt() + result["corrupt_files"].asInt();
+        if (!result.get("within_memory_budget", true).asBool()) {
+            std::cerr << scenario->name << " used " << result["memory_per_download_bytes"].asInt64() / 1024
+                      << " KB per download, over the budget of " << memoryBudget / 1024 << " KB" << std::endl;
+            failures++;
+        }
+        report["scenarios"].append(result);
+    }
+
+    manager.shutdown();
+    origin.stop();
+    dm::utils::Logger::shutdown();
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    std::string text = Json::writeString(builder, report) + "\n";
+    if (outputPath.empty()) {
+        std::cout << text;
+    } else {
+        std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+        output << text;
+        if (!output) {
+            std::cerr << "Failed to write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+} // namespace bench
+} // namespace dm
+
+int main(int argc, char* argv[]) {
+    return dm::bench::run(argc, argv);
+}